@@ -0,0 +1,97 @@
+/* bench-mapping.c -- mapping plugin used by the mapping benchmarks
+ *
+ * Maps a BenchItem to a BenchSummary, whose `total` is the sum of
+ * the `data` array of the item, and a WorkloadChemistry to a
+ * WorkloadSummary, whose `total` is the sum of the `X0` array.
+ */
+#include "utils/err.h"
+
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-mapping-plugins.h"
+
+#include "bench.h"
+
+
+static DLiteInstance *mapper(const DLiteMappingPlugin *api,
+                             const DLiteInstance **instances, int n)
+{
+  const DLiteInstance *item = instances[0];
+  DLiteInstance *summary;
+  const double *data;
+  double total=0.0;
+  int i, N;
+  UNUSED(api);
+  UNUSED(n);
+
+  if ((N = dlite_instance_get_dimension_size(item, "N")) < 0) return NULL;
+  if (!(data = dlite_instance_get_property(item, "data"))) return NULL;
+  for (i=0; i<N; i++) total += data[i];
+
+  if (!(summary = dlite_instance_create_from_id(BENCH_SUMMARY_URI,
+                                                NULL, NULL))) return NULL;
+  if (dlite_instance_set_property(summary, "name",
+                                  dlite_instance_get_property(item, "name")) ||
+      dlite_instance_set_property(summary, "total", &total)) {
+    dlite_instance_decref(summary);
+    return NULL;
+  }
+  return summary;
+}
+
+static DLiteInstance *workload_mapper(const DLiteMappingPlugin *api,
+                                      const DLiteInstance **instances, int n)
+{
+  const DLiteInstance *chem = instances[0];
+  DLiteInstance *summary;
+  const double *X0;
+  double total=0.0;
+  int i, nelements;
+  UNUSED(api);
+  UNUSED(n);
+
+  if ((nelements = dlite_instance_get_dimension_size(chem, "nelements")) < 0)
+    return NULL;
+  if (!(X0 = dlite_instance_get_property(chem, "X0"))) return NULL;
+  for (i=0; i<nelements; i++) total += X0[i];
+
+  if (!(summary = dlite_instance_create_from_id(WORKLOAD_SUMMARY_URI,
+                                                NULL, NULL))) return NULL;
+  if (dlite_instance_set_property(summary, "alloy",
+                                  dlite_instance_get_property(chem, "alloy")) ||
+      dlite_instance_set_property(summary, "total", &total)) {
+    dlite_instance_decref(summary);
+    return NULL;
+  }
+  return summary;
+}
+
+
+DSL_EXPORT const DLiteMappingPlugin *get_dlite_mapping_api(void *state,
+                                                           int *iter)
+{
+  static DLiteMappingPlugin apis[2];
+  static const char *input_uris[] = { BENCH_ITEM_URI };
+  static const char *workload_input_uris[] = { WORKLOAD_CHEMISTRY_URI };
+  int i = (iter) ? *iter : 0;
+
+  dlite_globals_set(state);
+
+  apis[0].name = "bench-mapping";
+  apis[0].output_uri = BENCH_SUMMARY_URI;
+  apis[0].ninput = 1;
+  apis[0].input_uris = input_uris;
+  apis[0].mapper = mapper;
+  apis[0].cost = 20;
+
+  apis[1].name = "workload-mapping";
+  apis[1].output_uri = WORKLOAD_SUMMARY_URI;
+  apis[1].ninput = 1;
+  apis[1].input_uris = workload_input_uris;
+  apis[1].mapper = workload_mapper;
+  apis[1].cost = 20;
+
+  if (i < 0 || i >= (int)countof(apis)) return NULL;
+  if (iter && i < (int)countof(apis) - 1) (*iter)++;
+  return apis + i;
+}
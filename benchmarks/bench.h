@@ -0,0 +1,17 @@
+/* bench.h -- entities shared by the benchmarks and their mapping plugin */
+#ifndef _BENCH_H
+#define _BENCH_H
+
+/* Entity with dimension N and properties name, count, value and data[N] */
+#define BENCH_ITEM_URI     "http://onto-ns.com/meta/0.1/BenchItem"
+
+/* Entity with properties name and total, mapped from BenchItem */
+#define BENCH_SUMMARY_URI  "http://onto-ns.com/meta/0.1/BenchSummary"
+
+/* Chemistry-like entity generated by dlite-workload */
+#define WORKLOAD_CHEMISTRY_URI "http://onto-ns.com/meta/0.1/WorkloadChemistry"
+
+/* Entity with properties alloy and total, mapped from WorkloadChemistry */
+#define WORKLOAD_SUMMARY_URI   "http://onto-ns.com/meta/0.1/WorkloadSummary"
+
+#endif /* _BENCH_H */
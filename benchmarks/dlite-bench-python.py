@@ -0,0 +1,307 @@
+#!/usr/bin/env python
+"""Benchmarks for the hot paths of the Python bindings of dlite.
+
+Like dlite-bench, each benchmark is run for a list of sizes.  For each
+size the benchmark is first set up, then the number of loops per
+repetition is calibrated such that a repetition takes at least
+`min_time` seconds.  After `warmup` untimed repetitions, `repeat`
+repetitions are timed.  The results are written as JSON in the same
+format as dlite-bench, such that both can be tracked together.
+"""
+import argparse
+import fnmatch
+import json
+import os
+import statistics
+import sys
+import time
+
+import numpy as np
+
+import dlite
+from dlite.utils import instance_from_dict
+
+
+thisdir = os.path.abspath(os.path.dirname(__file__))
+dlite.python_storage_plugin_path.append(
+    os.path.join(thisdir, 'python-storage-plugins'))
+
+# Maximum number of loops per repetition
+MAX_LOOPS = 1000000
+
+# Length of the data array of instances that are not sized by the
+# benchmark
+NDATA = 16
+
+Item = instance_from_dict({
+    'uri': 'http://onto-ns.com/meta/0.1/PyBenchItem',
+    'meta': 'http://onto-ns.com/meta/0.3/EntitySchema',
+    'description': 'Item used by dlite-bench-python.',
+    'dimensions': [
+        {'name': 'N', 'description': 'Length of data.'},
+    ],
+    'properties': [
+        {'name': 'name', 'type': 'string', 'description': 'Name.'},
+        {'name': 'count', 'type': 'int32', 'description': 'Count.'},
+        {'name': 'value', 'type': 'float64', 'description': 'Value.'},
+        {'name': 'data', 'type': 'float64', 'dims': ['N'],
+         'description': 'Data.'},
+    ],
+})
+
+
+class PyItem:
+    """Plain Python class extended by the factory benchmarks."""
+    def __init__(self, name, count, value, data):
+        self.name = name
+        self.count = count
+        self.value = value
+        self.data = data
+
+
+# List of (name, unit, description, setup) tuples.  setup(n) prepares
+# the benchmark for size `n` and returns a function running it once.
+# The size is the number of items, as given by the unit, processed by
+# one call.
+benchmarks = []
+
+
+def benchmark(name, unit, descr):
+    """Decorator registering a setup function as a benchmark."""
+    def register(setup):
+        benchmarks.append((name, unit, descr, setup))
+        return setup
+    return register
+
+
+def new_item(i, ndata=NDATA):
+    """Returns a new, initialised instance of Item."""
+    inst = Item(dims=[ndata])
+    inst.name = f'item-{i}'
+    inst.count = i
+    inst.value = 0.5 * i
+    inst.data = np.arange(ndata, dtype=float)
+    return inst
+
+
+@benchmark('instance-create', 'instances', 'Create and free instances.')
+def setup_instance_create(n):
+    def run():
+        for _ in range(n):
+            Item(dims=[NDATA])
+    return run
+
+
+@benchmark('attr-get', 'instances', 'Get scalar properties as attributes.')
+def setup_attr_get(n):
+    insts = [new_item(i) for i in range(n)]
+
+    def run():
+        for inst in insts:
+            inst.count
+            inst.value
+    return run
+
+
+@benchmark('attr-set', 'instances', 'Set scalar properties as attributes.')
+def setup_attr_set(n):
+    insts = [new_item(i) for i in range(n)]
+
+    def run():
+        for i, inst in enumerate(insts):
+            inst.count = i
+            inst.value = 1.5
+    return run
+
+
+@benchmark('item-get', 'instances', 'Get scalar properties by name.')
+def setup_item_get(n):
+    insts = [new_item(i) for i in range(n)]
+
+    def run():
+        for inst in insts:
+            inst['count']
+            inst['value']
+    return run
+
+
+@benchmark('array-get', 'elements', 'Get array property as numpy array.')
+def setup_array_get(n):
+    inst = new_item(0, n)
+
+    def run():
+        inst.data
+    return run
+
+
+@benchmark('array-set', 'elements', 'Set array property from numpy array.')
+def setup_array_set(n):
+    inst = new_item(0, n)
+    arr = np.linspace(0.0, 1.0, n)
+
+    def run():
+        inst.data = arr
+    return run
+
+
+@benchmark('classfactory', 'classes', 'Extend a class with classfactory().')
+def setup_classfactory(n):
+    def run():
+        for _ in range(n):
+            dlite.classfactory(PyItem, meta=Item)
+    return run
+
+
+@benchmark('objectfactory', 'objects', 'Extend objects with objectfactory().')
+def setup_objectfactory(n):
+    cls = dlite.classfactory(PyItem, meta=Item)
+    objs = [PyItem(f'item-{i}', i, 0.5 * i, np.zeros(NDATA))
+            for i in range(n)]
+
+    def run():
+        for obj in objs:
+            dlite.objectfactory(obj, cls=cls)
+    return run
+
+
+@benchmark('plugin-save', 'instances', 'Save instances with a Python '
+           'storage plugin.')
+def setup_plugin_save(n):
+    storage = dlite.Storage('benchmem', 'plugin-save', 'mode=w')
+    insts = [new_item(i) for i in range(n)]
+
+    def run():
+        for inst in insts:
+            storage.save(inst)
+    return run
+
+
+@benchmark('plugin-load', 'instances', 'Load instances with a Python '
+           'storage plugin.')
+def setup_plugin_load(n):
+    storage = dlite.Storage('benchmem', 'plugin-load', 'mode=w')
+    uuids = []
+    for i in range(n):
+        inst = new_item(i)
+        storage.save(inst)
+        uuids.append(inst.uuid)
+
+    def run():
+        for uuid in uuids:
+            storage.load(uuid)
+    return run
+
+
+def timeit(run, loops):
+    """Returns the time of `loops` calls to `run`."""
+    t0 = time.perf_counter()
+    for _ in range(loops):
+        run()
+    return time.perf_counter() - t0
+
+
+def run_benchmark(name, unit, setup, n, args):
+    """Runs benchmark `name` with size `n` and returns the result as a
+    dict."""
+    run = setup(n)
+
+    # Calibrate the number of loops per repetition
+    loops = 1
+    t = timeit(run, 1)
+    if t < args.min_time:
+        loops = int(args.min_time / t) + 1 if t > 0 else MAX_LOOPS
+    loops = min(loops, MAX_LOOPS)
+
+    for _ in range(args.warmup):
+        timeit(run, loops)
+    times = sorted(timeit(run, loops) / loops for _ in range(args.repeat))
+    median = statistics.median(times)
+    stddev = statistics.stdev(times) if len(times) > 1 else 0.0
+    ns_per_item = 1e9 * median / n if n else 0.0
+
+    print(f'  {name:<18} {n:10d} {unit:<10} {1e6 * median:12.3f} us  '
+          f'{ns_per_item:10.1f} ns/item', file=sys.stderr)
+    return {
+        'name': name,
+        'size': n,
+        'unit': unit,
+        'loops': loops,
+        'repeat': args.repeat,
+        'min': times[0],
+        'median': median,
+        'mean': statistics.mean(times),
+        'max': times[-1],
+        'stddev': stddev,
+        'ns_per_item': round(ns_per_item, 3),
+    }
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description='Runs benchmarks for the hot paths of the Python '
+        'bindings of dlite and writes the results as JSON.  The reported '
+        'times are in seconds per call to the benchmarked operation.  A '
+        'summary is written to standard error.')
+    parser.add_argument(
+        'patterns', metavar='BENCHMARK', nargs='*',
+        help='Benchmark name or glob pattern.  Default is to run all.')
+    parser.add_argument(
+        '-l', '--list', action='store_true',
+        help='List available benchmarks and exit.')
+    parser.add_argument(
+        '-m', '--min-time', type=float, default=0.01, metavar='SEC',
+        help='Minimum time of a timed repetition.  The number of loops per '
+        'repetition is calibrated to reach it.  Default: 0.01')
+    parser.add_argument(
+        '-o', '--output', metavar='FILE',
+        help='Write JSON results to FILE instead of standard output.')
+    parser.add_argument(
+        '-r', '--repeat', type=int, default=5, metavar='N',
+        help='Number of timed repetitions.  Default: 5')
+    parser.add_argument(
+        '-s', '--sizes', default='10,1000', metavar='LIST',
+        help='Comma-separated list of sizes.  Default: 10,1000')
+    parser.add_argument(
+        '-w', '--warmup', type=int, default=1, metavar='N',
+        help='Number of untimed repetitions.  Default: 1')
+    args = parser.parse_args(argv)
+
+    if args.list:
+        for name, unit, descr, _ in benchmarks:
+            print(f'{name:<18} {unit:<10} {descr}')
+        return 0
+    if args.repeat < 1:
+        parser.error('--repeat must be positive')
+    try:
+        sizes = [int(s) for s in args.sizes.split(',')]
+    except ValueError:
+        parser.error(f'invalid sizes: {args.sizes}')
+
+    selected = [b for b in benchmarks if not args.patterns or
+                any(fnmatch.fnmatchcase(b[0], p) for p in args.patterns)]
+    if not selected:
+        parser.error('no benchmarks matching: ' + ' '.join(args.patterns))
+
+    results = [run_benchmark(name, unit, setup, n, args)
+               for name, unit, _, setup in selected for n in sizes]
+    doc = {
+        'dlite_version': dlite.get_version(),
+        'python_version': '.'.join(str(v) for v in sys.version_info[:3]),
+        'numpy_version': np.__version__,
+        'repeat': args.repeat,
+        'warmup': args.warmup,
+        'min_time': args.min_time,
+        'results': results,
+    }
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(doc, f, indent=2)
+            f.write('\n')
+    else:
+        json.dump(doc, sys.stdout, indent=2)
+        sys.stdout.write('\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
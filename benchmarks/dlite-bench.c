@@ -0,0 +1,685 @@
+/* dlite-bench.c -- benchmarks for the hot paths of dlite
+ *
+ * Each benchmark is run for a list of sizes.  For each size the
+ * benchmark is first set up, then the number of loops per repetition
+ * is calibrated such that a repetition takes at least `min_time`
+ * seconds.  After `warmup` untimed repetitions, `repeat` repetitions
+ * are timed.  The results are written as JSON.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "config.h"
+
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-json.h"
+#include "dlite-collection.h"
+#include "dlite-mapping.h"
+#include "dlite-mapping-plugins.h"
+#include "dlite-type-cast.h"
+#include "triplestore.h"
+#include "utils/compat/getopt.h"
+#include "utils/globmatch.h"
+#include "utils/err.h"
+
+#include "bench.h"
+
+/* Maximum number of loops per repetition */
+#define MAX_LOOPS 1000000
+
+/* Length of the data array of instances that are not sized by the
+   benchmark */
+#define NDATA 16
+
+/* Files written by the storage benchmarks */
+#define HDF5_FILE "dlite-bench.h5"
+#define COLL_FILE "dlite-bench-collection.json"
+#define COLL_ID   "dlite-bench-collection"
+
+
+/* A benchmark.  The size passed to its functions is the number of
+   items, as given by `unit`, processed by one call to run(). */
+typedef struct {
+  const char *name;      /* Name of benchmark */
+  const char *unit;      /* What the size counts */
+  const char *descr;     /* Description */
+  int (*setup)(size_t n);  /* Prepares state, returns non-zero on error */
+  int (*run)(size_t n);    /* Runs once, returns non-zero on error */
+} Benchmark;
+
+/* State of the current benchmark.  Released by teardown(). */
+typedef struct {
+  DLiteInstance *inst;
+  DLiteInstance **insts;
+  size_t ninsts;
+  char *buf;
+  size_t bufsize;
+  char uuid[DLITE_UUID_LENGTH+1];
+  TripleStore *ts;
+  char **keys;
+  size_t nkeys;
+  DLiteMapping *mapping;
+  void *src;
+  void *dest;
+  DLiteTypeCastKernel kernel;
+  const char *file;
+} State;
+
+/* Globals */
+DLiteMeta *item_meta = NULL;
+DLiteMeta *summary_meta = NULL;
+State state;
+
+
+/* Returns wall clock time in seconds. */
+static double walltime(void)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Creates the metadata used by the benchmarks. */
+static int create_meta(void)
+{
+  char *dims[] = {"N"};
+  DLiteDimension item_dims[] = {
+    {"N", "Length of data."}
+  };
+  DLiteProperty item_props[] = {
+    {"name",  dliteStringPtr, sizeof(char *), 0, NULL, NULL, NULL, "Name."},
+    {"count", dliteInt,       sizeof(int32_t), 0, NULL, NULL, NULL, "Count."},
+    {"value", dliteFloat,     sizeof(double), 0, NULL, NULL, NULL, "Value."},
+    {"data",  dliteFloat,     sizeof(double), 1, dims, NULL, NULL, "Data."}
+  };
+  DLiteProperty summary_props[] = {
+    {"name",  dliteStringPtr, sizeof(char *), 0, NULL, NULL, NULL, "Name."},
+    {"total", dliteFloat,     sizeof(double), 0, NULL, NULL, NULL,
+     "Sum of data."}
+  };
+  if (!(item_meta = dlite_meta_create(BENCH_ITEM_URI, NULL,
+                                      "Item used by dlite-bench.",
+                                      countof(item_dims), item_dims,
+                                      countof(item_props), item_props)))
+    return 1;
+  if (!(summary_meta = dlite_meta_create(BENCH_SUMMARY_URI, NULL,
+                                         "Summary of a BenchItem.",
+                                         0, NULL,
+                                         countof(summary_props),
+                                         summary_props)))
+    return 1;
+  return 0;
+}
+
+/* Returns a new BenchItem with `ndata` data elements. */
+static DLiteInstance *create_item(size_t ndata, size_t k)
+{
+  DLiteInstance *inst;
+  char buf[32], *name=buf;
+  int32_t count = (int32_t)k;
+  double value = 0.5 * k, *data;
+  size_t i;
+  if (!(inst = dlite_instance_create(item_meta, &ndata, NULL))) return NULL;
+  snprintf(buf, sizeof(buf), "item-%lu", (unsigned long)k);
+  dlite_instance_set_property(inst, "name", &name);
+  dlite_instance_set_property(inst, "count", &count);
+  dlite_instance_set_property(inst, "value", &value);
+  data = dlite_instance_get_property(inst, "data");
+  for (i=0; i<ndata; i++) data[i] = (double)i;
+  return inst;
+}
+
+/* Creates `n` instances in state.insts. */
+static int create_items(size_t n, size_t ndata)
+{
+  if (!(state.insts = calloc(n ? n : 1, sizeof(DLiteInstance *))))
+    return err(1, "allocation failure");
+  for (state.ninsts=0; state.ninsts < n; state.ninsts++)
+    if (!(state.insts[state.ninsts] = create_item(ndata, state.ninsts)))
+      return 1;
+  return 0;
+}
+
+/* Releases the state of the current benchmark. */
+static void teardown(void)
+{
+  size_t i;
+  if (state.inst) dlite_instance_decref(state.inst);
+  for (i=0; i < state.ninsts; i++)
+    if (state.insts[i]) dlite_instance_decref(state.insts[i]);
+  free(state.insts);
+  free(state.buf);
+  if (state.ts) triplestore_free(state.ts);
+  for (i=0; i < state.nkeys; i++) free(state.keys[i]);
+  free(state.keys);
+  if (state.mapping) dlite_mapping_free(state.mapping);
+  free(state.src);
+  free(state.dest);
+  if (state.file) remove(state.file);
+  memset(&state, 0, sizeof(state));
+}
+
+
+/***************************************************************
+ * Benchmarks
+ ***************************************************************/
+
+/* instance-create */
+static int run_instance_create(size_t n)
+{
+  DLiteInstance *inst;
+  size_t k, ndata=NDATA;
+  for (k=0; k<n; k++) {
+    if (!(inst = dlite_instance_create(item_meta, &ndata, NULL))) return 1;
+    dlite_instance_decref(inst);
+  }
+  return 0;
+}
+
+/* property-get / property-set */
+static int setup_property(size_t n)
+{
+  UNUSED(n);
+  return !(state.inst = create_item(NDATA, 0));
+}
+
+static int run_property_get(size_t n)
+{
+  const char *names[] = {"name", "count", "value", "data"};
+  size_t k;
+  for (k=0; k<n; k++)
+    if (!dlite_instance_get_property(state.inst, names[k % countof(names)]))
+      return 1;
+  return 0;
+}
+
+static int run_property_set(size_t n)
+{
+  int32_t count;
+  double value;
+  size_t k;
+  for (k=0; k<n; k++) {
+    if (k % 2) {
+      value = (double)k;
+      if (dlite_instance_set_property(state.inst, "value", &value)) return 1;
+    } else {
+      count = (int32_t)k;
+      if (dlite_instance_set_property(state.inst, "count", &count)) return 1;
+    }
+  }
+  return 0;
+}
+
+/* json-sprint */
+static int setup_json_sprint(size_t n)
+{
+  int m;
+  if (!(state.inst = create_item(n, 0))) return 1;
+  if ((m = dlite_json_sprint(NULL, 0, state.inst, 0, 0)) < 0) return 1;
+  state.bufsize = m + 1;
+  if (!(state.buf = malloc(state.bufsize)))
+    return err(1, "allocation failure");
+  return 0;
+}
+
+static int run_json_sprint(size_t n)
+{
+  UNUSED(n);
+  return dlite_json_sprint(state.buf, state.bufsize, state.inst, 0, 0) < 0;
+}
+
+/* json-sscan */
+static int setup_json_sscan(size_t n)
+{
+  DLiteInstance *inst;
+  if (!(inst = create_item(n, 0))) return 1;
+  state.buf = dlite_json_aprint(inst, 0, 0);
+  dlite_instance_decref(inst);
+  return !state.buf;
+}
+
+static int run_json_sscan(size_t n)
+{
+  DLiteInstance *inst;
+  UNUSED(n);
+  if (!(inst = dlite_json_sscan(state.buf, NULL, NULL))) return 1;
+  dlite_instance_decref(inst);
+  return 0;
+}
+
+/* hdf5-save / hdf5-load */
+static int save_item(DLiteInstance *inst)
+{
+  DLiteStorage *s;
+  int stat;
+  if (!(s = dlite_storage_open("hdf5", HDF5_FILE, "mode=w"))) return 1;
+  state.file = HDF5_FILE;
+  stat = dlite_instance_save(s, inst);
+  return dlite_storage_close(s) || stat;
+}
+
+static int setup_hdf5_save(size_t n)
+{
+  return !(state.inst = create_item(n, 0));
+}
+
+static int run_hdf5_save(size_t n)
+{
+  UNUSED(n);
+  return save_item(state.inst);
+}
+
+static int setup_hdf5_load(size_t n)
+{
+  DLiteInstance *inst;
+  int stat;
+  if (!(inst = create_item(n, 0))) return 1;
+  memcpy(state.uuid, inst->uuid, sizeof(state.uuid));
+  stat = save_item(inst);
+  dlite_instance_decref(inst);
+  return stat;
+}
+
+static int run_hdf5_load(size_t n)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  UNUSED(n);
+  if (!(s = dlite_storage_open("hdf5", HDF5_FILE, "mode=r"))) return 1;
+  if ((inst = dlite_instance_load(s, state.uuid)))
+    dlite_instance_decref(inst);
+  return dlite_storage_close(s) || !inst;
+}
+
+/* triplestore-find */
+static int setup_triplestore_find(size_t n)
+{
+  char o[32];
+  if (!(state.ts = triplestore_create())) return 1;
+  if (!(state.keys = calloc(n ? n : 1, sizeof(char *))))
+    return err(1, "allocation failure");
+  for (state.nkeys=0; state.nkeys < n; state.nkeys++) {
+    size_t k = state.nkeys;
+    if (!(state.keys[k] = malloc(32))) return err(1, "allocation failure");
+    snprintf(state.keys[k], 32, ":s%lu", (unsigned long)k);
+    snprintf(o, sizeof(o), "o%lu", (unsigned long)k);
+    if (triplestore_add(state.ts, state.keys[k], ":p", o)) return 1;
+  }
+  return 0;
+}
+
+static int run_triplestore_find(size_t n)
+{
+  TripleState ts;
+  const Triple *t;
+  size_t k;
+  for (k=0; k<n; k++) {
+    triplestore_init_state(state.ts, &ts);
+    t = triplestore_find(&ts, state.keys[(k * 7919) % n], NULL, NULL);
+    triplestore_deinit_state(&ts);
+    if (!t) return errx(1, "no match for %s", state.keys[(k * 7919) % n]);
+  }
+  return 0;
+}
+
+/* collection-load */
+
+/* Removes the `n` members from `coll` before releasing it.  The
+   members must be removed explicitly, since dlite_collection_decref()
+   doesn't release them, and loading the collection again would then
+   only return new references to them. */
+static void release_collection(DLiteCollection *coll, size_t n)
+{
+  char label[32];
+  size_t k;
+  for (k=0; k<n; k++) {
+    snprintf(label, sizeof(label), "item%lu", (unsigned long)k);
+    dlite_collection_remove(coll, label);
+  }
+  dlite_collection_decref(coll);
+}
+
+static int setup_collection_load(size_t n)
+{
+  DLiteCollection *coll;
+  char label[32];
+  size_t k;
+  int stat=1;
+  if (!(coll = dlite_collection_create(COLL_ID))) return 1;
+  for (k=0; k<n; k++) {
+    DLiteInstance *inst = create_item(NDATA, k);
+    if (!inst) goto fail;
+    snprintf(label, sizeof(label), "item%lu", (unsigned long)k);
+    stat = dlite_collection_add(coll, label, inst);
+    dlite_instance_decref(inst);
+    if (stat) goto fail;
+  }
+  state.file = COLL_FILE;
+  stat = dlite_collection_save_url(coll, "json://" COLL_FILE "?mode=w");
+ fail:
+  release_collection(coll, n);
+  return stat;
+}
+
+static int run_collection_load(size_t n)
+{
+  DLiteStorage *s;
+  DLiteCollection *coll;
+  if (!(s = dlite_storage_open("json", COLL_FILE, "mode=r"))) return 1;
+  if ((coll = dlite_collection_load(s, COLL_ID, 0)))
+    release_collection(coll, n);
+  return dlite_storage_close(s) || !coll;
+}
+
+/* mapping */
+static int setup_mapping(size_t n)
+{
+  const char *input_uris[] = {BENCH_ITEM_URI};
+  if (create_items(n, NDATA)) return 1;
+  if (!(state.mapping = dlite_mapping_create(BENCH_SUMMARY_URI,
+                                             input_uris, 1))) return 1;
+  if (!(state.dest = calloc(n ? n : 1, sizeof(DLiteInstance *))))
+    return err(1, "allocation failure");
+  return 0;
+}
+
+static int run_mapping(size_t n)
+{
+  DLiteInstance **out = state.dest;
+  size_t k;
+  if (dlite_mapping_map_many(state.mapping,
+                             (const DLiteInstance **)state.insts, 1, n, out))
+    return 1;
+  for (k=0; k<n; k++) dlite_instance_decref(out[k]);
+  return 0;
+}
+
+/* cast-elements / cast-kernel */
+static int setup_cast(size_t n)
+{
+  int32_t *src;
+  size_t i;
+  if (!(state.src = malloc((n ? n : 1) * sizeof(int32_t))) ||
+      !(state.dest = malloc((n ? n : 1) * sizeof(double))))
+    return err(1, "allocation failure");
+  src = state.src;
+  for (i=0; i<n; i++) src[i] = (int32_t)i - (int32_t)(n / 2);
+  if (!(state.kernel = dlite_type_get_cast_kernel(dliteFloat,
+                                                  sizeof(double),
+                                                  dliteInt,
+                                                  sizeof(int32_t))))
+    return errx(1, "no cast kernel for int32 -> float64");
+  return 0;
+}
+
+static int run_cast_elements(size_t n)
+{
+  const int32_t *src = state.src;
+  double *dest = state.dest;
+  size_t i;
+  for (i=0; i<n; i++)
+    if (dlite_type_copy_cast(dest + i, dliteFloat, sizeof(double),
+                             src + i, dliteInt, sizeof(int32_t)))
+      return 1;
+  return 0;
+}
+
+static int run_cast_kernel(size_t n)
+{
+  return state.kernel(state.dest, state.src, n);
+}
+
+
+Benchmark benchmarks[] = {
+  {"instance-create",  "instances", "Create and free instances.",
+   NULL, run_instance_create},
+  {"property-get",     "calls",     "Get properties by name.",
+   setup_property, run_property_get},
+  {"property-set",     "calls",     "Set properties by name.",
+   setup_property, run_property_set},
+  {"json-sprint",      "elements",  "Serialise instance to JSON string.",
+   setup_json_sprint, run_json_sprint},
+  {"json-sscan",       "elements",  "Parse instance from JSON string.",
+   setup_json_sscan, run_json_sscan},
+  {"hdf5-save",        "elements",  "Save instance to HDF5 file.",
+   setup_hdf5_save, run_hdf5_save},
+  {"hdf5-load",        "elements",  "Load instance from HDF5 file.",
+   setup_hdf5_load, run_hdf5_load},
+  {"triplestore-find", "lookups",   "Find triples by subject.",
+   setup_triplestore_find, run_triplestore_find},
+  {"collection-load",  "instances", "Load collection from JSON file.",
+   setup_collection_load, run_collection_load},
+  {"mapping",          "instances", "Map instances with a mapping plugin.",
+   setup_mapping, run_mapping},
+  {"cast-elements",    "elements",  "Cast int32 to float64 per element.",
+   setup_cast, run_cast_elements},
+  {"cast-kernel",      "elements",  "Cast int32 to float64 with a kernel.",
+   setup_cast, run_cast_kernel},
+};
+
+
+/***************************************************************
+ * Driver
+ ***************************************************************/
+
+/* Timing parameters */
+int repeat = 5;
+int warmup = 1;
+double min_time = 0.01;
+
+
+/* Returns the time of `loops` calls to the run() function of `b` or a
+   negative number on error. */
+static double timeit(const Benchmark *b, size_t n, long loops)
+{
+  double t0 = walltime();
+  long j;
+  for (j=0; j<loops; j++)
+    if (b->run(n)) return -1.0;
+  return walltime() - t0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Runs benchmark `b` with size `n` and writes the result as a JSON
+   object to `fp`.  `sep` is written before the object.  Returns
+   non-zero on error. */
+static int run_benchmark(const Benchmark *b, size_t n, FILE *fp,
+                         const char *sep)
+{
+  double t, *times=NULL, median, mean=0.0, var=0.0;
+  long loops=1;
+  int r, retval=1;
+
+  if (!(times = calloc(repeat, sizeof(double))))
+    FAIL("allocation failure");
+  if (b->setup && b->setup(n))
+    FAIL2("cannot set up benchmark %s with size %lu",
+          b->name, (unsigned long)n);
+
+  /* Calibrate the number of loops per repetition */
+  if ((t = timeit(b, n, 1)) < 0) goto fail;
+  if (t < min_time)
+    loops = (t > 0) ? (long)(min_time / t) + 1 : MAX_LOOPS;
+  if (loops > MAX_LOOPS) loops = MAX_LOOPS;
+
+  for (r=0; r<warmup; r++)
+    if (timeit(b, n, loops) < 0) goto fail;
+  for (r=0; r<repeat; r++) {
+    if ((t = timeit(b, n, loops)) < 0) goto fail;
+    times[r] = t / loops;
+    mean += times[r];
+  }
+  mean /= repeat;
+  for (r=0; r<repeat; r++) var += (times[r] - mean) * (times[r] - mean);
+  if (repeat > 1) var /= repeat - 1;
+  qsort(times, repeat, sizeof(double), cmp_double);
+  median = (repeat % 2) ? times[repeat/2] :
+    0.5 * (times[repeat/2 - 1] + times[repeat/2]);
+
+  fprintf(fp, "%s    {\n", sep);
+  fprintf(fp, "      \"name\": \"%s\",\n", b->name);
+  fprintf(fp, "      \"size\": %lu,\n", (unsigned long)n);
+  fprintf(fp, "      \"unit\": \"%s\",\n", b->unit);
+  fprintf(fp, "      \"loops\": %ld,\n", loops);
+  fprintf(fp, "      \"repeat\": %d,\n", repeat);
+  fprintf(fp, "      \"min\": %.6e,\n", times[0]);
+  fprintf(fp, "      \"median\": %.6e,\n", median);
+  fprintf(fp, "      \"mean\": %.6e,\n", mean);
+  fprintf(fp, "      \"max\": %.6e,\n", times[repeat-1]);
+  fprintf(fp, "      \"stddev\": %.6e,\n", sqrt(var));
+  fprintf(fp, "      \"ns_per_item\": %.3f\n", (n) ? 1e9 * median / n : 0.0);
+  fprintf(fp, "    }");
+
+  fprintf(stderr, "  %-18s %10lu %-10s %12.3f us  %10.1f ns/item\n",
+          b->name, (unsigned long)n, b->unit, 1e6 * median,
+          (n) ? 1e9 * median / n : 0.0);
+  retval = 0;
+ fail:
+  teardown();
+  free(times);
+  return retval;
+}
+
+
+/* Parses comma-separated list of sizes.  Returns number of sizes or -1
+   on error. */
+static int parse_sizes(const char *s, size_t *sizes, int maxsizes)
+{
+  char *endptr;
+  int n=0;
+  while (*s) {
+    if (n >= maxsizes) return errx(-1, "too many sizes: %s", s);
+    sizes[n++] = strtoul(s, &endptr, 10);
+    if (endptr == s || (*endptr && *endptr != ','))
+      return errx(-1, "invalid size: %s", s);
+    s = (*endptr) ? endptr + 1 : endptr;
+  }
+  return n;
+}
+
+
+void help()
+{
+  char **p, *msg[] = {
+    "Usage: dlite-bench [OPTIONS] [BENCHMARK...]",
+    "Runs benchmarks for the hot paths of dlite and writes the results",
+    "as JSON.  BENCHMARK may be a glob pattern.  Default is to run all.",
+    "  -b, --build         Use plugins and paths in the build directory.",
+    "  -h, --help          Prints this help and exit.",
+    "  -l, --list          List available benchmarks and exit.",
+    "  -m, --min-time SEC  Minimum time of a timed repetition.  The number",
+    "                      of loops per repetition is calibrated to reach",
+    "                      it.  Default: 0.01",
+    "  -o, --output FILE   Write JSON results to FILE instead of standard",
+    "                      output.",
+    "  -r, --repeat N      Number of timed repetitions.  Default: 5",
+    "  -s, --sizes LIST    Comma-separated list of sizes.  Default: 10,1000",
+    "  -V, --version       Print dlite version number and exit.",
+    "  -w, --warmup N      Number of untimed repetitions.  Default: 1",
+    "",
+    "For each benchmark and size, the reported times are in seconds per",
+    "call to the benchmarked operation.  A summary is written to standard",
+    "error.",
+    "",
+    NULL
+  };
+  for (p=msg; *p; p++) printf("%s\n", *p);
+}
+
+
+int main(int argc, char *argv[])
+{
+  size_t sizes[32] = {10, 1000};
+  int nsizes=2, i, j, k, retval=0, nselect=0;
+  const char *output=NULL, **select=NULL, *sep="";
+  FILE *fp=stdout;
+
+  err_set_prefix("dlite-bench");
+
+  /* Parse options and arguments */
+  while (1) {
+    int longindex = 0;
+    struct option longopts[] = {
+      {"build",         0, NULL, 'b'},
+      {"help",          0, NULL, 'h'},
+      {"list",          0, NULL, 'l'},
+      {"min-time",      1, NULL, 'm'},
+      {"output",        1, NULL, 'o'},
+      {"repeat",        1, NULL, 'r'},
+      {"sizes",         1, NULL, 's'},
+      {"version",       0, NULL, 'V'},
+      {"warmup",        1, NULL, 'w'},
+      {NULL, 0, NULL, 0}
+    };
+    int c = getopt_long(argc, argv, "bhlm:o:r:s:Vw:", longopts, &longindex);
+    if (c == -1) break;
+    switch (c) {
+    case 'b':  dlite_set_use_build_root(1); break;
+    case 'h':  help(); exit(0);
+    case 'l':
+      for (i=0; i < (int)countof(benchmarks); i++)
+        printf("%-18s %s\n", benchmarks[i].name, benchmarks[i].descr);
+      exit(0);
+    case 'm':  min_time = atof(optarg); break;
+    case 'o':  output = optarg; break;
+    case 'r':  repeat = atoi(optarg); break;
+    case 's':
+      if ((nsizes = parse_sizes(optarg, sizes, countof(sizes))) < 0) exit(1);
+      break;
+    case 'V':  printf("%s\n", dlite_VERSION); exit(0);
+    case 'w':  warmup = atoi(optarg); break;
+    case '?':  exit(1);
+    default:   abort();
+    }
+  }
+  if (repeat < 1) return errx(1, "--repeat must be positive");
+  if (optind < argc) {
+    select = (const char **)argv + optind;
+    nselect = argc - optind;
+  }
+
+  dlite_mapping_plugin_path_insert(0, STRINGIFY(BENCH_MAPPING_DIR));
+  if (create_meta()) return 1;
+  if (output && !(fp = fopen(output, "w")))
+    return err(1, "cannot open output file: %s", output);
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"dlite_version\": \"%s\",\n", dlite_VERSION);
+  fprintf(fp, "  \"repeat\": %d,\n", repeat);
+  fprintf(fp, "  \"warmup\": %d,\n", warmup);
+  fprintf(fp, "  \"min_time\": %g,\n", min_time);
+  fprintf(fp, "  \"results\": [\n");
+  for (i=0; i < (int)countof(benchmarks); i++) {
+    const Benchmark *b = benchmarks + i;
+    if (nselect) {
+      for (k=0; k<nselect; k++)
+        if (globmatch(select[k], b->name) == 0) break;
+      if (k == nselect) continue;
+    }
+    for (j=0; j<nsizes; j++) {
+      if (run_benchmark(b, sizes[j], fp, sep))
+        retval = 1;
+      else
+        sep = ",\n";
+    }
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  if (output) fclose(fp);
+
+  dlite_meta_decref(summary_meta);
+  dlite_meta_decref(item_meta);
+  return retval;
+}
@@ -0,0 +1,598 @@
+/* dlite-workload.c -- end-to-end workload benchmarks
+ *
+ * Each workload mimics one of the examples, from reading input files
+ * to saving the result, on generated data of configurable size.  The
+ * input files are generated before the workload is run.  Each
+ * repetition of a workload is divided into phases that are timed
+ * separately:
+ *
+ *   - metadata: loading or inferring the metadata
+ *   - parse:    loading the instances from the input files
+ *   - map:      mapping the loaded instances with a mapping plugin
+ *   - save:     saving the instances to HDF5
+ *
+ * The first (cold) run of each workload is reported separately, since
+ * e.g. loaded metadata is kept in the instance store for the rest of
+ * the process.  In addition, the startup time for loading the storage
+ * and mapping plugins is timed once.  The results are written as JSON.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-mapping.h"
+#include "dlite-mapping-plugins.h"
+#include "dlite-storage-plugins.h"
+#include "utils/compat/getopt.h"
+#include "utils/globmatch.h"
+#include "utils/err.h"
+
+#include "bench.h"
+
+/* Number of phases and elements of the chemistry workload */
+#define NPHASES 3
+#define NBASE   6
+
+/* Maximum number of rows in the CSV sample used for inferring metadata */
+#define NSAMPLE 100
+
+/* Files written by the workloads */
+#define CHEM_ENTITY_FILE "workload-chemistry-entity.json"
+#define CHEM_DATA_FILE   "workload-chemistry.json"
+#define CHEM_HDF5_FILE   "workload-chemistry.h5"
+#define CSV_FILE         "workload.csv"
+#define CSV_SAMPLE_FILE  "workload-sample.csv"
+#define CSV_HDF5_FILE    "workload-csv.h5"
+
+/* Uri of the metadata inferred from the CSV file */
+#define WORKLOAD_CSV_URI "http://onto-ns.com/meta/0.1/WorkloadTable"
+
+
+/* Timed phases of a workload */
+typedef enum {
+  phaseMetadata,
+  phaseParse,
+  phaseMap,
+  phaseSave,
+  phaseTotal,
+  nphases
+} Phase;
+
+static const char *phase_names[] = {
+  "metadata", "parse", "map", "save", "total"
+};
+
+/* A workload.  run() sets the time in seconds of each phase in
+   `times`, or a negative time for phases that are not applicable. */
+typedef struct {
+  const char *name;         /* Name of workload */
+  const char *descr;        /* Description */
+  const char *example;      /* Example that the workload is derived from */
+  int (*generate)(void);    /* Writes input files, returns non-zero on error */
+  int (*run)(double *times);  /* Runs once, returns non-zero on error */
+  const char **files;       /* NULL-terminated list of files to remove */
+} Workload;
+
+/* Globals */
+size_t ninstances = 100;
+int nproperties = 8;
+size_t array_size = 10;
+int repeat = 5;
+int warmup = 1;
+DLiteMeta *summary_meta = NULL;
+
+
+/* Returns wall clock time in seconds. */
+static double walltime(void)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Writes a JSON array of `n` numbers to `fp`. */
+static void write_numbers(FILE *fp, size_t n, double offset, double scale)
+{
+  size_t i;
+  fprintf(fp, "[");
+  for (i=0; i<n; i++)
+    fprintf(fp, "%s%.6g", (i) ? ", " : "", offset + scale * i);
+  fprintf(fp, "]");
+}
+
+
+/***************************************************************
+ * Workloads
+ ***************************************************************/
+
+/* chemistry
+ *
+ * Like examples ex1-ex4: an entity like Chemistry with the
+ * dimensions `nelements` (the array size) and `nphases` and
+ * properties `alloy`, `elements`, `phases`, `X0`, `Xp` and `volfrac`.
+ * Additional properties `p1`, `p2`... of shape [nelements] are added
+ * to reach the requested number of properties. */
+static int generate_chemistry(void)
+{
+  FILE *fp;
+  char uuid[DLITE_UUID_LENGTH+1], id[32];
+  size_t i, k;
+  int j;
+
+  if (!(fp = fopen(CHEM_ENTITY_FILE, "w")))
+    return err(1, "cannot write %s", CHEM_ENTITY_FILE);
+  fprintf(fp,
+    "{\n"
+    "  \"uri\": \"%s\",\n"
+    "  \"meta\": \"http://onto-ns.com/meta/0.3/EntitySchema\",\n"
+    "  \"description\": \"Alloy and particle compositions.\",\n"
+    "  \"dimensions\": [\n"
+    "    {\"name\": \"nelements\", \"description\": \"Number of elements.\"},\n"
+    "    {\"name\": \"nphases\", \"description\": \"Number of phases.\"}\n"
+    "  ],\n"
+    "  \"properties\": [\n"
+    "    {\"name\": \"alloy\", \"type\": \"string\",\n"
+    "     \"description\": \"Alloying system and temper.\"},\n"
+    "    {\"name\": \"elements\", \"type\": \"string\","
+    " \"dims\": [\"nelements\"],\n"
+    "     \"description\": \"Chemical symbol of each element.\"},\n"
+    "    {\"name\": \"phases\", \"type\": \"string\","
+    " \"dims\": [\"nphases\"],\n"
+    "     \"description\": \"Name of each phase.\"},\n"
+    "    {\"name\": \"X0\", \"type\": \"float64\","
+    " \"dims\": [\"nelements\"],\n"
+    "     \"description\": \"Nominal composition.\"},\n"
+    "    {\"name\": \"Xp\", \"type\": \"float64\","
+    " \"dims\": [\"nphases\", \"nelements\"],\n"
+    "     \"description\": \"Average composition of each phase.\"},\n"
+    "    {\"name\": \"volfrac\", \"type\": \"float64\","
+    " \"dims\": [\"nphases\"],\n"
+    "     \"description\": \"Volume fraction of each phase.\"}",
+    WORKLOAD_CHEMISTRY_URI);
+  for (j=NBASE; j<nproperties; j++)
+    fprintf(fp, ",\n"
+            "    {\"name\": \"p%d\", \"type\": \"float64\","
+            " \"dims\": [\"nelements\"],\n"
+            "     \"description\": \"Additional property.\"}", j - NBASE + 1);
+  fprintf(fp, "\n  ]\n}\n");
+  fclose(fp);
+
+  if (!(fp = fopen(CHEM_DATA_FILE, "w")))
+    return err(1, "cannot write %s", CHEM_DATA_FILE);
+  fprintf(fp, "{");
+  for (k=0; k<ninstances; k++) {
+    snprintf(id, sizeof(id), "workload-%lu", (unsigned long)k);
+    dlite_get_uuid(uuid, id);
+    fprintf(fp, "%s\n  \"%s\": {\n", (k) ? "," : "", uuid);
+    fprintf(fp, "    \"uri\": \"%s\",\n", id);
+    fprintf(fp, "    \"meta\": \"%s\",\n", WORKLOAD_CHEMISTRY_URI);
+    fprintf(fp, "    \"dimensions\": {\"nelements\": %lu, \"nphases\": %d},\n",
+            (unsigned long)array_size, NPHASES);
+    fprintf(fp, "    \"properties\": {\n");
+    fprintf(fp, "      \"alloy\": \"Alloy %lu\",\n", (unsigned long)k);
+    fprintf(fp, "      \"elements\": [");
+    for (i=0; i<array_size; i++)
+      fprintf(fp, "%s\"E%lu\"", (i) ? ", " : "", (unsigned long)i);
+    fprintf(fp, "],\n");
+    fprintf(fp, "      \"phases\": [\"FCC_A1\", \"MG2SI\", \"BETA\"],\n");
+    fprintf(fp, "      \"X0\": ");
+    write_numbers(fp, array_size, 0.5 + 1e-3 * k, 0.01);
+    fprintf(fp, ",\n      \"Xp\": [");
+    for (j=0; j<NPHASES; j++) {
+      fprintf(fp, "%s", (j) ? ", " : "");
+      write_numbers(fp, array_size, 0.1 * j, 0.02);
+    }
+    fprintf(fp, "],\n      \"volfrac\": ");
+    write_numbers(fp, NPHASES, 0.01, 0.005);
+    for (j=NBASE; j<nproperties; j++) {
+      fprintf(fp, ",\n      \"p%d\": ", j - NBASE + 1);
+      write_numbers(fp, array_size, j, 0.25);
+    }
+    fprintf(fp, "\n    }\n  }");
+  }
+  fprintf(fp, "\n}\n");
+  fclose(fp);
+  return 0;
+}
+
+static int run_chemistry(double *times)
+{
+  const char *input_uris[] = {WORKLOAD_CHEMISTRY_URI};
+  DLiteStorage *s=NULL;
+  DLiteMeta *meta=NULL;
+  DLiteMapping *mapping=NULL;
+  DLiteInstance **insts=NULL, **out=NULL;
+  char **uuids=NULL;
+  size_t i, n=0, nloaded=0;
+  double t;
+  int retval=1;
+
+  /* Loaded metadata is kept in the instance store, so only the cold
+     run loads it from file */
+  t = walltime();
+  if (dlite_instance_has(WORKLOAD_CHEMISTRY_URI, 0)) {
+    if (!(meta = dlite_meta_get(WORKLOAD_CHEMISTRY_URI))) goto fail;
+  } else {
+    if (!(s = dlite_storage_open("json", CHEM_ENTITY_FILE, "mode=r")))
+      goto fail;
+    if (!(meta = dlite_meta_load(s, WORKLOAD_CHEMISTRY_URI))) goto fail;
+    dlite_storage_close(s);
+    s = NULL;
+  }
+  times[phaseMetadata] = walltime() - t;
+
+  t = walltime();
+  if (!(s = dlite_storage_open("json", CHEM_DATA_FILE, "mode=r"))) goto fail;
+  if (!(uuids = dlite_storage_uuids(s, NULL))) goto fail;
+  while (uuids[n]) n++;
+  if (!(insts = calloc(n ? n : 1, sizeof(DLiteInstance *))) ||
+      !(out = calloc(n ? n : 1, sizeof(DLiteInstance *))))
+    FAIL("allocation failure");
+  for (nloaded=0; nloaded<n; nloaded++)
+    if (!(insts[nloaded] = dlite_instance_load(s, uuids[nloaded]))) goto fail;
+  dlite_storage_close(s);
+  s = NULL;
+  times[phaseParse] = walltime() - t;
+
+  t = walltime();
+  if (!(mapping = dlite_mapping_create(WORKLOAD_SUMMARY_URI, input_uris, 1)))
+    goto fail;
+  if (dlite_mapping_map_many(mapping, (const DLiteInstance **)insts, 1, n,
+                             out)) goto fail;
+  times[phaseMap] = walltime() - t;
+
+  t = walltime();
+  if (!(s = dlite_storage_open("hdf5", CHEM_HDF5_FILE, "mode=w"))) goto fail;
+  if (dlite_instance_save_many(s, (const DLiteInstance **)insts, n)) goto fail;
+  if (dlite_storage_close(s)) {
+    s = NULL;
+    goto fail;
+  }
+  s = NULL;
+  times[phaseSave] = walltime() - t;
+
+  retval = 0;
+ fail:
+  if (s) dlite_storage_close(s);
+  if (mapping) dlite_mapping_free(mapping);
+  for (i=0; i<n && out; i++)
+    if (out[i]) dlite_instance_decref(out[i]);
+  for (i=0; i<nloaded; i++) dlite_instance_decref(insts[i]);
+  if (meta) dlite_meta_decref(meta);
+  if (uuids) dlite_storage_uuids_free(uuids);
+  free(insts);
+  free(out);
+  return retval;
+}
+
+static const char *chemistry_files[] = {
+  CHEM_ENTITY_FILE, CHEM_DATA_FILE, CHEM_HDF5_FILE, NULL
+};
+
+
+/* csv
+ *
+ * Like the read-csv example: a table with a string column followed by
+ * numerical columns, with one column per property and `instances` x
+ * `array-size` rows.  The metadata is inferred from a sample of the
+ * table, which is then loaded with the inferred metadata. */
+static int generate_csv(void)
+{
+  const char *files[] = {CSV_FILE, CSV_SAMPLE_FILE};
+  size_t k, nrows = ninstances * array_size;
+  int i, j;
+
+  for (i=0; i<2; i++) {
+    size_t n = (i == 0 || nrows < NSAMPLE) ? nrows : NSAMPLE;
+    FILE *fp;
+    if (!(fp = fopen(files[i], "w")))
+      return err(1, "cannot write %s", files[i]);
+    fprintf(fp, "label");
+    for (j=1; j<nproperties; j++) fprintf(fp, ",x%d", j);
+    fprintf(fp, "\n");
+    for (k=0; k<n; k++) {
+      fprintf(fp, "row%lu", (unsigned long)k);
+      for (j=1; j<nproperties; j++)
+        fprintf(fp, ",%.6g", 0.5 * j + 1e-3 * k);
+      fprintf(fp, "\n");
+    }
+    fclose(fp);
+  }
+  return 0;
+}
+
+static int run_csv(double *times)
+{
+  DLiteStorage *s=NULL;
+  DLiteMeta *meta=NULL;
+  DLiteInstance *inst=NULL;
+  double t;
+  int retval=1;
+
+  t = walltime();
+  if (!(s = dlite_storage_open("csvstream", CSV_SAMPLE_FILE,
+                               "meta=" WORKLOAD_CSV_URI ";infer=true")))
+    goto fail;
+  if (!(inst = dlite_instance_load(s, NULL))) goto fail;
+  meta = (DLiteMeta *)inst->meta;
+  dlite_meta_incref(meta);
+  dlite_instance_decref(inst);
+  inst = NULL;
+  dlite_storage_close(s);
+  s = NULL;
+  times[phaseMetadata] = walltime() - t;
+
+  t = walltime();
+  if (!(s = dlite_storage_open("csvstream", CSV_FILE,
+                               "meta=" WORKLOAD_CSV_URI ";infer=false")))
+    goto fail;
+  if (!(inst = dlite_instance_load(s, NULL))) goto fail;
+  dlite_storage_close(s);
+  s = NULL;
+  times[phaseParse] = walltime() - t;
+
+  times[phaseMap] = -1.0;
+
+  t = walltime();
+  if (!(s = dlite_storage_open("hdf5", CSV_HDF5_FILE, "mode=w"))) goto fail;
+  if (dlite_instance_save(s, inst)) goto fail;
+  if (dlite_storage_close(s)) {
+    s = NULL;
+    goto fail;
+  }
+  s = NULL;
+  times[phaseSave] = walltime() - t;
+
+  retval = 0;
+ fail:
+  if (s) dlite_storage_close(s);
+  if (inst) dlite_instance_decref(inst);
+  if (meta) dlite_meta_decref(meta);
+  return retval;
+}
+
+static const char *csv_files[] = {
+  CSV_FILE, CSV_SAMPLE_FILE, CSV_HDF5_FILE, NULL
+};
+
+
+/* List of workloads */
+static Workload workloads[] = {
+  {"chemistry", "Load entity and instances from JSON, map and save to HDF5.",
+   "ex1-ex4", generate_chemistry, run_chemistry, chemistry_files},
+  {"csv",       "Infer metadata from CSV, load table and save to HDF5.",
+   "read-csv", generate_csv, run_csv, csv_files},
+};
+
+
+/***************************************************************
+ * Driver
+ ***************************************************************/
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Returns the sum of the times of the applicable phases in `times`. */
+static double total_time(const double *times)
+{
+  double total=0.0;
+  int p;
+  for (p=0; p<phaseTotal; p++) if (times[p] >= 0) total += times[p];
+  return total;
+}
+
+/* Loads the storage plugins and mapping plugins used by the workloads
+   and creates the WorkloadSummary entity.  Returns the startup time in
+   seconds or a negative number on error. */
+static double startup(void)
+{
+  DLiteProperty summary_props[] = {
+    {"alloy", dliteStringPtr, sizeof(char *), 0, NULL, NULL, NULL, "Alloy."},
+    {"total", dliteFloat,     sizeof(double), 0, NULL, NULL, NULL,
+     "Sum of X0."}
+  };
+  const char *plugins[] = {"json", "csvstream", "hdf5"};
+  double t = walltime();
+  size_t i;
+
+  for (i=0; i<countof(plugins); i++)
+    if (!dlite_storage_plugin_get(plugins[i])) return -1.0;
+  if (!dlite_mapping_plugin_get("workload-mapping")) return -1.0;
+  t = walltime() - t;
+
+  if (!(summary_meta = dlite_meta_create(WORKLOAD_SUMMARY_URI, NULL,
+                                         "Summary of a WorkloadChemistry.",
+                                         0, NULL, countof(summary_props),
+                                         summary_props)))
+    return -1.0;
+  return t;
+}
+
+/* Generates input for workload `w`, runs it and writes the result as a
+   JSON object to `fp`.  `sep` is written before the object.  Returns
+   non-zero on error. */
+static int run_workload(const Workload *w, FILE *fp, const char *sep)
+{
+  double *times=NULL, t[nphases], cold[nphases];
+  const char **f;
+  int p, r, retval=1;
+
+  if (!(times = calloc(nphases * repeat, sizeof(double))))
+    FAIL("allocation failure");
+  if (w->generate())
+    FAIL1("cannot generate input for workload %s", w->name);
+
+  /* The cold run is the first run in this process */
+  if (w->run(cold)) goto fail;
+  cold[phaseTotal] = total_time(cold);
+  for (r=0; r<warmup; r++)
+    if (w->run(t)) goto fail;
+  for (r=0; r<repeat; r++) {
+    if (w->run(t)) goto fail;
+    t[phaseTotal] = total_time(t);
+    for (p=0; p<nphases; p++) times[p*repeat + r] = t[p];
+  }
+
+  fprintf(fp, "%s    {\n", sep);
+  fprintf(fp, "      \"name\": \"%s\",\n", w->name);
+  fprintf(fp, "      \"example\": \"%s\",\n", w->example);
+  fprintf(fp, "      \"phases\": {");
+  for (p=0; p<nphases; p++) {
+    double *pt = times + p*repeat, median, mean=0.0;
+    if (pt[0] < 0) continue;
+    for (r=0; r<repeat; r++) mean += pt[r];
+    mean /= repeat;
+    qsort(pt, repeat, sizeof(double), cmp_double);
+    median = (repeat % 2) ? pt[repeat/2] :
+      0.5 * (pt[repeat/2 - 1] + pt[repeat/2]);
+    fprintf(fp, "%s\n        \"%s\": {\"cold\": %.6e, \"min\": %.6e, "
+            "\"median\": %.6e, \"mean\": %.6e}", (p) ? "," : "",
+            phase_names[p], cold[p], pt[0], median, mean);
+    fprintf(stderr, "  %-12s %-10s %12.3f ms %12.3f ms\n",
+            (p) ? "" : w->name, phase_names[p], 1e3 * cold[p], 1e3 * median);
+  }
+  fprintf(fp, "\n      }\n");
+  fprintf(fp, "    }");
+
+  retval = 0;
+ fail:
+  for (f=w->files; *f; f++) remove(*f);
+  free(times);
+  return retval;
+}
+
+
+void help()
+{
+  char **p, *msg[] = {
+    "Usage: dlite-workload [OPTIONS] [WORKLOAD...]",
+    "Runs end-to-end workloads derived from the examples on generated",
+    "data and writes the time of each phase as JSON.  WORKLOAD may be a",
+    "glob pattern.  Default is to run all.",
+    "  -a, --array-size N  Length of array properties.  For the csv",
+    "                      workload, the number of rows per instance.",
+    "                      Default: 10",
+    "  -b, --build         Use plugins and paths in the build directory.",
+    "  -h, --help          Prints this help and exit.",
+    "  -l, --list          List available workloads and exit.",
+    "  -n, --instances N   Number of instances.  Default: 100",
+    "  -o, --output FILE   Write JSON results to FILE instead of standard",
+    "                      output.",
+    "  -p, --properties M  Number of properties (at least 6).  For the csv",
+    "                      workload, the number of columns.  Default: 8",
+    "  -r, --repeat N      Number of timed repetitions.  Default: 5",
+    "  -V, --version       Print dlite version number and exit.",
+    "  -w, --warmup N      Number of untimed repetitions.  Default: 1",
+    "",
+    "The phases are metadata, parse, map and save.  The reported times",
+    "are in seconds per repetition.  The `cold` time of each phase is from",
+    "the first run, before warmup.  The startup time for loading the",
+    "plugins is measured once.  A summary is written to standard error.",
+    "",
+    NULL
+  };
+  for (p=msg; *p; p++) printf("%s\n", *p);
+}
+
+
+int main(int argc, char *argv[])
+{
+  int i, k, retval=0, nselect=0;
+  const char *output=NULL, **select=NULL, *sep="";
+  double tstartup;
+  FILE *fp=stdout;
+
+  err_set_prefix("dlite-workload");
+
+  /* Parse options and arguments */
+  while (1) {
+    int longindex = 0;
+    struct option longopts[] = {
+      {"array-size",    1, NULL, 'a'},
+      {"build",         0, NULL, 'b'},
+      {"help",          0, NULL, 'h'},
+      {"list",          0, NULL, 'l'},
+      {"instances",     1, NULL, 'n'},
+      {"output",        1, NULL, 'o'},
+      {"properties",    1, NULL, 'p'},
+      {"repeat",        1, NULL, 'r'},
+      {"version",       0, NULL, 'V'},
+      {"warmup",        1, NULL, 'w'},
+      {NULL, 0, NULL, 0}
+    };
+    int c = getopt_long(argc, argv, "a:bhln:o:p:r:Vw:", longopts, &longindex);
+    if (c == -1) break;
+    switch (c) {
+    case 'a':  array_size = strtoul(optarg, NULL, 10); break;
+    case 'b':  dlite_set_use_build_root(1); break;
+    case 'h':  help(); exit(0);
+    case 'l':
+      for (i=0; i < (int)countof(workloads); i++)
+        printf("%-12s %s\n", workloads[i].name, workloads[i].descr);
+      exit(0);
+    case 'n':  ninstances = strtoul(optarg, NULL, 10); break;
+    case 'o':  output = optarg; break;
+    case 'p':  nproperties = atoi(optarg); break;
+    case 'r':  repeat = atoi(optarg); break;
+    case 'V':  printf("%s\n", dlite_VERSION); exit(0);
+    case 'w':  warmup = atoi(optarg); break;
+    case '?':  exit(1);
+    default:   abort();
+    }
+  }
+  if (repeat < 1) return errx(1, "--repeat must be positive");
+  if (nproperties < NBASE)
+    return errx(1, "--properties must be at least %d", NBASE);
+  if (ninstances < 1 || array_size < 1)
+    return errx(1, "--instances and --array-size must be positive");
+  if (optind < argc) {
+    select = (const char **)argv + optind;
+    nselect = argc - optind;
+  }
+
+  dlite_mapping_plugin_path_insert(0, STRINGIFY(BENCH_MAPPING_DIR));
+  if ((tstartup = startup()) < 0) return 1;
+  if (output && !(fp = fopen(output, "w")))
+    return err(1, "cannot open output file: %s", output);
+  fprintf(stderr, "  %-12s %-10s %15s %15s\n", "", "", "cold", "median");
+  fprintf(stderr, "  %-12s %-10s %12.3f ms\n", "", "startup", 1e3 * tstartup);
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"dlite_version\": \"%s\",\n", dlite_VERSION);
+  fprintf(fp, "  \"instances\": %lu,\n", (unsigned long)ninstances);
+  fprintf(fp, "  \"properties\": %d,\n", nproperties);
+  fprintf(fp, "  \"array_size\": %lu,\n", (unsigned long)array_size);
+  fprintf(fp, "  \"repeat\": %d,\n", repeat);
+  fprintf(fp, "  \"warmup\": %d,\n", warmup);
+  fprintf(fp, "  \"startup\": %.6e,\n", tstartup);
+  fprintf(fp, "  \"results\": [\n");
+  for (i=0; i < (int)countof(workloads); i++) {
+    const Workload *w = workloads + i;
+    if (nselect) {
+      for (k=0; k<nselect; k++)
+        if (globmatch(select[k], w->name) == 0) break;
+      if (k == nselect) continue;
+    }
+    if (run_workload(w, fp, sep))
+      retval = 1;
+    else
+      sep = ",\n";
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  if (output) fclose(fp);
+
+  dlite_meta_decref(summary_meta);
+  return retval;
+}
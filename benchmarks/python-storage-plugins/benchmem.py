@@ -0,0 +1,24 @@
+"""Storage plugin used by dlite-bench-python for measuring the overhead
+of calling Python storage plugins.  Instances are kept in memory as
+dicts, such that no file access is timed."""
+from dlite.utils import instance_from_dict
+
+
+class benchmem(DLiteStorageBase):  # noqa: F821
+    """Keeps saved instances in a dict shared by all storages with the
+    same location."""
+    storages = {}
+
+    def open(self, location, options=None):
+        self.instances = self.storages.setdefault(location, {})
+
+    def close(self):
+        pass
+
+    def load(self, uuid):
+        """Returns a new instance created from the stored dict."""
+        return instance_from_dict(self.instances[uuid])
+
+    def save(self, inst):
+        """Stores instance `inst` as a dict."""
+        self.instances[inst.uuid] = inst.asdict()
@@ -4,13 +4,19 @@
 module DLite
   use iso_c_binding, only : c_ptr, c_int, c_size_t, c_char, c_null_char, &
                             c_associated, c_null_ptr, c_bool, c_float,   &
-                            c_double, c_f_pointer, c_loc
+                            c_double, c_f_pointer, c_loc, c_int32_t,     &
+                            c_int64_t
   use c_interface, only: c_f_string, f_c_string
 
   implicit none
   private
 
+  ! DLiteType numbers used for checking the type of aliased properties
+  integer(c_int), parameter :: DLITE_INT = 2
+  integer(c_int), parameter :: DLITE_FLOAT = 4
+
   public :: dlite_instance_set_property_value
+  public :: dlite_save_many
 
   type, public :: DLiteStorage
      type(c_ptr) :: cptr
@@ -18,6 +24,8 @@ module DLite
    contains
      procedure :: close => dlite_storage_close
      procedure :: is_writable => dlite_storage_is_writable
+     procedure :: set_write_behind => dlite_storage_set_write_behind
+     procedure :: flush => dlite_storage_flush
   end type DLiteStorage
 
   interface DLiteStorage
@@ -45,6 +53,28 @@ module DLite
      procedure :: get_property => dlite_instance_get_property
      procedure :: get_property_by_index => dlite_instance_get_property_by_index
      procedure :: get_property_dims_by_index => dlite_instance_get_property_dims_by_index
+     procedure :: get_property_data_by_index => dlite_instance_get_property_data_by_index
+     procedure :: get_property_by_handle => dlite_instance_get_property_by_handle
+     procedure :: set_property_by_handle => dlite_instance_set_property_by_handle
+     procedure :: get_meta => dlite_instance_get_meta
+     procedure, private :: pointer_float_1d => dlite_instance_pointer_float_1d
+     procedure, private :: pointer_float_2d => dlite_instance_pointer_float_2d
+     procedure, private :: pointer_float_3d => dlite_instance_pointer_float_3d
+     procedure, private :: pointer_double_1d => dlite_instance_pointer_double_1d
+     procedure, private :: pointer_double_2d => dlite_instance_pointer_double_2d
+     procedure, private :: pointer_double_3d => dlite_instance_pointer_double_3d
+     procedure, private :: pointer_int32_1d => dlite_instance_pointer_int32_1d
+     procedure, private :: pointer_int32_2d => dlite_instance_pointer_int32_2d
+     procedure, private :: pointer_int32_3d => dlite_instance_pointer_int32_3d
+     procedure, private :: pointer_int64_1d => dlite_instance_pointer_int64_1d
+     procedure, private :: pointer_int64_2d => dlite_instance_pointer_int64_2d
+     procedure, private :: pointer_int64_3d => dlite_instance_pointer_int64_3d
+     generic :: get_property_pointer => pointer_float_1d, pointer_float_2d, &
+                                        pointer_float_3d, pointer_double_1d, &
+                                        pointer_double_2d, pointer_double_3d, &
+                                        pointer_int32_1d, pointer_int32_2d, &
+                                        pointer_int32_3d, pointer_int64_1d, &
+                                        pointer_int64_2d, pointer_int64_3d
      procedure :: destroy => dlite_instance_decref
   end type DLiteInstance
 
@@ -68,6 +98,21 @@ module DLite
      module procedure dlite_meta_create_from_metamodel
   end interface DLiteMeta
 
+  ! Handle to a property of a metadata, resolved once by name.  Use
+  ! it with instance%get_property_by_handle() to access the property
+  ! of many instances of the metadata without looking up the name.
+  ! The metadata must be kept alive while the handle is in use.
+  type, public :: DLitePropertyHandle
+    type(c_ptr) :: cptr
+  contains
+    procedure :: check => dlite_property_handle_check
+    procedure :: destroy => dlite_property_handle_free
+  end type DLitePropertyHandle
+
+  interface DLitePropertyHandle
+     module procedure dlite_property_handle_create
+  end interface DLitePropertyHandle
+
   type, public :: DLiteMetaModel
     type(c_ptr) :: cptr
   contains
@@ -118,6 +163,21 @@ module DLite
     type(c_ptr), value, intent(in) :: storage
   end function dlite_storage_is_writable_c
 
+  integer(c_int) function dlite_storage_set_write_behind_c(storage, enable, &
+      maxbytes, interval) bind(C,name="dlite_storage_set_write_behind")
+    import c_ptr, c_int, c_size_t, c_double
+    type(c_ptr), value, intent(in)       :: storage
+    integer(c_int), value, intent(in)    :: enable
+    integer(c_size_t), value, intent(in) :: maxbytes
+    real(c_double), value, intent(in)    :: interval
+  end function dlite_storage_set_write_behind_c
+
+  integer(c_int) function dlite_storage_flush_c(storage) &
+    bind(C,name="dlite_storage_flush")
+    import c_ptr, c_int
+    type(c_ptr), value, intent(in) :: storage
+  end function dlite_storage_flush_c
+
   ! --------------------------------------------------------
   ! C interface for DLiteInstance
   ! --------------------------------------------------------
@@ -157,6 +217,14 @@ module DLite
     type(c_ptr), value, intent(in)                         :: instance
   end function dlite_instance_save_c
 
+  integer(c_int) function dlite_instance_save_many_c(storage, insts, n) &
+      bind(C,name="dlite_instance_save_many")
+    import c_ptr, c_int, c_size_t
+    type(c_ptr), value, intent(in)                         :: storage
+    type(c_ptr), dimension(*), intent(in)                  :: insts
+    integer(c_size_t), value, intent(in)                   :: n
+  end function dlite_instance_save_many_c
+
   integer(c_int) function dlite_instance_save_url_c(url, instance) &
       bind(C,name="dlite_instance_save_url")
     import c_ptr, c_char, c_int
@@ -224,6 +292,49 @@ module DLite
     integer(c_size_t), value, intent(in)                   :: i
   end function dlite_instance_get_property_dims_by_index_c
 
+  ! void *dlite_instance_get_property_data_by_index(const DLiteInstance *inst,
+  !     size_t i, DLiteType type, size_t size, int ndims, size_t *shape,
+  !     int order);
+  type(c_ptr) function dlite_instance_get_property_data_by_index_c(instance, &
+      i, type, size, ndims, shape, order) &
+    bind(C,name="dlite_instance_get_property_data_by_index")
+    import c_ptr, c_size_t, c_int
+    type(c_ptr), value, intent(in)                         :: instance
+    integer(c_size_t), value, intent(in)                   :: i
+    integer(c_int), value, intent(in)                      :: type
+    integer(c_size_t), value, intent(in)                   :: size
+    integer(c_int), value, intent(in)                      :: ndims
+    integer(c_size_t), dimension(*), intent(out)           :: shape
+    integer(c_int), value, intent(in)                      :: order
+  end function dlite_instance_get_property_data_by_index_c
+
+  ! void *dlite_instance_get_property_by_handle(const DLiteInstance *inst,
+  !     const DLitePropertyHandle *handle);
+  type(c_ptr) function dlite_instance_get_property_by_handle_c(instance, &
+      handle) &
+    bind(C,name="dlite_instance_get_property_by_handle")
+    import c_ptr
+    type(c_ptr), value, intent(in)                         :: instance
+    type(c_ptr), value, intent(in)                         :: handle
+  end function dlite_instance_get_property_by_handle_c
+
+  ! int dlite_instance_set_property_by_handle(DLiteInstance *inst,
+  !     const DLitePropertyHandle *handle, const void *ptr);
+  integer(c_int) function dlite_instance_set_property_by_handle_c(instance, &
+      handle, ptr) &
+    bind(C,name="dlite_instance_set_property_by_handle")
+    import c_ptr, c_int
+    type(c_ptr), value, intent(in)                         :: instance
+    type(c_ptr), value, intent(in)                         :: handle
+    type(c_ptr), value, intent(in)                         :: ptr
+  end function dlite_instance_set_property_by_handle_c
+
+  type(c_ptr) function dlite_instance_get_meta_uri_c(instance) &
+      bind(C,name='dlite_instance_get_meta_uri')
+    import c_ptr
+    type(c_ptr), value, intent(in) :: instance
+  end function dlite_instance_get_meta_uri_c
+
   ! int dlite_instance_decref(DLiteInstance *inst)
   integer(c_int) function dlite_instance_decref_c(instance) &
     bind(C,name="dlite_instance_decref")
@@ -231,6 +342,13 @@ module DLite
     type(c_ptr), value, intent(in)                         :: instance
   end function dlite_instance_decref_c
 
+  ! DLiteMeta *dlite_meta_get(const char *id)
+  type(c_ptr) function dlite_meta_get_c(id) &
+    bind(C,name="dlite_meta_get")
+    import c_ptr
+    type(c_ptr), value, intent(in)                         :: id
+  end function dlite_meta_get_c
+
   ! int dlite_meta_decref(DLiteMeta *meta)
   integer(c_int) function dlite_meta_decref_c(meta) &
     bind(C,name="dlite_meta_decref")
@@ -336,6 +454,24 @@ module DLite
     character(len=1,kind=c_char), dimension(*), intent(in) :: name
   end function dlite_meta_has_property_c
 
+  ! C interface for DLitePropertyHandle
+
+  ! DLitePropertyHandle *dlite_property_handle_create(const DLiteMeta *meta,
+  !     const char *name)
+  type(c_ptr) function dlite_property_handle_create_c(meta, name) &
+    bind(C,name="dlite_property_handle_create")
+    import c_ptr, c_char
+    type(c_ptr), value, intent(in)                         :: meta
+    character(len=1,kind=c_char), dimension(*), intent(in) :: name
+  end function dlite_property_handle_create_c
+
+  ! void dlite_property_handle_free(DLitePropertyHandle *handle)
+  subroutine dlite_property_handle_free_c(handle) &
+    bind(C,name="dlite_property_handle_free")
+    import c_ptr
+    type(c_ptr), value, intent(in)                         :: handle
+  end subroutine dlite_property_handle_free_c
+
   ! End C interface for DLite
   end interface
 
@@ -395,6 +531,28 @@ contains
     status = c_status
   end function dlite_storage_is_writable
 
+  ! Enables write-behind, such that saves to `storage` are queued and
+  ! written in batches when `maxbytes` bytes are pending or `interval`
+  ! seconds have passed.  With write-behind enabled, instance%save()
+  ! and dlite_save_many() may be called concurrently from OpenMP
+  ! threads.  Call this (and `flush`) outside parallel regions.
+  function dlite_storage_set_write_behind(storage, maxbytes, interval) &
+      result(status)
+    class(DLiteStorage), intent(in) :: storage
+    integer(8), intent(in)          :: maxbytes
+    real(8), intent(in)             :: interval
+    integer                         :: status
+    status = dlite_storage_set_write_behind_c(storage%cptr, 1_c_int, &
+         int(maxbytes, c_size_t), real(interval, c_double))
+  end function dlite_storage_set_write_behind
+
+  ! Writes all instances queued by write-behind to `storage`.
+  function dlite_storage_flush(storage) result(status)
+    class(DLiteStorage), intent(in) :: storage
+    integer                         :: status
+    status = dlite_storage_flush_c(storage%cptr)
+  end function dlite_storage_flush
+
 
   ! --------------------------------------------------------
   ! Fortran methods for DLiteInstance
@@ -477,6 +635,19 @@ contains
     status = dlite_instance_save_c(storage%cptr, instance%cinst)
   end function dlite_instance_save
 
+  ! Saves all `instances` to `storage` in one call to the storage plugin.
+  function dlite_save_many(storage, instances) result(status)
+    type(DLiteStorage), intent(in)  :: storage
+    type(DLiteInstance), intent(in) :: instances(:)
+    type(c_ptr)                     :: insts(size(instances))
+    integer                         :: i, status
+    do i = 1, size(instances)
+      insts(i) = instances(i)%cinst
+    end do
+    status = dlite_instance_save_many_c(storage%cptr, insts, &
+         int(size(instances), c_size_t))
+  end function dlite_save_many
+
   function dlite_instance_save_url(instance, url) result(status)
     class(DLiteInstance), intent(in) :: instance
     character(len=*), intent(in)     :: url
@@ -580,6 +751,192 @@ contains
     call free_c(ptr)
   end subroutine dlite_instance_get_property_dims_by_index
 
+  ! Zero-copy access to array properties.  `call
+  ! instance%get_property_pointer(i, ptr)` associates the Fortran
+  ! pointer `ptr` with the data of property `i` (zero-based) of
+  ! `instance`.  The dimensions of `ptr` are the reversed dimensions of
+  ! the property, such that ptr(j,i) refers to element [i][j] in C.
+  ! `ptr` is nullified if the property doesn't match its type and rank.
+  ! It is valid until the instance is free'ed or the property resized.
+  ! Returns a C pointer to the data of property `i` (zero-based) of
+  ! `instance` without copying it, or a null pointer on error.  The
+  ! property must have DLiteType number `dtype`, element size `esize`
+  ! and size(shape) dimensions.  The dimensions are written to `shape`
+  ! in reverse order, which is the shape of the data seen from Fortran.
+  function dlite_instance_get_property_data_by_index(instance, i, dtype, &
+                                                     esize, shape) result(cptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    integer(c_int), intent(in)           :: dtype
+    integer(c_size_t), intent(in)        :: esize
+    integer(c_size_t), intent(out)       :: shape(:)
+    type(c_ptr)                          :: cptr
+    cptr = dlite_instance_get_property_data_by_index_c(instance%cinst, &
+        int(i, c_size_t), dtype, esize, int(size(shape), c_int), shape, &
+        int(iachar('F'), c_int))
+  end function dlite_instance_get_property_data_by_index
+
+  subroutine dlite_instance_pointer_float_1d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    real(c_float), pointer               :: ptr(:)
+    integer(c_size_t)                    :: shape(1)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_FLOAT, 4_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_float_1d
+
+  subroutine dlite_instance_pointer_float_2d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    real(c_float), pointer               :: ptr(:,:)
+    integer(c_size_t)                    :: shape(2)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_FLOAT, 4_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_float_2d
+
+  subroutine dlite_instance_pointer_float_3d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    real(c_float), pointer               :: ptr(:,:,:)
+    integer(c_size_t)                    :: shape(3)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_FLOAT, 4_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_float_3d
+
+  subroutine dlite_instance_pointer_double_1d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    real(c_double), pointer              :: ptr(:)
+    integer(c_size_t)                    :: shape(1)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_FLOAT, 8_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_double_1d
+
+  subroutine dlite_instance_pointer_double_2d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    real(c_double), pointer              :: ptr(:,:)
+    integer(c_size_t)                    :: shape(2)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_FLOAT, 8_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_double_2d
+
+  subroutine dlite_instance_pointer_double_3d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    real(c_double), pointer              :: ptr(:,:,:)
+    integer(c_size_t)                    :: shape(3)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_FLOAT, 8_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_double_3d
+
+  subroutine dlite_instance_pointer_int32_1d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    integer(c_int32_t), pointer          :: ptr(:)
+    integer(c_size_t)                    :: shape(1)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_INT, 4_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_int32_1d
+
+  subroutine dlite_instance_pointer_int32_2d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    integer(c_int32_t), pointer          :: ptr(:,:)
+    integer(c_size_t)                    :: shape(2)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_INT, 4_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_int32_2d
+
+  subroutine dlite_instance_pointer_int32_3d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    integer(c_int32_t), pointer          :: ptr(:,:,:)
+    integer(c_size_t)                    :: shape(3)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_INT, 4_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_int32_3d
+
+  subroutine dlite_instance_pointer_int64_1d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    integer(c_int64_t), pointer          :: ptr(:)
+    integer(c_size_t)                    :: shape(1)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_INT, 8_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_int64_1d
+
+  subroutine dlite_instance_pointer_int64_2d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    integer(c_int64_t), pointer          :: ptr(:,:)
+    integer(c_size_t)                    :: shape(2)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_INT, 8_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_int64_2d
+
+  subroutine dlite_instance_pointer_int64_3d(instance, i, ptr)
+    class(DLiteInstance), intent(in)     :: instance
+    integer, intent(in)                  :: i
+    integer(c_int64_t), pointer          :: ptr(:,:,:)
+    integer(c_size_t)                    :: shape(3)
+    type(c_ptr)                          :: cptr
+    cptr = instance%get_property_data_by_index(i, DLITE_INT, 8_c_size_t, shape)
+    nullify(ptr)
+    if (c_associated(cptr)) call c_f_pointer(cptr, ptr, shape)
+  end subroutine dlite_instance_pointer_int64_3d
+
+  ! Returns a C pointer to the data of the property referred to by
+  ! `handle` in `instance`, or a null pointer on error.  For array
+  ! properties, it points to the first element.
+  function dlite_instance_get_property_by_handle(instance, handle) result(ptr)
+    class(DLiteInstance), intent(in)      :: instance
+    class(DLitePropertyHandle), intent(in):: handle
+    type(c_ptr)                           :: ptr
+    ptr = dlite_instance_get_property_by_handle_c(instance%cinst, handle%cptr)
+  end function dlite_instance_get_property_by_handle
+
+  ! Copies the data pointed to by the C pointer `ptr` to the property
+  ! referred to by `handle` in `instance`.  Returns non-zero on error.
+  function dlite_instance_set_property_by_handle(instance, handle, ptr) &
+      result(status)
+    class(DLiteInstance), intent(in)      :: instance
+    class(DLitePropertyHandle), intent(in):: handle
+    type(c_ptr), intent(in)               :: ptr
+    integer                               :: status
+    status = dlite_instance_set_property_by_handle_c(instance%cinst, &
+        handle%cptr, ptr)
+  end function dlite_instance_set_property_by_handle
+
+  ! Returns a new reference to the metadata of `instance`.
+  function dlite_instance_get_meta(instance) result(meta)
+    class(DLiteInstance), intent(in) :: instance
+    type(DLiteMeta)                  :: meta
+    meta%cptr = dlite_meta_get_c(dlite_instance_get_meta_uri_c(instance%cinst))
+  end function dlite_instance_get_meta
+
   function dlite_instance_decref(instance) result(count)
     class(DLiteInstance)                 :: instance
     integer(c_int)                       :: count_c
@@ -737,6 +1094,31 @@ contains
     answer = answer_c
   end function dlite_meta_has_property
 
+  ! --------------------------------------------------------
+  ! Fortran methods for DLitePropertyHandle
+  ! --------------------------------------------------------
+
+  function dlite_property_handle_create(meta, name) result(handle)
+    class(DLiteMeta), intent(in)  :: meta
+    character(len=*), intent(in)  :: name
+    character(len=1,kind=c_char)  :: name_c(len_trim(name)+1)
+    type(DLitePropertyHandle)     :: handle
+    call f_c_string(name, name_c)
+    handle%cptr = dlite_property_handle_create_c(meta%cptr, name_c)
+  end function dlite_property_handle_create
+
+  function dlite_property_handle_check(handle) result(status)
+    class(DLitePropertyHandle)   :: handle
+    logical                      :: status
+    status = c_associated(handle%cptr)
+  end function dlite_property_handle_check
+
+  subroutine dlite_property_handle_free(handle)
+    class(DLitePropertyHandle)   :: handle
+    call dlite_property_handle_free_c(handle%cptr)
+    handle%cptr = c_null_ptr
+  end subroutine dlite_property_handle_free
+
   subroutine set_property_value_string(inst, index, prop)
     type(DLiteInstance), intent(in)  :: inst
     integer, intent(in)              :: index
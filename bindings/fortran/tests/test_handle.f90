@@ -0,0 +1,58 @@
+! Tests property handles for repeated access to many instances
+
+program ftest_handle
+
+  use iso_c_binding
+  use DLite
+  use Scan3D
+
+  implicit none
+
+  integer, parameter        :: n = 4
+  type(TScan3D)             :: scans(n)
+  type(DLiteInstance)       :: instances(n)
+  type(DLiteMeta)           :: meta
+  type(DLitePropertyHandle) :: handle, bad
+  real(c_float), pointer    :: ptr(:,:)
+  real(c_float), target     :: values(3, 5)
+  type(c_ptr)               :: cptr
+  integer                   :: i, k, status
+
+  print *, "test_handle.f90: access properties of Scan3D instances via a handle"
+
+  do k = 1, n
+    scans(k) = TScan3D(5, 3)
+    scans(k)%date = '2020-09-07'
+    scans(k)%points = 0.0
+    instances(k) = scans(k)%writeToInstance()
+  end do
+
+  ! resolve the property once
+  meta = instances(1)%get_meta()
+  if (.not. meta%check()) error stop "cannot get metadata"
+  handle = DLitePropertyHandle(meta, "points")
+  if (.not. handle%check()) error stop "cannot resolve handle"
+  bad = DLitePropertyHandle(meta, "no-such-property")
+  if (bad%check()) error stop "handle to non-existing property"
+
+  ! set and get the property of all instances
+  do k = 1, n
+    values = real(k, c_float)
+    status = instances(k)%set_property_by_handle(handle, c_loc(values))
+    if (status /= 0) error stop "cannot set property by handle"
+  end do
+  do k = 1, n
+    cptr = instances(k)%get_property_by_handle(handle)
+    if (.not. c_associated(cptr)) error stop "cannot get property by handle"
+    call c_f_pointer(cptr, ptr, [3, 5])
+    do i = 1, 5
+      if (any(abs(ptr(:, i) - k) > 1e-6)) error stop "wrong value"
+    end do
+  end do
+
+  call handle%destroy()
+  status = meta%destroy()
+  do k = 1, n
+    status = scans(k)%destroy()
+  end do
+end program ftest_handle
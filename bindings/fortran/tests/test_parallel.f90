@@ -0,0 +1,74 @@
+! Saves instances concurrently from OpenMP threads to a storage with
+! write-behind enabled and with dlite_save_many().  Without OpenMP
+! the loops run serially.
+
+program ftest_parallel
+
+  use iso_c_binding
+  use DLite
+  use Scan3D
+
+  implicit none
+
+  integer, parameter  :: n = 32
+  type(TScan3D)       :: scans(n)
+  type(DLiteInstance) :: instances(n), inst
+  type(DLiteStorage)  :: storage
+  character(len=36)   :: uuids(n)
+  integer             :: k, status, nerr
+
+  ! Create the metadata before entering the parallel region
+  scans(1) = TScan3D(4, 3)
+
+  print *, "test_parallel.f90: concurrent saves with write-behind"
+  storage = DLiteStorage("json", "parallel.json", "mode=w")
+  if (.not. c_associated(storage%cptr)) error stop "cannot open storage"
+  status = storage%set_write_behind(1000_8, 0.0_8)
+  if (status /= 0) error stop "cannot enable write-behind"
+
+  nerr = 0
+  !$omp parallel do private(status) reduction(+:nerr)
+  do k = 1, n
+    scans(k) = TScan3D(4, 3)
+    scans(k)%date = '2020-09-07'
+    scans(k)%points = real(k, c_float)
+    instances(k) = scans(k)%writeToInstance()
+    uuids(k) = instances(k)%get_uuid()
+    status = instances(k)%save(storage)
+    if (status /= 0) nerr = nerr + 1
+  end do
+  !$omp end parallel do
+  if (nerr /= 0) error stop "concurrent save failed"
+
+  if (storage%flush() /= 0) error stop "flush failed"
+  if (storage%close() /= 0) error stop "close failed"
+
+  print *, "test_parallel.f90: batch save"
+  storage = DLiteStorage("json", "parallel_many.json", "mode=w")
+  if (dlite_save_many(storage, instances) /= 0) error stop "save_many failed"
+  status = storage%close()
+
+  ! Free the instances, such that they are loaded from the storages
+  do k = 1, n
+    status = instances(k)%destroy()
+  end do
+
+  storage = DLiteStorage("json", "parallel.json", "mode=r")
+  do k = 1, n
+    inst = DLiteInstance(storage, uuids(k))
+    if (.not. inst%check()) error stop "cannot load saved instance"
+    call scans(k)%readFromInstance(inst)
+    if (any(abs(scans(k)%points - k) > 1e-6)) error stop "wrong points"
+    status = inst%destroy()
+  end do
+  status = storage%close()
+
+  storage = DLiteStorage("json", "parallel_many.json", "mode=r")
+  do k = 1, n
+    inst = DLiteInstance(storage, uuids(k))
+    if (.not. inst%check()) error stop "cannot load batch-saved instance"
+    status = inst%destroy()
+  end do
+  status = storage%close()
+
+end program ftest_parallel
@@ -0,0 +1,53 @@
+! Tests zero-copy pointer access to array properties
+
+program ftest_pointer
+
+  use iso_c_binding
+  use DLite
+  use Scan3D
+
+  implicit none
+
+  type(TScan3D)          :: scan, scan2
+  type(DLiteInstance)    :: instance
+  real(c_float), pointer :: ptr(:,:), ptr2(:,:)
+  real(c_double), pointer:: dptr(:,:)
+  integer                :: i, j, status
+
+  print *, "test_pointer.f90: alias points of a Scan3D instance"
+
+  scan = TScan3D(5, 3)
+  scan%date = '2020-09-07'
+  do i = 1, 5
+    do j = 1, 3
+      scan%points(i, j) = 10*i + j
+    end do
+  end do
+
+  ! no underlying instance yet
+  ptr => scan%points_ptr()
+  if (associated(ptr)) error stop "pointer without instance"
+
+  instance = scan%writeToInstance()
+  ptr => scan%points_ptr()
+  if (.not. associated(ptr)) error stop "pointer not associated"
+  if (any(shape(ptr) /= [3, 5])) error stop "dimensions are not reversed"
+  do i = 1, 5
+    do j = 1, 3
+      if (abs(ptr(j, i) - scan%points(i, j)) > 1e-6) error stop "wrong value"
+    end do
+  end do
+
+  ! the pointer aliases the instance data
+  ptr(2, 4) = 42.0
+  call instance%get_property_pointer(1, ptr2)
+  if (.not. associated(ptr2, ptr)) error stop "pointers differ"
+  call scan2%readFromInstance(instance)
+  if (abs(scan2%points(4, 2) - 42.0) > 1e-6) error stop "data is not aliased"
+
+  ! type mismatch
+  call instance%get_property_pointer(1, dptr)
+  if (associated(dptr)) error stop "type mismatch not detected"
+
+  status = scan%destroy()
+end program ftest_pointer
@@ -31,4 +31,21 @@ if sys.platform == 'win32':
 
 
 from .dlite import *  # noqa: F401, F403
-from .factory import classfactory, objectfactory, loadfactory  # noqa: F401
+
+
+def __getattr__(name):
+    # Import the asyncio interface lazily, since importing asyncio is slow
+    if name == 'aio':
+        from . import aio
+        return aio
+    # The factory functions are rarely used by short-lived scripts
+    if name in ('classfactory', 'objectfactory', 'loadfactory'):
+        from . import factory
+        return getattr(factory, name)
+    # Search paths are created on first access, see dlite-path-python.i
+    swigmodule = sys.modules[__name__ + '.dlite']
+    if name in swigmodule._path_types:
+        value = getattr(swigmodule, name)
+        globals()[name] = value
+        return value
+    raise AttributeError(f"module 'dlite' has no attribute '{name}'")
@@ -0,0 +1,142 @@
+"""asyncio interface to DLite storage operations.
+
+The coroutines in this module execute storage I/O in the DLite I/O
+threads (see load_async() and save_async()) without holding the GIL.
+The running event loop is woken up via a pipe when an operation is
+completed, such that the loop is never blocked and concurrent tasks
+overlap their I/O:
+
+    inst = await dlite.aio.load('json://data.json#my-id')
+    await dlite.aio.save(inst, 'json://out.json?mode=w')
+    await inst.asave('json://out.json?mode=w')
+
+Opening and closing storages may also perform I/O and is run in the
+default executor of the loop.  On event loops without add_reader()
+support, like the proactor loop on Windows, completion is awaited in
+the executor instead.
+"""
+import asyncio
+import os
+import weakref
+
+import dlite
+
+
+# Maps event loops to their notifiers
+_notifiers = weakref.WeakKeyDictionary()
+
+
+class _Notifier:
+    """Wakeup pipe watched by an event loop.  The DLite I/O threads
+    write a byte to the pipe when an operation is completed."""
+
+    def __init__(self, loop):
+        self.loop = loop
+        self.pending = {}
+        self.rfd, self.wfd = os.pipe()
+        os.set_blocking(self.rfd, False)
+        os.set_blocking(self.wfd, False)
+        try:
+            loop.add_reader(self.rfd, self._wakeup)
+        except NotImplementedError:
+            self.close()
+            raise
+
+    def close(self):
+        for fd in (self.rfd, self.wfd):
+            try:
+                os.close(fd)
+            except OSError:
+                pass
+
+    def _wakeup(self):
+        try:
+            while os.read(self.rfd, 4096):
+                pass
+        except BlockingIOError:
+            pass
+        for key, (future, waiter) in list(self.pending.items()):
+            if future.poll():
+                del self.pending[key]
+                if not waiter.done():
+                    waiter.set_result(None)
+
+    def wait(self, future):
+        """Returns an awaitable that is done when `future` is completed."""
+        waiter = self.loop.create_future()
+        self.pending[id(future)] = (future, waiter)
+        future.notify_fd(self.wfd)
+        return waiter
+
+
+async def _wait(future):
+    """Waits for dlite Future `future` without blocking the event loop."""
+    loop = asyncio.get_running_loop()
+    notifier = _notifiers.get(loop, False)
+    if notifier is False:
+        try:
+            notifier = _Notifier(loop)
+        except NotImplementedError:
+            notifier = None
+        _notifiers[loop] = notifier
+    if notifier is None:
+        await loop.run_in_executor(None, future.wait)
+    else:
+        await notifier.wait(future)
+
+
+async def _open(driver, location, options):
+    """Opens a storage in the default executor."""
+    loop = asyncio.get_running_loop()
+    return await loop.run_in_executor(None, dlite.Storage, driver, location,
+                                      options)
+
+
+async def _close(holder):
+    """Closes the storage in list `holder` in the default executor, by
+    dropping the last reference to it in a worker thread."""
+    loop = asyncio.get_running_loop()
+    await loop.run_in_executor(None, holder.clear)
+
+
+async def load(url, id=None):
+    """Loads and returns the instance referred to by `url`, which should
+    be of the form ``driver://location?options#id``.  If `id` is given,
+    it overrides the fragment of `url`."""
+    driver, location, options, fragment = dlite.split_url(url)
+    if id is None:
+        id = fragment if fragment else None
+    holder = [await _open(driver, location, options)]
+    try:
+        future = dlite.load_async(holder[0], id)
+        await _wait(future)
+        return future.get_instance()
+    finally:
+        await _close(holder)
+
+
+async def save(inst, *args):
+    """Saves instance `inst`.  The arguments are the same as for
+    Instance.save(), i.e. an url of the form
+    ``driver://location?options``, a Storage or driver, location and
+    (optionally) options."""
+    if len(args) == 1 and isinstance(args[0], dlite.Storage):
+        holder = [args[0]]
+        owned = False
+    else:
+        if len(args) == 1:
+            driver, location, options, _ = dlite.split_url(args[0])
+        elif len(args) in (2, 3):
+            driver, location, options = (tuple(args) + (None, ))[:3]
+        else:
+            raise TypeError('expected url, storage or driver, location '
+                            'and options')
+        holder = [await _open(driver, location, options)]
+        owned = True
+    try:
+        future = dlite.save_async(holder[0], inst)
+        await _wait(future)
+        future.wait()
+    finally:
+        if owned:
+            await _close(holder)
@@ -0,0 +1,92 @@
+/* -*- C -*-  (not really, but good for syntax highlighting) */
+
+%{
+#include "dlite-async.h"
+%}
+
+
+/* Futures for asynchronous storage operations */
+%feature("docstring", "\
+Future for an asynchronous storage operation, returned by load_async()
+and save_async().  The operation is executed by the dlite I/O threads.
+
+Use notify_fd() to get notified when the operation is completed.  This
+is how the `dlite.aio` module integrates with asyncio.
+") _DLiteFuture;
+%rename(Future) _DLiteFuture;
+%nodefaultctor _DLiteFuture;
+
+%dlite_nogil(_DLiteFuture::~_DLiteFuture);
+%dlite_nogil(_DLiteFuture::wait);
+%dlite_nogil(_DLiteFuture::get_instance);
+
+struct _DLiteFuture {
+};
+
+%extend _DLiteFuture {
+  ~_DLiteFuture(void) {
+    dlite_future_free($self);
+  }
+
+  %feature("docstring",
+           "Returns true if the operation is completed.  Does not block.") poll;
+  bool poll(void) {
+    return dlite_future_poll($self);
+  }
+
+  %feature("docstring", "\
+Waits until the operation is completed.  Raises DLiteError if it failed.
+") wait;
+  void wait(void) {
+    if (dlite_future_wait($self))
+      dlite_err(1, "%s", dlite_future_errmsg($self));
+  }
+
+  %feature("docstring", "\
+Waits until the load operation is completed and returns the loaded
+instance.
+") get_instance;
+  %newobject get_instance;
+  struct _DLiteInstance *get_instance(void) {
+    return dlite_future_get_instance($self);
+  }
+
+  %feature("docstring", "\
+Returns the error message if the operation failed, otherwise None.
+") errmsg;
+  const char *errmsg(void) {
+    return dlite_future_errmsg($self);
+  }
+
+  %feature("docstring", "\
+Writes one byte to file descriptor `fd` when the operation is completed.
+") notify_fd;
+  void notify_fd(int fd) {
+    dlite_future_notify_fd($self, fd);
+  }
+}
+
+
+%feature("docstring", "\
+Queues loading of instance `id` from `storage` and returns a Future.
+`id` may be None if the storage only contains one instance.
+") load_async;
+%newobject load_async;
+
+%feature("docstring", "\
+Queues saving of `instance` to `storage` and returns a Future.  The
+instance is kept alive until it is saved, but must not be modified
+meanwhile.
+") save_async;
+%newobject save_async;
+
+%inline %{
+  struct _DLiteFuture *load_async(struct _DLiteStorage *storage,
+                                  const char *id=NULL) {
+    return dlite_instance_load_async(storage, id);
+  }
+  struct _DLiteFuture *save_async(struct _DLiteStorage *storage,
+                                  struct _DLiteInstance *instance) {
+    return dlite_instance_save_async(storage, instance);
+  }
+%}
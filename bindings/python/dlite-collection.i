@@ -140,7 +140,8 @@ Collection(url, lazy)
     dlite_collection_add_relation($self, s, p, o);
   }
   void add_relation(const Triple *t) {
-    triplestore_add_triples($self->rstore, t, 1);
+    if (!triplestore_add_triples($self->rstore, t, 1))
+      DLITE_PROP_DIM($self, 0, 0) = $self->nrelations;
   }
 
   %feature("docstring", "Returns reference to metadata.") get_meta;
@@ -4,9 +4,7 @@
 %pythoncode %{
 import sys
 import json
-import base64
 
-from uuid import UUID
 if sys.version_info >= (3, 7):
     OrderedDict = dict
 else:
@@ -16,6 +14,7 @@ import numpy as np
 
 class InstanceEncoder(json.JSONEncoder):
     def default(self, obj):
+        import base64
         if isinstance(obj, bytearray):
             return base64.b16encode(obj).decode()
         elif isinstance(obj, bytes):
@@ -38,6 +37,37 @@ class InstanceEncoder(json.JSONEncoder):
             return json.JSONEncoder.default(self, obj)
 
 
+class PropertyView:
+    """Zero-copy view of the numerical property `name` of instance `inst`.
+
+    The view can be consumed by any library supporting DLPack (like
+    PyTorch, CuPy or numpy.from_dlpack()), the numpy array interface or
+    the buffer protocol via `memoryview`.  The underlying data is shared
+    with the instance, which is kept alive by the consumer.
+    """
+    def __init__(self, inst, name):
+        self.inst = inst
+        self.name = name
+
+    def __repr__(self):
+        return f"<PropertyView: {self.name!r} of {self.inst!r}>"
+
+    def __dlpack__(self, stream=None):
+        return self.inst._dlpack(self.name)
+
+    def __dlpack_device__(self):
+        return (1, 0)  # kDLCPU, device id
+
+    def __array__(self, dtype=None, copy=None):
+        arr = self.inst.get_property(self.name)
+        return arr if dtype is None else arr.astype(dtype, copy=False)
+
+    @property
+    def memoryview(self):
+        """A memoryview of the data."""
+        return memoryview(np.asarray(self.inst.get_property(self.name)))
+
+
 def standardise(v, asdict=True):
     """Represent property value `v` as a standard python type.
     If `asdict` is true, dimensions, properties and relations will be
@@ -177,6 +207,43 @@ def standardise(v, asdict=True):
     return PyCapsule_New($self, NULL, NULL);
   }
 
+  %newobject _dlpack;
+  PyObject *_dlpack(const char *name) {
+    int i = dlite_meta_get_property_index($self->meta, name);
+    if (i < 0) return NULL;
+    return dlite_swig_get_dlpack($self, i);
+  }
+  PyObject *_dlpack(int i) {
+    return dlite_swig_get_dlpack($self, i);
+  }
+
+  /* Attribute access.  `name` is looked up once in the name index of
+     the metadata, so `inst.name` costs one C call instead of separate
+     calls for checking and getting the property. */
+  %newobject _getattr;
+  PyObject *_getattr(const char *name) {
+    int i;
+    if ((i = dlite_meta_find_property_index($self->meta, name)) >= 0)
+      return dlite_swig_get_property_by_index($self, i);
+    if ((i = dlite_meta_find_dimension_index($self->meta, name)) >= 0) {
+      dlite_instance_sync_to_dimension_sizes($self);
+      return PyLong_FromSize_t(DLITE_DIM($self, i));
+    }
+    PyErr_Format(PyExc_AttributeError,
+                 "Instance object has no attribute '%s'", name);
+    return NULL;
+  }
+
+  /* Sets property `name` to `obj`.  Returns false if `name` is not a
+     property, such that the caller can set a normal attribute. */
+  bool _setattr(const char *name, PyObject *obj) {
+    int i;
+    if ((i = dlite_meta_find_property_index($self->meta, name)) < 0)
+      return false;
+    dlite_swig_set_property_by_index($self, i, obj);
+    return true;
+  }
+
   %pythoncode %{
     meta = property(get_meta, doc="Reference to the metadata of this instance.")
     iri = property(get_iri, set_iri,
@@ -191,11 +258,14 @@ def standardise(v, asdict=True):
         doc='Dictionary with property name-value pairs.')
     is_data = property(_is_data, doc='Whether this is a data instance.')
     is_meta = property(_is_meta, doc='Whether this is a metadata instance.')
+    is_frozen = property(_is_frozen, doc='Whether this instance is frozen.')
     is_metameta = property(_is_metameta,
                            doc='Whether this is a meta-metadata instance.')
 
     def __getitem__(self, ind):
-        if self.has_property(ind):
+        if isinstance(ind, PropertyHandle):
+            return self.get_property_by_handle(ind)
+        elif self.has_property(ind):
             return self.get_property(ind)
         elif isinstance(ind, int):
             raise IndexError('instance property index out of range: %d' % ind)
@@ -203,7 +273,9 @@ def standardise(v, asdict=True):
             raise KeyError('no such property: %s' % ind)
 
     def __setitem__(self, ind, value):
-        if self.has_property(ind):
+        if isinstance(ind, PropertyHandle):
+            self.set_property_by_handle(ind, value)
+        elif self.has_property(ind):
             self.set_property(ind, value)
         elif isinstance(ind, int):
             raise IndexError('instance property index out of range: %d' % ind)
@@ -214,24 +286,13 @@ def standardise(v, asdict=True):
         return item in self.properties.keys()
 
     def __getattr__(self, name):
+        # Only called when normal attribute lookup fails
         if name == 'this':
             return object.__getattribute__(self, name)
-        d = object.__getattribute__(self, '__dict__')
-        if name in d:
-            return d[name]
-        elif self.has_property(name):
-            return _get_property(self, name)
-        elif self.has_dimension(name):
-            return self.get_dimension_size(name)
-        else:
-            raise AttributeError('Instance object has no attribute %r' % name)
+        return _dlite.Instance__getattr(self, name)
 
     def __setattr__(self, name, value):
-        if name == 'this':
-            object.__setattr__(self, name, value)
-        elif _has_property(self, name):
-            _set_property(self, name, value)
-        else:
+        if name == 'this' or not _dlite.Instance__setattr(self, name, value):
             object.__setattr__(self, name, value)
 
     def __dir__(self):
@@ -240,7 +301,7 @@ def standardise(v, asdict=True):
                 [d.name for d in self.meta.properties['dimensions']])
 
     def __hash__(self):
-        return UUID(self.uuid).int
+        return int(self.uuid.replace('-', ''), 16)
 
     def __eq__(self, other):
         return self.uuid == other.uuid
@@ -248,6 +309,36 @@ def standardise(v, asdict=True):
     def __str__(self):
         return self.asjson(indent=2)
 
+    def __reduce_ex__(self, protocol):
+        # Data instances are placed in shared memory within a
+        # shm_pickling() context.  With pickle protocol 5, numerical
+        # arrays are passed as PickleBuffer objects, such that they can
+        # be transferred out-of-band without copying.
+        if self.is_data and _pickle_namespace:
+            return (_load_shared,
+                    (self.meta.uri, _save_shared(self), self.uuid))
+        if self.is_data and protocol >= 5:
+            import pickle
+            buffers, state = {}, {}
+            for name, value in self.properties.items():
+                if (isinstance(value, np.ndarray) and
+                        value.dtype.kind in 'biuf' and
+                        value.flags.c_contiguous):
+                    buffers[name] = (pickle.PickleBuffer(value),
+                                     value.dtype.str, value.shape)
+                elif isinstance(value, np.ndarray):
+                    p = np.zeros_like(value)
+                    p.flat = [v.asdict() if hasattr(v, 'asdict') else v
+                              for v in value]
+                    state[name] = p
+                else:
+                    state[name] = (value.asdict()
+                                   if hasattr(value, 'asdict') else value)
+            return (_instance_from_buffers,
+                    (self.meta.uri, list(self.dimensions.values()),
+                     self.uuid, buffers, state))
+        return self.__reduce__()
+
     def __reduce__(self):
         # ensures that instances can be pickled
         def iterfun(inst):
@@ -298,6 +389,67 @@ def standardise(v, asdict=True):
             d['relations'] = self['relations'].tolist()
         return d
 
+    @staticmethod
+    def from_table(meta, table, id=None, rows=False):
+        """Returns new instance(s) of metadata `meta` created from `table`,
+        which may be a numpy structured array, a pandas DataFrame or a
+        mapping of column names to sequences.  Columns are assigned to
+        the properties with the same name with one conversion per column.
+
+        By default, a single instance whose properties are the columns
+        is returned.  The first dimension of `meta` is the number of rows,
+        while other dimensions are zero.  If `rows` is true, a list with one instance per row is
+        returned instead, in which case the properties should be scalars
+        and `id` may be a sequence of ids.
+        """
+        if isinstance(meta, str):
+            meta = get_instance(meta)
+        columns = table_columns(table)
+        nrows = len(next(iter(columns.values()))) if columns else 0
+        names = set(p.name for p in meta['properties'])
+        if rows:
+            dims = [0] * len(meta['dimensions'])
+            insts = _create_many(meta.uri, dims, nrows, id)
+            for name, column in columns.items():
+                if name in names:
+                    _set_column(insts, name, column)
+            return insts
+        dims = [nrows] + [0] * (len(meta['dimensions']) - 1)
+        inst = Instance(meta.uri, dims, id)
+        for name, column in columns.items():
+            if name in names:
+                inst[name] = column
+        return inst
+
+    def to_table(self, names=None):
+        """Returns a numpy structured array with the properties listed in
+        `names` as columns.  By default, all one-dimensional properties
+        along the first dimension are included."""
+        first = self.meta['dimensions'][0].name
+        props = [p for p in self.meta['properties']
+                 if p.ndims == 1 and p.get_dims()[0] == first]
+        if names is not None:
+            props = [p for p in props if p.name in names]
+        columns = [np.asarray(self[p.name]) for p in props]
+        nrows = len(columns[0]) if columns else 0
+        arr = np.empty(nrows, dtype=[(p.name, col.dtype)
+                                     for p, col in zip(props, columns)])
+        for p, col in zip(props, columns):
+            arr[p.name] = col
+        return arr
+
+    def view(self, name):
+        """Returns a zero-copy PropertyView of numerical property `name`,
+        that supports DLPack and the buffer protocol."""
+        return PropertyView(self, name)
+
+    async def asave(self, *args):
+        """Asynchronous version of save() for use in coroutines.  The
+        instance is saved by the dlite I/O threads without blocking the
+        event loop.  See dlite.aio.save()."""
+        from dlite import aio
+        await aio.save(self, *args)
+
     def asjson(self, **kwargs):
         """Returns a JSON representation of self.  Arguments are passed to
         json.dumps()."""
@@ -305,3 +457,223 @@ def standardise(v, asdict=True):
   %}
 
 }
+
+
+/* Returns a new reference to the instance referred to by capsule `cap`,
+   which should be named DLITE_INSTANCE_CAPSULA_NAME.  Used by embedded
+   Python to wrap instances without looking them up by id. */
+%{
+struct _DLiteInstance *dlite_swig_instance_from_capsule(PyObject *cap)
+{
+  DLiteInstance *inst;
+  if (!(inst = PyCapsule_GetPointer(cap, DLITE_INSTANCE_CAPSULA_NAME)))
+    return dlite_err(1, "not an instance capsule"), NULL;
+  dlite_instance_incref(inst);
+  return inst;
+}
+%}
+
+%feature("docstring", "\
+Returns a new reference to the instance referred to by a capsule named
+'dlite.Instance'.  Intended for embedded Python.
+") dlite_swig_instance_from_capsule;
+%rename(_instance_from_capsule) dlite_swig_instance_from_capsule;
+%newobject dlite_swig_instance_from_capsule;
+struct _DLiteInstance *dlite_swig_instance_from_capsule(PyObject *cap);
+
+
+/* Columnar access to many instances, used by Instance.from_table() and
+   instances_to_table() */
+%rename(_create_many) dlite_swig_create_many;
+%rename(_set_column) dlite_swig_set_column;
+%rename(_get_column) dlite_swig_get_column;
+obj_t *dlite_swig_create_many(const char *metaid, int *dims, int ndims,
+                              int n, obj_t *ids=NULL);
+int dlite_swig_set_column(struct _DLiteInstance **instances,
+                          int ninstances, const char *name, obj_t *obj);
+obj_t *dlite_swig_get_column(struct _DLiteInstance **instances,
+                             int ninstances, const char *name);
+
+%pythoncode %{
+# Shared memory namespace used for pickling data instances, see
+# shm_pickling()
+_pickle_namespace = None
+
+
+class shm_pickling:
+    """Context manager that makes pickling of data instances place them
+    in POSIX shared memory via the "shm" storage plugin.  The pickle
+    only contains the namespace and UUID of the instance, and arrays are
+    mapped without copying when the instance is unpickled, e.g. by a
+    multiprocessing or concurrent.futures worker on the same host:
+
+        with dlite.shm_pickling():
+            with ProcessPoolExecutor() as pool:
+                results = list(pool.map(analyse, instances))
+
+    The metadata of the instances must be available to the workers,
+    which is always the case for forked workers.
+
+    If `namespace` is None, a unique namespace is created.  If `remove`
+    is true, all instances in the namespace are removed from shared
+    memory when the context exits.  Instances that are already
+    unpickled are not affected.
+    """
+    def __init__(self, namespace=None, remove=True):
+        if namespace is None:
+            import os
+            from uuid import uuid4
+            namespace = 'pickle%d-%s' % (os.getpid(), uuid4().hex[:12])
+        self.namespace = namespace
+        self.remove = remove
+        self._previous = None
+
+    def __enter__(self):
+        global _pickle_namespace
+        self._previous = _pickle_namespace
+        _pickle_namespace = self.namespace
+        return self
+
+    def __exit__(self, *exc):
+        global _pickle_namespace
+        _pickle_namespace = self._previous
+        if self.remove:
+            Storage('shm', self.namespace, 'mode=w')
+
+
+def _save_shared(inst):
+    """Saves `inst` to the current shared memory pickle namespace and
+    returns the namespace."""
+    ns = _pickle_namespace
+    inst.save(Storage('shm', ns, 'mode=a'))
+    return ns
+
+
+def _load_shared(metaid, namespace, uuid):
+    """Unpickles an instance saved by _save_shared()."""
+    get_instance(metaid)  # make sure that the metadata is loaded
+    return Instance(Storage('shm', namespace, 'mode=r'), uuid)
+
+
+def _instance_from_buffers(metaid, dims, uuid, buffers, state):
+    """Unpickles an instance pickled with protocol 5."""
+    inst = Instance(metaid, dims, uuid)
+    for name, (buf, dtype, shape) in buffers.items():
+        inst[name] = np.frombuffer(buf, dtype=dtype).reshape(shape)
+    for name, value in state.items():
+        inst[name] = value
+    return inst
+
+
+def table_columns(table):
+    """Returns a dict mapping column names to arrays for `table`, which
+    may be a numpy structured array, a pandas DataFrame or a mapping of
+    column names to sequences."""
+    if getattr(getattr(table, 'dtype', None), 'names', None):
+        return {name: table[name] for name in table.dtype.names}
+    if hasattr(table, 'columns') and hasattr(table, 'iloc'):
+        return {name: table[name].to_numpy() for name in table.columns}
+    return dict(table)
+
+
+def get_column(instances, name):
+    """Returns a numpy array with scalar property `name` of each instance
+    in `instances`.
+
+    The values are gathered in C without creating a Python object per
+    instance.  The property index is looked up once per metadata, so
+    the instances may have different metadata as long as the property
+    has the same type.  String properties are returned as a numpy
+    unicode array."""
+    return _get_column(list(instances), name)
+
+
+def set_column(instances, name, values):
+    """Assigns scalar property `name` of each instance in `instances`
+    from the corresponding element of the one-dimensional sequence or
+    array `values`.  This is the inverse of get_column()."""
+    _set_column(list(instances), name, values)
+
+
+def instances_to_table(instances, names=None):
+    """Returns a numpy structured array with one row per instance in
+    `instances`, which must share metadata.  The fields are the scalar
+    properties listed in `names` (default: all scalar properties).
+    Numerical columns are copied in one go if the instances were
+    created together, like with `Instance.from_table(..., rows=True)`."""
+    instances = list(instances)
+    if not instances:
+        return np.empty(0)
+    if names is None:
+        names = [p.name for p in instances[0].meta['properties']
+                 if not p.ndims]
+    columns = [_get_column(instances, name) for name in names]
+    arr = np.empty(len(instances), dtype=[(name, col.dtype)
+                                          for name, col in
+                                          zip(names, columns)])
+    for name, col in zip(names, columns):
+        arr[name] = col
+    return arr
+%}
+
+
+/* Exchange of instances with Apache Arrow */
+%rename(_to_arrow) dlite_swig_to_arrow;
+%rename(_from_arrow) dlite_swig_from_arrow;
+obj_t *dlite_swig_to_arrow(struct _DLiteInstance **instances,
+                           int ninstances, const char *metaid=NULL);
+obj_t *dlite_swig_from_arrow(const char *metaid, obj_t *schema,
+                             obj_t *array);
+
+%pythoncode %{
+class ArrowExport:
+    """Instances of the same metadata exposed as an Arrow struct array
+    via the Arrow PyCapsule interface.  Arrow-based libraries, like
+    pyarrow, Polars and DuckDB, can consume it without copying."""
+    def __init__(self, instances, meta=None):
+        self.instances = list(instances)
+        self.metaid = meta if meta is None or isinstance(meta, str) \
+            else meta.uri
+
+    def __arrow_c_array__(self, requested_schema=None):
+        return _to_arrow(self.instances, self.metaid)
+
+    def __arrow_c_schema__(self):
+        return self.__arrow_c_array__()[0]
+
+
+def to_arrow(instances, meta=None):
+    """Returns the instances in `instances` as a table with one row per
+    instance and one column per property.  All instances must share
+    metadata.  `meta` is only needed if `instances` is empty.
+
+    Dimensional properties become list columns with the elements
+    flattened in C order.
+
+    A pyarrow RecordBatch is returned if pyarrow is installed, otherwise
+    an ArrowExport object that can be passed to any library supporting
+    the Arrow PyCapsule interface."""
+    exporter = ArrowExport(instances, meta)
+    try:
+        import pyarrow as pa
+    except ImportError:
+        return exporter
+    return pa.record_batch(exporter)
+
+
+def from_arrow(meta, data):
+    """Returns a list of new instances of `meta`, one for each row in
+    `data`.  `data` may be a pyarrow RecordBatch or Table, or any object
+    with an `__arrow_c_array__()` or `to_arrow()` method, like a Polars
+    DataFrame.  Columns are matched to properties by name."""
+    metaid = meta if isinstance(meta, str) else meta.uri
+    if hasattr(data, '__arrow_c_array__'):
+        schema, array = data.__arrow_c_array__()
+        return _from_arrow(metaid, schema, array)
+    if hasattr(data, 'to_batches'):
+        return [inst for batch in data.to_batches()
+                for inst in _from_arrow(metaid, *batch.__arrow_c_array__())]
+    if hasattr(data, 'to_arrow'):
+        return from_arrow(metaid, data.to_arrow())
+    raise TypeError('cannot convert %r to arrow' % type(data).__name__)
+%}
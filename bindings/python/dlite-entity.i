@@ -217,6 +217,59 @@ char *triple_get_id(const char *s, const char *p, const char *o,
 
 void triple_set_default_namespace(const char *namespace);
 
+typedef enum _TripleIdMode {
+  tripleIdSha1,
+  tripleIdFast
+} TripleIdMode;
+
+void triple_set_id_mode(TripleIdMode mode);
+TripleIdMode triple_get_id_mode(void);
+
+
+/* --------------
+ * PropertyHandle
+ * -------------- */
+%feature("docstring", "\
+Handle to a property of a given metadata.
+
+PropertyHandle(meta, name)
+    Looks up property `name` in metadata `meta` once.  The handle can
+    be passed to Instance.get_property_by_handle(),
+    Instance.set_property_by_handle() or used as index to any instance
+    of `meta`, avoiding repeated name lookups.
+
+") _DLitePropertyHandle;
+%rename(PropertyHandle) _DLitePropertyHandle;
+struct _DLitePropertyHandle {
+  %immutable;
+  size_t index;
+  int type;
+  size_t size;
+  int ndims;
+  %mutable;
+};
+
+%extend _DLitePropertyHandle {
+  _DLitePropertyHandle(struct _DLiteInstance *meta, const char *name) {
+    DLitePropertyHandle *h;
+    if (!dlite_instance_is_meta(meta))
+      return dlite_err(1, "not metadata: %s", meta->uuid), NULL;
+    if (!(h = dlite_property_handle_create((DLiteMeta *)meta, name)))
+      return NULL;
+    dlite_meta_incref((DLiteMeta *)meta);
+    return h;
+  }
+  ~_DLitePropertyHandle() {
+    dlite_meta_decref((DLiteMeta *)$self->meta);
+    dlite_property_handle_free($self);
+  }
+
+  %feature("docstring", "Returns the uri of the metadata.") get_meta_uri;
+  const char *get_meta_uri(void) {
+    return $self->meta->uri;
+  }
+}
+
 
 /* --------
  * Instance
@@ -403,6 +456,26 @@ struct _DLiteInstance {
     dlite_swig_set_property_by_index($self, i, obj);
   }
 
+  %feature("docstring", "Returns property referred to by property handle "
+           "`h`.") get_property_by_handle;
+  %newobject get_property_by_handle;
+  obj_t *get_property_by_handle(struct _DLitePropertyHandle *h) {
+    if (h->meta != $self->meta)
+      return dlite_err(1, "property handle for %s does not match instance "
+                       "of %s", h->meta->uri, $self->meta->uri), NULL;
+    return dlite_swig_get_property_by_index($self, (int)h->index);
+  }
+
+  %feature("docstring", "Sets property referred to by property handle `h` "
+           "to `obj`.") set_property_by_handle;
+  void set_property_by_handle(struct _DLitePropertyHandle *h, obj_t *obj) {
+    if (h->meta != $self->meta)
+      dlite_err(1, "property handle for %s does not match instance of %s",
+                h->meta->uri, $self->meta->uri);
+    else
+      dlite_swig_set_property_by_index($self, (int)h->index, obj);
+  }
+
   %feature("docstring", "Returns true if this instance has a property with "
            "given name or index.") has_property;
   bool has_property(const char *name) {
@@ -440,6 +513,23 @@ struct _DLiteInstance {
     return (bool)dlite_instance_is_metameta($self);
   }
 
+  %feature("docstring", "Returns true if this instance is frozen.") _is_frozen;
+  bool _is_frozen(void) {
+    return dlite_instance_is_frozen($self);
+  }
+
+  %feature("docstring",
+           "Makes this instance immutable, such that it can be shared "
+           "between threads.  If `meta` is true, the metadata is frozen "
+           "as well.  If `immortal` is true, the frozen instances are "
+           "never free'ed.") freeze;
+  void freeze(bool meta=false, bool immortal=false) {
+    int flags = 0;
+    if (meta) flags |= dliteFreezeMeta;
+    if (immortal) flags |= dliteFreezeImmortal;
+    dlite_instance_freeze($self, flags);
+  }
+
   %feature("docstring",
            "Increase reference count and return the new refcount.") incref;
   int incref(void) {
@@ -18,6 +18,56 @@ struct _DLiteInstance *swig_mapping(const char *output_uri,
                        ninstances);
 }
 
+/* Maps `ninstances/ninput` sets of `ninput` input instances to new
+   instances of `output_uri` with dlite_mapping_map_many().  The input
+   metadata is taken from the first set.  Returns a list of new
+   instances or NULL on error. */
+obj_t *swig_mapping_many(const char *output_uri,
+                         struct _DLiteInstance **instances, int ninstances,
+                         int ninput)
+{
+  int i, n;
+  const char **uris=NULL;
+  DLiteMapping *m=NULL;
+  DLiteInstance **out=NULL;
+  PyObject *lst=NULL, *retval=NULL;
+
+  if (ninput <= 0 || ninstances % ninput)
+    FAIL2("cannot split %d instances into sets of %d", ninstances, ninput);
+  n = ninstances / ninput;
+  for (i=0; i<ninstances; i++)
+    if (!instances[i]) FAIL1("item %d is not a dlite instance", i);
+  if (!(uris = calloc(ninput, sizeof(char *)))) FAIL("allocation failure");
+  for (i=0; i<ninput; i++) uris[i] = instances[i]->meta->uri;
+  if (!(m = dlite_mapping_create(output_uri, uris, ninput))) goto fail;
+  if (!(out = calloc(n, sizeof(DLiteInstance *))))
+    FAIL("allocation failure");
+  if (dlite_mapping_map_many(m, (const DLiteInstance **)instances, ninput,
+                             n, out)) {
+    free(out);
+    out = NULL;
+    goto fail;
+  }
+  if (!(lst = PyList_New(n))) FAIL("cannot create list");
+  for (i=0; i<n; i++) {
+    PyObject *obj = SWIG_NewPointerObj(SWIG_as_voidptr(out[i]),
+                                       SWIGTYPE_p__DLiteInstance,
+                                       SWIG_POINTER_OWN);
+    if (!obj) FAIL("cannot create instance object");
+    PyList_SET_ITEM(lst, i, obj);
+    out[i] = NULL;  /* the reference is now owned by `obj` */
+  }
+  retval = lst;
+ fail:
+  if (!retval) Py_XDECREF(lst);
+  if (out) {
+    for (i=0; i<n; i++) if (out[i]) dlite_instance_decref(out[i]);
+    free(out);
+  }
+  if (m) dlite_mapping_free(m);
+  if (uris) free(uris);
+  return retval;
+}
 
 %}
 
@@ -32,6 +82,27 @@ struct _DLiteInstance *swig_mapping(const char *output_uri,
                                     struct _DLiteInstance **instances,
                                     int ninstances);
 
+%rename(_mapping_many) swig_mapping_many;
+obj_t *swig_mapping_many(const char *output_uri,
+                         struct _DLiteInstance **instances, int ninstances,
+                         int ninput);
+
+%pythoncode %{
+def mapping_many(output_uri, batches):
+    """Maps each set of input instances in `batches` to a new instance
+    of metadata `output_uri` and returns a list with the new instances.
+
+    All sets must have the same metadata in the same order.  Mapping
+    plugins implementing `map_many()` are called once for all sets.
+    """
+    batches = [list(batch) for batch in batches]
+    if not batches:
+        return []
+    return _mapping_many(
+        output_uri, [inst for batch in batches for inst in batch],
+        len(batches[0]))
+%}
+
 %rename("%(strip:[dlite_])s") "";
 
 %feature("docstring", "\
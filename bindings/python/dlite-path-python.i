@@ -22,10 +22,22 @@
 
 
 %pythoncode %{
-storage_path = FUPath("storages")
-storage_plugin_path = FUPath("storage-plugins")
-mapping_plugin_path = FUPath("mapping-plugins")
-python_storage_plugin_path = FUPath("python-storage-plugins")
-python_mapping_plugin_path = FUPath("python-mapping-plugins")
+# The search paths are created on first access, since initialising
+# them reads environment variables and plugin manifests, which would
+# slow down `import dlite`
+_path_types = {
+    "storage_path": "storages",
+    "storage_plugin_path": "storage-plugins",
+    "mapping_plugin_path": "mapping-plugins",
+    "python_storage_plugin_path": "python-storage-plugins",
+    "python_mapping_plugin_path": "python-mapping-plugins",
+}
+
+def __getattr__(name):
+    if name in _path_types:
+        path = FUPath(_path_types[name])
+        globals()[name] = path
+        return path
+    raise AttributeError(f"module 'dlite' has no attribute '{name}'")
 
 %}
@@ -141,18 +141,59 @@ int npy_type(DLiteType type, size_t size)
   case dliteProperty:
   case dliteRelation:
     return NPY_OBJECT;
+  default:
+    if (dlite_type_is_struct(type)) return NPY_VOID;
+    return dlite_err(-1, "no numpy type code for dtype number %d", type);
   }
-  abort();  /* should never be reached */
 }
 
 
+PyArray_Descr *npy_dtype(DLiteType type, size_t size);
+
+/* Returns a new numpy structured PyArray_Descr with the same field
+   names, offsets and itemsize as struct type `st`.  Returns NULL on
+   error. */
+static PyArray_Descr *npy_struct_dtype(const DLiteStruct *st)
+{
+  PyObject *names=NULL, *formats=NULL, *offsets=NULL, *spec=NULL;
+  PyArray_Descr *dtype=NULL;
+  size_t i;
+  if (!(names = PyList_New(st->nfields)) ||
+      !(formats = PyList_New(st->nfields)) ||
+      !(offsets = PyList_New(st->nfields)))
+    FAIL("cannot create lists");
+  for (i=0; i < st->nfields; i++) {
+    const DLiteStructField *f = st->fields + i;
+    PyArray_Descr *fdtype = npy_dtype(f->type, f->size);
+    if (!fdtype) goto fail;
+    PyList_SET_ITEM(names, i, PyUnicode_FromString(f->name));
+    PyList_SET_ITEM(formats, i, (PyObject *)fdtype);
+    PyList_SET_ITEM(offsets, i, PyLong_FromSize_t(f->offset));
+  }
+  if (!(spec = Py_BuildValue("{s:O,s:O,s:O,s:n}", "names", names,
+                             "formats", formats, "offsets", offsets,
+                             "itemsize", (Py_ssize_t)st->size)))
+    FAIL1("cannot create dtype specification for struct %s", st->name);
+  if (!PyArray_DescrConverter(spec, &dtype))
+    FAIL1("cannot create numpy dtype for struct %s", st->name);
+ fail:
+  Py_XDECREF(names);
+  Py_XDECREF(formats);
+  Py_XDECREF(offsets);
+  Py_XDECREF(spec);
+  return dtype;
+}
+
 /* Returns a new numpy PyArray_Descr corresponding to `type` and `size`.
-   Returns NULL on error. */
+   Struct types are returned as structured dtypes.  Returns NULL on
+   error. */
 PyArray_Descr *npy_dtype(DLiteType type, size_t size)
 {
   int typecode = npy_type(type, size);
   PyArray_Descr *dtype;
+  const DLiteStruct *st;
   if (typecode < 0) return NULL;
+  if ((st = dlite_struct_get(type))) return npy_struct_dtype(st);
   if (!(dtype = PyArray_DescrNewFromType(typecode)))
     return dlite_err(-1, "cannot create numpy array description for %s",
                      dlite_type_get_dtypename(type)), NULL;
@@ -176,6 +217,8 @@ PyArray_Descr *npy_dtype(DLiteType type, size_t size)
     //assert(dtype->elsize == 0);
     assert(dtype->elsize == 0 || sizeof(void *));
     break;
+  default:
+    break;
   }
   return dtype;
 }
@@ -209,8 +252,94 @@ void dlite_swig_errclr(void)
 }
 
 
+/* Cache of object arrays converted from properties of type
+   dliteStringPtr, dliteDimension, dliteProperty and dliteRelation, such
+   that repeated access to large properties does not create a new Python
+   object for each item.  Entries are identified by the address, type
+   and shape of the C data.  Dimensions, properties and relations are
+   wrapped as references to the C data, while strings are copied.  Hence
+   a hash of the strings is also compared for dliteStringPtr. */
+#define DLITE_SWIG_ARRAY_CACHE_SIZE 8     /* number of cached arrays */
+#define DLITE_SWIG_ARRAY_CACHE_MINSIZE 256  /* min number of elements */
+
+typedef struct {
+  const void *data;    /* Address of C data, NULL if unused */
+  DLiteType type;      /* Type of C data */
+  size_t size;         /* Size of each C data element */
+  uint64_t hash;       /* Hash of the strings for dliteStringPtr */
+  PyObject *array;     /* Cached object array, without base object */
+} ArrayCacheEntry;
+
+static ArrayCacheEntry array_cache[DLITE_SWIG_ARRAY_CACHE_SIZE];
+static int array_cache_next = 0;
+
+/* Returns a FNV-1a hash of the `n` strings in `strings`. */
+static uint64_t array_cache_hash(char **strings, int n)
+{
+  uint64_t h = 14695981039346656037ULL;
+  int i;
+  for (i=0; i<n; i++) {
+    const unsigned char *p = (const unsigned char *)strings[i];
+    if (p) for (; *p; p++) h = (h ^ *p) * 1099511628211ULL;
+    h = (h ^ ((p) ? 0x100 : 0x200)) * 1099511628211ULL;
+  }
+  return h;
+}
+
+/* Returns a borrowed reference to the cached array for `data` or NULL
+   if it is not in the cache. */
+static PyObject *array_cache_get(const void *data, DLiteType type,
+                                 size_t size, uint64_t hash,
+                                 int ndims, npy_intp *dims)
+{
+  int i;
+  for (i=0; i<DLITE_SWIG_ARRAY_CACHE_SIZE; i++) {
+    ArrayCacheEntry *e = array_cache + i;
+    if (e->data == data && e->type == type && e->size == size &&
+        e->hash == hash &&
+        PyArray_NDIM((PyArrayObject *)e->array) == ndims &&
+        memcmp(PyArray_DIMS((PyArrayObject *)e->array), dims,
+               ndims*sizeof(npy_intp)) == 0)
+      return e->array;
+  }
+  return NULL;
+}
+
+/* Removes cached arrays for `data`. */
+static void array_cache_remove(const void *data)
+{
+  int i;
+  for (i=0; i<DLITE_SWIG_ARRAY_CACHE_SIZE; i++) {
+    if (array_cache[i].data == data) {
+      array_cache[i].data = NULL;
+      Py_CLEAR(array_cache[i].array);
+    }
+  }
+}
+
+/* Adds `array` to the cache, replacing the oldest entry. */
+static void array_cache_add(const void *data, DLiteType type, size_t size,
+                            uint64_t hash, PyObject *array)
+{
+  ArrayCacheEntry *e;
+  array_cache_remove(data);
+  e = array_cache + array_cache_next;
+  array_cache_next = (array_cache_next + 1) % DLITE_SWIG_ARRAY_CACHE_SIZE;
+  Py_XDECREF(e->array);
+  e->data = data;
+  e->type = type;
+  e->size = size;
+  e->hash = hash;
+  e->array = array;
+  Py_INCREF(array);
+}
+
+
 /* Returns a new array object for the target language or NULL on error.
 
+   Arrays of object types owned by `inst` are cached, such that large
+   properties are not converted element by element on every access.
+
    `inst` : The DLite instance that own the data. If NULL, the returned
             array takes over the ownership.
    `ndims`: Number of dimensions.
@@ -242,7 +371,20 @@ obj_t *dlite_swig_get_array(DLiteInstance *inst, int ndims, int *dims,
       npy_intp itemsize;
       char *itemptr;
       PyArrayObject *arr;
+      PyObject *cached;
+      uint64_t hash=0;
       for (i=0; i<ndims; i++) n *= dims[i];
+
+      /* Return a copy of the cached array if the data is unchanged */
+      if (inst && n >= DLITE_SWIG_ARRAY_CACHE_MINSIZE) {
+        if (type == dliteStringPtr) hash = array_cache_hash(data, n);
+        if ((cached = array_cache_get(data, type, size, hash, ndims, d))) {
+          if (!(obj = PyArray_NewCopy((PyArrayObject *)cached, NPY_CORDER)))
+            FAIL("cannot copy cached array");
+          break;
+        }
+      }
+
       if (!(obj = PyArray_EMPTY(ndims, d, typecode, 0)))
         FAIL("not able to create numpy array");
       arr = (PyArrayObject *)obj;
@@ -257,6 +399,15 @@ obj_t *dlite_swig_get_array(DLiteInstance *inst, int ndims, int *dims,
           FAIL1("cannot set item of type %s", dlite_type_get_dtypename(type));
         Py_DECREF(item);
       }
+
+      /* The cached array must not refer to `inst`, so return a copy */
+      if (inst && n >= DLITE_SWIG_ARRAY_CACHE_MINSIZE) {
+        array_cache_add(data, type, size, hash, obj);
+        cached = obj;
+        obj = PyArray_NewCopy(arr, NPY_CORDER);
+        Py_DECREF(cached);
+        if (!obj) FAIL("cannot copy array");
+      }
       break;
     }
 
@@ -264,6 +415,7 @@ obj_t *dlite_swig_get_array(DLiteInstance *inst, int ndims, int *dims,
     { /* All other types */
       PyArray_Descr *dtype = npy_dtype(type, size);
       int flags = NPY_ARRAY_CARRAY;
+      if (inst && dlite_instance_is_frozen(inst)) flags = NPY_ARRAY_CARRAY_RO;
       if (inst) flags |= NPY_ARRAY_OWNDATA;
       if (!(obj = PyArray_NewFromDescr(&PyArray_Type, dtype, ndims, d,
                                        NULL, data, flags, NULL)))
@@ -343,7 +495,15 @@ int dlite_swig_set_array(void *ptr, int ndims, int *dims,
 
   if (typecode < 0) goto fail;
   for (i=0; i<ndims; i++) n *= dims[i];
-  if (!(arr = (PyArrayObject *)PyArray_ContiguousFromAny(obj, typecode, 0, 0)))
+  if (dlite_type_is_struct(type)) {
+    PyArray_Descr *dtype = npy_dtype(type, size);
+    if (!dtype) goto fail;
+    if (!(arr = (PyArrayObject *)PyArray_FromAny(obj, dtype, ndims, ndims,
+                                                 NPY_ARRAY_CARRAY, NULL)))
+      FAIL1("cannot convert to array of struct %s",
+            dlite_struct_get(type)->name);
+  } else if (!(arr = (PyArrayObject *)PyArray_ContiguousFromAny(obj, typecode,
+                                                                0, 0)))
     FAIL("cannot create contiguous array");
 
   /* Check dimensions */
@@ -587,6 +747,14 @@ obj_t *dlite_swig_get_scalar(DLiteType type, size_t size, void *data)
     break;
 
   default:
+    if (dlite_type_is_struct(type)) {
+      /* a numpy structured scalar with a copy of the data */
+      PyArray_Descr *dtype = npy_dtype(type, size);
+      if (!dtype) goto fail;
+      obj = PyArray_Scalar(data, dtype, NULL);
+      Py_DECREF(dtype);
+      break;
+    }
     FAIL1("converting type \"%s\" to scalar is not yet implemented",
          dlite_type_get_dtypename(type));
     break;
@@ -922,6 +1090,27 @@ int dlite_swig_set_scalar(void *ptr, DLiteType type, size_t size, obj_t *obj)
       }
     }
     break;
+
+  default:
+    {
+      /* structs are converted via numpy, e.g. from a tuple */
+      PyArray_Descr *dtype;
+      PyArrayObject *arr;
+      if (!dlite_type_is_struct(type))
+        FAIL1("cannot convert Python object to dtype number %d", type);
+      if (!(dtype = npy_dtype(type, size))) goto fail;
+      if (!(arr = (PyArrayObject *)PyArray_FromAny(obj, dtype, 0, 0,
+                                                   NPY_ARRAY_CARRAY, NULL)))
+        FAIL1("cannot convert Python object to struct %s",
+              dlite_struct_get(type)->name);
+      if (PyArray_SIZE(arr) != 1) {
+        Py_DECREF(arr);
+        FAIL1("expected a single struct %s", dlite_struct_get(type)->name);
+      }
+      memcpy(ptr, PyArray_DATA(arr), size);
+      Py_DECREF(arr);
+    }
+    break;
   }
 
   return 0;
@@ -944,6 +1133,7 @@ obj_t *dlite_swig_get_property_by_index(DLiteInstance *inst, int i)
   if (n < 0 || n >= (int)inst->meta->_nproperties)
     return dlite_err(-1, "Property index is out or range: %d", i), NULL;
   dlite_instance_sync_to_properties(inst);
+  if (dlite_instance_load_property(inst, n)) return NULL;
   ptr = DLITE_PROP(inst, n);
   p = inst->meta->_properties + n;
   if (p->ndims == 0) {
@@ -976,8 +1166,10 @@ int dlite_swig_set_property_by_index(DLiteInstance *inst, int i, obj_t *obj)
   if (n < 0) n += (int)inst->meta->_nproperties;
   if (n < 0 || n >= (int)inst->meta->_nproperties)
     FAIL1("Property index is out or range: %d", i);
-  ptr = DLITE_PROP(inst, n);
+  if (dlite_instance_load_property(inst, n)) goto fail;
+  if (!(ptr = DLITE_PROP_RW(inst, n))) goto fail;
   p = inst->meta->_properties + n;
+  if (p->ndims > 0) array_cache_remove(*(void **)ptr);
 
   if (p->ndims == 0) {
     if (dlite_swig_set_scalar(ptr, p->type, p->size, obj)) goto fail;
@@ -992,6 +1184,7 @@ int dlite_swig_set_property_by_index(DLiteInstance *inst, int i, obj_t *obj)
       goto fail;
   }
   if (dlite_instance_sync_from_properties(inst)) goto fail;
+  if (dlite_instance_mark_dirty_by_index(inst, n)) goto fail;
 
   status = 0;
  fail:
@@ -999,6 +1192,596 @@ int dlite_swig_set_property_by_index(DLiteInstance *inst, int i, obj_t *obj)
   return status;
 }
 
+
+/* Minimal definitions of the DLPack ABI (version 0.8), see
+   https://dmlc.github.io/dlpack/latest/c_api.html */
+typedef struct {
+  int32_t device_type;   /* 1 for CPU */
+  int32_t device_id;
+} DLDevice;
+
+typedef struct {
+  uint8_t code;          /* 0: int, 1: uint, 2: float, 6: bool */
+  uint8_t bits;
+  uint16_t lanes;
+} DLDataType;
+
+typedef struct {
+  void *data;
+  DLDevice device;
+  int32_t ndim;
+  DLDataType dtype;
+  int64_t *shape;
+  int64_t *strides;      /* NULL for compact row-major */
+  uint64_t byte_offset;
+} DLTensor;
+
+typedef struct _DLManagedTensor {
+  DLTensor dl_tensor;
+  void *manager_ctx;
+  void (*deleter)(struct _DLManagedTensor *self);
+} DLManagedTensor;
+
+/* Deleter of DLManagedTensor's created by dlite_swig_get_dlpack().
+   Releases the reference to the instance owning the data. */
+static void dlite_swig_dlpack_deleter(DLManagedTensor *self)
+{
+  dlite_instance_decref((DLiteInstance *)self->manager_ctx);
+  free(self);
+}
+
+/* Destructor of capsules returned by dlite_swig_get_dlpack().  Deletes
+   the tensor if the capsule has not been consumed. */
+static void dlite_swig_dlpack_capsule_free(PyObject *cap)
+{
+  DLManagedTensor *t;
+  if (PyCapsule_IsValid(cap, "dltensor") &&
+      (t = PyCapsule_GetPointer(cap, "dltensor")))
+    t->deleter(t);
+}
+
+/* Returns a DLPack capsule (named "dltensor") sharing the data of
+   property `i` with the consumer, or NULL on error.
+
+   The tensor holds a reference to `inst`, such that the data stays
+   valid until the consumer deletes it. */
+obj_t *dlite_swig_get_dlpack(DLiteInstance *inst, int i)
+{
+  int j, n=i;
+  void *ptr;
+  DLiteProperty *p;
+  DLManagedTensor *t;
+  PyObject *cap;
+  uint8_t code;
+
+  PyErr_Clear();
+  if (n < 0) n += (int)inst->meta->_nproperties;
+  if (n < 0 || n >= (int)inst->meta->_nproperties)
+    return dlite_err(-1, "Property index is out or range: %d", i), NULL;
+  dlite_instance_sync_to_properties(inst);
+  if (dlite_instance_load_property(inst, n)) return NULL;
+  p = inst->meta->_properties + n;
+
+  switch (p->type) {
+  case dliteBool:  code = 6; break;
+  case dliteInt:   code = 0; break;
+  case dliteUInt:  code = 1; break;
+  case dliteFloat: code = 2; break;
+  default:
+    return dlite_err(1, "cannot export property '%s' of type %s with DLPack",
+                     p->name, dlite_type_get_dtypename(p->type)), NULL;
+  }
+  if (p->size > 8)
+    return dlite_err(1, "cannot export property '%s' of size %d with DLPack",
+                     p->name, (int)p->size), NULL;
+
+  ptr = DLITE_PROP(inst, n);
+  if (p->ndims > 0) ptr = *(void **)ptr;
+
+  /* The shape is allocated together with the tensor */
+  if (!(t = calloc(1, sizeof(DLManagedTensor) + p->ndims*sizeof(int64_t))))
+    return dlite_err(dliteMemoryError, "allocation failure"), NULL;
+  t->dl_tensor.data = ptr;
+  t->dl_tensor.device.device_type = 1;
+  t->dl_tensor.ndim = p->ndims;
+  t->dl_tensor.dtype.code = code;
+  t->dl_tensor.dtype.bits = (uint8_t)(8*p->size);
+  t->dl_tensor.dtype.lanes = 1;
+  t->dl_tensor.shape = (int64_t *)(t + 1);
+  for (j=0; j<p->ndims; j++)
+    t->dl_tensor.shape[j] = DLITE_PROP_DIM(inst, n, j);
+  t->manager_ctx = inst;
+  t->deleter = dlite_swig_dlpack_deleter;
+  dlite_instance_incref(inst);
+
+  if (!(cap = PyCapsule_New(t, "dltensor", dlite_swig_dlpack_capsule_free))) {
+    t->deleter(t);
+    return dlite_err(1, "error creating DLPack capsule"), NULL;
+  }
+  return cap;
+}
+
+
+/* Returns the DLite type of the elements of numpy array `arr` if it
+   is a native boolean, integer or float type.  The size is assigned to
+   `*size`.  Returns -1 for all other types. */
+static int npy_simple_type(PyArrayObject *arr, size_t *size)
+{
+  *size = PyArray_ITEMSIZE(arr);
+  if (!PyArray_ISNOTSWAPPED(arr)) return -1;
+  switch (PyArray_DESCR(arr)->kind) {
+  case 'b': return dliteBool;
+  case 'i': return dliteInt;
+  case 'u': return dliteUInt;
+  case 'f': return dliteFloat;
+  }
+  return -1;
+}
+
+/* Returns the distance in bytes between the column properties of
+   consecutive instances in `insts`, which is constant for instances
+   created with dlite_instance_create_many().  `idx` holds the property
+   index for each instance.  Returns zero if the instances are not
+   evenly spaced. */
+static int column_stride(DLiteInstance **insts, int n, const int *idx)
+{
+  int j;
+  ptrdiff_t stride;
+  if (n < 2) return (int)insts[0]->meta->_properties[idx[0]].size;
+  stride = (char *)DLITE_PROP(insts[1], idx[1]) -
+    (char *)DLITE_PROP(insts[0], idx[0]);
+  if (stride == 0 || stride > INT_MAX || stride < -INT_MAX) return 0;
+  for (j=2; j<n; j++)
+    if ((char *)DLITE_PROP(insts[j], idx[j]) !=
+        (char *)DLITE_PROP(insts[0], idx[0]) + j*stride) return 0;
+  return (int)stride;
+}
+
+/* Writes the index of scalar property `name` for each of the `n`
+   instances in `insts` to `idx`.  The index is only looked up when
+   the metadata changes, so heterogeneous instances are supported as
+   long as the property has the same type and size in all metadata.
+
+   Returns the property of the first instance or NULL on error. */
+static DLiteProperty *column_indices(DLiteInstance **insts, int n,
+                                     const char *name, int *idx)
+{
+  int i=-1, j;
+  const DLiteMeta *meta=NULL;
+  DLiteProperty *p=NULL, *q;
+  for (j=0; j<n; j++) {
+    if (!insts[j])
+      return dlite_err(-1, "item %d is not a dlite instance", j), NULL;
+    if (insts[j]->meta != meta) {
+      meta = insts[j]->meta;
+      if ((i = dlite_meta_get_property_index(meta, name)) < 0) return NULL;
+      q = meta->_properties + i;
+      if (q->ndims)
+        return dlite_err(-1, "property '%s' of %s is not a scalar",
+                         name, meta->uri), NULL;
+      if (!p)
+        p = q;
+      else if (q->type != p->type || q->size != p->size)
+        return dlite_err(-1, "property '%s' has different types in %s "
+                         "and %s", name, insts[0]->meta->uri,
+                         meta->uri), NULL;
+    }
+    idx[j] = i;
+  }
+  return p;
+}
+
+/* Decodes the UTF-8 string `s` to `dest` and returns the number of
+   characters.  If `dest` is NULL, only the characters are counted. */
+static size_t utf8_to_ucs4(Py_UCS4 *dest, const char *s)
+{
+  const unsigned char *q = (const unsigned char *)s;
+  size_t n=0;
+  while (*q) {
+    Py_UCS4 c = *q++;
+    int k = 0;
+    if (c >= 0xf0)      { c &= 0x07; k = 3; }
+    else if (c >= 0xe0) { c &= 0x0f; k = 2; }
+    else if (c >= 0xc0) { c &= 0x1f; k = 1; }
+    while (k-- > 0 && (*q & 0xc0) == 0x80) c = (c << 6) | (*q++ & 0x3f);
+    if (dest) dest[n] = c;
+    n++;
+  }
+  return n;
+}
+
+/* Returns a newly allocated UTF-8 encoding of the at most `n` UCS4
+   characters in `s`.  Stops at the first NUL (numpy pads unicode
+   arrays with NUL).  Returns NULL on allocation failure. */
+static char *ucs4_to_utf8(const Py_UCS4 *s, size_t n)
+{
+  size_t i, m=0;
+  char *buf, *q;
+  for (i=0; i<n && s[i]; i++)
+    m += (s[i] < 0x80) ? 1 : (s[i] < 0x800) ? 2 : (s[i] < 0x10000) ? 3 : 4;
+  if (!(buf = malloc(m + 1))) return NULL;
+  for (i=0, q=buf; i<n && s[i]; i++) {
+    Py_UCS4 c = s[i];
+    if (c < 0x80) {
+      *q++ = (char)c;
+    } else if (c < 0x800) {
+      *q++ = (char)(0xc0 | (c >> 6));
+      *q++ = (char)(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      *q++ = (char)(0xe0 | (c >> 12));
+      *q++ = (char)(0x80 | ((c >> 6) & 0x3f));
+      *q++ = (char)(0x80 | (c & 0x3f));
+    } else {
+      *q++ = (char)(0xf0 | (c >> 18));
+      *q++ = (char)(0x80 | ((c >> 12) & 0x3f));
+      *q++ = (char)(0x80 | ((c >> 6) & 0x3f));
+      *q++ = (char)(0x80 | (c & 0x3f));
+    }
+  }
+  *q = '\0';
+  return buf;
+}
+
+/* Returns a new numpy unicode array with the string property with
+   index `idx[j]` of each of the `n` instances in `insts`.  NULL
+   strings become empty strings.  Returns NULL on error. */
+static PyObject *string_column(DLiteInstance **insts, int n, const int *idx)
+{
+  int j;
+  size_t len, maxlen=1;
+  npy_intp d=n;
+  char *data;
+  PyObject *obj;
+  for (j=0; j<n; j++) {
+    char *str = *(char **)DLITE_PROP(insts[j], idx[j]);
+    if (str && (len = utf8_to_ucs4(NULL, str)) > maxlen) maxlen = len;
+  }
+  if (!(obj = PyArray_New(&PyArray_Type, 1, &d, NPY_UNICODE, NULL, NULL,
+                          (int)(maxlen * sizeof(Py_UCS4)), 0, NULL)))
+    return dlite_err(1, "cannot create string array"), NULL;
+  data = PyArray_DATA((PyArrayObject *)obj);
+  memset(data, 0, n * maxlen * sizeof(Py_UCS4));
+  for (j=0; j<n; j++) {
+    char *str = *(char **)DLITE_PROP(insts[j], idx[j]);
+    if (str) utf8_to_ucs4((Py_UCS4 *)(data + j*maxlen*sizeof(Py_UCS4)), str);
+  }
+  return obj;
+}
+
+/* Returns a list of `n` new instances of metadata `metaid` with
+   dimensions `dims`, created with dlite_instance_create_many().  `ids`
+   should be None or a sequence of `n` ids or None.  Returns NULL on
+   error. */
+obj_t *dlite_swig_create_many(const char *metaid, int *dims, int ndims,
+                              int n, obj_t *ids)
+{
+  int i;
+  size_t *d=NULL;
+  const char **cids=NULL;
+  DLiteMeta *meta=NULL;
+  DLiteInstance **insts=NULL;
+  PyObject *lst=NULL, *retval=NULL;
+
+  if (!(meta = dlite_meta_get(metaid)))
+    FAIL1("cannot find metadata '%s'", metaid);
+  if (ndims != (int)meta->_ndimensions)
+    FAIL2("%s has %d dimensions", metaid, (int)meta->_ndimensions);
+  if (!(d = calloc(ndims+1, sizeof(size_t)))) FAIL("allocation failure");
+  for (i=0; i<ndims; i++) d[i] = dims[i];
+
+  if (ids && ids != Py_None) {
+    if (!PySequence_Check(ids) || PySequence_Length(ids) != n)
+      FAIL1("`ids` must be a sequence of length %d", n);
+    if (!(cids = calloc(n+1, sizeof(char *)))) FAIL("allocation failure");
+    for (i=0; i<n; i++) {
+      PyObject *id = PySequence_GetItem(ids, i);
+      if (id && PyUnicode_Check(id)) cids[i] = PyUnicode_AsUTF8(id);
+      Py_XDECREF(id);  /* the string is owned by `ids` */
+    }
+  }
+
+  if (!(insts = dlite_instance_create_many(meta, d, n, cids))) goto fail;
+  if (!(lst = PyList_New(n))) FAIL("cannot create list");
+  for (i=0; i<n; i++) {
+    PyObject *obj = SWIG_NewPointerObj(SWIG_as_voidptr(insts[i]),
+                                       SWIGTYPE_p__DLiteInstance,
+                                       SWIG_POINTER_OWN);
+    if (!obj) FAIL("cannot create instance object");
+    PyList_SET_ITEM(lst, i, obj);
+    insts[i] = NULL;  /* the reference is now owned by `obj` */
+  }
+  retval = lst;
+ fail:
+  if (!retval) Py_XDECREF(lst);
+  if (insts) {
+    for (i=0; i<n; i++) if (insts[i]) dlite_instance_decref(insts[i]);
+    free(insts);
+  }
+  if (cids) free(cids);
+  if (d) free(d);
+  if (meta) dlite_meta_decref(meta);
+  return retval;
+}
+
+/* Assigns scalar property `name` of the `ninstances` instances in
+   `instances` from the elements of the one-dimensional array `obj`.
+   The instances may have different metadata, see column_indices().
+
+   For boolean and numerical types, the column is converted with a
+   single call to dlite_type_ndcast() if the instances are evenly spaced
+   in memory and cast element by element otherwise.  Numpy unicode and
+   bytes arrays are assigned to string properties directly.  Only other
+   types are assigned via Python objects.
+
+   Returns non-zero on error. */
+int dlite_swig_set_column(struct _DLiteInstance **instances,
+                          int ninstances, const char *name, obj_t *obj)
+{
+  int j, stride, type, retval=-1, *idx=NULL;
+  size_t size, n=ninstances;
+  char kind;
+  DLiteProperty *p;
+  PyArrayObject *arr=NULL;
+
+  if (ninstances == 0) return 0;
+  if (!(idx = calloc(ninstances, sizeof(int))))
+    return dlite_err(dliteMemoryError, "allocation failure");
+  if (!(p = column_indices(instances, ninstances, name, idx))) goto fail;
+
+  if (!(arr = (PyArrayObject *)PyArray_FromAny(obj, NULL, 1, 1,
+                                               NPY_ARRAY_CARRAY_RO, NULL)))
+    FAIL1("cannot convert column '%s' to a one-dimensional array", name);
+  if (PyArray_DIM(arr, 0) != ninstances)
+    FAIL3("column '%s' has %ld elements, expected %d",
+          name, (long)PyArray_DIM(arr, 0), ninstances);
+  for (j=0; j<ninstances; j++)
+    if (!DLITE_PROP_RW(instances[j], idx[j])) goto fail;
+
+  type = npy_simple_type(arr, &size);
+  kind = PyArray_DESCR(arr)->kind;
+  if (type >= 0 && (p->type == dliteBool || p->type == dliteInt ||
+                    p->type == dliteUInt || p->type == dliteFloat)) {
+    if ((stride = column_stride(instances, ninstances, idx))) {
+      int sstride = (int)size;
+      if (dlite_type_ndcast(1, DLITE_PROP(instances[0], idx[0]), p->type,
+                            p->size, &n, &stride, PyArray_DATA(arr), type,
+                            size, &n, &sstride, NULL)) goto fail;
+    } else {
+      for (j=0; j<ninstances; j++)
+        if (dlite_type_copy_cast(DLITE_PROP(instances[j], idx[j]), p->type,
+                                 p->size, PyArray_GETPTR1(arr, j), type,
+                                 size)) goto fail;
+    }
+  } else if (p->type == dliteStringPtr && (kind == 'U' || kind == 'S') &&
+             PyArray_ISNOTSWAPPED(arr)) {
+    size_t itemsize = PyArray_ITEMSIZE(arr);
+    for (j=0; j<ninstances; j++) {
+      char **ptr = DLITE_PROP(instances[j], idx[j]);
+      const char *item = PyArray_GETPTR1(arr, j);
+      char *str = (kind == 'U') ?
+        ucs4_to_utf8((const Py_UCS4 *)item, itemsize / sizeof(Py_UCS4)) :
+        strndup(item, itemsize);
+      if (!str) FAIL("allocation failure");
+      if (*ptr) free(*ptr);
+      *ptr = str;
+    }
+  } else {
+    for (j=0; j<ninstances; j++) {
+      PyObject *item = PyArray_GETITEM(arr, PyArray_GETPTR1(arr, j));
+      int stat;
+      if (!item) FAIL2("cannot get item %d of column '%s'", j, name);
+      stat = dlite_swig_set_scalar(DLITE_PROP(instances[j], idx[j]), p->type,
+                                   p->size, item);
+      Py_DECREF(item);
+      if (stat) goto fail;
+    }
+  }
+
+  for (j=0; j<ninstances; j++) {
+    if (dlite_instance_sync_from_properties(instances[j])) goto fail;
+    if (dlite_instance_mark_dirty_by_index(instances[j], idx[j])) goto fail;
+  }
+  retval = 0;
+ fail:
+  Py_XDECREF(arr);
+  if (idx) free(idx);
+  return retval;
+}
+
+/* Returns a new one-dimensional array with scalar property `name` of
+   the `ninstances` instances in `instances`, or NULL on error.  The
+   instances may have different metadata, see column_indices().
+
+   Boolean and numerical columns are copied with a single call to
+   dlite_type_ndcast() if the instances are evenly spaced in memory and
+   gathered element by element otherwise.  String columns are returned
+   as numpy unicode arrays.  Only blobs and other types are converted
+   via Python objects. */
+obj_t *dlite_swig_get_column(struct _DLiteInstance **instances,
+                             int ninstances, const char *name)
+{
+  int j, stride, *idx=NULL;
+  size_t n=ninstances;
+  npy_intp d=ninstances;
+  DLiteProperty *p;
+  PyObject *obj=NULL, *lst=NULL;
+
+  if (ninstances == 0) return PyArray_SimpleNew(1, &d, NPY_DOUBLE);
+  if (!(idx = calloc(ninstances, sizeof(int))))
+    return dlite_err(dliteMemoryError, "allocation failure"), NULL;
+  if (!(p = column_indices(instances, ninstances, name, idx))) goto fail;
+  for (j=0; j<ninstances; j++) dlite_instance_sync_to_properties(instances[j]);
+
+  switch (p->type) {
+  case dliteBool:
+  case dliteInt:
+  case dliteUInt:
+  case dliteFloat:
+    {
+      int dstride = (int)p->size, typecode = npy_type(p->type, p->size);
+      char *data;
+      if (typecode < 0) goto fail;
+      if (!(obj = PyArray_SimpleNew(1, &d, typecode)))
+        FAIL("cannot create array");
+      data = PyArray_DATA((PyArrayObject *)obj);
+      if ((stride = column_stride(instances, ninstances, idx))) {
+        if (dlite_type_ndcast(1, data, p->type, p->size, &n, &dstride,
+                              DLITE_PROP(instances[0], idx[0]), p->type,
+                              p->size, &n, &stride, NULL)) goto fail;
+      } else {
+        for (j=0; j<ninstances; j++)
+          memcpy(data + j*p->size, DLITE_PROP(instances[j], idx[j]),
+                 p->size);
+      }
+    }
+    free(idx);
+    return obj;
+  case dliteStringPtr:
+    obj = string_column(instances, ninstances, idx);
+    free(idx);
+    return obj;
+  case dliteDimension:
+  case dliteProperty:
+  case dliteRelation:
+    FAIL2("columns of type %s are not supported: '%s'",
+          dlite_type_get_dtypename(p->type), name);
+  default:
+    break;
+  }
+
+  /* Convert element by element */
+  if (!(lst = PyList_New(ninstances))) FAIL("cannot create list");
+  for (j=0; j<ninstances; j++) {
+    PyObject *item = dlite_swig_get_scalar(p->type, p->size,
+                                           DLITE_PROP(instances[j], idx[j]));
+    if (!item) goto fail;
+    PyList_SET_ITEM(lst, j, item);
+  }
+  if (p->type == dliteBlob) {
+    if (!(obj = PyArray_SimpleNew(1, &d, NPY_OBJECT)))
+      FAIL("cannot create array");
+    for (j=0; j<ninstances; j++)
+      if (PyArray_SETITEM((PyArrayObject *)obj,
+                          PyArray_GETPTR1((PyArrayObject *)obj, j),
+                          PyList_GET_ITEM(lst, j))) goto fail;
+  } else {
+    obj = PyArray_FROM_O(lst);
+  }
+  Py_DECREF(lst);
+  free(idx);
+  return obj;
+ fail:
+  Py_XDECREF(lst);
+  Py_XDECREF(obj);
+  if (idx) free(idx);
+  return NULL;
+}
+
+
+/* Capsule destructors following the Arrow PyCapsule interface */
+static void arrow_schema_capsule_destructor(PyObject *capsule)
+{
+  struct ArrowSchema *s = PyCapsule_GetPointer(capsule, "arrow_schema");
+  if (s && s->release) s->release(s);
+  free(s);
+}
+
+static void arrow_array_capsule_destructor(PyObject *capsule)
+{
+  struct ArrowArray *a = PyCapsule_GetPointer(capsule, "arrow_array");
+  if (a && a->release) a->release(a);
+  free(a);
+}
+
+/*
+  Exports `instances` to Arrow.  Returns a tuple with an "arrow_schema"
+  and an "arrow_array" capsule, as specified by the Arrow PyCapsule
+  interface.  `metaid` gives the metadata if `instances` is empty.
+*/
+obj_t *dlite_swig_to_arrow(struct _DLiteInstance **instances,
+                           int ninstances, const char *metaid)
+{
+  DLiteMeta *meta=NULL;
+  struct ArrowSchema *schema=NULL;
+  struct ArrowArray *array=NULL;
+  PyObject *cschema=NULL, *carray=NULL, *retval=NULL;
+  int stat;
+
+  if (metaid && !(meta = dlite_meta_get(metaid)))
+    FAIL1("cannot find metadata '%s'", metaid);
+  if (!(schema = calloc(1, sizeof(struct ArrowSchema))) ||
+      !(array = calloc(1, sizeof(struct ArrowArray))))
+    FAIL("allocation failure");
+  Py_BEGIN_ALLOW_THREADS
+  stat = dlite_arrow_export(meta, instances, ninstances, schema, array);
+  Py_END_ALLOW_THREADS
+  if (stat) goto fail;
+  if (!(cschema = PyCapsule_New(schema, "arrow_schema",
+                                arrow_schema_capsule_destructor)))
+    goto fail;
+  schema = NULL;
+  if (!(carray = PyCapsule_New(array, "arrow_array",
+                               arrow_array_capsule_destructor)))
+    goto fail;
+  array = NULL;
+  retval = PyTuple_Pack(2, cschema, carray);
+ fail:
+  if (schema) {
+    if (schema->release) schema->release(schema);
+    free(schema);
+  }
+  if (array) {
+    if (array->release) array->release(array);
+    free(array);
+  }
+  Py_XDECREF(cschema);
+  Py_XDECREF(carray);
+  if (meta) dlite_meta_decref(meta);
+  return retval;
+}
+
+/*
+  Returns a list of new instances of `metaid` created from the Arrow
+  capsules `schema` and `array`, one instance per row.
+*/
+obj_t *dlite_swig_from_arrow(const char *metaid, obj_t *schema, obj_t *array)
+{
+  DLiteMeta *meta=NULL;
+  DLiteInstance **insts=NULL;
+  struct ArrowSchema *s;
+  struct ArrowArray *a;
+  PyObject *lst=NULL, *retval=NULL;
+  size_t i, n=0;
+
+  if (!(s = PyCapsule_GetPointer(schema, "arrow_schema")) ||
+      !(a = PyCapsule_GetPointer(array, "arrow_array")))
+    FAIL("expected \"arrow_schema\" and \"arrow_array\" capsules");
+  if (!(meta = dlite_meta_get(metaid)))
+    FAIL1("cannot find metadata '%s'", metaid);
+  Py_BEGIN_ALLOW_THREADS
+  insts = dlite_arrow_import(meta, s, a, &n);
+  Py_END_ALLOW_THREADS
+  if (!insts) goto fail;
+  if (!(lst = PyList_New(n))) FAIL("cannot create list");
+  for (i=0; i<n; i++) {
+    PyObject *obj = SWIG_NewPointerObj(SWIG_as_voidptr(insts[i]),
+                                       SWIGTYPE_p__DLiteInstance,
+                                       SWIG_POINTER_OWN);
+    if (!obj) FAIL("cannot create instance object");
+    PyList_SET_ITEM(lst, i, obj);
+    insts[i] = NULL;  /* the reference is now owned by `obj` */
+  }
+  retval = lst;
+ fail:
+  if (!retval) Py_XDECREF(lst);
+  if (insts) {
+    for (i=0; i<n; i++) if (insts[i]) dlite_instance_decref(insts[i]);
+    free(insts);
+  }
+  if (meta) dlite_meta_decref(meta);
+  return retval;
+}
+
 %}
 
 
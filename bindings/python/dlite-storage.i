@@ -130,6 +130,29 @@ matches `pattern`.  If `pattern` is None, all UUIDs will be returned.
     return dlite_storage_uuids($self, pattern);
   }
 
+  %feature("docstring", "\
+Enables or disables write-behind.  With write-behind enabled, saved
+instances are only recorded as pending and written in one batch when
+the storage is flushed or closed, when the pending instances exceed
+`maxbytes` bytes (if non-zero) or when a save is made more than
+`interval` seconds after the oldest pending save (if positive).
+Repeated saves of the same instance are coalesced.
+") set_write_behind;
+  status_t set_write_behind(bool enable=true, size_t maxbytes=0,
+                            double interval=0.0) {
+    return dlite_storage_set_write_behind($self, enable, maxbytes, interval);
+  }
+
+  %feature("docstring", "Writes all pending instances.") flush;
+  status_t flush(void) {
+    return dlite_storage_flush($self);
+  }
+
+  %feature("docstring", "Returns the number of pending instances.") pending;
+  size_t pending(void) {
+    return dlite_storage_pending($self);
+  }
+
   //StorageIterator *instances(const char *pattern=NULL) {
   //  return StorageIterator
   //}
@@ -1,6 +1,8 @@
 /* -*- C -*-  (not really, but good for syntax highlighting) */
 
 %{
+  #include <ctype.h>
+
   status_t from_typename(const char *typename, int *type, int *size) {
     size_t v = 0;
     status_t retval =
@@ -12,13 +14,50 @@
   char *to_typename(int type, int size) {
     char *s;
     if (size < 0) return dlite_err(1, "size must be non-negative"), NULL;
-    if (!(s = malloc(16))) return NULL;
-    if (dlite_type_set_typename(type, size, s, 16)) {
+    if (!(s = malloc(DLITE_STRUCT_NAME_SIZE))) return NULL;
+    if (dlite_type_set_typename(type, size, s, DLITE_STRUCT_NAME_SIZE)) {
       free(s);
       return NULL;
     }
     return s;
   }
+
+  /* Strips leading and trailing whitespace from `s` in place. */
+  static char *strip_space(char *s) {
+    char *end;
+    while (isspace((unsigned char)*s)) s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+  }
+
+  int register_struct(const char *name, const char *fields) {
+    DLiteStructField *f=NULL;
+    char *buf=NULL, *p, *q;
+    size_t n=0, i;
+    int dtype=-1;
+    if (!(buf = strdup(fields))) return dlite_err(-1, "allocation failure");
+    for (p=buf; *p; p++) if (*p == ',') n++;
+    if (!(f = calloc(n+1, sizeof(DLiteStructField)))) {
+      free(buf);
+      return dlite_err(-1, "allocation failure");
+    }
+    for (i=0, p=strtok(buf, ","); p; i++, p=strtok(NULL, ",")) {
+      if (!(q = strchr(p, ':'))) {
+        dlite_err(-1, "struct fields must be given as name:type: '%s'", p);
+        goto fail;
+      }
+      *q++ = '\0';
+      f[i].name = strip_space(p);
+      if (dlite_type_set_dtype_and_size(strip_space(q), &f[i].type,
+                                        &f[i].size)) goto fail;
+    }
+    dtype = dlite_struct_register(name, i, f);
+   fail:
+    free(f);
+    free(buf);
+    return dtype;
+  }
 %}
 
 
@@ -39,9 +78,23 @@ enum _DLiteType {
   dliteDimension,        /*!< Dimension, for entities */
   dliteProperty,         /*!< Property, for entities */
   dliteRelation,         /*!< Subject-predicate-object relation */
+
+  dliteStruct            /*!< First registered struct type */
 };
 
 
+%feature("docstring", """
+Registers a struct type called `name` and returns its dtype number.
+
+`fields` is a comma-separated string of `name:type` pairs, like
+"x:float64, y:float64, charge:int32".  The types must be blob, bool,
+int, uint, float, fixstring or registered struct types.  The fields
+are laid out like in the corresponding C struct, and struct
+properties are accessed as numpy structured arrays.
+""") register_struct;
+int register_struct(const char *name, const char *fields);
+
+
 %apply int *OUTPUT { int *type, int *size };
 status_t from_typename(const char *typename, int *type, int *size);
 
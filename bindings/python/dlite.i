@@ -74,6 +74,38 @@
   }
 }
 
+/* %dlite_nogil(decl) releases the Python global interpreter lock (GIL)
+ * while calling the wrapped function `decl`, such that other Python
+ * threads can run during storage I/O and mappings.  Only use it for
+ * functions that do not call the Python C API.  Plugins written in
+ * Python re-acquire the GIL with dlite_pyembed_gil_ensure(). */
+#ifdef SWIGPYTHON
+%define %dlite_nogil(decl)
+%exception decl {
+  dlite_swig_errclr();
+  Py_BEGIN_ALLOW_THREADS
+  $action
+  Py_END_ALLOW_THREADS
+  if (dlite_errval()) {
+    PyErr_SetString(DLiteError, dlite_errmsg());
+    SWIG_fail;
+  }
+}
+%enddef
+#else
+%define %dlite_nogil(decl)
+%enddef
+#endif
+
+%dlite_nogil(_DLiteStorage::_DLiteStorage);
+%dlite_nogil(_DLiteStorage::~_DLiteStorage);
+%dlite_nogil(_DLiteStorage::get_uuids);
+%dlite_nogil(_DLiteInstance::_DLiteInstance);
+%dlite_nogil(_DLiteInstance::save);
+%dlite_nogil(_DLiteCollection::save);
+%dlite_nogil(dlite_swig_get_instance);
+%dlite_nogil(swig_mapping);
+
 
 /**********************************************
  ** Generic typemaps
@@ -93,6 +125,7 @@
 %include "dlite-type.i"
 %include "dlite-storage.i"
 %include "dlite-entity.i"
+%include "dlite-async.i"
 %include "dlite-collection.i"
 %include "dlite-path.i"
 %include "dlite-mapping.i"
@@ -14,6 +14,14 @@ class Person2SimplePerson(DLiteMappingBase):
         simple.age = person.age
         return simple
 
+    def map_many(self, batches):
+        persons = [instances[0] for instances in batches]
+        columns = {
+            "name": dlite.get_column(persons, "name"),
+            "age": dlite.get_column(persons, "age"),
+        }
+        return dlite.Instance.from_table(self.output_uri, columns, rows=True)
+
 
 class SimplePerson2Person(DLiteMappingBase):
     name = "SimplePerson2Person"
@@ -0,0 +1,44 @@
+"""Storage plugin used for testing the view interface of Python storage
+plugins.  A single instance is stored in a numpy npz file."""
+import json
+
+import numpy as np
+
+
+class npzview(DLiteStorageBase):  # noqa: F821
+    """Stores an instance in a npz file using save_view(), load_layout()
+    and load_into()."""
+
+    def open(self, location, options=None):
+        self.location = location
+
+    def close(self):
+        pass
+
+    def save_view(self, view):
+        """Stores the instance viewed by `view`."""
+        props = view.instance.asdict()['properties']
+        header = {
+            'uuid': view.uuid,
+            'meta': view.meta,
+            'dimensions': view.dimensions,
+            'other': {name: props[name] for name in view.names
+                      if name not in view.arraynames},
+        }
+        arrays = {name: view[name] for name in view.arraynames}
+        with open(self.location, 'wb') as f:
+            np.savez(f, __header__=json.dumps(header), **arrays)
+
+    def load_layout(self, uuid):
+        """Returns metadata, dimensions and id of the stored instance."""
+        self.data = np.load(self.location)
+        self.header = json.loads(str(self.data['__header__']))
+        return (self.header['meta'], self.header['dimensions'],
+                self.header['uuid'])
+
+    def load_into(self, view):
+        """Fills the instance viewed by `view` in place."""
+        for name in view.arraynames:
+            view[name] = self.data[name]
+        for name, value in self.header['other'].items():
+            view.instance[name] = value
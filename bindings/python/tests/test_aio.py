@@ -0,0 +1,44 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import os
+import asyncio
+
+import dlite
+
+thisdir = os.path.abspath(os.path.dirname(__file__))
+
+Person = dlite.Instance('json://' + os.path.join(thisdir, 'SimplePerson.json'))
+
+
+async def roundtrip(i):
+    inst = Person([])
+    inst.name = 'Person %d' % i
+    inst.age = 10.0 + i
+    url = 'json://aio-%d.json?mode=w' % i
+    await inst.asave(url)
+    loaded = await dlite.aio.load('json://aio-%d.json?mode=r#%s' %
+                                  (i, inst.uuid))
+    assert loaded.uuid == inst.uuid
+    assert loaded.name == 'Person %d' % i
+    assert loaded.age == 10.0 + i
+    return loaded
+
+
+async def main():
+    # Concurrent tasks overlap their I/O
+    loaded = await asyncio.gather(*[roundtrip(i) for i in range(8)])
+    assert len(loaded) == 8
+
+    # Errors are propagated to the awaiting coroutine
+    try:
+        await dlite.aio.load('json://aio-0.json?mode=r#no-such-id')
+    except dlite.DLiteError:
+        pass
+    else:
+        assert False, 'expected DLiteError for missing instance'
+
+
+asyncio.run(main())
+
+for i in range(8):
+    os.remove('aio-%d.json' % i)
@@ -1,6 +1,7 @@
 #!/usr/bin/env python
 # -*- coding: utf-8 -*-
 import os
+import sys
 import pickle
 
 import dlite
@@ -59,6 +60,123 @@ inst['a-relation-array'] = [
     dlite.Relation('cat', 'is_a', 'mammal'),
     ]
 
+# Property handles
+h = dlite.PropertyHandle(myentity, 'an-int')
+assert myentity['properties'][h.index].name == 'an-int'
+assert h.ndims == 0
+assert inst[h] == 42
+inst[h] = 43
+assert inst['an-int'] == 43
+inst.set_property_by_handle(h, 42)
+assert inst.get_property_by_handle(h) == 42
+harr = dlite.PropertyHandle(myentity, 'a-float64-array')
+assert list(inst[harr]) == [3.14, 5.0, 42.3]
+
+# Attribute access to properties and dimensions
+assert getattr(inst, 'an-int') == 42
+assert getattr(inst, 'a-float64-array').tolist() == [3.14, 5.0, 42.3]
+assert inst.N == 2 and inst.M == 3
+setattr(inst, 'an-int', 44)
+assert inst['an-int'] == 44
+setattr(inst, 'an-int', 42)
+inst.extra = 'not a property'
+assert inst.extra == 'not a property'
+assert not inst.has_property('extra')
+try:
+    inst.no_such_attribute
+except AttributeError:
+    pass
+else:
+    assert False, 'expected AttributeError'
+
+import numpy as np
+view = inst.view('a-float64-array')
+assert np.all(np.asarray(view) == [3.14, 5.0, 42.3])
+mv = view.memoryview
+assert mv.format == 'd' and mv.shape == (3, )
+if hasattr(np, 'from_dlpack'):
+    arr = np.from_dlpack(view)
+    assert arr.tolist() == [3.14, 5.0, 42.3]
+    arr[1] = 6.0  # shares memory with the instance
+    assert inst['a-float64-array'][1] == 6.0
+    inst['a-float64-array'][1] = 5.0
+    assert np.from_dlpack(inst.view('an-int-array')).tolist() == [1, 2, 3]
+try:
+    inst.view('a-string-array').__dlpack__()
+except dlite.DLiteError:
+    pass
+else:
+    assert False, 'expected DLiteError for DLPack export of strings'
+
+# Check creating instances from tables
+SimplePerson = Instance('json://' + thisdir + '/SimplePerson.json')
+table = np.array([('Ada', 12.5), ('Ole', 40.0), ('Ida', 7.0)],
+                 dtype=[('name', 'O'), ('age', 'f8')])
+persons = Instance.from_table(SimplePerson, table, rows=True)
+assert len(persons) == 3
+assert persons[1].name == 'Ole'
+assert persons[2].age == 7.0
+rows = dlite.instances_to_table(persons)
+assert rows['age'].tolist() == [12.5, 40.0, 7.0]
+assert rows['name'].tolist() == ['Ada', 'Ole', 'Ida']
+
+# Frozen instances
+frozen = persons[0]
+frozen.freeze()
+assert frozen.is_frozen
+try:
+    frozen.age = 13.0
+except dlite.DLiteError:
+    pass
+else:
+    assert False, 'frozen instance should not be writable'
+assert frozen.age == 12.5
+
+# Check column access across separately created instances
+people = [SimplePerson([]) for _ in range(3)]
+dlite.set_column(people, 'age', [1.5, 2.5, 3.5])
+dlite.set_column(people, 'name', np.array(['Ann', 'Bj\xf8rn', 'C']))
+assert people[1].name == 'Bj\xf8rn'
+assert dlite.get_column(people, 'age').tolist() == [1.5, 2.5, 3.5]
+names = dlite.get_column(people + persons, 'name')
+assert names.dtype.kind == 'U'
+assert names.tolist() == ['Ann', 'Bj\xf8rn', 'C', 'Ada', 'Ole', 'Ida']
+
+cols = Instance.from_table(myentity, {'an-int-array': [4, 5],
+                                      'a-float64-array': [1.5, 2.5]})
+assert cols.dimensions == {'N': 2, 'M': 0}
+t = cols.to_table(['an-int-array', 'a-float64-array'])
+assert t['an-int-array'].tolist() == [4, 5]
+assert t['a-float64-array'].tolist() == [1.5, 2.5]
+del cols
+
+# Check exchange with Apache Arrow
+try:
+    import pyarrow as pa
+except ImportError:
+    pa = None
+if pa is not None:
+    batch = dlite.to_arrow(persons)
+    assert batch.num_rows == 3
+    assert batch.column('name').to_pylist() == ['Ada', 'Ole', 'Ida']
+    assert batch.column('age').to_pylist() == [12.5, 40.0, 7.0]
+    persons2 = dlite.from_arrow(SimplePerson, batch)
+    assert [p.name for p in persons2] == ['Ada', 'Ole', 'Ida']
+    assert persons2[1].age == 40.0
+    Person = Instance('json://' + thisdir + '/Person.json')
+    person = Instance(Person.uri, [2])
+    person.name = 'Ada'
+    person.skills = ['maths', 'programming']
+    arr = dlite.to_arrow([person])
+    assert arr.column('skills').to_pylist() == [['maths', 'programming']]
+    person2, = dlite.from_arrow(Person, pa.Table.from_batches([arr]))
+    assert person2.dimensions == {'N': 2}
+    assert person2.skills.tolist() == ['maths', 'programming']
+else:
+    schema, array = dlite.ArrowExport(persons).__arrow_c_array__()
+    persons2 = dlite.dlite._from_arrow(SimplePerson.uri, schema, array)
+    assert [p.name for p in persons2] == ['Ada', 'Ole', 'Ida']
+
 # Print the value of all properties
 for i in range(len(inst)):
     print('prop%d:' % i, inst[i])
@@ -74,6 +192,23 @@ inst2 = Instance('json://inst.json')
 s = pickle.dumps(inst)
 inst3 = pickle.loads(s)
 
+# Check pickling with protocol 5 and out-of-band buffers
+buffers = []
+s = pickle.dumps(inst, protocol=5, buffer_callback=buffers.append)
+assert buffers
+inst4 = pickle.loads(s, buffers=buffers)
+assert inst4.uuid == inst.uuid
+assert np.all(inst4['a-float64-array'] == inst['a-float64-array'])
+
+# Check pickling via shared memory
+if sys.platform != 'win32':
+    with dlite.shm_pickling() as shm:
+        s = pickle.dumps(inst)
+        assert len(s) < 400
+        assert shm.namespace.encode() in s
+        inst5 = pickle.loads(s)
+    assert np.all(inst5['a-float64-array'] == inst['a-float64-array'])
+
 dim = Dimension('N')
 
 prop = Property("a", type='float')
@@ -0,0 +1,51 @@
+#!/usr/bin/env python
+"""Checks that `import dlite` stays fast.
+
+The time for importing dlite is measured in fresh interpreters and
+compared to importing numpy, which the extension module requires
+anyway.  The budget (in seconds) for the additional time may be set
+with the DLITE_IMPORT_BUDGET environment variable.
+"""
+import os
+import subprocess
+import sys
+import time
+
+
+budget = float(os.environ.get('DLITE_IMPORT_BUDGET', '0.5'))
+
+
+def import_time(module, repeat=3):
+    """Returns the shortest wall time of importing `module` in a new
+    interpreter, minus the startup time of the interpreter itself."""
+    def run(code):
+        t0 = time.perf_counter()
+        subprocess.run([sys.executable, '-c', code], check=True)
+        return time.perf_counter() - t0
+    startup = min(run('pass') for _ in range(repeat))
+    return min(run(f'import {module}') for _ in range(repeat)) - startup
+
+
+# Nothing that is only needed on first use should be loaded on import
+code = '''
+import sys
+import dlite
+swig = sys.modules['dlite.dlite']
+loaded = [name for name in ('dlite.factory', 'dlite.aio', 'asyncio')
+          if name in sys.modules]
+assert not loaded, f'loaded on import: {loaded}'
+paths = [name for name in swig._path_types if name in vars(swig)]
+assert not paths, f'search paths created on import: {paths}'
+assert len(dlite.storage_path) >= 0
+assert 'storage_path' in vars(swig)
+assert dlite.classfactory is not None
+'''
+subprocess.run([sys.executable, '-c', code], check=True)
+
+t_numpy = import_time('numpy')
+t_dlite = import_time('dlite')
+print(f'import numpy: {t_numpy:.3f} s')
+print(f'import dlite: {t_dlite:.3f} s')
+assert t_dlite - t_numpy < budget, (
+    f'importing dlite takes {t_dlite - t_numpy:.3f} s more than numpy, '
+    f'budget is {budget} s')
@@ -40,3 +40,19 @@ assert p != person
 assert p.meta == person.meta
 assert p.name == person.name
 assert p.age == person.age
+
+
+# Map several persons at once.  Person2SimplePerson implements
+# map_many(), which is called once for all of them
+persons = [Person(dims=[0]) for i in range(3)]
+for i, p in enumerate(persons):
+    p.name = f'Person {i}'
+    p.age = 20 + i
+simples = dlite.mapping_many('http://onto-ns.com/meta/0.1/SimplePerson',
+                             [[p] for p in persons])
+assert len(simples) == 3
+for p, s in zip(persons, simples):
+    assert s.meta.uri == 'http://onto-ns.com/meta/0.1/SimplePerson'
+    assert s.name == p.name
+    assert s.age == p.age
+assert dlite.mapping_many('http://onto-ns.com/meta/0.1/SimplePerson', []) == []
@@ -0,0 +1,55 @@
+import os
+
+import numpy as np
+
+import dlite
+from dlite.utils import instance_from_dict
+
+
+thisdir = os.path.abspath(os.path.dirname(__file__))
+dlite.python_storage_plugin_path.append(f'{thisdir}/python-storage-plugins')
+
+ViewEntity = instance_from_dict({
+    'uri': 'http://onto-ns.com/meta/0.1/ViewEntity',
+    'meta': 'http://onto-ns.com/meta/0.3/EntitySchema',
+    'description': 'Entity for testing views in storage plugins.',
+    'dimensions': [
+        {'name': 'N', 'description': 'First dimension.'},
+        {'name': 'M', 'description': 'Second dimension.'},
+    ],
+    'properties': [
+        {'name': 'an-int', 'type': 'int32', 'description': 'An int.'},
+        {'name': 'floats', 'type': 'float64', 'dims': ['N', 'M'],
+         'description': 'A float array.'},
+        {'name': 'bools', 'type': 'bool', 'dims': ['M'],
+         'description': 'A bool array.'},
+        {'name': 'fixstrings', 'type': 'string5', 'dims': ['N'],
+         'description': 'A fixstring array.'},
+        {'name': 'name', 'type': 'string', 'description': 'A string.'},
+        {'name': 'words', 'type': 'string', 'dims': ['N'],
+         'description': 'A string array.'},
+    ],
+})
+
+inst = ViewEntity(dims=[2, 3])
+inst['an-int'] = 42
+inst.floats = np.arange(6.0).reshape(2, 3)
+inst.bools = [True, False, True]
+inst.fixstrings = ['Al', 'Mg']
+inst.name = 'view'
+inst.words = ['a', 'bc']
+uuid = inst.uuid
+inst.save('npzview://test_storage_view.npz')
+del inst
+
+with dlite.Storage('npzview', 'test_storage_view.npz') as s:
+    inst = s.load(id=uuid)
+assert inst.uuid == uuid
+assert inst.meta.uri == ViewEntity.uri
+assert inst.dimensions == {'N': 2, 'M': 3}
+assert inst['an-int'] == 42
+assert np.all(inst.floats == np.arange(6.0).reshape(2, 3))
+assert list(inst.bools) == [True, False, True]
+assert list(inst.fixstrings) == ['Al', 'Mg']
+assert inst.name == 'view'
+assert list(inst.words) == ['a', 'bc']
@@ -130,7 +130,7 @@ macro(dlite_codegen output template url)
     if(TARGET dlite-codegen)
       set(DLITE_CODEGEN $<TARGET_FILE:dlite-codegen>)
       list(APPEND codegen_dependencies dlite dlite-codegen)
-      if(WITH_JSON)
+      if(WITH_JSON AND TARGET dlite-plugins-json)
         list(APPEND codegen_dependencies dlite-plugins-json)
       endif()
     else()
@@ -0,0 +1,54 @@
+# -- Function compiling a storage plugin into the dlite libraries
+#
+# dlite_static_plugin(name
+#                     SOURCES sources...
+#                     [INCLUDE_DIRS dirs...]
+#                     [LIBRARIES libs...])
+#
+#   Compiles the sources of storage plugin `name` into the dlite and
+#   dlite-static libraries.  The plugin function is renamed to
+#   `dlite_static_<name>_storage_plugin_api()`, such that it can be
+#   registered from the table of statically linked storage plugins in
+#   src/dlite-storage-plugins.c.
+#
+#   This function is intended to be called from the CMakeLists.txt file
+#   of the plugin when WITH_STATIC_PLUGINS is true.
+#
+# Arguments:
+#   name
+#       Name of the plugin, e.g. "json"
+#   SOURCES sources...
+#       Source files of the plugin
+#   INCLUDE_DIRS dirs...
+#       Additional include directories needed by the plugin
+#   LIBRARIES libs...
+#       Additional libraries that the plugin links to
+
+function(dlite_static_plugin name)
+  cmake_parse_arguments(ARG "" "" "SOURCES;INCLUDE_DIRS;LIBRARIES" ${ARGN})
+
+  set(target dlite-plugins-${name}-objects)
+  add_library(${target} OBJECT ${ARG_SOURCES})
+  target_compile_definitions(${target} PRIVATE
+    HAVE_CONFIG_H
+    get_dlite_storage_plugin_api=dlite_static_${name}_storage_plugin_api
+    )
+  target_include_directories(${target} PRIVATE
+    ${CMAKE_CURRENT_BINARY_DIR}
+    ${dlite_SOURCE_DIR}/src
+    ${dlite_BINARY_DIR}/src
+    ${dlite_SOURCE_DIR}/src/utils
+    ${dlite_BINARY_DIR}/src/utils
+    ${ARG_INCLUDE_DIRS}
+    )
+  set_target_properties(${target} PROPERTIES
+    POSITION_INDEPENDENT_CODE ON
+    )
+
+  target_sources(dlite PRIVATE $<TARGET_OBJECTS:${target}>)
+  target_sources(dlite-static PRIVATE $<TARGET_OBJECTS:${target}>)
+  if(ARG_LIBRARIES)
+    target_link_libraries(dlite ${ARG_LIBRARIES})
+    target_link_libraries(dlite-static ${ARG_LIBRARIES})
+  endif()
+endfunction()
@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #ifdef HAVE_STDARG_H
@@ -8,6 +9,9 @@
 #endif
 
 #include "utils/err.h"
+#include "utils/integers.h"
+#include "utils/floats.h"
+#include "utils/boolean.h"
 #include "dlite.h"
 #include "dlite-macros.h"
 #include "dlite-arrays.h"
@@ -169,7 +173,7 @@ void *dlite_array_iter_next(DLiteArrayIter *iter)
 {
   int n;
   DLiteArray *arr = (DLiteArray *)iter->arr;
-  if (iter->ind[0] < 0) return NULL;  /* check stop indicator */
+  if (iter->ind[0] < -1) return NULL;  /* check stop indicator */
   for (n=arr->ndims-1; n>=0; n--)
     if (arr->dims[n] <= 0) return NULL;  /* check that all dimensions has
 					    positive length */
@@ -178,7 +182,8 @@ void *dlite_array_iter_next(DLiteArrayIter *iter)
     iter->ind[n] = 0;
   }
   if (n < 0) {
-    iter->ind[0] = -1;  /* stop indicator */
+    iter->ind[0] = -2;  /* stop indicator, -1 is the initial index of
+                           1D arrays */
     return NULL;
   }
   return dlite_array_index(arr, iter->ind);
@@ -205,6 +210,155 @@ int dlite_array_compare(const DLiteArray *a, const DLiteArray *b)
 }
 
 
+/* Side length of the tiles used when copying or transposing 2D blocks */
+#define ARRAY_TILE 32
+
+/* Maximum number of dimensions handled without allocating memory */
+#define ARRAY_MAXDIMS 16
+
+/* Copies an element of size `size` from `src` to `dest`.  Constant
+   sizes allow the compiler to replace memcpy() with a single move. */
+#define COPY_ELEMENT(dest, src, size)                                   \
+  do {                                                                  \
+    switch (size) {                                                     \
+    case 1: *(char *)(dest) = *(const char *)(src); break;              \
+    case 2: memcpy(dest, src, 2); break;                                \
+    case 4: memcpy(dest, src, 4); break;                                \
+    case 8: memcpy(dest, src, 8); break;                                \
+    case 16: memcpy(dest, src, 16); break;                              \
+    default: memcpy(dest, src, size); break;                            \
+    }                                                                   \
+  } while (0)
+
+/* Copies a 2D block of `ni` x `nj` elements of size `size`.  Element
+   (i, j) is located at `i*ds0 + j*ds1` in `dest` and at `i*ss0 + j*ss1`
+   in `src`.  The block is copied in tiles, such that transposed memory
+   layouts are copied cache-efficiently. */
+static void copy_block(char *dest, int ds0, int ds1,
+                       const char *src, int ss0, int ss1,
+                       size_t ni, size_t nj, size_t size)
+{
+  size_t i, j, ib, jb, iend, jend;
+  for (ib=0; ib<ni; ib+=ARRAY_TILE) {
+    iend = (ib + ARRAY_TILE < ni) ? ib + ARRAY_TILE : ni;
+    for (jb=0; jb<nj; jb+=ARRAY_TILE) {
+      jend = (jb + ARRAY_TILE < nj) ? jb + ARRAY_TILE : nj;
+      for (i=ib; i<iend; i++) {
+        char *d = dest + (ptrdiff_t)i*ds0 + (ptrdiff_t)jb*ds1;
+        const char *q = src + (ptrdiff_t)i*ss0 + (ptrdiff_t)jb*ss1;
+        for (j=jb; j<jend; j++, d+=ds1, q+=ss1) COPY_ELEMENT(d, q, size);
+      }
+    }
+  }
+}
+
+/*
+  Copies an n-dimensional array with dimensions `dims` and elements of
+  size `size` from `src` to `dest`.  The memory layout of the source
+  and destination are given by `src_strides` and `dest_strides`.
+
+  Returns non-zero on error.
+*/
+int dlite_array_copy_strided(int ndims, const size_t *dims, size_t size,
+                             void *dest, const int *dest_strides,
+                             const void *src, const int *src_strides)
+{
+  size_t dbuf[ARRAY_MAXDIMS], ibuf[ARRAY_MAXDIMS], *d=dbuf, *ind=ibuf;
+  int sbuf[2*ARRAY_MAXDIMS], *ds=sbuf, *ss=sbuf+ARRAY_MAXDIMS;
+  int i, m=0, nouter;
+  size_t run;
+  void *mem=NULL;
+
+  if (ndims > ARRAY_MAXDIMS) {
+    if (!(mem = malloc(ndims * (2*sizeof(size_t) + 2*sizeof(int)))))
+      return err(1, "allocation failure");
+    d = mem;
+    ind = d + ndims;
+    ds = (int *)(ind + ndims);
+    ss = ds + ndims;
+  }
+
+  /* Remove dimensions of length one and merge dimensions that can be
+     traversed with a single stride in both arrays */
+  for (i=0; i<ndims; i++) {
+    if (dims[i] == 0) goto done;
+    if (dims[i] == 1) continue;
+    if (m > 0 &&
+        ds[m-1] == dest_strides[i] * (int)dims[i] &&
+        ss[m-1] == src_strides[i] * (int)dims[i]) {
+      d[m-1] *= dims[i];
+      ds[m-1] = dest_strides[i];
+      ss[m-1] = src_strides[i];
+    } else {
+      d[m] = dims[i];
+      ds[m] = dest_strides[i];
+      ss[m] = src_strides[i];
+      m++;
+    }
+  }
+
+  if (m == 0) {
+    COPY_ELEMENT(dest, src, size);
+    goto done;
+  }
+
+  /* The innermost dimension is either copied with memcpy() (if it is
+     contiguous in both arrays) or together with the next outer
+     dimension as a tiled 2D block */
+  run = (ds[m-1] == (int)size && ss[m-1] == (int)size);
+  nouter = (run || m == 1) ? m - 1 : m - 2;
+  memset(ind, 0, nouter * sizeof(size_t));
+  while (1) {
+    char *dp = dest;
+    const char *sp = src;
+    for (i=0; i<nouter; i++) {
+      dp += (ptrdiff_t)ind[i] * ds[i];
+      sp += (ptrdiff_t)ind[i] * ss[i];
+    }
+    if (run)
+      memcpy(dp, sp, d[m-1] * size);
+    else if (m == 1)
+      copy_block(dp, 0, ds[0], sp, 0, ss[0], 1, d[0], size);
+    else
+      copy_block(dp, ds[m-2], ds[m-1], sp, ss[m-2], ss[m-1],
+                 d[m-2], d[m-1], size);
+
+    for (i=nouter-1; i>=0; i--) {
+      if (++ind[i] < d[i]) break;
+      ind[i] = 0;
+    }
+    if (i < 0) break;
+  }
+
+ done:
+  if (mem) free(mem);
+  return 0;
+}
+
+
+/*
+  Copies the elements of `src` to `dest`.  The arrays must have the
+  same type, element size and dimensions, but may have different
+  memory layout.  Elements are copied bitwise.
+
+  Returns non-zero on error.
+ */
+int dlite_array_copy(DLiteArray *dest, const DLiteArray *src)
+{
+  int i;
+  if (dest->type != src->type || dest->size != src->size)
+    return err(1, "cannot copy arrays of different types");
+  if (dest->ndims != src->ndims)
+    return err(1, "cannot copy arrays with different number of dimensions");
+  for (i=0; i < dest->ndims; i++)
+    if (dest->dims[i] != src->dims[i])
+      return err(1, "cannot copy arrays with different dimensions");
+  return dlite_array_copy_strided(src->ndims, src->dims, src->size,
+                                  dest->data, dest->strides,
+                                  src->data, src->strides);
+}
+
+
 #define abs(x) (((x) > 0) ? (x) : -(x))
 
 /*
@@ -316,6 +470,46 @@ DLiteArray *dlite_array_transpose(DLiteArray *arr)
 }
 
 
+/*
+  Transposes the square 2D array `arr` in-place, that is swaps
+  element (i, j) with element (j, i).  The memory layout described by
+  `arr` is unchanged.
+
+  Returns non-zero on error.
+ */
+int dlite_array_transpose_inplace(DLiteArray *arr)
+{
+  size_t i, j, ib, jb, iend, jend, k, n;
+  int s0, s1;
+  char *data = arr->data;
+  if (arr->ndims != 2 || arr->dims[0] != arr->dims[1])
+    return err(1, "in-place transpose requires a square 2D array");
+  n = arr->dims[0];
+  s0 = arr->strides[0];
+  s1 = arr->strides[1];
+
+  /* Swap the tiles above the diagonal with the tiles below */
+  for (ib=0; ib<n; ib+=ARRAY_TILE) {
+    iend = (ib + ARRAY_TILE < n) ? ib + ARRAY_TILE : n;
+    for (jb=ib; jb<n; jb+=ARRAY_TILE) {
+      jend = (jb + ARRAY_TILE < n) ? jb + ARRAY_TILE : n;
+      for (i=ib; i<iend; i++) {
+        for (j=(jb == ib) ? i+1 : jb; j<jend; j++) {
+          char *p = data + (ptrdiff_t)i*s0 + (ptrdiff_t)j*s1;
+          char *q = data + (ptrdiff_t)j*s0 + (ptrdiff_t)i*s1;
+          for (k=0; k < arr->size; k++) {
+            char tmp = p[k];
+            p[k] = q[k];
+            q[k] = tmp;
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+
 /*
   Creates a continuous copy of the data for `arr` (using malloc()) and
   updates `arr`.
@@ -324,29 +518,33 @@ DLiteArray *dlite_array_transpose(DLiteArray *arr)
  */
 void *dlite_array_make_continuous(DLiteArray *arr)
 {
-  int n, size=arr->size;
-  void *data, *p;
-  char *q;
-  DLiteArrayIter iter;
+  int n, size=arr->size, *strides;
+  void *data;
   for (n=0; n < arr->ndims; n++) size *= arr->dims[n];
   if (!(data = malloc(size))) return err(1, "allocation failure"), NULL;
   if (dlite_array_is_continuous(arr)) return memcpy(data, arr->data, size);
 
-  q = data;
-  dlite_array_iter_init(&iter, arr);
-  while ((p = dlite_array_iter_next(&iter))) {
-    memcpy(q, p, arr->size);
-    q += arr->size;
+  /* Copy to C-continuous layout */
+  if (!(strides = malloc(arr->ndims * sizeof(int)))) {
+    free(data);
+    return err(1, "allocation failure"), NULL;
   }
-  dlite_array_iter_deinit(&iter);
-
-  /* Update `arr` */
-  arr->data = data;
   size = arr->size;
   for (n=arr->ndims-1; n>=0; n--) {
-    arr->strides[n] = size;
+    strides[n] = size;
     size *= arr->dims[n];
   }
+  if (dlite_array_copy_strided(arr->ndims, arr->dims, arr->size,
+                               data, strides, arr->data, arr->strides)) {
+    free(strides);
+    free(data);
+    return NULL;
+  }
+
+  /* Update `arr` */
+  arr->data = data;
+  memcpy(arr->strides, strides, arr->ndims * sizeof(int));
+  free(strides);
   return data;
 }
 
@@ -384,3 +582,480 @@ int dlite_array_printf(FILE *fp, const DLiteArray *arr, int width, int prec)
   dlite_array_iter_deinit(&iter);
   return 0;
 }
+
+
+/**************************************************************
+ * Numerical kernels
+ **************************************************************/
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define ARRAY_SSE2
+#include <emmintrin.h>
+#endif
+
+/* Returns the element of type `type` and size `size` at `p` as a double. */
+static double array_get(const void *p, DLiteType type, size_t size)
+{
+  switch (type) {
+  case dliteBool:
+    return (*(const bool *)p) ? 1.0 : 0.0;
+  case dliteInt:
+    switch (size) {
+    case 1: return *(const int8_t *)p;
+    case 2: return *(const int16_t *)p;
+    case 4: return *(const int32_t *)p;
+    case 8: return (double)*(const int64_t *)p;
+    }
+    break;
+  case dliteUInt:
+    switch (size) {
+    case 1: return *(const uint8_t *)p;
+    case 2: return *(const uint16_t *)p;
+    case 4: return *(const uint32_t *)p;
+    case 8: return (double)*(const uint64_t *)p;
+    }
+    break;
+  case dliteFloat:
+    switch (size) {
+    case 4: return *(const float32_t *)p;
+    case 8: return *(const float64_t *)p;
+    }
+    break;
+  default:
+    break;
+  }
+  return 0.0;
+}
+
+/* Stores `v` as an element of type `type` and size `size` at `p`.
+   Integers are rounded to nearest. */
+static void array_set(void *p, DLiteType type, size_t size, double v)
+{
+  double r = (v < 0) ? v - 0.5 : v + 0.5;
+  switch (type) {
+  case dliteBool:
+    *(bool *)p = (v != 0.0);
+    break;
+  case dliteInt:
+    switch (size) {
+    case 1: *(int8_t *)p = (int8_t)r; break;
+    case 2: *(int16_t *)p = (int16_t)r; break;
+    case 4: *(int32_t *)p = (int32_t)r; break;
+    case 8: *(int64_t *)p = (int64_t)r; break;
+    }
+    break;
+  case dliteUInt:
+    switch (size) {
+    case 1: *(uint8_t *)p = (uint8_t)r; break;
+    case 2: *(uint16_t *)p = (uint16_t)r; break;
+    case 4: *(uint32_t *)p = (uint32_t)r; break;
+    case 8: *(uint64_t *)p = (uint64_t)r; break;
+    }
+    break;
+  case dliteFloat:
+    switch (size) {
+    case 4: *(float32_t *)p = (float32_t)v; break;
+    case 8: *(float64_t *)p = v; break;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+/* Returns non-zero with an error message if the elements of `arr` are
+   not numbers supported by the numerical kernels. */
+static int array_check_numeric(const DLiteArray *arr)
+{
+  switch (arr->type) {
+  case dliteBool:
+    if (arr->size == sizeof(bool)) return 0;
+    break;
+  case dliteInt:
+  case dliteUInt:
+    if (arr->size == 1 || arr->size == 2 || arr->size == 4 || arr->size == 8)
+      return 0;
+    break;
+  case dliteFloat:
+    if (arr->size == 4 || arr->size == 8) return 0;
+    break;
+  default:
+    break;
+  }
+  return errx(dliteValueError, "numerical kernels are not supported for "
+              "arrays of %s%d", dlite_type_get_dtypename(arr->type),
+              (int)arr->size*8);
+}
+
+/* Returns the number of elements in `arr`. */
+static size_t array_nelem(const DLiteArray *arr)
+{
+  int n;
+  size_t N=1;
+  for (n=0; n < arr->ndims; n++) N *= arr->dims[n];
+  return N;
+}
+
+/* Returns non-zero if `a` and `b` have the same dimensions. */
+static int array_samedims(const DLiteArray *a, const DLiteArray *b)
+{
+  int n;
+  if (a->ndims != b->ndims) return 0;
+  for (n=0; n < a->ndims; n++)
+    if (a->dims[n] != b->dims[n]) return 0;
+  return 1;
+}
+
+/* Reduces `n` contiguous float64 values. */
+static void reduce_float64(const float64_t *v, size_t n,
+                           double *sum, double *min, double *max)
+{
+  size_t i=0;
+  double s=0.0, lo=v[0], hi=v[0];
+#ifdef ARRAY_SSE2
+  if (n >= 4) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    __m128d l = _mm_loadu_pd(v), h = l;
+    double buf[2];
+    for (; i+4 <= n; i+=4) {
+      __m128d a = _mm_loadu_pd(v+i), b = _mm_loadu_pd(v+i+2);
+      s0 = _mm_add_pd(s0, a);
+      s1 = _mm_add_pd(s1, b);
+      l = _mm_min_pd(l, _mm_min_pd(a, b));
+      h = _mm_max_pd(h, _mm_max_pd(a, b));
+    }
+    _mm_storeu_pd(buf, _mm_add_pd(s0, s1));
+    s = buf[0] + buf[1];
+    _mm_storeu_pd(buf, l);
+    lo = (buf[0] < buf[1]) ? buf[0] : buf[1];
+    _mm_storeu_pd(buf, h);
+    hi = (buf[0] > buf[1]) ? buf[0] : buf[1];
+  }
+#endif
+  for (; i<n; i++) {
+    s += v[i];
+    if (v[i] < lo) lo = v[i];
+    if (v[i] > hi) hi = v[i];
+  }
+  *sum = s;
+  *min = lo;
+  *max = hi;
+}
+
+/* Reduces `n` contiguous float32 values.  The sum is accumulated in
+   double precision. */
+static void reduce_float32(const float32_t *v, size_t n,
+                           double *sum, double *min, double *max)
+{
+  size_t i=0;
+  double s=0.0;
+  float32_t lo=v[0], hi=v[0];
+#ifdef ARRAY_SSE2
+  if (n >= 4) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    __m128 l = _mm_loadu_ps(v), h = l;
+    float buf[4];
+    double dbuf[2];
+    for (; i+4 <= n; i+=4) {
+      __m128 a = _mm_loadu_ps(v+i);
+      s0 = _mm_add_pd(s0, _mm_cvtps_pd(a));
+      s1 = _mm_add_pd(s1, _mm_cvtps_pd(_mm_movehl_ps(a, a)));
+      l = _mm_min_ps(l, a);
+      h = _mm_max_ps(h, a);
+    }
+    _mm_storeu_pd(dbuf, _mm_add_pd(s0, s1));
+    s = dbuf[0] + dbuf[1];
+    _mm_storeu_ps(buf, l);
+    lo = buf[0];
+    if (buf[1] < lo) lo = buf[1];
+    if (buf[2] < lo) lo = buf[2];
+    if (buf[3] < lo) lo = buf[3];
+    _mm_storeu_ps(buf, h);
+    hi = buf[0];
+    if (buf[1] > hi) hi = buf[1];
+    if (buf[2] > hi) hi = buf[2];
+    if (buf[3] > hi) hi = buf[3];
+  }
+#endif
+  for (; i<n; i++) {
+    s += v[i];
+    if (v[i] < lo) lo = v[i];
+    if (v[i] > hi) hi = v[i];
+  }
+  *sum = s;
+  *min = lo;
+  *max = hi;
+}
+
+/*
+  Reduces all elements of numerical array `arr` according to `op` and
+  stores the result in `result`.
+
+  Returns non-zero on error.
+ */
+int dlite_array_reduce(const DLiteArray *arr, DLiteArrayReduce op,
+                       double *result)
+{
+  size_t N;
+  double sum=0.0, min=0.0, max=0.0;
+  if (array_check_numeric(arr)) return dliteValueError;
+  N = array_nelem(arr);
+  if (N == 0) {
+    if (op == dliteArraySum) return *result = 0.0, 0;
+    return errx(dliteIndexError, "cannot reduce empty array");
+  }
+
+  if (dlite_array_is_continuous(arr) && arr->type == dliteFloat &&
+      arr->size == 8) {
+    reduce_float64(arr->data, N, &sum, &min, &max);
+  } else if (dlite_array_is_continuous(arr) && arr->type == dliteFloat &&
+             arr->size == 4) {
+    reduce_float32(arr->data, N, &sum, &min, &max);
+  } else {
+    DLiteArrayIter iter;
+    void *p;
+    int first=1;
+    if (dlite_array_iter_init(&iter, arr)) return dliteMemoryError;
+    while ((p = dlite_array_iter_next(&iter))) {
+      double v = array_get(p, arr->type, arr->size);
+      sum += v;
+      if (first || v < min) min = v;
+      if (first || v > max) max = v;
+      first = 0;
+    }
+    dlite_array_iter_deinit(&iter);
+  }
+
+  switch (op) {
+  case dliteArraySum:  *result = sum;     break;
+  case dliteArrayMin:  *result = min;     break;
+  case dliteArrayMax:  *result = max;     break;
+  case dliteArrayMean: *result = sum / N; break;
+  default: return errx(dliteValueError, "invalid reduction: %d", op);
+  }
+  return 0;
+}
+
+
+/*
+  Replaces each element `x` of numerical array `arr` with
+  `scale*x + offset`.
+
+  Returns non-zero on error.
+ */
+int dlite_array_scale(DLiteArray *arr, double scale, double offset)
+{
+  size_t i=0, N;
+  if (array_check_numeric(arr)) return dliteValueError;
+  N = array_nelem(arr);
+
+  if (dlite_array_is_continuous(arr) && arr->type == dliteFloat &&
+      arr->size == 8) {
+    float64_t *v = arr->data;
+#ifdef ARRAY_SSE2
+    __m128d a = _mm_set1_pd(scale), b = _mm_set1_pd(offset);
+    for (; i+2 <= N; i+=2)
+      _mm_storeu_pd(v+i, _mm_add_pd(_mm_mul_pd(a, _mm_loadu_pd(v+i)), b));
+#endif
+    for (; i<N; i++) v[i] = scale*v[i] + offset;
+  } else if (dlite_array_is_continuous(arr) && arr->type == dliteFloat &&
+             arr->size == 4) {
+    float32_t *v = arr->data;
+#ifdef ARRAY_SSE2
+    __m128d a = _mm_set1_pd(scale), b = _mm_set1_pd(offset);
+    for (; i+4 <= N; i+=4) {
+      __m128 x = _mm_loadu_ps(v+i);
+      __m128d lo = _mm_add_pd(_mm_mul_pd(a, _mm_cvtps_pd(x)), b);
+      __m128d hi = _mm_add_pd(_mm_mul_pd(a, _mm_cvtps_pd(_mm_movehl_ps(x, x))),
+                              b);
+      _mm_storeu_ps(v+i, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+    }
+#endif
+    for (; i<N; i++) v[i] = (float32_t)(scale*v[i] + offset);
+  } else {
+    DLiteArrayIter iter;
+    void *p;
+    if (dlite_array_iter_init(&iter, arr)) return dliteMemoryError;
+    while ((p = dlite_array_iter_next(&iter)))
+      array_set(p, arr->type, arr->size,
+                scale*array_get(p, arr->type, arr->size) + offset);
+    dlite_array_iter_deinit(&iter);
+  }
+  return 0;
+}
+
+
+/*
+  Replaces each element `y` of numerical array `y` with `a*x + y`,
+  where `x` is the corresponding element of `x`.
+
+  Returns non-zero on error.
+ */
+int dlite_array_axpy(DLiteArray *y, double a, const DLiteArray *x)
+{
+  size_t i=0, N;
+  if (array_check_numeric(y) || array_check_numeric(x))
+    return dliteValueError;
+  if (!array_samedims(x, y))
+    return errx(dliteIndexError, "axpy requires arrays of same shape");
+  N = array_nelem(y);
+
+  if (dlite_array_is_continuous(x) && dlite_array_is_continuous(y) &&
+      x->type == dliteFloat && x->size == 8 &&
+      y->type == dliteFloat && y->size == 8) {
+    float64_t *yv = y->data;
+    const float64_t *xv = x->data;
+#ifdef ARRAY_SSE2
+    __m128d av = _mm_set1_pd(a);
+    for (; i+2 <= N; i+=2)
+      _mm_storeu_pd(yv+i, _mm_add_pd(_mm_mul_pd(av, _mm_loadu_pd(xv+i)),
+                                     _mm_loadu_pd(yv+i)));
+#endif
+    for (; i<N; i++) yv[i] += a*xv[i];
+  } else {
+    DLiteArrayIter xiter, yiter;
+    void *p, *q;
+    if (dlite_array_iter_init(&xiter, x)) return dliteMemoryError;
+    if (dlite_array_iter_init(&yiter, y)) {
+      dlite_array_iter_deinit(&xiter);
+      return dliteMemoryError;
+    }
+    while ((p = dlite_array_iter_next(&yiter)) &&
+           (q = dlite_array_iter_next(&xiter)))
+      array_set(p, y->type, y->size, a*array_get(q, x->type, x->size) +
+                array_get(p, y->type, y->size));
+    dlite_array_iter_deinit(&yiter);
+    dlite_array_iter_deinit(&xiter);
+  }
+  return 0;
+}
+
+
+/*
+  Compares each element of numerical array `arr` with `value` using
+  comparison operator `op` and writes the result to `mask`, which must
+  have space for one bool per element of `arr`.  The mask is written
+  in C order.
+
+  Returns non-zero on error.
+ */
+int dlite_array_mask(const DLiteArray *arr, DLiteArrayCompare op,
+                     double value, bool *mask)
+{
+  size_t i=0, N;
+  DLiteArrayIter iter;
+  void *p;
+  if (array_check_numeric(arr)) return dliteValueError;
+  if (op < dliteArrayEq || op > dliteArrayGe)
+    return errx(dliteValueError, "invalid comparison operator: %d", op);
+  N = array_nelem(arr);
+
+  if (dlite_array_is_continuous(arr) && arr->type == dliteFloat &&
+      arr->size == 8) {
+    const float64_t *v = arr->data;
+#ifdef ARRAY_SSE2
+    __m128d b = _mm_set1_pd(value);
+    for (; i+2 <= N; i+=2) {
+      __m128d a = _mm_loadu_pd(v+i), c;
+      int bits;
+      switch (op) {
+      case dliteArrayEq: c = _mm_cmpeq_pd(a, b);  break;
+      case dliteArrayNe: c = _mm_cmpneq_pd(a, b); break;
+      case dliteArrayLt: c = _mm_cmplt_pd(a, b);  break;
+      case dliteArrayLe: c = _mm_cmple_pd(a, b);  break;
+      case dliteArrayGt: c = _mm_cmpgt_pd(a, b);  break;
+      default:           c = _mm_cmpge_pd(a, b);  break;
+      }
+      bits = _mm_movemask_pd(c);
+      mask[i] = bits & 1;
+      mask[i+1] = (bits >> 1) & 1;
+    }
+#endif
+    for (; i<N; i++) {
+      switch (op) {
+      case dliteArrayEq: mask[i] = (v[i] == value); break;
+      case dliteArrayNe: mask[i] = (v[i] != value); break;
+      case dliteArrayLt: mask[i] = (v[i] < value);  break;
+      case dliteArrayLe: mask[i] = (v[i] <= value); break;
+      case dliteArrayGt: mask[i] = (v[i] > value);  break;
+      default:           mask[i] = (v[i] >= value); break;
+      }
+    }
+    return 0;
+  }
+
+  if (dlite_array_iter_init(&iter, arr)) return dliteMemoryError;
+  while ((p = dlite_array_iter_next(&iter))) {
+    double v = array_get(p, arr->type, arr->size);
+    switch (op) {
+    case dliteArrayEq: mask[i] = (v == value); break;
+    case dliteArrayNe: mask[i] = (v != value); break;
+    case dliteArrayLt: mask[i] = (v < value);  break;
+    case dliteArrayLe: mask[i] = (v <= value); break;
+    case dliteArrayGt: mask[i] = (v > value);  break;
+    default:           mask[i] = (v >= value); break;
+    }
+    i++;
+  }
+  dlite_array_iter_deinit(&iter);
+  return 0;
+}
+
+
+/*
+  Returns 1 if numerical arrays `a` and `b` have the same shape and
+  all elements satisfy `|a - b| <= atol + rtol*|b|`, zero if they
+  don't and a negative value on error.
+ */
+int dlite_array_compare_tol(const DLiteArray *a, const DLiteArray *b,
+                            double rtol, double atol)
+{
+  size_t i=0, N;
+  int retval=1;
+  if (array_check_numeric(a) || array_check_numeric(b))
+    return dliteRuntimeError;
+  if (!array_samedims(a, b)) return 0;
+  N = array_nelem(a);
+
+  if (dlite_array_is_continuous(a) && dlite_array_is_continuous(b) &&
+      a->type == dliteFloat && a->size == 8 &&
+      b->type == dliteFloat && b->size == 8) {
+    const float64_t *av = a->data, *bv = b->data;
+#ifdef ARRAY_SSE2
+    __m128d r = _mm_set1_pd(rtol), t = _mm_set1_pd(atol);
+    __m128d absmask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+    for (; i+2 <= N; i+=2) {
+      __m128d x = _mm_loadu_pd(av+i), y = _mm_loadu_pd(bv+i);
+      __m128d d = _mm_and_pd(_mm_sub_pd(x, y), absmask);
+      __m128d lim = _mm_add_pd(t, _mm_mul_pd(r, _mm_and_pd(y, absmask)));
+      if (_mm_movemask_pd(_mm_cmple_pd(d, lim)) != 3) return 0;
+    }
+#endif
+    for (; i<N; i++) {
+      double d = av[i] - bv[i];
+      double y = (bv[i] < 0) ? -bv[i] : bv[i];
+      if (!((d < 0 ? -d : d) <= atol + rtol*y)) return 0;
+    }
+  } else {
+    DLiteArrayIter aiter, biter;
+    void *p, *q;
+    if (dlite_array_iter_init(&aiter, a)) return dliteRuntimeError;
+    if (dlite_array_iter_init(&biter, b)) {
+      dlite_array_iter_deinit(&aiter);
+      return dliteRuntimeError;
+    }
+    while ((p = dlite_array_iter_next(&aiter)) &&
+           (q = dlite_array_iter_next(&biter))) {
+      double x = array_get(p, a->type, a->size);
+      double y = array_get(q, b->type, b->size);
+      double d = (x > y) ? x - y : y - x;
+      if (!(d <= atol + rtol*((y < 0) ? -y : y))) {
+        retval = 0;
+        break;
+      }
+    }
+    dlite_array_iter_deinit(&biter);
+    dlite_array_iter_deinit(&aiter);
+  }
+  return retval;
+}
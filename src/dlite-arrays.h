@@ -8,7 +8,8 @@
   The DLiteArray structure adds some basic functionality for accessing
   multidimensional array data.  It it not a complete array library and
   do no memory management.  It is neither optimised for speed, so don't
-  use it for writing optimised solvers.
+  use it for writing optimised solvers.  The numerical kernels do,
+  however, use SIMD instructions for contiguous float arrays.
 
   Included features:
     - indexing
@@ -16,9 +17,12 @@
     - comparisons
     - reshaping
     - slicing
-    - transpose
+    - transpose (also in-place for square matrices)
+    - copying between memory layouts
     - make_continuous
     - pretty printing
+    - numerical kernels: reductions, scale/offset, axpy, comparison
+      masks and comparison with tolerance
  */
 
 #include <stdio.h>
@@ -40,6 +44,25 @@ typedef struct _DLiteArray {
 } DLiteArray;
 
 
+/** Reductions supported by dlite_array_reduce(). */
+typedef enum _DLiteArrayReduce {
+  dliteArraySum,   /*!< sum of all elements */
+  dliteArrayMin,   /*!< smallest element */
+  dliteArrayMax,   /*!< largest element */
+  dliteArrayMean   /*!< arithmetic mean of all elements */
+} DLiteArrayReduce;
+
+/** Comparison operators supported by dlite_array_mask(). */
+typedef enum _DLiteArrayCompare {
+  dliteArrayEq,    /*!< equal */
+  dliteArrayNe,    /*!< not equal */
+  dliteArrayLt,    /*!< less than */
+  dliteArrayLe,    /*!< less than or equal */
+  dliteArrayGt,    /*!< greater than */
+  dliteArrayGe     /*!< greater than or equal */
+} DLiteArrayCompare;
+
+
 /** Array iterator object. */
 typedef struct _DLiteArrayIter {
   const DLiteArray *arr;  /*!< pointer to the array we are iterating over */
@@ -195,6 +218,40 @@ DLiteArray *dlite_array_reshape(const DLiteArray *arr,
  */
 DLiteArray *dlite_array_transpose(DLiteArray *arr);
 
+/**
+  Transposes the square 2D array `arr` in-place, that is swaps
+  element (i, j) with element (j, i).  The memory layout described by
+  `arr` is unchanged.
+
+  Returns non-zero on error.
+ */
+int dlite_array_transpose_inplace(DLiteArray *arr);
+
+/**
+  Copies an n-dimensional array with dimensions `dims` and elements of
+  size `size` from `src` to `dest`.  The memory layout of the source
+  and destination are given by `src_strides` and `dest_strides`.  The
+  memory regions must not overlap.
+
+  Elements are copied bitwise.  Contiguous runs are copied with
+  memcpy() and other layouts, like transposes, are copied in
+  cache-friendly tiles.
+
+  Returns non-zero on error.
+ */
+int dlite_array_copy_strided(int ndims, const size_t *dims, size_t size,
+                             void *dest, const int *dest_strides,
+                             const void *src, const int *src_strides);
+
+/**
+  Copies the elements of `src` to `dest`.  The arrays must have the
+  same type, element size and dimensions, but may have different
+  memory layout.  Elements are copied bitwise.
+
+  Returns non-zero on error.
+ */
+int dlite_array_copy(DLiteArray *dest, const DLiteArray *src);
+
 /**
   Creates a continuous copy of the data for `arr` (using malloc()) and
   updates `arr`.
@@ -215,4 +272,68 @@ void *dlite_array_make_continuous(DLiteArray *arr);
  */
 int dlite_array_printf(FILE *fp, const DLiteArray *arr, int width, int prec);
 
+
+/**
+  @name Numerical kernels
+  The functions below work on arrays of bool, int, uint, float32 and
+  float64 with arbitrary strides.  Elements are converted to double
+  for the computation.  Contiguous float arrays are processed with
+  SIMD instructions when available.
+  @{
+ */
+
+/**
+  Reduces all elements of numerical array `arr` according to `op` and
+  stores the result in `result`.  The sum of an empty array is zero,
+  while the other reductions of an empty array is an error.  The
+  result of min and max is unspecified if `arr` contains NaN.
+
+  Returns non-zero on error.
+ */
+int dlite_array_reduce(const DLiteArray *arr, DLiteArrayReduce op,
+                       double *result);
+
+/**
+  Replaces each element `x` of numerical array `arr` with
+  `scale*x + offset`.  Integer results are rounded to nearest.
+
+  Returns non-zero on error.
+ */
+int dlite_array_scale(DLiteArray *arr, double scale, double offset);
+
+/**
+  Replaces each element `y` of numerical array `y` with `a*x + y`,
+  where `x` is the corresponding element of `x`.  The arrays must
+  have the same shape, but may differ in type and memory layout.
+  Integer results are rounded to nearest.
+
+  Returns non-zero on error.
+ */
+int dlite_array_axpy(DLiteArray *y, double a, const DLiteArray *x);
+
+/**
+  Compares each element of numerical array `arr` with `value` using
+  comparison operator `op` and writes the result to `mask`, which must
+  have space for one bool per element of `arr`.  The mask is written
+  in C order.
+
+  Returns non-zero on error.
+ */
+int dlite_array_mask(const DLiteArray *arr, DLiteArrayCompare op,
+                     double value, bool *mask);
+
+/**
+  Like dlite_array_compare(), but compares the values of numerical
+  arrays `a` and `b` within a tolerance.  Like numpy.allclose(), two
+  elements are considered equal if `|a - b| <= atol + rtol*|b|`.  The
+  arrays may differ in type and memory layout.
+
+  Returns 1 if all elements are equal, zero if they are not or `a`
+  and `b` have different shape and a negative value on error.
+ */
+int dlite_array_compare_tol(const DLiteArray *a, const DLiteArray *b,
+                            double rtol, double atol);
+
+/** @} */
+
 #endif /* _DLITE_ARRAYS_H */
@@ -0,0 +1,606 @@
+/* dlite-arrow.c -- exchange of instances with Apache Arrow
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/boolean.h"
+#include "dlite-macros.h"
+#include "dlite-entity.h"
+#include "dlite-type-cast.h"
+#include "dlite-arrow.h"
+
+/* Number of bytes in a bitmap of `n` bits */
+#define BITMAP_SIZE(n) (((n) + 7) / 8)
+
+/* Largest offset that fits in the offsets buffer of utf8 and list arrays */
+#define MAX_OFFSET 2147483647
+
+
+/* Contiguous property values belonging to one row */
+typedef struct {
+  const char *ptr;   /* pointer to the first value */
+  size_t nmemb;      /* number of values */
+} Segment;
+
+
+/**************************************************************
+ * Construction and release of Arrow structures
+ **************************************************************/
+
+/* Release callback for exported schemas */
+static void release_schema(struct ArrowSchema *s)
+{
+  int64_t i;
+  for (i=0; i<s->n_children; i++) {
+    struct ArrowSchema *c = s->children[i];
+    if (c && c->release) c->release(c);
+    free(c);
+  }
+  free(s->children);
+  free((char *)s->format);
+  free((char *)s->name);
+  s->release = NULL;
+}
+
+/* Release callback for exported arrays */
+static void release_array(struct ArrowArray *a)
+{
+  int64_t i;
+  for (i=0; i<a->n_children; i++) {
+    struct ArrowArray *c = a->children[i];
+    if (c && c->release) c->release(c);
+    free(c);
+  }
+  free(a->children);
+  for (i=0; i<a->n_buffers; i++) free((void *)a->buffers[i]);
+  free(a->buffers);
+  a->release = NULL;
+}
+
+/* Initialises schema `s` with `n_children` zeroed children.  On error,
+   `s` is left in a state that can be released.  Returns non-zero on
+   error. */
+static int init_schema(struct ArrowSchema *s, const char *format,
+                       const char *name, int64_t n_children)
+{
+  int64_t i;
+  memset(s, 0, sizeof(struct ArrowSchema));
+  s->release = release_schema;
+  s->flags = ARROW_FLAG_NULLABLE;
+  if (!(s->format = strdup(format)) || !(s->name = strdup(name)))
+    return err(1, "allocation failure");
+  if (n_children) {
+    if (!(s->children = calloc(n_children, sizeof(struct ArrowSchema *))))
+      return err(1, "allocation failure");
+    s->n_children = n_children;
+    for (i=0; i<n_children; i++)
+      if (!(s->children[i] = calloc(1, sizeof(struct ArrowSchema))))
+        return err(1, "allocation failure");
+  }
+  return 0;
+}
+
+/* Initialises array `a` of given length with `n_buffers` NULL buffers
+   and `n_children` zeroed children.  On error, `a` is left in a state
+   that can be released.  Returns non-zero on error. */
+static int init_array(struct ArrowArray *a, int64_t length,
+                      int64_t n_buffers, int64_t n_children)
+{
+  int64_t i;
+  memset(a, 0, sizeof(struct ArrowArray));
+  a->release = release_array;
+  a->length = length;
+  if (!(a->buffers = calloc(n_buffers, sizeof(void *))))
+    return err(1, "allocation failure");
+  a->n_buffers = n_buffers;
+  if (n_children) {
+    if (!(a->children = calloc(n_children, sizeof(struct ArrowArray *))))
+      return err(1, "allocation failure");
+    a->n_children = n_children;
+    for (i=0; i<n_children; i++)
+      if (!(a->children[i] = calloc(1, sizeof(struct ArrowArray))))
+        return err(1, "allocation failure");
+  }
+  return 0;
+}
+
+
+/**************************************************************
+ * Export
+ **************************************************************/
+
+/* Returns the Arrow format string for values of the given type and
+   size or NULL if the type is not supported.  `buf` must have space
+   for at least 32 bytes. */
+static const char *get_format(char *buf, DLiteType type, size_t size)
+{
+  switch (type) {
+  case dliteBool:
+    return "b";
+  case dliteInt:
+    switch (size) {
+    case 1: return "c";
+    case 2: return "s";
+    case 4: return "i";
+    case 8: return "l";
+    }
+    break;
+  case dliteUInt:
+    switch (size) {
+    case 1: return "C";
+    case 2: return "S";
+    case 4: return "I";
+    case 8: return "L";
+    }
+    break;
+  case dliteFloat:
+    switch (size) {
+    case 4: return "f";
+    case 8: return "g";
+    }
+    break;
+  case dliteFixString:
+  case dliteStringPtr:
+    return "u";
+  case dliteBlob:
+    snprintf(buf, 32, "w:%d", (int)size);
+    return buf;
+  default:
+    break;
+  }
+  return NULL;
+}
+
+/* Returns a pointer to string `j` in segment `seg` of property `p`,
+   or NULL if the string is NULL.  The length is written to `*len`. */
+static const char *get_string(const DLiteProperty *p, const Segment *seg,
+                              size_t j, size_t *len)
+{
+  const char *s;
+  if (p->type == dliteStringPtr) {
+    s = ((char **)seg->ptr)[j];
+    *len = (s) ? strlen(s) : 0;
+  } else {
+    s = seg->ptr + j*p->size;
+    for (*len=0; *len < p->size && s[*len]; (*len)++);
+  }
+  return s;
+}
+
+/* Exports the `nsegs` segments in `segs` with a total of `len` values
+   of property `p` to the leaf array `a`.  Returns non-zero on error. */
+static int export_values(struct ArrowArray *a, const DLiteProperty *p,
+                         const Segment *segs, size_t nsegs, size_t len)
+{
+  size_t i, j, k=0;
+
+  switch (p->type) {
+
+  case dliteBool:
+    {
+      unsigned char *bits;
+      if (init_array(a, len, 2, 0)) return -1;
+      if (!(bits = calloc(BITMAP_SIZE(len) + 1, 1)))
+        return err(1, "allocation failure");
+      a->buffers[1] = bits;
+      for (i=0; i<nsegs; i++)
+        for (j=0; j<segs[i].nmemb; j++, k++)
+          if (((const bool *)segs[i].ptr)[j])
+            bits[k >> 3] |= (unsigned char)(1 << (k & 7));
+    }
+    break;
+
+  case dliteInt:
+  case dliteUInt:
+  case dliteFloat:
+  case dliteBlob:
+    {
+      char *data;
+      if (init_array(a, len, 2, 0)) return -1;
+      if (!(data = malloc(len*p->size + 1)))
+        return err(1, "allocation failure");
+      a->buffers[1] = data;
+      for (i=0; i<nsegs; i++) {
+        if (segs[i].nmemb)
+          memcpy(data + k*p->size, segs[i].ptr, segs[i].nmemb*p->size);
+        k += segs[i].nmemb;
+      }
+    }
+    break;
+
+  case dliteFixString:
+  case dliteStringPtr:
+    {
+      unsigned char *valid=NULL;
+      int32_t *offsets;
+      char *data;
+      size_t slen, nbytes=0;
+      int64_t nnull=0;
+      const char *s;
+      for (i=0; i<nsegs; i++)
+        for (j=0; j<segs[i].nmemb; j++) {
+          if (!get_string(p, segs+i, j, &slen)) nnull++;
+          nbytes += slen;
+        }
+      if (nbytes > MAX_OFFSET)
+        return errx(1, "too long strings in property '%s' to export to "
+                    "arrow", p->name);
+      if (init_array(a, len, 3, 0)) return -1;
+      a->null_count = nnull;
+      if (nnull && !(a->buffers[0] = valid = calloc(BITMAP_SIZE(len), 1)))
+        return err(1, "allocation failure");
+      if (!(a->buffers[1] = offsets = malloc((len + 1)*sizeof(int32_t))) ||
+          !(a->buffers[2] = data = malloc(nbytes + 1)))
+        return err(1, "allocation failure");
+      offsets[0] = 0;
+      for (i=0; i<nsegs; i++)
+        for (j=0; j<segs[i].nmemb; j++, k++) {
+          if ((s = get_string(p, segs+i, j, &slen))) {
+            memcpy(data + offsets[k], s, slen);
+            if (valid) valid[k >> 3] |= (unsigned char)(1 << (k & 7));
+          }
+          offsets[k+1] = offsets[k] + (int32_t)slen;
+        }
+    }
+    break;
+
+  default:
+    return errx(1, "cannot export property '%s' of type %s to arrow",
+                p->name, dlite_type_get_dtypename(p->type));
+  }
+  return 0;
+}
+
+/* Exports property `i` of the `n` instances in `instances` to schema `s`
+   and array `a`.  Returns non-zero on error. */
+static int export_column(struct ArrowSchema *s, struct ArrowArray *a,
+                         const DLiteMeta *meta, size_t i,
+                         DLiteInstance **instances, size_t n)
+{
+  char buf[32];
+  const DLiteProperty *p = meta->_properties + i;
+  const char *format = get_format(buf, p->type, p->size);
+  Segment *segs=NULL;
+  size_t k, len=0;
+  int j, retval=1;
+
+  if (!format)
+    return errx(1, "cannot export property '%s' of type %s to arrow",
+                p->name, dlite_type_get_dtypename(p->type));
+  if (!(segs = calloc(n + 1, sizeof(Segment))))
+    return err(1, "allocation failure");
+
+  for (k=0; k<n; k++) {
+    DLiteInstance *inst = instances[k];
+    segs[k].ptr = dlite_instance_get_property_by_index(inst, i);
+    segs[k].nmemb = 1;
+    for (j=0; j<p->ndims; j++) segs[k].nmemb *= DLITE_PROP_DIM(inst, i, j);
+    if (segs[k].nmemb && !segs[k].ptr) goto fail;
+    len += segs[k].nmemb;
+  }
+
+  if (p->ndims == 0) {
+    if (init_schema(s, format, p->name, 0)) goto fail;
+    if (export_values(a, p, segs, n, len)) goto fail;
+  } else {
+    int32_t *offsets;
+    if (len > MAX_OFFSET)
+      FAIL1("too many elements in property '%s' to export to arrow",
+            p->name);
+    if (init_schema(s, "+l", p->name, 1) ||
+        init_schema(s->children[0], format, "item", 0)) goto fail;
+    if (init_array(a, n, 2, 1)) goto fail;
+    if (!(a->buffers[1] = offsets = malloc((n + 1)*sizeof(int32_t))))
+      FAIL("allocation failure");
+    offsets[0] = 0;
+    for (k=0; k<n; k++) offsets[k+1] = offsets[k] + (int32_t)segs[k].nmemb;
+    if (export_values(a->children[0], p, segs, n, len)) goto fail;
+  }
+  retval = 0;
+ fail:
+  free(segs);
+  return retval;
+}
+
+
+/*
+  Exports the `n` instances in `instances` to an Arrow struct array
+  with one row per instance and one column per property.
+
+  Returns non-zero on error.
+ */
+int dlite_arrow_export(const DLiteMeta *meta, DLiteInstance **instances,
+                       size_t n, struct ArrowSchema *schema,
+                       struct ArrowArray *array)
+{
+  size_t i;
+  memset(schema, 0, sizeof(struct ArrowSchema));
+  memset(array, 0, sizeof(struct ArrowArray));
+  if (!meta) {
+    if (!n) return errx(1, "metadata must be given when exporting zero "
+                        "instances to arrow");
+    meta = instances[0]->meta;
+  }
+  for (i=0; i<n; i++)
+    if (instances[i]->meta != meta)
+      return errx(1, "cannot export instances of different metadata to "
+                  "arrow: %s and %s", meta->uri, instances[i]->meta->uri);
+
+  if (init_schema(schema, "+s", "", meta->_nproperties) ||
+      init_array(array, n, 1, meta->_nproperties)) goto fail;
+  for (i=0; i<meta->_nproperties; i++)
+    if (export_column(schema->children[i], array->children[i], meta, i,
+                      instances, n)) goto fail;
+  return 0;
+ fail:
+  if (schema->release) schema->release(schema);
+  if (array->release) array->release(array);
+  return 1;
+}
+
+
+/**************************************************************
+ * Import
+ **************************************************************/
+
+/* Assigns `*type` and `*size` to the DLite type corresponding to the
+   Arrow leaf format `format`.  Returns non-zero if the format is not
+   supported. */
+static int get_type(const char *format, DLiteType *type, size_t *size)
+{
+  if (format[0] == 'w' && format[1] == ':') {
+    *type = dliteBlob;
+    *size = atoi(format + 2);
+    return (*size > 0) ? 0 : 1;
+  }
+  if (!format[0] || format[1]) return 1;
+  switch (format[0]) {
+  case 'b': *type = dliteBool;      *size = sizeof(bool);     break;
+  case 'c': *type = dliteInt;       *size = 1;                break;
+  case 's': *type = dliteInt;       *size = 2;                break;
+  case 'i': *type = dliteInt;       *size = 4;                break;
+  case 'l': *type = dliteInt;       *size = 8;                break;
+  case 'C': *type = dliteUInt;      *size = 1;                break;
+  case 'S': *type = dliteUInt;      *size = 2;                break;
+  case 'I': *type = dliteUInt;      *size = 4;                break;
+  case 'L': *type = dliteUInt;      *size = 8;                break;
+  case 'f': *type = dliteFloat;     *size = 4;                break;
+  case 'g': *type = dliteFloat;     *size = 8;                break;
+  case 'u':
+  case 'U': *type = dliteStringPtr; *size = sizeof(char *);   break;
+  default: return 1;
+  }
+  return 0;
+}
+
+/* Returns non-zero if element `i` of array `a` is not null */
+static int is_valid(const struct ArrowArray *a, int64_t i)
+{
+  const unsigned char *bits = a->buffers[0];
+  int64_t j = a->offset + i;
+  if (!bits || a->null_count == 0) return 1;
+  return (bits[j >> 3] >> (j & 7)) & 1;
+}
+
+/* Returns the offset of element `i` of the utf8 or list array `a`,
+   whos format is `format`. */
+static int64_t get_offset(const char *format, const struct ArrowArray *a,
+                          int64_t i)
+{
+  int64_t j = a->offset + i;
+  if (format[0] == 'U' || strcmp(format, "+L") == 0)
+    return ((const int64_t *)a->buffers[1])[j];
+  return ((const int32_t *)a->buffers[1])[j];
+}
+
+/* Imports `n` values starting at element `start` of the leaf array `a`
+   described by `s` to `dest`, which points to memory for `n` values of
+   property `p`.  Null values are left untouched.  Returns non-zero on
+   error. */
+static int import_values(void *dest, const DLiteProperty *p,
+                         const struct ArrowSchema *s,
+                         const struct ArrowArray *a,
+                         int64_t start, size_t n)
+{
+  DLiteType type;
+  size_t size, k;
+  char *d = dest;
+
+  if (get_type(s->format, &type, &size))
+    return errx(1, "unsupported arrow format for property '%s': %s",
+                p->name, s->format);
+
+  if (type == p->type && size == p->size && type != dliteStringPtr &&
+      type != dliteBool && a->null_count == 0) {
+    if (n) memcpy(d, (const char *)a->buffers[1] + (a->offset+start)*size,
+                  n*size);
+    return 0;
+  }
+
+  for (k=0; k<n; k++, d+=p->size) {
+    int64_t i = start + k, j = a->offset + i;
+    if (!is_valid(a, i)) continue;
+
+    if (type == dliteBool) {
+      const unsigned char *bits = a->buffers[1];
+      bool v = (bits[j >> 3] >> (j & 7)) & 1;
+      if (p->type == dliteBool)
+        *(bool *)d = v;
+      else if (dlite_type_copy_cast(d, p->type, p->size, &v, type, size))
+        return -1;
+
+    } else if (type == dliteStringPtr) {
+      int64_t off = get_offset(s->format, a, i);
+      int64_t len = get_offset(s->format, a, i+1) - off;
+      const char *data = (const char *)a->buffers[2] + off;
+      char *str;
+      if (p->type == dliteFixString) {
+        size_t m = ((size_t)len < p->size) ? (size_t)len : p->size - 1;
+        memcpy(d, data, m);
+        d[m] = '\0';
+        continue;
+      }
+      if (!(str = malloc(len + 1))) return err(1, "allocation failure");
+      memcpy(str, data, len);
+      str[len] = '\0';
+      if (p->type == dliteStringPtr) {
+        free(*(char **)d);
+        *(char **)d = str;
+      } else {
+        int stat = dlite_type_copy_cast(d, p->type, p->size,
+                                        &str, dliteStringPtr, sizeof(char *));
+        free(str);
+        if (stat) return -1;
+      }
+
+    } else {
+      const char *src = (const char *)a->buffers[1] + j*size;
+      if (dlite_type_copy_cast(d, p->type, p->size, src, type, size))
+        return -1;
+    }
+  }
+  return 0;
+}
+
+/* Returns index of the dimension of `meta` that `expr` refers to or -1
+   if `expr` is not the name of a dimension. */
+static int dimension_index(const DLiteMeta *meta, const char *expr)
+{
+  size_t i;
+  for (i=0; i<meta->_ndimensions; i++)
+    if (strcmp(meta->_dimensions[i].name, expr) == 0) return (int)i;
+  return -1;
+}
+
+
+/*
+  Creates new instances of `meta` from the Arrow struct array `array`
+  described by `schema`, one instance per row.
+
+  Returns NULL on error.
+ */
+DLiteInstance **dlite_arrow_import(const DLiteMeta *meta,
+                                   const struct ArrowSchema *schema,
+                                   const struct ArrowArray *array,
+                                   size_t *n)
+{
+  DLiteInstance **instances=NULL;
+  int *cols=NULL;
+  size_t *dims=NULL;
+  size_t i, r, nrows, ndims=meta->_ndimensions;
+  int j, same=1, ok=0;
+
+  if (strcmp(schema->format, "+s"))
+    return errx(1, "expected arrow struct array, got format: %s",
+                schema->format), NULL;
+  if (schema->n_children != array->n_children)
+    return errx(1, "inconsistent arrow schema and array"), NULL;
+  nrows = array->length;
+
+  if (!(cols = malloc((meta->_nproperties + 1)*sizeof(int))) ||
+      !(dims = calloc(nrows*ndims + 1, sizeof(size_t))) ||
+      !(instances = calloc(nrows + 1, sizeof(DLiteInstance *))))
+    FAIL("allocation failure");
+
+  /* Map properties to columns */
+  for (i=0; i<meta->_nproperties; i++) cols[i] = -1;
+  for (j=0; j<schema->n_children; j++) {
+    const struct ArrowSchema *c = schema->children[j];
+    const DLiteProperty *p;
+    int k;
+    if (!c->name || !dlite_meta_has_property(meta, c->name)) continue;
+    k = dlite_meta_get_property_index(meta, c->name);
+    p = meta->_properties + k;
+    if (p->ndims > 0 && strcmp(c->format, "+l") && strcmp(c->format, "+L"))
+      FAIL2("expected arrow list column for dimensional property '%s', "
+            "got format: %s", p->name, c->format);
+    if (p->ndims == 0 && c->format[0] == '+')
+      FAIL2("expected arrow column of scalars for property '%s', "
+            "got format: %s", p->name, c->format);
+    cols[k] = j;
+  }
+
+  /* Derive dimensions from the one-dimensional properties */
+  for (i=0; i<meta->_nproperties; i++) {
+    const DLiteProperty *p = meta->_properties + i;
+    const struct ArrowArray *a;
+    int d;
+    if (cols[i] < 0 || p->ndims != 1) continue;
+    if ((d = dimension_index(meta, p->dims[0])) < 0) continue;
+    a = array->children[cols[i]];
+    for (r=0; r<nrows; r++) {
+      const char *format = schema->children[cols[i]]->format;
+      int64_t k = array->offset + r;
+      dims[r*ndims + d] =
+        get_offset(format, a, k+1) - get_offset(format, a, k);
+    }
+  }
+  for (r=1; r<nrows && same; r++)
+    if (memcmp(dims, dims + r*ndims, ndims*sizeof(size_t))) same = 0;
+
+  /* Create instances */
+  if (same && nrows) {
+    DLiteInstance **insts;
+    if (!(insts = dlite_instance_create_many(meta, dims, nrows, NULL)))
+      goto fail;
+    memcpy(instances, insts, nrows*sizeof(DLiteInstance *));
+    free(insts);
+  } else {
+    for (r=0; r<nrows; r++)
+      if (!(instances[r] = dlite_instance_create(meta, dims + r*ndims, NULL)))
+        goto fail;
+  }
+
+  /* Assign properties */
+  for (i=0; i<meta->_nproperties; i++) {
+    const DLiteProperty *p = meta->_properties + i;
+    const struct ArrowSchema *cs;
+    const struct ArrowArray *ca;
+    if (cols[i] < 0) continue;
+    cs = schema->children[cols[i]];
+    ca = array->children[cols[i]];
+    for (r=0; r<nrows; r++) {
+      DLiteInstance *inst = instances[r];
+      int64_t k = array->offset + r;
+      void *ptr;
+      if (!(ptr = DLITE_PROP_RW(inst, i))) goto fail;
+      if (p->ndims == 0) {
+        if (import_values(ptr, p, cs, ca, k, 1)) goto fail;
+      } else {
+        int64_t start = get_offset(cs->format, ca, k);
+        int64_t len = get_offset(cs->format, ca, k+1) - start;
+        size_t nmemb=1;
+        for (j=0; j<p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+        if ((size_t)len != nmemb)
+          FAIL4("row %d of arrow column '%s' has %d elements, but the "
+                "dimensions of the property requires %d",
+                (int)r, p->name, (int)len, (int)nmemb);
+        if (import_values(*(void **)ptr, p, cs->children[0],
+                          ca->children[0], start, nmemb)) goto fail;
+      }
+    }
+  }
+  for (r=0; r<nrows; r++)
+    if (dlite_instance_sync_from_properties(instances[r])) goto fail;
+
+  *n = nrows;
+  ok = 1;
+ fail:
+  if (!ok && instances) {
+    for (r=0; r<nrows; r++)
+      if (instances[r]) dlite_instance_decref(instances[r]);
+    free(instances);
+    instances = NULL;
+  }
+  free(cols);
+  free(dims);
+  return instances;
+}
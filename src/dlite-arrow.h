@@ -0,0 +1,126 @@
+#ifndef _DLITE_ARROW_H
+#define _DLITE_ARROW_H
+
+/**
+  @file
+  @brief Exchange of instances with Apache Arrow
+
+  The functions in this module convert a set of instances of the same
+  metadata to and from a table in the [Arrow C data interface], such
+  that they can be queried column-wise by Arrow-based tools, like
+  pyarrow, Polars or DuckDB, without going through each instance one
+  by one.
+
+  The table is a struct array with one row per instance and one child
+  array (column) per property:
+
+  | DLite type                | Arrow type                   |
+  | ------------------------- | ---------------------------- |
+  | bool                      | boolean                      |
+  | int8, ..., int64          | int8, ..., int64             |
+  | uint8, ..., uint64        | uint8, ..., uint64           |
+  | float32, float64          | float32, float64             |
+  | string, string*           | utf8                         |
+  | blob                      | fixed-size binary            |
+  | dimensional properties    | list of the above            |
+
+  Dimensional properties are flattened in C order, such that each
+  list holds all the elements of the property for one instance.
+  Properties of other types are not supported.
+
+  No dependency on the Arrow library is needed, since the C data
+  interface is a stable ABI that is defined below.
+
+  [Arrow C data interface]: https://arrow.apache.org/docs/format/CDataInterface.html
+ */
+
+#include <stdint.h>
+#include "dlite-entity.h"
+
+
+/* The Arrow C data interface, as defined by the Arrow specification */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  /* Array type description */
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  /* Release callback */
+  void (*release)(struct ArrowSchema*);
+  /* Opaque producer-specific data */
+  void* private_data;
+};
+
+struct ArrowArray {
+  /* Array data description */
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  /* Release callback */
+  void (*release)(struct ArrowArray*);
+  /* Opaque producer-specific data */
+  void* private_data;
+};
+
+#endif  /* ARROW_C_DATA_INTERFACE */
+
+
+/**
+  Exports the `n` instances in `instances` to an Arrow struct array
+  with one row per instance and one column per property.  All
+  instances must have the same metadata.  If `n` is zero, `meta`
+  provides the metadata for the columns.  Otherwise `meta` may be NULL.
+
+  On success, `schema` and `array` are initialised.  They are owned by
+  the caller, who should release them by calling their `release`
+  callbacks.  The exported data is a copy, so the instances may be
+  modified or freed afterwards.
+
+  Returns non-zero on error.
+ */
+int dlite_arrow_export(const DLiteMeta *meta, DLiteInstance **instances,
+                       size_t n, struct ArrowSchema *schema,
+                       struct ArrowArray *array);
+
+/**
+  Creates new instances of `meta` from the Arrow struct array `array`
+  described by `schema`, one instance per row.
+
+  Columns are matched to properties by name.  Columns that do not
+  correspond to a property are ignored and properties without a
+  column are left zero.  Numerical columns are casted to the type of
+  the corresponding property.  Dimensions of the new instances are
+  derived from the lengths of the list columns of one-dimensional
+  properties.
+
+  `schema` and `array` are not released and remains owned by the
+  caller.
+
+  Returns a newly allocated array of new instances, whos length is
+  written to `*n`.  The caller is responsible to decref the instances
+  and free the array.  Returns NULL on error.
+ */
+DLiteInstance **dlite_arrow_import(const DLiteMeta *meta,
+                                   const struct ArrowSchema *schema,
+                                   const struct ArrowArray *array,
+                                   size_t *n);
+
+
+#endif /* _DLITE_ARROW_H */
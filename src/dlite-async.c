@@ -0,0 +1,772 @@
+/* dlite-async.c -- asynchronous loading and saving of instances
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+# include <io.h>
+# define write _write
+#else
+# include <unistd.h>
+#endif
+
+#include "utils/err.h"
+#include "utils/thread.h"
+#include "dlite-errors.h"
+#include "dlite-misc.h"
+#include "dlite-macros.h"
+#include "dlite-entity.h"
+#include "dlite-storage.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-record.h"
+#include "dlite-async.h"
+#include "dlite-notify.h"
+
+/* Default and maximum number of I/O threads */
+#define ASYNC_DEFAULT_THREADS 4
+#define ASYNC_MAX_THREADS     64
+
+/* Timeout in milliseconds when a waiting thread drives the
+   asyncPoll() function of a plugin.  Another waiting thread may take
+   over polling when it returns. */
+#define ASYNC_POLL_TIMEOUT 100
+
+
+/* Type of asynchronous operation */
+typedef enum {
+  asyncSave,
+  asyncLoad
+} AsyncType;
+
+/* Asynchronous operation and its result */
+struct _DLiteFuture {
+  AsyncType type;           /* type of operation */
+  DLiteStorage *s;          /* storage to operate on */
+  DLiteInstance *inst;      /* instance to save (we hold a reference)
+                               or loaded instance */
+  char *id;                 /* id of instance to load */
+  int done;                 /* whether the operation is completed */
+  int status;               /* zero on success */
+  char *errmsg;             /* error message if the operation failed */
+  int notify;               /* whether to write to `notify_fd` when done */
+  int notify_fd;            /* file descriptor to notify on completion */
+  struct _DLiteFuture *next;  /* next operation on the same storage */
+  struct _AsyncQueue *q;    /* queue of storage if the operation is
+                               submitted to the asynchronous api of the
+                               plugin, otherwise NULL */
+  uint64_t t0;              /* time the operation was submitted */
+};
+
+/* Iterator over loaded instances.  Futures for the instances
+   uuids[pos] ... uuids[next-1] are kept in a ring buffer of length
+   window. */
+struct _DLiteInstanceIter {
+  DLiteStorage *s;          /* storage to iterate over */
+  char **uuids;             /* NULL-terminated list of UUIDs */
+  size_t n;                 /* number of UUIDs */
+  size_t pos;               /* index of next instance to return */
+  size_t next;              /* index of next instance to submit */
+  size_t window;            /* number of instances loaded ahead */
+  DLiteFuture **futures;    /* ring buffer with pending loads */
+};
+
+/* Queue of pending operations on a storage */
+typedef struct _AsyncQueue {
+  const DLiteStorage *s;    /* the storage */
+  DLiteFuture *head;        /* first pending operation */
+  DLiteFuture *tail;        /* last pending operation */
+  int scheduled;            /* whether the queue is ready or being served */
+  int concurrent;           /* whether operations may run concurrently */
+  int running;              /* number of running concurrent operations */
+  int native;               /* number of outstanding operations submitted
+                               to the asynchronous api of the plugin */
+  int polling;              /* whether a thread is in asyncPoll() */
+  struct _AsyncQueue *next;       /* next queue */
+  struct _AsyncQueue *nextready;  /* next queue ready to be served */
+} AsyncQueue;
+
+/* Pool of I/O threads */
+typedef struct {
+  ThreadMutex mutex;        /* protects everything below */
+  ThreadCond work;          /* signalled when a queue becomes ready */
+  ThreadCond done;          /* broadcasted when an operation completes */
+  AsyncQueue *queues;       /* all queues with pending operations */
+  AsyncQueue *ready;        /* first queue ready to be served */
+  AsyncQueue *readytail;    /* last queue ready to be served */
+  int stop;                 /* set to stop the threads */
+  int nthreads;             /* number of running threads */
+  Thread threads[ASYNC_MAX_THREADS];
+} AsyncPool;
+
+
+static ThreadMutex _async_pool_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Executes the operation of future `f`. */
+static void _async_run(DLiteFuture *f)
+{
+  err_clear();
+  switch (f->type) {
+  case asyncSave:
+    f->status = dlite_instance_save(f->s, f->inst);
+    dlite_instance_decref(f->inst);
+    f->inst = NULL;
+    break;
+  case asyncLoad:
+    f->inst = dlite_instance_load(f->s, f->id);
+    f->status = (f->inst) ? 0 : 1;
+    break;
+  }
+  if (f->status) {
+    const char *msg = err_getmsg();
+    f->errmsg = strdup((msg && *msg) ? msg : "asynchronous operation failed");
+  }
+  err_clear();
+}
+
+/* Writes a byte to the notification file descriptor of `f`, if any.
+   Errors are ignored, since the byte only wakes up the listener, who
+   polls the futures it waits for.  Must be called with the pool lock
+   held. */
+static void _async_notify(DLiteFuture *f)
+{
+  char c = 0;
+  if (f->notify && write(f->notify_fd, &c, 1) < 0) err_clear();
+}
+
+/* Adds queue `q` to the end of the ready list.  Must be called with
+   the pool lock held. */
+static void _async_push_ready(AsyncPool *pool, AsyncQueue *q)
+{
+  q->scheduled = 1;
+  q->nextready = NULL;
+  if (pool->readytail)
+    pool->readytail->nextready = q;
+  else
+    pool->ready = q;
+  pool->readytail = q;
+  thread_cond_signal(&pool->work);
+}
+
+/* Thread function serving the ready queues.  Only the first operation
+   in each queue is executed before the queue is put back at the end
+   of the ready list, such that all storages progress.  The queue of a
+   thread-safe storage is put back before the operation is executed,
+   such that other threads can serve it concurrently. */
+static void *_async_worker(void *arg)
+{
+  AsyncPool *pool = arg;
+  thread_mutex_lock(&pool->mutex);
+  while (1) {
+    AsyncQueue *q;
+    DLiteFuture *f;
+    if (!pool->ready) {
+      if (pool->stop) break;
+      thread_cond_wait(&pool->work, &pool->mutex);
+      continue;
+    }
+    q = pool->ready;
+    if (!(pool->ready = q->nextready)) pool->readytail = NULL;
+    f = q->head;
+    if (q->concurrent) {
+      if (!(q->head = f->next)) q->tail = NULL;
+      f->next = NULL;
+      q->running++;
+      if (q->head)
+        _async_push_ready(pool, q);
+      else
+        q->scheduled = 0;
+    }
+    thread_mutex_unlock(&pool->mutex);
+
+    _async_run(f);
+
+    thread_mutex_lock(&pool->mutex);
+    if (q->concurrent) {
+      q->running--;
+    } else {
+      if (!(q->head = f->next)) q->tail = NULL;
+      f->next = NULL;
+      if (q->head)
+        _async_push_ready(pool, q);
+      else
+        q->scheduled = 0;
+    }
+    f->done = 1;
+    _async_notify(f);
+    thread_cond_broadcast(&pool->done);
+  }
+  thread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+/* Waits for all pending operations and stops the threads. */
+static void _async_pool_stop(AsyncPool *pool)
+{
+  int i, n;
+  thread_mutex_lock(&pool->mutex);
+  while (pool->ready)
+    thread_cond_wait(&pool->done, &pool->mutex);
+  pool->stop = 1;
+  n = pool->nthreads;
+  pool->nthreads = 0;
+  thread_cond_broadcast(&pool->work);
+  thread_mutex_unlock(&pool->mutex);
+  for (i=0; i<n; i++) thread_join(pool->threads[i], NULL);
+}
+
+/* Frees the pool.  Called at exit. */
+static void _async_pool_free(void *ptr)
+{
+  AsyncPool *pool = ptr;
+  AsyncQueue *q, *next;
+  _async_pool_stop(pool);
+  for (q=pool->queues; q; q=next) {
+    next = q->next;
+    free(q);
+  }
+  thread_cond_destroy(&pool->work);
+  thread_cond_destroy(&pool->done);
+  thread_mutex_destroy(&pool->mutex);
+  free(pool);
+}
+
+/* Stops the threads before the globals are free'ed when the
+   application exits, since pending operations may need them. */
+static void _async_atexit(void)
+{
+  AsyncPool *pool = dlite_globals_get_state("dlite-async-pool");
+  if (pool) _async_pool_stop(pool);
+}
+
+/* Returns the pool of I/O threads, starting it if needed.  Returns
+   NULL on error. */
+static AsyncPool *_async_pool(void)
+{
+  AsyncPool *pool = dlite_globals_get_state("dlite-async-pool");
+  if (!pool) {
+    thread_mutex_lock(&_async_pool_mutex);
+    if (!(pool = dlite_globals_get_state("dlite-async-pool")) &&
+        (pool = calloc(1, sizeof(AsyncPool)))) {
+      char *endptr, *p = getenv("DLITE_ASYNC_THREADS");
+      int i, n = ASYNC_DEFAULT_THREADS;
+      if (p && *p) {
+        n = strtol(p, &endptr, 10);
+        if (*endptr || n < 0) {
+          warnx("invalid value of DLITE_ASYNC_THREADS: '%s'", p);
+          n = ASYNC_DEFAULT_THREADS;
+        }
+      }
+      if (n > ASYNC_MAX_THREADS) n = ASYNC_MAX_THREADS;
+      thread_mutex_init(&pool->mutex);
+      thread_cond_init(&pool->work);
+      thread_cond_init(&pool->done);
+      for (i=0; i<n; i++)
+        if (thread_create(pool->threads + pool->nthreads, _async_worker,
+                          pool) == 0)
+          pool->nthreads++;
+      dlite_globals_add_state("dlite-async-pool", pool, _async_pool_free);
+      atexit(_async_atexit);
+    }
+    thread_mutex_unlock(&_async_pool_mutex);
+    if (!pool) return err(1, "allocation failure"), NULL;
+  }
+  return pool;
+}
+
+/* Returns the queue of storage `s`, creating it if needed.  Returns
+   NULL on error.  Must be called with the pool lock held. */
+static AsyncQueue *_async_queue(AsyncPool *pool, const DLiteStorage *s)
+{
+  AsyncQueue *q;
+  for (q=pool->queues; q; q=q->next)
+    if (q->s == s) return q;
+  if (!(q = calloc(1, sizeof(AsyncQueue))))
+    return err(1, "allocation failure"), NULL;
+  q->s = s;
+  q->concurrent =
+    (dlite_storage_get_capabilities(s) & dliteCapThreadSafe) ? 1 : 0;
+  q->next = pool->queues;
+  pool->queues = q;
+  return q;
+}
+
+/* Submits future `f` to the queue of its storage.  If there are no
+   I/O threads, the operation is executed directly.  Returns non-zero
+   on error. */
+static int _async_submit(DLiteFuture *f)
+{
+  AsyncPool *pool;
+  AsyncQueue *q;
+  if (!(pool = _async_pool())) return 1;
+  thread_mutex_lock(&pool->mutex);
+  if (pool->nthreads == 0) {
+    thread_mutex_unlock(&pool->mutex);
+    _async_run(f);
+    f->done = 1;
+    return 0;
+  }
+  if (!(q = _async_queue(pool, f->s))) {
+    thread_mutex_unlock(&pool->mutex);
+    return 1;
+  }
+  if (q->tail)
+    q->tail->next = f;
+  else
+    q->head = f;
+  q->tail = f;
+  if (!q->scheduled) _async_push_ready(pool, q);
+  thread_mutex_unlock(&pool->mutex);
+  return 0;
+}
+
+/* Callback completing future `userdata` when the plugin has completed
+   an operation submitted to its asynchronous api. */
+static void _async_completed(int status, DLiteInstance *inst, void *userdata)
+{
+  DLiteFuture *f = userdata;
+  AsyncPool *pool = dlite_globals_get_state("dlite-async-pool");
+  if (!status && f->type == asyncLoad && !inst) status = 1;
+  if (status) {
+    const char *msg = err_getmsg();
+    f->status = status;
+    f->errmsg = strdup((msg && *msg) ? msg : "asynchronous operation failed");
+    if (f->type == asyncLoad && inst) dlite_instance_decref(inst);
+  } else if (f->type == asyncLoad) {
+    dlite_instance_load_completed(f->s, inst, f->t0);
+    f->inst = inst;
+  } else {
+    dlite_instance_save_completed(f->s, f->inst, f->t0);
+    dlite_instance_notify(f->inst, f->s->location, NULL);
+  }
+  if (f->type == asyncSave) {
+    dlite_instance_decref(f->inst);
+    f->inst = NULL;
+  }
+  err_clear();
+
+  thread_mutex_lock(&pool->mutex);
+  f->q->native--;
+  f->done = 1;
+  _async_notify(f);
+  thread_cond_broadcast(&pool->done);
+  thread_mutex_unlock(&pool->mutex);
+}
+
+/* Submits future `f` to the asynchronous api of the plugin of its
+   storage.  Returns non-zero on error. */
+static int _async_submit_native(DLiteFuture *f)
+{
+  AsyncPool *pool;
+  AsyncQueue *q;
+  int stat;
+  if (!(pool = _async_pool())) return 1;
+  thread_mutex_lock(&pool->mutex);
+  if (!(q = _async_queue(pool, f->s))) {
+    thread_mutex_unlock(&pool->mutex);
+    return 1;
+  }
+  q->native++;
+  f->q = q;
+  thread_mutex_unlock(&pool->mutex);
+
+  /* the callback may be called before the submit function returns */
+  f->t0 = dlite_record_begin();
+  if (f->type == asyncLoad)
+    stat = f->s->api->loadInstanceAsync(f->s, f->id, _async_completed, f);
+  else
+    stat = f->s->api->saveInstanceAsync(f->s, f->inst, _async_completed, f);
+  if (stat) {
+    thread_mutex_lock(&pool->mutex);
+    q->native--;
+    thread_cond_broadcast(&pool->done);
+    thread_mutex_unlock(&pool->mutex);
+  }
+  return stat;
+}
+
+/* Calls the asyncPoll() function of the plugin of the storage of
+   queue `q` with the given timeout and returns its result.  Must be
+   called with the pool lock held, which is released during the
+   call. */
+static int _async_poll(AsyncPool *pool, AsyncQueue *q, int timeout)
+{
+  int n;
+  q->polling = 1;
+  thread_mutex_unlock(&pool->mutex);
+  n = q->s->api->asyncPoll((DLiteStorage *)q->s, timeout);
+  thread_mutex_lock(&pool->mutex);
+  q->polling = 0;
+
+  /* wake up waiting threads, such that one of them may take over */
+  thread_cond_broadcast(&pool->done);
+  return n;
+}
+
+/* Waits until future `f` is completed, or if `f` is NULL, until queue
+   `q` has no pending operations.  Operations submitted to the
+   asynchronous api of a plugin are completed by calling its
+   asyncPoll() function, unless another thread already does it.  Must
+   be called with the pool lock held. */
+static void _async_wait(AsyncPool *pool, AsyncQueue *q, DLiteFuture *f)
+{
+  while ((f) ? !f->done :
+         (q->scheduled || q->running || q->native || q->polling)) {
+    if (q && q->native && !q->polling && q->s->api->asyncPoll)
+      _async_poll(pool, q, ASYNC_POLL_TIMEOUT);
+    else
+      thread_cond_wait(&pool->done, &pool->mutex);
+  }
+}
+
+/* Returns non-zero if saving `inst` to `s` should be submitted to the
+   asynchronous api of the plugin.  Saves that dlite_instance_save()
+   would do via the datamodel api or defer are queued as usual. */
+static int _async_native_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  int caps = dlite_storage_get_capabilities(s);
+  return s->api->saveInstanceAsync && !s->saveq && !s->decomposition &&
+    !((inst->_flags & dliteFlagSaved) && (caps & dliteCapRandomAccess) &&
+      !(caps & dliteCapAppendOnly) && s->api->dataModel &&
+      s->api->setProperty);
+}
+
+/* Returns non-zero if loading `id` from `s` should be submitted to the
+   asynchronous api of the plugin.  Instances that already are loaded
+   are queued as usual, such that a new reference is returned. */
+static int _async_native_load(const DLiteStorage *s, const char *id)
+{
+  return s->api->loadInstanceAsync && !s->saveq && id && *id &&
+    !dlite_instance_has(id, 0);
+}
+
+
+/*
+  Queues saving of instance `inst` to storage `s` and returns a future
+  for the operation.
+
+  Returns NULL on error.
+ */
+DLiteFuture *dlite_instance_save_async(DLiteStorage *s,
+                                       const DLiteInstance *inst)
+{
+  DLiteFuture *f;
+  int stat;
+  if (!s) return errx(1, "invalid storage, see previous errors"), NULL;
+  if (!(f = calloc(1, sizeof(DLiteFuture))))
+    return err(1, "allocation failure"), NULL;
+  f->type = asyncSave;
+  f->s = s;
+  f->inst = (DLiteInstance *)inst;
+  dlite_instance_incref(f->inst);
+  if (!_async_native_save(s, inst))
+    stat = _async_submit(f);
+  else if (!inst->meta)
+    stat = errx(-1, "no metadata available");
+  else
+    stat = dlite_instance_sync_to_properties(f->inst) ||
+      _async_submit_native(f);
+  if (stat) {
+    dlite_instance_decref(f->inst);
+    free(f);
+    return NULL;
+  }
+  return f;
+}
+
+/*
+  Queues loading of instance `id` from storage `s` and returns a
+  future for the operation.  Use dlite_future_get_instance() to get
+  the loaded instance.
+
+  Returns NULL on error.
+ */
+DLiteFuture *dlite_instance_load_async(DLiteStorage *s, const char *id)
+{
+  DLiteFuture *f;
+  if (!s) return errx(1, "invalid storage, see previous errors"), NULL;
+  if (!(f = calloc(1, sizeof(DLiteFuture))))
+    return err(1, "allocation failure"), NULL;
+  f->type = asyncLoad;
+  f->s = s;
+  if (id && !(f->id = strdup(id))) {
+    free(f);
+    return err(1, "allocation failure"), NULL;
+  }
+  if (_async_native_load(s, id) ?
+      _async_submit_native(f) : _async_submit(f)) {
+    if (f->id) free(f->id);
+    free(f);
+    return NULL;
+  }
+  return f;
+}
+
+/*
+  Returns non-zero if the operation of `future` is completed and zero
+  if it is still pending.  Does not block.
+ */
+int dlite_future_poll(DLiteFuture *future)
+{
+  AsyncPool *pool = dlite_globals_get_state("dlite-async-pool");
+  AsyncQueue *q = future->q;
+  int done;
+  if (!pool) return future->done;
+  thread_mutex_lock(&pool->mutex);
+  if (!future->done && q && !q->polling && q->s->api->asyncPoll)
+    _async_poll(pool, q, 0);
+  done = future->done;
+  thread_mutex_unlock(&pool->mutex);
+  return done;
+}
+
+/*
+  Writes one byte to `fd` when the operation of `future` is completed.
+ */
+int dlite_future_notify_fd(DLiteFuture *future, int fd)
+{
+  AsyncPool *pool = dlite_globals_get_state("dlite-async-pool");
+  if (fd < 0) return errx(dliteValueError, "invalid file descriptor: %d", fd);
+  if (pool) thread_mutex_lock(&pool->mutex);
+  future->notify = 1;
+  future->notify_fd = fd;
+  if (future->done) _async_notify(future);
+  if (pool) thread_mutex_unlock(&pool->mutex);
+  return 0;
+}
+
+/*
+  Waits until the operation of `future` is completed.
+
+  Returns zero if the operation succeeded and non-zero otherwise.  See
+  dlite_future_errmsg() for the error message.
+ */
+int dlite_future_wait(DLiteFuture *future)
+{
+  AsyncPool *pool = dlite_globals_get_state("dlite-async-pool");
+  if (pool) {
+    thread_mutex_lock(&pool->mutex);
+    _async_wait(pool, future->q, future);
+    thread_mutex_unlock(&pool->mutex);
+  }
+  return future->status;
+}
+
+/*
+  Waits until the load operation of `future` is completed and returns
+  a new reference to the loaded instance, or NULL on error.
+ */
+DLiteInstance *dlite_future_get_instance(DLiteFuture *future)
+{
+  if (future->type != asyncLoad)
+    return errx(1, "future is not for a load operation"), NULL;
+  if (dlite_future_wait(future))
+    return errx(1, "asynchronous load of \"%s\" failed", future->id), NULL;
+  dlite_instance_incref(future->inst);
+  return future->inst;
+}
+
+/*
+  Returns the error message of a failed operation, or NULL if the
+  operation succeeded or is still pending.
+ */
+const char *dlite_future_errmsg(DLiteFuture *future)
+{
+  if (!dlite_future_poll(future)) return NULL;
+  return future->errmsg;
+}
+
+/*
+  Frees `future`.  If the operation is still pending, this function
+  waits until it is completed.
+ */
+void dlite_future_free(DLiteFuture *future)
+{
+  dlite_future_wait(future);
+  if (future->inst) dlite_instance_decref(future->inst);
+  if (future->id) free(future->id);
+  if (future->errmsg) free(future->errmsg);
+  free(future);
+}
+
+/*
+  Waits until all pending asynchronous operations on storage `s` are
+  completed.
+
+  Returns non-zero on error.
+ */
+int dlite_storage_wait(const DLiteStorage *s)
+{
+  AsyncPool *pool = dlite_globals_get_state("dlite-async-pool");
+  AsyncQueue *q, **qp;
+  if (!pool) return 0;
+  thread_mutex_lock(&pool->mutex);
+  for (q=pool->queues; q; q=q->next)
+    if (q->s == s) break;
+  if (q) {
+    _async_wait(pool, q, NULL);
+
+    /* remove the queue, other queues may have been added meanwhile */
+    for (qp=&pool->queues; *qp != q; qp=&(*qp)->next) ;
+    *qp = q->next;
+    free(q);
+  }
+  thread_mutex_unlock(&pool->mutex);
+  return 0;
+}
+
+/*
+  Returns a file descriptor that becomes readable when
+  dlite_storage_async_poll() has completions to process on storage
+  `s`, or -1 if the plugin provides no such descriptor.
+ */
+int dlite_storage_async_fd(const DLiteStorage *s)
+{
+  if (!s->api->asyncFd) return -1;
+  return s->api->asyncFd(s);
+}
+
+/*
+  Processes completed operations on storage `s`, waiting at most
+  `timeout` milliseconds.
+
+  Returns the number of completed operations or a negative number on
+  error.
+ */
+int dlite_storage_async_poll(DLiteStorage *s, int timeout)
+{
+  AsyncPool *pool = dlite_globals_get_state("dlite-async-pool");
+  AsyncQueue *q;
+  int n=0;
+  if (!pool || !s->api->asyncPoll) return 0;
+  thread_mutex_lock(&pool->mutex);
+  for (q=pool->queues; q; q=q->next)
+    if (q->s == s) break;
+  if (q && q->native && !q->polling) n = _async_poll(pool, q, timeout);
+  thread_mutex_unlock(&pool->mutex);
+  return n;
+}
+
+
+/* Submits loading of instances until `window` loads are pending. */
+static void _instance_iter_fill(DLiteInstanceIter *iter)
+{
+  while (iter->next < iter->n && iter->next - iter->pos < iter->window) {
+    size_t i = iter->next % iter->window;
+    iter->futures[i] = dlite_instance_load_async(iter->s,
+                                                 iter->uuids[iter->next]);
+    iter->next++;
+  }
+}
+
+/*
+  Returns a new iterator over all instances in storage `s` whos
+  metadata URI matches the glob pattern `pattern`.  If `pattern` is
+  NULL, it matches all instances.
+
+  Instead of UUIDs, the iterator yields loaded instances.  While the
+  caller processes one instance, the next `window` instances are
+  loaded in the background.  If `window` is zero or negative, a
+  default window of DLITE_ASYNC_DEFAULT_WINDOW instances is used.
+
+  The UUIDs of the matching instances are listed when the iterator is
+  created, hence the storage must support dlite_storage_iter_create().
+  The storage must be kept open while the iterator is in use.
+
+  Returns NULL on error.
+ */
+DLiteInstanceIter *dlite_storage_instance_iter_create(DLiteStorage *s,
+                                                      const char *pattern,
+                                                      int window)
+{
+  DLiteInstanceIter *iter;
+  char buf[DLITE_UUID_LENGTH+1];
+  void *it, *ptr;
+  size_t len=0;
+  int stat;
+  if (!s) return errx(1, "invalid storage, see previous errors"), NULL;
+  if (window <= 0) window = DLITE_ASYNC_DEFAULT_WINDOW;
+  if (!(iter = calloc(1, sizeof(DLiteInstanceIter))) ||
+      !(iter->futures = calloc(window, sizeof(DLiteFuture *))) ||
+      !(iter->uuids = calloc(1, sizeof(char *)))) {
+    if (iter && iter->futures) free(iter->futures);
+    if (iter) free(iter);
+    return err(1, "allocation failure"), NULL;
+  }
+  iter->s = s;
+  iter->window = window;
+
+  /* list the UUIDs before any loads are queued on `s` */
+  if (!(it = dlite_storage_iter_create(s, pattern))) goto fail;
+  while ((stat = dlite_storage_iter_next(s, it, buf)) == 0) {
+    if (iter->n + 1 >= len) {
+      len += 32;
+      if (!(ptr = realloc(iter->uuids, len*sizeof(char *)))) {
+        err(1, "allocation failure");
+        break;
+      }
+      iter->uuids = ptr;
+    }
+    if (!(iter->uuids[iter->n] = strdup(buf))) {
+      err(1, "allocation failure");
+      break;
+    }
+    iter->uuids[++iter->n] = NULL;
+  }
+  dlite_storage_iter_free(s, it);
+  if (stat < 0) FAIL1("error iterating over storage \"%s\"", s->location);
+  if (stat == 0) goto fail;
+
+  _instance_iter_fill(iter);
+  return iter;
+ fail:
+  dlite_storage_instance_iter_free(iter);
+  return NULL;
+}
+
+/*
+  Assigns `*inst` to a new reference to the next instance in `iter`.
+
+  Returns zero on success, 1 if there are no more instances to iterate
+  over and a negative number if the next instance could not be loaded.
+  In the latter case, the iteration may be continued with the
+  following instance.
+ */
+int dlite_storage_instance_iter_next(DLiteInstanceIter *iter,
+                                     DLiteInstance **inst)
+{
+  size_t i;
+  DLiteFuture *f;
+  *inst = NULL;
+  if (iter->pos >= iter->n) return 1;
+  i = iter->pos % iter->window;
+  f = iter->futures[i];
+  iter->futures[i] = NULL;
+  iter->pos++;
+  if (f) {
+    *inst = dlite_future_get_instance(f);
+    dlite_future_free(f);
+  } else {
+    errx(1, "cannot queue loading of \"%s\"", iter->uuids[iter->pos-1]);
+  }
+  _instance_iter_fill(iter);
+  return (*inst) ? 0 : -1;
+}
+
+/*
+  Frees iterator created with dlite_storage_instance_iter_create().
+  Waits for pending background loads.
+ */
+void dlite_storage_instance_iter_free(DLiteInstanceIter *iter)
+{
+  size_t i;
+  for (i=0; i<iter->window; i++)
+    if (iter->futures[i]) dlite_future_free(iter->futures[i]);
+  dlite_storage_uuids_free(iter->uuids);
+  free(iter->futures);
+  free(iter);
+}
@@ -0,0 +1,186 @@
+#ifndef _DLITE_ASYNC_H
+#define _DLITE_ASYNC_H
+
+/**
+  @file
+  @brief Asynchronous loading and saving of instances
+
+  The functions in this module queue a load or save operation and
+  return immediately with a future that can be polled or waited for.
+  The operations are executed by a pool of I/O threads, such that
+  computations can overlap with storage I/O.
+
+  Operations on the same storage are executed one at a time and in
+  the order they were submitted.  Hence, a storage plugin never sees
+  concurrent calls on the same storage from this module, while
+  operations on different storages may run in parallel.  The exception
+  are storages with the `dliteCapThreadSafe` capability, whos
+  operations are started in order, but may run concurrently.
+
+  The storage must not be used synchronously (with e.g.
+  dlite_instance_save()) while it has pending asynchronous
+  operations.  Use dlite_storage_wait() to wait for them.
+  dlite_storage_close() waits automatically.
+
+  Instances that are saved asynchronously are kept alive until the
+  save is completed, but must not be modified meanwhile.
+
+  The number of I/O threads can be set with the environment variable
+  `DLITE_ASYNC_THREADS`.  Without thread support, or if it is set to
+  zero, the operations are executed synchronously and the returned
+  futures are already completed.
+
+  Storage plugins implementing the asynchronous API (see
+  dlite-storage-plugins.h) are not served by the I/O threads.  Their
+  operations are submitted directly to the plugin, which may have many
+  of them outstanding and complete them in any order.  If the plugin
+  needs to be driven, waiting for a future drives it.  An event loop
+  can instead watch dlite_storage_async_fd() and call
+  dlite_storage_async_poll() when it becomes readable.
+ */
+
+#include "dlite-entity.h"
+#include "dlite-storage.h"
+
+/** Default number of instances that are loaded ahead by
+    dlite_storage_instance_iter_next(). */
+#define DLITE_ASYNC_DEFAULT_WINDOW 8
+
+/** Opaque type for the result of an asynchronous operation. */
+typedef struct _DLiteFuture DLiteFuture;
+
+/** Opaque type for an iterator over loaded instances in a storage. */
+typedef struct _DLiteInstanceIter DLiteInstanceIter;
+
+
+/**
+  Queues saving of instance `inst` to storage `s` and returns a future
+  for the operation.
+
+  Returns NULL on error.
+ */
+DLiteFuture *dlite_instance_save_async(DLiteStorage *s,
+                                       const DLiteInstance *inst);
+
+/**
+  Queues loading of instance `id` from storage `s` and returns a
+  future for the operation.  Use dlite_future_get_instance() to get
+  the loaded instance.
+
+  Returns NULL on error.
+ */
+DLiteFuture *dlite_instance_load_async(DLiteStorage *s, const char *id);
+
+/**
+  Returns non-zero if the operation of `future` is completed and zero
+  if it is still pending.  Does not block.
+ */
+int dlite_future_poll(DLiteFuture *future);
+
+/**
+  Requests that one byte is written to file descriptor `fd` when the
+  operation of `future` is completed, e.g. the write end of a pipe
+  watched by an event loop.  If the operation is already completed,
+  the byte is written immediately.
+
+  The byte is only a wakeup signal.  The listener should poll its
+  futures with dlite_future_poll(), since several completions may be
+  signalled by one byte if `fd` is non-blocking and the pipe is full.
+
+  Returns non-zero on error.
+ */
+int dlite_future_notify_fd(DLiteFuture *future, int fd);
+
+/**
+  Waits until the operation of `future` is completed.
+
+  Returns zero if the operation succeeded and non-zero otherwise.  See
+  dlite_future_errmsg() for the error message.
+ */
+int dlite_future_wait(DLiteFuture *future);
+
+/**
+  Waits until the load operation of `future` is completed and returns
+  a new reference to the loaded instance, or NULL on error.
+ */
+DLiteInstance *dlite_future_get_instance(DLiteFuture *future);
+
+/**
+  Returns the error message of a failed operation, or NULL if the
+  operation succeeded or is still pending.
+ */
+const char *dlite_future_errmsg(DLiteFuture *future);
+
+/**
+  Frees `future`.  If the operation is still pending, this function
+  waits until it is completed.
+ */
+void dlite_future_free(DLiteFuture *future);
+
+/**
+  Waits until all pending asynchronous operations on storage `s` are
+  completed.
+
+  Returns non-zero on error.
+ */
+int dlite_storage_wait(const DLiteStorage *s);
+
+/**
+  Returns a file descriptor that becomes readable when
+  dlite_storage_async_poll() has completions to process on storage
+  `s`, or -1 if the plugin of `s` provides no such descriptor.
+ */
+int dlite_storage_async_fd(const DLiteStorage *s);
+
+/**
+  Processes completed operations on storage `s` that were submitted to
+  the asynchronous API of its plugin.  Waits at most `timeout`
+  milliseconds for a completion if none is ready.  Returns immediately
+  if the plugin completes operations by itself or another thread is
+  already processing completions.
+
+  Returns the number of completed operations or a negative number on
+  error.
+ */
+int dlite_storage_async_poll(DLiteStorage *s, int timeout);
+
+
+/**
+  Returns a new iterator over all instances in storage `s` whos
+  metadata URI matches the glob pattern `pattern`.  If `pattern` is
+  NULL, it matches all instances.
+
+  Instead of UUIDs, the iterator yields loaded instances.  While the
+  caller processes one instance, the next `window` instances are
+  loaded in the background.  If `window` is zero or negative, a
+  default window of DLITE_ASYNC_DEFAULT_WINDOW instances is used.
+
+  The UUIDs of the matching instances are listed when the iterator is
+  created, hence the storage must support dlite_storage_iter_create().
+  The storage must be kept open while the iterator is in use.
+
+  Returns NULL on error.
+ */
+DLiteInstanceIter *dlite_storage_instance_iter_create(DLiteStorage *s,
+                                                      const char *pattern,
+                                                      int window);
+
+/**
+  Assigns `*inst` to a new reference to the next instance in `iter`.
+
+  Returns zero on success, 1 if there are no more instances to iterate
+  over and a negative number if the next instance could not be loaded.
+  In the latter case, the iteration may be continued with the
+  following instance.
+ */
+int dlite_storage_instance_iter_next(DLiteInstanceIter *iter,
+                                     DLiteInstance **inst);
+
+/**
+  Frees iterator created with dlite_storage_instance_iter_create().
+  Waits for pending background loads.
+ */
+void dlite_storage_instance_iter_free(DLiteInstanceIter *iter);
+
+
+#endif /* _DLITE_ASYNC_H */
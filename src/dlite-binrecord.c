@@ -0,0 +1,483 @@
+/* dlite-binrecord.c -- native binary serialisation of instances
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "utils/err.h"
+#include "utils/crc32c.h"
+#include "dlite-macros.h"
+#include "dlite-entity.h"
+#include "dlite-binrecord.h"
+
+/* The dtype of struct types is local to the process.  In property
+   descriptions they are therefore encoded as the string table offset
+   of the type name with this bit set. */
+#define STRUCT_TYPE_BIT ((uint64_t)1 << 63)
+
+
+/* Growing buffer used when writing records. */
+typedef struct {
+  char *data;
+  size_t n;                 /* number of bytes used */
+  size_t size;              /* allocated size */
+} Buf;
+
+
+/********************************************************************
+ * Writing
+ ********************************************************************/
+
+/* Ensures that `buf` can hold `n` more bytes.  Returns non-zero on
+   error. */
+static int buf_reserve(Buf *buf, size_t n)
+{
+  if (buf->n + n > buf->size) {
+    size_t size = buf->size + n + 4096;
+    void *ptr;
+    if (!(ptr = realloc(buf->data, size))) return err(1, "allocation failure");
+    buf->data = ptr;
+    buf->size = size;
+  }
+  return 0;
+}
+
+/* Appends `n` bytes from `src` to `buf`.  If `src` is NULL, zeros are
+   appended.  Returns non-zero on error. */
+static int buf_append(Buf *buf, const void *src, size_t n)
+{
+  if (buf_reserve(buf, n)) return 1;
+  if (src)
+    memcpy(buf->data + buf->n, src, n);
+  else
+    memset(buf->data + buf->n, 0, n);
+  buf->n += n;
+  return 0;
+}
+
+/* Pads `buf` with zeros to a multiple of `align`. */
+static int buf_align(Buf *buf, size_t align)
+{
+  return buf_append(buf, NULL, align_up(buf->n, align) - buf->n);
+}
+
+/* Appends string `s` to string table `strtab` and return its offset,
+   or zero if `s` is NULL. */
+static uint64_t strtab_add(Buf *strtab, const char *s, int *status)
+{
+  uint64_t offset = strtab->n;
+  if (!s) return 0;
+  if (buf_append(strtab, s, strlen(s) + 1)) *status = 1;
+  return offset;
+}
+
+/* Appends item `p` of allocated type `type` to `buf`.  Returns
+   non-zero on error. */
+static int encode_item(Buf *buf, Buf *strtab, const void *p, DLiteType type)
+{
+  uint64_t w[8];
+  int i, n=0, status=0;
+  switch (type) {
+  case dliteStringPtr:
+    w[n++] = strtab_add(strtab, *(char **)p, &status);
+    break;
+  case dliteDimension:
+    {
+      const DLiteDimension *d = p;
+      w[n++] = strtab_add(strtab, d->name, &status);
+      w[n++] = strtab_add(strtab, d->description, &status);
+    }
+    break;
+  case dliteProperty:
+    {
+      const DLiteProperty *prop = p;
+      w[n++] = strtab_add(strtab, prop->name, &status);
+      if (dlite_type_is_struct(prop->type))
+        w[n++] = STRUCT_TYPE_BIT |
+          strtab_add(strtab, dlite_struct_get(prop->type)->name, &status);
+      else
+        w[n++] = prop->type;
+      w[n++] = prop->size;
+      w[n++] = prop->ndims;
+      w[n++] = (prop->ndims > 0) ? strtab->n : 0;
+      for (i=0; i < prop->ndims; i++)
+        if (buf_append(strtab, prop->dims[i], strlen(prop->dims[i]) + 1))
+          return 1;
+      w[n++] = strtab_add(strtab, prop->unit, &status);
+      w[n++] = strtab_add(strtab, prop->iri, &status);
+      w[n++] = strtab_add(strtab, prop->description, &status);
+    }
+    break;
+  case dliteRelation:
+    {
+      const DLiteRelation *r = p;
+      w[n++] = strtab_add(strtab, r->s, &status);
+      w[n++] = strtab_add(strtab, r->p, &status);
+      w[n++] = strtab_add(strtab, r->o, &status);
+      w[n++] = strtab_add(strtab, r->id, &status);
+    }
+    break;
+  default:
+    return errx(1, "not an allocated type: %d", type);
+  }
+  if (status) return 1;
+  return buf_append(buf, w, n*sizeof(uint64_t));
+}
+
+/* Appends `inst` serialised as a new record to `buf`.  The size of
+   `buf` must be a multiple of DLITE_BINRECORD_ALIGN.  Returns non-zero
+   on error. */
+static int encode_record(Buf *buf, const DLiteInstance *inst)
+{
+  const DLiteMeta *meta = inst->meta;
+  DLiteBinRecord rec;
+  Buf strtab = {NULL, 0, 0};
+  size_t i, offset, pos, start=buf->n;
+  int j, retval=1, status=0;
+  uint64_t *props;
+  uint32_t *crcs=NULL;
+
+  assert(start % DLITE_BINRECORD_ALIGN == 0);
+  memset(&rec, 0, sizeof(rec));
+  if (buf_append(&strtab, "", 1)) goto fail;  /* offset zero is NULL */
+  rec.uri = strtab_add(&strtab, inst->uri, &status);
+  rec.metauri = strtab_add(&strtab, meta->uri, &status);
+  if (status) goto fail;
+  rec.ndims = meta->_ndimensions;
+  rec.nprops = meta->_nproperties;
+  if (!(crcs = calloc(meta->_nproperties + 1, sizeof(uint32_t))))
+    FAIL("allocation failure");
+
+  if (buf_append(buf, &rec, sizeof(rec))) goto fail;
+  for (i=0; i < meta->_ndimensions; i++) {
+    uint64_t dim = DLITE_DIM(inst, i);
+    if (buf_append(buf, &dim, sizeof(dim))) goto fail;
+  }
+  offset = buf->n;
+  if (buf_append(buf, NULL, meta->_nproperties*sizeof(uint64_t))) goto fail;
+
+  for (i=0; i < meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    const void *ptr = (char *)inst + meta->_propoffsets[i];
+    size_t n, nmemb=1;
+    int allocated = dlite_type_is_allocated(p->type);
+    if (p->ndims > 0) {
+      for (j=0; j < p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+      ptr = *(void **)ptr;
+      if (buf_align(buf, DLITE_BINRECORD_ALIGN)) goto fail;
+    } else if (allocated) {
+      if (buf_align(buf, sizeof(uint64_t))) goto fail;
+    } else {
+      if (buf_align(buf, dlite_type_get_alignment(p->type, p->size)))
+        goto fail;
+    }
+    props = (uint64_t *)(buf->data + offset);
+    props[i] = pos = buf->n - start;
+    if (nmemb == 0) continue;
+    if (allocated) {
+      for (n=0; n < nmemb; n++)
+        if (encode_item(buf, &strtab, (char *)ptr + n*p->size, p->type))
+          goto fail;
+    } else {
+      if (buf_append(buf, ptr, nmemb*p->size)) goto fail;
+    }
+    /* `props` is invalidated if `buf` was reallocated */
+    crcs[i] = crc32c(0, buf->data + start + pos, buf->n - start - pos);
+  }
+
+  /* string table */
+  rec.strtab = buf->n - start;
+  rec.strtabsize = strtab.n;
+  if (buf_append(buf, strtab.data, strtab.n)) goto fail;
+  crcs[meta->_nproperties] = crc32c(0, strtab.data, strtab.n);
+
+  /* checksum table */
+  if (buf_align(buf, sizeof(uint64_t))) goto fail;
+  rec.checksums = buf->n - start;
+  if (buf_append(buf, crcs, (meta->_nproperties + 1)*sizeof(uint32_t)))
+    goto fail;
+  if (buf_align(buf, DLITE_BINRECORD_ALIGN)) goto fail;
+  rec.size = buf->n - start;
+  memcpy(buf->data + start, &rec, sizeof(rec));
+
+  retval = 0;
+ fail:
+  if (strtab.data) free(strtab.data);
+  if (crcs) free(crcs);
+  return retval;
+}
+
+/*
+  Appends `inst` serialised as a binary record to `*buf` at position
+  `pos`.  Returns the number of bytes appended or a negative value on
+  error.
+ */
+int dlite_binrecord_encode(char **buf, size_t *size, size_t pos,
+                           const DLiteInstance *inst)
+{
+  Buf b = {*buf, pos, *size};
+  int stat;
+  if (pos % DLITE_BINRECORD_ALIGN)
+    return errx(-1, "binary records must be aligned to %d bytes",
+                DLITE_BINRECORD_ALIGN);
+  if (pos > *size) return errx(-1, "position is beyond end of buffer");
+  stat = encode_record(&b, inst);
+  *buf = b.data;
+  *size = b.size;
+  if (stat) return -1;
+  if (b.n - pos > INT32_MAX)
+    return errx(-1, "binary record of %s exceeds 2 GB", inst->uuid);
+  return (int)(b.n - pos);
+}
+
+
+/********************************************************************
+ * Reading
+ ********************************************************************/
+
+/*
+  Returns a pointer to string at `offset` in the string table of
+  record `rec`, or NULL if `offset` is zero.  `*status` is set to
+  non-zero if `offset` is out of range.
+ */
+const char *dlite_binrecord_str(const DLiteBinRecord *rec, uint64_t offset,
+                                int *status)
+{
+  const char *strtab = (const char *)rec + rec->strtab;
+  if (!offset) return NULL;
+  if (offset >= rec->strtabsize ||
+      !memchr(strtab + offset, '\0', rec->strtabsize - offset)) {
+    *status = 1;
+    return NULL;
+  }
+  return strtab + offset;
+}
+
+/*
+  Checks that the `size` bytes at `rec` holds a consistent record
+  header.  Returns non-zero if not.
+ */
+int dlite_binrecord_check(const DLiteBinRecord *rec, size_t size)
+{
+  size_t n;
+  if (size < sizeof(DLiteBinRecord) || rec->size != size ||
+      rec->ndims > size / sizeof(uint64_t) ||
+      rec->nprops > size / sizeof(uint64_t))
+    return 1;
+  n = sizeof(DLiteBinRecord) + (rec->ndims + rec->nprops)*sizeof(uint64_t);
+  if (n > size || rec->strtab < n || rec->strtab > size ||
+      rec->strtabsize > size - rec->strtab)
+    return 1;
+  if (rec->checksums &&
+      (rec->checksums < rec->strtab + rec->strtabsize ||
+       rec->checksums % sizeof(uint32_t) || rec->checksums > size ||
+       (rec->nprops + 1)*sizeof(uint32_t) > size - rec->checksums))
+    return 1;
+  return 0;
+}
+
+/* Returns a newly allocated copy of `s` or NULL if `s` is NULL. */
+static char *str_dup(const char *s, int *status)
+{
+  char *copy;
+  if (!s) return NULL;
+  if (!(copy = strdup(s))) *status = 1;
+  return copy;
+}
+
+/* Decodes item of allocated `type` from `src` to `p`.  Returns
+   pointer past the item or NULL on error. */
+static const uint64_t *decode_item(void *p, const uint64_t *w,
+                                   const DLiteBinRecord *rec, DLiteType type)
+{
+  int i, n=0, status=0;
+  switch (type) {
+  case dliteStringPtr:
+    *(char **)p = str_dup(dlite_binrecord_str(rec, w[n++], &status), &status);
+    break;
+  case dliteDimension:
+    {
+      DLiteDimension *d = p;
+      d->name = str_dup(dlite_binrecord_str(rec, w[n++], &status), &status);
+      d->description =
+        str_dup(dlite_binrecord_str(rec, w[n++], &status), &status);
+    }
+    break;
+  case dliteProperty:
+    {
+      DLiteProperty *prop = p;
+      prop->name = str_dup(dlite_binrecord_str(rec, w[n++], &status),
+                           &status);
+      if (w[n] & STRUCT_TYPE_BIT) {
+        const char *name =
+          dlite_binrecord_str(rec, w[n++] & ~STRUCT_TYPE_BIT, &status);
+        const DLiteStruct *st = (name) ? dlite_struct_get_by_name(name) : NULL;
+        if (!st)
+          return errx(1, "unregistered struct type: %s", name), NULL;
+        prop->type = st->dtype;
+      } else {
+        prop->type = (DLiteType)w[n++];
+      }
+      prop->size = w[n++];
+      prop->ndims = (int)w[n++];
+      if (prop->ndims > 0) {
+        uint64_t offset = w[n];
+        if (!(prop->dims = calloc(prop->ndims, sizeof(char *)))) status = 1;
+        for (i=0; i < prop->ndims && !status; i++) {
+          const char *s = dlite_binrecord_str(rec, offset, &status);
+          if (!s) status = 1;
+          prop->dims[i] = str_dup(s, &status);
+          if (s) offset += strlen(s) + 1;
+        }
+      }
+      n++;
+      prop->unit = str_dup(dlite_binrecord_str(rec, w[n++], &status),
+                           &status);
+      prop->iri = str_dup(dlite_binrecord_str(rec, w[n++], &status), &status);
+      prop->description =
+        str_dup(dlite_binrecord_str(rec, w[n++], &status), &status);
+    }
+    break;
+  case dliteRelation:
+    {
+      DLiteRelation *r = p;
+      r->s = str_dup(dlite_binrecord_str(rec, w[n++], &status), &status);
+      r->p = str_dup(dlite_binrecord_str(rec, w[n++], &status), &status);
+      r->o = str_dup(dlite_binrecord_str(rec, w[n++], &status), &status);
+      r->id = str_dup(dlite_binrecord_str(rec, w[n++], &status), &status);
+    }
+    break;
+  default:
+    return errx(1, "not an allocated type: %d", type), NULL;
+  }
+  if (status) return errx(1, "corrupted string table"), NULL;
+  return w + n;
+}
+
+/* Returns size in bytes of an encoded item of allocated `type`. */
+static size_t encoded_size(DLiteType type)
+{
+  switch (type) {
+  case dliteStringPtr: return 1*sizeof(uint64_t);
+  case dliteDimension: return 2*sizeof(uint64_t);
+  case dliteProperty:  return 8*sizeof(uint64_t);
+  case dliteRelation:  return 4*sizeof(uint64_t);
+  default:             return 0;
+  }
+}
+
+/*
+  Returns a new instance decoded from record `rec`.  Returns NULL on
+  error.
+ */
+DLiteInstance *dlite_binrecord_decode(const DLiteBinRecord *rec,
+                                      const char *uuid,
+                                      DLiteBinRecordAdopt adopt, void *data)
+{
+  return dlite_binrecord_decode_as(rec, uuid, NULL, adopt, data);
+}
+
+/*
+  Returns a new instance with id `id` decoded from record `rec`.
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_binrecord_decode_as(const DLiteBinRecord *rec,
+                                         const char *uuid, const char *id,
+                                         DLiteBinRecordAdopt adopt,
+                                         void *data)
+{
+  return dlite_binrecord_decode_with(rec, uuid, id, 0, adopt, data);
+}
+
+/*
+  Like dlite_binrecord_decode_as(), but with additional `flags`.
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_binrecord_decode_with(const DLiteBinRecord *rec,
+                                           const char *uuid, const char *id,
+                                           int flags,
+                                           DLiteBinRecordAdopt adopt,
+                                           void *data)
+{
+  const uint32_t *crcs = (rec->checksums && !(flags & dliteBinRecordNoVerify))
+    ? (const uint32_t *)((const char *)rec + rec->checksums) : NULL;
+  const uint64_t *recdims = (const uint64_t *)(rec + 1);
+  const uint64_t *props = recdims + rec->ndims;
+  DLiteMeta *meta=NULL;
+  DLiteInstance *inst=NULL;
+  const char *uri, *metauri;
+  size_t i, *dims=NULL;
+  int j, status=0, ok=0;
+
+  /* the string table is needed to find the metadata */
+  if (crcs && crcs[rec->nprops] !=
+      crc32c(0, (const char *)rec + rec->strtab, rec->strtabsize))
+    FAIL1("checksum mismatch in string table of %s", uuid);
+
+  /* get metadata */
+  uri = dlite_binrecord_str(rec, rec->uri, &status);
+  metauri = dlite_binrecord_str(rec, rec->metauri, &status);
+  if (status || !metauri) FAIL1("corrupted record %s", uuid);
+  if (!(meta = (DLiteMeta *)dlite_instance_get(metauri)))
+    FAIL2("cannot find metadata \"%s\" of instance %s", metauri, uuid);
+  if (!meta->_propoffsets && dlite_meta_init(meta)) goto fail;
+  if (rec->ndims != meta->_ndimensions || rec->nprops != meta->_nproperties)
+    FAIL2("instance %s does not match its metadata %s", uuid, metauri);
+
+  /* create instance */
+  if (!(dims = calloc(meta->_ndimensions + 1, sizeof(size_t))))
+    FAIL("allocation failure");
+  for (i=0; i < meta->_ndimensions; i++) dims[i] = recdims[i];
+  if (!id) id = (uri) ? uri : uuid;
+  if (!(inst = dlite_instance_create(meta, dims, id)))
+    goto fail;
+
+  /* assign properties */
+  for (i=0; i < meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    void *ptr = DLITE_PROP(inst, i);
+    const char *src = (const char *)rec + props[i];
+    size_t n, nmemb=1, itemsize;
+    int allocated = dlite_type_is_allocated(p->type), stat=1;
+    if (p->ndims > 0) {
+      for (j=0; j < p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+      ptr = *(void **)ptr;
+    }
+    itemsize = (allocated) ? encoded_size(p->type) : p->size;
+    if (props[i] > rec->strtab || nmemb*itemsize > rec->strtab - props[i])
+      FAIL2("corrupted property \"%s\" of %s", p->name, uuid);
+    if (crcs && crcs[i] != crc32c(0, src, nmemb*itemsize))
+      FAIL2("checksum mismatch in property \"%s\" of %s", p->name, uuid);
+    if (nmemb == 0) continue;
+
+    if (allocated) {
+      const uint64_t *w = (const uint64_t *)src;
+      for (n=0; n < nmemb; n++)
+        if (!(w = decode_item((char *)ptr + n*p->size, w, rec, p->type)))
+          goto fail;
+    } else {
+      if (adopt && p->ndims > 0 && dlite_instance_is_data(inst) &&
+          (stat = adopt(inst, i, (void *)src, data)) < 0)
+        goto fail;
+      if (stat) memcpy(ptr, src, nmemb*p->size);
+    }
+    if (meta->_loadprop) meta->_loadprop(inst, i);
+  }
+  if (dlite_instance_is_meta(inst) && dlite_meta_init((DLiteMeta *)inst))
+    goto fail;
+
+  ok = 1;
+ fail:
+  if (dims) free(dims);
+  if (meta) dlite_meta_decref(meta);
+  if (!ok && inst) {
+    dlite_instance_decref(inst);
+    inst = NULL;
+  }
+  return inst;
+}
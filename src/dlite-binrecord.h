@@ -0,0 +1,155 @@
+#ifndef _DLITE_BINRECORD_H
+#define _DLITE_BINRECORD_H
+
+/**
+  @file
+  @brief Native binary serialisation of instances
+
+  A binary record mirrors the in-memory layout of an instance, such
+  that it can be written and read without parsing.  It is used by the
+  `bin` storage plugin for its files and by the `remote` storage
+  plugin and `dlite-server` as wire format.
+
+  All integers are 64-bit and in native byte order:
+
+      DLiteBinRecord                      (record offset 0)
+      uint64_t dims[ndims]                dimension values
+      uint64_t props[nprops]              record offsets of property blocks
+      property blocks                     arrays aligned to
+                                          DLITE_BINRECORD_ALIGN, scalars per
+                                          dlite_type_get_alignment()
+      string table                        NUL-terminated strings
+      uint32_t checksums[nprops+1]        CRC-32C of each property block
+                                          followed by the string table
+
+  Items of allocated types are stored as 64-bit words, where strings
+  are replaced by their offset into the string table (zero means
+  NULL):
+
+      dliteStringPtr  1 word:  string
+      dliteDimension  2 words: name, description
+      dliteProperty   8 words: name, type, size, ndims, dims, unit, iri,
+                               description
+                               where `dims` is the offset of the first
+                               of `ndims` consecutive strings
+      dliteRelation   4 words: s, p, o, id
+
+  The checksum of a property block covers its `nmemb` encoded items.
+  Records written before checksums were introduced have no checksum
+  table, which is indicated by a zero `checksums` offset.
+
+  The size of a record is a multiple of DLITE_BINRECORD_ALIGN.
+  Records must be aligned to at least 8 bytes when decoded.
+ */
+
+#include <stdint.h>
+
+#include "dlite-entity.h"
+
+/** Alignment of records and arrays within records. */
+#define DLITE_BINRECORD_ALIGN 64
+
+/** Marker in native byte order, used to detect byte order mismatch. */
+#define DLITE_BINRECORD_BYTEORDER 0x01020304
+
+
+/** Record header */
+typedef struct {
+  uint64_t size;            /*!< Size of record in bytes. */
+  uint64_t uri;             /*!< String offset of uri, zero if none. */
+  uint64_t metauri;         /*!< String offset of metadata uri. */
+  uint64_t ndims;           /*!< Number of dimensions. */
+  uint64_t nprops;          /*!< Number of properties. */
+  uint64_t strtab;          /*!< Record offset of string table. */
+  uint64_t strtabsize;      /*!< Size of string table. */
+  uint64_t checksums;       /*!< Record offset of checksum table, zero if
+                                 none. */
+} DLiteBinRecord;
+
+/** Flags for dlite_binrecord_decode_with(). */
+typedef enum _DLiteBinRecordFlag {
+  dliteBinRecordNoVerify=1  /*!< Do not verify checksums. */
+} DLiteBinRecordFlag;
+
+
+/**
+  Callback offering property `i` of `inst` to be adopted directly from
+  `src`, which points into the record being decoded.  See
+  dlite_instance_adopt_property_by_index().
+
+  Should return 0 if the array was adopted, 1 if it should be copied
+  and a negative value on error.
+ */
+typedef int (*DLiteBinRecordAdopt)(DLiteInstance *inst, size_t i, void *src,
+                                   void *data);
+
+
+/**
+  Appends `inst` serialised as a binary record to `*buf` at position
+  `pos`, which must be a multiple of DLITE_BINRECORD_ALIGN.  `*buf`
+  is a malloc'ed buffer of `*size` bytes, which is reallocated as
+  needed.  It may be NULL.
+
+  Returns the number of bytes appended or a negative value on error.
+ */
+int dlite_binrecord_encode(char **buf, size_t *size, size_t pos,
+                           const DLiteInstance *inst);
+
+/**
+  Checks that the `size` bytes at `rec` holds a consistent record
+  header.  Returns non-zero if not.
+ */
+int dlite_binrecord_check(const DLiteBinRecord *rec, size_t size);
+
+/**
+  Returns a pointer to the string at `offset` in the string table of
+  record `rec`, or NULL if `offset` is zero.  `*status` is set to
+  non-zero if `offset` is out of range.
+ */
+const char *dlite_binrecord_str(const DLiteBinRecord *rec, uint64_t offset,
+                                int *status);
+
+/**
+  Returns a new instance decoded from record `rec`, which must have
+  been validated with dlite_binrecord_check().  `uuid` is the uuid of
+  the instance, used as id if the record has no uri.
+
+  If `adopt` is not NULL, it is called for each array of a
+  non-allocated type in a data instance.  Otherwise all arrays are
+  copied.
+
+  The checksums of the string table and of each property block are
+  verified before they are decoded, such that a corrupted record is
+  detected without reading data twice.
+
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_binrecord_decode(const DLiteBinRecord *rec,
+                                      const char *uuid,
+                                      DLiteBinRecordAdopt adopt, void *data);
+
+/**
+  Like dlite_binrecord_decode(), but the new instance gets id `id`
+  instead of the uri or uuid stored in the record.  If `id` is NULL,
+  this is equivalent to dlite_binrecord_decode().
+
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_binrecord_decode_as(const DLiteBinRecord *rec,
+                                         const char *uuid, const char *id,
+                                         DLiteBinRecordAdopt adopt,
+                                         void *data);
+
+/**
+  Like dlite_binrecord_decode_as(), but with additional `flags`.  See
+  DLiteBinRecordFlag.
+
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_binrecord_decode_with(const DLiteBinRecord *rec,
+                                           const char *uuid, const char *id,
+                                           int flags,
+                                           DLiteBinRecordAdopt adopt,
+                                           void *data);
+
+#endif /* _DLITE_BINRECORD_H */
@@ -0,0 +1,411 @@
+/* dlite-bloom.c -- Bloom filters of the instances in storage files
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "utils/fileinfo.h"
+#include "utils/map.h"
+#include "utils/strutils.h"
+#include "utils/thread.h"
+#include "dlite-misc.h"
+#include "dlite-macros.h"
+#include "dlite-bloom.h"
+
+#define GLOBALS_ID "dlite-bloom-id"
+
+/* Magic number and version of sidecar files */
+#define BLOOM_MAGIC "DLBF"
+#define BLOOM_VERSION 1
+
+/* Size of the sidecar header in bytes */
+#define BLOOM_HEADER_SIZE 40
+
+
+struct _DLiteBloom {
+  uint64_t nbits;          /* number of bits, a multiple of 8 */
+  uint32_t nhashes;        /* number of hash functions */
+  unsigned char *bits;     /* bit array [nbits/8] */
+};
+
+/* A cached sidecar */
+typedef struct {
+  double mtime;            /* modification time of the storage file */
+  long long size;          /* size of the storage file */
+  double sidecar_mtime;    /* modification time of the sidecar */
+  DLiteBloom *b;           /* the filter, NULL if the sidecar is unusable */
+} BloomEntry;
+
+typedef map_t(BloomEntry) bloom_map_t;
+
+/* Global variables for this module */
+typedef struct {
+  ThreadMutex mutex;
+  bloom_map_t cache;       /* maps storage location to cached sidecar */
+} Globals;
+
+
+/* Protects creation of the globals */
+static ThreadMutex bloom_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Frees the entries of `cache`. */
+static void free_cache(bloom_map_t *cache)
+{
+  const char *key;
+  map_iter_t iter = map_iter(cache);
+  while ((key = map_next(cache, &iter))) {
+    BloomEntry *e = map_get(cache, key);
+    if (e && e->b) dlite_bloom_free(e->b);
+  }
+  map_deinit(cache);
+}
+
+/* Frees global state for this module - called by atexit() */
+static void free_globals(void *globals)
+{
+  Globals *g = globals;
+  free_cache(&g->cache);
+  thread_mutex_destroy(&g->mutex);
+  free(g);
+}
+
+/* Return a pointer to global state for this module */
+static Globals *get_globals(void)
+{
+  Globals *g = dlite_globals_get_state(GLOBALS_ID);
+  if (!g) {
+    thread_mutex_lock(&bloom_mutex);
+    if (!(g = dlite_globals_get_state(GLOBALS_ID))) {
+      if ((g = calloc(1, sizeof(Globals)))) {
+        thread_mutex_init(&g->mutex);
+        map_init(&g->cache);
+        dlite_globals_add_state(GLOBALS_ID, g, free_globals);
+      }
+    }
+    thread_mutex_unlock(&bloom_mutex);
+    if (!g) return err(1, "allocation failure"), NULL;
+  }
+  return g;
+}
+
+/* Assigns `h1` and `h2` to the two hashes of `id` used for double
+   hashing.  Returns non-zero if `id` cannot be converted to an UUID. */
+static int hash_id(const char *id, uint64_t *h1, uint64_t *h2)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  uint64_t h = 0xcbf29ce484222325ULL;  /* FNV-1a */
+  const char *p;
+  if (dlite_get_uuid(uuid, id) < 0) return 1;
+  for (p=uuid; *p; p++) {
+    h ^= (unsigned char)*p;
+    h *= 0x100000001b3ULL;
+  }
+  *h1 = h;
+  h ^= h >> 33;  /* final mixing of MurmurHash3 */
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  *h2 = h | 1;
+  return 0;
+}
+
+/* Writes `v` as `n` little-endian bytes to `buf`. */
+static void put_le(unsigned char *buf, uint64_t v, int n)
+{
+  int i;
+  for (i=0; i<n; i++) buf[i] = (unsigned char)(v >> (8*i));
+}
+
+/* Returns the `n` little-endian bytes in `buf` as an integer. */
+static uint64_t get_le(const unsigned char *buf, int n)
+{
+  uint64_t v=0;
+  int i;
+  for (i=n-1; i>=0; i--) v = (v << 8) | buf[i];
+  return v;
+}
+
+
+/*
+  Returns a new empty Bloom filter sized for `n` UUIDs.
+ */
+DLiteBloom *dlite_bloom_create(size_t n)
+{
+  DLiteBloom *b;
+  uint64_t nbits = (uint64_t)n * DLITE_BLOOM_BITS_PER_ITEM;
+  if (nbits < 64) nbits = 64;
+  nbits = (nbits + 7) & ~(uint64_t)7;
+  if (!(b = calloc(1, sizeof(DLiteBloom))) ||
+      !(b->bits = calloc(nbits / 8, 1))) {
+    if (b) free(b);
+    return err(1, "allocation failure"), NULL;
+  }
+  b->nbits = nbits;
+  b->nhashes = DLITE_BLOOM_NHASHES;
+  return b;
+}
+
+/*
+  Frees Bloom filter `b`.
+ */
+void dlite_bloom_free(DLiteBloom *b)
+{
+  if (!b) return;
+  free(b->bits);
+  free(b);
+}
+
+/*
+  Adds `id` to Bloom filter `b`.
+ */
+int dlite_bloom_add(DLiteBloom *b, const char *id)
+{
+  uint64_t h1, h2, bit;
+  uint32_t i;
+  if (hash_id(id, &h1, &h2)) return 1;
+  for (i=0; i < b->nhashes; i++) {
+    bit = (h1 + i*h2) % b->nbits;
+    b->bits[bit / 8] |= (unsigned char)(1 << (bit % 8));
+  }
+  return 0;
+}
+
+/*
+  Returns non-zero if `id` may be in Bloom filter `b`.
+ */
+int dlite_bloom_contains(const DLiteBloom *b, const char *id)
+{
+  uint64_t h1, h2, bit;
+  uint32_t i;
+  if (hash_id(id, &h1, &h2)) return 1;
+  for (i=0; i < b->nhashes; i++) {
+    bit = (h1 + i*h2) % b->nbits;
+    if (!(b->bits[bit / 8] & (1 << (bit % 8)))) return 0;
+  }
+  return 1;
+}
+
+/*
+  Writes Bloom filter `b` to `filename`.  The file is written to a
+  temporary file that is renamed on success, such that concurrent
+  readers never see a partly written filter.
+ */
+int dlite_bloom_write(const DLiteBloom *b, const char *filename, double mtime,
+                      long long size)
+{
+  unsigned char header[BLOOM_HEADER_SIZE];
+  uint64_t mbits;
+  char *tmp=NULL;
+  FILE *fp=NULL;
+  int retval=1;
+
+  memset(header, 0, sizeof(header));
+  memcpy(header, BLOOM_MAGIC, 4);
+  put_le(header + 4, BLOOM_VERSION, 4);
+  put_le(header + 8, b->nhashes, 4);
+  put_le(header + 16, b->nbits, 8);
+  memcpy(&mbits, &mtime, sizeof(mbits));
+  put_le(header + 24, mbits, 8);
+  put_le(header + 32, (uint64_t)size, 8);
+
+  if (!(tmp = aprintf("%s.tmp", filename))) FAIL("allocation failure");
+  if (!(fp = fopen(tmp, "wb"))) FAIL1("cannot create '%s'", tmp);
+  if (fwrite(header, 1, sizeof(header), fp) != sizeof(header) ||
+      fwrite(b->bits, 1, b->nbits / 8, fp) != b->nbits / 8)
+    FAIL1("cannot write '%s'", tmp);
+  if (fclose(fp)) {
+    fp = NULL;
+    FAIL1("cannot write '%s'", tmp);
+  }
+  fp = NULL;
+  if (rename(tmp, filename)) {
+    /* rename() does not replace existing files on Windows */
+    remove(filename);
+    if (rename(tmp, filename))
+      FAIL2("cannot rename '%s' to '%s'", tmp, filename);
+  }
+  retval = 0;
+ fail:
+  if (fp) fclose(fp);
+  if (retval && tmp) remove(tmp);
+  if (tmp) free(tmp);
+  return retval;
+}
+
+/*
+  Returns a new Bloom filter read from `filename`.
+ */
+DLiteBloom *dlite_bloom_read(const char *filename, double *mtime,
+                             long long *size)
+{
+  unsigned char header[BLOOM_HEADER_SIZE];
+  DLiteBloom *b=NULL;
+  uint64_t nbits, mbits;
+  uint32_t nhashes;
+  FILE *fp;
+  if (!(fp = fopen(filename, "rb")))
+    return errx(1, "cannot open '%s'", filename), NULL;
+  if (fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+      memcmp(header, BLOOM_MAGIC, 4))
+    FAIL1("not a bloom filter: %s", filename);
+  if (get_le(header + 4, 4) != BLOOM_VERSION)
+    FAIL1("unsupported bloom filter version: %s", filename);
+  nhashes = (uint32_t)get_le(header + 8, 4);
+  nbits = get_le(header + 16, 8);
+  if (nhashes < 1 || nhashes > 32 || nbits < 64 || nbits % 8 ||
+      (long long)(nbits / 8) > fileinfo_size(filename) - BLOOM_HEADER_SIZE)
+    FAIL1("invalid bloom filter: %s", filename);
+  if (!(b = calloc(1, sizeof(DLiteBloom))) ||
+      !(b->bits = malloc(nbits / 8)))
+    FAIL("allocation failure");
+  b->nbits = nbits;
+  b->nhashes = nhashes;
+  if (fread(b->bits, 1, nbits / 8, fp) != nbits / 8)
+    FAIL1("truncated bloom filter: %s", filename);
+  if (mtime) {
+    mbits = get_le(header + 24, 8);
+    memcpy(mtime, &mbits, sizeof(mbits));
+  }
+  if (size) *size = (long long)get_le(header + 32, 8);
+  fclose(fp);
+  return b;
+ fail:
+  fclose(fp);
+  dlite_bloom_free(b);
+  return NULL;
+}
+
+/*
+  Returns the name of the sidecar file of storage file `location`.
+ */
+char *dlite_bloom_sidecar(const char *location)
+{
+  char *sidecar = aprintf("%s.bloom", location);
+  if (!sidecar) err(1, "allocation failure");
+  return sidecar;
+}
+
+/*
+  Writes a sidecar with the UUIDs in `uuids` for storage file `location`.
+ */
+int dlite_bloom_write_sidecar(const char *location, const char **uuids,
+                              int n)
+{
+  DLiteBloom *b=NULL;
+  char *sidecar=NULL;
+  double mtime;
+  long long size;
+  int i, retval=1;
+  if (n < 0) for (n=0; uuids && uuids[n]; n++) ;
+  if ((mtime = fileinfo_mtime(location)) < 0 ||
+      (size = fileinfo_size(location)) < 0)
+    FAIL1("cannot stat '%s'", location);
+  if (!(b = dlite_bloom_create(n))) goto fail;
+  for (i=0; i<n; i++)
+    if (dlite_bloom_add(b, uuids[i])) goto fail;
+  if (!(sidecar = dlite_bloom_sidecar(location))) goto fail;
+  if (dlite_bloom_write(b, sidecar, mtime, size)) goto fail;
+  retval = 0;
+ fail:
+  if (sidecar) free(sidecar);
+  dlite_bloom_free(b);
+  return retval;
+}
+
+/* Returns the cached Bloom filter of storage file `location`, reading
+   its sidecar if needed.  Returns NULL if `location` has no up to date
+   sidecar.  Must be called with the lock of `g` held. */
+static DLiteBloom *get_filter(Globals *g, const char *location)
+{
+  BloomEntry *e, entry;
+  char *sidecar;
+  double mtime, sidecar_mtime, written=-1;
+  long long size, written_size=-1;
+
+  if ((mtime = fileinfo_mtime(location)) < 0) return NULL;
+  if ((size = fileinfo_size(location)) < 0) return NULL;
+  if (!(sidecar = dlite_bloom_sidecar(location))) return NULL;
+  sidecar_mtime = fileinfo_mtime(sidecar);
+  if ((e = map_get(&g->cache, location)) && e->mtime == mtime &&
+      e->size == size && e->sidecar_mtime == sidecar_mtime) {
+    free(sidecar);
+    return e->b;
+  }
+
+  memset(&entry, 0, sizeof(entry));
+  entry.mtime = mtime;
+  entry.size = size;
+  entry.sidecar_mtime = sidecar_mtime;
+  if (sidecar_mtime >= 0) {
+    ErrTry:
+      entry.b = dlite_bloom_read(sidecar, &written, &written_size);
+    ErrOther:  // invalid sidecars are ignored
+      break;
+    ErrEnd;
+    if (entry.b && (written != mtime || written_size != size)) {
+      /* the storage file has been modified after the sidecar */
+      dlite_bloom_free(entry.b);
+      entry.b = NULL;
+    }
+  }
+  free(sidecar);
+  if (e && e->b) dlite_bloom_free(e->b);
+  if (map_set(&g->cache, location, entry)) {
+    dlite_bloom_free(entry.b);
+    return NULL;
+  }
+  return entry.b;
+}
+
+/*
+  Returns non-zero if storage file `location` has an up to date
+  sidecar.
+ */
+int dlite_bloom_available(const char *location)
+{
+  Globals *g;
+  int available;
+  if (!location || !(g = get_globals())) return 0;
+  thread_mutex_lock(&g->mutex);
+  available = (get_filter(g, location) != NULL);
+  thread_mutex_unlock(&g->mutex);
+  return available;
+}
+
+/*
+  Returns non-zero if storage file `location` has an up to date
+  sidecar telling that it does not contain the instance with given
+  `id`.
+ */
+int dlite_bloom_excludes(const char *location, const char *id)
+{
+  DLiteBloom *b;
+  Globals *g;
+  int excludes=0;
+  if (!location || !id || !(g = get_globals())) return 0;
+  thread_mutex_lock(&g->mutex);
+  if ((b = get_filter(g, location))) excludes = !dlite_bloom_contains(b, id);
+  thread_mutex_unlock(&g->mutex);
+  return excludes;
+}
+
+/*
+  Clears the in-memory cache of sidecars.
+ */
+void dlite_bloom_clear_cache(void)
+{
+  Globals *g;
+  if (!(g = dlite_globals_get_state(GLOBALS_ID))) return;
+  thread_mutex_lock(&g->mutex);
+  free_cache(&g->cache);
+  map_init(&g->cache);
+  thread_mutex_unlock(&g->mutex);
+}
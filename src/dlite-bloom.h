@@ -0,0 +1,128 @@
+#ifndef _DLITE_BLOOM_H
+#define _DLITE_BLOOM_H
+
+/**
+  @file
+  @brief Bloom filters of the instances in storage files
+
+  A Bloom filter is a compact set of UUIDs that can tell that a UUID
+  is definitely not in the set.  With 10 bits per UUID, about 1% of
+  the UUIDs that are not in the set are reported as maybe present.
+
+  A storage file can have a Bloom filter of the UUIDs of the instances
+  it contains in a sidecar file, named as the storage file with
+  `.bloom` appended.  When dlite_instance_get() searches the storage
+  paths, storage files whose sidecar excludes the requested UUID are
+  skipped without being opened.  This complements the storage index
+  (see dlite-storage-index.h) for storage paths that are added
+  dynamically, since sidecars are written with the storage.  When the
+  index is updated, new or modified storage files with an up to date
+  sidecar are not opened for listing their instances, but left to the
+  sidecar.
+
+  A sidecar is only used if the modification time and size of the
+  storage file are the same as when the sidecar was written.  It is written when a
+  writable storage is closed, if any of the following holds:
+
+    - the storage was opened with option `bloom=yes`
+    - the environment variable `DLITE_STORAGE_BLOOM` is true and the
+      storage was not opened with option `bloom=no`
+    - the storage file already has a sidecar, which is kept up to date
+      unless the storage was opened with option `bloom=no`
+
+  Sidecars can also be written for all storage files in the storage
+  paths with the `--bloom` option of the `dlite-index` tool.  Only
+  storages that can list their instances get a sidecar.
+ */
+
+#include <stddef.h>
+
+
+/** Bits per UUID in Bloom filters */
+#define DLITE_BLOOM_BITS_PER_ITEM 10
+
+/** Number of hash functions of Bloom filters */
+#define DLITE_BLOOM_NHASHES 7
+
+
+/** A Bloom filter of UUIDs */
+typedef struct _DLiteBloom DLiteBloom;
+
+
+/**
+  Returns a new empty Bloom filter sized for `n` UUIDs, or NULL on
+  error.
+ */
+DLiteBloom *dlite_bloom_create(size_t n);
+
+/**
+  Frees Bloom filter `b`.
+ */
+void dlite_bloom_free(DLiteBloom *b);
+
+/**
+  Adds `id` to Bloom filter `b`.  `id` may be an UUID or an URI, which
+  is converted to an UUID with dlite_get_uuid().  Returns non-zero on
+  error.
+ */
+int dlite_bloom_add(DLiteBloom *b, const char *id);
+
+/**
+  Returns non-zero if `id` may be in Bloom filter `b` and zero if it
+  definitely is not.
+ */
+int dlite_bloom_contains(const DLiteBloom *b, const char *id);
+
+/**
+  Writes Bloom filter `b` to `filename`.  `mtime` and `size` are the
+  modification time and size of the storage file it belongs to.
+  Returns non-zero on error.
+ */
+int dlite_bloom_write(const DLiteBloom *b, const char *filename, double mtime,
+                      long long size);
+
+/**
+  Returns a new Bloom filter read from `filename`, or NULL on error.
+  If `mtime` and `size` are not NULL, they are assigned to the
+  modification time and size of the storage file when the filter was
+  written.
+ */
+DLiteBloom *dlite_bloom_read(const char *filename, double *mtime,
+                             long long *size);
+
+/**
+  Returns a newly malloc'ed string with the name of the sidecar file of
+  storage file `location`, or NULL on error.
+ */
+char *dlite_bloom_sidecar(const char *location);
+
+/**
+  Writes a sidecar with the `n` UUIDs in array `uuids` for storage file
+  `location`.  If `n` is negative, `uuids` is NULL-terminated.  Returns
+  non-zero on error.
+ */
+int dlite_bloom_write_sidecar(const char *location, const char **uuids,
+                              int n);
+
+/**
+  Returns non-zero if storage file `location` has an up to date
+  sidecar.
+ */
+int dlite_bloom_available(const char *location);
+
+/**
+  Returns non-zero if storage file `location` has an up to date
+  sidecar telling that it does not contain the instance with given
+  `id`.  Such files can be skipped when searching for `id`.
+
+  Sidecars are cached in memory and only reread if they or the
+  storage file are modified.
+ */
+int dlite_bloom_excludes(const char *location, const char *id);
+
+/**
+  Clears the in-memory cache of sidecars.
+ */
+void dlite_bloom_clear_cache(void);
+
+#endif /* _DLITE_BLOOM_H */
@@ -0,0 +1,1062 @@
+/* dlite-cbor.c -- compact binary serialisation of instances in CBOR
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "utils/err.h"
+#include "dlite-macros.h"
+#include "dlite-entity.h"
+#include "dlite-cbor.h"
+
+/* CBOR major types */
+#define MAJOR_UINT   0
+#define MAJOR_NINT   1
+#define MAJOR_BYTES  2
+#define MAJOR_TEXT   3
+#define MAJOR_ARRAY  4
+#define MAJOR_MAP    5
+#define MAJOR_TAG    6
+#define MAJOR_SIMPLE 7
+
+/* Simple values and additional information of major type 7 */
+#define SIMPLE_FALSE 20
+#define SIMPLE_TRUE  21
+#define SIMPLE_NULL  22
+#define AI_FLOAT16   25
+#define AI_FLOAT32   26
+#define AI_FLOAT64   27
+
+/* Tags */
+#define TAG_MULTIDIM      40   /* multi-dimensional array, RFC 8746 */
+#define TAG_TYPED_FIRST   64   /* first typed array tag, RFC 8746 */
+#define TAG_TYPED_LAST    87   /* last typed array tag, RFC 8746 */
+
+/* Maximum nesting of data items accepted when scanning */
+#define CBOR_MAX_DEPTH 64
+
+
+/* Returns non-zero if the host is little endian. */
+static int host_is_little(void)
+{
+  const unsigned short one = 1;
+  return *(const unsigned char *)&one;
+}
+
+
+/********************************************************************
+ * Writing
+ ********************************************************************/
+
+/* Growing buffer used when serialising.  If `fixed` is non-zero, the
+   buffer is not reallocated and output beyond `size` is only
+   counted. */
+typedef struct {
+  unsigned char *data;
+  size_t n;                 /* number of bytes written or counted */
+  size_t size;              /* allocated size */
+  int fixed;                /* whether `data` is a fixed-size buffer */
+} Buf;
+
+/* Appends `n` bytes from `src` to `buf`.  Returns non-zero on error. */
+static int put(Buf *buf, const void *src, size_t n)
+{
+  if (buf->n + n > buf->size && !buf->fixed) {
+    size_t size = 2*buf->size + n + 256;
+    void *ptr;
+    if (!(ptr = realloc(buf->data, size))) return err(1, "allocation failure");
+    buf->data = ptr;
+    buf->size = size;
+  }
+  if (buf->n + n <= buf->size) memcpy(buf->data + buf->n, src, n);
+  buf->n += n;
+  return 0;
+}
+
+/* Appends the head of a data item of type `major` with argument `val`.
+   Returns non-zero on error. */
+static int put_head(Buf *buf, int major, uint64_t val)
+{
+  unsigned char h[9];
+  size_t i, n;
+  if (val < 24) {
+    h[0] = (unsigned char)(major << 5 | val);
+    return put(buf, h, 1);
+  }
+  if (val <= 0xff)            { h[0] = (unsigned char)(major << 5 | 24); n = 1; }
+  else if (val <= 0xffff)     { h[0] = (unsigned char)(major << 5 | 25); n = 2; }
+  else if (val <= 0xffffffff) { h[0] = (unsigned char)(major << 5 | 26); n = 4; }
+  else                        { h[0] = (unsigned char)(major << 5 | 27); n = 8; }
+  for (i=0; i<n; i++) h[n-i] = (unsigned char)(val >> (8*i));
+  return put(buf, h, n+1);
+}
+
+/* Appends a text string or null if `s` is NULL.  Returns non-zero on
+   error. */
+static int put_text(Buf *buf, const char *s)
+{
+  size_t len;
+  if (!s) return put_head(buf, MAJOR_SIMPLE, SIMPLE_NULL);
+  len = strlen(s);
+  if (put_head(buf, MAJOR_TEXT, len)) return 1;
+  return put(buf, s, len);
+}
+
+/* Appends a signed integer.  Returns non-zero on error. */
+static int put_int(Buf *buf, int64_t v)
+{
+  if (v >= 0) return put_head(buf, MAJOR_UINT, (uint64_t)v);
+  return put_head(buf, MAJOR_NINT, (uint64_t)(-(v + 1)));
+}
+
+/* Appends a float32 if `size` is 4, otherwise a float64.  Returns
+   non-zero on error. */
+static int put_float(Buf *buf, double v, size_t size)
+{
+  unsigned char h[9];
+  int i;
+  if (size == 4) {
+    float f = (float)v;
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    h[0] = MAJOR_SIMPLE << 5 | AI_FLOAT32;
+    for (i=0; i<4; i++) h[4-i] = (unsigned char)(bits >> (8*i));
+    return put(buf, h, 5);
+  } else {
+    uint64_t bits;
+    memcpy(&bits, &v, 8);
+    h[0] = MAJOR_SIMPLE << 5 | AI_FLOAT64;
+    for (i=0; i<8; i++) h[8-i] = (unsigned char)(bits >> (8*i));
+    return put(buf, h, 9);
+  }
+}
+
+/* Returns the typed array tag for elements of `type` and `size` in
+   native byte order, or -1 if there is no such tag. */
+static int typed_tag(DLiteType type, size_t size)
+{
+  int e = (host_is_little()) ? 4 : 0;
+  switch (type) {
+  case dliteBool:
+    return (size == 1) ? TAG_TYPED_FIRST : -1;
+  case dliteInt:
+  case dliteUInt:
+    {
+      int s = (type == dliteInt) ? 8 : 0;
+      switch (size) {
+      case 1: return TAG_TYPED_FIRST + s;
+      case 2: return TAG_TYPED_FIRST + s + e + 1;
+      case 4: return TAG_TYPED_FIRST + s + e + 2;
+      case 8: return TAG_TYPED_FIRST + s + e + 3;
+      }
+    }
+    return -1;
+  case dliteFloat:
+    switch (size) {
+    case 4: return TAG_TYPED_FIRST + 16 + e + 1;
+    case 8: return TAG_TYPED_FIRST + 16 + e + 2;
+    }
+    return -1;
+  default:
+    return -1;
+  }
+}
+
+/* Appends the value of `type` and `size` pointed to by `p`.  Returns
+   non-zero on error. */
+static int put_value(Buf *buf, const void *p, DLiteType type, size_t size)
+{
+  int i;
+  switch (type) {
+  case dliteBlob:
+    if (put_head(buf, MAJOR_BYTES, size)) return 1;
+    return put(buf, p, size);
+  case dliteBool:
+    return put_head(buf, MAJOR_SIMPLE,
+                    (*(bool *)p) ? SIMPLE_TRUE : SIMPLE_FALSE);
+  case dliteInt:
+    switch (size) {
+    case 1: return put_int(buf, *(int8_t *)p);
+    case 2: return put_int(buf, *(int16_t *)p);
+    case 4: return put_int(buf, *(int32_t *)p);
+    case 8: return put_int(buf, *(int64_t *)p);
+    }
+    break;
+  case dliteUInt:
+    switch (size) {
+    case 1: return put_head(buf, MAJOR_UINT, *(uint8_t *)p);
+    case 2: return put_head(buf, MAJOR_UINT, *(uint16_t *)p);
+    case 4: return put_head(buf, MAJOR_UINT, *(uint32_t *)p);
+    case 8: return put_head(buf, MAJOR_UINT, *(uint64_t *)p);
+    }
+    break;
+  case dliteFloat:
+    switch (size) {
+    case 4: return put_float(buf, *(float *)p, 4);
+    case 8: return put_float(buf, *(double *)p, 8);
+#ifdef HAVE_FLOAT80
+    case 10: return put_float(buf, (double)*(float80_t *)p, 8);
+#endif
+#ifdef HAVE_FLOAT128
+    case 16: return put_float(buf, (double)*(float128_t *)p, 8);
+#endif
+    }
+    break;
+  case dliteFixString:
+    {
+      size_t len = strnlen(p, size);
+      if (put_head(buf, MAJOR_TEXT, len)) return 1;
+      return put(buf, p, len);
+    }
+  case dliteStringPtr:
+    return put_text(buf, *(char **)p);
+  case dliteDimension:
+    {
+      const DLiteDimension *d = p;
+      if (put_head(buf, MAJOR_MAP, 2)) return 1;
+      if (put_text(buf, "name") || put_text(buf, d->name)) return 1;
+      if (put_text(buf, "description") || put_text(buf, d->description))
+        return 1;
+      return 0;
+    }
+  case dliteProperty:
+    {
+      const DLiteProperty *q = p;
+      char typename[32];
+      if (dlite_type_set_typename(q->type, q->size, typename,
+                                  sizeof(typename))) return 1;
+      if (put_head(buf, MAJOR_MAP, 6)) return 1;
+      if (put_text(buf, "name") || put_text(buf, q->name)) return 1;
+      if (put_text(buf, "type") || put_text(buf, typename)) return 1;
+      if (put_text(buf, "shape") || put_head(buf, MAJOR_ARRAY, q->ndims))
+        return 1;
+      for (i=0; i < q->ndims; i++)
+        if (put_text(buf, q->dims[i])) return 1;
+      if (put_text(buf, "unit") || put_text(buf, q->unit)) return 1;
+      if (put_text(buf, "iri") || put_text(buf, q->iri)) return 1;
+      if (put_text(buf, "description") || put_text(buf, q->description))
+        return 1;
+      return 0;
+    }
+  case dliteRelation:
+    {
+      const DLiteRelation *r = p;
+      if (put_head(buf, MAJOR_ARRAY, (r->id) ? 4 : 3)) return 1;
+      if (put_text(buf, r->s) || put_text(buf, r->p) || put_text(buf, r->o))
+        return 1;
+      if (r->id && put_text(buf, r->id)) return 1;
+      return 0;
+    }
+  default:
+    {
+      const DLiteStruct *st = dlite_struct_get(type);
+      size_t k;
+      if (!st) break;
+      if (put_head(buf, MAJOR_MAP, st->nfields)) return 1;
+      for (k=0; k < st->nfields; k++) {
+        const DLiteStructField *f = st->fields + k;
+        if (put_text(buf, f->name) ||
+            put_value(buf, (const char *)p + f->offset, f->type, f->size))
+          return 1;
+      }
+      return 0;
+    }
+  }
+  return errx(1, "cannot serialise type %s of size %d to cbor",
+              dlite_type_get_dtypename(type), (int)size);
+}
+
+/* Appends property `i` of `inst`.  Returns non-zero on error. */
+static int put_property(Buf *buf, const DLiteInstance *inst, size_t i)
+{
+  const DLiteProperty *p = inst->meta->_properties + i;
+  const void *ptr = dlite_instance_get_property_by_index(inst, i);
+  const size_t *dims = DLITE_PROP_DIMS(inst, i);
+  size_t k, n=1;
+  int tag, j;
+
+  if (!p->ndims) return put_value(buf, ptr, p->type, p->size);
+
+  for (j=0; j < p->ndims; j++) n *= dims[j];
+  if (p->ndims > 1) {
+    if (put_head(buf, MAJOR_TAG, TAG_MULTIDIM)) return 1;
+    if (put_head(buf, MAJOR_ARRAY, 2)) return 1;
+    if (put_head(buf, MAJOR_ARRAY, p->ndims)) return 1;
+    for (j=0; j < p->ndims; j++)
+      if (put_head(buf, MAJOR_UINT, dims[j])) return 1;
+  }
+  if ((tag = typed_tag(p->type, p->size)) >= 0) {
+    if (put_head(buf, MAJOR_TAG, tag)) return 1;
+    if (put_head(buf, MAJOR_BYTES, n * p->size)) return 1;
+    return (n) ? put(buf, ptr, n * p->size) : 0;
+  }
+  if (put_head(buf, MAJOR_ARRAY, n)) return 1;
+  for (k=0; k<n; k++)
+    if (put_value(buf, (const char *)ptr + k*p->size, p->type, p->size))
+      return 1;
+  return 0;
+}
+
+/* Serialises `inst` to `buf`.  Returns non-zero on error. */
+static int encode(Buf *buf, const DLiteInstance *inst)
+{
+  const DLiteMeta *meta = inst->meta;
+  size_t i;
+
+  if (!meta) return errx(1, "no metadata available");
+  if (dlite_instance_sync_to_properties((DLiteInstance *)inst)) return 1;
+
+  if (put_head(buf, MAJOR_MAP, (inst->uri) ? 5 : 4)) return 1;
+  if (put_text(buf, "uuid") || put_text(buf, inst->uuid)) return 1;
+  if (inst->uri && (put_text(buf, "uri") || put_text(buf, inst->uri)))
+    return 1;
+  if (put_text(buf, "meta") || put_text(buf, meta->uri)) return 1;
+
+  if (put_text(buf, "dimensions")) return 1;
+  if (put_head(buf, MAJOR_MAP, meta->_ndimensions)) return 1;
+  for (i=0; i < meta->_ndimensions; i++) {
+    if (put_text(buf, meta->_dimensions[i].name)) return 1;
+    if (put_head(buf, MAJOR_UINT, DLITE_DIM(inst, i))) return 1;
+  }
+
+  if (put_text(buf, "properties")) return 1;
+  if (put_head(buf, MAJOR_MAP, meta->_nproperties)) return 1;
+  for (i=0; i < meta->_nproperties; i++) {
+    if (put_text(buf, meta->_properties[i].name)) return 1;
+    if (put_property(buf, inst, i)) return 1;
+  }
+  return 0;
+}
+
+/*
+  Serialise instance `inst` to `dest` as CBOR.  No more than `size`
+  bytes are written to `dest`.
+
+  Returns number of bytes written to `dest`.  If the output is
+  truncated, the number of bytes that would have been written if
+  `size` was large enough is returned.  On error, a negative value is
+  returned.
+ */
+int dlite_cbor_sprint(unsigned char *dest, size_t size,
+                      const DLiteInstance *inst)
+{
+  Buf buf = {dest, 0, size, 1};
+  if (encode(&buf, inst)) return -1;
+  return (int)buf.n;
+}
+
+/*
+  Like dlite_cbor_sprint(), but returns a malloc'ed buffer with the
+  serialised instance.  The length of the output is written to `len`.
+
+  Returns NULL on error.
+ */
+unsigned char *dlite_cbor_aprint(const DLiteInstance *inst, size_t *len)
+{
+  Buf buf = {NULL, 0, 0, 0};
+  if (encode(&buf, inst)) {
+    if (buf.data) free(buf.data);
+    return NULL;
+  }
+  if (len) *len = buf.n;
+  return buf.data;
+}
+
+
+/********************************************************************
+ * Reading
+ ********************************************************************/
+
+/* Position in a CBOR source */
+typedef struct {
+  const unsigned char *p;   /* current position */
+  const unsigned char *end; /* end of source */
+} Reader;
+
+/* A decoded data item head */
+typedef struct {
+  int major;                /* major type */
+  int ai;                   /* additional information */
+  uint64_t val;             /* argument */
+} Head;
+
+/* Reads a big-endian unsigned integer of `n` bytes. */
+static uint64_t read_be(const unsigned char *p, size_t n)
+{
+  uint64_t v=0;
+  size_t i;
+  for (i=0; i<n; i++) v = v << 8 | p[i];
+  return v;
+}
+
+/* Reads the head of the next data item.  Indefinite lengths are not
+   supported.  Returns non-zero on error. */
+static int get_head(Reader *r, Head *h)
+{
+  size_t n;
+  if (r->p >= r->end) return errx(1, "unexpected end of cbor data");
+  h->major = *r->p >> 5;
+  h->ai = *r->p & 0x1f;
+  r->p++;
+  if (h->ai < 24) {
+    h->val = h->ai;
+    return 0;
+  }
+  switch (h->ai) {
+  case 24: n = 1; break;
+  case 25: n = 2; break;
+  case 26: n = 4; break;
+  case 27: n = 8; break;
+  default:
+    return errx(1, "unsupported cbor additional information: %d", h->ai);
+  }
+  if ((size_t)(r->end - r->p) < n) return errx(1, "unexpected end of cbor data");
+  h->val = read_be(r->p, n);
+  r->p += n;
+  return 0;
+}
+
+/* Skips the next data item.  Returns non-zero on error. */
+static int skip_item(Reader *r, int depth)
+{
+  Head h;
+  uint64_t i;
+  if (depth > CBOR_MAX_DEPTH) return errx(1, "cbor data nested too deeply");
+  if (get_head(r, &h)) return 1;
+  switch (h.major) {
+  case MAJOR_BYTES:
+  case MAJOR_TEXT:
+    if ((uint64_t)(r->end - r->p) < h.val)
+      return errx(1, "unexpected end of cbor data");
+    r->p += h.val;
+    return 0;
+  case MAJOR_ARRAY:
+    for (i=0; i < h.val; i++)
+      if (skip_item(r, depth+1)) return 1;
+    return 0;
+  case MAJOR_MAP:
+    for (i=0; i < 2*h.val; i++)
+      if (skip_item(r, depth+1)) return 1;
+    return 0;
+  case MAJOR_TAG:
+    return skip_item(r, depth+1);
+  default:
+    return 0;
+  }
+}
+
+/* Reads a text string or null.  On return `*s` points to the string,
+   which is not NUL-terminated, and `*len` is its length.  `*s` is NULL
+   for null.  Returns non-zero on error. */
+static int get_text(Reader *r, const char **s, size_t *len)
+{
+  Head h;
+  if (get_head(r, &h)) return 1;
+  if (h.major == MAJOR_SIMPLE && h.ai == SIMPLE_NULL) {
+    *s = NULL;
+    *len = 0;
+    return 0;
+  }
+  if (h.major != MAJOR_TEXT) return errx(1, "expected cbor text string");
+  if ((uint64_t)(r->end - r->p) < h.val)
+    return errx(1, "unexpected end of cbor data");
+  *s = (const char *)r->p;
+  *len = h.val;
+  r->p += h.val;
+  return 0;
+}
+
+/* Reads a text string or null and returns it as a malloc'ed string in
+   `*dest`, free'ing the old value.  Returns non-zero on error. */
+static int get_strdup(Reader *r, char **dest)
+{
+  const char *s;
+  size_t len;
+  if (get_text(r, &s, &len)) return 1;
+  if (*dest) free(*dest);
+  *dest = NULL;
+  if (s && !(*dest = strndup(s, len))) return err(1, "allocation failure");
+  return 0;
+}
+
+/* Returns non-zero if the text string `s` of length `len` equals
+   `key`. */
+static int keyeq(const char *s, size_t len, const char *key)
+{
+  return s && strlen(key) == len && memcmp(s, key, len) == 0;
+}
+
+/* Converts an IEEE 754 half-precision float to double. */
+static double half_to_double(uint16_t h)
+{
+  int e = (h >> 10) & 0x1f, m = h & 0x3ff;
+  double v;
+  if (e == 0) v = ldexp(m, -24);
+  else if (e == 31) v = (m) ? NAN : INFINITY;
+  else v = ldexp(m + 1024, e - 25);
+  return (h & 0x8000) ? -v : v;
+}
+
+/* Kinds of numbers */
+typedef enum { NumInt, NumUInt, NumFloat } NumKind;
+
+/* A decoded number */
+typedef struct {
+  NumKind kind;
+  int64_t i;
+  uint64_t u;
+  double d;
+} Number;
+
+/* Reads a number or boolean into `num`.  Returns non-zero on error. */
+static int get_number(Reader *r, Number *num)
+{
+  Head h;
+  if (get_head(r, &h)) return 1;
+  switch (h.major) {
+  case MAJOR_UINT:
+    num->kind = NumUInt;
+    num->u = h.val;
+    return 0;
+  case MAJOR_NINT:
+    num->kind = NumInt;
+    num->i = -1 - (int64_t)h.val;
+    return 0;
+  case MAJOR_SIMPLE:
+    switch (h.ai) {
+    case SIMPLE_FALSE:
+    case SIMPLE_TRUE:
+      num->kind = NumUInt;
+      num->u = (h.ai == SIMPLE_TRUE);
+      return 0;
+    case AI_FLOAT16:
+      num->kind = NumFloat;
+      num->d = half_to_double((uint16_t)h.val);
+      return 0;
+    case AI_FLOAT32:
+      {
+        uint32_t bits = (uint32_t)h.val;
+        float f;
+        memcpy(&f, &bits, 4);
+        num->kind = NumFloat;
+        num->d = f;
+        return 0;
+      }
+    case AI_FLOAT64:
+      num->kind = NumFloat;
+      memcpy(&num->d, &h.val, 8);
+      return 0;
+    }
+  }
+  return errx(1, "expected cbor number");
+}
+
+/* Stores `num` in `p`, which is of type `type` and size `size`.
+   Returns non-zero on error. */
+static int set_number(void *p, DLiteType type, size_t size, const Number *num)
+{
+  int64_t i = (num->kind == NumInt) ? num->i :
+    (num->kind == NumUInt) ? (int64_t)num->u : (int64_t)num->d;
+  uint64_t u = (num->kind == NumUInt) ? num->u :
+    (num->kind == NumInt) ? (uint64_t)num->i : (uint64_t)num->d;
+  double d = (num->kind == NumFloat) ? num->d :
+    (num->kind == NumInt) ? (double)num->i : (double)num->u;
+  switch (type) {
+  case dliteBool:
+    *(bool *)p = (num->kind == NumFloat) ? d != 0.0 : u != 0;
+    return 0;
+  case dliteInt:
+    switch (size) {
+    case 1: *(int8_t *)p = (int8_t)i; return 0;
+    case 2: *(int16_t *)p = (int16_t)i; return 0;
+    case 4: *(int32_t *)p = (int32_t)i; return 0;
+    case 8: *(int64_t *)p = i; return 0;
+    }
+    break;
+  case dliteUInt:
+    switch (size) {
+    case 1: *(uint8_t *)p = (uint8_t)u; return 0;
+    case 2: *(uint16_t *)p = (uint16_t)u; return 0;
+    case 4: *(uint32_t *)p = (uint32_t)u; return 0;
+    case 8: *(uint64_t *)p = u; return 0;
+    }
+    break;
+  case dliteFloat:
+    switch (size) {
+    case 4: *(float *)p = (float)d; return 0;
+    case 8: *(double *)p = d; return 0;
+#ifdef HAVE_FLOAT80
+    case 10: *(float80_t *)p = d; return 0;
+#endif
+#ifdef HAVE_FLOAT128
+    case 16: *(float128_t *)p = d; return 0;
+#endif
+    }
+    break;
+  default:
+    break;
+  }
+  return errx(1, "cannot assign a number to type %s of size %d",
+              dlite_type_get_dtypename(type), (int)size);
+}
+
+/* Reads a dimension into `d`.  Returns non-zero on error. */
+static int get_dimension(Reader *r, DLiteDimension *d)
+{
+  Head h;
+  uint64_t k;
+  if (get_head(r, &h)) return 1;
+  if (h.major != MAJOR_MAP) return errx(1, "expected cbor map for dimension");
+  for (k=0; k < h.val; k++) {
+    const char *key;
+    size_t len;
+    if (get_text(r, &key, &len)) return 1;
+    if (keyeq(key, len, "name")) {
+      if (get_strdup(r, &d->name)) return 1;
+    } else if (keyeq(key, len, "description")) {
+      if (get_strdup(r, &d->description)) return 1;
+    } else if (skip_item(r, 0)) {
+      return 1;
+    }
+  }
+  if (!d->name) return errx(1, "dimension has no name");
+  return 0;
+}
+
+/* Reads a property description into `q`.  Returns non-zero on error. */
+static int get_propdesc(Reader *r, DLiteProperty *q)
+{
+  Head h, a;
+  uint64_t k, j;
+  int hastype=0;
+  if (get_head(r, &h)) return 1;
+  if (h.major != MAJOR_MAP) return errx(1, "expected cbor map for property");
+  for (k=0; k < h.val; k++) {
+    const char *key, *s;
+    size_t len, slen;
+    if (get_text(r, &key, &len)) return 1;
+    if (keyeq(key, len, "name")) {
+      if (get_strdup(r, &q->name)) return 1;
+    } else if (keyeq(key, len, "type")) {
+      char typename[32];
+      if (get_text(r, &s, &slen)) return 1;
+      if (!s || slen >= sizeof(typename))
+        return errx(1, "invalid property type in cbor data");
+      memcpy(typename, s, slen);
+      typename[slen] = '\0';
+      if (dlite_type_set_dtype_and_size(typename, &q->type, &q->size))
+        return 1;
+      hastype = 1;
+    } else if (keyeq(key, len, "shape")) {
+      if (get_head(r, &a)) return 1;
+      if (a.major != MAJOR_ARRAY || a.val > (uint64_t)(r->end - r->p))
+        return errx(1, "expected cbor array for property shape");
+      if (q->dims) {
+        for (j=0; j < (uint64_t)q->ndims; j++) free(q->dims[j]);
+        free(q->dims);
+        q->dims = NULL;
+      }
+      q->ndims = (int)a.val;
+      if (a.val && !(q->dims = calloc(a.val, sizeof(char *))))
+        return err(1, "allocation failure");
+      for (j=0; j < a.val; j++)
+        if (get_strdup(r, q->dims + j)) return 1;
+    } else if (keyeq(key, len, "unit")) {
+      if (get_strdup(r, &q->unit)) return 1;
+    } else if (keyeq(key, len, "iri")) {
+      if (get_strdup(r, &q->iri)) return 1;
+    } else if (keyeq(key, len, "description")) {
+      if (get_strdup(r, &q->description)) return 1;
+    } else if (skip_item(r, 0)) {
+      return 1;
+    }
+  }
+  if (!q->name || !hastype) return errx(1, "property has no name or type");
+  return 0;
+}
+
+/* Reads a relation into `t`.  Returns non-zero on error. */
+static int get_relation(Reader *r, DLiteRelation *t)
+{
+  Head h;
+  char *s[4] = {NULL, NULL, NULL, NULL};
+  uint64_t k;
+  int retval=1;
+  if (get_head(r, &h)) return 1;
+  if (h.major != MAJOR_ARRAY || h.val < 3 || h.val > 4)
+    return errx(1, "expected cbor array of 3 or 4 strings for relation");
+  for (k=0; k < h.val; k++)
+    if (get_strdup(r, s + k)) goto fail;
+  if (!s[0] || !s[1] || !s[2]) FAIL("relation must have s, p and o");
+  triple_clean(t);
+  if (triple_set(t, s[0], s[1], s[2], s[3])) goto fail;
+  retval = 0;
+ fail:
+  for (k=0; k<4; k++)
+    if (s[k]) free(s[k]);
+  return retval;
+}
+
+static int get_value(Reader *r, void *p, DLiteType type, size_t size);
+
+/* Reads a struct of type `type` into `p`.  Returns non-zero on error. */
+static int get_struct(Reader *r, void *p, DLiteType type)
+{
+  const DLiteStruct *st = dlite_struct_get(type);
+  Head h;
+  uint64_t k;
+  size_t j;
+  if (get_head(r, &h)) return 1;
+  if (h.major != MAJOR_MAP)
+    return errx(1, "expected cbor map for struct %s", st->name);
+  for (k=0; k < h.val; k++) {
+    const char *key;
+    size_t len;
+    if (get_text(r, &key, &len)) return 1;
+    for (j=0; j < st->nfields; j++)
+      if (keyeq(key, len, st->fields[j].name)) break;
+    if (j < st->nfields) {
+      const DLiteStructField *f = st->fields + j;
+      if (get_value(r, (char *)p + f->offset, f->type, f->size)) return 1;
+    } else if (skip_item(r, 0)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Reads a value of `type` and `size` into `p`.  Returns non-zero on
+   error. */
+static int get_value(Reader *r, void *p, DLiteType type, size_t size)
+{
+  Head h;
+  Number num;
+  const char *s;
+  size_t len;
+
+  switch (type) {
+  case dliteBlob:
+    if (get_head(r, &h)) return 1;
+    if (h.major != MAJOR_BYTES || h.val != size)
+      return errx(1, "expected cbor byte string of length %d", (int)size);
+    if ((uint64_t)(r->end - r->p) < h.val)
+      return errx(1, "unexpected end of cbor data");
+    memcpy(p, r->p, size);
+    r->p += size;
+    return 0;
+  case dliteBool:
+  case dliteInt:
+  case dliteUInt:
+  case dliteFloat:
+    if (get_number(r, &num)) return 1;
+    return set_number(p, type, size, &num);
+  case dliteFixString:
+    if (get_text(r, &s, &len)) return 1;
+    if (!s) len = 0;
+    if (len >= size) len = size - 1;
+    memset(p, 0, size);
+    if (len) memcpy(p, s, len);
+    return 0;
+  case dliteStringPtr:
+    return get_strdup(r, (char **)p);
+  case dliteDimension:
+    return get_dimension(r, p);
+  case dliteProperty:
+    return get_propdesc(r, p);
+  case dliteRelation:
+    return get_relation(r, p);
+  default:
+    if (dlite_type_is_struct(type)) return get_struct(r, p, type);
+  }
+  return errx(1, "cannot scan type %s from cbor",
+              dlite_type_get_dtypename(type));
+}
+
+/* Returns the element size of typed arrays with tag `tag`. */
+static size_t typed_esize(int tag)
+{
+  return (tag & 16) ? (size_t)2 << (tag & 3) : (size_t)1 << (tag & 3);
+}
+
+/* Reads the `n` elements of the typed array with tag `tag` at `src`
+   into the array of `type` and `size` at `p`.  Returns non-zero on
+   error. */
+static int get_typed(const unsigned char *src, size_t n, int tag, void *p,
+                     DLiteType type, size_t size)
+{
+  int f = (tag >> 4) & 1, s = (tag >> 3) & 1, e = (tag >> 2) & 1;
+  size_t esize = typed_esize(tag), k, j;
+  int swap = (esize > 1 && e != host_is_little());
+  Number num;
+
+  if (f && (s || esize == 16))
+    return errx(1, "unsupported cbor typed array tag: %d", tag);
+  if (tag == typed_tag(type, size)) {
+    memcpy(p, src, n * esize);
+    return 0;
+  }
+  for (k=0; k<n; k++) {
+    unsigned char b[8];
+    const unsigned char *q = src + k*esize;
+    for (j=0; j < esize; j++) b[j] = q[(swap) ? esize - 1 - j : j];
+    if (f) {
+      num.kind = NumFloat;
+      if (esize == 2) {
+        uint16_t v;
+        memcpy(&v, b, 2);
+        num.d = half_to_double(v);
+      } else if (esize == 4) {
+        float v;
+        memcpy(&v, b, 4);
+        num.d = v;
+      } else {
+        memcpy(&num.d, b, 8);
+      }
+    } else if (s) {
+      num.kind = NumInt;
+      switch (esize) {
+      case 1: { int8_t v;  memcpy(&v, b, 1); num.i = v; break; }
+      case 2: { int16_t v; memcpy(&v, b, 2); num.i = v; break; }
+      case 4: { int32_t v; memcpy(&v, b, 4); num.i = v; break; }
+      default: memcpy(&num.i, b, 8);
+      }
+    } else {
+      num.kind = NumUInt;
+      switch (esize) {
+      case 1: num.u = b[0]; break;
+      case 2: { uint16_t v; memcpy(&v, b, 2); num.u = v; break; }
+      case 4: { uint32_t v; memcpy(&v, b, 4); num.u = v; break; }
+      default: memcpy(&num.u, b, 8);
+      }
+    }
+    if (set_number((char *)p + k*size, type, size, &num)) return 1;
+  }
+  return 0;
+}
+
+/* Reads the array of `n` elements of property `prop` into `p`.
+   Returns non-zero on error. */
+static int get_elements(Reader *r, void *p, const DLiteProperty *prop,
+                        size_t n)
+{
+  Head h;
+  size_t k;
+  const unsigned char *save = r->p;
+  if (get_head(r, &h)) return 1;
+  if (h.major == MAJOR_TAG &&
+      h.val >= TAG_TYPED_FIRST && h.val <= TAG_TYPED_LAST) {
+    int tag = (int)h.val;
+    size_t esize = typed_esize(tag);
+    if (get_head(r, &h)) return 1;
+    if (h.major != MAJOR_BYTES || h.val != n * esize)
+      return errx(1, "typed array of property '%s' should have %d elements",
+                  prop->name, (int)n);
+    if ((uint64_t)(r->end - r->p) < h.val)
+      return errx(1, "unexpected end of cbor data");
+    if (get_typed(r->p, n, tag, p, prop->type, prop->size)) return 1;
+    r->p += h.val;
+    return 0;
+  }
+  if (h.major != MAJOR_ARRAY || h.val != n) {
+    r->p = save;
+    return errx(1, "property '%s' should be an array of %d elements",
+                prop->name, (int)n);
+  }
+  for (k=0; k<n; k++)
+    if (get_value(r, (char *)p + k*prop->size, prop->type, prop->size))
+      return 1;
+  return 0;
+}
+
+/* Reads property `i` of `inst`.  Returns non-zero on error. */
+static int get_property(Reader *r, DLiteInstance *inst, size_t i)
+{
+  const DLiteProperty *p = inst->meta->_properties + i;
+  const size_t *pdims = DLITE_PROP_DIMS(inst, i);
+  void *ptr = DLITE_PROP(inst, i);
+  size_t n=1;
+  int j;
+
+  if (!p->ndims) return get_value(r, ptr, p->type, p->size);
+  ptr = *(void **)ptr;
+  for (j=0; j < p->ndims; j++) n *= pdims[j];
+
+  if (r->p < r->end && *r->p == (MAJOR_TAG << 5 | 24) &&
+      r->end - r->p > 1 && r->p[1] == TAG_MULTIDIM) {
+    Head h;
+    uint64_t k;
+    r->p += 2;
+    if (get_head(r, &h)) return 1;
+    if (h.major != MAJOR_ARRAY || h.val != 2)
+      return errx(1, "invalid multi-dimensional array in property '%s'",
+                  p->name);
+    if (get_head(r, &h)) return 1;
+    if (h.major != MAJOR_ARRAY || h.val != (uint64_t)p->ndims)
+      return errx(1, "property '%s' should have %d dimensions",
+                  p->name, p->ndims);
+    for (k=0; k < h.val; k++) {
+      Head d;
+      if (get_head(r, &d)) return 1;
+      if (d.major != MAJOR_UINT || d.val != pdims[k])
+        return errx(1, "dimension %d of property '%s' should be %d",
+                    (int)k, p->name, (int)pdims[k]);
+    }
+  }
+  return get_elements(r, ptr, p, n);
+}
+
+/* Returns a new instance decoded from `r`, with id `id` if not NULL. */
+static DLiteInstance *decode(Reader *r, const char *id)
+{
+  Head h;
+  Reader dimsr = {NULL, NULL}, propsr = {NULL, NULL};
+  char *uuid=NULL, *uri=NULL, *metauri=NULL;
+  char uuid2[DLITE_UUID_LENGTH+1];
+  const char *newid;
+  size_t *dims=NULL;
+  uint64_t k, ndims=0, nprops=0;
+  DLiteMeta *meta=NULL;
+  DLiteInstance *inst=NULL;
+  int ok=0;
+
+  if (get_head(r, &h)) return NULL;
+  if (h.major != MAJOR_MAP) return errx(1, "expected cbor map"), NULL;
+
+  /* locate the items, since a map may be in any order */
+  for (k=0; k < h.val; k++) {
+    const char *key;
+    size_t len;
+    if (get_text(r, &key, &len)) goto fail;
+    if (keyeq(key, len, "uuid")) {
+      if (get_strdup(r, &uuid)) goto fail;
+    } else if (keyeq(key, len, "uri")) {
+      if (get_strdup(r, &uri)) goto fail;
+    } else if (keyeq(key, len, "meta")) {
+      if (get_strdup(r, &metauri)) goto fail;
+    } else if (keyeq(key, len, "dimensions") ||
+               keyeq(key, len, "properties")) {
+      Reader *sub = (*key == 'd') ? &dimsr : &propsr;
+      Head m;
+      sub->p = r->p;
+      if (get_head(r, &m)) goto fail;
+      if (m.major != MAJOR_MAP)
+        FAIL("\"dimensions\" and \"properties\" must be cbor maps");
+      if (*key == 'd') ndims = m.val; else nprops = m.val;
+      r->p = sub->p;
+      if (skip_item(r, 0)) goto fail;
+      sub->end = r->p;
+      get_head(sub, &m);
+    } else if (skip_item(r, 0)) {
+      goto fail;
+    }
+  }
+
+  if (!metauri) FAIL("no \"meta\" in cbor data");
+  newid = (uri) ? uri : uuid;
+  if (!newid) FAIL("no \"uuid\" or \"uri\" in cbor data");
+  if (id && *id) {
+    char uuid1[DLITE_UUID_LENGTH+1];
+    if (dlite_get_uuid(uuid1, id) < 0 || dlite_get_uuid(uuid2, newid) < 0)
+      goto fail;
+    if (strcmp(uuid1, uuid2))
+      FAIL3("instance has id \"%s\", expected \"%s\" (%s)", uuid2, uuid1, id);
+  }
+  if (!(meta = dlite_meta_get(metauri)))
+    FAIL2("cannot find metadata '%s' when loading '%s' - please add the "
+          "right storage to DLITE_STORAGES and try again", metauri, newid);
+
+  /* dimensions */
+  if (ndims != meta->_ndimensions)
+    FAIL3("expected %d dimensions, got %d in instance %s",
+          (int)meta->_ndimensions, (int)ndims, newid);
+  if (!(dims = calloc(meta->_ndimensions + 1, sizeof(size_t))))
+    FAIL("allocation failure");
+  for (k=0; k < ndims; k++) {
+    const char *key;
+    char name[256];
+    size_t len;
+    int j;
+    Head v;
+    if (get_text(&dimsr, &key, &len)) goto fail;
+    if (!key || len >= sizeof(name)) FAIL1("invalid dimension in %s", newid);
+    memcpy(name, key, len);
+    name[len] = '\0';
+    if ((j = dlite_meta_get_dimension_index(meta, name)) < 0) goto fail;
+    if (get_head(&dimsr, &v)) goto fail;
+    if (v.major != MAJOR_UINT)
+      FAIL2("dimension \"%s\" should be an unsigned integer: %s", name, newid);
+    dims[j] = v.val;
+  }
+
+  /* properties */
+  if (!(inst = dlite_instance_create(meta, dims, newid))) goto fail;
+  if (nprops != meta->_nproperties)
+    FAIL3("expected %d properties, got %d in instance %s",
+          (int)meta->_nproperties, (int)nprops, newid);
+  for (k=0; k < nprops; k++) {
+    const char *key;
+    char name[256];
+    size_t len;
+    int j;
+    if (get_text(&propsr, &key, &len)) goto fail;
+    if (!key || len >= sizeof(name)) FAIL1("invalid property in %s", newid);
+    memcpy(name, key, len);
+    name[len] = '\0';
+    if ((j = dlite_meta_get_property_index(meta, name)) < 0) goto fail;
+    if (get_property(&propsr, inst, j)) goto fail;
+    if (meta->_loadprop) meta->_loadprop(inst, j);
+  }
+  if (dlite_instance_is_meta(inst) && dlite_meta_init((DLiteMeta *)inst))
+    goto fail;
+
+  ok = 1;
+ fail:
+  if (uuid) free(uuid);
+  if (uri) free(uri);
+  if (metauri) free(metauri);
+  if (dims) free(dims);
+  if (meta) dlite_meta_decref(meta);
+  if (!ok && inst) {
+    dlite_instance_decref(inst);
+    inst = NULL;
+  }
+  return inst;
+}
+
+/*
+  Returns a new instance scanned from the `len` bytes of CBOR in `src`.
+
+  If `id` is not NULL, it is the uri or uuid of the instance to scan.
+  It is an error if the instance in `src` has another id.
+
+  Returns the instance or NULL on error.
+ */
+DLiteInstance *dlite_cbor_sscan(const unsigned char *src, size_t len,
+                                const char *id)
+{
+  Reader r = {src, src + len};
+  return decode(&r, id);
+}
+
+/*
+  Returns the number of bytes of the CBOR data item at the start of the
+  `len` bytes in `src` or a negative value if `src` doesn't start with
+  a complete data item.
+ */
+long dlite_cbor_item_size(const unsigned char *src, size_t len)
+{
+  Reader r = {src, src + len};
+  int stat;
+  ErrTry:
+    stat = skip_item(&r, 0);
+  ErrOther:
+    stat = 1;
+  ErrEnd;
+  return (stat) ? -1 : (long)(r.p - src);
+}
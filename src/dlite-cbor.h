@@ -0,0 +1,91 @@
+#ifndef _DLITE_CBOR_H
+#define _DLITE_CBOR_H
+
+/**
+  @file
+  @brief Compact binary serialisation of instances in CBOR
+
+  Instances are serialised to CBOR (RFC 8949) with the same structure
+  as the JSON data format of dlite_json_sprint():
+
+      {"uuid": "...", "uri": "...", "meta": "...",
+       "dimensions": {"N": 3, ...},
+       "properties": {"name": value, ...}}
+
+  "uri" is omitted if the instance has no uri.  Metadata are written
+  in the same way as data, i.e. like with the `dliteJsonMetaAsData`
+  flag.
+
+  Property values are encoded as follows:
+
+      dliteBlob       byte string
+      dliteBool       true/false
+      dliteInt        integer
+      dliteUInt       unsigned integer
+      dliteFloat      float32 or float64 (long double as float64)
+      dliteFixString  text string
+      dliteStringPtr  text string or null
+      dliteDimension  map with "name" and "description"
+      dliteProperty   map with "name", "type", "shape", "unit", "iri" and
+                      "description", where "shape" is an array of
+                      dimension expressions
+      dliteRelation   array of 3 or 4 text strings: s, p, o[, id]
+      struct types    map from field name to field value
+
+  Arrays of booleans, integers and of floats of size 4 and 8 are
+  encoded as typed arrays (RFC 8746) in native byte order, such that
+  they are copied rather than formatted.  Other arrays are
+  encoded as CBOR arrays.  Arrays with more than one dimension are
+  wrapped in a multi-dimensional array (tag 40) holding the shape and
+  the elements in row-major order.
+
+  Typed arrays in either byte order are accepted when scanning.
+ */
+
+#include <stddef.h>
+
+#include "dlite-entity.h"
+
+
+/**
+  Serialise instance `inst` to `dest` as CBOR.  No more than `size`
+  bytes are written to `dest`.
+
+  Returns number of bytes written to `dest`.  If the output is
+  truncated because it exceeds `size`, the number of bytes that would
+  have been written if `size` was large enough is returned.  On error,
+  a negative value is returned.
+ */
+int dlite_cbor_sprint(unsigned char *dest, size_t size,
+                      const DLiteInstance *inst);
+
+/**
+  Like dlite_cbor_sprint(), but returns a malloc'ed buffer with the
+  serialised instance.  The length of the output is written to `len`.
+
+  Returns NULL on error.
+ */
+unsigned char *dlite_cbor_aprint(const DLiteInstance *inst, size_t *len);
+
+/**
+  Returns a new instance scanned from the `len` bytes of CBOR in `src`.
+
+  If `id` is not NULL, it is the uri or uuid of the instance to scan.
+  It is an error if the instance in `src` has another id.
+
+  Returns the instance or NULL on error.
+ */
+DLiteInstance *dlite_cbor_sscan(const unsigned char *src, size_t len,
+                                const char *id);
+
+/**
+  Returns the number of bytes of the CBOR data item at the start of the
+  `len` bytes in `src` or a negative value if `src` doesn't start with
+  a complete data item.
+
+  This can be used to split a stream of concatenated instances.
+ */
+long dlite_cbor_item_size(const unsigned char *src, size_t len);
+
+
+#endif /* _DLITE_CBOR_H */
@@ -6,6 +6,8 @@
 #include "utils/err.h"
 #include "utils/tgen.h"
 #include "utils/fileutils.h"
+#include "utils/thread.h"
+#include "utils/scheduler.h"
 
 #include "config-paths.h"
 
@@ -206,11 +208,22 @@ static int list_properties_helper(TGenBuf *s, const char *template, int len,
     char *descr = (p->description) ? p->description : "";
     size_t nref = (p->ndims > 0) ? 1 : 0;
     int isallocated = dlite_type_is_allocated(p->type);
-    char typename[32], pcdecl[64], ftype[25], isoctype[64];
+    char typename[32], pcdecl[64], ctype[64], ftype[25], isoctype[64];
     char *iri = (p->iri) ? p->iri : "";
+    int hasctype;
     dlite_type_set_typename(p->type, p->size, typename, sizeof(typename));
     dlite_type_set_cdecl(p->type, p->size, p->name, nref, pcdecl,
 			 sizeof(pcdecl), g->use_native_typenames);
+
+    /* C type of a single element, ready to be followed by a name
+       (like "double " or "char *").  Not available for types that are
+       C arrays (blob and fixstring), since they cannot be returned by
+       value. */
+    ctype[0] = '\0';
+    hasctype = (p->type != dliteBlob && p->type != dliteFixString);
+    if (hasctype)
+      dlite_type_set_cdecl(p->type, p->size, "", 0, ctype, sizeof(ctype),
+                           g->use_native_typenames);
     dlite_type_set_ftype(p->type, p->size, ftype, sizeof(ftype));
     dlite_type_set_isoctype(p->type, p->size, isoctype, sizeof(isoctype));
 
@@ -223,6 +236,7 @@ static int list_properties_helper(TGenBuf *s, const char *template, int len,
     tgen_subs_set(&psubs, "prop.ftype",    ftype,    NULL);
     tgen_subs_set(&psubs, "prop.isoctype", isoctype, NULL);
     tgen_subs_set(&psubs, "prop.cdecl",    pcdecl,   NULL);
+    tgen_subs_set(&psubs, "prop.ctype",    ctype,    NULL);
     tgen_subs_set(&psubs, "prop.unit",     unit,     NULL);
     tgen_subs_set(&psubs, "prop.iri",      iri,      NULL);
     tgen_subs_set(&psubs, "prop.descr",    descr,    NULL);
@@ -231,6 +245,7 @@ static int list_properties_helper(TGenBuf *s, const char *template, int len,
     tgen_subs_set_fmt(&psubs, "prop.size",        NULL, "%u",(unsigned)p->size);
     tgen_subs_set_fmt(&psubs, "prop.ndims",       NULL, "%d",  p->ndims);
     tgen_subs_set_fmt(&psubs, "prop.isallocated", NULL, "%d",  isallocated);
+    tgen_subs_set_fmt(&psubs, "prop.hasctype",    NULL, "%d",  hasctype);
     tgen_subs_set_fmt(&psubs, "prop.i",           NULL, "%u", (unsigned)i);
     tgen_subs_set_fmt(&psubs, "prop.dimind",      NULL, "%u",
                       (unsigned)m->_propdiminds[i]);
@@ -553,6 +568,78 @@ char *dlite_codegen(const char *template, const DLiteInstance *inst,
 }
 
 
+/*
+  Like dlite_codegen(), but renders compiled template `tt`.
+ */
+char *dlite_codegen_compiled(const TGenTemplate *tt, const DLiteInstance *inst,
+                             const char *options)
+{
+  TGenSubs subs;
+  char *text=NULL;
+  Context context;
+
+  context.inst = inst;
+  context.iprop = -1;
+  context.metameta = 0;
+
+  tgen_subs_init(&subs);
+  if (dlite_instance_subs(&subs, inst) == 0 &&
+      dlite_option_subs(&subs, options) == 0)
+    text = tgen_render(tt, &subs, &context);
+  tgen_subs_deinit(&subs);
+  return text;
+}
+
+
+/* Shared state for the tasks of dlite_codegen_many() */
+typedef struct {
+  const TGenTemplate *tt;
+  DLiteInstance **insts;
+  const char *options;
+  char **texts;
+  int nfailed;          /* number of documents that failed (atomic) */
+} CodegenWork;
+
+/* Task rendering the documents of instances `begin` to `end`. */
+static void codegen_range(size_t begin, size_t end, void *arg)
+{
+  CodegenWork *w = arg;
+  size_t i;
+  for (i=begin; i<end; i++)
+    if (!(w->texts[i] = dlite_codegen_compiled(w->tt, w->insts[i],
+                                               w->options)))
+      thread_atomic_add(&w->nfailed, 1);
+}
+
+/*
+  Generates documents for the `n` instances in `insts` from the same
+  template.
+ */
+int dlite_codegen_many(const char *template, DLiteInstance **insts, size_t n,
+                       const char *options, char **texts, int nthreads)
+{
+  CodegenWork w;
+
+  memset(texts, 0, n*sizeof(char *));
+  if (!(w.tt = tgen_compile(template, -1, NULL))) return -1;
+  w.insts = insts;
+  w.options = options;
+  w.texts = texts;
+  w.nfailed = 0;
+
+  /* make sure that the global state is created before starting tasks */
+  dlite_codegen_get_native_typenames();
+
+  if (nthreads <= 0) nthreads = sched_get_nthreads();
+  if ((size_t)nthreads > n) nthreads = (int)n;
+  if (nthreads < 1) nthreads = 1;
+  sched_parallel_for(n, (n + nthreads - 1) / nthreads, codegen_range, &w);
+
+  tgen_template_free((TGenTemplate *)w.tt);
+  return w.nfailed;
+}
+
+
 /*
   Returns a pointer to malloc'ed template file name, given a template
   name (e.g. "c-header", "c-meta-header", "c-source", ...) or
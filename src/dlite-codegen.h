@@ -62,6 +62,32 @@ char *dlite_codegen(const char *template, const DLiteInstance *inst,
                     const char *options);
 
 
+/**
+  Like dlite_codegen(), but renders compiled template `tt` (see
+  tgen_compile()).  This is faster when generating documents for many
+  instances from the same template.
+
+  Returns NULL on error.
+ */
+char *dlite_codegen_compiled(const TGenTemplate *tt, const DLiteInstance *inst,
+                             const char *options);
+
+/**
+  Generates documents for the `n` instances in `insts` from the same
+  `template`.  The template is compiled once and the documents are
+  rendered concurrently in up to `nthreads` tasks by the shared task
+  scheduler.  If `nthreads` is zero or negative, the number of
+  scheduler threads is used.
+
+  On return, `texts` (of length `n`) holds the newly malloc'ed
+  documents.  Documents that failed are set to NULL.
+
+  Returns the number of documents that failed or -1 if the template
+  cannot be compiled.
+ */
+int dlite_codegen_many(const char *template, DLiteInstance **insts, size_t n,
+                       const char *options, char **texts, int nthreads);
+
 /**
   Returns a pointer to malloc'ed template file name, given a template
   name (e.g. "c-header", "c-source", "c-ext_header", ...).
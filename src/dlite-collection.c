@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "utils/err.h"
+#include "utils/map.h"
 #include "dlite-macros.h"
 #include "dlite-store.h"
 #include "dlite-mapping.h"
@@ -11,10 +12,122 @@
 #include "dlite-schemas.h"
 #include "dlite-storage-plugins.h"
 #include "dlite-collection.h"
+#include "dlite-async.h"
 #include "dlite.h"
 
 
 
+/**************************************************************
+ * Member index
+ *
+ * Resolving a label requires a scan of the triplestore for the
+ * "_has-uuid" relation followed by an instance store lookup.  The
+ * member index caches the result, such that repeated member access is
+ * a single hash lookup.  Members are added to the index by
+ * dlite_collection_add_new() and on the first lookup and removed by
+ * dlite_collection_remove().  The whole index is dropped when
+ * "_has-uuid" relations are modified by other means.
+ **************************************************************/
+
+/* A member of a collection */
+typedef struct {
+  char uuid[DLITE_UUID_LENGTH+1];  /* uuid of the member */
+  DLiteInstance *inst;             /* borrowed reference or NULL if not
+                                      yet resolved */
+} CollectionMember;
+
+typedef map_t(CollectionMember) member_map_t;
+
+struct _DLiteCollectionIndex {
+  member_map_t labels;   /* maps labels to members */
+  member_map_t uuids;    /* maps uuids to members */
+};
+
+/* Drops the member index of `coll`. */
+static void _index_clear(DLiteCollection *coll)
+{
+  if (!coll->index) return;
+  map_deinit(&coll->index->labels);
+  map_deinit(&coll->index->uuids);
+  free(coll->index);
+  coll->index = NULL;
+}
+
+/* Adds member with given label and uuid to the index of `coll`.
+   Returns a pointer to the new member or NULL on error. */
+static CollectionMember *_index_add(DLiteCollection *coll, const char *label,
+                                    const char *uuid, DLiteInstance *inst)
+{
+  CollectionMember m;
+  if (!coll->index) {
+    if (!(coll->index = calloc(1, sizeof(struct _DLiteCollectionIndex))))
+      return err(1, "allocation failure"), NULL;
+    map_init(&coll->index->labels);
+    map_init(&coll->index->uuids);
+  }
+  strncpy(m.uuid, uuid, sizeof(m.uuid));
+  m.uuid[DLITE_UUID_LENGTH] = '\0';
+  m.inst = inst;
+  if (map_set(&coll->index->labels, label, m) ||
+      map_set(&coll->index->uuids, m.uuid, m)) {
+    _index_clear(coll);
+    return err(1, "allocation failure"), NULL;
+  }
+  return map_get(&coll->index->labels, label);
+}
+
+/* Removes member with given label from the index of `coll`. */
+static void _index_remove(DLiteCollection *coll, const char *label)
+{
+  CollectionMember *m;
+  if (!coll->index || !(m = map_get(&coll->index->labels, label))) return;
+  map_remove(&coll->index->uuids, m->uuid);
+  map_remove(&coll->index->labels, label);
+}
+
+/* Resolves the instance of member `m` if it is not already resolved.
+   Returns a borrowed reference to the instance or NULL on error. */
+static DLiteInstance *_index_resolve(CollectionMember *m)
+{
+  if (!m->inst) {
+    DLiteInstance *inst = dlite_instance_get(m->uuid);
+    if (!inst) return NULL;
+
+    /* The collection holds a reference to its members, so release the
+       reference returned by dlite_instance_get() */
+    if (inst->_refcount >= 2) dlite_instance_decref(inst);
+    m->inst = inst;
+  }
+  return m->inst;
+}
+
+/* Returns the member of `coll` with given label or NULL if there is no
+   such member. */
+static CollectionMember *_member_by_label(const DLiteCollection *coll,
+                                          const char *label)
+{
+  CollectionMember *m;
+  const DLiteRelation *r;
+  if (coll->index && (m = map_get(&coll->index->labels, label))) return m;
+  if (!(r = dlite_collection_find(coll, NULL, label, "_has-uuid", NULL)))
+    return NULL;
+  return _index_add((DLiteCollection *)coll, label, r->o, NULL);
+}
+
+/* Returns the member of `coll` with given uuid or NULL if there is no
+   such member. */
+static CollectionMember *_member_by_uuid(const DLiteCollection *coll,
+                                         const char *uuid)
+{
+  CollectionMember *m;
+  const DLiteRelation *r;
+  if (coll->index && (m = map_get(&coll->index->uuids, uuid))) return m;
+  if (!(r = dlite_collection_find(coll, NULL, NULL, "_has-uuid", uuid)))
+    return NULL;
+  return _index_add((DLiteCollection *)coll, r->s, uuid, NULL);
+}
+
+
 /**************************************************************
  * Collection
  **************************************************************/
@@ -48,6 +161,7 @@ int dlite_collection_deinit(DLiteInstance *inst)
   }
   dlite_collection_deinit_state(&state);
 
+  _index_clear(coll);
   triplestore_free(coll->rstore);
   return 0;
 }
@@ -57,33 +171,59 @@ int dlite_collection_getdim(const DLiteInstance *inst, size_t i)
 {
   DLiteCollection *coll = (DLiteCollection *)inst;
   if (i != 0) return err(-1, "index out of range: %lu", (unsigned long)i);
+  if (coll->rversion == triplestore_get_version(coll->rstore))
+    return (int)coll->nrelations;
   return triplestore_length(coll->rstore);
 }
 
-/* Loads instance relations to triplestore.  Returns -1 on error. */
+/* Returns non-zero if relation `r` equals triple `t`. */
+static int _relation_eq(const DLiteRelation *r, const Triple *t)
+{
+  return (r->id && t->id && strcmp(r->id, t->id) == 0 &&
+          strcmp(r->s, t->s) == 0 && strcmp(r->p, t->p) == 0 &&
+          strcmp(r->o, t->o) == 0);
+}
+
+/* Loads instance relations to triplestore.  Returns -1 on error.
+
+   The triplestore is only rebuilt if the relations differ from it.
+   Relations appended after the ones already in the triplestore are
+   just added. */
 int dlite_collection_loadprop(const DLiteInstance *inst, size_t i)
 {
   int retval = 0;
   DLiteCollection *coll = (DLiteCollection *)inst;
   TripleState state;
   const Triple *t;
+  size_t j=0, n=coll->nrelations;
   if (i != 0) return err(-1, "index out of range: %lu", (unsigned long)i);
-  triplestore_clear(coll->rstore);
-  if (triplestore_add_triples(coll->rstore, coll->relations, coll->nrelations))
-    return -1;
 
-  /* Iterate over all newly added triples and load instances corresponding
-     to "_has-uuid" relations. */
-  triplestore_init_state(coll->rstore, &state);
-  while ((t = triplestore_find(&state, NULL, "_has-uuid", NULL))) {
-    DLiteInstance *inst2 = dlite_instance_get(t->o);
-    if (!inst2) retval = errx(1, "cannot get instance \"%s\" labeled \"%s\" "
-                              "from collection \"%s\".  "
-                              "Is DLITE_STORAGES properly set?",
-                              t->o, t->s, coll->uuid);
+  /* number of leading relations that are already in the triplestore */
+  if (n >= triplestore_length(coll->rstore)) {
+    triplestore_init_state(coll->rstore, &state);
+    while ((t = triplestore_next(&state)) && _relation_eq(coll->relations+j, t))
+      j++;
+    triplestore_deinit_state(&state);
+    if (t) j = 0;
   }
-  triplestore_deinit_state(&state);
+  if (j < n) _index_clear(coll);
+  if (j == 0) triplestore_clear(coll->rstore);
+  if (triplestore_add_triples(coll->rstore, coll->relations + j, n - j))
+    return -1;
 
+  /* Load instances corresponding to newly added "_has-uuid" relations. */
+  for (; j<n; j++) {
+    const DLiteRelation *r = coll->relations + j;
+    DLiteInstance *inst2;
+    if (!r->p || strcmp(r->p, "_has-uuid")) continue;
+    if (!(inst2 = dlite_instance_get(r->o)))
+      retval = errx(1, "cannot get instance \"%s\" labeled \"%s\" "
+                    "from collection \"%s\".  "
+                    "Is DLITE_STORAGES properly set?",
+                    r->o, r->s, coll->uuid);
+  }
+  coll->rversion = (triplestore_length(coll->rstore) == n) ?
+    triplestore_get_version(coll->rstore) : 0;
   return retval;
 }
 
@@ -93,20 +233,32 @@ int dlite_collection_saveprop(DLiteInstance *inst, size_t i)
   DLiteCollection *coll = (DLiteCollection *)inst;
   TripleState state;
   const Triple *t;
+  size_t version;
   int n, j=0;
 
   if ((n = dlite_instance_get_dimension_size_by_index(inst, i)) < 0) return -1;
   if (i != 0) return err(-1, "index out of range: %lu", (unsigned long)i);
 
+  /* nothing to do if the triplestore hasn't changed since last sync */
+  version = triplestore_get_version(coll->rstore);
+  if (coll->rversion == version && n == (int)coll->nrelations) return 0;
+
+  /* Relations that are already up to date are not copied, to avoid
+     reallocating all strings each time a large collection is saved. */
   triplestore_init_state(coll->rstore, &state);
   while ((t = triplestore_next(&state))) {
+    DLiteRelation *r = coll->relations + j;
     assert(j < (int)coll->nrelations);
-    triple_copy(coll->relations + j, t);
+    if (!_relation_eq(r, t) && !triple_copy(r, t)) {
+      triplestore_deinit_state(&state);
+      return -1;
+    }
     j++;
   }
   triplestore_deinit_state(&state);
 
   assert(j == n);
+  coll->rversion = version;
   return 0;
 }
 
@@ -145,6 +297,182 @@ void dlite_collection_decref(DLiteCollection *coll)
 }
 
 
+/* A member of a collection to load eagerly */
+typedef struct {
+  const char *uuid;     /* uuid of the member */
+  const char *metauri;  /* uri of its metadata */
+} LoadMember;
+
+/* Compare members by metadata uri, for qsort() */
+static int _member_cmp(const void *p1, const void *p2)
+{
+  const LoadMember *m1 = p1, *m2 = p2;
+  return strcmp(m1->metauri, m2->metauri);
+}
+
+/* Returns a new reference to metadata `uri`, which is looked up like
+   in dlite_instance_load().  Returns NULL if it cannot be found. */
+static DLiteInstance *_load_meta(const DLiteStorage *s, const char *uri)
+{
+  DLiteInstance *meta;
+  char uuid[DLITE_UUID_LENGTH+1];
+  ErrTry:
+    if (!(meta = dlite_instance_get(uri)) && dlite_get_uuid(uuid, uri) >= 0)
+      meta = dlite_instance_load(s, uuid);
+  ErrOther:
+    meta = NULL;  /* left to the instance loader to report */
+  ErrEnd;
+  return meta;
+}
+
+/* Loads the `n` members of a collection in `members`, which must be
+   sorted by metadata.  The metadata of each group is loaded once
+   before the members.  Storages with the batch api load all members
+   with one call.  Otherwise members of storages with the
+   `dliteCapThreadSafe` capability are loaded concurrently with the
+   asynchronous api.
+
+   Like the recursive loader, the new references to the members are
+   owned by the collection.  Returns non-zero on error. */
+static int _load_members(DLiteStorage *s, LoadMember *members, size_t n)
+{
+  DLiteInstance **metas=NULL, **insts=NULL;
+  DLiteFuture **futures=NULL;
+  const char **ids=NULL;
+  size_t i, nmetas=0;
+  int caps = dlite_storage_get_capabilities(s), retval=1;
+
+  if (!n) return 0;
+  if (!(metas = calloc(n, sizeof(DLiteInstance *))) ||
+      !(ids = calloc(n, sizeof(char *))))
+    FAIL("allocation failure");
+  for (i=0; i<n; i++) {
+    ids[i] = members[i].uuid;
+    if (i == 0 || strcmp(members[i].metauri, members[i-1].metauri))
+      if ((metas[nmetas] = _load_meta(s, members[i].metauri))) nmetas++;
+  }
+
+  if (caps & dliteCapBatch) {
+    if (!(insts = dlite_instance_load_many(s, ids, n))) goto fail;
+  } else if (caps & dliteCapThreadSafe) {
+    if (!(futures = calloc(n, sizeof(DLiteFuture *))))
+      FAIL("allocation failure");
+    for (i=0; i<n; i++)
+      if (!(futures[i] = dlite_instance_load_async(s, ids[i]))) break;
+    retval = (i < n);
+    for (i=0; i<n && futures[i]; i++) {
+      if (dlite_future_wait(futures[i]) ||
+          !dlite_future_get_instance(futures[i])) {
+        const char *msg = dlite_future_errmsg(futures[i]);
+        retval = errx(1, "cannot load collection member \"%s\": %s",
+                      ids[i], (msg) ? msg : "unknown error");
+      }
+      dlite_future_free(futures[i]);
+    }
+    if (retval) goto fail;
+  } else {
+    for (i=0; i<n; i++)
+      if (!dlite_instance_load(s, ids[i])) goto fail;
+  }
+  retval = 0;
+ fail:
+  for (i=0; i<nmetas; i++) dlite_instance_decref(metas[i]);
+  if (metas) free(metas);
+  if (ids) free(ids);
+  if (insts) free(insts);
+  if (futures) free(futures);
+  return retval;
+}
+
+/* Help function for dlite_collection_load().  Loads the collection
+   with given `id` and all its members.  `loaded` maps the uuids of the
+   collections and members loaded so far, such that instances and
+   nested collections that are shared are only loaded once.
+
+   If the collection is already in `loaded`, nothing is done and
+   `*coll` is set to NULL.  Returns non-zero on error. */
+static int _collection_load(DLiteStorage *s, const char *id,
+                            map_int_t *loaded, DLiteCollection **coll)
+{
+  DLiteCollectionState state;
+  const Triple *t, *t2;
+  LoadMember *members=NULL;
+  char **nested=NULL;
+  size_t i, n=0, nnested=0, size=0;
+  char uuid[DLITE_UUID_LENGTH+1];
+  int retval=1;
+
+  *coll = NULL;
+  if (dlite_get_uuid(uuid, id) < 0) return 1;
+  if (map_get(loaded, uuid)) return 0;
+  if (!(*coll = (DLiteCollection *)dlite_instance_load(s, id))) return 1;
+  if (map_set(loaded, uuid, 1)) FAIL("allocation failure");
+
+  /* collect members that are not loaded yet */
+  dlite_collection_init_state(*coll, &state);
+  while ((t = dlite_collection_find(*coll, &state, NULL, "_has-uuid",
+                                    NULL))) {
+    if (map_get(loaded, t->o)) continue;
+
+    /* Members in memory are already referenced by the collection,
+       since dlite_collection_loadprop() gets them when the collection
+       is loaded.  Loading them again would leak a reference. */
+    if (dlite_instance_has(t->o, 0)) continue;
+
+    if (!(t2 = dlite_collection_find_first(*coll, t->s, "_has-meta", NULL))) {
+      dlite_collection_deinit_state(&state);
+      FAIL1("collection inconsistency - no \"_has-meta\" relation for "
+            "instance: %s", t->s);
+    }
+    if (strcmp(t2->o, DLITE_COLLECTION_ENTITY) == 0) {
+      char **q;
+      if (!(q = realloc(nested, (nnested + 1)*sizeof(char *)))) {
+        dlite_collection_deinit_state(&state);
+        FAIL("allocation failure");
+      }
+      nested = q;
+      nested[nnested++] = t->o;
+    } else {
+      if (n >= size) {
+        LoadMember *q;
+        size = (size) ? 2*size : 64;
+        if (!(q = realloc(members, size*sizeof(LoadMember)))) {
+          dlite_collection_deinit_state(&state);
+          FAIL("allocation failure");
+        }
+        members = q;
+      }
+      members[n].uuid = t->o;
+      members[n].metauri = t2->o;
+      n++;
+      if (map_set(loaded, t->o, 1)) {
+        dlite_collection_deinit_state(&state);
+        FAIL("allocation failure");
+      }
+    }
+  }
+  dlite_collection_deinit_state(&state);
+
+  /* load members grouped by metadata */
+  if (n > 1) qsort(members, n, sizeof(LoadMember), _member_cmp);
+  if (_load_members(s, members, n)) goto fail;
+
+  /* load nested collections */
+  for (i=0; i<nnested; i++) {
+    DLiteCollection *sub;
+    if (_collection_load(s, nested[i], loaded, &sub)) goto fail;
+  }
+  retval = 0;
+ fail:
+  if (members) free(members);
+  if (nested) free(nested);
+  if (retval && *coll) {
+    dlite_collection_decref(*coll);
+    *coll = NULL;
+  }
+  return retval;
+}
+
 /*
   Loads collection with given id from storage `s`.  If `lazy` is zero,
   all its instances are also loaded.  Otherwise, instances are loaded
@@ -156,34 +484,19 @@ DLiteCollection *dlite_collection_load(DLiteStorage *s, const char *id,
                                        int lazy)
 {
   DLiteCollection *coll;
-  DLiteCollectionState state;
-  const Triple *t, *t2;
-
-  if (!(coll = (DLiteCollection *)dlite_instance_load(s, id)))
-    return NULL;
+  map_int_t loaded;
 
   if (lazy) {
+    if (!(coll = (DLiteCollection *)dlite_instance_load(s, id)))
+      return NULL;
     dlite_storage_paths_append(s->location);
     return coll;
   }
 
-  dlite_collection_init_state(coll, &state);
-  while ((t = dlite_collection_find(coll, &state, NULL, "_has-uuid", NULL))) {
-    if (!(t2 = dlite_collection_find_first(coll, t->s, "_has-meta", NULL)))
-      FAIL1("collection inconsistency - no \"_has-meta\" relation for "
-           "instance: %s", t->s);
-    if (strcmp(t2->o, DLITE_COLLECTION_ENTITY) == 0) {
-      if (!dlite_collection_load(s, t->o, 0)) goto fail;
-    } else {
-      if (!dlite_instance_load(s, t->o)) goto fail;
-    }
-  }
-  dlite_collection_deinit_state(&state);
+  map_init(&loaded);
+  if (_collection_load(s, id, &loaded, &coll)) coll = NULL;
+  map_deinit(&loaded);
   return coll;
- fail:
-  dlite_collection_deinit_state(&state);
-  if (coll) dlite_collection_decref(coll);
-  return NULL;
 }
 
 /*
@@ -202,36 +515,176 @@ DLiteCollection *dlite_collection_load_url(const char *url, int lazy)
   if (dlite_split_url(str, &driver, &location, &options, &id)) goto fail;
   if (!id || !(coll = (DLiteCollection *)dlite_instance_get(id))) {
     err_clear();
-    if (!(s = dlite_storage_open(driver, location, options))) goto fail;
+    if (!(s = dlite_storage_cache_open(driver, location, options)))
+      goto fail;
     if (!(coll = dlite_collection_load(s, id, lazy))) goto fail;
   }
  fail:
-  if (s) dlite_storage_close(s);
+  if (s) dlite_storage_cache_release(s);
   if (str) free(str);
   return coll;
 }
 
 
-/*
-  Saves collection and all its instances to storage `s`.
-  Returns non-zero on error.
- */
-int dlite_collection_save(DLiteCollection *coll, DLiteStorage *s)
+/* A member of a collection to save */
+typedef struct {
+  const DLiteInstance *inst;  /* the member */
+  size_t order;               /* position in which the member was found */
+} SaveMember;
+
+/* Collections and members gathered by _save_gather() */
+typedef struct {
+  map_int_t seen;             /* uuids of instances gathered so far */
+  DLiteCollection **colls;    /* collections, containing before nested */
+  size_t ncolls, collsize;
+  SaveMember *members;        /* members that are not collections */
+  size_t nmembers, membersize;
+} SavePlan;
+
+/* Compare members by metadata and then by order, for qsort() */
+static int _save_member_cmp(const void *p1, const void *p2)
+{
+  const SaveMember *m1 = p1, *m2 = p2;
+  int c = strcmp(m1->inst->meta->uuid, m2->inst->meta->uuid);
+  if (c) return c;
+  return (m1->order > m2->order) - (m1->order < m2->order);
+}
+
+/* Adds collection `coll` and, recursively, its nested collections and
+   members to `plan`.  Instances already in the plan are skipped.
+   Returns non-zero on error. */
+static int _save_gather(SavePlan *plan, DLiteCollection *coll)
 {
   DLiteCollectionState state;
   DLiteInstance *inst;
   const DLiteMeta *e = dlite_get_collection_entity();
-  int stat=0;
-  if ((stat = dlite_instance_save(s, (DLiteInstance *)coll))) return stat;
+  int retval=0;
+
+  if (map_get(&plan->seen, coll->uuid)) return 0;
+  if (map_set(&plan->seen, coll->uuid, 1))
+    return err(1, "allocation failure");
+  if (plan->ncolls >= plan->collsize) {
+    size_t size = (plan->collsize) ? 2*plan->collsize : 8;
+    void *ptr = realloc(plan->colls, size*sizeof(DLiteCollection *));
+    if (!ptr) return err(1, "allocation failure");
+    plan->colls = ptr;
+    plan->collsize = size;
+  }
+  plan->colls[plan->ncolls++] = coll;
+
   dlite_collection_init_state(coll, &state);
   while ((inst = dlite_collection_next(coll, &state))) {
-    if (inst->meta == e)
-      stat |= dlite_collection_save((DLiteCollection *)inst, s);
-    else
-      stat |= dlite_instance_save(s, inst);
+    if (inst->meta == e) {
+      if ((retval = _save_gather(plan, (DLiteCollection *)inst))) break;
+      continue;
+    }
+    if (map_get(&plan->seen, inst->uuid)) continue;
+    if (map_set(&plan->seen, inst->uuid, 1)) {
+      retval = err(1, "allocation failure");
+      break;
+    }
+    if (plan->nmembers >= plan->membersize) {
+      size_t size = (plan->membersize) ? 2*plan->membersize : 64;
+      void *ptr = realloc(plan->members, size*sizeof(SaveMember));
+      if (!ptr) {
+        retval = err(1, "allocation failure");
+        break;
+      }
+      plan->members = ptr;
+      plan->membersize = size;
+    }
+    plan->members[plan->nmembers].inst = inst;
+    plan->members[plan->nmembers].order = plan->nmembers;
+    plan->nmembers++;
   }
   dlite_collection_deinit_state(&state);
-  return stat;
+  return retval;
+}
+
+/*
+  Saves collection and all its instances to storage `s`.
+  Returns non-zero on error.
+ */
+int dlite_collection_save(DLiteCollection *coll, DLiteStorage *s)
+{
+  return dlite_collection_save_with(coll, s, 0, NULL, NULL);
+}
+
+/*
+  Saves collection `coll`, its nested collections and all their
+  members to storage `s`.  Shared instances are saved once, the
+  members are saved grouped by metadata in batches and the collections
+  are saved last.  If `flags` includes `dliteCollectionSaveMeta`, the
+  metadata of the members are saved first.
+
+  If `progress` is not NULL, it is called with `data` after each stage
+  and batch.  Returns non-zero on error or if cancelled by `progress`.
+ */
+int dlite_collection_save_with(DLiteCollection *coll, DLiteStorage *s,
+                               int flags, DLiteCollectionProgress progress,
+                               void *data)
+{
+  SavePlan plan;
+  const DLiteInstance **insts=NULL;
+  size_t i, j, n, nmetas=0, nsaved=0, total;
+  int retval=1;
+
+  memset(&plan, 0, sizeof(plan));
+  map_init(&plan.seen);
+  if (_save_gather(&plan, coll)) goto fail;
+  if (plan.nmembers > 1)
+    qsort(plan.members, plan.nmembers, sizeof(SaveMember), _save_member_cmp);
+
+  /* metadata of each group that is not already a member */
+  if (!(insts = malloc((plan.nmembers + 1)*sizeof(DLiteInstance *))))
+    FAIL("allocation failure");
+  if (flags & dliteCollectionSaveMeta) {
+    for (i=0; i<plan.nmembers; i++) {
+      const DLiteMeta *meta = plan.members[i].inst->meta;
+      if (i > 0 && meta == plan.members[i-1].inst->meta) continue;
+      if (dlite_meta_is_metameta(meta)) continue;
+      if (map_get(&plan.seen, meta->uuid)) continue;
+      insts[nmetas++] = (const DLiteInstance *)meta;
+    }
+  }
+  total = nmetas + plan.nmembers + plan.ncolls;
+
+  if (nmetas) {
+    if (dlite_instance_save_many(s, insts, nmetas)) goto fail;
+    nsaved += nmetas;
+    if (progress && progress(nsaved, total, data))
+      FAIL1("saving collection '%s' was cancelled", coll->uuid);
+  }
+
+  /* members in batches that don't cross metadata groups */
+  for (i=0; i<plan.nmembers; i+=n) {
+    const DLiteMeta *meta = plan.members[i].inst->meta;
+    for (n=0; i+n < plan.nmembers && n < DLITE_COLLECTION_SAVE_BATCH; n++) {
+      if (plan.members[i+n].inst->meta != meta) break;
+      insts[n] = plan.members[i+n].inst;
+    }
+    if (dlite_instance_save_many(s, insts, n)) goto fail;
+    nsaved += n;
+    if (progress && progress(nsaved, total, data))
+      FAIL1("saving collection '%s' was cancelled", coll->uuid);
+  }
+
+  /* relations last, such that a stored collection only refers to
+     instances that are already stored */
+  for (j=plan.ncolls; j>0; j--) {
+    if (dlite_instance_save(s, (DLiteInstance *)plan.colls[j-1])) goto fail;
+    nsaved++;
+  }
+  if (progress && plan.ncolls && progress(nsaved, total, data))
+    FAIL1("saving collection '%s' was cancelled", coll->uuid);
+
+  retval = 0;
+ fail:
+  map_deinit(&plan.seen);
+  if (plan.colls) free(plan.colls);
+  if (plan.members) free(plan.members);
+  if (insts) free((void *)insts);
+  return retval;
 }
 
 /*
@@ -254,6 +707,125 @@ int dlite_collection_save_url(DLiteCollection *coll, const char *url)
   return retval;
 }
 
+/*
+  Saves the members of collection `coll` with metadata `metaid` to
+  storage `s` together with a view that stacks each of their
+  properties along a new first dimension.  Use
+  dlite_collection_load_view() to read a stacked property back.
+
+  The collection itself is not saved.  Requires a storage plugin that
+  implements the collection view api, like hdf5.
+
+  Returns non-zero on error.
+ */
+int dlite_collection_save_view(DLiteCollection *coll, DLiteStorage *s,
+                               const char *metaid)
+{
+  DLiteCollectionState state;
+  DLiteInstance *inst;
+  const DLiteInstance **insts=NULL;
+  const char **uuids=NULL;
+  char metauuid[DLITE_UUID_LENGTH+1];
+  size_t n=0, size=0;
+  int retval=1;
+
+  if (!s->api->saveView)
+    return errx(1, "storage plugin '%s' does not support collection views",
+                s->api->name);
+  if (dlite_get_uuid(metauuid, metaid) < 0) return 1;
+
+  dlite_collection_init_state(coll, &state);
+  while ((inst = dlite_collection_next(coll, &state))) {
+    if (strcmp(inst->meta->uuid, metauuid)) continue;
+    if (n >= size) {
+      size_t newsize = size + 64;
+      void *ptr;
+      if (!(ptr = realloc(insts, newsize*sizeof(DLiteInstance *)))) break;
+      insts = ptr;
+      if (!(ptr = realloc(uuids, newsize*sizeof(char *)))) break;
+      uuids = ptr;
+      size = newsize;
+    }
+    insts[n] = inst;
+    uuids[n++] = inst->uuid;
+  }
+  dlite_collection_deinit_state(&state);
+  if (inst) FAIL("allocation failure");
+  if (!n) FAIL2("collection '%s' has no members of '%s'",
+                coll->uuid, metaid);
+
+  if (dlite_instance_save_many(s, insts, n)) goto fail;
+  retval = s->api->saveView(s, coll->uuid, metauuid, uuids, n);
+ fail:
+  if (insts) free(insts);
+  if (uuids) free(uuids);
+  return retval;
+}
+
+/*
+  Returns property `name` of the members of collection `id` with
+  metadata `metaid` in storage `s`, stacked along a new first
+  dimension.  The view must have been saved with
+  dlite_collection_save_view().  Properties of allocated types, like
+  strings, are not supported.
+
+  The caller is responsible to free the data with `free(arr->data)`
+  before releasing the returned array with dlite_array_free().
+
+  Returns NULL on error.
+ */
+DLiteArray *dlite_collection_load_view(DLiteStorage *s, const char *id,
+                                       const char *metaid, const char *name)
+{
+  DLiteMeta *meta=NULL;
+  const DLiteProperty *p;
+  DLiteArray *arr=NULL;
+  char uuid[DLITE_UUID_LENGTH+1], metauuid[DLITE_UUID_LENGTH+1];
+
+  if (!s->api->loadView)
+    FAIL1("storage plugin '%s' does not support collection views",
+          s->api->name);
+  if (dlite_get_uuid(uuid, id) < 0 || dlite_get_uuid(metauuid, metaid) < 0)
+    goto fail;
+  if (!(meta = dlite_meta_get(metaid))) goto fail;
+  if (!(p = dlite_meta_get_property(meta, name))) goto fail;
+  if (dlite_type_is_allocated(p->type))
+    FAIL2("cannot load view of property '%s' of allocated type %s",
+          name, dlite_type_get_dtypename(p->type));
+  arr = s->api->loadView(s, uuid, metauuid, name, p->type, p->size);
+ fail:
+  if (meta) dlite_meta_decref(meta);
+  return arr;
+}
+
+/* Returns non-zero if relations with predicate `p` may affect the
+   member index. */
+static int _affects_index(const char *p)
+{
+  return (!p || strcmp(p, "_has-uuid") == 0);
+}
+
+/* Like dlite_collection_add_relation(), but does not update the member
+   index. */
+static int _add_relation(DLiteCollection *coll, const char *s,
+                         const char *p, const char *o)
+{
+  int stat = triplestore_add(coll->rstore, s, p, o);
+  if (!stat) DLITE_PROP_DIM(coll, 0, 0) = coll->nrelations;
+  return stat;
+}
+
+/* Like dlite_collection_remove_relations(), but does not update the
+   member index. */
+static int _remove_relations(DLiteCollection *coll, const char *s,
+                             const char *p, const char *o)
+{
+  int retval = triplestore_remove(coll->rstore, s, p, o);
+  if (retval > -1)
+    DLITE_PROP_DIM(coll, 0, 0) = coll->nrelations;
+  return retval;
+}
+
 /*
   Adds subject-predicate-object relation to collection.  Returns non-zero
   on error.
@@ -261,10 +833,8 @@ int dlite_collection_save_url(DLiteCollection *coll, const char *url)
 int dlite_collection_add_relation(DLiteCollection *coll, const char *s,
                                   const char *p, const char *o)
 {
-  int stat = triplestore_add(coll->rstore, s, p, o);
-  if (!stat)
-    DLITE_PROP_DIM(coll, 0, 0) = coll->nrelations;
-  return stat;
+  if (_affects_index(p)) _index_clear(coll);
+  return _add_relation(coll, s, p, o);
 }
 
 
@@ -275,10 +845,8 @@ int dlite_collection_add_relation(DLiteCollection *coll, const char *s,
 int dlite_collection_remove_relations(DLiteCollection *coll, const char *s,
                                       const char *p, const char *o)
 {
-  int retval = triplestore_remove(coll->rstore, s, p, o);
-  if (retval > -1)
-    DLITE_PROP_DIM(coll, 0, 0) = coll->nrelations;
-  return retval;
+  if (_affects_index(p)) _index_clear(coll);
+  return _remove_relations(coll, s, p, o);
 }
 
 
@@ -362,9 +930,10 @@ int dlite_collection_add_new(DLiteCollection *coll, const char *label,
     return err(1, "instance with label '%s' is already in the collection",
                label);
 
-  dlite_collection_add_relation(coll, label, "_is-a", "Instance");
-  dlite_collection_add_relation(coll, label, "_has-uuid", inst->uuid);
-  dlite_collection_add_relation(coll, label, "_has-meta", inst->meta->uri);
+  _add_relation(coll, label, "_is-a", "Instance");
+  _add_relation(coll, label, "_has-uuid", inst->uuid);
+  _add_relation(coll, label, "_has-meta", inst->meta->uri);
+  _index_add(coll, label, inst->uuid, inst);
   return 0;
 }
 
@@ -390,9 +959,10 @@ int dlite_collection_remove(DLiteCollection *coll, const char *label)
   DLiteCollectionState state;
   DLiteInstance *inst;
   const DLiteRelation *r;
-  if (dlite_collection_remove_relations(coll, label, "_is-a", "Instance") > 0) {
+  if (_remove_relations(coll, label, "_is-a", "Instance") > 0) {
     r = dlite_collection_find(coll, NULL, label, "_has-uuid", NULL);
     assert(r);
+    _index_remove(coll, label);
 
     /* Removes reference hold by collection to the instance. We have
      to call dlite_instance_decref() twice, since dlite_instance_get()
@@ -411,9 +981,9 @@ int dlite_collection_remove(DLiteCollection *coll, const char *label)
     //*dlite_collection_deinit_state(&state);
     UNUSED(state);
 
-    dlite_collection_remove_relations(coll, label, "_has-uuid", NULL);
-    dlite_collection_remove_relations(coll, label, "_has-meta", NULL);
-    dlite_collection_remove_relations(coll, label, "_has-dimmap", NULL);
+    _remove_relations(coll, label, "_has-uuid", NULL);
+    _remove_relations(coll, label, "_has-meta", NULL);
+    _remove_relations(coll, label, "_has-dimmap", NULL);
     return 0;
   }
   return 1;
@@ -426,16 +996,10 @@ int dlite_collection_remove(DLiteCollection *coll, const char *label)
 const DLiteInstance *dlite_collection_get(const DLiteCollection *coll,
                                           const char *label)
 {
-  const DLiteRelation *r;
-  if ((r = dlite_collection_find(coll, NULL, label, "_has-uuid", NULL))) {
-    DLiteInstance *inst = dlite_instance_get(r->o);
-    //assert(inst->_refcount >= 2);
-    //dlite_instance_decref(inst);
-
-    /* FIXME - this looks like a hack, should be solved properly... */
-    if (inst->_refcount >= 2) dlite_instance_decref(inst);
+  CollectionMember *m;
+  DLiteInstance *inst;
+  if ((m = _member_by_label(coll, label)) && (inst = _index_resolve(m)))
     return inst;
-  }
   errx(1, "cannot load instance '%s' from collection", label);
   return NULL;
 }
@@ -446,11 +1010,10 @@ const DLiteInstance *dlite_collection_get(const DLiteCollection *coll,
 const DLiteInstance *dlite_collection_get_id(const DLiteCollection *coll,
                                              const char *id)
 {
-  const DLiteRelation *r;
+  CollectionMember *m;
   char uuid[DLITE_UUID_LENGTH+1];
   if (dlite_get_uuid(uuid, id) < 0) return NULL;
-  if ((r = dlite_collection_find(coll, NULL, NULL, "_has-uuid", uuid)))
-    return dlite_instance_get(id);
+  if ((m = _member_by_uuid(coll, uuid))) return _index_resolve(m);
   return NULL;
 }
 
@@ -480,7 +1043,7 @@ DLiteInstance *dlite_collection_get_new(const DLiteCollection *coll,
  */
 int dlite_collection_has(const DLiteCollection *coll, const char *label)
 {
-  return (dlite_collection_find_first(coll, label, "_has-uuid", NULL)) ? 1 : 0;
+  return (_member_by_label(coll, label)) ? 1 : 0;
 }
 
 /*
@@ -491,7 +1054,7 @@ int dlite_collection_has_id(const DLiteCollection *coll, const char *id)
 {
   char uuid[DLITE_UUID_LENGTH+1];
   if (dlite_get_uuid(uuid, id) < 0) return 0;
-  return (dlite_collection_find_first(coll, NULL, "_has-uuid", uuid)) ? 1 : 0;
+  return (_member_by_uuid(coll, uuid)) ? 1 : 0;
 }
 
 
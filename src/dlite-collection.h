@@ -41,6 +41,11 @@ typedef struct _DLiteCollection {
   /* -- extended header */
   DLiteInstance_HEAD
   TripleStore *rstore;       /*!< TripleStore managing the relations. */
+  size_t rversion;           /*!< Version of `rstore` that `relations`
+                                  is in sync with or zero if it is not
+                                  in sync. */
+  struct _DLiteCollectionIndex *index;  /*!< Maps labels and uuids to
+                                             members.  NULL until used. */
 
   /* -- dimensions */
   size_t nrelations;         /*!< Number of relations. */
@@ -63,6 +68,23 @@ typedef struct _DLiteCollection {
 /** State used by dlite_collection_find(). */
 typedef struct _TripleState DLiteCollectionState;
 
+/** Maximum number of members passed to one dlite_instance_save_many()
+    call by dlite_collection_save_with(). */
+#define DLITE_COLLECTION_SAVE_BATCH 1024
+
+/** Flags for dlite_collection_save_with(). */
+typedef enum {
+  dliteCollectionSaveMeta=1   /*!< Also save the metadata of the members. */
+} DLiteCollectionSaveFlag;
+
+/**
+  Progress callback for dlite_collection_save_with().  It is called
+  with the number of instances saved so far and the total number of
+  instances to save.  A non-zero return value cancels the save.
+ */
+typedef int (*DLiteCollectionProgress)(size_t nsaved, size_t total,
+                                       void *data);
+
 /**
   Initiates a collection instance.
 
@@ -121,6 +143,13 @@ void dlite_collection_decref(DLiteCollection *coll);
   Loads collection with given id from storage `s`.  If `lazy` is zero,
   all its instances are loaded immediately.  Otherwise, instances are
   first loaded on demand.  Returns non-zero on error.
+
+  With `lazy` equal to zero, the metadata of the members is loaded
+  once per metadata, after which the members are loaded with one
+  batch call if the storage implements the loadInstances() api, or
+  concurrently with the asynchronous api if the storage has the
+  `dliteCapThreadSafe` capability.  Instances and nested collections
+  that occur several times are only loaded once.
  */
 DLiteCollection *dlite_collection_load(DLiteStorage *s, const char *id,
                                        int lazy);
@@ -137,9 +166,35 @@ DLiteCollection *dlite_collection_load_url(const char *url, int lazy);
 /**
   Saves collection and all its instances to storage `s`.
   Returns non-zero on error.
+
+  This is equivalent to dlite_collection_save_with() with no flags
+  and no progress callback.
  */
 int dlite_collection_save(DLiteCollection *coll, DLiteStorage *s);
 
+/**
+  Saves collection `coll`, its nested collections and all their
+  members to storage `s`.
+
+  The save is done in stages:
+    1. The members of `coll` and its nested collections are gathered.
+       Instances and nested collections that occur several times are
+       only saved once.
+    2. If `flags` includes `dliteCollectionSaveMeta`, the metadata of
+       the members are saved.
+    3. The members are grouped by metadata and saved with
+       dlite_instance_save_many() in batches of at most
+       DLITE_COLLECTION_SAVE_BATCH instances.
+    4. The collections and hence their relations are saved last,
+       nested collections before the collections containing them.
+
+  If `progress` is not NULL, it is called with `data` after each stage
+  and batch.  Returns non-zero on error or if cancelled by `progress`.
+ */
+int dlite_collection_save_with(DLiteCollection *coll, DLiteStorage *s,
+                               int flags, DLiteCollectionProgress progress,
+                               void *data);
+
 /**
   A convinient function that saves instance `inst` to the storage specified
   by `url`, which should be of the form "driver://path?options".
@@ -147,6 +202,35 @@ int dlite_collection_save(DLiteCollection *coll, DLiteStorage *s);
  */
 int dlite_collection_save_url(DLiteCollection *coll, const char *url);
 
+/**
+  Saves the members of collection `coll` with metadata `metaid` to
+  storage `s` together with a view that stacks each of their
+  properties along a new first dimension.  Use
+  dlite_collection_load_view() to read a stacked property back.
+
+  The collection itself is not saved.  Requires a storage plugin that
+  implements the collection view api, like hdf5.
+
+  Returns non-zero on error.
+ */
+int dlite_collection_save_view(DLiteCollection *coll, DLiteStorage *s,
+                               const char *metaid);
+
+/**
+  Returns property `name` of the members of collection `id` with
+  metadata `metaid` in storage `s`, stacked along a new first
+  dimension.  The view must have been saved with
+  dlite_collection_save_view().  Properties of allocated types, like
+  strings, are not supported.
+
+  The caller is responsible to free the data with `free(arr->data)`
+  before releasing the returned array with dlite_array_free().
+
+  Returns NULL on error.
+ */
+DLiteArray *dlite_collection_load_view(DLiteStorage *s, const char *id,
+                                       const char *metaid, const char *name);
+
 
 /**
   Adds subject-predicate-object relation to collection.  Returns non-zero
@@ -0,0 +1,337 @@
+/* dlite-compress.c -- transparent compression of file-based storages
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "config.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/strutils.h"
+#include "utils/scheduler.h"
+#include "utils/tmpfileplus.h"
+#include "dlite-macros.h"
+#include "dlite-compress.h"
+
+/* Min number of bytes compressed by each task */
+#define COMPRESS_MIN_BLOCK (1024*1024)
+
+/* Max number of bytes compressed by each task, such that sizes fit
+   into the unsigned int fields of z_stream */
+#define COMPRESS_MAX_BLOCK (256*1024*1024)
+
+/* Size of buffer used when decompressing */
+#define DECOMPRESS_BUFSIZE (64*1024)
+
+
+struct _DLiteCompression {
+  char *location;    /* compressed file */
+  char *path;        /* temporary uncompressed file */
+  int level;         /* compression level */
+  int nthreads;      /* number of compression threads */
+};
+
+
+/*
+  Parses a compression specification of the form
+  "CODEC[:LEVEL[:THREADS]]".  Returns non-zero on error.
+ */
+int dlite_compress_parse(const char *spec, int *level, int *nthreads)
+{
+  size_t len = strcspn(spec, ":");
+  const char *p = spec + len;
+  char *endptr;
+  *level = -1;
+  *nthreads = 1;
+  if (!((len == 4 && strncmp(spec, "gzip", 4) == 0) ||
+        (len == 2 && strncmp(spec, "gz", 2) == 0)))
+    return errx(1, "unsupported compression '%.*s', only gzip is supported",
+                (int)len, spec);
+  if (*p == ':' && p[1] != ':') {
+    long v = strtol(p+1, &endptr, 10);
+    if (endptr == p+1 || (*endptr && *endptr != ':') || v < 1 || v > 9)
+      return errx(1, "invalid compression level in '%s', must be 1-9", spec);
+    *level = v;
+    p = endptr;
+  } else if (*p == ':') {
+    p++;
+  }
+  if (*p == ':') {
+    long v = strtol(p+1, &endptr, 10);
+    if (endptr == p+1 || *endptr || v < 0)
+      return errx(1, "invalid number of compression threads in '%s'", spec);
+    *nthreads = (v) ? v : sched_get_nthreads();
+    if (*nthreads < 1) *nthreads = 1;
+  } else if (*p) {
+    return errx(1, "invalid compression specification: '%s'", spec);
+  }
+#ifndef HAVE_ZLIB
+  return errx(1, "cannot compress storages - dlite is built without zlib");
+#endif
+  return 0;
+}
+
+
+#ifdef HAVE_ZLIB
+
+/* A block compressed by one thread */
+typedef struct {
+  const unsigned char *in;  /* input */
+  size_t inlen;             /* length of input */
+  unsigned char *out;       /* output, a complete gzip member */
+  size_t outlen;            /* length of output */
+  int level;                /* compression level */
+  int stat;                 /* zlib status */
+} Block;
+
+/* Compresses a block. */
+static void compress_block(Block *b)
+{
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if ((b->stat = deflateInit2(&z, b->level, Z_DEFLATED, 15 + 16, 8,
+                              Z_DEFAULT_STRATEGY)) != Z_OK) return;
+  b->outlen = deflateBound(&z, (uLong)b->inlen);
+  if (!(b->out = malloc(b->outlen))) {
+    deflateEnd(&z);
+    b->stat = Z_MEM_ERROR;
+    return;
+  }
+  z.next_in = (unsigned char *)b->in;
+  z.avail_in = (uInt)b->inlen;
+  z.next_out = b->out;
+  z.avail_out = (uInt)b->outlen;
+  b->stat = deflate(&z, Z_FINISH);
+  b->outlen = z.total_out;
+  deflateEnd(&z);
+  if (b->stat == Z_STREAM_END) b->stat = Z_OK;
+  else if (b->stat == Z_OK) b->stat = Z_BUF_ERROR;
+}
+
+/* Task compressing blocks `begin` to `end` of the array `arg`. */
+static void compress_blocks(size_t begin, size_t end, void *arg)
+{
+  Block *blocks = arg;
+  size_t i;
+  for (i=begin; i<end; i++) compress_block(blocks + i);
+}
+
+/* Reads file `path` into a newly allocated buffer and stores its length
+   in `*len`.  Returns NULL on error. */
+static unsigned char *read_file(const char *path, size_t *len)
+{
+  FILE *fp;
+  unsigned char *buf=NULL;
+  long n;
+  if (!(fp = fopen(path, "rb")))
+    return err(1, "cannot open '%s'", path), NULL;
+  if (fseek(fp, 0, SEEK_END) || (n = ftell(fp)) < 0 ||
+      fseek(fp, 0, SEEK_SET))
+    FAIL1("cannot read '%s'", path);
+  if (!(buf = malloc((n) ? n : 1))) FAIL("allocation failure");
+  if (fread(buf, 1, n, fp) != (size_t)n) {
+    free(buf);
+    buf = NULL;
+    FAIL1("cannot read '%s'", path);
+  }
+  *len = n;
+ fail:
+  fclose(fp);
+  return buf;
+}
+
+#endif
+
+
+/*
+  Compresses file `src` to `dst` using `nthreads` threads.
+ */
+int dlite_compress_file(const char *src, const char *dst, int level,
+                        int nthreads)
+{
+#ifdef HAVE_ZLIB
+  unsigned char *in=NULL;
+  size_t i, len, bsize, nblocks=0;
+  Block *blocks=NULL;
+  char *tmp=NULL;
+  FILE *fp=NULL;
+  int retval=1;
+
+  if (nthreads < 1) nthreads = 1;
+  if (!(in = read_file(src, &len))) goto fail;
+
+  /* Split the input into blocks, at most one per thread at a time */
+  bsize = len / nthreads + 1;
+  if (bsize < COMPRESS_MIN_BLOCK) bsize = COMPRESS_MIN_BLOCK;
+  if (bsize > COMPRESS_MAX_BLOCK) bsize = COMPRESS_MAX_BLOCK;
+  nblocks = (len) ? (len + bsize - 1) / bsize : 1;
+  if (!(blocks = calloc(nblocks, sizeof(Block))))
+    FAIL("allocation failure");
+  for (i=0; i<nblocks; i++) {
+    blocks[i].in = in + i*bsize;
+    blocks[i].inlen = (i < nblocks-1) ? bsize : len - i*bsize;
+    blocks[i].level = (level > 0) ? level : Z_DEFAULT_COMPRESSION;
+  }
+
+  /* Compress the blocks in `nthreads` concurrent tasks */
+  sched_parallel_for(nblocks, (nblocks + nthreads - 1) / nthreads,
+                     compress_blocks, blocks);
+  for (i=0; i<nblocks; i++)
+    if (blocks[i].stat != Z_OK)
+      FAIL2("cannot compress '%s': zlib error %d", src, blocks[i].stat);
+
+  /* Write to a temporary file that is renamed on success */
+  if (!(tmp = aprintf("%s.tmp", dst))) FAIL("allocation failure");
+  if (!(fp = fopen(tmp, "wb"))) FAIL1("cannot create '%s'", tmp);
+  for (i=0; i<nblocks; i++)
+    if (fwrite(blocks[i].out, 1, blocks[i].outlen, fp) != blocks[i].outlen)
+      FAIL1("cannot write '%s'", tmp);
+  if (fclose(fp)) {
+    fp = NULL;
+    FAIL1("cannot write '%s'", tmp);
+  }
+  fp = NULL;
+  if (rename(tmp, dst)) {
+    /* rename() does not replace existing files on Windows */
+    remove(dst);
+    if (rename(tmp, dst)) FAIL2("cannot rename '%s' to '%s'", tmp, dst);
+  }
+  retval = 0;
+ fail:
+  if (fp) fclose(fp);
+  if (retval && tmp) remove(tmp);
+  if (tmp) free(tmp);
+  if (blocks) {
+    for (i=0; i<nblocks; i++) if (blocks[i].out) free(blocks[i].out);
+    free(blocks);
+  }
+  if (in) free(in);
+  return retval;
+#else
+  UNUSED(src);
+  UNUSED(dst);
+  UNUSED(level);
+  UNUSED(nthreads);
+  return errx(1, "cannot compress files - dlite is built without zlib");
+#endif
+}
+
+
+/*
+  Decompresses gzip file `src` to `dst`.
+ */
+int dlite_decompress_file(const char *src, const char *dst)
+{
+#ifdef HAVE_ZLIB
+  gzFile gz;
+  FILE *fp;
+  unsigned char *buf;
+  int n, retval=1;
+  if (!(gz = gzopen(src, "rb"))) return err(1, "cannot open '%s'", src);
+  if (!(fp = fopen(dst, "wb"))) {
+    gzclose(gz);
+    return err(1, "cannot create '%s'", dst);
+  }
+  if (!(buf = malloc(DECOMPRESS_BUFSIZE))) FAIL("allocation failure");
+  while ((n = gzread(gz, buf, DECOMPRESS_BUFSIZE)) > 0)
+    if (fwrite(buf, 1, n, fp) != (size_t)n) FAIL1("cannot write '%s'", dst);
+  if (n < 0) {
+    int errnum;
+    const char *msg = gzerror(gz, &errnum);
+    FAIL2("cannot decompress '%s': %s", src, msg);
+  }
+  retval = 0;
+ fail:
+  if (buf) free(buf);
+  if (fclose(fp) && !retval) retval = err(1, "cannot write '%s'", dst);
+  gzclose(gz);
+  return retval;
+#else
+  UNUSED(src);
+  UNUSED(dst);
+  return errx(1, "cannot decompress files - dlite is built without zlib");
+#endif
+}
+
+
+/*
+  Starts transparent compression of file `location`.
+ */
+DLiteCompression *dlite_compression_open(const char *location,
+                                         const char *spec)
+{
+  DLiteCompression *c=NULL;
+  FILE *fp;
+  if (!(c = calloc(1, sizeof(DLiteCompression)))) FAIL("allocation failure");
+  if (dlite_compress_parse(spec, &c->level, &c->nthreads)) goto fail;
+  if (!(c->location = strdup(location))) FAIL("allocation failure");
+  if (!(fp = tmpfileplus(NULL, "dlite-", &c->path, TMPFILE_KEEP)))
+    FAIL("cannot create temporary file for compressed storage");
+  fclose(fp);
+
+  if ((fp = fopen(location, "rb"))) {
+    fclose(fp);
+    if (dlite_decompress_file(location, c->path)) goto fail;
+  } else {
+    /* let the plugin create a new file */
+    remove(c->path);
+  }
+  return c;
+ fail:
+  if (c) {
+    if (c->path) {
+      remove(c->path);
+      free(c->path);
+    }
+    if (c->location) free(c->location);
+    free(c);
+  }
+  return NULL;
+}
+
+
+/*
+  Returns the path of the temporary uncompressed file of `c`.
+ */
+const char *dlite_compression_path(const DLiteCompression *c)
+{
+  return c->path;
+}
+
+
+/*
+  Returns the location of the compressed file of `c`.
+ */
+const char *dlite_compression_location(const DLiteCompression *c)
+{
+  return c->location;
+}
+
+
+/*
+  Ends transparent compression.
+ */
+int dlite_compression_close(DLiteCompression *c, int writable)
+{
+  FILE *fp;
+  int stat=0;
+  if (writable && (fp = fopen(c->path, "rb"))) {
+    fclose(fp);
+    stat = dlite_compress_file(c->path, c->location, c->level, c->nthreads);
+  }
+  remove(c->path);
+  free(c->path);
+  free(c->location);
+  free(c);
+  return stat;
+}
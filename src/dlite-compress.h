@@ -0,0 +1,98 @@
+#ifndef _DLITE_COMPRESS_H
+#define _DLITE_COMPRESS_H
+
+/**
+  @file
+  @brief Transparent compression of file-based storages
+
+  Any storage plugin that reads and writes a single file can be used
+  with a compressed file.  The compression is requested either by
+  prefixing the driver with the codec, like
+
+      dlite_storage_open("gzip+json", "data.json.gz", "mode=w");
+
+  by the `compress` option, which is removed from the options before
+  they are passed to the plugin
+
+      dlite_storage_open("json", "data.json.gz", "mode=w;compress=gzip:9");
+
+  or, if no driver is given, by a location ending with ".gz".
+
+  The file is decompressed to a temporary file when the storage is
+  opened, and the plugin works on the temporary file.  The `location`
+  field of the storage is the path of the temporary file.  When a writable
+  storage is closed, the temporary file is compressed back to the
+  location.  Large files may be compressed by several threads.  Each
+  thread compresses a block of the file as a separate gzip member.
+  The members are concatenated into a valid gzip file that standard
+  tools can read.
+
+  Only gzip (zlib) is supported.  If DLite is built without zlib,
+  opening a compressed storage fails.
+ */
+
+/** Compressed file wrapped by a storage. */
+typedef struct _DLiteCompression DLiteCompression;
+
+
+/**
+  Parses a compression specification `spec` of the form
+  "CODEC[:LEVEL[:THREADS]]", where CODEC is "gzip" (or "gz"), LEVEL is
+  the compression level from 1 to 9 and THREADS is the number of
+  compression threads.  A THREADS value of zero means the number of
+  threads of the shared task scheduler (see DLITE_NUM_THREADS).  The
+  level and number of threads are stored in `*level` and `*nthreads`.  If not given, they are set to -1 (the default level
+  of zlib) and 1, respectively.
+
+  Returns non-zero on error.
+ */
+int dlite_compress_parse(const char *spec, int *level, int *nthreads);
+
+/**
+  Compresses file `src` with gzip and writes the result to `dst`
+  using `nthreads` threads.  `level` is the compression level, or -1
+  for the default level.  `dst` is written to a temporary file that is
+  renamed on success.
+
+  Returns non-zero on error.
+ */
+int dlite_compress_file(const char *src, const char *dst, int level,
+                        int nthreads);
+
+/**
+  Decompresses gzip file `src` to `dst`.  Uncompressed files are
+  copied as-is.  Returns non-zero on error.
+ */
+int dlite_decompress_file(const char *src, const char *dst);
+
+/**
+  Starts transparent compression of file `location` according to
+  `spec` (see dlite_compress_parse()).  If `location` exists, it is
+  decompressed to a temporary file.
+
+  Returns a new compression object, or NULL on error.
+ */
+DLiteCompression *dlite_compression_open(const char *location,
+                                         const char *spec);
+
+/**
+  Returns the path of the temporary uncompressed file of `c`.
+ */
+const char *dlite_compression_path(const DLiteCompression *c);
+
+/**
+  Returns the location of the compressed file of `c`.
+ */
+const char *dlite_compression_location(const DLiteCompression *c);
+
+/**
+  Ends transparent compression.  If `writable` is non-zero and the
+  temporary file exists, it is compressed back to the location.  The
+  temporary file is removed and `c` is freed.
+
+  Returns non-zero on error.
+ */
+int dlite_compression_close(DLiteCompression *c, int writable);
+
+
+#endif /* _DLITE_COMPRESS_H */
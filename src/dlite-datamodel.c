@@ -5,9 +5,11 @@
 
 #include "utils/compat.h"
 #include "utils/err.h"
+#include "utils/scheduler.h"
 #include "dlite.h"
 #include "dlite-macros.h"
 #include "dlite-datamodel.h"
+#include "dlite-record.h"
 
 
 
@@ -119,7 +121,14 @@ int dlite_datamodel_get_property(const DLiteDataModel *d, const char *name,
                                  void *ptr, DLiteType type, size_t size,
                                  size_t ndims, const size_t *dims)
 {
-  return d->api->getProperty(d, name, ptr, type, size, ndims, dims);
+  uint64_t t0 = dlite_record_begin();
+  int stat = d->api->getProperty(d, name, ptr, type, size, ndims, dims);
+  if (t0 && !stat) {
+    size_t i, nbytes = size;
+    for (i=0; i<ndims; i++) nbytes *= dims[i];
+    dlite_record_io(d->s, dliteRecordGetProperty, d->uuid, name, nbytes, t0);
+  }
+  return stat;
 }
 
 
@@ -190,6 +199,59 @@ int dlite_datamodel_has_property(DLiteDataModel *d, const char *name)
 }
 
 
+/*
+  Writes the memory pointed to by `ptr` to a block of property `name`
+  with dimensions `dims`.
+
+  `offsets` and `counts` are arrays of length `ndims` with the index of
+  the first element of the block and its number of elements along each
+  dimension.  The elements of the block are read in C order from `ptr`.
+
+  Returns non-zero on error (e.g. if this function isn't supported by
+  the plugin).
+ */
+int dlite_datamodel_set_property_slice(DLiteDataModel *d, const char *name,
+                                       const void *ptr, DLiteType type,
+                                       size_t size, size_t ndims,
+                                       const size_t *dims,
+                                       const size_t *offsets,
+                                       const size_t *counts)
+{
+  if (!d->api->setPropertySlice)
+    return errx(1, "driver '%s' does not support setPropertySlice()",
+                d->api->name);
+  return d->api->setPropertySlice(d, name, ptr, type, size, ndims, dims,
+                                  offsets, counts);
+}
+
+
+/*
+  Copies a slice of property `name` to memory pointed to by `ptr`.
+
+  `offsets`, `counts` and `strides` are arrays of length `ndims` with
+  the index of the first element, the number of elements and the step
+  between elements along each dimension.  If `strides` is NULL, a step
+  of one is assumed.  The selected elements are written continuously
+  in C order to `ptr`.
+
+  Returns non-zero on error (e.g. if this function isn't supported by
+  the plugin).
+ */
+int dlite_datamodel_get_property_slice(const DLiteDataModel *d,
+                                       const char *name, void *ptr,
+                                       DLiteType type, size_t size,
+                                       size_t ndims, const size_t *offsets,
+                                       const size_t *counts,
+                                       const size_t *strides)
+{
+  if (!d->api->getPropertySlice)
+    return errx(1, "driver '%s' does not support getPropertySlice()",
+                d->api->name);
+  return d->api->getPropertySlice(d, name, ptr, type, size, ndims,
+                                  offsets, counts, strides);
+}
+
+
 /*
   If the uuid was generated from a unique name, return a pointer to a
   newly malloc'ed string with this name.  Otherwise NULL is returned.
@@ -207,75 +269,168 @@ char *dlite_datamodel_get_dataname(DLiteDataModel *d)
  * Utility functions intended to be used by the storage plugins
  ********************************************************************/
 
+/* Minimum number of bytes copied by each task in dlite_copy_to_flat()
+   and dlite_copy_to_nested() */
+#define COPY_MIN_BYTES_PER_THREAD (1<<20)
+
+/* The arrays to copy, see copy_range() */
+typedef struct {
+  char *flat;          /* Flat C-ordered array */
+  void *nested;        /* Nested pointer to pointers array */
+  size_t size;         /* Size of each element */
+  size_t ndims;        /* Number of dimensions */
+  const size_t *dims;  /* Dimensions */
+  int to_flat;         /* Whether to copy from `nested` to `flat` */
+} CopyArrays;
+
+/* Copies `n` contiguous bytes between `flat` and `row`. */
+static void copy_row(char *flat, void *row, size_t n, int to_flat)
+{
+  if (to_flat)
+    memcpy(flat, row, n);
+  else
+    memcpy(row, flat, n);
+}
+
+/* Copies entries `begin` to `end` along the outermost dimension between
+   the flat array `flat` and the nested array `nested`.  The innermost
+   dimension is copied a row at a time. */
+static void copy_rec(char *flat, void *nested, size_t size, size_t ndims,
+                     const size_t *dims, size_t begin, size_t end,
+                     int to_flat)
+{
+  size_t i, stride=size;
+  if (ndims == 1) {
+    copy_row(flat + begin*size, (char *)nested + begin*size,
+             (end - begin)*size, to_flat);
+    return;
+  }
+  for (i=1; i<ndims; i++) stride *= dims[i];
+  for (i=begin; i<end; i++)
+    copy_rec(flat + i*stride, ((void **)nested)[i], size, ndims-1, dims+1,
+             0, dims[1], to_flat);
+}
+
+/* Task copying the range [`begin`, `end`) along the outermost dimension
+   of the arrays described by `arg`. */
+static void copy_range(size_t begin, size_t end, void *arg)
+{
+  CopyArrays *a = arg;
+  copy_rec(a->flat, a->nested, a->size, a->ndims, a->dims, begin, end,
+           a->to_flat);
+}
+
+/* Returns the number of tasks to split a copy of `nbytes` bytes into. */
+static int copy_nthreads(size_t nbytes)
+{
+  char *endptr, *p = getenv("DLITE_COPY_THREADS");
+  size_t n = sched_get_nthreads();
+  if (p && *p) {
+    long v = strtol(p, &endptr, 10);
+    if (*endptr || v < 1)
+      warnx("invalid value of DLITE_COPY_THREADS: '%s'", p);
+    else
+      n = v;
+  }
+  if (n > nbytes / COPY_MIN_BYTES_PER_THREAD)
+    n = nbytes / COPY_MIN_BYTES_PER_THREAD;
+  return (n < 1) ? 1 : (int)n;
+}
+
+/* Copies between the flat array `flat` and the nested array `nested`.
+   For large arrays, chunks of the outermost dimension are copied
+   concurrently by the shared task scheduler. */
+static int copy_nested(char *flat, void *nested, size_t size, size_t ndims,
+                       const size_t *dims, int to_flat)
+{
+  size_t i, nbytes=size;
+  int nthreads;
+  CopyArrays a;
+
+  /* No dims means a single element */
+  if (!dims) {
+    for (i=0; i+1<ndims; i++) nested = ((void **)nested)[0];
+    copy_row(flat, nested, size, to_flat);
+    return 0;
+  }
+  if (ndims == 0) {
+    copy_row(flat, nested, size, to_flat);
+    return 0;
+  }
+  for (i=0; i<ndims; i++) nbytes *= dims[i];
+  if (nbytes == 0) return 0;
+
+  a.flat = flat;
+  a.nested = nested;
+  a.size = size;
+  a.ndims = ndims;
+  a.dims = dims;
+  a.to_flat = to_flat;
+  nthreads = copy_nthreads(nbytes);
+  if (nthreads == 1) {
+    copy_range(0, dims[0], &a);
+    return 0;
+  }
+  return sched_parallel_for(dims[0], (dims[0] + nthreads - 1) / nthreads,
+                            copy_range, &a);
+}
+
+
 /* Copies data from nested pointer to pointers array \a src to the
    flat continuous C-ordered array \a dst. The size of dest must be
-   sufficient large.  Returns non-zero on error. */
+   sufficient large.  Returns non-zero on error.
+
+   All but the innermost level of \a src are arrays of pointers to the
+   next level, while the innermost level consists of contiguous rows
+   of elements. */
 int dlite_copy_to_flat(void *dst, const void *src, size_t size,
                        size_t ndims, const size_t *dims)
 {
-  int i, n=0, ntot=1, retval=1, *ind=NULL;
-  char *q=dst;
-  void **p=(void **)src;
-
-  if (!(ind = calloc(ndims, sizeof(int)))) FAIL("allocation failure");
-
-  for (i=0; i<(int)ndims-1; i++) p = p[ind[i]];
-  for (i=0; i<(int)ndims; i++) ntot *= (dims) ? (int)dims[i] : 1;
-
-  while (n++ < ntot) {
-    memcpy(q, *p, size);
-    p++;
-    q += size;
-    if (++ind[ndims-1] >= ((dims) ? (int)dims[ndims-1] : 1)) {
-      ind[ndims-1] = 0;
-      for (i=ndims-2; i>=0; i--) {
-        if (++ind[i] < ((dims) ? (int)dims[i] : i))
-          break;
-        else
-          ind[i] = 0;
-      }
-      for (i=0, p=(void **)src; i<(int)ndims-1; i++) p = p[ind[i]];
-    }
-  }
-  retval = 0;
- fail:
-  if (ind) free(ind);
-  return retval;
+  return copy_nested(dst, (void *)src, size, ndims, dims, 1);
 }
 
 
-/* Copies data from flat continuous C-ordered array \a dst to nested
-   pointer to pointers array \a src. The size of dest must be
+/* Copies data from flat continuous C-ordered array \a src to nested
+   pointer to pointers array \a dst. The size of dest must be
    sufficient large.  Returns non-zero on error. */
 int dlite_copy_to_nested(void *dst, const void *src, size_t size,
                          size_t ndims, const size_t *dims)
 {
-  int i, n=0, ntot=1, *ind=NULL, retval=1;
-  const char *q=src;
-  void **p=dst;
-
-  if (!(ind = calloc(ndims, sizeof(int)))) FAIL("allocation failure");
-
-  for (i=0; i<(int)ndims-1; i++) p = p[ind[i]];
-  for (i=0; i<(int)ndims; i++) ntot *= (dims) ? (int)dims[i] : 1;
-
-  while (n++ < ntot) {
-    memcpy(*p, q, size);
-    p++;
-    q += size;
-    if (++ind[ndims-1] >= ((dims) ? (int)dims[ndims-1] : 1)) {
-      ind[ndims-1] = 0;
-      for (i=ndims-2; i>=0; i--) {
-        if (++ind[i] < ((dims) ? (int)dims[i] : i))
-          break;
-        else
-          ind[i] = 0;
-      }
-      for (i=0, p=(void **)src; i<(int)ndims-1; i++) p = p[ind[i]];
-    }
+  return copy_nested((char *)src, dst, size, ndims, dims, 0);
+}
+
+
+/* Returns a new zero-initialised nested pointer to pointers array with
+   dimensions \a dims and elements of size \a size.  The pointer tables
+   and the data are allocated in one block, that should be released
+   with free().  Returns NULL on error. */
+void *dlite_nested_alloc(size_t size, size_t ndims, const size_t *dims)
+{
+  size_t i, j, n=1, nptrs=0, offset;
+  void **p, **q;
+  char *buf, *data;
+
+  for (i=0; i+1<ndims; i++) {
+    n *= dims[i];
+    nptrs += n;
   }
-  retval = 0;
- fail:
-  if (ind) free(ind);
-  return retval;
+  if (ndims) n *= dims[ndims-1];
+
+  /* Keep the data aligned for any primitive type */
+  offset = (nptrs*sizeof(void *) + 15) & ~(size_t)15;
+  if (!(buf = calloc(1, offset + n*size + 1)))
+    return err(dliteMemoryError, "allocation failure"), NULL;
+  data = buf + offset;
+
+  /* Let each pointer table point into the next level */
+  p = (void **)buf;
+  for (i=0, n=1; i+1<ndims; i++) {
+    n *= dims[i];
+    q = p + n;
+    for (j=0; j<n; j++)
+      p[j] = (i+2 < ndims) ? (void *)(q + j*dims[i+1]) :
+        (void *)(data + j*dims[i+1]*size);
+    p = q;
+  }
+  return buf;
 }
@@ -145,6 +145,43 @@ int dlite_datamodel_has_dimension(DLiteDataModel *d, const char *name);
  */
 int dlite_datamodel_has_property(DLiteDataModel *d, const char *name);
 
+/**
+  Writes the memory pointed to by `ptr` to a block of property `name`
+  with dimensions `dims`.
+
+  `offsets` and `counts` are arrays of length `ndims` with the index of
+  the first element of the block and its number of elements along each
+  dimension.  The elements of the block are read in C order from `ptr`.
+
+  Returns non-zero on error (e.g. if this function isn't supported by
+  the plugin).
+ */
+int dlite_datamodel_set_property_slice(DLiteDataModel *d, const char *name,
+                                       const void *ptr, DLiteType type,
+                                       size_t size, size_t ndims,
+                                       const size_t *dims,
+                                       const size_t *offsets,
+                                       const size_t *counts);
+
+/**
+  Copies a slice of property `name` to memory pointed to by `ptr`.
+
+  `offsets`, `counts` and `strides` are arrays of length `ndims` with
+  the index of the first element, the number of elements and the step
+  between elements along each dimension.  If `strides` is NULL, a step
+  of one is assumed.  The selected elements are written continuously
+  in C order to `ptr`.
+
+  Returns non-zero on error (e.g. if this function isn't supported by
+  the plugin).
+ */
+int dlite_datamodel_get_property_slice(const DLiteDataModel *d,
+                                       const char *name, void *ptr,
+                                       DLiteType type, size_t size,
+                                       size_t ndims, const size_t *offsets,
+                                       const size_t *counts,
+                                       const size_t *strides);
+
 /**
    If the uuid was generated from a unique name, return a pointer to a
    newly malloc'ed string with this name.  Otherwise NULL is returned.
@@ -166,6 +203,13 @@ char *dlite_datamodel_get_dataname(DLiteDataModel *d);
    Copies data from nested pointer to pointers array `src` to the
    flat continuous C-ordered array `dst`. The size of dest must be
    sufficient large.  Returns non-zero on error.
+
+   All but the innermost level of `src` are arrays of pointers to the
+   next level, while the innermost level consists of contiguous rows
+   of elements that are copied with memcpy().  For large arrays, chunks
+   of the outermost dimension are copied concurrently.  The number of
+   threads defaults to the number of CPUs and can be limited with the
+   environment variable `DLITE_COPY_THREADS`.
 */
 int dlite_copy_to_flat(void *dst, const void *src, size_t size,
                        size_t ndims, const size_t *dims);
@@ -178,6 +222,17 @@ int dlite_copy_to_flat(void *dst, const void *src, size_t size,
 int dlite_copy_to_nested(void *dst, const void *src, size_t size,
                          size_t ndims, const size_t *dims);
 
+/**
+   Returns a new zero-initialised nested pointer to pointers array with
+   dimensions `dims` and elements of size `size`, as used by
+   dlite_copy_to_flat() and dlite_copy_to_nested().
+
+   The pointer tables and the data are allocated in a single block,
+   which should be released with free().  The data are contiguous in C
+   order.  Returns NULL on error.
+*/
+void *dlite_nested_alloc(size_t size, size_t ndims, const size_t *dims);
+
 /** @} */
 
 
@@ -0,0 +1,456 @@
+/* dlite-device.c -- property arrays in pinned host memory and device memory
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/thread.h"
+#include "dlite-misc.h"
+#include "dlite-type.h"
+#include "dlite-entity.h"
+#include "dlite-device.h"
+
+#define GLOBALS_ID "dlite-device-id"
+
+/* Size of the header before each pinned allocation.  Also the
+   alignment of the returned memory. */
+#define PINNED_HEADER 64
+
+/* States of a device copy */
+#define DEVICE_SYNCED      0   /* host and device copies are equal */
+#define DEVICE_HOST_NEWER  1   /* host array may be modified */
+#define DEVICE_NEWER       2   /* device copy may be modified */
+
+
+/* Header before each pinned allocation */
+typedef struct {
+  size_t size;                        /* requested size */
+  const DLiteDeviceBackend *backend;  /* allocating backend, NULL if
+                                         allocated with malloc() */
+} Header;
+
+/* Device copy of a property array */
+typedef struct {
+  void *ptr;                /* device memory, NULL if not allocated */
+  size_t nbytes;            /* size of device memory */
+  int state;                /* DEVICE_SYNCED, DEVICE_HOST_NEWER or
+                               DEVICE_NEWER */
+} DeviceCopy;
+
+/* Device copies of an instance */
+typedef struct {
+  const DLiteDeviceBackend *backend;  /* backend allocating the copies */
+  size_t nprops;                      /* number of properties */
+  DeviceCopy copies[];                /* device copy of each property */
+} DeviceState;
+
+typedef map_t(DeviceState *) device_map_t;
+
+/* Global variables for this module */
+typedef struct {
+  ThreadMutex mutex;        /* protects `map` */
+  device_map_t map;         /* maps instance uuids to their state */
+} Globals;
+
+
+static const DLiteDeviceBackend *_backend=NULL;
+static ThreadMutex device_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Frees global state for this module - called by atexit().  Device
+   memory is not free'ed, since the backend may be unloaded at this
+   point. */
+static void free_globals(void *globals)
+{
+  Globals *g = globals;
+  const char *uuid;
+  map_iter_t iter = map_iter(&g->map);
+  while ((uuid = map_next(&g->map, &iter))) {
+    DeviceState **q = map_peek(&g->map, uuid);
+    if (q && *q) free(*q);
+  }
+  map_deinit(&g->map);
+  thread_mutex_destroy(&g->mutex);
+  free(g);
+}
+
+/* Return a pointer to global state for this module */
+static Globals *get_globals(void)
+{
+  Globals *g = dlite_globals_get_state(GLOBALS_ID);
+  if (!g) {
+    thread_mutex_lock(&device_mutex);
+    if (!(g = dlite_globals_get_state(GLOBALS_ID))) {
+      if ((g = calloc(1, sizeof(Globals)))) {
+        thread_mutex_init(&g->mutex);
+        map_init(&g->map);
+        dlite_globals_add_state(GLOBALS_ID, g, free_globals);
+      }
+    }
+    thread_mutex_unlock(&device_mutex);
+    if (!g) return err(1, "allocation failure"), NULL;
+  }
+  return g;
+}
+
+
+/********************************************************************
+ * Pinned allocator
+ ********************************************************************/
+
+static void *pinned_alloc(size_t size, int zero)
+{
+  const DLiteDeviceBackend *b = dlite_device_get_backend();
+  Header *h;
+  if (size > (size_t)-1 - PINNED_HEADER) return NULL;
+  if (b && b->host_alloc) {
+    if (!(h = b->host_alloc(size + PINNED_HEADER, b->data))) return NULL;
+    if (zero) memset(h, 0, size + PINNED_HEADER);
+  } else {
+    b = NULL;
+    if (!(h = (zero) ? calloc(1, size + PINNED_HEADER) :
+          malloc(size + PINNED_HEADER))) return NULL;
+  }
+  h->size = size;
+  h->backend = b;
+  return (char *)h + PINNED_HEADER;
+}
+
+static void pinned_free(void *ptr, void *data)
+{
+  Header *h = (Header *)((char *)ptr - PINNED_HEADER);
+  (void)data;
+  if (!ptr) return;
+  if (h->backend)
+    h->backend->host_free(h, h->backend->data);
+  else
+    free(h);
+}
+
+static void *pinned_malloc(size_t size, void *data)
+{
+  (void)data;
+  return pinned_alloc(size, 0);
+}
+
+static void *pinned_calloc(size_t nmemb, size_t size, void *data)
+{
+  (void)data;
+  if (size && nmemb > (size_t)-1 / size) return NULL;
+  return pinned_alloc(nmemb * size, 1);
+}
+
+static void *pinned_realloc(void *ptr, size_t size, void *data)
+{
+  Header *h = (Header *)((char *)ptr - PINNED_HEADER);
+  void *q;
+  if (!ptr) return pinned_alloc(size, 0);
+  if (size <= h->size) {
+    h->size = size;
+    return ptr;
+  }
+  if (!(q = pinned_alloc(size, 0))) return NULL;
+  memcpy(q, ptr, h->size);
+  pinned_free(ptr, data);
+  return q;
+}
+
+static DLiteAllocator pinned_allocator = {
+  pinned_malloc, pinned_calloc, pinned_realloc, pinned_free, NULL
+};
+
+
+/********************************************************************
+ * Device copies
+ ********************************************************************/
+
+/* Stores the host array of property `i` of `inst` and its size in
+   `*ptr` and `*nbytes`.  Returns non-zero if the property cannot have
+   a device copy. */
+static int host_array(const DLiteInstance *inst, size_t i, void **ptr,
+                      size_t *nbytes)
+{
+  const DLiteProperty *p = inst->meta->_properties + i;
+  size_t nmemb=1;
+  int j;
+  if (p->ndims <= 0 || dlite_type_is_allocated(p->type))
+    return errx(1, "property '%s' of %s cannot have a device copy",
+                p->name, inst->uuid);
+  for (j=0; j<p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+  *ptr = *(void **)DLITE_PROP(inst, i);
+  *nbytes = (*ptr) ? nmemb * p->size : 0;
+  return 0;
+}
+
+/* Copies the device copy `c` of property `i` of `inst` back to the
+   host if it may have been modified.  Must be called with the lock
+   held.  Returns non-zero on error. */
+static int download(DLiteInstance *inst, size_t i, DeviceState *state,
+                    DeviceCopy *c)
+{
+  const DLiteDeviceBackend *b = state->backend;
+  size_t nbytes;
+  void *ptr;
+  if (c->state != DEVICE_NEWER) return 0;
+  ptr = *(void **)DLITE_PROP(inst, i);
+  nbytes = (ptr) ? c->nbytes : 0;
+  if (nbytes && b->to_host(ptr, c->ptr, nbytes, b->data))
+    return errx(1, "cannot copy property '%s' of %s from device",
+                inst->meta->_properties[i].name, inst->uuid);
+  c->state = DEVICE_SYNCED;
+  return 0;
+}
+
+/* Frees all device copies in `state`. */
+static void free_copies(DeviceState *state)
+{
+  const DLiteDeviceBackend *b = state->backend;
+  size_t i;
+  for (i=0; i < state->nprops; i++)
+    if (state->copies[i].ptr) b->device_free(state->copies[i].ptr, b->data);
+}
+
+
+/********************************************************************
+ * Public api
+ ********************************************************************/
+
+/*
+  Sets the device backend.  Returns non-zero on error.
+ */
+int dlite_device_set_backend(const DLiteDeviceBackend *backend)
+{
+  if (backend && (!backend->device_alloc || !backend->device_free ||
+                  !backend->to_device || !backend->to_host))
+    return errx(1, "device backend must provide device_alloc, device_free, "
+                "to_device and to_host");
+  if (backend && backend->host_alloc && !backend->host_free)
+    return errx(1, "device backend with host_alloc must provide host_free");
+  thread_mutex_lock(&device_mutex);
+  _backend = backend;
+  thread_mutex_unlock(&device_mutex);
+  return 0;
+}
+
+/*
+  Returns the device backend or NULL if no backend is set.
+ */
+const DLiteDeviceBackend *dlite_device_get_backend(void)
+{
+  const DLiteDeviceBackend *b;
+  thread_mutex_lock(&device_mutex);
+  b = _backend;
+  thread_mutex_unlock(&device_mutex);
+  return b;
+}
+
+/*
+  Returns an allocator of pinned host memory.
+ */
+const DLiteAllocator *dlite_device_pinned_allocator(void)
+{
+  return &pinned_allocator;
+}
+
+/*
+  Sets the allocator for new instances in the current globals
+  according to `space`.  Returns non-zero on error.
+ */
+int dlite_device_set_memspace(DLiteMemSpace space)
+{
+  switch (space) {
+  case dliteMemHost:
+    dlite_instance_set_allocator(NULL);
+    return 0;
+  case dliteMemPinned:
+    dlite_instance_set_allocator(&pinned_allocator);
+    return 0;
+  case dliteMemDevice:
+    return errx(1, "property arrays cannot be allocated in device memory, "
+                "use dlite_device_get_property() to get device copies");
+  }
+  return errx(1, "invalid memory space: %d", space);
+}
+
+/*
+  Returns the memory space of the current copy of property `i` of
+  `inst`.
+ */
+DLiteMemSpace dlite_device_memspace(const DLiteInstance *inst, size_t i)
+{
+  DLiteMemSpace space = (dlite_instance_allocator(inst) == &pinned_allocator) ?
+    dliteMemPinned : dliteMemHost;
+  Globals *g;
+  DeviceState **q;
+  if (!(inst->_flags & dliteFlagDevice) ||
+      !(g = dlite_globals_get_state(GLOBALS_ID))) return space;
+  thread_mutex_lock(&g->mutex);
+  if ((q = map_peek(&g->map, inst->uuid)) && *q && i < (*q)->nprops &&
+      (*q)->copies[i].state == DEVICE_NEWER)
+    space = dliteMemDevice;
+  thread_mutex_unlock(&g->mutex);
+  return space;
+}
+
+/*
+  Returns a pointer to a device copy of property `i` of `inst`.
+  Returns NULL on error.
+ */
+void *dlite_device_get_property(DLiteInstance *inst, size_t i,
+                                DLiteDeviceAccess mode)
+{
+  const DLiteDeviceBackend *b;
+  DeviceState **q, *state=NULL;
+  DeviceCopy *c;
+  Globals *g;
+  size_t nbytes;
+  void *host, *retval=NULL;
+
+  if (i >= inst->meta->_nproperties)
+    return errx(1, "index %d exceeds number of properties (%d) in %s",
+                (int)i, (int)inst->meta->_nproperties, inst->meta->uri), NULL;
+  if (!(mode & dliteDeviceReadWrite))
+    return errx(1, "invalid device access mode: %d", mode), NULL;
+  if ((mode & dliteDeviceWrite) && (inst->_flags & dliteFlagFrozen))
+    return errx(1, "cannot write to frozen instance: %s", inst->uuid), NULL;
+  if (!(b = dlite_device_get_backend()))
+    return errx(1, "no device backend is set"), NULL;
+  if (dlite_instance_load_property(inst, i)) return NULL;
+  if (host_array(inst, i, &host, &nbytes)) return NULL;
+  if (!nbytes)
+    return errx(1, "property '%s' of %s has no data",
+                inst->meta->_properties[i].name, inst->uuid), NULL;
+  if (!(g = get_globals())) return NULL;
+
+  thread_mutex_lock(&g->mutex);
+  if ((q = map_peek(&g->map, inst->uuid)) && *q) {
+    state = *q;
+    if (state->backend != b) {
+      errx(1, "device copies of %s belong to another backend", inst->uuid);
+      goto fail;
+    }
+  } else {
+    size_t nprops = inst->meta->_nproperties;
+    if (!(state = calloc(1, sizeof(DeviceState) +
+                         nprops * sizeof(DeviceCopy)))) {
+      err(1, "allocation failure");
+      goto fail;
+    }
+    state->backend = b;
+    state->nprops = nprops;
+    if (map_set(&g->map, inst->uuid, state)) {
+      free(state);
+      state = NULL;
+      err(1, "cannot add device copies of %s", inst->uuid);
+      goto fail;
+    }
+    inst->_flags |= dliteFlagDevice;
+  }
+
+  c = state->copies + i;
+  if (c->ptr && c->nbytes != nbytes) {
+    /* the dimensions have changed */
+    b->device_free(c->ptr, b->data);
+    c->ptr = NULL;
+  }
+  if (!c->ptr) {
+    if (!(c->ptr = b->device_alloc(nbytes, b->data))) {
+      err(1, "cannot allocate %lu bytes of device memory",
+          (unsigned long)nbytes);
+      goto fail;
+    }
+    c->nbytes = nbytes;
+    c->state = DEVICE_HOST_NEWER;
+  }
+  if ((mode & dliteDeviceRead) && c->state == DEVICE_HOST_NEWER) {
+    if (b->to_device(c->ptr, host, nbytes, b->data)) {
+      errx(1, "cannot copy property '%s' of %s to device",
+           inst->meta->_properties[i].name, inst->uuid);
+      goto fail;
+    }
+    c->state = DEVICE_SYNCED;
+  }
+  if (mode & dliteDeviceWrite) c->state = DEVICE_NEWER;
+  retval = c->ptr;
+ fail:
+  thread_mutex_unlock(&g->mutex);
+  return retval;
+}
+
+/*
+  Copies property `i` of `inst` back to the host if its device copy
+  may have been modified.  Returns non-zero on error.
+ */
+int dlite_device_sync_property(DLiteInstance *inst, size_t i, int write)
+{
+  Globals *g;
+  DeviceState **q;
+  int retval=0;
+  if (!(inst->_flags & dliteFlagDevice) ||
+      !(g = dlite_globals_get_state(GLOBALS_ID))) return 0;
+  thread_mutex_lock(&g->mutex);
+  if ((q = map_peek(&g->map, inst->uuid)) && *q && i < (*q)->nprops) {
+    DeviceCopy *c = (*q)->copies + i;
+    retval = download(inst, i, *q, c);
+    if (!retval && write && c->ptr) c->state = DEVICE_HOST_NEWER;
+  }
+  thread_mutex_unlock(&g->mutex);
+  return retval;
+}
+
+/*
+  Copies all device copies of `inst` that may have been modified back
+  to the host.  Returns non-zero on error.
+ */
+int dlite_device_sync(DLiteInstance *inst)
+{
+  Globals *g;
+  DeviceState **q;
+  size_t i;
+  int retval=0;
+  if (!(inst->_flags & dliteFlagDevice) ||
+      !(g = dlite_globals_get_state(GLOBALS_ID))) return 0;
+  thread_mutex_lock(&g->mutex);
+  if ((q = map_peek(&g->map, inst->uuid)) && *q)
+    for (i=0; i < (*q)->nprops && !retval; i++)
+      retval = download(inst, i, *q, (*q)->copies + i);
+  thread_mutex_unlock(&g->mutex);
+  return retval;
+}
+
+/*
+  Copies the modified device copies of `inst` back to the host and
+  frees all its device copies.  Returns non-zero on error.
+ */
+int dlite_device_release(DLiteInstance *inst)
+{
+  if (dlite_device_sync(inst)) return 1;
+  dlite_device_forget(inst);
+  return 0;
+}
+
+/*
+  Frees the device copies of `inst` without copying them back.
+ */
+void dlite_device_forget(DLiteInstance *inst)
+{
+  Globals *g;
+  DeviceState **q;
+  if (!(inst->_flags & dliteFlagDevice) ||
+      !(g = dlite_globals_get_state(GLOBALS_ID))) return;
+  thread_mutex_lock(&g->mutex);
+  if ((q = map_peek(&g->map, inst->uuid)) && *q) {
+    DeviceState *state = *q;
+    map_remove(&g->map, inst->uuid);
+    free_copies(state);
+    free(state);
+  }
+  inst->_flags &= ~dliteFlagDevice;
+  thread_mutex_unlock(&g->mutex);
+}
@@ -0,0 +1,165 @@
+#ifndef _DLITE_DEVICE_H
+#define _DLITE_DEVICE_H
+
+/**
+  @file
+  @brief Property arrays in pinned host memory and device memory
+
+  Applications feeding property arrays to GPU kernels otherwise copy
+  them from pageable host memory to the device after every load.  This
+  module lets property arrays live in one of three memory spaces:
+
+    - host: pageable memory from the instance allocator (default)
+    - pinned: page-locked host memory, which the device can transfer
+      with DMA.  Set dlite_device_set_memspace(dliteMemPinned) before
+      loading instances to load their arrays directly into it.
+    - device: a device copy of a property array, returned by
+      dlite_device_get_property().
+
+  DLite does not link to CUDA, HIP or any other runtime.  The
+  application registers a backend with functions allocating pinned
+  and device memory and copying between them, see
+  dlite_device_set_backend().
+
+  Instances with device copies are marked with dliteFlagDevice.  The
+  host array remains the authoritative copy for DLite.  A device copy
+  that may have been written to by a kernel is lazily copied back to
+  the host when the property is accessed with
+  dlite_instance_get_property() and friends, or when the instance is
+  saved or copied.  Accessing the property from the host in turn makes
+  the next dlite_device_get_property() upload it again.  Call
+  dlite_device_sync() before accessing the arrays directly with
+  DLITE_PROP().
+
+  Only dimensional properties of types that are not allocated (i.e.
+  not strings, references or properties) may have device copies.
+ */
+
+#include "dlite-entity.h"
+
+
+/** Memory spaces */
+typedef enum {
+  dliteMemHost,     /*!< Pageable host memory. */
+  dliteMemPinned,   /*!< Page-locked host memory. */
+  dliteMemDevice    /*!< Device memory. */
+} DLiteMemSpace;
+
+/** Access modes for dlite_device_get_property(). */
+typedef enum {
+  dliteDeviceRead=1,       /*!< The kernel reads the array. */
+  dliteDeviceWrite=2,      /*!< The kernel writes the array. */
+  dliteDeviceReadWrite=3   /*!< The kernel reads and writes the array. */
+} DLiteDeviceAccess;
+
+/**
+  Device runtime backend, e.g. wrapping cudaMallocHost(),
+  cudaMalloc() and cudaMemcpy().
+
+  All functions are passed `data` as their last argument.
+  `device_alloc`, `device_free`, `to_device` and `to_host` are
+  required.  If `host_alloc` is NULL, pinned memory is allocated with
+  malloc(), i.e. it is not page-locked.  The copy functions should
+  return non-zero on error.
+ */
+typedef struct _DLiteDeviceBackend {
+  const char *name;   /*!< Name of the backend, like "cuda". */
+  void *(*host_alloc)(size_t size, void *data);
+  void (*host_free)(void *ptr, void *data);
+  void *(*device_alloc)(size_t size, void *data);
+  void (*device_free)(void *ptr, void *data);
+  int (*to_device)(void *dst, const void *src, size_t size, void *data);
+  int (*to_host)(void *dst, const void *src, size_t size, void *data);
+  void *data;         /*!< Backend state passed to the functions. */
+} DLiteDeviceBackend;
+
+
+/**
+  Sets the device backend.  The backend is process-wide, not copied
+  and must outlive all instances with pinned or device memory.  If
+  `backend` is NULL, the backend is unset.
+
+  Returns non-zero on error.
+ */
+int dlite_device_set_backend(const DLiteDeviceBackend *backend);
+
+/**
+  Returns the device backend or NULL if no backend is set.
+ */
+const DLiteDeviceBackend *dlite_device_get_backend(void);
+
+/**
+  Returns an allocator of pinned host memory.  The returned allocator
+  is static and may be passed to dlite_instance_set_allocator().
+ */
+const DLiteAllocator *dlite_device_pinned_allocator(void);
+
+/**
+  Convenience function that sets the allocator for new instances in
+  the current globals according to `space`, i.e. the standard
+  allocator for `dliteMemHost` and the pinned allocator for
+  `dliteMemPinned`.  Property arrays cannot be allocated in device
+  memory, since DLite reads them from the host.
+
+  Returns non-zero on error.
+ */
+int dlite_device_set_memspace(DLiteMemSpace space);
+
+/**
+  Returns the memory space of the current copy of property `i` of
+  `inst`: `dliteMemDevice` if the device copy may have been modified
+  since it was copied back, otherwise `dliteMemPinned` if the instance
+  is allocated with the pinned allocator, else `dliteMemHost`.
+ */
+DLiteMemSpace dlite_device_memspace(const DLiteInstance *inst, size_t i);
+
+/**
+  Returns a pointer to a device copy of property `i` of `inst`.  The
+  device copy is allocated on first call and is updated from the host
+  array if `mode` includes `dliteDeviceRead` and the host array may
+  have been modified since the last upload.  If `mode` includes
+  `dliteDeviceWrite`, the device copy is copied back to the host
+  before the property is accessed from the host next time.
+
+  The returned pointer is valid until the dimensions of `inst` are
+  changed, dlite_device_release() is called or `inst` is free'ed.
+
+  Returns NULL on error.
+ */
+void *dlite_device_get_property(DLiteInstance *inst, size_t i,
+                                DLiteDeviceAccess mode);
+
+/**
+  Copies all device copies of `inst` that may have been modified back
+  to the host.  This is a no-op for instances without device copies.
+
+  Returns non-zero on error.
+ */
+int dlite_device_sync(DLiteInstance *inst);
+
+/**
+  Copies the modified device copies of `inst` back to the host and
+  frees all its device copies.
+
+  Returns non-zero on error.
+ */
+int dlite_device_release(DLiteInstance *inst);
+
+/**
+  Copies property `i` of `inst` back to the host if its device copy
+  may have been modified.  If `write` is non-zero, the host array is
+  assumed to be modified afterwards.  Called by the instance api
+  before property `i` is accessed.  Intended for internal use.
+
+  Returns non-zero on error.
+ */
+int dlite_device_sync_property(DLiteInstance *inst, size_t i, int write);
+
+/**
+  Frees the device copies of `inst` without copying them back.
+  Called when `inst` is free'ed.  Intended for internal use.
+ */
+void dlite_device_forget(DLiteInstance *inst);
+
+
+#endif /* _DLITE_DEVICE_H */
@@ -5,11 +5,18 @@
 #include <ctype.h>
 
 #include "utils/compat.h"
+#include "utils/byteorder.h"
 #include "utils/err.h"
 #include "utils/map.h"
+#include "utils/md5.h"
+#include "utils/omap.h"
+#include "utils/scratch.h"
 #include "utils/fileutils.h"
 #include "utils/infixcalc.h"
 #include "utils/jsmnx.h"
+#include "utils/thread.h"
+#include "utils/trace.h"
+#include "utils/uuid4.h"
 
 #include "dlite.h"
 #include "dlite-macros.h"
@@ -19,6 +26,14 @@
 #include "dlite-entity.h"
 #include "dlite-datamodel.h"
 #include "dlite-schemas.h"
+#include "dlite-storage-index.h"
+#include "dlite-stats.h"
+#include "dlite-record.h"
+#include "dlite-metacache.h"
+#include "dlite-device.h"
+#include "dlite-json.h"
+#include "dlite-notify.h"
+#include "dlite-bloom.h"
 
 #ifdef min
 #undef min
@@ -33,7 +48,8 @@
 /* Forward declerations */
 int dlite_meta_init(DLiteMeta *meta);
 DLiteInstance *_instance_load_casted(const DLiteStorage *s, const char *id,
-                                     const char *metaid, int lookup);
+                                     const char *metaid, int lookup,
+                                     int lazy);
 
 
 
@@ -51,38 +67,86 @@ DLiteInstance *_instance_load_casted(const DLiteStorage *s, const char *id,
  *  the refcount hold by the instance store.
  ********************************************************************/
 
-typedef map_t(DLiteInstance *) instance_map_t;
+/* The instance store is hit on every instance lookup, so it uses the
+   open-addressing map with uuids stored inline. */
+typedef omap_t(DLiteInstance *) instance_map_t;
+
+/* Number of shards in the instance store.  Must be 16, since the shard
+   is selected from the first hex digit of the uuid. */
+#define INSTANCE_STORE_NSHARDS 16
+
+/* A shard of the instance store, protected by its own read-write lock. */
+typedef struct {
+  ThreadRWLock lock;
+  instance_map_t map;
+} InstanceShard;
+
+/* The instance store.  Instances are distributed over the shards
+   based on their uuid, such that threads working on different
+   instances mostly don't contend for the same lock. */
+typedef struct {
+  InstanceShard shards[INSTANCE_STORE_NSHARDS];
+} InstanceStore;
+
+/* Serialises creation of the instance store. */
+static ThreadMutex _instance_store_mutex = THREAD_MUTEX_INITIALIZER;
 
 /* Forward declarations */
-static instance_map_t *_instance_store(void);
+static InstanceStore *_instance_store(void);
 static void _instance_store_free(void *instance_store);
 static int _instance_store_add(const DLiteInstance *inst);
-static int _instance_store_remove(const char *id);
+static int _instance_store_add_many(DLiteInstance **insts, size_t n,
+                                    int *status);
+static int _instance_store_remove(const DLiteInstance *inst);
 static DLiteInstance *_instance_store_get(const char *id);
+static DLiteInstance *_instance_store_get_ref(const char *id);
 
 
+/* Returns the shard that `uuid` belongs to. */
+static InstanceShard *_instance_store_shard(InstanceStore *istore,
+                                            const char *uuid)
+{
+  int c = tolower(uuid[0]);
+  int n = (c >= 'a' && c <= 'f') ? c - 'a' + 10 : c - '0';
+  return istore->shards + (n & (INSTANCE_STORE_NSHARDS - 1));
+}
+
 /* Help function for adding metadata */
-static void _instance_store_addmeta(instance_map_t *istore,
+static void _instance_store_addmeta(InstanceStore *istore,
                                     const DLiteMeta *meta)
 {
-  int stat = map_set(istore, meta->uuid, (DLiteInstance *)meta);
+  InstanceShard *shard = _instance_store_shard(istore, meta->uuid);
+  int stat = omap_set(&shard->map, meta->uuid, (DLiteInstance *)meta);
   assert(stat == 0);
+  (void)stat;
   dlite_instance_incref((DLiteInstance *)meta);
 }
 
 /* Returns pointer to instance store. */
-static instance_map_t *_instance_store(void)
+static InstanceStore *_instance_store(void)
 {
-  instance_map_t *istore = dlite_globals_get_state("dlite-instance-store");
+  InstanceStore *istore = dlite_globals_get_state("dlite-instance-store");
   if (!istore) {
-    if (!(istore = malloc(sizeof(instance_map_t))))
+    int i;
+    thread_mutex_lock(&_instance_store_mutex);
+    if ((istore = dlite_globals_get_state("dlite-instance-store"))) {
+      thread_mutex_unlock(&_instance_store_mutex);
+      return istore;
+    }
+    if (!(istore = malloc(sizeof(InstanceStore)))) {
+      thread_mutex_unlock(&_instance_store_mutex);
       return err(1, "allocation failure"), NULL;
-    map_init(istore);
+    }
+    for (i=0; i<INSTANCE_STORE_NSHARDS; i++) {
+      thread_rwlock_init(&istore->shards[i].lock);
+      omap_init(&istore->shards[i].map);
+    }
     _instance_store_addmeta(istore, dlite_get_basic_metadata_schema());
     _instance_store_addmeta(istore, dlite_get_entity_schema());
     _instance_store_addmeta(istore, dlite_get_collection_entity());
     dlite_globals_add_state("dlite-instance-store", istore,
                             _instance_store_free);
+    thread_mutex_unlock(&_instance_store_mutex);
   }
   return istore;
 }
@@ -91,48 +155,79 @@ static instance_map_t *_instance_store(void)
    but can be called at any time. */
 static void _instance_store_free(void *instance_store)
 {
-  instance_map_t *istore = instance_store;
+  InstanceStore *istore = instance_store;
   const char *uuid;
-  map_iter_t iter;
+  omap_iter_t iter;
   DLiteInstance **del=NULL;
   int i, ndel=0, delsize=0;
   assert(istore);
 
   /* Remove all instances (to decrease the reference count for metadata) */
-  iter = map_iter(istore);
-  while ((uuid = map_next(istore, &iter))) {
-    DLiteInstance *inst, **q;
-    if ((q = map_get(istore, uuid)) && (inst = *q) &&
-        dlite_instance_is_meta(inst) && inst->_refcount > 0) {
-      if (delsize <= ndel) {
-        void *ptr;
-        delsize += 64;
-        if (!(ptr = realloc(del, delsize*sizeof(DLiteInstance *))))
-          free(del);
-        del = ptr;
+  for (i=0; i<INSTANCE_STORE_NSHARDS; i++) {
+    instance_map_t *map = &istore->shards[i].map;
+    thread_rwlock_rdlock(&istore->shards[i].lock);
+    iter = omap_iter(map);
+    while ((uuid = omap_next(map, &iter))) {
+      DLiteInstance *inst, **q;
+      if ((q = omap_peek(map, uuid)) && (inst = *q) &&
+          dlite_instance_is_meta(inst) && inst->_refcount > 0) {
+        if (delsize <= ndel) {
+          void *ptr;
+          delsize += 64;
+          if (!(ptr = realloc(del, delsize*sizeof(DLiteInstance *))))
+            free(del);
+          del = ptr;
+        }
+        if (del) del[ndel++] = inst;
       }
-      if (del) del[ndel++] = inst;
     }
+    thread_rwlock_rdunlock(&istore->shards[i].lock);
   }
 
   if (del) {
     for (i=0; i<ndel; i++) dlite_instance_decref(del[i]);
     free(del);
   }
-  map_deinit(istore);
+  for (i=0; i<INSTANCE_STORE_NSHARDS; i++) {
+    omap_deinit(&istore->shards[i].map);
+    thread_rwlock_destroy(&istore->shards[i].lock);
+  }
   free(istore);
 }
 
 /* Adds instance to global instance store.  Returns zero on success, 1
    if instance is already in the store and a negative number of other errors.
+
+   An instance in the store whos refcount has reached zero is about to
+   be free'ed and will be replaced by `inst`.
 */
 static int _instance_store_add(const DLiteInstance *inst)
 {
-  instance_map_t *istore = _instance_store();
-  assert(istore);
+  InstanceStore *istore = _instance_store();
+  InstanceShard *shard;
+  DLiteInstance **q;
+  int stat;
+  if (!istore) return -1;
   assert(inst);
-  if (map_get(istore, inst->uuid)) return 1;
-  map_set(istore, inst->uuid, (DLiteInstance *)inst);
+  shard = _instance_store_shard(istore, inst->uuid);
+
+  /* Most calls are for metadata that is already in the store, so
+     check with a read lock first */
+  thread_rwlock_rdlock(&shard->lock);
+  q = omap_peek(&shard->map, inst->uuid);
+  stat = (q && thread_atomic_load(&(*q)->_refcount) > 0);
+  thread_rwlock_rdunlock(&shard->lock);
+  if (stat) return 1;
+
+  thread_rwlock_wrlock(&shard->lock);
+  if ((q = omap_get(&shard->map, inst->uuid)) &&
+      thread_atomic_load(&(*q)->_refcount) > 0) {
+    thread_rwlock_wrunlock(&shard->lock);
+    return 1;
+  }
+  stat = omap_set(&shard->map, inst->uuid, (DLiteInstance *)inst);
+  thread_rwlock_wrunlock(&shard->lock);
+  if (stat) return err(-1, "cannot add %s to instance store", inst->uuid);
 
   /* Increase reference  count for metadata that is kept in the store */
   if (dlite_instance_is_meta(inst))
@@ -141,35 +236,365 @@ static int _instance_store_add(const DLiteInstance *inst)
   return 0;
 }
 
-/* Removes instance `uuid` from global instance store.  Returns non-zero
-   on error.*/
-static int _instance_store_remove(const char *uuid)
+/* Adds the `n` data instances in `insts` to the global instance store,
+   locking each shard only once.  The result of adding instance `i` is
+   written to `status[i]`, with the same meaning as the return value of
+   _instance_store_add().  Returns non-zero on error. */
+static int _instance_store_add_many(DLiteInstance **insts, size_t n,
+                                    int *status)
 {
-  instance_map_t *istore = _instance_store();
-  DLiteInstance *inst, **q;
-  assert(istore);
-  if (!(q = map_get(istore, uuid)))
-    return errx(-1, "cannot remove %s since it is not in store", uuid);
-  inst = *q;
-  map_remove(istore, uuid);
+  InstanceStore *istore = _instance_store();
+  size_t i, k;
+  if (!istore) return -1;
+  for (k=0; k<INSTANCE_STORE_NSHARDS; k++) {
+    InstanceShard *shard = istore->shards + k;
+    int locked=0;
+    for (i=0; i<n; i++) {
+      DLiteInstance **q;
+      assert(!dlite_instance_is_meta(insts[i]));
+      if (_instance_store_shard(istore, insts[i]->uuid) != shard) continue;
+      if (!locked) {
+        thread_rwlock_wrlock(&shard->lock);
+        locked = 1;
+      }
+      if ((q = omap_peek(&shard->map, insts[i]->uuid)) &&
+          thread_atomic_load(&(*q)->_refcount) > 0)
+        status[i] = 1;
+      else if (omap_set(&shard->map, insts[i]->uuid, insts[i]))
+        status[i] = err(-1, "cannot add %s to instance store",
+                        insts[i]->uuid);
+      else
+        status[i] = 0;
+    }
+    if (locked) thread_rwlock_wrunlock(&shard->lock);
+  }
+  return 0;
+}
+
+/* Removes instance `inst` from global instance store.  Returns non-zero
+   on error.
+
+   Nothing is done if the store maps the uuid of `inst` to another
+   instance, which happens if it has been replaced by
+   _instance_store_add(). */
+static int _instance_store_remove(const DLiteInstance *inst)
+{
+  InstanceStore *istore = _instance_store();
+  InstanceShard *shard;
+  DLiteInstance **q;
+  if (!istore) return -1;
+  shard = _instance_store_shard(istore, inst->uuid);
+  thread_rwlock_wrlock(&shard->lock);
+  if (!(q = omap_get(&shard->map, inst->uuid))) {
+    thread_rwlock_wrunlock(&shard->lock);
+    return errx(-1, "cannot remove %s since it is not in store", inst->uuid);
+  }
+  if (*q != inst) {
+    thread_rwlock_wrunlock(&shard->lock);
+    return 0;
+  }
+  omap_remove(&shard->map, inst->uuid);
+  thread_rwlock_wrunlock(&shard->lock);
 
   if (dlite_instance_is_meta(inst) && inst->_refcount > 0)
-    dlite_instance_decref(inst);
+    dlite_instance_decref((DLiteInstance *)inst);
   return 0;
 }
 
-/* Returns pointer to instance for id `id` or NULL if `id` cannot be found. */
-static DLiteInstance *_instance_store_get(const char *id)
+/* Help function for _instance_store_get() and _instance_store_get_ref().
+   If `incref` is true, the refcount of the returned instance is
+   increased while the store is locked.  Instances whos refcount has
+   reached zero are about to be free'ed and are not returned in this
+   case. */
+static DLiteInstance *_instance_store_lookup(const char *id, int incref)
 {
-  instance_map_t *istore = _instance_store();
+  InstanceStore *istore = _instance_store();
+  InstanceShard *shard;
   int uuidver;
   char uuid[DLITE_UUID_LENGTH+1];
-  DLiteInstance **instp;
+  DLiteInstance **instp, *inst=NULL;
+  if (!istore) return NULL;
   if ((uuidver = dlite_get_uuid(uuid, id)) != 0 && uuidver != 5)
     return errx(1, "id '%s' is neither a valid UUID or a convertable string",
                 id), NULL;
-  if (!(instp = map_get(istore, uuid))) return NULL;
-  return *instp;
+  shard = _instance_store_shard(istore, uuid);
+  thread_rwlock_rdlock(&shard->lock);
+  if ((instp = omap_peek(&shard->map, uuid))) {
+    inst = *instp;
+    if (incref && !(inst->_flags & dliteFlagImmortal)) {
+      int count;
+      do {
+        if ((count = thread_atomic_load(&inst->_refcount)) <= 0) {
+          inst = NULL;
+          break;
+        }
+      } while (!thread_atomic_cas(&inst->_refcount, count, count + 1));
+    }
+  }
+  thread_rwlock_rdunlock(&shard->lock);
+  dlite_stats_add((inst) ? dliteStatsStoreHits : dliteStatsStoreMisses, 1);
+  return inst;
+}
+
+/* Returns pointer to instance for id `id` or NULL if `id` cannot be found.
+   A borrowed reference is returned. */
+static DLiteInstance *_instance_store_get(const char *id)
+{
+  return _instance_store_lookup(id, 0);
+}
+
+/* Like _instance_store_get(), but returns a new reference.  Unlike
+   calling dlite_instance_incref() on the result of
+   _instance_store_get(), this is safe if another thread concurrently
+   releases the last reference to the instance. */
+static DLiteInstance *_instance_store_get_ref(const char *id)
+{
+  return _instance_store_lookup(id, 1);
+}
+
+
+
+/********************************************************************
+ *  Name index
+ *
+ *  Open-addressing hash tables mapping the dimension and property
+ *  names of a metadata to their indices.  The index is (re)build by
+ *  dlite_meta_init().  Since dimensions and properties may be assigned
+ *  after the index is build, it also records what it was build for.
+ *  Lookups fall back to a linear search if the index is missing or
+ *  outdated.
+ ********************************************************************/
+
+struct _DLiteNameIndex {
+  const DLiteDimension *dimensions; /* Dimensions the index is build for. */
+  const DLiteProperty *properties;  /* Properties the index is build for. */
+  size_t ndimensions;               /* Number of indexed dimensions. */
+  size_t nproperties;               /* Number of indexed properties. */
+  size_t dimmask;                   /* Length of `dimslots` minus one. */
+  size_t propmask;                  /* Length of `propslots` minus one. */
+  int *dimslots;                    /* Dimension index plus one or zero. */
+  int *propslots;                   /* Property index plus one or zero. */
+};
+
+/* Returns FNV-1a hash of `name`. */
+static size_t _nameindex_hash(const char *name)
+{
+  size_t hash = 2166136261u;
+  while (*name) {
+    hash ^= (unsigned char)*name++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* Returns the smallest power of two larger than `2*n`. */
+static size_t _nameindex_tablesize(size_t n)
+{
+  size_t size = 2;
+  while (size < 2*n) size <<= 1;
+  return size;
+}
+
+/* Inserts the `n` names in `arr` into `slots`.  The elements of `arr`
+   has size `stride` and must start with a `char *name` field (like
+   DLiteDimension and DLiteProperty).  Returns non-zero if any name is
+   NULL. */
+static int _nameindex_fill(int *slots, size_t mask, const void *arr,
+                           size_t n, size_t stride)
+{
+  size_t i;
+  for (i=0; i<n; i++) {
+    const char *name = *(char **)((char *)arr + i*stride);
+    size_t j;
+    if (!name) return 1;
+    j = _nameindex_hash(name) & mask;
+    while (slots[j]) j = (j + 1) & mask;
+    slots[j] = i + 1;
+  }
+  return 0;
+}
+
+/* Returns the index of `name` in `arr` using the hash table `slots`
+   or -1 if `name` is not in the table. */
+static int _nameindex_get(const int *slots, size_t mask, const void *arr,
+                          size_t stride, const char *name)
+{
+  size_t j = _nameindex_hash(name) & mask;
+  while (slots[j]) {
+    int i = slots[j] - 1;
+    if (strcmp(*(char **)((char *)arr + i*stride), name) == 0) return i;
+    j = (j + 1) & mask;
+  }
+  return -1;
+}
+
+/* Returns a newly allocated name index for `meta` or NULL if `meta`
+   has unassigned dimension or property names or on allocation failure. */
+static struct _DLiteNameIndex *_nameindex_create(const DLiteMeta *meta)
+{
+  struct _DLiteNameIndex *index;
+  size_t dimsize = _nameindex_tablesize(meta->_ndimensions);
+  size_t propsize = _nameindex_tablesize(meta->_nproperties);
+  if ((meta->_ndimensions && !meta->_dimensions) ||
+      (meta->_nproperties && !meta->_properties)) return NULL;
+  if (!(index = calloc(1, sizeof(struct _DLiteNameIndex) +
+                       (dimsize + propsize)*sizeof(int)))) return NULL;
+  index->dimensions = meta->_dimensions;
+  index->properties = meta->_properties;
+  index->ndimensions = meta->_ndimensions;
+  index->nproperties = meta->_nproperties;
+  index->dimmask = dimsize - 1;
+  index->propmask = propsize - 1;
+  index->dimslots = (int *)(index + 1);
+  index->propslots = index->dimslots + dimsize;
+  if (_nameindex_fill(index->dimslots, index->dimmask, meta->_dimensions,
+                      meta->_ndimensions, sizeof(DLiteDimension)) ||
+      _nameindex_fill(index->propslots, index->propmask, meta->_properties,
+                      meta->_nproperties, sizeof(DLiteProperty))) {
+    free(index);
+    return NULL;
+  }
+  return index;
+}
+
+/* Returns index of dimension `name` in `meta` or -1 if `meta` has no
+   such dimension.  No error is reported. */
+static int _meta_find_dimension(const DLiteMeta *meta, const char *name)
+{
+  const struct _DLiteNameIndex *index = meta->_nameindex;
+  size_t i;
+  if (index && index->dimensions == meta->_dimensions &&
+      index->ndimensions == meta->_ndimensions)
+    return _nameindex_get(index->dimslots, index->dimmask, meta->_dimensions,
+                          sizeof(DLiteDimension), name);
+  for (i=0; i<meta->_ndimensions; i++)
+    if (strcmp(name, meta->_dimensions[i].name) == 0) return i;
+  return -1;
+}
+
+/* Returns index of property `name` in `meta` or -1 if `meta` has no
+   such property.  No error is reported. */
+static int _meta_find_property(const DLiteMeta *meta, const char *name)
+{
+  const struct _DLiteNameIndex *index = meta->_nameindex;
+  size_t i;
+  if (index && index->properties == meta->_properties &&
+      index->nproperties == meta->_nproperties)
+    return _nameindex_get(index->propslots, index->propmask, meta->_properties,
+                          sizeof(DLiteProperty), name);
+  for (i=0; i<meta->_nproperties; i++)
+    if (strcmp(name, meta->_properties[i].name) == 0) return i;
+  return -1;
+}
+
+
+
+/********************************************************************
+ *  Compiled property dimensions
+ *
+ *  The property dimension expressions of a metadata are compiled by
+ *  dlite_meta_init(), such that evaluating the property dimensions of
+ *  new instances doesn't require parsing.  Expressions that are just a
+ *  dimension name are stored as the index of that dimension.  Like the
+ *  name index, it records what it was compiled for and is ignored if
+ *  outdated.
+ ********************************************************************/
+
+/* A compiled property dimension expression. */
+typedef struct {
+  int dimindex;        /* Dimension index if the expression is just a
+                          dimension name, otherwise -1. */
+  InfixCalcCode *code; /* Compiled expression if `dimindex` is -1. */
+} PropDimExpr;
+
+struct _DLitePropDimsCode {
+  const DLiteProperty *properties;  /* Properties compiled for. */
+  size_t ndimensions;               /* Number of dimensions. */
+  size_t nproperties;               /* Number of properties. */
+  size_t npropdims;                 /* Number of expressions. */
+  PropDimExpr exprs[];              /* Expressions, length `npropdims`. */
+};
+
+/* Frees compiled property dimensions `pdc`. */
+static void _propdimscode_free(struct _DLitePropDimsCode *pdc)
+{
+  size_t i;
+  if (!pdc) return;
+  for (i=0; i < pdc->npropdims; i++)
+    if (pdc->exprs[i].code) infixcalc_free(pdc->exprs[i].code);
+  free(pdc);
+}
+
+/* Returns newly allocated compiled property dimensions for `meta` or
+   NULL if `meta` has unassigned names, invalid property dimension
+   expressions or on allocation failure.  No error is reported, since
+   the expressions are evaluated the slow way in that case. */
+static struct _DLitePropDimsCode *_propdimscode_create(const DLiteMeta *meta)
+{
+  struct _DLitePropDimsCode *pdc;
+  InfixCalcVariable *vars=NULL;
+  size_t i, n=0;
+  if ((meta->_ndimensions && !meta->_dimensions) ||
+      (meta->_nproperties && !meta->_properties)) return NULL;
+  if (!(pdc = calloc(1, sizeof(struct _DLitePropDimsCode) +
+                     meta->_npropdims*sizeof(PropDimExpr)))) return NULL;
+  pdc->properties = meta->_properties;
+  pdc->ndimensions = meta->_ndimensions;
+  pdc->nproperties = meta->_nproperties;
+  pdc->npropdims = meta->_npropdims;
+
+  if (meta->_ndimensions &&
+      !(vars = calloc(meta->_ndimensions, sizeof(InfixCalcVariable))))
+    goto fail;
+  for (i=0; i < meta->_ndimensions; i++)
+    if (!(vars[i].name = meta->_dimensions[i].name)) goto fail;
+
+  for (i=0; i < meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    int j;
+    if (p->ndims && !p->dims) goto fail;
+    for (j=0; j < p->ndims; j++) {
+      PropDimExpr *expr = pdc->exprs + n++;
+      if (n > pdc->npropdims || !p->dims[j]) goto fail;
+      if ((expr->dimindex = _meta_find_dimension(meta, p->dims[j])) < 0 &&
+          !(expr->code = infixcalc_compile(p->dims[j], vars,
+                                           meta->_ndimensions, NULL, 0)))
+        goto fail;
+    }
+  }
+  if (n != pdc->npropdims) goto fail;
+  free(vars);
+  return pdc;
+ fail:
+  if (vars) free(vars);
+  _propdimscode_free(pdc);
+  return NULL;
+}
+
+/* Evaluates compiled property dimensions `pdc` for dimensions `dims`
+   and writes the result to `propdims`.  Returns non-zero on error. */
+static int _propdimscode_eval(const struct _DLitePropDimsCode *pdc,
+                              const size_t *dims, size_t *propdims)
+{
+  int buf[16], *values=NULL;
+  size_t i, k;
+  for (i=0; i < pdc->npropdims; i++) {
+    const PropDimExpr *expr = pdc->exprs + i;
+    if (expr->dimindex >= 0) {
+      propdims[i] = dims[expr->dimindex];
+      continue;
+    }
+    if (!values) {
+      if (pdc->ndimensions <= sizeof(buf)/sizeof(int))
+        values = buf;
+      else if (!(values = malloc(pdc->ndimensions*sizeof(int))))
+        return err(1, "allocation failure");
+      for (k=0; k < pdc->ndimensions; k++) values[k] = dims[k];
+    }
+    propdims[i] = infixcalc_eval(expr->code, values);
+  }
+  if (values && values != buf) free(values);
+  return 0;
 }
 
 
@@ -328,136 +753,3114 @@ size_t dlite_instance_size(const DLiteMeta *meta, const size_t *dims)
 
 
 /********************************************************************
- *  Instances
+ *  Property arena
+ *
+ *  In the arena allocation mode, the arrays of all dimensional
+ *  properties of a data instance are placed in a single block
+ *  following the instance header, within the same allocation as the
+ *  instance.  The block is cache-line aligned and preceded by its
+ *  size, such that it can be determined whether a property array
+ *  lives in the arena or has been separately allocated (which is the
+ *  case for arrays that have grown with
+ *  dlite_instance_set_dimension_sizes()).
  ********************************************************************/
 
-/*
-  Help function that evaluates array of instance property dimension
-  values, where `dims` is the instance dimensions.  It assigns the
-  `propdims` memory section of `inst`.
+#define ARENA_ALIGN      64  /* Alignment of the arena */
+#define ARENA_ITEM_ALIGN 16  /* Alignment of each array in the arena */
 
-  Returns non-zero in error.
- */
-static int _instance_propdims_eval(DLiteInstance *inst, const size_t *dims)
+/* Global allocation mode */
+static DLiteAllocMode _alloc_mode = dliteAllocSeparate;
+
+/* Global layout mode */
+static DLiteLayoutMode _layout_mode = dliteLayoutDeclared;
+
+/* Forward declarations */
+static int _propdims_eval(const DLiteMeta *meta, const size_t *dims,
+                          size_t *propdims);
+static int _strings_detach(DLiteInstance *inst, size_t i);
+
+
+/* Returns non-zero if new instances of `meta` should use an arena. */
+static int _arena_is_used(const DLiteMeta *meta)
 {
-  int retval = 1;
-  const DLiteMeta *meta = inst->meta;
-  size_t *propdims = (size_t *)((char *)inst + meta->_propdimsoffset);
-  size_t i, n=0;
-  InfixCalcVariable *vars=NULL;
+  if (dlite_meta_is_metameta(meta)) return 0;
+  if (meta->_flags & dliteFlagAllocArena) return 1;
+  if (meta->_flags & dliteFlagAllocSeparate) return 0;
+  return _alloc_mode == dliteAllocArena;
+}
 
-  if (!(vars = calloc(meta->_ndimensions, sizeof(InfixCalcVariable))))
-    FAIL("allocation failure");
-  for (i=0; i < meta->_ndimensions; i++) {
-    vars[i].name = meta->_dimensions[i].name;
-    vars[i].value = dims[i];
-  }
+/* Calculates the arena size needed by an instance of `meta` with
+   dimensions `dims` and stores it in `*arenasize`.
 
-  for (i=0; i < meta->_nproperties; i++) {
+   Returns non-zero on error. */
+static int _arena_size(const DLiteMeta *meta, const size_t *dims,
+                       size_t *arenasize)
+{
+  size_t i, n=0, size=0, *propdims;
+  if (!(propdims = malloc((meta->_npropdims + 1) * sizeof(size_t))))
+    return err(1, "allocation failure");
+  if (_propdims_eval(meta, dims, propdims)) {
+    free(propdims);
+    return 1;
+  }
+  for (i=0; i<meta->_nproperties; i++) {
     DLiteProperty *p = meta->_properties + i;
+    size_t nmemb=1;
     int j;
-    char errmsg[256] = "";
-    for (j=0; j < p->ndims; j++)
-      propdims[n++] = infixcalc(p->dims[j], vars, meta->_ndimensions,
-                                errmsg, sizeof(errmsg));
-    if (errmsg[0]) FAIL1("invalid property dimension expression: %s", errmsg);
+    for (j=0; j<p->ndims; j++) nmemb *= propdims[n++];
+    if (p->ndims > 0 && p->dims && nmemb > 0)
+      size += align_up(nmemb * p->size, ARENA_ITEM_ALIGN);
   }
-  assert(n == meta->_npropdims);
+  free(propdims);
+  *arenasize = size;
+  return 0;
+}
 
-  retval = 0;
- fail:
-  if (vars) free(vars);
-  return retval;
+/* Returns the start of the arena of an instance starting at `inst`
+   with header size `size`. */
+static char *_arena_start(const DLiteInstance *inst, size_t size)
+{
+  char *ptr = (char *)inst + size + sizeof(size_t);
+  return ptr + (align_up((size_t)ptr, ARENA_ALIGN) - (size_t)ptr);
+}
+
+/* Returns non-zero if `ptr` points into the arena of `inst`. */
+static int _arena_contains(const DLiteInstance *inst, const void *ptr)
+{
+  char *arena;
+  if (!ptr || !(inst->_flags & dliteFlagArena)) return 0;
+  arena = _arena_start(inst, dlite_instance_size(inst->meta, NULL));
+  return ((const char *)ptr >= arena &&
+          (const char *)ptr < arena + ((size_t *)arena)[-1]);
 }
 
 
 /*
-  Help function for dlite_instance_create().  If `lookup` is true,
-  a check will be done to see if the instance already exists.
+  Sets the global allocation mode for the property arrays of new data
+  instances, whos metadata does not specify an allocation mode.  The
+  default is `dliteAllocSeparate`.
+
+  Returns the previous mode or -1 on error.
  */
-static DLiteInstance *_instance_create(const DLiteMeta *meta,
-                                       const size_t *dims,
-                                       const char *id, int lookup)
+int dlite_instance_set_alloc_mode(DLiteAllocMode mode)
 {
-  char uuid[DLITE_UUID_LENGTH+1];
-  size_t i, size;
-  DLiteInstance *inst=NULL;
-  int j, uuid_version;
+  DLiteAllocMode prev = _alloc_mode;
+  if (mode != dliteAllocSeparate && mode != dliteAllocArena)
+    return errx(-1, "invalid global allocation mode: %d", mode);
+  _alloc_mode = mode;
+  return prev;
+}
 
-  /* Check if we are trying to create an instance with an already
-     existing id. */
-  if (lookup && id && *id && (inst = _instance_store_get(id))) {
-    dlite_instance_incref(inst);
-    warn("trying to create new instance with id '%s' - creates a new "
-        "reference instead (refcount=%d)", id, inst->_refcount);
+/*
+  Returns the global allocation mode for the property arrays of new
+  data instances.
+ */
+DLiteAllocMode dlite_instance_get_alloc_mode(void)
+{
+  return _alloc_mode;
+}
 
-    /* Check that `dims` corresponds to the dims of the existing instance. */
-    for (i=0; i < meta->_ndimensions; i++) {
-      if (dims[i] != dlite_instance_get_dimension_size_by_index(inst, i))
-        FAIL3("mismatch of dimension %d. Trying to create with size %d "
-              "but existing instance has size %d", (int)i, (int)dims[i],
-              (int)dlite_instance_get_dimension_size_by_index(inst, i));
-    }
-    return inst;
-  }
+/*
+  Sets the allocation mode for the property arrays of new instances of
+  `meta`.  If `mode` is `dliteAllocDefault`, the global mode set with
+  dlite_instance_set_alloc_mode() is used.  Existing instances are not
+  affected.
 
-  /* Make sure that metadata is initialised */
-  if (!meta->_propoffsets && dlite_meta_init((DLiteMeta *)meta)) goto fail;
-  if (_instance_store_add((DLiteInstance *)meta) < 0) goto fail;
+  The arena mode only applies to data instances, i.e. it is ignored
+  for meta-metadata.
 
-  /* Allocate instance */
-  if (!(size = dlite_instance_size(meta, dims))) goto fail;
-  if (!(inst = calloc(1, size))) FAIL("allocation failure");
-  dlite_instance_incref(inst);  /* increase refcount of the new instance */
+  Returns non-zero on error.
+ */
+int dlite_meta_set_alloc_mode(DLiteMeta *meta, DLiteAllocMode mode)
+{
+  int flags = meta->_flags & ~(dliteFlagAllocSeparate | dliteFlagAllocArena);
+  switch (mode) {
+  case dliteAllocDefault:                                  break;
+  case dliteAllocSeparate: flags |= dliteFlagAllocSeparate; break;
+  case dliteAllocArena:    flags |= dliteFlagAllocArena;    break;
+  default: return errx(1, "invalid allocation mode: %d", mode);
+  }
+  meta->_flags = flags;
+  return 0;
+}
 
-  /* Initialise header */
-  if ((uuid_version = dlite_get_uuid(uuid, id)) < 0) goto fail;
-  memcpy(inst->uuid, uuid, sizeof(uuid));
-  if (uuid_version == 5) inst->uri = strdup(id);
-  inst->meta = (DLiteMeta *)meta;
+/*
+  Returns the allocation mode for instances of `meta`.  May return
+  `dliteAllocDefault`.
+ */
+DLiteAllocMode dlite_meta_get_alloc_mode(const DLiteMeta *meta)
+{
+  if (meta->_flags & dliteFlagAllocArena) return dliteAllocArena;
+  if (meta->_flags & dliteFlagAllocSeparate) return dliteAllocSeparate;
+  return dliteAllocDefault;
+}
 
-  /* Set dimensions */
-  if (meta->_ndimensions) {
-    size_t *dimensions = DLITE_DIMS(inst);
-    memcpy(dimensions, dims, meta->_ndimensions*sizeof(size_t));
-  }
 
-  /* Evaluate property dimensions */
-  if (_instance_propdims_eval(inst, dims)) goto fail;
 
-  /* Allocate arrays for dimensional properties */
-  for (i=0; i<meta->_nproperties; i++) {
-    DLiteProperty *p = DLITE_PROP_DESCR(inst, i);
-    void **ptr = DLITE_PROP(inst, i);
-    if (p->ndims > 0 && p->dims) {
-      size_t nmemb=1, size=p->size;
-      for (j=0; j<p->ndims; j++)
-        nmemb *= DLITE_PROP_DIM(inst, i, j);
-      if (nmemb > 0) {
-        if (!(*ptr = calloc(nmemb, size))) goto fail;
-      } else {
-        *ptr = NULL;
-      }
-    }
-  }
+/********************************************************************
+ *  Layout of property values
+ *
+ *  By default, dlite_meta_init() places the property values in the
+ *  instance header in declaration order.  The packed layout places
+ *  the values of hot properties first, followed by the rest.  Within
+ *  each group, the values are ordered by decreasing alignment, which
+ *  removes the padding between them.
+ *
+ *  The layout of metadata is fixed once it has instances, which is
+ *  recorded with dliteFlagInstantiated by _instance_init().
+ ********************************************************************/
 
-  /* Further initialisation if metadata..,  */
-  if (dlite_meta_is_metameta(meta) && dlite_meta_init((DLiteMeta *)inst))
-    goto fail;
+/* Marks that `meta` has instances. */
+static void _layout_fix(const DLiteMeta *meta)
+{
+  int *flags = (int *)&meta->_flags, f;
+  while (!((f = thread_atomic_load(flags)) & dliteFlagInstantiated))
+    if (thread_atomic_cas(flags, f, f | dliteFlagInstantiated)) break;
+}
 
-  /* Initialisation of extended metadata.
-     Note that we do not call _setdim() and _loadprop() here.  If
-     needed, they should be called by _init(). */
-  if (meta->_init && meta->_init(inst)) goto fail;
+/* Returns non-zero if the layout of `meta` cannot be changed. */
+static int _layout_check(const DLiteMeta *meta)
+{
+  if (meta->_flags & dliteFlagInstantiated)
+    return errx(1, "cannot change layout of %s, since it has instances",
+                meta->uri);
+  return 0;
+}
 
-  /* Add to instance cache */
-  if (_instance_store_add(inst)) goto fail;
+/* Returns non-zero if instances of `meta` use the packed layout.  If
+   the layout mode of `meta` is not set, the global mode is assigned
+   to it. */
+static int _layout_is_packed(DLiteMeta *meta)
+{
+  if (dlite_meta_is_metameta(meta)) return 0;
+  if (!(meta->_flags & (dliteFlagLayoutDeclared | dliteFlagLayoutPacked)))
+    meta->_flags |= (_layout_mode == dliteLayoutPacked) ?
+      dliteFlagLayoutPacked : dliteFlagLayoutDeclared;
+  return (meta->_flags & dliteFlagLayoutPacked) ? 1 : 0;
+}
 
-  /* Increase reference count of metadata */
-  dlite_meta_incref((DLiteMeta *)meta);
+/* Assigns the offsets of the property values of `meta` in packed
+   layout, starting at offset `*size`.  On return, `*size` is the end
+   of the property values.  Returns non-zero on error. */
+static int _layout_pack(DLiteMeta *meta, size_t *size)
+{
+  size_t i, j, k, n=meta->_nproperties, *order, *key;
+  if (!n) return 0;
+  if (!(order = malloc(2 * n * sizeof(size_t))))
+    return err(1, "allocation failure");
+  key = order + n;
+
+  /* Sort key: hot properties first, then by decreasing alignment.
+     Insertion sort keeps declaration order for equal keys. */
+  for (i=0; i<n; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    size_t align = (p->ndims) ? alignof(void *) :
+      dlite_type_get_alignment(p->type, p->size);
+    if (!align) {
+      free(order);
+      return errx(1, "cannot get alignment of property %s of %s",
+                  p->name, meta->uri);
+    }
+    key[i] = align + ((meta->_hotprops && meta->_hotprops[i]) ?
+                      (size_t)1 << (8*sizeof(size_t) - 1) : 0);
+    for (j=i; j > 0 && key[order[j-1]] < key[i]; j--) order[j] = order[j-1];
+    order[j] = i;
+  }
 
-  return inst;
- fail:
+  for (k=0; k<n; k++) {
+    DLiteProperty *p;
+    i = order[k];
+    p = meta->_properties + i;
+    if (p->ndims) {
+      *size += padding_at(void *, *size);
+      meta->_propoffsets[i] = *size;
+      *size += sizeof(void *);
+    } else {
+      *size += dlite_type_padding_at(p->type, p->size, *size);
+      meta->_propoffsets[i] = *size;
+      *size += p->size;
+    }
+  }
+  free(order);
+  return 0;
+}
+
+/*
+  Sets the global layout mode for the property values of instances of
+  metadata, whos layout mode is not set.
+
+  Returns the previous mode or -1 on error.
+ */
+int dlite_instance_set_layout_mode(DLiteLayoutMode mode)
+{
+  DLiteLayoutMode prev = _layout_mode;
+  if (mode != dliteLayoutDeclared && mode != dliteLayoutPacked)
+    return errx(-1, "invalid global layout mode: %d", mode);
+  _layout_mode = mode;
+  return prev;
+}
+
+/*
+  Returns the global layout mode for the property values of instances.
+ */
+DLiteLayoutMode dlite_instance_get_layout_mode(void)
+{
+  return _layout_mode;
+}
+
+/*
+  Sets the layout mode for the property values of instances of `meta`
+  and reinitialises its memory layout.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_set_layout_mode(DLiteMeta *meta, DLiteLayoutMode mode)
+{
+  int flags = meta->_flags &
+    ~(dliteFlagLayoutDeclared | dliteFlagLayoutPacked);
+  switch (mode) {
+  case dliteLayoutDefault:                                    break;
+  case dliteLayoutDeclared: flags |= dliteFlagLayoutDeclared; break;
+  case dliteLayoutPacked:   flags |= dliteFlagLayoutPacked;   break;
+  default: return errx(1, "invalid layout mode: %d", mode);
+  }
+  if (_layout_check(meta)) return 1;
+  meta->_flags = flags;
+  return dlite_meta_init(meta);
+}
+
+/*
+  Returns the layout mode for instances of `meta`.
+ */
+DLiteLayoutMode dlite_meta_get_layout_mode(const DLiteMeta *meta)
+{
+  if (meta->_flags & dliteFlagLayoutPacked) return dliteLayoutPacked;
+  if (meta->_flags & dliteFlagLayoutDeclared) return dliteLayoutDeclared;
+  return dliteLayoutDefault;
+}
+
+/*
+  Flags the `n` properties in `names` of `meta` as hot.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_set_hot_properties(DLiteMeta *meta, const char **names,
+                                  size_t n)
+{
+  unsigned char *hot=NULL;
+  size_t i;
+  int j;
+  if (_layout_check(meta)) return 1;
+  if (n) {
+    if (!(hot = calloc(meta->_nproperties, 1)))
+      return err(1, "allocation failure");
+    for (i=0; i<n; i++) {
+      if ((j = dlite_meta_get_property_index(meta, names[i])) < 0) {
+        free(hot);
+        return 1;
+      }
+      hot[j] = 1;
+    }
+  }
+  free(meta->_hotprops);
+  meta->_hotprops = hot;
+  return dlite_meta_init(meta);
+}
+
+
+
+/********************************************************************
+ *  Batch allocation
+ *
+ *  dlite_instance_create_many() allocates all new instances in a
+ *  single block.  Each instance is preceded by a pointer to the
+ *  header of the block, which counts the instances in the block that
+ *  are not yet deallocated.  The block is free'ed together with its
+ *  last instance.
+ ********************************************************************/
+
+/* Space reserved before each instance in a batch for a pointer to the
+   batch header.  Also the alignment of instances in the batch. */
+#define BATCH_PREFIX 16
+
+/* Header of a block of instances allocated in batch. */
+typedef struct {
+  int count;   /* Number of instances in the block not yet deallocated. */
+  const DLiteAllocator *allocator;  /* Allocator of the block or NULL. */
+} InstanceBatch;
+
+
+
+/********************************************************************
+ *  Custom allocators
+ *
+ *  The allocator set with dlite_instance_set_allocator() is stored in
+ *  the globals.  Instances allocated with it have the
+ *  dliteFlagAllocator flag set and remember their allocator, either
+ *  in the header of their batch or in a prefix of size BATCH_PREFIX
+ *  before the instance.  Their property arrays are allocated with the
+ *  same allocator.
+ ********************************************************************/
+
+#define ALLOCATOR_ID "dlite-allocator"
+
+/*
+  Sets the allocator used for new instances and their property arrays
+  in the current globals.  If `allocator` is NULL, the standard C
+  library allocator is used.
+
+  Returns the previous allocator.
+ */
+const DLiteAllocator *dlite_instance_set_allocator(
+  const DLiteAllocator *allocator)
+{
+  const DLiteAllocator *prev = dlite_globals_get_state(ALLOCATOR_ID);
+  if (allocator && (!allocator->malloc || !allocator->realloc)) {
+    errx(1, "custom allocator must provide malloc and realloc");
+    return prev;
+  }
+  if (prev) dlite_globals_remove_state(ALLOCATOR_ID);
+  if (allocator)
+    dlite_globals_add_state(ALLOCATOR_ID, (void *)allocator, NULL);
+  return prev;
+}
+
+/*
+  Returns the allocator for new instances in the current globals, or
+  NULL if the standard C library allocator is used.
+ */
+const DLiteAllocator *dlite_instance_get_allocator(void)
+{
+  return dlite_globals_get_state(ALLOCATOR_ID);
+}
+
+/* Returns the allocator of `inst` or NULL if it is allocated with the
+   standard C library allocator. */
+static const DLiteAllocator *_instance_allocator(const DLiteInstance *inst)
+{
+  const char *prefix = (const char *)inst - BATCH_PREFIX;
+  if (!(inst->_flags & dliteFlagAllocator)) return NULL;
+  if (inst->_flags & dliteFlagBatch)
+    return (*(InstanceBatch **)prefix)->allocator;
+  return *(const DLiteAllocator **)prefix;
+}
+
+/*
+  Returns the allocator `inst` was allocated with, or NULL if it is
+  allocated with the standard C library allocator.
+ */
+const DLiteAllocator *dlite_instance_allocator(const DLiteInstance *inst)
+{
+  return _instance_allocator(inst);
+}
+
+/* Allocates `size` bytes with allocator `a`, or with malloc() if `a`
+   is NULL. */
+static void *_allocator_malloc(const DLiteAllocator *a, size_t size)
+{
+  return (a) ? a->malloc(size, a->data) : malloc(size);
+}
+
+/* Allocates `nmemb` zeroed items of size `size` with allocator `a`,
+   or with calloc() if `a` is NULL. */
+static void *_allocator_calloc(const DLiteAllocator *a, size_t nmemb,
+                               size_t size)
+{
+  void *ptr;
+  if (!a) return calloc(nmemb, size);
+  if (a->calloc) return a->calloc(nmemb, size, a->data);
+  if (size && nmemb > (size_t)-1 / size) return NULL;
+  if ((ptr = a->malloc(nmemb * size, a->data))) memset(ptr, 0, nmemb * size);
+  return ptr;
+}
+
+/* Reallocates `ptr` to `size` bytes with allocator `a`, or with
+   realloc() if `a` is NULL. */
+static void *_allocator_realloc(const DLiteAllocator *a, void *ptr,
+                                size_t size)
+{
+  return (a) ? a->realloc(ptr, size, a->data) : realloc(ptr, size);
+}
+
+/* Frees `ptr` with allocator `a`, or with free() if `a` is NULL. */
+static void _allocator_free(const DLiteAllocator *a, void *ptr)
+{
+  if (!a)
+    free(ptr);
+  else if (a->free && ptr)
+    a->free(ptr, a->data);
+}
+
+/* Returns a new zeroed instance of `size` bytes allocated with
+   allocator `a`, or NULL on error. */
+static DLiteInstance *_instance_alloc(const DLiteAllocator *a, size_t size)
+{
+  char *block;
+  DLiteInstance *inst;
+  if (!a) return calloc(1, size);
+  if (!(block = _allocator_calloc(a, 1, BATCH_PREFIX + size))) return NULL;
+  *(const DLiteAllocator **)block = a;
+  inst = (DLiteInstance *)(block + BATCH_PREFIX);
+  inst->_flags = dliteFlagAllocator;
+  return inst;
+}
+
+/* Deallocates the memory of instance `inst`.  Property arrays must
+   already have been free'ed. */
+static void _instance_dealloc(DLiteInstance *inst)
+{
+  const DLiteAllocator *a = _instance_allocator(inst);
+  if (inst->_flags & dliteFlagBatch) {
+    InstanceBatch *batch = *(InstanceBatch **)((char *)inst - BATCH_PREFIX);
+    if (thread_atomic_add(&batch->count, -1) == 0) _allocator_free(a, batch);
+  } else if (a) {
+    _allocator_free(a, (char *)inst - BATCH_PREFIX);
+  } else {
+    free(inst);
+  }
+}
+
+
+
+/********************************************************************
+ *  Instance pool
+ *
+ *  An opt-in pool of free'ed data instances attached to their
+ *  metadata.  Instances in the pool keep their allocated property
+ *  arrays, which are zeroed when the instance is added to the pool.
+ *  Hence, they can be reused for new instances with the same
+ *  dimension sizes.  Instances in the pool don't hold a reference to
+ *  their metadata.
+ ********************************************************************/
+
+struct _DLiteInstancePool {
+  ThreadMutex mutex;            /* Protects the pool. */
+  DLiteInstance **instances;    /* Free'ed instances, length `maxsize`. */
+  DLitePoolStats stats;         /* Statistics. */
+};
+
+
+/* Frees allocated arrays of dimensional properties of `inst`.  Items
+   in the arrays must already be cleared. */
+static void _instance_free_arrays(DLiteInstance *inst)
+{
+  size_t i;
+  const DLiteMeta *meta = inst->meta;
+  if (!meta->_properties) return;
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    void **ptr = DLITE_PROP(inst, i);
+    if (p->ndims > 0 && p->dims && !_arena_contains(inst, *ptr))
+      _allocator_free(_instance_allocator(inst), *ptr);
+  }
+}
+
+/* Zeroes all properties and resets the header of `inst`, which is
+   about to be added to the pool.  Must be called after all allocated
+   memory within the properties are released. */
+static void _pool_zero_instance(DLiteInstance *inst)
+{
+  size_t i;
+  const DLiteMeta *meta = inst->meta;
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    void *ptr = DLITE_PROP(inst, i);
+    if (p->ndims > 0 && p->dims) {
+      int j;
+      size_t nmemb=1;
+      for (j=0; j<p->ndims; j++)
+        nmemb *= DLITE_PROP_DIM(inst, i, j);
+      if (*(void **)ptr) memset(*(void **)ptr, 0, nmemb*p->size);
+    } else {
+      memset(ptr, 0, p->size);
+    }
+  }
+  memset(inst->uuid, 0, sizeof(inst->uuid));
+  inst->uri = NULL;
+  inst->iri = NULL;
+  inst->_refcount = 0;
+
+  /* Only keep the flags describing how the instance is allocated.  The
+     other flags (like frozen, dirty state or strings in an arena)
+     belong to the lifetime of the free'ed instance. */
+  inst->_flags &= dliteFlagArena | dliteFlagBatch | dliteFlagAllocator;
+}
+
+/* Adds free'ed instance `inst` to the pool of its metadata.  Returns
+   non-zero if the pool is full, in which case it must be deallocated
+   by the caller. */
+static int _pool_push(DLiteInstance *inst)
+{
+  struct _DLiteInstancePool *pool = inst->meta->_pool;
+  int retval = 1;
+  thread_mutex_lock(&pool->mutex);
+  if (pool->stats.size < pool->stats.maxsize) {
+    _pool_zero_instance(inst);
+    pool->instances[pool->stats.size++] = inst;
+    pool->stats.recycled++;
+    retval = 0;
+  } else {
+    pool->stats.discarded++;
+  }
+  thread_mutex_unlock(&pool->mutex);
+  return retval;
+}
+
+/* Returns an instance with dimension sizes `dims` from the pool of
+   `meta`, or NULL if no such instance is available. */
+static DLiteInstance *_pool_pop(const DLiteMeta *meta, const size_t *dims)
+{
+  struct _DLiteInstancePool *pool = meta->_pool;
+  DLiteInstance *inst=NULL;
+  size_t i, n = meta->_ndimensions * sizeof(size_t);
+  thread_mutex_lock(&pool->mutex);
+  for (i=pool->stats.size; i>0; i--) {
+    DLiteInstance *candidate = pool->instances[i-1];
+    if (n == 0 || memcmp(DLITE_DIMS(candidate), dims, n) == 0) {
+      inst = candidate;
+      pool->instances[i-1] = pool->instances[--pool->stats.size];
+      break;
+    }
+  }
+  if (inst)
+    pool->stats.hits++;
+  else
+    pool->stats.misses++;
+  thread_mutex_unlock(&pool->mutex);
+  return inst;
+}
+
+/* Releases instances in the pool exceeding `maxsize`. */
+static void _pool_shrink(struct _DLiteInstancePool *pool, size_t maxsize)
+{
+  while (pool->stats.size > maxsize) {
+    DLiteInstance *inst = pool->instances[--pool->stats.size];
+    _instance_free_arrays(inst);
+    _instance_dealloc(inst);
+  }
+}
+
+/* Releases the pool of `meta` and all instances in it. */
+static void _pool_free(DLiteMeta *meta)
+{
+  struct _DLiteInstancePool *pool = meta->_pool;
+  if (!pool) return;
+  _pool_shrink(pool, 0);
+  thread_mutex_destroy(&pool->mutex);
+  free(pool->instances);
+  free(pool);
+  meta->_pool = NULL;
+}
+
+
+/*
+  Enables a pool of free'ed instances of `meta` with room for up to
+  `maxsize` instances.  When an instance of `meta` is free'ed, it is
+  added to the pool (if there is room) instead of being deallocated.
+  A new instance created with the same dimension sizes as an instance
+  in the pool, will reuse it.  Reused instances are only zeroed and
+  assigned a new UUID, not reallocated.
+
+  If `maxsize` is zero, the pool is disabled and all instances in it
+  are released.  Calling this function with a different `maxsize`
+  resizes an existing pool.
+
+  Pools are only supported for data instances, i.e. `meta` cannot be
+  meta-metadata.  This function should not be called while other
+  threads are creating or free'ing instances of `meta`.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_enable_pool(DLiteMeta *meta, size_t maxsize)
+{
+  struct _DLiteInstancePool *pool = meta->_pool;
+  DLiteInstance **instances;
+  if (dlite_meta_is_metameta(meta))
+    return errx(1, "instance pools are not supported for meta-metadata: %s",
+                meta->uri);
+  if (maxsize == 0) {
+    _pool_free(meta);
+    return 0;
+  }
+  if (!pool) {
+    if (!(pool = calloc(1, sizeof(struct _DLiteInstancePool))))
+      return err(1, "allocation failure");
+    thread_mutex_init(&pool->mutex);
+  }
+  _pool_shrink(pool, maxsize);
+  if (!(instances = realloc(pool->instances,
+                            maxsize*sizeof(DLiteInstance *)))) {
+    if (!meta->_pool) free(pool);
+    return err(1, "allocation failure");
+  }
+  pool->instances = instances;
+  pool->stats.maxsize = maxsize;
+  meta->_pool = pool;
+  return 0;
+}
+
+/*
+  Copies the pool statistics of `meta` to `stats`.  All values are
+  zero if `meta` has no pool.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_get_pool_stats(const DLiteMeta *meta, DLitePoolStats *stats)
+{
+  struct _DLiteInstancePool *pool = meta->_pool;
+  if (!pool) {
+    memset(stats, 0, sizeof(DLitePoolStats));
+    return 0;
+  }
+  thread_mutex_lock(&pool->mutex);
+  memcpy(stats, &pool->stats, sizeof(DLitePoolStats));
+  thread_mutex_unlock(&pool->mutex);
+  return 0;
+}
+
+
+
+/********************************************************************
+ *  Shared property buffers
+ *
+ *  dlite_instance_copy_cow() lets the copy share the property arrays
+ *  of the source instead of copying them.  Shared arrays are recorded
+ *  in a global registry mapping the array pointer to the number of
+ *  instances holding it.  Instances holding shared arrays are marked
+ *  with dliteFlagShared.  A private copy of a shared array is made
+ *  when write access to it is requested through
+ *  dlite_instance_make_writable().  An array is removed from the
+ *  registry when its last but one holder releases it, such that the
+ *  remaining holder becomes its owner.
+ ********************************************************************/
+
+typedef map_t(int) shared_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  shared_map_t map;
+} SharedBuffers;
+
+static ThreadMutex _shared_buffers_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees the registry of shared buffers. */
+static void _shared_buffers_free(void *shared_buffers)
+{
+  SharedBuffers *sb = shared_buffers;
+  map_deinit(&sb->map);
+  thread_mutex_destroy(&sb->mutex);
+  free(sb);
+}
+
+/* Returns pointer to the registry of shared buffers. */
+static SharedBuffers *_shared_buffers(void)
+{
+  SharedBuffers *sb = dlite_globals_get_state("dlite-shared-buffers");
+  if (!sb) {
+    thread_mutex_lock(&_shared_buffers_mutex);
+    if (!(sb = dlite_globals_get_state("dlite-shared-buffers"))) {
+      if ((sb = calloc(1, sizeof(SharedBuffers)))) {
+        thread_mutex_init(&sb->mutex);
+        map_init(&sb->map);
+        dlite_globals_add_state("dlite-shared-buffers", sb,
+                                _shared_buffers_free);
+      }
+    }
+    thread_mutex_unlock(&_shared_buffers_mutex);
+    if (!sb) return err(1, "allocation failure"), NULL;
+  }
+  return sb;
+}
+
+/* Registers that one more instance holds the array `ptr`.  Returns
+   non-zero on error. */
+static int _shared_acquire(void *ptr)
+{
+  SharedBuffers *sb;
+  char key[32];
+  int *count, stat;
+  if (!(sb = _shared_buffers())) return 1;
+  PTR_KEY(key, ptr);
+  thread_mutex_lock(&sb->mutex);
+  if ((count = map_get(&sb->map, key)))
+    stat = map_set(&sb->map, key, *count + 1);
+  else
+    stat = map_set(&sb->map, key, 2);
+  thread_mutex_unlock(&sb->mutex);
+  if (stat) return err(1, "cannot register shared buffer");
+  return 0;
+}
+
+/* Releases the shared array pointed to by `*ptr`.  If the array is
+   shared, `*ptr` is set to NULL and 1 is returned.  Otherwise the
+   caller owns the array and 0 is returned. */
+static int _shared_release(void **ptr)
+{
+  SharedBuffers *sb;
+  char key[32];
+  int *count, retval=0;
+  if (!*ptr || !(sb = dlite_globals_get_state("dlite-shared-buffers")))
+    return 0;
+  PTR_KEY(key, *ptr);
+  thread_mutex_lock(&sb->mutex);
+  if ((count = map_get(&sb->map, key))) {
+    if (*count > 2)
+      (*count)--;
+    else
+      map_remove(&sb->map, key);
+    *ptr = NULL;
+    retval = 1;
+  }
+  thread_mutex_unlock(&sb->mutex);
+  return retval;
+}
+
+/* Releases all shared arrays of `inst`. */
+static void _shared_release_all(DLiteInstance *inst)
+{
+  size_t i;
+  for (i=0; i<inst->meta->_nproperties; i++)
+    if (inst->meta->_properties[i].ndims > 0)
+      _shared_release(DLITE_PROP(inst, i));
+}
+
+/* If the array pointed to by `*ptr` of size `nbytes` is shared, it is
+   replaced with a private copy allocated with allocator `a`.  Returns
+   non-zero on error.
+
+   The data is copied while holding the lock, such that the other
+   holders cannot release it in the meantime. */
+static int _shared_make_private(void **ptr, size_t nbytes,
+                                const DLiteAllocator *a)
+{
+  SharedBuffers *sb;
+  char key[32];
+  int *count, retval=0;
+  if (!*ptr || !(sb = dlite_globals_get_state("dlite-shared-buffers")))
+    return 0;
+  PTR_KEY(key, *ptr);
+  thread_mutex_lock(&sb->mutex);
+  if ((count = map_get(&sb->map, key))) {
+    void *q;
+    if ((q = _allocator_malloc(a, nbytes))) {
+      memcpy(q, *ptr, nbytes);
+      if (*count > 2)
+        (*count)--;
+      else
+        map_remove(&sb->map, key);
+      *ptr = q;
+    } else {
+      retval = 1;
+    }
+  }
+  thread_mutex_unlock(&sb->mutex);
+  if (retval) return err(1, "allocation failure");
+  return 0;
+}
+
+/* Reports that frozen instance `inst` cannot be modified.  Returns 1. */
+static int _frozen_error(const DLiteInstance *inst)
+{
+  return errx(1, "cannot modify frozen instance: %s",
+              (inst->uri) ? inst->uri : inst->uuid);
+}
+
+/*
+  Ensures that property `i` of `inst` can be written to without
+  affecting other instances, by replacing a shared property array
+  with a private copy.  This is a no-op for instances not created by
+  dlite_instance_copy_cow().
+
+  Returns non-zero on error.
+ */
+int dlite_instance_make_writable(DLiteInstance *inst, size_t i)
+{
+  DLiteProperty *p;
+  size_t nmemb=1;
+  int j;
+  if (inst->_flags & dliteFlagFrozen) return _frozen_error(inst);
+  if ((inst->_flags & dliteFlagStrings) && _strings_detach(inst, i)) return 1;
+  if (!(inst->_flags & dliteFlagShared)) return 0;
+  if (i >= inst->meta->_nproperties)
+    return errx(1, "index %d exceeds number of properties (%d) in %s",
+                (int)i, (int)inst->meta->_nproperties, inst->meta->uri);
+  p = inst->meta->_properties + i;
+  if (p->ndims <= 0) return 0;
+  for (j=0; j<p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+  return _shared_make_private(DLITE_PROP(inst, i), nmemb*p->size,
+                              _instance_allocator(inst));
+}
+
+
+/********************************************************************
+ *  String arenas
+ *
+ *  dlite_instance_pack_strings() moves the string values of an
+ *  instance into a single allocation, the string arena.  Short strings
+ *  are stored in fixed slots at the start of the arena, followed by
+ *  the longer strings.  The arenas are kept in a global map from
+ *  instance uuid, and instances with an arena are marked with
+ *  dliteFlagStrings.  Before a string property is written to, its
+ *  strings are moved out of the arena by _strings_detach().
+ ********************************************************************/
+
+typedef struct {
+  char *buf;         /* the arena */
+  size_t size;       /* size of the arena */
+} StringArena;
+
+typedef map_t(StringArena) string_arena_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  string_arena_map_t map;
+} StringArenas;
+
+static ThreadMutex _string_arenas_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees the map of string arenas. */
+static void _string_arenas_free(void *string_arenas)
+{
+  StringArenas *sa = string_arenas;
+  const char *uuid;
+  map_iter_t iter = map_iter(&sa->map);
+  while ((uuid = map_next(&sa->map, &iter)))
+    free(map_get(&sa->map, uuid)->buf);
+  map_deinit(&sa->map);
+  thread_mutex_destroy(&sa->mutex);
+  free(sa);
+}
+
+/* Returns pointer to the map of string arenas. */
+static StringArenas *_string_arenas(void)
+{
+  StringArenas *sa = dlite_globals_get_state("dlite-string-arenas");
+  if (!sa) {
+    thread_mutex_lock(&_string_arenas_mutex);
+    if (!(sa = dlite_globals_get_state("dlite-string-arenas"))) {
+      if ((sa = calloc(1, sizeof(StringArenas)))) {
+        thread_mutex_init(&sa->mutex);
+        map_init(&sa->map);
+        dlite_globals_add_state("dlite-string-arenas", sa,
+                                _string_arenas_free);
+      }
+    }
+    thread_mutex_unlock(&_string_arenas_mutex);
+    if (!sa) return err(1, "allocation failure"), NULL;
+  }
+  return sa;
+}
+
+/* Assigns `*arena` to the string arena of `inst`.  If `remove` is
+   true, the arena is removed from the map.  Returns non-zero if `inst`
+   has no arena. */
+static int _strings_arena(const DLiteInstance *inst, StringArena *arena,
+                          int remove)
+{
+  StringArenas *sa;
+  StringArena *q;
+  memset(arena, 0, sizeof(StringArena));
+  if (!(sa = _string_arenas())) return 1;
+  thread_mutex_lock(&sa->mutex);
+  if ((q = map_get(&sa->map, inst->uuid))) {
+    *arena = *q;
+    if (remove) map_remove(&sa->map, inst->uuid);
+  }
+  thread_mutex_unlock(&sa->mutex);
+  return (arena->buf) ? 0 : 1;
+}
+
+/* Returns non-zero if `s` points into `arena`. */
+#define STRINGS_CONTAIN(arena, s) \
+  ((s) && (s) >= (arena)->buf && (s) < (arena)->buf + (arena)->size)
+
+/* Returns the number of string values of property `i` of `inst` and
+   assigns `*vals` to point to the first.  Returns zero if property `i`
+   is not a string. */
+static size_t _strings_values(const DLiteInstance *inst, size_t i,
+                              char ***vals)
+{
+  DLiteProperty *p = inst->meta->_properties + i;
+  size_t n=1;
+  int j;
+  if (p->type != dliteStringPtr) return 0;
+  if (p->ndims == 0) {
+    *vals = (char **)DLITE_PROP(inst, i);
+    return 1;
+  }
+  if (!(*vals = *(char ***)DLITE_PROP(inst, i))) return 0;
+  for (j=0; j<p->ndims; j++) n *= DLITE_PROP_DIM(inst, i, j);
+  return n;
+}
+
+/* Moves the strings of property `i` of `inst` out of its string arena.
+   The arena itself is kept.  Returns non-zero on error. */
+static int _strings_detach(DLiteInstance *inst, size_t i)
+{
+  StringArena arena;
+  char **vals;
+  size_t k, n;
+  if (i >= inst->meta->_nproperties ||
+      !(n = _strings_values(inst, i, &vals))) return 0;
+  if (_strings_arena(inst, &arena, 0)) return 0;
+  for (k=0; k<n; k++) {
+    if (STRINGS_CONTAIN(&arena, vals[k]) && !(vals[k] = strdup(vals[k])))
+      return err(1, "allocation failure");
+  }
+  return 0;
+}
+
+/* Frees the string arena of `inst`, which is about to be free'ed.
+   The values pointing into the arena are set to NULL. */
+static void _strings_forget(DLiteInstance *inst)
+{
+  StringArena arena;
+  char **vals;
+  size_t i, k, n;
+  if (!_strings_arena(inst, &arena, 1)) {
+    for (i=0; i<inst->meta->_nproperties; i++)
+      for (k=0, n=_strings_values(inst, i, &vals); k<n; k++)
+        if (STRINGS_CONTAIN(&arena, vals[k])) vals[k] = NULL;
+    free(arena.buf);
+  }
+  inst->_flags &= ~dliteFlagStrings;
+}
+
+/*
+  Moves the values of all string properties of data instance `inst`
+  into a string arena.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_pack_strings(DLiteInstance *inst)
+{
+  StringArenas *sa;
+  StringArena old, new;
+  char **vals;
+  size_t i, k, n, len, nslots=0, nlong=0, slot=0, pos;
+
+  if (!dlite_instance_is_data(inst))
+    return errx(1, "cannot pack strings of metadata: %s", inst->uuid);
+  if (inst->_flags & dliteFlagFrozen) return _frozen_error(inst);
+  if (dlite_instance_load_all(inst)) return 1;
+  if (dlite_instance_sync_to_properties(inst)) return 1;
+  if (!(sa = _string_arenas())) return 1;
+
+  for (i=0; i<inst->meta->_nproperties; i++)
+    for (k=0, n=_strings_values(inst, i, &vals); k<n; k++) {
+      if (!vals[k]) continue;
+      if ((len = strlen(vals[k]) + 1) <= DLITE_STRING_SLOT)
+        nslots++;
+      else
+        nlong += len;
+    }
+  if (nslots + nlong == 0) return dlite_instance_unpack_strings(inst);
+
+  new.size = nslots * DLITE_STRING_SLOT + nlong;
+  if (!(new.buf = malloc(new.size))) return err(1, "allocation failure");
+  _strings_arena(inst, &old, 0);
+  thread_mutex_lock(&sa->mutex);
+  if (map_set(&sa->map, inst->uuid, new)) {
+    thread_mutex_unlock(&sa->mutex);
+    free(new.buf);
+    return err(1, "cannot register string arena for %s", inst->uuid);
+  }
+  thread_mutex_unlock(&sa->mutex);
+
+  pos = nslots * DLITE_STRING_SLOT;
+  for (i=0; i<inst->meta->_nproperties; i++)
+    for (k=0, n=_strings_values(inst, i, &vals); k<n; k++) {
+      char *dst;
+      if (!vals[k]) continue;
+      if ((len = strlen(vals[k]) + 1) <= DLITE_STRING_SLOT) {
+        dst = new.buf + DLITE_STRING_SLOT * slot++;
+      } else {
+        dst = new.buf + pos;
+        pos += len;
+      }
+      memcpy(dst, vals[k], len);
+      if (!STRINGS_CONTAIN(&old, vals[k])) free(vals[k]);
+      vals[k] = dst;
+    }
+  free(old.buf);
+  inst->_flags |= dliteFlagStrings;
+  return 0;
+}
+
+/*
+  Moves the strings of `inst` out of its string arena and frees the
+  arena.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_unpack_strings(DLiteInstance *inst)
+{
+  StringArena arena;
+  size_t i;
+  if (!(inst->_flags & dliteFlagStrings)) return 0;
+  for (i=0; i<inst->meta->_nproperties; i++)
+    if (_strings_detach(inst, i)) return 1;
+  if (!_strings_arena(inst, &arena, 1)) free(arena.buf);
+  inst->_flags &= ~dliteFlagStrings;
+  return 0;
+}
+
+
+/********************************************************************
+ *  Foreign buffers
+ *
+ *  Property arrays attached with dlite_instance_adopt_property() or
+ *  dlite_instance_borrow_property() are not allocated by DLite.  They
+ *  are recorded in a global registry mapping the array pointer to
+ *  how it should be released.  Instances holding such arrays are
+ *  marked with dliteFlagForeign.
+ ********************************************************************/
+
+typedef struct {
+  DLiteDeallocator dealloc;  /* deallocator for adopted arrays */
+  int borrowed;              /* whether the array is borrowed */
+} ForeignBuffer;
+
+typedef map_t(ForeignBuffer) foreign_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  foreign_map_t map;
+} ForeignBuffers;
+
+static ThreadMutex _foreign_buffers_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees the registry of foreign buffers. */
+static void _foreign_buffers_free(void *foreign_buffers)
+{
+  ForeignBuffers *fb = foreign_buffers;
+  map_deinit(&fb->map);
+  thread_mutex_destroy(&fb->mutex);
+  free(fb);
+}
+
+/* Returns pointer to the registry of foreign buffers. */
+static ForeignBuffers *_foreign_buffers(void)
+{
+  ForeignBuffers *fb = dlite_globals_get_state("dlite-foreign-buffers");
+  if (!fb) {
+    thread_mutex_lock(&_foreign_buffers_mutex);
+    if (!(fb = dlite_globals_get_state("dlite-foreign-buffers"))) {
+      if ((fb = calloc(1, sizeof(ForeignBuffers)))) {
+        thread_mutex_init(&fb->mutex);
+        map_init(&fb->map);
+        dlite_globals_add_state("dlite-foreign-buffers", fb,
+                                _foreign_buffers_free);
+      }
+    }
+    thread_mutex_unlock(&_foreign_buffers_mutex);
+    if (!fb) return err(1, "allocation failure"), NULL;
+  }
+  return fb;
+}
+
+/* Registers foreign array `ptr`.  Returns non-zero on error. */
+static int _foreign_add(void *ptr, DLiteDeallocator dealloc, int borrowed)
+{
+  ForeignBuffers *fb;
+  ForeignBuffer buf;
+  char key[32];
+  int stat=0;
+  if (!(fb = _foreign_buffers())) return 1;
+  buf.dealloc = dealloc;
+  buf.borrowed = borrowed;
+  PTR_KEY(key, ptr);
+  thread_mutex_lock(&fb->mutex);
+  if (map_peek(&fb->map, key))
+    stat = 2;
+  else if (map_set(&fb->map, key, buf))
+    stat = 1;
+  thread_mutex_unlock(&fb->mutex);
+  if (stat == 2) return errx(1, "buffer %p is already attached", ptr);
+  if (stat) return err(1, "cannot register foreign buffer");
+  return 0;
+}
+
+/* Returns non-zero if `ptr` is a foreign array. */
+static int _foreign_contains(const void *ptr)
+{
+  ForeignBuffers *fb;
+  char key[32];
+  int found;
+  if (!ptr || !(fb = dlite_globals_get_state("dlite-foreign-buffers")))
+    return 0;
+  PTR_KEY(key, ptr);
+  thread_mutex_lock(&fb->mutex);
+  found = (map_peek(&fb->map, key)) ? 1 : 0;
+  thread_mutex_unlock(&fb->mutex);
+  return found;
+}
+
+/* Releases the array pointed to by `*ptr` if it is foreign, by calling
+   its deallocator unless it is borrowed.  Sets `*ptr` to NULL and
+   returns 1 if the array was foreign, otherwise 0 is returned. */
+static int _foreign_release(void **ptr)
+{
+  ForeignBuffers *fb;
+  ForeignBuffer *q, buf;
+  char key[32];
+  int found=0;
+  if (!*ptr || !(fb = dlite_globals_get_state("dlite-foreign-buffers")))
+    return 0;
+  PTR_KEY(key, *ptr);
+  thread_mutex_lock(&fb->mutex);
+  if ((q = map_peek(&fb->map, key))) {
+    buf = *q;
+    map_remove(&fb->map, key);
+    found = 1;
+  }
+  thread_mutex_unlock(&fb->mutex);
+  if (!found) return 0;
+  if (!buf.borrowed) {
+    if (buf.dealloc)
+      buf.dealloc(*ptr);
+    else
+      free(*ptr);
+  }
+  *ptr = NULL;
+  return 1;
+}
+
+/* Releases all foreign arrays of `inst`. */
+static void _foreign_release_all(DLiteInstance *inst)
+{
+  size_t i;
+  for (i=0; i<inst->meta->_nproperties; i++)
+    if (inst->meta->_properties[i].ndims > 0)
+      _foreign_release(DLITE_PROP(inst, i));
+}
+
+/* If the array pointed to by `*ptr` of size `nbytes` is foreign, it
+   is replaced with a copy allocated with allocator `a`.  Returns
+   non-zero on error. */
+static int _foreign_make_owned(void **ptr, size_t nbytes,
+                               const DLiteAllocator *a)
+{
+  void *q, *p = *ptr;
+  if (!_foreign_contains(p)) return 0;
+  if (!(q = _allocator_malloc(a, nbytes)))
+    return err(1, "allocation failure");
+  memcpy(q, p, nbytes);
+  _foreign_release(&p);
+  *ptr = q;
+  return 0;
+}
+
+
+/********************************************************************
+ *  Lazy loading
+ *
+ *  Instances loaded with dlite_instance_load_lazy() keep the data model
+ *  they were loaded from open and read each property on first access.
+ *  The state of such instances is kept in a global map keyed by their
+ *  uuid, and the instances are marked with dliteFlagLazy.  The data
+ *  model is released and the flag cleared when all properties are
+ *  loaded.
+ ********************************************************************/
+
+typedef struct {
+  DLiteDataModel *d;        /* data model to load from */
+  size_t nloaded;           /* number of loaded properties */
+  unsigned char loaded[];   /* whether each property is loaded */
+} LazyState;
+
+typedef map_t(LazyState *) lazy_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  lazy_map_t map;
+} LazyInstances;
+
+static ThreadMutex _lazy_instances_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees the map of lazy instances.  The data models are not free'ed,
+   since their storages may already be closed at this point. */
+static void _lazy_instances_free(void *lazy_instances)
+{
+  LazyInstances *li = lazy_instances;
+  const char *uuid;
+  map_iter_t iter = map_iter(&li->map);
+  while ((uuid = map_next(&li->map, &iter))) {
+    LazyState **q = map_peek(&li->map, uuid);
+    if (q && *q) free(*q);
+  }
+  map_deinit(&li->map);
+  thread_mutex_destroy(&li->mutex);
+  free(li);
+}
+
+/* Returns pointer to the map of lazy instances. */
+static LazyInstances *_lazy_instances(void)
+{
+  LazyInstances *li = dlite_globals_get_state("dlite-lazy-instances");
+  if (!li) {
+    thread_mutex_lock(&_lazy_instances_mutex);
+    if (!(li = dlite_globals_get_state("dlite-lazy-instances"))) {
+      if ((li = calloc(1, sizeof(LazyInstances)))) {
+        thread_mutex_init(&li->mutex);
+        map_init(&li->map);
+        dlite_globals_add_state("dlite-lazy-instances", li,
+                                _lazy_instances_free);
+      }
+    }
+    thread_mutex_unlock(&_lazy_instances_mutex);
+    if (!li) return err(1, "allocation failure"), NULL;
+  }
+  return li;
+}
+
+/* Makes `inst` lazy, such that its properties are loaded from `d` on
+   first access.  Takes over the ownership of `d`.  Returns non-zero
+   on error, in which case the caller still owns `d`. */
+static int _lazy_add(DLiteInstance *inst, DLiteDataModel *d)
+{
+  LazyInstances *li;
+  LazyState *state;
+  size_t nprops = inst->meta->_nproperties;
+  int stat;
+  if (!(li = _lazy_instances())) return 1;
+  if (!(state = calloc(1, sizeof(LazyState) + nprops)))
+    return err(1, "allocation failure");
+  state->d = d;
+  thread_mutex_lock(&li->mutex);
+  stat = map_set(&li->map, inst->uuid, state);
+  thread_mutex_unlock(&li->mutex);
+  if (stat) {
+    free(state);
+    return err(1, "cannot make instance lazy: %s", inst->uuid);
+  }
+  inst->_flags |= dliteFlagLazy;
+  return 0;
+}
+
+/* Removes `state` of lazy instance `inst` from `li` and frees it.
+   Must be called with the lock held. */
+static void _lazy_remove(LazyInstances *li, DLiteInstance *inst,
+                         LazyState *state)
+{
+  map_remove(&li->map, inst->uuid);
+  dlite_datamodel_free(state->d);
+  free(state);
+  inst->_flags &= ~dliteFlagLazy;
+}
+
+/* Loads property `i` of lazy instance `inst` if it is not already
+   loaded.  If `load` is zero, the property is only marked as loaded,
+   which is used when it is about to be overwritten.
+
+   Returns non-zero on error. */
+static int _lazy_load(DLiteInstance *inst, size_t i, int load)
+{
+  LazyInstances *li;
+  LazyState **q, *state;
+  int retval=0;
+  if (!(li = dlite_globals_get_state("dlite-lazy-instances"))) return 0;
+  thread_mutex_lock(&li->mutex);
+  if ((q = map_peek(&li->map, inst->uuid)) && (state = *q) &&
+      !state->loaded[i]) {
+    if (load) {
+      DLiteProperty *p = inst->meta->_properties + i;
+      void *ptr = DLITE_PROP(inst, i);
+      if (p->ndims > 0) ptr = *(void **)ptr;
+      if (dlite_datamodel_get_property(state->d, p->name, ptr, p->type,
+                                       p->size, p->ndims,
+                                       DLITE_PROP_DIMS(inst, i))) {
+        if (p->ndims == 0) dlite_type_clear(ptr, p->type, p->size);
+        retval = 1;
+      }
+    }
+    if (!retval) {
+      state->loaded[i] = 1;
+      if (++state->nloaded >= inst->meta->_nproperties)
+        _lazy_remove(li, inst, state);
+    }
+  }
+  thread_mutex_unlock(&li->mutex);
+  if (retval)
+    return err(1, "cannot load property '%s' of %s",
+               inst->meta->_properties[i].name, inst->uuid);
+  return 0;
+}
+
+/* Releases the lazy state of `inst` without loading the remaining
+   properties. */
+static void _lazy_release(DLiteInstance *inst)
+{
+  LazyInstances *li;
+  LazyState **q;
+  if (!(li = dlite_globals_get_state("dlite-lazy-instances"))) return;
+  thread_mutex_lock(&li->mutex);
+  if ((q = map_peek(&li->map, inst->uuid)) && *q)
+    _lazy_remove(li, inst, *q);
+  thread_mutex_unlock(&li->mutex);
+}
+
+/*
+  Loads property `i` of an instance created with
+  dlite_instance_load_lazy() from storage, if it is not already
+  loaded.  This is a no-op for other instances.
+
+  Only needed before accessing the property directly with
+  DLITE_PROP(), since dlite_instance_get_property() and friends load
+  the property automatically.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_load_property(DLiteInstance *inst, size_t i)
+{
+  if (!(inst->_flags & dliteFlagLazy)) return 0;
+  if (i >= inst->meta->_nproperties)
+    return errx(1, "index %d exceeds number of properties (%d) in %s",
+                (int)i, (int)inst->meta->_nproperties, inst->meta->uri);
+  return _lazy_load(inst, i, 1);
+}
+
+/*
+  Loads all properties of an instance created with
+  dlite_instance_load_lazy() that are not already loaded.
+  Afterwards the storage the instance was loaded from may be closed.
+  This is a no-op for other instances.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_load_all(DLiteInstance *inst)
+{
+  size_t i;
+  for (i=0; i < inst->meta->_nproperties && (inst->_flags & dliteFlagLazy);
+       i++)
+    if (_lazy_load(inst, i, 1)) return 1;
+  return 0;
+}
+
+
+/********************************************************************
+ *  Fingerprints
+ *
+ *  The fingerprint is an MD5 digest of a canonical serialisation of
+ *  the instance content.  Calculated fingerprints are kept in a global
+ *  map keyed by the instance uuid and the instance is marked with
+ *  dliteFlagFingerprint, which is cleared together with the dirty
+ *  bits when the instance is modified.
+ ********************************************************************/
+
+typedef struct {
+  unsigned char digest[DLITE_FINGERPRINT_SIZE];
+} Fingerprint;
+
+typedef map_t(Fingerprint) fingerprint_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  fingerprint_map_t map;
+} Fingerprints;
+
+static ThreadMutex _fingerprints_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees the map of fingerprints. */
+static void _fingerprints_free(void *fingerprints)
+{
+  Fingerprints *fp = fingerprints;
+  map_deinit(&fp->map);
+  thread_mutex_destroy(&fp->mutex);
+  free(fp);
+}
+
+/* Returns pointer to the map of fingerprints. */
+static Fingerprints *_fingerprints(void)
+{
+  Fingerprints *fp = dlite_globals_get_state("dlite-fingerprints");
+  if (!fp) {
+    thread_mutex_lock(&_fingerprints_mutex);
+    if (!(fp = dlite_globals_get_state("dlite-fingerprints"))) {
+      if ((fp = calloc(1, sizeof(Fingerprints)))) {
+        thread_mutex_init(&fp->mutex);
+        map_init(&fp->map);
+        dlite_globals_add_state("dlite-fingerprints", fp,
+                                _fingerprints_free);
+      }
+    }
+    thread_mutex_unlock(&_fingerprints_mutex);
+    if (!fp) return err(1, "allocation failure"), NULL;
+  }
+  return fp;
+}
+
+/* Removes the cached fingerprint of `inst`, if any. */
+static void _fingerprint_forget(DLiteInstance *inst)
+{
+  Fingerprints *fp;
+  if (!(fp = dlite_globals_get_state("dlite-fingerprints"))) return;
+  thread_mutex_lock(&fp->mutex);
+  map_remove(&fp->map, inst->uuid);
+  inst->_flags &= ~dliteFlagFingerprint;
+  thread_mutex_unlock(&fp->mutex);
+}
+
+/* Adds `n` bytes at `p` to the digest. */
+static void _fp_bytes(MD5_CTX *c, const void *p, size_t n)
+{
+  const unsigned char *q = p;
+  while (n > 0) {
+    unsigned long m = (n > 0x40000000) ? 0x40000000 : (unsigned long)n;
+    MD5Update(c, q, m);
+    q += m;
+    n -= m;
+  }
+}
+
+/* Adds integer `v` to the digest. */
+static void _fp_uint(MD5_CTX *c, uint64_t v)
+{
+  v = htole64(v);
+  MD5Update(c, &v, sizeof(v));
+}
+
+/* Adds string `s` to the digest.  NULL and "" are distinguished by
+   the length prefix. */
+static void _fp_str(MD5_CTX *c, const char *s)
+{
+  if (!s) {
+    _fp_uint(c, 0);
+  } else {
+    size_t len = strlen(s);
+    _fp_uint(c, len + 1);
+    _fp_bytes(c, s, len);
+  }
+}
+
+/* Adds `nmemb` elements of type `type` and size `size` at `ptr` to the
+   digest. */
+static void _fp_items(MD5_CTX *c, const void *ptr, size_t nmemb,
+                      DLiteType type, size_t size)
+{
+  const char *p = ptr;
+  size_t n;
+  int i;
+  switch (type) {
+  case dliteBool:
+    for (n=0; n < nmemb; n++) {
+      unsigned char b = (*(const bool *)(p + n*size)) ? 1 : 0;
+      MD5Update(c, &b, 1);
+    }
+    break;
+  case dliteInt:
+  case dliteUInt:
+  case dliteFloat:
+    if (htole16(1) == 1 || size == 1 ||
+        (size != 2 && size != 4 && size != 8)) {
+      _fp_bytes(c, p, nmemb*size);
+    } else {
+      for (n=0; n < nmemb; n++) {
+        unsigned char buf[8];
+        for (i=0; i < (int)size; i++) buf[i] = p[n*size + size - 1 - i];
+        MD5Update(c, buf, (unsigned long)size);
+      }
+    }
+    break;
+  case dliteFixString:
+    for (n=0; n < nmemb; n++) {
+      size_t len = strnlen(p + n*size, size);
+      _fp_uint(c, len + 1);
+      _fp_bytes(c, p + n*size, len);
+    }
+    break;
+  case dliteStringPtr:
+    for (n=0; n < nmemb; n++) _fp_str(c, *(char **)(p + n*size));
+    break;
+  case dliteDimension:
+    for (n=0; n < nmemb; n++) {
+      const DLiteDimension *d = (const DLiteDimension *)(p + n*size);
+      _fp_str(c, d->name);
+      _fp_str(c, d->description);
+    }
+    break;
+  case dliteProperty:
+    for (n=0; n < nmemb; n++) {
+      const DLiteProperty *prop = (const DLiteProperty *)(p + n*size);
+      _fp_str(c, prop->name);
+      if (dlite_type_is_struct(prop->type))
+        _fp_str(c, dlite_struct_get(prop->type)->name);
+      else
+        _fp_uint(c, prop->type);
+      _fp_uint(c, prop->size);
+      _fp_uint(c, prop->ndims);
+      for (i=0; i < prop->ndims; i++)
+        _fp_str(c, (prop->dims) ? prop->dims[i] : NULL);
+      _fp_str(c, prop->unit);
+      _fp_str(c, prop->iri);
+      _fp_str(c, prop->description);
+    }
+    break;
+  case dliteRelation:
+    for (n=0; n < nmemb; n++) {
+      const DLiteRelation *r = (const DLiteRelation *)(p + n*size);
+      _fp_str(c, r->s);
+      _fp_str(c, r->p);
+      _fp_str(c, r->o);
+    }
+    break;
+  default:  /* dliteBlob */
+    _fp_bytes(c, p, nmemb*size);
+    break;
+  }
+}
+
+/*
+  Calculates a 128-bit fingerprint of the content of `inst` and
+  writes it to `fingerprint`.  Returns non-zero on error.
+ */
+int dlite_instance_fingerprint(const DLiteInstance *inst,
+                               unsigned char *fingerprint)
+{
+  const DLiteMeta *meta = inst->meta;
+  Fingerprints *fp;
+  Fingerprint *q, f;
+  MD5_CTX c;
+  size_t i;
+  int j;
+
+  if (!meta) return errx(1, "no metadata available");
+  if (!(fp = _fingerprints())) return 1;
+  if (inst->_flags & (dliteFlagFingerprint | dliteFlagFrozen)) {
+    thread_mutex_lock(&fp->mutex);
+    if ((inst->_flags & (dliteFlagFingerprint | dliteFlagFrozen)) &&
+        (q = map_get(&fp->map, inst->uuid))) {
+      memcpy(fingerprint, q->digest, DLITE_FINGERPRINT_SIZE);
+      thread_mutex_unlock(&fp->mutex);
+      return 0;
+    }
+    thread_mutex_unlock(&fp->mutex);
+  }
+
+  MD5Init(&c);
+  _fp_str(&c, meta->uri);
+  _fp_uint(&c, meta->_ndimensions);
+  for (i=0; i < meta->_ndimensions; i++) _fp_uint(&c, DLITE_DIM(inst, i));
+  _fp_uint(&c, meta->_nproperties);
+  for (i=0; i < meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    const void *ptr = dlite_instance_get_property_by_index(inst, i);
+    size_t nmemb=1;
+    for (j=0; j < p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+    if (!ptr && (p->ndims == 0 || nmemb > 0)) return 1;
+    _fp_items(&c, ptr, nmemb, p->type, p->size);
+  }
+  MD5Final(f.digest, &c);
+  memcpy(fingerprint, f.digest, DLITE_FINGERPRINT_SIZE);
+
+  thread_mutex_lock(&fp->mutex);
+  if (map_set(&fp->map, inst->uuid, f) == 0 &&
+      !(inst->_flags & dliteFlagFrozen))
+    ((DLiteInstance *)inst)->_flags |= dliteFlagFingerprint;
+  thread_mutex_unlock(&fp->mutex);
+  return 0;
+}
+
+
+/********************************************************************
+ *  Value indexes
+ *
+ *  A value index maps the value of a scalar property to the instances
+ *  of a metadata in the instance store that have this value.
+ *  Instances of metadata with indexes are marked with dliteFlagIndexed.
+ *  Since _dirty_mark() may be called before the new value is assigned
+ *  and loaded properties are written directly, created and modified
+ *  instances are only queued as pending and (re-)keyed by the next
+ *  lookup.  All indexes are protected by a single global mutex.
+ ********************************************************************/
+
+typedef struct {
+  double number;          /* key of numerical properties */
+  char *string;           /* key of string properties, NULL otherwise */
+} IndexKey;
+
+typedef struct {
+  IndexKey key;           /* key, the string is owned by `keys` */
+  DLiteInstance *inst;    /* borrowed reference */
+} IndexEntry;
+
+typedef struct {
+  DLiteInstance **insts;  /* borrowed references */
+  size_t n;               /* number of instances */
+  size_t size;            /* allocated length of `insts` */
+} IndexBucket;
+
+typedef map_t(IndexKey) index_key_map_t;
+typedef map_t(IndexBucket) index_bucket_map_t;
+typedef map_t(DLiteInstance *) index_pending_map_t;
+
+struct _DLiteIndex {
+  DLiteMeta *meta;              /* metadata of indexed instances */
+  size_t prop;                  /* index of indexed property */
+  DLiteIndexKind kind;          /* kind of index */
+  int isstring;                 /* whether keys are strings */
+  index_key_map_t keys;         /* maps uuid to current key */
+  index_pending_map_t pending;  /* maps uuid of instances to (re-)key */
+  index_bucket_map_t buckets;   /* hash index: maps key to instances */
+  IndexEntry *entries;          /* sorted index: entries sorted by key */
+  size_t nentries;              /* sorted index: number of entries */
+  size_t size;                  /* sorted index: allocated entries */
+};
+
+typedef struct {
+  ThreadMutex mutex;
+  DLiteIndex **indexes;         /* all indexes */
+  size_t nindexes;              /* number of indexes */
+  size_t size;                  /* allocated length of `indexes` */
+} ValueIndexes;
+
+static ThreadMutex _value_indexes_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees the list of value indexes.  The indexes themselves are owned
+   by the user. */
+static void _value_indexes_free(void *value_indexes)
+{
+  ValueIndexes *vi = value_indexes;
+  if (vi->indexes) free(vi->indexes);
+  thread_mutex_destroy(&vi->mutex);
+  free(vi);
+}
+
+/* Returns pointer to the list of value indexes. */
+static ValueIndexes *_value_indexes(void)
+{
+  ValueIndexes *vi = dlite_globals_get_state("dlite-value-indexes");
+  if (!vi) {
+    thread_mutex_lock(&_value_indexes_mutex);
+    if (!(vi = dlite_globals_get_state("dlite-value-indexes"))) {
+      if ((vi = calloc(1, sizeof(ValueIndexes)))) {
+        thread_mutex_init(&vi->mutex);
+        dlite_globals_add_state("dlite-value-indexes", vi,
+                                _value_indexes_free);
+      }
+    }
+    thread_mutex_unlock(&_value_indexes_mutex);
+    if (!vi) return err(1, "allocation failure"), NULL;
+  }
+  return vi;
+}
+
+/* Returns non-zero if property `p` can be indexed. */
+static int _index_supported(const DLiteProperty *p)
+{
+  if (p->ndims) return 0;
+  switch (p->type) {
+  case dliteBool:
+  case dliteFixString:
+  case dliteStringPtr:
+    return 1;
+  case dliteInt:
+  case dliteUInt:
+    return (p->size == 1 || p->size == 2 || p->size == 4 || p->size == 8);
+  case dliteFloat:
+    return (p->size == sizeof(float) || p->size == sizeof(double));
+  default:
+    return 0;
+  }
+}
+
+/* Assigns `key` from the value at `ptr` of property `p`, which must be
+   supported by _index_supported().  String keys are newly malloc'ed.
+   Returns non-zero on error. */
+static int _index_key(const DLiteProperty *p, const void *ptr, IndexKey *key)
+{
+  const char *s;
+  size_t len;
+  key->number = 0.0;
+  key->string = NULL;
+  switch (p->type) {
+  case dliteBool:
+    key->number = (*(bool *)ptr) ? 1.0 : 0.0;
+    return 0;
+  case dliteInt:
+    switch (p->size) {
+    case 1: key->number = *(int8_t *)ptr; break;
+    case 2: key->number = *(int16_t *)ptr; break;
+    case 4: key->number = *(int32_t *)ptr; break;
+    case 8: key->number = (double)*(int64_t *)ptr; break;
+    }
+    return 0;
+  case dliteUInt:
+    switch (p->size) {
+    case 1: key->number = *(uint8_t *)ptr; break;
+    case 2: key->number = *(uint16_t *)ptr; break;
+    case 4: key->number = *(uint32_t *)ptr; break;
+    case 8: key->number = (double)*(uint64_t *)ptr; break;
+    }
+    return 0;
+  case dliteFloat:
+    key->number = (p->size == sizeof(float)) ? *(float *)ptr : *(double *)ptr;
+    if (key->number == 0.0) key->number = 0.0;  /* normalise -0.0 */
+    return 0;
+  case dliteFixString:
+    s = ptr;
+    for (len=0; len < p->size && s[len]; len++) ;
+    break;
+  default:
+    s = (*(char **)ptr) ? *(char **)ptr : "";
+    len = strlen(s);
+    break;
+  }
+  if (!(key->string = malloc(len + 1))) return err(1, "allocation failure");
+  memcpy(key->string, s, len);
+  key->string[len] = '\0';
+  return 0;
+}
+
+/* Returns the key of `key` in the buckets of a hash index.  `buf` must
+   have space for at least 32 bytes. */
+static const char *_index_hashkey(const IndexKey *key, char *buf)
+{
+  if (key->string) return key->string;
+  snprintf(buf, 32, "%.17g", key->number);
+  return buf;
+}
+
+/* Compares keys `a` and `b`.  Returns negative, zero or positive if `a`
+   is less than, equal to or greater than `b`. */
+static int _index_cmp(const IndexKey *a, const IndexKey *b)
+{
+  if (a->string) return strcmp(a->string, b->string);
+  return (a->number > b->number) - (a->number < b->number);
+}
+
+/* Returns the position of the first entry in sorted index `idx` that is
+   not less than `key` (or greater than `key` if `upper` is true). */
+static size_t _index_bound(const DLiteIndex *idx, const IndexKey *key,
+                           int upper)
+{
+  size_t lo=0, hi=idx->nentries;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int c = _index_cmp(&idx->entries[mid].key, key);
+    if (c < 0 || (upper && c == 0))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Removes `inst` from index `idx`. */
+static void _index_remove(DLiteIndex *idx, const DLiteInstance *inst)
+{
+  IndexKey *key;
+  size_t i;
+  if (!(key = map_get(&idx->keys, inst->uuid))) return;
+  if (idx->kind == dliteIndexHash) {
+    char buf[32];
+    const char *k = _index_hashkey(key, buf);
+    IndexBucket *b = map_get(&idx->buckets, k);
+    for (i=0; b && i < b->n; i++) {
+      if (b->insts[i] != inst) continue;
+      b->insts[i] = b->insts[--b->n];
+      if (b->n == 0) {
+        free(b->insts);
+        map_remove(&idx->buckets, k);
+      }
+      break;
+    }
+  } else {
+    for (i=_index_bound(idx, key, 0); i < idx->nentries &&
+           _index_cmp(&idx->entries[i].key, key) == 0; i++) {
+      if (idx->entries[i].inst != inst) continue;
+      memmove(idx->entries + i, idx->entries + i + 1,
+              (idx->nentries - i - 1) * sizeof(IndexEntry));
+      idx->nentries--;
+      break;
+    }
+  }
+  if (key->string) free(key->string);
+  map_remove(&idx->keys, inst->uuid);
+}
+
+/* Inserts `inst` with key `key` into index `idx`, which takes over the
+   ownership of the key string.  Returns non-zero on error. */
+static int _index_insert(DLiteIndex *idx, DLiteInstance *inst, IndexKey key)
+{
+  if (map_set(&idx->keys, inst->uuid, key)) {
+    if (key.string) free(key.string);
+    return err(1, "allocation failure");
+  }
+  if (idx->kind == dliteIndexHash) {
+    char buf[32];
+    const char *k = _index_hashkey(&key, buf);
+    IndexBucket *b = map_get(&idx->buckets, k);
+    if (!b) {
+      IndexBucket empty = {NULL, 0, 0};
+      if (map_set(&idx->buckets, k, empty) ||
+          !(b = map_get(&idx->buckets, k))) goto fail;
+    }
+    if (b->n >= b->size) {
+      size_t size = (b->size) ? 2*b->size : 4;
+      DLiteInstance **insts = realloc(b->insts, size * sizeof(*insts));
+      if (!insts) goto fail;
+      b->insts = insts;
+      b->size = size;
+    }
+    b->insts[b->n++] = inst;
+  } else {
+    size_t pos = _index_bound(idx, &key, 1);
+    if (idx->nentries >= idx->size) {
+      size_t size = (idx->size) ? 2*idx->size : 64;
+      IndexEntry *entries = realloc(idx->entries, size * sizeof(IndexEntry));
+      if (!entries) goto fail;
+      idx->entries = entries;
+      idx->size = size;
+    }
+    memmove(idx->entries + pos + 1, idx->entries + pos,
+            (idx->nentries - pos) * sizeof(IndexEntry));
+    idx->entries[pos].key = key;
+    idx->entries[pos].inst = inst;
+    idx->nentries++;
+  }
+  return 0;
+ fail:
+  if (key.string) free(key.string);
+  map_remove(&idx->keys, inst->uuid);
+  return err(1, "allocation failure");
+}
+
+/* (Re-)keys all pending instances of index `idx`.  Instances that
+   cannot be keyed are left out of the index.  Returns non-zero on
+   error. */
+static int _index_flush(DLiteIndex *idx)
+{
+  const DLiteProperty *p = idx->meta->_properties + idx->prop;
+  map_iter_t iter = map_iter(&idx->pending);
+  const char *uuid;
+  int retval=0;
+  while ((uuid = map_next(&idx->pending, &iter))) {
+    DLiteInstance *inst = *map_get(&idx->pending, uuid);
+    IndexKey key;
+    _index_remove(idx, inst);
+    if ((inst->_flags & dliteFlagLazy) && _lazy_load(inst, idx->prop, 1))
+      retval = 1;
+    else if (_index_key(p, DLITE_PROP(inst, idx->prop), &key) ||
+             _index_insert(idx, inst, key))
+      retval = 1;
+  }
+  map_deinit(&idx->pending);
+  map_init(&idx->pending);
+  return retval;
+}
+
+/* Queues `inst` as pending in index `idx`.  Returns non-zero on error. */
+static int _index_pend(DLiteIndex *idx, DLiteInstance *inst)
+{
+  if (map_set(&idx->pending, inst->uuid, inst))
+    return err(1, "allocation failure");
+  inst->_flags |= dliteFlagIndexed;
+  return 0;
+}
+
+/* Adds the newly created instance `inst` to the indexes of its
+   metadata. */
+static void _index_add(DLiteInstance *inst)
+{
+  ValueIndexes *vi;
+  size_t i;
+  if (!(vi = dlite_globals_get_state("dlite-value-indexes"))) return;
+  thread_mutex_lock(&vi->mutex);
+  for (i=0; i < vi->nindexes; i++)
+    if (vi->indexes[i]->meta == inst->meta)
+      _index_pend(vi->indexes[i], inst);
+  thread_mutex_unlock(&vi->mutex);
+}
+
+/* Marks property `i` of `inst` as modified in the indexes of its
+   metadata.  If `i` is negative, all properties are marked. */
+static void _index_mark(DLiteInstance *inst, int i)
+{
+  ValueIndexes *vi;
+  size_t k;
+  if (!(vi = dlite_globals_get_state("dlite-value-indexes"))) return;
+  thread_mutex_lock(&vi->mutex);
+  for (k=0; k < vi->nindexes; k++) {
+    DLiteIndex *idx = vi->indexes[k];
+    if (idx->meta == inst->meta && (i < 0 || idx->prop == (size_t)i))
+      _index_pend(idx, inst);
+  }
+  thread_mutex_unlock(&vi->mutex);
+}
+
+/* Removes `inst` from the indexes of its metadata. */
+static void _index_forget(DLiteInstance *inst)
+{
+  ValueIndexes *vi;
+  size_t i;
+  if (!(vi = dlite_globals_get_state("dlite-value-indexes"))) return;
+  thread_mutex_lock(&vi->mutex);
+  for (i=0; i < vi->nindexes; i++) {
+    DLiteIndex *idx = vi->indexes[i];
+    if (idx->meta != inst->meta) continue;
+    map_remove(&idx->pending, inst->uuid);
+    _index_remove(idx, inst);
+  }
+  inst->_flags &= ~dliteFlagIndexed;
+  thread_mutex_unlock(&vi->mutex);
+}
+
+/* Callback for dlite_instance_store_foreach() queuing existing
+   instances of the metadata of index `data`. */
+static int _index_pend_existing(const DLiteInstance *inst, void *data)
+{
+  DLiteIndex *idx = data;
+  if (inst->meta != idx->meta) return 0;
+  return _index_pend(idx, (DLiteInstance *)inst);
+}
+
+/* Callback for dlite_instance_store_foreach() unmarking instances of
+   metadata `data`. */
+static int _index_unmark(const DLiteInstance *inst, void *data)
+{
+  if (inst->meta == data)
+    ((DLiteInstance *)inst)->_flags &= ~dliteFlagIndexed;
+  return 0;
+}
+
+/* Increases the refcount of `inst` unless it has reached zero, in which
+   case it is about to be free'ed.  Returns non-zero on success. */
+static int _index_incref(DLiteInstance *inst)
+{
+  int count;
+  if (inst->_flags & dliteFlagImmortal) return 1;
+  do {
+    if ((count = thread_atomic_load(&inst->_refcount)) <= 0) return 0;
+  } while (!thread_atomic_cas(&inst->_refcount, count, count + 1));
+  return 1;
+}
+
+/*
+  Creates an index over the value of the scalar property `property`
+  of all instances of `meta` in the instance store.
+ */
+DLiteIndex *dlite_index_create(DLiteMeta *meta, const char *property,
+                               DLiteIndexKind kind)
+{
+  ValueIndexes *vi;
+  DLiteIndex *idx;
+  const DLiteProperty *p;
+  int i, stat;
+  if ((i = dlite_meta_get_property_index(meta, property)) < 0) return NULL;
+  p = meta->_properties + i;
+  if (!_index_supported(p))
+    return errx(1, "cannot index property '%s' of type %s and size %d",
+                p->name, dlite_type_get_dtypename(p->type),
+                (int)p->size), NULL;
+  if (kind != dliteIndexHash && kind != dliteIndexSorted)
+    return errx(1, "invalid index kind: %d", kind), NULL;
+  if (!(vi = _value_indexes())) return NULL;
+  if (!(idx = calloc(1, sizeof(DLiteIndex))))
+    return err(1, "allocation failure"), NULL;
+  idx->meta = meta;
+  idx->prop = i;
+  idx->kind = kind;
+  idx->isstring = (p->type == dliteFixString || p->type == dliteStringPtr);
+  map_init(&idx->keys);
+  map_init(&idx->pending);
+  map_init(&idx->buckets);
+  dlite_meta_incref(meta);
+
+  thread_mutex_lock(&vi->mutex);
+  if (vi->nindexes >= vi->size) {
+    size_t size = (vi->size) ? 2*vi->size : 8;
+    DLiteIndex **indexes = realloc(vi->indexes, size * sizeof(DLiteIndex *));
+    if (!indexes) {
+      thread_mutex_unlock(&vi->mutex);
+      dlite_index_free(idx);
+      return err(1, "allocation failure"), NULL;
+    }
+    vi->indexes = indexes;
+    vi->size = size;
+  }
+  vi->indexes[vi->nindexes++] = idx;
+  stat = dlite_instance_store_foreach(_index_pend_existing, idx);
+  thread_mutex_unlock(&vi->mutex);
+  if (stat) {
+    dlite_index_free(idx);
+    return NULL;
+  }
+  return idx;
+}
+
+/*
+  Frees index `index`.
+ */
+void dlite_index_free(DLiteIndex *index)
+{
+  ValueIndexes *vi;
+  map_iter_t iter;
+  const char *key;
+  size_t i;
+  int used=0;
+  if ((vi = dlite_globals_get_state("dlite-value-indexes"))) {
+    thread_mutex_lock(&vi->mutex);
+    for (i=0; i < vi->nindexes; i++) {
+      if (vi->indexes[i] == index) {
+        vi->indexes[i--] = vi->indexes[--vi->nindexes];
+      } else if (vi->indexes[i]->meta == index->meta) {
+        used = 1;
+      }
+    }
+    if (!used)
+      dlite_instance_store_foreach(_index_unmark, index->meta);
+    thread_mutex_unlock(&vi->mutex);
+  }
+
+  iter = map_iter(&index->keys);
+  while ((key = map_next(&index->keys, &iter))) {
+    IndexKey *k = map_get(&index->keys, key);
+    if (k->string) free(k->string);
+  }
+  iter = map_iter(&index->buckets);
+  while ((key = map_next(&index->buckets, &iter)))
+    free(map_get(&index->buckets, key)->insts);
+  map_deinit(&index->keys);
+  map_deinit(&index->pending);
+  map_deinit(&index->buckets);
+  if (index->entries) free(index->entries);
+  dlite_meta_decref(index->meta);
+  free(index);
+}
+
+/* Help function for dlite_index_lookup() and dlite_index_range().
+   Assigns `*insts` to a newly malloc'ed array with new references to
+   the `n` instances in `candidates`, separated by `stride` bytes.
+   Instances about to be free'ed are skipped.  Returns the number of
+   instances or -1 on error. */
+static int _index_result(DLiteInstance **candidates, size_t n,
+                         size_t stride, DLiteInstance ***insts)
+{
+  size_t i;
+  int m=0;
+  *insts = NULL;
+  if (n == 0) return 0;
+  if (!(*insts = malloc(n * sizeof(DLiteInstance *))))
+    return err(-1, "allocation failure");
+  for (i=0; i<n; i++) {
+    DLiteInstance *inst = *(DLiteInstance **)((char *)candidates + i*stride);
+    if (_index_incref(inst)) (*insts)[m++] = inst;
+  }
+  return m;
+}
+
+/*
+  Looks up instances in `index` whos indexed property equals `value`.
+ */
+int dlite_index_lookup(DLiteIndex *index, const void *value,
+                       DLiteInstance ***insts)
+{
+  const DLiteProperty *p = index->meta->_properties + index->prop;
+  ValueIndexes *vi;
+  IndexKey key;
+  int n;
+  *insts = NULL;
+  if (!(vi = _value_indexes())) return -1;
+  if (_index_key(p, value, &key)) return -1;
+  thread_mutex_lock(&vi->mutex);
+  if (_index_flush(index)) {
+    n = -1;
+  } else if (index->kind == dliteIndexHash) {
+    char buf[32];
+    IndexBucket *b = map_get(&index->buckets, _index_hashkey(&key, buf));
+    n = (b) ? _index_result(b->insts, b->n, sizeof(DLiteInstance *),
+                            insts) : 0;
+  } else {
+    size_t lo = _index_bound(index, &key, 0);
+    size_t hi = _index_bound(index, &key, 1);
+    n = (lo < hi) ? _index_result(&index->entries[lo].inst, hi - lo,
+                                  sizeof(IndexEntry), insts) : 0;
+  }
+  thread_mutex_unlock(&vi->mutex);
+  if (key.string) free(key.string);
+  return n;
+}
+
+/*
+  Looks up instances in sorted index `index` whos indexed property is
+  in the range [`low`, `high`].
+ */
+int dlite_index_range(DLiteIndex *index, const void *low, const void *high,
+                      DLiteInstance ***insts)
+{
+  const DLiteProperty *p = index->meta->_properties + index->prop;
+  ValueIndexes *vi;
+  IndexKey lowkey={0.0, NULL}, highkey={0.0, NULL};
+  int n=-1;
+  *insts = NULL;
+  if (index->kind != dliteIndexSorted)
+    return errx(-1, "range lookups requires a sorted index");
+  if (!(vi = _value_indexes())) return -1;
+  if (low && _index_key(p, low, &lowkey)) goto fail;
+  if (high && _index_key(p, high, &highkey)) goto fail;
+  thread_mutex_lock(&vi->mutex);
+  if (_index_flush(index) == 0) {
+    size_t lo = (low) ? _index_bound(index, &lowkey, 0) : 0;
+    size_t hi = (high) ? _index_bound(index, &highkey, 1) : index->nentries;
+    n = (lo < hi) ? _index_result(&index->entries[lo].inst, hi - lo,
+                                  sizeof(IndexEntry), insts) : 0;
+  }
+  thread_mutex_unlock(&vi->mutex);
+ fail:
+  if (lowkey.string) free(lowkey.string);
+  if (highkey.string) free(highkey.string);
+  return n;
+}
+
+
+/********************************************************************
+ *  Dirty tracking
+ *
+ *  When an instance is saved with the data model api, the storage is
+ *  recorded and the instance marked with dliteFlagSaved.  From then
+ *  on, properties modified with dlite_instance_set_property() and
+ *  friends or marked with dlite_instance_mark_dirty() are tracked,
+ *  such that the next save to the same storage only needs to write
+ *  the modified properties.  The state is kept in a global map keyed
+ *  by the instance uuid.
+ *
+ *  The dimension sizes at the last save are recorded as well.  Rows
+ *  appended along the first dimension of a property (see
+ *  dlite_instance_append_dimension()) do not mark it as modified, but
+ *  are written as a slice by the next save.
+ ********************************************************************/
+
+/* Flags of instances whos modifications are tracked.  Modifying an
+   instance clears dliteFlagReloadable (see the bounded instance store
+   below) and dliteFlagFingerprint (see fingerprints above) and queues
+   instances with dliteFlagIndexed for re-keying (see value indexes
+   above). */
+#define DIRTY_FLAGS (dliteFlagSaved | dliteFlagReloadable | \
+                     dliteFlagFingerprint | dliteFlagIndexed)
+
+typedef struct {
+  const DLiteStoragePlugin *api;  /* api of storage last saved to */
+  char *location;                 /* location of storage last saved to */
+  size_t *dims;                   /* dimension sizes followed by property
+                                     dimensions when last saved */
+  unsigned char dirty[];          /* whether each property is modified */
+} DirtyState;
+
+typedef map_t(DirtyState *) dirty_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  dirty_map_t map;
+} DirtyInstances;
+
+static ThreadMutex _dirty_instances_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees dirty state. */
+static void _dirty_state_free(DirtyState *state)
+{
+  free(state->location);
+  if (state->dims) free(state->dims);
+  free(state);
+}
+
+/* Frees the map of dirty states. */
+static void _dirty_instances_free(void *dirty_instances)
+{
+  DirtyInstances *di = dirty_instances;
+  const char *uuid;
+  map_iter_t iter = map_iter(&di->map);
+  while ((uuid = map_next(&di->map, &iter))) {
+    DirtyState **q = map_peek(&di->map, uuid);
+    if (q && *q) _dirty_state_free(*q);
+  }
+  map_deinit(&di->map);
+  thread_mutex_destroy(&di->mutex);
+  free(di);
+}
+
+/* Returns pointer to the map of dirty states. */
+static DirtyInstances *_dirty_instances(void)
+{
+  DirtyInstances *di = dlite_globals_get_state("dlite-dirty-instances");
+  if (!di) {
+    thread_mutex_lock(&_dirty_instances_mutex);
+    if (!(di = dlite_globals_get_state("dlite-dirty-instances"))) {
+      if ((di = calloc(1, sizeof(DirtyInstances)))) {
+        thread_mutex_init(&di->mutex);
+        map_init(&di->map);
+        dlite_globals_add_state("dlite-dirty-instances", di,
+                                _dirty_instances_free);
+      }
+    }
+    thread_mutex_unlock(&_dirty_instances_mutex);
+    if (!di) return err(1, "allocation failure"), NULL;
+  }
+  return di;
+}
+
+/* Marks property `i` of `inst` as modified.  If `i` is negative, all
+   properties are marked. */
+static void _dirty_mark(const DLiteInstance *inst, int i)
+{
+  DirtyInstances *di;
+  DirtyState **q;
+  ((DLiteInstance *)inst)->_flags &= ~dliteFlagReloadable;
+  if (inst->_flags & dliteFlagFingerprint)
+    _fingerprint_forget((DLiteInstance *)inst);
+  if (inst->_flags & dliteFlagIndexed)
+    _index_mark((DLiteInstance *)inst, i);
+  if (!(inst->_flags & dliteFlagSaved)) return;
+  if (!(di = dlite_globals_get_state("dlite-dirty-instances"))) return;
+  thread_mutex_lock(&di->mutex);
+  if ((q = map_peek(&di->map, inst->uuid)) && *q) {
+    if (i >= 0)
+      (*q)->dirty[i] = 1;
+    else
+      memset((*q)->dirty, 1, inst->meta->_nproperties);
+  }
+  thread_mutex_unlock(&di->mutex);
+}
+
+/* Returns the number of elements in DirtyState.dims for `inst`. */
+static size_t _dirty_ndims(const DLiteInstance *inst)
+{
+  return inst->meta->_ndimensions + inst->meta->_npropdims;
+}
+
+/* If `inst` was last saved to storage `s`, a newly malloc'ed array
+   with the modified properties is returned and the dirty bits are
+   cleared.  Otherwise NULL is returned.
+
+   If `saveddims` is not NULL, it is assigned to a newly malloc'ed copy
+   of the dimension sizes and property dimensions when `inst` was last
+   saved.  It is set to NULL if they are not known. */
+static unsigned char *_dirty_begin(const DLiteInstance *inst,
+                                   const DLiteStorage *s, size_t **saveddims)
+{
+  DirtyInstances *di;
+  DirtyState **q, *state;
+  unsigned char *dirty=NULL;
+  size_t nprops = inst->meta->_nproperties;
+  size_t nbytes = _dirty_ndims(inst) * sizeof(size_t);
+  if (saveddims) *saveddims = NULL;
+  if (!(di = dlite_globals_get_state("dlite-dirty-instances"))) return NULL;
+  thread_mutex_lock(&di->mutex);
+  if ((q = map_peek(&di->map, inst->uuid)) && (state = *q) &&
+      state->api == s->api && strcmp(state->location, s->location) == 0 &&
+      (dirty = malloc(nprops))) {
+    memcpy(dirty, state->dirty, nprops);
+    memset(state->dirty, 0, nprops);
+    if (saveddims && state->dims && nbytes && (*saveddims = malloc(nbytes)))
+      memcpy(*saveddims, state->dims, nbytes);
+  }
+  thread_mutex_unlock(&di->mutex);
+  return dirty;
+}
+
+/* Records that `inst` has been saved to storage `s`.  Properties
+   marked as modified after _dirty_begin() remain marked. */
+static void _dirty_saved(DLiteInstance *inst, const DLiteStorage *s,
+                         int incremental)
+{
+  DirtyInstances *di;
+  DirtyState **q, *state=NULL;
+  char *location;
+  if (inst->_flags & dliteFlagFrozen) return;
+  if (!(di = _dirty_instances())) return;
+  if (!(location = strdup(s->location))) return;
+  thread_mutex_lock(&di->mutex);
+  if ((q = map_peek(&di->map, inst->uuid)) && (state = *q)) {
+    if (!incremental) memset(state->dirty, 0, inst->meta->_nproperties);
+    free(state->location);
+  } else if ((state = calloc(1, sizeof(DirtyState) +
+                             inst->meta->_nproperties))) {
+    if (map_set(&di->map, inst->uuid, state)) {
+      free(state);
+      state = NULL;
+    }
+  }
+  if (state) {
+    size_t ndims = _dirty_ndims(inst);
+    size_t *dims = realloc(state->dims, ndims * sizeof(size_t));
+    if (dims && ndims) {
+      memcpy(dims, DLITE_DIMS(inst),
+             inst->meta->_ndimensions * sizeof(size_t));
+      memcpy(dims + inst->meta->_ndimensions, DLITE_PROP_DIMS(inst, 0),
+             inst->meta->_npropdims * sizeof(size_t));
+    }
+    state->dims = dims;
+    state->api = s->api;
+    state->location = location;
+    inst->_flags |= dliteFlagSaved;
+  } else {
+    free(location);
+  }
+  thread_mutex_unlock(&di->mutex);
+}
+
+/* Stops dirty tracking of `inst`. */
+static void _dirty_release(DLiteInstance *inst)
+{
+  DirtyInstances *di;
+  DirtyState **q;
+  if (!(di = dlite_globals_get_state("dlite-dirty-instances"))) return;
+  thread_mutex_lock(&di->mutex);
+  if ((q = map_peek(&di->map, inst->uuid)) && *q) {
+    _dirty_state_free(*q);
+    map_remove(&di->map, inst->uuid);
+  }
+  inst->_flags &= ~dliteFlagSaved;
+  thread_mutex_unlock(&di->mutex);
+}
+
+/* Returns non-zero if data model `d` contains `inst` with the
+   dimension sizes `saveddims` and all properties, such that only
+   modified properties and appended rows need to be written.  If
+   `saveddims` is NULL, the dimension sizes of `inst` are assumed. */
+static int _dirty_can_update(const DLiteInstance *inst, DLiteDataModel *d,
+                             const size_t *saveddims)
+{
+  size_t i;
+  if (!d->api->hasDimension || !d->api->hasProperty) return 0;
+  for (i=0; i < inst->meta->_ndimensions; i++) {
+    const char *name = inst->meta->_dimensions[i].name;
+    size_t size = (saveddims) ? saveddims[i] : DLITE_DIM(inst, i);
+    if (dlite_datamodel_has_dimension(d, name) <= 0) return 0;
+    if (dlite_datamodel_get_dimension_size(d, name) != (int)size) return 0;
+  }
+  for (i=0; i < inst->meta->_nproperties; i++)
+    if (dlite_datamodel_has_property(d, inst->meta->_properties[i].name) <= 0)
+      return 0;
+  return 1;
+}
+
+/*
+  Marks property `i` of `inst` as modified, such that it is written
+  by the next call to dlite_instance_save().  This is needed after
+  modifying a property directly (e.g. via DLITE_PROP()), since only
+  dlite_instance_set_property() and friends mark properties
+  automatically.  If `i` is negative, all properties are marked.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_mark_dirty_by_index(DLiteInstance *inst, int i)
+{
+  if (i >= (int)inst->meta->_nproperties)
+    return errx(1, "index %d exceeds number of properties (%d) in %s",
+                i, (int)inst->meta->_nproperties, inst->meta->uri);
+  if (inst->_flags & dliteFlagFrozen) return _frozen_error(inst);
+  if (inst->_flags & DIRTY_FLAGS) _dirty_mark(inst, i);
+  return 0;
+}
+
+/*
+  Like dlite_instance_mark_dirty_by_index(), but marks property `name`.
+  If `name` is NULL, all properties are marked.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_mark_dirty(DLiteInstance *inst, const char *name)
+{
+  int i = -1;
+  if (name && (i = dlite_meta_get_property_index(inst->meta, name)) < 0)
+    return 1;
+  return dlite_instance_mark_dirty_by_index(inst, i);
+}
+
+
+/********************************************************************
+ *  Reserved capacity
+ *
+ *  Property arrays may be allocated with room for more elements than
+ *  given by the dimension sizes, such that growing a dimension doesn't
+ *  require reallocation (see dlite_instance_reserve_dimension()).
+ *  The allocated number of elements of each array is kept in a global
+ *  map keyed by the instance uuid, and the instances are marked with
+ *  dliteFlagReserved.  A recorded capacity is only valid as long as
+ *  the property still points to the same array.  Capacities are never
+ *  used for instances that share or adopt property arrays.
+ ********************************************************************/
+
+typedef struct {
+  void *ptr;          /* Array the capacity refers to. */
+  size_t capacity;    /* Number of allocated elements of `ptr`. */
+} ReservedArray;
+
+typedef map_t(ReservedArray *) reserved_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  reserved_map_t map;  /* Maps uuid to array of length nproperties. */
+} ReservedInstances;
+
+static ThreadMutex _reserved_instances_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees the map of reserved capacities. */
+static void _reserved_instances_free(void *reserved_instances)
+{
+  ReservedInstances *ri = reserved_instances;
+  const char *uuid;
+  map_iter_t iter = map_iter(&ri->map);
+  while ((uuid = map_next(&ri->map, &iter))) {
+    ReservedArray **q = map_peek(&ri->map, uuid);
+    if (q && *q) free(*q);
+  }
+  map_deinit(&ri->map);
+  thread_mutex_destroy(&ri->mutex);
+  free(ri);
+}
+
+/* Returns pointer to the map of reserved capacities. */
+static ReservedInstances *_reserved_instances(void)
+{
+  ReservedInstances *ri = dlite_globals_get_state("dlite-reserved-instances");
+  if (!ri) {
+    thread_mutex_lock(&_reserved_instances_mutex);
+    if (!(ri = dlite_globals_get_state("dlite-reserved-instances"))) {
+      if ((ri = calloc(1, sizeof(ReservedInstances)))) {
+        thread_mutex_init(&ri->mutex);
+        map_init(&ri->map);
+        dlite_globals_add_state("dlite-reserved-instances", ri,
+                                _reserved_instances_free);
+      }
+    }
+    thread_mutex_unlock(&_reserved_instances_mutex);
+    if (!ri) return err(1, "allocation failure"), NULL;
+  }
+  return ri;
+}
+
+/* Returns the number of elements allocated for property `i` of `inst`
+   or zero if no capacity is recorded for its current array. */
+static size_t _reserved_get(const DLiteInstance *inst, size_t i)
+{
+  ReservedInstances *ri;
+  ReservedArray **q;
+  size_t capacity=0;
+  if (!(inst->_flags & dliteFlagReserved) ||
+      (inst->_flags & (dliteFlagShared | dliteFlagForeign))) return 0;
+  if (!(ri = dlite_globals_get_state("dlite-reserved-instances"))) return 0;
+  thread_mutex_lock(&ri->mutex);
+  if ((q = map_peek(&ri->map, inst->uuid)) && *q &&
+      (*q)[i].ptr && (*q)[i].ptr == *(void **)DLITE_PROP(inst, i))
+    capacity = (*q)[i].capacity;
+  thread_mutex_unlock(&ri->mutex);
+  return capacity;
+}
+
+/* Records that the current array of property `i` of `inst` has room
+   for `capacity` elements.  Returns non-zero on error. */
+static int _reserved_set(DLiteInstance *inst, size_t i, size_t capacity)
+{
+  ReservedInstances *ri;
+  ReservedArray **q, *arrays=NULL;
+  if (!(ri = _reserved_instances())) return 1;
+  thread_mutex_lock(&ri->mutex);
+  if ((q = map_peek(&ri->map, inst->uuid)) && *q) {
+    arrays = *q;
+  } else if ((arrays = calloc(inst->meta->_nproperties,
+                              sizeof(ReservedArray)))) {
+    if (map_set(&ri->map, inst->uuid, arrays)) {
+      free(arrays);
+      arrays = NULL;
+    }
+  }
+  if (arrays) {
+    arrays[i].ptr = *(void **)DLITE_PROP(inst, i);
+    arrays[i].capacity = capacity;
+    inst->_flags |= dliteFlagReserved;
+  }
+  thread_mutex_unlock(&ri->mutex);
+  if (!arrays) return err(1, "allocation failure");
+  return 0;
+}
+
+/* Forgets the reserved capacities of `inst`. */
+static void _reserved_release(DLiteInstance *inst)
+{
+  ReservedInstances *ri;
+  ReservedArray **q;
+  if (!(ri = dlite_globals_get_state("dlite-reserved-instances"))) return;
+  thread_mutex_lock(&ri->mutex);
+  if ((q = map_peek(&ri->map, inst->uuid)) && *q) {
+    free(*q);
+    map_remove(&ri->map, inst->uuid);
+  }
+  inst->_flags &= ~dliteFlagReserved;
+  thread_mutex_unlock(&ri->mutex);
+}
+
+
+/********************************************************************
+ *  Bounded instance store
+ *
+ *  With a positive budget (see dlite_instance_store_set_budget()), the
+ *  store keeps a reference to data instances loaded from storages.
+ *  They are kept in a list ordered by last access.  When the total
+ *  size of the kept instances exceeds the budget, references are
+ *  released from the least recently used end.  Instances that are
+ *  still marked with dliteFlagReloadable leave a stub with the storage
+ *  they were loaded from, which is used by dlite_instance_get() to
+ *  reload them.  The state is kept in a global map keyed by the
+ *  instance uuid.
+ ********************************************************************/
+
+typedef struct _SpillEntry {
+  DLiteInstance *inst;            /* kept instance, NULL for a stub */
+  size_t nbytes;                  /* size of `inst` when kept */
+  char *driver;                   /* storage to reload from */
+  char *location;
+  char *options;
+  struct _SpillEntry *prev;       /* more recently used instance */
+  struct _SpillEntry *next;       /* less recently used instance */
+} SpillEntry;
+
+typedef map_t(SpillEntry *) spill_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  spill_map_t map;                /* kept instances and stubs */
+  SpillEntry *head;               /* most recently used instance */
+  SpillEntry *tail;               /* least recently used instance */
+  size_t budget;                  /* memory budget in bytes */
+  size_t used;                    /* bytes used by kept instances */
+} SpillStore;
+
+static ThreadMutex _spill_store_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees spill entry. */
+static void _spill_entry_free(SpillEntry *e)
+{
+  free(e->driver);
+  free(e->location);
+  if (e->options) free(e->options);
+  free(e);
+}
+
+/* Frees the bounded instance store.  Kept instances are not released,
+   since the instance store may already be free'ed at this point.  Use
+   dlite_instance_store_set_budget() to release them. */
+static void _spill_store_free(void *spill_store)
+{
+  SpillStore *ss = spill_store;
+  const char *uuid;
+  map_iter_t iter = map_iter(&ss->map);
+  while ((uuid = map_next(&ss->map, &iter))) {
+    SpillEntry **q = map_peek(&ss->map, uuid);
+    if (q && *q) _spill_entry_free(*q);
+  }
+  map_deinit(&ss->map);
+  thread_mutex_destroy(&ss->mutex);
+  free(ss);
+}
+
+/* Returns the bounded instance store.  If `create` is zero, NULL is
+   returned if it does not exist and the budget is not set with the
+   DLITE_INSTANCE_STORE_BUDGET environment variable. */
+static SpillStore *_spill_store(int create)
+{
+  SpillStore *ss = dlite_globals_get_state("dlite-spill-store");
+  if (!ss) {
+    static int checked=0;
+    char *p = NULL;
+    thread_mutex_lock(&_spill_store_mutex);
+    if (!checked) {
+      p = getenv("DLITE_INSTANCE_STORE_BUDGET");
+      if (p && *p) create = 1;
+      checked = 1;
+    }
+    if (create && !(ss = dlite_globals_get_state("dlite-spill-store"))) {
+      if ((ss = calloc(1, sizeof(SpillStore)))) {
+        thread_mutex_init(&ss->mutex);
+        map_init(&ss->map);
+        if (p && *p) ss->budget = strtoul(p, NULL, 10);
+        dlite_globals_add_state("dlite-spill-store", ss, _spill_store_free);
+      } else {
+        err(1, "allocation failure");
+      }
+    }
+    thread_mutex_unlock(&_spill_store_mutex);
+  }
+  return ss;
+}
+
+/* Unlinks `e` from the list of kept instances. */
+static void _spill_unlink(SpillStore *ss, SpillEntry *e)
+{
+  if (e->prev) e->prev->next = e->next; else ss->head = e->next;
+  if (e->next) e->next->prev = e->prev; else ss->tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+/* Links `e` to the most recently used end of the list. */
+static void _spill_link(SpillStore *ss, SpillEntry *e)
+{
+  e->prev = NULL;
+  e->next = ss->head;
+  if (ss->head) ss->head->prev = e;
+  ss->head = e;
+  if (!ss->tail) ss->tail = e;
+}
+
+/* Releases the least recently used instances until the used memory
+   is within the budget.  The instances to decref are moved to the
+   array `*released` of length `*nreleased`.  Must be called with
+   `ss->mutex` held. */
+static void _spill_evict(SpillStore *ss, DLiteInstance ***released,
+                         size_t *nreleased)
+{
+  size_t n=0, used=ss->used;
+  SpillEntry *e;
+  *released = NULL;
+  *nreleased = 0;
+  for (e=ss->tail; e && used > ss->budget; e=e->prev, n++)
+    used -= e->nbytes;
+  if (!n || !(*released = malloc(n * sizeof(DLiteInstance *)))) return;
+  while (*nreleased < n) {
+    e = ss->tail;
+    _spill_unlink(ss, e);
+    ss->used -= e->nbytes;
+    (*released)[(*nreleased)++] = e->inst;
+    if (e->inst->_flags & dliteFlagReloadable) {
+      e->inst = NULL;
+    } else {
+      map_remove(&ss->map, e->inst->uuid);
+      _spill_entry_free(e);
+    }
+  }
+}
+
+/* Decrefs the `n` instances in `released` and frees the array. */
+static void _spill_release(DLiteInstance **released, size_t n)
+{
+  size_t i;
+  if (!released) return;
+  for (i=0; i<n; i++) dlite_instance_decref(released[i]);
+  dlite_stats_add(dliteStatsStoreEvictions, n);
+  free(released);
+}
+
+/* Lets the store keep a reference to `inst`, which was just loaded
+   from storage `s`, if the budget is positive. */
+static void _spill_keep(DLiteInstance *inst, const DLiteStorage *s)
+{
+  SpillStore *ss;
+  SpillEntry **q, *e=NULL;
+  DLiteInstance **released=NULL;
+  size_t nreleased=0;
+  if (!(ss = _spill_store(0)) || !ss->budget) return;
+  if (dlite_instance_is_meta(inst) || s->writable || s->compression ||
+      (inst->_flags & dliteFlagLazy)) return;
+  thread_mutex_lock(&ss->mutex);
+  if ((q = map_peek(&ss->map, inst->uuid)) && (e = *q)) {
+    if (e->inst) {  /* already kept */
+      thread_mutex_unlock(&ss->mutex);
+      return;
+    }
+    free(e->driver);
+    free(e->location);
+    if (e->options) free(e->options);
+    e->driver = e->location = e->options = NULL;
+  } else if ((e = calloc(1, sizeof(SpillEntry))) &&
+             map_set(&ss->map, inst->uuid, e)) {
+    free(e);
+    e = NULL;
+  }
+  if (e) {
+    e->driver = strdup(s->api->name);
+    e->location = strdup(s->location);
+    e->options = (s->options) ? strdup(s->options) : NULL;
+    if (!e->driver || !e->location || (s->options && !e->options)) {
+      map_remove(&ss->map, inst->uuid);
+      _spill_entry_free(e);
+    } else {
+      e->inst = inst;
+      e->nbytes = dlite_stats_instance_nbytes(inst);
+      dlite_instance_incref(inst);
+      inst->_flags |= dliteFlagReloadable;
+      _spill_link(ss, e);
+      ss->used += e->nbytes;
+      _spill_evict(ss, &released, &nreleased);
+    }
+  }
+  thread_mutex_unlock(&ss->mutex);
+  _spill_release(released, nreleased);
+}
+
+/* Marks `inst` as most recently used. */
+static void _spill_touch(const DLiteInstance *inst)
+{
+  SpillStore *ss;
+  SpillEntry **q;
+  if (!(ss = dlite_globals_get_state("dlite-spill-store"))) return;
+  thread_mutex_lock(&ss->mutex);
+  if ((q = map_peek(&ss->map, inst->uuid)) && (*q)->inst == inst &&
+      ss->head != *q) {
+    _spill_unlink(ss, *q);
+    _spill_link(ss, *q);
+  }
+  thread_mutex_unlock(&ss->mutex);
+}
+
+/* Removes the stub of `inst`, which is about to be free'ed, if it is
+   modified and therefore cannot be reloaded. */
+static void _spill_forget(const DLiteInstance *inst)
+{
+  SpillStore *ss;
+  SpillEntry **q;
+  if (inst->_flags & dliteFlagReloadable) return;
+  if (!(ss = dlite_globals_get_state("dlite-spill-store"))) return;
+  thread_mutex_lock(&ss->mutex);
+  if ((q = map_peek(&ss->map, inst->uuid)) && !(*q)->inst) {
+    _spill_entry_free(*q);
+    map_remove(&ss->map, inst->uuid);
+  }
+  thread_mutex_unlock(&ss->mutex);
+}
+
+/* Reloads instance `id` from the storage recorded in its stub.
+   Returns a new reference or NULL if there is no stub or the instance
+   cannot be reloaded.  No error is reported. */
+static DLiteInstance *_spill_reload(const char *id)
+{
+  SpillStore *ss;
+  SpillEntry **q;
+  DLiteStorage *s;
+  DLiteInstance *inst=NULL;
+  char uuid[DLITE_UUID_LENGTH+1], *driver=NULL, *location=NULL, *options=NULL;
+  if (!(ss = dlite_globals_get_state("dlite-spill-store"))) return NULL;
+  if (dlite_get_uuid(uuid, id) < 0) return NULL;
+  thread_mutex_lock(&ss->mutex);
+  if ((q = map_peek(&ss->map, uuid)) && !(*q)->inst) {
+    driver = strdup((*q)->driver);
+    location = strdup((*q)->location);
+    if ((*q)->options) options = strdup((*q)->options);
+  }
+  thread_mutex_unlock(&ss->mutex);
+  if (driver && location) {
+    ErrTry:
+      if ((s = dlite_storage_cache_open(driver, location, options))) {
+        inst = dlite_instance_load(s, uuid);
+        dlite_storage_cache_release(s);
+      }
+    ErrOther:
+      break;
+    ErrEnd;
+    if (inst) {
+      dlite_stats_add(dliteStatsStoreReloads, 1);
+    } else {
+      /* forget stubs that cannot be reloaded */
+      thread_mutex_lock(&ss->mutex);
+      if ((q = map_peek(&ss->map, uuid)) && !(*q)->inst) {
+        _spill_entry_free(*q);
+        map_remove(&ss->map, uuid);
+      }
+      thread_mutex_unlock(&ss->mutex);
+    }
+  }
+  if (driver) free(driver);
+  if (location) free(location);
+  if (options) free(options);
+  return inst;
+}
+
+/*
+  Sets the memory budget of the instance store to `nbytes`.
+ */
+int dlite_instance_store_set_budget(size_t nbytes)
+{
+  SpillStore *ss;
+  DLiteInstance **released=NULL;
+  size_t nreleased=0;
+  if (!(ss = _spill_store(nbytes > 0))) return (nbytes > 0) ? 1 : 0;
+  thread_mutex_lock(&ss->mutex);
+  ss->budget = nbytes;
+  _spill_evict(ss, &released, &nreleased);
+  if (!nbytes) {
+    const char *uuid;
+    map_iter_t iter = map_iter(&ss->map);
+    while ((uuid = map_next(&ss->map, &iter))) {
+      SpillEntry **q = map_peek(&ss->map, uuid);
+      if (q && *q) _spill_entry_free(*q);
+    }
+    map_deinit(&ss->map);
+    map_init(&ss->map);
+  }
+  thread_mutex_unlock(&ss->mutex);
+  _spill_release(released, nreleased);
+  return 0;
+}
+
+/*
+  Returns the memory budget of the instance store.
+ */
+size_t dlite_instance_store_get_budget(size_t *used)
+{
+  SpillStore *ss = _spill_store(0);
+  if (used) *used = (ss) ? ss->used : 0;
+  return (ss) ? ss->budget : 0;
+}
+
+
+/********************************************************************
+ *  Frozen instances
+ *
+ *  A frozen instance is marked with dliteFlagFrozen and all functions
+ *  modifying it fail.  Functions only reading it must not modify its
+ *  flags or other internal state, such that it can be read from
+ *  several threads without synchronisation.  Hence, lazy properties
+ *  and extended metadata are synchronised when it is frozen, and its
+ *  fingerprint is cached without setting dliteFlagFingerprint.
+ ********************************************************************/
+
+/*
+  Makes `inst` immutable.  See dlite-entity.h for details.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_freeze(DLiteInstance *inst, int flags)
+{
+  if (!(inst->_flags & dliteFlagFrozen)) {
+    if (dlite_instance_load_all(inst)) return 1;
+    if (dlite_instance_sync_to_dimension_sizes(inst)) return 1;
+    if (dlite_instance_sync_to_properties(inst)) return 1;
+    inst->_flags |= dliteFlagFrozen;
+  }
+  if (flags & dliteFreezeImmortal) inst->_flags |= dliteFlagImmortal;
+  if ((flags & dliteFreezeMeta) && inst->meta &&
+      (const DLiteInstance *)inst->meta != inst)
+    return dlite_instance_freeze((DLiteInstance *)inst->meta,
+                                 flags & ~dliteFreezeMeta);
+  return 0;
+}
+
+/*
+  Returns true if `inst` is frozen.
+ */
+bool dlite_instance_is_frozen(const DLiteInstance *inst)
+{
+  return (inst->_flags & dliteFlagFrozen) ? true : false;
+}
+
+
+/********************************************************************
+ *  Instances
+ ********************************************************************/
+
+/*
+  Help function that evaluates array of instance property dimension
+  values, where `dims` is the instance dimensions.  It assigns the
+  `propdims` memory section of `inst`.
+
+  Returns non-zero in error.
+ */
+static int _instance_propdims_eval(DLiteInstance *inst, const size_t *dims)
+{
+  const DLiteMeta *meta = inst->meta;
+  size_t *propdims = (size_t *)((char *)inst + meta->_propdimsoffset);
+  return _propdims_eval(meta, dims, propdims);
+}
+
+/*
+  Help function for _instance_propdims_eval().  Evaluates the property
+  dimension values of an instance of `meta` with dimensions `dims` and
+  writes them to `propdims`, which must have length `meta->_npropdims`.
+
+  Returns non-zero in error.
+ */
+static int _propdims_eval(const DLiteMeta *meta, const size_t *dims,
+                          size_t *propdims)
+{
+  const struct _DLitePropDimsCode *pdc = meta->_propdimscode;
+  int retval = 1;
+  size_t i, n=0;
+  InfixCalcVariable *vars=NULL;
+
+  if (pdc && pdc->properties == meta->_properties &&
+      pdc->ndimensions == meta->_ndimensions &&
+      pdc->nproperties == meta->_nproperties &&
+      pdc->npropdims == meta->_npropdims)
+    return _propdimscode_eval(pdc, dims, propdims);
+
+  if (!(vars = scratch_calloc(meta->_ndimensions,
+                              sizeof(InfixCalcVariable))))
+    goto fail;
+  for (i=0; i < meta->_ndimensions; i++) {
+    vars[i].name = meta->_dimensions[i].name;
+    vars[i].value = dims[i];
+  }
+
+  for (i=0; i < meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    int j;
+    char errmsg[256] = "";
+    for (j=0; j < p->ndims; j++)
+      propdims[n++] = infixcalc(p->dims[j], vars, meta->_ndimensions,
+                                errmsg, sizeof(errmsg));
+    if (errmsg[0]) FAIL1("invalid property dimension expression: %s", errmsg);
+  }
+  assert(n == meta->_npropdims);
+
+  retval = 0;
+ fail:
+  scratch_free(vars);
+  return retval;
+}
+
+
+/* Flags for _instance_init() */
+#define INIT_PROPDIMS 1  /* `propdims` section is already assigned */
+#define INIT_ARRAYS   2  /* Arrays of dimensional properties are allocated */
+#define INIT_UUID     4  /* A random `uuid` is already assigned */
+
+/*
+  Help function for _instance_create() and dlite_instance_create_many()
+  that initialises newly allocated instance `inst` of metadata `meta`
+  with dimensions `dims` and id `id`.  If `arena` is not NULL, the
+  arrays of dimensional properties are placed in it.  `flags` is a
+  combination of the INIT_* flags telling what is already initialised.
+
+  Returns non-zero on error.
+ */
+static int _instance_init(DLiteInstance *inst, const DLiteMeta *meta,
+                          const size_t *dims, const char *id, char *arena,
+                          int flags)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  size_t i;
+  int j, uuid_version;
+
+  /* Initialise header */
+  inst->meta = (DLiteMeta *)meta;
+  if (!dlite_meta_is_metameta(meta)) _layout_fix(meta);
+  if (!(flags & INIT_UUID)) {
+    if ((uuid_version = dlite_get_uuid(uuid, id)) < 0) return 1;
+    memcpy(inst->uuid, uuid, sizeof(uuid));
+    if (uuid_version == 5) inst->uri = strdup(id);
+  }
+
+  /* Set dimensions */
+  if (meta->_ndimensions) {
+    size_t *dimensions = DLITE_DIMS(inst);
+    memcpy(dimensions, dims, meta->_ndimensions*sizeof(size_t));
+  }
+
+  /* Evaluate property dimensions */
+  if (!(flags & INIT_PROPDIMS) && _instance_propdims_eval(inst, dims))
+    return 1;
+
+  /* Allocate arrays for dimensional properties */
+  for (i=0; i<meta->_nproperties && !(flags & INIT_ARRAYS); i++) {
+    DLiteProperty *p = DLITE_PROP_DESCR(inst, i);
+    void **ptr = DLITE_PROP(inst, i);
+    if (p->ndims > 0 && p->dims) {
+      size_t nmemb=1, size=p->size;
+      for (j=0; j<p->ndims; j++)
+        nmemb *= DLITE_PROP_DIM(inst, i, j);
+      if (nmemb > 0 && arena) {
+        *ptr = arena;
+        arena += align_up(nmemb * size, ARENA_ITEM_ALIGN);
+      } else if (nmemb > 0) {
+        if (!(*ptr = _allocator_calloc(_instance_allocator(inst),
+                                       nmemb, size)))
+          return err(1, "allocation failure");
+      } else {
+        *ptr = NULL;
+      }
+    }
+  }
+
+  /* Further initialisation if metadata..,  */
+  if (dlite_meta_is_metameta(meta) && dlite_meta_init((DLiteMeta *)inst))
+    return 1;
+
+  /* Initialisation of extended metadata.
+     Note that we do not call _setdim() and _loadprop() here.  If
+     needed, they should be called by _init(). */
+  if (meta->_init && meta->_init(inst)) return 1;
+
+  return 0;
+}
+
+
+/*
+  Help function for dlite_instance_create().  If `lookup` is true,
+  a check will be done to see if the instance already exists.
+ */
+static DLiteInstance *_instance_create(const DLiteMeta *meta,
+                                       const size_t *dims,
+                                       const char *id, int lookup)
+{
+  size_t i, size, arenasize=0;
+  char *arena=NULL;
+  DLiteInstance *inst=NULL;
+  const DLiteAllocator *a=NULL;
+  int stat, recycled=0;
+
+  /* Check if we are trying to create an instance with an already
+     existing id. */
+  if (lookup && id && *id && (inst = _instance_store_get_ref(id))) {
+    warn("trying to create new instance with id '%s' - creates a new "
+        "reference instead (refcount=%d)", id, inst->_refcount);
+
+    /* Check that `dims` corresponds to the dims of the existing instance. */
+    for (i=0; i < meta->_ndimensions; i++) {
+      if (dims[i] != dlite_instance_get_dimension_size_by_index(inst, i))
+        FAIL3("mismatch of dimension %d. Trying to create with size %d "
+              "but existing instance has size %d", (int)i, (int)dims[i],
+              (int)dlite_instance_get_dimension_size_by_index(inst, i));
+    }
+    return inst;
+  }
+
+  /* Make sure that metadata is initialised */
+  if (!meta->_propoffsets && dlite_meta_init((DLiteMeta *)meta)) goto fail;
+  if (_instance_store_add((DLiteInstance *)meta) < 0) goto fail;
+
+  /* Allocate instance, or reuse one from the pool.  Metadata is
+     always allocated with the standard allocator. */
+  if (!(size = dlite_instance_size(meta, dims))) goto fail;
+  if (!dlite_meta_is_metameta(meta)) a = dlite_instance_get_allocator();
+  if (meta->_pool && (inst = _pool_pop(meta, dims))) {
+    recycled = 1;
+  } else if (_arena_is_used(meta) && _arena_size(meta, dims, &arenasize)) {
+    goto fail;
+  } else if (arenasize) {
+    if (!(inst = _instance_alloc(a, size + sizeof(size_t) + ARENA_ALIGN-1 +
+                                 arenasize)))
+      FAIL("allocation failure");
+    arena = _arena_start(inst, size);
+    ((size_t *)arena)[-1] = arenasize;
+    inst->_flags |= dliteFlagArena;
+  } else {
+    if (!(inst = _instance_alloc(a, size))) FAIL("allocation failure");
+  }
+  dlite_instance_incref(inst);  /* increase refcount of the new instance */
+
+  /* Initialise instance */
+  if (_instance_init(inst, meta, dims, id, arena,
+                     (recycled) ? INIT_PROPDIMS | INIT_ARRAYS : 0))
+    goto fail;
+
+  /* Add to instance cache.  If another thread has added an instance
+     with the same id in the meantime, return a reference to that
+     instance instead. */
+  if ((stat = _instance_store_add(inst))) {
+    DLiteInstance *existing;
+    if (stat < 0 || !(existing = _instance_store_get_ref(inst->uuid)))
+      goto fail;
+    dlite_meta_incref((DLiteMeta *)meta);
+    dlite_instance_decref(inst);
+    return existing;
+  }
+
+  /* Increase reference count of metadata */
+  dlite_meta_incref((DLiteMeta *)meta);
+
+  _index_add(inst);
+  return inst;
+ fail:
   if (inst) {
     /* `dlite_instance_decref(inst)` will decrease the reference count
        to the metadata, but on failure we haven't increased it yet, so
@@ -492,6 +3895,171 @@ DLiteInstance *dlite_instance_create(const DLiteMeta *meta,
 }
 
 
+/*
+  Creates `n` new instances of `meta`, all with dimensions `dims`.
+
+  `ids` may be NULL, in which case all instances get a random UUID.
+  Otherwise it should be an array of length `n` with the ids of the
+  new instances, see dlite_instance_create().  Elements of `ids` may
+  be NULL.
+
+  This is equivalent to calling dlite_instance_create() `n` times, but
+  more efficient since the metadata is validated once, the new
+  instances are allocated in a single block and they are added to the
+  instance store in one batch.
+
+  Returns a newly allocated array of `n` new references to the
+  instances or NULL on error.  The caller is responsible to decref the
+  instances and free the array.
+ */
+DLiteInstance **dlite_instance_create_many(const DLiteMeta *meta,
+                                           const size_t *dims, size_t n,
+                                           const char **ids)
+{
+  DLiteInstance **insts=NULL, **newinsts=NULL, *first=NULL;
+  InstanceBatch *batch=NULL;
+  const DLiteAllocator *a=NULL;
+  size_t i, k, nnew=0, ninit=0, size, arenasize=0, stride, nrandom=0;
+  size_t *newidx=NULL;
+  int *status=NULL;
+  char *slot, *uuids=NULL;
+
+  if (!(insts = calloc((n) ? n : 1, sizeof(DLiteInstance *))))
+    FAIL("allocation failure");
+
+  /* Metadata is not created in batch */
+  if (dlite_meta_is_metameta(meta)) {
+    for (i=0; i<n; i++)
+      if (!(insts[i] = _instance_create(meta, dims, (ids) ? ids[i] : NULL,
+                                        1))) goto fail;
+    return insts;
+  }
+
+  /* Make sure that metadata is initialised */
+  if (!meta->_propoffsets && dlite_meta_init((DLiteMeta *)meta)) goto fail;
+  if (_instance_store_add((DLiteInstance *)meta) < 0) goto fail;
+
+  /* New references to already existing instances */
+  for (i=0; i<n; i++)
+    if (ids && ids[i] && *ids[i] && _instance_store_get(ids[i]) &&
+        !(insts[i] = _instance_create(meta, dims, ids[i], 1))) goto fail;
+
+  if (!(newinsts = calloc((n) ? n : 1, sizeof(DLiteInstance *))) ||
+      !(newidx = calloc((n) ? n : 1, sizeof(size_t))) ||
+      !(status = calloc((n) ? n : 1, sizeof(int))))
+    FAIL("allocation failure");
+  for (i=0; i<n; i++)
+    if (!insts[i]) newidx[nnew++] = i;
+  if (nnew == 0) goto done;
+
+  /* Allocate all new instances in one block */
+  if (!(size = dlite_instance_size(meta, dims))) goto fail;
+  if (_arena_is_used(meta) && _arena_size(meta, dims, &arenasize))
+    goto fail;
+  stride = size;
+  if (arenasize) stride += sizeof(size_t) + ARENA_ALIGN-1 + arenasize;
+  stride = align_up(BATCH_PREFIX + stride, BATCH_PREFIX);
+  a = dlite_instance_get_allocator();
+  if (!(batch = _allocator_calloc(a, 1, BATCH_PREFIX + nnew*stride)))
+    FAIL("allocation failure");
+  batch->count = (int)nnew;
+  batch->allocator = a;
+  slot = (char *)batch + BATCH_PREFIX;
+  for (k=0; k<nnew; k++, slot+=stride) {
+    *(InstanceBatch **)slot = batch;
+    newinsts[k] = (DLiteInstance *)(slot + BATCH_PREFIX);
+    newinsts[k]->_flags = dliteFlagBatch | ((a) ? dliteFlagAllocator : 0);
+  }
+
+  /* Generate random UUIDs for all new instances without an id in one
+     go */
+  for (k=0; k<nnew; k++)
+    if (!ids || !ids[newidx[k]] || !*ids[newidx[k]]) nrandom++;
+  if (nrandom) {
+    if (!(uuids = malloc(nrandom * UUID4_LEN)))
+      FAIL("allocation failure");
+    if (uuid4_generate_many(uuids, nrandom, UUID4_LEN))
+      FAIL("cannot generate random UUIDs");
+  }
+
+  /* Initialise new instances.  Property dimensions are only evaluated
+     for the first one. */
+  for (k=0, i=0; k<nnew; k++) {
+    DLiteInstance *inst = newinsts[k];
+    const char *id = (ids) ? ids[newidx[k]] : NULL;
+    char *arena=NULL;
+    int flags=0;
+    inst->meta = (DLiteMeta *)meta;
+    if (!id || !*id) {
+      memcpy(inst->uuid, uuids + UUID4_LEN*i++, UUID4_LEN);
+      flags |= INIT_UUID;
+    }
+    if (arenasize) {
+      arena = _arena_start(inst, size);
+      ((size_t *)arena)[-1] = arenasize;
+      inst->_flags |= dliteFlagArena;
+    }
+    if (first && meta->_npropdims) {
+      memcpy(DLITE_PROP_DIMS(inst, 0), DLITE_PROP_DIMS(first, 0),
+             meta->_npropdims*sizeof(size_t));
+      flags |= INIT_PROPDIMS;
+    }
+    dlite_instance_incref(inst);
+    dlite_meta_incref((DLiteMeta *)meta);
+    ninit++;
+    if (_instance_init(inst, meta, dims, id, arena, flags)) goto fail;
+    if (!first) first = inst;
+  }
+
+  /* Add to instance store.  If another thread has added an instance
+     with the same id in the meantime, return a reference to that
+     instance instead. */
+  if (_instance_store_add_many(newinsts, nnew, status)) goto fail;
+  for (k=0; k<nnew; k++) {
+    DLiteInstance *existing;
+    if (status[k] < 0) goto fail;
+    if (status[k] == 0) {
+      insts[newidx[k]] = newinsts[k];
+      _index_add(newinsts[k]);
+    }
+    else if ((existing = _instance_store_get_ref(newinsts[k]->uuid)))
+      insts[newidx[k]] = existing;
+    else
+      goto fail;
+  }
+  for (k=0; k<nnew; k++)
+    if (status[k]) dlite_instance_decref(newinsts[k]);
+
+ done:
+  free(newinsts);
+  free(newidx);
+  free(status);
+  free(uuids);
+  return insts;
+
+ fail:
+  if (insts) {
+    for (i=0; i<n; i++)
+      if (insts[i] && (!batch || !(insts[i]->_flags & dliteFlagBatch) ||
+                       *(InstanceBatch **)((char *)insts[i] -
+                                           BATCH_PREFIX) != batch))
+        dlite_instance_decref(insts[i]);
+    free(insts);
+  }
+  for (k=0; k<nnew && batch; k++) {
+    if (k < ninit)
+      dlite_instance_decref(newinsts[k]);
+    else
+      _instance_dealloc(newinsts[k]);
+  }
+  if (newinsts) free(newinsts);
+  if (newidx) free(newidx);
+  if (status) free(status);
+  if (uuids) free(uuids);
+  return NULL;
+}
+
+
 /*
   Like dlite_instance_create() but takes the uri or uuid if the
   metadata as the first argument.  `dims`.  The lengths of `dims` is
@@ -526,8 +4094,25 @@ static void dlite_instance_free(DLiteInstance *inst)
   /* Additional deinitialisation */
   if (meta->_deinit) meta->_deinit(inst);
 
+  /* Release the pool of metadata before its properties are cleared */
+  if (dlite_meta_is_metameta(meta)) _pool_free((DLiteMeta *)inst);
+
   /* Remove from instance cache */
-  _instance_store_remove(inst->uuid);
+  _instance_store_remove(inst);
+  _spill_forget(inst);
+
+  /* Release shared arrays, which are not owned by this instance */
+  if (inst->_flags & dliteFlagShared) _shared_release_all(inst);
+
+  /* Stop lazy loading and dirty tracking */
+  if (inst->_flags & dliteFlagLazy) _lazy_release(inst);
+  if (inst->_flags & dliteFlagSaved) _dirty_release(inst);
+  if (inst->_flags & dliteFlagReserved) _reserved_release(inst);
+  if (inst->_flags & (dliteFlagFingerprint | dliteFlagFrozen))
+    _fingerprint_forget(inst);
+  if (inst->_flags & dliteFlagIndexed) _index_forget(inst);
+  if (inst->_flags & dliteFlagDevice) dlite_device_forget(inst);
+  if (inst->_flags & dliteFlagStrings) _strings_forget(inst);
 
   /* Standard free */
   nprops = meta->_nproperties;
@@ -546,13 +4131,29 @@ static void dlite_instance_free(DLiteInstance *inst)
           for (n=0; n<nmemb; n++)
             dlite_type_clear(*(char **)ptr + n*p->size, p->type, p->size);
         }
-        free(*(void **)ptr);
       } else {
         dlite_type_clear(ptr, p->type, p->size);
       }
     }
   }
-  free(inst);
+  if (dlite_meta_is_metameta(meta) && ((DLiteMeta *)inst)->_nameindex)
+    free(((DLiteMeta *)inst)->_nameindex);
+  if (dlite_meta_is_metameta(meta)) {
+    _propdimscode_free(((DLiteMeta *)inst)->_propdimscode);
+    dlite_json_parser_free(((DLiteMeta *)inst)->_jsonparser);
+    free(((DLiteMeta *)inst)->_hotprops);
+    free(((DLiteMeta *)inst)->_sparseprops);
+  }
+
+  /* Release arrays not allocated by DLite */
+  if (inst->_flags & dliteFlagForeign) _foreign_release_all(inst);
+
+  /* Add to pool or deallocate */
+  if (!meta->_pool || (inst->_flags & (dliteFlagShared | dliteFlagForeign)) ||
+      _pool_push(inst)) {
+    _instance_free_arrays(inst);
+    _instance_dealloc(inst);
+  }
 
   dlite_meta_decref((DLiteMeta *)meta);  /* decrease metadata refcount */
 }
@@ -565,10 +4166,11 @@ static void dlite_instance_free(DLiteInstance *inst)
  */
 int dlite_instance_incref(DLiteInstance *inst)
 {
+  if (inst->_flags & dliteFlagImmortal) return inst->_refcount;
   DEBUG_LOG("+++ incref: %2d -> %2d : %s\n",
             inst->_refcount, inst->_refcount+1,
             (inst->uri) ? inst->uri : inst->uuid);
-  return ++inst->_refcount;
+  return thread_atomic_add(&inst->_refcount, 1);
 }
 
 /*
@@ -580,11 +4182,13 @@ int dlite_instance_incref(DLiteInstance *inst)
 int dlite_instance_decref(DLiteInstance *inst)
 {
   int count;
+  if (inst->_flags & dliteFlagImmortal) return inst->_refcount;
   DEBUG_LOG("--- decref: %2d -> %2d : %s\n",
             inst->_refcount, inst->_refcount-1,
             (inst->uri) ? inst->uri : inst->uuid);
-  assert(inst->_refcount > 0);
-  if ((count = --inst->_refcount) <= 0) dlite_instance_free(inst);
+  count = thread_atomic_add(&inst->_refcount, -1);
+  assert(count >= 0);
+  if (count <= 0) dlite_instance_free(inst);
   return count;
 }
 
@@ -616,39 +4220,77 @@ DLiteInstance *dlite_instance_has(const char *id, bool check_storages)
   return inst;
 }
 
-
 /*
-  Returns a new reference to instance with given `id` or NULL if no such
-  instance can be found.
+  Calls `fn` for each instance in the in-memory instance store, with
+  `data` passed as its second argument.  The iteration stops when `fn`
+  returns non-zero.  Since the store is locked during the iteration,
+  `fn` must not create or free instances.
 
-  If the instance exists in the in-memory store it is returned (with
-  its refcount increased by one).  Otherwise it is searched for in the
-  storage plugin path (initiated from the DLITE_STORAGES environment
-  variable).
+  Returns the last value returned by `fn` or a negative value on error.
+ */
+int dlite_instance_store_foreach(int (*fn)(const DLiteInstance *inst,
+                                           void *data), void *data)
+{
+  InstanceStore *istore = _instance_store();
+  int i, retval=0;
+  if (!istore) return -1;
+  for (i=0; i<INSTANCE_STORE_NSHARDS && !retval; i++) {
+    instance_map_t *map = &istore->shards[i].map;
+    omap_iter_t iter;
+    const char *uuid;
+    DLiteInstance **q;
+    thread_rwlock_rdlock(&istore->shards[i].lock);
+    iter = omap_iter(map);
+    while (!retval && (uuid = omap_next(map, &iter)))
+      if ((q = omap_peek(map, uuid)) &&
+          thread_atomic_load(&(*q)->_refcount) > 0)
+        retval = fn(*q, data);
+    thread_rwlock_rdunlock(&istore->shards[i].lock);
+  }
+  return retval;
+}
 
-  It is an error message if the instance cannot be found.
-*/
-DLiteInstance *dlite_instance_get(const char *id)
+
+/* Help function for dlite_instance_get().  Searches for instance `id`
+   in the metadata cache, the storage index and the storage paths.
+   Returns a new reference to the instance or NULL if it cannot be
+   found. */
+static DLiteInstance *_instance_search(const char *id)
 {
   DLiteInstance *inst=NULL;
   DLiteStoragePathIter *iter;
+  DLiteStorage *s;
   const char *url;
+  unsigned mark;
 
-  /* check if instance `id` is already instansiated... */
-  if ((inst = _instance_store_get(id))) {
-    dlite_instance_incref(inst);
-    return inst;
+  /* don't search again for ids that are known to be missing */
+  if (dlite_storage_paths_is_missing(id, &mark)) return NULL;
+
+  /* ...check the metadata cache... */
+  if ((inst = dlite_metacache_load(id))) return inst;
+
+  /* ...otherwise look up its storage in the storage index... */
+  if ((s = dlite_storage_index_open(id))) {
+    ErrTry:
+      inst = _instance_load_casted(s, id, NULL, 0, 0);
+    ErrCatch(dliteStorageLoadError):  // suppressed error
+      break;
+    ErrEnd;
+    dlite_storage_cache_release(s);
+    if (inst) return inst;
   }
 
-  /* ...otherwise look it up in storages */
+  /* ...or search the storages not covered by the index */
   if (!(iter = dlite_storage_paths_iter_start())) return NULL;
 
   assert(iter);
   while ((url = dlite_storage_paths_iter_next(iter))) {
-    DLiteStorage *s;
     char *copy, *driver, *location, *options;
 
-    if (!(copy = strdup(url))) return err(1, "allocation failure"), NULL;
+    if (!(copy = scratch_strdup(url))) {
+      dlite_storage_paths_iter_stop(iter);
+      return NULL;
+    }
 #ifdef _WIN32
     /* Hack: on Window, don't interpreat the "C" in urls starting with
        "C:\" or "C:/" as a driver, but rather as a part of the location...
@@ -666,14 +4308,18 @@ DLiteInstance *dlite_instance_get(const char *id)
 
     /* Set read-only as default mode (all drivers should support this) */
     if (!options) options = "mode=r";
-    if ((s = dlite_storage_open(driver, location, options))) {
+    if (dlite_storage_index_excludes(location, id) ||
+        dlite_bloom_excludes(location, id)) {
+      /* indexed storage or storage with a Bloom filter sidecar that
+         doesn't have the instance */
+    } else if ((s = dlite_storage_cache_open(driver, location, options))) {
       /* url is a storage we can open... */
       ErrTry:
-        inst = _instance_load_casted(s, id, NULL, 0);
+        inst = _instance_load_casted(s, id, NULL, 0, 0);
       ErrCatch(dliteStorageLoadError):  // suppressed error
         break;
       ErrEnd;
-      dlite_storage_close(s);
+      dlite_storage_cache_release(s);
     } else {
       /* ...otherwise it may be a glob pattern */
       FUIter *fiter;
@@ -681,28 +4327,238 @@ DLiteInstance *dlite_instance_get(const char *id)
         const char *path;
         while (!inst && (path = fu_globnext(fiter))) {
 	  driver = (char *)fu_fileext(path);
-	  if ((s = dlite_storage_open(driver, path, options))) {
+          if (dlite_storage_index_excludes(path, id) ||
+              dlite_bloom_excludes(path, id)) continue;
+	  if ((s = dlite_storage_cache_open(driver, path, options))) {
             ErrTry:
-              inst = _instance_load_casted(s, id, NULL, 0);
+              inst = _instance_load_casted(s, id, NULL, 0, 0);
             ErrCatch(dliteStorageLoadError):  // suppressed error
               break;
             ErrEnd;
-	    dlite_storage_close(s);
+	    dlite_storage_cache_release(s);
 	  }
         }
         fu_globend(fiter);
       }
     }
-    free(copy);
+    scratch_free(copy);
     if (inst) {
       dlite_storage_paths_iter_stop(iter);
       return inst;
     }
   }
   dlite_storage_paths_iter_stop(iter);
+  dlite_storage_paths_add_missing(id, mark);
   return NULL;
 }
 
+/*
+  Returns a new reference to instance with given `id` or NULL if no such
+  instance can be found.
+
+  If the instance exists in the in-memory store it is returned (with
+  its refcount increased by one).  Otherwise it is searched for in the
+  storage plugin path (initiated from the DLITE_STORAGES environment
+  variable), using the storage index and Bloom filter sidecars (see
+  dlite-bloom.h) to avoid opening storages that doesn't contain the
+  instance.
+
+  It is an error message if the instance cannot be found.
+*/
+DLiteInstance *dlite_instance_get(const char *id)
+{
+  DLiteInstance *inst;
+
+  /* check if instance `id` is already instansiated... */
+  if ((inst = _instance_store_get_ref(id))) {
+    _spill_touch(inst);
+    return inst;
+  }
+
+  /* ...or has been released by the bounded instance store... */
+  if ((inst = _spill_reload(id))) return inst;
+
+  /* ...otherwise search for it */
+  TRACE_BEGIN(span, "dlite_instance_get", id);
+  inst = _instance_search(id);
+  TRACE_END(span);
+  return inst;
+}
+
+/********************************************************************
+ *  Cast cache
+ *
+ *  Optional cache of casted instances, keyed by the uuid of the source
+ *  instance and the uuid of the target metadata.  An entry is only
+ *  used while the fingerprints of both the source and the casted
+ *  instance are unchanged (see dlite_instance_fingerprint()).
+ ********************************************************************/
+
+typedef struct {
+  unsigned char srcfp[DLITE_FINGERPRINT_SIZE];  /* source fingerprint */
+  unsigned char dstfp[DLITE_FINGERPRINT_SIZE];  /* casted fingerprint */
+  DLiteInstance *inst;                          /* casted instance */
+} CastEntry;
+
+typedef map_t(CastEntry) cast_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  cast_map_t map;       /* maps source uuid + target uuid to entries */
+  size_t n;             /* number of entries */
+  size_t maxsize;       /* maximum number of entries */
+} CastCache;
+
+static ThreadMutex _cast_cache_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees the cast cache.  The cached instances are not released, since
+   the instance store may already be free'ed at exit. */
+static void _cast_cache_free(void *cast_cache)
+{
+  CastCache *cc = cast_cache;
+  map_deinit(&cc->map);
+  thread_mutex_destroy(&cc->mutex);
+  free(cc);
+}
+
+/* Returns pointer to the cast cache. */
+static CastCache *_cast_cache(void)
+{
+  CastCache *cc = dlite_globals_get_state("dlite-cast-cache");
+  if (!cc) {
+    thread_mutex_lock(&_cast_cache_mutex);
+    if (!(cc = dlite_globals_get_state("dlite-cast-cache"))) {
+      if ((cc = calloc(1, sizeof(CastCache)))) {
+        thread_mutex_init(&cc->mutex);
+        map_init(&cc->map);
+        dlite_globals_add_state("dlite-cast-cache", cc, _cast_cache_free);
+      }
+    }
+    thread_mutex_unlock(&_cast_cache_mutex);
+    if (!cc) return err(1, "allocation failure"), NULL;
+  }
+  return cc;
+}
+
+/* Removes all entries from the cast cache `cc`, which must be locked,
+   and returns them as a newly malloc'ed array of `*n` instances that
+   should be released by the caller after unlocking. */
+static DLiteInstance **_cast_cache_drain(CastCache *cc, size_t *n)
+{
+  DLiteInstance **insts = NULL;
+  map_iter_t iter = map_iter(&cc->map);
+  const char *key;
+  *n = 0;
+  if (cc->n && !(insts = malloc(cc->n * sizeof(DLiteInstance *))))
+    return err(1, "allocation failure"), NULL;
+  while ((key = map_next(&cc->map, &iter)))
+    insts[(*n)++] = map_get(&cc->map, key)->inst;
+  map_deinit(&cc->map);
+  map_init(&cc->map);
+  cc->n = 0;
+  return insts;
+}
+
+/*
+  Sets the maximum number of casted instances cached by
+  dlite_instance_get_casted() and dlite_instance_load_casted().
+ */
+int dlite_instance_set_cast_cache(size_t maxsize)
+{
+  CastCache *cc;
+  DLiteInstance **insts=NULL;
+  size_t i, n=0;
+  if (!(cc = _cast_cache())) return 1;
+  thread_mutex_lock(&cc->mutex);
+  if (maxsize < cc->n) insts = _cast_cache_drain(cc, &n);
+  cc->maxsize = maxsize;
+  thread_mutex_unlock(&cc->mutex);
+  for (i=0; i<n; i++) dlite_instance_decref(insts[i]);
+  if (insts) free(insts);
+  return 0;
+}
+
+/* Writes the cast cache key for instance `inst` casted to `metaid` to
+   `key`, which must have space for 2*DLITE_UUID_LENGTH+1 bytes.
+   Returns non-zero on error. */
+static int _cast_cache_key(const DLiteInstance *inst, const char *metaid,
+                           char *key)
+{
+  memcpy(key, inst->uuid, DLITE_UUID_LENGTH);
+  if (dlite_get_uuid(key + DLITE_UUID_LENGTH, metaid) < 0) return 1;
+  return 0;
+}
+
+/* Returns a new reference to `inst` casted to `metaid`.  The cast
+   cache is used if it is enabled.  Returns NULL on error. */
+static DLiteInstance *_instance_cast(const DLiteInstance *inst,
+                                     const char *metaid)
+{
+  CastCache *cc = dlite_globals_get_state("dlite-cast-cache");
+  CastEntry entry, *e;
+  DLiteInstance *casted=NULL, *old=NULL;
+  char key[2*DLITE_UUID_LENGTH+1];
+
+  if (!cc || !cc->maxsize || _cast_cache_key(inst, metaid, key))
+    return dlite_mapping(metaid, &inst, 1);
+  if (dlite_instance_fingerprint(inst, entry.srcfp)) {
+    err_clear();
+    return dlite_mapping(metaid, &inst, 1);
+  }
+
+  /* check the cache */
+  thread_mutex_lock(&cc->mutex);
+  if ((e = map_get(&cc->map, key))) {
+    if (memcmp(e->srcfp, entry.srcfp, DLITE_FINGERPRINT_SIZE) == 0 &&
+        dlite_instance_fingerprint(e->inst, entry.dstfp) == 0 &&
+        memcmp(e->dstfp, entry.dstfp, DLITE_FINGERPRINT_SIZE) == 0) {
+      casted = e->inst;
+      dlite_instance_incref(casted);
+    } else {
+      old = e->inst;
+      map_remove(&cc->map, key);
+      cc->n--;
+    }
+  }
+  thread_mutex_unlock(&cc->mutex);
+  if (old) dlite_instance_decref(old);
+  if (casted) {
+    dlite_stats_add(dliteStatsCastCacheHits, 1);
+    return casted;
+  }
+  dlite_stats_add(dliteStatsCastCacheMisses, 1);
+
+  /* cast and add to the cache */
+  if (!(casted = dlite_mapping(metaid, &inst, 1))) return NULL;
+  if (casted == inst || dlite_instance_fingerprint(casted, entry.dstfp)) {
+    err_clear();
+    return casted;
+  }
+  entry.inst = casted;
+  old = NULL;
+  thread_mutex_lock(&cc->mutex);
+  if (!map_get(&cc->map, key)) {
+    if (cc->n >= cc->maxsize) {
+      /* evict an arbitrary entry */
+      map_iter_t iter = map_iter(&cc->map);
+      const char *k = map_next(&cc->map, &iter);
+      if (k) {
+        old = map_get(&cc->map, k)->inst;
+        map_remove(&cc->map, k);
+        cc->n--;
+      }
+    }
+    if (cc->n < cc->maxsize && map_set(&cc->map, key, entry) == 0) {
+      dlite_instance_incref(casted);
+      cc->n++;
+    }
+  }
+  thread_mutex_unlock(&cc->mutex);
+  if (old) dlite_instance_decref(old);
+  return casted;
+}
+
+
 /*
   Like dlite_instance_get(), but maps the instance with the given id
   to an instance of `metaid`.  If `metaid` is NULL, it falls back to
@@ -713,7 +4569,7 @@ DLiteInstance *dlite_instance_get_casted(const char *id, const char *metaid)
   DLiteInstance *inst, *instances;
   if (!(inst = dlite_instance_get(id))) return NULL;
   if (metaid) {
-    instances = dlite_mapping(metaid, (const DLiteInstance **)&inst, 1);
+    instances = _instance_cast(inst, metaid);
     dlite_instance_decref(inst);
   } else {
     instances = inst;
@@ -756,19 +4612,80 @@ DLiteInstance *dlite_instance_load_url(const char *url)
   assert(url);
   if (!(str = strdup(url))) FAIL("allocation failure");
   if (dlite_split_url(str, &driver, &location, &options, &id)) goto fail;
-  if (id && *id && (inst = _instance_store_get(id))) {
-    dlite_instance_incref(inst);
-  } else {
+  if (!(id && *id && (inst = _instance_store_get_ref(id)))) {
     err_clear();
-    if (!(s = dlite_storage_open(driver, location, options))) goto fail;
+    if (!(s = dlite_storage_cache_open(driver, location, options)))
+      goto fail;
     if (!(inst = dlite_instance_load(s, id))) goto fail;
   }
  fail:
-  if (s) dlite_storage_close(s);
+  if (s) dlite_storage_cache_release(s);
   if (str) free(str);
   return inst;
 }
 
+/* Adds the size of `inst` to driver counter `counter` of storage `s`. */
+static void _stats_io(const DLiteStorage *s, const DLiteInstance *inst,
+                      DLiteStatsDriverCounter counter)
+{
+  dlite_stats_add_driver(s->api->name, counter,
+                         dlite_stats_instance_nbytes(inst));
+}
+
+/*
+  Updates statistics, the trace and the value indexes after instance
+  `inst` has been loaded from storage `s` with the instance api.  The
+  strings of instances using the arena allocation mode are packed.
+ */
+void dlite_instance_load_completed(const DLiteStorage *s, DLiteInstance *inst,
+                                   uint64_t t0)
+{
+  if (_arena_is_used(inst->meta) && dlite_instance_is_data(inst))
+    dlite_instance_pack_strings(inst);
+  _stats_io(s, inst, dliteStatsBytesRead);
+  if (t0) dlite_record_io(s, dliteRecordLoad, inst->uuid, NULL,
+                          dlite_stats_instance_nbytes(inst), t0);
+  if (inst->_flags & dliteFlagIndexed) _index_mark(inst, -1);
+  _spill_keep(inst, s);
+}
+
+/*
+  Updates statistics and the trace after instance `inst` has been
+  saved to storage `s`.
+ */
+void dlite_instance_save_completed(DLiteStorage *s, const DLiteInstance *inst,
+                                   uint64_t t0)
+{
+  _stats_io(s, inst, dliteStatsBytesWritten);
+  if (t0) dlite_record_io(s, dliteRecordSave, inst->uuid, NULL,
+                          dlite_stats_instance_nbytes(inst), t0);
+
+  /* the instance is no longer missing if `s` is in the storage paths */
+  dlite_storage_paths_clear_missing();
+}
+
+/* Lets array property `i` of the newly loaded data instance `inst`
+   adopt its data mapped directly from `d`, if the storage supports it.
+   Returns non-zero if the property was mapped. */
+static int _instance_map_property(DLiteDataModel *d, DLiteInstance *inst,
+                                  size_t i)
+{
+  DLiteProperty *p = inst->meta->_properties + i;
+  DLiteDeallocator dealloc=NULL;
+  void *ptr;
+  if (!d->api->mapProperty || p->ndims <= 0 ||
+      dlite_type_is_allocated(p->type) || !dlite_instance_is_data(inst))
+    return 0;
+  if (!(ptr = d->api->mapProperty(d, p->name, p->type, p->size, p->ndims,
+                                  DLITE_PROP_DIMS(inst, i), &dealloc)))
+    return 0;
+  if (dlite_instance_adopt_property_by_index(inst, i, ptr, dealloc)) {
+    if (dealloc) dealloc(ptr);
+    return 0;
+  }
+  return 1;
+}
+
 /*
   Help function for dlite_instance_load_casted().
 
@@ -777,31 +4694,51 @@ DLiteInstance *dlite_instance_load_url(const char *url)
 
   If `lookup` is non-zero, a check will be done to see if the instance
   already exists.  This is the normal case.
+
+  If `lazy` is non-zero, the properties of data instances are not
+  loaded until they are accessed.  See dlite_instance_load_lazy().
  */
 DLiteInstance *_instance_load_casted(const DLiteStorage *s, const char *id,
-                                     const char *metaid, int lookup)
+                                     const char *metaid, int lookup,
+                                     int lazy)
 {
   DLiteMeta *meta;
   DLiteInstance *inst=NULL, *instance=NULL;
   DLiteDataModel *d=NULL;
   size_t i, *dims=NULL;
   const char *uri=NULL;
+  int caps;
+  uint64_t t0;
 
   if (!s) FAIL("invalid storage, see previous errors");
 
   /* check if id is already loaded */
-  if (lookup && id && *id && (inst = _instance_store_get(id))) {
-    dlite_instance_incref(inst);
+  if (lookup && id && *id && (inst = _instance_store_get_ref(id))) {
     warn("trying to load existing instance from storage \"%s\": %s"
          " - create a new reference", s->location, id);
     return inst;
   }
 
-  /* check if storage implements the instance api */
-  if (s->api->loadInstance) {
-    if (!(inst = s->api->loadInstance(s, id))) goto fail;
+  /* write pending saves before reading from the storage */
+  if (dlite_storage_flush((DLiteStorage *)s)) goto fail;
+  t0 = dlite_record_begin();
+
+  /* check if storage implements the instance api, but prefer the
+     datamodel api for lazy loading from a random-access storage */
+  caps = dlite_storage_get_capabilities(s);
+  if ((s->api->loadInstance || s->api->loadInstances) &&
+      !(lazy && (caps & dliteCapRandomAccess) && s->api->dataModel)) {
+    if (s->api->loadInstance) {
+      if (!(inst = s->api->loadInstance(s, id))) goto fail;
+    } else {
+      DLiteInstance **insts;
+      if (!(insts = s->api->loadInstances(s, &id, 1))) goto fail;
+      inst = insts[0];
+      free(insts);
+    }
+    dlite_instance_load_completed(s, inst, t0);
     if (metaid)
-      return dlite_mapping(metaid, (const DLiteInstance **)&inst, 1);
+      return _instance_cast(inst, metaid);
     else
       return inst;
   }
@@ -826,7 +4763,7 @@ DLiteInstance *_instance_load_casted(const DLiteStorage *s, const char *id,
   if (!meta) FAIL1("cannot load metadata: %s", uri);
 
   /* Make sure that metadata is initialised */
-  if (dlite_meta_init(meta)) goto fail;
+  if (!meta->_propoffsets && dlite_meta_init(meta)) goto fail;
 
   /* check metadata uri */
   if (strcmp(uri, meta->uri) != 0)
@@ -835,8 +4772,8 @@ DLiteInstance *_instance_load_casted(const DLiteStorage *s, const char *id,
 
   /* read dimensions */
   dlite_datamodel_resolve_dimensions(d, meta);
-  if (!(dims = calloc(meta->_ndimensions, sizeof(size_t))))
-    FAIL("allocation failure");
+  if (!(dims = scratch_calloc(meta->_ndimensions, sizeof(size_t))))
+    goto fail;
   for (i=0; i<meta->_ndimensions; i++)
     if ((int)(dims[i] =
          dlite_datamodel_get_dimension_size(d, meta->_dimensions[i].name)) < 0)
@@ -850,17 +4787,33 @@ DLiteInstance *_instance_load_casted(const DLiteStorage *s, const char *id,
   if (!(inst = _instance_create(meta, dims, id, lookup))) goto fail;
   dlite_meta_decref(meta);
 
+  /* defer loading of properties, the instance takes over `d` */
+  if (lazy && !metaid && !dlite_meta_is_metameta(meta) &&
+      !meta->_loadprop && !meta->_saveprop && meta->_nproperties > 0 &&
+      !(inst->_flags & dliteFlagLazy)) {
+    if (_lazy_add(inst, d)) goto fail;
+    d = NULL;
+    instance = inst;
+    goto fail;
+  }
+
   /* assign properties */
   for (i=0; i<meta->_nproperties; i++) {
     DLiteProperty *p = (DLiteProperty *)meta->_properties + i;
     void *ptr = (void *)dlite_instance_get_property_by_index(inst, i);
     size_t *pdims = DLITE_PROP_DIMS(inst, i);
+    if (_instance_map_property(d, inst, i)) continue;
     if (dlite_datamodel_get_property(d, p->name, ptr, p->type, p->size,
 				     p->ndims, pdims)) {
       dlite_type_clear(ptr, p->type, p->size);
       goto fail;
     }
   }
+  if (_arena_is_used(meta) && dlite_instance_pack_strings(inst)) goto fail;
+  _stats_io(s, inst, dliteStatsBytesRead);
+  if (t0) dlite_record_io(s, dliteRecordLoad, inst->uuid, NULL,
+                          dlite_stats_instance_nbytes(inst), t0);
+  if (inst->_flags & dliteFlagIndexed) _index_mark(inst, -1);
 
   /* initiates metadata of the new instance is metadata */
   if (dlite_meta_is_metameta(inst->meta) && dlite_meta_init((DLiteMeta *)inst))
@@ -893,9 +4846,11 @@ DLiteInstance *_instance_load_casted(const DLiteStorage *s, const char *id,
     }
   }
 
+  _spill_keep(inst, s);
+
   /* cast if `metaid` is not NULL */
   if (inst && metaid)
-    instance = dlite_mapping(metaid, (const DLiteInstance **)&inst, 1);
+    instance = _instance_cast(inst, metaid);
   else
     instance = inst;
 
@@ -905,11 +4860,31 @@ DLiteInstance *_instance_load_casted(const DLiteStorage *s, const char *id,
   if (!instance && inst) dlite_instance_decref(inst);
   if (d) dlite_datamodel_free(d);
   if (uri) free((char *)uri);
-  if (dims) free(dims);
+  scratch_free(dims);
   err_update_eval(dliteStorageLoadError);
   return instance;
 }
 
+/*
+  Like dlite_instance_load(), but the properties are not read from
+  storage until they are accessed with dlite_instance_get_property()
+  and friends.  This is useful if only a few properties of a large
+  instance are needed.
+
+  The storage `s` must not be closed before all properties are loaded
+  (see dlite_instance_load_all()) or the instance is free'ed.
+
+  Metadata, instances of metadata with `_loadprop` or `_saveprop`
+  hooks and instances loaded from storages that do not implement the
+  data model api are loaded as with dlite_instance_load().
+
+  On error, NULL is returned.
+ */
+DLiteInstance *dlite_instance_load_lazy(const DLiteStorage *s, const char *id)
+{
+  return _instance_load_casted(s, id, NULL, 1, 1);
+}
+
 /*
   Like dlite_instance_load(), but allows casting the loaded instance
   into an instance of metadata identified by `metaid`.  If `metaid` is
@@ -920,51 +4895,457 @@ DLiteInstance *_instance_load_casted(const DLiteStorage *s, const char *id,
 
   Returns NULL of error or if no mapping can be found.
  */
-DLiteInstance *dlite_instance_load_casted(const DLiteStorage *s,
-                                          const char *id,
-                                          const char *metaid)
+DLiteInstance *dlite_instance_load_casted(const DLiteStorage *s,
+                                          const char *id,
+                                          const char *metaid)
+{
+  return _instance_load_casted(s, id, metaid, 1, 0);
+}
+
+/*
+  Loads the `n` instances identified by the array `ids` from storage
+  `s`.
+
+  This is equivalent to calling dlite_instance_load() `n` times, but
+  storage plugins implementing the loadInstances() api may load all
+  instances in one round-trip.
+
+  Returns a newly allocated array of `n` new references to the
+  instances or NULL on error.  The caller is responsible to decref the
+  instances and free the array.
+ */
+DLiteInstance **dlite_instance_load_many(const DLiteStorage *s,
+                                         const char **ids, size_t n)
+{
+  DLiteInstance **insts;
+  size_t i;
+  if (!s) return errx(1, "invalid storage, see previous errors"), NULL;
+  if (s->api->loadInstances) {
+    uint64_t t0 = dlite_record_begin();
+    if ((insts = s->api->loadInstances(s, ids, n)) && t0)
+      for (i=0; i<n; i++)
+        dlite_record_io(s, dliteRecordLoad, insts[i]->uuid, NULL,
+                        dlite_stats_instance_nbytes(insts[i]), t0);
+    return insts;
+  }
+
+  if (!(insts = calloc((n) ? n : 1, sizeof(DLiteInstance *))))
+    return err(1, "allocation failure"), NULL;
+  for (i=0; i<n; i++) {
+    if (!(insts[i] = dlite_instance_load(s, ids[i]))) {
+      while (i-- > 0) dlite_instance_decref(insts[i]);
+      free(insts);
+      return NULL;
+    }
+  }
+  return insts;
+}
+
+/*
+  Loads a slice of array property `name` of instance `id` in storage
+  `s`, without loading the rest of the instance.
+
+  `offsets`, `counts` and `strides` are arrays of length equal to the
+  number of dimensions of the property, with the index of the first
+  element, the number of elements and the step between elements along
+  each dimension.  If `strides` is NULL, a step of one is assumed.
+
+  Storage plugins implementing the getPropertySlice() api only read
+  the selected elements.  For other plugins the whole property is
+  read and the slice copied out of it.
+
+  Returns a new C-ordered array with dimensions `counts` or NULL on
+  error.  In contrast to dlite_instance_get_property_array(), the
+  returned array owns its data.  Free it with free(arr->data) followed
+  by dlite_array_free(arr).  For allocated types, the elements must be
+  cleared with dlite_type_clear() before freeing the data.
+ */
+DLiteArray *dlite_instance_load_property_slice(const DLiteStorage *s,
+                                               const char *id,
+                                               const char *name,
+                                               const size_t *offsets,
+                                               const size_t *counts,
+                                               const size_t *strides)
+{
+  DLiteDataModel *d=NULL;
+  DLiteMeta *meta=NULL;
+  DLiteArray *arr=NULL;
+  const DLiteProperty *p=NULL;
+  char *uri=NULL, *data=NULL, *full=NULL;
+  size_t i, n=0, nmemb=1, fullnmemb=1, *dims=NULL, *propdims=NULL, *pdims;
+  int j, k;
+
+  if (!s) FAIL("invalid storage, see previous errors");
+  if (!(d = dlite_datamodel(s, id))) goto fail;
+  if (!(uri = dlite_datamodel_get_meta_uri(d))) goto fail;
+  if (!(meta = dlite_meta_get(uri)))
+    FAIL2("cannot find metadata '%s' of '%s'", uri, id);
+  if ((k = dlite_meta_get_property_index(meta, name)) < 0) goto fail;
+  p = meta->_properties + k;
+  if (p->ndims == 0)
+    FAIL2("cannot load slice of scalar property '%s' of '%s'", name, id);
+
+  /* evaluate the shape of the property in the storage */
+  if (!(dims = calloc(meta->_ndimensions + 1, sizeof(size_t))) ||
+      !(propdims = calloc(meta->_npropdims + 1, sizeof(size_t))))
+    FAIL("allocation failure");
+  for (i=0; i<meta->_ndimensions; i++) {
+    int size = dlite_datamodel_get_dimension_size(d, meta->_dimensions[i].name);
+    if (size < 0) goto fail;
+    dims[i] = size;
+  }
+  if (_propdims_eval(meta, dims, propdims)) goto fail;
+  for (i=0; i<(size_t)k; i++) n += meta->_properties[i].ndims;
+  pdims = propdims + n;
+
+  for (j=0; j<p->ndims; j++) {
+    size_t step = (strides) ? strides[j] : 1;
+    if (step == 0) FAIL2("zero stride along dimension %d of '%s'", j, name);
+    if (counts[j] && offsets[j] + (counts[j] - 1) * step >= pdims[j])
+      FAIL2("slice exceeds dimension %d of '%s'", j, name);
+    nmemb *= counts[j];
+    fullnmemb *= pdims[j];
+  }
+  if (!(data = calloc((nmemb) ? nmemb : 1, p->size)))
+    FAIL("allocation failure");
+
+  if (nmemb == 0) {
+    ;  /* pass, nothing to read */
+  } else if (d->api->getPropertySlice) {
+    if (dlite_datamodel_get_property_slice(d, name, data, p->type, p->size,
+                                           p->ndims, offsets, counts,
+                                           strides)) goto fail;
+  } else {
+    /* fallback, read the whole property and copy out the slice */
+    if (!(full = calloc((fullnmemb) ? fullnmemb : 1, p->size)))
+      FAIL("allocation failure");
+    if (dlite_datamodel_get_property(d, name, full, p->type, p->size,
+                                     p->ndims, pdims)) goto fail;
+    for (i=0; i<nmemb; i++) {
+      size_t rem=i, src=0, stride=1;
+      for (j=p->ndims-1; j>=0; j--) {
+        size_t step = (strides) ? strides[j] : 1;
+        src += (offsets[j] + (rem % counts[j]) * step) * stride;
+        rem /= counts[j];
+        stride *= pdims[j];
+      }
+      if (!dlite_type_copy(data + i*p->size, full + src*p->size,
+                           p->type, p->size)) goto fail;
+    }
+  }
+  if (!(arr = dlite_array_create(data, p->type, p->size, p->ndims, counts)))
+    goto fail;
+  data = NULL;
+
+ fail:
+  if (full) {
+    if (dlite_type_is_allocated(p->type))
+      for (i=0; i<fullnmemb; i++) dlite_type_clear(full + i*p->size,
+                                                   p->type, p->size);
+    free(full);
+  }
+  if (data) {
+    if (dlite_type_is_allocated(p->type))
+      for (i=0; i<nmemb; i++) dlite_type_clear(data + i*p->size,
+                                               p->type, p->size);
+    free(data);
+  }
+  if (propdims) free(propdims);
+  if (dims) free(dims);
+  if (meta) dlite_meta_decref(meta);
+  if (uri) free(uri);
+  if (d) dlite_datamodel_free(d);
+  return arr;
+}
+
+/*
+  Help function for _instance_save().  Writes property number `i` of
+  `inst` to datamodel `d` of a storage with decomposed dimensions.
+  Properties that depend on a decomposed dimension are written as a
+  block of the global property.
+
+  Returns non-zero on error.
+ */
+static int _save_distributed_property(DLiteDataModel *d,
+                                      const DLiteInstance *inst, size_t i)
+{
+  DLiteProperty *p = (DLiteProperty *)inst->meta->_properties + i;
+  const void *ptr = dlite_instance_get_property_by_index(inst, i);
+  size_t *pdims = DLITE_PROP_DIMS(inst, i);
+  size_t *gdims=NULL, *offsets=NULL;
+  int j, n=0, retval=1;
+
+  if (p->ndims == 0)
+    return dlite_datamodel_set_property(d, p->name, ptr, p->type, p->size,
+                                        p->ndims, pdims);
+  if (!(gdims = calloc(p->ndims, sizeof(size_t))) ||
+      !(offsets = calloc(p->ndims, sizeof(size_t))))
+    FAIL("allocation failure");
+  for (j=0; j < p->ndims; j++) {
+    const DLiteDecomposition *dec =
+      dlite_storage_get_decomposition(d->s, p->dims[j]);
+    gdims[j] = (dec) ? dec->size : pdims[j];
+    offsets[j] = (dec) ? dec->offset : 0;
+    if (dec) n++;
+  }
+  if (n)
+    retval = dlite_datamodel_set_property_slice(d, p->name, ptr, p->type,
+                                                p->size, p->ndims, gdims,
+                                                offsets, pdims);
+  else
+    retval = dlite_datamodel_set_property(d, p->name, ptr, p->type, p->size,
+                                          p->ndims, pdims);
+ fail:
+  if (gdims) free(gdims);
+  if (offsets) free(offsets);
+  return retval;
+}
+
+/*
+  Help function for _instance_save().  Writes property number `i` of
+  `inst` to datamodel `d`, whose property dimensions were `savedpdims`
+  when it was last saved.
+
+  If the property only has grown along its first dimension, just the
+  appended rows are written.  Otherwise the whole property is written.
+
+  Returns non-zero on error.
+ */
+static int _save_appended_property(DLiteDataModel *d,
+                                   const DLiteInstance *inst, size_t i,
+                                   const size_t *savedpdims)
+{
+  DLiteProperty *p = (DLiteProperty *)inst->meta->_properties + i;
+  const char *ptr = dlite_instance_get_property_by_index(inst, i);
+  size_t *pdims = DLITE_PROP_DIMS(inst, i);
+  size_t *offsets=NULL, *counts=NULL, rowsize=p->size;
+  int j, retval=1;
+
+  if (!d->api->setPropertySlice || p->ndims == 0 ||
+      pdims[0] < savedpdims[0])
+    goto whole;
+  for (j=1; j < p->ndims; j++) {
+    if (pdims[j] != savedpdims[j]) goto whole;
+    rowsize *= pdims[j];
+  }
+  if (!(offsets = calloc(p->ndims, sizeof(size_t))) ||
+      !(counts = calloc(p->ndims, sizeof(size_t))))
+    FAIL("allocation failure");
+  offsets[0] = savedpdims[0];
+  counts[0] = pdims[0] - savedpdims[0];
+  for (j=1; j < p->ndims; j++) counts[j] = pdims[j];
+  retval = dlite_datamodel_set_property_slice(d, p->name,
+                                              ptr + offsets[0] * rowsize,
+                                              p->type, p->size, p->ndims,
+                                              pdims, offsets, counts);
+ fail:
+  if (offsets) free(offsets);
+  if (counts) free(counts);
+  return retval;
+ whole:
+  return dlite_datamodel_set_property(d, p->name, ptr, p->type, p->size,
+                                      p->ndims, pdims);
+}
+
+/*
+  Help function for _instance_save().  Writes property number `i` of
+  `inst`, which is declared sparse by its metadata, to datamodel `d`
+  with the setSparseProperty() function of the storage plugin.
+
+  Returns non-zero on error.
+ */
+static int _save_sparse_property(DLiteDataModel *d,
+                                 const DLiteInstance *inst, size_t i)
+{
+  DLiteSparse *sp;
+  int retval;
+  if (!(sp = dlite_instance_get_sparse_by_index(inst, i, dliteSparseNone)))
+    return 1;
+  retval = d->api->setSparseProperty(d, inst->meta->_properties[i].name, sp);
+  dlite_sparse_free(sp);
+  return retval;
+}
+
+/*
+  Help function for dlite_instance_save().
+ */
+static int _instance_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  int retval=1;
+  DLiteDataModel *d=NULL;
+  const DLiteMeta *meta;
+  size_t i, *dims, *saveddims=NULL;
+  unsigned char *dirty=NULL;
+  int caps = dlite_storage_get_capabilities(s);
+
+  if (!(meta = inst->meta)) return errx(-1, "no metadata available");
+  if (dlite_instance_sync_to_properties((DLiteInstance *)inst)) goto fail;
+
+  /* check if storage implements the instance api, but prefer the
+     datamodel api for updating an instance in a random-access storage.
+     Distributed instances always use the datamodel api */
+  if (!s->decomposition &&
+      !((inst->_flags & dliteFlagSaved) && (caps & dliteCapRandomAccess) &&
+        !(caps & dliteCapAppendOnly) && s->api->dataModel &&
+        s->api->setProperty)) {
+    if (s->api->saveInstance || s->api->saveInstances) {
+      if (s->api->saveInstance)
+        retval = s->api->saveInstance(s, inst);
+      else
+        retval = s->api->saveInstances(s, &inst, 1);
+      if (!retval) dlite_instance_notify(inst, s->location, NULL);
+      return retval;
+    }
+  }
+
+  /* proceede with the datamodel api... */
+  if (!(d = dlite_datamodel(s, inst->uuid))) goto fail;
+
+  /* only write modified properties if the storage is up to date and
+     can be updated in place */
+  if (!s->decomposition && (inst->_flags & dliteFlagSaved) &&
+      !meta->_saveprop &&
+      !(caps & dliteCapAppendOnly) &&
+      (dirty = _dirty_begin(inst, s, &saveddims)) &&
+      !_dirty_can_update(inst, d, saveddims)) {
+    free(dirty);
+    dirty = NULL;
+  }
+
+  /* update dimensions that have changed since last save */
+  if (dirty && saveddims) {
+    dims = DLITE_DIMS(inst);
+    for (i=0; i<meta->_ndimensions; i++)
+      if (dims[i] != saveddims[i] &&
+          dlite_datamodel_set_dimension_size(d, meta->_dimensions[i].name,
+                                             dims[i])) goto fail;
+  }
+
+  if (!dirty) {
+    if (dlite_datamodel_set_meta_uri(d, meta->uri)) goto fail;
+
+    dims = DLITE_DIMS(inst);
+    for (i=0; i<meta->_ndimensions; i++) {
+      char *dimname = inst->meta->_dimensions[i].name;
+      size_t size = dims[i];
+      const DLiteDecomposition *dec;
+      if ((dec = dlite_storage_get_decomposition(s, dimname))) {
+        if (dec->offset + dims[i] > dec->size)
+          FAIL4("local part [%lu, %lu) of dimension '%s' exceeds its "
+                "global size %lu", (unsigned long)dec->offset,
+                (unsigned long)(dec->offset + dims[i]), dimname,
+                (unsigned long)dec->size);
+        size = dec->size;
+      }
+      if (dlite_datamodel_set_dimension_size(d, dimname, size)) goto fail;
+    }
+  }
+
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = (DLiteProperty *)inst->meta->_properties + i;
+    const void *ptr;
+    size_t *pdims = DLITE_PROP_DIMS(inst, i);
+    if (s->decomposition) {
+      if (_save_distributed_property(d, inst, i)) goto fail;
+      continue;
+    }
+    if (dirty && !dirty[i]) {
+      const size_t *savedpdims;
+      int j;
+      if (!saveddims || p->ndims == 0) continue;
+      savedpdims = saveddims + meta->_ndimensions + meta->_propdiminds[i];
+      for (j=0; j < p->ndims; j++)
+        if (pdims[j] != savedpdims[j]) break;
+      if (j == p->ndims) continue;
+      if (_save_appended_property(d, inst, i, savedpdims)) goto fail;
+      dirty[i] = 1;  /* report appended properties as changed */
+      continue;
+    }
+    if (d->api->setSparseProperty && p->ndims > 0 &&
+        dlite_meta_get_sparse_format(meta, i)) {
+      if (_save_sparse_property(d, inst, i)) goto fail;
+      continue;
+    }
+    ptr = dlite_instance_get_property_by_index(inst, i);
+    if (dlite_datamodel_set_property(d, p->name, ptr, p->type, p->size,
+				     p->ndims, pdims)) goto fail;
+  }
+  if (!s->decomposition)
+    _dirty_saved((DLiteInstance *)inst, s, dirty != NULL);
+  dlite_instance_notify(inst, s->location, dirty);
+  retval = 0;
+ fail:
+  if (retval && dirty) _dirty_mark(inst, -1);
+  if (dirty) free(dirty);
+  if (saveddims) free(saveddims);
+  if (d) dlite_datamodel_free(d);
+  return retval;
+}
+
+/*
+  Saves instance `inst` to storage `s` and updates the statistics.
+  Returns non-zero on error.
+ */
+static int _instance_save_io(DLiteStorage *s, const DLiteInstance *inst)
 {
-  return _instance_load_casted(s, id, metaid, 1);
+  uint64_t t0 = dlite_record_begin();
+  int stat = _instance_save(s, inst);
+  if (!stat) dlite_instance_save_completed(s, inst, t0);
+  return stat;
 }
 
 /*
   Saves instance `inst` to storage `s`.  Returns non-zero on error.
+
+  If `inst` was last saved to `s` and `s` still contains it with the
+  same dimensions, only properties that have been modified since then
+  are written.  See dlite_instance_mark_dirty().
+
+  If write-behind is enabled for `s`, the instance is only recorded as
+  pending and written when `s` is flushed.  See
+  dlite_storage_set_write_behind().
  */
 int dlite_instance_save(DLiteStorage *s, const DLiteInstance *inst)
 {
-  int retval=1;
-  DLiteDataModel *d=NULL;
-  const DLiteMeta *meta;
-  size_t i, *dims;
-
-  if (!(meta = inst->meta)) return errx(-1, "no metadata available");
-  if (dlite_instance_sync_to_properties((DLiteInstance *)inst)) goto fail;
-
-  /* check if storage implements the instance api */
-  if (s->api->saveInstance)
-    return s->api->saveInstance(s, inst);
+  if (s && s->saveq) return dlite_storage_defer_save(s, inst);
+  return _instance_save_io(s, inst);
+}
 
-  /* proceede with the datamodel api... */
-  if (!(d = dlite_datamodel(s, inst->uuid))) goto fail;
-  if (dlite_datamodel_set_meta_uri(d, meta->uri)) goto fail;
+/*
+  Saves the `n` instances in array `insts` to storage `s`.
 
-  dims = DLITE_DIMS(inst);
-  for (i=0; i<meta->_ndimensions; i++) {
-    char *dimname = inst->meta->_dimensions[i].name;
-    if (dlite_datamodel_set_dimension_size(d, dimname, dims[i])) goto fail;
-  }
+  This is equivalent to calling dlite_instance_save() for each
+  instance, but storage plugins implementing the saveInstances() api
+  may store all instances in one round-trip.
 
-  for (i=0; i<meta->_nproperties; i++) {
-    DLiteProperty *p = (DLiteProperty *)inst->meta->_properties + i;
-    const void *ptr = dlite_instance_get_property_by_index(inst, i);
-    size_t *pdims = DLITE_PROP_DIMS(inst, i);
-    if (dlite_datamodel_set_property(d, p->name, ptr, p->type, p->size,
-				     p->ndims, pdims)) goto fail;
+  Returns non-zero on error.
+ */
+int dlite_instance_save_many(DLiteStorage *s, const DLiteInstance **insts,
+                             size_t n)
+{
+  size_t i;
+  uint64_t t0;
+  if (!s) return errx(1, "invalid storage, see previous errors");
+  if (s->api->saveInstances) {
+    for (i=0; i<n; i++) {
+      if (!insts[i]->meta) return errx(-1, "no metadata available");
+      if (dlite_instance_sync_to_properties((DLiteInstance *)insts[i]))
+        return 1;
+    }
+    t0 = dlite_record_begin();
+    if (s->api->saveInstances(s, insts, n)) return 1;
+    for (i=0; i<n; i++) {
+      _stats_io(s, insts[i], dliteStatsBytesWritten);
+      if (t0) dlite_record_io(s, dliteRecordSave, insts[i]->uuid, NULL,
+                              dlite_stats_instance_nbytes(insts[i]), t0);
+      dlite_instance_notify(insts[i], s->location, NULL);
+    }
+    dlite_storage_paths_clear_missing();
+    return 0;
   }
-  retval = 0;
- fail:
-  if (d) dlite_datamodel_free(d);
-  return retval;
+  for (i=0; i<n; i++)
+    if (_instance_save_io(s, insts[i])) return 1;
+  return 0;
 }
 
 /*
@@ -1037,10 +5418,7 @@ const char *dlite_instance_get_meta_uri(const DLiteInstance *inst)
  */
 bool dlite_instance_has_dimension(DLiteInstance *inst, const char *name)
 {
-  size_t i;
-  for (i=0; i < inst->meta->_ndimensions; i++)
-    if (strcmp(inst->meta->_dimensions[i].name, name) == 0) return true;
-  return false;
+  return dlite_meta_has_dimension(inst->meta, name);
 }
 
 
@@ -1102,7 +5480,11 @@ void *dlite_instance_get_property_by_index(const DLiteInstance *inst, size_t i)
 		(int)i, (int)inst->meta->_nproperties, inst->meta->uri), NULL;
   if (dlite_instance_sync_to_dimension_sizes((DLiteInstance *)inst))
     return NULL;
-  if (inst->meta->_saveprop &&
+  if ((inst->_flags & dliteFlagLazy) &&
+      _lazy_load((DLiteInstance *)inst, i, 1)) return NULL;
+  if ((inst->_flags & dliteFlagDevice) &&
+      dlite_device_sync_property((DLiteInstance *)inst, i, 1)) return NULL;
+  if (inst->meta->_saveprop && !(inst->_flags & dliteFlagFrozen) &&
       inst->meta->_saveprop((DLiteInstance *)inst, i)) return NULL;
   ptr = DLITE_PROP(inst, i);
   if (inst->meta->_properties[i].ndims > 0)
@@ -1122,6 +5504,10 @@ int dlite_instance_set_property_by_index(DLiteInstance *inst, size_t i,
   DLiteProperty *p = meta->_properties + i;
   void *dest;
 
+  if (dlite_instance_make_writable(inst, i)) return -1;
+  if ((inst->_flags & dliteFlagLazy) && _lazy_load(inst, i, 0)) return -1;
+  if ((inst->_flags & dliteFlagDevice) &&
+      dlite_device_sync_property(inst, i, 1)) return -1;
   if (p->ndims > 0) {
     int j;
     size_t n, nmemb=1;
@@ -1145,6 +5531,7 @@ int dlite_instance_set_property_by_index(DLiteInstance *inst, size_t i,
       dlite_instance_sync_from_dimension_sizes((DLiteInstance *)inst))
     return -1;
   if (inst->meta->_loadprop && inst->meta->_loadprop(inst, i)) return -1;
+  if (inst->_flags & DIRTY_FLAGS) _dirty_mark(inst, i);
 
   return 0;
 }
@@ -1199,6 +5586,44 @@ size_t *dlite_instance_get_property_dims_by_index(const DLiteInstance *inst,
   return dims;
 }
 
+/*
+  Returns a pointer to the data of property `i` in `inst` without
+  copying it.  The property must have type `type`, size `size` and
+  `ndims` dimensions.  Its dimension sizes are written to `shape`.  If
+  `order` is 'F', they are written in reverse order.
+
+  Returns NULL on error.
+ */
+void *dlite_instance_get_property_data_by_index(const DLiteInstance *inst,
+                                                size_t i, DLiteType type,
+                                                size_t size, int ndims,
+                                                size_t *shape, int order)
+{
+  const DLiteProperty *p;
+  void *ptr;
+  int j;
+  if (!inst->meta)
+    return errx(1, "no metadata available"), NULL;
+  if (!(p = dlite_meta_get_property_by_index(inst->meta, i)))
+    return NULL;
+  if (p->type != type || p->size != size)
+    return errx(1, "property '%s' is not of type %s with size %lu",
+                p->name, dlite_type_get_dtypename(type),
+                (unsigned long)size), NULL;
+  if (p->ndims != ndims)
+    return errx(1, "property '%s' has %d dimensions, but %d was requested",
+                p->name, p->ndims, ndims), NULL;
+  if (order != 'C' && order != 'F')
+    return errx(1, "order must be 'C' or 'F', got '%c'", order), NULL;
+  if (!(ptr = dlite_instance_get_property_by_index(inst, i))) return NULL;
+  if (ndims > 0 &&
+      dlite_instance_sync_to_dimension_sizes((DLiteInstance *)inst))
+    return NULL;
+  for (j=0; j < ndims; j++)
+    shape[(order == 'F') ? ndims - j - 1 : j] = DLITE_PROP_DIM(inst, i, j);
+  return ptr;
+}
+
 
 /*
   Returns size of dimension `i` or -1 on error.
@@ -1240,15 +5665,124 @@ int dlite_instance_set_property(DLiteInstance *inst, const char *name,
   return dlite_instance_set_property_by_index(inst, i, ptr);
 }
 
+/* Help function for adopting or borrowing `ptr` as the array of
+   property `i`. */
+static int _instance_attach_property(DLiteInstance *inst, size_t i,
+                                     void *ptr, DLiteDeallocator dealloc,
+                                     int borrowed)
+{
+  DLiteProperty *p;
+  void **dest;
+  if (!dlite_instance_is_data(inst))
+    return errx(1, "cannot attach property arrays to metadata");
+  if (inst->_flags & dliteFlagFrozen) return _frozen_error(inst);
+  if (i >= inst->meta->_nproperties)
+    return errx(1, "index %d exceeds number of properties (%d) in %s",
+                (int)i, (int)inst->meta->_nproperties, inst->meta->uri);
+  p = inst->meta->_properties + i;
+  if (p->ndims <= 0)
+    return errx(1, "cannot attach buffer to scalar property: %s", p->name);
+  if (borrowed && dlite_type_is_allocated(p->type))
+    return errx(1, "cannot borrow buffer for property '%s' of type %s",
+                p->name, dlite_type_get_dtypename(p->type));
+  if (!ptr) return errx(1, "cannot attach NULL to property: %s", p->name);
+
+  /* All fallible steps must be done before `ptr` is registered, since
+     the caller keeps the ownership of `ptr` on error. */
+  if ((inst->_flags & dliteFlagStrings) && _strings_detach(inst, i)) return 1;
+  if (_foreign_add(ptr, dealloc, borrowed)) return 1;
+
+  /* release current array */
+  dest = DLITE_PROP(inst, i);
+  if (*dest && dlite_type_is_allocated(p->type)) {
+    int j;
+    size_t n, nmemb=1;
+    for (j=0; j<p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+    for (n=0; n<nmemb; n++)
+      dlite_type_clear((char *)(*dest) + n*p->size, p->type, p->size);
+  }
+  if (!(inst->_flags & dliteFlagShared && _shared_release(dest)) &&
+      !(inst->_flags & dliteFlagForeign && _foreign_release(dest)) &&
+      !_arena_contains(inst, *dest))
+    _allocator_free(_instance_allocator(inst), *dest);
+
+  *dest = ptr;
+  inst->_flags |= dliteFlagForeign;
+
+  /* Mark the property as loaded, such that it is not overwritten from
+     storage.  This cannot fail since nothing is loaded. */
+  if (inst->_flags & dliteFlagLazy) _lazy_load(inst, i, 0);
+  if (inst->_flags & DIRTY_FLAGS) _dirty_mark(inst, i);
+  return 0;
+}
+
+/*
+  Lets property `i` of `inst` take over the ownership of the array
+  `ptr` instead of copying it.  The array must have the size and layout
+  of the property, i.e. C-ordered with as many items as the property
+  has.  The previous array of the property is free'ed.
+
+  `ptr` is released with `dealloc` when it is no longer needed by
+  `inst`.  If `dealloc` is NULL, free() is used.  If the dimensions
+  of `inst` are changed later, the data is copied to a new array and
+  `ptr` is released immediately.
+
+  Only dimensional properties of data instances can be adopted.
+
+  Returns non-zero on error, in which case the caller still owns `ptr`.
+ */
+int dlite_instance_adopt_property_by_index(DLiteInstance *inst, size_t i,
+                                           void *ptr, DLiteDeallocator dealloc)
+{
+  return _instance_attach_property(inst, i, ptr, dealloc, 0);
+}
+
+/*
+  Like dlite_instance_adopt_property_by_index(), but refers to the
+  property by name.
+ */
+int dlite_instance_adopt_property(DLiteInstance *inst, const char *name,
+                                  void *ptr, DLiteDeallocator dealloc)
+{
+  int i;
+  if ((i = dlite_meta_get_property_index(inst->meta, name)) < 0) return 1;
+  return _instance_attach_property(inst, i, ptr, dealloc, 0);
+}
+
+/*
+  Like dlite_instance_adopt_property_by_index(), but `inst` only
+  borrows `ptr` and never frees it.  The caller must keep `ptr`
+  valid for the lifetime of `inst`, or until the dimensions of `inst`
+  are changed.
+
+  Arrays of allocated types (like strings) cannot be borrowed.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_borrow_property_by_index(DLiteInstance *inst, size_t i,
+                                            void *ptr)
+{
+  return _instance_attach_property(inst, i, ptr, NULL, 1);
+}
+
+/*
+  Like dlite_instance_borrow_property_by_index(), but refers to the
+  property by name.
+ */
+int dlite_instance_borrow_property(DLiteInstance *inst, const char *name,
+                                   void *ptr)
+{
+  int i;
+  if ((i = dlite_meta_get_property_index(inst->meta, name)) < 0) return 1;
+  return _instance_attach_property(inst, i, ptr, NULL, 1);
+}
+
 /*
   Returns true if instance has a property with the given name.
  */
 bool dlite_instance_has_property(const DLiteInstance *inst, const char *name)
 {
-  size_t i;
-  for (i=0; i < inst->meta->_nproperties; i++)
-    if (strcmp(inst->meta->_properties[i].name, name) == 0) return true;
-  return false;
+  return dlite_meta_has_property(inst->meta, name);
 }
 
 /*
@@ -1324,7 +5858,7 @@ int dlite_instance_sync_to_dimension_sizes(DLiteInstance *inst)
 {
   int n, retval=1, update=0, *newdims=NULL;
   size_t i, *dims=DLITE_DIMS(inst);
-  if (!inst->meta->_getdim) return 0;
+  if (!inst->meta->_getdim || (inst->_flags & dliteFlagFrozen)) return 0;
   for (i=0; i<inst->meta->_ndimensions; i++) {
     if ((n = inst->meta->_getdim(inst, i)) < 0) goto fail;
     if (n != (int)dims[i]) update=1;
@@ -1360,13 +5894,16 @@ int dlite_instance_sync_from_dimension_sizes(DLiteInstance *inst)
 /*
   Help function that update properties from the saveprop() method of
   extended metadata.  Does nothing, if the metadata has no saveprop() method.
+  Modified device copies of the property arrays are copied back first
+  (see dlite-device.h).
 
   Returns non-zero on error.
  */
 int dlite_instance_sync_to_properties(DLiteInstance *inst)
 {
   size_t i;
-  if (!inst->meta->_saveprop) return 0;
+  if ((inst->_flags & dliteFlagDevice) && dlite_device_sync(inst)) return 1;
+  if (!inst->meta->_saveprop || (inst->_flags & dliteFlagFrozen)) return 0;
   if (dlite_instance_sync_to_dimension_sizes(inst)) return 1;
   for (i=0; i<inst->meta->_nproperties; i++)
     if (inst->meta->_saveprop(inst, i)) return 1;
@@ -1401,36 +5938,46 @@ int dlite_instance_sync_from_properties(DLiteInstance *inst)
   more dimensions, where any but the first dimension is updated,
   should be considered invalidated.
 
+  Arrays with reserved capacity (see dlite_instance_reserve_dimension())
+  are not reallocated as long as they fit within it.  When they do not
+  fit, the capacity is at least doubled.
+
   Returns non-zero on error.
  */
 int dlite_instance_set_dimension_sizes(DLiteInstance *inst, const int *dims)
 {
   int retval=1, i;
-  size_t n;
-  size_t *xdims=NULL;
+  size_t n, k, nbuf;
+  size_t buf[32], *xdims=buf;
   size_t *oldpropdims=NULL;
-  int *oldmembs=NULL;
+  size_t *oldmembs=NULL;
+  const DLiteAllocator *a = _instance_allocator(inst);
 
   if (!dlite_instance_is_data(inst))
     return err(1, "it is not possible to change dimensions of metadata");
+  if (inst->_flags & dliteFlagFrozen) return _frozen_error(inst);
+  if (dlite_instance_load_all(inst)) return 1;
+  if ((inst->_flags & dliteFlagDevice) && dlite_device_sync(inst)) return 1;
+  if ((inst->_flags & dliteFlagStrings) && dlite_instance_unpack_strings(inst))
+    return 1;
 
   if (inst->meta->_setdim)
     for (n=0; n < inst->meta->_ndimensions; n++)
-      if (inst->meta->_setdim(inst, n, dims[n]) < 0) goto fail;
+      if (inst->meta->_setdim(inst, n, dims[n]) < 0) return 1;
 
-  if (!(xdims = calloc(inst->meta->_ndimensions, sizeof(size_t))))
-    FAIL("Allocation failure");
+  /* work arrays: new dimensions, old propdims and old property members */
+  nbuf = inst->meta->_ndimensions + inst->meta->_npropdims +
+    inst->meta->_nproperties;
+  if (nbuf > countof(buf) && !(xdims = malloc(nbuf * sizeof(size_t))))
+    return err(1, "Allocation failure");
   for (n=0; n < inst->meta->_ndimensions; n++)
     xdims[n] = (dims[n] >= 0) ? (size_t)dims[n] : DLITE_DIM(inst, n);
 
-  /* save old propdims and property members (oldmembs) */
-  if (!(oldpropdims = calloc(inst->meta->_npropdims, sizeof(size_t))))
-    FAIL("Allocation failure");
+  oldpropdims = xdims + inst->meta->_ndimensions;
   memcpy(oldpropdims, DLITE_PROP_DIMS(inst, 0),
          inst->meta->_npropdims * sizeof(size_t));
 
-  if (!(oldmembs = calloc(inst->meta->_nproperties, sizeof(int))))
-    FAIL("Allocation failure");
+  oldmembs = oldpropdims + inst->meta->_npropdims;
   for (n=0; n < inst->meta->_nproperties; n++) {
     DLiteProperty *p = inst->meta->_properties + n;
     oldmembs[n] = 1;
@@ -1444,7 +5991,7 @@ int dlite_instance_set_dimension_sizes(DLiteInstance *inst, const int *dims)
   /* reallocate properties */
   for (n=0; n < inst->meta->_nproperties; n++) {
     DLiteProperty *p = inst->meta->_properties + n;
-    int newmembs=1, oldsize, newsize;
+    size_t newmembs=1, oldsize, newsize, capacity;
     void **ptr = DLITE_PROP(inst, n);
     if (p->ndims <= 0) continue;
     for (i=0; i < p->ndims; i++)
@@ -1452,23 +5999,44 @@ int dlite_instance_set_dimension_sizes(DLiteInstance *inst, const int *dims)
 
     oldsize = oldmembs[n] * p->size;
     newsize = newmembs * p->size;
-    if (newmembs == oldmembs[n]) {
-      continue;
-    } else if (newmembs > 0) {
+    if (newmembs == oldmembs[n]) continue;
+    if ((inst->_flags & dliteFlagShared) &&
+        _shared_make_private(ptr, oldsize, a)) goto fail;
+    if ((inst->_flags & dliteFlagForeign) &&
+        _foreign_make_owned(ptr, oldsize, a)) goto fail;
+    capacity = _reserved_get(inst, n);
+    if (newmembs > 0) {
       void *q;
       if (newmembs < oldmembs[n])
-        for (i=newmembs; i < oldmembs[n]; i++)
-          dlite_type_clear((char *)(*ptr) + i*p->size, p->type, p->size);
-      if (!(*ptr = realloc((q = *ptr), newsize))) {
-        if (q) free(q);
-        return err(1, "error reallocating '%s' to size %d", p->name, newsize);
+        for (k=newmembs; k < oldmembs[n]; k++)
+          dlite_type_clear((char *)(*ptr) + k*p->size, p->type, p->size);
+      if (newmembs <= capacity) {
+        /* Fits within the reserved capacity */
+      } else if (_arena_contains(inst, *ptr)) {
+        /* Arrays in the arena cannot grow, move them out of it */
+        if (newsize > oldsize) {
+          if (!(q = _allocator_malloc(a, newsize)))
+            FAIL2("error allocating '%s' of size %lu",
+                  p->name, (unsigned long)newsize);
+          memcpy(q, *ptr, oldsize);
+          *ptr = q;
+        }
+      } else {
+        /* Grow geometrically if capacity is reserved */
+        size_t nalloc = (capacity && newmembs < 2*capacity) ?
+          2*capacity : newmembs;
+        if (!(q = _allocator_realloc(a, *ptr, nalloc * p->size)))
+          FAIL2("error reallocating '%s' to size %lu",
+                p->name, (unsigned long)(nalloc * p->size));
+        *ptr = q;
+        if (capacity && _reserved_set(inst, n, nalloc)) goto fail;
       }
       if (newmembs > oldmembs[n])
         memset((char *)(*ptr) + oldsize, 0, newsize - oldsize);
     } else if (*ptr) {
-      for (i=0; i < oldmembs[n]; i++)
-        dlite_type_clear((char *)(*ptr) + i*p->size, p->type, p->size);
-      free(*ptr);
+      for (k=0; k < oldmembs[n]; k++)
+        dlite_type_clear((char *)(*ptr) + k*p->size, p->type, p->size);
+      if (!_arena_contains(inst, *ptr)) _allocator_free(a, *ptr);
       *ptr = NULL;
     } else {
       assert(oldsize == 0);
@@ -1481,14 +6049,28 @@ int dlite_instance_set_dimension_sizes(DLiteInstance *inst, const int *dims)
 
   if (dlite_instance_sync_from_dimension_sizes(inst)) goto fail;
 
+  /* mark properties whose values are invalidated as modified.  Rows
+     appended along the first dimension are tracked separately */
+  inst->_flags &= ~dliteFlagReloadable;
+  if (inst->_flags & dliteFlagFingerprint) _fingerprint_forget(inst);
+  if (inst->_flags & dliteFlagSaved) {
+    for (n=0; n < inst->meta->_nproperties; n++) {
+      DLiteProperty *p = inst->meta->_properties + n;
+      size_t *newpdims = DLITE_PROP_DIMS(inst, n);
+      size_t *oldpdims = oldpropdims + inst->meta->_propdiminds[n];
+      for (i=0; i < p->ndims; i++)
+        if (newpdims[i] != oldpdims[i] &&
+            (i > 0 || newpdims[i] < oldpdims[i])) break;
+      if (i < p->ndims) _dirty_mark(inst, n);
+    }
+  }
+
   retval = 0;
  fail:
-  if (retval && oldpropdims)
+  if (retval)
     memcpy(DLITE_PROP_DIMS(inst, 0), oldpropdims,
            inst->meta->_npropdims * sizeof(size_t));
-  if (xdims) free(xdims);
-  if (oldpropdims) free(oldpropdims);
-  if (oldmembs) free(oldmembs);
+  if (xdims != buf) free(xdims);
   return retval;
 }
 
@@ -1501,11 +6083,14 @@ int dlite_instance_set_dimension_size_by_index(DLiteInstance *inst,
 {
   size_t j;
   int retval;
-  int *dims = malloc(inst->meta->_ndimensions * sizeof(int));
+  int buf[16], *dims=buf;
+  if (inst->meta->_ndimensions > countof(buf) &&
+      !(dims = malloc(inst->meta->_ndimensions * sizeof(int))))
+    return err(1, "Allocation failure");
   for (j=0; j < inst->meta->_ndimensions; j++) dims[j] = -1;
   dims[i] = size;
   retval = dlite_instance_set_dimension_sizes(inst, dims);
-  free(dims);
+  if (dims != buf) free(dims);
   return retval;
 }
 
@@ -1521,6 +6106,135 @@ int dlite_instance_set_dimension_size(DLiteInstance *inst, const char *name,
   return dlite_instance_set_dimension_size_by_index(inst, i, size);
 }
 
+/*
+  Help function for dlite_instance_reserve_dimension_by_index() and
+  dlite_instance_append_dimension_by_index().  Ensures that the arrays
+  of all properties depending on dimension `i` of `inst` have room for
+  `size` entries along that dimension.  If `grow` is non-zero, arrays
+  that must be reallocated get at least twice their current capacity.
+
+  Returns non-zero on error.
+ */
+static int _instance_reserve(DLiteInstance *inst, size_t i, size_t size,
+                             int grow)
+{
+  const DLiteMeta *meta = inst->meta;
+  const DLiteAllocator *a = _instance_allocator(inst);
+  size_t buf[32], *xdims=buf, *propdims;
+  size_t n, nbuf = meta->_ndimensions + meta->_npropdims;
+  int j, retval=1;
+
+  if (inst->_flags & (dliteFlagShared | dliteFlagForeign)) return 0;
+  if (size <= DLITE_DIM(inst, i)) return 0;
+  if (nbuf > countof(buf) && !(xdims = malloc(nbuf * sizeof(size_t))))
+    return err(1, "Allocation failure");
+  propdims = xdims + meta->_ndimensions;
+  memcpy(xdims, DLITE_DIMS(inst), meta->_ndimensions * sizeof(size_t));
+  xdims[i] = size;
+  if (_propdims_eval(meta, xdims, propdims)) goto fail;
+
+  for (n=0; n < meta->_nproperties; n++) {
+    DLiteProperty *p = meta->_properties + n;
+    size_t *pdims = propdims + meta->_propdiminds[n];
+    size_t nmembs=1, curmembs=1, capacity;
+    void **ptr = DLITE_PROP(inst, n), *q;
+    if (p->ndims <= 0) continue;
+    for (j=0; j < p->ndims; j++) {
+      nmembs *= pdims[j];
+      curmembs *= DLITE_PROP_DIM(inst, n, j);
+    }
+    if (nmembs <= curmembs) continue;
+    capacity = _reserved_get(inst, n);
+    if (nmembs <= capacity) continue;
+    if (capacity < curmembs) capacity = curmembs;
+    if (grow && nmembs < 2*capacity) nmembs = 2*capacity;
+    if (_arena_contains(inst, *ptr)) {
+      if ((q = _allocator_malloc(a, nmembs * p->size)))
+        memcpy(q, *ptr, curmembs * p->size);
+    } else {
+      q = _allocator_realloc(a, *ptr, nmembs * p->size);
+    }
+    if (!q) FAIL2("error reserving '%s' of size %lu",
+                  p->name, (unsigned long)(nmembs * p->size));
+    *ptr = q;
+    if (_reserved_set(inst, n, nmembs)) goto fail;
+  }
+  retval = 0;
+ fail:
+  if (xdims != buf) free(xdims);
+  return retval;
+}
+
+/*
+  Reserves room for `size` entries along dimension `i` of `inst`
+  without changing its size.
+ */
+int dlite_instance_reserve_dimension_by_index(DLiteInstance *inst, size_t i,
+                                              size_t size)
+{
+  if (!dlite_instance_is_data(inst))
+    return err(1, "it is not possible to change dimensions of metadata");
+  if (inst->_flags & dliteFlagFrozen) return _frozen_error(inst);
+  if (i >= inst->meta->_ndimensions)
+    return errx(1, "dimension index %lu out of range: %s",
+                (unsigned long)i, inst->meta->uri);
+  return _instance_reserve(inst, i, size, 0);
+}
+
+/*
+  Like dlite_instance_reserve_dimension_by_index(), but reserves room
+  along dimension `name`.  Returns non-zero on error.
+ */
+int dlite_instance_reserve_dimension(DLiteInstance *inst, const char *name,
+                                     size_t size)
+{
+  int i;
+  if ((i = dlite_meta_get_dimension_index(inst->meta, name)) < 0) return -1;
+  return dlite_instance_reserve_dimension_by_index(inst, i, size);
+}
+
+/*
+  Appends `n` rows to dimension `i` of `inst`.  The new rows are zeroed.
+
+  This is intended for time series, where `i` is the first dimension
+  of the properties depending on it.  The rows appended to such
+  properties are not marked as modified.  Instead, if `inst` has been
+  saved to a storage supporting property slices (like hdf5), the next
+  save to it writes only the new rows without rewriting the earlier
+  ones.  Fill the new rows via the property pointers, since
+  dlite_instance_set_property() marks the whole property as modified.
+
+  The property arrays grow geometrically (see
+  dlite_instance_reserve_dimension()), such that appending rows one by
+  one takes amortised constant time.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_append_dimension_by_index(DLiteInstance *inst, size_t i,
+                                             size_t n)
+{
+  if (inst->_flags & dliteFlagFrozen) return _frozen_error(inst);
+  if (i >= inst->meta->_ndimensions)
+    return errx(1, "dimension index %lu out of range: %s",
+                (unsigned long)i, inst->meta->uri);
+  if (dlite_instance_is_data(inst) &&
+      _instance_reserve(inst, i, DLITE_DIM(inst, i) + n, 1)) return 1;
+  return dlite_instance_set_dimension_size_by_index(inst, i,
+                                                    DLITE_DIM(inst, i) + n);
+}
+
+/*
+  Like dlite_instance_append_dimension_by_index(), but appends `n`
+  rows to dimension `name`.  Returns non-zero on error.
+ */
+int dlite_instance_append_dimension(DLiteInstance *inst, const char *name,
+                                    size_t n)
+{
+  int i;
+  if ((i = dlite_meta_get_dimension_index(inst->meta, name)) < 0) return -1;
+  return dlite_instance_append_dimension_by_index(inst, i, n);
+}
+
 
 /*
   Copies instance `inst` to a newly created instance.
@@ -1564,6 +6278,76 @@ DLiteInstance *dlite_instance_copy(const DLiteInstance *inst, const char *newid)
 }
 
 
+/*
+  Like dlite_instance_copy(), but the new instance shares the arrays of
+  non-allocated types (like numbers) with `inst` instead of copying
+  them.  A private copy of a shared array is made first when write
+  access to it is requested with dlite_instance_set_property(),
+  dlite_instance_make_writable() or DLITE_PROP_RW().
+
+  Note that writing to a shared array through DLITE_PROP() or the
+  pointer returned by dlite_instance_get_property() affects all
+  instances sharing the array.
+
+  Metadata and instances of metadata with `_loadprop` or `_saveprop`
+  hooks are always deep-copied.
+
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_instance_copy_cow(DLiteInstance *inst, const char *newid)
+{
+  DLiteInstance *new=NULL;
+  const DLiteMeta *meta = inst->meta;
+  size_t n;
+  int i;
+  if (dlite_instance_is_meta(inst) || meta->_loadprop || meta->_saveprop)
+    return dlite_instance_copy(inst, newid);
+  /* A frozen instance can only share its arrays if it is already
+     marked as sharing them or never free's them */
+  if ((inst->_flags & dliteFlagFrozen) &&
+      !(inst->_flags & (dliteFlagShared | dliteFlagImmortal)))
+    return dlite_instance_copy(inst, newid);
+  if (dlite_instance_load_all(inst)) return NULL;
+  if (dlite_instance_sync_to_properties(inst)) return NULL;
+  if (!(new = dlite_instance_create(meta, DLITE_DIMS(inst), newid)))
+    return NULL;
+  new->_flags |= dliteFlagShared;
+  for (n=0; n < meta->_nproperties; n++) {
+    DLiteProperty *p = meta->_properties + n;
+    void *src = DLITE_PROP(inst, n);
+    void *dst = DLITE_PROP(new, n);
+    if (p->ndims > 0) {
+      void **srcp = src, **dstp = dst;
+      size_t nmembs=1;
+      for (i=0; i < p->ndims; i++)
+        nmembs *= DLITE_PROP_DIM(inst, n, i);
+      if (nmembs && *srcp && !dlite_type_is_allocated(p->type) &&
+          !_arena_contains(inst, *srcp) && !_foreign_contains(*srcp) &&
+          _instance_allocator(inst) == _instance_allocator(new)) {
+        /* share the array */
+        if (_shared_acquire(*srcp)) goto fail;
+        if (!_arena_contains(new, *dstp))
+          _allocator_free(_instance_allocator(new), *dstp);
+        *dstp = *srcp;
+        if (!(inst->_flags & dliteFlagFrozen))
+          inst->_flags |= dliteFlagShared;
+      } else {
+        for (i=0; i < (int)nmembs; i++)
+          if (!dlite_type_copy((char *)(*dstp) + i*p->size,
+                               (char *)(*srcp) + i*p->size,
+                               p->type, p->size)) goto fail;
+      }
+    } else {
+      if (!dlite_type_copy(dst, src, p->type, p->size)) goto fail;
+    }
+  }
+  return new;
+ fail:
+  if (new) dlite_instance_decref(new);
+  return NULL;
+}
+
+
 /*
   Returns a new DLiteArray object for property number `i` in instance `inst`.
 
@@ -1771,9 +6555,12 @@ int dlite_instance_assign_casted_property_by_index(const DLiteInstance *inst,
   //if (ddims) free(ddims);
   //return stat;
   //
-  void *dest = dlite_instance_get_property_by_index(inst, i);
+  void *dest;
   DLiteProperty *p = inst->meta->_properties + i;
   size_t *ddims = DLITE_PROP_DIMS(inst, i);
+  if (dlite_instance_make_writable((DLiteInstance *)inst, i)) return 1;
+  dest = dlite_instance_get_property_by_index(inst, i);
+  if (inst->_flags & DIRTY_FLAGS) _dirty_mark(inst, i);
   return dlite_type_ndcast(p->ndims,
                            dest, p->type, p->size, ddims, NULL,
                            src, type, size, dims, strides,
@@ -1844,6 +6631,7 @@ int dlite_meta_init(DLiteMeta *meta)
   int idim_dim=-1, idim_prop=-1, idim_rel=-1;
   int iprop_dim=-1, iprop_prop=-1, iprop_rel=-1;
   int ismeta = dlite_meta_is_metameta(meta);
+  int packed;
 
   /* Initiate meta-metadata */
   if (!meta->meta->_dimoffset && dlite_meta_init((DLiteMeta *)meta->meta))
@@ -1916,7 +6704,9 @@ int dlite_meta_init(DLiteMeta *meta)
 
   /* -- property values (propoffsets[]) */
   meta->_propoffsets = (size_t *)((char *)meta + DLITE_PROPOFFSETSOFFSET(meta));
-  for (i=0; i<meta->_nproperties; i++) {
+  if ((packed = _layout_is_packed(meta)) && _layout_pack(meta, &size))
+    goto fail;
+  for (i=0; i<meta->_nproperties && !packed; i++) {
     DLiteProperty *p = meta->_properties + i;
     if (p->ndims) {
       size += padding_at(void *, size);
@@ -1961,6 +6751,15 @@ int dlite_meta_init(DLiteMeta *meta)
   size += padding_at(size_t, size);
   DEBUG_LOG("    size=%d\n", (int)size);
 
+  /* -- name index.  Not created if names are not yet assigned. */
+  if (meta->_nameindex) free(meta->_nameindex);
+  meta->_nameindex = _nameindex_create(meta);
+
+  /* -- compiled property dimensions.  Not created if names are not yet
+        assigned or expressions are invalid. */
+  _propdimscode_free(meta->_propdimscode);
+  meta->_propdimscode = _propdimscode_create(meta);
+
   return 0;
  fail:
   return 1;
@@ -2045,11 +6844,8 @@ int dlite_meta_save_url(const char *url, const DLiteMeta *meta)
  */
 int dlite_meta_get_dimension_index(const DLiteMeta *meta, const char *name)
 {
-  size_t i;
-  for (i=0; i<meta->_ndimensions; i++) {
-    DLiteDimension *d = meta->_dimensions + i;
-    if (strcmp(name, d->name) == 0) return i;
-  }
+  int i;
+  if ((i = _meta_find_dimension(meta, name)) >= 0) return i;
   return err(-1, "%s has no such dimension: '%s'", meta->uri, name);
 }
 
@@ -2059,14 +6855,31 @@ int dlite_meta_get_dimension_index(const DLiteMeta *meta, const char *name)
  */
 int dlite_meta_get_property_index(const DLiteMeta *meta, const char *name)
 {
-  size_t i;
-  for (i=0; i<meta->_nproperties; i++) {
-    DLiteProperty *p = meta->_properties + i;
-    if (strcmp(name, p->name) == 0) return i;
-  }
+  int i;
+  if ((i = _meta_find_property(meta, name)) >= 0) return i;
   return err(-1, "%s has no such property: '%s'", meta->uri, name);
 }
 
+/*
+  Returns index of dimension named `name` or -1 if `meta` has no such
+  dimension.  Unlike dlite_meta_get_dimension_index(), no error is
+  reported.
+ */
+int dlite_meta_find_dimension_index(const DLiteMeta *meta, const char *name)
+{
+  return _meta_find_dimension(meta, name);
+}
+
+/*
+  Returns index of property named `name` or -1 if `meta` has no such
+  property.  Unlike dlite_meta_get_property_index(), no error is
+  reported.
+ */
+int dlite_meta_find_property_index(const DLiteMeta *meta, const char *name)
+{
+  return _meta_find_property(meta, name);
+}
+
 
 /*
   Returns a pointer to dimension with index `i` or NULL on error.
@@ -2149,12 +6962,7 @@ int dlite_meta_is_metameta(const DLiteMeta *meta)
  */
 bool dlite_meta_has_dimension(const DLiteMeta *meta, const char *name)
 {
-  size_t i;
-  for (i=0; i<meta->_ndimensions; i++) {
-    DLiteDimension *d = meta->_dimensions + i;
-    if (strcmp(name, d->name) == 0) return true;
-  }
-  return false;
+  return (_meta_find_dimension(meta, name) >= 0) ? true : false;
 }
 
 /*
@@ -2162,12 +6970,7 @@ bool dlite_meta_has_dimension(const DLiteMeta *meta, const char *name)
  */
 bool dlite_meta_has_property(const DLiteMeta *meta, const char *name)
 {
-  size_t i;
-  for (i=0; i<meta->_nproperties; i++) {
-    DLiteProperty *p = meta->_properties + i;
-    if (strcmp(name, p->name) == 0) return true;
-  }
-  return false;
+  return (_meta_find_property(meta, name) >= 0) ? true : false;
 }
 
 
@@ -2466,6 +7269,102 @@ int dlite_property_scan(const char *src, void *ptr, const DLiteProperty *p,
 }
 
 
+/*
+  Resolves property `name` of `meta` into `handle`.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_get_property_handle(const DLiteMeta *meta, const char *name,
+                                   DLitePropertyHandle *handle)
+{
+  const DLiteProperty *p;
+  int i;
+  if ((i = dlite_meta_get_property_index(meta, name)) < 0) return -1;
+  p = meta->_properties + i;
+  handle->meta = meta;
+  handle->index = i;
+  handle->type = p->type;
+  handle->size = p->size;
+  handle->ndims = p->ndims;
+  handle->offset = meta->_propoffsets[i];
+  handle->direct = (!dlite_type_is_allocated(p->type) &&
+                    !meta->_getdim && !meta->_setdim &&
+                    !meta->_loadprop && !meta->_saveprop);
+  return 0;
+}
+
+/*
+  Returns a newly malloc'ed handle to property `name` of `meta` or
+  NULL on error.
+ */
+DLitePropertyHandle *dlite_property_handle_create(const DLiteMeta *meta,
+                                                  const char *name)
+{
+  DLitePropertyHandle *handle;
+  if (!(handle = malloc(sizeof(DLitePropertyHandle))))
+    return err(1, "allocation failure"), NULL;
+  if (dlite_meta_get_property_handle(meta, name, handle)) {
+    free(handle);
+    return NULL;
+  }
+  return handle;
+}
+
+/*
+  Frees a handle created with dlite_property_handle_create().
+ */
+void dlite_property_handle_free(DLitePropertyHandle *handle)
+{
+  free(handle);
+}
+
+/*
+  Returns a pointer to the data of the property referred to by `handle`
+  in `inst` or NULL on error.
+ */
+void *dlite_instance_get_property_by_handle(const DLiteInstance *inst,
+                                            const DLitePropertyHandle *handle)
+{
+  void *ptr;
+  if (inst->meta != handle->meta)
+    return errx(1, "instance of %s does not match property handle for %s",
+                inst->meta->uri, handle->meta->uri), NULL;
+  if (!handle->direct || (inst->_flags & dliteFlagLazy))
+    return dlite_instance_get_property_by_index(inst, handle->index);
+  ptr = (char *)inst + handle->offset;
+  return (handle->ndims > 0) ? *(void **)ptr : ptr;
+}
+
+/*
+  Copies memory pointed to by `ptr` to the property referred to by
+  `handle` in `inst`.  Returns non-zero on error.
+ */
+int dlite_instance_set_property_by_handle(DLiteInstance *inst,
+                                          const DLitePropertyHandle *handle,
+                                          const void *ptr)
+{
+  void *dest;
+  if (inst->meta != handle->meta)
+    return errx(1, "instance of %s does not match property handle for %s",
+                inst->meta->uri, handle->meta->uri);
+  if (!handle->direct ||
+      (inst->_flags & (dliteFlagLazy | dliteFlagShared | dliteFlagFrozen)))
+    return dlite_instance_set_property_by_index(inst, handle->index, ptr);
+  dest = (char *)inst + handle->offset;
+  if (handle->ndims > 0) {
+    size_t nmemb=1;
+    int j;
+    for (j=0; j<handle->ndims; j++)
+      nmemb *= DLITE_PROP_DIM(inst, handle->index, j);
+    if (nmemb) memcpy(*(void **)dest, ptr, nmemb*handle->size);
+  } else {
+    memcpy(dest, ptr, handle->size);
+  }
+  if (inst->_flags & DIRTY_FLAGS) _dirty_mark(inst, handle->index);
+  return 0;
+}
+
+
 
 /********************************************************************
  *  MetaModel - a data model for metadata
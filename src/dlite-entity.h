@@ -128,6 +128,7 @@
 */
 
 #include <stddef.h>
+#include <stdint.h>
 #include "utils/boolean.h"
 #include "dlite-misc.h"
 #include "dlite-type.h"
@@ -178,6 +179,103 @@ typedef int (*DLiteLoadProperty)(const DLiteInstance *inst, size_t i);
 typedef int (*DLiteSaveProperty)(DLiteInstance *inst, size_t i);
 
 
+/** How the arrays of dimensional properties are allocated. */
+typedef enum _DLiteAllocMode {
+  dliteAllocDefault=0,  /*!< Metadata only: use the global mode. */
+  dliteAllocSeparate,   /*!< One allocation per property array. */
+  dliteAllocArena       /*!< All property arrays are placed in a single,
+                             cache-line aligned block following the
+                             instance header, within the same
+                             allocation as the instance.  The strings
+                             of loaded instances are packed into a
+                             string arena, see
+                             dlite_instance_pack_strings(). */
+} DLiteAllocMode;
+
+/** Size of the fixed slots that short strings are stored in by
+    dlite_instance_pack_strings(). */
+#define DLITE_STRING_SLOT 16
+
+/** How property values are laid out in the instance header. */
+typedef enum _DLiteLayoutMode {
+  dliteLayoutDefault=0, /*!< Metadata only: use the global mode. */
+  dliteLayoutDeclared,  /*!< Property values in declaration order. */
+  dliteLayoutPacked     /*!< Hot property values first, then ordered by
+                             decreasing alignment to minimise padding. */
+} DLiteLayoutMode;
+
+/**
+  A custom memory allocator for instances and their property arrays,
+  see dlite_instance_set_allocator().
+
+  All functions are passed `data` as their last argument.  `malloc`
+  and `realloc` are required, while `calloc` and `free` may be NULL.
+  If `calloc` is NULL, `malloc` is used and the memory is zeroed.  If
+  `free` is NULL, memory is never free'ed by DLite, which is useful
+  for an arena that is released as a whole after a batch job.
+ */
+typedef struct _DLiteAllocator {
+  void *(*malloc)(size_t size, void *data);
+  void *(*calloc)(size_t nmemb, size_t size, void *data);
+  void *(*realloc)(void *ptr, size_t size, void *data);
+  void (*free)(void *ptr, void *data);
+  void *data;   /*!< Allocator state passed to the functions. */
+} DLiteAllocator;
+
+/** Bit flags stored in the `_flags` member of instances. */
+typedef enum _DLiteFlag {
+  dliteFlagArena=1,           /*!< Instance has a property arena. */
+  dliteFlagAllocSeparate=2,   /*!< Metadata: instances use
+                                   dliteAllocSeparate. */
+  dliteFlagAllocArena=4,      /*!< Metadata: instances use
+                                   dliteAllocArena. */
+  dliteFlagBatch=8,           /*!< Instance is allocated in a block
+                                   together with other instances. */
+  dliteFlagShared=16,         /*!< Instance may share property arrays
+                                   with other instances. */
+  dliteFlagLazy=32,           /*!< Instance has properties that are not
+                                   yet loaded from storage. */
+  dliteFlagSaved=64,          /*!< Instance has been saved and modified
+                                   properties are tracked. */
+  dliteFlagForeign=128,       /*!< Instance has property arrays that are
+                                   not allocated by DLite. */
+  dliteFlagReserved=256,      /*!< Instance has property arrays with
+                                   room for more elements than given by
+                                   the dimension sizes. */
+  dliteFlagAllocator=512,     /*!< Instance is allocated with a custom
+                                   allocator. */
+  dliteFlagReloadable=1024,   /*!< Instance is unmodified since it was
+                                   loaded and can be reloaded from its
+                                   storage by the bounded instance
+                                   store. */
+  dliteFlagFingerprint=2048,  /*!< Instance is unmodified since its
+                                   fingerprint was calculated. */
+  dliteFlagIndexed=4096,      /*!< Instance is in a value index and
+                                   modifications are tracked. */
+  dliteFlagFrozen=8192,       /*!< Instance is immutable, see
+                                   dlite_instance_freeze(). */
+  dliteFlagImmortal=16384,    /*!< Instance is never free'ed and its
+                                   refcount is not updated. */
+  dliteFlagDevice=32768,      /*!< Instance has property arrays copied
+                                   to device memory, see dlite-device.h. */
+  dliteFlagLayoutDeclared=65536, /*!< Metadata: instances use
+                                   dliteLayoutDeclared. */
+  dliteFlagLayoutPacked=131072,  /*!< Metadata: instances use
+                                   dliteLayoutPacked. */
+  dliteFlagInstantiated=262144,  /*!< Metadata: instances have been
+                                   created, so the layout is fixed. */
+  dliteFlagStrings=524288     /*!< Instance has string values in a
+                                   string arena, see
+                                   dlite_instance_pack_strings(). */
+} DLiteFlag;
+
+/** Flags for dlite_instance_freeze(). */
+typedef enum _DLiteFreezeFlag {
+  dliteFreezeMeta=1,          /*!< Freeze the metadata as well. */
+  dliteFreezeImmortal=2       /*!< Make the frozen instances immortal. */
+} DLiteFreezeFlag;
+
+
 
 /**
   Initial segment of all DLite instances.
@@ -188,6 +286,7 @@ typedef int (*DLiteSaveProperty)(DLiteInstance *inst, size_t i);
                                   /* May be NULL. */                    \
   int _refcount;                  /* Number of references to this */    \
                                   /* instance. */                       \
+  int _flags;                     /* Internal flags, see DLiteFlag. */  \
   const struct _DLiteMeta *meta;  /* Pointer to the metadata descri- */ \
                                   /* bing this instance. */             \
   const char *iri;                /* Unique IRI to corresponding */     \
@@ -243,7 +342,31 @@ typedef int (*DLiteSaveProperty)(DLiteInstance *inst, size_t i);
                           /* offsets to property values in instance. */ \
   size_t _reloffset;      /* Offset of first relation value. */         \
   size_t _propdimsoffset; /* Offset to `propdims` array. */             \
-  size_t _propdimindsoffset; /* Offset of `propdiminds` array. */
+  size_t _propdimindsoffset; /* Offset of `propdiminds` array. */       \
+                                                                        \
+  /* Hash index of dimension and property names */                     \
+  /* Automatically assigned by dlite_meta_init() */                     \
+  struct _DLiteNameIndex *_nameindex; /* Maps names to indices. */    \
+                                                                        \
+  /* Compiled property dimension expressions */                         \
+  /* Automatically assigned by dlite_meta_init() */                     \
+  struct _DLitePropDimsCode *_propdimscode; /* Compiled propdims. */    \
+                                                                        \
+  /* Pool of free'ed instances for reuse */                             \
+  /* Assigned by dlite_meta_enable_pool(), NULL if disabled */          \
+  struct _DLiteInstancePool *_pool;   /* Recycled instances. */         \
+                                                                        \
+  /* Compiled JSON parser */                                            \
+  /* Assigned by the JSON parser on first use */                        \
+  struct _DLiteJsonParser *_jsonparser; /* JSON key lookup. */          \
+                                                                        \
+  /* Hot properties placed first by the packed layout */                \
+  /* Assigned by dlite_meta_set_hot_properties(), NULL if none */       \
+  unsigned char *_hotprops; /* Non-zero for each hot property. */       \
+                                                                        \
+  /* Serialisation format of sparse properties */                       \
+  /* Assigned by dlite_meta_set_sparse_property(), NULL if none */      \
+  unsigned char *_sparseprops; /* DLiteSparseFormat of each property. */
 
 
 /**
@@ -298,6 +421,45 @@ typedef struct _DLiteMeta {
 } DLiteMeta;
 
 
+/**
+  Statistics for the instance pool of a metadata.
+  See dlite_meta_enable_pool().
+ */
+typedef struct _DLitePoolStats {
+  size_t maxsize;     /*!< Max number of instances kept in the pool. */
+  size_t size;        /*!< Current number of instances in the pool. */
+  size_t hits;        /*!< Number of instances created from the pool. */
+  size_t misses;      /*!< Number of instances that had to be allocated. */
+  size_t recycled;    /*!< Number of free'ed instances added to the pool. */
+  size_t discarded;   /*!< Number of free'ed instances that was released
+                           since the pool was full. */
+} DLitePoolStats;
+
+
+/**
+  Handle to a property of a metadata, resolved once with
+  dlite_meta_get_property_handle().  Accessing the property of many
+  instances of the same metadata via a handle avoids looking up the
+  property by name and, for properties of non-allocated types,
+  dispatching on the type for each access.
+
+  A handle borrows a reference to its metadata, which must be kept
+  alive while the handle is in use.
+ */
+typedef struct _DLitePropertyHandle {
+  const DLiteMeta *meta;  /*!< Metadata the handle is resolved for. */
+  size_t index;           /*!< Index of the property. */
+  DLiteType type;         /*!< Type of the property. */
+  size_t size;            /*!< Size of one data element. */
+  int ndims;              /*!< Number of dimensions.  Zero if scalar. */
+  size_t offset;          /*!< Offset of the property in instance memory. */
+  int direct;             /*!< Whether the property data can be accessed
+                               directly, i.e. it is of a non-allocated
+                               type and the metadata has no property
+                               or dimension hooks. */
+} DLitePropertyHandle;
+
+
 /**
   Opaque datatype used for metadata models.
  */
@@ -337,6 +499,13 @@ typedef struct _DLiteMetaModel DLiteMetaModel;
 #define DLITE_PROP(inst, n) \
   ((void *)((char *)(inst) + ((DLiteInstance *)(inst))->meta->_propoffsets[n]))
 
+/** Like DLITE_PROP(), but ensures that the property can be written to
+    without affecting other instances sharing its data.  Expands to NULL
+    on error. */
+#define DLITE_PROP_RW(inst, n)                                          \
+  ((dlite_instance_make_writable((DLiteInstance *)(inst), n)) ?         \
+   NULL : DLITE_PROP(inst, n))
+
 /** Expands to number of dimensions of property `n` --> (int) */
 #define DLITE_PROP_NDIM(inst, n) \
   (((DLiteInstance *)(inst))->meta->_properties[n].ndims)
@@ -416,6 +585,25 @@ void dlite_instance_debug(const DLiteInstance *inst);
  */
 size_t dlite_instance_size(const DLiteMeta *meta, const size_t *dims);
 
+/**
+  Updates statistics, the trace and the value indexes after instance
+  `inst` has been loaded from storage `s` with the instance api of its
+  plugin.  `t0` is the value returned by dlite_record_begin() when the
+  load was started.  The strings of instances using the arena
+  allocation mode are packed.  Intended for internal use.
+ */
+void dlite_instance_load_completed(const DLiteStorage *s, DLiteInstance *inst,
+                                   uint64_t t0);
+
+/**
+  Updates statistics and the trace after instance `inst` has been
+  saved to storage `s` with the instance api of its plugin.  `t0` is
+  the value returned by dlite_record_begin() when the save was
+  started.  Intended for internal use.
+ */
+void dlite_instance_save_completed(DLiteStorage *s, const DLiteInstance *inst,
+                                   uint64_t t0);
+
 
 /** @} */
 /* ================================================================= */
@@ -445,6 +633,27 @@ DLiteInstance *dlite_instance_create(const DLiteMeta *meta,
                                      const size_t *dims,
                                      const char *id);
 
+/**
+  Creates `n` new instances of `meta`, all with dimensions `dims`.
+
+  `ids` may be NULL, in which case all instances get a random UUID.
+  Otherwise it should be an array of length `n` with the ids of the
+  new instances, see dlite_instance_create().  Elements of `ids` may
+  be NULL.
+
+  This is equivalent to calling dlite_instance_create() `n` times, but
+  more efficient since the metadata is validated once, the new
+  instances are allocated in a single block and they are added to the
+  instance store in one batch.
+
+  Returns a newly allocated array of `n` new references to the
+  instances or NULL on error.  The caller is responsible to decref the
+  instances and free the array.
+ */
+DLiteInstance **dlite_instance_create_many(const DLiteMeta *meta,
+                                           const size_t *dims, size_t n,
+                                           const char **ids);
+
 /**
   Like dlite_instance_create() but takes the uri or uuid of the
   metadata as the first argument.
@@ -455,6 +664,69 @@ DLiteInstance *dlite_instance_create_from_id(const char *metaid,
                                              const size_t *dims,
                                              const char *id);
 
+/**
+  Sets the global allocation mode for the property arrays of new data
+  instances, whos metadata does not specify an allocation mode.  The
+  default is `dliteAllocSeparate`.
+
+  Returns the previous mode or -1 on error.
+ */
+int dlite_instance_set_alloc_mode(DLiteAllocMode mode);
+
+/**
+  Returns the global allocation mode for the property arrays of new
+  data instances.
+ */
+DLiteAllocMode dlite_instance_get_alloc_mode(void);
+
+/**
+  Sets the global layout mode for the property values of instances of
+  metadata, whos layout mode is not set.  The mode is applied when the
+  metadata is initialised and is kept for its lifetime.  The default
+  is `dliteLayoutDeclared`.  See dlite_meta_set_layout_mode().
+
+  Returns the previous mode or -1 on error.
+ */
+int dlite_instance_set_layout_mode(DLiteLayoutMode mode);
+
+/**
+  Returns the global layout mode for the property values of instances.
+ */
+DLiteLayoutMode dlite_instance_get_layout_mode(void);
+
+/**
+  Sets the allocator used for new instances and their property arrays
+  in the current globals, i.e. in the current context if any (see
+  dlite_context_set_current()).  If `allocator` is NULL, the standard
+  C library allocator is used.
+
+  Instances remember their allocator, such that their property arrays
+  are reallocated and free'ed with it.  The allocator is not copied
+  and must outlive all instances allocated with it.
+
+  Metadata, as well as strings and other memory referred to by
+  properties, are always allocated with the standard C library
+  allocator.  Instances reused from a metadata pool (see
+  dlite_meta_enable_pool()) keep the allocator they were created
+  with.
+
+  Returns the previous allocator.
+ */
+const DLiteAllocator *dlite_instance_set_allocator(
+  const DLiteAllocator *allocator);
+
+/**
+  Returns the allocator for new instances in the current globals, or
+  NULL if the standard C library allocator is used.
+ */
+const DLiteAllocator *dlite_instance_get_allocator(void);
+
+/**
+  Returns the allocator `inst` was allocated with, or NULL if it is
+  allocated with the standard C library allocator.
+ */
+const DLiteAllocator *dlite_instance_allocator(const DLiteInstance *inst);
+
 /**
   Increases reference count on `inst`.
 
@@ -486,14 +758,68 @@ int dlite_instance_decref(DLiteInstance *inst);
  */
 DLiteInstance *dlite_instance_has(const char *id, bool check_storages);
 
+/**
+  Calls `fn` for each instance in the in-memory instance store, with
+  `data` passed as its second argument.  The iteration stops when `fn`
+  returns non-zero.  Since the store is locked during the iteration,
+  `fn` must not create or free instances.
+
+  Returns the last value returned by `fn` or a negative value on error.
+ */
+int dlite_instance_store_foreach(int (*fn)(const DLiteInstance *inst,
+                                           void *data), void *data);
+
+/**
+  Sets the memory budget of the instance store to `nbytes`.
+
+  By default (a budget of zero), the instance store only holds weak
+  references to data instances, which are free'ed when their refcount
+  drops to zero.  With a positive budget, the store keeps a reference
+  to data instances loaded from a storage, such that they can be
+  reused without reloading.  When the memory used by these instances
+  exceeds the budget, the store releases its references in least
+  recently used order.
+
+  An instance that is unmodified since it was loaded leaves a stub
+  with the storage it was loaded from when it is released, such that
+  dlite_instance_get() transparently reloads it on next access.
+  Modifications are detected as for dlite_instance_mark_dirty(), i.e.
+  properties modified directly via DLITE_PROP() must be marked.
+  Only instances loaded from read-only storages are kept, since
+  reopening a writable storage may truncate it.  Instances loaded
+  lazily or from compressed storages are not kept either.
+
+  Instances are only free'ed when all other references to them are
+  released.  Hence, references held by the application or by
+  collections still keep instances alive.
+
+  The budget may also be set with the environment variable
+  `DLITE_INSTANCE_STORE_BUDGET`.  Setting it to zero releases all
+  references and stubs held by the store.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_store_set_budget(size_t nbytes);
+
+/**
+  Returns the memory budget of the instance store.  If `used` is not
+  NULL, it is assigned the number of bytes used by instances kept by
+  the store.
+ */
+size_t dlite_instance_store_get_budget(size_t *used);
+
 /**
   Returns a new reference to instance with given `id` or NULL if no such
   instance can be found.
 
   If the instance exists in the in-memory store it is returned (with
-  its refcount increased by one).  Otherwise it is searched for in the
+  its refcount increased by one).  If it has been released by the
+  bounded instance store (see dlite_instance_store_set_budget()), it
+  is reloaded from its storage.  Otherwise it is searched for in the
   storage plugin path (initiated from the DLITE_STORAGES environment
-  variable).
+  variable), using the storage index and Bloom filter sidecars (see
+  dlite-bloom.h) to avoid opening storages that doesn't contain the
+  instance.
 
   It is an error message if the instance cannot be found.
 */
@@ -503,9 +829,27 @@ DLiteInstance *dlite_instance_get(const char *id);
   Like dlite_instance_get(), but maps the instance with the given id
   to an instance of `metaid`.  If `metaid` is NULL, it falls back to
   dlite_instance_get().  Returns NULL on error.
+
+  See also dlite_instance_set_cast_cache().
  */
 DLiteInstance *dlite_instance_get_casted(const char *id, const char *metaid);
 
+/**
+  Sets the maximum number of casted instances cached by
+  dlite_instance_get_casted() and dlite_instance_load_casted() to
+  `maxsize`.  The default is zero, which disables the cache.
+
+  While enabled, casting the same source instance to the same metadata
+  returns a new reference to the previously casted instance as long as
+  neither the source nor the casted instance is modified.
+  Modifications are detected by their fingerprints (see
+  dlite_instance_fingerprint()).  Since cached instances are shared,
+  callers should treat them as read-only.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_set_cast_cache(size_t maxsize);
+
 
 /**
   Loads instance identified by `id` from storage `s` and returns a
@@ -532,6 +876,46 @@ DLiteInstance *dlite_instance_load(const DLiteStorage *s, const char *id);
  */
 DLiteInstance *dlite_instance_load_url(const char *url);
 
+/**
+  Like dlite_instance_load(), but the properties are not read from
+  storage until they are accessed with dlite_instance_get_property()
+  and friends.  This is useful if only a few properties of a large
+  instance are needed.
+
+  The storage `s` must not be closed before all properties are loaded
+  (see dlite_instance_load_all()) or the instance is free'ed.
+
+  Metadata, instances of metadata with `_loadprop` or `_saveprop`
+  hooks and instances loaded from storages that do not implement the
+  data model api are loaded as with dlite_instance_load().
+
+  On error, NULL is returned.
+ */
+DLiteInstance *dlite_instance_load_lazy(const DLiteStorage *s, const char *id);
+
+/**
+  Loads property `i` of an instance created with
+  dlite_instance_load_lazy() from storage, if it is not already
+  loaded.  This is a no-op for other instances.
+
+  Only needed before accessing the property directly with
+  DLITE_PROP(), since dlite_instance_get_property() and friends load
+  the property automatically.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_load_property(DLiteInstance *inst, size_t i);
+
+/**
+  Loads all properties of an instance created with
+  dlite_instance_load_lazy() that are not already loaded.
+  Afterwards the storage the instance was loaded from may be closed.
+  This is a no-op for other instances.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_load_all(DLiteInstance *inst);
+
 /**
   Like dlite_instance_load(), but allows casting the loaded instance
   into an instance of metadata identified by `metaid`.  If `metaid` is
@@ -549,12 +933,76 @@ DLiteInstance *dlite_instance_load_casted(const DLiteStorage *s,
                                           const char *id,
                                           const char *metaid);
 
+/**
+  Loads the `n` instances identified by the array `ids` from storage
+  `s`.
+
+  This is equivalent to calling dlite_instance_load() `n` times, but
+  storage plugins implementing the loadInstances() api may load all
+  instances in one round-trip.
+
+  Returns a newly allocated array of `n` new references to the
+  instances or NULL on error.  The caller is responsible to decref the
+  instances and free the array.
+ */
+DLiteInstance **dlite_instance_load_many(const DLiteStorage *s,
+                                         const char **ids, size_t n);
+
+/**
+  Loads a slice of array property `name` of instance `id` in storage
+  `s`, without loading the rest of the instance.
+
+  `offsets`, `counts` and `strides` are arrays of length equal to the
+  number of dimensions of the property, with the index of the first
+  element, the number of elements and the step between elements along
+  each dimension.  If `strides` is NULL, a step of one is assumed.
+
+  Storage plugins implementing the getPropertySlice() api only read
+  the selected elements.  For other plugins the whole property is
+  read and the slice copied out of it.
+
+  Returns a new C-ordered array with dimensions `counts` or NULL on
+  error.  In contrast to dlite_instance_get_property_array(), the
+  returned array owns its data.  Free it with free(arr->data) followed
+  by dlite_array_free(arr).  For allocated types, the elements must be
+  cleared with dlite_type_clear() before freeing the data.
+ */
+DLiteArray *dlite_instance_load_property_slice(const DLiteStorage *s,
+                                               const char *id,
+                                               const char *name,
+                                               const size_t *offsets,
+                                               const size_t *counts,
+                                               const size_t *strides);
+
 
 /**
   Saves instance `inst` to storage `s`.  Returns non-zero on error.
+
+  If `inst` was last saved to `s` and `s` still contains it with the
+  same dimensions, only properties that have been modified since then
+  are written.  See dlite_instance_mark_dirty().
+
+  If write-behind is enabled for `s`, the instance is only recorded as
+  pending and written when `s` is flushed.  See
+  dlite_storage_set_write_behind().
+
+  When the instance is written, a change event is sent to the
+  subscribers.  See dlite_subscribe().
  */
 int dlite_instance_save(DLiteStorage *s, const DLiteInstance *inst);
 
+/**
+  Saves the `n` instances in array `insts` to storage `s`.
+
+  This is equivalent to calling dlite_instance_save() for each
+  instance, but storage plugins implementing the saveInstances() api
+  may store all instances in one round-trip.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_save_many(DLiteStorage *s, const DLiteInstance **insts,
+                             size_t n);
+
 
 /**
   A convinient function that saves instance `inst` to the storage specified
@@ -648,6 +1096,24 @@ int dlite_instance_get_property_dimsize_by_index(const DLiteInstance *inst,
 size_t *dlite_instance_get_property_dims_by_index(const DLiteInstance *inst,
                                                   size_t i);
 
+/**
+  Returns a pointer to the data of property `i` in `inst` without
+  copying it.  The property must have type `type`, size `size` and
+  `ndims` dimensions.  Its dimension sizes are written to `shape`,
+  which must have length `ndims`.
+
+  If `order` is 'F', the dimension sizes are written in reverse order,
+  which is the shape of the row-major data as seen from column-major
+  (Fortran-style) languages, allowing them to alias the data without
+  transposing it.  If `order` is 'C', they are written as they are.
+
+  Returns NULL on error.
+ */
+void *dlite_instance_get_property_data_by_index(const DLiteInstance *inst,
+                                                size_t i, DLiteType type,
+                                                size_t size, int ndims,
+                                                size_t *shape, int order);
+
 /**
   Returns size of dimension `i` or -1 on error.
  */
@@ -666,6 +1132,156 @@ void *dlite_instance_get_property(const DLiteInstance *inst, const char *name);
 int dlite_instance_set_property(DLiteInstance *inst, const char *name,
                                 const void *ptr);
 
+/** Function releasing an array adopted with
+    dlite_instance_adopt_property(). */
+typedef void (*DLiteDeallocator)(void *ptr);
+
+/**
+  Lets property `i` of `inst` take over the ownership of the array
+  `ptr` instead of copying it.  The array must have the size and layout
+  of the property, i.e. C-ordered with as many items as the property
+  has.  The previous array of the property is free'ed.
+
+  `ptr` is released with `dealloc` when it is no longer needed by
+  `inst`.  If `dealloc` is NULL, free() is used.  If the dimensions
+  of `inst` are changed later, the data is copied to a new array and
+  `ptr` is released immediately.
+
+  Only dimensional properties of data instances can be adopted.
+
+  Returns non-zero on error, in which case the caller still owns `ptr`.
+ */
+int dlite_instance_adopt_property_by_index(DLiteInstance *inst, size_t i,
+                                           void *ptr, DLiteDeallocator dealloc);
+
+/**
+  Like dlite_instance_adopt_property_by_index(), but refers to the
+  property by name.
+ */
+int dlite_instance_adopt_property(DLiteInstance *inst, const char *name,
+                                  void *ptr, DLiteDeallocator dealloc);
+
+/**
+  Like dlite_instance_adopt_property_by_index(), but `inst` only
+  borrows `ptr` and never frees it.  The caller must keep `ptr`
+  valid for the lifetime of `inst`, or until the dimensions of `inst`
+  are changed.
+
+  Arrays of allocated types (like strings) cannot be borrowed.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_borrow_property_by_index(DLiteInstance *inst, size_t i,
+                                            void *ptr);
+
+/**
+  Like dlite_instance_borrow_property_by_index(), but refers to the
+  property by name.
+ */
+int dlite_instance_borrow_property(DLiteInstance *inst, const char *name,
+                                   void *ptr);
+
+/**
+  Marks property `i` of `inst` as modified, such that it is written
+  by the next call to dlite_instance_save().  This is needed after
+  modifying a property directly (e.g. via DLITE_PROP()), since only
+  dlite_instance_set_property() and friends mark properties
+  automatically.  If `i` is negative, all properties are marked.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_mark_dirty_by_index(DLiteInstance *inst, int i);
+
+/**
+  Like dlite_instance_mark_dirty_by_index(), but marks property `name`.
+  If `name` is NULL, all properties are marked.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_mark_dirty(DLiteInstance *inst, const char *name);
+
+/** Size of instance fingerprints in bytes. */
+#define DLITE_FINGERPRINT_SIZE 16
+
+/**
+  Calculates a 128-bit fingerprint of the content of `inst` and
+  writes it to `fingerprint`, which must have space for
+  DLITE_FINGERPRINT_SIZE bytes.
+
+  The fingerprint covers the metadata URI, the dimension sizes and the
+  values of all properties, but not the uuid or URI of `inst`.  Hence
+  two instances of the same metadata with equal content have equal
+  fingerprints, e.g. an instance and a copy of it loaded from
+  storage.  Strings and relations are hashed by value and numbers in
+  little-endian byte order, such that the fingerprint is stable across
+  processes and platforms.
+
+  The fingerprint is cached until the instance is modified.
+  Modifications are detected as for dlite_instance_mark_dirty(), i.e.
+  properties modified directly (via DLITE_PROP()) must be marked.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_fingerprint(const DLiteInstance *inst,
+                               unsigned char *fingerprint);
+
+/** Kinds of value indexes, see dlite_index_create(). */
+typedef enum _DLiteIndexKind {
+  dliteIndexHash,     /*!< Hash index, supports equality lookups. */
+  dliteIndexSorted    /*!< Sorted index, supports also range lookups. */
+} DLiteIndexKind;
+
+/** Opaque type for a value index. */
+typedef struct _DLiteIndex DLiteIndex;
+
+/**
+  Creates an index over the value of the scalar property `property` of
+  the instances of `meta` in the in-memory instance store.  The
+  property must be of type bool, int, uint, float, fixstring or
+  string.  Numbers are indexed as double and strings by value, with
+  NULL indexed as the empty string.
+
+  The index is maintained as instances are created, loaded, modified
+  and free'ed.  Modifications are detected as for
+  dlite_instance_mark_dirty(), i.e. properties modified directly (via
+  DLITE_PROP()) after the instance has been looked up must be marked.
+
+  Returns the new index, which should be released with
+  dlite_index_free(), or NULL on error.
+ */
+DLiteIndex *dlite_index_create(DLiteMeta *meta, const char *property,
+                               DLiteIndexKind kind);
+
+/**
+  Frees index `index`.
+ */
+void dlite_index_free(DLiteIndex *index);
+
+/**
+  Looks up instances in `index` whos indexed property equals the value
+  pointed to by `value`, which must be of the type of the indexed
+  property (e.g. a `char **` for a string property).
+
+  On success, `*insts` is assigned to a newly malloc'ed array of new
+  references to the matching instances, or NULL if there are no
+  matches.  The caller should decref the instances and free the array.
+
+  Returns the number of matching instances or -1 on error.
+ */
+int dlite_index_lookup(DLiteIndex *index, const void *value,
+                       DLiteInstance ***insts);
+
+/**
+  Like dlite_index_lookup(), but looks up instances in sorted index
+  `index` whos indexed property is in the inclusive range [`low`,
+  `high`].  If `low` or `high` is NULL, the range is unbounded in that
+  direction.  The instances are returned in increasing order.
+
+  Returns the number of matching instances or -1 on error.
+ */
+int dlite_index_range(DLiteIndex *index, const void *low, const void *high,
+                      DLiteInstance ***insts);
+
 /**
   Returns true if instance has a property with the given name.
  */
@@ -725,6 +1341,8 @@ int dlite_instance_sync_from_dimension_sizes(DLiteInstance *inst);
 /**
   Help function that update properties from the saveprop() method of
   extended metadata.  Does nothing, if the metadata has no saveprop() method.
+  Modified device copies of the property arrays are copied back first
+  (see dlite-device.h).
 
   Returns non-zero on error.
  */
@@ -750,6 +1368,10 @@ int dlite_instance_sync_from_properties(DLiteInstance *inst);
   more dimensions, where any but the first dimension is updated,
   should be considered invalidated.
 
+  Arrays with reserved capacity (see dlite_instance_reserve_dimension())
+  are not reallocated as long as they fit within it.  When they do not
+  fit, the capacity is at least doubled.
+
   Returns non-zero on error.
  */
 int dlite_instance_set_dimension_sizes(DLiteInstance *inst, const int *dims);
@@ -768,6 +1390,57 @@ int dlite_instance_set_dimension_size_by_index(DLiteInstance *inst,
 int dlite_instance_set_dimension_size(DLiteInstance *inst, const char *name,
                                       size_t size);
 
+/**
+  Reserves room for `size` entries along dimension `i` of `inst`
+  without changing its size.  The arrays of properties depending on
+  dimension `i` are reallocated (if needed) to hold `size` entries,
+  such that later growing the dimension up to `size` with
+  dlite_instance_set_dimension_sizes() or
+  dlite_instance_append_dimension() does not reallocate them.
+  Growing beyond the reserved capacity at least doubles it.
+
+  This is a no-op for instances sharing or adopting property arrays
+  (see dlite_instance_copy_cow() and dlite_instance_adopt_property()).
+
+  Returns non-zero on error.
+ */
+int dlite_instance_reserve_dimension_by_index(DLiteInstance *inst, size_t i,
+                                              size_t size);
+
+/**
+  Like dlite_instance_reserve_dimension_by_index(), but reserves room
+  along dimension `name`.  Returns non-zero on error.
+ */
+int dlite_instance_reserve_dimension(DLiteInstance *inst, const char *name,
+                                     size_t size);
+
+/**
+  Appends `n` rows to dimension `i` of `inst`.  The new rows are zeroed.
+
+  This is intended for time series, where `i` is the first dimension
+  of the properties depending on it.  The rows appended to such
+  properties are not marked as modified.  Instead, if `inst` has been
+  saved to a storage supporting property slices (like hdf5), the next
+  save to it writes only the new rows without rewriting the earlier
+  ones.  Fill the new rows via the property pointers, since
+  dlite_instance_set_property() marks the whole property as modified.
+
+  The property arrays grow geometrically (see
+  dlite_instance_reserve_dimension()), such that appending rows one by
+  one takes amortised constant time.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_append_dimension_by_index(DLiteInstance *inst, size_t i,
+                                             size_t n);
+
+/**
+  Like dlite_instance_append_dimension_by_index(), but appends `n`
+  rows to dimension `name`.  Returns non-zero on error.
+ */
+int dlite_instance_append_dimension(DLiteInstance *inst, const char *name,
+                                    size_t n);
+
 /**
   Copies instance `inst` to a newly created instance.
 
@@ -782,6 +1455,97 @@ int dlite_instance_set_dimension_size(DLiteInstance *inst, const char *name,
 DLiteInstance *dlite_instance_copy(const DLiteInstance *inst,
                                    const char *newid);
 
+/**
+  Like dlite_instance_copy(), but the new instance shares the arrays of
+  non-allocated types (like numbers) with `inst` instead of copying
+  them.  A private copy of a shared array is made first when write
+  access to it is requested with dlite_instance_set_property(),
+  dlite_instance_make_writable() or DLITE_PROP_RW().
+
+  Note that writing to a shared array through DLITE_PROP() or the
+  pointer returned by dlite_instance_get_property() affects all
+  instances sharing the array.
+
+  Metadata and instances of metadata with `_loadprop` or `_saveprop`
+  hooks are always deep-copied.
+
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_instance_copy_cow(DLiteInstance *inst, const char *newid);
+
+/**
+  Ensures that property `i` of `inst` can be written to without
+  affecting other instances, by replacing a shared property array
+  with a private copy.  This is a no-op for instances not created by
+  dlite_instance_copy_cow().
+
+  Returns non-zero on error.
+ */
+int dlite_instance_make_writable(DLiteInstance *inst, size_t i);
+
+/**
+  Moves the values of all string properties of data instance `inst`
+  into a string arena, which is a single allocation owned by `inst`.
+  Strings shorter than `DLITE_STRING_SLOT` bytes (including the
+  terminating NUL) are stored inline in fixed, consecutive slots,
+  followed by the longer strings.  This replaces one allocation per
+  string with one per instance, and places short labels, like element
+  symbols, next to each other in memory.
+
+  The property values are still `char *` pointers, now pointing into
+  the arena, so code reading them is not affected.  The strings of a
+  property are moved out of the arena again before it is written to
+  with dlite_instance_set_property(), dlite_instance_make_writable(),
+  DLITE_PROP_RW() or when the dimensions are changed.  Hence, strings
+  in the arena must not be free'ed or reallocated directly.  A string
+  pointer may be replaced without freeing the old one, though.
+
+  Calling this function again repacks all strings, including those
+  set after the previous call.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_pack_strings(DLiteInstance *inst);
+
+/**
+  Moves the strings of `inst` out of its string arena to separate
+  allocations and frees the arena.  This is a no-op if `inst` has no
+  string arena.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_unpack_strings(DLiteInstance *inst);
+
+/**
+  Makes `inst` immutable, such that it can be read concurrently from
+  several threads without synchronisation.  Properties not yet loaded
+  by dlite_instance_load_lazy() are loaded and the properties of
+  extended metadata are synchronised before the instance is frozen.
+  Afterwards all functions modifying the instance, like
+  dlite_instance_set_property(), dlite_instance_set_dimension_sizes()
+  and DLITE_PROP_RW(), fail.  Writing through DLITE_PROP() or the
+  pointer returned by dlite_instance_get_property() is not detected,
+  but is undefined behaviour.  An instance cannot be unfrozen.
+
+  `flags` is a bitwise OR of DLiteFreezeFlag values:
+    - dliteFreezeMeta: freeze the metadata of `inst` as well.
+    - dliteFreezeImmortal: make the frozen instances immortal.
+      dlite_instance_incref() and dlite_instance_decref() then do not
+      touch the reference count, which avoids contention when many
+      threads take references.  Immortal instances are never free'ed.
+      Their memory is reclaimed when the process exits.
+
+  The instance must be frozen before it is shared with other threads.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_freeze(DLiteInstance *inst, int flags);
+
+/**
+  Returns true if `inst` is frozen.
+ */
+bool dlite_instance_is_frozen(const DLiteInstance *inst);
+
 /**
   Returns a new DLiteArray object for property number `i` in instance `inst`.
 
@@ -915,6 +1679,94 @@ dlite_meta_create(const char *uri, const char *iri,
  */
 int dlite_meta_init(DLiteMeta *meta);
 
+/**
+  Sets the allocation mode for the property arrays of new instances of
+  `meta`.  If `mode` is `dliteAllocDefault`, the global mode set with
+  dlite_instance_set_alloc_mode() is used.  Existing instances are not
+  affected.
+
+  The arena mode only applies to data instances, i.e. it is ignored
+  for meta-metadata.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_set_alloc_mode(DLiteMeta *meta, DLiteAllocMode mode);
+
+/**
+  Returns the allocation mode for instances of `meta`.  May return
+  `dliteAllocDefault`.
+ */
+DLiteAllocMode dlite_meta_get_alloc_mode(const DLiteMeta *meta);
+
+/**
+  Sets the layout mode for the property values of instances of `meta`
+  and reinitialises its memory layout.  If `mode` is
+  `dliteLayoutDefault`, the global mode set with
+  dlite_instance_set_layout_mode() is used.
+
+  The layout only changes where property values are stored in the
+  instance header.  Properties are still indexed, iterated over and
+  serialised in declaration order.  Since existing instances would be
+  invalidated, it is an error to change the layout of metadata that
+  has had instances.
+
+  The packed layout should not be used for metadata with a generated
+  C struct, since the struct follows declaration order.  The layout
+  only applies to data instances, i.e. it is ignored for
+  meta-metadata.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_set_layout_mode(DLiteMeta *meta, DLiteLayoutMode mode);
+
+/**
+  Returns the layout mode for instances of `meta`.  Returns
+  `dliteLayoutDefault` if the mode has not been set and `meta` is not
+  yet initialised.
+ */
+DLiteLayoutMode dlite_meta_get_layout_mode(const DLiteMeta *meta);
+
+/**
+  Flags the `n` properties in `names` of `meta` as hot, i.e. as
+  frequently used.  In the packed layout, the values of hot properties
+  are placed together first, such that they share as few cache lines
+  as possible.  If `n` is zero, no properties are hot.  Like
+  dlite_meta_set_layout_mode(), it is an error to call this function
+  on metadata that has had instances.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_set_hot_properties(DLiteMeta *meta, const char **names,
+                                  size_t n);
+
+/**
+  Enables a pool of free'ed instances of `meta` with room for up to
+  `maxsize` instances.  When an instance of `meta` is free'ed, it is
+  added to the pool (if there is room) instead of being deallocated.
+  A new instance created with the same dimension sizes as an instance
+  in the pool, will reuse it.  Reused instances are only zeroed and
+  assigned a new UUID, not reallocated.
+
+  If `maxsize` is zero, the pool is disabled and all instances in it
+  are released.  Calling this function with a different `maxsize`
+  resizes an existing pool.
+
+  Pools are only supported for data instances, i.e. `meta` cannot be
+  meta-metadata.  This function should not be called while other
+  threads are creating or free'ing instances of `meta`.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_enable_pool(DLiteMeta *meta, size_t maxsize);
+
+/**
+  Copies the pool statistics of `meta` to `stats`.  All values are
+  zero if `meta` has no pool.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_get_pool_stats(const DLiteMeta *meta, DLitePoolStats *stats);
+
 /**
   Increase reference count to meta-metadata.
 
@@ -968,6 +1820,20 @@ int dlite_meta_get_dimension_index(const DLiteMeta *meta, const char *name);
  */
 int dlite_meta_get_property_index(const DLiteMeta *meta, const char *name);
 
+/**
+  Returns index of dimension named `name` or -1 if `meta` has no such
+  dimension.  Unlike dlite_meta_get_dimension_index(), no error is
+  reported.
+ */
+int dlite_meta_find_dimension_index(const DLiteMeta *meta, const char *name);
+
+/**
+  Returns index of property named `name` or -1 if `meta` has no such
+  property.  Unlike dlite_meta_get_property_index(), no error is
+  reported.
+ */
+int dlite_meta_find_property_index(const DLiteMeta *meta, const char *name);
+
 /**
   Returns a pointer to dimension with index `i` or NULL on error.
  */
@@ -1131,6 +1997,50 @@ int dlite_property_aprint(char **dest, size_t *n, size_t pos, const void *ptr,
 int dlite_property_scan(const char *src, void *ptr, const DLiteProperty *p,
                         const size_t *dims, DLiteTypeFlag flags);
 
+/**
+  Resolves property `name` of `meta` into `handle`.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_get_property_handle(const DLiteMeta *meta, const char *name,
+                                   DLitePropertyHandle *handle);
+
+/**
+  Like dlite_meta_get_property_handle(), but returns a newly malloc'ed
+  handle, which should be free'ed with dlite_property_handle_free().
+  Intended for bindings.
+
+  Returns NULL on error.
+ */
+DLitePropertyHandle *dlite_property_handle_create(const DLiteMeta *meta,
+                                                  const char *name);
+
+/**
+  Frees a handle created with dlite_property_handle_create().
+ */
+void dlite_property_handle_free(DLitePropertyHandle *handle);
+
+/**
+  Like dlite_instance_get_property_by_index(), but refers to the
+  property via `handle`.  `inst` must be an instance of the metadata
+  that `handle` is resolved for.
+
+  Returns NULL on error.
+ */
+void *dlite_instance_get_property_by_handle(const DLiteInstance *inst,
+                                            const DLitePropertyHandle *handle);
+
+/**
+  Like dlite_instance_set_property_by_index(), but refers to the
+  property via `handle`.  `inst` must be an instance of the metadata
+  that `handle` is resolved for.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_set_property_by_handle(DLiteInstance *inst,
+                                          const DLitePropertyHandle *handle,
+                                          const void *ptr);
+
 
 /** @} */
 /* ================================================================= */
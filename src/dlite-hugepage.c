@@ -0,0 +1,275 @@
+/* dlite-hugepage.c -- huge page backed allocation of large property arrays
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE  /* for mremap() */
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef __linux__
+# include <unistd.h>
+# include <sys/mman.h>
+# if defined(MADV_HUGEPAGE) && defined(MAP_HUGETLB) && defined(MREMAP_MAYMOVE)
+#  define HAVE_HUGEPAGES
+# endif
+#endif
+
+#include "utils/err.h"
+#include "dlite-entity.h"
+#include "dlite-macros.h"
+#include "dlite-hugepage.h"
+
+/* Size of the header before each allocation.  Also the alignment of
+   the returned memory. */
+#define HUGEPAGE_HEADER 64
+
+/* Header flags */
+#define HUGEPAGE_MAPPED   1   /* allocation is mapped */
+#define HUGEPAGE_EXPLICIT 2   /* mapping uses explicit huge pages */
+
+/* Header before each allocation */
+typedef struct {
+  size_t size;     /* requested size */
+  size_t len;      /* length of the mapping */
+  int flags;       /* header flags */
+} Header;
+
+
+/* Current configuration */
+static DLiteHugePagePolicy _policy = dliteHugePageAdvise;
+static size_t _threshold = DLITE_HUGEPAGE_THRESHOLD;
+
+
+/*
+  Returns the huge page size, or zero if huge pages are not supported.
+ */
+size_t dlite_hugepage_size(void)
+{
+#ifdef HAVE_HUGEPAGES
+  static size_t hpsize=0;
+  if (!hpsize) {
+    FILE *fp;
+    char line[128];
+    size_t n=0;
+    if ((fp = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size",
+                    "r"))) {
+      if (fgets(line, sizeof(line), fp)) n = strtoul(line, NULL, 10);
+      fclose(fp);
+    }
+    if (!n && (fp = fopen("/proc/meminfo", "r"))) {
+      while (fgets(line, sizeof(line), fp))
+        if (strncmp(line, "Hugepagesize:", 13) == 0)
+          n = strtoul(line + 13, NULL, 10) * 1024;
+      fclose(fp);
+    }
+    hpsize = (n) ? n : 2*1024*1024;
+  }
+  return hpsize;
+#else
+  return 0;
+#endif
+}
+
+/*
+  Configures the huge page allocator.  Returns non-zero on error.
+ */
+int dlite_hugepage_configure(DLiteHugePagePolicy policy, size_t threshold)
+{
+  if ((int)policy < 0 || policy > dliteHugePageExplicit)
+    return errx(1, "invalid huge page policy: %d", policy);
+  _policy = policy;
+  _threshold = (threshold) ? threshold : DLITE_HUGEPAGE_THRESHOLD;
+  return 0;
+}
+
+
+#ifdef HAVE_HUGEPAGES
+
+/* Returns a new mapping for `size` bytes and the header, backed by huge
+   pages according to the current policy, or NULL on error. */
+static Header *map_huge(size_t size)
+{
+  size_t hpsize = dlite_hugepage_size();
+  size_t len = align_up(size + HUGEPAGE_HEADER, hpsize);
+  char *addr, *aligned;
+  Header *h;
+
+  if (_policy == dliteHugePageExplicit &&
+      (addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)) !=
+      MAP_FAILED) {
+    h = (Header *)addr;
+    h->flags = HUGEPAGE_MAPPED | HUGEPAGE_EXPLICIT;
+  } else {
+    /* Over-allocate to align the mapping to the huge page size */
+    if ((addr = mmap(NULL, len + hpsize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+      return NULL;
+    aligned = (char *)align_up((size_t)addr, hpsize);
+    if (aligned > addr) munmap(addr, aligned - addr);
+    if (addr + hpsize > aligned)
+      munmap(aligned + len, addr + hpsize - aligned);
+    madvise(aligned, len, MADV_HUGEPAGE);
+    h = (Header *)aligned;
+    h->flags = HUGEPAGE_MAPPED;
+  }
+  h->size = size;
+  h->len = len;
+  return h;
+}
+
+/* Allocates `size` bytes.  Memory is zeroed if `zero` is non-zero.
+   Mapped memory is always zeroed. */
+static void *hugepage_alloc(size_t size, int zero)
+{
+  Header *h;
+  if (size > (size_t)-1 / 2) return NULL;
+  if (_policy != dliteHugePageNone && size >= _threshold) {
+    if (!(h = map_huge(size))) return NULL;
+  } else {
+    if (!(h = (zero) ? calloc(1, size + HUGEPAGE_HEADER) :
+          malloc(size + HUGEPAGE_HEADER))) return NULL;
+    h->size = size;
+    h->len = 0;
+    h->flags = 0;
+  }
+  return (char *)h + HUGEPAGE_HEADER;
+}
+
+static void hugepage_free(void *ptr, void *data)
+{
+  Header *h = (Header *)((char *)ptr - HUGEPAGE_HEADER);
+  (void)data;
+  if (!ptr) return;
+  if (h->flags & HUGEPAGE_MAPPED)
+    munmap(h, h->len);
+  else
+    free(h);
+}
+
+static void *hugepage_malloc(size_t size, void *data)
+{
+  (void)data;
+  return hugepage_alloc(size, 0);
+}
+
+static void *hugepage_calloc(size_t nmemb, size_t size, void *data)
+{
+  (void)data;
+  if (size && nmemb > (size_t)-1 / size) return NULL;
+  return hugepage_alloc(nmemb * size, 1);
+}
+
+static void *hugepage_realloc(void *ptr, size_t size, void *data)
+{
+  Header *h = (Header *)((char *)ptr - HUGEPAGE_HEADER);
+  int mapped = (_policy != dliteHugePageNone && size >= _threshold);
+  void *q;
+  if (!ptr) return hugepage_alloc(size, 0);
+
+  if (!(h->flags & HUGEPAGE_MAPPED) && !mapped) {
+    if (!(h = realloc(h, size + HUGEPAGE_HEADER))) return NULL;
+    h->size = size;
+    return (char *)h + HUGEPAGE_HEADER;
+  }
+  if ((h->flags & HUGEPAGE_MAPPED) && mapped &&
+      !(h->flags & HUGEPAGE_EXPLICIT)) {
+    /* Resize transparent huge page mappings in place if possible */
+    size_t len = align_up(size + HUGEPAGE_HEADER, dlite_hugepage_size());
+    if (len != h->len) {
+      if ((q = mremap(h, h->len, len, MREMAP_MAYMOVE)) == MAP_FAILED)
+        return NULL;
+      h = q;
+      madvise(h, len, MADV_HUGEPAGE);
+      h->len = len;
+    }
+    h->size = size;
+    return (char *)h + HUGEPAGE_HEADER;
+  }
+  if (!(q = hugepage_alloc(size, 0))) return NULL;
+  memcpy(q, ptr, (size < h->size) ? size : h->size);
+  hugepage_free(ptr, data);
+  return q;
+}
+
+static DLiteAllocator hugepage_allocator = {
+  hugepage_malloc, hugepage_calloc, hugepage_realloc, hugepage_free, NULL
+};
+
+#endif  /* HAVE_HUGEPAGES */
+
+
+/*
+  Returns the huge page allocator, or NULL if huge pages are not
+  supported.
+ */
+const DLiteAllocator *dlite_hugepage_allocator(void)
+{
+#ifdef HAVE_HUGEPAGES
+  return &hugepage_allocator;
+#else
+  return NULL;
+#endif
+}
+
+/*
+  Configures the huge page allocator and sets it as allocator for new
+  instances in the current globals.
+
+  Returns non-zero on error.
+ */
+int dlite_hugepage_set_policy(DLiteHugePagePolicy policy, size_t threshold)
+{
+  if (dlite_hugepage_configure(policy, threshold)) return 1;
+  dlite_instance_set_allocator((policy == dliteHugePageNone) ? NULL :
+                               dlite_hugepage_allocator());
+  return 0;
+}
+
+/*
+  Parses a huge page specification `spec` of the form
+  "POLICY[:THRESHOLD]".
+
+  Returns non-zero on error.
+ */
+int dlite_hugepage_parse(const char *spec, DLiteHugePagePolicy *policy,
+                         size_t *threshold)
+{
+  size_t len = strcspn(spec, ":");
+  char *endptr;
+  if (len == 4 && strncmp(spec, "none", len) == 0)
+    *policy = dliteHugePageNone;
+  else if (len == 6 && strncmp(spec, "advise", len) == 0)
+    *policy = dliteHugePageAdvise;
+  else if (len == 8 && strncmp(spec, "explicit", len) == 0)
+    *policy = dliteHugePageExplicit;
+  else
+    return errx(1, "invalid huge page policy: '%.*s'", (int)len, spec);
+
+  *threshold = 0;
+  if (spec[len] == ':') {
+    const char *s = spec + len + 1;
+    unsigned long long v;
+    if (!isdigit((unsigned char)*s)) goto fail;
+    v = strtoull(s, &endptr, 10);
+    switch (toupper((unsigned char)*endptr)) {
+    case 'G': v *= 1024;  /* fall through */
+    case 'M': v *= 1024;  /* fall through */
+    case 'K': v *= 1024; endptr++; break;
+    case '\0': break;
+    default: goto fail;
+    }
+    if (*endptr) goto fail;
+    *threshold = (size_t)v;
+  }
+  return 0;
+ fail:
+  return errx(1, "invalid huge page threshold: '%s'", spec + len + 1);
+}
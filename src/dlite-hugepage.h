@@ -0,0 +1,87 @@
+#ifndef _DLITE_HUGEPAGE_H
+#define _DLITE_HUGEPAGE_H
+
+/**
+  @file
+  @brief Huge page backed allocation of large property arrays
+
+  Kernels reading large property arrays directly suffer from TLB
+  misses when the arrays are backed by normal pages.  This module
+  provides an allocator (see dlite_instance_set_allocator()) that
+  maps allocations above a size threshold directly and backs them
+  with huge pages, either transparent huge pages requested with
+  `madvise(MADV_HUGEPAGE)` or explicit huge pages (`MAP_HUGETLB`).
+  Smaller allocations use the standard allocator.
+
+  Mapped arrays are resized with `mremap()`, so growing a property
+  with dlite_instance_set_dimension_sizes() does not copy it.
+
+  The allocator can also be enabled with the `DLITE_HUGEPAGES`
+  environment variable, whose value is parsed with
+  dlite_hugepage_parse().
+
+  Huge pages are only supported on Linux.  Elsewhere the allocator is
+  NULL, i.e. the standard allocator.
+ */
+
+#include "dlite-entity.h"
+
+/** Default size threshold for huge page backed allocations. */
+#define DLITE_HUGEPAGE_THRESHOLD (2*1024*1024)
+
+
+/** Huge page policies */
+typedef enum {
+  dliteHugePageNone,      /*!< Standard allocator. */
+  dliteHugePageAdvise,    /*!< Transparent huge pages via madvise(). */
+  dliteHugePageExplicit   /*!< Explicit huge pages from the huge page
+                               pool, falling back to transparent huge
+                               pages if the pool is exhausted. */
+} DLiteHugePagePolicy;
+
+
+/**
+  Returns the huge page size, or zero if huge pages are not supported.
+ */
+size_t dlite_hugepage_size(void);
+
+/**
+  Configures the huge page allocator.  Allocations of at least
+  `threshold` bytes are backed by huge pages according to `policy`.
+  If `threshold` is zero, DLITE_HUGEPAGE_THRESHOLD is used.
+
+  The configuration is process-wide and affects subsequent
+  allocations.  Returns non-zero on error.
+ */
+int dlite_hugepage_configure(DLiteHugePagePolicy policy, size_t threshold);
+
+/**
+  Returns the huge page allocator, or NULL if huge pages are not
+  supported.  The returned allocator is static and may be passed to
+  dlite_instance_set_allocator().
+ */
+const DLiteAllocator *dlite_hugepage_allocator(void);
+
+/**
+  Convenience function that configures the huge page allocator and
+  sets it as allocator for new instances in the current globals.  The
+  standard allocator is set if `policy` is `dliteHugePageNone`.
+
+  Returns non-zero on error.
+ */
+int dlite_hugepage_set_policy(DLiteHugePagePolicy policy, size_t threshold);
+
+/**
+  Parses a huge page specification `spec` of the form
+  "POLICY[:THRESHOLD]", where POLICY is "none", "advise" or "explicit"
+  and THRESHOLD is a size in bytes with an optional suffix "K", "M" or
+  "G", like "advise:4M".  The result is stored in `*policy` and
+  `*threshold`, which is zero if no threshold is given.
+
+  Returns non-zero on error.
+ */
+int dlite_hugepage_parse(const char *spec, DLiteHugePagePolicy *policy,
+                         size_t *threshold);
+
+
+#endif /* _DLITE_HUGEPAGE_H */
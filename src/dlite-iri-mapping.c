@@ -0,0 +1,358 @@
+/* dlite-iri-mapping.c -- declarative mappings based on property IRIs
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "utils/err.h"
+#include "utils/strutils.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-arrays.h"
+#include "dlite-type-cast.h"
+#include "dlite-mapping-plugins.h"
+#include "dlite-iri-mapping.h"
+
+
+/* How a property is copied */
+typedef enum {
+  iriCopy,   /* plain memcpy() of the property data */
+  iriCast    /* cast with a kernel or dlite_type_ndcast() */
+} IriOpKind;
+
+/* Copy of one source property to one target property */
+typedef struct {
+  IriOpKind kind;
+  int src;                     /* index of source property */
+  int dest;                    /* index of target property */
+  DLiteTypeCastKernel kernel;  /* cast kernel, may be NULL */
+  double scale;                /* unit conversion: */
+  double offset;               /*   dest = scale * src + offset */
+} IriOp;
+
+/* Where the value of a target dimension is taken from.  If `prop` is
+   non-negative, it is dimension `index` of source property `prop`.
+   Otherwise it is source dimension `index`. */
+typedef struct {
+  int prop;
+  int index;
+} IriDim;
+
+/* Compiled copy plan */
+struct _DLiteIriMapping {
+  DLiteMeta *src;   /* source metadata */
+  DLiteMeta *dest;  /* target metadata */
+  int nops;         /* number of copy operations */
+  IriOp *ops;       /* copy operations */
+  IriDim *dims;     /* one for each target dimension */
+};
+
+
+/* Returns true if `s` is NULL or empty. */
+static int isempty(const char *s)
+{
+  return !s || !*s;
+}
+
+/*
+  Computes the unit conversion from property `ps` to `pd`.  Missing
+  units are assumed to be the same.
+
+  Returns 2 if the units are equal, 1 if they are compatible and 0
+  if they are not.
+ */
+static int unit_match(const DLiteProperty *ps, const DLiteProperty *pd,
+                      double *scale, double *offset)
+{
+  int stat=1;
+  *scale = 1.0;
+  *offset = 0.0;
+  if (isempty(ps->unit) || isempty(pd->unit)) return 1;
+  if (strcmp(ps->unit, pd->unit) == 0) return 2;
+  ErrTry:
+    if (dlite_unit_conversion(ps->unit, pd->unit, scale, offset)) stat = 0;
+  ErrOther:
+    stat = 0;
+  ErrEnd;
+  return stat;
+}
+
+/* Returns the index of dimension `name` in `meta` or -1 if there is
+   no such dimension. */
+static int dim_index(const DLiteMeta *meta, const char *name)
+{
+  size_t i;
+  for (i=0; i<meta->_ndimensions; i++)
+    if (strcmp(meta->_dimensions[i].name, name) == 0) return i;
+  return -1;
+}
+
+/*
+  Compiles a copy plan for mapping instances of `src` to instances of
+  `dest` by matching property IRIs.
+ */
+DLiteIriMapping *dlite_iri_mapping_compile(const DLiteMeta *src,
+                                           const DLiteMeta *dest)
+{
+  DLiteIriMapping *plan=NULL;
+  size_t i, j;
+  int k;
+
+  if (!(plan = calloc(1, sizeof(DLiteIriMapping)))) FAIL("allocation failure");
+  if (!(plan->ops = calloc(dest->_nproperties + 1, sizeof(IriOp))))
+    FAIL("allocation failure");
+  if (!(plan->dims = calloc(dest->_ndimensions + 1, sizeof(IriDim))))
+    FAIL("allocation failure");
+  for (i=0; i<dest->_ndimensions; i++)
+    plan->dims[i].prop = plan->dims[i].index = -1;
+
+  /* Match properties */
+  for (j=0; j<dest->_nproperties; j++) {
+    DLiteProperty *pd = dest->_properties + j;
+    IriOp *op = plan->ops + plan->nops;
+    int best=-1, bestrank=0;
+    double scale=1.0, offset=0.0;
+    if (isempty(pd->iri)) continue;
+    for (i=0; i<src->_nproperties; i++) {
+      DLiteProperty *ps = src->_properties + i;
+      double s, o;
+      int rank;
+      if (isempty(ps->iri) || strcmp(ps->iri, pd->iri)) continue;
+      if (ps->ndims != pd->ndims) continue;
+      if (!(rank = unit_match(ps, pd, &s, &o))) continue;
+      rank = 2*rank + (strcmp(ps->name, pd->name) == 0);
+      if (rank > bestrank) {
+        best = i;
+        bestrank = rank;
+        scale = s;
+        offset = o;
+      }
+    }
+    if (best < 0) continue;
+
+    op->src = best;
+    op->dest = j;
+    op->scale = scale;
+    op->offset = offset;
+    if (src->_properties[best].type == pd->type &&
+        src->_properties[best].size == pd->size &&
+        !dlite_type_is_allocated(pd->type)) {
+      op->kind = iriCopy;
+    } else {
+      op->kind = iriCast;
+      if (src->_properties[best].type == dliteStringPtr)
+        op->kernel = dlite_type_get_parse_kernel(pd->type, pd->size);
+      else
+        op->kernel = dlite_type_get_cast_kernel(pd->type, pd->size,
+                                                src->_properties[best].type,
+                                                src->_properties[best].size);
+    }
+    if ((scale != 1.0 || offset != 0.0) &&
+        pd->type != dliteInt && pd->type != dliteUInt &&
+        pd->type != dliteFloat)
+      FAIL4("cannot map property '%s' of %s to non-numerical property '%s' "
+            "of %s with a different unit",
+            src->_properties[best].name, src->uri, pd->name, dest->uri);
+
+    /* Target dimensions used by the matched property */
+    for (k=0; k<pd->ndims; k++) {
+      int d = dim_index(dest, pd->dims[k]);
+      if (d >= 0 && plan->dims[d].prop < 0) {
+        plan->dims[d].prop = best;
+        plan->dims[d].index = k;
+      }
+    }
+    plan->nops++;
+  }
+  if (!plan->nops)
+    FAIL2("no properties of %s and %s share IRIs", src->uri, dest->uri);
+
+  /* Remaining target dimensions are taken from source dimensions
+     with the same name */
+  for (i=0; i<dest->_ndimensions; i++) {
+    if (plan->dims[i].prop >= 0) continue;
+    if ((k = dim_index(src, dest->_dimensions[i].name)) < 0)
+      FAIL2("cannot determine dimension '%s' of %s",
+            dest->_dimensions[i].name, dest->uri);
+    plan->dims[i].index = k;
+  }
+
+  plan->src = (DLiteMeta *)src;
+  plan->dest = (DLiteMeta *)dest;
+  dlite_meta_incref(plan->src);
+  dlite_meta_incref(plan->dest);
+  return plan;
+ fail:
+  dlite_iri_mapping_free(plan);
+  return NULL;
+}
+
+/*
+  Frees a copy plan.
+ */
+void dlite_iri_mapping_free(DLiteIriMapping *plan)
+{
+  if (!plan) return;
+  if (plan->src) dlite_meta_decref(plan->src);
+  if (plan->dest) dlite_meta_decref(plan->dest);
+  if (plan->ops) free(plan->ops);
+  if (plan->dims) free(plan->dims);
+  free(plan);
+}
+
+/*
+  Returns the number of target properties copied by `plan`.
+ */
+int dlite_iri_mapping_nmatched(const DLiteIriMapping *plan)
+{
+  return plan->nops;
+}
+
+/* Executes copy operation `op` from `inst` to `new`.  Returns non-zero
+   on error. */
+static int apply_op(const DLiteIriMapping *plan, const IriOp *op,
+                    const DLiteInstance *inst, DLiteInstance *new)
+{
+  DLiteProperty *ps = plan->src->_properties + op->src;
+  DLiteProperty *pd = plan->dest->_properties + op->dest;
+  size_t *sdims=NULL, *ddims=NULL, n=1;
+  const void *src;
+  void *dest;
+  int j, stat=0;
+
+  if (ps->ndims) {
+    sdims = DLITE_PROP_DIMS(inst, op->src);
+    ddims = DLITE_PROP_DIMS(new, op->dest);
+    for (j=0; j<ps->ndims; j++) {
+      if (sdims[j] != ddims[j])
+        return errx(dliteIndexError, "cannot map property '%s' to '%s': "
+                    "length of dimension %d differs (%d != %d)",
+                    ps->name, pd->name, j, (int)sdims[j], (int)ddims[j]);
+      n *= sdims[j];
+    }
+  }
+  if (n == 0) return 0;
+  if (!(src = dlite_instance_get_property_by_index(inst, op->src)) ||
+      !(dest = dlite_instance_get_property_by_index(new, op->dest)))
+    return 1;
+
+  switch (op->kind) {
+  case iriCopy:
+    memcpy(dest, src, n * ps->size);
+    break;
+  case iriCast:
+    if (!op->kernel || op->kernel(dest, src, n))
+      if (dlite_type_ndcast(ps->ndims, dest, pd->type, pd->size, ddims, NULL,
+                            src, ps->type, ps->size, sdims, NULL, NULL))
+        return 1;
+    break;
+  }
+
+  if (op->scale != 1.0 || op->offset != 0.0) {
+    DLiteArray *arr;
+    if (!(arr = dlite_array_create(dest, pd->type, pd->size, 1, &n)))
+      return 1;
+    stat = dlite_array_scale(arr, op->scale, op->offset);
+    dlite_array_free(arr);
+  }
+  return stat;
+}
+
+/*
+  Applies `plan` to `inst` and returns a new instance of the target
+  metadata.
+ */
+DLiteInstance *dlite_iri_mapping_apply(const DLiteIriMapping *plan,
+                                       const DLiteInstance *inst)
+{
+  DLiteInstance *new=NULL;
+  size_t i, *dims=NULL;
+  int k;
+
+  if (inst->meta != plan->src)
+    FAIL2("expected an instance of %s, got %s",
+          plan->src->uri, inst->meta->uri);
+  if (dlite_instance_sync_to_dimension_sizes((DLiteInstance *)inst))
+    goto fail;
+  if (!(dims = calloc(plan->dest->_ndimensions + 1, sizeof(size_t))))
+    FAIL("allocation failure");
+  for (i=0; i<plan->dest->_ndimensions; i++) {
+    const IriDim *d = plan->dims + i;
+    dims[i] = (d->prop >= 0) ?
+      DLITE_PROP_DIM(inst, d->prop, d->index) : DLITE_DIM(inst, d->index);
+  }
+  if (!(new = dlite_instance_create(plan->dest, dims, NULL))) goto fail;
+  for (k=0; k<plan->nops; k++)
+    if (apply_op(plan, plan->ops + k, inst, new)) goto fail;
+  free(dims);
+  return new;
+ fail:
+  if (new) dlite_instance_decref(new);
+  if (dims) free(dims);
+  return NULL;
+}
+
+
+/* Mapper function of registered IRI mappings */
+static DLiteInstance *iri_mapper(const DLiteMappingPlugin *api,
+                                 const DLiteInstance **instances, int n)
+{
+  if (n != 1)
+    return errx(dliteValueError, "IRI mapping expects one input, got %d",
+                n), NULL;
+  return dlite_iri_mapping_apply(api->data, instances[0]);
+}
+
+/* Frees a registered IRI mapping */
+static void iri_freeapi(PluginAPI *api)
+{
+  DLiteMappingPlugin *p = (DLiteMappingPlugin *)api;
+  if (p->name) free(p->name);
+  if (p->output_uri) free((char *)p->output_uri);
+  if (p->input_uris) {
+    if (p->input_uris[0]) free((char *)p->input_uris[0]);
+    free(p->input_uris);
+  }
+  dlite_iri_mapping_free(p->data);
+  free(p);
+}
+
+/*
+  Compiles a copy plan from `input_uri` to `output_uri` and registers
+  it as a mapping plugin.
+ */
+int dlite_iri_mapping_register(const char *input_uri, const char *output_uri)
+{
+  DLiteMeta *src=NULL, *dest=NULL;
+  DLiteMappingPlugin *api=NULL;
+  int retval=1;
+
+  if (!(src = dlite_meta_get(input_uri))) goto fail;
+  if (!(dest = dlite_meta_get(output_uri))) goto fail;
+  if (!(api = calloc(1, sizeof(DLiteMappingPlugin))))
+    FAIL("allocation failure");
+  api->freeapi = iri_freeapi;
+  if (!(api->data = dlite_iri_mapping_compile(src, dest))) goto fail;
+  if (!(api->name = aprintf("iri:%s->%s", input_uri, output_uri)) ||
+      !(api->output_uri = strdup(output_uri)) ||
+      !(api->input_uris = calloc(1, sizeof(char *))) ||
+      !(api->input_uris[0] = strdup(input_uri)))
+    FAIL("allocation failure");
+  api->ninput = 1;
+  api->mapper = iri_mapper;
+  api->cost = 10;
+  api->flags = dliteMappingThreadSafe;
+  if (dlite_mapping_plugin_register_api(api)) goto fail;
+  api = NULL;
+  retval = 0;
+ fail:
+  if (api) iri_freeapi((PluginAPI *)api);
+  if (src) dlite_meta_decref(src);
+  if (dest) dlite_meta_decref(dest);
+  return retval;
+}
@@ -0,0 +1,84 @@
+#ifndef _DLITE_IRI_MAPPING_H
+#define _DLITE_IRI_MAPPING_H
+
+/**
+  @file
+  @brief Declarative mappings based on property IRIs
+
+  Properties of two metadata refer to the same ontological concept if
+  they have the same `iri`.  This module maps instances of a source
+  metadata to a target metadata without any hand-written mapping code,
+  by copying each property of the source to the target property with
+  the same IRI.
+
+  A target property is matched by a source property with the same IRI
+  and a compatible unit (or no unit).  If several source properties
+  match, the one with the same unit is preferred, and then the one
+  with the same name.  Target properties without a matching source
+  property are left zero-initialised.
+
+  The matching is done once, when a mapping is compiled into a copy
+  plan.  The plan stores the property indices, the cast kernels and
+  the unit conversion factors, such that applying it is a sequence of
+  memcpy() calls and vectorised casts.
+
+  The dimensions of the new instance are taken from the dimensions of
+  the matched source properties.  Target dimensions that are not used
+  by any matched property are taken from the source dimension with
+  the same name.
+
+  Compiled plans may be registered as mapping plugins with
+  dlite_iri_mapping_register(), such that they are used by
+  dlite_mapping().
+ */
+
+#include "dlite-entity.h"
+
+/** Opaque type for a compiled copy plan */
+typedef struct _DLiteIriMapping DLiteIriMapping;
+
+
+/**
+  Compiles a copy plan for mapping instances of `src` to instances of
+  `dest` by matching property IRIs.
+
+  Returns NULL on error, e.g. if no properties share IRIs or if a
+  dimension of `dest` cannot be determined.
+ */
+DLiteIriMapping *dlite_iri_mapping_compile(const DLiteMeta *src,
+                                           const DLiteMeta *dest);
+
+/**
+  Frees a copy plan.
+ */
+void dlite_iri_mapping_free(DLiteIriMapping *plan);
+
+/**
+  Returns the number of target properties copied by `plan`.
+ */
+int dlite_iri_mapping_nmatched(const DLiteIriMapping *plan);
+
+/**
+  Applies `plan` to `inst` and returns a new instance of the target
+  metadata.  `inst` must be an instance of the source metadata.
+
+  This function is thread safe.
+
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_iri_mapping_apply(const DLiteIriMapping *plan,
+                                       const DLiteInstance *inst);
+
+/**
+  Compiles a copy plan from `input_uri` to `output_uri` and registers
+  it as a mapping plugin, such that it is used by dlite_mapping().
+
+  The plugin is named "iri:<input_uri>-><output_uri>" and can be
+  removed with dlite_mapping_plugin_unload().
+
+  Returns non-zero on error.
+ */
+int dlite_iri_mapping_register(const char *input_uri, const char *output_uri);
+
+
+#endif /* _DLITE_IRI_MAPPING_H */
@@ -5,75 +5,340 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdarg.h>
+
+#include "config.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "utils/err.h"
 #include "utils/compat.h"
+#include "utils/floatfmt.h"
 #include "utils/strutils.h"
+#include "utils/scheduler.h"
+#include "utils/scratch.h"
+#include "utils/thread.h"
+#include "utils/trace.h"
 
 #include "dlite.h"
 #include "dlite-macros.h"
 #include "dlite-json.h"
+#include "dlite-stats.h"
 
 
-/* Expands to `a - b` if `a > b` else to `0`. */
-#define PDIFF(a, b) (((size_t)(a) > (size_t)(b)) ? (a) - (b) : 0)
-
 /* These macros could have been simplified with __VA_ARGS__, but not
-   all compilers support that... */
+   all compilers support that... They expect an emitter `e` */
 #define PRINT(fmt)                                      \
   do {                                                  \
-    int m = snprintf(dest+n, PDIFF(size, n), fmt);      \
-    if (m < 0) goto fail;                               \
-    n += m;                                             \
+    if (emit(e, fmt)) goto fail;                        \
   } while (0)
 #define PRINT1(fmt, a1)                                 \
   do {                                                  \
-    int m = snprintf(dest+n, PDIFF(size, n), fmt, a1);  \
-    if (m < 0) goto fail;                               \
-    n += m;                                             \
+    if (emit(e, fmt, a1)) goto fail;                    \
   } while (0)
-#define PRINT2(fmt, a1, a2)                                     \
-  do {                                                          \
-    int m = snprintf(dest+n, PDIFF(size, n), fmt, a1, a2);      \
-    if (m < 0) goto fail;                                       \
-    n += m;                                                     \
+#define PRINT2(fmt, a1, a2)                             \
+  do {                                                  \
+    if (emit(e, fmt, a1, a2)) goto fail;                \
   } while (0)
-#define PRINT3(fmt, a1, a2, a3)                                 \
-  do {                                                          \
-    int m = snprintf(dest+n, PDIFF(size, n), fmt, a1, a2, a3);  \
-    if (m < 0) goto fail;                                       \
-    n += m;                                                     \
+#define PRINT3(fmt, a1, a2, a3)                         \
+  do {                                                  \
+    if (emit(e, fmt, a1, a2, a3)) goto fail;            \
   } while (0)
-#define PRINT4(fmt, a1, a2, a3, a4)                                     \
-  do {                                                                  \
-    int m = snprintf(dest+n, PDIFF(size, n), fmt, a1, a2, a3, a4);      \
-    if (m < 0) goto fail;                                               \
-    n += m;                                                             \
+#define PRINT4(fmt, a1, a2, a3, a4)                     \
+  do {                                                  \
+    if (emit(e, fmt, a1, a2, a3, a4)) goto fail;        \
   } while (0)
 
 
 /* Forward declarations */
 static const jsmntok_t *nexttok(DLiteJsonIter *iter, int *length);
+static DLiteInstance *json_sscann(const char *src, size_t srclen,
+                                  const char *id, const char *metaid);
+
+
+/* Size of the buffer of the json emitter */
+#define EMIT_BUFSIZE 8192
+
+/* Numeric arrays spanning at least this many bytes of JSON source are
+   not tokenised, but scanned directly into the property by
+   scan_numeric_array(). */
+#define JSON_COMPACT_MINLEN 4096
+
+/* A buffered json emitter, writing to a DLiteJsonWriter sink */
+typedef struct {
+  DLiteJsonWriter writer;  /* sink */
+  void *context;           /* context passed to `writer` */
+  size_t n;                /* number of bytes in `buf` */
+  size_t total;            /* total number of bytes emitted */
+  char buf[EMIT_BUFSIZE];  /* output buffer */
+} Emitter;
+
+/* Writes the content of the emitter buffer to the sink.
+   Returns non-zero on error. */
+static int emit_flush(Emitter *e)
+{
+  if (e->n && e->writer(e->buf, e->n, e->context))
+    return err(1, "error writing json");
+  e->n = 0;
+  return 0;
+}
+
+/* Emits `len` bytes from `s`.  Returns non-zero on error. */
+static int emit_raw(Emitter *e, const char *s, size_t len)
+{
+  if (len > EMIT_BUFSIZE - e->n) {
+    if (emit_flush(e)) return 1;
+    if (len >= EMIT_BUFSIZE) {
+      if (e->writer(s, len, e->context)) return err(1, "error writing json");
+      e->total += len;
+      return 0;
+    }
+  }
+  memcpy(e->buf + e->n, s, len);
+  e->n += len;
+  e->total += len;
+  return 0;
+}
+
+/* Emits a printf()-formatted string.  Returns non-zero on error. */
+static int emit(Emitter *e, const char *fmt, ...)
+{
+  va_list ap;
+  int m;
+  va_start(ap, fmt);
+  m = vsnprintf(e->buf + e->n, EMIT_BUFSIZE - e->n, fmt, ap);
+  va_end(ap);
+  if (m < 0) return err(1, "error formatting json");
+  if ((size_t)m >= EMIT_BUFSIZE - e->n) {
+    char *s;
+    if (!(s = malloc(m + 1))) return err(1, "allocation failure");
+    va_start(ap, fmt);
+    vsnprintf(s, m + 1, fmt, ap);
+    va_end(ap);
+    m = emit_raw(e, s, m);
+    free(s);
+    return m;
+  }
+  e->n += m;
+  e->total += m;
+  return 0;
+}
+
+/* Emits a value of type `type` and size `size` pointed to by `ptr`.
+   Returns non-zero on error. */
+static int emit_value(Emitter *e, const void *ptr, DLiteType type,
+                      size_t size, DLiteTypeFlag flags)
+{
+  int m = dlite_type_print(e->buf + e->n, EMIT_BUFSIZE - e->n, ptr, type,
+                           size, 0, -2, flags);
+  if (m < 0) return 1;
+  if ((size_t)m >= EMIT_BUFSIZE - e->n) {
+    char *s;
+    if (emit_flush(e)) return 1;
+    if ((size_t)m < EMIT_BUFSIZE) return emit_value(e, ptr, type, size, flags);
+    if (!(s = malloc(m + 1))) return err(1, "allocation failure");
+    dlite_type_print(s, m + 1, ptr, type, size, 0, -2, flags);
+    m = emit_raw(e, s, m);
+    free(s);
+    return m;
+  }
+  e->n += m;
+  e->total += m;
+  return 0;
+}
+
+/* Emits dimension `d` of array property `p`, element by element, like
+   dlite_property_print().  `*pptr` points to the next element and is
+   advanced.  Returns non-zero on error. */
+static int emit_dim(Emitter *e, int d, const void **pptr,
+                    const DLiteProperty *p, const size_t *dims,
+                    DLiteTypeFlag flags)
+{
+  size_t i;
+  if (d < p->ndims) {
+    if (emit_raw(e, "[", 1)) return 1;
+    for (i=0; i < dims[d]; i++) {
+      if (emit_dim(e, d+1, pptr, p, dims, flags)) return 1;
+      if (i < dims[d]-1 && emit_raw(e, ", ", 2)) return 1;
+    }
+    if (emit_raw(e, "]", 1)) return 1;
+  } else {
+    if (emit_value(e, *pptr, p->type, p->size, flags)) return 1;
+    *((char **)pptr) += p->size;
+  }
+  return 0;
+}
+
+/* Returns the byte order of the host, "little" or "big". */
+static const char *host_byteorder(void)
+{
+  const unsigned short one = 1;
+  return (*(const unsigned char *)&one) ? "little" : "big";
+}
+
+/* Returns non-zero if property `p` with dimension values `dims` should
+   be written as a binary array. */
+static int use_binary_array(const DLiteProperty *p, const size_t *dims)
+{
+  size_t nelem=1;
+  int i;
+  if (p->ndims == 0) return 0;
+  switch (p->type) {
+  case dliteBool:
+  case dliteInt:
+  case dliteUInt:
+  case dliteFloat:
+    break;
+  default:
+    return 0;
+  }
+  for (i=0; i < p->ndims; i++) nelem *= dims[i];
+  return nelem >= DLITE_JSON_BINARY_MINSIZE;
+}
+
+/* Emits the data pointed to by `ptr` of array property `p` with
+   dimension values `dims` as a binary array object.  The data is
+   encoded in chunks.  Returns non-zero on error. */
+static int emit_binary_array(Emitter *e, const void *ptr,
+                             const DLiteProperty *p, const size_t *dims,
+                             DLiteJsonFlag flags)
+{
+  int i, ok=0;
+  size_t j, chunk, nbytes=p->size;
+  char typename[32], enc[EMIT_BUFSIZE + 1];
+  const unsigned char *data = ptr;
+  unsigned char *zbuf=NULL;
+  int base85 = !(flags & dliteJsonBase64Arrays);
+
+  for (i=0; i < p->ndims; i++) nbytes *= dims[i];
+  if (dlite_type_set_typename(p->type, p->size, typename, sizeof(typename)))
+    goto fail;
+
+  PRINT1("{\"dtype\": \"%s\", \"shape\": [", typename);
+  for (i=0; i < p->ndims; i++)
+    PRINT2("%lu%s", (unsigned long)dims[i], (i < p->ndims-1) ? ", " : "");
+  PRINT2("], \"byteorder\": \"%s\", \"encoding\": \"%s\"",
+         host_byteorder(), (base85) ? "base85" : "base64");
+
+  if (flags & dliteJsonCompressArrays) {
+#ifdef HAVE_ZLIB
+    uLongf zsize = compressBound(nbytes);
+    if (!(zbuf = malloc(zsize))) FAIL("allocation failure");
+    if (compress2(zbuf, &zsize, data, nbytes, Z_DEFAULT_COMPRESSION) != Z_OK)
+      FAIL1("cannot compress property \"%s\"", p->name);
+    data = zbuf;
+    nbytes = zsize;
+    PRINT(", \"compression\": \"zlib\"");
+#else
+    FAIL("cannot compress binary arrays - dlite is built without zlib");
+#endif
+  }
+
+  /* Chunks are multiples of the group size of the encoding, such that
+     their concatenation equals the encoding of the whole data */
+  PRINT(", \"data\": \"");
+  chunk = (base85) ? EMIT_BUFSIZE / 5 * 4 : EMIT_BUFSIZE / 4 * 3;
+  for (j=0; j < nbytes; j += chunk) {
+    size_t len = (nbytes - j < chunk) ? nbytes - j : chunk;
+    int m = (base85) ? strbase85(enc, sizeof(enc), data + j, len) :
+      strbase64(enc, sizeof(enc), data + j, len);
+    if (m < 0) FAIL1("cannot encode property \"%s\"", p->name);
+    if (emit_raw(e, enc, m)) goto fail;
+  }
+  PRINT("\"}");
+
+  ok = 1;
+ fail:
+  if (zbuf) free(zbuf);
+  return (ok) ? 0 : 1;
+}
+
+
+/* Emits the data pointed to by `ptr` of array property `p` with
+   dimension values `dims` as a sparse array object in format `format`
+   (see dlite-sparse.h).  Returns non-zero on error. */
+static int emit_sparse_array(Emitter *e, const void *ptr,
+                             const DLiteProperty *p, const size_t *dims,
+                             DLiteSparseFormat format, DLiteTypeFlag flags)
+{
+  DLiteSparse *sp;
+  char typename[DLITE_STRUCT_NAME_SIZE];
+  size_t k;
+  int i, ok=0;
+
+  if (!(sp = dlite_sparse_from_dense(format, ptr, p->type, p->size,
+                                     p->ndims, dims))) return 1;
+  if (dlite_type_set_typename(p->type, p->size, typename, sizeof(typename)))
+    goto fail;
+
+  PRINT2("{\"format\": \"%s\", \"dtype\": \"%s\", \"shape\": [",
+         dlite_sparse_format_name(format), typename);
+  for (i=0; i < p->ndims; i++)
+    PRINT2("%lu%s", (unsigned long)dims[i], (i < p->ndims-1) ? ", " : "");
+  PRINT("]");
+  if (format == dliteSparseCSR) {
+    PRINT(", \"indptr\": [");
+    for (k=0; k <= dims[0]; k++)
+      PRINT2("%lu%s", (unsigned long)sp->indptr[k], (k < dims[0]) ? ", " : "");
+    PRINT("]");
+  }
+  PRINT(", \"indices\": [");
+  for (k=0; k < sp->nnz; k++) {
+    if (k) PRINT(", ");
+    if (format == dliteSparseCOO) {
+      PRINT("[");
+      for (i=0; i < p->ndims; i++)
+        PRINT2("%lu%s", (unsigned long)sp->indices[k*p->ndims + i],
+               (i < p->ndims-1) ? ", " : "");
+      PRINT("]");
+    } else {
+      PRINT1("%lu", (unsigned long)sp->indices[k]);
+    }
+  }
+  PRINT("], \"values\": [");
+  for (k=0; k < sp->nnz; k++) {
+    if (k) PRINT(", ");
+    if (emit_value(e, (char *)sp->values + k*p->size, p->type, p->size,
+                   flags)) goto fail;
+  }
+  PRINT("]}");
+
+  ok = 1;
+ fail:
+  dlite_sparse_free(sp);
+  return (ok) ? 0 : 1;
+}
 
 
 /*
-  Serialise instance `inst` to `dest`, formatted as JSON.
+  Serialise instance `inst` as JSON, writing the output in chunks to
+  the sink `writer`.  `context` is passed on to `writer`.
 
-  No more than `size` bytes are written to `dest` (incl. the
-  terminating NUL).
+  The output is the same as for dlite_json_sprint(), but it is never
+  built up in memory as a whole.  Arrays are written element by
+  element.
 
-  Returns number of bytes written to `dest`.  If the output is
-  truncated because it exceeds `size`, the number of bytes that would
-  have been written if `size` was large enough is returned.  On error, a
-  negative value is returned.
+  Returns number of bytes written or a negative number on error.
 */
-int dlite_json_sprint(char *dest, size_t size, const DLiteInstance *inst,
-                      int indent, DLiteJsonFlag flags)
+int dlite_json_write(DLiteJsonWriter writer, void *context,
+                     const DLiteInstance *inst, int indent,
+                     DLiteJsonFlag flags)
 {
-  DLiteTypeFlag f = (DLiteTypeFlag)flags;
-  int n=0, ok=0, m, j;
+  DLiteTypeFlag f = dliteFlagQuoted;
+  int binary = flags & (dliteJsonBase64Arrays | dliteJsonBase85Arrays);
+  int ok=0, j;
   size_t i;
-  char *in = malloc(indent + 1);
+  Emitter *e;
+  char *in=NULL;
+
+  if (!(e = malloc(sizeof(Emitter)))) FAIL("allocation failure");
+  e->writer = writer;
+  e->context = context;
+  e->n = 0;
+  e->total = 0;
+  if (!(in = malloc(indent + 1))) FAIL("allocation failure");
   memset(in, ' ', indent);
   in[indent] = '\0';
 
@@ -99,12 +364,19 @@ int dlite_json_sprint(char *dest, size_t size, const DLiteInstance *inst,
     for (i=0; i < inst->meta->_nproperties; i++) {
       char *c = (i < inst->meta->_nproperties - 1) ? "," : "";
       DLiteProperty *p = inst->meta->_properties + i;
-      void *ptr = dlite_instance_get_property_by_index(inst, i);
+      const void *ptr = dlite_instance_get_property_by_index(inst, i);
       size_t *dims = DLITE_PROP_DIMS(inst, i);
+      DLiteSparseFormat sparse = dlite_meta_get_sparse_format(inst->meta, i);
       PRINT2("%s    \"%s\": ", in, p->name);
-      m = dlite_property_print(dest+n, PDIFF(size, n), ptr, p, dims, 0, -2, f);
-      if (m < 0) return -1;
-      n += m;
+      if (sparse && p->ndims) {
+        if (emit_sparse_array(e, ptr, p, dims, sparse, f)) goto fail;
+      } else if (binary && use_binary_array(p, dims)) {
+        if (emit_binary_array(e, ptr, p, dims, flags)) goto fail;
+      } else if (p->ndims) {
+        if (emit_dim(e, 0, &ptr, p, dims, f)) goto fail;
+      } else {
+        if (emit_value(e, ptr, p->type, p->size, f)) goto fail;
+      }
       PRINT1("%s\n", c);
     }
     PRINT1("%s  }\n", in);
@@ -147,6 +419,9 @@ int dlite_json_sprint(char *dest, size_t size, const DLiteInstance *inst,
       }
       if (p->unit)
         PRINT2(",\n%s      \"unit\": \"%s\"", in, p->unit);
+      if (dlite_meta_get_sparse_format(met, i))
+        PRINT2(",\n%s      \"sparse\": \"%s\"", in,
+               dlite_sparse_format_name(dlite_meta_get_sparse_format(met, i)));
       if (p->description)
         PRINT2(",\n%s      \"description\": \"%s\"", in, p->description);
       PRINT2("\n%s    }%s\n", in, c);
@@ -155,14 +430,98 @@ int dlite_json_sprint(char *dest, size_t size, const DLiteInstance *inst,
   }
 
   PRINT1("%s}", in);
+  if (emit_flush(e)) goto fail;
 
   ok = 1;
  fail:
-  free(in);
-  return (ok) ? n : -1;
+  if (in) free(in);
+  i = (e) ? e->total : 0;
+  if (e) free(e);
+  return (ok) ? (int)i : -1;
+}
+
+
+/* Sink for dlite_json_sprint() writing to a fixed-size buffer */
+typedef struct {
+  char *dest;   /* destination buffer */
+  size_t size;  /* size of `dest` */
+  size_t pos;   /* number of bytes written so far */
+} BufferSink;
+
+/* DLiteJsonWriter for a BufferSink.  Output that doesn't fit is
+   counted, but not written. */
+static int buffer_writer(const char *data, size_t len, void *context)
+{
+  BufferSink *s = context;
+  if (s->pos < s->size) {
+    size_t n = (len < s->size - s->pos) ? len : s->size - s->pos;
+    memcpy(s->dest + s->pos, data, n);
+  }
+  s->pos += len;
+  return 0;
+}
+
+/*
+  Serialise instance `inst` to `dest`, formatted as JSON.
+
+  No more than `size` bytes are written to `dest` (incl. the
+  terminating NUL).
+
+  If `flags` includes dliteJsonBase64Arrays or dliteJsonBase85Arrays,
+  boolean, integer and float arrays with at least
+  DLITE_JSON_BINARY_MINSIZE elements are written as an object with
+  the raw data encoded as a string:
+
+      {"dtype": "float64", "shape": [2, 100], "byteorder": "little",
+       "encoding": "base64", "data": "..."}
+
+  With dliteJsonCompressArrays, the data is compressed with zlib before
+  it is encoded and the object gets a `"compression": "zlib"` item.
+  Both forms of arrays are accepted when scanning.
+
+  Returns number of bytes written to `dest`.  If the output is
+  truncated because it exceeds `size`, the number of bytes that would
+  have been written if `size` was large enough is returned.  On error, a
+  negative value is returned.
+*/
+int dlite_json_sprint(char *dest, size_t size, const DLiteInstance *inst,
+                      int indent, DLiteJsonFlag flags)
+{
+  BufferSink sink;
+  int m;
+  sink.dest = dest;
+  sink.size = size;
+  sink.pos = 0;
+  m = dlite_json_write(buffer_writer, &sink, inst, indent, flags);
+  if (size) dest[(sink.pos < size) ? sink.pos : size-1] = '\0';
+  return m;
 }
 
 
+/* Sink for dlite_json_asprint() writing to a reallocated buffer */
+typedef struct {
+  char **dest;   /* pointer to allocated buffer */
+  size_t *size;  /* pointer to allocated size of `*dest` */
+  size_t pos;    /* current position in `*dest` */
+} AllocSink;
+
+/* DLiteJsonWriter for an AllocSink.  Returns non-zero on error. */
+static int alloc_writer(const char *data, size_t len, void *context)
+{
+  AllocSink *s = context;
+  if (s->pos + len >= *s->size) {
+    size_t newsize = 2 * (*s->size) + EMIT_BUFSIZE;
+    void *q;
+    if (newsize <= s->pos + len) newsize = s->pos + len + 1;
+    if (!(q = realloc(*s->dest, newsize))) return 1;
+    *s->dest = q;
+    *s->size = newsize;
+  }
+  memcpy(*s->dest + s->pos, data, len);
+  s->pos += len;
+  return 0;
+}
+
 /*
   Like dlite_json_sprint(), but prints to allocated buffer.
 
@@ -175,21 +534,15 @@ int dlite_json_asprint(char **dest, size_t *size, size_t pos,
                        const DLiteInstance *inst, int indent,
                        DLiteJsonFlag flags)
 {
+  AllocSink sink;
   int m;
-  void *q;
-  size_t newsize;
-  if (!dest && !*dest) *size = 0;
-  m = dlite_json_sprint(*dest + pos, PDIFF(*size, pos), inst, indent, flags);
-  if (m < 0) return m;
-  if (m < (int)PDIFF(*size, pos)) return m;
-
-  /* Reallocate buffer to required size. */
-  newsize = m + pos + 1;
-  if (!(q = realloc(*dest, newsize))) return -1;
-  *dest = q;
-  *size = newsize;
-  m = dlite_json_sprint(*dest + pos, PDIFF(*size, pos), inst, indent, flags);
-  assert(0 <= m && m < (int)*size);
+  if (!*dest) *size = 0;
+  sink.dest = dest;
+  sink.size = size;
+  sink.pos = pos;
+  if ((m = dlite_json_write(alloc_writer, &sink, inst, indent, flags)) < 0)
+    return m;
+  if (alloc_writer("", 1, &sink)) return err(-1, "allocation failure");
   return m;
 }
 
@@ -203,13 +556,22 @@ char *dlite_json_aprint(const DLiteInstance *inst, int indent,
 {
   char *dest=NULL;
   size_t size=0;
-  if ((dlite_json_asprint(&dest, &size, 0, inst, indent, flags)) < 0)
+  if ((dlite_json_asprint(&dest, &size, 0, inst, indent, flags)) < 0) {
+    if (dest) free(dest);
     return NULL;
+  }
   return dest;
 }
 
+/* DLiteJsonWriter writing to the stream `context`. */
+static int file_writer(const char *data, size_t len, void *context)
+{
+  return fwrite(data, 1, len, (FILE *)context) != len;
+}
+
 /*
-  Like dlite_json_sprint(), but prints to stream `fp`.
+  Like dlite_json_sprint(), but prints to stream `fp`.  The output is
+  written in chunks, without building it up in memory.
 
   Returns number or bytes printed or a negative number on error.
 */
@@ -217,12 +579,8 @@ int dlite_json_fprint(FILE *fp, const DLiteInstance *inst, int indent,
                       DLiteJsonFlag flags)
 {
   int m;
-  char *buf=NULL;
-  size_t size=0;
-  if ((m = dlite_json_asprint(&buf, &size, 0, inst, indent, flags)) >= 0) {
-    fprintf(fp, "%s\n", buf);
-    free(buf);
-  }
+  if ((m = dlite_json_write(file_writer, fp, inst, indent, flags)) >= 0)
+    fputc('\n', fp);
   return m;
 }
 
@@ -261,6 +619,7 @@ int dlite_json_append(char **s, size_t *size, const DLiteInstance *inst,
   jsmn_init(&parser);
   if ((r = jsmn_parse_alloc(&parser, *s, *size, &tokens, &ntokens)) < 0)
     FAIL1("error parsing json: %s", jsmn_strerror(r));
+  dlite_stats_add(dliteStatsJsonTokens, r);
   if (r == 0) FAIL("cannot append to empty json string");
   if (tokens[0].type != JSMN_OBJECT)
     FAIL("can only append to json object");
@@ -351,6 +710,568 @@ static int get_meta_uuid(char *uuid, const char *src, const jsmntok_t *obj)
 }
 
 
+/* Returns non-zero if the string token `t` in `src` equals `s`. */
+static int tokeq(const char *src, const jsmntok_t *t, const char *s)
+{
+  int len = t->end - t->start;
+  return t->type == JSMN_STRING && (int)strlen(s) == len &&
+    strncmp(src + t->start, s, len) == 0;
+}
+
+/*
+  Scans the binary array object `obj` in `src` (see emit_binary_array())
+  into the memory pointed to by `ptr` of array property `p` with
+  dimension values `dims`.  `id` is only used for error messages.
+
+  Returns non-zero on error.
+*/
+static int scan_binary_array(const char *src, const jsmntok_t *obj,
+                             void *ptr, const DLiteProperty *p,
+                             const size_t *dims, const char *id)
+{
+  int retval=1, i, m, zlib=0, base85=0, len;
+  size_t j, nbytes=p->size;
+  char typename[32];
+  const jsmntok_t *t;
+  unsigned char *data = ptr, *zbuf=NULL;
+
+  for (i=0; i < p->ndims; i++) nbytes *= dims[i];
+  if (dlite_type_set_typename(p->type, p->size, typename, sizeof(typename)))
+    goto fail;
+
+  if (!(t = jsmn_item(src, obj, "dtype")) || !tokeq(src, t, typename))
+    FAIL3("expected binary array \"%s\" of type %s in %s",
+          p->name, typename, id);
+
+  if (!(t = jsmn_item(src, obj, "shape")) || t->type != JSMN_ARRAY ||
+      t->size != p->ndims)
+    FAIL3("binary array \"%s\" must have shape with %d dimensions: %s",
+          p->name, p->ndims, id);
+  for (i=0; i < p->ndims; i++) {
+    const jsmntok_t *d = jsmn_element(src, t, i);
+    if (!d || strtoul(src + d->start, NULL, 10) != dims[i])
+      FAIL3("shape of binary array \"%s\" does not match its dimensions "
+            "(dimension %d): %s", p->name, i, id);
+  }
+
+  if ((t = jsmn_item(src, obj, "encoding"))) {
+    if (tokeq(src, t, "base85"))
+      base85 = 1;
+    else if (!tokeq(src, t, "base64"))
+      FAIL3("unsupported encoding of binary array \"%s\": '%.*s'",
+            p->name, t->end - t->start, src + t->start);
+  }
+
+  if ((t = jsmn_item(src, obj, "compression"))) {
+    if (!tokeq(src, t, "zlib"))
+      FAIL3("unsupported compression of binary array \"%s\": '%.*s'",
+            p->name, t->end - t->start, src + t->start);
+    zlib = 1;
+  }
+
+  if (!(t = jsmn_item(src, obj, "data")) || t->type != JSMN_STRING)
+    FAIL2("binary array \"%s\" has no data: %s", p->name, id);
+  len = t->end - t->start;
+
+  if (zlib) {
+#ifdef HAVE_ZLIB
+    uLongf size=nbytes;
+    size_t zsize = (base85) ? len * 4 / 5 + 4 : len * 3 / 4 + 3;
+    if (!(zbuf = malloc(zsize))) FAIL("allocation failure");
+    m = (base85) ? strunbase85(zbuf, zsize, src + t->start, len) :
+      strunbase64(zbuf, zsize, src + t->start, len);
+    if (m < 0) FAIL2("cannot decode binary array \"%s\": %s", p->name, id);
+    if (uncompress(data, &size, zbuf, m) != Z_OK || size != nbytes)
+      FAIL2("cannot uncompress binary array \"%s\": %s", p->name, id);
+#else
+    FAIL2("cannot uncompress binary array \"%s\" - dlite is built without "
+          "zlib: %s", p->name, id);
+#endif
+  } else {
+    m = (base85) ? strunbase85(data, nbytes, src + t->start, len) :
+      strunbase64(data, nbytes, src + t->start, len);
+    if (m < 0) FAIL2("cannot decode binary array \"%s\": %s", p->name, id);
+    if ((size_t)m != nbytes)
+      FAIL4("binary array \"%s\" has %d bytes, expected %lu: %s",
+            p->name, m, (unsigned long)nbytes, id);
+  }
+
+  /* Swap byte order if needed */
+  if ((t = jsmn_item(src, obj, "byteorder")) &&
+      !tokeq(src, t, host_byteorder()) && p->size > 1) {
+    for (j=0; j < nbytes; j += p->size) {
+      size_t k;
+      for (k=0; k < p->size/2; k++) {
+        unsigned char c = data[j + k];
+        data[j + k] = data[j + p->size - 1 - k];
+        data[j + p->size - 1 - k] = c;
+      }
+    }
+  }
+
+  retval = 0;
+ fail:
+  if (zbuf) free(zbuf);
+  return retval;
+}
+
+
+/* Returns non-zero if array property `p` can be scanned with
+   scan_numeric_array(). */
+static int is_numeric_array(const DLiteProperty *p)
+{
+  if (p->ndims <= 0) return 0;
+  switch (p->type) {
+  case dliteInt:
+  case dliteUInt:
+    return p->size == 1 || p->size == 2 || p->size == 4 || p->size == 8;
+  case dliteFloat:
+    return p->size == 4 || p->size == 8;
+  default:
+    return 0;
+  }
+}
+
+/* Help function for scan_numeric_array().  Scans dimension `d` at `*s`
+   into `*dst` and advances both.  Returns non-zero if the input cannot
+   be scanned this way. */
+static int scan_numeric_dim(const char **s, char **dst, int d,
+                            const DLiteProperty *p, const size_t *dims)
+{
+  const char *q = *s;
+  char *endptr;
+  size_t i;
+  while (isspace((unsigned char)*q)) q++;
+  if (*q++ != '[') return 1;
+  for (i=0; i < dims[d]; i++) {
+    while (isspace((unsigned char)*q)) q++;
+    if (i && *q++ != ',') return 1;
+    if (d + 1 < p->ndims) {
+      if (scan_numeric_dim(&q, dst, d+1, p, dims)) return 1;
+      continue;
+    }
+    while (isspace((unsigned char)*q)) q++;
+    /* leave numbers that sscanf("%i") reads as octal to the general
+       scanner */
+    if (p->type != dliteFloat && q[q[0] == '-'] == '0' &&
+        isdigit((unsigned char)q[(q[0] == '-') + 1])) return 1;
+    switch (p->type) {
+    case dliteInt: {
+      long long v = strtoll(q, &endptr, 10);
+      switch (p->size) {
+      case 1: *((int8_t *)*dst) = (int8_t)v; break;
+      case 2: *((int16_t *)*dst) = (int16_t)v; break;
+      case 4: *((int32_t *)*dst) = (int32_t)v; break;
+      case 8: *((int64_t *)*dst) = (int64_t)v; break;
+      }
+      break;
+    }
+    case dliteUInt: {
+      unsigned long long v;
+      if (*q == '-') return 1;
+      v = strtoull(q, &endptr, 10);
+      switch (p->size) {
+      case 1: *((uint8_t *)*dst) = (uint8_t)v; break;
+      case 2: *((uint16_t *)*dst) = (uint16_t)v; break;
+      case 4: *((uint32_t *)*dst) = (uint32_t)v; break;
+      case 8: *((uint64_t *)*dst) = (uint64_t)v; break;
+      }
+      break;
+    }
+    default:
+      if (p->size == 4)
+        *((float *)*dst) = fast_strtof(q, &endptr);
+      else
+        *((double *)*dst) = fast_strtod(q, &endptr);
+    }
+    if (endptr == q) return 1;
+    q = endptr;
+    if (!isspace((unsigned char)*q) && *q != ',' && *q != ']') return 1;
+    *dst += p->size;
+  }
+  while (isspace((unsigned char)*q)) q++;
+  if (*q++ != ']') return 1;
+  *s = q;
+  return 0;
+}
+
+/*
+  Scans the JSON array in `src` starting at position `start` directly
+  into the memory pointed to by `ptr` of numeric array property `p`
+  (see is_numeric_array()) with dimension values `dims`.
+
+  The elements are parsed in place without tokenising or copying the
+  array, which may be a compact array token from jsmn_parse_compact().
+
+  Returns non-zero if the array doesn't match the dimensions or isn't
+  plain numbers, in which case it should be scanned with
+  dlite_property_scan() for proper error reporting.  The content of
+  `ptr` is then undefined.
+*/
+static int scan_numeric_array(const char *src, int start, void *ptr,
+                              const DLiteProperty *p, const size_t *dims)
+{
+  const char *s = src + start;
+  char *dst = ptr;
+  return scan_numeric_dim(&s, &dst, 0, p, dims);
+}
+
+
+/* Help function for scan_sparse_array().  Scans the JSON array token `t`
+   in `src` into `ptr`, described by `p` with dimension values `dims`.
+   `*buf` is a work buffer of size `*size`.  Returns non-zero on error. */
+static int scan_array(const char *src, const jsmntok_t *t, void *ptr,
+                      const DLiteProperty *p, const size_t *dims,
+                      char **buf, size_t *size)
+{
+  if (t->type != JSMN_ARRAY)
+    return errx(1, "expected array for \"%s\"", p->name);
+  if (is_numeric_array(p) && scan_numeric_array(src, t->start, ptr, p, dims)
+      == 0) return 0;
+  strnput(buf, size, 0, src + t->start, t->end - t->start);
+  return (dlite_property_scan(*buf, ptr, p, dims, 0) < 0) ? 1 : 0;
+}
+
+/*
+  Scans the sparse array object `obj` in `src` (see emit_sparse_array())
+  into the memory pointed to by `ptr` of array property `p` with
+  dimension values `dims`.  `id` is only used for error messages.
+
+  Returns non-zero on error.
+*/
+static int scan_sparse_array(const char *src, const jsmntok_t *obj,
+                             void *ptr, const DLiteProperty *p,
+                             const size_t *dims, const char *id)
+{
+  DLiteSparse *sp=NULL;
+  DLiteProperty q;
+  char typename[DLITE_STRUCT_NAME_SIZE], *buf=NULL;
+  const jsmntok_t *t, *v;
+  size_t nnz, qdims[2], size=0;
+  int i, format, retval=1;
+
+  if (!(t = jsmn_item(src, obj, "format")) ||
+      (format = dlite_sparse_format_from_name(src + t->start,
+                                              t->end - t->start)) <= 0)
+    FAIL2("invalid format of sparse array \"%s\": %s", p->name, id);
+  if (dlite_type_set_typename(p->type, p->size, typename, sizeof(typename)))
+    goto fail;
+  if (!(t = jsmn_item(src, obj, "dtype")) || !tokeq(src, t, typename))
+    FAIL3("expected sparse array \"%s\" of type %s in %s",
+          p->name, typename, id);
+  if (!(t = jsmn_item(src, obj, "shape")) || t->type != JSMN_ARRAY ||
+      t->size != p->ndims)
+    FAIL3("sparse array \"%s\" must have shape with %d dimensions: %s",
+          p->name, p->ndims, id);
+  for (i=0; i < p->ndims; i++) {
+    const jsmntok_t *d = jsmn_element(src, t, i);
+    if (!d || strtoul(src + d->start, NULL, 10) != dims[i])
+      FAIL3("shape of sparse array \"%s\" does not match its dimensions "
+            "(dimension %d): %s", p->name, i, id);
+  }
+  if (!(v = jsmn_item(src, obj, "values")) || v->type != JSMN_ARRAY)
+    FAIL2("sparse array \"%s\" has no values: %s", p->name, id);
+  nnz = (v->size < 0) ? -v->size : v->size;
+  if (!(sp = dlite_sparse_create(format, p->type, p->size, p->ndims, dims,
+                                 nnz))) goto fail;
+
+  /* index arrays are scanned as arrays of size_t */
+  memset(&q, 0, sizeof(q));
+  q.name = p->name;
+  q.type = dliteUInt;
+  q.size = sizeof(size_t);
+  q.ndims = 1;
+  if (format == dliteSparseCSR) {
+    qdims[0] = dims[0] + 1;
+    if (!(t = jsmn_item(src, obj, "indptr")) ||
+        scan_array(src, t, sp->indptr, &q, qdims, &buf, &size))
+      FAIL2("invalid indptr of sparse array \"%s\": %s", p->name, id);
+  }
+  qdims[0] = nnz;
+  qdims[1] = p->ndims;
+  if (format == dliteSparseCOO) q.ndims = 2;
+  if (!(t = jsmn_item(src, obj, "indices")) ||
+      scan_array(src, t, sp->indices, &q, qdims, &buf, &size))
+    FAIL2("invalid indices of sparse array \"%s\": %s", p->name, id);
+
+  q.type = p->type;
+  q.size = p->size;
+  q.ndims = 1;
+  if (scan_array(src, v, sp->values, &q, qdims, &buf, &size))
+    FAIL2("invalid values of sparse array \"%s\": %s", p->name, id);
+
+  if (dlite_sparse_to_dense(sp, ptr))
+    FAIL2("cannot assign sparse array \"%s\": %s", p->name, id);
+  retval = 0;
+ fail:
+  if (buf) free(buf);
+  dlite_sparse_free(sp);
+  return retval;
+}
+
+/*
+  Declares the properties of metadata `meta` with a "sparse" item in
+  the "properties" token `t` as sparse.  `t` may be an array of
+  property objects or an object mapping property names to property
+  objects.
+
+  Returns non-zero on error.
+*/
+static int scan_sparse_declarations(const char *src, const jsmntok_t *t,
+                                    DLiteMeta *meta)
+{
+  const jsmntok_t *item;
+  int k;
+  if (!t || (t->type != JSMN_ARRAY && t->type != JSMN_OBJECT)) return 0;
+  item = t + 1;
+  for (k=0; k < t->size; k++) {
+    const jsmntok_t *obj=item, *name=NULL, *s;
+    if (t->type == JSMN_OBJECT) {
+      name = item;
+      obj = item + 1;
+    }
+    if (obj->type == JSMN_OBJECT && (s = jsmn_item(src, obj, "sparse"))) {
+      char *propname;
+      int format, stat;
+      if (!name && !(name = jsmn_item(src, obj, "name")))
+        return errx(1, "missing property name in %s", meta->uri);
+      if ((format = dlite_sparse_format_from_name(src + s->start,
+                                                  s->end - s->start)) < 0)
+        return errx(1, "invalid sparse format of property '%.*s' in %s: "
+                    "'%.*s'", name->end - name->start, src + name->start,
+                    meta->uri, s->end - s->start, src + s->start);
+      if (!(propname = strndup(src + name->start, name->end - name->start)))
+        return err(1, "allocation failure");
+      stat = dlite_meta_set_sparse_property(meta, propname, format);
+      free(propname);
+      if (stat) return 1;
+    }
+    item = obj + jsmn_count(obj) + 1;
+  }
+  return 0;
+}
+
+
+/********************************************************************
+ *  Compiled parser
+ *
+ *  Looking up each dimension and property with jsmn_item() scans the
+ *  object once per key.  Instead the keys of an object are matched in
+ *  one pass, expecting them in the order dlite_json_write() writes
+ *  them and falling back to a hash lookup when they come in another
+ *  order.  The lookup tables are compiled on first use and cached in
+ *  the `_jsonparser` field of the metadata.
+ ********************************************************************/
+
+/* Lookup tables for the dimension and property names of a metadata */
+struct _DLiteJsonParser {
+  const DLiteDimension *dimensions; /* Dimensions compiled for. */
+  const DLiteProperty *properties;  /* Properties compiled for. */
+  size_t ndimensions;               /* Number of dimensions. */
+  size_t nproperties;               /* Number of properties. */
+  size_t dimmask;                   /* Length of `dimslots` minus one. */
+  size_t propmask;                  /* Length of `propslots` minus one. */
+  int *dimslots;                    /* Dimension index plus one or zero. */
+  int *propslots;                   /* Property index plus one or zero. */
+  size_t *dimlens;                  /* Lengths of dimension names. */
+  size_t *proplens;                 /* Lengths of property names. */
+};
+
+/* Serialises creation of compiled parsers */
+static ThreadMutex _parser_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Returns FNV-1a hash of the `len` first bytes of `key`. */
+static size_t key_hash(const char *key, size_t len)
+{
+  size_t i, hash = 2166136261u;
+  for (i=0; i<len; i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* Inserts the `n` names in `arr` into `slots` and their lengths into
+   `lens`.  The elements of `arr` has size `stride` and start with a
+   `char *name` field.  Returns non-zero if any name is NULL. */
+static int parser_fill(int *slots, size_t mask, size_t *lens,
+                       const void *arr, size_t n, size_t stride)
+{
+  size_t i, j;
+  for (i=0; i<n; i++) {
+    const char *name = *(char **)((char *)arr + i*stride);
+    if (!name) return 1;
+    lens[i] = strlen(name);
+    j = key_hash(name, lens[i]) & mask;
+    while (slots[j]) j = (j + 1) & mask;
+    slots[j] = i + 1;
+  }
+  return 0;
+}
+
+/* Returns a new compiled parser for `meta` or NULL if `meta` has
+   unassigned names or on allocation failure. */
+static struct _DLiteJsonParser *parser_create(const DLiteMeta *meta)
+{
+  struct _DLiteJsonParser *parser;
+  size_t dimsize=2, propsize=2;
+  while (dimsize < 2*meta->_ndimensions) dimsize <<= 1;
+  while (propsize < 2*meta->_nproperties) propsize <<= 1;
+  if ((meta->_ndimensions && !meta->_dimensions) ||
+      (meta->_nproperties && !meta->_properties)) return NULL;
+  if (!(parser = calloc(1, sizeof(struct _DLiteJsonParser) +
+                        (dimsize + propsize)*sizeof(int) +
+                        (meta->_ndimensions + meta->_nproperties)*
+                        sizeof(size_t)))) return NULL;
+  parser->dimensions = meta->_dimensions;
+  parser->properties = meta->_properties;
+  parser->ndimensions = meta->_ndimensions;
+  parser->nproperties = meta->_nproperties;
+  parser->dimmask = dimsize - 1;
+  parser->propmask = propsize - 1;
+  parser->dimlens = (size_t *)(parser + 1);
+  parser->proplens = parser->dimlens + meta->_ndimensions;
+  parser->dimslots = (int *)(parser->proplens + meta->_nproperties);
+  parser->propslots = parser->dimslots + dimsize;
+  if (parser_fill(parser->dimslots, parser->dimmask, parser->dimlens,
+                  meta->_dimensions, meta->_ndimensions,
+                  sizeof(DLiteDimension)) ||
+      parser_fill(parser->propslots, parser->propmask, parser->proplens,
+                  meta->_properties, meta->_nproperties,
+                  sizeof(DLiteProperty))) {
+    free(parser);
+    return NULL;
+  }
+  return parser;
+}
+
+/* Returns the compiled parser for `meta`, creating it if needed.
+   Returns NULL if it cannot be created, in which case the keys should
+   be looked up with jsmn_item(). */
+static const struct _DLiteJsonParser *get_parser(const DLiteMeta *meta)
+{
+  DLiteMeta *m = (DLiteMeta *)meta;
+  struct _DLiteJsonParser *parser;
+  thread_mutex_lock(&_parser_mutex);
+  parser = m->_jsonparser;
+  if (parser && (parser->dimensions != meta->_dimensions ||
+                 parser->properties != meta->_properties ||
+                 parser->ndimensions != meta->_ndimensions ||
+                 parser->nproperties != meta->_nproperties)) {
+    free(parser);
+    parser = NULL;
+  }
+  if (!parser) parser = parser_create(meta);
+  m->_jsonparser = parser;
+  thread_mutex_unlock(&_parser_mutex);
+  return parser;
+}
+
+/*
+  Frees the compiled JSON parser.
+ */
+void dlite_json_parser_free(struct _DLiteJsonParser *parser)
+{
+  if (parser) free(parser);
+}
+
+/*
+  Assigns `vals[i]` to the value of key `i` in JSON object `obj` for
+  each of the `n` names in `arr` (see parser_fill()), or NULL if `obj`
+  has no such key.  If a key occurs more than once, the first is used.
+
+  Returns non-zero on error.
+*/
+static int match_keys(const char *src, const jsmntok_t *obj,
+                      const jsmntok_t **vals, const void *arr, size_t n,
+                      size_t stride, const int *slots, size_t mask,
+                      const size_t *lens)
+{
+  const jsmntok_t *t = obj + 1;
+  size_t next=0;
+  int k, m;
+  assert(obj->type == JSMN_OBJECT);
+  memset(vals, 0, n*sizeof(jsmntok_t *));
+  for (k=0; k < obj->size; k++) {
+    const char *key = src + t->start;
+    size_t len = t->end - t->start, j;
+    int i = -1;
+    assert(t->type == JSMN_STRING);
+    if (next < n && len == lens[next] &&
+        memcmp(key, *(char **)((char *)arr + next*stride), len) == 0) {
+      i = next;  /* sequential fast path */
+    } else {
+      j = key_hash(key, len) & mask;
+      while (slots[j]) {
+        int q = slots[j] - 1;
+        if (len == lens[q] &&
+            memcmp(key, *(char **)((char *)arr + q*stride), len) == 0) {
+          i = q;
+          break;
+        }
+        j = (j + 1) & mask;
+      }
+    }
+    t++;
+    if (i >= 0) {
+      if (!vals[i]) vals[i] = t;
+      next = i + 1;
+    }
+    if ((m = jsmn_count(t)) < 0) return 1;
+    t += m + 1;
+  }
+  return 0;
+}
+
+/* Assigns `vals` to the values of the dimensions of `meta` in JSON
+   object `obj`.  Returns non-zero on error. */
+static int match_dimensions(const char *src, const jsmntok_t *obj,
+                            const jsmntok_t **vals, const DLiteMeta *meta,
+                            const struct _DLiteJsonParser *parser)
+{
+  size_t i;
+  if (parser)
+    return match_keys(src, obj, vals, meta->_dimensions, meta->_ndimensions,
+                      sizeof(DLiteDimension), parser->dimslots,
+                      parser->dimmask, parser->dimlens);
+  for (i=0; i < meta->_ndimensions; i++)
+    vals[i] = jsmn_item(src, obj, meta->_dimensions[i].name);
+  return 0;
+}
+
+/* Assigns `vals` to the values of the properties of `meta` in JSON
+   object `obj`.  Returns non-zero on error. */
+static int match_properties(const char *src, const jsmntok_t *obj,
+                            const jsmntok_t **vals, const DLiteMeta *meta,
+                            const struct _DLiteJsonParser *parser)
+{
+  size_t i;
+  if (parser)
+    return match_keys(src, obj, vals, meta->_properties, meta->_nproperties,
+                      sizeof(DLiteProperty), parser->propslots,
+                      parser->propmask, parser->proplens);
+  for (i=0; i < meta->_nproperties; i++)
+    vals[i] = jsmn_item(src, obj, meta->_properties[i].name);
+  return 0;
+}
+
+/* Returns non-zero if scalar property `p` can be scanned directly
+   from the JSON source with dlite_type_scan(). */
+static int is_direct_scalar(const DLiteProperty *p)
+{
+  if (p->ndims > 0) return 0;
+  switch (p->type) {
+  case dliteBool:
+  case dliteInt:
+  case dliteUInt:
+  case dliteFloat:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
 /*
   Help function for parsing an instance.
   - src: json source
@@ -363,13 +1284,15 @@ static DLiteInstance *parse_instance(const char *src, jsmntok_t *obj,
                                      const char *id)
 {
   int ok=0;
-  const jsmntok_t *item, *t;
-  char *buf=NULL, *uri=NULL, *metauri=NULL, uuid[DLITE_UUID_LENGTH+1];
-  size_t i, size=0, *dims=NULL;
+  const jsmntok_t *item, *t, **vals=NULL;
+  char *uri=NULL, *metauri=NULL, uuid[DLITE_UUID_LENGTH+1];
+  size_t i, *dims=NULL;
   DLiteInstance *inst=NULL;
   const DLiteMeta *meta=NULL;
+  const struct _DLiteJsonParser *parser;
   jsmntype_t dimtype = 0;
   char *name=NULL, *version=NULL, *namespace=NULL;
+  TRACE_BEGIN(span, "parse_instance", id);
 
   assert(obj->type == JSMN_OBJECT);
 
@@ -405,9 +1328,12 @@ static DLiteInstance *parse_instance(const char *src, jsmntok_t *obj,
   }
   assert(meta);
 
-  /* Allocate dimensions */
-  if (!(dims = calloc(meta->_ndimensions, sizeof(size_t))))
-    FAIL("allocation failure");
+  /* Allocate dimensions and value tokens */
+  if (!(dims = scratch_calloc(meta->_ndimensions, sizeof(size_t))) ||
+      !(vals = scratch_calloc(meta->_ndimensions + meta->_nproperties,
+                              sizeof(jsmntok_t *))))
+    goto fail;
+  parser = get_parser(meta);
 
   /* Parse dimensions */
   if (meta->_ndimensions > 0) {
@@ -419,9 +1345,11 @@ static DLiteInstance *parse_instance(const char *src, jsmntok_t *obj,
       if (item->size != (int)meta->_ndimensions)
         FAIL3("expected %d dimensions, got %d in instance %s",
               (int)meta->_ndimensions, item->size, id);
+      if (match_dimensions(src, item, vals, meta, parser))
+        FAIL1("invalid \"dimensions\" in %s", id);
       for (i=0; i < meta->_ndimensions; i++) {
         DLiteDimension *d = meta->_dimensions + i;
-        if (!(t = jsmn_item(src, item, d->name)))
+        if (!(t = vals[i]))
           FAIL2("missing dimension \"%s\" in %s", d->name, id);
         if (t->type != JSMN_PRIMITIVE)
           FAIL3("value '%.*s' of dimension should be an integer: %s",
@@ -482,14 +1410,33 @@ static DLiteInstance *parse_instance(const char *src, jsmntok_t *obj,
     }
 
     /* -- read properties */
+    if (match_properties(src, base, vals, meta, parser))
+      FAIL1("invalid \"properties\" in %s", id);
     for (i=0; i < meta->_nproperties; i++) {
       DLiteProperty *p = meta->_properties + i;
       size_t *pdims = DLITE_PROP_DIMS(inst, i);
       void *ptr = DLITE_PROP(inst, i);
       if (DLITE_PROP_NDIM(inst, i) > 0) ptr = *(void **)ptr;
-      if ((t = jsmn_item(src, base, p->name))) {
-        strnput(&buf, &size, 0, src+t->start, t->end-t->start);
-        if (dlite_property_scan(buf, ptr, p, pdims, 0) < 0) goto fail;
+      if ((t = vals[i]) && t->type == JSMN_OBJECT && p->ndims > 0 &&
+          jsmn_item(src, t, "format")) {
+        if (scan_sparse_array(src, t, ptr, p, pdims, id)) goto fail;
+      } else if (t && t->type == JSMN_OBJECT && p->ndims > 0) {
+        if (scan_binary_array(src, t, ptr, p, pdims, id)) goto fail;
+      } else if (t && t->type == JSMN_PRIMITIVE && is_direct_scalar(p)) {
+        /* scanned directly from the source */
+        if (dlite_type_scan(src+t->start, t->end-t->start, ptr, p->type,
+                            p->size, 0) < 0) goto fail;
+      } else if (t && t->type == JSMN_ARRAY && is_numeric_array(p) &&
+                 scan_numeric_array(src, t->start, ptr, p, pdims) == 0) {
+        /* scanned directly from the source */
+      } else if (t) {
+        char *buf;
+        int stat;
+        if (!(buf = scratch_strndup(src+t->start, t->end-t->start)))
+          goto fail;
+        stat = dlite_property_scan(buf, ptr, p, pdims, 0);
+        scratch_free(buf);
+        if (stat < 0) goto fail;
       //} else {
       } else if (dlite_instance_is_meta(inst)) {
         /* -- if not given, use inferred name, version and namespace */
@@ -508,15 +1455,21 @@ static DLiteInstance *parse_instance(const char *src, jsmntok_t *obj,
       if (meta->_loadprop) meta->_loadprop(inst, i);
     }
   }
-  if (dlite_instance_is_meta(inst)) dlite_meta_init((DLiteMeta *)inst);
+  if (dlite_instance_is_meta(inst)) {
+    dlite_meta_init((DLiteMeta *)inst);
+    for (i=0; i < meta->_nproperties && vals; i++)
+      if (strcmp(meta->_properties[i].name, "properties") == 0 &&
+          scan_sparse_declarations(src, vals[i], (DLiteMeta *)inst))
+        goto fail;
+  }
 
   ok = 1;
  fail:
   if (name) free(name);
   if (version) free(version);
   if (namespace) free(namespace);
-  if (dims) free(dims);
-  if (buf) free(buf);
+  scratch_free(vals);
+  scratch_free(dims);
   if (uri) free(uri);
   if (metauri) free(metauri);
   if (!ok && inst) {
@@ -524,6 +1477,7 @@ static DLiteInstance *parse_instance(const char *src, jsmntok_t *obj,
     inst = NULL;
   }
   if (meta) dlite_meta_decref((DLiteMeta *)meta);
+  TRACE_END(span);
   return inst;
 }
 
@@ -542,6 +1496,13 @@ static DLiteInstance *parse_instance(const char *src, jsmntok_t *obj,
 */
 DLiteInstance *dlite_json_sscan(const char *src, const char *id,
                                 const char *metaid)
+{
+  return json_sscann(src, strlen(src), id, metaid);
+}
+
+/* Like dlite_json_sscan(), but the length of `src` is given by `srclen`. */
+static DLiteInstance *json_sscann(const char *src, size_t srclen,
+                                  const char *id, const char *metaid)
 {
   int i, r;
   char *buf=NULL;
@@ -550,12 +1511,13 @@ DLiteInstance *dlite_json_sscan(const char *src, const char *id,
   unsigned int ntokens=0;
   jsmntok_t *tokens=NULL, *root;
   jsmn_parser parser;
-  size_t srclen = strlen(src);
   errno = 0;
 
   jsmn_init(&parser);
-  r = jsmn_parse_alloc(&parser, src, srclen, &tokens, &ntokens);
+  r = jsmn_parse_compact(&parser, src, srclen, &tokens, &ntokens,
+                         JSON_COMPACT_MINLEN);
   if (r < 0) FAIL1("error parsing json: %s", jsmn_strerror(r));
+  dlite_stats_add(dliteStatsJsonTokens, r);
   root = tokens;
   if (root->type != JSMN_OBJECT) FAIL("json root should be an object");
 
@@ -647,13 +1609,11 @@ DLiteInstance *dlite_json_fscan(FILE *fp, const char *id, const char *metaid)
 DLiteInstance *dlite_json_scanfile(const char *filename, const char *id,
                                    const char *metaid)
 {
-  DLiteInstance *inst;
-  FILE *fp;
-  char *buf;
-  if (!(fp = fopen(filename, "r")))
+  DLiteInstance *inst=NULL;
+  JStoreMap map;
+  if (jstore_mapfile(&map, filename))
     FAIL1("cannot open storage \"%s\"", filename);
-  if (!(buf = fu_readfile(fp))) goto fail;
-  if (!(inst = dlite_json_sscan(buf, id, metaid))) {
+  if (!(inst = json_sscann(map.data, map.size, id, metaid))) {
     /* write full error message */
     char *msg=NULL;
     size_t size=0, n=0;
@@ -664,9 +1624,8 @@ DLiteInstance *dlite_json_scanfile(const char *filename, const char *id,
     errx(1, "%s", msg);
     free(msg);
   }
+  jstore_unmapfile(&map);
  fail:
-  if (fp) fclose(fp);
-  if (buf) free(buf);
   return inst;
 }
 
@@ -739,6 +1698,7 @@ DLiteJsonIter *dlite_json_iter_create(const char *src, int length,
   jsmn_init(&parser);
   r = jsmn_parse_alloc(&parser, src, length, &iter->tokens, &iter->ntokens);
   if (r < 0) FAIL1("error parsing json: %s", jsmn_strerror(r));
+  dlite_stats_add(dliteStatsJsonTokens, r);
   if (r == 0) goto fail;
   if (iter->tokens->type != JSMN_OBJECT) FAIL("json root should be an object");
   iter->src = src;
@@ -796,10 +1756,274 @@ struct _DLiteJStoreIter {
 };
 
 
+/* Rebase the `n` tokens starting at index `first` in `tokens` in-place,
+   such that their positions are relative to the start of the first
+   token and their parent indices are relative to the first token. */
+static jsmntok_t *rebase_tokens(jsmntok_t *tokens, int first, unsigned int n)
+{
+  unsigned int i;
+  jsmntok_t *tok = tokens + first;
+  int offset = tok->start;
+  for (i=0; i < n; i++) {
+    tok[i].start -= offset;
+    tok[i].end -= offset;
+    tok[i].parent = (tok[i].parent >= first) ? tok[i].parent - first : -1;
+  }
+  return tok;
+}
+
+/* Maximum number of tasks used by dlite_jstore_loads() */
+#define LOADS_MAX_THREADS 64
+
+/* A member of the root object of a json document */
+typedef struct {
+  int kstart, kend;         /* position of the key (excl. quotes) */
+  int vstart, vend;         /* position of the value */
+  char uuid[DLITE_UUID_LENGTH+1];  /* uuid corresponding to the key */
+  jsmntok_t *tokens;        /* tokens of the value, relative to `vstart` */
+  unsigned int ntokens;     /* number of allocated tokens */
+  int stat;                 /* zero on success */
+} LoadsTask;
+
+/* Shared state of the tokenising tasks */
+typedef struct {
+  const char *src;          /* json source */
+  LoadsTask *tasks;         /* tasks */
+  size_t ntasks;            /* number of tasks */
+} LoadsWork;
+
+/* Returns the number of threads to use by dlite_jstore_loads(). */
+static int loads_threads(void)
+{
+  char *endptr, *p = getenv("DLITE_JSON_THREADS");
+  int n;
+  if (!p || !*p) return 1;
+  n = strtol(p, &endptr, 10);
+  if (*endptr || n < 1) {
+    warnx("invalid value of DLITE_JSON_THREADS: '%s'", p);
+    return 1;
+  }
+  return (n > LOADS_MAX_THREADS) ? LOADS_MAX_THREADS : n;
+}
+
+/* Returns the position after the json string starting at `src[i]`
+   (which must be a double quote) or -1 if it isn't terminated. */
+static int skip_string(const char *src, int len, int i)
+{
+  for (i++; i < len; i++) {
+    if (src[i] == '\\') i++;
+    else if (src[i] == '"') return i+1;
+  }
+  return -1;
+}
+
+/* Returns the position after the json value starting at `src[i]` or
+   -1 on error.  Only the structure is checked; the value is validated
+   when it is tokenised. */
+static int skip_value(const char *src, int len, int i)
+{
+  int depth=0;
+  if (i >= len) return -1;
+  if (src[i] != '{' && src[i] != '[') {
+    if (src[i] == '"') return skip_string(src, len, i);
+    while (i < len && !isspace((unsigned char)src[i]) && src[i] != ',' && src[i] != '}' &&
+           src[i] != ']') i++;
+    return i;
+  }
+  while (i < len) {
+    switch (src[i]) {
+    case '"':
+      if ((i = skip_string(src, len, i)) < 0) return -1;
+      continue;
+    case '{':
+    case '[':
+      depth++;
+      break;
+    case '}':
+    case ']':
+      if (--depth == 0) return i+1;
+      break;
+    }
+    i++;
+  }
+  return -1;
+}
+
+/* Pre-scans the root object of the json document `src` and returns an
+   allocated array with a task for each of its members.  The number of
+   members is stored in `*ntasks`.
+
+   Returns NULL on error or if `src` has a member named "properties"
+   (metadata format).  No error message is emitted, since the caller
+   falls back to the serial parser, which reports the error. */
+static LoadsTask *loads_split(const char *src, int len, size_t *ntasks)
+{
+  LoadsTask *tasks=NULL, *t;
+  size_t n=0, size=0;
+  int i=0;
+  while (i < len && isspace((unsigned char)src[i])) i++;
+  if (i >= len || src[i++] != '{') return NULL;
+  while (1) {
+    while (i < len && isspace((unsigned char)src[i])) i++;
+    if (i < len && src[i] == '}' && n == 0) break;
+    if (i >= len || src[i] != '"') goto fail;
+    if (n >= size) {
+      size = (size) ? size*2 : 64;
+      if (!(t = realloc(tasks, size*sizeof(LoadsTask)))) goto fail;
+      tasks = t;
+    }
+    t = tasks + n++;
+    memset(t, 0, sizeof(LoadsTask));
+    t->kstart = i+1;
+    if ((i = skip_string(src, len, i)) < 0) goto fail;
+    t->kend = i-1;
+    if (t->kend - t->kstart == 10 &&
+        strncmp(src + t->kstart, "properties", 10) == 0) goto fail;
+    while (i < len && isspace((unsigned char)src[i])) i++;
+    if (i >= len || src[i++] != ':') goto fail;
+    while (i < len && isspace((unsigned char)src[i])) i++;
+    t->vstart = i;
+    if ((i = skip_value(src, len, i)) < 0) goto fail;
+    t->vend = i;
+    while (i < len && isspace((unsigned char)src[i])) i++;
+    if (i < len && src[i] == ',') { i++; continue; }
+    if (i < len && src[i] == '}') break;
+    goto fail;
+  }
+  *ntasks = n;
+  return tasks;
+ fail:
+  if (tasks) free(tasks);
+  return NULL;
+}
+
+/* Writes the UUID of the metadata of the json object `src` of length
+   `len` to `uuid`.  Only the "meta" member of the object is parsed,
+   which is found with the same structural scan as used by
+   loads_split().  `tokens` and `ntokens` are passed on to
+   jsmn_parse_alloc() if "meta" is an object.
+
+   Returns non-zero on error. */
+static int scan_meta_uuid(char *uuid, const char *src, int len,
+                          jsmntok_t **tokens, unsigned int *ntokens)
+{
+  int i=0, kstart, kend, vstart;
+  while (i < len && isspace((unsigned char)src[i])) i++;
+  if (i >= len || src[i++] != '{') goto fail;
+  while (1) {
+    while (i < len && isspace((unsigned char)src[i])) i++;
+    if (i >= len || src[i] != '"') goto fail;
+    kstart = i+1;
+    if ((i = skip_string(src, len, i)) < 0) goto fail;
+    kend = i-1;
+    while (i < len && isspace((unsigned char)src[i])) i++;
+    if (i >= len || src[i++] != ':') goto fail;
+    while (i < len && isspace((unsigned char)src[i])) i++;
+    vstart = i;
+    if ((i = skip_value(src, len, i)) < 0) goto fail;
+    if (kend - kstart == 4 && strncmp(src + kstart, "meta", 4) == 0) {
+      if (src[vstart] == '"') {
+        if (dlite_get_uuidn(uuid, src + vstart + 1, i - vstart - 2) < 0)
+          return 1;
+        return 0;
+      } else if (src[vstart] == '{') {
+        jsmn_parser parser;
+        char *uri;
+        int stat;
+        jsmn_init(&parser);
+        if (jsmn_parse_alloc(&parser, src + vstart, i - vstart,
+                             tokens, ntokens) < 0) goto fail;
+        if (!(uri = get_uri(src + vstart, *tokens))) return 1;
+        stat = (dlite_get_uuid(uuid, uri) < 0);
+        free(uri);
+        return stat;
+      }
+      goto fail;
+    }
+    while (i < len && isspace((unsigned char)src[i])) i++;
+    if (i < len && src[i] == ',') { i++; continue; }
+    break;
+  }
+ fail:
+  return errx(1, "json input has no valid meta uri: \"%.*s\"",
+              (len > 30) ? 30 : len, src);
+}
+
+/* Tokenises the tasks `begin` to `end` in `arg`. */
+static void loads_range(size_t begin, size_t end, void *arg)
+{
+  LoadsWork *work = arg;
+  size_t i;
+  for (i=begin; i<end; i++) {
+    LoadsTask *t = work->tasks + i;
+    jsmn_parser parser;
+    int r;
+    t->stat = 1;
+    if (dlite_get_uuidn(t->uuid, work->src + t->kstart,
+                        t->kend - t->kstart) < 0) continue;
+    jsmn_init(&parser);
+    r = jsmn_parse_compact(&parser, work->src + t->vstart,
+                           t->vend - t->vstart, &t->tokens, &t->ntokens,
+                           JSON_COMPACT_MINLEN);
+    if (r < 0) {
+      err(1, "error parsing json value of \"%.*s\": %s",
+          t->kend - t->kstart, work->src + t->kstart, jsmn_strerror(r));
+      continue;
+    }
+    t->ntokens = r;
+    t->stat = 0;
+  }
+}
+
+/* Loads json document `src` of length `len` in data format into `js`
+   using `nthreads` tasks.  The members of the root object are found
+   with a fast structural pre-scan and then tokenised concurrently by
+   the shared task scheduler.
+   The results are added to `js` in document order.
+
+   Returns zero on success, a negative number if `src` cannot be split
+   (the caller should fall back to serial parsing) and a positive number
+   on other errors. */
+static int loads_parallel(JStore *js, const char *src, int len, int nthreads)
+{
+  LoadsWork work;
+  LoadsTask *tasks;
+  size_t i, ntasks=0;
+  int stat=0;
+
+  if (!(tasks = loads_split(src, len, &ntasks))) return -1;
+  if ((size_t)nthreads > ntasks) nthreads = (int)ntasks;
+  if (nthreads < 1) nthreads = 1;
+
+  memset(&work, 0, sizeof(work));
+  work.src = src;
+  work.tasks = tasks;
+  work.ntasks = ntasks;
+  sched_parallel_for(ntasks, (ntasks + nthreads - 1) / nthreads,
+                     loads_range, &work);
+
+  for (i=0; i<ntasks; i++) {
+    LoadsTask *t = tasks + i;
+    if (!stat && !t->stat)
+      stat = jstore_addn_tokens(js, t->uuid, DLITE_UUID_LENGTH,
+                                src + t->vstart, t->vend - t->vstart,
+                                t->tokens, t->ntokens);
+    else
+      stat = 1;
+    if (t->tokens) free(t->tokens);
+  }
+  free(tasks);
+  return stat;
+}
+
 /*
   Load content of json string `src` to json store `js`.
   `len` is the length of `src`.
 
+  If the environment variable `DLITE_JSON_THREADS` is larger than one,
+  the instances in a data-formatted document are tokenised by that
+  number of threads.
+
   Returns json format or -1 on error.
  */
 DLiteJsonFormat dlite_jstore_loads(JStore *js, const char *src, int len)
@@ -811,8 +2035,18 @@ DLiteJsonFormat dlite_jstore_loads(JStore *js, const char *src, int len)
   int r;
   DLiteJsonFormat retval=-1;
   char *dots = (len > 30) ? "..." : "";
+  int nthreads = loads_threads();
+
+  if (nthreads > 1) {
+    if ((r = loads_parallel(js, src, len, nthreads)) == 0)
+      return dliteJsonDataFormat;
+    if (r > 0)
+      FAIL2("error loading json string: \"%.30s%s\"", src, dots);
+  }
+
   jsmn_init(&parser);
-  if ((r = jsmn_parse_alloc(&parser, src, len, &tokens, &ntokens)) < 0)
+  if ((r = jsmn_parse_compact(&parser, src, len, &tokens, &ntokens,
+                              JSON_COMPACT_MINLEN)) < 0)
     FAIL3("error parsing json string: \"%.30s%s\": %s",
           src, dots, jsmn_strerror(r));
   if (tokens->type != JSMN_OBJECT)
@@ -823,8 +2057,11 @@ DLiteJsonFormat dlite_jstore_loads(JStore *js, const char *src, int len)
     if (!(uri = get_uri(src, tokens)))
       FAIL2("missing uri in metadata-formatted json data: \"%.30s%s\"",
             src, dots);
+    int n = jsmn_count(tokens) + 1, start = tokens->start, end = tokens->end;
     if (dlite_get_uuid(uuid, uri) < 0) goto fail;
-    jstore_addn(js, uuid, DLITE_UUID_LENGTH, src, len);
+    if (jstore_addn_tokens(js, uuid, DLITE_UUID_LENGTH, src + start,
+                           end - start, rebase_tokens(tokens, 0, n), n))
+      goto fail;
     retval = dliteJsonMetaFormat;
   } else {
     /* data format */
@@ -832,11 +2069,13 @@ DLiteJsonFormat dlite_jstore_loads(JStore *js, const char *src, int len)
     int i;
     for (i=0; i < tokens->size; i++) {
       jsmntok_t *v = t+1;
+      int n = jsmn_count(v) + 1, start = v->start, end = v->end;
       if (dlite_get_uuidn(uuid, src + t->start, t->end - t->start) < 0)
         goto fail;
-      if (jstore_addn(js, uuid, DLITE_UUID_LENGTH,
-                      src + v->start, v->end - v->start)) goto fail;
-      t += jsmn_count(v) + 2;
+      if (jstore_addn_tokens(js, uuid, DLITE_UUID_LENGTH, src + start,
+                             end - start, rebase_tokens(tokens, v - tokens, n),
+                             n)) goto fail;
+      t += n + 1;
     }
     retval = dliteJsonDataFormat;
   }
@@ -853,14 +2092,58 @@ DLiteJsonFormat dlite_jstore_loads(JStore *js, const char *src, int len)
  */
 DLiteJsonFormat dlite_jstore_loadf(JStore *js, const char *filename)
 {
-  char *buf = jstore_readfile(filename);
+  JStoreMap map;
   int fmt;
-  if (!buf) return err(1, "cannot load json file \"%s\"", filename);
-  fmt = dlite_jstore_loads(js, buf, strlen(buf));
-  free(buf);
+  if (jstore_mapfile(&map, filename))
+    return err(1, "cannot load json file \"%s\"", filename);
+  fmt = dlite_jstore_loads(js, map.data, map.size);
+  jstore_unmapfile(&map);
   return fmt;
 }
 
+/*
+  Like dlite_jstore_loadf(), but only indexes the instances in
+  `filename`.  The file is memory-mapped and the byte range of each
+  instance is found with a fast structural scan.  Copying and parsing
+  of an instance is deferred until it is loaded with
+  dlite_jstore_scan().  The file must not be modified while `js` is
+  open.
+
+  Files in metadata format are loaded as with dlite_jstore_loadf().
+
+  Returns json format or -1 on error.
+ */
+DLiteJsonFormat dlite_jstore_loadf_lazy(JStore *js, const char *filename)
+{
+  JStoreMap map;
+  LoadsTask *tasks;
+  size_t i, ntasks=0;
+  char uuid[DLITE_UUID_LENGTH+1];
+  int fmt;
+  if (jstore_mapfile(&map, filename))
+    return err(1, "cannot load json file \"%s\"", filename);
+  if (!(tasks = loads_split(map.data, map.size, &ntasks))) {
+    fmt = dlite_jstore_loads(js, map.data, map.size);
+    jstore_unmapfile(&map);
+    return fmt;
+  }
+  /* the map is kept before any value refers to it */
+  if (jstore_keep_map(js, &map)) {
+    free(tasks);
+    jstore_unmapfile(&map);
+    return -1;
+  }
+  for (i=0; i<ntasks; i++) {
+    LoadsTask *t = tasks + i;
+    if (dlite_get_uuidn(uuid, map.data + t->kstart, t->kend - t->kstart) < 0 ||
+        jstore_addn_ref(js, uuid, DLITE_UUID_LENGTH, map.data + t->vstart,
+                        t->vend - t->vstart)) break;
+  }
+  free(tasks);
+  if (i < ntasks) return err(-1, "cannot index json file \"%s\"", filename);
+  return dliteJsonDataFormat;
+}
+
 /*
   Add json representation of `inst` to json store `js`.
 
@@ -883,6 +2166,31 @@ int dlite_jstore_remove(JStore *js, const char *id)
   return jstore_remove(js, id);
 }
 
+/*
+  Returns a new instance scanned from the value stored under `key` in
+  json store `js`.  `id` is the id of the instance and may be NULL.
+
+  The tokens parsed when the value was added with dlite_jstore_loads()
+  are reused, such that the value doesn't need to be parsed again.
+  Values indexed with dlite_jstore_loadf_lazy() are parsed in place,
+  without being copied.
+
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_jstore_scan(JStore *js, const char *key, const char *id)
+{
+  const char *val;
+  const jsmntok_t *tokens;
+  size_t len;
+  if (!(val = jstore_getn(js, key, &len)))
+    return errx(1, "no instance with key \"%s\" in json store", key), NULL;
+  if ((tokens = jstore_get_tokens(js, key, NULL)) &&
+      tokens->type == JSMN_OBJECT &&
+      jsmn_item(val, tokens, "properties"))
+    return parse_instance(val, (jsmntok_t *)tokens, id);
+  return json_sscann(val, len, id, NULL);
+}
+
 /*
   Initiate iterator `init` from json store `js`.
   If `metaid` is provided, the iterator will only iterate over instances
@@ -919,20 +2227,21 @@ const char *dlite_jstore_iter_next(DLiteJStoreIter *iter)
 {
   const char *iid;
   JStore *js = iter->jiter.js;
-  jsmn_parser parser;
-  jsmn_init(&parser);
   while ((iid = jstore_iter_next(&iter->jiter))) {
     if (iter->metauuid[0]) {
       char metauuid[DLITE_UUID_LENGTH+1];
-      const char *val = jstore_get(js, iid);
-      if (jsmn_parse_alloc(&parser, val, strlen(val),
-                           &iter->tokens, &iter->ntokens) < 0) {
-        err(-1, "invalid json input: \"%s\"", val);
-        continue;
-      }
-      if (get_meta_uuid(metauuid, val, iter->tokens)) {
-        err(-1, "json input has no meta uri: \"%s\"", val);
-        continue;
+      size_t len;
+      const char *val = jstore_getn(js, iid, &len);
+      const jsmntok_t *tokens = jstore_get_tokens(js, iid, NULL);
+      if (tokens) {
+        if (get_meta_uuid(metauuid, val, tokens)) {
+          err(-1, "json input has no meta uri: \"%s\"", val);
+          continue;
+        }
+      } else {
+        /* only parse the "meta" member */
+        if (scan_meta_uuid(metauuid, val, len, &iter->tokens,
+                           &iter->ntokens)) continue;
       }
       if (strcmp(metauuid, iter->metauuid)) continue;
     }
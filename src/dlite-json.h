@@ -14,10 +14,24 @@
 
 /** Flags for serialisation */
 typedef enum {
-  dliteJsonWithUuid=1,    /*!< Whether to include uuid in output */
-  dliteJsonMetaAsData=2   /*!< Whether to write metadata as data */
+  dliteJsonWithUuid=1,        /*!< Whether to include uuid in output */
+  dliteJsonMetaAsData=2,      /*!< Whether to write metadata as data */
+  dliteJsonBase64Arrays=4,    /*!< Write large numerical arrays as base64 */
+  dliteJsonBase85Arrays=8,    /*!< Write large numerical arrays as base85 */
+  dliteJsonCompressArrays=16  /*!< Compress binary arrays with zlib */
 } DLiteJsonFlag;
 
+/** Minimum number of elements in arrays written in binary form with
+    the dliteJsonBase64Arrays or dliteJsonBase85Arrays flags */
+#define DLITE_JSON_BINARY_MINSIZE 64
+
+/**
+  Sink for dlite_json_write().  Is called with the next `len` bytes of
+  output in `data` and the `context` passed to dlite_json_write().
+  Should return non-zero on error.
+*/
+typedef int (*DLiteJsonWriter)(const char *data, size_t len, void *context);
+
 /** JSON formats */
 typedef enum {
   dliteJsonDataFormat,    /*!< Data format - single item */
@@ -40,12 +54,38 @@ typedef enum {
 /** @{ */
 
 
+/**
+  Serialise instance `inst` as JSON, writing the output in chunks to
+  the sink `writer`.  `context` is passed on to `writer`.
+
+  The output is the same as for dlite_json_sprint(), but it is never
+  built up in memory as a whole.  Arrays are written element by
+  element.
+
+  Returns number of bytes written or a negative number on error.
+*/
+int dlite_json_write(DLiteJsonWriter writer, void *context,
+                     const DLiteInstance *inst, int indent,
+                     DLiteJsonFlag flags);
+
 /**
   Serialise instance `inst` to `dest`, formatted as JSON.
 
   No more than `size` bytes are written to `dest` (incl. the
   terminating NUL).
 
+  If `flags` includes dliteJsonBase64Arrays or dliteJsonBase85Arrays,
+  boolean, integer and float arrays with at least
+  DLITE_JSON_BINARY_MINSIZE elements are written as an object with
+  the raw data encoded as a string:
+
+      {"dtype": "float64", "shape": [2, 100], "byteorder": "little",
+       "encoding": "base64", "data": "..."}
+
+  With dliteJsonCompressArrays, the data is compressed with zlib before
+  it is encoded and the object gets a `"compression": "zlib"` item.
+  Both forms of arrays are accepted when scanning.
+
   Returns number of bytes written to `dest`.  If the output is
   truncated because it exceeds `size`, the number of bytes that would
   have been written if `size` was large enough is returned.  On error, a
@@ -73,7 +113,8 @@ char *dlite_json_aprint(const DLiteInstance *inst, int indent,
                         DLiteJsonFlag flags);
 
 /**
-  Like dlite_sprint(), but prints to stream `fp`.
+  Like dlite_sprint(), but prints to stream `fp`.  The output is
+  written in chunks, without building it up in memory.
 
   Returns number or bytes printed or a negative number on error.
  */
@@ -140,6 +181,13 @@ DLiteInstance *dlite_json_fscan(FILE *fp, const char *id, const char *metaid);
 DLiteInstance *dlite_json_scanfile(const char *filename, const char *id,
                                    const char *metaid);
 
+/**
+  Frees the compiled JSON parser that is cached in the `_jsonparser`
+  field of metadata after the first instance of it is scanned.
+  Called when the metadata is free'ed.  Intended for internal use.
+ */
+void dlite_json_parser_free(struct _DLiteJsonParser *parser);
+
 
 
 
@@ -199,6 +247,10 @@ const char *dlite_json_next(DLiteJsonIter *iter, int *length);
   Load content of json string `src` to json store `js`.
   `len` is the length of `src`.
 
+  If the environment variable `DLITE_JSON_THREADS` is larger than one,
+  the instances in a data-formatted document are tokenised by that
+  number of threads.
+
   Returns json format or -1 on error.
  */
 DLiteJsonFormat dlite_jstore_loads(JStore *js, const char *src, int len);
@@ -210,6 +262,20 @@ DLiteJsonFormat dlite_jstore_loads(JStore *js, const char *src, int len);
  */
 DLiteJsonFormat dlite_jstore_loadf(JStore *js, const char *filename);
 
+/**
+  Like dlite_jstore_loadf(), but only indexes the instances in
+  `filename`.  The file is memory-mapped and the byte range of each
+  instance is found with a fast structural scan.  Copying and parsing
+  of an instance is deferred until it is loaded with
+  dlite_jstore_scan().  The file must not be modified while `js` is
+  open.
+
+  Files in metadata format are loaded as with dlite_jstore_loadf().
+
+  Returns json format or -1 on error.
+ */
+DLiteJsonFormat dlite_jstore_loadf_lazy(JStore *js, const char *filename);
+
 /** Opaque iterator struct */
 typedef struct _DLiteJStoreIter DLiteJStoreIter;
 
@@ -228,6 +294,19 @@ int dlite_jstore_add(JStore *js, const DLiteInstance *inst,
  */
 int dlite_jstore_remove(JStore *js, const char *id);
 
+/**
+  Returns a new instance scanned from the value stored under `key` in
+  json store `js`.  `id` is the id of the instance and may be NULL.
+
+  The tokens parsed when the value was added with dlite_jstore_loads()
+  are reused, such that the value doesn't need to be parsed again.
+  Values indexed with dlite_jstore_loadf_lazy() are parsed in place,
+  without being copied.
+
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_jstore_scan(JStore *js, const char *key, const char *id);
+
 /**
   Initiate iterator `init` from json store `js`.
   If `metaid` is provided, the iterator will only iterate over instances
@@ -0,0 +1,231 @@
+/* dlite-lossy.c -- error-bounded lossy compression of float properties
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "dlite-lossy.h"
+
+
+/* Tolerances of a property */
+typedef struct {
+  char *name;      /* property name, "*" for all others */
+  double abs_tol;  /* absolute tolerance, zero if none */
+  double rel_tol;  /* relative tolerance, zero if none */
+} LossyEntry;
+
+struct _DLiteLossy {
+  LossyEntry *entries;
+  size_t nentries;
+};
+
+
+/* Returns the entry for `name` in `lossy`, adding it if needed.
+   `len` is the length of `name`.  Returns NULL on error. */
+static LossyEntry *get_entry(DLiteLossy *lossy, const char *name, size_t len)
+{
+  LossyEntry *e;
+  size_t i;
+  for (i=0; i < lossy->nentries; i++)
+    if (strlen(lossy->entries[i].name) == len &&
+        strncmp(lossy->entries[i].name, name, len) == 0)
+      return lossy->entries + i;
+  if (!(e = realloc(lossy->entries,
+                    (lossy->nentries + 1)*sizeof(LossyEntry))))
+    return err(1, "allocation failure"), NULL;
+  lossy->entries = e;
+  e += lossy->nentries;
+  memset(e, 0, sizeof(LossyEntry));
+  if (!(e->name = strndup(name, len)))
+    return err(1, "allocation failure"), NULL;
+  lossy->nentries++;
+  return e;
+}
+
+/* Parses tolerance specification `spec` into `lossy`.  If `relative`
+   is non-zero, the tolerances are relative.  Returns non-zero on
+   error. */
+static int parse_spec(DLiteLossy *lossy, const char *spec, int relative)
+{
+  const char *optname = (relative) ? "rel_tol" : "abs_tol";
+  const char *p = spec;
+  while (p && *p) {
+    const char *end = p + strcspn(p, ",");
+    const char *colon = memchr(p, ':', end - p);
+    const char *name = "*", *q = p;
+    size_t len = 1;
+    char *endptr;
+    double tol;
+    LossyEntry *e;
+    if (colon) {
+      name = p;
+      len = colon - p;
+      q = colon + 1;
+      if (len == 0)
+        return errx(1, "missing property name in `%s=%s`", optname, spec);
+    }
+    tol = strtod(q, &endptr);
+    if (endptr == q || endptr != end)
+      return errx(1, "invalid tolerance in `%s=%s`", optname, spec);
+    if (!(tol > 0 && tol <= DBL_MAX))
+      return errx(1, "tolerances must be positive in `%s=%s`", optname, spec);
+    if (!(e = get_entry(lossy, name, len))) return 1;
+    if (relative)
+      e->rel_tol = tol;
+    else
+      e->abs_tol = tol;
+    p = (*end) ? end + 1 : end;
+  }
+  return 0;
+}
+
+
+/*
+  Returns a new set of tolerances parsed from the specifications
+  `abs_tol` and `rel_tol`.
+ */
+DLiteLossy *dlite_lossy_create(const char *abs_tol, const char *rel_tol)
+{
+  DLiteLossy *lossy;
+  if (!(lossy = calloc(1, sizeof(DLiteLossy))))
+    return err(1, "allocation failure"), NULL;
+  if (parse_spec(lossy, abs_tol, 0) || parse_spec(lossy, rel_tol, 1)) {
+    dlite_lossy_free(lossy);
+    return NULL;
+  }
+  return lossy;
+}
+
+/*
+  Frees tolerances created with dlite_lossy_create().
+ */
+void dlite_lossy_free(DLiteLossy *lossy)
+{
+  size_t i;
+  if (!lossy) return;
+  for (i=0; i < lossy->nentries; i++) free(lossy->entries[i].name);
+  if (lossy->entries) free(lossy->entries);
+  free(lossy);
+}
+
+/*
+  Assigns `*abs_tol` and `*rel_tol` to the tolerances of property `name`.
+ */
+int dlite_lossy_get(const DLiteLossy *lossy, const char *name,
+                    double *abs_tol, double *rel_tol)
+{
+  const LossyEntry *e=NULL;
+  size_t i;
+  *abs_tol = *rel_tol = 0.0;
+  if (!lossy) return 0;
+  for (i=0; i < lossy->nentries; i++) {
+    if (strcmp(lossy->entries[i].name, name) == 0) {
+      e = lossy->entries + i;
+      break;
+    }
+    if (strcmp(lossy->entries[i].name, "*") == 0) e = lossy->entries + i;
+  }
+  if (!e) return 0;
+  *abs_tol = e->abs_tol;
+  *rel_tol = e->rel_tol;
+  return (e->abs_tol > 0 || e->rel_tol > 0);
+}
+
+
+/* Returns floor(log2(x)) for positive, finite `x`.  Implemented with
+   bit operations to avoid linking to libm. */
+static int ilog2(double x)
+{
+  uint64_t bits;
+  int e;
+  memcpy(&bits, &x, sizeof(bits));
+  e = (int)((bits >> 52) & 0x7ff);
+  if (e) return e - 1023;
+  for (e=-1023; bits < ((uint64_t)1 << 51); bits <<= 1) e--;
+  return e;
+}
+
+
+/*
+  A float with exponent `E` (unbiased) and `m` mantissa bits has a
+  unit in the last place of 2^(E-m).  Rounding away the `d` lowest
+  mantissa bits gives an error of at most 2^(E-m+d-1).  Hence:
+
+    - the absolute tolerance 2^L <= abs_tol allows d = L - E + m + 1
+    - keeping k = -L - 1 mantissa bits, where 2^L <= rel_tol, gives
+      a relative error of at most 2^(-k-1) <= rel_tol, i.e. d = m - k
+
+  With both tolerances, the larger number of bits is dropped.
+ */
+#define QUANTIZE(uint_t, mbits, expmax, data, n, abs_tol, tolbits, L, k) \
+  do {                                                                  \
+    const uint_t one = 1;                                               \
+    const uint_t sign = one << (8*sizeof(uint_t) - 1);                  \
+    size_t i;                                                           \
+    for (i=0; i<n; i++) {                                               \
+      uint_t bits, q;                                                   \
+      int e, d=0;                                                       \
+      memcpy(&bits, (char *)data + i*sizeof(uint_t), sizeof(uint_t));   \
+      e = (int)((bits >> mbits) & expmax);                              \
+      if (e == expmax) continue;  /* inf or nan */                      \
+      if (abs_tol > 0 && (bits & ~sign) <= tolbits) {                   \
+        bits &= sign;                                                   \
+        memcpy((char *)data + i*sizeof(uint_t), &bits, sizeof(uint_t)); \
+        continue;                                                       \
+      }                                                                 \
+      if (e == 0) continue;  /* denormal */                             \
+      e -= expmax / 2;                                                  \
+      if (abs_tol > 0) d = L - e + mbits + 1;                           \
+      if (k >= 0 && mbits - k > d) d = mbits - k;                       \
+      if (d > mbits) d = mbits;                                         \
+      if (d <= 0) continue;                                             \
+      q = (bits + (one << (d - 1))) & ~((one << d) - 1);                \
+      if (((q >> mbits) & expmax) == expmax) continue;  /* overflow */  \
+      memcpy((char *)data + i*sizeof(uint_t), &q, sizeof(uint_t));      \
+    }                                                                   \
+  } while (0)
+
+/*
+  Rounds the `n` floats of `size` bytes pointed to by `data` in place.
+ */
+int dlite_quantize(void *data, size_t size, size_t n,
+                   double abs_tol, double rel_tol)
+{
+  int L=0, k=-1;
+  if (!(abs_tol >= 0 && abs_tol <= DBL_MAX && rel_tol >= 0 &&
+        rel_tol <= DBL_MAX))
+    return errx(1, "tolerances must be positive and finite");
+  if (abs_tol > 0) L = ilog2(abs_tol);
+  if (rel_tol > 0) {
+    k = -ilog2(rel_tol) - 1;
+    if (k < 0) k = 0;
+  }
+  switch (size) {
+  case 4:
+    {
+      float ftol = (float)abs_tol;
+      uint32_t tolbits;
+      memcpy(&tolbits, &ftol, sizeof(tolbits));
+      if (ftol > abs_tol) tolbits--;  /* round down */
+      QUANTIZE(uint32_t, 23, 0xff, data, n, abs_tol, tolbits, L, k);
+    }
+    break;
+  case 8:
+    {
+      uint64_t tolbits;
+      memcpy(&tolbits, &abs_tol, sizeof(tolbits));
+      QUANTIZE(uint64_t, 52, 0x7ff, data, n, abs_tol, tolbits, L, k);
+    }
+    break;
+  default:
+    return errx(1, "lossy compression requires float32 or float64, got "
+                "%d-byte floats", (int)size);
+  }
+  return 0;
+}
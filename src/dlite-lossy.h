@@ -0,0 +1,79 @@
+#ifndef _DLITE_LOSSY_H
+#define _DLITE_LOSSY_H
+
+/**
+  @file
+  @brief Error-bounded lossy compression of float properties
+
+  Simulation fields are often stored as float64, although they are
+  only meaningful to a few significant digits.  This module rounds
+  away the mantissa bits of floating point values that are below a
+  given error bound.  The rounded values are still ordinary floats
+  that any reader can use, but their low mantissa bits are zero, so
+  that they compress well with a generic compressor (like the
+  `compress=gzip` option of file storages or the compression filters
+  of hdf5).
+
+  Two kinds of bounds are supported:
+
+    - absolute tolerance `abs_tol`: the error of each value is at most
+      `abs_tol`.  Values with magnitude not larger than `abs_tol` are
+      set to zero.
+    - relative tolerance `rel_tol`: the error of each value `x` is at
+      most `rel_tol*|x|`.
+
+  If both are given, the error of each value is at most
+  `max(abs_tol, rel_tol*|x|)`.  That is, the relative tolerance
+  applies to large values and the absolute tolerance to values close
+  to zero.  Infinities, NaNs and denormals are left unchanged.
+
+  Storages supporting lossy compression take the tolerances as the
+  options `abs_tol` and `rel_tol`.  Their value is either a single
+  tolerance applied to all float properties, like `abs_tol=1e-6`, or a
+  comma-separated list of `name:tolerance` pairs applying to the named
+  properties, like `rel_tol=temperature:1e-6,pressure:1e-4`.  The name
+  `*` matches all properties not listed.
+ */
+
+#include <stddef.h>
+
+
+/** Tolerances of lossy compression, see dlite_lossy_create(). */
+typedef struct _DLiteLossy DLiteLossy;
+
+
+/**
+  Returns a new set of tolerances parsed from the specifications
+  `abs_tol` and `rel_tol`.  Either may be NULL or empty.  See the
+  file documentation for the format.  Tolerances must be positive.
+
+  Returns NULL on error.
+ */
+DLiteLossy *dlite_lossy_create(const char *abs_tol, const char *rel_tol);
+
+/**
+  Frees tolerances created with dlite_lossy_create().
+ */
+void dlite_lossy_free(DLiteLossy *lossy);
+
+/**
+  Assigns `*abs_tol` and `*rel_tol` to the tolerances of property
+  `name`.  Tolerances that do not apply are set to zero.
+
+  Returns non-zero if any tolerance applies to `name`.
+ */
+int dlite_lossy_get(const DLiteLossy *lossy, const char *name,
+                    double *abs_tol, double *rel_tol);
+
+/**
+  Rounds the `n` floats of `size` bytes pointed to by `data` in place,
+  keeping their errors within `abs_tol` and `rel_tol`.  A tolerance of
+  zero means no such bound.  If both are zero, nothing is changed.
+
+  Only float32 and float64 (`size` 4 or 8) are supported.  Returns
+  non-zero on error.
+ */
+int dlite_quantize(void *data, size_t size, size_t n,
+                   double abs_tol, double rel_tol);
+
+#endif /* _DLITE_LOSSY_H */
@@ -21,6 +21,13 @@
 /** Expands to number of elements of array `arr` */
 #define countof(arr) (sizeof(arr) / sizeof(arr[0]))
 
+/** Rounds `n` up to nearest multiple of `align`, which must be a power
+    of two */
+#define align_up(n, align) (((n) + (align) - 1) & ~((size_t)(align) - 1))
+
+/** Writes a registry key for pointer `ptr` to the char array `key` */
+#define PTR_KEY(key, ptr) snprintf(key, sizeof(key), "%p", (void *)(ptr))
+
 
 /** Convenient macros for failing */
 #define FAIL(msg) do { \
@@ -12,6 +12,8 @@
 #include "utils/compat.h"
 #include "utils/fileutils.h"
 #include "utils/plugin.h"
+#include "utils/map.h"
+#include "utils/thread.h"
 
 #include "dlite-datamodel.h"
 #include "dlite-mapping-plugins.h"
@@ -23,19 +25,63 @@
 #define GLOBALS_ID "dlite-mapping-plugins-id"
 
 
+/* Entry in the index of mapping plugins by output uri */
+typedef struct {
+  const DLiteMappingPlugin **apis;  /* plugins with this output uri */
+  size_t napis;                     /* number of plugins in `apis` */
+  map_int_t sources;  /* uris this uri may be mapped from, directly or
+                         via other mappings (unused map value) */
+  int grounded;       /* whether this uri can be mapped to without any
+                         inputs */
+} IndexEntry;
+
+typedef map_t(IndexEntry) Index;
+
 typedef struct {
   /* Global reference to mapping plugin info */
   PluginInfo *mapping_plugin_info;
 
   /* Sha256 hash of plugin paths */
   unsigned char mapping_plugin_path_hash[32];
+
+  /* Incremented whenever the set of mapping plugins changes */
+  int generation;
+
+  /* Number of registered plugins and loaded Python mappings when
+     `generation` was last updated */
+  unsigned int napis;
+  void *python_mappings;
+
+  /* Index of the plugins by output uri and the generation it is
+     built for */
+  Index index;
+  int index_generation;
 } Globals;
 
+/* Protects building of the plugin index */
+static ThreadMutex _mapping_index_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Frees all entries in `index`. */
+static void index_clear(Index *index)
+{
+  map_iter_t iter = map_iter(index);
+  const char *key;
+  while ((key = map_next(index, &iter))) {
+    IndexEntry *e = map_get(index, key);
+    if (e->apis) free(e->apis);
+    map_deinit(&e->sources);
+  }
+  map_deinit(index);
+  map_init(index);
+}
+
 
 /* Free global state for this module */
 static void free_globals(void *globals)
 {
   Globals *g = globals;
+  index_clear(&g->index);
   if (g->mapping_plugin_info) {
     plugin_info_free(g->mapping_plugin_info);
   }
@@ -46,7 +92,10 @@ static void free_globals(void *globals)
 static Globals *get_globals(void) {
   Globals *g = dlite_globals_get_state(GLOBALS_ID);
   if (!g) {
+    const char *manifest;
     if (!(g = calloc(1, sizeof(Globals)))) FAIL("allocation failure");
+    map_init(&g->index);
+    g->index_generation = -1;
 
     g->mapping_plugin_info = plugin_info_create("mapping-plugin",
                                                 "get_dlite_mapping_api",
@@ -62,6 +111,10 @@ static Globals *get_globals(void) {
       plugin_path_extend_prefix(g->mapping_plugin_info, dlite_root_get(),
                                 DLITE_ROOT "/" DLITE_MAPPING_PLUGIN_DIRS, NULL);
 
+    /* Cache the apis exposed by the plugins, if requested */
+    if ((manifest = getenv("DLITE_MAPPING_PLUGIN_MANIFEST")) && *manifest)
+      plugin_set_manifest(g->mapping_plugin_info, manifest);
+
     /* Make sure that dlite DLLs are added to the library search path */
     dlite_add_dll_path();
 
@@ -89,13 +142,18 @@ static void load_mapping_plugins(void)
   const unsigned char *hash;
   sha3_context c;
   Globals *g;
-
 #ifdef WITH_PYTHON
-  dlite_python_mapping_load();
+  void *python_mappings = dlite_python_mapping_load();
 #endif
 
   // FIXME - use pathshash() instead
   if (!(g = get_globals())) return;
+#ifdef WITH_PYTHON
+  if (python_mappings != g->python_mappings) {
+    g->python_mappings = python_mappings;
+    g->generation++;
+  }
+#endif
   if (!(info = g->mapping_plugin_info)) return;
   if (!(iter = fu_pathsiter_init(&info->paths, NULL))) return;
   sha3_Init256(&c);
@@ -109,6 +167,10 @@ static void load_mapping_plugins(void)
     plugin_load_all(info);
     memcpy(g->mapping_plugin_path_hash, hash, 32);
   }
+  if (info->apis.base.nnodes != g->napis) {
+    g->napis = info->apis.base.nnodes;
+    g->generation++;
+  }
 }
 
 
@@ -153,9 +215,13 @@ const DLiteMappingPlugin *dlite_mapping_plugin_get(const char *name)
   if ((paths = dlite_mapping_plugin_paths()))
     for (i=0; paths[i]; i++)
       m += asnpprintf(&buf, &size, m, "    %s\n", paths[i]);
+#ifdef WITH_PYTHON
   if ((paths = dlite_python_mapping_paths_get()))
     for (j=0; paths[j]; j++)
       m += asnpprintf(&buf, &size, m, "    %s\n", paths[j]);
+#else
+  j = 0;
+#endif
   if (i <= 1 || j <= 1)
     m += asnpprintf(&buf, &size, m,
                     "Are the DLITE_MAPPING_PLUGIN_DIRS and "
@@ -167,6 +233,23 @@ const DLiteMappingPlugin *dlite_mapping_plugin_get(const char *name)
 }
 
 
+/*
+  Registers mapping plugin `api` created at runtime.  On success, the
+  ownership of `api` is transferred to dlite and it is released with
+  `api->freeapi` when unloaded.
+
+  Returns non-zero on error.
+ */
+int dlite_mapping_plugin_register_api(DLiteMappingPlugin *api)
+{
+  PluginInfo *info;
+  if (!(info = get_mapping_plugin_info())) return 1;
+  if (plugin_register_api(info, (PluginAPI *)api)) return 1;
+  get_globals()->generation++;
+  return 0;
+}
+
+
 /*
   Initiates a mapping plugin iterator.  Returns non-zero on error.
 */
@@ -194,15 +277,168 @@ dlite_mapping_plugin_next(DLiteMappingPluginIter *iter)
   const DLiteMappingPlugin *api;
   if ((api = (const DLiteMappingPlugin *)plugin_api_iter_next(&iter->iter)))
     return api;
+#ifdef WITH_PYTHON
   if (!iter->stop) {
     int n = iter->n;
     api = dlite_python_mapping_next(dlite_globals_get(), &iter->n);
     if (iter->n == n) iter->stop = 1;
   }
+#endif
   return api;
 }
 
 
+/*
+  Returns a number that changes whenever mapping plugins are loaded or
+  unloaded.  New plugins in the search paths are loaded first.
+
+  This can be used to invalidate data that depends on the available
+  mapping plugins, like cached mapping plans.
+ */
+int dlite_mapping_plugin_generation(void)
+{
+  Globals *g;
+  load_mapping_plugins();
+  if (!(g = get_globals())) return -1;
+  return g->generation;
+}
+
+
+/* Adds the uris that `uri` may be mapped from to `sources`.  Returns
+   non-zero on error. */
+static int index_sources(Index *index, const char *uri, map_int_t *sources)
+{
+  IndexEntry *e = map_get(index, uri);
+  size_t i;
+  int j;
+  if (!e) return 0;
+  for (i=0; i < e->napis; i++) {
+    const DLiteMappingPlugin *api = e->apis[i];
+    for (j=0; j < api->ninput; j++) {
+      const char *input = api->input_uris[j];
+      if (map_get(sources, input)) continue;
+      if (map_set(sources, input, 1)) return err(1, "allocation failure");
+      if (index_sources(index, input, sources)) return 1;
+    }
+  }
+  return 0;
+}
+
+/* Rebuilds the index of mapping plugins by output uri together with
+   the sources each output uri may be mapped from.  Returns non-zero
+   on error. */
+static int index_build(Globals *g)
+{
+  DLiteMappingPluginIter iter;
+  const DLiteMappingPlugin *api;
+  map_iter_t it;
+  const char *key;
+  int changed=1;
+
+  index_clear(&g->index);
+  if (dlite_mapping_plugin_init_iter(&iter)) return 1;
+  while ((api = dlite_mapping_plugin_next(&iter))) {
+    IndexEntry *e, entry;
+    const DLiteMappingPlugin **apis;
+    if (!(e = map_get(&g->index, api->output_uri))) {
+      memset(&entry, 0, sizeof(entry));
+      map_init(&entry.sources);
+      if (map_set(&g->index, api->output_uri, entry))
+        return err(1, "allocation failure");
+      e = map_get(&g->index, api->output_uri);
+    }
+    if (!(apis = realloc(e->apis, (e->napis + 1)*sizeof(*apis))))
+      return err(1, "allocation failure");
+    e->apis = apis;
+    e->apis[e->napis++] = api;
+  }
+
+  it = map_iter(&g->index);
+  while ((key = map_next(&g->index, &it)))
+    if (index_sources(&g->index, key, &map_get(&g->index, key)->sources))
+      return 1;
+
+  /* uris with a plugin whos inputs all are grounded are grounded */
+  while (changed) {
+    changed = 0;
+    it = map_iter(&g->index);
+    while ((key = map_next(&g->index, &it))) {
+      IndexEntry *e = map_get(&g->index, key);
+      size_t i;
+      if (e->grounded) continue;
+      for (i=0; i < e->napis && !e->grounded; i++) {
+        int j;
+        for (j=0; j < e->apis[i]->ninput; j++) {
+          IndexEntry *in = map_get(&g->index, e->apis[i]->input_uris[j]);
+          if (!in || !in->grounded) break;
+        }
+        if (j == e->apis[i]->ninput) e->grounded = changed = 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* Returns the index entry for `output_uri`, rebuilding the index if
+   the mapping plugins have changed.  Returns NULL if no plugin maps to
+   `output_uri` or on error. */
+static IndexEntry *index_get(const char *output_uri)
+{
+  Globals *g;
+  IndexEntry *e=NULL;
+  int generation;
+  if ((generation = dlite_mapping_plugin_generation()) < 0) return NULL;
+  if (!(g = get_globals())) return NULL;
+  thread_mutex_lock(&_mapping_index_mutex);
+  if (g->index_generation != generation) {
+    if (index_build(g)) {
+      index_clear(&g->index);
+      g->index_generation = -1;
+      thread_mutex_unlock(&_mapping_index_mutex);
+      return NULL;
+    }
+    g->index_generation = generation;
+  }
+  e = map_get(&g->index, output_uri);
+  thread_mutex_unlock(&_mapping_index_mutex);
+  return e;
+}
+
+/*
+  Returns the mapping plugins with output uri `output_uri` and writes
+  their number to `n`.  Returns NULL if no plugin maps to `output_uri`.
+
+  The plugins are looked up in an index that is rebuilt when mapping
+  plugins are loaded or unloaded.  The returned array is owned by the
+  index and is valid until then.
+ */
+const DLiteMappingPlugin **dlite_mapping_plugin_by_output(const char *output_uri,
+                                                          size_t *n)
+{
+  IndexEntry *e = index_get(output_uri);
+  *n = (e) ? e->napis : 0;
+  return (e) ? e->apis : NULL;
+}
+
+/*
+  Returns non-zero if the mapping plugins may map an instance of
+  `input_uri` to `output_uri`, directly or via other mappings, possibly
+  together with other inputs.  If `input_uri` is NULL, non-zero is
+  returned if `output_uri` can be mapped to without any inputs.
+
+  A zero return value means that no chain of plugins leads from
+  `input_uri` to `output_uri`.
+ */
+int dlite_mapping_plugin_reachable(const char *output_uri,
+                                   const char *input_uri)
+{
+  IndexEntry *e = index_get(output_uri);
+  if (!e) return 0;
+  if (!input_uri) return e->grounded;
+  return map_get(&e->sources, input_uri) != NULL;
+}
+
+
 /*
   Unloads and unregisters mapping plugin with the given name.
 
@@ -215,6 +451,7 @@ int dlite_mapping_plugin_unload(const char *name)
   int stat;
   PluginInfo *info;
   if (!(info = get_mapping_plugin_info())) return 1;
+  get_globals()->generation++;
   if (name)
     stat = plugin_unload(info, name);
   else
@@ -230,6 +467,7 @@ int dlite_mapping_plugin_unload_all(void)
   PluginInfo *info;
   char **p, **names;
   if (!(info = get_mapping_plugin_info())) return 1;
+  get_globals()->generation++;
   if (!(names = plugin_names(info))) return 1;
   for (p=names; *p; p++) {
     plugin_unload(info, *p);
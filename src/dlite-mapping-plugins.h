@@ -79,6 +79,17 @@ typedef const DLiteMappingPlugin *(*GetDLiteMappingAPI)(int *iter);
  */
 const DLiteMappingPlugin *dlite_mapping_plugin_get(const char *name);
 
+/**
+  Registers mapping plugin `api` created at runtime, e.g. by
+  dlite_iri_mapping_register().  On success, the ownership of `api` is
+  transferred to dlite and it is released with `api->freeapi` when
+  unloaded.
+
+  Returns non-zero on error, e.g. if a plugin with the same name is
+  already registered.
+*/
+int dlite_mapping_plugin_register_api(DLiteMappingPlugin *api);
+
 /**
   Initiates a mapping plugin iterator.  Returns non-zero on error.
 */
@@ -95,6 +106,39 @@ const DLiteMappingPlugin *
 dlite_mapping_plugin_next(DLiteMappingPluginIter *iter);
 
 
+/**
+  Returns a number that changes whenever mapping plugins are loaded or
+  unloaded.  New plugins in the search paths are loaded first.
+
+  This can be used to invalidate data that depends on the available
+  mapping plugins, like cached mapping plans.
+ */
+int dlite_mapping_plugin_generation(void);
+
+/**
+  Returns the mapping plugins with output uri `output_uri` and writes
+  their number to `n`.  Returns NULL if no plugin maps to `output_uri`.
+
+  The plugins are looked up in an index that is rebuilt when mapping
+  plugins are loaded or unloaded.  The returned array is owned by the
+  index and is valid until then.
+ */
+const DLiteMappingPlugin **dlite_mapping_plugin_by_output(const char *output_uri,
+                                                          size_t *n);
+
+/**
+  Returns non-zero if the mapping plugins may map an instance of
+  `input_uri` to `output_uri`, directly or via other mappings, possibly
+  together with other inputs.  If `input_uri` is NULL, non-zero is
+  returned if `output_uri` can be mapped to without any inputs.
+
+  A zero return value means that no chain of plugins leads from
+  `input_uri` to `output_uri`.  The reachability graph is part of the
+  index used by dlite_mapping_plugin_by_output().
+ */
+int dlite_mapping_plugin_reachable(const char *output_uri,
+                                   const char *input_uri);
+
 /**
   Unloads and unregisters mapping plugin with the given name.
 
@@ -183,6 +227,26 @@ int dlite_mapping_plugin_path_delete(int n);
 typedef DLiteInstance *(*Mapper)(const DLiteMappingPlugin *api,
                                  const DLiteInstance **instances, int n);
 
+/**
+  Maps `n` sets of input instances at once.  `instances` is an array
+  of `n*api->ninput` instance pointers, where `instances[i*api->ninput + j]`
+  is input `j` of set `i`.  The `n` new instances are written to `out`.
+
+  Returns non-zero on error, in which case no new references are
+  left in `out`.
+ */
+typedef int (*MapperMany)(const DLiteMappingPlugin *api,
+                          const DLiteInstance **instances, size_t n,
+                          DLiteInstance **out);
+
+/**
+  Flags for mapping plugins.
+ */
+typedef enum _DLiteMappingFlag {
+  dliteMappingThreadSafe=1   /*!< The mapper may be called concurrently
+                                  from several threads */
+} DLiteMappingFlag;
+
 /**
   Releases internal resources associated with `api`.
  */
@@ -201,6 +265,15 @@ typedef void (*Freer)(DLiteMappingPlugin *api);
   Mappings with low costs are preferred in front of mappings with high
   costs.  The default cost for a mapping is 20, while the cost for the
   trivial mapping to an existing input is zero.
+
+  Plugins whose mapper may be called concurrently from several threads
+  should set the `dliteMappingThreadSafe` flag.  Independent inputs of
+  a mapping are then evaluated in parallel.
+
+  Plugins may optionally provide `mapper_many`, which maps many sets
+  of inputs in one call.  It is used by dlite_mapping_map_many() and
+  avoids per-instance overhead, like the conversion of each instance
+  to a Python object.
 */
 struct _DLiteMappingPlugin {
   PluginAPI_HEAD
@@ -210,6 +283,8 @@ struct _DLiteMappingPlugin {
   Mapper         mapper;     /*!< Pointer to mapping function */
   int            cost;       /*!< Cost of this mapping. Default: 20 */
   void *         data;       /*!< Internal data used by the mapper */
+  int            flags;      /*!< Bitwise or of DLiteMappingFlag */
+  MapperMany     mapper_many; /*!< Optional batch mapper, may be NULL */
 };
 
 
@@ -1,18 +1,26 @@
 #include "config.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "utils/err.h"
 #include "utils/map.h"
 #include "utils/tgen.h"
 #include "utils/plugin.h"
+#include "utils/thread.h"
+#include "utils/scheduler.h"
+#include "utils/scratch.h"
+#include "utils/trace.h"
 
 #include "dlite-macros.h"
 #include "dlite-store.h"
 #include "dlite-entity.h"
 #include "dlite-mapping-plugins.h"
 #include "dlite-mapping.h"
+#include "dlite-stats.h"
 
 
 /*
@@ -20,6 +28,237 @@
  */
 typedef map_t(DLiteInstance *) Instances;
 typedef map_t(DLiteMapping *) Mappings;
+typedef map_t(DLiteInstance **) Columns;
+typedef map_t(DLiteMappingStats) Stats;
+
+
+#define GLOBALS_ID "dlite-mapping-id"
+
+/* Header of files with mapping statistics */
+#define STATS_HEADER "# dlite mapping stats 1"
+
+/* Global variables for this module */
+typedef struct {
+  Mappings plans;   /* Cache of mapping plans, see mapping_get_plan() */
+  int generation;   /* Mapping plugin generation the cached plans are
+                       created with */
+  int costgen;      /* Incremented when the mapping costs change */
+  int plans_costgen;  /* Value of `costgen` the cached plans are
+                         created with */
+  Stats stats;      /* Measured statistics, keyed by plugin name */
+  int stats_enabled;  /* Whether mapping statistics are recorded */
+  DLiteMappingCostMode cost_mode;  /* How mapping costs are obtained */
+} Globals;
+
+/* Protects the mapping plan cache */
+static ThreadMutex _mapping_plans_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Protects the mapping statistics */
+static ThreadMutex _mapping_stats_mutex = THREAD_MUTEX_INITIALIZER;
+
+static int read_stats(Globals *g, const char *filename);
+static int write_stats(Globals *g, const char *filename);
+
+/* Returns the name of the statistics file or NULL if the statistics
+   are not persistent. */
+static const char *stats_filename(void)
+{
+  const char *filename = getenv("DLITE_MAPPING_STATS");
+  return (filename && *filename) ? filename : NULL;
+}
+
+
+/* Frees all cached mapping plans. */
+static void free_plans(Mappings *plans)
+{
+  map_iter_t iter = map_iter(plans);
+  const char *key;
+  while ((key = map_next(plans, &iter)))
+    dlite_mapping_free(*map_get(plans, key));
+  map_deinit(plans);
+  map_init(plans);
+}
+
+/* Free global state for this module */
+static void free_globals(void *globals)
+{
+  Globals *g = globals;
+  const char *filename = stats_filename();
+  if (filename && g->stats_enabled) write_stats(g, filename);
+  free_plans(&g->plans);
+  map_deinit(&g->stats);
+  free(g);
+}
+
+/* Return a pointer to global state for this module */
+static Globals *get_globals(void)
+{
+  Globals *g = dlite_globals_get_state(GLOBALS_ID);
+  if (!g) {
+    if (!(g = calloc(1, sizeof(Globals))))
+      return err(1, "allocation failure"), NULL;
+    const char *filename = stats_filename(), *mode = getenv("DLITE_MAPPING_COST");
+    map_init(&g->plans);
+    map_init(&g->stats);
+    g->generation = -1;
+    if (filename) {
+      g->stats_enabled = 1;
+      if (read_stats(g, filename) > 0)
+        warnx("cannot read mapping statistics: %s", filename);
+    }
+    if (mode && strcmp(mode, "measured") == 0)
+      g->cost_mode = dliteMappingCostMeasured;
+    else if (mode && *mode && strcmp(mode, "static") != 0)
+      warnx("invalid value of DLITE_MAPPING_COST: '%s'", mode);
+    dlite_globals_add_state(GLOBALS_ID, g, free_globals);
+  }
+  return g;
+}
+
+
+/* Returns wall clock time in seconds. */
+static double walltime(void)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Returns non-zero if mapping statistics should be recorded. */
+static int stats_enabled(void)
+{
+  Globals *g = get_globals();
+  return (g) ? g->stats_enabled : 0;
+}
+
+/* Adds `n` mapped instances `out` created by `api` using wall time
+   `time` to the statistics. */
+static void stats_record(const DLiteMappingPlugin *api, size_t n,
+                         DLiteInstance **out, double time)
+{
+  size_t i, nbytes=0;
+  DLiteMappingStats *st, empty={0, 0.0, 0};
+  Globals *g;
+  if (!api->name || !(g = get_globals())) return;
+  for (i=0; i<n; i++)
+    if (out[i])
+      nbytes += dlite_instance_size(out[i]->meta, DLITE_DIMS(out[i]));
+  thread_mutex_lock(&_mapping_stats_mutex);
+  if (!(st = map_get(&g->stats, api->name)) &&
+      map_set(&g->stats, api->name, empty) == 0)
+    st = map_get(&g->stats, api->name);
+  if (st) {
+    st->ncalls += n;
+    st->time += time;
+    st->nbytes += nbytes;
+  }
+  thread_mutex_unlock(&_mapping_stats_mutex);
+}
+
+/* Returns the cost of mapping plugin `api` according to the current
+   cost mode.  The measured cost is the mean wall time per mapped
+   instance in microseconds.  The declared cost is used for plugins
+   without statistics. */
+static int mapping_cost(const DLiteMappingPlugin *api)
+{
+  Globals *g = get_globals();
+  DLiteMappingStats *st;
+  int cost = api->cost;
+  if (!g || g->cost_mode != dliteMappingCostMeasured || !api->name)
+    return cost;
+  thread_mutex_lock(&_mapping_stats_mutex);
+  if ((st = map_get(&g->stats, api->name)) && st->ncalls > 0) {
+    double us = 1e6 * st->time / st->ncalls;
+    cost = (us < 1.0) ? 1 : (us > 1e9) ? 1000000000 : (int)(us + 0.5);
+  }
+  thread_mutex_unlock(&_mapping_stats_mutex);
+  return cost;
+}
+
+/* Reads statistics from `filename` and adds them to `g`.  Returns
+   non-zero on error, and a positive value if `filename` cannot be
+   opened.  Must be called with `_mapping_stats_mutex` held. */
+static int read_stats(Globals *g, const char *filename)
+{
+  FILE *fp;
+  char line[1024], name[512];
+  int stat=-1;
+  if (!(fp = fopen(filename, "r"))) return 1;
+  if (!fgets(line, sizeof(line), fp) ||
+      strncmp(line, STATS_HEADER, strlen(STATS_HEADER)) != 0) {
+    err(-1, "not a dlite mapping statistics file: %s", filename);
+    goto fail;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    DLiteMappingStats v, *st;
+    unsigned long long ncalls, nbytes;
+    if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') continue;
+    if (sscanf(line, "%511s %llu %lg %llu", name, &ncalls, &v.time,
+               &nbytes) != 4) {
+      err(-1, "invalid line in %s: %s", filename, line);
+      goto fail;
+    }
+    v.ncalls = ncalls;
+    v.nbytes = nbytes;
+    if ((st = map_get(&g->stats, name))) {
+      st->ncalls += v.ncalls;
+      st->time += v.time;
+      st->nbytes += v.nbytes;
+    } else if (map_set(&g->stats, name, v)) {
+      err(-1, "allocation failure");
+      goto fail;
+    }
+  }
+  g->costgen++;
+  stat = 0;
+ fail:
+  fclose(fp);
+  return stat;
+}
+
+/* Writes the statistics in `g` to `filename`.  Must be called with
+   `_mapping_stats_mutex` held.  Returns non-zero on error. */
+static int write_stats(Globals *g, const char *filename)
+{
+  FILE *fp=NULL;
+  char *tmpname=NULL;
+  const char *name;
+  map_iter_t iter;
+  int stat=1;
+  if (!(tmpname = malloc(strlen(filename) + 5))) FAIL("allocation failure");
+  sprintf(tmpname, "%s.tmp", filename);
+  if (!(fp = fopen(tmpname, "w")))
+    FAIL1("cannot write mapping statistics: %s", tmpname);
+  fprintf(fp, "%s\n", STATS_HEADER);
+  iter = map_iter(&g->stats);
+  while ((name = map_next(&g->stats, &iter))) {
+    DLiteMappingStats *st = map_get(&g->stats, name);
+    /* skip names that cannot be represented in the file */
+    if (!*name || name[strcspn(name, " \t\r\n")]) continue;
+    fprintf(fp, "%s %llu %.17g %llu\n", name,
+            (unsigned long long)st->ncalls, st->time,
+            (unsigned long long)st->nbytes);
+  }
+  if (fclose(fp)) {
+    fp = NULL;
+    FAIL1("error writing mapping statistics: %s", tmpname);
+  }
+  fp = NULL;
+#ifdef _WIN32
+  remove(filename);
+#endif
+  if (rename(tmpname, filename))
+    FAIL1("cannot write mapping statistics: %s", filename);
+  stat = 0;
+ fail:
+  if (fp) fclose(fp);
+  if (tmpname) free(tmpname);
+  return stat;
+}
 
 
 /*
@@ -36,6 +275,23 @@ void mapping_remove_rec(DLiteMapping *m, Mappings *created)
       mapping_remove_rec((DLiteMapping *)m->input_maps[i], created);
 }
 
+/*
+  Returns non-zero if `uri` may be realised from the input URIs in
+  `inputs`, according to the reachability graph of the mapping plugins.
+  A zero return value means that no chain of mappings can produce it.
+ */
+static int mapping_realisable(const char *uri, Instances *inputs)
+{
+  map_iter_t iter;
+  const char *input;
+  if (map_get(inputs, uri)) return 1;
+  if (dlite_mapping_plugin_reachable(uri, NULL)) return 1;
+  iter = map_iter(inputs);
+  while ((input = map_next(inputs, &iter)))
+    if (dlite_mapping_plugin_reachable(uri, input)) return 1;
+  return 0;
+}
+
 /*
   Recursive help function returning a mapping.
 
@@ -50,10 +306,11 @@ DLiteMapping *mapping_create_rec(const char *output_uri, Instances *inputs,
 {
   int i, lowest_cost=-1;
   DLiteMapping *m=NULL, *retval=NULL;
-  const DLiteMappingPlugin *api, *cheapest=NULL;
-  DLiteMappingPluginIter iter;
+  const DLiteMappingPlugin *api, *cheapest=NULL, **apis;
+  size_t k, napis;
+  TRACE_BEGIN(span, "mapping_create_rec", output_uri);
 
-  dlite_mapping_plugin_init_iter(&iter);
+  apis = dlite_mapping_plugin_by_output(output_uri, &napis);
 
   /* Ensure that no input URI equals output URI */
   assert(!map_get(inputs, output_uri));
@@ -65,21 +322,26 @@ DLiteMapping *mapping_create_rec(const char *output_uri, Instances *inputs,
   assert(!map_get(visited, output_uri));
   map_set(visited, output_uri, NULL);
 
-  /* Find cheapest mapping to output_api */
-  while ((api = dlite_mapping_plugin_next(&iter))) {
+  /* Find cheapest mapping to output_api among the plugins indexed by
+     output uri */
+  for (k=0; k < napis; k++) {
     int ignore = 0;
-    int cost = api->cost;
-    if (strcmp(output_uri, api->output_uri) != 0) continue;
+    int cost;
+    api = apis[k];
+    assert(strcmp(output_uri, api->output_uri) == 0);
 
-    /* avoid infinite cyclic loops and known dead ends */
+    /* avoid infinite cyclic loops, known dead ends and inputs that no
+       chain of mappings leads to */
     for (i=0; i < api->ninput; i++) {
       if (map_get(visited, api->input_uris[i]) ||
-          map_get(dead_ends, api->input_uris[i])) {
+          map_get(dead_ends, api->input_uris[i]) ||
+          !mapping_realisable(api->input_uris[i], inputs)) {
         ignore = 1;
         break;
       }
     }
     if (ignore) continue;
+    cost = mapping_cost(api);
 
     /* avoid mappings that depends on input that cannot be realised and
        calculate cost */
@@ -135,6 +397,7 @@ DLiteMapping *mapping_create_rec(const char *output_uri, Instances *inputs,
  fail:
   map_remove(visited, output_uri);
   if (!retval) map_set(dead_ends, output_uri, NULL);
+  TRACE_END(span);
   return retval;
 }
 
@@ -193,6 +456,75 @@ DLiteMapping *mapping_create_base(const char *output_uri, Instances *inputs)
 }
 
 
+/* Compare strings pointed to by `a` and `b`, for qsort(). */
+static int strptrcmp(const void *a, const void *b)
+{
+  return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/*
+  Returns a mapping plan for mapping the set of input URIs in `inputs`
+  to `output_uri`, or NULL on error.
+
+  The plans are cached, keyed by `output_uri` and the sorted input URIs,
+  since searching for the cheapest mapping is expensive and instances
+  of the same metadata are typically mapped many times.  The cache is
+  cleared when mapping plugins are loaded or unloaded and when the
+  mapping costs change.  Measured costs recorded after a plan is
+  created do not affect it.
+
+  The returned plan is owned by the cache.  The trivial case, where
+  one of the inputs equals `output_uri`, must be handled by the caller.
+ */
+static const DLiteMapping *mapping_get_plan(const char *output_uri,
+                                            Instances *inputs)
+{
+  Globals *g;
+  DLiteMapping *m=NULL, **mp;
+  TGenBuf key;
+  const char **uris=NULL, *uri;
+  map_iter_t iter;
+  int i, n=0, generation;
+
+  assert(!map_get(inputs, output_uri));
+  if (!(g = get_globals())) return NULL;
+  tgen_buf_init(&key);
+  if (!(uris = malloc((inputs->base.nnodes + 1) * sizeof(char *))))
+    FAIL("allocation failure");
+  iter = map_iter(inputs);
+  while ((uri = map_next(inputs, &iter))) uris[n++] = uri;
+  qsort(uris, n, sizeof(char *), strptrcmp);
+  tgen_buf_append(&key, output_uri, -1);
+  for (i=0; i<n; i++) tgen_buf_append_fmt(&key, "\n%s", uris[i]);
+
+  thread_mutex_lock(&_mapping_plans_mutex);
+  if ((generation = dlite_mapping_plugin_generation()) != g->generation ||
+      g->costgen != g->plans_costgen) {
+    free_plans(&g->plans);
+    g->generation = generation;
+    g->plans_costgen = g->costgen;
+  }
+  if ((mp = map_get(&g->plans, tgen_buf_get(&key)))) {
+    m = *mp;
+    dlite_stats_add(dliteStatsPlanHits, 1);
+  } else {
+    dlite_stats_add(dliteStatsPlanMisses, 1);
+    if ((m = mapping_create_base(output_uri, inputs)) &&
+        map_set(&g->plans, tgen_buf_get(&key), m)) {
+      dlite_mapping_free(m);
+      m = NULL;
+      err(1, "allocation failure");
+    }
+  }
+  thread_mutex_unlock(&_mapping_plans_mutex);
+
+ fail:
+  if (uris) free(uris);
+  tgen_buf_deinit(&key);
+  return m;
+}
+
+
 /*
   Returns a new nested mapping structure describing how `n` input
   instances of metadata `input_uris` can be mapped to `output_uri`.
@@ -225,64 +557,284 @@ DLiteMapping *dlite_mapping_create(const char *output_uri,
 }
 
 
+/* Recursive help function that adds `m` and all its sub-mappings to
+   `nodes`.  A sub-mapping shared by several mappings is only added once.
+
+   The nodes are keyed by address, since the output URIs are owned by
+   the plugins, which may have been unloaded when a cached mapping is
+   freed. */
+static void mapping_collect_rec(const DLiteMapping *m, Mappings *nodes)
+{
+  int i;
+  char key[32];
+  snprintf(key, sizeof(key), "%p", (void *)m);
+  if (map_get(nodes, key)) return;
+  map_set(nodes, key, (DLiteMapping *)m);
+  for (i=0; i < m->ninput; i++)
+    if (m->input_maps[i]) mapping_collect_rec(m->input_maps[i], nodes);
+}
+
 /*
   Frees a nested mapping tree.
+
+  Sub-mappings may be shared within the tree, so all nodes are
+  collected first, such that each of them is freed once.
 */
 void dlite_mapping_free(DLiteMapping *m)
+{
+  int i;
+  Mappings nodes;
+  map_iter_t iter;
+  const char *key;
+
+  map_init(&nodes);
+  mapping_collect_rec(m, &nodes);
+  iter = map_iter(&nodes);
+  while ((key = map_next(&nodes, &iter))) {
+    DLiteMapping *node = *map_get(&nodes, key);
+    for (i=0; i < node->ninput; i++) {
+      assert(node->input_maps[i] || node->input_uris[i]);
+      assert(!(node->input_maps[i] && node->input_uris[i]));
+    }
+    free((void *)node->input_maps);
+    free((void *)node->input_uris);
+    free(node);
+  }
+  map_deinit(&nodes);
+}
+
+
+/*
+  A node in the mapping graph to evaluate, see mapping_map_rec().
+ */
+typedef struct {
+  const DLiteMapping *m;  /* The mapping of this node */
+  DLiteInstance *inst;    /* The created instance, NULL if not evaluated */
+  char *errmsg;           /* Error message if evaluation failed */
+} MapNode;
+
+/* Shared state for the tasks evaluating a wave of nodes */
+typedef struct {
+  MapNode **nodes;        /* Nodes in the wave with a thread-safe mapper */
+  int nnodes;             /* Number of nodes */
+  int ntasks;             /* Number of tasks to split the nodes into */
+  Instances *instances;   /* Read-only while the wave is evaluated */
+} MapWave;
+
+/* Recursive help function that appends `m` and its sub-mappings to
+   `nodes` in post-order, skipping mappings whose output is already in
+   `instances`.  Returns non-zero on error. */
+static int mapping_nodes_rec(const DLiteMapping *m, Instances *instances,
+                             Mappings *seen, MapNode **nodes, int *nnodes,
+                             int *size)
+{
+  int i;
+  if (map_get(instances, m->output_uri) || map_get(seen, m->output_uri))
+    return 0;
+  map_set(seen, m->output_uri, (DLiteMapping *)m);
+  for (i=0; i < m->ninput; i++)
+    if (m->input_maps[i] &&
+        mapping_nodes_rec(m->input_maps[i], instances, seen, nodes, nnodes,
+                          size))
+      return 1;
+  if (*nnodes >= *size) {
+    int newsize = (*size) ? 2 * (*size) : 8;
+    MapNode *p = realloc(*nodes, newsize * sizeof(MapNode));
+    if (!p) return err(1, "allocation failure");
+    *nodes = p;
+    *size = newsize;
+  }
+  memset(*nodes + *nnodes, 0, sizeof(MapNode));
+  (*nodes)[(*nnodes)++].m = m;
+  return 0;
+}
+
+/* Returns non-zero if all inputs of `m` are available in `instances`. */
+static int mapping_ready(const DLiteMapping *m, Instances *instances)
 {
   int i;
   for (i=0; i < m->ninput; i++) {
-    assert(m->input_maps[i] || m->input_uris[i]);
-    assert(!(m->input_maps[i] && m->input_uris[i]));
-    if (m->input_maps[i]) dlite_mapping_free((DLiteMapping *)m->input_maps[i]);
+    const char *uri = (m->input_maps[i]) ?
+      m->input_maps[i]->output_uri : m->input_uris[i];
+    if (!map_get(instances, uri)) return 0;
   }
-  free((void *)m->input_maps);
-  free((void *)m->input_uris);
-  free(m);
+  return 1;
 }
 
+/* Evaluates `node` by calling the mapper of its plugin.  On error,
+   `node->errmsg` is assigned.  May be called from any thread as long
+   as `instances` is not modified concurrently. */
+static void mapping_eval(MapNode *node, Instances *instances)
+{
+  int i;
+  const DLiteMapping *m = node->m;
+  const DLiteInstance **insts=NULL;
+
+  err_clear();
+  if (!(insts = scratch_calloc(m->ninput, sizeof(DLiteInstance *)))) {
+    node->errmsg = strdup("allocation failure");
+    return;
+  }
+  for (i=0; i < m->ninput; i++) {
+    const char *uri = (m->input_maps[i]) ?
+      m->input_maps[i]->output_uri : m->input_uris[i];
+    DLiteInstance **instp = map_get(instances, uri);
+    assert(instp);
+    insts[i] = *instp;
+  }
+  if (stats_enabled()) {
+    double t0 = walltime();
+    node->inst = m->api->mapper(m->api, insts, m->ninput);
+    if (node->inst) stats_record(m->api, 1, &node->inst, walltime() - t0);
+  } else {
+    node->inst = m->api->mapper(m->api, insts, m->ninput);
+  }
+  if (!node->inst) {
+    const char *msg = err_getmsg();
+    node->errmsg = strdup((msg && *msg) ? msg : "mapping failed");
+  }
+  err_clear();
+  scratch_free((void *)insts);
+}
+
+/* Task evaluating nodes `begin` to `end` of the wave in `arg`. */
+static void mapping_range(size_t begin, size_t end, void *arg)
+{
+  MapWave *wave = arg;
+  size_t i;
+  for (i=begin; i<end; i++)
+    mapping_eval(wave->nodes[i], wave->instances);
+}
+
+/* Task evaluating all nodes of the wave in `arg` concurrently. */
+static void mapping_wave_task(void *arg)
+{
+  MapWave *wave = arg;
+  sched_parallel_for(wave->nnodes,
+                     (wave->nnodes + wave->ntasks - 1) / wave->ntasks,
+                     mapping_range, wave);
+}
+
+/* Returns the maximum number of tasks used for evaluating mappings. */
+static int mapping_maxthreads(void)
+{
+  char *endptr, *p = getenv("DLITE_MAPPING_THREADS");
+  int n = sched_get_nthreads();
+  if (p && *p) {
+    n = strtol(p, &endptr, 10);
+    if (*endptr || n < 1) {
+      warnx("invalid value of DLITE_MAPPING_THREADS: '%s'", p);
+      n = sched_get_nthreads();
+    }
+  }
+  return n;
+}
+
+/* Evaluates the `n` nodes in `wave`, which all are ready.  Nodes with
+   a thread-safe mapper are evaluated concurrently by the shared task
+   scheduler, while the remaining nodes are evaluated in the calling
+   thread. */
+static void mapping_eval_wave(MapNode **wave, int n, Instances *instances)
+{
+  int i, nsafe=0, maxthreads;
+  MapWave w;
+  SchedGroup *g;
+
+  /* Move nodes with a thread-safe mapper to the front */
+  for (i=0; i<n; i++) {
+    if (wave[i]->m->api->flags & dliteMappingThreadSafe) {
+      MapNode *tmp = wave[nsafe];
+      wave[nsafe++] = wave[i];
+      wave[i] = tmp;
+    }
+  }
+
+  if (n < 2 || nsafe == 0 || (maxthreads = mapping_maxthreads()) < 2) {
+    for (i=0; i<n; i++) mapping_eval(wave[i], instances);
+    return;
+  }
+
+  w.nodes = wave;
+  w.nnodes = nsafe;
+  w.ntasks = (nsafe < maxthreads) ? nsafe : maxthreads;
+  w.instances = instances;
+  if (nsafe == n) {
+    mapping_wave_task(&w);
+  } else if (!(g = sched_group_create())) {
+    for (i=0; i<n; i++) mapping_eval(wave[i], instances);
+  } else {
+    /* The thread-safe nodes are evaluated while the calling thread
+       evaluates the others */
+    sched_spawn(g, mapping_wave_task, &w);
+    for (i=nsafe; i<n; i++) mapping_eval(wave[i], instances);
+    sched_group_free(g);
+  }
+}
 
 /*
-  Recursive help function that performs the actual mapping and returns
-  a new instance (with metadata `m->output_uri`).
+  Help function that performs the actual mapping and returns a new
+  instance (with metadata `m->output_uri`).
 
   `m`: mapping tree that descripes how the instance can be created.
   `instances`: maps metadata URI to an instance with this metadata.  The
        instance should be either an input instance or created by a
-       mapping.
+       mapping.  Created instances are added to it.
+
+  The nodes of the mapping tree are evaluated in waves.  Each wave
+  consists of all nodes whose inputs are available, i.e. independent
+  sub-mappings.  Sub-mappings shared by several nodes are only
+  evaluated once.
  */
 DLiteInstance *mapping_map_rec(const DLiteMapping *m, Instances *instances)
 {
-  int i;
-  const DLiteInstance **insts=NULL;
+  int i, n, ndone=0, nnodes=0, size=0, failed=0;
+  MapNode *nodes=NULL, **wave=NULL;
+  Mappings seen;
   DLiteInstance *inst=NULL, **instp;
 
   /* Trivial case - we already have an instance with metadata `m->output_uri` */
   if ((instp = map_get(instances, m->output_uri)))
     return *instp;
 
-  /* Create `insts` array */
-  if (!(insts = calloc(m->ninput, sizeof(DLiteInstance))))
+  map_init(&seen);
+  if (mapping_nodes_rec(m, instances, &seen, &nodes, &nnodes, &size))
+    goto fail;
+  if (!(wave = calloc(nnodes, sizeof(MapNode *))))
     FAIL("allocation failure");
-  for (i=0; i < m->ninput; i++) {
-    if (m->input_maps[i]) {
-      insts[i] = mapping_map_rec(m->input_maps[i], instances);
-    } else {
-      instp = map_get(instances, m->input_uris[i]);
-      assert(instp);
-      insts[i] = *instp;
+
+  while (ndone < nnodes && !failed) {
+    for (n=0, i=0; i<nnodes; i++)
+      if (!nodes[i].inst && mapping_ready(nodes[i].m, instances))
+        wave[n++] = nodes + i;
+    assert(n > 0);
+    mapping_eval_wave(wave, n, instances);
+
+    /* Add created instances to `instances` */
+    for (i=0; i<n; i++) {
+      MapNode *node = wave[i];
+      if (node->errmsg) {
+        if (!failed) errx(1, "%s", node->errmsg);
+        failed = 1;
+        continue;
+      }
+      assert(node->inst);
+      assert(strcmp(node->inst->meta->uri, node->m->output_uri) == 0);
+      map_set(instances, node->inst->meta->uri, node->inst);
+      ndone++;
     }
   }
-
-  /* Call the mapper function from plugin */
-  if (!(inst = m->api->mapper(m->api, insts, m->ninput))) goto fail;
-
-  /* Add new instance to `instances` */
-  assert(strcmp(inst->meta->uri, m->output_uri) == 0);
-  map_set(instances, inst->meta->uri, inst);
+  if (!failed) {
+    instp = map_get(instances, m->output_uri);
+    assert(instp);
+    inst = *instp;
+  }
 
  fail:
-  if (insts) free((void *)insts);
+  for (i=0; i<nnodes; i++)
+    if (nodes[i].errmsg) free(nodes[i].errmsg);
+  if (nodes) free(nodes);
+  if (wave) free(wave);
+  map_deinit(&seen);
   return inst;
 }
 
@@ -409,6 +961,131 @@ DLiteInstance *dlite_mapping_map(const DLiteMapping *m,
 }
 
 
+/* Applies the mapping of `node` to `n` sets of inputs taken from
+   `columns` and writes the output instances to `out`.  Returns
+   non-zero on error. */
+static int mapping_eval_many(const DLiteMapping *node, Columns *columns,
+                             size_t n, DLiteInstance **out)
+{
+  int j, retval=1, k=node->ninput, record=stats_enabled();
+  size_t i;
+  double t0=0.0;
+  const DLiteInstance **insts=NULL;
+  const DLiteMappingPlugin *api = node->api;
+
+  if (!(insts = calloc(n * k, sizeof(DLiteInstance *))))
+    FAIL("allocation failure");
+  for (j=0; j<k; j++) {
+    const char *uri = (node->input_maps[j]) ?
+      node->input_maps[j]->output_uri : node->input_uris[j];
+    DLiteInstance ***colp = map_get(columns, uri);
+    assert(colp);
+    for (i=0; i<n; i++) insts[i*k + j] = (*colp)[i];
+  }
+
+  if (record) t0 = walltime();
+  if (api->mapper_many) {
+    if (api->mapper_many(api, insts, n, out)) goto fail;
+  } else {
+    for (i=0; i<n; i++) {
+      if (!(out[i] = api->mapper(api, insts + i*k, k))) {
+        while (i > 0) dlite_instance_decref(out[--i]);
+        goto fail;
+      }
+    }
+  }
+  if (record) stats_record(api, n, out, walltime() - t0);
+  for (i=0; i<n; i++)
+    assert(strcmp(out[i]->meta->uri, node->output_uri) == 0);
+  retval = 0;
+ fail:
+  if (insts) free((void *)insts);
+  return retval;
+}
+
+/*
+  Applies the mapping `m` on `n` sets of `ninput` input instances.
+  The instances are stored row-wise in `instances`.  The `n` new
+  instances are written to `out`.  Returns non-zero on error.
+ */
+int dlite_mapping_map_many(const DLiteMapping *m,
+                           const DLiteInstance **instances, int ninput,
+                           size_t n, DLiteInstance **out)
+{
+  int j, inode, nnodes=0, size=0, retval=1;
+  size_t i;
+  MapNode *nodes=NULL;
+  Instances inputs;
+  Mappings seen;
+  Columns columns;
+  DLiteInstance **col, ***colp;
+
+  if (n == 0) return 0;
+  map_init(&inputs);
+  map_init(&seen);
+  map_init(&columns);
+
+  /* Collect input instances column-wise by metadata URI */
+  for (j=0; j<ninput; j++) {
+    const char *uri = instances[j]->meta->uri;
+    if (map_get(&columns, uri))
+      FAIL1("more than one instance of the same metadata: %s", uri);
+    if (!(col = calloc(n, sizeof(DLiteInstance *))))
+      FAIL("allocation failure");
+    map_set(&columns, uri, col);
+    map_set(&inputs, uri, (DLiteInstance *)instances[j]);
+    for (i=0; i<n; i++) {
+      col[i] = (DLiteInstance *)instances[i*ninput + j];
+      if (strcmp(col[i]->meta->uri, uri))
+        FAIL3("input set %zu has an instance of %s where %s is expected",
+              i, col[i]->meta->uri, uri);
+    }
+  }
+
+  /* Apply mappings in order, such that inputs are created before use */
+  if (!map_get(&inputs, m->output_uri)) {
+    if (mapping_nodes_rec(m, &inputs, &seen, &nodes, &nnodes, &size))
+      goto fail;
+    for (inode=0; inode<nnodes; inode++) {
+      const DLiteMapping *node = nodes[inode].m;
+      if (!(col = calloc(n, sizeof(DLiteInstance *))))
+        FAIL("allocation failure");
+      if (mapping_eval_many(node, &columns, n, col)) {
+        free(col);
+        goto fail;
+      }
+      map_set(&columns, node->output_uri, col);
+    }
+  }
+
+  colp = map_get(&columns, m->output_uri);
+  assert(colp);
+  memcpy(out, *colp, n * sizeof(DLiteInstance *));
+  if (map_get(&inputs, m->output_uri))
+    for (i=0; i<n; i++) dlite_instance_incref(out[i]);
+  else
+    map_remove(&columns, m->output_uri);
+  retval = 0;
+
+ fail:
+  {
+    map_iter_t iter = map_iter(&columns);
+    const char *key;
+    while ((key = map_next(&columns, &iter))) {
+      col = *map_get(&columns, key);
+      if (!map_get(&inputs, key))
+        for (i=0; i<n; i++) dlite_instance_decref(col[i]);
+      free(col);
+    }
+  }
+  if (nodes) free(nodes);
+  map_deinit(&columns);
+  map_deinit(&seen);
+  map_deinit(&inputs);
+  return retval;
+}
+
+
 /*
   Returns a new instance of metadata `output_uri` by mapping the `n` input
   instances in the array `instances`.
@@ -421,14 +1098,20 @@ DLiteInstance *dlite_mapping(const char *output_uri,
   int i;
   DLiteInstance *inst=NULL;
   DLiteMapping *m=NULL;
+  const DLiteMapping *plan;
   Instances inputs;
 
   map_init(&inputs);
 
   /* Increases refcount on each input instance */
   if (set_inputs(&inputs, instances, n)) goto fail;
-  if (!(m = mapping_create_base(output_uri, &inputs))) goto fail;
-  inst = dlite_mapping_map(m, instances, n);
+  if (map_get(&inputs, output_uri)) {
+    if (!(m = mapping_create_base(output_uri, &inputs))) goto fail;
+    inst = dlite_mapping_map(m, instances, n);
+  } else {
+    if (!(plan = mapping_get_plan(output_uri, &inputs))) goto fail;
+    inst = dlite_mapping_map(plan, instances, n);
+  }
 
  fail:
   map_deinit(&inputs);
@@ -437,3 +1120,130 @@ DLiteInstance *dlite_mapping(const char *output_uri,
   for (i=0; i<n; i++) dlite_instance_decref((DLiteInstance *)instances[i]);
   return inst;
 }
+
+
+/*
+  Enables or disables recording of mapping statistics.  Returns the
+  previous value.
+ */
+int dlite_mapping_stats_enable(int enable)
+{
+  int prev;
+  Globals *g;
+  if (!(g = get_globals())) return -1;
+  prev = g->stats_enabled;
+  g->stats_enabled = (enable) ? 1 : 0;
+  return prev;
+}
+
+/*
+  Copies the statistics recorded for mapping plugin `name` to `stats`.
+  Returns non-zero if no statistics are recorded for `name`.
+ */
+int dlite_mapping_stats_get(const char *name, DLiteMappingStats *stats)
+{
+  Globals *g;
+  DLiteMappingStats *st;
+  int stat=1;
+  if (!(g = get_globals())) return -1;
+  thread_mutex_lock(&_mapping_stats_mutex);
+  if ((st = map_get(&g->stats, name))) {
+    if (stats) *stats = *st;
+    stat = 0;
+  }
+  thread_mutex_unlock(&_mapping_stats_mutex);
+  return stat;
+}
+
+/*
+  Returns a malloc'ed string with a table of all recorded statistics.
+ */
+char *dlite_mapping_stats_string(void)
+{
+  Globals *g;
+  TGenBuf s;
+  const char *name;
+  map_iter_t iter;
+  char *str=NULL;
+  if (!(g = get_globals())) return NULL;
+  tgen_buf_init(&s);
+  tgen_buf_append_fmt(&s, "%-24s %12s %12s %12s %14s\n", "plugin", "ncalls",
+                      "time [s]", "mean [us]", "nbytes");
+  thread_mutex_lock(&_mapping_stats_mutex);
+  iter = map_iter(&g->stats);
+  while ((name = map_next(&g->stats, &iter))) {
+    DLiteMappingStats *st = map_get(&g->stats, name);
+    tgen_buf_append_fmt(&s, "%-24s %12zu %12.6f %12.2f %14zu\n", name,
+                        st->ncalls, st->time,
+                        (st->ncalls) ? 1e6 * st->time / st->ncalls : 0.0,
+                        st->nbytes);
+  }
+  thread_mutex_unlock(&_mapping_stats_mutex);
+  str = strdup(tgen_buf_get(&s));
+  tgen_buf_deinit(&s);
+  return str;
+}
+
+/*
+  Clears all recorded mapping statistics.
+ */
+void dlite_mapping_stats_clear(void)
+{
+  Globals *g;
+  if (!(g = get_globals())) return;
+  thread_mutex_lock(&_mapping_stats_mutex);
+  map_deinit(&g->stats);
+  map_init(&g->stats);
+  g->costgen++;
+  thread_mutex_unlock(&_mapping_stats_mutex);
+}
+
+/*
+  Writes the recorded mapping statistics to `filename`.
+  Returns non-zero on error.
+ */
+int dlite_mapping_stats_save(const char *filename)
+{
+  Globals *g;
+  int stat;
+  if (!(g = get_globals())) return -1;
+  thread_mutex_lock(&_mapping_stats_mutex);
+  stat = write_stats(g, filename);
+  thread_mutex_unlock(&_mapping_stats_mutex);
+  return stat;
+}
+
+/*
+  Reads mapping statistics from `filename` and adds them to the
+  recorded statistics.  Returns non-zero on error.
+ */
+int dlite_mapping_stats_load(const char *filename)
+{
+  Globals *g;
+  int stat;
+  if (!(g = get_globals())) return -1;
+  thread_mutex_lock(&_mapping_stats_mutex);
+  if ((stat = read_stats(g, filename)) > 0)
+    err(1, "cannot open mapping statistics: %s", filename);
+  thread_mutex_unlock(&_mapping_stats_mutex);
+  return stat;
+}
+
+/*
+  Sets how mapping costs are obtained when searching for the cheapest
+  mapping.  Returns the previous mode.
+ */
+DLiteMappingCostMode dlite_mapping_set_cost_mode(DLiteMappingCostMode mode)
+{
+  DLiteMappingCostMode prev;
+  Globals *g;
+  if (!(g = get_globals())) return dliteMappingCostStatic;
+  thread_mutex_lock(&_mapping_stats_mutex);
+  prev = g->cost_mode;
+  if (mode != prev) {
+    g->cost_mode = mode;
+    g->costgen++;
+  }
+  thread_mutex_unlock(&_mapping_stats_mutex);
+  return prev;
+}
@@ -78,5 +78,98 @@ char *dlite_mapping_string(const DLiteMapping *m);
 DLiteInstance *dlite_mapping_map(const DLiteMapping *m,
                                  const DLiteInstance **instances, int n);
 
+/**
+  Applies the mapping `m` on `n` sets of `ninput` input instances.
+
+  `instances` is an array of `n*ninput` instance pointers, where
+  `instances[i*ninput + j]` is input `j` of set `i`.  All sets must
+  have the same metadata in the same order.  The `n` new instances are
+  written to `out`, which must have space for `n` pointers.
+
+  Each mapping in `m` is applied to all sets before the next mapping
+  is applied.  Mapping plugins that provide a batch mapper are called
+  once per mapping, the others once per set.  The input instances are
+  borrowed, while temporary instances are released.
+
+  Returns non-zero on error.
+ */
+int dlite_mapping_map_many(const DLiteMapping *m,
+                           const DLiteInstance **instances, int ninput,
+                           size_t n, DLiteInstance **out);
+
+
+
+/**
+  @name Mapping statistics
+  The wall time and output size of each mapping plugin invocation can
+  be recorded and used as measured costs when searching for the
+  cheapest mapping.
+
+  If the environment variable `DLITE_MAPPING_STATS` is set to a file
+  name, statistics are recorded, read from this file on first use and
+  written back to it at exit, such that they persist between runs.
+  Setting `DLITE_MAPPING_COST=measured` selects the measured costs.
+  @{
+ */
+
+/** Statistics recorded for a mapping plugin. */
+typedef struct _DLiteMappingStats {
+  size_t ncalls;   /*!< Number of mapped instances */
+  double time;     /*!< Total wall time in seconds */
+  size_t nbytes;   /*!< Total allocated size of output instances */
+} DLiteMappingStats;
+
+/** How mapping costs are obtained. */
+typedef enum _DLiteMappingCostMode {
+  dliteMappingCostStatic,   /*!< Use the cost declared by the plugins */
+  dliteMappingCostMeasured  /*!< Use the measured mean wall time per
+                                 instance in microseconds.  Plugins without
+                                 statistics use their declared cost. */
+} DLiteMappingCostMode;
+
+/**
+  Enables or disables recording of mapping statistics.  Returns the
+  previous value.
+ */
+int dlite_mapping_stats_enable(int enable);
+
+/**
+  Copies the statistics recorded for mapping plugin `name` to `stats`.
+  Returns non-zero if no statistics are recorded for `name`.
+ */
+int dlite_mapping_stats_get(const char *name, DLiteMappingStats *stats);
+
+/**
+  Returns a malloc'ed string with a table of all recorded statistics.
+ */
+char *dlite_mapping_stats_string(void);
+
+/**
+  Clears all recorded mapping statistics.
+ */
+void dlite_mapping_stats_clear(void);
+
+/**
+  Writes the recorded mapping statistics to `filename`.
+  Returns non-zero on error.
+ */
+int dlite_mapping_stats_save(const char *filename);
+
+/**
+  Reads mapping statistics from `filename` and adds them to the
+  recorded statistics.  Returns non-zero on error.
+ */
+int dlite_mapping_stats_load(const char *filename);
+
+/**
+  Sets how mapping costs are obtained when searching for the cheapest
+  mapping.  Changing the mode, clearing or loading statistics clears the
+  cache of mapping plans used by dlite_mapping().  Returns the previous
+  mode.
+ */
+DLiteMappingCostMode dlite_mapping_set_cost_mode(DLiteMappingCostMode mode);
+
+/** @} */
+
 
 #endif /* _DLITE_MAPPING_H */
@@ -0,0 +1,701 @@
+/* dlite-metacache.c -- binary cache of the metadata in the storage paths
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/fileinfo.h"
+#include "utils/map.h"
+#include "utils/thread.h"
+#include "pathshash.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-binrecord.h"
+#include "dlite-metacache.h"
+
+#define GLOBALS_ID "dlite-metacache-id"
+
+#define METACACHE_MAGIC     "DLITEMET"   /* 8 bytes, not NUL-terminated */
+#define METACACHE_VERSION   1
+#define METACACHE_BYTEORDER DLITE_BINRECORD_BYTEORDER
+#define METACACHE_ALIGN     DLITE_BINRECORD_ALIGN  /* alignment of records */
+
+/* Size of the path hash in bytes */
+#define HASHSIZE 32
+
+
+/*
+  File layout (all offsets are from the start of the file):
+
+      MetaCacheHeader
+      MetaCacheEntry[nmeta]     sorted by uuid
+      MetaCacheFile[nfiles]     storage files the cache is built from
+      string table              NUL-terminated file locations
+      records                   binary records aligned to METACACHE_ALIGN
+*/
+
+/* File header */
+typedef struct {
+  char magic[8];                  /* METACACHE_MAGIC */
+  uint32_t byteorder;             /* METACACHE_BYTEORDER */
+  uint32_t version;               /* METACACHE_VERSION */
+  unsigned char hash[HASHSIZE];   /* pathshash() of the storage paths */
+  uint64_t size;                  /* size of the file */
+  uint64_t nmeta;                 /* number of metadata */
+  uint64_t index;                 /* offset of the entries */
+  uint64_t nfiles;                /* number of storage files */
+  uint64_t files;                 /* offset of the storage files */
+} MetaCacheHeader;
+
+/* A cached metadata */
+typedef struct {
+  char uuid[DLITE_UUID_LENGTH+3]; /* uuid, padded to 8 bytes */
+  uint64_t offset;                /* offset of binary record */
+  uint64_t size;                  /* size of binary record */
+} MetaCacheEntry;
+
+/* A storage file the cache is built from */
+typedef struct {
+  double mtime;                   /* modification time */
+  uint64_t location;              /* offset of location string */
+} MetaCacheFile;
+
+
+/* Prefix of cache names referring to a shared memory segment */
+#define SHM_PREFIX "shm:"
+
+
+/* Global variables for this module */
+typedef struct {
+  char *base;               /* mapped cache file, NULL if not available */
+  size_t size;              /* size of mapped file */
+  int mmapped;              /* whether `base` is mmap'ed */
+  int shared;               /* whether `base` is a shared memory segment */
+  int opened;               /* whether we have tried to map the cache */
+  int building;             /* whether the cache is being built */
+} Globals;
+
+
+/* Protects the globals */
+static ThreadMutex metacache_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Releases the mapped cache file. */
+static void unmap_cache(Globals *g)
+{
+  if (!g->base) return;
+#ifdef HAVE_MMAP
+  if (g->mmapped) munmap(g->base, g->size);
+#endif
+  if (!g->mmapped) free(g->base);
+  g->base = NULL;
+  g->size = 0;
+  g->mmapped = 0;
+  g->shared = 0;
+}
+
+/* Frees global state for this module - called by atexit() */
+static void free_globals(void *globals)
+{
+  Globals *g = globals;
+  unmap_cache(g);
+  free(g);
+}
+
+/* Return a pointer to global state for this module */
+static Globals *get_globals(void)
+{
+  Globals *g = dlite_globals_get_state(GLOBALS_ID);
+  if (!g) {
+    thread_mutex_lock(&metacache_mutex);
+    if (!(g = dlite_globals_get_state(GLOBALS_ID))) {
+      if ((g = calloc(1, sizeof(Globals))))
+        dlite_globals_add_state(GLOBALS_ID, g, free_globals);
+    }
+    thread_mutex_unlock(&metacache_mutex);
+    if (!g) return err(1, "allocation failure"), NULL;
+  }
+  return g;
+}
+
+/* Returns the name of the cache file or NULL if the cache is not
+   enabled. */
+static const char *cache_filename(void)
+{
+  const char *filename = getenv("DLITE_META_CACHE");
+  return (filename && *filename) ? filename : NULL;
+}
+
+/* Returns the name of the shared memory segment if `filename` has the
+   form "shm:NAME", otherwise NULL. */
+static const char *shm_name(const char *filename)
+{
+  size_t n = strlen(SHM_PREFIX);
+  return (strncmp(filename, SHM_PREFIX, n) == 0) ? filename + n : NULL;
+}
+
+/* Opens the cache `filename` with `flags`, which may be a file or a
+   shared memory segment.  Returns a file descriptor or -1 on error. */
+#ifdef HAVE_MMAP
+static int open_cache_fd(const char *filename, int flags)
+{
+  const char *name = shm_name(filename);
+  if (!name) return open(filename, flags);
+#ifdef HAVE_SHM_OPEN
+  return shm_open(name, flags, 0444);
+#else
+  return -1;
+#endif
+}
+#endif
+
+/* Maps cache file `filename` into memory.  Returns non-zero if it
+   cannot be mapped. */
+static int map_cache(Globals *g, const char *filename)
+{
+#ifdef HAVE_MMAP
+  int fd;
+  struct stat st;
+  void *p;
+  if ((fd = open_cache_fd(filename, O_RDONLY)) < 0) return 1;
+  if (fstat(fd, &st) || st.st_size < (off_t)sizeof(MetaCacheHeader)) {
+    close(fd);
+    return 1;
+  }
+  p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return 1;
+  g->base = p;
+  g->size = st.st_size;
+  g->mmapped = 1;
+  g->shared = (shm_name(filename) != NULL);
+  return 0;
+#else
+  FILE *fp;
+  long size;
+  if (shm_name(filename)) return 1;
+  if (!(fp = fopen(filename, "rb"))) return 1;
+  if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) <
+      (long)sizeof(MetaCacheHeader) || fseek(fp, 0, SEEK_SET) ||
+      !(g->base = malloc(size))) {
+    fclose(fp);
+    return 1;
+  }
+  if (fread(g->base, 1, size, fp) != (size_t)size) {
+    free(g->base);
+    g->base = NULL;
+    fclose(fp);
+    return 1;
+  }
+  fclose(fp);
+  g->size = size;
+  g->mmapped = 0;
+  return 0;
+#endif
+}
+
+/* Calls `fn` for each normal file in the storage paths, with the
+   driver, location and options of the storage.  Files occurring
+   several times in the storage paths are only visited once.  Returns
+   non-zero if `fn` returns non-zero or on error. */
+static int foreach_file(int (*fn)(const char *driver, const char *location,
+                                  const char *options, void *data),
+                        void *data)
+{
+  DLiteStoragePathIter *iter;
+  map_int_t seen;
+  const char *url;
+  int stat=0;
+  if (!(iter = dlite_storage_paths_iter_start())) return 1;
+  map_init(&seen);
+  while (!stat && (url = dlite_storage_paths_iter_next(iter))) {
+    char *copy, *driver, *location, *options;
+    if (!(copy = strdup(url))) {
+      stat = err(1, "allocation failure");
+      break;
+    }
+#ifdef _WIN32
+    dlite_split_url_winpath(copy, &driver, &location, &options, NULL, 1);
+#else
+    dlite_split_url(copy, &driver, &location, &options, NULL);
+#endif
+    if (!driver) driver = (char *)fu_fileext(location);
+    if (!options) options = "mode=r";
+    if (driver && *driver && !map_get(&seen, location) &&
+        fileinfo_isnormal(location)) {
+      map_set(&seen, location, 1);
+      stat = fn(driver, location, options, data);
+    }
+    free(copy);
+  }
+  map_deinit(&seen);
+  dlite_storage_paths_iter_stop(iter);
+  return stat;
+}
+
+/* Callback for files_hash() appending `location` to paths `data`. */
+static int append_file(const char *driver, const char *location,
+                       const char *options, void *data)
+{
+  UNUSED(driver);
+  UNUSED(options);
+  return fu_paths_append((FUPaths *)data, location) < 0;
+}
+
+/* Stores the pathshash() of the files in the storage paths in `hash`.
+   Unlike the storage paths themselves, this doesn't change when
+   storage plugins append the files they open to the storage paths.
+   Returns non-zero on error. */
+static int files_hash(unsigned char *hash)
+{
+  FUPaths paths;
+  int stat;
+  if (fu_paths_init(&paths, NULL) < 0) return 1;
+  stat = dlite_metacache_files(&paths) ||
+    pathshash(hash, HASHSIZE, &paths);
+  fu_paths_deinit(&paths);
+  return stat;
+}
+
+/* Returns non-zero if the mapped cache is inconsistent or outdated
+   with respect to the storage paths. */
+static int outdated(const Globals *g)
+{
+  const MetaCacheHeader *h = (const MetaCacheHeader *)g->base;
+  const MetaCacheFile *files;
+  const MetaCacheEntry *entries;
+  unsigned char hash[HASHSIZE];
+  size_t i;
+
+  if (memcmp(h->magic, METACACHE_MAGIC, 8) != 0 ||
+      h->byteorder != METACACHE_BYTEORDER ||
+      h->version != METACACHE_VERSION || h->size != g->size ||
+      h->index > g->size || h->nmeta > g->size / sizeof(MetaCacheEntry) ||
+      h->index + h->nmeta * sizeof(MetaCacheEntry) > g->size ||
+      h->files > g->size || h->nfiles > g->size / sizeof(MetaCacheFile) ||
+      h->files + h->nfiles * sizeof(MetaCacheFile) > g->size)
+    return 1;
+  entries = (const MetaCacheEntry *)(g->base + h->index);
+  for (i=0; i < h->nmeta; i++)
+    if (entries[i].offset % METACACHE_ALIGN || entries[i].offset > g->size ||
+        entries[i].size > g->size - entries[i].offset) return 1;
+
+  if (files_hash(hash)) return 1;
+  if (memcmp(hash, h->hash, HASHSIZE) != 0) return 1;
+
+  files = (const MetaCacheFile *)(g->base + h->files);
+  for (i=0; i < h->nfiles; i++) {
+    const char *location = g->base + files[i].location;
+    if (files[i].location >= g->size ||
+        !memchr(location, '\0', g->size - files[i].location) ||
+        fileinfo_mtime(location) != files[i].mtime) return 1;
+  }
+  return 0;
+}
+
+/* Compares uuid `key` with the uuid of cache entry `p`. */
+static int cmp_entry(const void *key, const void *p)
+{
+  return strcmp((const char *)key, ((const MetaCacheEntry *)p)->uuid);
+}
+
+
+/* Help struct used while building the cache */
+typedef struct {
+  DLiteInstance **metas;    /* metadata to cache */
+  size_t nmetas;            /* number of metadata */
+  size_t metasize;          /* allocated length of `metas` */
+  map_int_t uuids;          /* uuids of metadata in `metas` */
+  MetaCacheFile *files;     /* storage files, `location` is an offset
+                               into `strtab` */
+  size_t nfiles;            /* number of storage files */
+  size_t filesize;          /* allocated length of `files` */
+  char *strtab;             /* string table */
+  size_t strtablen;         /* length of string table */
+} Builder;
+
+/* Returns metadata `uuid` from storage `s` or NULL if it is not
+   metadata or cannot be loaded.  Errors are suppressed. */
+static DLiteInstance *load_meta(const DLiteStorage *s, const char *uuid)
+{
+  DLiteInstance *inst=NULL;
+  ErrTry:
+    if ((inst = dlite_instance_has(uuid, 0)))
+      dlite_instance_incref(inst);
+    else
+      inst = dlite_instance_load(s, uuid);
+  ErrOther:
+    break;
+  ErrEnd;
+  if (inst && !dlite_instance_is_meta(inst)) {
+    dlite_instance_decref(inst);
+    inst = NULL;
+  }
+  return inst;
+}
+
+/* Callback for build_cache() adding the metadata in the storage file
+   `location` to builder `data`.  Storages that cannot be opened or
+   listed are skipped.  Returns non-zero on error. */
+static int add_storage(const char *driver, const char *location,
+                       const char *options, void *data)
+{
+  Builder *b = data;
+  DLiteStorage *s=NULL;
+  char **uuids=NULL;
+  size_t i, len=strlen(location) + 1;
+
+  if (b->nfiles >= b->filesize) {
+    size_t size = (b->filesize) ? 2*b->filesize : 64;
+    void *ptr = realloc(b->files, size*sizeof(MetaCacheFile));
+    if (!ptr) return err(1, "allocation failure");
+    b->files = ptr;
+    b->filesize = size;
+  }
+  {
+    char *ptr = realloc(b->strtab, b->strtablen + len);
+    if (!ptr) return err(1, "allocation failure");
+    b->strtab = ptr;
+  }
+  memcpy(b->strtab + b->strtablen, location, len);
+  b->files[b->nfiles].mtime = fileinfo_mtime(location);
+  b->files[b->nfiles].location = b->strtablen;
+  b->nfiles++;
+  b->strtablen += len;
+
+  ErrTry:
+    if ((s = dlite_storage_cache_open(driver, location, options)))
+      uuids = dlite_storage_uuids(s, NULL);
+  ErrOther:
+    break;
+  ErrEnd;
+
+  for (i=0; uuids && uuids[i]; i++) {
+    DLiteInstance *meta;
+    if (map_get(&b->uuids, uuids[i])) continue;
+    if (!(meta = load_meta(s, uuids[i]))) continue;
+    if (map_get(&b->uuids, meta->uuid)) {
+      dlite_instance_decref(meta);
+      continue;
+    }
+    if (b->nmetas >= b->metasize) {
+      size_t size = (b->metasize) ? 2*b->metasize : 64;
+      void *ptr = realloc(b->metas, size*sizeof(DLiteInstance *));
+      if (!ptr) {
+        dlite_instance_decref(meta);
+        dlite_storage_uuids_free(uuids);
+        dlite_storage_cache_release(s);
+        return err(1, "allocation failure");
+      }
+      b->metas = ptr;
+      b->metasize = size;
+    }
+    map_set(&b->uuids, meta->uuid, (int)b->nmetas);
+    b->metas[b->nmetas++] = meta;
+  }
+  if (uuids) dlite_storage_uuids_free(uuids);
+  if (s) dlite_storage_cache_release(s);
+  return 0;
+}
+
+/* Compares the uuids of two metadata. */
+static int cmp_uuid(const void *a, const void *b)
+{
+  return strcmp((*(DLiteInstance **)a)->uuid, (*(DLiteInstance **)b)->uuid);
+}
+
+/* Creates a new shared memory segment `name` for writing, replacing
+   any existing segment with this name.  Processes that have mapped
+   the old segment keep it until they unmap it.  Returns NULL on
+   error. */
+static FILE *create_shm(const char *name)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SHM_OPEN)
+  FILE *fp;
+  int fd;
+  shm_unlink(name);
+  if ((fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644)) < 0)
+    return err(1, "cannot create shared memory segment: %s", name), NULL;
+  if (!(fp = fdopen(fd, "wb"))) {
+    close(fd);
+    shm_unlink(name);
+    return err(1, "cannot write shared memory segment: %s", name), NULL;
+  }
+  return fp;
+#else
+  return errx(1, "shared memory segments are not supported on this "
+              "system: %s", name), NULL;
+#endif
+}
+
+/* Writes the cache file `filename` from the content of `b`.  If
+   `filename` has the form "shm:NAME", the cache is published to the
+   shared memory segment NAME instead.  Returns non-zero on error. */
+static int write_cache(Builder *b, const char *filename,
+                       const unsigned char *hash)
+{
+  MetaCacheHeader h;
+  MetaCacheEntry *entries=NULL;
+  char *records=NULL, *tmpname=NULL;
+  const char *shm = shm_name(filename);
+  size_t i, size=0, pos=0, start;
+  FILE *fp=NULL;
+  int stat=1;
+
+  qsort(b->metas, b->nmetas, sizeof(DLiteInstance *), cmp_uuid);
+  if (b->nmetas &&
+      !(entries = calloc(b->nmetas, sizeof(MetaCacheEntry))))
+    FAIL("allocation failure");
+  for (i=0; i < b->nmetas; i++) {
+    int n = dlite_binrecord_encode(&records, &size, pos, b->metas[i]);
+    if (n < 0) goto fail;
+    memcpy(entries[i].uuid, b->metas[i]->uuid, DLITE_UUID_LENGTH+1);
+    entries[i].offset = pos;
+    entries[i].size = n;
+    pos += n;
+  }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, METACACHE_MAGIC, 8);
+  h.byteorder = METACACHE_BYTEORDER;
+  h.version = METACACHE_VERSION;
+  memcpy(h.hash, hash, HASHSIZE);
+  h.nmeta = b->nmetas;
+  h.index = sizeof(MetaCacheHeader);
+  h.nfiles = b->nfiles;
+  h.files = h.index + b->nmetas * sizeof(MetaCacheEntry);
+  start = align_up(h.files + b->nfiles * sizeof(MetaCacheFile) +
+                   b->strtablen, METACACHE_ALIGN);
+  h.size = start + pos;
+  for (i=0; i < b->nmetas; i++) entries[i].offset += start;
+  for (i=0; i < b->nfiles; i++)
+    b->files[i].location += h.files + b->nfiles * sizeof(MetaCacheFile);
+
+  if (shm) {
+    /* a segment cannot be renamed, so the magic is written last to
+       keep attaching processes from using an incomplete segment */
+    if (!(fp = create_shm(shm))) goto fail;
+    if (!(tmpname = strdup(filename))) FAIL("allocation failure");
+    memset(h.magic, 0, 8);
+  } else {
+    if (!(tmpname = malloc(strlen(filename) + 5)))
+      FAIL("allocation failure");
+    sprintf(tmpname, "%s.tmp", filename);
+    if (!(fp = fopen(tmpname, "wb")))
+      FAIL1("cannot write metadata cache: %s", tmpname);
+  }
+  if (fwrite(&h, sizeof(h), 1, fp) != 1 ||
+      (b->nmetas &&
+       fwrite(entries, sizeof(MetaCacheEntry), b->nmetas, fp) != b->nmetas) ||
+      (b->nfiles &&
+       fwrite(b->files, sizeof(MetaCacheFile), b->nfiles, fp) != b->nfiles) ||
+      (b->strtablen && fwrite(b->strtab, 1, b->strtablen, fp) != b->strtablen))
+    FAIL1("error writing metadata cache: %s", tmpname);
+  for (i=h.files + b->nfiles * sizeof(MetaCacheFile) + b->strtablen;
+       i < start; i++)
+    fputc('\0', fp);
+  if (pos && fwrite(records, 1, pos, fp) != pos)
+    FAIL1("error writing metadata cache: %s", tmpname);
+  if (shm) {
+    memcpy(h.magic, METACACHE_MAGIC, 8);
+    if (fflush(fp) || fseek(fp, 0, SEEK_SET) || fwrite(&h, 8, 1, fp) != 1)
+      FAIL1("error writing metadata cache: %s", tmpname);
+#ifdef HAVE_MMAP
+    /* published segments are read-only */
+    fchmod(fileno(fp), 0444);
+#endif
+  }
+  if (fclose(fp)) {
+    fp = NULL;
+    FAIL1("error writing metadata cache: %s", tmpname);
+  }
+  fp = NULL;
+  if (!shm) {
+#ifdef _WIN32
+    remove(filename);
+#endif
+    if (rename(tmpname, filename))
+      FAIL1("cannot write metadata cache: %s", filename);
+  }
+  stat = 0;
+ fail:
+  if (fp) fclose(fp);
+  if (tmpname) free(tmpname);
+  if (records) free(records);
+  if (entries) free(entries);
+  return stat;
+}
+
+/* Builds the cache file `filename`.  Returns non-zero on error. */
+static int build_cache(const char *filename)
+{
+  Builder b;
+  unsigned char hash[HASHSIZE];
+  size_t i;
+  int stat=1;
+
+  memset(&b, 0, sizeof(b));
+  map_init(&b.uuids);
+  /* hash the files after the storages are opened, since opening them
+     may add files to the storage paths */
+  if (foreach_file(add_storage, &b) == 0 && files_hash(hash) == 0)
+    stat = write_cache(&b, filename, hash);
+  for (i=0; i < b.nmetas; i++) dlite_instance_decref(b.metas[i]);
+  if (b.metas) free(b.metas);
+  if (b.files) free(b.files);
+  if (b.strtab) free(b.strtab);
+  map_deinit(&b.uuids);
+  return stat;
+}
+
+/* Maps the cache on first use and rebuilds it if it is missing or
+   outdated.  Returns non-zero if the cache is not available. */
+static int open_cache(Globals *g, const char *filename)
+{
+  int stat;
+  thread_mutex_lock(&metacache_mutex);
+  if (g->building || g->opened) {
+    stat = g->building || !g->base;
+    thread_mutex_unlock(&metacache_mutex);
+    return stat;
+  }
+  g->opened = 1;
+  g->building = 1;
+  thread_mutex_unlock(&metacache_mutex);
+
+  if (map_cache(g, filename) == 0 && outdated(g)) unmap_cache(g);
+  if (!g->base) {
+    ErrTry:
+      if (build_cache(filename) == 0 && map_cache(g, filename) == 0 &&
+          outdated(g))
+        unmap_cache(g);
+    ErrOther:
+      warnx("cannot build metadata cache \"%s\": %s", filename,
+            err_getmsg());
+    ErrEnd;
+  }
+
+  thread_mutex_lock(&metacache_mutex);
+  g->building = 0;
+  stat = !g->base;
+  thread_mutex_unlock(&metacache_mutex);
+  return stat;
+}
+
+
+
+/********************************************************************
+ * Public api
+ ********************************************************************/
+
+/*
+  Returns a new reference to metadata `id` from the metadata cache, or
+  NULL if the cache is not enabled or doesn't contain `id`.
+ */
+DLiteInstance *dlite_metacache_load(const char *id)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  const char *filename;
+  const MetaCacheHeader *h;
+  const MetaCacheEntry *e;
+  const DLiteBinRecord *rec;
+  DLiteInstance *inst=NULL;
+  Globals *g;
+  if (!(filename = cache_filename())) return NULL;
+  if (!id || dlite_get_uuid(uuid, id) < 0) return NULL;
+  if (!(g = get_globals())) return NULL;
+  if (open_cache(g, filename)) return NULL;
+  h = (const MetaCacheHeader *)g->base;
+  if (!(e = bsearch(uuid, g->base + h->index, h->nmeta,
+                    sizeof(MetaCacheEntry), cmp_entry))) return NULL;
+  if ((inst = dlite_instance_has(uuid, 0))) {
+    dlite_instance_incref(inst);
+    return inst;
+  }
+  ErrTry:
+    rec = (const DLiteBinRecord *)(g->base + e->offset);
+    if (dlite_binrecord_check(rec, e->size) == 0)
+      inst = dlite_binrecord_decode(rec, uuid, NULL, NULL);
+    /* metadata from a shared segment are shared by all processes
+       attached to it and are never modified */
+    if (inst && g->shared)
+      dlite_instance_freeze(inst, dliteFreezeImmortal);
+  ErrOther:
+    /* fall back to searching the storages */
+    break;
+  ErrEnd;
+  return inst;
+}
+
+/*
+  Writes a metadata cache with all metadata in the storage paths to
+  `filename`.  Returns non-zero on error.
+ */
+int dlite_metacache_update(const char *filename)
+{
+  Globals *g;
+  int stat;
+  if (!(g = get_globals())) return 1;
+  thread_mutex_lock(&metacache_mutex);
+  if (g->building) {
+    thread_mutex_unlock(&metacache_mutex);
+    return errx(1, "metadata cache is already being built");
+  }
+  g->building = 1;
+  thread_mutex_unlock(&metacache_mutex);
+  stat = build_cache(filename);
+  thread_mutex_lock(&metacache_mutex);
+  g->building = 0;
+  thread_mutex_unlock(&metacache_mutex);
+  return stat;
+}
+
+/*
+  Appends the normal files in the storage paths to `paths`.  Files
+  occurring several times in the storage paths are only appended once.
+  Returns non-zero on error.
+ */
+int dlite_metacache_files(FUPaths *paths)
+{
+  return foreach_file(append_file, paths);
+}
+
+/*
+  Returns the number of metadata in the mapped metadata cache.
+ */
+size_t dlite_metacache_count(void)
+{
+  Globals *g;
+  if (!(g = dlite_globals_get_state(GLOBALS_ID)) || !g->base) return 0;
+  return ((const MetaCacheHeader *)g->base)->nmeta;
+}
+
+/*
+  Unmaps the metadata cache.
+ */
+void dlite_metacache_clear(void)
+{
+  Globals *g;
+  if (!(g = dlite_globals_get_state(GLOBALS_ID))) return;
+  thread_mutex_lock(&metacache_mutex);
+  unmap_cache(g);
+  g->opened = 0;
+  thread_mutex_unlock(&metacache_mutex);
+}
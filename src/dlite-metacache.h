@@ -0,0 +1,81 @@
+#ifndef _DLITE_METACACHE_H
+#define _DLITE_METACACHE_H
+
+/**
+  @file
+  @brief Binary cache of the metadata in the storage paths
+
+  Looking up metadata in the storage paths requires parsing the
+  storages they are stored in, which may dominate the startup time of
+  applications that use many entities.  The metadata cache is a
+  binary snapshot of all metadata found in the storage paths, stored
+  as binary records (see dlite-binrecord.h) that are decoded without
+  parsing.  It is memory mapped on first use and consulted by
+  dlite_instance_get() before the storages are searched.
+
+  The cache is enabled by setting the environment variable
+  `DLITE_META_CACHE` to a file name.  It is keyed by the hash of the
+  storage paths (see pathshash()) and the modification times of the
+  files in them.  If any of these has changed when the cache is
+  mapped, it is rebuilt.  The `dlite-index` tool can be used to build
+  it up front.
+
+  If `DLITE_META_CACHE` has the form "shm:NAME", the cache is kept in
+  the POSIX shared memory segment NAME instead of a file.  The first
+  process that finds the segment missing or outdated publishes it and
+  the other processes attach to it, such that the pages of the
+  records are shared between all processes on the host.  Metadata
+  decoded from a shared segment are frozen and immortal (see
+  dlite_instance_freeze()).  Shared segments are only supported on
+  systems with shm_open().
+ */
+
+#include "utils/fileutils.h"
+#include "dlite-entity.h"
+
+
+/**
+  Returns a new reference to metadata `id` from the metadata cache, or
+  NULL if the cache is not enabled or doesn't contain `id`.  No error
+  is reported in these cases.
+
+  If the cache is not yet mapped, it is mapped and validated against
+  the storage paths.  A missing or outdated cache file is rebuilt.
+ */
+DLiteInstance *dlite_metacache_load(const char *id);
+
+/**
+  Writes a metadata cache with all metadata in the storage paths to
+  `filename`.  If `filename` has the form "shm:NAME", the cache is
+  published to the shared memory segment NAME, replacing any existing
+  segment with this name.  Storages that cannot be opened are skipped.
+
+  Note that this loads all instances in the storage paths.
+
+  Returns non-zero on error.
+ */
+int dlite_metacache_update(const char *filename);
+
+/**
+  Appends the normal files in the storage paths to `paths`.  Files
+  occurring several times in the storage paths are only appended once.
+  The cache is keyed by the pathshash() of these files.
+
+  Returns non-zero on error.
+ */
+int dlite_metacache_files(FUPaths *paths);
+
+/**
+  Returns the number of metadata in the mapped metadata cache.
+ */
+size_t dlite_metacache_count(void);
+
+/**
+  Unmaps the metadata cache.  It is mapped and validated again on next
+  lookup.  Must not be called while other threads are looking up
+  instances.
+ */
+void dlite_metacache_clear(void);
+
+
+#endif /* _DLITE_METACACHE_H */
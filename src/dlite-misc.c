@@ -13,6 +13,8 @@
 #include "utils/tgen.h"
 #include "utils/fileutils.h"
 #include "utils/session.h"
+#include "utils/trace.h"
+#include "utils/scheduler.h"
 #include "getuuid.h"
 #include "dlite.h"
 #include "dlite-macros.h"
@@ -460,6 +462,10 @@ int dlite_add_dll_path(void)
 /* A cache pointing to the current session handler */
 static DLiteGlobals *_globals_handler=NULL;
 
+/* Context made current in this thread with dlite_context_set_current()
+   or NULL if the default globals are used */
+static _thread_local DLiteContext *_current_context=NULL;
+
 
 /* Called by atexit().  Should be ok to call this multiple times... */
 static void _free_globals(void) {
@@ -473,16 +479,40 @@ static void _free_globals(void) {
   session_free(s);
 }
 
-/*
-  Returns reference to globals handle.
-*/
-DLiteGlobals *dlite_globals_get(void)
+/* Writes statistics to the file given by DLITE_STATS.  Called at exit
+   before the globals are free'ed. */
+static void _write_stats(void)
+{
+  const char *filename = getenv("DLITE_STATS");
+  if (filename && *filename) dlite_stats_write(filename);
+}
+
+/* Sets the huge page allocator in the default globals according to
+   the specification `spec` from DLITE_HUGEPAGES. */
+static void _set_hugepages(const char *spec)
+{
+  DLiteContext *ctx = _current_context;
+  DLiteHugePagePolicy policy;
+  size_t threshold;
+  if (dlite_hugepage_parse(spec, &policy, &threshold)) {
+    err_clear();  /* already reported, don't chain to later errors */
+    return;
+  }
+  _current_context = NULL;
+  dlite_hugepage_set_policy(policy, threshold);
+  _current_context = ctx;
+}
+
+/* Returns the process-wide globals handle, ignoring any current
+   context. */
+static DLiteGlobals *_default_globals(void)
 {
   if (!_globals_handler) {
     _globals_handler = session_get_default();
 
     if (!session_get_state(_globals_handler, ATEXIT_MARKER_ID)) {
       static void **dummy_ptr=NULL;
+      const char *trace, *stats, *hugepages, *record, *nthreads;
 
       /* Make valgrind and other memory leak detectors happy by freeing
          up all globals at exit. */
@@ -492,17 +522,57 @@ DLiteGlobals *dlite_globals_get(void)
          The value of the state is not used. */
       session_add_state((Session *)_globals_handler, ATEXIT_MARKER_ID,
                         &dummy_ptr, NULL);
+
+      /* Record tracing spans if DLITE_TRACE is set */
+      if ((trace = getenv("DLITE_TRACE")) && *trace)
+        trace_enable(trace);
+
+      /* Record storage accesses if DLITE_RECORD is set */
+      if ((record = getenv("DLITE_RECORD")) && *record)
+        dlite_record_start(record);
+
+      /* Write statistics at exit if DLITE_STATS is set */
+      if ((stats = getenv("DLITE_STATS")) && *stats)
+        atexit(_write_stats);
+
+      /* Back large property arrays by huge pages if DLITE_HUGEPAGES
+         is set */
+      if ((hugepages = getenv("DLITE_HUGEPAGES")) && *hugepages)
+        _set_hugepages(hugepages);
+
+      /* Size the shared task scheduler if DLITE_NUM_THREADS is set */
+      if ((nthreads = getenv("DLITE_NUM_THREADS")) && *nthreads) {
+        char *endptr;
+        long n = strtol(nthreads, &endptr, 10);
+        if (*endptr || n < 1)
+          warnx("invalid value of DLITE_NUM_THREADS: '%s'", nthreads);
+        else
+          sched_set_nthreads((int)n);
+      }
     }
   }
   return _globals_handler;
 }
 
+/*
+  Returns reference to globals handle.
+
+  If a context is current in the calling thread, it is returned.
+*/
+DLiteGlobals *dlite_globals_get(void)
+{
+  if (_current_context) return _current_context;
+  return _default_globals();
+}
+
 /*
   Set globals handle.  Should be called as the first thing by dynamic
   loaded plugins.
 */
 void dlite_globals_set(DLiteGlobals *globals_handler)
 {
+  /* Plugins loaded within a context are passed the context */
+  if (globals_handler && globals_handler == _current_context) return;
   session_set_default((Session *)globals_handler);
   _globals_handler = globals_handler;
 }
@@ -545,7 +615,72 @@ void *dlite_globals_get_state(const char *name)
  */
 int dlite_globals_in_atexit(void)
 {
-  return (dlite_globals_get_state(ATEXIT_MARKER_ID)) ? 0 : 1;
+  return (session_get_state(_default_globals(), ATEXIT_MARKER_ID)) ? 0 : 1;
+}
+
+
+/********************************************************************
+ * Contexts
+ ********************************************************************/
+
+/*
+  Creates a new context with the given id.  If `id` is NULL, a unique
+  id is generated.
+
+  Returns the new context or NULL on error.
+ */
+DLiteContext *dlite_context_create(const char *id)
+{
+  char buf[DLITE_UUID_LENGTH + 16];
+  if (!id) {
+    char uuid[DLITE_UUID_LENGTH + 1];
+    if (dlite_get_uuid(uuid, NULL) < 0) return NULL;
+    snprintf(buf, sizeof(buf), "dlite-context-%s", uuid);
+    id = buf;
+  }
+  return session_create(id);
+}
+
+/*
+  Frees context `ctx` and all state owned by it.
+
+  Returns non-zero on error.
+ */
+int dlite_context_free(DLiteContext *ctx)
+{
+  DLiteContext *prev = _current_context;
+  if (!ctx) return 0;
+  if (ctx == _globals_handler)
+    return errx(1, "cannot free the default context");
+
+  /* Make `ctx` current while freeing it, since free functions of its
+     states may look up other states */
+  _current_context = ctx;
+  session_free(ctx);
+  _current_context = (prev == ctx) ? NULL : prev;
+  return 0;
+}
+
+/*
+  Makes `ctx` the current context of the calling thread.  If `ctx` is
+  NULL, the default process-wide globals are used.
+
+  Returns the previous current context.
+ */
+DLiteContext *dlite_context_set_current(DLiteContext *ctx)
+{
+  DLiteContext *prev = _current_context;
+  _current_context = (ctx == _globals_handler) ? NULL : ctx;
+  return prev;
+}
+
+/*
+  Returns the current context of the calling thread or NULL if the
+  default process-wide globals are used.
+ */
+DLiteContext *dlite_context_get_current(void)
+{
+  return _current_context;
 }
 
 
@@ -281,6 +281,60 @@ int dlite_globals_in_atexit(void);
 /** @} */
 
 
+/**
+  @name Contexts
+  A context owns its own set of global states, like the instance
+  store, storage paths and plugin caches.  By making a context current
+  in a thread with dlite_context_set_current(), that thread works
+  isolated from the rest of the process, without contending on the
+  locks of the default globals.
+
+  Instances created in a context should be released before the
+  context is freed, and must be released while the same context is
+  current.
+  @{
+*/
+
+/**
+  Context handle.  A context is a globals handle that can be made
+  current per thread.
+ */
+typedef struct _Session DLiteContext;
+
+/**
+  Creates a new context with the given id.  If `id` is NULL, a unique
+  id is generated.
+
+  Returns the new context or NULL on error.
+ */
+DLiteContext *dlite_context_create(const char *id);
+
+/**
+  Frees context `ctx` and all state owned by it.  If `ctx` is current
+  in the calling thread, the calling thread falls back to the default
+  globals.
+
+  Returns non-zero on error.
+ */
+int dlite_context_free(DLiteContext *ctx);
+
+/**
+  Makes `ctx` the current context of the calling thread.  If `ctx` is
+  NULL, the default process-wide globals are used.
+
+  Returns the previous current context.
+ */
+DLiteContext *dlite_context_set_current(DLiteContext *ctx);
+
+/**
+  Returns the current context of the calling thread or NULL if the
+  default process-wide globals are used.
+ */
+DLiteContext *dlite_context_get_current(void);
+
+/** @} */
+
+
 /**
   @name Wrappers around error functions
   @{
@@ -0,0 +1,602 @@
+/* dlite-notify.c -- publish/subscribe notification of instance changes
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+# include <errno.h>
+# include <fcntl.h>
+# include <poll.h>
+# include <unistd.h>
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+#endif
+
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/thread.h"
+#include "utils/globmatch.h"
+#include "utils/jsmnx.h"
+#include "utils/tgen.h"
+#include "dlite-macros.h"
+#include "dlite-misc.h"
+#include "dlite-entity.h"
+#include "dlite-notify.h"
+
+/* Max size of an event sent to a socket */
+#define NOTIFY_MAX_MESSAGE 65536
+
+
+typedef map_t(uint64_t) map_u64_t;
+
+/* A subscription */
+typedef struct {
+  int id;                  /* subscription id */
+  char *pattern;           /* glob pattern, NULL matches all */
+  DLiteNotifyCallback cb;  /* callback, NULL for sockets */
+  void *data;              /* callback data */
+  int sock;                /* socket to send to, -1 for callbacks */
+  char *path;              /* path of socket to send to */
+} Subscriber;
+
+/* Global state shared by the library and the plugins */
+typedef struct {
+  ThreadMutex mutex;
+  Subscriber *subs;        /* array of subscriptions */
+  size_t nsubs;            /* number of subscriptions */
+  size_t size;             /* allocated length of `subs` */
+  int lastid;              /* last assigned subscription id */
+  map_u64_t versions;      /* maps uuid to last event version */
+} Notify;
+
+/* A callback to call after releasing the lock */
+typedef struct {
+  DLiteNotifyCallback cb;
+  void *data;
+} Delivery;
+
+struct _DLiteNotifyReceiver {
+  int sock;                /* bound socket */
+  char *path;              /* path of the socket */
+  char *buf;               /* receive buffer */
+  jsmntok_t *tokens;       /* parsed tokens */
+  unsigned int ntokens;    /* allocated number of tokens */
+};
+
+static ThreadMutex _notify_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Frees the global state. */
+static void _notify_free(void *notify)
+{
+  Notify *n = notify;
+  size_t i;
+  for (i=0; i < n->nsubs; i++) {
+    if (n->subs[i].pattern) free(n->subs[i].pattern);
+    if (n->subs[i].path) free(n->subs[i].path);
+#ifndef _WIN32
+    if (n->subs[i].sock >= 0) close(n->subs[i].sock);
+#endif
+  }
+  if (n->subs) free(n->subs);
+  map_deinit(&n->versions);
+  thread_mutex_destroy(&n->mutex);
+  free(n);
+}
+
+/* Returns the global state, creating it if needed. */
+static Notify *_notify(void)
+{
+  Notify *n = dlite_globals_get_state("dlite-notify");
+  if (!n) {
+    thread_mutex_lock(&_notify_mutex);
+    if (!(n = dlite_globals_get_state("dlite-notify"))) {
+      if ((n = calloc(1, sizeof(Notify)))) {
+        thread_mutex_init(&n->mutex);
+        map_init(&n->versions);
+        dlite_globals_add_state("dlite-notify", n, _notify_free);
+      }
+    }
+    thread_mutex_unlock(&_notify_mutex);
+    if (!n) return err(1, "allocation failure"), NULL;
+  }
+  return n;
+}
+
+/* Adds subscription `sub` and returns its id.  On error, the
+   resources of `sub` are released and -1 is returned. */
+static int _subscribe(Subscriber *sub)
+{
+  Notify *n;
+  int id=-1;
+  if ((n = _notify())) {
+    thread_mutex_lock(&n->mutex);
+    if (n->nsubs >= n->size) {
+      size_t size = (n->size) ? 2*n->size : 4;
+      Subscriber *subs = realloc(n->subs, size*sizeof(Subscriber));
+      if (subs) {
+        n->subs = subs;
+        n->size = size;
+      }
+    }
+    if (n->nsubs < n->size) {
+      sub->id = id = ++n->lastid;
+      n->subs[n->nsubs++] = *sub;
+    }
+    thread_mutex_unlock(&n->mutex);
+    if (id < 0) err(1, "allocation failure");
+  }
+  if (id < 0) {
+    if (sub->pattern) free(sub->pattern);
+    if (sub->path) free(sub->path);
+#ifndef _WIN32
+    if (sub->sock >= 0) close(sub->sock);
+#endif
+  }
+  return id;
+}
+
+/* Returns the path of `url`, which should be of the form "unix:PATH".
+   Returns NULL on error. */
+static const char *_socket_path(const char *url)
+{
+  if (!url || strncmp(url, "unix:", 5))
+    return errx(1, "unsupported notification url '%s', should be "
+                "'unix:PATH'", (url) ? url : "(null)"), NULL;
+#ifdef _WIN32
+  return errx(1, "unix sockets are not supported on this platform"), NULL;
+#else
+  if (!url[5])
+    return errx(1, "missing socket path in url '%s'", url), NULL;
+  if (strlen(url + 5) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+    return errx(1, "too long socket path: %s", url + 5), NULL;
+  return url + 5;
+#endif
+}
+
+
+/*
+  Subscribes to change events of instances matching `pattern`.
+ */
+int dlite_subscribe(const char *pattern, DLiteNotifyCallback cb, void *data)
+{
+  Subscriber sub;
+  if (!cb) return errx(1, "missing notification callback"), -1;
+  memset(&sub, 0, sizeof(sub));
+  sub.cb = cb;
+  sub.data = data;
+  sub.sock = -1;
+  if (pattern && !(sub.pattern = strdup(pattern)))
+    return err(1, "allocation failure"), -1;
+  return _subscribe(&sub);
+}
+
+/*
+  Like dlite_subscribe(), but sends the events to `url`.
+ */
+int dlite_subscribe_url(const char *pattern, const char *url)
+{
+  Subscriber sub;
+  const char *path;
+  if (!(path = _socket_path(url))) return -1;
+  memset(&sub, 0, sizeof(sub));
+  sub.sock = -1;
+#ifndef _WIN32
+  if ((sub.sock = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+    return err(1, "cannot create socket"), -1;
+  fcntl(sub.sock, F_SETFD, FD_CLOEXEC);
+#endif
+  if (!(sub.path = strdup(path)) ||
+      (pattern && !(sub.pattern = strdup(pattern)))) {
+    err(1, "allocation failure");
+    if (sub.pattern) free(sub.pattern);
+    if (sub.path) free(sub.path);
+#ifndef _WIN32
+    close(sub.sock);
+#endif
+    return -1;
+  }
+  return _subscribe(&sub);
+}
+
+/*
+  Cancels subscription `id`.
+ */
+int dlite_unsubscribe(int id)
+{
+  Notify *n = dlite_globals_get_state("dlite-notify");
+  Subscriber sub;
+  size_t i;
+  int found=0;
+  if (n) {
+    thread_mutex_lock(&n->mutex);
+    for (i=0; i < n->nsubs; i++) {
+      if (n->subs[i].id == id) {
+        sub = n->subs[i];
+        memmove(n->subs + i, n->subs + i + 1,
+                (n->nsubs - i - 1)*sizeof(Subscriber));
+        n->nsubs--;
+        found = 1;
+        break;
+      }
+    }
+    thread_mutex_unlock(&n->mutex);
+  }
+  if (!found) return errx(1, "no such subscription: %d", id);
+  if (sub.pattern) free(sub.pattern);
+  if (sub.path) free(sub.path);
+#ifndef _WIN32
+  if (sub.sock >= 0) close(sub.sock);
+#endif
+  return 0;
+}
+
+/*
+  Returns the number of subscriptions.
+ */
+size_t dlite_notify_count(void)
+{
+  Notify *n = dlite_globals_get_state("dlite-notify");
+  size_t nsubs;
+  if (!n) return 0;
+  thread_mutex_lock(&n->mutex);
+  nsubs = n->nsubs;
+  thread_mutex_unlock(&n->mutex);
+  return nsubs;
+}
+
+
+/* Appends `s` as a JSON string to `buf`.  NULL is written as null. */
+static void _append_string(TGenBuf *buf, const char *s)
+{
+  const char *p;
+  if (!s) {
+    tgen_buf_append(buf, "null", 4);
+    return;
+  }
+  tgen_buf_append(buf, "\"", 1);
+  for (p=s; *p; p++) {
+    unsigned char c = *p;
+    if (c == '"' || c == '\\')
+      tgen_buf_append_fmt(buf, "\\%c", c);
+    else if (c < 0x20)
+      tgen_buf_append_fmt(buf, "\\u%04x", c);
+    else
+      tgen_buf_append(buf, p, 1);
+  }
+  tgen_buf_append(buf, "\"", 1);
+}
+
+/* Encodes `event` as JSON in `buf`.  The list of changed properties is
+   only included if the message fits in a datagram. */
+static void _encode_event(TGenBuf *buf, const DLiteEvent *event)
+{
+  size_t i, len;
+  tgen_buf_append(buf, "{\"uuid\": ", -1);
+  _append_string(buf, event->uuid);
+  tgen_buf_append(buf, ", \"uri\": ", -1);
+  _append_string(buf, event->uri);
+  tgen_buf_append(buf, ", \"meta\": ", -1);
+  _append_string(buf, event->metauri);
+  tgen_buf_append_fmt(buf, ", \"version\": %llu, \"location\": ",
+                      (unsigned long long)event->version);
+  _append_string(buf, event->location);
+  tgen_buf_append(buf, ", \"changed\": ", -1);
+  len = tgen_buf_length(buf);
+  if (event->changed) {
+    tgen_buf_append(buf, "[", 1);
+    for (i=0; i < event->nchanged; i++) {
+      if (i) tgen_buf_append(buf, ", ", 2);
+      _append_string(buf, event->changed[i]);
+    }
+    tgen_buf_append(buf, "]}", 2);
+  }
+  if (!event->changed || tgen_buf_length(buf) > NOTIFY_MAX_MESSAGE) {
+    tgen_buf_unappend(buf, tgen_buf_length(buf) - len);
+    tgen_buf_append(buf, "null}", 5);
+  }
+}
+
+/* Sends the JSON encoded event `msg` of length `len` to socket
+   subscriber `sub`.  Errors are ignored, since an absent or slow
+   receiver should not make saving fail. */
+static void _send_event(const Subscriber *sub, const char *msg, size_t len)
+{
+#ifdef _WIN32
+  (void)sub;
+  (void)msg;
+  (void)len;
+#else
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, sub->path, sizeof(addr.sun_path) - 1);
+  sendto(sub->sock, msg, len, MSG_DONTWAIT, (struct sockaddr *)&addr,
+         sizeof(addr));
+#endif
+}
+
+/* Emits a change event for `inst`.  The changed properties are given
+   either by `names` or by the flags in `changed`.  If both are NULL,
+   all properties are listed. */
+static int _emit(const DLiteInstance *inst, const char *location,
+                 const char **names, size_t nnames,
+                 const unsigned char *changed)
+{
+  Notify *n = dlite_globals_get_state("dlite-notify");
+  DLiteEvent event;
+  Delivery *deliveries=NULL;
+  const char **props=NULL;
+  TGenBuf buf;
+  size_t i, ndeliveries=0;
+  int encoded=0, retval=1;
+  uint64_t *v;
+
+  if (!n || !inst || !inst->meta) return 0;
+  thread_mutex_lock(&n->mutex);
+  if (n->nsubs == 0) {
+    thread_mutex_unlock(&n->mutex);
+    return 0;
+  }
+  tgen_buf_init(&buf);
+
+  memset(&event, 0, sizeof(event));
+  event.uuid = inst->uuid;
+  event.uri = inst->uri;
+  event.metauri = inst->meta->uri;
+  event.location = location;
+  if (names) {
+    event.changed = names;
+    event.nchanged = nnames;
+  } else {
+    if (!(props = malloc((inst->meta->_nproperties + 1)*sizeof(char *))))
+      FAIL("allocation failure");
+    for (i=0; i < inst->meta->_nproperties; i++)
+      if (!changed || changed[i])
+        props[event.nchanged++] = inst->meta->_properties[i].name;
+    event.changed = props;
+  }
+  if ((v = map_get(&n->versions, inst->uuid)))
+    event.version = ++(*v);
+  else if (map_set(&n->versions, inst->uuid, (event.version = 1)))
+    FAIL("allocation failure");
+
+  if (!(deliveries = malloc(n->nsubs*sizeof(Delivery))))
+    FAIL("allocation failure");
+  for (i=0; i < n->nsubs; i++) {
+    Subscriber *sub = n->subs + i;
+    if (sub->pattern && globmatch(sub->pattern, inst->uuid) &&
+        (!inst->uri || globmatch(sub->pattern, inst->uri)) &&
+        globmatch(sub->pattern, inst->meta->uri)) continue;
+    if (sub->cb) {
+      deliveries[ndeliveries].cb = sub->cb;
+      deliveries[ndeliveries].data = sub->data;
+      ndeliveries++;
+    } else {
+      if (!encoded) _encode_event(&buf, &event);
+      encoded = 1;
+      _send_event(sub, tgen_buf_get(&buf), tgen_buf_length(&buf));
+    }
+  }
+  retval = 0;
+ fail:
+  thread_mutex_unlock(&n->mutex);
+
+  /* call callbacks without holding the lock, such that they may save,
+     publish or unsubscribe */
+  for (i=0; i < ndeliveries; i++)
+    deliveries[i].cb(&event, deliveries[i].data);
+
+  if (deliveries) free(deliveries);
+  if (props) free(props);
+  tgen_buf_deinit(&buf);
+  return retval;
+}
+
+
+/*
+  Emits a change event for instance `inst`.
+ */
+int dlite_instance_publish(const DLiteInstance *inst, const char **names,
+                           size_t n)
+{
+  size_t i;
+  if (!inst || !inst->meta) return errx(1, "invalid instance");
+  if (names) {
+    for (i=0; i<n; i++)
+      if (dlite_meta_get_property_index(inst->meta, names[i]) < 0)
+        return 1;
+  }
+  return _emit(inst, NULL, names, n, NULL);
+}
+
+/*
+  Emits a change event for instance `inst` after saving it.
+ */
+int dlite_instance_notify(const DLiteInstance *inst, const char *location,
+                          const unsigned char *changed)
+{
+  return _emit(inst, location, NULL, 0, changed);
+}
+
+
+/*
+  Opens a receiver of events sent to `url`.
+ */
+DLiteNotifyReceiver *dlite_notify_receiver_open(const char *url)
+{
+#ifdef _WIN32
+  _socket_path(url);
+  return NULL;
+#else
+  DLiteNotifyReceiver *r=NULL;
+  struct sockaddr_un addr;
+  const char *path;
+  if (!(path = _socket_path(url))) return NULL;
+  if (!(r = calloc(1, sizeof(DLiteNotifyReceiver))))
+    return err(1, "allocation failure"), NULL;
+  r->sock = -1;
+  if (!(r->path = strdup(path)) || !(r->buf = malloc(NOTIFY_MAX_MESSAGE + 1)))
+    FAIL("allocation failure");
+  if ((r->sock = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+    FAIL("cannot create socket");
+  fcntl(r->sock, F_SETFD, FD_CLOEXEC);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+  if (bind(r->sock, (struct sockaddr *)&addr, sizeof(addr)))
+    FAIL1("cannot bind socket to '%s'", path);
+  return r;
+ fail:
+  if (r->sock >= 0) close(r->sock);
+  r->sock = -1;
+  dlite_notify_receiver_close(r);
+  return NULL;
+#endif
+}
+
+/*
+  Closes receiver `r` and removes its socket.
+ */
+void dlite_notify_receiver_close(DLiteNotifyReceiver *r)
+{
+  if (!r) return;
+#ifndef _WIN32
+  if (r->sock >= 0) {
+    close(r->sock);
+    unlink(r->path);
+  }
+#endif
+  if (r->path) free(r->path);
+  if (r->buf) free(r->buf);
+  if (r->tokens) free(r->tokens);
+  free(r);
+}
+
+/*
+  Returns the file descriptor of receiver `r`.
+ */
+int dlite_notify_receiver_fd(const DLiteNotifyReceiver *r)
+{
+  return r->sock;
+}
+
+/* Unescapes JSON string token `t` of `js` in place and returns it.
+   Only ASCII \u escapes are decoded, others are replaced with '?'. */
+static char *_unescape(char *js, const jsmntok_t *t)
+{
+  char *s = js + t->start, *q = s;
+  int i;
+  for (i=t->start; i < t->end; i++) {
+    if (js[i] != '\\' || i+1 >= t->end) {
+      *q++ = js[i];
+      continue;
+    }
+    switch (js[++i]) {
+    case 'b': *q++ = '\b'; break;
+    case 'f': *q++ = '\f'; break;
+    case 'n': *q++ = '\n'; break;
+    case 'r': *q++ = '\r'; break;
+    case 't': *q++ = '\t'; break;
+    case 'u':
+      if (i+4 < t->end) {
+        char hex[5];
+        long c;
+        memcpy(hex, js + i + 1, 4);
+        hex[4] = '\0';
+        c = strtol(hex, NULL, 16);
+        *q++ = (c > 0 && c < 0x80) ? (char)c : '?';
+        i += 4;
+      }
+      break;
+    default: *q++ = js[i];
+    }
+  }
+  *q = '\0';
+  return s;
+}
+
+/* Returns the string value of item `key` of object `t` in `js`, or
+   NULL if it is missing or null. */
+static const char *_get_string(char *js, const jsmntok_t *t, const char *key)
+{
+  const jsmntok_t *v = jsmn_item(js, t, key);
+  if (!v || v->type != JSMN_STRING) return NULL;
+  return _unescape(js, v);
+}
+
+/*
+  Waits for an event to arrive at receiver `r` and calls `cb` with it.
+ */
+int dlite_notify_receive(DLiteNotifyReceiver *r, int timeout,
+                         DLiteNotifyCallback cb, void *data)
+{
+#ifdef _WIN32
+  (void)r;
+  (void)timeout;
+  (void)cb;
+  (void)data;
+  return errx(1, "unix sockets are not supported on this platform"), -1;
+#else
+  struct pollfd pfd;
+  DLiteEvent event;
+  const jsmntok_t *t, *changed;
+  const char **names=NULL;
+  jsmn_parser parser;
+  ssize_t len;
+  int i, stat, retval=-1;
+
+  pfd.fd = r->sock;
+  pfd.events = POLLIN;
+  do {
+    stat = poll(&pfd, 1, timeout);
+  } while (stat < 0 && errno == EINTR);
+  if (stat < 0) return err(1, "error waiting for events"), -1;
+  if (stat == 0) return 0;
+  if ((len = recv(r->sock, r->buf, NOTIFY_MAX_MESSAGE, 0)) < 0)
+    return err(1, "error receiving event"), -1;
+  r->buf[len] = '\0';
+
+  jsmn_init(&parser);
+  if ((stat = jsmn_parse_alloc(&parser, r->buf, len, &r->tokens,
+                               &r->ntokens)) < 0)
+    return errx(1, "invalid event: %s", jsmn_strerror(stat)), -1;
+  if (stat == 0 || r->tokens->type != JSMN_OBJECT)
+    return errx(1, "invalid event: not a json object"), -1;
+
+  memset(&event, 0, sizeof(event));
+  event.uri = _get_string(r->buf, r->tokens, "uri");
+  event.metauri = _get_string(r->buf, r->tokens, "meta");
+  event.location = _get_string(r->buf, r->tokens, "location");
+  if ((t = jsmn_item(r->buf, r->tokens, "version")))
+    event.version = strtoull(r->buf + t->start, NULL, 10);
+  if ((changed = jsmn_item(r->buf, r->tokens, "changed")) &&
+      changed->type == JSMN_ARRAY) {
+    if (!(names = malloc((changed->size + 1)*sizeof(char *))))
+      FAIL("allocation failure");
+    for (i=0; i < changed->size; i++) {
+      if (!(t = jsmn_element(r->buf, changed, i)) || t->type != JSMN_STRING)
+        FAIL("invalid event: changed properties must be strings");
+      names[i] = _unescape(r->buf, t);
+    }
+    event.nchanged = changed->size;
+    event.changed = names;
+  }
+  if (!(event.uuid = _get_string(r->buf, r->tokens, "uuid")) ||
+      !event.metauri)
+    FAIL("invalid event: missing uuid or meta");
+  if (cb) cb(&event, data);
+  retval = 1;
+ fail:
+  if (names) free(names);
+  return retval;
+#endif
+}
@@ -0,0 +1,156 @@
+#ifndef _DLITE_NOTIFY_H
+#define _DLITE_NOTIFY_H
+
+/**
+  @file
+  @brief Publish/subscribe notification of instance changes
+
+  Consumers watching shared instances, like dashboards and coupled
+  codes, can subscribe to change events instead of polling storages.
+  An event is emitted each time an instance is saved and when an
+  instance is explicitly published with dlite_instance_publish().
+
+  An event holds the uuid, uri and metadata uri of the instance, a
+  version number and the names of the changed properties.  The
+  version starts at one and increases by one for each event of the
+  same instance emitted by the current process.  For an incremental
+  save (see dlite_instance_save()), the changed properties are the
+  properties that were written.  Otherwise all properties are listed.
+
+  Subscribers select instances with a glob pattern, matched against
+  the uuid, uri and metadata uri of the instance.  Events are
+  delivered over one of the following transports:
+
+    - in-process callbacks, see dlite_subscribe().  The callback is
+      called synchronously by the thread saving or publishing the
+      instance.  Other transports, like message queues, can be plugged
+      in as callbacks.
+    - Unix datagram sockets, see dlite_subscribe_url().  Each event is
+      sent as one datagram holding a JSON object:
+
+          {"uuid": "...", "uri": "...", "meta": "...", "version": 3,
+           "location": "...", "changed": ["temperature", "pressure"]}
+
+      where `"uri"` and `"location"` may be null.  `"changed"` is null
+      if the list of changed properties is too long to fit in a
+      datagram.  Sending never blocks.  Events are dropped if no one
+      is receiving or the receiver is behind.  Use
+      dlite_notify_receiver_open() to receive such events, possibly
+      in another process.
+
+  When there are no subscribers, the cost of saving an instance is
+  unchanged.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dlite-entity.h"
+
+
+/** A change event */
+typedef struct _DLiteEvent {
+  const char *uuid;      /*!< UUID of the instance */
+  const char *uri;       /*!< URI of the instance, may be NULL */
+  const char *metauri;   /*!< URI of the metadata of the instance */
+  uint64_t version;      /*!< Event number of this instance */
+  const char *location;  /*!< Location of the storage the instance was
+                              saved to.  NULL if published explicitly */
+  size_t nchanged;       /*!< Number of changed properties */
+  const char **changed;  /*!< Names of changed properties.  If NULL,
+                              any property may have changed */
+} DLiteEvent;
+
+/**
+  Callback receiving change event `event`.  `data` is the pointer
+  provided when subscribing.  The event is only valid during the call.
+ */
+typedef void (*DLiteNotifyCallback)(const DLiteEvent *event, void *data);
+
+/** Receiver of events sent to a Unix socket. */
+typedef struct _DLiteNotifyReceiver DLiteNotifyReceiver;
+
+
+/**
+  Subscribes to change events of instances whose uuid, uri or metadata
+  uri matches the glob pattern `pattern`.  If `pattern` is NULL, all
+  instances match.  `cb` is called with `data` for each event.
+
+  Returns a positive subscription id or -1 on error.
+ */
+int dlite_subscribe(const char *pattern, DLiteNotifyCallback cb, void *data);
+
+/**
+  Like dlite_subscribe(), but sends the events to `url`.  Currently
+  only Unix datagram sockets, given as `unix:PATH`, are supported.
+
+  Returns a positive subscription id or -1 on error.
+ */
+int dlite_subscribe_url(const char *pattern, const char *url);
+
+/**
+  Cancels subscription `id`.  A callback may still be called by events
+  emitted concurrently by other threads.
+
+  Returns non-zero if there is no such subscription.
+ */
+int dlite_unsubscribe(int id);
+
+/**
+  Returns the number of subscriptions.
+ */
+size_t dlite_notify_count(void);
+
+/**
+  Emits a change event for instance `inst`, telling that the `n`
+  properties in `names` have changed.  If `names` is NULL, all
+  properties are listed.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_publish(const DLiteInstance *inst, const char **names,
+                           size_t n);
+
+/**
+  Emits a change event for instance `inst` after it has been saved to
+  the storage at `location`.  `changed` is an array of flags telling
+  which properties were written or NULL if all properties were
+  written.
+
+  This is called by dlite_instance_save() and friends.  Returns
+  non-zero on error.
+ */
+int dlite_instance_notify(const DLiteInstance *inst, const char *location,
+                          const unsigned char *changed);
+
+/**
+  Opens a receiver of events sent to `url`, which should be of the
+  form `unix:PATH`.  A socket is created at PATH, replacing any
+  existing socket.
+
+  Returns NULL on error.
+ */
+DLiteNotifyReceiver *dlite_notify_receiver_open(const char *url);
+
+/**
+  Closes receiver `r` and removes its socket.
+ */
+void dlite_notify_receiver_close(DLiteNotifyReceiver *r);
+
+/**
+  Returns the file descriptor of receiver `r`, for use in an event
+  loop.
+ */
+int dlite_notify_receiver_fd(const DLiteNotifyReceiver *r);
+
+/**
+  Waits at most `timeout` milliseconds for an event to arrive at
+  receiver `r` and calls `cb` with it and `data`.  A negative
+  `timeout` waits forever.
+
+  Returns 1 if an event was received, 0 on timeout and -1 on error.
+ */
+int dlite_notify_receive(DLiteNotifyReceiver *r, int timeout,
+                         DLiteNotifyCallback cb, void *data);
+
+#endif /* _DLITE_NOTIFY_H */
@@ -0,0 +1,392 @@
+/* dlite-numa.c -- NUMA-aware placement of instances and property arrays
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# if defined(SYS_mbind) && defined(SYS_move_pages)
+#  define HAVE_NUMA
+# endif
+#endif
+
+#include "utils/err.h"
+#include "utils/thread.h"
+#include "dlite-entity.h"
+#include "dlite-numa.h"
+
+/* Memory policies and flags from <numaif.h>, which is not required */
+#define NUMA_MPOL_BIND       2
+#define NUMA_MPOL_INTERLEAVE 3
+#define NUMA_MPOL_MF_MOVE    (1<<1)
+
+/* Size of the header before each allocation.  Also the alignment of
+   the returned memory. */
+#define NUMA_HEADER 64
+
+/* Allocations of at least this size are mapped directly, such that
+   they can be placed and are not written to by the allocator. */
+#define NUMA_MMAP_THRESHOLD (64*1024)
+
+/* Maximum number of pages passed to move_pages() in one call */
+#define NUMA_MOVE_CHUNK 1024
+
+
+/* Placement of an allocator, passed as allocator data */
+typedef struct {
+  DLiteNumaPolicy policy;
+  int node;
+} Placement;
+
+/* Header before each allocation */
+typedef struct {
+  size_t size;     /* requested size */
+  int mapped;      /* whether the allocation is mapped */
+} Header;
+
+
+/*
+  Returns the number of NUMA nodes, or 1 if NUMA is not supported.
+ */
+int dlite_numa_nnodes(void)
+{
+#ifdef HAVE_NUMA
+  static int nnodes=0;
+  if (!nnodes) {
+    /* The last number in e.g. "0-3" or "0,2" is the highest node */
+    FILE *fp = fopen("/sys/devices/system/node/possible", "r");
+    char buf[256], *p;
+    int n=1;
+    if (fp && fgets(buf, sizeof(buf), fp)) {
+      for (p=buf + strlen(buf); p > buf && !(p[-1] >= '0' && p[-1] <= '9');)
+        *--p = '\0';
+      while (p > buf && p[-1] >= '0' && p[-1] <= '9') p--;
+      n = atoi(p) + 1;
+    }
+    if (fp) fclose(fp);
+    if (n < 1) n = 1;
+    if (n > DLITE_NUMA_MAX_NODES) n = DLITE_NUMA_MAX_NODES;
+    nnodes = n;
+  }
+  return nnodes;
+#else
+  return 1;
+#endif
+}
+
+
+#ifdef HAVE_NUMA
+
+/* Returns the size of a mapping holding `size` bytes and the header. */
+static size_t mapped_size(size_t size)
+{
+  size_t pagesize = sysconf(_SC_PAGESIZE);
+  return (size + NUMA_HEADER + pagesize - 1) & ~(pagesize - 1);
+}
+
+/* Applies placement `pl` to the mapping `addr` of length `len`.
+   Failures are ignored, since placement is a hint. */
+static void place(void *addr, size_t len, const Placement *pl)
+{
+  unsigned long mask=0;
+  int mode;
+  switch (pl->policy) {
+  case dliteNumaInterleave:
+    mode = NUMA_MPOL_INTERLEAVE;
+    mask = (dlite_numa_nnodes() >= 64) ?
+      ~0UL : (1UL << dlite_numa_nnodes()) - 1;
+    break;
+  case dliteNumaBind:
+    mode = NUMA_MPOL_BIND;
+    mask = 1UL << pl->node;
+    break;
+  default:
+    return;
+  }
+  syscall(SYS_mbind, addr, len, mode, &mask, DLITE_NUMA_MAX_NODES + 1, 0);
+}
+
+/* Allocates `size` bytes with placement `pl`.  Memory is zeroed if
+   `zero` is non-zero.  Mapped memory is always zeroed. */
+static void *numa_alloc(size_t size, int zero, const Placement *pl)
+{
+  Header *h;
+  if (size > (size_t)-1 - NUMA_HEADER - NUMA_MMAP_THRESHOLD) return NULL;
+  if (size + NUMA_HEADER >= NUMA_MMAP_THRESHOLD) {
+    size_t len = mapped_size(size);
+    void *addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) return NULL;
+    place(addr, len, pl);
+    h = addr;
+    h->mapped = 1;
+  } else {
+    if (!(h = (zero) ? calloc(1, size + NUMA_HEADER) :
+          malloc(size + NUMA_HEADER))) return NULL;
+    h->mapped = 0;
+  }
+  h->size = size;
+  return (char *)h + NUMA_HEADER;
+}
+
+static void numa_free(void *ptr, void *data)
+{
+  Header *h = (Header *)((char *)ptr - NUMA_HEADER);
+  (void)data;
+  if (!ptr) return;
+  if (h->mapped)
+    munmap(h, mapped_size(h->size));
+  else
+    free(h);
+}
+
+static void *numa_malloc(size_t size, void *data)
+{
+  return numa_alloc(size, 0, data);
+}
+
+static void *numa_calloc(size_t nmemb, size_t size, void *data)
+{
+  if (size && nmemb > (size_t)-1 / size) return NULL;
+  return numa_alloc(nmemb * size, 1, data);
+}
+
+static void *numa_realloc(void *ptr, size_t size, void *data)
+{
+  Header *h = (Header *)((char *)ptr - NUMA_HEADER);
+  void *q;
+  if (!ptr) return numa_alloc(size, 0, data);
+  if (!h->mapped && size + NUMA_HEADER < NUMA_MMAP_THRESHOLD) {
+    if (!(h = realloc(h, size + NUMA_HEADER))) return NULL;
+    h->size = size;
+    return (char *)h + NUMA_HEADER;
+  }
+  if (h->mapped && mapped_size(size) == mapped_size(h->size)) {
+    h->size = size;
+    return ptr;
+  }
+  if (!(q = numa_alloc(size, 0, data))) return NULL;
+  memcpy(q, ptr, (size < h->size) ? size : h->size);
+  numa_free(ptr, data);
+  return q;
+}
+
+
+/* Allocators and their placements */
+static Placement first_touch = {dliteNumaFirstTouch, 0};
+static Placement interleave = {dliteNumaInterleave, 0};
+static Placement bind_placements[DLITE_NUMA_MAX_NODES];
+static DLiteAllocator first_touch_allocator = {
+  numa_malloc, numa_calloc, numa_realloc, numa_free, &first_touch
+};
+static DLiteAllocator interleave_allocator = {
+  numa_malloc, numa_calloc, numa_realloc, numa_free, &interleave
+};
+static DLiteAllocator bind_allocators[DLITE_NUMA_MAX_NODES];
+static ThreadMutex bind_mutex = THREAD_MUTEX_INITIALIZER;
+
+#endif  /* HAVE_NUMA */
+
+
+/*
+  Returns an allocator placing memory according to `policy`.  `node`
+  is the node to bind to with the `dliteNumaBind` policy and ignored
+  otherwise.
+
+  Returns NULL for the `dliteNumaDefault` policy or if NUMA is not
+  supported.
+ */
+const DLiteAllocator *dlite_numa_allocator(DLiteNumaPolicy policy, int node)
+{
+#ifdef HAVE_NUMA
+  DLiteAllocator *a;
+  switch (policy) {
+  case dliteNumaDefault:
+    return NULL;
+  case dliteNumaFirstTouch:
+    return &first_touch_allocator;
+  case dliteNumaInterleave:
+    return &interleave_allocator;
+  case dliteNumaBind:
+    if (node < 0 || node >= dlite_numa_nnodes())
+      return errx(1, "no such NUMA node: %d", node), NULL;
+    a = bind_allocators + node;
+    thread_mutex_lock(&bind_mutex);
+    if (!a->malloc) {
+      bind_placements[node].policy = dliteNumaBind;
+      bind_placements[node].node = node;
+      a->calloc = numa_calloc;
+      a->realloc = numa_realloc;
+      a->free = numa_free;
+      a->data = bind_placements + node;
+      a->malloc = numa_malloc;
+    }
+    thread_mutex_unlock(&bind_mutex);
+    return a;
+  }
+  return errx(1, "invalid NUMA policy: %d", policy), NULL;
+#else
+  if (policy == dliteNumaBind && (node < 0 || node >= dlite_numa_nnodes()))
+    return errx(1, "no such NUMA node: %d", node), NULL;
+  return NULL;
+#endif
+}
+
+/*
+  Sets the allocator for new instances in the current globals to
+  dlite_numa_allocator(policy, node).
+
+  Returns non-zero on error.
+ */
+int dlite_numa_set_policy(DLiteNumaPolicy policy, int node)
+{
+  if ((int)policy < 0 || policy > dliteNumaBind)
+    return errx(1, "invalid NUMA policy: %d", policy);
+  if (policy == dliteNumaBind && (node < 0 || node >= dlite_numa_nnodes()))
+    return errx(1, "no such NUMA node: %d", node);
+  dlite_instance_set_allocator(dlite_numa_allocator(policy, node));
+  return 0;
+}
+
+
+/* Stores the memory range of property `i` of `inst` in `*ptr` and
+   `*nbytes`.  For dimensional properties this is the array. */
+static void prop_range(const DLiteInstance *inst, size_t i, void **ptr,
+                       size_t *nbytes)
+{
+  const DLiteProperty *p = inst->meta->_properties + i;
+  if (p->ndims > 0 && p->dims) {
+    size_t nmemb=1;
+    int j;
+    for (j=0; j<p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+    *ptr = *(void **)DLITE_PROP(inst, i);
+    *nbytes = (*ptr) ? nmemb * p->size : 0;
+  } else {
+    *ptr = DLITE_PROP(inst, i);
+    *nbytes = p->size;
+  }
+}
+
+#ifdef HAVE_NUMA
+
+/* Moves the pages in `pages` to `node`, or interleaves them if `node`
+   is negative.  Returns non-zero on error. */
+static int migrate(void **pages, size_t npages, int node)
+{
+  int nodes[NUMA_MOVE_CHUNK], status[NUMA_MOVE_CHUNK];
+  int nnodes = dlite_numa_nnodes();
+  size_t i, n;
+  for (i=0; i<npages; i+=n) {
+    size_t k;
+    n = (npages - i < NUMA_MOVE_CHUNK) ? npages - i : NUMA_MOVE_CHUNK;
+    for (k=0; k<n; k++)
+      nodes[k] = (node >= 0) ? node : (int)((i + k) % nnodes);
+    if (syscall(SYS_move_pages, 0, (unsigned long)n, pages + i, nodes,
+                status, NUMA_MPOL_MF_MOVE) < 0)
+      return err(1, "cannot migrate pages: %s", strerror(errno));
+  }
+  return 0;
+}
+
+/* Appends the pages of the range `ptr`, `nbytes` to `*pages`.
+   Returns non-zero on error. */
+static int add_pages(void ***pages, size_t *npages, size_t *size,
+                     const void *ptr, size_t nbytes)
+{
+  size_t pagesize = sysconf(_SC_PAGESIZE);
+  size_t addr, begin = (size_t)ptr & ~(pagesize - 1);
+  if (!ptr || !nbytes) return 0;
+  for (addr=begin; addr < (size_t)ptr + nbytes; addr+=pagesize) {
+    if (*npages && (size_t)(*pages)[*npages - 1] == addr) continue;
+    if (*npages >= *size) {
+      size_t newsize = (*size) ? 2 * *size : 64;
+      void **q = realloc(*pages, newsize * sizeof(void *));
+      if (!q) return err(1, "allocation failure");
+      *pages = q;
+      *size = newsize;
+    }
+    (*pages)[(*npages)++] = (void *)addr;
+  }
+  return 0;
+}
+
+#endif  /* HAVE_NUMA */
+
+
+/*
+  Migrates the property arrays of instance `inst` to NUMA node `node`.
+  If `node` is negative, the pages are interleaved over all nodes.
+
+  If `i` is non-negative, only property `i` is migrated.  Otherwise
+  all property arrays and the instance itself are migrated.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_numa_migrate(DLiteInstance *inst, int i, int node)
+{
+  if (i >= (int)inst->meta->_nproperties)
+    return errx(1, "index %d exceeds number of properties (%d) in %s",
+                i, (int)inst->meta->_nproperties, inst->meta->uri);
+  if (node >= dlite_numa_nnodes())
+    return errx(1, "no such NUMA node: %d", node);
+#ifdef HAVE_NUMA
+  {
+    void **pages=NULL, *ptr;
+    size_t n, nbytes, npages=0, size=0;
+    int retval=1;
+    if (i >= 0) {
+      prop_range(inst, i, &ptr, &nbytes);
+      if (add_pages(&pages, &npages, &size, ptr, nbytes)) goto fail;
+    } else {
+      if (add_pages(&pages, &npages, &size, inst, DLITE_INSTANCE_SIZE(inst)))
+        goto fail;
+      for (n=0; n < inst->meta->_nproperties; n++) {
+        if (inst->meta->_properties[n].ndims <= 0) continue;
+        prop_range(inst, n, &ptr, &nbytes);
+        if (add_pages(&pages, &npages, &size, ptr, nbytes)) goto fail;
+      }
+    }
+    retval = migrate(pages, npages, node);
+  fail:
+    free(pages);
+    return retval;
+  }
+#else
+  return 0;
+#endif
+}
+
+/*
+  Returns the NUMA node of the first page of property `i` of `inst`,
+  or of the instance itself if `i` is negative.
+
+  Returns -1 if the node cannot be determined.
+ */
+int dlite_instance_numa_node(const DLiteInstance *inst, int i)
+{
+#ifdef HAVE_NUMA
+  void *ptr=(void *)inst, *page;
+  size_t nbytes=1, pagesize = sysconf(_SC_PAGESIZE);
+  int status=-1;
+  if (i >= (int)inst->meta->_nproperties) return -1;
+  if (i >= 0) prop_range(inst, i, &ptr, &nbytes);
+  if (!ptr || !nbytes) return -1;
+  page = (void *)((size_t)ptr & ~(pagesize - 1));
+  if (syscall(SYS_move_pages, 0, 1UL, &page, NULL, &status, 0) < 0)
+    return -1;
+  return (status >= 0) ? status : -1;
+#else
+  (void)inst;
+  (void)i;
+  (void)prop_range;
+  return -1;
+#endif
+}
@@ -0,0 +1,94 @@
+#ifndef _DLITE_NUMA_H
+#define _DLITE_NUMA_H
+
+/**
+  @file
+  @brief NUMA-aware placement of instances and property arrays
+
+  On machines with several NUMA nodes, memory is by default placed on
+  the node of the thread that first writes to it.  Property arrays of
+  instances loaded by one thread hence end up on the node of that
+  thread, and compute threads running on other nodes access remote
+  memory.
+
+  This module provides allocators (see dlite_instance_set_allocator())
+  that place new instances and their property arrays according to a
+  placement policy, and functions for migrating the arrays of an
+  existing instance to another node.
+
+  The allocators return zeroed memory for large arrays without writing
+  to it.  With the `dliteNumaFirstTouch` policy, the pages of a
+  property array are therefore placed on the nodes of the threads that
+  fill it.  Arrays filled concurrently, like by dlite_copy_to_flat(),
+  are spread over the nodes of the copying threads.
+
+  Placement is a hint.  On systems without NUMA support (currently
+  all but Linux), the allocators are NULL, i.e. the standard
+  allocator, and migration is a no-op.
+ */
+
+#include "dlite-entity.h"
+
+/** Maximum number of NUMA nodes supported. */
+#define DLITE_NUMA_MAX_NODES 64
+
+
+/** Placement policies */
+typedef enum {
+  dliteNumaDefault,     /*!< Standard allocator, no placement. */
+  dliteNumaFirstTouch,  /*!< Pages are placed on the node of the thread
+                             that first writes to them. */
+  dliteNumaInterleave,  /*!< Pages are interleaved over all nodes. */
+  dliteNumaBind         /*!< Pages are bound to a given node. */
+} DLiteNumaPolicy;
+
+
+/**
+  Returns the number of NUMA nodes, or 1 if NUMA is not supported.
+ */
+int dlite_numa_nnodes(void);
+
+/**
+  Returns an allocator placing memory according to `policy`.  `node`
+  is the node to bind to with the `dliteNumaBind` policy and ignored
+  otherwise.
+
+  Returns NULL for the `dliteNumaDefault` policy or if NUMA is not
+  supported.  The returned allocator is static and may be passed to
+  dlite_instance_set_allocator().
+ */
+const DLiteAllocator *dlite_numa_allocator(DLiteNumaPolicy policy, int node);
+
+/**
+  Convenience function that sets the allocator for new instances in
+  the current globals to dlite_numa_allocator(policy, node).
+
+  Returns non-zero on error.
+ */
+int dlite_numa_set_policy(DLiteNumaPolicy policy, int node);
+
+/**
+  Migrates the property arrays of instance `inst` to NUMA node `node`.
+  If `node` is negative, the pages are interleaved over all nodes.
+
+  If `i` is non-negative, only property `i` is migrated.  Otherwise
+  all property arrays and the instance itself are migrated.
+
+  Pages shared with other memory are migrated as well.  Pages that
+  are not yet written to are skipped.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_numa_migrate(DLiteInstance *inst, int i, int node);
+
+/**
+  Returns the NUMA node of the first page of property `i` of `inst`,
+  or of the instance itself if `i` is negative.
+
+  Returns -1 if the node cannot be determined, e.g. if NUMA is not
+  supported or the property has no data.
+ */
+int dlite_instance_numa_node(const DLiteInstance *inst, int i);
+
+
+#endif /* _DLITE_NUMA_H */
@@ -0,0 +1,405 @@
+/* dlite-query.c -- predicates over scalar properties of instances
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utils/err.h"
+#include "dlite-macros.h"
+#include "dlite-entity.h"
+#include "dlite-query.h"
+
+
+/* Parser state */
+typedef struct {
+  const DLiteMeta *meta;    /* metadata */
+  const char *src;          /* predicate */
+  const char *p;            /* current position */
+} Parser;
+
+/* Value of an evaluated node */
+typedef struct {
+  double number;
+  const char *string;       /* NULL for numbers */
+} Value;
+
+
+/* Frees node `n` and its children. */
+static void node_free(DLiteQueryNode *n)
+{
+  if (!n) return;
+  node_free(n->left);
+  node_free(n->right);
+  if (n->string) free(n->string);
+  free(n);
+}
+
+/* Returns a new node of type `op` with operands `left` and `right`.
+   The operands are freed on error. */
+static DLiteQueryNode *node_new(DLiteQueryOp op, DLiteQueryNode *left,
+                                DLiteQueryNode *right)
+{
+  DLiteQueryNode *n;
+  if (!(n = calloc(1, sizeof(DLiteQueryNode)))) {
+    node_free(left);
+    node_free(right);
+    return err(1, "allocation failure"), NULL;
+  }
+  n->op = op;
+  n->left = left;
+  n->right = right;
+  return n;
+}
+
+/* Reports a syntax error at the current position and returns NULL. */
+static DLiteQueryNode *syntax_error(Parser *ps, const char *msg)
+{
+  errx(1, "%s at position %d in predicate: %s", msg, (int)(ps->p - ps->src),
+       ps->src);
+  return NULL;
+}
+
+/* Skips whitespace. */
+static void skip_space(Parser *ps)
+{
+  while (isspace((unsigned char)*ps->p)) ps->p++;
+}
+
+/* Returns the comparison operator at the current position and advances
+   past it, or -1 if there is none. */
+static int parse_cmpop(Parser *ps)
+{
+  const char *p = ps->p;
+  int op=-1, len=1;
+  switch (p[0]) {
+  case '=': op = dliteQueryEq; if (p[1] == '=') len = 2; break;
+  case '!': if (p[1] == '=') { op = dliteQueryNe; len = 2; } break;
+  case '<':
+    if (p[1] == '=') { op = dliteQueryLe; len = 2; } else op = dliteQueryLt;
+    break;
+  case '>':
+    if (p[1] == '=') { op = dliteQueryGe; len = 2; } else op = dliteQueryGt;
+    break;
+  }
+  if (op >= 0) ps->p += len;
+  return op;
+}
+
+static DLiteQueryNode *parse_or(Parser *ps);
+
+/* Parses a value: number, string, property name or parenthesised
+   expression. */
+static DLiteQueryNode *parse_value(Parser *ps)
+{
+  DLiteQueryNode *n;
+  skip_space(ps);
+  if (*ps->p == '(') {
+    ps->p++;
+    if (!(n = parse_or(ps))) return NULL;
+    skip_space(ps);
+    if (*ps->p != ')') {
+      node_free(n);
+      return syntax_error(ps, "expected ')'");
+    }
+    ps->p++;
+  } else if (*ps->p == '"' || *ps->p == '\'') {
+    char quote = *ps->p++, *q;
+    const char *p;
+    size_t len=0;
+    for (p=ps->p; *p && *p != quote; p++, len++)
+      if (*p == '\\' && p[1]) p++;
+    if (!*p) return syntax_error(ps, "unterminated string");
+    if (!(n = node_new(dliteQueryString, NULL, NULL))) return NULL;
+    if (!(n->string = q = malloc(len + 1))) {
+      node_free(n);
+      return err(1, "allocation failure"), NULL;
+    }
+    for (p=ps->p; *p != quote; p++) {
+      if (*p == '\\' && p[1]) p++;
+      *q++ = *p;
+    }
+    *q = '\0';
+    n->isstring = 1;
+    ps->p = p + 1;
+  } else if (isdigit((unsigned char)*ps->p) || *ps->p == '-' ||
+             *ps->p == '+' || *ps->p == '.') {
+    char *endptr;
+    double v = strtod(ps->p, &endptr);
+    if (endptr == ps->p) return syntax_error(ps, "invalid number");
+    if (!(n = node_new(dliteQueryNumber, NULL, NULL))) return NULL;
+    n->number = v;
+    ps->p = endptr;
+  } else if (isalpha((unsigned char)*ps->p) || *ps->p == '_') {
+    const char *start = ps->p;
+    size_t i, len;
+    while (isalnum((unsigned char)*ps->p) || *ps->p == '_') ps->p++;
+    len = ps->p - start;
+    for (i=0; i < ps->meta->_nproperties; i++) {
+      const char *name = ps->meta->_properties[i].name;
+      if (strncmp(name, start, len) == 0 && name[len] == '\0') break;
+    }
+    if (i >= ps->meta->_nproperties)
+      return errx(1, "no property '%.*s' in %s", (int)len, start,
+                  ps->meta->uri), NULL;
+    if (ps->meta->_properties[i].ndims > 0)
+      return errx(1, "property '%.*s' in predicate is not a scalar",
+                  (int)len, start), NULL;
+    switch (ps->meta->_properties[i].type) {
+    case dliteBool:
+    case dliteInt:
+    case dliteUInt:
+    case dliteFloat:
+    case dliteFixString:
+    case dliteStringPtr:
+      break;
+    default:
+      return errx(1, "cannot use property '%.*s' of type %s in predicate",
+                  (int)len, start,
+                  dlite_type_get_dtypename(ps->meta->_properties[i].type)),
+        NULL;
+    }
+    if (!(n = node_new(dliteQueryProperty, NULL, NULL))) return NULL;
+    n->index = i;
+    n->isstring = (ps->meta->_properties[i].type == dliteFixString ||
+                   ps->meta->_properties[i].type == dliteStringPtr);
+  } else {
+    return syntax_error(ps, (*ps->p) ? "unexpected character" :
+                        "unexpected end");
+  }
+  return n;
+}
+
+/* Parses a comparison or a single value. */
+static DLiteQueryNode *parse_cmp(Parser *ps)
+{
+  DLiteQueryNode *left, *right;
+  int op;
+  if (!(left = parse_value(ps))) return NULL;
+  skip_space(ps);
+  if ((op = parse_cmpop(ps)) < 0) return left;
+  if (!(right = parse_value(ps))) {
+    node_free(left);
+    return NULL;
+  }
+  if (left->isstring != right->isstring) {
+    node_free(left);
+    node_free(right);
+    return syntax_error(ps, "cannot compare string with number");
+  }
+  return node_new(op, left, right);
+}
+
+/* Parses logical not. */
+static DLiteQueryNode *parse_not(Parser *ps)
+{
+  DLiteQueryNode *n;
+  skip_space(ps);
+  if (ps->p[0] == '!' && ps->p[1] != '=') {
+    ps->p++;
+    if (!(n = parse_not(ps))) return NULL;
+    return node_new(dliteQueryNot, n, NULL);
+  }
+  return parse_cmp(ps);
+}
+
+/* Parses logical and. */
+static DLiteQueryNode *parse_and(Parser *ps)
+{
+  DLiteQueryNode *left, *right;
+  if (!(left = parse_not(ps))) return NULL;
+  while (skip_space(ps), *ps->p == '&') {
+    ps->p++;
+    if (*ps->p == '&') ps->p++;
+    if (!(right = parse_not(ps))) {
+      node_free(left);
+      return NULL;
+    }
+    if (!(left = node_new(dliteQueryAnd, left, right))) return NULL;
+  }
+  return left;
+}
+
+/* Parses logical or. */
+static DLiteQueryNode *parse_or(Parser *ps)
+{
+  DLiteQueryNode *left, *right;
+  if (!(left = parse_and(ps))) return NULL;
+  while (skip_space(ps), *ps->p == '|') {
+    ps->p++;
+    if (*ps->p == '|') ps->p++;
+    if (!(right = parse_and(ps))) {
+      node_free(left);
+      return NULL;
+    }
+    if (!(left = node_new(dliteQueryOr, left, right))) return NULL;
+  }
+  return left;
+}
+
+
+/*
+  Compiles predicate `predicate` over the scalar properties of
+  instances of metadata `metaid`.
+ */
+DLiteQuery *dlite_query_compile(const char *metaid, const char *predicate)
+{
+  DLiteQuery *q=NULL;
+  Parser ps;
+
+  if (!(q = calloc(1, sizeof(DLiteQuery)))) FAIL("allocation failure");
+  if (!(q->meta = dlite_meta_get(metaid)))
+    FAIL1("cannot find metadata '%s'", metaid);
+  if (!q->meta->_propoffsets && dlite_meta_init(q->meta)) goto fail;
+  if (predicate) predicate += strspn(predicate, " \t\n\r\f\v");
+  if (predicate && *predicate) {
+    if (!(q->predicate = strdup(predicate))) FAIL("allocation failure");
+    ps.meta = q->meta;
+    ps.src = ps.p = q->predicate;
+    if (!(q->root = parse_or(&ps))) goto fail;
+    skip_space(&ps);
+    if (*ps.p) {
+      syntax_error(&ps, "unexpected character");
+      goto fail;
+    }
+  }
+  return q;
+ fail:
+  dlite_query_free(q);
+  return NULL;
+}
+
+/*
+  Frees query `q`.
+ */
+void dlite_query_free(DLiteQuery *q)
+{
+  if (!q) return;
+  node_free(q->root);
+  if (q->predicate) free(q->predicate);
+  if (q->meta) dlite_meta_decref(q->meta);
+  free(q);
+}
+
+
+/* Evaluates the value of node `n` for `inst` and stores it in `v`.
+   Returns non-zero on error. */
+static int eval_value(const DLiteQueryNode *n, const DLiteInstance *inst,
+                      Value *v)
+{
+  const DLiteProperty *p;
+  const void *ptr;
+  v->number = 0.0;
+  v->string = NULL;
+  switch (n->op) {
+  case dliteQueryNumber:
+    v->number = n->number;
+    return 0;
+  case dliteQueryString:
+    v->string = n->string;
+    return 0;
+  case dliteQueryProperty:
+    break;
+  default:
+    return errx(1, "invalid value node in predicate");
+  }
+  p = inst->meta->_properties + n->index;
+  ptr = DLITE_PROP(inst, n->index);
+  switch (p->type) {
+  case dliteBool:
+    v->number = (*(bool *)ptr) ? 1.0 : 0.0;
+    return 0;
+  case dliteInt:
+    switch (p->size) {
+    case 1: v->number = *(int8_t *)ptr; return 0;
+    case 2: v->number = *(int16_t *)ptr; return 0;
+    case 4: v->number = *(int32_t *)ptr; return 0;
+    case 8: v->number = (double)*(int64_t *)ptr; return 0;
+    }
+    break;
+  case dliteUInt:
+    switch (p->size) {
+    case 1: v->number = *(uint8_t *)ptr; return 0;
+    case 2: v->number = *(uint16_t *)ptr; return 0;
+    case 4: v->number = *(uint32_t *)ptr; return 0;
+    case 8: v->number = (double)*(uint64_t *)ptr; return 0;
+    }
+    break;
+  case dliteFloat:
+    switch (p->size) {
+    case sizeof(float): v->number = *(float *)ptr; return 0;
+    case sizeof(double): v->number = *(double *)ptr; return 0;
+    }
+    break;
+  case dliteFixString:
+    v->string = ptr;
+    return 0;
+  case dliteStringPtr:
+    v->string = (*(char **)ptr) ? *(char **)ptr : "";
+    return 0;
+  default:
+    break;
+  }
+  return errx(1, "cannot use property '%s' of type %s and size %d in "
+              "predicate", p->name, dlite_type_get_dtypename(p->type),
+              (int)p->size);
+}
+
+/* Returns 1 if node `n` is true for `inst`, 0 if it is false and a
+   negative value on error. */
+static int eval(const DLiteQueryNode *n, const DLiteInstance *inst)
+{
+  Value a, b;
+  double c;
+  int r;
+  switch (n->op) {
+  case dliteQueryOr:
+    if ((r = eval(n->left, inst))) return r;
+    return eval(n->right, inst);
+  case dliteQueryAnd:
+    if ((r = eval(n->left, inst)) <= 0) return r;
+    return eval(n->right, inst);
+  case dliteQueryNot:
+    if ((r = eval(n->left, inst)) < 0) return r;
+    return !r;
+  case dliteQueryNumber:
+  case dliteQueryString:
+  case dliteQueryProperty:
+    if (eval_value(n, inst, &a)) return -1;
+    return (a.string) ? (a.string[0] != '\0') : (a.number != 0.0);
+  default:
+    break;
+  }
+  if (eval_value(n->left, inst, &a) || eval_value(n->right, inst, &b))
+    return -1;
+  c = (a.string) ? strcmp(a.string, b.string) : a.number - b.number;
+  switch (n->op) {
+  case dliteQueryEq: return c == 0;
+  case dliteQueryNe: return c != 0;
+  case dliteQueryLt: return c < 0;
+  case dliteQueryLe: return c <= 0;
+  case dliteQueryGt: return c > 0;
+  case dliteQueryGe: return c >= 0;
+  default: break;
+  }
+  return errx(-1, "invalid node in predicate");
+}
+
+/*
+  Returns 1 if `inst` matches query `q`, 0 if it does not and a
+  negative value on error.
+ */
+int dlite_query_match(const DLiteQuery *q, const DLiteInstance *inst)
+{
+  if (inst->meta != q->meta &&
+      (!inst->meta->uri || strcmp(inst->meta->uri, q->meta->uri) != 0))
+    return 0;
+  if (!q->root) return 1;
+  return eval(q->root, inst);
+}
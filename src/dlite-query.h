@@ -0,0 +1,93 @@
+#ifndef _DLITE_QUERY_H
+#define _DLITE_QUERY_H
+
+/**
+  @file
+  @brief Predicates over scalar properties of instances
+
+  A predicate is a small infix expression over the scalar properties
+  of instances of a given metadata, like
+
+      temperature > 800 & (alloy = "AA6060" | alloy = 'AA6082')
+
+  The following operators are supported, in order of increasing
+  precedence:
+
+      |                   logical or
+      &                   logical and
+      !                   logical not
+      = == != < <= > >=   comparisons
+
+  Operands are property names, numbers and quoted strings.  Numerical
+  properties (bool, int, uint and float) are compared as numbers and
+  string properties (string and fixstring) are compared as strings.  A
+  NULL string compares equal to the empty string.  An operand used as
+  a condition is true if it is a non-zero number or a non-empty
+  string.
+
+  A predicate is compiled to a tree, which storage plugins may
+  translate to a native query (see dlite_storage_query()).
+ */
+
+#include "dlite-entity.h"
+
+
+/** Node types */
+typedef enum _DLiteQueryOp {
+  dliteQueryOr,          /*!< Logical or */
+  dliteQueryAnd,         /*!< Logical and */
+  dliteQueryNot,         /*!< Logical not, the operand is `left` */
+  dliteQueryEq,          /*!< Equal */
+  dliteQueryNe,          /*!< Not equal */
+  dliteQueryLt,          /*!< Less than */
+  dliteQueryLe,          /*!< Less than or equal */
+  dliteQueryGt,          /*!< Greater than */
+  dliteQueryGe,          /*!< Greater than or equal */
+  dliteQueryProperty,    /*!< Value of property `index` */
+  dliteQueryNumber,      /*!< Number literal */
+  dliteQueryString       /*!< String literal */
+} DLiteQueryOp;
+
+/** A node in a compiled predicate */
+typedef struct _DLiteQueryNode {
+  DLiteQueryOp op;                /*!< Node type */
+  struct _DLiteQueryNode *left;   /*!< Left operand, NULL for values */
+  struct _DLiteQueryNode *right;  /*!< Right operand, NULL for values
+                                       and logical not */
+  int isstring;                   /*!< Whether the node is a string value */
+  size_t index;                   /*!< Property index */
+  double number;                  /*!< Value of number literal */
+  char *string;                   /*!< Value of string literal */
+} DLiteQueryNode;
+
+/** A compiled predicate */
+typedef struct _DLiteQuery {
+  DLiteMeta *meta;                /*!< Metadata of matching instances */
+  char *predicate;                /*!< Source of the predicate */
+  DLiteQueryNode *root;           /*!< Root node, NULL matches all */
+} DLiteQuery;
+
+
+/**
+  Compiles predicate `predicate` over the scalar properties of
+  instances of metadata `metaid`.  A NULL or empty predicate matches
+  all instances of `metaid`.
+
+  Returns a new query that should be released with dlite_query_free()
+  or NULL on error.
+ */
+DLiteQuery *dlite_query_compile(const char *metaid, const char *predicate);
+
+/**
+  Frees query `q`.
+ */
+void dlite_query_free(DLiteQuery *q);
+
+/**
+  Returns 1 if `inst` matches query `q`, 0 if it does not and a
+  negative value on error.  Instances of other metadata never match.
+ */
+int dlite_query_match(const DLiteQuery *q, const DLiteInstance *inst);
+
+
+#endif /* _DLITE_QUERY_H */
@@ -0,0 +1,199 @@
+/* dlite-record.c -- recording of storage accesses
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/thread.h"
+#include "utils/trace.h"
+#include "dlite.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-record.h"
+
+/* State of the recorder, protected by `record_mutex` */
+static FILE *record_fp = NULL;
+static int record_on = 0;
+static uint64_t record_epoch = 0;
+static map_int_t record_storages;  /* maps storage address to number */
+static int record_nstorages = 0;
+static int record_atexit = 0;
+static ThreadMutex record_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Writes string `s` as a field to the trace, with tabs and newlines
+   replaced by spaces. */
+static void put_field(const char *s)
+{
+  fputc('\t', record_fp);
+  if (!s) return;
+  for (; *s; s++)
+    fputc((*s == '\t' || *s == '\n' || *s == '\r') ? ' ' : *s, record_fp);
+}
+
+/* Writes the common fields of an event. */
+static void put_event(DLiteRecordOp op, int n, uint64_t t0, uint64_t t1)
+{
+  fprintf(record_fp, "%c\t%d\t%llu\t%llu", op, n,
+          (unsigned long long)(t0 - record_epoch),
+          (unsigned long long)(t1 - t0));
+}
+
+/* Returns the number of storage `s` in the trace, assigning a new
+   number if `s` is not already known.  For storages opened before
+   the recording started, an open event with zero duration is written.
+   Must be called with `record_mutex` locked. */
+static int storage_number(const DLiteStorage *s, int open, uint64_t t0)
+{
+  char key[32];
+  int *ip, n;
+  snprintf(key, sizeof(key), "%p", (void *)s);
+  if (!open && (ip = map_get(&record_storages, key))) return *ip;
+  n = ++record_nstorages;
+  map_set(&record_storages, key, n);
+  if (!open) {
+    put_event(dliteRecordOpen, n, t0, t0);
+    put_field(s->api->name);
+    put_field(s->location);
+    put_field(s->options);
+    fputc('\n', record_fp);
+  }
+  return n;
+}
+
+/* Stops recording at exit. */
+static void record_exit(void)
+{
+  dlite_record_stop();
+}
+
+
+/*
+  Starts recording storage accesses to `filename`.
+ */
+int dlite_record_start(const char *filename)
+{
+  int retval=1;
+  thread_mutex_lock(&record_mutex);
+  if (record_fp) {
+    errx(1, "storage accesses are already recorded");
+    goto fail;
+  }
+  if (!(record_fp = fopen(filename, "w"))) {
+    err(1, "cannot open trace file: %s", filename);
+    goto fail;
+  }
+  fprintf(record_fp, "#dlite-record 1\n");
+  map_init(&record_storages);
+  record_nstorages = 0;
+  record_epoch = trace_now();
+  if (!record_atexit) {
+    atexit(record_exit);
+    record_atexit = 1;
+  }
+  thread_atomic_add(&record_on, 1);
+  retval = 0;
+ fail:
+  thread_mutex_unlock(&record_mutex);
+  return retval;
+}
+
+/*
+  Stops recording and closes the trace.
+ */
+int dlite_record_stop(void)
+{
+  int retval=0;
+  thread_mutex_lock(&record_mutex);
+  if (record_fp) {
+    thread_atomic_add(&record_on, -1);
+    if (fclose(record_fp)) retval = err(1, "error closing trace file");
+    record_fp = NULL;
+    map_deinit(&record_storages);
+  }
+  thread_mutex_unlock(&record_mutex);
+  return retval;
+}
+
+/*
+  Returns non-zero if storage accesses are recorded.
+ */
+int dlite_record_enabled(void)
+{
+  return thread_atomic_load(&record_on);
+}
+
+/*
+  Returns the start time of a call to record, or zero if recording is
+  disabled.
+ */
+uint64_t dlite_record_begin(void)
+{
+  return (thread_atomic_load(&record_on)) ? trace_now() : 0;
+}
+
+/*
+  Records that storage `s` was opened.
+ */
+void dlite_record_open(const DLiteStorage *s, const char *driver,
+                       const char *location, const char *options,
+                       uint64_t t0)
+{
+  uint64_t t1;
+  if (!t0) return;
+  t1 = trace_now();
+  thread_mutex_lock(&record_mutex);
+  if (record_fp) {
+    put_event(dliteRecordOpen, storage_number(s, 1, t0), t0, t1);
+    put_field(driver);
+    put_field(location);
+    put_field(options);
+    fputc('\n', record_fp);
+  }
+  thread_mutex_unlock(&record_mutex);
+}
+
+/*
+  Records that storage `s` was closed.
+ */
+void dlite_record_close(const DLiteStorage *s, uint64_t t0)
+{
+  char key[32];
+  uint64_t t1;
+  if (!t0) return;
+  t1 = trace_now();
+  snprintf(key, sizeof(key), "%p", (void *)s);
+  thread_mutex_lock(&record_mutex);
+  if (record_fp) {
+    put_event(dliteRecordClose, storage_number(s, 0, t0), t0, t1);
+    fputc('\n', record_fp);
+    map_remove(&record_storages, key);
+  }
+  thread_mutex_unlock(&record_mutex);
+}
+
+/*
+  Records load, save or get property operation `op`.
+ */
+void dlite_record_io(const DLiteStorage *s, DLiteRecordOp op,
+                     const char *id, const char *property, size_t nbytes,
+                     uint64_t t0)
+{
+  uint64_t t1;
+  if (!t0) return;
+  t1 = trace_now();
+  thread_mutex_lock(&record_mutex);
+  if (record_fp) {
+    put_event(op, storage_number(s, 0, t0), t0, t1);
+    fprintf(record_fp, "\t%lu", (unsigned long)nbytes);
+    put_field(id);
+    if (op == dliteRecordGetProperty) put_field(property);
+    fputc('\n', record_fp);
+  }
+  thread_mutex_unlock(&record_mutex);
+}
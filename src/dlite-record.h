@@ -0,0 +1,114 @@
+#ifndef _DLITE_RECORD_H
+#define _DLITE_RECORD_H
+
+/**
+  @file
+  @brief Recording of storage accesses
+
+  When recording is enabled, every call to a storage plugin for
+  opening or closing a storage, loading or saving an instance and
+  reading a property through the data model api is written as one line
+  to a trace file, together with its time, duration and the number of
+  bytes transferred.  The trace can be replayed against another driver
+  with the `dlite-replay` tool to compare storage backends on real
+  access patterns.
+
+  Recording is enabled by setting the environment variable
+  `DLITE_RECORD` to the name of the trace file, or by calling
+  dlite_record_start().
+
+  The trace is a text file with one event per line and tab-separated
+  fields.  The first line is a header `#dlite-record 1`.  The fields
+  of each event are
+
+      O  storage  time  duration  driver  location  options
+      C  storage  time  duration
+      L  storage  time  duration  nbytes  id
+      S  storage  time  duration  nbytes  id
+      P  storage  time  duration  nbytes  id  property
+
+  for open (O), close (C), load (L), save (S) and get property (P),
+  respectively.  `storage` is a number identifying the storage within
+  the trace, `time` is the start time in nanoseconds since recording
+  started and `duration` the duration of the call in nanoseconds.
+  `nbytes` is the in-memory size of the loaded or saved instance or
+  property.  Tabs and newlines in strings are written as spaces.
+ */
+
+#include <stdint.h>
+
+#include "dlite-entity.h"
+#include "dlite-storage.h"
+
+
+/** Recorded operations. */
+typedef enum _DLiteRecordOp {
+  dliteRecordOpen='O',      /*!< Open storage */
+  dliteRecordClose='C',     /*!< Close storage */
+  dliteRecordLoad='L',      /*!< Load instance */
+  dliteRecordSave='S',      /*!< Save instance */
+  dliteRecordGetProperty='P'  /*!< Read property with the data model api */
+} DLiteRecordOp;
+
+
+/**
+  Starts recording storage accesses to `filename`.  An existing file
+  is overwritten.  The trace is closed by dlite_record_stop() or at
+  exit.
+
+  Returns non-zero on error, e.g. if recording already is started.
+ */
+int dlite_record_start(const char *filename);
+
+/**
+  Stops recording and closes the trace.  Returns non-zero on error.
+ */
+int dlite_record_stop(void);
+
+/**
+  Returns non-zero if storage accesses are recorded.
+ */
+int dlite_record_enabled(void);
+
+
+/**
+  @name Functions for recording events
+  Mostly intended for internal use.  A zero start time `t0` means
+  that recording was disabled when the call started, in which case
+  nothing is recorded.
+  @{
+ */
+
+/**
+  Returns the start time of a call to record, or zero if recording is
+  disabled.
+ */
+uint64_t dlite_record_begin(void);
+
+/**
+  Records that storage `s` was opened with `driver`, `location` and
+  `options`, starting at time `t0`.
+ */
+void dlite_record_open(const DLiteStorage *s, const char *driver,
+                       const char *location, const char *options,
+                       uint64_t t0);
+
+/**
+  Records that storage `s` was closed, starting at time `t0`.  Must be
+  called before `s` is free'ed, but after the plugin close call.
+ */
+void dlite_record_close(const DLiteStorage *s, uint64_t t0);
+
+/**
+  Records operation `op` (load, save or get property) of instance `id`
+  in storage `s` transferring `nbytes` bytes, starting at time `t0`.
+  `property` is the name of the property for dliteRecordGetProperty
+  and otherwise ignored.
+ */
+void dlite_record_io(const DLiteStorage *s, DLiteRecordOp op,
+                     const char *id, const char *property, size_t nbytes,
+                     uint64_t t0);
+
+/** @} */
+
+#endif /* _DLITE_RECORD_H */
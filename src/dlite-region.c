@@ -0,0 +1,279 @@
+/* dlite-region.c -- reference counted memory regions for adopted arrays
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/thread.h"
+#include "dlite-misc.h"
+#include "dlite-macros.h"
+#include "dlite-region.h"
+
+#define GLOBALS_ID "dlite-region-registry"
+
+/* Registry of attached arrays, mapping pointers to their regions.  The
+   mutex also protects the reference counts of all regions.
+
+   The registry is stored in the global state, such that it is shared
+   with plugins linked with their own copy of this file.  It is created
+   together with the first region and is freed with the global state,
+   after which regions are no longer released. */
+typedef struct {
+  ThreadMutex mutex;
+  map_void_t arrays;
+} Registry;
+
+static ThreadMutex registry_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Frees the registry. */
+static void registry_free(void *registry)
+{
+  Registry *r = registry;
+  map_deinit(&r->arrays);
+  thread_mutex_destroy(&r->mutex);
+  free(r);
+}
+
+/* Returns the registry, which is created if `create` is non-zero.
+   Returns NULL if it doesn't exist or on error. */
+static Registry *get_registry(int create)
+{
+  Registry *r = dlite_globals_get_state(GLOBALS_ID);
+  if (!r && create) {
+    thread_mutex_lock(&registry_mutex);
+    if (!(r = dlite_globals_get_state(GLOBALS_ID))) {
+      if ((r = calloc(1, sizeof(Registry)))) {
+        thread_mutex_init(&r->mutex);
+        map_init(&r->arrays);
+        dlite_globals_add_state(GLOBALS_ID, r, registry_free);
+      }
+    }
+    thread_mutex_unlock(&registry_mutex);
+    if (!r) return err(1, "allocation failure"), NULL;
+  }
+  return r;
+}
+
+/* Releases the memory of region `r` and frees it. */
+static void region_free(DLiteRegion *r)
+{
+  if (r->freer)
+    r->freer(r);
+  else
+    free(r->base);
+  free(r);
+}
+
+
+/*
+  Returns a new region for the `size` bytes of memory at `base`,
+  which is released with `freer` when the last reference to the region
+  is released.  If `freer` is NULL, free() is used.
+ */
+DLiteRegion *dlite_region_create(void *base, size_t size,
+                                 DLiteRegionFreer freer)
+{
+  DLiteRegion *r;
+  if (!get_registry(1)) return NULL;
+  if (!(r = calloc(1, sizeof(DLiteRegion))))
+    return err(1, "allocation failure"), NULL;
+  r->addr = base;
+  r->size = size;
+  r->base = base;
+  r->basesize = size;
+  r->freer = freer;
+  r->refcount = 1;
+  return r;
+}
+
+#ifdef HAVE_MMAP
+/* Unmaps region `r`. */
+static void unmap(DLiteRegion *r)
+{
+  munmap(r->base, r->basesize);
+}
+#endif
+
+/*
+  Returns a new region with the content of file `path`.  Returns NULL
+  on error.
+ */
+DLiteRegion *dlite_region_map_file(const char *path, size_t align)
+{
+  DLiteRegion *r;
+  void *base;
+  size_t size;
+#ifdef HAVE_MMAP
+  int fd;
+  struct stat st;
+  UNUSED(align);
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return err(1, "cannot open \"%s\"", path), NULL;
+  if (fstat(fd, &st) || st.st_size <= 0) {
+    close(fd);
+    return err(1, "cannot determine size of \"%s\"", path), NULL;
+  }
+  size = st.st_size;
+  base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return err(1, "cannot memory map \"%s\"", path), NULL;
+  if (!(r = dlite_region_create(base, size, unmap))) {
+    munmap(base, size);
+    return NULL;
+  }
+#else
+  FILE *fp;
+  long len;
+  char *addr;
+  if (!(fp = fopen(path, "rb")))
+    return err(1, "cannot open \"%s\"", path), NULL;
+  if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) <= 0 ||
+      fseek(fp, 0, SEEK_SET)) {
+    fclose(fp);
+    return err(1, "cannot determine size of \"%s\"", path), NULL;
+  }
+  size = len;
+  if (!(base = malloc(size + align))) {
+    fclose(fp);
+    return err(1, "allocation failure"), NULL;
+  }
+  addr = (char *)align_up((uintptr_t)base, align);
+  if (fread(addr, 1, size, fp) != size) {
+    fclose(fp);
+    free(base);
+    return err(1, "cannot read \"%s\"", path), NULL;
+  }
+  fclose(fp);
+  if (!(r = dlite_region_create(base, size + align, NULL))) {
+    free(base);
+    return NULL;
+  }
+  r->addr = addr;
+  r->size = size;
+#endif
+  return r;
+}
+
+/*
+  Increases the reference count of region `r`.
+ */
+void dlite_region_incref(DLiteRegion *r)
+{
+  Registry *reg = get_registry(1);
+  if (reg) thread_mutex_lock(&reg->mutex);
+  r->refcount++;
+  if (reg) thread_mutex_unlock(&reg->mutex);
+}
+
+/*
+  Decreases the reference count of region `r` and releases it when
+  the count reaches zero.
+ */
+void dlite_region_decref(DLiteRegion *r)
+{
+  Registry *reg = get_registry(1);
+  int refcount;
+  if (reg) thread_mutex_lock(&reg->mutex);
+  refcount = --r->refcount;
+  if (reg) thread_mutex_unlock(&reg->mutex);
+  if (refcount <= 0) region_free(r);
+}
+
+/*
+  Records that the array `ptr` in region `r` holds a reference to `r`.
+  Returns non-zero on error or if `ptr` is already attached.
+ */
+int dlite_region_attach(DLiteRegion *r, const void *ptr)
+{
+  Registry *reg;
+  char key[32];
+  int stat=0;
+  if (!(reg = get_registry(1))) return 1;
+  PTR_KEY(key, ptr);
+  thread_mutex_lock(&reg->mutex);
+  if (map_get(&reg->arrays, key))
+    stat = 2;
+  else if (map_set(&reg->arrays, key, r))
+    stat = 1;
+  else
+    r->refcount++;
+  thread_mutex_unlock(&reg->mutex);
+  if (stat == 2) return errx(1, "array %p is already attached to a region",
+                             ptr);
+  if (stat) return err(1, "cannot attach array to region");
+  return 0;
+}
+
+/*
+  Releases the reference to a region held by the attached array `ptr`.
+ */
+void dlite_region_release(void *ptr)
+{
+  Registry *reg = get_registry(0);
+  DLiteRegion *r=NULL, **q;
+  char key[32];
+  int refcount=1;
+  if (!reg) return;
+  PTR_KEY(key, ptr);
+  thread_mutex_lock(&reg->mutex);
+  if ((q = (DLiteRegion **)map_get(&reg->arrays, key))) {
+    r = *q;
+    map_remove(&reg->arrays, key);
+    refcount = --r->refcount;
+  }
+  thread_mutex_unlock(&reg->mutex);
+  if (refcount <= 0) region_free(r);
+}
+
+/*
+  Lets property `i` of `inst` adopt the array `ptr` in region `data`.
+  Returns zero on success and -1 on error.
+ */
+int dlite_region_adopt(DLiteInstance *inst, size_t i, void *ptr, void *data)
+{
+  DLiteRegion *r = data;
+  if (dlite_region_attach(r, ptr)) return -1;
+  if (dlite_instance_adopt_property_by_index(inst, i, ptr,
+                                             dlite_region_release)) {
+    dlite_region_release(ptr);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+  Returns a new reference to the region that array `ptr` is attached
+  to, or NULL if `ptr` is not attached.
+ */
+DLiteRegion *dlite_region_find(const void *ptr)
+{
+  Registry *reg = get_registry(0);
+  DLiteRegion *r=NULL, **q;
+  char key[32];
+  if (!reg) return NULL;
+  PTR_KEY(key, ptr);
+  thread_mutex_lock(&reg->mutex);
+  if ((q = (DLiteRegion **)map_get(&reg->arrays, key))) {
+    r = *q;
+    r->refcount++;
+  }
+  thread_mutex_unlock(&reg->mutex);
+  return r;
+}
@@ -0,0 +1,112 @@
+#ifndef _DLITE_REGION_H
+#define _DLITE_REGION_H
+
+/**
+  @file
+  @brief Reference counted memory regions for adopted arrays
+
+  A region is a block of memory, typically a memory mapped file, from
+  which instances adopt property arrays directly instead of copying
+  them (see dlite_instance_adopt_property_by_index()).  The region is
+  kept alive until the last array adopted from it is released.
+
+  The owner of a region holds one reference, which it releases with
+  dlite_region_decref() when it no longer needs the region.  Each
+  attached array holds one more reference, which is released by
+  dlite_region_release().  Attached arrays are recorded in a global
+  registry keyed by their pointer, so releasing an array is a single
+  lookup.
+ */
+
+#include <stddef.h>
+
+#include "dlite-entity.h"
+
+
+typedef struct _DLiteRegion DLiteRegion;
+
+/** Function releasing the memory of region `r` when its last reference
+    is released.  It should not free `r` itself. */
+typedef void (*DLiteRegionFreer)(DLiteRegion *r);
+
+/** A reference counted memory region. */
+struct _DLiteRegion {
+  char *addr;               /*!< Start of content. */
+  size_t size;              /*!< Size of content in bytes. */
+  void *base;               /*!< Start of the memory to release. */
+  size_t basesize;          /*!< Size of the memory to release. */
+  DLiteRegionFreer freer;   /*!< Releases the memory, NULL for free(). */
+  void *data;               /*!< User data, not used by DLite. */
+  int refcount;             /*!< Number of references. */
+};
+
+
+/**
+  Returns a new region for the `size` bytes of memory at `base`,
+  which is released with `freer` when the last reference to the region
+  is released.  If `freer` is NULL, free() is used.
+
+  The content of the region (`addr` and `size`) initially covers the
+  whole memory.  The caller may narrow it and assign `data` before the
+  region is shared.
+
+  The caller holds the only reference.  Returns NULL on error, in which
+  case the caller still owns `base`.
+ */
+DLiteRegion *dlite_region_create(void *base, size_t size,
+                                 DLiteRegionFreer freer);
+
+/**
+  Returns a new region with the content of file `path`.  Where mmap()
+  is available, the file is mapped copy-on-write, so pages are read on
+  demand and modifications are private to the process.  Otherwise the
+  file is read into memory aligned to `align` bytes.
+
+  Returns NULL on error.
+ */
+DLiteRegion *dlite_region_map_file(const char *path, size_t align);
+
+/**
+  Increases the reference count of region `r`.
+ */
+void dlite_region_incref(DLiteRegion *r);
+
+/**
+  Decreases the reference count of region `r` and releases it when
+  the count reaches zero.
+ */
+void dlite_region_decref(DLiteRegion *r);
+
+/**
+  Records that the array `ptr` in region `r` holds a reference to `r`.
+  The reference is released by calling dlite_region_release() with
+  `ptr`, which is hence a valid DLiteDeallocator for the array.
+
+  Returns non-zero on error or if `ptr` is already attached.
+ */
+int dlite_region_attach(DLiteRegion *r, const void *ptr);
+
+/**
+  Releases the reference to a region held by the attached array `ptr`.
+  Does nothing if `ptr` is not attached.
+ */
+void dlite_region_release(void *ptr);
+
+/**
+  Lets property `i` of `inst` adopt the array `ptr` in region `data`,
+  which is attached to the region.  Has the signature of
+  DLiteBinRecordAdopt, such that it can be passed to
+  dlite_binrecord_decode() with the region as data.
+
+  Returns zero on success and -1 on error.
+ */
+int dlite_region_adopt(DLiteInstance *inst, size_t i, void *ptr, void *data);
+
+/**
+  Returns a new reference to the region that array `ptr` is attached
+  to, or NULL if `ptr` is not attached.  No error is reported.
+ */
+DLiteRegion *dlite_region_find(const void *ptr);
+
+
+#endif /* _DLITE_REGION_H */
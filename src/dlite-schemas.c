@@ -117,6 +117,7 @@ static struct _BasicMetadataSchema {
   "a8194052-7d3b-530f-ba1e-7e82fd51bf31",        /* uuid (corresponds to uri) */
   DLITE_BASIC_METADATA_SCHEMA,                   /* uri */
   1,                                             /* _refcount, never free */
+  0,                                             /* _flags */
   (DLiteMeta *)&basic_metadata_schema,           /* meta */
   NULL,                                          /* iri */
 
@@ -144,6 +145,12 @@ static struct _BasicMetadataSchema {
   offsetof(struct _BasicMetadataSchema, relations),    /* _reloffset */
   offsetof(struct _BasicMetadataSchema, __propdims),   /* _propdimsoffset */
   offsetof(struct _BasicMetadataSchema, __propdiminds),/* _propdimindsoffset */
+  NULL,                                                /* _nameindex */
+  NULL,                                                /* _propdimscode */
+  NULL,                                                /* _pool */
+  NULL,                                                /* _jsonparser */
+  NULL,                                                /* _hotprops */
+  NULL,                                             /* _sparseprops */
   /* -- length of each dimention */
   3,                                             /* ndimensions */
   7,                                             /* nproperties */
@@ -273,6 +280,7 @@ static struct _EntitySchema {
   "46168985-705c-5029-b856-3ee1cccccefc",     /* uuid (corresponds to uri) */
   DLITE_ENTITY_SCHEMA,                        /* uri */
   1,                                          /* _refcount, never free */
+  0,                                          /* _flags */
   (DLiteMeta *)&basic_metadata_schema,        /* meta */
   NULL,                                       /* iri */
 
@@ -300,6 +308,12 @@ static struct _EntitySchema {
   0,                                          /* _reloffset */
   0,                                          /* _propdimsoffset */
   0,                                          /* _propdimindsoffset */
+  NULL,                                       /* _nameindex */
+  NULL,                                       /* _propdimscode */
+  NULL,                                       /* _pool */
+  NULL,                                       /* _jsonparser */
+  NULL,                                       /* _hotprops */
+  NULL,                                    /* _sparseprops */
   /* -- length of each dimention */
   2,                                          /* ndimensions */
   6,                                          /* nproperties */
@@ -371,6 +385,7 @@ static struct _CollectionEntity {
   "96f31fc3-3838-5cb8-8d90-eddee6ff59ca",        /* uuid (corresponds to uri) */
   DLITE_COLLECTION_ENTITY,                       /* uri */
   1,                                             /* _refcount, never free */
+  0,                                             /* _flags */
   (DLiteMeta *)&entity_schema,                   /* meta */
   NULL,                                          /* iri */
 
@@ -398,6 +413,12 @@ static struct _CollectionEntity {
   0,                                             /* _reloffset */
   0,                                             /* _propdimsoffset */
   0,                                             /* _propdimindsoffset */
+  NULL,                                          /* _nameindex */
+  NULL,                                          /* _propdimscode */
+  NULL,                                          /* _pool */
+  NULL,                                          /* _jsonparser */
+  NULL,                                          /* _hotprops */
+  NULL,                                       /* _sparseprops */
   /* -- length of each dimention */
   1,                                             /* ndimensions */
   1,                                             /* nproperties */
@@ -0,0 +1,500 @@
+/* dlite-snapshot.c -- warm-start snapshots of the in-memory instance store
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/fileinfo.h"
+#include "utils/fileutils.h"
+#include "utils/scheduler.h"
+#include "pathshash.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-binrecord.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-snapshot.h"
+
+#define SNAPSHOT_MAGIC     "DLITESNP"   /* 8 bytes, not NUL-terminated */
+#define SNAPSHOT_VERSION   1
+#define SNAPSHOT_BYTEORDER DLITE_BINRECORD_BYTEORDER
+#define SNAPSHOT_ALIGN     DLITE_BINRECORD_ALIGN  /* alignment of records */
+
+/* Size of the path hash in bytes */
+#define HASHSIZE 32
+
+
+/*
+  File layout (all offsets are from the start of the file):
+
+      SnapshotHeader
+      SnapshotEntry[ninst]      in order of increasing rank
+      SnapshotFile[nfiles]      storage files the snapshot is keyed by
+      uint64_t plugins[nplugins] offsets of storage plugin names
+      string table              NUL-terminated strings
+      records                   binary records aligned to SNAPSHOT_ALIGN
+*/
+
+/* File header */
+typedef struct {
+  char magic[8];                  /* SNAPSHOT_MAGIC */
+  uint32_t byteorder;             /* SNAPSHOT_BYTEORDER */
+  uint32_t version;               /* SNAPSHOT_VERSION */
+  unsigned char hash[HASHSIZE];   /* pathshash() of the storage files */
+  uint64_t size;                  /* size of the file */
+  uint64_t ninst;                 /* number of instances */
+  uint64_t index;                 /* offset of the entries */
+  uint64_t nfiles;                /* number of storage files */
+  uint64_t files;                 /* offset of the storage files */
+  uint64_t nplugins;              /* number of storage plugins */
+  uint64_t plugins;               /* offset of the storage plugins */
+} SnapshotHeader;
+
+/* An instance in the snapshot */
+typedef struct {
+  char uuid[DLITE_UUID_LENGTH+3]; /* uuid, padded to 8 bytes */
+  uint64_t offset;                /* offset of binary record */
+  uint64_t size;                  /* size of binary record */
+  uint64_t rank;                  /* decoding rank */
+} SnapshotEntry;
+
+/* A storage file the snapshot is keyed by */
+typedef struct {
+  double mtime;                   /* modification time */
+  uint64_t location;              /* offset of location string */
+} SnapshotFile;
+
+
+/********************************************************************
+ * Saving
+ ********************************************************************/
+
+/* Maximum nesting depth of collections considered by get_rank() */
+#define MAX_NESTING 32
+
+/* An instance to save and its rank */
+typedef struct {
+  DLiteInstance *inst;      /* new reference to instance */
+  size_t rank;              /* decoding rank, see get_rank() */
+} Item;
+
+/* Help struct used while saving a snapshot */
+typedef struct {
+  Item *items;              /* instances to save */
+  size_t nitems;            /* number of instances */
+  size_t itemsize;          /* allocated length of `items` */
+  int failed;               /* set if `items` cannot be reallocated */
+} Collector;
+
+/* Callback for dlite_instance_store_foreach() adding a reference to
+   `inst` to the collector `data`. */
+static int collect(const DLiteInstance *inst, void *data)
+{
+  Collector *c = data;
+  if (c->nitems >= c->itemsize) {
+    size_t size = (c->itemsize) ? 2*c->itemsize : 256;
+    void *ptr = realloc(c->items, size*sizeof(Item));
+    if (!ptr) return c->failed = 1;
+    c->items = ptr;
+    c->itemsize = size;
+  }
+  dlite_instance_incref((DLiteInstance *)inst);
+  c->items[c->nitems].inst = (DLiteInstance *)inst;
+  c->items[c->nitems].rank = 0;
+  c->nitems++;
+  return 0;
+}
+
+/* Returns the number of metadata levels above the basic metadata
+   schema of `inst`. */
+static size_t get_level(const DLiteInstance *inst)
+{
+  size_t level = 0;
+  while (inst->meta && (const DLiteInstance *)inst->meta != inst) {
+    inst = (const DLiteInstance *)inst->meta;
+    level++;
+  }
+  return level;
+}
+
+/* Returns the decoding rank of `inst`.  Instances must be decoded after
+   all instances of lower rank.
+
+   The rank of an instance is its metadata level, such that metadata
+   are decoded before their instances.  Since decoding a collection
+   gets all its members, collections rank above their members.  The
+   relations of collections must be synchronised before calling this
+   function. */
+static size_t get_rank(const DLiteInstance *inst, int depth)
+{
+  const DLiteCollection *coll = (const DLiteCollection *)inst;
+  size_t i, rank = get_level(inst);
+  if (inst->meta != dlite_get_collection_entity() || depth >= MAX_NESTING)
+    return rank;
+  for (i=0; i < coll->nrelations; i++) {
+    const DLiteRelation *r = coll->relations + i;
+    const DLiteInstance *member;
+    size_t rank2;
+    if (!r->p || strcmp(r->p, "_has-uuid") || !r->o) continue;
+    if (!(member = dlite_instance_has(r->o, 0))) continue;
+    if ((rank2 = get_rank(member, depth+1) + 1) > rank) rank = rank2;
+  }
+  return rank;
+}
+
+/* Compares items by rank and uuid. */
+static int cmp_rank(const void *a, const void *b)
+{
+  const Item *p = a, *q = b;
+  if (p->rank != q->rank) return (p->rank < q->rank) ? -1 : 1;
+  return strcmp(p->inst->uuid, q->inst->uuid);
+}
+
+/* Appends string `s` to the string table `*strtab` of length `*len`.
+   Returns the offset of `s` in the string table or -1 on error. */
+static long append_string(char **strtab, size_t *len, const char *s)
+{
+  size_t n = strlen(s) + 1, pos = *len;
+  char *ptr = realloc(*strtab, *len + n);
+  if (!ptr) return err(1, "allocation failure"), -1;
+  memcpy(ptr + pos, s, n);
+  *strtab = ptr;
+  *len += n;
+  return (long)pos;
+}
+
+/*
+  Saves all instances in the in-memory instance store to a snapshot
+  file `path`.  Returns non-zero on error.
+ */
+int dlite_snapshot_save(const char *path)
+{
+  Collector c;
+  SnapshotHeader h;
+  SnapshotEntry *entries=NULL;
+  SnapshotFile *files=NULL;
+  uint64_t *plugins=NULL;
+  FUPaths paths;
+  DLiteStoragePluginIter *iter=NULL;
+  const DLiteStoragePlugin *api;
+  const char **locations;
+  char *records=NULL, *strtab=NULL, *tmpname=NULL;
+  size_t i, size=0, pos=0, strtablen=0, nfiles=0, nplugins=0, start, hsize;
+  FILE *fp=NULL;
+  int stat=1;
+
+  memset(&c, 0, sizeof(c));
+  if (fu_paths_init(&paths, NULL) < 0) return 1;
+
+  /* take references to the instances, such that the instance store
+     is not locked while encoding them */
+  if (dlite_instance_store_foreach(collect, &c) < 0) goto fail;
+  if (c.failed) FAIL("allocation failure");
+  for (i=0; i < c.nitems; i++)
+    if (dlite_instance_sync_to_properties(c.items[i].inst)) goto fail;
+  for (i=0; i < c.nitems; i++)
+    c.items[i].rank = get_rank(c.items[i].inst, 0);
+  qsort(c.items, c.nitems, sizeof(Item), cmp_rank);
+
+  if (c.nitems && !(entries = calloc(c.nitems, sizeof(SnapshotEntry))))
+    FAIL("allocation failure");
+  for (i=0; i < c.nitems; i++) {
+    const DLiteInstance *inst = c.items[i].inst;
+    int n;
+    if ((n = dlite_binrecord_encode(&records, &size, pos, inst)) < 0)
+      goto fail;
+    memcpy(entries[i].uuid, inst->uuid, DLITE_UUID_LENGTH+1);
+    entries[i].offset = pos;
+    entries[i].size = n;
+    entries[i].rank = c.items[i].rank;
+    pos += n;
+  }
+
+  /* storage files the snapshot is keyed by */
+  memset(&h, 0, sizeof(h));
+  if (dlite_metacache_files(&paths) || pathshash(h.hash, HASHSIZE, &paths))
+    goto fail;
+  nfiles = paths.n;
+  if (nfiles && !(files = calloc(nfiles, sizeof(SnapshotFile))))
+    FAIL("allocation failure");
+  locations = fu_paths_get(&paths);
+  for (i=0; i < nfiles; i++) {
+    long offset = append_string(&strtab, &strtablen, locations[i]);
+    if (offset < 0) goto fail;
+    files[i].mtime = fileinfo_mtime(locations[i]);
+    files[i].location = offset;
+  }
+
+  /* names of loaded storage plugins */
+  if (!(iter = dlite_storage_plugin_iter_create())) goto fail;
+  while ((api = dlite_storage_plugin_iter_next(iter))) {
+    long offset;
+    void *ptr;
+    if (!api->name) continue;
+    if (!(ptr = realloc(plugins, (nplugins + 1)*sizeof(uint64_t))))
+      FAIL("allocation failure");
+    plugins = ptr;
+    if ((offset = append_string(&strtab, &strtablen, api->name)) < 0)
+      goto fail;
+    plugins[nplugins++] = offset;
+  }
+
+  memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+  h.byteorder = SNAPSHOT_BYTEORDER;
+  h.version = SNAPSHOT_VERSION;
+  h.ninst = c.nitems;
+  h.index = sizeof(SnapshotHeader);
+  h.nfiles = nfiles;
+  h.files = h.index + c.nitems * sizeof(SnapshotEntry);
+  h.nplugins = nplugins;
+  h.plugins = h.files + nfiles * sizeof(SnapshotFile);
+  hsize = h.plugins + nplugins * sizeof(uint64_t);
+  start = align_up(hsize + strtablen, SNAPSHOT_ALIGN);
+  h.size = start + pos;
+  for (i=0; i < c.nitems; i++) entries[i].offset += start;
+  for (i=0; i < nfiles; i++) files[i].location += hsize;
+  for (i=0; i < nplugins; i++) plugins[i] += hsize;
+
+  if (!(tmpname = malloc(strlen(path) + 5))) FAIL("allocation failure");
+  sprintf(tmpname, "%s.tmp", path);
+  if (!(fp = fopen(tmpname, "wb")))
+    FAIL1("cannot write snapshot: %s", tmpname);
+  if (fwrite(&h, sizeof(h), 1, fp) != 1 ||
+      (c.nitems &&
+       fwrite(entries, sizeof(SnapshotEntry), c.nitems, fp) != c.nitems) ||
+      (nfiles && fwrite(files, sizeof(SnapshotFile), nfiles, fp) != nfiles) ||
+      (nplugins &&
+       fwrite(plugins, sizeof(uint64_t), nplugins, fp) != nplugins) ||
+      (strtablen && fwrite(strtab, 1, strtablen, fp) != strtablen))
+    FAIL1("error writing snapshot: %s", tmpname);
+  for (i=hsize + strtablen; i < start; i++) fputc('\0', fp);
+  if (pos && fwrite(records, 1, pos, fp) != pos)
+    FAIL1("error writing snapshot: %s", tmpname);
+  if (fclose(fp)) {
+    fp = NULL;
+    FAIL1("error writing snapshot: %s", tmpname);
+  }
+  fp = NULL;
+#ifdef _WIN32
+  remove(path);
+#endif
+  if (rename(tmpname, path))
+    FAIL1("cannot write snapshot: %s", path);
+  stat = 0;
+ fail:
+  if (fp) {
+    fclose(fp);
+    remove(tmpname);
+  }
+  if (tmpname) free(tmpname);
+  if (iter) dlite_storage_plugin_iter_free(iter);
+  for (i=0; i < c.nitems; i++) dlite_instance_decref(c.items[i].inst);
+  if (c.items) free(c.items);
+  if (records) free(records);
+  if (entries) free(entries);
+  if (files) free(files);
+  if (plugins) free(plugins);
+  if (strtab) free(strtab);
+  fu_paths_deinit(&paths);
+  return stat;
+}
+
+
+/********************************************************************
+ * Loading
+ ********************************************************************/
+
+/* Returns pointer to the NUL-terminated string at `offset` in mapping
+   `m`, or NULL if it is out of range. */
+static const char *get_string(const DLiteRegion *m, uint64_t offset)
+{
+  if (offset >= m->size || !memchr(m->addr + offset, '\0', m->size - offset))
+    return NULL;
+  return m->addr + offset;
+}
+
+/* Checks the header and the entries of the snapshot mapped by `m`.
+   Returns non-zero if the snapshot is inconsistent. */
+static int check_snapshot(const DLiteRegion *m, const char *path)
+{
+  const SnapshotHeader *h = (const SnapshotHeader *)m->addr;
+  const SnapshotEntry *entries;
+  const uint64_t *plugins;
+  size_t i;
+
+  if (m->size < sizeof(SnapshotHeader) ||
+      memcmp(h->magic, SNAPSHOT_MAGIC, 8) != 0)
+    return errx(1, "not a dlite snapshot: %s", path);
+  if (h->byteorder != SNAPSHOT_BYTEORDER)
+    return errx(1, "non-native byte order of snapshot: %s", path);
+  if (h->version != SNAPSHOT_VERSION)
+    return errx(1, "unsupported version %d of snapshot: %s",
+                (int)h->version, path);
+  if (h->size != m->size ||
+      h->index > m->size || h->ninst > m->size / sizeof(SnapshotEntry) ||
+      h->index + h->ninst * sizeof(SnapshotEntry) > m->size ||
+      h->files > m->size || h->nfiles > m->size / sizeof(SnapshotFile) ||
+      h->files + h->nfiles * sizeof(SnapshotFile) > m->size ||
+      h->plugins > m->size || h->nplugins > m->size / sizeof(uint64_t) ||
+      h->plugins + h->nplugins * sizeof(uint64_t) > m->size)
+    return errx(1, "corrupted snapshot: %s", path);
+  entries = (const SnapshotEntry *)(m->addr + h->index);
+  for (i=0; i < h->ninst; i++)
+    if (!memchr(entries[i].uuid, '\0', sizeof(entries[i].uuid)) ||
+        entries[i].offset % SNAPSHOT_ALIGN || entries[i].offset > m->size ||
+        entries[i].size > m->size - entries[i].offset ||
+        (i && entries[i].rank < entries[i-1].rank))
+      return errx(1, "corrupted snapshot: %s", path);
+  plugins = (const uint64_t *)(m->addr + h->plugins);
+  for (i=0; i < h->nplugins; i++)
+    if (!get_string(m, plugins[i]))
+      return errx(1, "corrupted snapshot: %s", path);
+  return 0;
+}
+
+/* Returns non-zero if the snapshot mapped by `m` is outdated with
+   respect to the storage paths. */
+static int outdated(const DLiteRegion *m, const char *path)
+{
+  const SnapshotHeader *h = (const SnapshotHeader *)m->addr;
+  const SnapshotFile *files = (const SnapshotFile *)(m->addr + h->files);
+  unsigned char hash[HASHSIZE];
+  FUPaths paths;
+  size_t i;
+  int stat;
+
+  if (fu_paths_init(&paths, NULL) < 0) return 1;
+  stat = dlite_metacache_files(&paths) || pathshash(hash, HASHSIZE, &paths);
+  fu_paths_deinit(&paths);
+  if (stat) return 1;
+  if (memcmp(hash, h->hash, HASHSIZE) != 0)
+    return errx(1, "storage paths have changed since the snapshot was "
+                "saved: %s", path);
+  for (i=0; i < h->nfiles; i++) {
+    const char *location = get_string(m, files[i].location);
+    if (!location)
+      return errx(1, "corrupted snapshot: %s", path);
+    if (fileinfo_mtime(location) != files[i].mtime)
+      return errx(1, "storage \"%s\" is modified since the snapshot was "
+                  "saved: %s", location, path);
+  }
+  return 0;
+}
+
+/* Instances decoded concurrently by the shared scheduler */
+typedef struct {
+  DLiteRegion *m;          /* mapped snapshot */
+  const SnapshotEntry *entries;  /* entries to decode */
+  DLiteInstance **insts;   /* new references to decoded instances */
+  int *stat;               /* non-zero for instances that failed */
+} SnapshotIO;
+
+/* Task decoding entries `begin` to `end` of the SnapshotIO in `arg`. */
+static void decode_range(size_t begin, size_t end, void *arg)
+{
+  SnapshotIO *io = arg;
+  size_t i;
+  for (i=begin; i<end; i++) {
+    const SnapshotEntry *e = io->entries + i;
+    const DLiteBinRecord *rec =
+      (const DLiteBinRecord *)(io->m->addr + e->offset);
+    if ((io->insts[i] = dlite_instance_has(e->uuid, 0))) {
+      dlite_instance_incref(io->insts[i]);
+      continue;
+    }
+    if (dlite_binrecord_check(rec, e->size) ||
+        !(io->insts[i] = dlite_binrecord_decode(rec, e->uuid,
+                                                dlite_region_adopt, io->m)))
+      io->stat[i] = 1;
+  }
+}
+
+/* Decodes the `n` entries of `io` concurrently using the shared
+   scheduler.  Returns the number of instances that failed. */
+static int parallel_decode(SnapshotIO *io, size_t n)
+{
+  size_t i;
+  int nthreads = sched_get_nthreads(), nfailed=0;
+  if (nthreads < 1) nthreads = 1;
+  if (!(io->stat = calloc((n) ? n : 1, sizeof(int))))
+    return err(1, "allocation failure");
+  if (sched_parallel_for(n, (n + nthreads - 1) / nthreads, decode_range, io))
+    nfailed = (int)n;
+  else
+    for (i=0; i<n; i++) if (io->stat[i]) nfailed++;
+  free(io->stat);
+  io->stat = NULL;
+  return nfailed;
+}
+
+/*
+  Loads the snapshot file `path` saved with dlite_snapshot_save().
+  Returns a new store holding a reference to each instance in the
+  snapshot or NULL on error.
+ */
+DLiteStore *dlite_snapshot_load(const char *path)
+{
+  DLiteRegion *m;
+  const SnapshotHeader *h;
+  const SnapshotEntry *entries;
+  const uint64_t *plugins;
+  DLiteInstance **insts=NULL;
+  DLiteStore *store=NULL, *retval=NULL;
+  size_t i, begin, end;
+
+  if (!(m = dlite_region_map_file(path, SNAPSHOT_ALIGN))) return NULL;
+  h = (const SnapshotHeader *)m->addr;
+  if (check_snapshot(m, path) || outdated(m, path)) goto fail;
+  entries = (const SnapshotEntry *)(m->addr + h->index);
+  plugins = (const uint64_t *)(m->addr + h->plugins);
+
+  /* load the storage plugins that were loaded when the snapshot was
+     saved, plugins that are no longer available are skipped */
+  for (i=0; i < h->nplugins; i++) {
+    const char *name = get_string(m, plugins[i]);
+    ErrTry:
+      dlite_storage_plugin_get(name);
+    ErrOther:
+      warnx("cannot load storage plugin \"%s\" from snapshot: %s",
+            name, path);
+    ErrEnd;
+  }
+
+  /* decode the instances rank by rank, such that metadata are decoded
+     before their instances and collections after their members */
+  if (h->ninst && !(insts = calloc(h->ninst, sizeof(DLiteInstance *))))
+    FAIL("allocation failure");
+  for (begin=0; begin < h->ninst; begin=end) {
+    SnapshotIO io;
+    for (end=begin; end < h->ninst &&
+           entries[end].rank == entries[begin].rank; end++);
+    memset(&io, 0, sizeof(io));
+    io.m = m;
+    io.entries = entries + begin;
+    io.insts = insts + begin;
+    if (parallel_decode(&io, end - begin))
+      FAIL1("cannot decode all instances in snapshot: %s", path);
+  }
+
+  if (!(store = dlite_store_create())) goto fail;
+  if (dlite_store_add_many(store, insts, h->ninst)) goto fail;
+  retval = store;
+ fail:
+  if (insts) {
+    for (i=0; i < h->ninst; i++)
+      if (insts[i]) dlite_instance_decref(insts[i]);
+    free(insts);
+  }
+  if (!retval && store) dlite_store_free(store);
+  dlite_region_decref(m);
+  return retval;
+}
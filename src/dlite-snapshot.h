@@ -0,0 +1,58 @@
+#ifndef _DLITE_SNAPSHOT_H
+#define _DLITE_SNAPSHOT_H
+
+/**
+  @file
+  @brief Warm-start snapshots of the in-memory instance store
+
+  Long-running applications may spend a significant time after a
+  restart on loading metadata and data instances and on building
+  collections.  A snapshot saves all instances in the in-memory
+  instance store as binary records (see dlite-binrecord.h) in a single
+  native file, which is memory mapped and decoded without parsing when
+  the snapshot is loaded.
+
+  Metadata are stored before the instances of them, such that
+  instances are decoded after their metadata.  Collections are stored
+  with their relations.  Reference counts are not stored.
+
+  The storage and mapping plugins that are loaded when the snapshot is
+  saved are recorded by name and loaded again when the snapshot is
+  loaded.  The plugin registries themselves are not stored, since they
+  hold function pointers and handles to shared libraries.
+
+  Like the metadata cache (see dlite-metacache.h), a snapshot is keyed
+  by the hash of the files in the storage paths and their modification
+  times.  A snapshot can only be loaded if none of these has changed.
+ */
+
+#include "dlite-store.h"
+
+
+/**
+  Saves all instances in the in-memory instance store to a snapshot
+  file `path`.  The file is written atomically, i.e. a file `path`
+  from a previous snapshot is only replaced when the new snapshot is
+  complete.
+
+  Returns non-zero on error.
+ */
+int dlite_snapshot_save(const char *path);
+
+/**
+  Loads the snapshot file `path` saved with dlite_snapshot_save().
+
+  Instances in the snapshot that are not already in the in-memory
+  instance store are decoded and added to it.  Arrays of data
+  instances are adopted directly from the mapped file, which is kept
+  mapped until the last of them is released.
+
+  Returns a new store holding a reference to each instance in the
+  snapshot, which keeps them alive as long as it is not free'ed.
+  Returns NULL on error or if the snapshot is outdated with respect to
+  the storage paths.
+ */
+DLiteStore *dlite_snapshot_load(const char *path);
+
+
+#endif /* _DLITE_SNAPSHOT_H */
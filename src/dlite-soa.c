@@ -0,0 +1,210 @@
+/* dlite-soa.c -- structure-of-arrays containers for instances
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "dlite-misc.h"
+#include "dlite-type.h"
+#include "dlite-entity.h"
+#include "dlite-soa.h"
+
+/* Pointer to record `k` of column `i` */
+#define RECORD(meta, columns, i, k) \
+  ((char *)(columns)[i] + (k) * (meta)->_properties[i].size)
+
+
+/* Returns non-zero and reports an error if `meta` cannot be stored in
+   a SoA container. */
+static int check_meta(const DLiteMeta *meta)
+{
+  if (meta->_ndimensions)
+    return err(1, "SoA containers require metadata without dimensions: %s",
+               meta->uri);
+  return 0;
+}
+
+/* Returns a newly allocated uri for the SoA metadata of `meta` or NULL
+   on error. */
+static char *soa_uri(const DLiteMeta *meta)
+{
+  char *name=NULL, *version=NULL, *namespace=NULL, *soaname=NULL;
+  char *uri=NULL;
+  size_t len;
+  if (dlite_split_meta_uri(meta->uri, &name, &version, &namespace))
+    goto fail;
+  len = strlen(name);
+  if (!(soaname = malloc(len + 4))) goto fail;
+  memcpy(soaname, name, len);
+  memcpy(soaname + len, "SoA", 4);
+  uri = dlite_join_meta_uri(soaname, version, namespace);
+ fail:
+  free(name);
+  free(version);
+  free(namespace);
+  free(soaname);
+  return uri;
+}
+
+/* Copies `n` values of property `p` from `src` to `dest`. */
+static int copy_values(void *dest, const void *src, const DLiteProperty *p,
+                       size_t n)
+{
+  size_t k;
+  if (!dlite_type_is_allocated(p->type)) {
+    if (n) memcpy(dest, src, n * p->size);
+    return 0;
+  }
+  for (k=0; k<n; k++)
+    if (!dlite_type_copy((char *)dest + k*p->size,
+                         (const char *)src + k*p->size, p->type, p->size))
+      return err(1, "cannot copy value of property '%s'", p->name);
+  return 0;
+}
+
+
+/*
+  Returns a new reference to the SoA metadata corresponding to `meta`
+  or NULL on error.
+ */
+DLiteMeta *dlite_soa_meta(const DLiteMeta *meta)
+{
+  DLiteMeta *soa=NULL;
+  DLiteProperty *props=NULL;
+  DLiteDimension dim = {DLITE_SOA_DIMENSION, "Number of records."};
+  char *dims[] = {DLITE_SOA_DIMENSION};
+  char *uri=NULL;
+  size_t i;
+
+  if (check_meta(meta)) return NULL;
+  if (!(uri = soa_uri(meta))) return NULL;
+  if ((soa = (DLiteMeta *)dlite_instance_has(uri, false))) {
+    dlite_meta_incref(soa);
+    goto done;
+  }
+
+  if (!(props = calloc(meta->_nproperties, sizeof(DLiteProperty)))) {
+    err(1, "allocation failure");
+    goto done;
+  }
+  for (i=0; i < meta->_nproperties; i++) {
+    props[i] = meta->_properties[i];
+    props[i].ndims = 1;
+    props[i].dims = dims;
+  }
+  soa = dlite_meta_create(uri, NULL, "Structure-of-arrays container.",
+                          1, &dim, meta->_nproperties, props);
+ done:
+  free(props);
+  free(uri);
+  return soa;
+}
+
+
+/*
+  Copies the property values of the `n` instances in `insts` to
+  records `offset` to `offset + n - 1` of `columns`.
+ */
+int dlite_soa_from_instances(const DLiteMeta *meta, void **columns,
+                             size_t offset, DLiteInstance **insts,
+                             size_t n)
+{
+  size_t i, k;
+  if (check_meta(meta)) return 1;
+  for (k=0; k<n; k++)
+    if (strcmp(insts[k]->meta->uuid, meta->uuid) != 0)
+      return err(1, "instance %s is not an instance of %s",
+                 insts[k]->uuid, meta->uri);
+  for (i=0; i < meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    for (k=0; k<n; k++)
+      if (copy_values(RECORD(meta, columns, i, offset + k),
+                      DLITE_PROP(insts[k], i), p, 1))
+        return 1;
+  }
+  return 0;
+}
+
+
+/*
+  Creates `n` new instances of `meta` from records `offset` to
+  `offset + n - 1` of `columns`.
+ */
+DLiteInstance **dlite_soa_to_instances(const DLiteMeta *meta,
+                                       void **columns, size_t offset,
+                                       size_t n)
+{
+  DLiteInstance **insts;
+  size_t i, k;
+  if (check_meta(meta)) return NULL;
+  if (!(insts = dlite_instance_create_many(meta, NULL, n, NULL)))
+    return NULL;
+  for (i=0; i < meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    for (k=0; k<n; k++)
+      if (copy_values(DLITE_PROP(insts[k], i),
+                      RECORD(meta, columns, i, offset + k), p, 1))
+        goto fail;
+  }
+  return insts;
+ fail:
+  for (k=0; k<n; k++) dlite_instance_decref(insts[k]);
+  free(insts);
+  return NULL;
+}
+
+
+/*
+  Returns a new instance of the SoA metadata of `meta` with id `id`,
+  holding a copy of the first `n` records of `columns`.
+ */
+DLiteInstance *dlite_soa_create_instance(const DLiteMeta *meta,
+                                         void **columns, size_t n,
+                                         const char *id)
+{
+  DLiteMeta *soa;
+  DLiteInstance *inst=NULL;
+  size_t i;
+  if (!(soa = dlite_soa_meta(meta))) return NULL;
+  if (!(inst = dlite_instance_create(soa, &n, id))) goto fail;
+  for (i=0; i < meta->_nproperties; i++)
+    if (copy_values(*(void **)DLITE_PROP(inst, i), columns[i],
+                    meta->_properties + i, n))
+      goto fail;
+  dlite_meta_decref(soa);
+  return inst;
+ fail:
+  if (inst) dlite_instance_decref(inst);
+  dlite_meta_decref(soa);
+  return NULL;
+}
+
+
+/*
+  Copies all records of `inst`, which must be an instance of the SoA
+  metadata of `meta`, to `columns` starting at record `offset`.
+ */
+int dlite_soa_from_instance(const DLiteMeta *meta, void **columns,
+                            size_t offset, const DLiteInstance *inst)
+{
+  char *uri;
+  size_t i, n;
+  int mismatch;
+  if (check_meta(meta)) return 1;
+  if (!(uri = soa_uri(meta))) return 1;
+  mismatch = (strcmp(inst->meta->uri, uri) != 0);
+  free(uri);
+  if (mismatch || inst->meta->_nproperties != meta->_nproperties)
+    return err(1, "instance %s is not a SoA container of %s",
+               inst->uuid, meta->uri);
+  n = DLITE_DIM(inst, 0);
+  for (i=0; i < meta->_nproperties; i++)
+    if (copy_values(RECORD(meta, columns, i, offset),
+                    *(void **)DLITE_PROP(inst, i), meta->_properties + i, n))
+      return 1;
+  return 0;
+}
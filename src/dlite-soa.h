@@ -0,0 +1,92 @@
+#ifndef _DLITE_SOA_H
+#define _DLITE_SOA_H
+
+/**
+  @file
+  @brief Structure-of-arrays containers for instances of the same metadata
+
+  A structure-of-arrays (SoA) container holds `n` records of an
+  entity with only scalar properties (no dimensions), with the values
+  of each property stored contiguously in its own column.  This is
+  much more cache friendly than separately allocated instances when
+  scanning a few properties over many records.
+
+  The functions in this module work on the columns of such a
+  container.  The columns are passed as an array `columns` of pointers
+  to the first record of each column, in the order of the properties
+  of the metadata.  Record `k` of property `i` is located at
+  `(char *)columns[i] + k * meta->_properties[i].size`.
+
+  Typed containers are generated with the `c-soa-header` template of
+  dlite-codegen.
+
+  A container is stored as a single instance of the SoA metadata
+  returned by dlite_soa_meta(), which has one dimension `nrecords` and
+  the same properties as the original metadata, but with the extra
+  dimension.
+ */
+
+#include "dlite-entity.h"
+
+/** Name of the extra dimension of SoA metadata. */
+#define DLITE_SOA_DIMENSION "nrecords"
+
+
+/**
+  Returns a new reference to the SoA metadata corresponding to `meta`
+  or NULL on error.
+
+  The SoA metadata has the same namespace and version as `meta`, but
+  its name has "SoA" appended.  It is created the first time it is
+  requested.  `meta` must not have any dimensions.
+ */
+DLiteMeta *dlite_soa_meta(const DLiteMeta *meta);
+
+/**
+  Copies the property values of the `n` instances in `insts` to
+  records `offset` to `offset + n - 1` of `columns`.  All instances
+  must be instances of `meta`.  The columns must have room for these
+  records.  Values of allocated types, like strings, are copied.
+
+  Returns non-zero on error.
+ */
+int dlite_soa_from_instances(const DLiteMeta *meta, void **columns,
+                             size_t offset, DLiteInstance **insts,
+                             size_t n);
+
+/**
+  Creates `n` new instances of `meta` from records `offset` to
+  `offset + n - 1` of `columns`.
+
+  Returns a newly allocated array of `n` new references to the
+  instances or NULL on error.  The caller is responsible to decref the
+  instances and free the array.
+ */
+DLiteInstance **dlite_soa_to_instances(const DLiteMeta *meta,
+                                       void **columns, size_t offset,
+                                       size_t n);
+
+/**
+  Returns a new instance of the SoA metadata of `meta` with id `id`,
+  holding a copy of the first `n` records of `columns`.  Use
+  dlite_instance_save() to store the whole container in one go.
+
+  Returns NULL on error.
+ */
+DLiteInstance *dlite_soa_create_instance(const DLiteMeta *meta,
+                                         void **columns, size_t n,
+                                         const char *id);
+
+/**
+  Copies all records of `inst`, which must be an instance of the SoA
+  metadata of `meta`, to `columns` starting at record `offset`.  The
+  columns must have room for the records.  The number of records is
+  given by dimension 0 of `inst`.
+
+  Returns non-zero on error.
+ */
+int dlite_soa_from_instance(const DLiteMeta *meta, void **columns,
+                            size_t offset, const DLiteInstance *inst);
+
+
+#endif /* _DLITE_SOA_H */
@@ -0,0 +1,609 @@
+/* dlite-sparse.c -- sparse representation of array properties
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "dlite-misc.h"
+#include "dlite-type.h"
+#include "dlite-arrays.h"
+#include "dlite-entity.h"
+#include "dlite-sparse.h"
+
+
+static const char *sparse_format_names[] = {"none", "coo", "csr"};
+
+
+/* Returns non-zero if all `size` bytes of `p` are zero. */
+static int is_zero(const void *p, size_t size)
+{
+  const unsigned char *c = p;
+  uint32_t v4;
+  uint64_t v8;
+  size_t i;
+  switch (size) {
+  case 1: return *c == 0;
+  case 4: memcpy(&v4, p, 4); return v4 == 0;
+  case 8: memcpy(&v8, p, 8); return v8 == 0;
+  }
+  for (i=0; i<size; i++)
+    if (c[i]) return 0;
+  return 1;
+}
+
+/* Returns non-zero and reports an error if arrays with elements of
+   type `type`, `ndims` dimensions cannot be stored in format
+   `format`. */
+static int check_format(DLiteSparseFormat format, DLiteType type,
+                        size_t size, int ndims)
+{
+  char typename[DLITE_STRUCT_NAME_SIZE];
+  if (format != dliteSparseCOO && format != dliteSparseCSR)
+    return errx(1, "invalid sparse format: %d", format);
+  if (dlite_type_is_allocated(type)) {
+    dlite_type_set_typename(type, size, typename, sizeof(typename));
+    return errx(1, "sparse arrays of type %s are not supported", typename);
+  }
+  if (ndims < 1)
+    return errx(1, "sparse arrays must have at least one dimension");
+  if (format == dliteSparseCSR && ndims != 2)
+    return errx(1, "CSR arrays must have two dimensions, got %d", ndims);
+  return 0;
+}
+
+/* Returns the number of elements of an array with `ndims` dimensions
+   of sizes `shape`. */
+static size_t nelements(int ndims, const size_t *shape)
+{
+  size_t n=1;
+  int i;
+  for (i=0; i<ndims; i++) n *= shape[i];
+  return n;
+}
+
+
+/*
+  Returns the name of sparse format `format` or NULL if `format` is
+  invalid.
+ */
+const char *dlite_sparse_format_name(DLiteSparseFormat format)
+{
+  if ((int)format < 0 || format > dliteSparseCSR) return NULL;
+  return sparse_format_names[format];
+}
+
+/*
+  Returns the sparse format called `name` or -1 if `name` is not a
+  valid format name.
+ */
+int dlite_sparse_format_from_name(const char *name, int len)
+{
+  int i;
+  if (len < 0) len = strlen(name);
+  for (i=0; i <= dliteSparseCSR; i++)
+    if ((int)strlen(sparse_format_names[i]) == len &&
+        strncasecmp(name, sparse_format_names[i], len) == 0) return i;
+  return -1;
+}
+
+/*
+  Returns a new sparse array with room for `nnz` elements.
+ */
+DLiteSparse *dlite_sparse_create(DLiteSparseFormat format, DLiteType type,
+                                 size_t size, int ndims, const size_t *shape,
+                                 size_t nnz)
+{
+  DLiteSparse *sp;
+  size_t nind = (format == dliteSparseCOO) ? nnz * ndims : nnz;
+  if (check_format(format, type, size, ndims)) return NULL;
+  if (!(sp = calloc(1, sizeof(DLiteSparse))))
+    return err(1, "allocation failure"), NULL;
+  sp->format = format;
+  sp->type = type;
+  sp->size = size;
+  sp->ndims = ndims;
+  sp->nnz = nnz;
+  if (!(sp->shape = malloc(ndims * sizeof(size_t))) ||
+      !(sp->indices = calloc((nind) ? nind : 1, sizeof(size_t))) ||
+      !(sp->values = calloc((nnz) ? nnz : 1, size)) ||
+      (format == dliteSparseCSR &&
+       !(sp->indptr = calloc(shape[0] + 1, sizeof(size_t))))) {
+    dlite_sparse_free(sp);
+    return err(1, "allocation failure"), NULL;
+  }
+  memcpy(sp->shape, shape, ndims * sizeof(size_t));
+  return sp;
+}
+
+/*
+  Frees sparse array `sp`.
+ */
+void dlite_sparse_free(DLiteSparse *sp)
+{
+  if (!sp) return;
+  free(sp->shape);
+  free(sp->indptr);
+  free(sp->indices);
+  free(sp->values);
+  free(sp);
+}
+
+/*
+  Returns the number of bytes used by the indices and values of `sp`.
+ */
+size_t dlite_sparse_nbytes(const DLiteSparse *sp)
+{
+  size_t n = sp->nnz * sp->size;
+  if (sp->format == dliteSparseCOO)
+    n += sp->nnz * sp->ndims * sizeof(size_t);
+  else
+    n += (sp->nnz + sp->shape[0] + 1) * sizeof(size_t);
+  return n;
+}
+
+/*
+  Returns the number of non-zero elements in `data`.
+ */
+size_t dlite_sparse_count_nonzero(const void *data, size_t size,
+                                  size_t nmemb)
+{
+  const char *p = data;
+  size_t i, n=0;
+  for (i=0; i<nmemb; i++, p+=size)
+    if (!is_zero(p, size)) n++;
+  return n;
+}
+
+
+/* Iterates over the elements of a dense array or a DLiteArray in
+   row-major order, keeping track of the coordinates. */
+typedef struct {
+  const char *data;      /* dense data, if `arr` is NULL */
+  DLiteArrayIter iter;   /* iterator over `arr` */
+  const DLiteArray *arr; /* array with any layout */
+  size_t size;           /* element size */
+  int ndims;             /* number of dimensions */
+  const size_t *shape;   /* dimension sizes */
+  size_t k;              /* index of next element */
+  size_t nmemb;          /* number of elements */
+  size_t *ind;           /* coordinates of the current element */
+} Cursor;
+
+/* Initialises cursor `c`.  Returns non-zero on error. */
+static int cursor_init(Cursor *c, const void *data, const DLiteArray *arr,
+                       size_t size, int ndims, const size_t *shape)
+{
+  memset(c, 0, sizeof(Cursor));
+  c->data = data;
+  c->arr = arr;
+  c->size = size;
+  c->ndims = ndims;
+  c->shape = shape;
+  c->nmemb = nelements(ndims, shape);
+  if (!(c->ind = calloc(ndims, sizeof(size_t))))
+    return err(1, "allocation failure");
+  if (arr && dlite_array_iter_init(&c->iter, arr)) {
+    free(c->ind);
+    return 1;
+  }
+  return 0;
+}
+
+/* Releases cursor `c`. */
+static void cursor_deinit(Cursor *c)
+{
+  if (c->arr) dlite_array_iter_deinit(&c->iter);
+  free(c->ind);
+}
+
+/* Returns a pointer to the next element or NULL when all elements are
+   visited.  The coordinates of the element are in `c->ind`. */
+static const void *cursor_next(Cursor *c)
+{
+  int i;
+  if (c->k >= c->nmemb) return NULL;
+  if (c->k++) {
+    for (i=c->ndims-1; i>0; i--) {
+      if (++c->ind[i] < c->shape[i]) break;
+      c->ind[i] = 0;
+    }
+    if (i == 0) c->ind[0]++;
+  }
+  if (c->arr) return dlite_array_iter_next(&c->iter);
+  return c->data + (c->k - 1) * c->size;
+}
+
+/* Returns a new sparse array with the non-zero elements of the dense
+   array `data` or, if `data` is NULL, of `arr`. */
+static DLiteSparse *sparse_from(DLiteSparseFormat format, const void *data,
+                                const DLiteArray *arr, DLiteType type,
+                                size_t size, int ndims, const size_t *shape)
+{
+  DLiteSparse *sp=NULL;
+  Cursor c;
+  const void *p;
+  size_t nnz=0, k=0;
+  if (check_format(format, type, size, ndims)) return NULL;
+  if (cursor_init(&c, data, arr, size, ndims, shape)) return NULL;
+  if (data) {
+    nnz = dlite_sparse_count_nonzero(data, size, c.nmemb);
+  } else {
+    while ((p = cursor_next(&c)))
+      if (!is_zero(p, size)) nnz++;
+    cursor_deinit(&c);
+    if (cursor_init(&c, data, arr, size, ndims, shape)) return NULL;
+  }
+  if (!(sp = dlite_sparse_create(format, type, size, ndims, shape, nnz)))
+    goto fail;
+  while ((p = cursor_next(&c)) && k < nnz) {
+    if (is_zero(p, size)) continue;
+    memcpy((char *)sp->values + k*size, p, size);
+    if (format == dliteSparseCOO) {
+      memcpy(sp->indices + k*ndims, c.ind, ndims*sizeof(size_t));
+    } else {
+      sp->indices[k] = c.ind[1];
+      sp->indptr[c.ind[0] + 1]++;
+    }
+    k++;
+  }
+  if (format == dliteSparseCSR) {
+    size_t i;
+    for (i=0; i<shape[0]; i++) sp->indptr[i+1] += sp->indptr[i];
+  }
+ fail:
+  cursor_deinit(&c);
+  return sp;
+}
+
+/*
+  Returns a new sparse array with the non-zero elements of `data`.
+ */
+DLiteSparse *dlite_sparse_from_dense(DLiteSparseFormat format,
+                                     const void *data, DLiteType type,
+                                     size_t size, int ndims,
+                                     const size_t *shape)
+{
+  return sparse_from(format, data, NULL, type, size, ndims, shape);
+}
+
+/*
+  Returns a new sparse array with the non-zero elements of `arr`.
+ */
+DLiteSparse *dlite_sparse_from_array(DLiteSparseFormat format,
+                                     const DLiteArray *arr)
+{
+  if (dlite_array_is_continuous(arr))
+    return sparse_from(format, arr->data, NULL, arr->type, arr->size,
+                       arr->ndims, arr->dims);
+  return sparse_from(format, NULL, arr, arr->type, arr->size, arr->ndims,
+                     arr->dims);
+}
+
+/*
+  Writes the coordinates of stored element `k` of `sp` to `ind`.
+ */
+int dlite_sparse_coords(const DLiteSparse *sp, size_t k, size_t *ind)
+{
+  if (k >= sp->nnz)
+    return errx(1, "index %lu exceeds number of stored elements (%lu)",
+                (unsigned long)k, (unsigned long)sp->nnz);
+  if (sp->format == dliteSparseCOO) {
+    memcpy(ind, sp->indices + k*sp->ndims, sp->ndims*sizeof(size_t));
+  } else {
+    /* find the last row starting at or before `k` */
+    size_t lo=0, hi=sp->shape[0];
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (sp->indptr[mid+1] <= k) lo = mid + 1; else hi = mid;
+    }
+    ind[0] = lo;
+    ind[1] = sp->indices[k];
+  }
+  return 0;
+}
+
+/* Returns the offset of the element at coordinates `ind` in a dense
+   array of shape `sp->shape` or -1 if `ind` is out of range. */
+static long long dense_offset(const DLiteSparse *sp, const size_t *ind)
+{
+  size_t offset=0;
+  int i;
+  for (i=0; i<sp->ndims; i++) {
+    if (ind[i] >= sp->shape[i]) return -1;
+    offset = offset * sp->shape[i] + ind[i];
+  }
+  return offset;
+}
+
+/* Checks that the CSR row offsets of `sp` are consistent.  Returns
+   non-zero on error. */
+static int check_indptr(const DLiteSparse *sp)
+{
+  size_t i;
+  if (sp->format != dliteSparseCSR) return 0;
+  if (sp->indptr[0] != 0 || sp->indptr[sp->shape[0]] != sp->nnz)
+    return errx(1, "CSR row offsets must start at 0 and end at nnz");
+  for (i=0; i<sp->shape[0]; i++)
+    if (sp->indptr[i+1] < sp->indptr[i])
+      return errx(1, "CSR row offsets must be non-decreasing");
+  return 0;
+}
+
+/*
+  Writes `sp` to the dense array `data`.
+ */
+int dlite_sparse_to_dense(const DLiteSparse *sp, void *data)
+{
+  size_t k, ind[2], nmemb=nelements(sp->ndims, sp->shape);
+  char *p = data;
+  if (check_indptr(sp)) return 1;
+  for (k=0; k<nmemb; k++, p+=sp->size)
+    if (!is_zero(p, sp->size)) memset(p, 0, sp->size);
+  for (k=0; k<sp->nnz; k++) {
+    long long offset;
+    if (sp->format == dliteSparseCOO) {
+      offset = dense_offset(sp, sp->indices + k*sp->ndims);
+    } else {
+      dlite_sparse_coords(sp, k, ind);
+      offset = dense_offset(sp, ind);
+    }
+    if (offset < 0)
+      return errx(1, "index of sparse element %lu is out of range",
+                  (unsigned long)k);
+    memcpy((char *)data + offset*sp->size, (char *)sp->values + k*sp->size,
+           sp->size);
+  }
+  return 0;
+}
+
+/*
+  Writes `sp` to array `arr`.
+ */
+int dlite_sparse_to_array(const DLiteSparse *sp, DLiteArray *arr)
+{
+  DLiteArrayIter iter;
+  void *p;
+  size_t k, ind[2];
+  int i, *iind;
+  if (arr->type != sp->type || arr->size != sp->size ||
+      arr->ndims != sp->ndims)
+    return errx(1, "array and sparse array have different type or rank");
+  for (i=0; i<sp->ndims; i++)
+    if (arr->dims[i] != sp->shape[i])
+      return errx(1, "array and sparse array have different shape");
+  if (dlite_array_is_continuous(arr))
+    return dlite_sparse_to_dense(sp, arr->data);
+  if (check_indptr(sp)) return 1;
+
+  if (dlite_array_iter_init(&iter, arr)) return 1;
+  while ((p = dlite_array_iter_next(&iter)))
+    if (!is_zero(p, sp->size)) memset(p, 0, sp->size);
+  dlite_array_iter_deinit(&iter);
+
+  if (!(iind = calloc(sp->ndims, sizeof(int))))
+    return err(1, "allocation failure");
+  for (k=0; k<sp->nnz; k++) {
+    const size_t *coords = ind;
+    if (sp->format == dliteSparseCOO)
+      coords = sp->indices + k*sp->ndims;
+    else
+      dlite_sparse_coords(sp, k, ind);
+    if (dense_offset(sp, coords) < 0) {
+      free(iind);
+      return errx(1, "index of sparse element %lu is out of range",
+                  (unsigned long)k);
+    }
+    for (i=0; i<sp->ndims; i++) iind[i] = coords[i];
+    memcpy(dlite_array_index(arr, iind), (char *)sp->values + k*sp->size,
+           sp->size);
+  }
+  free(iind);
+  return 0;
+}
+
+/*
+  Returns a new copy of `sp` converted to format `format`.
+ */
+DLiteSparse *dlite_sparse_convert(const DLiteSparse *sp,
+                                  DLiteSparseFormat format)
+{
+  DLiteSparse *new;
+  size_t i, k;
+  if (!(new = dlite_sparse_create(format, sp->type, sp->size, sp->ndims,
+                                  sp->shape, sp->nnz))) return NULL;
+  if (format == sp->format) {
+    size_t nind = (format == dliteSparseCOO) ? sp->nnz * sp->ndims : sp->nnz;
+    memcpy(new->indices, sp->indices, nind * sizeof(size_t));
+    memcpy(new->values, sp->values, sp->nnz * sp->size);
+    if (sp->indptr)
+      memcpy(new->indptr, sp->indptr, (sp->shape[0]+1) * sizeof(size_t));
+
+  } else if (format == dliteSparseCOO) {
+    for (k=0; k<sp->nnz; k++)
+      dlite_sparse_coords(sp, k, new->indices + 2*k);
+    memcpy(new->values, sp->values, sp->nnz * sp->size);
+
+  } else {
+    /* counting sort by row, stable within each row */
+    size_t *next=NULL;
+    for (k=0; k<sp->nnz; k++) {
+      if (sp->indices[2*k] >= sp->shape[0]) {
+        dlite_sparse_free(new);
+        return errx(1, "index of sparse element %lu is out of range",
+                    (unsigned long)k), NULL;
+      }
+      new->indptr[sp->indices[2*k] + 1]++;
+    }
+    for (i=0; i<sp->shape[0]; i++) new->indptr[i+1] += new->indptr[i];
+    if (!(next = malloc((sp->shape[0] + 1) * sizeof(size_t)))) {
+      dlite_sparse_free(new);
+      return err(1, "allocation failure"), NULL;
+    }
+    memcpy(next, new->indptr, (sp->shape[0] + 1) * sizeof(size_t));
+    for (k=0; k<sp->nnz; k++) {
+      size_t j = next[sp->indices[2*k]]++;
+      new->indices[j] = sp->indices[2*k + 1];
+      memcpy((char *)new->values + j*sp->size,
+             (char *)sp->values + k*sp->size, sp->size);
+    }
+    free(next);
+  }
+  return new;
+}
+
+/* Compares the `n` coordinates in `a` and `b` in row-major order. */
+static int coordcmp(const size_t *a, const size_t *b, int n)
+{
+  int i;
+  for (i=0; i<n; i++)
+    if (a[i] != b[i]) return (a[i] < b[i]) ? -1 : 1;
+  return 0;
+}
+
+/*
+  Returns a pointer to the element of `sp` at coordinates `ind` or NULL
+  if it is not stored.
+ */
+const void *dlite_sparse_get(const DLiteSparse *sp, const size_t *ind)
+{
+  size_t lo, hi;
+  if (sp->format == dliteSparseCOO) {
+    lo = 0;
+    hi = sp->nnz;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      int c = coordcmp(sp->indices + mid*sp->ndims, ind, sp->ndims);
+      if (c == 0) return (char *)sp->values + mid*sp->size;
+      if (c < 0) lo = mid + 1; else hi = mid;
+    }
+  } else {
+    if (ind[0] >= sp->shape[0]) return NULL;
+    lo = sp->indptr[ind[0]];
+    hi = sp->indptr[ind[0] + 1];
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (sp->indices[mid] == ind[1]) return (char *)sp->values + mid*sp->size;
+      if (sp->indices[mid] < ind[1]) lo = mid + 1; else hi = mid;
+    }
+  }
+  return NULL;
+}
+
+
+/********************************************************************
+ *  Sparse properties
+ ********************************************************************/
+
+/*
+  Declares property `name` of `meta` to be serialised in sparse format
+  `format`.
+ */
+int dlite_meta_set_sparse_property(DLiteMeta *meta, const char *name,
+                                   DLiteSparseFormat format)
+{
+  const DLiteProperty *p;
+  int i;
+  if ((i = dlite_meta_get_property_index(meta, name)) < 0) return 1;
+  p = meta->_properties + i;
+  if (format != dliteSparseNone &&
+      check_format(format, p->type, p->size, p->ndims))
+    return err(1, "cannot declare property '%s' of %s as sparse",
+               name, meta->uri);
+  if (!meta->_sparseprops) {
+    if (format == dliteSparseNone) return 0;
+    if (!(meta->_sparseprops = calloc(meta->_nproperties, 1)))
+      return err(1, "allocation failure");
+  }
+  meta->_sparseprops[i] = format;
+  return 0;
+}
+
+/*
+  Returns the sparse format of property number `i` of `meta`.
+ */
+DLiteSparseFormat dlite_meta_get_sparse_format(const DLiteMeta *meta,
+                                               size_t i)
+{
+  if (!meta->_sparseprops || i >= meta->_nproperties) return dliteSparseNone;
+  return meta->_sparseprops[i];
+}
+
+/*
+  Returns a new sparse array with the non-zero elements of property
+  number `i` of `inst`.
+ */
+DLiteSparse *dlite_instance_get_sparse_by_index(const DLiteInstance *inst,
+                                                size_t i,
+                                                DLiteSparseFormat format)
+{
+  const DLiteProperty *p;
+  const void *ptr;
+  if (!(ptr = dlite_instance_get_property_by_index(inst, i))) return NULL;
+  p = inst->meta->_properties + i;
+  if (p->ndims == 0)
+    return errx(1, "cannot make scalar property '%s' sparse", p->name), NULL;
+  if (format == dliteSparseNone)
+    format = dlite_meta_get_sparse_format(inst->meta, i);
+  if (format == dliteSparseNone) format = dliteSparseCOO;
+  return dlite_sparse_from_dense(format, ptr, p->type, p->size, p->ndims,
+                                 DLITE_PROP_DIMS(inst, i));
+}
+
+/*
+  Like dlite_instance_get_sparse_by_index(), but the property is
+  given by its name.
+ */
+DLiteSparse *dlite_instance_get_sparse(const DLiteInstance *inst,
+                                       const char *name,
+                                       DLiteSparseFormat format)
+{
+  int i;
+  if ((i = dlite_meta_get_property_index(inst->meta, name)) < 0) return NULL;
+  return dlite_instance_get_sparse_by_index(inst, i, format);
+}
+
+/*
+  Assigns property number `i` of `inst` from sparse array `sp`.
+ */
+int dlite_instance_set_sparse_by_index(DLiteInstance *inst, size_t i,
+                                       const DLiteSparse *sp)
+{
+  const DLiteProperty *p;
+  const size_t *dims;
+  void *ptr;
+  int j;
+  if (i >= inst->meta->_nproperties)
+    return errx(1, "index %d exceeds number of properties (%d) in %s",
+                (int)i, (int)inst->meta->_nproperties, inst->meta->uri);
+  p = inst->meta->_properties + i;
+  dims = DLITE_PROP_DIMS(inst, i);
+  if (p->type != sp->type || p->size != sp->size || p->ndims != sp->ndims)
+    return errx(1, "sparse array does not match type and rank of property "
+                "'%s'", p->name);
+  for (j=0; j<p->ndims; j++)
+    if (dims[j] != sp->shape[j])
+      return errx(1, "sparse array does not match shape of property '%s' "
+                  "(dimension %d)", p->name, j);
+  if (dlite_instance_make_writable(inst, i)) return 1;
+  if (!(ptr = dlite_instance_get_property_by_index(inst, i))) return 1;
+  if (dlite_sparse_to_dense(sp, ptr)) return 1;
+  if (inst->meta->_loadprop && inst->meta->_loadprop(inst, i)) return 1;
+  return dlite_instance_mark_dirty_by_index(inst, i);
+}
+
+/*
+  Like dlite_instance_set_sparse_by_index(), but the property is
+  given by its name.
+ */
+int dlite_instance_set_sparse(DLiteInstance *inst, const char *name,
+                              const DLiteSparse *sp)
+{
+  int i;
+  if ((i = dlite_meta_get_property_index(inst->meta, name)) < 0) return 1;
+  return dlite_instance_set_sparse_by_index(inst, i, sp);
+}
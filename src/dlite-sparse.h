@@ -0,0 +1,242 @@
+#ifndef _DLITE_SPARSE_H
+#define _DLITE_SPARSE_H
+
+/**
+  @file
+  @brief Sparse representation of array properties
+
+  Many array properties, like interaction matrices and occupancy grids,
+  are almost all zeros.  This module provides a sparse representation
+  of such arrays, holding only the non-zero elements, in one of two
+  formats:
+
+    - `dliteSparseCOO`: coordinate list.  The coordinates of the
+      non-zero elements are stored in row-major order as `nnz` rows of
+      `ndims` indices.  Supports any number of dimensions.
+    - `dliteSparseCSR`: compressed sparse rows.  Only two dimensions.
+      `indptr[i]` to `indptr[i+1]` is the range of the column indices
+      and values of row `i`.
+
+  An element is zero if all its bytes are zero.  Hence, only arrays of
+  non-allocated types (blob, bool, int, uint, float, fixstring and
+  struct types) can be sparse.
+
+  Property arrays of instances are always dense in memory, since most
+  of dlite accesses them directly.  Use dlite_instance_get_sparse() and
+  dlite_instance_set_sparse() to read and write them sparse.  Since
+  dlite_instance_set_sparse() only writes the non-zero elements (and
+  elements that are not already zero), the untouched pages of a large
+  property array are never committed to memory.
+
+  Metadata can declare properties as sparse with
+  dlite_meta_set_sparse_property().  Such properties are serialised
+  sparse by storages that support it.  JSON writes them as an object:
+
+      {"format": "coo", "dtype": "float64", "shape": [100, 100],
+       "indices": [[0, 3], [57, 12]], "values": [1.5, -2.0]}
+
+      {"format": "csr", "dtype": "float64", "shape": [3, 100],
+       "indptr": [0, 1, 1, 2], "indices": [3, 12], "values": [1.5, -2.0]}
+
+  and entities declare the format with a `"sparse"` item in the
+  description of the property.  HDF5 writes them to chunked datasets,
+  where only the chunks with non-zero elements are allocated.
+ */
+
+#include <stddef.h>
+
+#include "dlite-type.h"
+#include "dlite-arrays.h"
+#include "dlite-entity.h"
+
+
+/** Storage formats of sparse arrays */
+typedef enum _DLiteSparseFormat {
+  dliteSparseNone=0,     /*!< Dense array */
+  dliteSparseCOO,        /*!< Coordinate list, any number of dimensions */
+  dliteSparseCSR         /*!< Compressed sparse rows, two dimensions */
+} DLiteSparseFormat;
+
+
+/** A sparse array */
+typedef struct _DLiteSparse {
+  DLiteSparseFormat format; /*!< Storage format */
+  DLiteType type;      /*!< Type of the elements */
+  size_t size;         /*!< Size of each element */
+  int ndims;           /*!< Number of dimensions */
+  size_t *shape;       /*!< Dimension sizes [ndims] */
+  size_t nnz;          /*!< Number of stored elements */
+  size_t *indptr;      /*!< CSR: row offsets [shape[0]+1].  NULL for COO */
+  size_t *indices;     /*!< COO: coordinates [nnz*ndims].
+                            CSR: column indices [nnz] */
+  void *values;        /*!< Stored elements [nnz] */
+} DLiteSparse;
+
+
+/**
+  Returns the name of sparse format `format` ("none", "coo" or "csr")
+  or NULL if `format` is invalid.
+ */
+const char *dlite_sparse_format_name(DLiteSparseFormat format);
+
+/**
+  Returns the sparse format called `name` or -1 if `name` is not a
+  valid format name.  `len` is the length of `name`.  If it is
+  negative, `name` must be NUL-terminated.
+ */
+int dlite_sparse_format_from_name(const char *name, int len);
+
+/**
+  Returns a new sparse array in format `format` with elements of type
+  `type` and size `size`, `ndims` dimensions of sizes `shape` and room
+  for `nnz` elements.  The indices and values are zeroed and should be
+  assigned by the caller in row-major order.
+
+  Returns NULL on error.
+ */
+DLiteSparse *dlite_sparse_create(DLiteSparseFormat format, DLiteType type,
+                                 size_t size, int ndims, const size_t *shape,
+                                 size_t nnz);
+
+/**
+  Frees sparse array `sp`.
+ */
+void dlite_sparse_free(DLiteSparse *sp);
+
+/**
+  Returns the number of bytes used by the indices and values of `sp`.
+ */
+size_t dlite_sparse_nbytes(const DLiteSparse *sp);
+
+/**
+  Returns the number of non-zero elements among the `nmemb` elements
+  of size `size` in `data`.
+ */
+size_t dlite_sparse_count_nonzero(const void *data, size_t size,
+                                  size_t nmemb);
+
+/**
+  Returns a new sparse array in format `format` with the non-zero
+  elements of the dense C-ordered array `data` with elements of type
+  `type` and size `size` and `ndims` dimensions of sizes `shape`.
+
+  Returns NULL on error.
+ */
+DLiteSparse *dlite_sparse_from_dense(DLiteSparseFormat format,
+                                     const void *data, DLiteType type,
+                                     size_t size, int ndims,
+                                     const size_t *shape);
+
+/**
+  Writes `sp` to the dense C-ordered array `data`, which must have
+  room for all elements of `sp`.  Elements not stored in `sp` are set
+  to zero.  Only elements that are non-zero in either `sp` or `data`
+  are written to.
+
+  Returns non-zero on error.
+ */
+int dlite_sparse_to_dense(const DLiteSparse *sp, void *data);
+
+/**
+  Like dlite_sparse_from_dense(), but reads the elements from array
+  `arr`, which may have any memory layout.
+
+  Returns NULL on error.
+ */
+DLiteSparse *dlite_sparse_from_array(DLiteSparseFormat format,
+                                     const DLiteArray *arr);
+
+/**
+  Like dlite_sparse_to_dense(), but writes to array `arr`, which must
+  have the same type and shape as `sp`, but may have any memory layout.
+
+  Returns non-zero on error.
+ */
+int dlite_sparse_to_array(const DLiteSparse *sp, DLiteArray *arr);
+
+/**
+  Returns a new copy of `sp` converted to format `format`.
+
+  Returns NULL on error.
+ */
+DLiteSparse *dlite_sparse_convert(const DLiteSparse *sp,
+                                  DLiteSparseFormat format);
+
+/**
+  Writes the coordinates of stored element `k` of `sp` to `ind`, which
+  must have length `sp->ndims`.
+
+  Returns non-zero on error.
+ */
+int dlite_sparse_coords(const DLiteSparse *sp, size_t k, size_t *ind);
+
+/**
+  Returns a pointer to the element of `sp` at coordinates `ind` or NULL
+  if it is not stored, i.e. if it is zero.  The elements must be
+  stored in row-major order.
+ */
+const void *dlite_sparse_get(const DLiteSparse *sp, const size_t *ind);
+
+
+/**
+  @name Sparse properties
+  @{
+ */
+
+/**
+  Declares property `name` of `meta` to be serialised in sparse format
+  `format`.  If `format` is `dliteSparseNone`, the property is
+  serialised dense.  The property must be an array of a non-allocated
+  type and CSR requires two dimensions.
+
+  Returns non-zero on error.
+ */
+int dlite_meta_set_sparse_property(DLiteMeta *meta, const char *name,
+                                   DLiteSparseFormat format);
+
+/**
+  Returns the sparse format of property number `i` of `meta`.
+ */
+DLiteSparseFormat dlite_meta_get_sparse_format(const DLiteMeta *meta,
+                                               size_t i);
+
+/**
+  Returns a new sparse array with the non-zero elements of property
+  number `i` of `inst`.  If `format` is `dliteSparseNone`, the format
+  declared by the metadata is used, or COO if the property is not
+  declared as sparse.
+
+  Returns NULL on error.
+ */
+DLiteSparse *dlite_instance_get_sparse_by_index(const DLiteInstance *inst,
+                                                size_t i,
+                                                DLiteSparseFormat format);
+
+/**
+  Like dlite_instance_get_sparse_by_index(), but the property is
+  given by its name.
+ */
+DLiteSparse *dlite_instance_get_sparse(const DLiteInstance *inst,
+                                       const char *name,
+                                       DLiteSparseFormat format);
+
+/**
+  Assigns property number `i` of `inst` from sparse array `sp`, which
+  must have the same type and shape as the property.
+
+  Returns non-zero on error.
+ */
+int dlite_instance_set_sparse_by_index(DLiteInstance *inst, size_t i,
+                                       const DLiteSparse *sp);
+
+/**
+  Like dlite_instance_set_sparse_by_index(), but the property is
+  given by its name.
+ */
+int dlite_instance_set_sparse(DLiteInstance *inst, const char *name,
+                              const DLiteSparse *sp);
+
+/** @} */
+
+
+#endif /* _DLITE_SPARSE_H */
@@ -0,0 +1,331 @@
+/* dlite-stats.c -- runtime counters and memory accounting
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/thread.h"
+#include "dlite-misc.h"
+#include "dlite-entity.h"
+#include "dlite-stats.h"
+
+#define GLOBALS_ID "dlite-stats-id"
+
+/* Counters stored in the globals */
+typedef struct {
+  int64_t counters[dliteStatsNCounters];
+  int ndrivers;
+  DLiteDriverStats drivers[DLITE_STATS_MAX_DRIVERS];
+} Counters;
+
+/* Serialises creation of the counters and adding new drivers */
+static ThreadMutex _stats_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Returns the counters of the current globals or NULL on error.  No
+   counters are created while the globals are free'ed at exit. */
+static Counters *get_counters(void)
+{
+  Counters *c = dlite_globals_get_state(GLOBALS_ID);
+  if (!c && !dlite_globals_in_atexit()) {
+    thread_mutex_lock(&_stats_mutex);
+    if (!(c = dlite_globals_get_state(GLOBALS_ID))) {
+      if (!(c = calloc(1, sizeof(Counters))))
+        err(1, "allocation failure");
+      else
+        dlite_globals_add_state(GLOBALS_ID, c, free);
+    }
+    thread_mutex_unlock(&_stats_mutex);
+  }
+  return c;
+}
+
+/* Returns the statistics of `driver` or NULL if the maximum number of
+   drivers is reached. */
+static DLiteDriverStats *get_driver(Counters *c, const char *driver)
+{
+  DLiteDriverStats *d=NULL;
+  int i, n = thread_atomic_load(&c->ndrivers);
+  for (i=0; i<n; i++)
+    if (strcmp(c->drivers[i].driver, driver) == 0) return c->drivers + i;
+
+  thread_mutex_lock(&_stats_mutex);
+  for (n=c->ndrivers; i<n; i++)
+    if (strcmp(c->drivers[i].driver, driver) == 0) d = c->drivers + i;
+  if (!d && n < DLITE_STATS_MAX_DRIVERS) {
+    d = c->drivers + n;
+    strncpy(d->driver, driver, sizeof(d->driver) - 1);
+    thread_atomic_add(&c->ndrivers, 1);
+  }
+  thread_mutex_unlock(&_stats_mutex);
+  return d;
+}
+
+
+/* Accumulates live instances, used by dlite_stats_get() */
+typedef struct {
+  DLiteStats *stats;
+  map_int_t index;   /* maps metadata uri to index in stats->meta */
+  size_t size;       /* allocated length of stats->meta */
+} Accumulator;
+
+/* Callback for dlite_instance_store_foreach() adding `inst` to the
+   accumulator `data`. */
+static int accumulate(const DLiteInstance *inst, void *data)
+{
+  Accumulator *acc = data;
+  DLiteStats *stats = acc->stats;
+  DLiteMetaStats *m;
+  const char *uri = inst->meta->uri;
+  size_t nbytes = dlite_stats_instance_nbytes(inst);
+  int *ip;
+
+  if ((ip = map_get(&acc->index, uri))) {
+    m = stats->meta + *ip;
+  } else {
+    if (stats->nmeta >= acc->size) {
+      size_t size = acc->size + 32;
+      void *ptr = realloc(stats->meta, size*sizeof(DLiteMetaStats));
+      if (!ptr) return err(-1, "allocation failure");
+      stats->meta = ptr;
+      acc->size = size;
+    }
+    m = stats->meta + stats->nmeta;
+    memset(m, 0, sizeof(DLiteMetaStats));
+    if (!(m->uri = strdup(uri))) return err(-1, "allocation failure");
+    map_set(&acc->index, m->uri, (int)stats->nmeta);
+    stats->nmeta++;
+  }
+  m->ninstances++;
+  m->nbytes += nbytes;
+  stats->ninstances++;
+  stats->nbytes += nbytes;
+  return 0;
+}
+
+/* Compares DLiteMetaStats by decreasing number of instances, for qsort() */
+static int metacmp(const void *a, const void *b)
+{
+  const DLiteMetaStats *ma = a, *mb = b;
+  if (ma->ninstances != mb->ninstances)
+    return (ma->ninstances < mb->ninstances) ? 1 : -1;
+  return strcmp(ma->uri, mb->uri);
+}
+
+
+/*
+  Takes a snapshot of the runtime statistics and stores it in `stats`,
+  which must be released with dlite_stats_deinit().
+
+  Returns non-zero on error.
+ */
+int dlite_stats_get(DLiteStats *stats)
+{
+  Counters *c;
+  Accumulator acc;
+  int i, j, stat;
+  static Counters nocounters;
+
+  memset(stats, 0, sizeof(DLiteStats));
+  if (!(c = get_counters())) c = &nocounters;
+
+  for (i=0; i<dliteStatsNCounters; i++)
+    stats->counters[i] = thread_counter_load(&c->counters[i]);
+
+  stats->ndrivers = thread_atomic_load(&c->ndrivers);
+  if (stats->ndrivers &&
+      !(stats->drivers = calloc(stats->ndrivers, sizeof(DLiteDriverStats))))
+    return err(1, "allocation failure");
+  for (i=0; i<(int)stats->ndrivers; i++) {
+    DLiteDriverStats *d = stats->drivers + i;
+    strcpy(d->driver, c->drivers[i].driver);
+    for (j=0; j<dliteStatsNDriverCounters; j++) {
+      d->counters[j] = thread_counter_load(&c->drivers[i].counters[j]);
+      stats->totals[j] += d->counters[j];
+    }
+  }
+
+  acc.stats = stats;
+  acc.size = 0;
+  map_init(&acc.index);
+  stat = dlite_instance_store_foreach(accumulate, &acc);
+  map_deinit(&acc.index);
+  if (stat) {
+    dlite_stats_deinit(stats);
+    return 1;
+  }
+  qsort(stats->meta, stats->nmeta, sizeof(DLiteMetaStats), metacmp);
+  return 0;
+}
+
+/*
+  Releases memory allocated by dlite_stats_get().
+ */
+void dlite_stats_deinit(DLiteStats *stats)
+{
+  size_t i;
+  for (i=0; i<stats->nmeta; i++) free(stats->meta[i].uri);
+  free(stats->meta);
+  free(stats->drivers);
+  memset(stats, 0, sizeof(DLiteStats));
+}
+
+/*
+  Resets all counters to zero.  The number of live instances is not
+  affected.
+ */
+void dlite_stats_reset(void)
+{
+  Counters *c;
+  int i, j, n;
+  if (!(c = get_counters())) return;
+  for (i=0; i<dliteStatsNCounters; i++)
+    thread_counter_store(&c->counters[i], 0);
+  n = thread_atomic_load(&c->ndrivers);
+  for (i=0; i<n; i++)
+    for (j=0; j<dliteStatsNDriverCounters; j++)
+      thread_counter_store(&c->drivers[i].counters[j], 0);
+}
+
+/* Returns the hit rate in percent. */
+static double hitrate(int64_t hits, int64_t misses)
+{
+  return (hits + misses) ? 100.0 * hits / (hits + misses) : 0.0;
+}
+
+/*
+  Writes `stats` in a human readable form to `fp`.
+
+  Returns non-zero on error.
+ */
+int dlite_stats_fprint(FILE *fp, const DLiteStats *stats)
+{
+  const int64_t *c = stats->counters;
+  size_t i;
+
+  fprintf(fp, "Live instances:       %zu (%zu bytes)\n",
+          stats->ninstances, stats->nbytes);
+  fprintf(fp, "Instance store:       %lld hits, %lld misses (%.1f%%)\n",
+          (long long)c[dliteStatsStoreHits],
+          (long long)c[dliteStatsStoreMisses],
+          hitrate(c[dliteStatsStoreHits], c[dliteStatsStoreMisses]));
+  if (c[dliteStatsStoreEvictions] || c[dliteStatsStoreReloads])
+    fprintf(fp, "Bounded store:        %lld evictions, %lld reloads\n",
+            (long long)c[dliteStatsStoreEvictions],
+            (long long)c[dliteStatsStoreReloads]);
+  fprintf(fp, "Mapping plan cache:   %lld hits, %lld misses (%.1f%%)\n",
+          (long long)c[dliteStatsPlanHits],
+          (long long)c[dliteStatsPlanMisses],
+          hitrate(c[dliteStatsPlanHits], c[dliteStatsPlanMisses]));
+  if (c[dliteStatsCastCacheHits] || c[dliteStatsCastCacheMisses])
+    fprintf(fp, "Cast cache:           %lld hits, %lld misses (%.1f%%)\n",
+            (long long)c[dliteStatsCastCacheHits],
+            (long long)c[dliteStatsCastCacheMisses],
+            hitrate(c[dliteStatsCastCacheHits],
+                    c[dliteStatsCastCacheMisses]));
+  fprintf(fp, "JSON tokens parsed:   %lld\n",
+          (long long)c[dliteStatsJsonTokens]);
+  fprintf(fp, "Storages opened:      %lld\n",
+          (long long)stats->totals[dliteStatsOpens]);
+  fprintf(fp, "Bytes read/written:   %lld / %lld\n",
+          (long long)stats->totals[dliteStatsBytesRead],
+          (long long)stats->totals[dliteStatsBytesWritten]);
+
+  if (stats->nmeta) {
+    fprintf(fp, "\nLive instances per metadata:\n");
+    fprintf(fp, "  %10s %12s  %s\n", "instances", "bytes", "metadata");
+    for (i=0; i<stats->nmeta; i++)
+      fprintf(fp, "  %10zu %12zu  %s\n", stats->meta[i].ninstances,
+              stats->meta[i].nbytes, stats->meta[i].uri);
+  }
+
+  if (stats->ndrivers) {
+    fprintf(fp, "\nStorage drivers:\n");
+    fprintf(fp, "  %-16s %8s %14s %14s\n",
+            "driver", "opens", "bytes read", "bytes written");
+    for (i=0; i<stats->ndrivers; i++) {
+      const DLiteDriverStats *d = stats->drivers + i;
+      fprintf(fp, "  %-16s %8lld %14lld %14lld\n", d->driver,
+              (long long)d->counters[dliteStatsOpens],
+              (long long)d->counters[dliteStatsBytesRead],
+              (long long)d->counters[dliteStatsBytesWritten]);
+    }
+  }
+  return (ferror(fp)) ? err(1, "error writing statistics") : 0;
+}
+
+/*
+  Takes a snapshot of the runtime statistics and writes it to
+  `filename`.  The special names "-" and "stderr" write to standard
+  output and standard error, respectively.
+
+  Returns non-zero on error.
+ */
+int dlite_stats_write(const char *filename)
+{
+  DLiteStats stats;
+  FILE *fp;
+  int stat;
+  if (strcmp(filename, "-") == 0)
+    fp = stdout;
+  else if (strcmp(filename, "stderr") == 0)
+    fp = stderr;
+  else if (!(fp = fopen(filename, "w")))
+    return err(1, "cannot open statistics file: %s", filename);
+  if (!(stat = dlite_stats_get(&stats))) {
+    stat = dlite_stats_fprint(fp, &stats);
+    dlite_stats_deinit(&stats);
+  }
+  if (fp != stdout && fp != stderr) fclose(fp);
+  return stat;
+}
+
+/*
+  Returns the number of bytes allocated for instance `inst` and its
+  property arrays.  Memory referred to by properties, like strings,
+  is not included.
+ */
+size_t dlite_stats_instance_nbytes(const DLiteInstance *inst)
+{
+  size_t i, nbytes = DLITE_INSTANCE_SIZE(inst);
+  const DLiteMeta *meta = inst->meta;
+  if (!meta->_properties) return nbytes;
+  for (i=0; i<meta->_nproperties; i++) {
+    const DLiteProperty *p = meta->_properties + i;
+    if (p->ndims > 0 && p->dims) {
+      const size_t *pdims = DLITE_PROP_DIMS(inst, i);
+      size_t j, n = p->size;
+      for (j=0; j<(size_t)p->ndims; j++) n *= pdims[j];
+      nbytes += n;
+    }
+  }
+  return nbytes;
+}
+
+
+/*
+  Adds `n` to global counter `counter`.
+ */
+void dlite_stats_add(DLiteStatsCounter counter, int64_t n)
+{
+  Counters *c = get_counters();
+  if (c) thread_counter_add(&c->counters[counter], n);
+}
+
+/*
+  Adds `n` to counter `counter` of storage driver `driver`.  Drivers
+  beyond the first DLITE_STATS_MAX_DRIVERS are not counted.
+ */
+void dlite_stats_add_driver(const char *driver,
+                            DLiteStatsDriverCounter counter, int64_t n)
+{
+  Counters *c = get_counters();
+  DLiteDriverStats *d;
+  if (c && (d = get_driver(c, driver)))
+    thread_counter_add(&d->counters[counter], n);
+}
@@ -0,0 +1,157 @@
+#ifndef _DLITE_STATS_H
+#define _DLITE_STATS_H
+
+/**
+  @file
+  @brief Runtime counters and memory accounting
+
+  DLite maintains a set of counters, like the number of hits and
+  misses in the in-memory instance store, the number of storages
+  opened with each driver and the number of parsed JSON tokens.  The
+  counters are atomic and cheap enough to always be enabled.
+
+  The number of live instances and the memory allocated for them are
+  not counted, but computed from the instance store when
+  dlite_stats_get() is called.  A number of live instances of some
+  metadata that keeps growing is a sign of a reference leak.
+
+  Like the instance store, the counters are kept in the current
+  globals (see dlite_globals_get()).
+
+  If the environment variable `DLITE_STATS` is set, the statistics are
+  written to the file it names at exit.  The special names "-" and
+  "stderr" write to standard output and standard error, respectively.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "dlite-entity.h"
+
+/** Maximum length of driver names in the statistics, including NUL. */
+#define DLITE_STATS_DRIVER_SIZE 32
+
+/** Maximum number of drivers that are counted separately. */
+#define DLITE_STATS_MAX_DRIVERS 64
+
+
+/** Global counters. */
+typedef enum {
+  dliteStatsStoreHits,     /*!< Instances found in the instance store */
+  dliteStatsStoreMisses,   /*!< Instances not found in the instance store */
+  dliteStatsJsonTokens,    /*!< Parsed JSON tokens */
+  dliteStatsPlanHits,      /*!< Mapping plans found in the plan cache */
+  dliteStatsPlanMisses,    /*!< Mapping plans not found in the plan cache */
+  dliteStatsStoreEvictions,  /*!< Instances released by the bounded
+                                  instance store */
+  dliteStatsStoreReloads,  /*!< Released instances reloaded on access */
+  dliteStatsCastCacheHits,   /*!< Casted instances found in the cast
+                                  cache */
+  dliteStatsCastCacheMisses, /*!< Casted instances not found in the cast
+                                  cache */
+  dliteStatsNCounters      /*!< Number of global counters */
+} DLiteStatsCounter;
+
+/** Counters per storage driver. */
+typedef enum {
+  dliteStatsOpens,         /*!< Opened storages */
+  dliteStatsBytesRead,     /*!< In-memory size of loaded instances */
+  dliteStatsBytesWritten,  /*!< In-memory size of saved instances */
+  dliteStatsNDriverCounters  /*!< Number of driver counters */
+} DLiteStatsDriverCounter;
+
+
+/** Live instances of one metadata. */
+typedef struct {
+  char *uri;               /*!< Metadata URI */
+  size_t ninstances;       /*!< Number of live instances */
+  size_t nbytes;           /*!< Bytes allocated for the instances */
+} DLiteMetaStats;
+
+/** Counters of one storage driver. */
+typedef struct {
+  char driver[DLITE_STATS_DRIVER_SIZE];  /*!< Driver name */
+  int64_t counters[dliteStatsNDriverCounters];  /*!< Driver counters */
+} DLiteDriverStats;
+
+/** Snapshot of the runtime statistics. */
+typedef struct {
+  size_t ninstances;       /*!< Number of live instances, including
+                                metadata */
+  size_t nbytes;           /*!< Bytes allocated for live instances */
+  int64_t counters[dliteStatsNCounters];  /*!< Global counters */
+  int64_t totals[dliteStatsNDriverCounters];  /*!< Driver counters
+                                                   summed over drivers */
+  size_t nmeta;            /*!< Length of `meta` */
+  DLiteMetaStats *meta;    /*!< Live instances per metadata, sorted by
+                                decreasing number of instances */
+  size_t ndrivers;         /*!< Length of `drivers` */
+  DLiteDriverStats *drivers;  /*!< Counters per driver */
+} DLiteStats;
+
+
+/**
+  Takes a snapshot of the runtime statistics and stores it in `stats`,
+  which must be released with dlite_stats_deinit().
+
+  Returns non-zero on error.
+ */
+int dlite_stats_get(DLiteStats *stats);
+
+/**
+  Releases memory allocated by dlite_stats_get().
+ */
+void dlite_stats_deinit(DLiteStats *stats);
+
+/**
+  Resets all counters to zero.  The number of live instances is not
+  affected.
+ */
+void dlite_stats_reset(void);
+
+/**
+  Writes `stats` in a human readable form to `fp`.
+
+  Returns non-zero on error.
+ */
+int dlite_stats_fprint(FILE *fp, const DLiteStats *stats);
+
+/**
+  Takes a snapshot of the runtime statistics and writes it to
+  `filename`.  The special names "-" and "stderr" write to standard
+  output and standard error, respectively.
+
+  Returns non-zero on error.
+ */
+int dlite_stats_write(const char *filename);
+
+/**
+  Returns the number of bytes allocated for instance `inst` and its
+  property arrays.  Memory referred to by properties, like strings,
+  is not included.
+ */
+size_t dlite_stats_instance_nbytes(const DLiteInstance *inst);
+
+
+/**
+  @name Functions for updating the counters
+  Mostly intended for internal use.
+  @{
+ */
+
+/**
+  Adds `n` to global counter `counter`.
+ */
+void dlite_stats_add(DLiteStatsCounter counter, int64_t n);
+
+/**
+  Adds `n` to counter `counter` of storage driver `driver`.  Drivers
+  beyond the first DLITE_STATS_MAX_DRIVERS are not counted.
+ */
+void dlite_stats_add_driver(const char *driver,
+                            DLiteStatsDriverCounter counter, int64_t n);
+
+/** @} */
+
+
+#endif /* _DLITE_STATS_H */
@@ -0,0 +1,756 @@
+/* dlite-storage-index.c -- index mapping instance UUIDs to storages
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/fileinfo.h"
+#include "utils/map.h"
+#include "utils/thread.h"
+#include "pathshash.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-storage-index.h"
+#include "dlite-bloom.h"
+
+#define GLOBALS_ID "dlite-storage-index-id"
+
+/* First line of index files */
+#define INDEX_HEADER "# dlite storage index 1"
+
+/* Size of the path hash in bytes */
+#define HASHSIZE 32
+
+/* Maximum number of additional threads used for indexing */
+#define INDEX_MAX_THREADS 32
+
+
+/* An indexed storage file */
+typedef struct {
+  char *location;           /* path to the file */
+  char *driver;             /* driver used to open the file */
+  char *options;            /* options used to open the file, may be NULL */
+  double mtime;             /* modification time when the file was indexed */
+  int iterable;             /* whether the instances in the file could be
+                               listed */
+  int order;                /* position in the storage paths */
+  int visited;              /* id of the last update that visited the file */
+  size_t ninst;             /* number of instances */
+  char (*uuids)[DLITE_UUID_LENGTH+1];  /* uuids of the instances */
+} IndexFile;
+
+/* Global variables for this module */
+typedef struct {
+  unsigned char hash[HASHSIZE];  /* pathshash() of the indexed paths */
+  IndexFile *files;         /* indexed files */
+  size_t nfiles;            /* number of indexed files */
+  size_t size;              /* allocated length of `files` */
+  map_int_t uuids;          /* maps uuid to index in `files` */
+  map_int_t locations;      /* maps location to index in `files` */
+  int updating;             /* whether an update is in progress */
+  int updates;              /* number of updates */
+  int loaded;               /* whether we have tried to read the index file */
+} Globals;
+
+
+/* Protects the globals */
+static ThreadMutex index_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Frees the memory used by file `f`. */
+static void free_file(IndexFile *f)
+{
+  free(f->location);
+  free(f->driver);
+  if (f->options) free(f->options);
+  if (f->uuids) free(f->uuids);
+}
+
+/* Frees global state for this module - called by atexit() */
+static void free_globals(void *globals)
+{
+  Globals *g = globals;
+  size_t i;
+  for (i=0; i<g->nfiles; i++) free_file(g->files + i);
+  if (g->files) free(g->files);
+  map_deinit(&g->uuids);
+  map_deinit(&g->locations);
+  free(g);
+}
+
+/* Return a pointer to global state for this module */
+static Globals *get_globals(void)
+{
+  Globals *g = dlite_globals_get_state(GLOBALS_ID);
+  if (!g) {
+    thread_mutex_lock(&index_mutex);
+    if (!(g = dlite_globals_get_state(GLOBALS_ID))) {
+      if ((g = calloc(1, sizeof(Globals)))) {
+        map_init(&g->uuids);
+        map_init(&g->locations);
+        dlite_globals_add_state(GLOBALS_ID, g, free_globals);
+      }
+    }
+    thread_mutex_unlock(&index_mutex);
+    if (!g) return err(1, "allocation failure"), NULL;
+  }
+  return g;
+}
+
+/* Returns the name of the index file or NULL if the index is not
+   persistent. */
+static const char *index_filename(void)
+{
+  const char *filename = getenv("DLITE_STORAGE_INDEX");
+  return (filename && *filename) ? filename : NULL;
+}
+
+/* Compares the order of two files, used by rebuild_maps(). */
+static int cmp_order(const void *a, const void *b)
+{
+  const IndexFile *fa = *(IndexFile **)a, *fb = *(IndexFile **)b;
+  return fb->order - fa->order;
+}
+
+/* Rebuilds the maps from the indexed files.  If an uuid is found in
+   several files, it is mapped to the first file in the storage
+   paths.  Must be called with `index_mutex` held.  Returns non-zero
+   on error. */
+static int rebuild_maps(Globals *g)
+{
+  IndexFile **sorted;
+  size_t i, j;
+  map_deinit(&g->uuids);
+  map_deinit(&g->locations);
+  map_init(&g->uuids);
+  map_init(&g->locations);
+  if (!g->nfiles) return 0;
+  if (!(sorted = malloc(g->nfiles * sizeof(IndexFile *))))
+    return err(1, "allocation failure");
+  for (i=0; i<g->nfiles; i++) sorted[i] = g->files + i;
+  qsort(sorted, g->nfiles, sizeof(IndexFile *), cmp_order);
+  for (i=0; i<g->nfiles; i++) {
+    IndexFile *f = sorted[i];
+    int n = f - g->files;
+    map_set(&g->locations, f->location, n);
+    for (j=0; j<f->ninst; j++)
+      map_set(&g->uuids, f->uuids[j], n);
+  }
+  free(sorted);
+  return 0;
+}
+
+/* Lists the instances in storage `location`.  On success, the uuids
+   are returned via `uuids` and `ninst`, and `iterable` is set to
+   whether the storage supports listing its instances.  Errors are
+   suppressed, storages that cannot be opened are just not
+   iterable. */
+static void index_storage(const char *driver, const char *location,
+                          const char *options,
+                          char (**uuids)[DLITE_UUID_LENGTH+1],
+                          size_t *ninst, int *iterable)
+{
+  DLiteStorage *s=NULL;
+  char **names=NULL;
+  size_t i, n=0;
+  *uuids = NULL;
+  *ninst = 0;
+  *iterable = 0;
+  ErrTry:
+    if ((s = dlite_storage_cache_open(driver, location, options)) &&
+        ((s->api->iterCreate && s->api->iterNext && s->api->iterFree) ||
+         s->api->getUUIDs)) {
+      *iterable = 1;
+      if ((names = dlite_storage_uuids(s, NULL))) {
+        while (names[n]) n++;
+        if (n && !(*uuids = malloc(n * sizeof(**uuids)))) {
+          *iterable = 0;
+          n = 0;
+        }
+        for (i=0; i<n; i++) {
+          strncpy((*uuids)[i], names[i], DLITE_UUID_LENGTH);
+          (*uuids)[i][DLITE_UUID_LENGTH] = '\0';
+        }
+        *ninst = n;
+      }
+    }
+  ErrOther:
+    break;
+  ErrEnd;
+  if (names) dlite_storage_uuids_free(names);
+  if (s) dlite_storage_cache_release(s);
+}
+
+/* Adds or replaces the indexed file for `location`.  Takes over the
+   ownership of `uuids`.  Must be called with `index_mutex` held.
+   Returns non-zero on error. */
+static int set_file(Globals *g, const char *driver, const char *location,
+                    const char *options, double mtime, int order,
+                    int iterable, char (*uuids)[DLITE_UUID_LENGTH+1],
+                    size_t ninst)
+{
+  IndexFile *f;
+  int *ip = map_get(&g->locations, location);
+  if (ip) {
+    f = g->files + *ip;
+    free_file(f);
+  } else {
+    if (g->nfiles >= g->size) {
+      size_t size = g->size + 64;
+      void *ptr = realloc(g->files, size*sizeof(IndexFile));
+      if (!ptr) {
+        if (uuids) free(uuids);
+        return err(1, "allocation failure");
+      }
+      g->files = ptr;
+      g->size = size;
+    }
+    f = g->files + g->nfiles;
+    map_set(&g->locations, location, g->nfiles);
+    g->nfiles++;
+  }
+  memset(f, 0, sizeof(IndexFile));
+  f->location = strdup(location);
+  f->driver = strdup((driver) ? driver : "");
+  f->options = (options) ? strdup(options) : NULL;
+  f->mtime = mtime;
+  f->iterable = iterable;
+  f->order = order;
+  f->visited = g->updates;
+  f->ninst = ninst;
+  f->uuids = uuids;
+  return 0;
+}
+
+
+/* Reads index file `filename` into `g`.  Must be called with
+   `index_mutex` held.  Returns non-zero on error. */
+static int read_index(Globals *g, const char *filename)
+{
+  FILE *fp;
+  char line[4096], *p;
+  IndexFile *f=NULL;
+  int stat=1, order=0;
+  if (!(fp = fopen(filename, "r"))) return 1;  /* not an error */
+  if (!fgets(line, sizeof(line), fp) ||
+      strncmp(line, INDEX_HEADER, strlen(INDEX_HEADER)) != 0)
+    FAIL1("not a dlite storage index: %s", filename);
+  while (fgets(line, sizeof(line), fp)) {
+    size_t len = strlen(line);
+    if (len && line[len-1] == '\n') line[--len] = '\0';
+    if (len && line[len-1] == '\r') line[--len] = '\0';
+    if (strncmp(line, "hash ", 5) == 0) {
+      size_t i;
+      if (len != 5 + 2*HASHSIZE) FAIL1("invalid hash in %s", filename);
+      for (i=0; i<HASHSIZE; i++) {
+        unsigned int v;
+        if (sscanf(line + 5 + 2*i, "%2x", &v) != 1)
+          FAIL1("invalid hash in %s", filename);
+        g->hash[i] = v;
+      }
+    } else if (strncmp(line, "file ", 5) == 0) {
+      char driver[64], options[1024], *location;
+      double mtime;
+      int iterable, n;
+      if (sscanf(line+5, "%lg %d %63s %1023s %n", &mtime, &iterable,
+                 driver, options, &n) < 4)
+        FAIL1("invalid file entry in %s", filename);
+      location = line + 5 + n;
+      if (set_file(g, driver, location,
+                   (strcmp(options, "-") == 0) ? NULL : options,
+                   mtime, order++, iterable, NULL, 0)) goto fail;
+      f = g->files + *map_get(&g->locations, location);
+    } else if (f && len == DLITE_UUID_LENGTH) {
+      if (!(p = realloc(f->uuids, (f->ninst+1)*sizeof(*f->uuids))))
+        FAIL("allocation failure");
+      f->uuids = (void *)p;
+      memcpy(f->uuids[f->ninst++], line, DLITE_UUID_LENGTH+1);
+    } else if (len) {
+      FAIL2("invalid line in %s: %s", filename, line);
+    }
+  }
+  stat = rebuild_maps(g);
+ fail:
+  fclose(fp);
+  return stat;
+}
+
+/* Writes the index in `g` to `filename`.  Must be called with
+   `index_mutex` held.  Returns non-zero on error. */
+static int write_index(Globals *g, const char *filename)
+{
+  FILE *fp=NULL;
+  char *tmpname=NULL;
+  size_t i, j;
+  int stat=1;
+  if (!(tmpname = malloc(strlen(filename) + 5))) FAIL("allocation failure");
+  sprintf(tmpname, "%s.tmp", filename);
+  if (!(fp = fopen(tmpname, "w")))
+    FAIL1("cannot write storage index: %s", tmpname);
+  fprintf(fp, "%s\n", INDEX_HEADER);
+  fprintf(fp, "hash ");
+  for (i=0; i<HASHSIZE; i++) fprintf(fp, "%02x", g->hash[i]);
+  fprintf(fp, "\n");
+  for (i=0; i<g->nfiles; i++) {
+    IndexFile *f = g->files + i;
+    /* skip entries that cannot be represented in the file */
+    if (strchr(f->driver, ' ') || !*f->driver ||
+        (f->options && (strchr(f->options, ' ') || !*f->options)) ||
+        strchr(f->location, '\n')) continue;
+    fprintf(fp, "file %.17g %d %s %s %s\n", f->mtime, f->iterable,
+            f->driver, (f->options) ? f->options : "-", f->location);
+    for (j=0; j<f->ninst; j++) fprintf(fp, "%s\n", f->uuids[j]);
+  }
+  if (fclose(fp)) {
+    fp = NULL;
+    FAIL1("error writing storage index: %s", tmpname);
+  }
+  fp = NULL;
+#ifdef _WIN32
+  remove(filename);
+#endif
+  if (rename(tmpname, filename))
+    FAIL1("cannot write storage index: %s", filename);
+  stat = 0;
+ fail:
+  if (fp) fclose(fp);
+  if (tmpname) free(tmpname);
+  return stat;
+}
+
+/* Reads the index file on first use, if the index is persistent.
+   Must be called with `index_mutex` held. */
+static void load_index(Globals *g)
+{
+  const char *filename;
+  if (g->loaded) return;
+  g->loaded = 1;
+  if ((filename = index_filename()) && fileinfo_exists(filename)) {
+    ErrTry:
+      read_index(g, filename);
+    ErrOther:
+      /* ignore invalid index file, it will be rewritten */
+      break;
+    ErrEnd;
+  }
+}
+
+
+/* A storage file to be indexed by update_index() */
+typedef struct {
+  char *copy;               /* storage url, split into the fields below */
+  char *driver;             /* driver used to open the file */
+  char *location;           /* path to the file */
+  char *options;            /* options used to open the file */
+  double mtime;             /* modification time before indexing */
+  int order;                /* position in the storage paths */
+  int bloom;                /* whether the file has an up to date Bloom
+                               filter sidecar, then it is not listed */
+  int iterable;             /* result of index_storage() */
+  size_t ninst;             /* result of index_storage() */
+  char (*uuids)[DLITE_UUID_LENGTH+1];  /* result of index_storage() */
+} IndexTask;
+
+/* Work shared by the threads indexing storages in parallel */
+typedef struct {
+  IndexTask *tasks;         /* storages to index */
+  size_t ntasks;            /* number of storages */
+  size_t next;              /* index of next storage to index */
+  ThreadMutex mutex;        /* protects `next` */
+} IndexWork;
+
+/* Returns the number of threads to use for indexing storages. */
+static int index_threads(void)
+{
+  char *endptr, *p = getenv("DLITE_INDEX_THREADS");
+  int n;
+  if (!p || !*p) return 1;
+  n = strtol(p, &endptr, 10);
+  if (*endptr || n < 1) {
+    warnx("invalid value of DLITE_INDEX_THREADS: '%s'", p);
+    return 1;
+  }
+  return n;
+}
+
+/* Thread function indexing the storages in `arg` until all are done. */
+static void *index_worker(void *arg)
+{
+  IndexWork *work = arg;
+  while (1) {
+    IndexTask *t;
+    thread_mutex_lock(&work->mutex);
+    t = (work->next < work->ntasks) ? work->tasks + work->next++ : NULL;
+    thread_mutex_unlock(&work->mutex);
+    if (!t) break;
+    if (t->bloom) continue;
+    index_storage(t->driver, t->location, t->options, &t->uuids, &t->ninst,
+                  &t->iterable);
+  }
+  return NULL;
+}
+
+/* Indexes the `ntasks` storages in `tasks`.  Up to DLITE_INDEX_THREADS
+   storages are opened and listed concurrently, such that the latency
+   of e.g. network file systems is paid once rather than once per
+   storage. */
+static void index_tasks(IndexTask *tasks, size_t ntasks)
+{
+  IndexWork work;
+  Thread threads[INDEX_MAX_THREADS];
+  size_t i;
+  int n, nthreads=0;
+
+  n = index_threads();
+  if (n > INDEX_MAX_THREADS + 1) n = INDEX_MAX_THREADS + 1;
+  if ((size_t)n > ntasks) n = (int)ntasks;
+
+  memset(&work, 0, sizeof(work));
+  work.tasks = tasks;
+  work.ntasks = ntasks;
+  thread_mutex_init(&work.mutex);
+
+  /* load the plugins up front, since loading plugins is not thread
+     safe */
+  if (n > 1) {
+    for (i=0; i<ntasks; i++) {
+      ErrTry:
+        dlite_storage_plugin_get(tasks[i].driver);
+      ErrOther:
+        break;
+      ErrEnd;
+    }
+  }
+
+  /* the current thread is also a worker */
+  while (nthreads < n - 1 &&
+         thread_create(threads + nthreads, index_worker, &work) == 0)
+    nthreads++;
+  index_worker(&work);
+  for (i=0; i<(size_t)nthreads; i++) thread_join(threads[i], NULL);
+  thread_mutex_destroy(&work.mutex);
+}
+
+/* Indexes all storage files in the storage paths that are not indexed
+   or have been modified since they were indexed.  Files that are no
+   longer in the storage paths are removed from the index.  Files with
+   an up to date Bloom filter sidecar are not opened, but indexed as not
+   iterable, such that dlite_instance_get() checks their sidecar.
+
+   If an update is already running (possibly in the current thread,
+   if a storage plugin looks up instances when it is opened), this
+   function returns 1 immediately.  Returns non-zero on error. */
+static int update_index(Globals *g, const unsigned char *hash)
+{
+  DLiteStoragePathIter *iter;
+  const char *url, *filename;
+  IndexTask *tasks=NULL;
+  size_t i, n, ntasks=0, size=0;
+  int visited, order=0, stat=0;
+
+  thread_mutex_lock(&index_mutex);
+  if (g->updating) {
+    thread_mutex_unlock(&index_mutex);
+    return 1;
+  }
+  g->updating = 1;
+  visited = ++g->updates;
+  thread_mutex_unlock(&index_mutex);
+
+  /* find the files that needs to be (re)indexed */
+  if (!(iter = dlite_storage_paths_iter_start())) {
+    stat = 1;
+  } else {
+    while ((url = dlite_storage_paths_iter_next(iter))) {
+      char *copy, *driver, *location, *options;
+      double mtime;
+      int *ip, uptodate=0;
+      if (!(copy = strdup(url))) {
+        stat = err(1, "allocation failure");
+        break;
+      }
+#ifdef _WIN32
+      dlite_split_url_winpath(copy, &driver, &location, &options, NULL, 1);
+#else
+      dlite_split_url(copy, &driver, &location, &options, NULL);
+#endif
+      if (!driver) driver = (char *)fu_fileext(location);
+      if (!options) options = "mode=r";
+
+      /* only normal files are indexed */
+      if (driver && *driver && fileinfo_isnormal(location) &&
+          (mtime = fileinfo_mtime(location)) >= 0) {
+        thread_mutex_lock(&index_mutex);
+        if ((ip = map_get(&g->locations, location))) {
+          IndexFile *f = g->files + *ip;
+          f->order = order;
+          f->visited = visited;
+          uptodate = (f->mtime == mtime && strcmp(f->driver, driver) == 0);
+        }
+        thread_mutex_unlock(&index_mutex);
+
+        if (!uptodate) {
+          if (ntasks >= size) {
+            void *ptr;
+            size = (size) ? 2*size : 16;
+            if (!(ptr = realloc(tasks, size*sizeof(IndexTask)))) {
+              free(copy);
+              stat = err(1, "allocation failure");
+              break;
+            }
+            tasks = ptr;
+          }
+          memset(tasks + ntasks, 0, sizeof(IndexTask));
+          tasks[ntasks].copy = copy;
+          tasks[ntasks].driver = driver;
+          tasks[ntasks].location = location;
+          tasks[ntasks].options = options;
+          tasks[ntasks].mtime = mtime;
+          tasks[ntasks].order = order;
+          tasks[ntasks].bloom = dlite_bloom_available(location);
+          ntasks++;
+          copy = NULL;
+        }
+        order++;
+      }
+      if (copy) free(copy);
+    }
+    dlite_storage_paths_iter_stop(iter);
+  }
+
+  /* index them */
+  index_tasks(tasks, ntasks);
+  thread_mutex_lock(&index_mutex);
+  for (i=0; i<ntasks; i++) {
+    IndexTask *t = tasks + i;
+    stat |= set_file(g, t->driver, t->location, t->options, t->mtime,
+                     t->order, t->iterable, t->uuids, t->ninst);
+    free(t->copy);
+  }
+  thread_mutex_unlock(&index_mutex);
+  if (tasks) free(tasks);
+
+  thread_mutex_lock(&index_mutex);
+  if (!stat) {
+    /* remove files that were not visited */
+    for (i=0, n=0; i<g->nfiles; i++) {
+      if (g->files[i].visited == visited)
+        g->files[n++] = g->files[i];
+      else
+        free_file(g->files + i);
+    }
+    g->nfiles = n;
+    memcpy(g->hash, hash, HASHSIZE);
+  }
+  stat |= rebuild_maps(g);
+  if (!stat && (filename = index_filename())) stat = write_index(g, filename);
+  g->updating = 0;
+  thread_mutex_unlock(&index_mutex);
+  return stat;
+}
+
+/* Updates the index if the storage paths have changed.  Returns
+   non-zero on error. */
+static int check_index(Globals *g)
+{
+  unsigned char hash[HASHSIZE];
+  int changed;
+  FUPaths *paths;
+  if (!(paths = dlite_storage_paths())) return 1;
+  if (pathshash(hash, sizeof(hash), paths)) return 1;
+  thread_mutex_lock(&index_mutex);
+  load_index(g);
+  changed = (memcmp(hash, g->hash, HASHSIZE) != 0);
+  thread_mutex_unlock(&index_mutex);
+  return (changed) ? update_index(g, hash) : 0;
+}
+
+
+
+/********************************************************************
+ * Public api
+ ********************************************************************/
+
+/*
+  Returns a storage from the storage paths that contains the instance
+  with given `id`, or NULL if no such storage is found in the index.
+
+  The storage is opened with dlite_storage_cache_open() and should be
+  released with dlite_storage_cache_release().
+
+  The index is updated if the storage paths have changed since it was
+  built or if `id` is not found.  Only storage files that can list
+  their instances are indexed.  Use dlite_storage_index_excludes() to
+  check whether a storage can be skipped when searching for `id`.
+ */
+DLiteStorage *dlite_storage_index_open(const char *id)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  DLiteStorage *s=NULL;
+  Globals *g;
+  int pass;
+  if (!id || dlite_get_uuid(uuid, id) < 0) return NULL;
+  if (!(g = get_globals())) return NULL;
+  check_index(g);
+
+  for (pass=0; pass<2 && !s; pass++) {
+    char *driver=NULL, *location=NULL, *options=NULL;
+    double mtime=-1;
+    int *ip;
+    thread_mutex_lock(&index_mutex);
+    if ((ip = map_get(&g->uuids, uuid))) {
+      IndexFile *f = g->files + *ip;
+      driver = strdup(f->driver);
+      location = strdup(f->location);
+      if (f->options) options = strdup(f->options);
+      mtime = f->mtime;
+    }
+    thread_mutex_unlock(&index_mutex);
+
+    if (location && fileinfo_mtime(location) == mtime)
+      s = dlite_storage_cache_open(driver, location, options);
+    if (driver) free(driver);
+    if (location) free(location);
+    if (options) free(options);
+
+    if (!s && pass == 0) {
+      unsigned char hash[HASHSIZE];
+      if (pathshash(hash, sizeof(hash), dlite_storage_paths())) break;
+      if (update_index(g, hash)) break;
+    }
+  }
+  return s;
+}
+
+/*
+  Returns non-zero if the storage file `location` is indexed, has not
+  been modified since it was indexed and does not contain the instance
+  with given `id`.  Such files can be skipped when searching for `id`.
+ */
+int dlite_storage_index_excludes(const char *location, const char *id)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  Globals *g;
+  size_t i;
+  int *ip, excludes=0;
+  double mtime=-1;
+  if (!id || dlite_get_uuid(uuid, id) < 0) return 0;
+  if (!(g = dlite_globals_get_state(GLOBALS_ID))) return 0;
+  thread_mutex_lock(&index_mutex);
+  if ((ip = map_get(&g->locations, location))) {
+    IndexFile *f = g->files + *ip;
+    if (f->iterable) {
+      excludes = 1;
+      mtime = f->mtime;
+      for (i=0; i<f->ninst; i++)
+        if (strcmp(f->uuids[i], uuid) == 0) excludes = 0;
+    }
+  }
+  thread_mutex_unlock(&index_mutex);
+  return (excludes && fileinfo_mtime(location) == mtime);
+}
+
+/*
+  Updates the storage index, such that it covers all storage files in
+  the storage paths.  If the environment variable `DLITE_STORAGE_INDEX`
+  is set, the index is written to the file it refers to.
+
+  Returns non-zero on error.
+ */
+int dlite_storage_index_update(void)
+{
+  unsigned char hash[HASHSIZE];
+  Globals *g;
+  if (!(g = get_globals())) return 1;
+  if (pathshash(hash, sizeof(hash), dlite_storage_paths())) return 1;
+  thread_mutex_lock(&index_mutex);
+  load_index(g);
+  thread_mutex_unlock(&index_mutex);
+  return update_index(g, hash);
+}
+
+/*
+  Writes the storage index to `filename`.  Returns non-zero on error.
+ */
+int dlite_storage_index_save(const char *filename)
+{
+  Globals *g;
+  int stat;
+  if (!(g = get_globals())) return 1;
+  thread_mutex_lock(&index_mutex);
+  stat = write_index(g, filename);
+  thread_mutex_unlock(&index_mutex);
+  return stat;
+}
+
+/*
+  Writes a Bloom filter sidecar for each up to date storage file in the
+  index that can list its instances.
+ */
+int dlite_storage_index_write_bloom(void)
+{
+  Globals *g;
+  size_t i, j;
+  int n=0;
+  if (!(g = get_globals())) return -1;
+  thread_mutex_lock(&index_mutex);
+  for (i=0; i<g->nfiles && n >= 0; i++) {
+    IndexFile *f = g->files + i;
+    DLiteBloom *b;
+    char *sidecar;
+    if (!f->iterable || fileinfo_mtime(f->location) != f->mtime) continue;
+    if (!(b = dlite_bloom_create(f->ninst))) {
+      n = -1;
+      break;
+    }
+    for (j=0; j<f->ninst; j++) dlite_bloom_add(b, f->uuids[j]);
+    if ((sidecar = dlite_bloom_sidecar(f->location)) &&
+        dlite_bloom_write(b, sidecar, f->mtime,
+                          fileinfo_size(f->location)) == 0)
+      n++;
+    else
+      n = -1;
+    if (sidecar) free(sidecar);
+    dlite_bloom_free(b);
+  }
+  thread_mutex_unlock(&index_mutex);
+  return n;
+}
+
+/*
+  Returns the number of instances in the storage index.
+ */
+size_t dlite_storage_index_count(void)
+{
+  Globals *g;
+  size_t i, n=0;
+  if (!(g = dlite_globals_get_state(GLOBALS_ID))) return 0;
+  thread_mutex_lock(&index_mutex);
+  for (i=0; i<g->nfiles; i++) n += g->files[i].ninst;
+  thread_mutex_unlock(&index_mutex);
+  return n;
+}
+
+/*
+  Clears the in-memory storage index.  It is rebuilt on next lookup.
+ */
+void dlite_storage_index_clear(void)
+{
+  Globals *g;
+  size_t i;
+  if (!(g = dlite_globals_get_state(GLOBALS_ID))) return;
+  thread_mutex_lock(&index_mutex);
+  for (i=0; i<g->nfiles; i++) free_file(g->files + i);
+  g->nfiles = 0;
+  memset(g->hash, 0, HASHSIZE);
+  rebuild_maps(g);
+  thread_mutex_unlock(&index_mutex);
+}
@@ -0,0 +1,86 @@
+#ifndef _DLITE_STORAGE_INDEX_H
+#define _DLITE_STORAGE_INDEX_H
+
+/**
+  @file
+  @brief Index mapping instance UUIDs to storages in the storage paths
+
+  The index makes it possible for dlite_instance_get() to find the
+  storage containing a given instance without opening all storages in
+  the storage paths.  It is built lazily on the first lookup and
+  updated when the storage paths change (detected with pathshash()) or
+  when an indexed file is modified (detected by its modification time).
+
+  If the environment variable `DLITE_STORAGE_INDEX` is set to a file
+  name, the index is read from and written to this file, such that it
+  persists between processes.  The `dlite-index` tool can be used to
+  build it up front.
+
+  The environment variable `DLITE_INDEX_THREADS` sets the number of
+  threads used to open and list storages while the index is built.
+
+  New or modified storage files with an up to date Bloom filter
+  sidecar (see dlite-bloom.h) are not opened when the index is
+  updated.  They are left to dlite_instance_get() to check their
+  sidecar.
+ */
+
+#include "dlite-storage.h"
+
+
+/**
+  Returns a storage from the storage paths that contains the instance
+  with given `id`, or NULL if no such storage is found in the index.
+
+  The storage is opened with dlite_storage_cache_open() and should be
+  released with dlite_storage_cache_release().
+
+  The index is updated if the storage paths have changed since it was
+  built or if `id` is not found.  Only storage files that can list
+  their instances are indexed.  Use dlite_storage_index_excludes() to
+  check whether a storage can be skipped when searching for `id`.
+ */
+DLiteStorage *dlite_storage_index_open(const char *id);
+
+/**
+  Returns non-zero if the storage file `location` is indexed, has not
+  been modified since it was indexed and does not contain the instance
+  with given `id`.  Such files can be skipped when searching for `id`.
+ */
+int dlite_storage_index_excludes(const char *location, const char *id);
+
+/**
+  Updates the storage index, such that it covers all storage files in
+  the storage paths.  If the environment variable `DLITE_STORAGE_INDEX`
+  is set, the index is written to the file it refers to.
+
+  Returns non-zero on error.
+ */
+int dlite_storage_index_update(void);
+
+/**
+  Writes the storage index to `filename`.  Returns non-zero on error.
+ */
+int dlite_storage_index_save(const char *filename);
+
+/**
+  Writes a Bloom filter sidecar (see dlite-bloom.h) for each storage
+  file in the index that can list its instances and has not been
+  modified since it was indexed.
+
+  Returns the number of written sidecars or -1 on error.
+ */
+int dlite_storage_index_write_bloom(void);
+
+/**
+  Returns the number of instances in the storage index.
+ */
+size_t dlite_storage_index_count(void);
+
+/**
+  Clears the in-memory storage index.  It is rebuilt on next lookup.
+ */
+void dlite_storage_index_clear(void);
+
+
+#endif /* _DLITE_STORAGE_INDEX_H */
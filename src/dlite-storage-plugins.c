@@ -19,6 +19,35 @@
 #define GLOBALS_ID "dlite-storage-plugins-id"
 
 
+#ifdef WITH_STATIC_PLUGINS
+/* Storage plugins compiled into libdlite, see cmake/dliteStaticPlugin.cmake */
+const DLiteStoragePlugin *dlite_static_bin_storage_plugin_api(void *, int *);
+#ifdef WITH_JSON
+const DLiteStoragePlugin *dlite_static_json_storage_plugin_api(void *, int *);
+#endif
+#ifdef WITH_HDF5
+const DLiteStoragePlugin *dlite_static_hdf5_storage_plugin_api(void *, int *);
+#endif
+#ifdef HAVE_REDLAND
+const DLiteStoragePlugin *dlite_static_rdf_storage_plugin_api(void *, int *);
+#endif
+
+static const PluginFunc static_storage_plugins[] = {
+  (PluginFunc)dlite_static_bin_storage_plugin_api,
+#ifdef WITH_JSON
+  (PluginFunc)dlite_static_json_storage_plugin_api,
+#endif
+#ifdef WITH_HDF5
+  (PluginFunc)dlite_static_hdf5_storage_plugin_api,
+#endif
+#ifdef HAVE_REDLAND
+  (PluginFunc)dlite_static_rdf_storage_plugin_api,
+#endif
+  NULL
+};
+#endif
+
+
 struct _DLiteStoragePluginIter {
   PluginIter iter;
 };
@@ -54,6 +83,7 @@ static Globals *get_globals(void)
 static PluginInfo *get_storage_plugin_info(void)
 {
   Globals *g;
+  const char *manifest;
   if (!(g = get_globals())) return NULL;
 
   if (!g->storage_plugin_info &&
@@ -69,6 +99,15 @@ static PluginInfo *get_storage_plugin_info(void)
       plugin_path_extend_prefix(g->storage_plugin_info, dlite_root_get(),
                                 DLITE_STORAGE_PLUGIN_DIRS, NULL);
 
+#ifdef WITH_STATIC_PLUGINS
+    /* Plugins compiled into libdlite are consulted before the search path */
+    plugin_set_static(g->storage_plugin_info, static_storage_plugins);
+#endif
+
+    /* Cache the apis exposed by the plugins, if requested */
+    if ((manifest = getenv("DLITE_STORAGE_PLUGIN_MANIFEST")) && *manifest)
+      plugin_set_manifest(g->storage_plugin_info, manifest);
+
     /* Make sure that dlite DLLs are added to the library search path */
     dlite_add_dll_path();
   }
@@ -163,6 +202,7 @@ void dlite_storage_plugin_unload_all()
   PluginInfo *info;
   char **p, **names;
   if (!(info = get_storage_plugin_info())) return;
+  dlite_storage_cache_clear();
   if (!(names = plugin_names(info))) return;
   for (p=names; *p; p++) {
     plugin_unload(info, *p);
@@ -214,6 +254,7 @@ int dlite_storage_plugin_unload(const char *name)
 {
   PluginInfo *info;
   if (!(info = get_storage_plugin_info())) return 1;
+  dlite_storage_cache_clear();
   return plugin_unload(info, name);
 }
 
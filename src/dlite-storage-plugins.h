@@ -32,6 +32,15 @@
   therefore offers an alternative and simpler API for storage plugins
   that works directly on DLite instances and only contains two
   functions; LoadInstance() and SaveInstance().
+
+  Capabilities
+  ------------
+  Plugins may declare what they support in the `flags` field of
+  DLiteStoragePlugin (see DLiteStorageCapability).  The core uses it
+  to choose how to access a storage.  For example, instances last
+  saved to a random-access storage are updated in place via the
+  datamodel API, and asynchronous operations on a thread-safe storage
+  may run concurrently.
 */
 #include "utils/dsl.h"
 #include "utils/fileutils.h"
@@ -40,6 +49,9 @@
 #include "dlite-datamodel.h"
 #include "dlite-storage.h"
 #include "dlite-entity.h"
+#include "dlite-sparse.h"
+#include "dlite-compress.h"
+#include "dlite-query.h"
 
 /** A struct with function pointers to all functions provided by a plugin. */
 typedef struct _DLiteStoragePlugin     DLiteStoragePlugin;
@@ -51,7 +63,12 @@ typedef struct _DLiteStoragePluginIter DLiteStoragePluginIter;
   char *location;           /*!< Location passed to dlite_storage_open() */ \
   char *options;            /*!< Options passed to dlite_storage_open() */ \
   int writable;             /*!< Whether storage is writable */            \
-  DLiteIDFlag idflag;       /*!< How to handle instance id's */
+  DLiteIDFlag idflag;       /*!< How to handle instance id's */            \
+  DLiteDecomposition *decomposition;  /*!< Decomposed dimensions */  \
+  DLiteCompression *compression;  /*!< Compression wrapper, if any */ \
+  struct _DLiteWriteBehind *saveq;  /*!< Write-behind saves, if any */ \
+  int bloom;                /*!< Whether to write a Bloom filter sidecar
+                                 on close: 1=yes, 0=if exists, -1=no */
 
 
 /** Initial segment of all DLiteDataModel plugin data structures. */
@@ -325,6 +342,27 @@ typedef DLiteInstance *(*LoadInstance)(const DLiteStorage *s, const char *uuid);
  */
 typedef int (*SaveInstance)(DLiteStorage *s, const DLiteInstance *inst);
 
+/**
+  Returns a newly allocated array of `n` new instances loaded from
+  storage `s`, where `ids` is an array of length `n` with the ids of
+  the instances to load.  The caller is responsible to decref the
+  instances and free the array.
+
+  Optional.  If not implemented, LoadInstance() is called for each
+  instance.  NULL is returned on error.
+ */
+typedef DLiteInstance **(*LoadInstances)(const DLiteStorage *s,
+                                         const char **ids, size_t n);
+
+/**
+  Stores the `n` instances in array `insts` to storage `s`.
+
+  Optional.  If not implemented, SaveInstance() is called for each
+  instance.  Returns non-zero on error.
+ */
+typedef int (*SaveInstances)(DLiteStorage *s, const DLiteInstance **insts,
+                             size_t n);
+
 /** @} */
 
 
@@ -444,6 +482,27 @@ typedef int (*HasDimension)(const DLiteDataModel *d, const char *name);
 typedef int (*HasProperty)(const DLiteDataModel *d, const char *name);
 
 
+/**
+  Copies a slice of property `name` to memory pointed to by `ptr`.
+
+  The expected type, size and number of dimensions of the memory is
+  described by `type`, `size` and `ndims`.  `offsets`, `counts` and
+  `strides` are arrays of length `ndims` with the index of the first
+  element, the number of elements and the step between elements
+  along each dimension.  `strides` may be NULL, meaning a step of one
+  along all dimensions.
+
+  The selected elements are written in C order to `ptr`, which must
+  have space for the product of `counts` elements.
+
+  Returns non-zero on error.
+ */
+typedef int (*GetPropertySlice)(const DLiteDataModel *d, const char *name,
+                                void *ptr, DLiteType type, size_t size,
+                                size_t ndims, const size_t *offsets,
+                                const size_t *counts, const size_t *strides);
+
+
 /**
   If the uuid was generated from a unique name, return a pointer to a
   newly malloc'ed string with this name.  Otherwise NULL is returned.
@@ -458,6 +517,193 @@ typedef char *(*GetDataName)(const DLiteDataModel *d);
 */
 typedef int (*SetDataName)(DLiteDataModel *d, const char *name);
 
+
+/**
+  Writes the memory pointed to by `ptr` to a block of property `name`
+  with dimensions `dims`.  The property is created if it doesn't
+  exist.
+
+  The type, size and number of dimensions of the memory and the
+  property are described by `type`, `size` and `ndims`.  `offsets` and
+  `counts` are arrays of length `ndims` with the index of the first
+  element of the block and its number of elements along each
+  dimension.  The elements of the block are read in C order from `ptr`.
+
+  This makes it possible for several processes to save their part of
+  a distributed instance to the same storage.  See
+  dlite_storage_set_decomposition().
+
+  Returns non-zero on error.
+ */
+typedef int (*SetPropertySlice)(DLiteDataModel *d, const char *name,
+                                const void *ptr, DLiteType type, size_t size,
+                                size_t ndims, const size_t *dims,
+                                const size_t *offsets, const size_t *counts);
+
+
+/**
+  Sets property `name` from sparse array `sp` with its non-zero
+  elements.  Elements not in `sp` are zero.
+
+  Used by dlite_instance_save() instead of SetProperty for properties
+  declared sparse by their metadata (see
+  dlite_meta_set_sparse_property()), such that the storage can store
+  them in a native sparse encoding.
+
+  Returns non-zero on error.
+ */
+typedef int (*SetSparseProperty)(DLiteDataModel *d, const char *name,
+                                 const DLiteSparse *sp);
+
+
+/**
+  Returns a pointer to the data of property `name` mapped directly
+  from the storage, instead of copying it into a new buffer.  The
+  arguments are the same as for GetProperty.  The mapping must be
+  C-ordered with the memory layout of the property and private to the
+  caller, i.e. writes to it are not seen by the storage.
+
+  `*dealloc` is assigned to the function that releases the mapping.
+
+  Used by dlite_instance_load() for array properties of non-allocated
+  types, which then adopt the mapping.  Returns NULL without setting
+  an error if the property cannot be mapped, in which case it is read
+  with GetProperty.
+ */
+typedef void *(*MapProperty)(const DLiteDataModel *d, const char *name,
+                             DLiteType type, size_t size,
+                             size_t ndims, const size_t *dims,
+                             DLiteDeallocator *dealloc);
+
+/** @} */
+
+
+/**
+ * @name Query API
+ * Optional API for translating predicates to native queries.
+ * @{
+ */
+
+/**
+  Returns a new iterator over the uuids of instances in storage `s`
+  that may match query `q`.  The iterator is used with the IterNext()
+  and IterFree() functions of the plugin.
+
+  The iterator may return a superset of the matching instances, e.g.
+  if only parts of the predicate can be translated to a native query.
+  Each returned instance is loaded and checked against `q` by
+  dlite_storage_query_next().
+
+  Returns NULL on error.
+ */
+typedef void *(*QueryCreate)(const DLiteStorage *s, const DLiteQuery *q);
+
+/** @} */
+
+
+/**
+ * @name Collection view API
+ * Optional API for stacking a property of many instances.
+ * @{
+ */
+
+/**
+  Writes a view of the `n` instances in storage `s` with the given
+  `uuids`, which all are of metadata with uuid `metauuid`.  For each
+  property, the view stacks the property of all instances along a new
+  first dimension.  `id` is the uuid of the collection that the view
+  belongs to.  An existing view with the same `id` and `metauuid` is
+  replaced.
+
+  The instances must already be saved to `s`.
+
+  Returns non-zero on error.
+ */
+typedef int (*SaveView)(DLiteStorage *s, const char *id,
+                        const char *metauuid, const char **uuids, size_t n);
+
+/**
+  Returns property `name` of the view written by SaveView() as a new
+  array of elements of the given `type` and `size`.  The first
+  dimension of the array runs over the instances of the view.
+
+  The array data is allocated with malloc() and must be released by
+  the caller before calling dlite_array_free().
+
+  Returns NULL on error.
+ */
+typedef DLiteArray *(*LoadView)(const DLiteStorage *s, const char *id,
+                                const char *metauuid, const char *name,
+                                DLiteType type, size_t size);
+
+/** @} */
+
+
+/**
+ * @name Asynchronous API
+ * Optional completion-based API for storages that may have many
+ * outstanding requests, like network storages.  It is used by
+ * dlite_instance_load_async() and dlite_instance_save_async() instead
+ * of occupying an I/O thread for each request.
+ *
+ * A plugin completes a request by calling its callback exactly once,
+ * either from its own threads or from AsyncPoll().  The synchronous
+ * functions of the plugin may be called from other threads while
+ * requests are outstanding.
+ * @{
+ */
+
+/**
+  Callback called by the plugin when an asynchronous request is
+  completed.  `status` is zero on success.  For a load, `inst` is a
+  new reference to the loaded instance that the callback takes over,
+  or NULL on error.  For a save, `inst` is the saved instance.  On
+  error, the plugin should report the error with err() in the thread
+  calling the callback before calling it.
+ */
+typedef void (*DLiteAsyncCallback)(int status, DLiteInstance *inst,
+                                   void *userdata);
+
+/**
+  Submits loading of instance `uuid` from storage `s`.  `callback`
+  is called with `userdata` when the load is completed.
+
+  Returns non-zero if the request cannot be submitted, in which case
+  `callback` is not called.
+ */
+typedef int (*LoadInstanceAsync)(const DLiteStorage *s, const char *uuid,
+                                 DLiteAsyncCallback callback, void *userdata);
+
+/**
+  Submits saving of instance `inst` to storage `s`.  The instance is
+  kept alive and unmodified until `callback` is called with
+  `userdata`.
+
+  Returns non-zero if the request cannot be submitted, in which case
+  `callback` is not called.
+ */
+typedef int (*SaveInstanceAsync)(DLiteStorage *s, const DLiteInstance *inst,
+                                 DLiteAsyncCallback callback, void *userdata);
+
+/**
+  Returns a file descriptor that becomes readable when AsyncPoll()
+  has completions to process, such that it can be watched by an event
+  loop.  Returns -1 if no such descriptor exists.
+ */
+typedef int (*AsyncFd)(const DLiteStorage *s);
+
+/**
+  Processes completed requests on storage `s` and calls their
+  callbacks.  Waits at most `timeout` milliseconds for a completion
+  if none is ready.  Never called concurrently for the same storage.
+
+  Optional for plugins that call the callbacks from their own
+  threads.  On a fatal error, outstanding requests should be completed
+  with a non-zero status.  Returns the number of completed requests or
+  a negative number on error.
+ */
+typedef int (*AsyncPoll)(DLiteStorage *s, int timeout);
+
 /** @} */
 
 
@@ -497,6 +743,8 @@ struct _DLiteStoragePlugin {
   /* Instance API */
   LoadInstance       loadInstance;     /*!< Returns new instance from storage */
   SaveInstance       saveInstance;     /*!< Stores an instance */
+  LoadInstances      loadInstances;    /*!< Returns many new instances */
+  SaveInstances      saveInstances;    /*!< Stores many instances */
 
   /* DataModel API */
   DataModel          dataModel;        /*!< Creates new data model */
@@ -514,12 +762,42 @@ struct _DLiteStoragePlugin {
 
   HasDimension       hasDimension;     /*!< Checks for dimension name */
   HasProperty        hasProperty;      /*!< Checks for property name */
+  GetPropertySlice   getPropertySlice; /*!< Gets slice of property */
 
   GetDataName        getDataName;      /*!< Returns name of instance */
   SetDataName        setDataName;      /*!< Assigns name to instance */
 
   /* Driver data */
   void *             data;             /*!< Internal data used by the driver */
+
+  /* Capabilities (optional) */
+  int                flags;            /*!< Bitwise OR of
+                                            DLiteStorageCapability flags */
+
+  /* Distributed DataModel API (optional) */
+  SetPropertySlice   setPropertySlice; /*!< Sets block of property */
+
+  /* Query API (optional) */
+  QueryCreate        queryCreate;      /*!< Creates iterator over instances
+                                            that may match a query */
+
+  /* Collection view API (optional) */
+  SaveView           saveView;         /*!< Writes view of many instances */
+  LoadView           loadView;         /*!< Reads stacked property of view */
+
+  /* Asynchronous API (optional) */
+  LoadInstanceAsync  loadInstanceAsync;/*!< Submits loading of an instance */
+  SaveInstanceAsync  saveInstanceAsync;/*!< Submits saving of an instance */
+  AsyncFd            asyncFd;          /*!< Returns fd to watch for
+                                            completions */
+  AsyncPoll          asyncPoll;        /*!< Processes completions */
+
+  /* Sparse DataModel API (optional) */
+  SetSparseProperty  setSparseProperty;/*!< Sets property from its
+                                            non-zero elements */
+
+  /* Mapped DataModel API (optional) */
+  MapProperty        mapProperty;      /*!< Maps property into memory */
 };
 
 
@@ -2,10 +2,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "utils/compat.h"
 #include "utils/err.h"
+#include "utils/fileinfo.h"
 #include "utils/fileutils.h"
+#include "utils/map.h"
+#include "utils/strtob.h"
+#include "utils/thread.h"
 
 #include "config-paths.h"
 
@@ -13,27 +18,79 @@
 #include "dlite-macros.h"
 #include "dlite-datamodel.h"
 #include "dlite-storage-plugins.h"
+#include "dlite-stats.h"
+#include "dlite-record.h"
+#include "dlite-bloom.h"
 #include "getuuid.h"
 
 #define GLOBALS_ID "dlite-storage-id"
 
+/* Default maximum number of idle storages kept open in the cache */
+#define CACHE_DEFAULT_SIZE 8
+
+/* Default number of seconds an idle storage is kept open in the cache */
+#define CACHE_DEFAULT_TIMEOUT 60
+
+/* Maximum number of ids in the cache of missing ids */
+#define MISSING_MAX 4096
+
 
 /* Iterator over dlite storage paths. */
 struct _DLiteStoragePathIter {
   FUIter *pathiter;
 };
 
+/* Entry in the storage cache */
+typedef struct _CacheEntry {
+  DLiteStorage *s;          /* the open storage */
+  char *driver;             /* driver passed to dlite_storage_open() */
+  int inuse;                /* whether the storage is handed out */
+  int stale;                /* whether the storage should be closed
+                               when released */
+  time_t released;          /* time the storage was last released */
+  struct _CacheEntry *next;
+} CacheEntry;
+
 /* Global variables for dlite-storage */
 typedef struct {
   FUPaths *storage_paths;
+  CacheEntry *cache;        /* cached storages, most recently used first */
+  int cache_size;           /* max number of idle storages in the cache */
+  int cache_timeout;        /* max number of seconds a storage may stay
+                               idle in the cache */
+  map_int_t missing;        /* uuids of ids not found in the storage paths */
+  int nmissing;             /* number of ids in `missing` */
+  unsigned missing_mark;    /* incremented when `missing` is cleared */
 } Globals;
 
 
+/* Protects the storage cache */
+static ThreadMutex cache_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Protects the cache of missing ids */
+static ThreadMutex missing_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Serialises modifications of the storage paths, since storage
+   plugins may append to them when storages are opened concurrently
+   (e.g. while indexing) */
+static ThreadMutex paths_mutex = THREAD_MUTEX_INITIALIZER;
+
+
 /* Frees global state for this module - called by atexit() */
 static void free_globals(void *globals)
 {
   Globals *g = globals;
+  CacheEntry *e, *next;
   dlite_storage_paths_free();
+
+  /* The cached storages are closed by cache_atexit(), since the
+     plugins may be unloaded at this point.  Just free the memory. */
+  for (e=g->cache; e; e=next) {
+    next = e->next;
+    free(e->driver);
+    free(e);
+  }
+  if (g->nmissing) map_deinit(&g->missing);
   free(g);
 }
 
@@ -53,37 +110,255 @@ static Globals *get_globals(void)
 
 
 
+/* Closes the storages in the linked list `list` and frees the entries. */
+static void cache_close_entries(CacheEntry *list)
+{
+  CacheEntry *e, *next;
+  for (e=list; e; e=next) {
+    next = e->next;
+    dlite_storage_close(e->s);
+    free(e->driver);
+    free(e);
+  }
+}
+
+/* Removes idle entries that exceed the cache size or have timed out
+   and moves them to `*closelist`.  Must be called with `cache_mutex`
+   held. */
+static void cache_evict(Globals *g, CacheEntry **closelist)
+{
+  CacheEntry *e, **ep=&g->cache;
+  time_t now = time(NULL);
+  int nidle=0;
+  while ((e = *ep)) {
+    if (!e->inuse &&
+        (e->stale || ++nidle > g->cache_size ||
+         difftime(now, e->released) > g->cache_timeout)) {
+      *ep = e->next;
+      e->next = *closelist;
+      *closelist = e;
+    } else {
+      ep = &e->next;
+    }
+  }
+}
+
+/* Closes all cached storages when the application exits, before the
+   plugins are unloaded. */
+static void cache_atexit(void)
+{
+  dlite_storage_cache_clear();
+}
+
+/* Returns a pointer to the globals with the cache settings initialised
+   from the environment.  Returns NULL on error. */
+static Globals *cache_globals(void)
+{
+  static int initialised=0;
+  Globals *g;
+  if (!(g = get_globals())) return NULL;
+  thread_mutex_lock(&cache_mutex);
+  if (!initialised) {
+    char *p;
+    g->cache_size = CACHE_DEFAULT_SIZE;
+    g->cache_timeout = CACHE_DEFAULT_TIMEOUT;
+    if ((p = getenv("DLITE_STORAGE_CACHE_SIZE")) && *p)
+      g->cache_size = atoi(p);
+    if ((p = getenv("DLITE_STORAGE_CACHE_TIMEOUT")) && *p)
+      g->cache_timeout = atoi(p);
+    atexit(cache_atexit);
+    initialised = 1;
+  }
+  thread_mutex_unlock(&cache_mutex);
+  return g;
+}
+
+/* Returns the location of storage `s`.  For compressed storages, this
+   is the compressed file and not the temporary file the plugin works on. */
+static const char *storage_location(const DLiteStorage *s)
+{
+  return (s->compression) ?
+    dlite_compression_location(s->compression) : s->location;
+}
+
+/* Marks cached storages at the same location as `s` as stale, since
+   `s` may have modified it.  Idle storages are closed. */
+static void cache_invalidate(const DLiteStorage *s)
+{
+  Globals *g;
+  CacheEntry *e, *closelist=NULL;
+  if (!(g = dlite_globals_get_state(GLOBALS_ID)) || !g->cache) return;
+  thread_mutex_lock(&cache_mutex);
+  for (e=g->cache; e; e=e->next)
+    if (e->s != s && e->s->api == s->api &&
+        strcmp(storage_location(e->s), storage_location(s)) == 0)
+      e->stale = 1;
+  cache_evict(g, &closelist);
+  thread_mutex_unlock(&cache_mutex);
+  cache_close_entries(closelist);
+}
+
+
+
+/* Returns a NULL-terminated list of the uuids in writable storage `s`
+   if a Bloom filter sidecar should be written when `s` is closed.
+   Otherwise NULL is returned. */
+static char **bloom_uuids(DLiteStorage *s)
+{
+  char **uuids=NULL, *sidecar;
+  int write = (s->bloom > 0), failed=0;
+  if (s->bloom < 0) return NULL;
+  if (!(s->api->iterCreate && s->api->iterNext && s->api->iterFree) &&
+      !s->api->getUUIDs) return NULL;
+  if (!write && (sidecar = dlite_bloom_sidecar(storage_location(s)))) {
+    write = fileinfo_exists(sidecar);
+    free(sidecar);
+  }
+  if (!write) return NULL;
+  ErrTry:
+    uuids = dlite_storage_uuids(s, NULL);
+  ErrOther:  // the sidecar is left outdated and hence unused
+    failed = 1;
+    break;
+  ErrEnd;
+  if (!uuids && !failed) uuids = calloc(1, sizeof(char *));  /* empty */
+  return uuids;
+}
+
+/* Writes the Bloom filter sidecar of storage `s`, which has just been
+   closed, with the uuids in `uuids`.  Nothing is written if `s` is not
+   a file.  Errors are only reported as warnings, since the sidecar is
+   only an optimisation. */
+static void bloom_write(DLiteStorage *s, char **uuids)
+{
+  if (!fileinfo_exists(storage_location(s))) return;  /* not a file */
+  ErrTry:
+    dlite_bloom_write_sidecar(storage_location(s), (const char **)uuids, -1);
+  ErrOther:
+    warnx("cannot write bloom filter of '%s': %s", storage_location(s),
+          err_getmsg());
+    break;
+  ErrEnd;
+}
+
 
 /********************************************************************
  * Public api
  ********************************************************************/
 
+/* Returns a newly allocated copy of `options` without option `key`.
+   The value of `key` is returned as a newly allocated string via
+   `value`, or NULL if `options` has no such key.  Returns NULL on
+   error. */
+static char *strip_option(const char *options, const char *key, char **value)
+{
+  size_t keylen = strlen(key), m=0;
+  const char *p = options;
+  char *s;
+  *value = NULL;
+  if (!(s = malloc(strlen(options) + 1))) return err(1, NULL), NULL;
+  while (*p && *p != '#') {
+    size_t len = strcspn(p, ";&#");
+    if (strncmp(p, key, keylen) == 0 && p[keylen] == '=') {
+      if (*value) free(*value);
+      if (!(*value = strndup(p + keylen + 1, len - keylen - 1))) {
+        free(s);
+        return err(1, NULL), NULL;
+      }
+    } else {
+      if (m) s[m++] = ';';
+      memcpy(s + m, p, len);
+      m += len;
+    }
+    p += len;
+    if (*p && *p != '#') p++;
+  }
+  strcpy(s + m, p);  /* keep fragment */
+  return s;
+}
+
 /*
   Opens a storage located at `location` using `driver`.
   Returns a opaque pointer or NULL on error.
 
-  The `options` are passed to the driver.
+  The `options` are passed to the driver.  Compression of the file at
+  `location` is handled here, see dlite-compress.h.  So is the `bloom`
+  option, see dlite-bloom.h.
  */
 DLiteStorage *dlite_storage_open(const char *driver, const char *location,
                                  const char *options)
 {
   const DLiteStoragePlugin *api;
-  DLiteStorage *storage=NULL;
+  DLiteStorage *storage=NULL, *retval=NULL;
+  DLiteCompression *comp=NULL;
+  char *drv=NULL, *opts=NULL, *spec=NULL, *bloom=NULL;
+  const char *path=location, *p;
+  uint64_t t0;
 
   if (!location) FAIL("missing location");
   if (!driver || !*driver) driver = fu_fileext(location);
   if (!driver || !*driver) FAIL("missing driver");
+
+  /* Compressed storages, like "gzip+json", "compress=gzip" or "*.gz" */
+  if (options && !(opts = strip_option(options, "compress", &spec)))
+    goto fail;
+
+  /* Bloom filter sidecar, see dlite-bloom.h */
+  if (opts) {
+    char *stripped = strip_option(opts, "bloom", &bloom);
+    if (!stripped) goto fail;
+    free(opts);
+    opts = stripped;
+  }
+  if ((p = strchr(driver, '+'))) {
+    if (!spec && !(spec = strndup(driver, p - driver))) FAIL(NULL);
+    driver = p + 1;
+  } else if (strcmp(driver, "gz") == 0) {
+    size_t len = strlen(location) - 3;
+    const char *q = location + len;
+    while (q > location && q[-1] != '.' && q[-1] != '/' && q[-1] != '\\')
+      q--;
+    if (q == location || q[-1] != '.')
+      FAIL1("cannot determine driver of compressed storage: %s", location);
+    if (!(drv = strndup(q, location + len - q))) FAIL(NULL);
+    if (!spec && !(spec = strdup("gzip"))) FAIL(NULL);
+    driver = drv;
+  }
+
   if (!(api = dlite_storage_plugin_get(driver))) goto fail;
-  if (!(storage = api->open(api, location, options))) goto fail;
+  if (spec) {
+    if (!(comp = dlite_compression_open(location, spec))) goto fail;
+    path = dlite_compression_path(comp);
+  }
+  t0 = dlite_record_begin();
+  if (!(storage = api->open(api, path, (opts && *opts) ? opts : NULL)))
+    goto fail;
   storage->api = api;
-  if (!(storage->location = strdup(location))) FAIL(NULL);
+  dlite_stats_add_driver(api->name, dliteStatsOpens, 1);
+  if (!(storage->location = strdup(path))) FAIL(NULL);
   if (options && !(storage->options = strdup(options))) FAIL(NULL);
+  storage->compression = comp;
+  storage->saveq = NULL;
+  if (bloom)
+    storage->bloom = (atob(bloom) > 0) ? 1 : -1;
+  else if ((p = getenv("DLITE_STORAGE_BLOOM")) && *p)
+    storage->bloom = (atob(p) > 0) ? 1 : 0;
+  else
+    storage->bloom = 0;
+  dlite_record_open(storage, api->name, location, options, t0);
+  retval = storage;
 
-  return storage;
  fail:
-  if (storage) free(storage);
-  err_update_eval(dliteStorageOpenError);
-  return NULL;
+  if (drv) free(drv);
+  if (opts) free(opts);
+  if (spec) free(spec);
+  if (bloom) free(bloom);
+  if (!retval) {
+    if (storage) free(storage);
+    if (comp) dlite_compression_close(comp, 0);
+    err_update_eval(dliteStorageOpenError);
+  }
+  return retval;
 }
 
 
@@ -119,8 +394,36 @@ DLiteStorage *dlite_storage_open_url(const char *url)
 int dlite_storage_close(DLiteStorage *s)
 {
   int stat;
+  uint64_t t0;
+  char **uuids=NULL;
   assert(s);
-  stat = s->api->close(s);
+  stat = dlite_storage_set_write_behind(s, 0, 0, 0.0);
+  dlite_storage_wait(s);
+  if (s->writable) uuids = bloom_uuids(s);
+  t0 = dlite_record_begin();
+  if (s->api->close(s)) stat = 1;
+  dlite_record_close(s, t0);
+  if (s->compression &&
+      dlite_compression_close(s->compression, s->writable)) stat = 1;
+
+  /* cached storages at the same location may now be outdated and
+     previously missing instances may have been written */
+  if (s->writable) {
+    cache_invalidate(s);
+    dlite_storage_paths_clear_missing();
+  }
+  if (uuids) {
+    char **q;
+    if (!stat) bloom_write(s, uuids);
+    for (q=uuids; *q; q++) free(*q);
+    free(uuids);
+  }
+  while (s->decomposition) {
+    DLiteDecomposition *next = s->decomposition->next;
+    free(s->decomposition->dimension);
+    free(s->decomposition);
+    s->decomposition = next;
+  }
   free(s->location);
   if (s->options) free(s->options);
   free(s);
@@ -153,6 +456,7 @@ void dlite_storage_set_idflag(DLiteStorage *s, DLiteIDFlag idflag)
  */
 void *dlite_storage_iter_create(DLiteStorage *s, const char *pattern)
 {
+  if (dlite_storage_flush(s)) return NULL;
   if (!s->api->iterCreate)
     return errx(1, "driver '%s' does not support iterCreate()",
                 s->api->name), NULL;
@@ -201,6 +505,7 @@ void dlite_storage_iter_free(DLiteStorage *s, void *iter)
 char **dlite_storage_uuids(const DLiteStorage *s, const char *pattern)
 {
   char **p = NULL;
+  if (dlite_storage_flush((DLiteStorage *)s)) return NULL;
   if (s->api->iterCreate && s->api->iterNext && s->api->iterFree) {
     char buf[DLITE_UUID_LENGTH+1];
     void *ptr, *iter = s->api->iterCreate(s, pattern);
@@ -246,6 +551,78 @@ void dlite_storage_uuids_free(char **names)
 }
 
 
+/* Query over the instances in a storage */
+struct _DLiteStorageQuery {
+  DLiteStorage *s;          /* storage */
+  DLiteQuery *q;            /* compiled predicate */
+  void *iter;               /* iterator over candidates */
+};
+
+/*
+  Returns a new query over the instances of metadata `metaid` in
+  storage `s` that match `predicate`.
+ */
+DLiteStorageQuery *dlite_storage_query(DLiteStorage *s, const char *metaid,
+                                       const char *predicate)
+{
+  DLiteStorageQuery *sq=NULL;
+
+  if (dlite_storage_flush(s)) return NULL;
+  if (!(sq = calloc(1, sizeof(DLiteStorageQuery))))
+    FAIL("allocation failure");
+  sq->s = s;
+  if (!(sq->q = dlite_query_compile(metaid, predicate))) goto fail;
+  if (s->api->queryCreate) {
+    if (!(sq->iter = s->api->queryCreate(s, sq->q))) goto fail;
+  } else {
+    if (!s->api->iterCreate || !s->api->iterNext || !s->api->iterFree)
+      FAIL1("driver '%s' does not support queries", s->api->name);
+    if (!(sq->iter = s->api->iterCreate(s, sq->q->meta->uri))) goto fail;
+  }
+  return sq;
+ fail:
+  dlite_storage_query_free(sq);
+  return NULL;
+}
+
+/*
+  Assigns `*inst` to a new reference to the next instance matching
+  query `q`.
+
+  Returns zero on success, 1 if there are no more matching instances
+  and a negative number on other errors.
+ */
+int dlite_storage_query_next(DLiteStorageQuery *q, DLiteInstance **inst)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  int stat;
+  *inst = NULL;
+  while ((stat = q->s->api->iterNext(q->iter, uuid)) == 0) {
+    DLiteInstance *candidate;
+    if (!dlite_instance_has(uuid, 0) || !(candidate = dlite_instance_get(uuid)))
+      if (!(candidate = dlite_instance_load(q->s, uuid))) return -1;
+    if ((stat = dlite_query_match(q->q, candidate)) > 0) {
+      *inst = candidate;
+      return 0;
+    }
+    dlite_instance_decref(candidate);
+    if (stat < 0) return -1;
+  }
+  return stat;
+}
+
+/*
+  Frees query created with dlite_storage_query().
+ */
+void dlite_storage_query_free(DLiteStorageQuery *q)
+{
+  if (!q) return;
+  if (q->iter) q->s->api->iterFree(q->iter);
+  dlite_query_free(q->q);
+  free(q);
+}
+
+
 /*
   Returns non-zero if storage `s` is writable.
  */
@@ -254,6 +631,87 @@ int dlite_storage_is_writable(const DLiteStorage *s)
   return s->writable;
 }
 
+/*
+  Returns the capabilities of storage `s` as a bitwise OR of
+  DLiteStorageCapability flags.
+
+  The flags declared by the plugin are combined with the ones that
+  follows from the functions it implements (`dliteCapSlices`,
+  `dliteCapBatch` and `dliteCapDistributed`).
+ */
+int dlite_storage_get_capabilities(const DLiteStorage *s)
+{
+  int caps = s->api->flags;
+  if (s->api->getPropertySlice) caps |= dliteCapSlices;
+  if (s->api->loadInstances || s->api->saveInstances) caps |= dliteCapBatch;
+  if (s->api->setPropertySlice && s->api->dataModel)
+    caps |= dliteCapDistributed;
+  return caps;
+}
+
+/*
+  Declares that instances saved to storage `s` are distributed along
+  `dimension`, for instance over MPI ranks.
+
+  The instance saved by the calling process holds the part of the
+  global instance starting at `offset` along `dimension`, whose global
+  length is `size`.  The local length is the size of the dimension in
+  the saved instance.  Properties depending on `dimension` are written
+  as blocks of the global property, while other properties are written
+  as a whole by all processes.
+
+  May be called for several dimensions.  A `size` of zero removes the
+  decomposition of `dimension`.
+
+  Requires a storage with the `dliteCapDistributed` capability.
+  Returns non-zero on error.
+ */
+int dlite_storage_set_decomposition(DLiteStorage *s, const char *dimension,
+                                    size_t offset, size_t size)
+{
+  DLiteDecomposition *dec, **q = &s->decomposition;
+  if (!(dlite_storage_get_capabilities(s) & dliteCapDistributed))
+    return errx(1, "storage plugin '%s' does not support distributed "
+                "instances", s->api->name);
+  for (dec=s->decomposition; dec; q=&dec->next, dec=dec->next)
+    if (strcmp(dec->dimension, dimension) == 0) break;
+  if (size == 0) {
+    if (dec) {
+      *q = dec->next;
+      free(dec->dimension);
+      free(dec);
+    }
+    return 0;
+  }
+  if (offset >= size)
+    return errx(1, "offset %lu of dimension '%s' is out of range [0, %lu)",
+                (unsigned long)offset, dimension, (unsigned long)size);
+  if (!dec) {
+    if (!(dec = calloc(1, sizeof(DLiteDecomposition))) ||
+        !(dec->dimension = strdup(dimension))) {
+      if (dec) free(dec);
+      return err(1, "allocation failure");
+    }
+    *q = dec;
+  }
+  dec->offset = offset;
+  dec->size = size;
+  return 0;
+}
+
+/*
+  Returns the decomposition of `dimension` in storage `s` or NULL if
+  it is not decomposed.
+ */
+const DLiteDecomposition *
+dlite_storage_get_decomposition(const DLiteStorage *s, const char *dimension)
+{
+  const DLiteDecomposition *dec;
+  for (dec=s->decomposition; dec; dec=dec->next)
+    if (strcmp(dec->dimension, dimension) == 0) return dec;
+  return NULL;
+}
+
 
 /*
   Returns name of driver associated with storage `s`.
@@ -265,6 +723,310 @@ const char *dlite_storage_get_driver(const DLiteStorage *s)
 
 
 
+/*******************************************************************
+ *  Storage cache
+ *******************************************************************/
+
+/*
+  Like dlite_storage_open(), but returns an idle storage from the
+  storage cache if one was opened with the same `driver`, `location`
+  and `options`.  Otherwise a new storage is opened.
+
+  The returned storage is used exclusively by the caller until it is
+  given back with dlite_storage_cache_release().  It must not be closed
+  with dlite_storage_close().
+
+  Only read-only storages are kept in the cache, since some plugins
+  first write to their storage when it is closed.
+
+  Returns NULL on error.
+ */
+DLiteStorage *dlite_storage_cache_open(const char *driver,
+                                       const char *location,
+                                       const char *options)
+{
+  Globals *g;
+  CacheEntry *e, *closelist=NULL;
+  DLiteStorage *s=NULL;
+  if (!location) return errx(dliteStorageOpenError, "missing location"), NULL;
+  if (!driver || !*driver) driver = fu_fileext(location);
+  if (!(g = cache_globals())) return NULL;
+
+  thread_mutex_lock(&cache_mutex);
+  cache_evict(g, &closelist);
+  for (e=g->cache; e; e=e->next) {
+    if (!e->inuse && !e->stale &&
+        strcmp(e->driver, (driver) ? driver : "") == 0 &&
+        strcmp(storage_location(e->s), location) == 0 &&
+        strcmp((e->s->options) ? e->s->options : "",
+               (options) ? options : "") == 0) {
+      e->inuse = 1;
+      s = e->s;
+      break;
+    }
+  }
+  thread_mutex_unlock(&cache_mutex);
+  cache_close_entries(closelist);
+  if (s) return s;
+
+  if (!(s = dlite_storage_open(driver, location, options))) return NULL;
+  if (!s->writable && g->cache_size > 0) {
+    if (!(e = calloc(1, sizeof(CacheEntry))) ||
+        !(e->driver = strdup((driver) ? driver : ""))) {
+      if (e) free(e);
+      return s;  /* just don't cache it */
+    }
+    e->s = s;
+    e->inuse = 1;
+    thread_mutex_lock(&cache_mutex);
+    e->next = g->cache;
+    g->cache = e;
+    thread_mutex_unlock(&cache_mutex);
+  }
+  return s;
+}
+
+/*
+  Gives storage `s` returned by dlite_storage_cache_open() back to the
+  cache.  It is kept open for reuse until it is evicted.  Storages
+  that are not in the cache are closed.
+
+  Idle storages are evicted when there are more than
+  `DLITE_STORAGE_CACHE_SIZE` (default: 8) of them, or when they have
+  been idle for more than `DLITE_STORAGE_CACHE_TIMEOUT` (default: 60)
+  seconds.  Storages that are outdated because a writable storage at
+  the same location has been closed are evicted directly.
+
+  Returns non-zero on error.
+ */
+int dlite_storage_cache_release(DLiteStorage *s)
+{
+  Globals *g;
+  CacheEntry *e, **ep, *closelist=NULL;
+  if (!s) return 0;
+  if (!(g = cache_globals())) return 1;
+  thread_mutex_lock(&cache_mutex);
+  for (ep=&g->cache; (e = *ep); ep=&e->next)
+    if (e->s == s) break;
+  if (e) {
+    /* move to front of the cache */
+    *ep = e->next;
+    e->next = g->cache;
+    g->cache = e;
+    e->inuse = 0;
+    e->released = time(NULL);
+    cache_evict(g, &closelist);
+  }
+  thread_mutex_unlock(&cache_mutex);
+  cache_close_entries(closelist);
+  return (e) ? 0 : dlite_storage_close(s);
+}
+
+/*
+  Closes all idle storages in the storage cache.  Storages that are in
+  use are closed when they are released.
+ */
+void dlite_storage_cache_clear(void)
+{
+  Globals *g;
+  CacheEntry *e, *closelist=NULL;
+  if (!(g = dlite_globals_get_state(GLOBALS_ID)) || !g->cache) return;
+  thread_mutex_lock(&cache_mutex);
+  for (e=g->cache; e; e=e->next) e->stale = 1;
+  cache_evict(g, &closelist);
+  thread_mutex_unlock(&cache_mutex);
+  cache_close_entries(closelist);
+}
+
+
+/*******************************************************************
+ *  Write-behind
+ *******************************************************************/
+
+/* Pending saves of a storage with write-behind enabled */
+struct _DLiteWriteBehind {
+  ThreadMutex wmutex;       /* serialises writing of pending instances */
+  ThreadMutex mutex;        /* protects the fields below */
+  map_int_t index;          /* maps uuid to index in `insts` */
+  DLiteInstance **insts;    /* references to pending instances */
+  size_t *sizes;            /* size in bytes of each pending instance */
+  size_t n;                 /* number of pending instances */
+  size_t len;               /* allocated length of `insts` and `sizes` */
+  size_t nbytes;            /* total size of pending instances */
+  size_t maxbytes;          /* flush when `nbytes` exceeds this, if > 0 */
+  double interval;          /* flush when the oldest pending save is
+                               older than this many seconds, if > 0 */
+  double since;             /* time of oldest pending save */
+};
+
+/* Returns monotonic wall time in seconds. */
+static double walltime(void)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Detaches the pending instances from `wb` and returns them.  The
+   number of returned instances is stored in `*n`.  Must be called
+   with `wb->mutex` locked. */
+static DLiteInstance **wb_detach(struct _DLiteWriteBehind *wb, size_t *n)
+{
+  DLiteInstance **insts = wb->insts;
+  *n = wb->n;
+  map_deinit(&wb->index);
+  map_init(&wb->index);
+  wb->insts = NULL;
+  free(wb->sizes);
+  wb->sizes = NULL;
+  wb->n = wb->len = wb->nbytes = 0;
+  return insts;
+}
+
+/* Saves `n` instances `insts` to `s` and releases the references to
+   them.  Returns non-zero on error. */
+static int wb_save(DLiteStorage *s, DLiteInstance **insts, size_t n)
+{
+  size_t i;
+  int stat = 0;
+  if (n) stat = dlite_instance_save_many(s, (const DLiteInstance **)insts, n);
+  for (i=0; i<n; i++) dlite_instance_decref(insts[i]);
+  if (insts) free(insts);
+  return stat;
+}
+
+/*
+  Enables or disables write-behind for storage `s`.
+ */
+int dlite_storage_set_write_behind(DLiteStorage *s, int enable,
+                                   size_t maxbytes, double interval)
+{
+  struct _DLiteWriteBehind *wb = s->saveq;
+  if (!enable) {
+    int stat;
+    if (!wb) return 0;
+    stat = dlite_storage_flush(s);
+    s->saveq = NULL;
+    map_deinit(&wb->index);
+    thread_mutex_destroy(&wb->mutex);
+    thread_mutex_destroy(&wb->wmutex);
+    free(wb);
+    return stat;
+  }
+  if (!s->writable)
+    return errx(1, "cannot enable write-behind for "
+                "read-only storage: %s", s->location);
+  if (!wb) {
+    if (!(wb = calloc(1, sizeof(struct _DLiteWriteBehind))))
+      return err(1, "allocation failure");
+    if (thread_mutex_init(&wb->mutex)) {
+      free(wb);
+      return errx(1, "cannot initialise write-behind mutex");
+    }
+    if (thread_mutex_init(&wb->wmutex)) {
+      thread_mutex_destroy(&wb->mutex);
+      free(wb);
+      return errx(1, "cannot initialise write-behind mutex");
+    }
+    map_init(&wb->index);
+    s->saveq = wb;
+  }
+  thread_mutex_lock(&wb->mutex);
+  wb->maxbytes = maxbytes;
+  wb->interval = interval;
+  thread_mutex_unlock(&wb->mutex);
+  return 0;
+}
+
+/*
+  Writes all pending instances in storage `s`.
+ */
+int dlite_storage_flush(DLiteStorage *s)
+{
+  struct _DLiteWriteBehind *wb = s->saveq;
+  DLiteInstance **insts;
+  size_t n;
+  int stat;
+  if (!wb) return 0;
+  thread_mutex_lock(&wb->wmutex);
+  thread_mutex_lock(&wb->mutex);
+  insts = wb_detach(wb, &n);
+  thread_mutex_unlock(&wb->mutex);
+  stat = wb_save(s, insts, n);
+  thread_mutex_unlock(&wb->wmutex);
+  return stat;
+}
+
+/*
+  Returns the number of pending instances in storage `s`.
+ */
+size_t dlite_storage_pending(const DLiteStorage *s)
+{
+  struct _DLiteWriteBehind *wb = s->saveq;
+  size_t n;
+  if (!wb) return 0;
+  thread_mutex_lock(&wb->mutex);
+  n = wb->n;
+  thread_mutex_unlock(&wb->mutex);
+  return n;
+}
+
+/*
+  Records instance `inst` as pending in storage `s`.
+ */
+int dlite_storage_defer_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  struct _DLiteWriteBehind *wb = s->saveq;
+  DLiteInstance *ref = (DLiteInstance *)inst;
+  size_t nbytes = dlite_stats_instance_nbytes(inst);
+  int *ip, flush=0, retval=1;
+  double now = walltime();
+
+  assert(wb);
+  thread_mutex_lock(&wb->mutex);
+  if ((ip = map_get(&wb->index, inst->uuid))) {
+    /* coalesce with pending save of the same uuid */
+    if (wb->insts[*ip] != ref) {
+      dlite_instance_incref(ref);
+      dlite_instance_decref(wb->insts[*ip]);
+      wb->insts[*ip] = ref;
+    }
+    wb->nbytes += nbytes - wb->sizes[*ip];
+    wb->sizes[*ip] = nbytes;
+  } else {
+    if (wb->n >= wb->len) {
+      size_t len = wb->len + 32;
+      void *p;
+      if (!(p = realloc(wb->insts, len*sizeof(DLiteInstance *)))) goto fail;
+      wb->insts = p;
+      if (!(p = realloc(wb->sizes, len*sizeof(size_t)))) goto fail;
+      wb->sizes = p;
+      wb->len = len;
+    }
+    if (map_set(&wb->index, inst->uuid, (int)wb->n)) goto fail;
+    if (wb->n == 0) wb->since = now;
+    dlite_instance_incref(ref);
+    wb->insts[wb->n] = ref;
+    wb->sizes[wb->n] = nbytes;
+    wb->n++;
+    wb->nbytes += nbytes;
+  }
+  if ((wb->maxbytes && wb->nbytes >= wb->maxbytes) ||
+      (wb->interval > 0 && now - wb->since >= wb->interval))
+    flush = 1;
+  retval = 0;
+ fail:
+  thread_mutex_unlock(&wb->mutex);
+  if (retval) return err(1, "allocation failure");
+  return (flush) ? dlite_storage_flush(s) : 0;
+}
+
+
+
 /*******************************************************************
  *  Storage paths and URLs
  *******************************************************************/
@@ -300,6 +1062,31 @@ void dlite_storage_paths_free(void)
     free(g->storage_paths);
   }
   g->storage_paths = NULL;
+  dlite_storage_paths_clear_missing();
+}
+
+/* Help function for dlite_storage_paths_insert() and
+   dlite_storage_paths_append().  If `append` is non-zero, `n` is
+   ignored and `path` is appended. */
+static int paths_insert(int n, const char *path, int append)
+{
+  FUPaths *paths = dlite_storage_paths();
+  char *before, *after;
+  int index;
+
+  thread_mutex_lock(&paths_mutex);
+  before = fu_paths_string(paths);
+  index = fu_paths_insert(paths, path, (append) ? (int)paths->n : n);
+
+  /* storage plugins may append their location on every open, so only
+     clear the missing ids if the paths actually changed */
+  after = fu_paths_string(paths);
+  thread_mutex_unlock(&paths_mutex);
+  if (!before || !after || strcmp(before, after) != 0)
+    dlite_storage_paths_clear_missing();
+  if (before) free(before);
+  if (after) free(after);
+  return index;
 }
 
 /*
@@ -310,8 +1097,7 @@ void dlite_storage_paths_free(void)
  */
 int dlite_storage_paths_insert(int n, const char *path)
 {
-  FUPaths *paths = dlite_storage_paths();
-  return fu_paths_insert(paths, path, n);
+  return paths_insert(n, path, 0);
 }
 
 /*
@@ -321,8 +1107,7 @@ int dlite_storage_paths_insert(int n, const char *path)
  */
 int dlite_storage_paths_append(const char *path)
 {
-  FUPaths *paths = dlite_storage_paths();
-  return fu_paths_append(paths, path);
+  return paths_insert(0, path, 1);
 }
 
 /*
@@ -334,7 +1119,12 @@ int dlite_storage_paths_append(const char *path)
 int dlite_storage_paths_delete(int n)
 {
   FUPaths *paths = dlite_storage_paths();
-  return fu_paths_delete(paths, n);
+  int stat;
+  thread_mutex_lock(&paths_mutex);
+  stat = fu_paths_delete(paths, n);
+  thread_mutex_unlock(&paths_mutex);
+  if (!stat) dlite_storage_paths_clear_missing();
+  return stat;
 }
 
 /*
@@ -351,6 +1141,74 @@ const char **dlite_storage_paths_get()
   return fu_paths_get(paths);
 }
 
+/*
+  Returns non-zero if `id` is known to not be found in any storage in
+  the storage paths.
+
+  Otherwise zero is returned and a mark is stored in `*mark`, that
+  should be passed to dlite_storage_paths_add_missing() if a search
+  for `id` fails.
+ */
+int dlite_storage_paths_is_missing(const char *id, unsigned *mark)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  Globals *g;
+  int missing=0;
+  if (!(g = get_globals())) return 0;
+  if (dlite_get_uuid(uuid, id) < 0) return 0;
+  thread_mutex_lock(&missing_mutex);
+  if (g->nmissing && map_get(&g->missing, uuid)) missing = 1;
+  if (mark) *mark = g->missing_mark;
+  thread_mutex_unlock(&missing_mutex);
+  return missing;
+}
+
+/*
+  Records that `id` cannot be found in any storage in the storage
+  paths, such that dlite_instance_get() doesn't search for it again.
+  `mark` should be obtained with dlite_storage_paths_is_missing()
+  before the search started.  If the cache has been cleared since
+  then, `id` is not recorded, since the search may be outdated.
+ */
+void dlite_storage_paths_add_missing(const char *id, unsigned mark)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  Globals *g;
+  if (!(g = get_globals())) return;
+  if (dlite_get_uuid(uuid, id) < 0) return;
+  thread_mutex_lock(&missing_mutex);
+  if (mark == g->missing_mark) {
+    if (g->nmissing >= MISSING_MAX) {
+      map_deinit(&g->missing);
+      g->nmissing = 0;
+    }
+    if (!g->nmissing) map_init(&g->missing);
+    if (!map_get(&g->missing, uuid) && map_set(&g->missing, uuid, 1) == 0)
+      g->nmissing++;
+  }
+  thread_mutex_unlock(&missing_mutex);
+}
+
+/*
+  Clears the cache of ids that cannot be found in the storage paths.
+
+  This is done automatically when the storage paths are changed with
+  dlite_storage_paths_insert(), dlite_storage_paths_append() or
+  dlite_storage_paths_delete(), when an instance is saved and when a
+  writable storage is closed.  Call this function if the storage paths
+  are modified in other ways, e.g. by other processes.
+ */
+void dlite_storage_paths_clear_missing(void)
+{
+  Globals *g;
+  if (!(g = dlite_globals_get_state(GLOBALS_ID))) return;
+  thread_mutex_lock(&missing_mutex);
+  if (g->nmissing) map_deinit(&g->missing);
+  g->nmissing = 0;
+  g->missing_mark++;
+  thread_mutex_unlock(&missing_mutex);
+}
+
 /*
   Returns an iterator over all files in storage paths (with glob
   patterns in paths expanded).
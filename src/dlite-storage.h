@@ -21,6 +21,9 @@ typedef struct _DLiteInstance DLiteInstance;
 /** Iterator over dlite storage paths. */
 typedef struct _DLiteStoragePathIter DLiteStoragePathIter;
 
+/** Opaque type for a query over the instances in a storage. */
+typedef struct _DLiteStorageQuery DLiteStorageQuery;
+
 /** Flags for how to handle instance IDs. */
 typedef enum _DLiteIDFlag {
   dliteIDTranslateToUUID=0, /*!< Translate id's that are not a valid UUID to
@@ -32,6 +35,37 @@ typedef enum _DLiteIDFlag {
 } DLiteIDFlag;
 
 
+/** Capabilities of a storage plugin.  See dlite_storage_get_capabilities(). */
+typedef enum _DLiteStorageCapability {
+  dliteCapThreadSafe=1,     /*!< The plugin may be called concurrently on the
+                                 same storage. */
+  dliteCapSlices=2,         /*!< Slices of properties can be read without
+                                 reading the whole property. */
+  dliteCapBatch=4,          /*!< Many instances can be loaded or saved in
+                                 one call. */
+  dliteCapZeroCopy=8,       /*!< Property data is accessed directly from the
+                                 storage (e.g. memory mapped) without
+                                 intermediate copies. */
+  dliteCapRandomAccess=16,  /*!< Individual properties can be read and
+                                 written without rewriting the instance. */
+  dliteCapAppendOnly=32,    /*!< Data is only appended.  Saving an existing
+                                 instance adds a new record replacing the
+                                 old one. */
+  dliteCapDistributed=64    /*!< Distributed instances can be saved in
+                                 parts, see
+                                 dlite_storage_set_decomposition(). */
+} DLiteStorageCapability;
+
+/** Decomposition of a dimension of distributed instances.  See
+    dlite_storage_set_decomposition(). */
+typedef struct _DLiteDecomposition {
+  char *dimension;   /*!< Name of the decomposed dimension */
+  size_t offset;     /*!< Offset of the local part along `dimension` */
+  size_t size;       /*!< Global size of `dimension` */
+  struct _DLiteDecomposition *next;  /*!< Next decomposed dimension */
+} DLiteDecomposition;
+
+
 /**
   Opens a storage located at `location` using `driver`.
   Returns a opaque pointer or NULL on error.
@@ -44,6 +78,10 @@ typedef enum _DLiteIDFlag {
         - r    Read-only: open existing file for read-only
         - w    Write: truncate existing file or create new file
         - a    Append: open existing file for read and write
+
+  File-based storages may be compressed by prefixing `driver` with
+  the codec, like "gzip+json", by the option `compress=gzip[:LEVEL[:THREADS]]`
+  or by a location ending with ".gz".  See dlite-compress.h.
 */
 DLiteStorage *dlite_storage_open(const char *driver, const char *location,
                                  const char *options);
@@ -79,12 +117,163 @@ void dlite_storage_set_idflag(DLiteStorage *s, DLiteIDFlag idflag);
  */
 int dlite_storage_is_writable(const DLiteStorage *s);
 
+/**
+  Returns the capabilities of storage `s` as a bitwise OR of
+  DLiteStorageCapability flags.
+
+  The flags declared by the plugin are combined with the ones that
+  follows from the functions it implements (`dliteCapSlices`,
+  `dliteCapBatch` and `dliteCapDistributed`).
+ */
+int dlite_storage_get_capabilities(const DLiteStorage *s);
+
+/**
+  Declares that instances saved to storage `s` are distributed along
+  `dimension`, for instance over MPI ranks.
+
+  The instance saved by the calling process holds the part of the
+  global instance starting at `offset` along `dimension`, whose global
+  length is `size`.  The local length is the size of the dimension in
+  the saved instance.  Properties depending on `dimension` are written
+  as blocks of the global property, while other properties are written
+  as a whole by all processes.
+
+  May be called for several dimensions.  A `size` of zero removes the
+  decomposition of `dimension`.
+
+  Requires a storage with the `dliteCapDistributed` capability.
+  Returns non-zero on error.
+ */
+int dlite_storage_set_decomposition(DLiteStorage *s, const char *dimension,
+                                    size_t offset, size_t size);
+
+/**
+  Returns the decomposition of `dimension` in storage `s` or NULL if
+  it is not decomposed.
+ */
+const DLiteDecomposition *
+dlite_storage_get_decomposition(const DLiteStorage *s, const char *dimension);
+
 /**
   Returns name of driver associated with storage `s`.
  */
 const char *dlite_storage_get_driver(const DLiteStorage *s);
 
 
+/**
+ * @name Storage cache
+ * Reuse of open storages for repeated access to the same location.
+ * @{
+ */
+
+/**
+  Like dlite_storage_open(), but returns an idle storage from the
+  storage cache if one was opened with the same `driver`, `location`
+  and `options`.  Otherwise a new storage is opened.
+
+  The returned storage is used exclusively by the caller until it is
+  given back with dlite_storage_cache_release().  It must not be closed
+  with dlite_storage_close().
+
+  Only read-only storages are kept in the cache, since some plugins
+  first write to their storage when it is closed.
+
+  Returns NULL on error.
+ */
+DLiteStorage *dlite_storage_cache_open(const char *driver,
+                                       const char *location,
+                                       const char *options);
+
+/**
+  Gives storage `s` returned by dlite_storage_cache_open() back to the
+  cache.  It is kept open for reuse until it is evicted.  Storages
+  that are not in the cache are closed.
+
+  Idle storages are evicted when there are more than
+  `DLITE_STORAGE_CACHE_SIZE` (default: 8) of them, or when they have
+  been idle for more than `DLITE_STORAGE_CACHE_TIMEOUT` (default: 60)
+  seconds.  Storages that are outdated because a writable storage at
+  the same location has been closed are evicted directly.
+
+  Returns non-zero on error.
+ */
+int dlite_storage_cache_release(DLiteStorage *s);
+
+/**
+  Closes all idle storages in the storage cache.  Storages that are in
+  use are closed when they are released.
+ */
+void dlite_storage_cache_clear(void);
+
+/** @} */
+
+
+/**
+ * @name Write-behind
+ * Deferred and coalesced saving of instances.
+ * @{
+ */
+
+/**
+  Enables or disables write-behind for storage `s`.
+
+  With write-behind enabled, dlite_instance_save() only records the
+  instance as pending in `s`.  Repeated saves of an instance with the
+  same UUID are coalesced, such that only its last state is written.
+  The pending instances are written in one batch with the storage's
+  saveInstances() api (if it provides it) when:
+
+    - dlite_storage_flush() is called,
+    - the storage is closed,
+    - instances are loaded, iterated over or queried in `s`,
+    - the pending instances exceed `maxbytes` bytes (if non-zero), or
+    - a save is made more than `interval` seconds after the oldest
+      pending save (if `interval` is positive).
+
+  Note that the interval is only checked on save.  There is no
+  background timer.
+
+  Since pending instances are referred to, not copied, changes made to
+  them before the flush are also written.
+
+  dlite_instance_save() and dlite_storage_flush() may be called
+  concurrently from several threads for a storage with write-behind
+  enabled.  Flushes are serialised, such that the storage plugin is
+  only called from one thread at a time and the batches are written
+  in the order they were recorded.  Enabling and disabling
+  write-behind is not thread-safe.
+
+  Disabling write-behind flushes the pending instances.
+
+  Returns non-zero on error.
+ */
+int dlite_storage_set_write_behind(DLiteStorage *s, int enable,
+                                   size_t maxbytes, double interval);
+
+/**
+  Writes all pending instances in storage `s`.  Does nothing if
+  write-behind is not enabled.
+
+  Returns non-zero on error.  Pending instances are dropped on error.
+ */
+int dlite_storage_flush(DLiteStorage *s);
+
+/**
+  Returns the number of pending instances in storage `s`.
+ */
+size_t dlite_storage_pending(const DLiteStorage *s);
+
+/**
+  Records instance `inst` as pending in storage `s`, with write-behind
+  enabled.  Used by dlite_instance_save().
+
+  Returns non-zero on error.
+ */
+int dlite_storage_defer_save(DLiteStorage *s, const DLiteInstance *inst);
+
+/** @} */
+
+
 /* Dublicated declarations from dlite-storage-plugins.h */
 int dlite_storage_plugin_unload(const char *name);
 const char **dlite_storage_plugin_paths(void);
@@ -142,6 +331,36 @@ char **dlite_storage_uuids(const DLiteStorage *s, const char *pattern);
  */
 void dlite_storage_uuids_free(char **uuids);
 
+
+/**
+  Returns a new query over the instances of metadata `metaid` in
+  storage `s` that match `predicate`.  See dlite-query.h for the
+  syntax of predicates.  A NULL or empty predicate matches all
+  instances of `metaid`.
+
+  Plugins that can translate the predicate to a native query do so.
+  Otherwise the instances of `metaid` are loaded one by one and the
+  predicate is evaluated on them.
+
+  Returns NULL on error.
+ */
+DLiteStorageQuery *dlite_storage_query(DLiteStorage *s, const char *metaid,
+                                       const char *predicate);
+
+/**
+  Assigns `*inst` to a new reference to the next instance matching
+  query `q`, created with dlite_storage_query().
+
+  Returns zero on success, 1 if there are no more matching instances
+  and a negative number on other errors.
+ */
+int dlite_storage_query_next(DLiteStorageQuery *q, DLiteInstance **inst);
+
+/**
+  Frees query created with dlite_storage_query().
+ */
+void dlite_storage_query_free(DLiteStorageQuery *q);
+
 /** @} */
 
 
@@ -195,6 +414,36 @@ int dlite_storage_paths_delete(int n);
 const char **dlite_storage_paths_get();
 
 
+/**
+  Returns non-zero if `id` is known to not be found in any storage in
+  the storage paths.
+
+  Otherwise zero is returned and a mark is stored in `*mark`, that
+  should be passed to dlite_storage_paths_add_missing() if a search
+  for `id` fails.
+ */
+int dlite_storage_paths_is_missing(const char *id, unsigned *mark);
+
+/**
+  Records that `id` cannot be found in any storage in the storage
+  paths, such that dlite_instance_get() doesn't search for it again.
+  `mark` should be obtained with dlite_storage_paths_is_missing()
+  before the search started.  If the cache has been cleared since
+  then, `id` is not recorded, since the search may be outdated.
+ */
+void dlite_storage_paths_add_missing(const char *id, unsigned mark);
+
+/**
+  Clears the cache of ids that cannot be found in the storage paths.
+
+  This is done automatically when the storage paths are changed with
+  dlite_storage_paths_insert(), dlite_storage_paths_append() or
+  dlite_storage_paths_delete(), when an instance is saved and when a
+  writable storage is closed.  Call this function if the storage paths
+  are modified in other ways, e.g. by other processes.
+ */
+void dlite_storage_paths_clear_missing(void);
+
 /**
   Returns an iterator over all files in storage paths (with glob
   patterns in paths expanded).
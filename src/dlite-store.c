@@ -4,14 +4,11 @@
 #include <string.h>
 
 #include "utils/err.h"
+#include "utils/scheduler.h"
+#include "utils/thread.h"
 #include "dlite-macros.h"
 #include "dlite-store.h"
 
-/* TODO
-   - Add read and write locks for tread safety they should be local to
-     the store.
- */
-
 
 /* Item to add in the store */
 typedef struct {
@@ -24,9 +21,18 @@ typedef map_t(item_t) item_map_t;
 
 /* Definition of DLiteStore */
 struct _DLiteStore {
-  item_map_t map;  /* maps uuid to pointer to instance */
+  item_map_t map;     /* maps uuid to pointer to instance */
+  ThreadRWLock lock;  /* protects `map` */
 };
 
+/* Instances loaded or saved concurrently by the shared scheduler */
+typedef struct {
+  DLiteStorage *s;         /* storage */
+  const char **ids;        /* ids of instances to load */
+  DLiteInstance **insts;   /* loaded or saved instances */
+  int *stat;               /* non-zero for instances that failed */
+} StoreIO;
+
 
 
 /*
@@ -38,6 +44,10 @@ DLiteStore *dlite_store_create()
   if (!(store = calloc(1, sizeof(DLiteStore))))
     return err(1, "allocation failure"), NULL;
   map_init(&store->map);
+  if (thread_rwlock_init(&store->lock)) {
+    free(store);
+    return err(1, "cannot initialise store lock"), NULL;
+  }
   return store;
 }
 
@@ -54,49 +64,14 @@ void dlite_store_free(DLiteStore *store)
     dlite_instance_decref(item->inst);
   }
   map_deinit(&store->map);
+  thread_rwlock_destroy(&store->lock);
   free(store);
 }
 
-/*
-  Returns a new store populated with all instances in storage `s`.
-*/
-DLiteStore *dlite_store_load(DLiteStorage *s)
-{
-  char **p, **uuids=NULL;
-  DLiteStore *store=NULL, *retval=NULL;
-  DLiteInstance *inst;
-  if (!(uuids = dlite_storage_uuids(s, NULL))) goto fail;
-  if (!(store = dlite_store_create())) goto fail;
-  for (p=uuids; *p; p++) {
-    if (!(inst = dlite_instance_load(s, *p))) goto fail;
-    if (!dlite_store_add_new(store, inst)) goto fail;
-  }
-  retval = store;
- fail:
-  if (uuids) dlite_storage_uuids_free(uuids);
-  if (!retval && store) dlite_store_free(store);
-  return retval;
-}
-
-/*
-  Saves store to storage.  Returns non-zero on error.
-*/
-int dlite_store_save(DLiteStorage *s, DLiteStore *store)
-{
-  int retval=0;
-  const char *uuid;
-  map_iter_t iter = map_iter(&store->map);
-  while ((uuid = map_next(&store->map, &iter))) {
-    item_t *item = (item_t *)map_get(&store->map, uuid);
-    assert(item);
-    retval += (dlite_instance_save(s, item->inst)) ? 1 : 0;
-  }
-  return retval;
-}
-
 /*
   Adds instance to store.  If `steel` is non-zero, the ownership of
-  `inst` is taken over by the store.  Returns non-zero on error.
+  `inst` is taken over by the store.  Must be called with the write
+  lock held.  Returns non-zero on error.
  */
 static int add(DLiteStore *store, DLiteInstance *inst, int steel)
 {
@@ -115,12 +90,60 @@ static int add(DLiteStore *store, DLiteInstance *inst, int steel)
   return 0;
 }
 
+/*
+  Removes one occurrence of the instance with given id from store and
+  returns it.  If `all` is non-zero, all occurrences are removed.  Must
+  be called with the write lock held.  Returns NULL on error.
+ */
+static DLiteInstance *pop(DLiteStore *store, const char *id, int all)
+{
+  item_t *item;
+  DLiteInstance *inst;
+  int uuidver;
+  char uuid[DLITE_UUID_LENGTH+1];
+  if ((uuidver = dlite_get_uuid(uuid, id)) != 0 && uuidver != 5)
+    FAIL1("id '%s' is neither a valid UUID or a convertable string", id);
+  if (!(item = (item_t *)map_get(&store->map, uuid)))
+    FAIL1("id '%s' is not in store", id);
+  inst = item->inst;
+  if (all || --item->refcount <= 0)
+    map_remove(&store->map, uuid);
+  return inst;
+ fail:
+  return NULL;
+}
+
+/*
+  Adds the `n` instances in array `insts` to store.  If `steel` is
+  non-zero, the ownership of the instances is taken over by the store.
+  Either all or none of the instances are added.  Returns non-zero on
+  error.
+ */
+static int add_many(DLiteStore *store, DLiteInstance **insts, size_t n,
+                    int steel)
+{
+  size_t i;
+  thread_rwlock_wrlock(&store->lock);
+  for (i=0; i<n; i++)
+    if (add(store, insts[i], steel)) break;
+  if (i < n) {
+    while (i-- > 0) {
+      pop(store, insts[i]->uuid, 0);
+      if (!steel) dlite_instance_decref(insts[i]);
+    }
+    thread_rwlock_wrunlock(&store->lock);
+    return 1;
+  }
+  thread_rwlock_wrunlock(&store->lock);
+  return 0;
+}
+
 /*
   Adds instance to store.  Returns non-zero on error.
  */
 int dlite_store_add(DLiteStore *store, DLiteInstance *inst)
 {
-  return add(store, inst, 0);
+  return add_many(store, &inst, 1, 0);
 }
 
 /*
@@ -129,7 +152,17 @@ int dlite_store_add(DLiteStore *store, DLiteInstance *inst)
  */
 int dlite_store_add_new(DLiteStore *store, DLiteInstance *inst)
 {
-  return add(store, inst, 1);
+  return add_many(store, &inst, 1, 1);
+}
+
+/*
+  Adds the `n` instances in array `insts` to store.  The ownership is
+  retained with the caller.  Either all or none of the instances are
+  added.  Returns non-zero on error.
+ */
+int dlite_store_add_many(DLiteStore *store, DLiteInstance **insts, size_t n)
+{
+  return add_many(store, insts, n, 0);
 }
 
 /*
@@ -138,20 +171,11 @@ int dlite_store_add_new(DLiteStore *store, DLiteInstance *inst)
  */
 DLiteInstance *dlite_store_pop(DLiteStore *store, const char *id)
 {
-  item_t *item;
   DLiteInstance *inst;
-  int uuidver;
-  char uuid[DLITE_UUID_LENGTH+1];
-  if ((uuidver = dlite_get_uuid(uuid, id)) != 0 && uuidver != 5)
-    FAIL1("id '%s' is neither a valid UUID or a convertable string", id);
-  if (!(item = (item_t *)map_get(&store->map, uuid)))
-    FAIL1("id '%s' is not in store", id);
-  inst = item->inst;
-  if (--item->refcount <= 0)
-    map_remove(&store->map, uuid);
+  thread_rwlock_wrlock(&store->lock);
+  inst = pop(store, id, 0);
+  thread_rwlock_wrunlock(&store->lock);
   return inst;
- fail:
-  return NULL;
 }
 
 /*
@@ -160,19 +184,35 @@ DLiteInstance *dlite_store_pop(DLiteStore *store, const char *id)
  */
 DLiteInstance *dlite_store_pop_all(DLiteStore *store, const char *id)
 {
-  item_t *item;
   DLiteInstance *inst;
-  int uuidver;
-  char uuid[DLITE_UUID_LENGTH+1];
-  if ((uuidver = dlite_get_uuid(uuid, id)) != 0 && uuidver != 5)
-    FAIL1("id '%s' is neither a valid UUID or a convertable string", id);
-  if (!(item = (item_t *)map_get(&store->map, uuid)))
-    FAIL1("id '%s' is not in store", id);
-  inst = item->inst;
-  map_remove(&store->map, uuid);
+  thread_rwlock_wrlock(&store->lock);
+  inst = pop(store, id, 1);
+  thread_rwlock_wrunlock(&store->lock);
   return inst;
- fail:
-  return NULL;
+}
+
+/*
+  Removes the `n` instances with ids in array `ids` from store and
+  returns them as a newly allocated array.  Either all or none of the
+  instances are removed.  Returns NULL on error.
+ */
+DLiteInstance **dlite_store_pop_many(DLiteStore *store, const char **ids,
+                                     size_t n)
+{
+  DLiteInstance **insts;
+  size_t i;
+  if (!(insts = calloc((n) ? n : 1, sizeof(DLiteInstance *))))
+    return err(1, "allocation failure"), NULL;
+  thread_rwlock_wrlock(&store->lock);
+  for (i=0; i<n; i++)
+    if (!(insts[i] = pop(store, ids[i], 0))) break;
+  if (i < n) {
+    while (i-- > 0) add(store, insts[i], 1);
+    free(insts);
+    insts = NULL;
+  }
+  thread_rwlock_wrunlock(&store->lock);
+  return insts;
 }
 
 /*
@@ -204,22 +244,48 @@ int dlite_store_remove(DLiteStore *store, const char *id)
 }
 */
 
+/* Help function for dlite_store_get() and dlite_store_get_ref().  If
+   `incref` is true, the reference count of the returned instance is
+   increased while the lock is held. */
+static DLiteInstance *get(const DLiteStore *store, const char *id,
+                          int incref)
+{
+  DLiteStore *st = (DLiteStore *)store;
+  item_t *item;
+  DLiteInstance *inst=NULL;
+  int uuidver;
+  char uuid[DLITE_UUID_LENGTH+1];
+  if ((uuidver = dlite_get_uuid(uuid, id)) != 0 && uuidver != 5)
+    return errx(1, "id '%s' is neither a valid UUID or a convertable "
+                "string", id), NULL;
+  thread_rwlock_rdlock(&st->lock);
+  if ((item = (item_t *)map_get(&st->map, uuid))) {
+    inst = item->inst;
+    if (incref) dlite_instance_incref(inst);
+  }
+  thread_rwlock_rdunlock(&st->lock);
+  if (!inst) errx(1, "id '%s' not in store", id);
+  return inst;
+}
+
 /*
   Returns a borrowed reference to instance, or NULL if `id` is not
   in the store.
 */
 DLiteInstance *dlite_store_get(const DLiteStore *store, const char *id)
 {
-  item_t *item;
-  int uuidver;
-  char uuid[DLITE_UUID_LENGTH+1];
-  if ((uuidver = dlite_get_uuid(uuid, id)) != 0 && uuidver != 5)
-    FAIL1("id '%s' is neither a valid UUID or a convertable string", id);
-  if (!(item = (item_t *)map_get(&((DLiteStore *)store)->map, uuid)))
-    FAIL1("id '%s' not in store", id);
-  return item->inst;
- fail:
-  return NULL;
+  return get(store, id, 0);
+}
+
+/*
+  Like dlite_store_get(), but returns a new reference to the instance.
+  The reference is acquired while the store is locked, so the instance
+  stays valid even if another thread removes it from the store.  The
+  caller must release it with dlite_instance_decref().
+*/
+DLiteInstance *dlite_store_get_ref(const DLiteStore *store, const char *id)
+{
+  return get(store, id, 1);
 }
 
 
@@ -242,5 +308,146 @@ DLiteStoreIter dlite_store_iter(const DLiteStore *store)
  */
 const char *dlite_store_next(const DLiteStore *store, DLiteStoreIter *iter)
 {
-  return map_next((map_void_t *)&store->map, &iter->iter);
+  DLiteStore *st = (DLiteStore *)store;
+  const char *uuid;
+  thread_rwlock_rdlock(&st->lock);
+  uuid = map_next((map_void_t *)&st->map, &iter->iter);
+  thread_rwlock_rdunlock(&st->lock);
+  return uuid;
+}
+
+
+/* Task loading instances `begin` to `end` of the StoreIO in `arg`. */
+static void load_range(size_t begin, size_t end, void *arg)
+{
+  StoreIO *io = arg;
+  size_t i;
+  for (i=begin; i<end; i++)
+    if (!(io->insts[i] = dlite_instance_load(io->s, io->ids[i])))
+      io->stat[i] = 1;
+}
+
+/* Task saving instances `begin` to `end` of the StoreIO in `arg`. */
+static void save_range(size_t begin, size_t end, void *arg)
+{
+  StoreIO *io = arg;
+  size_t i;
+  for (i=begin; i<end; i++)
+    io->stat[i] = dlite_instance_save(io->s, io->insts[i]);
+}
+
+/* Calls `func` for the `n` instances of `io` concurrently using the
+   shared scheduler.  Returns the number of instances that failed. */
+static int parallel_io(StoreIO *io, size_t n, SchedRangeFunc func)
+{
+  size_t i;
+  int nthreads = sched_get_nthreads(), nfailed=0;
+  if (nthreads < 1) nthreads = 1;
+  if (!(io->stat = calloc((n) ? n : 1, sizeof(int))))
+    return err(1, "allocation failure");
+  if (sched_parallel_for(n, (n + nthreads - 1) / nthreads, func, io))
+    nfailed = (int)n;
+  else
+    for (i=0; i<n; i++) if (io->stat[i]) nfailed++;
+  free(io->stat);
+  io->stat = NULL;
+  return nfailed;
+}
+
+/*
+  Returns a new store populated with all instances in storage `s`.
+
+  Storages with the batch api load all instances with one call.
+  Otherwise instances in storages with the `dliteCapThreadSafe`
+  capability are loaded concurrently by the shared scheduler.
+*/
+DLiteStore *dlite_store_load(DLiteStorage *s)
+{
+  char **uuids=NULL;
+  DLiteStore *store=NULL, *retval=NULL;
+  DLiteInstance **insts=NULL;
+  size_t i, n=0;
+  int caps;
+  if (!s) FAIL("invalid storage, see previous errors");
+  caps = dlite_storage_get_capabilities(s);
+  if (!(uuids = dlite_storage_uuids(s, NULL))) goto fail;
+  while (uuids[n]) n++;
+  if (!(store = dlite_store_create())) goto fail;
+
+  if (!(caps & dliteCapBatch) && (caps & dliteCapThreadSafe) && n > 1) {
+    StoreIO io;
+    memset(&io, 0, sizeof(io));
+    io.s = s;
+    io.ids = (const char **)uuids;
+    if (!(insts = calloc(n, sizeof(DLiteInstance *))))
+      FAIL("allocation failure");
+    io.insts = insts;
+    if (parallel_io(&io, n, load_range)) {
+      for (i=0; i<n; i++) if (insts[i]) dlite_instance_decref(insts[i]);
+      FAIL("cannot load all instances from storage");
+    }
+  } else {
+    if (!(insts = dlite_instance_load_many(s, (const char **)uuids, n)))
+      goto fail;
+  }
+  if (add_many(store, insts, n, 1)) {
+    for (i=0; i<n; i++) dlite_instance_decref(insts[i]);
+    goto fail;
+  }
+  retval = store;
+ fail:
+  if (uuids) dlite_storage_uuids_free(uuids);
+  if (insts) free(insts);
+  if (!retval && store) dlite_store_free(store);
+  return retval;
+}
+
+/*
+  Saves store to storage.  Returns non-zero on error.
+
+  Storages with the batch api save all instances with one call.
+  Otherwise instances are saved concurrently by the shared scheduler
+  to storages with the `dliteCapThreadSafe` capability.
+*/
+int dlite_store_save(DLiteStorage *s, DLiteStore *store)
+{
+  const char *uuid;
+  map_iter_t iter;
+  DLiteInstance **insts=NULL;
+  size_t i, n=0;
+  int caps, retval=1;
+  if (!s) return errx(1, "invalid storage, see previous errors");
+  caps = dlite_storage_get_capabilities(s);
+
+  /* take a snapshot of the instances, such that the lock is not held
+     while saving */
+  thread_rwlock_rdlock(&store->lock);
+  n = store->map.base.nnodes;
+  if (!(insts = calloc((n) ? n : 1, sizeof(DLiteInstance *)))) {
+    thread_rwlock_rdunlock(&store->lock);
+    return err(1, "allocation failure");
+  }
+  n = 0;
+  iter = map_iter(&store->map);
+  while ((uuid = map_next(&store->map, &iter))) {
+    item_t *item = (item_t *)map_get(&store->map, uuid);
+    assert(item);
+    dlite_instance_incref(item->inst);
+    insts[n++] = item->inst;
+  }
+  thread_rwlock_rdunlock(&store->lock);
+
+  if (!(caps & dliteCapBatch) && (caps & dliteCapThreadSafe) && n > 1) {
+    StoreIO io;
+    memset(&io, 0, sizeof(io));
+    io.s = s;
+    io.insts = insts;
+    retval = parallel_io(&io, n, save_range);
+  } else {
+    retval = dlite_instance_save_many(s, (const DLiteInstance **)insts, n);
+  }
+
+  for (i=0; i<n; i++) dlite_instance_decref(insts[i]);
+  free(insts);
+  return retval;
 }
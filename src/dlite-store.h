@@ -4,6 +4,19 @@
 /**
   @file
   @brief An in-memory store for instances.
+
+  A store holds references to a set of instances, such that they can
+  be loaded from or saved to a storage as a unit.
+
+  The store is thread safe.  Each store has its own read-write lock,
+  so different stores don't block each other.  Pointers returned by
+  dlite_store_get() are borrowed and are only valid as long as the
+  instance is not removed from the store by another thread.  Use
+  dlite_store_get_ref() when other threads may remove instances.
+
+  Iterating with dlite_store_next() must not run concurrently with
+  adding or removing instances, since both the iterator and the
+  returned uuid refer to the internal map of the store.
  */
 
 #include "utils/map.h"
@@ -33,11 +46,19 @@ void dlite_store_free(DLiteStore *store);
 
 /**
   Returns a new store populated with all instances in storage `s`.
+
+  Storages with the batch api load all instances with one call.
+  Otherwise instances in storages with the `dliteCapThreadSafe`
+  capability are loaded concurrently by the shared scheduler.
 */
 DLiteStore *dlite_store_load(DLiteStorage *s);
 
 /**
   Saves store to storage.  Returns non-zero on error.
+
+  Storages with the batch api save all instances with one call.
+  Otherwise instances are saved concurrently by the shared scheduler
+  to storages with the `dliteCapThreadSafe` capability.
 */
 int dlite_store_save(DLiteStorage *s, DLiteStore *store);
 
@@ -54,6 +75,13 @@ int dlite_store_add(DLiteStore *store, DLiteInstance *inst);
  */
 int dlite_store_add_new(DLiteStore *store, DLiteInstance *inst);
 
+/**
+  Adds the `n` instances in array `insts` to store.  The ownership is
+  retained with the caller.  Either all or none of the instances are
+  added.  Returns non-zero on error.
+ */
+int dlite_store_add_many(DLiteStore *store, DLiteInstance **insts, size_t n);
+
 /**
   Removes instance with given id from store and return it.  Returns
   NULL on error.
@@ -66,6 +94,18 @@ DLiteInstance *dlite_store_pop(DLiteStore *store, const char *id);
  */
 DLiteInstance *dlite_store_pop_all(DLiteStore *store, const char *id);
 
+/**
+  Removes the `n` instances with ids in array `ids` from store and
+  returns them as a newly allocated array.  Either all or none of the
+  instances are removed.  Like dlite_store_pop(), an instance added
+  several times must be listed several times to be removed completely.
+
+  Returns NULL on error.  The caller is responsible to free the
+  returned array.
+ */
+DLiteInstance **dlite_store_pop_many(DLiteStore *store, const char **ids,
+                                     size_t n);
+
 /**
   Removes instance with given id from store.  Returns non-zero on error.
  */
@@ -74,9 +114,21 @@ int dlite_store_remove(DLiteStore *store, const char *id);
 /**
   Returns a borrowed pointer to instance, or NULL if `id` is not
   in the store.
+
+  The pointer is not protected by the lock of the store, and becomes
+  invalid if another thread removes the instance.  Use
+  dlite_store_get_ref() in that case.
 */
 DLiteInstance *dlite_store_get(const DLiteStore *store, const char *id);
 
+/**
+  Returns a new reference to instance, or NULL if `id` is not in the
+  store.  The reference is acquired under the lock of the store, so
+  the instance remains valid after another thread removes it.  The
+  caller must release it with dlite_instance_decref().
+*/
+DLiteInstance *dlite_store_get_ref(const DLiteStore *store, const char *id);
+
 /**
   Returns an initiated iterator for use with dlite_store_next().
  */
@@ -86,6 +138,9 @@ DLiteStoreIter dlite_store_iter(const DLiteStore *store);
   Returns the next uuid in `store` using iterator `iter` returned by
   dlite_store_iter().  Returns NULL when there are no more uuid's.
 
+  The returned uuid is owned by the store.  Instances must not be
+  added to or removed from `store` while iterating over it.
+
   Example:
 
         const char *uuid;
@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <string.h>
+#include <ctype.h>
 #include <stddef.h>
 #ifdef HAVE_INTTYPES_H
 #include <inttypes.h>
@@ -14,6 +15,7 @@
 #include "utils/boolean.h"
 #include "utils/integers.h"
 #include "utils/floats.h"
+#include "utils/floatfmt.h"
 
 #include "dlite-macros.h"
 #include "dlite-type.h"
@@ -62,7 +64,7 @@ static int isnegative(const void *src, DLiteType type, size_t size)
   case dliteStringPtr:
     p = (type == dliteFixString) ? (char *)src : *(char **)src;
     if (!p || !*p) return -1;
-    v = strtod(p, &endptr);
+    v = fast_strtod(p, &endptr);
     if (*endptr) return -1;
     return (v < 0) ? 1 : 0;
 
@@ -126,7 +128,7 @@ static int istrue(const void *src, DLiteType type, size_t size)
   case dliteStringPtr:
     p = (type == dliteFixString) ? (char *)src : *(char **)src;
     if (!p || !*p) return -1;
-    v = strtod(p, &endptr);
+    v = fast_strtod(p, &endptr);
     if (*endptr) return -1;
     return (v) ? 1 : 0;
 
@@ -190,7 +192,6 @@ int dlite_type_copy_cast(void *dest, DLiteType dest_type, size_t dest_size,
 {
   char *p, *endptr;
   long long int vi;
-  long double vf;
   char stype[32], dtype[32];
 
   switch (src_type) {
@@ -697,7 +698,7 @@ int dlite_type_copy_cast(void *dest, DLiteType dest_type, size_t dest_size,
                          "uint%lu_t", p, (unsigned long)(dest_size*8));
       default: goto fail;
       }
-      vi = strtoll(p, &endptr, 0);
+      vi = fast_strtoll(p, &endptr, 0);
       if (*endptr) return err(1, "cannot cast string \"%s\" to uint", p);
       if (vi < 0) return err(1, "cannot cast string \"%s\" to uint", p);
       switch (dest_size) {
@@ -708,7 +709,7 @@ int dlite_type_copy_cast(void *dest, DLiteType dest_type, size_t dest_size,
       default: goto fail;
       }
     case dliteInt:
-      vi = strtoll(p, &endptr, 0);
+      vi = fast_strtoll(p, &endptr, 0);
       if (*endptr) return err(1, "cannot cast string \"%s\" to int", p);
       switch (dest_size) {
       case 1: *((int8_t *)dest) = vi;  return 0;
@@ -718,19 +719,32 @@ int dlite_type_copy_cast(void *dest, DLiteType dest_type, size_t dest_size,
       default: goto fail;
       }
     case dliteFloat:
-      vf = strtold(p, &endptr);
-      if (*endptr) return err(1, "cannot cast string \"%s\" to float", p);
       switch (dest_size) {
-      case 4: *((float32_t *)dest) = vf;   return 0;
-      case 8: *((float64_t *)dest) = vf;   return 0;
+      case 4:
+        *((float32_t *)dest) = fast_strtof(p, &endptr);
+        if (*endptr) return err(1, "cannot cast string \"%s\" to float", p);
+        return 0;
+      case 8:
+        *((float64_t *)dest) = fast_strtod(p, &endptr);
+        if (*endptr) return err(1, "cannot cast string \"%s\" to float", p);
+        return 0;
+      }
+#if defined(HAVE_FLOAT80) || defined(HAVE_FLOAT128)
+      {
+        long double vf = strtold(p, &endptr);
+        if (*endptr) return err(1, "cannot cast string \"%s\" to float", p);
+        switch (dest_size) {
 #ifdef HAVE_FLOAT80
-      case 10: *((float80_t *)dest) = vf;  return 0;
+        case 10: *((float80_t *)dest) = vf;  return 0;
 #endif
 #ifdef HAVE_FLOAT128
-      case 16: *((float128_t *)dest) = vf; return 0;
+        case 16: *((float128_t *)dest) = vf; return 0;
 #endif
-      default: goto fail;
+        default: goto fail;
+        }
       }
+#endif
+      goto fail;
     case dliteFixString:
       toFixString;
     case dliteStringPtr:
@@ -765,6 +779,14 @@ int dlite_type_copy_cast(void *dest, DLiteType dest_type, size_t dest_size,
     goto fail;
 
   default:
+    if (dlite_type_is_struct(src_type)) {
+      if (dest_type == src_type) {
+        assert(dest_size == src_size);
+        memcpy(dest, src, src_size);
+        return 0;
+      }
+      if (dest_type == dliteStringPtr) toStringPtr;
+    }
     goto fail;
   }
   assert(0);
@@ -774,3 +796,368 @@ int dlite_type_copy_cast(void *dest, DLiteType dest_type, size_t dest_size,
   dlite_type_set_typename(dest_type, dest_size, dtype, sizeof(dtype));
   return err(1, "cannot cast %s to %s", stype, dtype);
 }
+
+
+/*
+  Kernels for casting contiguous numeric arrays.
+
+  They are written as simple loops that the compiler can vectorise and
+  give the same result as calling dlite_type_copy_cast() on each
+  element.  A kernel returns non-zero if it cannot cast the array,
+  e.g. a negative number to an unsigned integer.  The caller should
+  then fall back to casting element by element.
+*/
+
+/* Defines kernel casting array of `stype` to array of `dtype` */
+#define CAST_KERNEL(dtype, stype)                                       \
+  static int cast_##dtype##_##stype(void *dest, const void *src, size_t n) \
+  {                                                                     \
+    dtype *d = dest;                                                    \
+    const stype *s = src;                                               \
+    size_t i;                                                           \
+    for (i=0; i<n; i++) d[i] = (dtype)s[i];                             \
+    return 0;                                                           \
+  }
+
+/* Like CAST_KERNEL(), but fails if any element is negative */
+#define CAST_KERNEL_NONNEG(dtype, stype)                                \
+  static int cast_##dtype##_##stype(void *dest, const void *src, size_t n) \
+  {                                                                     \
+    dtype *d = dest;                                                    \
+    const stype *s = src;                                               \
+    size_t i;                                                           \
+    int neg=0;                                                          \
+    for (i=0; i<n; i++) neg |= (s[i] < 0);                              \
+    if (neg) return 1;                                                  \
+    for (i=0; i<n; i++) d[i] = (dtype)s[i];                             \
+    return 0;                                                           \
+  }
+
+CAST_KERNEL(int8_t, int8_t)
+CAST_KERNEL(int8_t, int16_t)
+CAST_KERNEL(int8_t, int32_t)
+CAST_KERNEL(int8_t, int64_t)
+CAST_KERNEL(int8_t, uint8_t)
+CAST_KERNEL(int8_t, uint16_t)
+CAST_KERNEL(int8_t, uint32_t)
+CAST_KERNEL(int8_t, uint64_t)
+CAST_KERNEL(int8_t, float32_t)
+CAST_KERNEL(int8_t, float64_t)
+CAST_KERNEL(int16_t, int8_t)
+CAST_KERNEL(int16_t, int16_t)
+CAST_KERNEL(int16_t, int32_t)
+CAST_KERNEL(int16_t, int64_t)
+CAST_KERNEL(int16_t, uint8_t)
+CAST_KERNEL(int16_t, uint16_t)
+CAST_KERNEL(int16_t, uint32_t)
+CAST_KERNEL(int16_t, uint64_t)
+CAST_KERNEL(int16_t, float32_t)
+CAST_KERNEL(int16_t, float64_t)
+CAST_KERNEL(int32_t, int8_t)
+CAST_KERNEL(int32_t, int16_t)
+CAST_KERNEL(int32_t, int32_t)
+CAST_KERNEL(int32_t, int64_t)
+CAST_KERNEL(int32_t, uint8_t)
+CAST_KERNEL(int32_t, uint16_t)
+CAST_KERNEL(int32_t, uint32_t)
+CAST_KERNEL(int32_t, uint64_t)
+CAST_KERNEL(int32_t, float32_t)
+CAST_KERNEL(int32_t, float64_t)
+CAST_KERNEL(int64_t, int8_t)
+CAST_KERNEL(int64_t, int16_t)
+CAST_KERNEL(int64_t, int32_t)
+CAST_KERNEL(int64_t, int64_t)
+CAST_KERNEL(int64_t, uint8_t)
+CAST_KERNEL(int64_t, uint16_t)
+CAST_KERNEL(int64_t, uint32_t)
+CAST_KERNEL(int64_t, uint64_t)
+CAST_KERNEL(int64_t, float32_t)
+CAST_KERNEL(int64_t, float64_t)
+CAST_KERNEL_NONNEG(uint8_t, int8_t)
+CAST_KERNEL_NONNEG(uint8_t, int16_t)
+CAST_KERNEL_NONNEG(uint8_t, int32_t)
+CAST_KERNEL_NONNEG(uint8_t, int64_t)
+CAST_KERNEL(uint8_t, uint8_t)
+CAST_KERNEL(uint8_t, uint16_t)
+CAST_KERNEL(uint8_t, uint32_t)
+CAST_KERNEL(uint8_t, uint64_t)
+CAST_KERNEL_NONNEG(uint8_t, float32_t)
+CAST_KERNEL_NONNEG(uint8_t, float64_t)
+CAST_KERNEL_NONNEG(uint16_t, int8_t)
+CAST_KERNEL_NONNEG(uint16_t, int16_t)
+CAST_KERNEL_NONNEG(uint16_t, int32_t)
+CAST_KERNEL_NONNEG(uint16_t, int64_t)
+CAST_KERNEL(uint16_t, uint8_t)
+CAST_KERNEL(uint16_t, uint16_t)
+CAST_KERNEL(uint16_t, uint32_t)
+CAST_KERNEL(uint16_t, uint64_t)
+CAST_KERNEL_NONNEG(uint16_t, float32_t)
+CAST_KERNEL_NONNEG(uint16_t, float64_t)
+CAST_KERNEL_NONNEG(uint32_t, int8_t)
+CAST_KERNEL_NONNEG(uint32_t, int16_t)
+CAST_KERNEL_NONNEG(uint32_t, int32_t)
+CAST_KERNEL_NONNEG(uint32_t, int64_t)
+CAST_KERNEL(uint32_t, uint8_t)
+CAST_KERNEL(uint32_t, uint16_t)
+CAST_KERNEL(uint32_t, uint32_t)
+CAST_KERNEL(uint32_t, uint64_t)
+CAST_KERNEL_NONNEG(uint32_t, float32_t)
+CAST_KERNEL_NONNEG(uint32_t, float64_t)
+CAST_KERNEL_NONNEG(uint64_t, int8_t)
+CAST_KERNEL_NONNEG(uint64_t, int16_t)
+CAST_KERNEL_NONNEG(uint64_t, int32_t)
+CAST_KERNEL_NONNEG(uint64_t, int64_t)
+CAST_KERNEL(uint64_t, uint8_t)
+CAST_KERNEL(uint64_t, uint16_t)
+CAST_KERNEL(uint64_t, uint32_t)
+CAST_KERNEL(uint64_t, uint64_t)
+CAST_KERNEL_NONNEG(uint64_t, float32_t)
+CAST_KERNEL_NONNEG(uint64_t, float64_t)
+CAST_KERNEL(float32_t, int8_t)
+CAST_KERNEL(float32_t, int16_t)
+CAST_KERNEL(float32_t, int32_t)
+CAST_KERNEL(float32_t, int64_t)
+CAST_KERNEL(float32_t, uint8_t)
+CAST_KERNEL(float32_t, uint16_t)
+CAST_KERNEL(float32_t, uint32_t)
+CAST_KERNEL(float32_t, uint64_t)
+CAST_KERNEL(float32_t, float32_t)
+CAST_KERNEL(float32_t, float64_t)
+CAST_KERNEL(float64_t, int8_t)
+CAST_KERNEL(float64_t, int16_t)
+CAST_KERNEL(float64_t, int32_t)
+CAST_KERNEL(float64_t, int64_t)
+CAST_KERNEL(float64_t, uint8_t)
+CAST_KERNEL(float64_t, uint16_t)
+CAST_KERNEL(float64_t, uint32_t)
+CAST_KERNEL(float64_t, uint64_t)
+CAST_KERNEL(float64_t, float32_t)
+CAST_KERNEL(float64_t, float64_t)
+
+/* Table of kernels indexed by destination and source, see kernel_index() */
+static const DLiteTypeCastKernel cast_kernels[10][10] = {
+  {
+    cast_int8_t_int8_t,
+    cast_int8_t_int16_t,
+    cast_int8_t_int32_t,
+    cast_int8_t_int64_t,
+    cast_int8_t_uint8_t,
+    cast_int8_t_uint16_t,
+    cast_int8_t_uint32_t,
+    cast_int8_t_uint64_t,
+    cast_int8_t_float32_t,
+    cast_int8_t_float64_t
+  },
+  {
+    cast_int16_t_int8_t,
+    cast_int16_t_int16_t,
+    cast_int16_t_int32_t,
+    cast_int16_t_int64_t,
+    cast_int16_t_uint8_t,
+    cast_int16_t_uint16_t,
+    cast_int16_t_uint32_t,
+    cast_int16_t_uint64_t,
+    cast_int16_t_float32_t,
+    cast_int16_t_float64_t
+  },
+  {
+    cast_int32_t_int8_t,
+    cast_int32_t_int16_t,
+    cast_int32_t_int32_t,
+    cast_int32_t_int64_t,
+    cast_int32_t_uint8_t,
+    cast_int32_t_uint16_t,
+    cast_int32_t_uint32_t,
+    cast_int32_t_uint64_t,
+    cast_int32_t_float32_t,
+    cast_int32_t_float64_t
+  },
+  {
+    cast_int64_t_int8_t,
+    cast_int64_t_int16_t,
+    cast_int64_t_int32_t,
+    cast_int64_t_int64_t,
+    cast_int64_t_uint8_t,
+    cast_int64_t_uint16_t,
+    cast_int64_t_uint32_t,
+    cast_int64_t_uint64_t,
+    cast_int64_t_float32_t,
+    cast_int64_t_float64_t
+  },
+  {
+    cast_uint8_t_int8_t,
+    cast_uint8_t_int16_t,
+    cast_uint8_t_int32_t,
+    cast_uint8_t_int64_t,
+    cast_uint8_t_uint8_t,
+    cast_uint8_t_uint16_t,
+    cast_uint8_t_uint32_t,
+    cast_uint8_t_uint64_t,
+    cast_uint8_t_float32_t,
+    cast_uint8_t_float64_t
+  },
+  {
+    cast_uint16_t_int8_t,
+    cast_uint16_t_int16_t,
+    cast_uint16_t_int32_t,
+    cast_uint16_t_int64_t,
+    cast_uint16_t_uint8_t,
+    cast_uint16_t_uint16_t,
+    cast_uint16_t_uint32_t,
+    cast_uint16_t_uint64_t,
+    cast_uint16_t_float32_t,
+    cast_uint16_t_float64_t
+  },
+  {
+    cast_uint32_t_int8_t,
+    cast_uint32_t_int16_t,
+    cast_uint32_t_int32_t,
+    cast_uint32_t_int64_t,
+    cast_uint32_t_uint8_t,
+    cast_uint32_t_uint16_t,
+    cast_uint32_t_uint32_t,
+    cast_uint32_t_uint64_t,
+    cast_uint32_t_float32_t,
+    cast_uint32_t_float64_t
+  },
+  {
+    cast_uint64_t_int8_t,
+    cast_uint64_t_int16_t,
+    cast_uint64_t_int32_t,
+    cast_uint64_t_int64_t,
+    cast_uint64_t_uint8_t,
+    cast_uint64_t_uint16_t,
+    cast_uint64_t_uint32_t,
+    cast_uint64_t_uint64_t,
+    cast_uint64_t_float32_t,
+    cast_uint64_t_float64_t
+  },
+  {
+    cast_float32_t_int8_t,
+    cast_float32_t_int16_t,
+    cast_float32_t_int32_t,
+    cast_float32_t_int64_t,
+    cast_float32_t_uint8_t,
+    cast_float32_t_uint16_t,
+    cast_float32_t_uint32_t,
+    cast_float32_t_uint64_t,
+    cast_float32_t_float32_t,
+    cast_float32_t_float64_t
+  },
+  {
+    cast_float64_t_int8_t,
+    cast_float64_t_int16_t,
+    cast_float64_t_int32_t,
+    cast_float64_t_int64_t,
+    cast_float64_t_uint8_t,
+    cast_float64_t_uint16_t,
+    cast_float64_t_uint32_t,
+    cast_float64_t_uint64_t,
+    cast_float64_t_float32_t,
+    cast_float64_t_float64_t
+  }
+};
+
+/* Returns index of numeric type `type` of size `size` in the table of
+   cast kernels, or -1 if there is no kernel for this type. */
+static int kernel_index(DLiteType type, size_t size)
+{
+  switch (type) {
+  case dliteInt:
+  case dliteUInt:
+    switch (size) {
+    case 1: return (type == dliteInt) ? 0 : 4;
+    case 2: return (type == dliteInt) ? 1 : 5;
+    case 4: return (type == dliteInt) ? 2 : 6;
+    case 8: return (type == dliteInt) ? 3 : 7;
+    default: return -1;
+    }
+  case dliteFloat:
+    switch (size) {
+    case 4: return 8;
+    case 8: return 9;
+    default: return -1;
+    }
+  default:
+    return -1;
+  }
+}
+
+/*
+  Returns a kernel for casting a contiguous array of `src_type` to a
+  contiguous array of `dest_type`, or NULL if no such kernel exists.
+*/
+DLiteTypeCastKernel dlite_type_get_cast_kernel(DLiteType dest_type,
+                                               size_t dest_size,
+                                               DLiteType src_type,
+                                               size_t src_size)
+{
+  int di = kernel_index(dest_type, dest_size);
+  int si = kernel_index(src_type, src_size);
+  uint16_t one = 1;
+  if (di < 0 || si < 0) return NULL;
+
+  /* dlite_type_copy_cast() copies the bytes of unsigned integers,
+     which only corresponds to a conversion on little endian systems */
+  if (dest_type == dliteUInt && src_type == dliteUInt &&
+      dest_size != src_size && !*(uint8_t *)&one)
+    return NULL;
+
+  return cast_kernels[di][si];
+}
+
+
+/* Kernels parsing a contiguous array of string pointers to numbers.
+   Like dlite_type_copy_cast(), integers are parsed as long long and
+   truncated to the destination size. */
+#define PARSE_KERNEL(dtype, parse, check)                               \
+  static int parse_##dtype(void *dest, const void *src, size_t n)       \
+  {                                                                     \
+    dtype *d = dest;                                                    \
+    char * const *s = src;                                              \
+    char *endptr;                                                       \
+    size_t i;                                                           \
+    for (i=0; i<n; i++) {                                               \
+      const char *p = s[i];                                             \
+      if (!p || !*p) return 1;                                          \
+      { check; }                                                        \
+      d[i] = (dtype)parse;                                              \
+      if (*endptr) return 1;                                            \
+    }                                                                   \
+    return 0;                                                           \
+  }
+
+#define NOCHECK
+#define NONNEGATIVE                                                     \
+  while (isspace(*p)) p++;                                              \
+  if (*p == '-') return 1;
+
+PARSE_KERNEL(int8_t,    fast_strtoll(p, &endptr, 0), NOCHECK)
+PARSE_KERNEL(int16_t,   fast_strtoll(p, &endptr, 0), NOCHECK)
+PARSE_KERNEL(int32_t,   fast_strtoll(p, &endptr, 0), NOCHECK)
+PARSE_KERNEL(int64_t,   fast_strtoll(p, &endptr, 0), NOCHECK)
+PARSE_KERNEL(uint8_t,   fast_strtoll(p, &endptr, 0), NONNEGATIVE)
+PARSE_KERNEL(uint16_t,  fast_strtoll(p, &endptr, 0), NONNEGATIVE)
+PARSE_KERNEL(uint32_t,  fast_strtoll(p, &endptr, 0), NONNEGATIVE)
+PARSE_KERNEL(uint64_t,  fast_strtoll(p, &endptr, 0), NONNEGATIVE)
+PARSE_KERNEL(float32_t, fast_strtof(p, &endptr),     NOCHECK)
+PARSE_KERNEL(float64_t, fast_strtod(p, &endptr),     NOCHECK)
+
+/* Table of parse kernels indexed by destination, see kernel_index() */
+static const DLiteTypeCastKernel parse_kernels[10] = {
+  parse_int8_t, parse_int16_t, parse_int32_t, parse_int64_t,
+  parse_uint8_t, parse_uint16_t, parse_uint32_t, parse_uint64_t,
+  parse_float32_t, parse_float64_t
+};
+
+/*
+  Returns a kernel for parsing a contiguous array of string pointers
+  to a contiguous array of `dest_type`, or NULL if no such kernel exists.
+*/
+DLiteTypeCastKernel dlite_type_get_parse_kernel(DLiteType dest_type,
+                                                size_t dest_size)
+{
+  int di = kernel_index(dest_type, dest_size);
+  if (di < 0) return NULL;
+  return parse_kernels[di];
+}
@@ -21,5 +21,45 @@ int dlite_type_copy_cast(void *dest, DLiteType dest_type, size_t dest_size,
                          const void *src, DLiteType src_type, size_t src_size);
 
 
+/**
+  Function casting `n` contiguous elements from `src` to `dest`.
+  Returns non-zero if the array cannot be casted.
+*/
+typedef int (*DLiteTypeCastKernel)(void *dest, const void *src, size_t n);
+
+/**
+  Returns a kernel for casting a contiguous array of `src_type` to a
+  contiguous array of `dest_type`, or NULL if no such kernel exists.
+
+  Kernels exist for all combinations of int, uint and float types
+  supported by dlite_type_copy_cast(), except float80 and float128.
+  They give the same result as calling dlite_type_copy_cast() on each
+  element, but are much faster for large arrays.  A kernel returns
+  non-zero if it cannot cast the array, e.g. if a negative number
+  should be casted to an unsigned integer.  Cast element by element
+  in this case to get a proper error message.
+*/
+DLiteTypeCastKernel dlite_type_get_cast_kernel(DLiteType dest_type,
+                                               size_t dest_size,
+                                               DLiteType src_type,
+                                               size_t src_size);
+
+/**
+  Returns a kernel for parsing a contiguous array of string pointers
+  (dliteStringPtr) to a contiguous array of `dest_type`, or NULL if no
+  such kernel exists.
+
+  Kernels exist for the same int, uint and float types as for
+  dlite_type_get_cast_kernel().  They use the locale-independent
+  parsers in utils/floatfmt.h and give the same result as
+  dlite_type_copy_cast().  A kernel returns non-zero if any string is
+  NULL, empty, negative for unsigned destinations or not fully
+  consumed.  Cast element by element in this case to get a proper
+  error message.
+*/
+DLiteTypeCastKernel dlite_type_get_parse_kernel(DLiteType dest_type,
+                                                size_t dest_size);
+
+
 
 #endif /* _DLITE_TYPE_CAST_H */
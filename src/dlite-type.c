@@ -14,12 +14,16 @@
 #include "utils/floats.h"
 #include "utils/boolean.h"
 #include "utils/strtob.h"
+#include "utils/floatfmt.h"
 #include "utils/strutils.h"
 #include "utils/jsmnx.h"
+#include "utils/thread.h"
 
+#include "dlite-misc.h"
 #include "dlite-entity.h"
 #include "dlite-macros.h"
 #include "dlite-type.h"
+#include "dlite-arrays.h"
 
 
 /* Name DLite types */
@@ -35,6 +39,8 @@ static char *dtype_names[] = {
   "dimension",
   "property",
   "relation",
+
+  "struct",
 };
 
 /* Type enum names */
@@ -50,6 +56,8 @@ static char *dtype_enum_names[] = {
   "dliteDimension",
   "dliteProperty",
   "dliteRelation",
+
+  "dliteStruct",
 };
 
 /* Name of fix-sized types (does not include dliteBlob and dliteFixString) */
@@ -91,6 +99,8 @@ static struct _TypeDescr {
   {NULL,       0,              0,                     0}
 };
 
+static const DLiteStruct *struct_lookup(const char *name, size_t len);
+
 
 
 /*
@@ -98,6 +108,7 @@ static struct _TypeDescr {
 */
 const char *dlite_type_get_dtypename(DLiteType dtype)
 {
+  if (dlite_type_is_struct(dtype)) return dtype_names[dliteStruct];
   if (dtype < 0 || dtype >= sizeof(dtype_names) / sizeof(char *))
     return err(1, "invalid dtype number: %d", dtype), NULL;
   return dtype_names[dtype];
@@ -108,6 +119,7 @@ const char *dlite_type_get_dtypename(DLiteType dtype)
  */
 const char *dlite_type_get_enum_name(DLiteType dtype)
 {
+  if (dlite_type_is_struct(dtype)) return dtype_enum_names[dliteStruct];
   if (dtype < 0 || dtype >= sizeof(dtype_names) / sizeof(char *))
     return err(1, "invalid dtype number: %d", dtype), NULL;
   return dtype_enum_names[dtype];
@@ -169,7 +181,14 @@ int dlite_type_set_typename(DLiteType dtype, size_t size,
     snprintf(typename, n, "relation");
     break;
   default:
-    return errx(1, "unknown dtype number: %d", dtype);
+    {
+      const DLiteStruct *st = dlite_struct_get(dtype);
+      if (!st) return errx(1, "unknown dtype number: %d", dtype);
+      if (size != st->size)
+        return errx(1, "struct %s should have size %lu, but %lu was provided",
+                    st->name, (unsigned long)st->size, (unsigned long)size);
+      snprintf(typename, n, "%s", st->name);
+    }
   }
   return 0;
 }
@@ -216,7 +235,11 @@ int dlite_type_set_ftype(DLiteType dtype, size_t size,
     snprintf(ftype, n, "type(DLiteRelation)");
     break;
   default:
-    return errx(1, "unknown dtype number: %d", dtype);
+    {
+      const DLiteStruct *st = dlite_struct_get(dtype);
+      if (!st) return errx(1, "unknown dtype number: %d", dtype);
+      snprintf(ftype, n, "type(%s)", st->name);
+    }
   }
   return 0;
 }
@@ -313,7 +336,11 @@ int dlite_type_set_isoctype(DLiteType dtype, size_t size,
     snprintf(isoctype, n, "type(c_ptr)");
     break;
   default:
-    return errx(1, "unknown dtype number: %d", dtype);
+    {
+      const DLiteStruct *st = dlite_struct_get(dtype);
+      if (!st) return errx(1, "unknown dtype number: %d", dtype);
+      snprintf(isoctype, n, "type(%s)", st->name);
+    }
   }
   return 0;
 }
@@ -404,7 +431,11 @@ int dlite_type_set_cdecl(DLiteType dtype, size_t size, const char *name,
     m = snprintf(pcdecl, n, "DLiteRelation %s%s", ref, name);
     break;
   default:
-    return errx(-1, "unknown dtype number: %d", dtype);
+    {
+      const DLiteStruct *st = dlite_struct_get(dtype);
+      if (!st) return errx(-1, "unknown dtype number: %d", dtype);
+      m = snprintf(pcdecl, n, "struct %s %s%s", st->name, ref, name);
+    }
   }
   if (m < 0)
     return err(-1, "error writing C declaration for dtype %d", dtype);
@@ -434,7 +465,17 @@ int dlite_type_set_dtype_and_size(const char *typename,
   int i;
   size_t len=0, namelen, typesize;
   char *endptr;
+  const DLiteStruct *st;
+
+  /* Check for registered struct types */
+  while (isalnum(typename[len]) || typename[len] == '_') len++;
+  if ((st = struct_lookup(typename, len))) {
+    *dtype = st->dtype;
+    *size = st->size;
+    return 0;
+  }
 
+  len = 0;
   while (isalpha(typename[len])) len++;
   namelen = len;
   while (isdigit(typename[len])) len++;
@@ -489,7 +530,10 @@ int dlite_type_is_allocated(DLiteType dtype)
   case dliteProperty:
   case dliteRelation:
     return 1;
+  case dliteStruct:
+    break;
   }
+  if (dlite_type_is_struct(dtype)) return 0;
   abort();  /* should never be reached */
 }
 
@@ -510,6 +554,12 @@ void *dlite_type_copy(void *dest, const void *src, DLiteType dtype, size_t size)
   case dliteFixString:
     memcpy(dest, src, size);
     break;
+  default:
+    /* struct fields are not allocated */
+    if (!dlite_type_is_struct(dtype))
+      return errx(1, "unknown dtype number: %d", dtype), NULL;
+    memcpy(dest, src, size);
+    break;
   case dliteStringPtr:
     {
       char *s = *((char **)src);
@@ -551,6 +601,7 @@ void *dlite_type_copy(void *dest, const void *src, DLiteType dtype, size_t size)
         d->dims = NULL;
       }
       d->unit = (s->unit) ? strdup(s->unit) : NULL;
+      d->iri = (s->iri) ? strdup(s->iri) : NULL;
       d->description = (s->description) ? strdup(s->description) : NULL;
     }
     break;
@@ -583,6 +634,7 @@ void *dlite_type_clear(void *p, DLiteType dtype, size_t size)
   case dliteUInt:
   case dliteFloat:
   case dliteFixString:
+  default:
     break;
   case dliteStringPtr:
     free(*((char **)p));
@@ -601,6 +653,7 @@ void *dlite_type_clear(void *p, DLiteType dtype, size_t size)
       free(((DLiteProperty *)p)->dims);
     }
     if (((DLiteProperty *)p)->unit) free(((DLiteProperty *)p)->unit);
+    if (((DLiteProperty *)p)->iri) free(((DLiteProperty *)p)->iri);
     if (((DLiteProperty *)p)->description)
       free(((DLiteProperty *)p)->description);
     break;
@@ -642,6 +695,9 @@ static StrquoteFlags as_qflags(DLiteTypeFlag flags)
   suitable value will selected according to `type`.  To ignore their
   effect, set `width` to zero or `prec` to -2.
 
+  For float32 and float64, `prec` -2 writes the shortest representation
+  that reads back to exactly the same value.
+
   Returns number of bytes written to `dest`.  If the output is
   truncated because it exceeds `n`, the number of bytes that would
   have been written if `n` was large enough is returned.  On error, a
@@ -718,6 +774,19 @@ int dlite_type_print(char *dest, size_t n, const void *p, DLiteType dtype,
   case dliteFloat:
     if (w == -1) w = 12;
     if (r == -1) r = 6;
+    if (r == -2 && (size == 4 || size == 8)) {
+      /* Shortest representation that round-trips */
+      char buf[FMTFLOAT_BUFSIZE];
+      int len = (size == 4) ? fmtfloat(buf, *((float32_t *)p)) :
+        fmtdouble(buf, *((float64_t *)p));
+      if (w > len || (size_t)len >= n) {
+        m = snprintf(dest, n, "%*s", w, buf);
+      } else {
+        memcpy(dest, buf, len + 1);
+        m = len;
+      }
+      break;
+    }
     switch (size) {
     case 4:  m = snprintf(dest, n, "%*.*g",  w, r, *((float32_t *)p)); break;
     case 8:  m = snprintf(dest, n, "%*.*g",  w, r, *((float64_t *)p)); break;
@@ -803,6 +872,26 @@ int dlite_type_print(char *dest, size_t n, const void *p, DLiteType dtype,
       m += snprintf(dest+m, PDIFF(n, m), "]");
     }
     break;
+
+  default:
+    {
+      const DLiteStruct *st = dlite_struct_get(dtype);
+      if (!st) return errx(-1, "unknown dtype number: %d", dtype);
+      m = snprintf(dest, n, "{");
+      for (i=0; i < st->nfields && m >= 0; i++) {
+        const DLiteStructField *f = st->fields + i;
+        int v;
+        m += snprintf(dest+m, PDIFF(n, m), "%s\"%s\": ",
+                      (i) ? ", " : "", f->name);
+        if ((v = dlite_type_print(dest+m, PDIFF(n, m), (char *)p + f->offset,
+                                  f->type, f->size, 0, -2,
+                                  dliteFlagQuoted)) < 0)
+          return v;
+        m += v;
+      }
+      m += snprintf(dest+m, PDIFF(n, m), "}");
+    }
+    break;
   }
   if (m < 0) {
     char buf[32];
@@ -868,6 +957,8 @@ int dlite_type_scan(const char *src, int len, void *p, DLiteType dtype,
 {
   size_t i;
   int m=0, v;
+  long long vi;
+  unsigned long long vu;
   char *endptr;
   StrquoteFlags qflags = as_qflags(flags);
   switch(dtype) {
@@ -899,65 +990,49 @@ int dlite_type_scan(const char *src, int len, void *p, DLiteType dtype,
     break;
 
   case dliteInt:
-    errno = 0;
+    /* like sscanf(), out of range values are silently truncated */
+    vi = fast_strtoll(src, &endptr, 0);
+    if (endptr == src) return err(-1, "invalid int: '%s'", src);
     switch (size) {
-#ifdef HAVE_INTTYPES_H
-    case 1: v = sscanf(src, "%"SCNi8"%n",  ((int8_t  *)p), &m); break;
-    case 2: v = sscanf(src, "%"SCNi16"%n", ((int16_t *)p), &m); break;
-    case 4: v = sscanf(src, "%"SCNi32"%n", ((int32_t *)p), &m); break;
-    case 8: v = sscanf(src, "%"SCNi64"%n", ((int64_t *)p), &m); break;
-#else
-    case 1: v = sscanf(src, "%hhi%n", ((int8_t  *)p), &m); break;
-    case 2: v = sscanf(src, "%hi%n",  ((int16_t *)p), &m); break;
-    case 4: v = sscanf(src, "%i%n",   ((int32_t *)p), &m); break;
-    case 8: v = sscanf(src, "%lli%n", ((int64_t *)p), &m); break;
-#endif
+    case 1: *((int8_t  *)p) = (int8_t)vi;  break;
+    case 2: *((int16_t *)p) = (int16_t)vi; break;
+    case 4: *((int32_t *)p) = (int32_t)vi; break;
+    case 8: *((int64_t *)p) = (int64_t)vi; break;
     default: return err(-1, "invalid int size: %lu", (unsigned long)size);
     }
-    if (v != 1) return err(-1, "invalid int: '%s'", src);
+    m = endptr - src;
     break;
 
   case dliteUInt:
-    v = 0;
-    while (isblank(src[v])) m++;
-    if (src[v] == '0' && (src[v+1] == 'x' || src[v+1] == 'X')) {
-      switch (size) {
-#ifdef HAVE_INTTYPES_H
-      case 1: v = sscanf(src, "%"SCNx8"%n",  ((uint8_t  *)p), &m); break;
-      case 2: v = sscanf(src, "%"SCNx16"%n", ((uint16_t *)p), &m); break;
-      case 4: v = sscanf(src, "%"SCNx32"%n", ((uint32_t *)p), &m); break;
-      case 8: v = sscanf(src, "%"SCNx64"%n", ((uint64_t *)p), &m); break;
-#else
-      case 1: v = sscanf(src, "%hhx%n", ((uint8_t  *)p), &m); break;
-      case 2: v = sscanf(src, "%hx%n",  ((uint16_t *)p), &m); break;
-      case 4: v = sscanf(src, "%x%n",   ((uint32_t *)p), &m); break;
-      case 8: v = sscanf(src, "%llx%n", ((uint64_t *)p), &m); break;
-#endif
-      default: return err(-1, "invalid int size: %lu", (unsigned long)size);
-      }
-    } else {
-      switch (size) {
-#ifdef HAVE_INTTYPES_H
-      case 1: v = sscanf(src, "%"SCNu8"%n",  ((uint8_t  *)p), &m); break;
-      case 2: v = sscanf(src, "%"SCNu16"%n", ((uint16_t *)p), &m); break;
-      case 4: v = sscanf(src, "%"SCNu32"%n", ((uint32_t *)p), &m); break;
-      case 8: v = sscanf(src, "%"SCNu64"%n", ((uint64_t *)p), &m); break;
-#else
-      case 1: v = sscanf(src, "%hhu%n", ((uint8_t  *)p), &m); break;
-      case 2: v = sscanf(src, "%hu%n",  ((uint16_t *)p), &m); break;
-      case 4: v = sscanf(src, "%u%n",   ((uint32_t *)p), &m); break;
-      case 8: v = sscanf(src, "%llu%n", ((uint64_t *)p), &m); break;
-#endif
-      default: return err(-1, "invalid uint size: %lu", (unsigned long)size);
-      }
+    /* hexadecimal if prefixed with 0x, otherwise decimal */
+    for (m=0; isspace(src[m]); m++) ;
+    if (src[m] == '+' || src[m] == '-') m++;
+    vu = fast_strtoull(src, &endptr,
+                       (src[m] == '0' && (src[m+1] == 'x' ||
+                                          src[m+1] == 'X')) ? 16 : 10);
+    if (endptr == src) return err(-1, "invalid uint: '%s'", src);
+    switch (size) {
+    case 1: *((uint8_t  *)p) = (uint8_t)vu;  break;
+    case 2: *((uint16_t *)p) = (uint16_t)vu; break;
+    case 4: *((uint32_t *)p) = (uint32_t)vu; break;
+    case 8: *((uint64_t *)p) = (uint64_t)vu; break;
+    default: return err(-1, "invalid uint size: %lu", (unsigned long)size);
     }
-    if (v != 1) return err(-1, "invalid uint: '%s'", src);
+    m = endptr - src;
     break;
 
   case dliteFloat:
     switch (size) {
-    case 4:  v = sscanf(src, "%f%n",  ((float32_t *)p), &m); break;
-    case 8:  v = sscanf(src, "%lf%n", ((float64_t *)p), &m); break;
+    case 4:
+      *((float32_t *)p) = fast_strtof(src, &endptr);
+      m = endptr - src;
+      v = (m > 0);
+      break;
+    case 8:
+      *((float64_t *)p) = fast_strtod(src, &endptr);
+      m = endptr - src;
+      v = (m > 0);
+      break;
 #ifdef HAVE_FLOAT80
     case 10: v = sscanf(src, "%Lf%n", ((float80_t *)p), &m); break;
 #endif
@@ -1008,7 +1083,8 @@ int dlite_type_scan(const char *src, int len, void *p, DLiteType dtype,
 
       if (len < 0) len = strlen(src);
       jsmn_init(&parser);
-      if ((r = jsmn_parse(&parser, src, len, tokens,MAX_DIMENSION_TOKENS)) < 0)
+      if ((r = jsmn_parse_fast(&parser, src, len, tokens,
+                               MAX_DIMENSION_TOKENS)) < 0)
         return err(-1, "cannot parse dimension: %s: '%s'",
                    jsmn_strerror(r), src);
       if (tokens->type != JSMN_OBJECT)
@@ -1034,12 +1110,14 @@ int dlite_type_scan(const char *src, int len, void *p, DLiteType dtype,
       if (prop->name) free(prop->name);
       if (prop->dims) free(prop->dims);
       if (prop->unit) free(prop->unit);
+      if (prop->iri) free(prop->iri);
       if (prop->description) free(prop->description);
       memset(prop, 0, sizeof(DLiteProperty));
 
       if (len < 0) len = strlen(src);
       jsmn_init(&parser);
-      if ((r = jsmn_parse(&parser, src, len, tokens, MAX_PROPERTY_TOKENS)) < 0)
+      if ((r = jsmn_parse_fast(&parser, src, len, tokens,
+                               MAX_PROPERTY_TOKENS)) < 0)
         return err(-1, "cannot parse property: %s: '%s'",
                    jsmn_strerror(r), src);
       if (tokens->type != JSMN_OBJECT)
@@ -1072,6 +1150,9 @@ int dlite_type_scan(const char *src, int len, void *p, DLiteType dtype,
       if ((t = jsmn_item(src, tokens, "unit")))
         prop->unit = strndup(src + t->start, t->end - t->start);
 
+      if ((t = jsmn_item(src, tokens, "iri")))
+        prop->iri = strndup(src + t->start, t->end - t->start);
+
       if ((t = jsmn_item(src, tokens, "description")))
         prop->description = strndup(src + t->start, t->end - t->start);
     }
@@ -1093,7 +1174,8 @@ int dlite_type_scan(const char *src, int len, void *p, DLiteType dtype,
 
       if (len < 0) len = strlen(src);
       jsmn_init(&parser);
-      if ((r = jsmn_parse(&parser, src, len, tokens, MAX_RELATION_TOKENS)) < 0)
+      if ((r = jsmn_parse_fast(&parser, src, len, tokens,
+                               MAX_RELATION_TOKENS)) < 0)
         return err(-1, "cannot parse relation: %s: '%s'",
                    jsmn_strerror(r), src);
       if (tokens->size < 3 || tokens->size > 4)
@@ -1122,6 +1204,45 @@ int dlite_type_scan(const char *src, int len, void *p, DLiteType dtype,
       }
     }
     break;
+
+  default:
+    {
+      const DLiteStruct *st = dlite_struct_get(dtype);
+      jsmn_parser parser;
+      jsmntok_t *tokens=NULL;
+      const jsmntok_t *t;
+      unsigned int ntokens=0;
+      int r;
+
+      if (!st) return errx(-1, "unknown dtype number: %d", dtype);
+      if (len < 0) len = strlen(src);
+      jsmn_init(&parser);
+      if ((r = jsmn_parse_alloc(&parser, src, len, &tokens, &ntokens)) < 0)
+        return err(-1, "cannot parse struct %s: %s: '%.*s'",
+                   st->name, jsmn_strerror(r), len, src);
+      if (tokens->type != JSMN_OBJECT) {
+        free(tokens);
+        return errx(-1, "struct %s should be a JSON object", st->name);
+      }
+      m = tokens->end;
+      for (i=0; i < st->nfields; i++) {
+        const DLiteStructField *f = st->fields + i;
+        if (!(t = jsmn_item(src, tokens, f->name))) {
+          free(tokens);
+          return errx(-1, "missing field \"%s\" in struct %s: '%.*s'",
+                      f->name, st->name, len, src);
+        }
+        if (dlite_type_scan(src + t->start, t->end - t->start,
+                            (char *)p + f->offset, f->type, f->size,
+                            dliteFlagDefault) < 0) {
+          free(tokens);
+          return err(-1, "cannot scan field \"%s\" of struct %s",
+                     f->name, st->name);
+        }
+      }
+      free(tokens);
+    }
+    break;
   }
   return m;
 }
@@ -1141,10 +1262,14 @@ size_t dlite_type_get_alignment(DLiteType dtype, size_t size)
   switch (dtype) {
   case dliteBlob:       return 1;
   case dliteFixString:  return 1;
-  default:              return err(1, "cannot determine alignment of "
-                                   "dtype='%s' (%d), size=%lu",
-                                   dlite_type_get_dtypename(dtype), dtype,
-                                   (unsigned long)size), 0;
+  default:
+    {
+      const DLiteStruct *st = dlite_struct_get(dtype);
+      if (st && st->size == size) return st->alignment;
+    }
+    return err(1, "cannot determine alignment of dtype='%s' (%d), size=%lu",
+               dlite_type_get_dtypename(dtype), dtype,
+               (unsigned long)size), 0;
   }
 }
 
@@ -1178,6 +1303,298 @@ int dlite_type_get_member_offset(size_t prev_offset, size_t prev_size,
 }
 
 
+/********************************************************************
+ * Struct types
+ ********************************************************************/
+
+#define STRUCT_GLOBALS_ID "dlite-struct-id"
+
+/* Registry of struct types.  It is stored in the global state, such
+   that all plugins see the same struct types and dtype numbers. */
+typedef struct {
+  ThreadRWLock lock;     /* protects the fields below */
+  size_t n;              /* number of registered struct types */
+  size_t size;           /* allocated size of `structs` */
+  DLiteStruct **structs; /* struct type with dtype dliteStruct+i */
+} StructRegistry;
+
+static ThreadMutex _struct_registry_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees a struct type */
+static void struct_free(DLiteStruct *st)
+{
+  size_t i;
+  for (i=0; i < st->nfields; i++)
+    if (st->fields[i].name) free(st->fields[i].name);
+  if (st->fields) free(st->fields);
+  if (st->name) free(st->name);
+  free(st);
+}
+
+/* Frees the struct registry */
+static void free_struct_registry(void *registry)
+{
+  StructRegistry *r = registry;
+  size_t i;
+  for (i=0; i < r->n; i++) struct_free(r->structs[i]);
+  if (r->structs) free(r->structs);
+  thread_rwlock_destroy(&r->lock);
+  free(r);
+}
+
+/* Returns the struct registry, creating it if `create` is non-zero.
+   Returns NULL if it doesn't exists and `create` is zero. */
+static StructRegistry *get_struct_registry(int create)
+{
+  StructRegistry *r = dlite_globals_get_state(STRUCT_GLOBALS_ID);
+  if (r || !create) return r;
+  thread_mutex_lock(&_struct_registry_mutex);
+  if (!(r = dlite_globals_get_state(STRUCT_GLOBALS_ID))) {
+    if ((r = calloc(1, sizeof(StructRegistry)))) {
+      thread_rwlock_init(&r->lock);
+      dlite_globals_add_state(STRUCT_GLOBALS_ID, r, free_struct_registry);
+    } else {
+      err(1, "allocation failure");
+    }
+  }
+  thread_mutex_unlock(&_struct_registry_mutex);
+  return r;
+}
+
+/* Returns the struct type whose name is the first `len` characters of
+   `name` or NULL if there is no such struct type. */
+static const DLiteStruct *struct_lookup(const char *name, size_t len)
+{
+  StructRegistry *r;
+  const DLiteStruct *st=NULL;
+  size_t i;
+  if (!len || !(r = get_struct_registry(0))) return NULL;
+  thread_rwlock_rdlock(&r->lock);
+  for (i=0; i < r->n; i++) {
+    if (strncmp(r->structs[i]->name, name, len) == 0 &&
+        r->structs[i]->name[len] == '\0') {
+      st = r->structs[i];
+      break;
+    }
+  }
+  thread_rwlock_rdunlock(&r->lock);
+  return st;
+}
+
+/* Returns non-zero if `name` is a valid identifier. */
+static int is_identifier(const char *name)
+{
+  const char *c = name;
+  if (!isalpha(*c) && *c != '_') return 0;
+  while (isalnum(*c) || *c == '_') c++;
+  return *c == '\0';
+}
+
+/*
+  Registers a struct type called `name` with the `nfields` fields in
+  `fields`.  The `offset` of the fields are ignored.  They are assigned
+  like the C compiler lays out a struct with the same members.
+
+  Returns the dtype of the new struct type or -1 on error.
+ */
+DLiteType dlite_struct_register(const char *name, size_t nfields,
+                                const DLiteStructField *fields)
+{
+  StructRegistry *r;
+  DLiteStruct *st=NULL;
+  const DLiteStruct *old;
+  DLiteType dtype=-1;
+  size_t i, j, offset=0, size=0, align, maxalign=1;
+  int locked=0;
+
+  if (!is_identifier(name))
+    FAIL1("struct type name must be an identifier: '%s'", name);
+  if (strlen(name) >= DLITE_STRUCT_NAME_SIZE)
+    FAIL2("struct type name must be shorter than %d characters: '%s'",
+          DLITE_STRUCT_NAME_SIZE, name);
+  if (!nfields) FAIL1("struct type %s must have at least one field", name);
+
+  /* Check for an existing type with the same name */
+  if ((old = struct_lookup(name, strlen(name)))) {
+    if (old->nfields != nfields) goto redefined;
+    for (i=0; i < nfields; i++)
+      if (strcmp(old->fields[i].name, fields[i].name) ||
+          old->fields[i].type != fields[i].type ||
+          old->fields[i].size != fields[i].size) goto redefined;
+    return old->dtype;
+  }
+  for (i=0; type_table[i].typename; i++)
+    if (strcmp(name, type_table[i].typename) == 0)
+      FAIL1("cannot register struct with the name of a basic type: %s", name);
+  for (i=0; i < sizeof(dtype_names) / sizeof(char *); i++)
+    if (strcmp(name, dtype_names[i]) == 0)
+      FAIL1("cannot register struct with the name of a basic type: %s", name);
+  if ((strncmp(name, "blob", 4) == 0 && isdigit(name[4])) ||
+      (strncmp(name, "string", 6) == 0 && isdigit(name[6])))
+    FAIL1("cannot register struct with the name of a basic type: %s", name);
+
+  if (!(st = calloc(1, sizeof(DLiteStruct)))) FAIL("allocation failure");
+  if (!(st->name = strdup(name))) FAIL("allocation failure");
+  if (!(st->fields = calloc(nfields, sizeof(DLiteStructField))))
+    FAIL("allocation failure");
+
+  /* Lay out the fields */
+  for (i=0; i < nfields; i++) {
+    const DLiteStructField *f = fields + i;
+    DLiteStructField *g = st->fields + i;
+    int off;
+    if (!is_identifier(f->name))
+      FAIL2("invalid name of field %d in struct %s", (int)i, name);
+    for (j=0; j<i; j++)
+      if (strcmp(f->name, fields[j].name) == 0)
+        FAIL2("duplicated field \"%s\" in struct %s", f->name, name);
+    switch (f->type) {
+    case dliteBlob:
+    case dliteBool:
+    case dliteInt:
+    case dliteUInt:
+    case dliteFloat:
+    case dliteFixString:
+      break;
+    default:
+      if (!dlite_type_is_struct(f->type))
+        FAIL3("field \"%s\" of struct %s has unsupported type: %s", f->name,
+              name, dlite_type_get_dtypename(f->type));
+    }
+    if (!(align = dlite_type_get_alignment(f->type, f->size))) goto fail;
+    if ((off = dlite_type_get_member_offset(offset, size, f->type,
+                                            f->size)) < 0) goto fail;
+    if (!(g->name = strdup(f->name))) FAIL("allocation failure");
+    g->type = f->type;
+    g->size = f->size;
+    g->offset = offset = off;
+    size = f->size;
+    if (align > maxalign) maxalign = align;
+  }
+  st->nfields = nfields;
+  st->alignment = maxalign;
+  size += offset;
+  st->size = size + ((maxalign - (size & (maxalign - 1))) & (maxalign - 1));
+
+  /* Add to registry */
+  if (!(r = get_struct_registry(1))) goto fail;
+  thread_rwlock_wrlock(&r->lock);
+  locked = 1;
+  for (i=0; i < r->n; i++)
+    if (strcmp(r->structs[i]->name, name) == 0)
+      FAIL1("struct type %s is concurrently registered", name);
+  if (r->n >= r->size) {
+    size_t newsize = (r->size) ? 2*r->size : 16;
+    DLiteStruct **p = realloc(r->structs, newsize*sizeof(DLiteStruct *));
+    if (!p) FAIL("allocation failure");
+    r->structs = p;
+    r->size = newsize;
+  }
+  st->dtype = dtype = dliteStruct + r->n;
+  r->structs[r->n++] = st;
+  st = NULL;
+ fail:
+  if (locked) thread_rwlock_wrunlock(&r->lock);
+  if (st) struct_free(st);
+  return dtype;
+ redefined:
+  return errx(-1, "struct type %s is already registered with other fields",
+              name);
+}
+
+/*
+  Returns true if `dtype` is a registered struct type.
+ */
+bool dlite_type_is_struct(DLiteType dtype)
+{
+  return dlite_struct_get(dtype) ? true : false;
+}
+
+/*
+  Returns the struct type with dtype `dtype` or NULL if `dtype` is not
+  a registered struct type.
+ */
+const DLiteStruct *dlite_struct_get(DLiteType dtype)
+{
+  StructRegistry *r;
+  const DLiteStruct *st=NULL;
+  if ((int)dtype < (int)dliteStruct || !(r = get_struct_registry(0)))
+    return NULL;
+  thread_rwlock_rdlock(&r->lock);
+  if ((size_t)(dtype - dliteStruct) < r->n) st = r->structs[dtype-dliteStruct];
+  thread_rwlock_rdunlock(&r->lock);
+  return st;
+}
+
+/*
+  Returns the struct type registered as `name` or NULL if there is no
+  such struct type.
+ */
+const DLiteStruct *dlite_struct_get_by_name(const char *name)
+{
+  return struct_lookup(name, strlen(name));
+}
+
+
+/* Returns non-zero if an array with given dimensions and strides is
+   C-contiguous.  Strides of dimensions of length one are ignored. */
+static int iscontiguous(int ndims, const size_t *dims, const int *strides,
+                        size_t size)
+{
+  int i;
+  size_t stride = size;
+  for (i=ndims-1; i>=0; i--) {
+    if (dims[i] != 1 && strides[i] != (int)stride) return 0;
+    stride *= dims[i];
+  }
+  return 1;
+}
+
+
+/* Copies the elements of `src` to `dest` bitwise, using
+   dlite_array_copy_strided().  The elements are visited in C order of
+   `src_dims` and `dest_dims`, respectively.  Returns zero on success,
+   a negative number on error and a positive number if the layouts
+   cannot be handled, which is when the dimensions differ and neither
+   array is contiguous. */
+static int ndcopy(int ndims,
+                  void *dest, const size_t *dest_dims, const int *dest_strides,
+                  const void *src, const size_t *src_dims,
+                  const int *src_strides, size_t size)
+{
+  int i, stat, *strides;
+  const size_t *dims=src_dims;
+  size_t stride=size;
+
+  for (i=0; i<ndims; i++)
+    if (dest_dims[i] != src_dims[i]) break;
+  if (i == ndims)
+    return (dlite_array_copy_strided(ndims, src_dims, size, dest,
+                                     dest_strides, src, src_strides)) ? -1 : 0;
+
+  /* Different dimensions.  Describe the contiguous array with the
+     dimensions of the other array. */
+  if (iscontiguous(ndims, src_dims, src_strides, size))
+    dims = dest_dims;
+  else if (!iscontiguous(ndims, dest_dims, dest_strides, size))
+    return 1;
+  if (!(strides = malloc(ndims * sizeof(int))))
+    return err(-1, "allocation failure");
+  for (i=ndims-1; i>=0; i--) {
+    strides[i] = stride;
+    stride *= dims[i];
+  }
+  if (dims == dest_dims)
+    stat = dlite_array_copy_strided(ndims, dims, size, dest, dest_strides,
+                                    src, strides);
+  else
+    stat = dlite_array_copy_strided(ndims, dims, size, dest, strides,
+                                    src, src_strides);
+  free(strides);
+  return (stat) ? -1 : 0;
+}
+
+
 /*
   Copies n-dimensional array `src` to `dest` by calling `castfun` on
   each element.  `dest` must have sufficient size to hold the result.
@@ -1219,9 +1636,10 @@ int dlite_type_ndcast(int ndims,
                       const size_t *src_dims, const int *src_strides,
                       DLiteTypeCast castfun)
 {
-  int i, retval=1, samelayout=1, *sstrides=NULL, *dstrides=NULL;
+  int i, retval=1, samelayout=1, stat, *sstrides=NULL, *dstrides=NULL;
   size_t *sidx=NULL, *didx=NULL;
   size_t j, n, N=1;
+  DLiteTypeCastKernel kernel;
 
   assert(src);
   assert(dest);
@@ -1274,23 +1692,34 @@ int dlite_type_ndcast(int ndims,
         break;
       }
   }
-  if (samelayout) {
-    /* -- check that source is contiguous */
-    int size = src_size;
-    for (i=0; i<ndims; i++) {
-      int iscont=0;
-      for (j=0; j < src_dims[j]; j++)
-        if (src_strides[j] == size) { iscont = 1; break; }
-      if (!iscont) { samelayout = 0; break; }
-      size *= src_dims[i];
-    }
-  }
+  if (samelayout && !iscontiguous(ndims, src_dims, src_strides, src_size))
+    samelayout = 0;
 
   if (samelayout) {
     /* Special case: if source and dest have same layout and are
        contiguous, copy all data in one chunck */
     memcpy(dest, src, N * src_size);
 
+  } else if (castfun == dlite_type_copy_cast && N > 0 &&
+             iscontiguous(ndims, src_dims, src_strides, src_size) &&
+             iscontiguous(ndims, dest_dims, dest_strides, dest_size) &&
+             (kernel = (src_type == dliteStringPtr) ?
+              dlite_type_get_parse_kernel(dest_type, dest_size) :
+              dlite_type_get_cast_kernel(dest_type, dest_size,
+                                         src_type, src_size)) &&
+             kernel(dest, src, N) == 0) {
+    /* Special case: numeric or string source and numeric dest are
+       contiguous, cast or parse all elements with a kernel */
+
+  } else if (castfun == dlite_type_copy_cast && dest_type == src_type &&
+             dest_size == src_size &&
+             (src_type == dliteBlob || src_type == dliteInt ||
+              src_type == dliteUInt || src_type == dliteFloat) &&
+             (stat = ndcopy(ndims, dest, dest_dims, dest_strides,
+                            src, src_dims, src_strides, src_size)) <= 0) {
+    /* Special case: same type, copy elements bitwise with strided copy */
+    if (stat) goto fail;
+
   } else {
     /* General case: copy all elements individually using castfun()
 
@@ -26,6 +26,7 @@
   fixstring | dliteFixString | any                    | char *                        | fix-sized NUL-terminated string  | string20
   string    | dliteStringPtr | sizeof(char *)         | char **                       | pointer to NUL-terminated string | string
   relation  | dliteRelation  | sizeof(DLiteRelation)  | DLiteRelation *               | subject-predicate-object triple  | relation
+  struct    | dliteStruct+n  | registered size        | void *                        | compound of fixed-sized fields   | (registered name)
   dimension | dliteDimension | sizeof(DLiteDimension) | DLiteDimension *              | only intended for metadata       | dimension
   property  | dliteProperty  | sizeof(DLiteProperty)  | DLiteProperty *               | only intended for metadata       | property
 
@@ -64,6 +65,13 @@
       for metadata.
     - *property*: Name and full description of a property.  Only intended
       for metadata.
+    - *struct*: A record of named fields, each of a non-allocated type
+      (blob, bool, int, uint, float, fixstring or another struct),
+      laid out like the corresponding C struct.  Struct types must be
+      registered with dlite_struct_register() before use.  The type
+      name is the registered name and the dtype is `dliteStruct + n`,
+      where `n` is the registration number.  Use dlite_type_is_struct()
+      to test for struct types.
 */
 
 #include <stdlib.h>
@@ -84,6 +92,7 @@
 typedef struct _DLiteProperty  DLiteProperty;
 typedef struct _DLiteDimension DLiteDimension;
 typedef struct _Triple         DLiteRelation;
+typedef struct _DLiteStruct    DLiteStruct;
 
 
 /** Basic data types */
@@ -98,10 +107,35 @@ typedef enum _DLiteType {
 
   dliteDimension,        /*!< Dimension, for entities */
   dliteProperty,         /*!< Property, for entities */
-  dliteRelation          /*!< Subject-predicate-object relation */
+  dliteRelation,         /*!< Subject-predicate-object relation */
+
+  dliteStruct            /*!< First registered struct type */
 } DLiteType;
 
 
+/** Max length of struct type names, including the terminating NUL.
+    Type names are commonly written to buffers of this size. */
+#define DLITE_STRUCT_NAME_SIZE 32
+
+/** Field of a struct type */
+typedef struct _DLiteStructField {
+  char *name;            /*!< Field name */
+  DLiteType type;        /*!< Field type */
+  size_t size;           /*!< Field size */
+  size_t offset;         /*!< Offset of the field, assigned on registration */
+} DLiteStructField;
+
+/** A registered struct type */
+struct _DLiteStruct {
+  char *name;                /*!< Type name */
+  DLiteType dtype;           /*!< Type number, `dliteStruct + n` */
+  size_t size;               /*!< Size including trailing padding */
+  size_t alignment;          /*!< Alignment of the struct */
+  size_t nfields;            /*!< Number of fields */
+  DLiteStructField *fields;  /*!< Array of fields */
+};
+
+
 /** Some flags for printing or scanning dlite types */
 typedef enum _DLiteTypeFlag {
   dliteFlagDefault = 0,  /*!< Default */
@@ -228,6 +262,9 @@ void *dlite_type_clear(void *p, DLiteType dtype, size_t size);
   suitable value will selected according to `type`.  To ignore their
   effect, set `width` to zero or `prec` to -2.
 
+  For float32 and float64, `prec` -2 writes the shortest representation
+  that reads back to exactly the same value.
+
   Returns number of bytes written to `dest`.  If the output is
   truncated because it exceeds `n`, the number of bytes that would
   have been written if `n` was large enough is returned.  On error, a
@@ -287,6 +324,41 @@ int dlite_type_get_member_offset(size_t prev_offset, size_t prev_size,
                                  DLiteType dtype, size_t size);
 
 
+/**
+  Registers a struct type called `name` with the `nfields` fields in
+  `fields`.  The `offset` of the fields are ignored.  They are assigned
+  like the C compiler lays out a struct with the same members.
+
+  `name` must be an identifier that is not already a type name and
+  shorter than DLITE_STRUCT_NAME_SIZE.
+  Registering the same name again with identical fields is a no-op.
+
+  The registry is shared by all plugins and lives until the process
+  exits.
+
+  Returns the dtype of the new struct type or -1 on error.
+ */
+DLiteType dlite_struct_register(const char *name, size_t nfields,
+                                const DLiteStructField *fields);
+
+/**
+  Returns true if `dtype` is a registered struct type.
+ */
+bool dlite_type_is_struct(DLiteType dtype);
+
+/**
+  Returns the struct type with dtype `dtype` or NULL if `dtype` is not
+  a registered struct type.
+ */
+const DLiteStruct *dlite_struct_get(DLiteType dtype);
+
+/**
+  Returns the struct type registered as `name` or NULL if there is no
+  such struct type.
+ */
+const DLiteStruct *dlite_struct_get_by_name(const char *name);
+
+
 /**
   Copies n-dimensional array `src` to `dest` by calling `castfun` on
   each element.  `dest` must have sufficient size to hold the result.
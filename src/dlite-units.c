@@ -0,0 +1,489 @@
+/* dlite-units.c -- unit parsing and conversion
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/thread.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-arrays.h"
+#include "dlite-units.h"
+
+#define GLOBALS_ID "dlite-units-cache"
+
+/* Maximum nesting of parentheses */
+#define MAX_DEPTH 8
+
+
+/* A known unit symbol */
+typedef struct {
+  const char *symbol;
+  double scale;
+  double offset;
+  signed char dims[DLITE_UNIT_NDIMS];   /* m, kg, s, A, K, mol, cd */
+  int prefixable;                       /* whether SI prefixes are allowed */
+} UnitDef;
+
+/* A SI prefix */
+typedef struct {
+  const char *symbol;
+  double scale;
+} PrefixDef;
+
+static const UnitDef units[] = {
+  /* base units, the kilogram is handled via the gram */
+  {"m",     1.0,          0.0, { 1, 0, 0, 0, 0, 0, 0}, 1},
+  {"g",     1e-3,         0.0, { 0, 1, 0, 0, 0, 0, 0}, 1},
+  {"s",     1.0,          0.0, { 0, 0, 1, 0, 0, 0, 0}, 1},
+  {"A",     1.0,          0.0, { 0, 0, 0, 1, 0, 0, 0}, 1},
+  {"K",     1.0,          0.0, { 0, 0, 0, 0, 1, 0, 0}, 1},
+  {"mol",   1.0,          0.0, { 0, 0, 0, 0, 0, 1, 0}, 1},
+  {"cd",    1.0,          0.0, { 0, 0, 0, 0, 0, 0, 1}, 1},
+
+  /* derived SI units */
+  {"Hz",    1.0,          0.0, { 0, 0,-1, 0, 0, 0, 0}, 1},
+  {"N",     1.0,          0.0, { 1, 1,-2, 0, 0, 0, 0}, 1},
+  {"Pa",    1.0,          0.0, {-1, 1,-2, 0, 0, 0, 0}, 1},
+  {"J",     1.0,          0.0, { 2, 1,-2, 0, 0, 0, 0}, 1},
+  {"W",     1.0,          0.0, { 2, 1,-3, 0, 0, 0, 0}, 1},
+  {"C",     1.0,          0.0, { 0, 0, 1, 1, 0, 0, 0}, 1},
+  {"V",     1.0,          0.0, { 2, 1,-3,-1, 0, 0, 0}, 1},
+  {"F",     1.0,          0.0, {-2,-1, 4, 2, 0, 0, 0}, 1},
+  {"ohm",   1.0,          0.0, { 2, 1,-3,-2, 0, 0, 0}, 1},
+  {"\xce\xa9", 1.0,       0.0, { 2, 1,-3,-2, 0, 0, 0}, 1},  /* Ω */
+  {"S",     1.0,          0.0, {-2,-1, 3, 2, 0, 0, 0}, 1},
+  {"Wb",    1.0,          0.0, { 2, 1,-2,-1, 0, 0, 0}, 1},
+  {"T",     1.0,          0.0, { 0, 1,-2,-1, 0, 0, 0}, 1},
+  {"H",     1.0,          0.0, { 2, 1,-2,-2, 0, 0, 0}, 1},
+  {"lm",    1.0,          0.0, { 0, 0, 0, 0, 0, 0, 1}, 1},
+  {"lx",    1.0,          0.0, {-2, 0, 0, 0, 0, 0, 1}, 1},
+  {"Bq",    1.0,          0.0, { 0, 0,-1, 0, 0, 0, 0}, 1},
+  {"Gy",    1.0,          0.0, { 2, 0,-2, 0, 0, 0, 0}, 1},
+  {"Sv",    1.0,          0.0, { 2, 0,-2, 0, 0, 0, 0}, 1},
+  {"kat",   1.0,          0.0, { 0, 0,-1, 0, 0, 1, 0}, 1},
+  {"rad",   1.0,          0.0, { 0, 0, 0, 0, 0, 0, 0}, 1},
+  {"sr",    1.0,          0.0, { 0, 0, 0, 0, 0, 0, 0}, 1},
+
+  /* non-SI units */
+  {"L",     1e-3,         0.0, { 3, 0, 0, 0, 0, 0, 0}, 1},
+  {"l",     1e-3,         0.0, { 3, 0, 0, 0, 0, 0, 0}, 1},
+  {"t",     1e3,          0.0, { 0, 1, 0, 0, 0, 0, 0}, 1},
+  {"eV",    1.602176634e-19, 0.0, { 2, 1,-2, 0, 0, 0, 0}, 1},
+  {"bar",   1e5,          0.0, {-1, 1,-2, 0, 0, 0, 0}, 1},
+  {"min",   60.0,         0.0, { 0, 0, 1, 0, 0, 0, 0}, 0},
+  {"h",     3600.0,       0.0, { 0, 0, 1, 0, 0, 0, 0}, 0},
+  {"d",     86400.0,      0.0, { 0, 0, 1, 0, 0, 0, 0}, 0},
+  {"atm",   101325.0,     0.0, {-1, 1,-2, 0, 0, 0, 0}, 0},
+  {"Da",    1.66053906660e-27, 0.0, { 0, 1, 0, 0, 0, 0, 0}, 1},
+  {"u",     1.66053906660e-27, 0.0, { 0, 1, 0, 0, 0, 0, 0}, 0},
+  {"Ang",   1e-10,        0.0, { 1, 0, 0, 0, 0, 0, 0}, 0},
+  {"\xc3\x85", 1e-10,     0.0, { 1, 0, 0, 0, 0, 0, 0}, 0},  /* Å */
+  {"\xe2\x84\xab", 1e-10, 0.0, { 1, 0, 0, 0, 0, 0, 0}, 0},  /* Å */
+  {"cal",   4.184,        0.0, { 2, 1,-2, 0, 0, 0, 0}, 1},
+  {"deg",   0.017453292519943295, 0.0, { 0, 0, 0, 0, 0, 0, 0}, 0},
+  {"%",     0.01,         0.0, { 0, 0, 0, 0, 0, 0, 0}, 0},
+  {"degC",  1.0,          273.15, { 0, 0, 0, 0, 1, 0, 0}, 0},
+  {"\xc2\xb0" "C", 1.0,   273.15, { 0, 0, 0, 0, 1, 0, 0}, 0},  /* °C */
+  {"degF",  5.0/9.0,      273.15 - 32.0*5.0/9.0,
+                               { 0, 0, 0, 0, 1, 0, 0}, 0},
+  {"\xc2\xb0" "F", 5.0/9.0, 273.15 - 32.0*5.0/9.0,
+                               { 0, 0, 0, 0, 1, 0, 0}, 0},     /* °F */
+  {NULL,    0.0,          0.0, { 0, 0, 0, 0, 0, 0, 0}, 0}
+};
+
+static const PrefixDef prefixes[] = {
+  {"da", 1e1},
+  {"Y", 1e24}, {"Z", 1e21}, {"E", 1e18}, {"P", 1e15}, {"T", 1e12},
+  {"G", 1e9},  {"M", 1e6},  {"k", 1e3},  {"h", 1e2},  {"d", 1e-1},
+  {"c", 1e-2}, {"m", 1e-3}, {"u", 1e-6}, {"\xc2\xb5", 1e-6},  /* µ */
+  {"\xce\xbc", 1e-6},  /* μ */
+  {"n", 1e-9}, {"p", 1e-12}, {"f", 1e-15}, {"a", 1e-18}, {"z", 1e-21},
+  {"y", 1e-24},
+  {NULL, 0.0}
+};
+
+
+/* Cache of parsed units, keyed by unit string */
+typedef map_t(DLiteUnit) unit_map_t;
+
+typedef struct {
+  ThreadMutex mutex;
+  unit_map_t map;
+} UnitCache;
+
+static ThreadMutex _unit_cache_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Frees the unit cache. */
+static void _unit_cache_free(void *unit_cache)
+{
+  UnitCache *uc = unit_cache;
+  map_deinit(&uc->map);
+  thread_mutex_destroy(&uc->mutex);
+  free(uc);
+}
+
+/* Returns pointer to the unit cache. */
+static UnitCache *_unit_cache(void)
+{
+  UnitCache *uc = dlite_globals_get_state(GLOBALS_ID);
+  if (!uc) {
+    thread_mutex_lock(&_unit_cache_mutex);
+    if (!(uc = dlite_globals_get_state(GLOBALS_ID))) {
+      if ((uc = calloc(1, sizeof(UnitCache)))) {
+        thread_mutex_init(&uc->mutex);
+        map_init(&uc->map);
+        dlite_globals_add_state(GLOBALS_ID, uc, _unit_cache_free);
+      }
+    }
+    thread_mutex_unlock(&_unit_cache_mutex);
+    if (!uc) return err(1, "allocation failure"), NULL;
+  }
+  return uc;
+}
+
+
+/* Parser state */
+typedef struct {
+  const char *unit;  /* the unit being parsed */
+  const char *p;     /* current position */
+  int nfactors;      /* number of parsed factors */
+} Parser;
+
+/* Returns non-zero if `p` points to a character that may be part of a
+   unit symbol. */
+static int issymbolchar(const char *p)
+{
+  unsigned char c = *p;
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '%')
+    return 1;
+  /* non-ASCII, except the separator · and the exponents ² and ³ */
+  if (c >= 0x80) {
+    if (c == 0xc2 && ((unsigned char)p[1] == 0xb7 ||
+                      (unsigned char)p[1] == 0xb2 ||
+                      (unsigned char)p[1] == 0xb3))
+      return 0;
+    return 1;
+  }
+  return 0;
+}
+
+/* Looks up unit symbol `s` of length `len`, possibly with a prefix.
+   On success, `u` is assigned and zero is returned. */
+static int lookup_symbol(const char *s, size_t len, DLiteUnit *u)
+{
+  const UnitDef *d;
+  const PrefixDef *q;
+  for (d=units; d->symbol; d++) {
+    if (strlen(d->symbol) == len && strncmp(d->symbol, s, len) == 0) {
+      u->scale = d->scale;
+      u->offset = d->offset;
+      memcpy(u->dims, d->dims, sizeof(u->dims));
+      return 0;
+    }
+  }
+  for (q=prefixes; q->symbol; q++) {
+    size_t n = strlen(q->symbol);
+    if (n >= len || strncmp(q->symbol, s, n)) continue;
+    for (d=units; d->symbol; d++) {
+      if (d->prefixable && strlen(d->symbol) == len - n &&
+          strncmp(d->symbol, s + n, len - n) == 0) {
+        u->scale = q->scale * d->scale;
+        u->offset = 0.0;
+        memcpy(u->dims, d->dims, sizeof(u->dims));
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/* Multiplies `u` with `v` raised to the power of `exp`. */
+static void unit_mul(DLiteUnit *u, const DLiteUnit *v, int exp)
+{
+  int i, e = (exp < 0) ? -exp : exp;
+  double scale = 1.0;
+  for (i=0; i<e; i++) scale *= v->scale;
+  u->scale *= (exp < 0) ? 1.0 / scale : scale;
+  for (i=0; i<DLITE_UNIT_NDIMS; i++) u->dims[i] += exp * v->dims[i];
+}
+
+/* Skips whitespace. */
+static void skip_space(Parser *ps)
+{
+  while (*ps->p == ' ' || *ps->p == '\t') ps->p++;
+}
+
+/* Parses an optional exponent and returns it. Returns 1 if there is no
+   exponent.  On error, `*ok` is set to zero. */
+static int parse_exponent(Parser *ps, int *ok)
+{
+  const char *p = ps->p;
+  int sign=1, exp=0, ndigits=0;
+  if ((unsigned char)p[0] == 0xc2 && (unsigned char)p[1] == 0xb2) {
+    ps->p += 2;
+    return 2;
+  }
+  if ((unsigned char)p[0] == 0xc2 && (unsigned char)p[1] == 0xb3) {
+    ps->p += 2;
+    return 3;
+  }
+  if (p[0] == '^') p++;
+  else if (p[0] == '*' && p[1] == '*') p += 2;
+  if (*p == '+') p++;
+  else if (*p == '-') { sign = -1; p++; }
+  while (*p >= '0' && *p <= '9') {
+    exp = 10*exp + (*p++ - '0');
+    if (++ndigits > 2) break;
+  }
+  if (ndigits == 0) {
+    if (p != ps->p) *ok = 0;  /* `^`, `**` or sign without digits */
+    return 1;
+  }
+  if (ndigits > 2) *ok = 0;
+  ps->p = p;
+  return sign * exp;
+}
+
+static int parse_product(Parser *ps, DLiteUnit *u, int depth);
+
+/* Parses a factor, that is a symbol or a parenthesised product,
+   followed by an optional exponent. */
+static int parse_factor(Parser *ps, DLiteUnit *u, int depth)
+{
+  DLiteUnit v;
+  const char *start;
+  int exp, ok=1;
+  skip_space(ps);
+  memset(u, 0, sizeof(DLiteUnit));
+  u->scale = 1.0;
+  if (*ps->p == '(') {
+    if (depth >= MAX_DEPTH)
+      return errx(dliteValueError, "too deeply nested unit: '%s'",
+                  ps->unit);
+    ps->p++;
+    if (parse_product(ps, &v, depth+1)) return 1;
+    skip_space(ps);
+    if (*ps->p != ')')
+      return errx(dliteValueError, "missing ')' in unit: '%s'", ps->unit);
+    ps->p++;
+    ps->nfactors++;  /* never keep offset for parenthesised units */
+  } else if (*ps->p == '1' && !issymbolchar(ps->p+1)) {
+    ps->p++;
+    memset(&v, 0, sizeof(v));
+    v.scale = 1.0;
+  } else {
+    start = ps->p;
+    while (issymbolchar(ps->p)) ps->p++;
+    if (ps->p == start)
+      return errx(dliteValueError, "invalid unit: '%s'", ps->unit);
+    if (lookup_symbol(start, ps->p - start, &v))
+      return errx(dliteValueError, "unknown unit '%.*s' in '%s'",
+                  (int)(ps->p - start), start, ps->unit);
+  }
+  exp = parse_exponent(ps, &ok);
+  if (!ok) return errx(dliteValueError, "invalid exponent in unit: '%s'",
+                       ps->unit);
+  if (exp != 1) ps->nfactors++;
+  unit_mul(u, &v, exp);
+  u->offset = v.offset;
+  ps->nfactors++;
+  return 0;
+}
+
+/* Parses a product of factors. */
+static int parse_product(Parser *ps, DLiteUnit *u, int depth)
+{
+  DLiteUnit v;
+  int sign = 1;
+  memset(u, 0, sizeof(DLiteUnit));
+  u->scale = 1.0;
+  while (1) {
+    if (parse_factor(ps, &v, depth)) return 1;
+    unit_mul(u, &v, sign);
+    u->offset = v.offset;
+    skip_space(ps);
+    if (*ps->p == '*' || *ps->p == '.') {
+      ps->p++;
+      sign = 1;
+    } else if ((unsigned char)ps->p[0] == 0xc2 &&
+               (unsigned char)ps->p[1] == 0xb7) {  /* · */
+      ps->p += 2;
+      sign = 1;
+    } else if (*ps->p == '/') {
+      ps->p++;
+      ps->nfactors++;  /* never keep offset for inverted units */
+      sign = -1;
+    } else if (*ps->p && *ps->p != ')' && issymbolchar(ps->p)) {
+      sign = 1;  /* space-separated factors */
+    } else if (*ps->p == '(') {
+      sign = 1;
+    } else {
+      break;
+    }
+  }
+  return 0;
+}
+
+/* Parses `unit` without consulting the cache. */
+static int parse_unit(const char *unit, DLiteUnit *u)
+{
+  Parser ps;
+  memset(u, 0, sizeof(DLiteUnit));
+  u->scale = 1.0;
+  if (!unit) return 0;
+  ps.unit = ps.p = unit;
+  ps.nfactors = 0;
+  skip_space(&ps);
+  if (!*ps.p) return 0;
+  if (parse_product(&ps, u, 0)) return 1;
+  if (*ps.p)
+    return errx(dliteValueError, "unexpected character '%c' in unit: '%s'",
+                *ps.p, unit);
+  if (ps.nfactors > 1) u->offset = 0.0;
+  return 0;
+}
+
+
+/*
+  Parses `unit` and stores its canonical representation in `u`.
+ */
+int dlite_unit_parse(const char *unit, DLiteUnit *u)
+{
+  UnitCache *uc;
+  DLiteUnit *cached;
+  int stat;
+  if (!unit || !*unit) return parse_unit(NULL, u);
+  if (!(uc = _unit_cache())) return 1;
+  thread_mutex_lock(&uc->mutex);
+  if ((cached = map_get(&uc->map, unit))) {
+    *u = *cached;
+    thread_mutex_unlock(&uc->mutex);
+    return 0;
+  }
+  thread_mutex_unlock(&uc->mutex);
+
+  if ((stat = parse_unit(unit, u))) return stat;
+  thread_mutex_lock(&uc->mutex);
+  map_set(&uc->map, unit, *u);
+  thread_mutex_unlock(&uc->mutex);
+  return 0;
+}
+
+
+/*
+  Returns 1 if units `unit1` and `unit2` have the same dimension, zero
+  if they don't and a negative value on error.
+ */
+int dlite_unit_compatible(const char *unit1, const char *unit2)
+{
+  DLiteUnit u1, u2;
+  if (dlite_unit_parse(unit1, &u1) || dlite_unit_parse(unit2, &u2))
+    return -1;
+  return (memcmp(u1.dims, u2.dims, sizeof(u1.dims)) == 0) ? 1 : 0;
+}
+
+
+/*
+  Computes `scale` and `offset` for converting a value from unit
+  `from` to unit `to`.
+ */
+int dlite_unit_conversion(const char *from, const char *to,
+                          double *scale, double *offset)
+{
+  DLiteUnit u1, u2;
+  if (dlite_unit_parse(from, &u1) || dlite_unit_parse(to, &u2))
+    return 1;
+  if (memcmp(u1.dims, u2.dims, sizeof(u1.dims)))
+    return errx(dliteValueError, "cannot convert from unit '%s' to '%s'",
+                (from) ? from : "", (to) ? to : "");
+  *scale = u1.scale / u2.scale;
+  *offset = (u1.offset - u2.offset) / u2.scale;
+  return 0;
+}
+
+
+/*
+  Converts `n` contiguous numbers in `data` from unit `from` to unit
+  `to` in place.
+ */
+int dlite_unit_convert(void *data, DLiteType type, size_t size, size_t n,
+                       const char *from, const char *to)
+{
+  DLiteArray *arr;
+  double scale, offset;
+  int stat;
+  if (dlite_unit_conversion(from, to, &scale, &offset)) return 1;
+  if (scale == 1.0 && offset == 0.0) return 0;
+  if (!(arr = dlite_array_create(data, type, size, 1, &n))) return 1;
+  stat = dlite_array_scale(arr, scale, offset);
+  dlite_array_free(arr);
+  return stat;
+}
+
+
+/*
+  Like dlite_instance_cast_property_by_index(), but also converts the
+  value from the unit of the property to `unit`.
+ */
+int dlite_instance_cast_property_to_unit(const DLiteInstance *inst,
+                                         int i,
+                                         DLiteType type,
+                                         size_t size,
+                                         const size_t *dims,
+                                         const int *strides,
+                                         void *dest,
+                                         DLiteTypeCast castfun,
+                                         const char *unit)
+{
+  DLiteProperty *p;
+  DLiteArray *arr;
+  double scale, offset;
+  size_t one=1;
+  int stat, j, ndims;
+  if (i < 0 || i >= (int)inst->meta->_nproperties)
+    return errx(dliteIndexError, "property index %d out of range", i);
+  p = inst->meta->_properties + i;
+  if (unit && dlite_unit_conversion(p->unit, unit, &scale, &offset))
+    return 1;
+  if (!dims && p->ndims) dims = DLITE_PROP_DIMS(inst, i);
+  if ((stat = dlite_instance_cast_property_by_index(inst, i, type, size,
+                                                    dims, strides, dest,
+                                                    castfun)))
+    return stat;
+  if (!unit || (scale == 1.0 && offset == 0.0)) return 0;
+
+  ndims = (p->ndims) ? p->ndims : 1;
+  if (!dims) dims = &one;
+  if (!(arr = dlite_array_create(dest, type, size, ndims, dims))) return 1;
+  if (strides)
+    for (j=0; j<ndims; j++) arr->strides[j] = strides[j];
+  stat = dlite_array_scale(arr, scale, offset);
+  dlite_array_free(arr);
+  return stat;
+}
+
+
+/*
+  Like dlite_instance_cast_property_to_unit(), but the property is
+  specified by name.
+ */
+int dlite_instance_get_property_in_unit(const DLiteInstance *inst,
+                                        const char *name,
+                                        DLiteType type,
+                                        size_t size,
+                                        void *dest,
+                                        const char *unit)
+{
+  int i;
+  if ((i = dlite_meta_get_property_index(inst->meta, name)) < 0) return 1;
+  return dlite_instance_cast_property_to_unit(inst, i, type, size, NULL,
+                                              NULL, dest, NULL, unit);
+}
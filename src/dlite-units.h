@@ -0,0 +1,106 @@
+#ifndef _DLITE_UNITS_H
+#define _DLITE_UNITS_H
+
+/**
+  @file
+  @brief Unit parsing and conversion
+
+  Units are parsed into a canonical representation, which is the
+  exponents of the seven SI base units together with a scale and an
+  offset relating the unit to the corresponding SI unit:
+
+      value_SI = scale * value + offset
+
+  A unit is a product of factors separated by `*`, `.`, `·` or space,
+  optionally divided by factors with `/`.  Each `/` divides by the
+  following factor or parenthesised group, such that `J/kg/K` and
+  `J/(kg*K)` are equivalent.  A factor is a unit symbol, optionally
+  with an SI prefix, followed by an optional integer exponent written
+  as `^2`, `**2`, `2`, `-1`, `²` or `³`, e.g. `kg/m3`, `m.s^-2` or
+  `µm²`.  The number `1` and an empty or NULL unit are dimensionless.
+
+  The offset is only kept for single factors with exponent one, like
+  `degC`.  In compound units, like `degC/s`, the offset is dropped.
+
+  Parsed units are cached, so parsing the same unit string repeatedly
+  is cheap.
+ */
+
+#include "dlite-entity.h"
+
+/** Number of SI base dimensions */
+#define DLITE_UNIT_NDIMS 7
+
+/** Canonical representation of a unit */
+typedef struct _DLiteUnit {
+  double scale;      /*!< scale factor to SI */
+  double offset;     /*!< offset to SI, in SI units */
+  signed char dims[DLITE_UNIT_NDIMS];  /*!< exponents of the SI base units
+                                          m, kg, s, A, K, mol, cd */
+} DLiteUnit;
+
+
+/**
+  Parses `unit` and stores its canonical representation in `u`.
+
+  Returns non-zero on error.
+ */
+int dlite_unit_parse(const char *unit, DLiteUnit *u);
+
+/**
+  Returns 1 if units `unit1` and `unit2` have the same dimension, zero
+  if they don't and a negative value on error.
+ */
+int dlite_unit_compatible(const char *unit1, const char *unit2);
+
+/**
+  Computes `scale` and `offset` for converting a value from unit
+  `from` to unit `to`, such that
+
+      value_to = scale * value_from + offset
+
+  Returns non-zero on error, e.g. if the units are incompatible.
+ */
+int dlite_unit_conversion(const char *from, const char *to,
+                          double *scale, double *offset);
+
+/**
+  Converts `n` contiguous numbers of type `type` and size `size` in
+  `data` from unit `from` to unit `to` in place.  Float data is
+  converted with SIMD kernels (see dlite_array_scale()).
+
+  Returns non-zero on error.
+ */
+int dlite_unit_convert(void *data, DLiteType type, size_t size, size_t n,
+                       const char *from, const char *to);
+
+/**
+  Like dlite_instance_cast_property_by_index(), but also converts the
+  value from the unit of the property to `unit`.  If `unit` is NULL,
+  no unit conversion is performed.
+
+  Return non-zero on error.
+ */
+int dlite_instance_cast_property_to_unit(const DLiteInstance *inst,
+                                         int i,
+                                         DLiteType type,
+                                         size_t size,
+                                         const size_t *dims,
+                                         const int *strides,
+                                         void *dest,
+                                         DLiteTypeCast castfun,
+                                         const char *unit);
+
+/**
+  Like dlite_instance_cast_property_to_unit(), but the property is
+  specified by name.
+ */
+int dlite_instance_get_property_in_unit(const DLiteInstance *inst,
+                                        const char *name,
+                                        DLiteType type,
+                                        size_t size,
+                                        void *dest,
+                                        const char *unit);
+
+
+#endif /* _DLITE_UNITS_H */
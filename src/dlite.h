@@ -16,9 +16,30 @@
 #include "dlite-schemas.h"
 #include "dlite-entity.h"
 #include "dlite-storage.h"
+#include "dlite-async.h"
+#include "dlite-arrow.h"
+#include "dlite-soa.h"
+#include "dlite-sparse.h"
+#include "dlite-lossy.h"
+#include "dlite-notify.h"
+#include "dlite-bloom.h"
+#include "dlite-storage-index.h"
+#include "dlite-query.h"
+#include "dlite-stats.h"
+#include "dlite-record.h"
+#include "dlite-numa.h"
+#include "dlite-hugepage.h"
+#include "dlite-device.h"
+#include "dlite-compress.h"
+#include "dlite-region.h"
+#include "dlite-metacache.h"
+#include "dlite-snapshot.h"
+#include "dlite-units.h"
+#include "dlite-iri-mapping.h"
 #include "dlite-collection.h"
 #include "dlite-getlicense.h"
 #include "dlite-json.h"
+#include "dlite-cbor.h"
 
 
 #endif /* _DLITE_H */
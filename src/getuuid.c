@@ -7,9 +7,71 @@
 
 #include "utils/uuid.h"
 #include "utils/uuid4.h"
+#include "utils/thread.h"
 #include "getuuid.h"
 
 
+/*
+ * Cache of version 5 UUIDs generated from ids.
+ *
+ * The same metadata URIs are converted to UUIDs over and over again,
+ * so the results are memoised in a small direct-mapped cache.  A new
+ * id simply replaces the entry it maps to, which keeps the cache
+ * bounded.  Ids that don't fit in an entry are not cached.
+ */
+#define UUID_CACHE_SIZE   512  /* number of entries, must be power of 2 */
+#define UUID_CACHE_IDSIZE 120  /* max length of cached ids, including NUL */
+
+typedef struct {
+  size_t len;                   /* length of id, zero if unused */
+  char id[UUID_CACHE_IDSIZE];   /* the id */
+  char uuid[UUID_LEN+1];        /* corresponding UUID */
+} UuidCacheEntry;
+
+static UuidCacheEntry uuid_cache[UUID_CACHE_SIZE];
+static ThreadRWLock uuid_cache_lock = THREAD_RWLOCK_INITIALIZER;
+
+/* Returns the cache entry that `id` of length `len` maps to. */
+static UuidCacheEntry *uuid_cache_entry(const char *id, size_t len)
+{
+  unsigned hash = 2166136261u;  /* FNV-1a */
+  size_t i;
+  for (i=0; i<len; i++) hash = (hash ^ (unsigned char)id[i]) * 16777619u;
+  return uuid_cache + (hash & (UUID_CACHE_SIZE - 1));
+}
+
+/* Writes the version 5 UUID of `id` of length `len` to `buff`. */
+static void uuid5_from_id(char *buff, const char *id, size_t len)
+{
+  uuid_s uuid;
+  UuidCacheEntry *e = NULL;
+  int found = 0;
+
+  if (len < UUID_CACHE_IDSIZE) {
+    e = uuid_cache_entry(id, len);
+    thread_rwlock_rdlock(&uuid_cache_lock);
+    if (e->len == len && memcmp(e->id, id, len) == 0) {
+      memcpy(buff, e->uuid, UUID_LEN+1);
+      found = 1;
+    }
+    thread_rwlock_rdunlock(&uuid_cache_lock);
+    if (found) return;
+  }
+
+  uuid_create_sha1_from_name(&uuid, NameSpace_DNS, id, len);
+  uuid_as_string(&uuid, buff);
+
+  if (e) {
+    thread_rwlock_wrlock(&uuid_cache_lock);
+    memcpy(e->id, id, len);
+    e->id[len] = '\0';
+    memcpy(e->uuid, buff, UUID_LEN+1);
+    e->len = len;
+    thread_rwlock_wrunlock(&uuid_cache_lock);
+  }
+}
+
+
 /*
  * Writes an UUID to `buff` based on `id`.
  *
@@ -35,7 +97,6 @@ int getuuid(char *buff, const char *id)
 int getuuidn(char *buff, const char *id, size_t len)
 {
   int i, version;
-  uuid_s uuid;
 
   if (len == 0) id = NULL;
 
@@ -43,18 +104,18 @@ int getuuidn(char *buff, const char *id, size_t len)
     int status = uuid4_generate(buff);
     version = (status == 0) ? 4 : -1;
   } else if (uuid_from_string(NULL, id, len)) {
-    uuid_create_sha1_from_name(&uuid, NameSpace_DNS, id, len);
-    uuid_as_string(&uuid, buff);
+    uuid5_from_id(buff, id, len);
     version = 5;
   } else {
     strncpy(buff, id, UUID_LEN);
     buff[UUID_LEN] = '\0';
     version = 0;
-  }
 
-  /* For reprodusability, always convert to lower case */
-  for (i=0; i < UUID_LEN; i++)
-    buff[i] = tolower(buff[i]);
+    /* For reprodusability, always convert to lower case.  Generated
+       UUIDs are already in lower case. */
+    for (i=0; i < UUID_LEN; i++)
+      buff[i] = tolower(buff[i]);
+  }
 
   return version;
 }
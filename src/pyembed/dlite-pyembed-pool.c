@@ -0,0 +1,257 @@
+/*
+  A pool of Python subinterpreters with their own GIL
+ */
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Python pulls in a lot of defines that conflicts with utils/config.h */
+#define SKIP_UTILS_CONFIG_H
+
+#include "utils/thread.h"
+#include "dlite-macros.h"
+#include "dlite-misc.h"
+#include "dlite-errors.h"
+#include "dlite-pyembed.h"
+#include "dlite-pyembed-pool.h"
+
+/* Maximum number of subinterpreters in the pool */
+#define POOL_MAX_SIZE 64
+
+/* Maximum number of subinterpreters.  -1 if not initialised. */
+static int pool_maxsize = -1;
+
+
+#if PY_VERSION_HEX >= 0x030C0000
+
+/* Python code defining pool_call() in each subinterpreter. */
+static const char *pool_code =
+  "import json\n"
+  "\n"
+  "_classes = {}\n"
+  "\n"
+  "def pool_call(path, classname, baseclassname, method, arg):\n"
+  "    \"\"\"Calls `method` of class `classname` defined in plugin `path`\n"
+  "    with the JSON-decoded `arg` and returns the JSON-encoded result.\n"
+  "    The plugin is executed the first time it is used.\"\"\"\n"
+  "    cls = _classes.get((path, classname))\n"
+  "    if cls is None:\n"
+  "        namespace = {'__file__': path, '__name__': '__main__',\n"
+  "                     baseclassname: type(baseclassname, (), {})}\n"
+  "        with open(path, 'rb') as f:\n"
+  "            exec(compile(f.read(), path, 'exec'), namespace)\n"
+  "        cls = _classes[path, classname] = namespace[classname]\n"
+  "    return json.dumps(getattr(cls, method)(cls, json.loads(arg)))\n";
+
+/* A subinterpreter in the pool */
+typedef struct {
+  PyThreadState *tstate;  /* thread state of the subinterpreter */
+  PyObject *call;         /* pool_call() in the subinterpreter */
+  int busy;               /* whether the subinterpreter is in use */
+} PoolSlot;
+
+static ThreadMutex pool_mutex = THREAD_MUTEX_INITIALIZER;
+static ThreadCond pool_cond = THREAD_COND_INITIALIZER;
+static PoolSlot pool_slots[POOL_MAX_SIZE];
+static int pool_nslots = 0;    /* number of created subinterpreters */
+static int pool_creating = 0;  /* number of subinterpreters being created */
+
+
+/*
+  Creates a new subinterpreter with its own GIL and assigns `slot`.
+  Returns non-zero on error.
+ */
+static int pool_create(PoolSlot *slot)
+{
+  PyInterpreterConfig config = {
+    .use_main_obmalloc = 0,
+    .allow_fork = 0,
+    .allow_exec = 0,
+    .allow_threads = 1,
+    .allow_daemon_threads = 0,
+    .check_multi_interp_extensions = 1,
+    .gil = PyInterpreterConfig_OWN_GIL,
+  };
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
+  PyThreadState *save = PyThreadState_Get(), *tstate=NULL;
+  PyObject *dict=NULL, *ret=NULL, *call=NULL;
+  PyStatus status;
+  int retval=1;
+
+  status = Py_NewInterpreterFromConfig(&tstate, &config);
+  if (PyStatus_Exception(status)) {
+    PyThreadState_Swap(save);
+    dlite_err(1, "cannot create Python subinterpreter: %s",
+              (status.err_msg) ? status.err_msg : "unknown error");
+    PyGILState_Release(gstate);
+    return 1;
+  }
+
+  /* Define pool_call() in the new subinterpreter */
+  if (!(dict = PyDict_New())) FAIL("cannot create dict");
+  if (PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins()) ||
+      !(ret = PyRun_String(pool_code, Py_file_input, dict, dict)) ||
+      !(call = PyDict_GetItemString(dict, "pool_call"))) {
+    dlite_pyembed_err(1, "cannot initialise Python subinterpreter");
+    goto fail;
+  }
+  Py_INCREF(call);
+  slot->tstate = tstate;
+  slot->call = call;
+  retval = 0;
+ fail:
+  Py_XDECREF(ret);
+  Py_XDECREF(dict);
+  if (retval) Py_EndInterpreter(tstate);
+  PyThreadState_Swap(save);
+  PyGILState_Release(gstate);
+  return retval;
+}
+
+#endif  /* PY_VERSION_HEX >= 0x030C0000 */
+
+
+/*
+  Returns the maximum number of subinterpreters in the pool.  Returns
+  zero if the pool is disabled or if subinterpreters with their own
+  GIL are not supported by the Python version.
+ */
+int dlite_pyembed_pool_size(void)
+{
+#if PY_VERSION_HEX >= 0x030C0000
+  if (pool_maxsize < 0) {
+    char *endptr, *p = getenv("DLITE_PYTHON_SUBINTERPRETERS");
+    int n = thread_ncpus();
+    if (p && *p) {
+      n = strtol(p, &endptr, 10);
+      if (*endptr || n < 0) {
+        dlite_warnx("invalid value of DLITE_PYTHON_SUBINTERPRETERS: '%s'", p);
+        n = thread_ncpus();
+      }
+    }
+    if (n > POOL_MAX_SIZE) n = POOL_MAX_SIZE;
+    pool_maxsize = n;
+  }
+  return pool_maxsize;
+#else
+  return 0;
+#endif
+}
+
+
+/*
+  Calls method `method` of the class `classname` defined in the Python
+  plugin `path` in a free subinterpreter of the pool.
+
+  Returns a newly malloc'ed string with the JSON-encoded return value
+  or NULL on error.
+ */
+char *dlite_pyembed_pool_call(const char *path, const char *classname,
+                              const char *baseclassname, const char *method,
+                              const char *arg)
+{
+#if PY_VERSION_HEX >= 0x030C0000
+  PoolSlot *slot=NULL, new={NULL, NULL, 1};
+  PyThreadState *save;
+  PyObject *ret=NULL;
+  const char *s;
+  char *result=NULL;
+  int i, create=0;
+
+  if (dlite_pyembed_pool_size() <= 0)
+    return dlite_err(1, "the Python subinterpreter pool is disabled"), NULL;
+
+  /* Get a free subinterpreter.  Create a new one if all are busy and
+     the pool is not full. */
+  thread_mutex_lock(&pool_mutex);
+  while (!slot && !create) {
+    for (i=0; i<pool_nslots; i++) {
+      if (!pool_slots[i].busy) {
+        slot = pool_slots + i;
+        slot->busy = 1;
+        break;
+      }
+    }
+    if (!slot) {
+      if (pool_nslots + pool_creating < pool_maxsize) {
+        pool_creating++;
+        create = 1;
+      } else if (pool_nslots + pool_creating == 0) {
+        break;
+      } else {
+        thread_cond_wait(&pool_cond, &pool_mutex);
+      }
+    }
+  }
+  thread_mutex_unlock(&pool_mutex);
+
+  if (create) {
+    int stat = pool_create(&new);
+    thread_mutex_lock(&pool_mutex);
+    pool_creating--;
+    if (stat == 0) {
+      slot = pool_slots + pool_nslots++;
+      *slot = new;
+    } else {
+      /* Do not try to grow the pool further */
+      pool_maxsize = pool_nslots + pool_creating;
+      thread_cond_broadcast(&pool_cond);
+    }
+    thread_mutex_unlock(&pool_mutex);
+  }
+  if (!slot)
+    return dlite_err(1, "no Python subinterpreter available for %s.%s()",
+                     classname, method), NULL;
+
+  /* Call pool_call() in the subinterpreter.  Swapping the thread state
+     releases the GIL held by the calling thread and acquires the GIL
+     of the subinterpreter. */
+  save = PyThreadState_Swap(slot->tstate);
+  if (!(ret = PyObject_CallFunction(slot->call, "sssss", path, classname,
+                                    baseclassname, method, arg)))
+    dlite_pyembed_err(1, "error calling %s.%s() in Python subinterpreter",
+                      classname, method);
+  else if (!(s = PyUnicode_AsUTF8(ret)))
+    dlite_pyembed_err(1, "cannot convert return value of %s.%s()",
+                      classname, method);
+  else if (!(result = strdup(s)))
+    dlite_err(dliteMemoryError, "allocation failure");
+  Py_XDECREF(ret);
+  PyThreadState_Swap(save);
+
+  thread_mutex_lock(&pool_mutex);
+  slot->busy = 0;
+  thread_cond_signal(&pool_cond);
+  thread_mutex_unlock(&pool_mutex);
+  return result;
+#else
+  UNUSED(path);
+  UNUSED(classname);
+  UNUSED(baseclassname);
+  UNUSED(method);
+  UNUSED(arg);
+  return dlite_err(1, "Python subinterpreters with their own GIL require "
+                   "Python 3.12 or later"), NULL;
+#endif
+}
+
+
+/*
+  Ends all subinterpreters in the pool.
+ */
+void dlite_pyembed_pool_finalise(void)
+{
+#if PY_VERSION_HEX >= 0x030C0000
+  int i;
+  PyThreadState *save = PyThreadState_Swap(NULL);
+  for (i=0; i<pool_nslots; i++) {
+    PyThreadState_Swap(pool_slots[i].tstate);
+    Py_CLEAR(pool_slots[i].call);
+    Py_EndInterpreter(pool_slots[i].tstate);
+    memset(pool_slots + i, 0, sizeof(PoolSlot));
+  }
+  pool_nslots = 0;
+  PyThreadState_Swap(save);
+#endif
+  pool_maxsize = -1;
+}
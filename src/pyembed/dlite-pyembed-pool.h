@@ -0,0 +1,67 @@
+#ifndef _DLITE_PYEMBED_POOL_H
+#define _DLITE_PYEMBED_POOL_H
+
+/**
+  @file
+  @brief Pool of Python subinterpreters
+
+  All Python plugins are normally executed in the main embedded
+  interpreter.  They serialise on its global interpreter lock (GIL),
+  even when they are called from parallel C threads.
+
+  Python 3.12 and later support subinterpreters with their own GIL.
+  Plugins that declare themselves subinterpreter-safe, by setting the
+  class attribute `subinterpreter_safe = True`, are executed in a pool
+  of such subinterpreters, which gives real parallelism for CPU-bound
+  Python code.
+
+  A subinterpreter cannot import extension modules that do not support
+  multiple interpreters, like the dlite and numpy extension modules.
+  Subinterpreter-safe plugins may therefore only use pure Python and
+  the standard library.  Arguments and return values are passed
+  between C and the subinterpreters as JSON strings.
+
+  Subinterpreters are created on demand.  The maximum number of
+  subinterpreters is given by the environment variable
+  DLITE_PYTHON_SUBINTERPRETERS, which defaults to the number of CPUs.
+  Setting it to zero disables the pool.
+ */
+
+#include "dlite-pyembed.h"
+
+
+/**
+  Returns the maximum number of subinterpreters in the pool.  Returns
+  zero if the pool is disabled or if subinterpreters with their own
+  GIL are not supported by the Python version.
+ */
+int dlite_pyembed_pool_size(void);
+
+/**
+  Calls method `method` of the class `classname` defined in the Python
+  plugin `path` in a free subinterpreter of the pool.
+
+  The plugin is executed in the subinterpreter the first time it is
+  used.  The class `baseclassname` is created in its namespace before
+  that, like for dlite_pyembed_load_plugins().  The method is called
+  like `classname.method(classname, json.loads(arg))`, i.e. in the same
+  way as plugin methods are called in the main interpreter.
+
+  The calling thread does not need to hold the GIL of the main
+  interpreter.  If it does, the GIL is released during the call.
+
+  Returns a newly malloc'ed string with the JSON-encoded return value
+  or NULL on error.
+ */
+char *dlite_pyembed_pool_call(const char *path, const char *classname,
+                              const char *baseclassname, const char *method,
+                              const char *arg);
+
+/**
+  Ends all subinterpreters in the pool.  Should be called with the GIL
+  of the main interpreter held and when no subinterpreter is in use.
+ */
+void dlite_pyembed_pool_finalise(void);
+
+
+#endif /* _DLITE_PYEMBED_POOL_H */
@@ -3,6 +3,7 @@
 #include "dlite-macros.h"
 #include "dlite-misc.h"
 #include "dlite-pyembed.h"
+#include "dlite-pyembed-pool.h"
 #include "dlite-python-storage.h"
 #include "dlite-python-mapping.h"
 #include "config-paths.h"
@@ -13,8 +14,140 @@
 #endif
 
 
+/* Name of capsules wrapping a DLite instance, see
+   dlite_pyembed_wrap_instance() */
+#define DLITE_INSTANCE_CAPSULA_NAME "dlite.Instance"
+
 static int python_initialized = 0;
 
+/* References to Python callables, cached for the lifetime of the
+   embedded interpreter.  Loaded by load_callables(). */
+static PyObject *py_get_instance = NULL;   /* dlite.get_instance() */
+static PyObject *py_from_capsule = NULL;   /* dlite._instance_from_capsule() */
+static PyObject *py_scan_plugin = NULL;    /* scan_plugin(), see below */
+static PyObject *py_view_class = NULL;     /* InstanceView, see below */
+
+/* Python code defining scan_plugin(), which finds plugin classes in
+   `path` without importing it.  Used by dlite_pyembed_scan_plugins(). */
+static const char *scan_plugin_code =
+  "import ast\n"
+  "\n"
+  "def scan_plugin(path, base):\n"
+  "    \"\"\"Returns a list of (name, methods, classname) tuples for the\n"
+  "    classes in `path` deriving directly from `base`.  Returns None if\n"
+  "    `path` must be imported to find them.\"\"\"\n"
+  "    try:\n"
+  "        with open(path, 'rb') as f:\n"
+  "            source = f.read()\n"
+  "        tree = ast.parse(source, path)\n"
+  "    except (OSError, SyntaxError, ValueError):\n"
+  "        return None\n"
+  "    found = []\n"
+  "    for node in tree.body:\n"
+  "        if not isinstance(node, ast.ClassDef) or not any(\n"
+  "                isinstance(b, ast.Name) and b.id == base\n"
+  "                for b in node.bases):\n"
+  "            continue\n"
+  "        if len(node.bases) > 1 or node.keywords or node.decorator_list:\n"
+  "            return None\n"
+  "        name, methods = node.name, []\n"
+  "        for item in node.body:\n"
+  "            if isinstance(item, (ast.FunctionDef, ast.AsyncFunctionDef)):\n"
+  "                methods.append(item.name)\n"
+  "            elif isinstance(item, ast.Assign) and any(\n"
+  "                    isinstance(t, ast.Name) and t.id == 'name'\n"
+  "                    for t in item.targets):\n"
+  "                if not (isinstance(item.value, ast.Constant) and\n"
+  "                        isinstance(item.value.value, str)):\n"
+  "                    return None\n"
+  "                name = item.value.value\n"
+  "        found.append((name, tuple(methods), node.name))\n"
+  "    if not found and base.encode() in source:\n"
+  "        return None\n"
+  "    return found\n";
+
+/* Python code defining InstanceView, the view of an instance passed to
+   the save_view() and load_into() methods of Python storage plugins.
+   Used by dlite_pyembed_instance_view(). */
+static const char *instance_view_code =
+  "class InstanceView:\n"
+  "    \"\"\"Lightweight view of a DLite instance.\n"
+  "\n"
+  "    Attributes:\n"
+  "        uuid: UUID of the instance.\n"
+  "        uri: URI of the instance or None.\n"
+  "        meta: URI of the metadata.\n"
+  "        dims: Tuple with the dimension sizes.\n"
+  "        dimensions: Dict mapping dimension names to sizes.\n"
+  "        names: Tuple with the property names.\n"
+  "        arraynames: Tuple with the names of properties accessible\n"
+  "            as numpy arrays sharing memory with the instance.\n"
+  "\n"
+  "    `view[name]` returns properties of numeric, bool, fixstring and\n"
+  "    blob types as numpy arrays sharing memory with the instance.\n"
+  "    Scalars are returned as 0-dimensional arrays.  Other properties\n"
+  "    are accessed via the `instance` attribute, which is the\n"
+  "    dlite.Instance that is viewed.  The view is only valid during\n"
+  "    the call it is passed to.\n"
+  "    \"\"\"\n"
+  "    __slots__ = ('uuid', 'uri', 'meta', 'dims', 'dimensions', 'names',\n"
+  "                 'arraynames', '_buffers', '_arrays', '_getter', '_key',\n"
+  "                 '_instance')\n"
+  "\n"
+  "    def __init__(self, uuid, uri, meta, dimensions, names, buffers,\n"
+  "                 getter, key):\n"
+  "        self.uuid = uuid\n"
+  "        self.uri = uri\n"
+  "        self.meta = meta\n"
+  "        self.dimensions = dimensions\n"
+  "        self.dims = tuple(dimensions.values())\n"
+  "        self.names = names\n"
+  "        self.arraynames = tuple(n for n in names if n in buffers)\n"
+  "        self._buffers = buffers\n"
+  "        self._arrays = {}\n"
+  "        self._getter = getter\n"
+  "        self._key = key\n"
+  "        self._instance = None\n"
+  "\n"
+  "    def __repr__(self):\n"
+  "        return f'<InstanceView of {self.uuid}>'\n"
+  "\n"
+  "    def __contains__(self, name):\n"
+  "        return name in self.names\n"
+  "\n"
+  "    def __getitem__(self, name):\n"
+  "        arr = self._arrays.get(name)\n"
+  "        if arr is None:\n"
+  "            if name not in self._buffers:\n"
+  "                return self.instance[name]\n"
+  "            import numpy as np\n"
+  "            mv, dtype, shape = self._buffers[name]\n"
+  "            arr = np.frombuffer(mv, dtype=dtype).reshape(shape)\n"
+  "            self._arrays[name] = arr\n"
+  "        return arr\n"
+  "\n"
+  "    def __setitem__(self, name, value):\n"
+  "        if name in self._buffers:\n"
+  "            self[name][...] = value\n"
+  "        else:\n"
+  "            self.instance[name] = value\n"
+  "\n"
+  "    @property\n"
+  "    def instance(self):\n"
+  "        if self._instance is None:\n"
+  "            self._instance = self._getter(self._key)\n"
+  "        return self._instance\n"
+  "\n"
+  "    def _release(self):\n"
+  "        self._arrays.clear()\n"
+  "        for mv, _, _ in self._buffers.values():\n"
+  "            try:\n"
+  "                mv.release()\n"
+  "            except BufferError:\n"
+  "                pass\n"
+  "        self._buffers = {}\n"
+  "        self._instance = None\n";
+
 /* Initialises the embedded Python environment. */
 void dlite_pyembed_initialise(void)
 {
@@ -51,11 +184,27 @@ void dlite_pyembed_initialise(void)
   }
 }
 
+/*
+  Initialises the embedded Python environment if needed and ensures
+  that the calling thread holds the GIL.  The returned state should be
+  passed to PyGILState_Release().
+*/
+PyGILState_STATE dlite_pyembed_gil_ensure(void)
+{
+  dlite_pyembed_initialise();
+  return PyGILState_Ensure();
+}
+
 /* Finalises the embedded Python environment.  Returns non-zero on error. */
 int dlite_pyembed_finalise(void)
 {
   int status=0;
   if (python_initialized) {
+    Py_CLEAR(py_get_instance);
+    Py_CLEAR(py_from_capsule);
+    Py_CLEAR(py_scan_plugin);
+    Py_CLEAR(py_view_class);
+    dlite_pyembed_pool_finalise();
     status = Py_FinalizeEx();
     python_initialized = 0;
   } else {
@@ -278,36 +427,76 @@ void *dlite_pyembed_get_address(const char *symbol)
 }
 
 
+/*
+  Imports dlite and caches references to the Python callables used for
+  wrapping instances.  Returns non-zero on error.
+*/
+static int load_callables(void)
+{
+  PyObject *dlite_module=NULL, *swig_module=NULL;
+  int retval=1;
+
+  if (py_get_instance) return 0;
+
+  if (!(dlite_module = PyImport_ImportModule("dlite")))
+    FAIL("cannot import Python package: dlite");
+  if (!(py_get_instance = PyObject_GetAttrString(dlite_module,
+                                                 "get_instance")))
+    FAIL("no such Python function: dlite.get_instance()");
+
+  /* Private functions are not exported to the dlite package.  Older
+     versions of the bindings lack _instance_from_capsule(), in which
+     case we fall back to get_instance(). */
+  if (!(swig_module = PyImport_ImportModule("dlite.dlite")) ||
+      !(py_from_capsule = PyObject_GetAttrString(swig_module,
+                                                 "_instance_from_capsule")))
+    PyErr_Clear();
+  retval = 0;
+ fail:
+  Py_XDECREF(swig_module);
+  Py_XDECREF(dlite_module);
+  return retval;
+}
+
+
 /*
   Returns a Python representation of dlite instance with given id or NULL
   on error.
 */
 PyObject *dlite_pyembed_from_instance(const char *id)
 {
-  PyObject *pyid=NULL, *dlite_name=NULL, *dlite_module=NULL, *dlite_dict=NULL;
-  PyObject *get_instance=NULL, *instance=NULL;
+  PyObject *pyid=NULL, *instance=NULL;
 
+  if (load_callables()) goto fail;
   if (!(pyid = PyUnicode_FromString(id)))
     FAIL("cannot create python string");
+  if (!(instance = PyObject_CallFunctionObjArgs(py_get_instance, pyid, NULL)))
+    FAIL("failure calling dlite.get_instance()");
+ fail:
+  Py_XDECREF(pyid);
+  return instance;
+}
 
-  /* Import dlite */
-  if (!(dlite_name = PyUnicode_FromString("dlite")) ||
-      !(dlite_module = PyImport_Import(dlite_name)))
-    FAIL("cannot import Python package: dlite");
-
-  /* Get reference to Python function get_instance() */
-  if (!(dlite_dict = PyModule_GetDict(dlite_module)) ||
-      !(get_instance = PyDict_GetItemString(dlite_dict, "get_instance")))
-    FAIL("no such Python function: dlite.get_instance()");
 
-  /* Call get_instance() */
-  if (!(instance = PyObject_CallFunctionObjArgs(get_instance, pyid, NULL)))
-    FAIL("failure calling dlite.get_instance()");
+/*
+  Returns a Python representation of `inst` or NULL on error.
 
+  Unlike dlite_pyembed_from_instance(), the instance is passed to
+  Python in a capsule instead of being looked up by its UUID.  This
+  is faster and also works when the caller has its own global state.
+*/
+PyObject *dlite_pyembed_wrap_instance(const DLiteInstance *inst)
+{
+  PyObject *cap=NULL, *instance=NULL;
+
+  if (load_callables()) goto fail;
+  if (!py_from_capsule) return dlite_pyembed_from_instance(inst->uuid);
+  if (!(cap = PyCapsule_New((void *)inst, DLITE_INSTANCE_CAPSULA_NAME, NULL)))
+    FAIL("cannot create instance capsule");
+  if (!(instance = PyObject_CallFunctionObjArgs(py_from_capsule, cap, NULL)))
+    FAIL("failure calling dlite._instance_from_capsule()");
  fail:
-  Py_XDECREF(pyid);
-  Py_XDECREF(dlite_module);
-  Py_XDECREF(dlite_name);
+  Py_XDECREF(cap);
   return instance;
 }
 
@@ -338,6 +527,236 @@ DLiteInstance *dlite_pyembed_get_instance(PyObject *pyinst)
 }
 
 
+/* Writes the numpy dtype string of items of `type` and `size` to `buf`.
+   Returns non-zero if `type` cannot be viewed by numpy. */
+static int numpy_dtype(char *buf, size_t n, DLiteType type, size_t size)
+{
+  switch (type) {
+  case dliteBlob:      snprintf(buf, n, "V%d", (int)size);  return 0;
+  case dliteBool:      snprintf(buf, n, "?");               return 0;
+  case dliteInt:       snprintf(buf, n, "i%d", (int)size);  return 0;
+  case dliteUInt:      snprintf(buf, n, "u%d", (int)size);  return 0;
+  case dliteFloat:     snprintf(buf, n, "f%d", (int)size);  return 0;
+  case dliteFixString: snprintf(buf, n, "S%d", (int)size);  return 0;
+  default:                                                  return 1;
+  }
+}
+
+/*
+  Returns a new reference to a view of `inst` or NULL on error.
+
+  The view is an instance of the Python class InstanceView (see
+  instance_view_code above), which exposes the properties of
+  non-allocated types as numpy arrays sharing memory with `inst`.
+  The numpy arrays are created on first access.  If `writable` is
+  zero, the arrays are read-only.  The dlite.Instance wrapping `inst`
+  is only created if the plugin accesses the `instance` attribute.
+
+  The caller must keep `inst` alive while the view is in use and call
+  dlite_pyembed_instance_view_release() when done with it.
+*/
+PyObject *dlite_pyembed_instance_view(const DLiteInstance *inst,
+                                      int writable)
+{
+  const DLiteMeta *meta = inst->meta;
+  PyObject *dims=NULL, *names=NULL, *buffers=NULL, *key=NULL;
+  PyObject *getter, *view=NULL;
+  size_t i;
+  int j;
+
+  if (load_callables()) goto fail;
+  if (!py_view_class) {
+    PyObject *dict, *ret;
+    if (!(dict = PyDict_New())) FAIL("cannot create dict");
+    if (PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins()) ||
+        !(ret = PyRun_String(instance_view_code, Py_file_input, dict, dict))) {
+      Py_DECREF(dict);
+      dlite_pyembed_err(1, "cannot define InstanceView");
+      goto fail;
+    }
+    Py_DECREF(ret);
+    py_view_class = PyDict_GetItemString(dict, "InstanceView");
+    Py_XINCREF(py_view_class);
+    Py_DECREF(dict);
+    if (!py_view_class) FAIL("cannot define InstanceView");
+  }
+
+  if (!(dims = PyDict_New()) ||
+      !(names = PyTuple_New(meta->_nproperties)) ||
+      !(buffers = PyDict_New()))
+    FAIL("allocation failure");
+  for (i=0; i<meta->_ndimensions; i++) {
+    PyObject *size = PyLong_FromSize_t(DLITE_DIM(inst, i));
+    if (!size || PyDict_SetItemString(dims, meta->_dimensions[i].name,
+                                      size)) {
+      Py_XDECREF(size);
+      FAIL("cannot create dimensions of instance view");
+    }
+    Py_DECREF(size);
+  }
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    PyObject *name, *mv=NULL, *shape=NULL, *buf=NULL;
+    char dtype[16], *data;
+    size_t nmemb=1;
+    if (!(name = PyUnicode_FromString(p->name)))
+      FAIL("cannot create property name");
+    PyTuple_SET_ITEM(names, i, name);  /* steals reference */
+    if (numpy_dtype(dtype, sizeof(dtype), p->type, p->size)) continue;
+    if (!(shape = PyTuple_New(p->ndims))) FAIL("allocation failure");
+    for (j=0; j<p->ndims; j++) {
+      size_t n = DLITE_PROP_DIM(inst, i, j);
+      PyObject *size = PyLong_FromSize_t(n);
+      if (!size) {
+        Py_DECREF(shape);
+        FAIL("allocation failure");
+      }
+      PyTuple_SET_ITEM(shape, j, size);  /* steals reference */
+      nmemb *= n;
+    }
+    data = dlite_instance_get_property_by_index(inst, i);
+    if (!data || nmemb == 0) data = "";
+    if ((mv = PyMemoryView_FromMemory(data, nmemb * p->size,
+                                      (writable) ? PyBUF_WRITE : PyBUF_READ)))
+      buf = Py_BuildValue("(NsN)", mv, dtype, shape);
+    else
+      Py_DECREF(shape);
+    if (!buf || PyDict_SetItem(buffers, name, buf)) {
+      Py_XDECREF(buf);
+      FAIL1("cannot create buffer for property '%s'", p->name);
+    }
+    Py_DECREF(buf);
+  }
+
+  /* Look up the dlite.Instance by capsule if possible, otherwise by
+     UUID */
+  if (py_from_capsule) {
+    getter = py_from_capsule;
+    key = PyCapsule_New((void *)inst, DLITE_INSTANCE_CAPSULA_NAME, NULL);
+  } else {
+    getter = py_get_instance;
+    key = PyUnicode_FromString(inst->uuid);
+  }
+  if (!key) FAIL("cannot create instance key");
+
+  view = PyObject_CallFunction(py_view_class, "szsOOOOO", inst->uuid,
+                               inst->uri, meta->uri, dims, names, buffers,
+                               getter, key);
+  if (!view) dlite_pyembed_err(1, "cannot create view of instance %s",
+                               inst->uuid);
+ fail:
+  Py_XDECREF(dims);
+  Py_XDECREF(names);
+  Py_XDECREF(buffers);
+  Py_XDECREF(key);
+  return view;
+}
+
+
+/*
+  Releases the buffers of `view` and the reference to it, such that
+  arrays kept by the plugin can no longer access the instance.
+*/
+void dlite_pyembed_instance_view_release(PyObject *view)
+{
+  PyObject *v;
+  if (!view) return;
+  if ((v = PyObject_CallMethod(view, "_release", "")))
+    Py_DECREF(v);
+  else
+    PyErr_Clear();
+  Py_DECREF(view);
+}
+
+
+/*
+  Returns a borrowed reference to the dict of the __main__ module, in
+  which the plugins are executed.  The class `baseclassname` is
+  created in the dict if it does not already exists or if `reset` is
+  non-zero.  Returns NULL on error.
+*/
+static PyObject *get_main_dict(const char *baseclassname, int reset)
+{
+  char initcode[96];
+  PyObject *main_module, *main_dict;
+
+  if (!(main_module = PyImport_AddModule("__main__")))
+    return dlite_err(1, "cannot load the embedded Python __main__ module"),
+      NULL;
+  if (!(main_dict = PyModule_GetDict(main_module)))
+    return dlite_err(1, "cannot access __dict__ of the embedded Python "
+                     "__main__ module"), NULL;
+  if (reset || !PyDict_GetItemString(main_dict, baseclassname)) {
+    if (snprintf(initcode, sizeof(initcode), "class %s: pass\n",
+                 baseclassname) < 0)
+      return dlite_err(1, "failure to create initialisation code for "
+                       "embedded Python __main__ module"), NULL;
+    if (PyRun_SimpleString(initcode))
+      return dlite_err(1, "failure when running embedded Python __main__ "
+                       "module initialisation code"), NULL;
+  }
+  return main_dict;
+}
+
+/*
+  Executes the Python file `path` in `main_dict`.  Returns non-zero on
+  error.
+*/
+static int run_plugin_file(PyObject *main_dict, const char *path)
+{
+  int stat;
+  FILE *fp=NULL;
+  char *basename=NULL;
+  PyObject *ppath, *ret;
+
+  if (!(ppath = PyUnicode_FromString(path)))
+    return dlite_err(1, "cannot create Python string from path: '%s'", path);
+  stat = PyDict_SetItemString(main_dict, "__file__", ppath);
+  Py_DECREF(ppath);
+  if (stat)
+    return dlite_err(1, "cannot assign path to '__file__' in dict of main "
+                     "module");
+
+  if (!(basename = fu_basename(path)) || !(fp = fopen(path, "r"))) {
+    if (basename) free(basename);
+    return dlite_err(1, "cannot open plugin: '%s'", path);
+  }
+  ret = PyRun_File(fp, basename, Py_file_input, main_dict, main_dict);
+  free(basename);
+  fclose(fp);
+  if (!ret) return dlite_pyembed_err(1, "error parsing '%s'", path);
+  Py_DECREF(ret);
+  return 0;
+}
+
+
+/* Forward declaration */
+static PyObject *get_subclasses(PyObject *baseclass);
+
+/*
+  Sets the `_dlite_plugin_path` attribute to `path` for the subclasses
+  of `baseclass` that do not define it already.  This records the
+  module defining each plugin class, such that it can be executed in a
+  subinterpreter (see dlite-pyembed-pool.h).
+*/
+static void tag_plugin_classes(PyObject *baseclass, const char *path)
+{
+  Py_ssize_t i;
+  PyObject *lst, *ppath;
+  if (!(lst = get_subclasses(baseclass))) return;
+  if ((ppath = PyUnicode_FromString(path))) {
+    for (i=0; i<PyList_Size(lst); i++) {
+      PyObject *cls = PyList_GetItem(lst, i);
+      PyObject *dict = ((PyTypeObject *)cls)->tp_dict;
+      if (dict && !PyDict_GetItemString(dict, "_dlite_plugin_path"))
+        PyObject_SetAttrString(cls, "_dlite_plugin_path", ppath);
+    }
+    Py_DECREF(ppath);
+  }
+  Py_DECREF(lst);
+  PyErr_Clear();
+}
+
 /*
   This function loads all Python modules found in `paths` and returns
   a list of plugin objects.
@@ -349,10 +768,9 @@ DLiteInstance *dlite_pyembed_get_instance(PyObject *pyinst)
  */
 PyObject *dlite_pyembed_load_plugins(FUPaths *paths, const char *baseclassname)
 {
-  char initcode[96];
   const char *path;
-  PyObject *baseclass=NULL, *main_module=NULL, *main_dict=NULL;
-  PyObject *ppath=NULL, *pfun=NULL, *subclasses=NULL, *lst=NULL;
+  PyObject *baseclass=NULL, *main_dict=NULL;
+  PyObject *pfun=NULL, *subclasses=NULL, *lst=NULL;
   PyObject *subclassnames=NULL;
   FUIter *iter;
   int i;
@@ -361,19 +779,9 @@ PyObject *dlite_pyembed_load_plugins(FUPaths *paths, const char *baseclassname)
   dlite_pyembed_initialise();
 
   /* Inject base class into the __main__ module */
-  if (snprintf(initcode, sizeof(initcode), "class %s: pass\n",
-               baseclassname) < 0)
-    FAIL("failure to create initialisation code for embedded Python "
-         "__main__ module");
-  if (PyRun_SimpleString(initcode))
-    FAIL("failure when running embedded Python __main__ module "
-         "initialisation code");
+  if (!(main_dict = get_main_dict(baseclassname, 1))) goto fail;
 
   /* Extract the base class from the __main__ module */
-  if (!(main_module = PyImport_AddModule("__main__")))
-    FAIL("cannot load the embedded Python __main__ module");
-  if (!(main_dict = PyModule_GetDict(main_module)))
-    FAIL("cannot access __dict__ of the embedded Python __main__ module");
   if (!(baseclass = PyDict_GetItemString(main_dict, baseclassname)))
     FAIL1("cannot get base class '%s' from the main dict", baseclassname);
 
@@ -397,29 +805,9 @@ PyObject *dlite_pyembed_load_plugins(FUPaths *paths, const char *baseclassname)
 
   /* Load all modules in `paths` */
   if (!(iter = fu_pathsiter_init(paths, "*.py"))) goto fail;
-  while ((path = fu_pathsiter_next(iter))) {
-    int stat;
-    FILE *fp=NULL;
-    char *basename=NULL;
-
-    if (!(ppath = PyUnicode_FromString(path)))
-      FAIL1("cannot create Python string from path: '%s'", path);
-    stat = PyDict_SetItemString(main_dict, "__file__", ppath);
-    Py_DECREF(ppath);
-    if (stat) FAIL("cannot assign path to '__file__' in dict of main module");
-
-    if ((basename = fu_basename(path)) && (fp = fopen(path, "r"))) {
-      PyObject *ret = PyRun_File(fp, basename, Py_file_input, main_dict,
-                                 main_dict);
-      free(basename);
-      if (!ret) {
-        dlite_pyembed_err(1, "error parsing '%s'", path);
-      } else {
-        Py_DECREF(ret);
-      }
-      fclose(fp);
-    }
-  }
+  while ((path = fu_pathsiter_next(iter)))
+    if (run_plugin_file(main_dict, path) == 0)
+      tag_plugin_classes(baseclass, path);
   if (fu_pathsiter_deinit(iter)) goto fail;
 
   /* Append new subclasses to the list of Python plugins that will be
@@ -449,3 +837,172 @@ PyObject *dlite_pyembed_load_plugins(FUPaths *paths, const char *baseclassname)
   Py_XDECREF(subclassnames);
   return subclasses;
 }
+
+
+/*
+  Returns a new reference to a list with the direct subclasses of
+  `baseclass` or NULL on error.
+*/
+static PyObject *get_subclasses(PyObject *baseclass)
+{
+  PyObject *pfun, *lst=NULL;
+  if ((pfun = PyObject_GetAttrString(baseclass, "__subclasses__")))
+    lst = PyObject_CallFunctionObjArgs(pfun, NULL);
+  Py_XDECREF(pfun);
+  if (!lst || !PyList_Check(lst)) {
+    Py_XDECREF(lst);
+    return dlite_pyembed_err(1, "cannot get subclasses of plugin base class"),
+      NULL;
+  }
+  return lst;
+}
+
+/*
+  Appends a plugin description for `cls` to `plugins`.  Returns
+  non-zero on error.
+*/
+static int append_imported_plugin(PyObject *plugins, PyObject *cls,
+                                  const char *path)
+{
+  PyObject *name=NULL, *classname=NULL, *plugin=NULL;
+  int retval=1;
+  if (!(classname = PyObject_GetAttrString(cls, "__name__"))) goto fail;
+  if (PyObject_HasAttrString(cls, "name")) {
+    if (!(name = PyObject_GetAttrString(cls, "name"))) goto fail;
+  } else {
+    name = classname;
+    Py_INCREF(name);
+  }
+  if (!(plugin = Py_BuildValue("[OOOsO]", name, Py_None, cls, path,
+                               classname))) goto fail;
+  if (PyList_Append(plugins, plugin)) goto fail;
+  retval = 0;
+ fail:
+  if (retval) dlite_pyembed_err(1, "cannot add plugin from '%s'", path);
+  Py_XDECREF(plugin);
+  Py_XDECREF(name);
+  Py_XDECREF(classname);
+  return retval;
+}
+
+/*
+  Finds the Python plugins in `paths` without importing them, if
+  possible.
+
+  Returns a new reference to a list of plugin descriptions or NULL on
+  error.
+ */
+PyObject *dlite_pyembed_scan_plugins(FUPaths *paths,
+                                     const char *baseclassname)
+{
+  const char *path;
+  PyObject *main_dict, *baseclass, *plugins=NULL, *retval=NULL;
+  FUIter *iter=NULL;
+  Py_ssize_t i;
+
+  dlite_errclr();
+  dlite_pyembed_initialise();
+
+  if (!py_scan_plugin) {
+    PyObject *dict, *ret;
+    if (!(dict = PyDict_New())) FAIL("cannot create dict");
+    if (PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins()) ||
+        !(ret = PyRun_String(scan_plugin_code, Py_file_input, dict, dict))) {
+      Py_DECREF(dict);
+      dlite_pyembed_err(1, "cannot define plugin scanner");
+      goto fail;
+    }
+    Py_DECREF(ret);
+    py_scan_plugin = PyDict_GetItemString(dict, "scan_plugin");
+    Py_XINCREF(py_scan_plugin);
+    Py_DECREF(dict);
+    if (!py_scan_plugin) FAIL("cannot define plugin scanner");
+  }
+
+  if (!(main_dict = get_main_dict(baseclassname, 0))) goto fail;
+  if (!(baseclass = PyDict_GetItemString(main_dict, baseclassname)))
+    FAIL1("cannot get base class '%s' from the main dict", baseclassname);
+  if (!(plugins = PyList_New(0))) FAIL("cannot create list");
+
+  if (!(iter = fu_pathsiter_init(paths, "*.py"))) goto fail;
+  while ((path = fu_pathsiter_next(iter))) {
+    PyObject *found = PyObject_CallFunction(py_scan_plugin, "ss", path,
+                                            baseclassname);
+    if (!found) {
+      dlite_pyembed_err(1, "error scanning '%s'", path);
+      continue;
+    }
+
+    if (found == Py_None) {
+      /* Fall back to importing `path` to find its plugins */
+      PyObject *before=NULL, *after=NULL;
+      if ((before = get_subclasses(baseclass)) &&
+          run_plugin_file(main_dict, path) == 0 &&
+          (after = get_subclasses(baseclass))) {
+        for (i=0; i<PyList_Size(after); i++) {
+          PyObject *cls = PyList_GetItem(after, i);
+          if (PySequence_Contains(before, cls) == 0)
+            append_imported_plugin(plugins, cls, path);
+        }
+      }
+      Py_XDECREF(before);
+      Py_XDECREF(after);
+
+    } else {
+      for (i=0; i<PySequence_Size(found); i++) {
+        PyObject *item = PySequence_GetItem(found, i), *plugin=NULL;
+        PyObject *name, *methods, *classname;
+        if (item && PyArg_ParseTuple(item, "OOO", &name, &methods,
+                                     &classname) &&
+            (plugin = Py_BuildValue("[OOOsO]", name, methods, Py_None,
+                                    path, classname)))
+          PyList_Append(plugins, plugin);
+        else
+          dlite_pyembed_err(1, "invalid plugin description from '%s'", path);
+        Py_XDECREF(plugin);
+        Py_XDECREF(item);
+      }
+    }
+    Py_DECREF(found);
+  }
+  retval = plugins;
+ fail:
+  if (iter && fu_pathsiter_deinit(iter)) retval = NULL;
+  if (!retval) Py_XDECREF(plugins);
+  return retval;
+}
+
+
+/*
+  Returns a borrowed reference to the class of `plugin`, which is a
+  plugin description returned by dlite_pyembed_scan_plugins().  The
+  module defining the class is imported if needed.
+
+  Returns NULL on error.
+ */
+PyObject *dlite_pyembed_plugin_class(PyObject *plugin,
+                                     const char *baseclassname)
+{
+  PyObject *cls, *main_dict;
+  const char *path, *classname;
+
+  if (!PyList_Check(plugin) || PyList_Size(plugin) != 5)
+    return dlite_err(1, "invalid plugin description"), NULL;
+  if ((cls = PyList_GetItem(plugin, 2)) != Py_None) return cls;
+
+  path = PyUnicode_AsUTF8(PyList_GetItem(plugin, 3));
+  classname = PyUnicode_AsUTF8(PyList_GetItem(plugin, 4));
+  if (!path || !classname)
+    return dlite_pyembed_err(1, "invalid plugin description"), NULL;
+
+  if (!(main_dict = get_main_dict(baseclassname, 0))) return NULL;
+  if (run_plugin_file(main_dict, path)) return NULL;
+  if (!(cls = PyDict_GetItemString(main_dict, classname)) ||
+      !PyType_Check(cls))
+    return dlite_err(1, "plugin '%s' does not define class '%s'",
+                     path, classname), NULL;
+  Py_INCREF(cls);
+  if (PyList_SetItem(plugin, 2, cls))  /* steals the reference */
+    return dlite_pyembed_err(1, "cannot update plugin description"), NULL;
+  return cls;
+}
@@ -36,6 +36,16 @@ int fu_endmatch(FUIter *iter);
 */
 void dlite_pyembed_initialise(void);
 
+/**
+  Initialises the embedded Python environment if needed and ensures
+  that the calling thread holds the global interpreter lock (GIL).
+  The returned state should be passed to PyGILState_Release().
+
+  The Python bindings release the GIL while doing storage I/O and
+  mappings, so all callbacks from C into Python must acquire it.
+*/
+PyGILState_STATE dlite_pyembed_gil_ensure(void);
+
 /**
   Finalises the embedded Python environment.
 */
@@ -90,12 +100,42 @@ void *dlite_pyembed_get_address(const char *symbol);
 */
 PyObject *dlite_pyembed_from_instance(const char *id);
 
+/**
+  Returns a Python representation of `inst` or NULL on error.
+
+  The instance is passed to Python by pointer, which avoids the lookup
+  by UUID done by dlite_pyembed_from_instance().  The Python callables
+  are imported once and cached until dlite_pyembed_finalise() is called.
+*/
+PyObject *dlite_pyembed_wrap_instance(const DLiteInstance *inst);
+
 /**
   Returns a new reference to DLite instance from Python representation
   or NULL on error.
 */
 DLiteInstance *dlite_pyembed_get_instance(PyObject *pyinst);
 
+/**
+  Returns a new reference to a lightweight view of `inst` or NULL on
+  error.
+
+  The view has the attributes `uuid`, `uri`, `meta` (metadata URI),
+  `dims` (tuple of dimension sizes), `dimensions` (dict) and `names`.
+  Indexing it with a property name returns a numpy array sharing
+  memory with `inst` for properties of non-allocated types.  The
+  arrays are read-only unless `writable` is non-zero.
+
+  The caller must keep `inst` alive while the view is in use and
+  release it with dlite_pyembed_instance_view_release().
+*/
+PyObject *dlite_pyembed_instance_view(const DLiteInstance *inst,
+                                      int writable);
+
+/**
+  Releases `view` and its buffers.
+*/
+void dlite_pyembed_instance_view_release(PyObject *view);
+
 
 /**
   This function loads all Python modules found in `paths` and returns
@@ -108,5 +148,40 @@ DLiteInstance *dlite_pyembed_get_instance(PyObject *pyinst);
  */
 PyObject *dlite_pyembed_load_plugins(FUPaths *paths, const char *baseclassname);
 
+/**
+  Like dlite_pyembed_load_plugins(), but avoids importing the Python
+  modules in `paths`.
+
+  Each module is scanned with the Python `ast` module for classes
+  deriving directly from `baseclassname`.  Modules for which this is
+  not conclusive (e.g. if the plugin class also has other base classes
+  or if its `name` attribute is not a string literal) are imported.
+
+  Returns a new reference to a list of plugin descriptions or NULL on
+  error.  Each plugin description is a list
+
+      [name, methods, cls, path, classname]
+
+  where `name` is the plugin name (the `name` class attribute or the
+  class name), `methods` is a tuple with the names of the methods
+  defined by the class, or None if the module is imported, `cls` is
+  the class or None if its module is not imported yet, `path` is the
+  path to the module and `classname` is the name of the class.
+
+  Use dlite_pyembed_plugin_class() to get the class.
+ */
+PyObject *dlite_pyembed_scan_plugins(FUPaths *paths,
+                                     const char *baseclassname);
+
+/**
+  Returns a borrowed reference to the class of `plugin`, which is a
+  plugin description returned by dlite_pyembed_scan_plugins().  The
+  module defining the class is imported on the first call.
+
+  Returns NULL on error.
+ */
+PyObject *dlite_pyembed_plugin_class(PyObject *plugin,
+                                     const char *baseclassname);
+
 
 #endif /* _DLITE_PYEMBED_H */
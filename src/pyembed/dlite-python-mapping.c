@@ -14,7 +14,9 @@
 #include "dlite-macros.h"
 #include "dlite-misc.h"
 #include "dlite-mapping-plugins.h"
+#include "dlite-json.h"
 #include "dlite-pyembed.h"
+#include "dlite-pyembed-pool.h"
 #include "dlite-python-mapping.h"
 
 
@@ -26,6 +28,15 @@ static unsigned char mapping_plugin_path_hash[32];
 /* A cache with all loaded plugins */
 static PyObject *loaded_mappings = NULL;
 
+/* Mapping plugin API with additional info about the Python plugin */
+typedef struct {
+  DLiteMappingPlugin api;  /* must be the first member */
+  char *path;              /* module of a subinterpreter-safe plugin */
+  char *classname;         /* class name of the plugin */
+  PyObject *map;           /* cached map() method */
+  PyObject *map_many;      /* cached map_many() method or NULL */
+} PythonMapping;
+
 /* Prototype for function converting `inst` to a Python object.
    Returns a new reference or NULL on error. */
 typedef PyObject *(*InstanceConverter)(DLiteInstance *inst);
@@ -142,10 +153,12 @@ void *dlite_python_mapping_load(void)
   fu_pathsiter_deinit(iter);
   if (memcmp(mapping_plugin_path_hash, hash,
              sizeof(mapping_plugin_path_hash)) != 0) {
+    PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
     if (loaded_mappings) dlite_python_mapping_unload();
     loaded_mappings = dlite_pyembed_load_plugins((FUPaths *)paths,
                                                  "DLiteMappingBase");
     memcpy(mapping_plugin_path_hash, hash, sizeof(mapping_plugin_path_hash));
+    PyGILState_Release(gstate);
   }
   return (void *)loaded_mappings;
 }
@@ -160,6 +173,58 @@ void dlite_python_mapping_unload(void)
 }
 
 
+/*
+   Calls Python method map() of a subinterpreter-safe plugin in the
+   subinterpreter pool.
+
+   The input instances are passed to map() as a list of dicts in the
+   DLite JSON format.  map() should return the output instance in the
+   same format.
+ */
+static DLiteInstance *pool_mapper(const PythonMapping *pm,
+                                  const DLiteInstance **instances, int n)
+{
+  int i;
+  size_t len=2, pos=0;
+  char **jsons=NULL, *arg=NULL, *result=NULL;
+  DLiteInstance *inst=NULL;
+  dlite_errclr();
+
+  /* Serialise input instances to a JSON array */
+  if (!(jsons = calloc(n, sizeof(char *))))
+    FAIL("allocation failure");
+  for (i=0; i<n; i++) {
+    if (!(jsons[i] = dlite_json_aprint(instances[i], 0, dliteJsonWithUuid)))
+      goto fail;
+    len += strlen(jsons[i]) + 1;
+  }
+  if (!(arg = malloc(len))) FAIL("allocation failure");
+  arg[pos++] = '[';
+  for (i=0; i<n; i++) {
+    size_t m = strlen(jsons[i]);
+    if (i) arg[pos++] = ',';
+    memcpy(arg + pos, jsons[i], m);
+    pos += m;
+  }
+  arg[pos++] = ']';
+  arg[pos] = '\0';
+
+  if (!(result = dlite_pyembed_pool_call(pm->path, pm->classname,
+                                         "DLiteMappingBase", "map", arg)))
+    goto fail;
+  inst = dlite_json_sscan(result, NULL, pm->api.output_uri);
+
+ fail:
+  if (jsons) {
+    for (i=0; i<n; i++) if (jsons[i]) free(jsons[i]);
+    free(jsons);
+  }
+  if (arg) free(arg);
+  if (result) free(result);
+  for (i=0; i<n; i++) dlite_instance_decref((DLiteInstance *)instances[i]);
+  return inst;
+}
+
 /*
    Wraps Python method map() into a DLite Mapper.
  */
@@ -167,10 +232,14 @@ static DLiteInstance *mapper(const DLiteMappingPlugin *api,
                              const DLiteInstance **instances, int n)
 {
   int i;
-  const char *classname, *uuid;
+  const PythonMapping *pm = (const PythonMapping *)api;
+  const char *classname = pm->classname;
   DLiteInstance *inst=NULL;
-  PyObject *map=NULL, *insts=NULL, *outinst=NULL, *pyuuid=NULL;
+  PyObject *insts=NULL, *outinst=NULL;
   PyObject *plugin = (PyObject *)api->data;
+  PyGILState_STATE gstate;
+  if (pm->path) return pool_mapper(pm, instances, n);
+  gstate = dlite_pyembed_gil_ensure();
   assert(plugin);
   dlite_errclr();
 
@@ -179,52 +248,114 @@ static DLiteInstance *mapper(const DLiteMappingPlugin *api,
     FAIL("failed to create list");
   for (i=0; i<n; i++) {
     PyObject *pyinst;
-    if (!(pyinst = dlite_pyembed_from_instance(instances[i]->uuid))) goto fail;
-    PyList_SetItem(insts, i, pyinst);
+    if (!(pyinst = dlite_pyembed_wrap_instance(instances[i]))) goto fail;
+    PyList_SET_ITEM(insts, i, pyinst);
   }
 
-  /* Call Python map() method */
-  if (!(classname = dlite_pyembed_classname(plugin)))
-    dlite_warnx("cannot get class name for plugin %p", (void *)plugin);
-  if (!(map = PyObject_GetAttrString(plugin, "map")))
-    FAIL1("plugin '%s' has no method: 'map'", classname);
-  if (!PyCallable_Check(map))
-    FAIL1("attribute 'map' of plugin '%s' is not callable", classname);
-  if (!(outinst = PyObject_CallFunctionObjArgs(map, plugin, insts, NULL))) {
+  /* Call the cached Python map() method */
+  if (!(outinst = PyObject_CallFunctionObjArgs(pm->map, plugin, insts,
+                                               NULL))) {
     dlite_pyembed_err(1, "error calling %s.map()", classname);
     goto fail;
   }
 
-  /* Extract uuid from returned `outinst` object and get corresponding
-     C instance */
-  if (!(pyuuid = PyObject_GetAttrString(outinst, "uuid")))
-    FAIL("output instance has no such attribute: uuid");
-  if (!PyUnicode_Check(pyuuid) || !(uuid = PyUnicode_AsUTF8(pyuuid)))
-    FAIL("cannot convert uuid");
-  if (!(inst = dlite_instance_get(uuid)))
-    FAIL1("no such instance: %s", uuid);
+  /* Get the C instance wrapped by the returned `outinst` object */
+  if (!(inst = dlite_pyembed_get_instance(outinst)))
+    FAIL1("%s.map() must return a dlite instance", classname);
 
  fail:
-  Py_XDECREF(pyuuid);
   Py_XDECREF(outinst);
   Py_XDECREF(insts);
-  Py_XDECREF(map);
   for (i=0; i<n; i++) dlite_instance_decref((DLiteInstance *)instances[i]);
   if (inst) dlite_meta_decref((DLiteMeta *)inst->meta);  // @todo - correct?
+  PyGILState_Release(gstate);
   return inst;
 }
 
+/*
+   Wraps Python method map_many() into a DLite MapperMany.
+
+   map_many() is called with a list of `n` lists of input instances and
+   should return a sequence of `n` output instances.
+ */
+static int mapper_many(const DLiteMappingPlugin *api,
+                       const DLiteInstance **instances, size_t n,
+                       DLiteInstance **out)
+{
+  size_t i, nout=0;
+  int j, retval=1, k=api->ninput;
+  const PythonMapping *pm = (const PythonMapping *)api;
+  const char *classname = pm->classname;
+  PyObject *sets=NULL, *outinsts=NULL;
+  PyObject *plugin = (PyObject *)api->data;
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
+  assert(plugin);
+  dlite_errclr();
+
+  /* Creates Python list of lists of input instances */
+  if (!(sets = PyList_New(n)))
+    FAIL("failed to create list");
+  for (i=0; i<n; i++) {
+    PyObject *insts;
+    if (!(insts = PyList_New(k))) FAIL("failed to create list");
+    PyList_SET_ITEM(sets, i, insts);
+    for (j=0; j<k; j++) {
+      PyObject *pyinst;
+      if (!(pyinst = dlite_pyembed_wrap_instance(instances[i*k + j])))
+        goto fail;
+      PyList_SET_ITEM(insts, j, pyinst);
+    }
+  }
+
+  /* Call the cached Python map_many() method */
+  if (!(outinsts = PyObject_CallFunctionObjArgs(pm->map_many, plugin, sets,
+                                                NULL))) {
+    dlite_pyembed_err(1, "error calling %s.map_many()", classname);
+    goto fail;
+  }
+  if (!PySequence_Check(outinsts) || PySequence_Length(outinsts) != (int)n)
+    FAIL2("%s.map_many() must return a sequence of %d instances",
+          classname, (int)n);
+
+  /* Get C instances corresponding to the returned Python instances */
+  for (nout=0; nout<n; nout++) {
+    PyObject *outinst;
+    DLiteInstance *inst=NULL;
+    if ((outinst = PySequence_GetItem(outinsts, nout)))
+      inst = dlite_pyembed_get_instance(outinst);
+    Py_XDECREF(outinst);
+    if (!inst) FAIL2("cannot get output instance %d from %s.map_many()",
+                     (int)nout, classname);
+    dlite_meta_decref((DLiteMeta *)inst->meta);  // consistent with mapper()
+    out[nout] = inst;
+  }
+  retval = 0;
+
+ fail:
+  Py_XDECREF(outinsts);
+  Py_XDECREF(sets);
+  if (retval)
+    for (i=0; i<nout; i++) dlite_instance_decref(out[i]);
+  PyGILState_Release(gstate);
+  return retval;
+}
+
 /*
   Free's internal resources in `api`.
 */
 static void freeapi(PluginAPI *api)
 {
-  DLiteMappingPlugin *p = (DLiteMappingPlugin *)api;
+  PythonMapping *pm = (PythonMapping *)api;
+  DLiteMappingPlugin *p = &pm->api;
   free(p->name);
   free((char *)p->output_uri);
   free((char **)p->input_uris);
   Py_XDECREF(p->data);
-  free(p);
+  Py_XDECREF(pm->map);
+  Py_XDECREF(pm->map_many);
+  if (pm->path) free(pm->path);
+  if (pm->classname) free(pm->classname);
+  free(pm);
 }
 
 
@@ -272,17 +403,26 @@ const void *dlite_python_mapping_get_api(const char *name)
   If there are more APIs, `*iter` will be increased by one.
 
   Default cost is 25.
+
+  Plugins with a true `subinterpreter_safe` class attribute are called
+  in the subinterpreter pool (see dlite-pyembed-pool.h) if it is
+  enabled.  They are flagged as thread safe, such that independent
+  mappings are executed in parallel.
 */
 const DLiteMappingPlugin *get_dlite_mapping_api(void *state, int *iter)
 {
   int i, n, cost=25;
+  PythonMapping *pm=NULL;
   DLiteMappingPlugin *api=NULL, *retval=NULL;
   PyObject *mappings=NULL, *cls=NULL;
   PyObject *name=NULL, *out_uri=NULL, *in_uris=NULL, *map=NULL, *pcost=NULL;
+  PyObject *map_many=NULL, *safe=NULL, *ppath=NULL;
   const char *output_uri=NULL, **input_uris=NULL, *classname=NULL;
   char *apiname=NULL;
+  PyGILState_STATE gstate;
 
   dlite_globals_set(state);
+  gstate = dlite_pyembed_gil_ensure();
 
   if (!(mappings = dlite_python_mapping_load())) goto fail;
   assert(PyList_Check(mappings));
@@ -336,8 +476,9 @@ const DLiteMappingPlugin *get_dlite_mapping_api(void *state, int *iter)
   if ((pcost = PyObject_GetAttrString(cls, "cost")) && PyLong_Check(pcost))
     cost = PyLong_AsLong(pcost);
 
-  if (!(api = calloc(1, sizeof(DLiteMappingPlugin))))
+  if (!(pm = calloc(1, sizeof(PythonMapping))))
     FAIL("allocation failure");
+  api = &pm->api;
 
   apiname = strdup(PyUnicode_AsUTF8(name));
   output_uri = strdup(PyUnicode_AsUTF8(out_uri));
@@ -349,9 +490,37 @@ const DLiteMappingPlugin *get_dlite_mapping_api(void *state, int *iter)
   api->input_uris = input_uris;
   api->mapper = mapper;
   api->cost = cost;
+  if (classname) pm->classname = strdup(classname);
+
+  /* Cache the bound methods to avoid attribute lookups for each call */
+  pm->map = map;
+  Py_INCREF(map);
+  if ((map_many = PyObject_GetAttrString(cls, "map_many")) &&
+      PyCallable_Check(map_many)) {
+    api->mapper_many = mapper_many;
+    pm->map_many = map_many;
+    Py_INCREF(map_many);
+  } else
+    PyErr_Clear();
   api->data = (void *)cls;
   Py_INCREF(cls);
 
+  /* Subinterpreter-safe plugins are called one input set at a time
+     in the subinterpreter pool */
+  if ((safe = PyObject_GetAttrString(cls, "subinterpreter_safe")) &&
+      PyObject_IsTrue(safe) == 1 && dlite_pyembed_pool_size() > 0) {
+    if ((ppath = PyObject_GetAttrString(cls, "_dlite_plugin_path")) &&
+        PyUnicode_Check(ppath) && classname) {
+      pm->path = strdup(PyUnicode_AsUTF8(ppath));
+      api->mapper_many = NULL;
+      api->flags |= dliteMappingThreadSafe;
+    } else {
+      dlite_warnx("cannot call mapping '%s' in a subinterpreter, since the "
+                  "module defining it is unknown", classname);
+    }
+  }
+  PyErr_Clear();
+
   retval = api;
  fail:
   Py_XDECREF(name);
@@ -359,11 +528,15 @@ const DLiteMappingPlugin *get_dlite_mapping_api(void *state, int *iter)
   Py_XDECREF(in_uris);
   Py_XDECREF(map);
   Py_XDECREF(pcost);
+  Py_XDECREF(map_many);
+  Py_XDECREF(safe);
+  Py_XDECREF(ppath);
   if (!retval) {
     if (name) free(name);
     if (output_uri) free((char *)output_uri);
     if (input_uris) free((char **)input_uris);
-    if (api) free(api);
+    if (pm) free(pm);
   }
+  PyGILState_Release(gstate);
   return retval;
 }
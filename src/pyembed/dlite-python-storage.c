@@ -4,6 +4,7 @@
 #include <Python.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* Python pulls in a lot of defines that conflicts with utils/config.h */
 #define SKIP_UTILS_CONFIG_H
@@ -14,6 +15,7 @@
 #include "dlite-macros.h"
 #include "dlite-misc.h"
 #include "dlite-storage-plugins.h"
+#include "pathshash.h"
 #include "dlite-pyembed.h"
 #include "dlite-python-storage.h"
 
@@ -29,7 +31,9 @@ typedef struct {
   FUPaths paths;              /* Python storage paths */
   int initialised;            /* Whether `paths` is initiated */
   int modified;               /* Whether `paths` is modified */
-  PyObject *loaded_storages;  /* Cache with all loaded python storage plugins */
+  PyObject *loaded_storages;  /* Descriptions of current storage plugins */
+  PyObject *cache;            /* Maps hash of `paths` to plugin descriptions */
+  unsigned char hash[32];     /* Hash of `paths` for `loaded_storages` */
 } PythonStorageGlobals;
 
 
@@ -40,7 +44,10 @@ static void free_globals(void *globals)
   if (g->initialised) fu_paths_deinit(&g->paths);
 
   /* Do not call Py_DECREF if we are in an atexit handler */
-  if (!dlite_globals_in_atexit()) Py_XDECREF(g->loaded_storages);
+  if (!dlite_globals_in_atexit()) {
+    Py_XDECREF(g->loaded_storages);
+    Py_XDECREF(g->cache);
+  }
 
   free(g);
 }
@@ -165,25 +172,73 @@ const char **dlite_python_storage_paths_get(void)
 
 
 /*
-  Loads all Python storages (if needed).
+  Finds all Python storages (if needed).
 
-  Returns a borrowed reference to a list of storage plugins (casted to
-  void *) or NULL on error.
+  Returns a borrowed reference to a list of storage plugin descriptions
+  (casted to void *) or NULL on error.
 */
 void *dlite_python_storage_load(void)
 {
   PythonStorageGlobals *g = get_globals();
-  if (!g->loaded_storages || g->modified) {
-    const FUPaths *paths;
-    if (g->loaded_storages) dlite_python_storage_unload();
-    if (!(paths = dlite_python_storage_paths())) return NULL;
-    g->loaded_storages = dlite_pyembed_load_plugins((FUPaths *)paths,
-                                                 "DLiteStorageBase");
+  const FUPaths *paths;
+  unsigned char hash[32];
+  PyGILState_STATE gstate;
+  PyObject *key=NULL, *plugins;
+
+  if (!(paths = dlite_python_storage_paths())) return NULL;
+  if (pathshash(hash, sizeof(hash), paths)) return NULL;
+  if (g->loaded_storages && !g->modified &&
+      memcmp(hash, g->hash, sizeof(hash)) == 0)
+    return (void *)g->loaded_storages;
+
+  gstate = dlite_pyembed_gil_ensure();
+  if (g->loaded_storages) dlite_python_storage_unload();
+  if (!g->cache && !(g->cache = PyDict_New()))
+    FAIL("cannot create cache for Python storage plugins");
+  if (!(key = PyBytes_FromStringAndSize((char *)hash, sizeof(hash))))
+    FAIL("cannot create key for Python storage plugins");
+  if (!(plugins = PyDict_GetItem(g->cache, key))) {
+    if (!(plugins = dlite_pyembed_scan_plugins((FUPaths *)paths,
+                                               "DLiteStorageBase")))
+      goto fail;
+    if (PyDict_SetItem(g->cache, key, plugins)) {
+      Py_DECREF(plugins);
+      FAIL("cannot cache Python storage plugins");
+    }
+  } else {
+    Py_INCREF(plugins);
   }
+  g->loaded_storages = plugins;
+  memcpy(g->hash, hash, sizeof(hash));
+  g->modified = 0;
+ fail:
+  Py_XDECREF(key);
+  PyGILState_Release(gstate);
   return (void *)g->loaded_storages;
 }
 
-/* Unloads all currently loaded storages. */
+/*
+  Returns a borrowed reference to the class implementing the storage
+  plugin described by `plugin` (casted to void *).  The Python module
+  of the plugin is imported on the first call.
+
+  Returns NULL on error.
+*/
+void *dlite_python_storage_get_class(void *plugin)
+{
+  void *cls;
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
+  cls = dlite_pyembed_plugin_class((PyObject *)plugin, "DLiteStorageBase");
+  PyGILState_Release(gstate);
+  return cls;
+}
+
+/*
+  Unloads all currently loaded storages.
+
+  Plugin descriptions remain cached, such that the storage paths are
+  not scanned again unless they change.
+*/
 void dlite_python_storage_unload(void)
 {
   PythonStorageGlobals *g = get_globals();
@@ -49,13 +49,26 @@ const char **dlite_python_storage_paths_get(void);
 
 
 /**
-  Loads all Python storages (if needed).
+  Finds all Python storages (if needed).
 
-  Returns a borrowed reference to a list of storage plugins (casted to
-  void *) or NULL on error.
+  The storage paths are scanned for plugins without importing their
+  modules, see dlite_pyembed_scan_plugins().  The result is cached per
+  hash of the storage paths.
+
+  Returns a borrowed reference to a list of storage plugin descriptions
+  (casted to void *) or NULL on error.
 */
 void *dlite_python_storage_load(void);
 
+/**
+  Returns a borrowed reference to the class implementing the storage
+  plugin described by `plugin` (casted to void *).  The Python module
+  of the plugin is imported on the first call.
+
+  Returns NULL on error.
+*/
+void *dlite_python_storage_get_class(void *plugin);
+
 /**
   Unloads all currently loaded storages.
 */
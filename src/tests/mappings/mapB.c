@@ -0,0 +1,63 @@
+#include "utils/err.h"
+
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-mapping-plugins.h"
+
+
+static DLiteInstance *mapper(const DLiteMappingPlugin *api,
+                             const DLiteInstance **instances, int n)
+{
+  const DLiteInstance *inst1;
+  DLiteInstance *inst3;
+  int *p;
+  float c;
+
+  UNUSED(api);
+  UNUSED(n);
+
+  inst1 = instances[0];
+
+  if (!(inst3 = dlite_instance_create_from_id("http://onto-ns.com/meta/0.1/ent3",
+                                              NULL, NULL))) return NULL;
+
+  p = dlite_instance_get_property(inst1, "a");
+  c = *p * 2.0f;
+  dlite_instance_set_property(inst3, "c", &c);
+  return inst3;
+}
+
+
+static int mapper_many(const DLiteMappingPlugin *api,
+                       const DLiteInstance **instances, size_t n,
+                       DLiteInstance **out)
+{
+  size_t i;
+  for (i=0; i<n; i++) {
+    if (!(out[i] = mapper(api, instances + i, 1))) {
+      while (i > 0) dlite_instance_decref(out[--i]);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+DSL_EXPORT const DLiteMappingPlugin *get_dlite_mapping_api(void *state, int *iter)
+{
+  static DLiteMappingPlugin api;
+  static const char *input_uris[] = { "http://onto-ns.com/meta/0.1/ent1" };
+  UNUSED(iter);
+
+  dlite_globals_set(state);
+
+  api.name = "mapB";
+  api.output_uri = "http://onto-ns.com/meta/0.1/ent3";
+  api.ninput = 1;
+  api.input_uris = input_uris;
+  api.mapper = mapper;
+  api.cost = 20;
+  api.flags = dliteMappingThreadSafe;
+  api.mapper_many = mapper_many;
+  return &api;
+}
@@ -0,0 +1,52 @@
+#include "utils/err.h"
+
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-mapping-plugins.h"
+
+
+static DLiteInstance *mapper(const DLiteMappingPlugin *api,
+                             const DLiteInstance **instances, int n)
+{
+  const DLiteInstance *inst2, *inst3;
+  DLiteInstance *inst4;
+  int *b, d;
+  float *c;
+
+  UNUSED(api);
+  UNUSED(n);
+
+  inst2 = instances[0];
+  inst3 = instances[1];
+
+  if (!(inst4 = dlite_instance_create_from_id("http://onto-ns.com/meta/0.1/ent4",
+                                              NULL, NULL))) return NULL;
+
+  b = dlite_instance_get_property(inst2, "b");
+  c = dlite_instance_get_property(inst3, "c");
+  d = *b + (int)*c;
+  dlite_instance_set_property(inst4, "d", &d);
+  return inst4;
+}
+
+
+DSL_EXPORT const DLiteMappingPlugin *get_dlite_mapping_api(void *state, int *iter)
+{
+  static DLiteMappingPlugin api;
+  static const char *input_uris[] = {
+    "http://onto-ns.com/meta/0.1/ent2",
+    "http://onto-ns.com/meta/0.1/ent3"
+  };
+  UNUSED(iter);
+
+  dlite_globals_set(state);
+
+  api.name = "mapC";
+  api.output_uri = "http://onto-ns.com/meta/0.1/ent4";
+  api.ninput = 2;
+  api.input_uris = input_uris;
+  api.mapper = mapper;
+  api.cost = 20;
+  api.flags = dliteMappingThreadSafe;
+  return &api;
+}
@@ -43,6 +43,35 @@ MU_TEST(test_load_modules)
 }
 
 
+MU_TEST(test_scan_plugins)
+{
+  FUPaths paths;
+  PyObject *plugins, *plugin, *cls;
+
+  fu_paths_init(&paths, "DLITE_PYTHON_MAPPING_PLUGIN_DIRS");
+  fu_paths_insert(&paths, STRINGIFY(TESTDIR), 0);
+
+  plugins = dlite_pyembed_scan_plugins(&paths, "DLiteMappingBase");
+  mu_check(plugins);
+  mu_assert_int_eq(2, (int)PyList_Size(plugins));
+
+  /* plugin1.py is scanned, but not imported */
+  plugin = PyList_GetItem(plugins, 0);
+  mu_assert_string_eq("plugin1",
+                      PyUnicode_AsUTF8(PyList_GetItem(plugin, 0)));
+  mu_check(PyList_GetItem(plugin, 2) == Py_None);
+  mu_check(PySequence_Size(PyList_GetItem(plugin, 1)) == 1);
+
+  cls = dlite_pyembed_plugin_class(plugin, "DLiteMappingBase");
+  mu_check(cls);
+  mu_assert_string_eq("plugin1", dlite_pyembed_classname(cls));
+  mu_check(PyList_GetItem(plugin, 2) == cls);
+
+  fu_paths_deinit(&paths);
+  Py_DECREF(plugins);
+}
+
+
 MU_TEST(test_get_address)
 {
   /* FIXME - enable this test on Windows */
@@ -99,6 +128,7 @@ MU_TEST_SUITE(test_suite)
 {
   MU_RUN_TEST(test_add_dll_path);
   MU_RUN_TEST(test_load_modules);
+  MU_RUN_TEST(test_scan_plugins);
   MU_RUN_TEST(test_get_address);
   MU_RUN_TEST(test_get_instance);
   MU_RUN_TEST(test_finalize);
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "config.h"
 
@@ -219,6 +221,170 @@ MU_TEST(test_array_transpose)
 }
 
 
+/* Returns non-zero if the elements of `a` equals the C-contiguous
+   data `q` when iterating over `a`. */
+static int equals_iter(const DLiteArray *a, const int *q)
+{
+  DLiteArrayIter iter;
+  int *p, equal=1;
+  dlite_array_iter_init(&iter, a);
+  while ((p = dlite_array_iter_next(&iter)))
+    if (*p != *(q++)) equal = 0;
+  dlite_array_iter_deinit(&iter);
+  return equal;
+}
+
+MU_TEST(test_array_copy)
+{
+  size_t i, dims[] = {5, 70, 45}, n=5*70*45;
+  int *buf, *out, start[] = {1, 0, 0}, step[] = {2, -1, 3};
+  DLiteArray *a, *b, *t, *s, *c;
+
+  mu_check((buf = malloc(n * sizeof(int))));
+  mu_check((out = malloc(n * sizeof(int))));
+  for (i=0; i<n; i++) buf[i] = i;
+  mu_check((a = dlite_array_create(buf, dliteInt, sizeof(int), 3, dims)));
+  mu_check((t = dlite_array_transpose(a)));
+  mu_check((s = dlite_array_slice(a, start, NULL, step)));
+
+  /* contiguous */
+  mu_check((b = dlite_array_create(out, dliteInt, sizeof(int), 3, a->dims)));
+  mu_assert_int_eq(0, dlite_array_copy(b, a));
+  mu_check(memcmp(buf, out, n * sizeof(int)) == 0);
+  dlite_array_free(b);
+
+  /* transposed and sliced */
+  mu_check((b = dlite_array_create(out, dliteInt, sizeof(int), 3, t->dims)));
+  mu_assert_int_eq(0, dlite_array_copy(b, t));
+  mu_check(equals_iter(t, out));
+  dlite_array_free(b);
+
+  mu_check((b = dlite_array_create(out, dliteInt, sizeof(int), 3, s->dims)));
+  mu_assert_int_eq(0, dlite_array_copy(b, s));
+  mu_check(equals_iter(s, out));
+
+  dlite_array_free(b);
+
+  /* copy to non-contiguous destination */
+  memset(out, 0, n * sizeof(int));
+  mu_check((b = dlite_array_create(out, dliteInt, sizeof(int), 3, dims)));
+  mu_check((c = dlite_array_transpose(b)));
+  mu_assert_int_eq(0, dlite_array_copy(c, t));
+  mu_check(memcmp(buf, out, n * sizeof(int)) == 0);
+  dlite_array_free(b);
+
+  /* mismatching dimensions */
+  mu_check(dlite_array_copy(c, a));
+  dlite_errclr();
+  dlite_array_free(c);
+
+  /* make_continuous() of transposed array */
+  mu_check(dlite_array_make_continuous(t));
+  mu_check(dlite_array_is_continuous(t));
+  mu_assert_int_eq(1, *((int *)dlite_array_vindex(t, 1, 0, 0)));
+  mu_assert_int_eq(45, *((int *)dlite_array_vindex(t, 0, 1, 0)));
+  mu_assert_int_eq(70*45, *((int *)dlite_array_vindex(t, 0, 0, 1)));
+  mu_check(equals_iter(t, t->data));
+  free(t->data);
+
+  dlite_array_free(t);
+  dlite_array_free(s);
+  dlite_array_free(a);
+  free(out);
+  free(buf);
+}
+
+
+MU_TEST(test_array_transpose_inplace)
+{
+  size_t i, j, n=37, dims[] = {37, 37}, dims2[] = {2, 3};
+  double *buf;
+  DLiteArray *a;
+
+  mu_check((buf = malloc(n * n * sizeof(double))));
+  for (i=0; i<n*n; i++) buf[i] = i;
+  mu_check((a = dlite_array_create(buf, dliteFloat, sizeof(double), 2, dims)));
+  mu_assert_int_eq(0, dlite_array_transpose_inplace(a));
+  for (i=0; i<n; i++)
+    for (j=0; j<n; j++)
+      mu_assert_double_eq(j*n + i, buf[i*n + j]);
+  dlite_array_free(a);
+
+  mu_check((a = dlite_array_create(buf, dliteFloat, sizeof(double), 2, dims2)));
+  mu_check(dlite_array_transpose_inplace(a));
+  dlite_errclr();
+  dlite_array_free(a);
+  free(buf);
+}
+
+
+MU_TEST(test_array_kernels)
+{
+  double v[10], w[10], r;
+  float f[10];
+  int16_t k[6] = {3, -1, 4, 1, -5, 9};
+  bool mask[10];
+  size_t i, dims[]={10}, kdims[]={2, 3};
+  int start[]={0, 0}, step[]={1, 2};
+  DLiteArray *a, *b, *c, *s, *t;
+  for (i=0; i<10; i++) f[i] = v[i] = w[i] = i - 2.5;
+
+  mu_check((a = dlite_array_create(v, dliteFloat, sizeof(double), 1, dims)));
+  mu_check((b = dlite_array_create(f, dliteFloat, sizeof(float), 1, dims)));
+  mu_check((c = dlite_array_create(k, dliteInt, sizeof(int16_t), 2, kdims)));
+  mu_check((t = dlite_array_transpose(c)));
+  mu_check((s = dlite_array_slice(c, start, NULL, step)));
+
+  /* reductions */
+  mu_assert_int_eq(0, dlite_array_reduce(a, dliteArraySum, &r));
+  mu_assert_double_eq(20.0, r);
+  mu_assert_int_eq(0, dlite_array_reduce(a, dliteArrayMin, &r));
+  mu_assert_double_eq(-2.5, r);
+  mu_assert_int_eq(0, dlite_array_reduce(b, dliteArrayMax, &r));
+  mu_assert_double_eq(6.5, r);
+  mu_assert_int_eq(0, dlite_array_reduce(b, dliteArrayMean, &r));
+  mu_assert_double_eq(2.0, r);
+  mu_assert_int_eq(0, dlite_array_reduce(t, dliteArrayMin, &r));
+  mu_assert_double_eq(-5.0, r);
+  mu_assert_int_eq(0, dlite_array_reduce(s, dliteArraySum, &r));
+  mu_assert_double_eq(3 + 4 + 1 + 9, r);
+
+  /* masks */
+  mu_assert_int_eq(0, dlite_array_mask(a, dliteArrayGe, 0.0, mask));
+  for (i=0; i<10; i++) mu_assert_int_eq(i >= 3, mask[i]);
+  mu_assert_int_eq(0, dlite_array_mask(t, dliteArrayLt, 0.0, mask));
+  mu_assert_int_eq(0, mask[0]);  /* 3 */
+  mu_assert_int_eq(0, mask[1]);  /* 1 */
+  mu_assert_int_eq(1, mask[2]);  /* -1 */
+  mu_assert_int_eq(1, mask[3]);  /* -5 */
+
+  /* scale and axpy */
+  mu_assert_int_eq(0, dlite_array_scale(a, 2.0, 1.0));
+  mu_assert_int_eq(0, dlite_array_scale(b, 2.0, 1.0));
+  for (i=0; i<10; i++) mu_assert_double_eq(2*w[i] + 1, v[i]);
+  mu_assert_int_eq(1, dlite_array_compare_tol(a, b, 0.0, 0.0));
+  mu_assert_int_eq(0, dlite_array_axpy(a, -1.0, b));
+  for (i=0; i<10; i++) mu_assert_double_eq(0.0, v[i]);
+  mu_assert_int_eq(0, dlite_array_scale(s, 0.5, 0.0));
+  mu_assert_int_eq(2, k[0]);  /* 1.5 rounded to nearest */
+  mu_assert_int_eq(-1, k[1]);
+  mu_assert_int_eq(2, k[2]);
+
+  /* comparison with tolerance */
+  for (i=0; i<10; i++) v[i] = f[i] * (1 + 1e-9);
+  mu_assert_int_eq(0, dlite_array_compare(a, b));
+  mu_assert_int_eq(1, dlite_array_compare_tol(a, b, 1e-6, 0.0));
+  mu_assert_int_eq(0, dlite_array_compare_tol(a, b, 1e-12, 0.0));
+  mu_assert_int_eq(0, dlite_array_compare_tol(a, c, 1.0, 1.0));
+
+  dlite_array_free(s);
+  dlite_array_free(t);
+  dlite_array_free(c);
+  dlite_array_free(b);
+  dlite_array_free(a);
+}
+
+
 MU_TEST(test_array_free)
 {
   dlite_array_free(arr);
@@ -237,6 +403,9 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_array_slice);
   MU_RUN_TEST(test_array_reshape);
   MU_RUN_TEST(test_array_transpose);
+  MU_RUN_TEST(test_array_copy);
+  MU_RUN_TEST(test_array_transpose_inplace);
+  MU_RUN_TEST(test_array_kernels);
   MU_RUN_TEST(test_array_free);      /* tear down */
 }
 
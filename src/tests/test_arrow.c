@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "minunit/minunit.h"
+#include "utils/boolean.h"
+#include "dlite.h"
+#include "dlite-arrow.h"
+
+#define NINST 3
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/ArrowEntity";
+char *uri2 = "http://www.sintef.no/meta/dlite/0.1/ArrowEntity2";
+DLiteMeta *entity=NULL;
+DLiteMeta *entity2=NULL;
+DLiteInstance *instances[NINST];
+
+
+MU_TEST(test_setup)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims unit iri  descr */
+    {"flag",   dliteBool,      sizeof(bool),   0, NULL, "",  NULL, "A flag."},
+    {"value",  dliteInt,       sizeof(int),    0, NULL, "",  NULL, "A value."},
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "",  NULL, "A name."},
+    {"label",  dliteFixString, 8,              0, NULL, "",  NULL, "A label."},
+    {"items",  dliteFloat,     sizeof(double), 1, dims, "m", NULL, "Items."}
+  };
+  DLiteProperty properties2[] = {
+    /* name    type            size            ndims dims unit iri  descr */
+    {"value",  dliteInt,       8,              0, NULL, "",  NULL, "A value."},
+    {"items",  dliteFloat,     4,              1, dims, "m", NULL, "Items."},
+    {"extra",  dliteInt,       4,              0, NULL, "",  NULL, "Unset."}
+  };
+  char *names[] = {"first", NULL, "third"};
+  char label[8] = "label";
+  int i;
+
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, NULL,
+                                                    "Arrow entity.",
+                                                    1, dimensions,
+                                                    5, properties)));
+  mu_check((entity2 = (DLiteMeta *)dlite_meta_create(uri2, NULL,
+                                                     "Arrow entity 2.",
+                                                     1, dimensions,
+                                                     3, properties2)));
+  for (i=0; i<NINST; i++) {
+    size_t shape[] = {i + 1};
+    bool flag = i % 2;
+    int j, value = 10*i;
+    double *items;
+    mu_check((instances[i] = dlite_instance_create(entity, shape, NULL)));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i], "flag",
+                                                    &flag));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i], "value",
+                                                    &value));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i], "name",
+                                                    names + i));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i], "label",
+                                                    label));
+    items = dlite_instance_get_property(instances[i], "items");
+    for (j=0; j<=i; j++) items[j] = i + 0.5*j;
+  }
+}
+
+MU_TEST(test_export)
+{
+  struct ArrowSchema schema;
+  struct ArrowArray array;
+  const struct ArrowArray *a;
+  const unsigned char *bits;
+  const int32_t *offsets;
+  const double *items;
+
+  mu_assert_int_eq(0, dlite_arrow_export(NULL, instances, NINST,
+                                         &schema, &array));
+  mu_assert_string_eq("+s", schema.format);
+  mu_assert_int_eq(5, schema.n_children);
+  mu_assert_int_eq(NINST, array.length);
+  mu_assert_int_eq(5, array.n_children);
+
+  mu_assert_string_eq("flag", schema.children[0]->name);
+  mu_assert_string_eq("b", schema.children[0]->format);
+  bits = array.children[0]->buffers[1];
+  mu_assert_int_eq(2, bits[0]);
+
+  mu_assert_string_eq("i", schema.children[1]->format);
+  mu_assert_int_eq(20, ((int *)array.children[1]->buffers[1])[2]);
+
+  mu_assert_string_eq("u", schema.children[2]->format);
+  a = array.children[2];
+  mu_assert_int_eq(1, a->null_count);
+  offsets = a->buffers[1];
+  mu_assert_int_eq(0, offsets[0]);
+  mu_assert_int_eq(5, offsets[1]);
+  mu_assert_int_eq(5, offsets[2]);
+  mu_assert_int_eq(10, offsets[3]);
+  mu_check(strncmp("firstthird", a->buffers[2], 10) == 0);
+
+  mu_assert_string_eq("u", schema.children[3]->format);
+  mu_assert_int_eq(15, ((int32_t *)array.children[3]->buffers[1])[3]);
+
+  mu_assert_string_eq("+l", schema.children[4]->format);
+  mu_assert_string_eq("g", schema.children[4]->children[0]->format);
+  a = array.children[4];
+  offsets = a->buffers[1];
+  mu_assert_int_eq(1, offsets[1]);
+  mu_assert_int_eq(6, offsets[3]);
+  mu_assert_int_eq(6, a->children[0]->length);
+  items = a->children[0]->buffers[1];
+  mu_assert_double_eq(0.0, items[0]);
+  mu_assert_double_eq(1.5, items[2]);
+  mu_assert_double_eq(3.0, items[5]);
+
+  schema.release(&schema);
+  array.release(&array);
+  mu_check(schema.release == NULL);
+  mu_check(array.release == NULL);
+}
+
+MU_TEST(test_import)
+{
+  struct ArrowSchema schema;
+  struct ArrowArray array;
+  DLiteInstance **insts;
+  size_t i, n;
+
+  mu_assert_int_eq(0, dlite_arrow_export(NULL, instances, NINST,
+                                         &schema, &array));
+  mu_check((insts = dlite_arrow_import(entity, &schema, &array, &n)));
+  mu_assert_int_eq(NINST, n);
+  for (i=0; i<n; i++) {
+    DLiteInstance *inst = insts[i];
+    char **name = dlite_instance_get_property(inst, "name");
+    char **name0 = dlite_instance_get_property(instances[i], "name");
+    double *items = dlite_instance_get_property(inst, "items");
+    mu_assert_int_eq(i + 1, DLITE_DIM(inst, 0));
+    mu_assert_int_eq(i % 2, *(bool *)dlite_instance_get_property(inst,
+                                                                 "flag"));
+    mu_assert_int_eq(10*i, *(int *)dlite_instance_get_property(inst,
+                                                               "value"));
+    if (*name0)
+      mu_assert_string_eq(*name0, *name);
+    else
+      mu_check(*name == NULL);
+    mu_assert_string_eq("label", dlite_instance_get_property(inst, "label"));
+    mu_assert_double_eq(i + 0.5*i, items[i]);
+    dlite_instance_decref(inst);
+  }
+  free(insts);
+
+  /* Import to other metadata with casting */
+  mu_check((insts = dlite_arrow_import(entity2, &schema, &array, &n)));
+  mu_assert_int_eq(NINST, n);
+  for (i=0; i<n; i++) {
+    DLiteInstance *inst = insts[i];
+    float *items = dlite_instance_get_property(inst, "items");
+    mu_assert_int_eq(10*i, *(int64_t *)dlite_instance_get_property(inst,
+                                                                   "value"));
+    mu_assert_int_eq(0, *(int32_t *)dlite_instance_get_property(inst,
+                                                                "extra"));
+    mu_assert_double_eq(i + 0.5*i, items[i]);
+    dlite_instance_decref(inst);
+  }
+  free(insts);
+
+  schema.release(&schema);
+  array.release(&array);
+}
+
+MU_TEST(test_empty)
+{
+  struct ArrowSchema schema;
+  struct ArrowArray array;
+  DLiteInstance **insts;
+  size_t n=1;
+
+  mu_check(dlite_arrow_export(NULL, instances, 0, &schema, &array));
+  mu_assert_int_eq(0, dlite_arrow_export(entity, instances, 0,
+                                         &schema, &array));
+  mu_assert_int_eq(0, array.length);
+  mu_check((insts = dlite_arrow_import(entity, &schema, &array, &n)));
+  mu_assert_int_eq(0, n);
+  free(insts);
+  schema.release(&schema);
+  array.release(&array);
+}
+
+MU_TEST(test_teardown)
+{
+  int i;
+  for (i=0; i<NINST; i++) dlite_instance_decref(instances[i]);
+  dlite_meta_decref(entity);
+  dlite_meta_decref(entity2);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);     /* setup */
+  MU_RUN_TEST(test_export);
+  MU_RUN_TEST(test_import);
+  MU_RUN_TEST(test_empty);
+  MU_RUN_TEST(test_teardown);  /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,417 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#endif
+
+#include "minunit/minunit.h"
+#include "dlite.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-async.h"
+
+#define NINST 8
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/AsyncEntity";
+char *filename = "test-async.json";
+DLiteMeta *entity=NULL;
+char uuids[NINST][DLITE_UUID_LENGTH+1];
+
+
+MU_TEST(test_setup)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri   descr */
+    {"value",  dliteInt,   sizeof(int),    0, NULL, "",   NULL, "A value."},
+    {"items",  dliteFloat, sizeof(double), 1, dims, "m",  NULL, "Items."}
+  };
+
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Async entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    2, properties)));
+}
+
+MU_TEST(test_save_async)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  DLiteFuture *futures[NINST];
+  size_t shape[] = {3};
+  int i;
+
+  mu_check((s = dlite_storage_open("json", filename, "mode=w")));
+  for (i=0; i<NINST; i++) {
+    double *items;
+    mu_check((inst = dlite_instance_create(entity, shape, NULL)));
+    strcpy(uuids[i], inst->uuid);
+    mu_assert_int_eq(0, dlite_instance_set_property(inst, "value", &i));
+    items = dlite_instance_get_property(inst, "items");
+    items[0] = items[1] = items[2] = 0.5 * i;
+    mu_check((futures[i] = dlite_instance_save_async(s, inst)));
+
+    /* the future keeps the instance alive until it is saved */
+    dlite_instance_decref(inst);
+  }
+
+  /* the last save completes after all previous ones */
+  mu_assert_int_eq(0, dlite_future_wait(futures[NINST-1]));
+  for (i=0; i<NINST; i++) {
+    mu_assert_int_eq(1, dlite_future_poll(futures[i]));
+    mu_assert_int_eq(0, dlite_future_wait(futures[i]));
+    mu_check(!dlite_future_errmsg(futures[i]));
+    dlite_future_free(futures[i]);
+  }
+  for (i=0; i<NINST; i++)
+    mu_check(!dlite_instance_has(uuids[i], 0));
+
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_load_async)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  DLiteFuture *futures[NINST];
+  int i, value;
+
+  mu_check((s = dlite_storage_open("json", filename, "mode=r")));
+  for (i=0; i<NINST; i++)
+    mu_check((futures[i] = dlite_instance_load_async(s, uuids[i])));
+  mu_assert_int_eq(0, dlite_storage_wait(s));
+
+  for (i=0; i<NINST; i++) {
+    double *items;
+    mu_assert_int_eq(1, dlite_future_poll(futures[i]));
+    mu_check((inst = dlite_future_get_instance(futures[i])));
+    mu_assert_string_eq(uuids[i], inst->uuid);
+    value = *(int *)dlite_instance_get_property(inst, "value");
+    mu_assert_int_eq(i, value);
+    items = dlite_instance_get_property(inst, "items");
+    mu_assert_double_eq(0.5 * i, items[2]);
+    dlite_future_free(futures[i]);
+
+    /* the future held the other reference */
+    mu_assert_int_eq(1, inst->_refcount);
+    dlite_instance_decref(inst);
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+#ifndef _WIN32
+MU_TEST(test_notify_fd)
+{
+  DLiteStorage *s;
+  DLiteFuture *futures[NINST];
+  int i, n=0, fds[2];
+  char buf[NINST];
+
+  mu_assert_int_eq(0, pipe(fds));
+  mu_check((s = dlite_storage_open("json", filename, "mode=r")));
+  for (i=0; i<NINST; i++) {
+    mu_check((futures[i] = dlite_instance_load_async(s, uuids[i])));
+    mu_assert_int_eq(0, dlite_future_notify_fd(futures[i], fds[1]));
+  }
+
+  /* one byte is written per completed operation */
+  while (n < NINST) {
+    ssize_t m = read(fds[0], buf, NINST - n);
+    mu_check(m > 0);
+    n += m;
+  }
+  for (i=0; i<NINST; i++) {
+    mu_assert_int_eq(1, dlite_future_poll(futures[i]));
+    dlite_future_free(futures[i]);
+  }
+
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  close(fds[0]);
+  close(fds[1]);
+}
+#endif
+
+MU_TEST(test_close_pending)
+{
+  DLiteStorage *s;
+  DLiteFuture *futures[NINST];
+  int i;
+
+  /* closing the storage waits for the pending operations */
+  mu_check((s = dlite_storage_open("json", filename, "mode=r")));
+  for (i=0; i<NINST; i++)
+    mu_check((futures[i] = dlite_instance_load_async(s, uuids[i])));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  for (i=0; i<NINST; i++) {
+    DLiteInstance *inst;
+    mu_assert_int_eq(1, dlite_future_poll(futures[i]));
+    mu_check((inst = dlite_future_get_instance(futures[i])));
+    dlite_future_free(futures[i]);
+    dlite_instance_decref(inst);
+  }
+}
+
+MU_TEST(test_error)
+{
+  DLiteStorage *s;
+  DLiteFuture *future;
+  const char *msg;
+
+  mu_check((s = dlite_storage_open("json", filename, "mode=r")));
+  mu_check((future = dlite_instance_load_async(s, "non-existing-id")));
+  mu_check(dlite_future_wait(future));
+  mu_check(!dlite_future_get_instance(future));
+  mu_check((msg = dlite_future_errmsg(future)));
+  mu_check(strlen(msg) > 0);
+  dlite_future_free(future);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_instance_iter)
+{
+  DLiteStorage *s;
+  DLiteInstanceIter *iter;
+  DLiteInstance *inst;
+  int i, n=0, seen[NINST];
+
+  memset(seen, 0, sizeof(seen));
+  mu_check((s = dlite_storage_open("json", filename, "mode=r")));
+
+  /* window smaller than the number of instances */
+  mu_check((iter = dlite_storage_instance_iter_create(s, uri, 3)));
+  while (dlite_storage_instance_iter_next(iter, &inst) == 0) {
+    for (i=0; i<NINST; i++)
+      if (strcmp(inst->uuid, uuids[i]) == 0) break;
+    mu_check(i < NINST);
+    mu_assert_int_eq(i, *(int *)dlite_instance_get_property(inst, "value"));
+    seen[i]++;
+    n++;
+    dlite_instance_decref(inst);
+  }
+  mu_assert_int_eq(NINST, n);
+  for (i=0; i<NINST; i++) mu_assert_int_eq(1, seen[i]);
+  mu_assert_int_eq(1, dlite_storage_instance_iter_next(iter, &inst));
+  mu_check(!inst);
+  dlite_storage_instance_iter_free(iter);
+
+  /* no matching metadata */
+  mu_check((iter = dlite_storage_instance_iter_create(s, "http://x/y", 0)));
+  mu_assert_int_eq(1, dlite_storage_instance_iter_next(iter, &inst));
+  dlite_storage_instance_iter_free(iter);
+
+  /* free with pending loads */
+  mu_check((iter = dlite_storage_instance_iter_create(s, NULL, 0)));
+  mu_assert_int_eq(0, dlite_storage_instance_iter_next(iter, &inst));
+  dlite_instance_decref(inst);
+  dlite_storage_instance_iter_free(iter);
+
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+#ifndef _WIN32
+/* Completion-based api wrapping the json plugin.  Requests are queued
+   and completed in reverse order by async_poll(), which is woken up
+   by a byte written to a pipe for each request. */
+typedef struct {
+  int save;
+  DLiteInstance *inst;
+  char id[DLITE_UUID_LENGTH+1];
+  DLiteAsyncCallback callback;
+  void *userdata;
+} Request;
+
+Request requests[NINST];
+int nrequests=0, npolls=0;
+int pipefds[2];
+const DLiteStoragePlugin *json_api=NULL;
+DLiteStoragePlugin async_api;
+
+static int load_async(const DLiteStorage *s, const char *uuid,
+                      DLiteAsyncCallback callback, void *userdata)
+{
+  Request *r = requests + nrequests;
+  char c=0;
+  (void)s;
+  if (nrequests >= NINST || write(pipefds[1], &c, 1) != 1) return 1;
+  memset(r, 0, sizeof(Request));
+  strncpy(r->id, uuid, DLITE_UUID_LENGTH);
+  r->callback = callback;
+  r->userdata = userdata;
+  nrequests++;
+  return 0;
+}
+
+static int save_async(DLiteStorage *s, const DLiteInstance *inst,
+                      DLiteAsyncCallback callback, void *userdata)
+{
+  Request *r = requests + nrequests;
+  char c=0;
+  (void)s;
+  if (nrequests >= NINST || write(pipefds[1], &c, 1) != 1) return 1;
+  memset(r, 0, sizeof(Request));
+  r->save = 1;
+  r->inst = (DLiteInstance *)inst;
+  r->callback = callback;
+  r->userdata = userdata;
+  nrequests++;
+  return 0;
+}
+
+static int async_fd(const DLiteStorage *s)
+{
+  (void)s;
+  return pipefds[0];
+}
+
+static int async_poll(DLiteStorage *s, int timeout)
+{
+  struct pollfd pfd;
+  char buf[NINST];
+  int n=0;
+  npolls++;
+  pfd.fd = pipefds[0];
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, timeout) <= 0) return 0;
+  if (read(pipefds[0], buf, sizeof(buf)) <= 0) return -1;
+  while (nrequests > 0) {
+    Request *r = requests + --nrequests;
+    if (r->save) {
+      r->callback(json_api->saveInstance(s, r->inst), r->inst, r->userdata);
+    } else {
+      DLiteInstance *inst = json_api->loadInstance(s, r->id);
+      r->callback((inst) ? 0 : 1, inst, r->userdata);
+    }
+    n++;
+  }
+  return n;
+}
+
+/* Opens a json storage that uses the completion-based api. */
+static DLiteStorage *open_native(const char *location, const char *options)
+{
+  DLiteStorage *s = dlite_storage_open("json", location, options);
+  if (!s) return NULL;
+  json_api = s->api;
+  async_api = *json_api;
+  async_api.loadInstanceAsync = load_async;
+  async_api.saveInstanceAsync = save_async;
+  async_api.asyncFd = async_fd;
+  async_api.asyncPoll = async_poll;
+  s->api = &async_api;
+  return s;
+}
+
+MU_TEST(test_native)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  DLiteFuture *futures[NINST], *future;
+  size_t shape[] = {2};
+  char saved[NINST][DLITE_UUID_LENGTH+1];
+  int i, n;
+
+  mu_assert_int_eq(0, pipe(pipefds));
+
+  /* loads are completed when an event loop polls the storage */
+  mu_check((s = open_native(filename, "mode=r")));
+  mu_assert_int_eq(pipefds[0], dlite_storage_async_fd(s));
+  for (i=0; i<NINST; i++)
+    mu_check((futures[i] = dlite_instance_load_async(s, uuids[i])));
+  mu_assert_int_eq(NINST, nrequests);
+  mu_assert_int_eq(NINST, dlite_storage_async_poll(s, 1000));
+  mu_assert_int_eq(0, dlite_storage_async_poll(s, 0));
+  for (i=0; i<NINST; i++) {
+    mu_assert_int_eq(1, dlite_future_poll(futures[i]));
+    mu_check((inst = dlite_future_get_instance(futures[i])));
+    mu_assert_string_eq(uuids[i], inst->uuid);
+    mu_assert_int_eq(i, *(int *)dlite_instance_get_property(inst, "value"));
+    dlite_future_free(futures[i]);
+    mu_assert_int_eq(1, inst->_refcount);
+    dlite_instance_decref(inst);
+  }
+
+  /* waiting for a future drives the plugin */
+  n = npolls;
+  mu_check((future = dlite_instance_load_async(s, uuids[1])));
+  mu_check((inst = dlite_future_get_instance(future)));
+  mu_assert_int_eq(1, *(int *)dlite_instance_get_property(inst, "value"));
+  mu_check(npolls > n);
+  dlite_future_free(future);
+  dlite_instance_decref(inst);
+
+  /* errors are reported via the future */
+  mu_check((future = dlite_instance_load_async(s, "non-existing-id")));
+  mu_check(dlite_future_wait(future));
+  mu_check(dlite_future_errmsg(future));
+  dlite_future_free(future);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* closing the storage completes pending saves */
+  mu_check((s = open_native("test-async-native.json", "mode=w")));
+  for (i=0; i<NINST; i++) {
+    mu_check((inst = dlite_instance_create(entity, shape, NULL)));
+    strcpy(saved[i], inst->uuid);
+    mu_assert_int_eq(0, dlite_instance_set_property(inst, "value", &i));
+    mu_check((futures[i] = dlite_instance_save_async(s, inst)));
+    dlite_instance_decref(inst);
+  }
+  mu_assert_int_eq(NINST, nrequests);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_assert_int_eq(0, nrequests);
+  for (i=0; i<NINST; i++) {
+    mu_assert_int_eq(0, dlite_future_wait(futures[i]));
+    dlite_future_free(futures[i]);
+  }
+
+  mu_check((s = dlite_storage_open("json", "test-async-native.json",
+                                   "mode=r")));
+  for (i=0; i<NINST; i++) {
+    mu_check((inst = dlite_instance_load(s, saved[i])));
+    mu_assert_int_eq(i, *(int *)dlite_instance_get_property(inst, "value"));
+    dlite_instance_decref(inst);
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  close(pipefds[0]);
+  close(pipefds[1]);
+}
+#endif
+
+MU_TEST(test_teardown)
+{
+  dlite_meta_decref(entity);  /* refs: global */
+  dlite_meta_decref(entity);  /* refs: store */
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);
+  MU_RUN_TEST(test_save_async);
+  MU_RUN_TEST(test_load_async);
+#ifndef _WIN32
+  MU_RUN_TEST(test_notify_fd);
+#endif
+  MU_RUN_TEST(test_close_pending);
+  MU_RUN_TEST(test_error);
+  MU_RUN_TEST(test_instance_iter);
+#ifndef _WIN32
+  MU_RUN_TEST(test_native);
+#endif
+  MU_RUN_TEST(test_teardown);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "utils/fileinfo.h"
+#include "dlite.h"
+#include "dlite-bloom.h"
+#include "dlite-stats.h"
+
+#include "minunit/minunit.h"
+
+#define N 1000
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/BloomEntity";
+char *afile = "test-bloom-a.json";
+char *bfile = "test-bloom-b.json";
+char *bloomfile = "test-bloom.bloom";
+DLiteMeta *entity=NULL;
+
+
+/* Returns the number of json storages opened since the last reset. */
+static int json_opens(void)
+{
+  DLiteStats stats;
+  size_t i;
+  int n=0;
+  if (dlite_stats_get(&stats)) return -1;
+  for (i=0; i < stats.ndrivers; i++)
+    if (strcmp(stats.drivers[i].driver, "json") == 0)
+      n = (int)stats.drivers[i].counters[dliteStatsOpens];
+  dlite_stats_deinit(&stats);
+  return n;
+}
+
+/* Saves new instances with the `n` ids in `ids` to json file
+   `filename` opened with `options`. */
+static int save(const char *filename, const char *options, char **ids, int n)
+{
+  DLiteStorage *s;
+  size_t dims[] = {2};
+  int i, stat=0;
+  if (!(s = dlite_storage_open("json", filename, options))) return 1;
+  for (i=0; i<n; i++) {
+    DLiteInstance *inst = dlite_instance_create(entity, dims, ids[i]);
+    if (!inst || dlite_instance_save(s, inst)) stat = 1;
+    if (inst) dlite_instance_decref(inst);
+  }
+  if (dlite_storage_close(s)) stat = 1;
+  return stat;
+}
+
+
+MU_TEST(test_setup)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri   descr */
+    {"items",  dliteFloat, sizeof(double), 1, dims, "m",  NULL, "Items."}
+  };
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Bloom entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    1, properties)));
+  remove(afile);
+  remove(bfile);
+}
+
+MU_TEST(test_filter)
+{
+  DLiteBloom *b, *b2;
+  char id[32];
+  double mtime;
+  long long size;
+  int i, nfalse=0;
+
+  mu_check((b = dlite_bloom_create(N)));
+  for (i=0; i<N; i++) {
+    snprintf(id, sizeof(id), "id-%d", i);
+    mu_assert_int_eq(0, dlite_bloom_add(b, id));
+  }
+  for (i=0; i<N; i++) {
+    snprintf(id, sizeof(id), "id-%d", i);
+    mu_check(dlite_bloom_contains(b, id));
+  }
+  for (i=N; i<11*N; i++) {
+    snprintf(id, sizeof(id), "id-%d", i);
+    if (dlite_bloom_contains(b, id)) nfalse++;
+  }
+  mu_check(nfalse < 10*N/50);  /* false positive rate below 2% */
+
+  /* write and read */
+  mu_assert_int_eq(0, dlite_bloom_write(b, bloomfile, 12.5, 42));
+  mu_check((b2 = dlite_bloom_read(bloomfile, &mtime, &size)));
+  mu_assert_double_eq(12.5, mtime);
+  mu_assert_int_eq(42, size);
+  for (i=0; i<11*N; i++) {
+    snprintf(id, sizeof(id), "id-%d", i);
+    mu_assert_int_eq(dlite_bloom_contains(b, id), dlite_bloom_contains(b2, id));
+  }
+  dlite_bloom_free(b2);
+  dlite_bloom_free(b);
+
+  /* invalid files */
+  err_set_stream(NULL);
+  mu_check(!dlite_bloom_read("non-existing.bloom", NULL, NULL));
+  mu_check(!dlite_bloom_read(__FILE__, NULL, NULL));
+  err_set_stream(stderr);
+  err_clear();
+  remove(bloomfile);
+}
+
+MU_TEST(test_sidecar)
+{
+  char *aids[] = {"bloom-inst-1"};
+  char *bids[] = {"bloom-inst-2", "bloom-inst-3"};
+  char *sidecar;
+
+  /* no sidecar by default */
+  mu_assert_int_eq(0, save(afile, "mode=w", aids, 1));
+  mu_check((sidecar = dlite_bloom_sidecar(afile)));
+  mu_check(!fileinfo_exists(sidecar));
+  mu_check(!dlite_bloom_available(afile));
+  mu_check(!dlite_bloom_excludes(afile, "bloom-inst-2"));
+
+  /* written on close with bloom=yes */
+  mu_assert_int_eq(0, save(afile, "mode=w;bloom=yes", aids, 1));
+  mu_check(fileinfo_exists(sidecar));
+  mu_check(dlite_bloom_available(afile));
+  mu_check(!dlite_bloom_excludes(afile, "bloom-inst-1"));
+  mu_check(dlite_bloom_excludes(afile, "bloom-inst-2"));
+
+  /* an existing sidecar is kept up to date */
+  mu_assert_int_eq(0, save(afile, "mode=w", bids, 2));
+  mu_check(dlite_bloom_available(afile));
+  mu_check(dlite_bloom_excludes(afile, "bloom-inst-1"));
+  mu_check(!dlite_bloom_excludes(afile, "bloom-inst-2"));
+  mu_check(!dlite_bloom_excludes(afile, "bloom-inst-3"));
+
+  /* ...unless bloom=no, which leaves it outdated and unused */
+  mu_assert_int_eq(0, save(afile, "mode=w;bloom=no", aids, 1));
+  mu_check(fileinfo_exists(sidecar));
+  mu_check(!dlite_bloom_available(afile));
+  mu_check(!dlite_bloom_excludes(afile, "bloom-inst-2"));
+
+  remove(sidecar);
+  free(sidecar);
+}
+
+MU_TEST(test_lookup)
+{
+  char *aids[] = {"bloom-inst-1"};
+  char *bids[] = {"bloom-inst-2", "bloom-inst-3"};
+  char *cids[] = {"bloom-inst-4"};
+  DLiteInstance *inst;
+
+  mu_assert_int_eq(0, save(afile, "mode=w;bloom=yes", aids, 1));
+  mu_assert_int_eq(0, save(bfile, "mode=w;bloom=yes", bids, 2));
+  mu_check(dlite_storage_paths_append(afile) >= 0);
+  mu_check(dlite_storage_paths_append(bfile) >= 0);
+
+  /* only the storage holding the instance is opened */
+  dlite_stats_reset();
+  mu_check((inst = dlite_instance_get("bloom-inst-3")));
+  mu_assert_int_eq(1, json_opens());
+  dlite_instance_decref(inst);
+
+  /* no storage is opened for a missing instance */
+  dlite_stats_reset();
+  err_set_stream(NULL);
+  mu_check(!dlite_instance_get("bloom-inst-missing"));
+  err_set_stream(stderr);
+  err_clear();
+  mu_assert_int_eq(0, json_opens());
+
+  /* outdated sidecars are not used */
+  mu_assert_int_eq(0, save(afile, "mode=w;bloom=no", cids, 1));
+  mu_check(!dlite_bloom_available(afile));
+  mu_check((inst = dlite_instance_get("bloom-inst-4")));
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_teardown)
+{
+  char *sidecar;
+  dlite_meta_decref(entity);
+  if ((sidecar = dlite_bloom_sidecar(afile))) {
+    remove(sidecar);
+    free(sidecar);
+  }
+  if ((sidecar = dlite_bloom_sidecar(bfile))) {
+    remove(sidecar);
+    free(sidecar);
+  }
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);
+  MU_RUN_TEST(test_filter);
+  MU_RUN_TEST(test_sidecar);
+  MU_RUN_TEST(test_lookup);
+  MU_RUN_TEST(test_teardown);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
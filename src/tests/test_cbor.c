@@ -0,0 +1,171 @@
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-cbor.h"
+
+#include "minunit/minunit.h"
+
+
+DLiteInstance *inst=NULL;
+DLiteMeta *meta=NULL;
+
+
+MU_TEST(test_load)
+{
+  char *url;
+  url="json://"STRINGIFY(dlite_SOURCE_DIR)"/src/tests/test-entity.json?mode=r";
+  meta = dlite_meta_load_url(url);
+  mu_check(meta);
+
+  url="json://" STRINGIFY(dlite_SOURCE_DIR) "/src/tests/test-data.json?mode=r"
+    "#e076a856-e36e-5335-967e-2f2fd153c17d";
+  inst = dlite_instance_load_url(url);
+  mu_check(inst);
+}
+
+
+MU_TEST(test_roundtrip)
+{
+  unsigned char *buf, small[16];
+  char *json, *json2;
+  size_t len;
+  int *arr;
+  DLiteInstance *inst2;
+
+  mu_check((buf = dlite_cbor_aprint(inst, &len)));
+  mu_assert_int_eq((int)len, dlite_cbor_sprint(small, sizeof(small), inst));
+  mu_assert_int_eq((int)len, dlite_cbor_item_size(buf, len));
+  mu_assert_int_eq(-1, dlite_cbor_item_size(buf, len - 1));
+
+  /* myarray is written as a typed int32 array in a multi-dim array */
+  mu_check(memmem(buf, len, "\xd8\x28\x82\x83\x02\x01\x03", 7));
+
+  json = dlite_json_aprint(inst, 0, dliteJsonWithUuid);
+  dlite_instance_decref(inst);
+  mu_check((inst = dlite_cbor_sscan(buf, len, NULL)));
+  json2 = dlite_json_aprint(inst, 0, dliteJsonWithUuid);
+  mu_assert_string_eq(json, json2);
+  arr = dlite_instance_get_property(inst, "myarray");
+  mu_assert_int_eq(4, arr[3]);
+
+  /* wrong id */
+  err_set_stream(NULL);
+  mu_check(!dlite_cbor_sscan(buf, len, "http://onto-ns.com/data/other"));
+  mu_check(!dlite_cbor_sscan(buf, len - 1, NULL));
+  err_set_stream(stderr);
+  err_clear();
+
+  /* with existing id */
+  dlite_instance_incref(inst);
+  mu_check((inst2 = dlite_cbor_sscan(buf, len, inst->uuid)));
+  dlite_instance_decref(inst2);
+
+  free(json);
+  free(json2);
+  free(buf);
+}
+
+
+MU_TEST(test_meta)
+{
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri  descr */
+    {"flag",   dliteBool,  sizeof(bool),   0,    NULL, "",  NULL, "Flag."},
+    {"values", dliteFloat, sizeof(double), 1,    dims, "m", NULL, "Values."},
+    {"names",  dliteStringPtr, sizeof(char *), 1, dims, NULL, NULL, "Names."}
+  };
+  char *uri = "http://onto-ns.com/meta/0.1/CborEntity";
+  char *uri2 = "http://onto-ns.com/meta/0.1/CborEntitz";
+  DLiteMeta *e, *e2;
+  DLiteInstance *x;
+  unsigned char *buf, *p;
+  size_t len, n=3, i;
+  double *values;
+  char **names;
+
+  mu_check((e = dlite_meta_create(uri, NULL, "Cbor entity.", 1, dimensions,
+                                  3, properties)));
+  mu_check((buf = dlite_cbor_aprint((DLiteInstance *)e, &len)));
+
+  /* rename the entity, since `e` is still in the instance store */
+  mu_check((p = memmem(buf, len, "CborEntity", 10)));
+  p[9] = 'z';
+  mu_check((e2 = (DLiteMeta *)dlite_cbor_sscan(buf, len, uri2)));
+  free(buf);
+  mu_assert_int_eq(3, e2->_nproperties);
+  mu_assert_string_eq("m", e2->_properties[1].unit);
+  mu_assert_int_eq(1, e2->_properties[2].ndims);
+  mu_assert_string_eq("N", e2->_properties[2].dims[0]);
+  mu_check(dliteStringPtr == e2->_properties[2].type);
+  dlite_meta_decref(e2);
+
+  /* an instance with a typed array in foreign byte order */
+  mu_check((x = dlite_instance_create(e, &n, NULL)));
+  *(bool *)dlite_instance_get_property(x, "flag") = true;
+  values = dlite_instance_get_property(x, "values");
+  names = dlite_instance_get_property(x, "names");
+  for (i=0; i<n; i++) {
+    values[i] = 1.5 * i;
+    names[i] = strdup("name");
+  }
+  free(names[1]);
+  names[1] = NULL;
+  mu_check((buf = dlite_cbor_aprint(x, &len)));
+  dlite_instance_decref(x);
+
+  mu_check((p = memmem(buf, len, "\xd8\x56\x58\x18", 4)) ||
+           (p = memmem(buf, len, "\xd8\x52\x58\x18", 4)));
+  p[1] ^= 4;
+  for (p+=4, i=0; i<n; i++, p+=8) {
+    int j;
+    for (j=0; j<4; j++) {
+      unsigned char c = p[j];
+      p[j] = p[7-j];
+      p[7-j] = c;
+    }
+  }
+  mu_check((x = dlite_cbor_sscan(buf, len, NULL)));
+  free(buf);
+  mu_check(*(bool *)dlite_instance_get_property(x, "flag"));
+  values = dlite_instance_get_property(x, "values");
+  mu_assert_double_eq(3.0, values[2]);
+  names = dlite_instance_get_property(x, "names");
+  mu_assert_string_eq("name", names[2]);
+  mu_check(names[1] == NULL);
+  dlite_instance_decref(x);
+  dlite_meta_decref(e);
+}
+
+
+MU_TEST(test_free)
+{
+  dlite_instance_decref(inst);
+  dlite_meta_decref(meta);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_roundtrip);
+  MU_RUN_TEST(test_meta);
+  MU_RUN_TEST(test_free);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
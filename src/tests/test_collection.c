@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include "minunit/minunit.h"
+#include "utils/err.h"
 #include "dlite.h"
 #include "dlite-collection.h"
 #include "dlite-macros.h"
@@ -103,12 +104,35 @@ MU_TEST(test_collection_add)
 }
 
 
+MU_TEST(test_collection_load_eager)
+{
+  DLiteCollection *coll2;
+  const DLiteInstance *inst, *inst2;
+  mu_check((coll2 = dlite_collection_load_url("json://coll.json#mycoll", 0)));
+  mu_assert_int_eq(3, dlite_collection_count(coll2));
+  mu_check((inst = dlite_collection_get(coll2, "inst")));
+  mu_check((inst2 = dlite_collection_get(coll2, "inst2")));
+  mu_check(inst == inst2);
+  mu_check(dlite_collection_get(coll2, "e"));
+  dlite_collection_decref(coll2);
+}
+
+
 MU_TEST(test_collection_get)
 {
   const DLiteInstance *inst;
   mu_check((inst = dlite_collection_get(coll, "inst")));
   mu_check(!dlite_collection_get(coll, "XXX"));
   dlite_errclr();
+
+  /* members are looked up in the member index */
+  mu_check(coll->index);
+  mu_check(dlite_collection_has(coll, "inst2"));
+  mu_check(!dlite_collection_has(coll, "XXX"));
+  mu_check(dlite_collection_get(coll, "inst2") == inst);
+  mu_check(dlite_collection_get_id(coll, inst->uuid) == inst);
+  mu_check(dlite_collection_has_id(coll, inst->uuid));
+  mu_assert_int_eq(2, inst->_refcount);
 }
 
 
@@ -139,6 +163,8 @@ MU_TEST(test_collection_remove)
 
   mu_check(!dlite_collection_remove(coll, "e"));
   mu_assert_int_eq(2, dlite_collection_count(coll));
+  mu_check(!dlite_collection_has(coll, "e"));
+  mu_check(dlite_collection_has(coll, "inst"));
 
   mu_check(!dlite_collection_remove(coll, "inst2"));
   mu_assert_int_eq(1, dlite_collection_count(coll));
@@ -194,6 +220,222 @@ MU_TEST(test_collection_load)
 }
 
 
+MU_TEST(test_collection_sync)
+{
+  DLiteCollection *c;
+  DLiteInstance *inst;
+  char s[32], *saved_s;
+  int i;
+
+  mu_check((c = dlite_collection_create(NULL)));
+  inst = (DLiteInstance *)c;
+  for (i=0; i<100; i++) {
+    snprintf(s, sizeof(s), "item%d", i);
+    mu_check(!dlite_collection_add_relation(c, s, "is_a", "thing"));
+  }
+  mu_check(!dlite_instance_sync_to_properties(inst));
+  mu_assert_int_eq(100, c->nrelations);
+  mu_assert_string_eq("item42", c->relations[42].s);
+
+  /* unchanged relations are not copied again */
+  saved_s = c->relations[42].s;
+  mu_check(!dlite_collection_add_relation(c, "item100", "is_a", "thing"));
+  mu_check(!dlite_instance_sync_to_properties(inst));
+  mu_assert_int_eq(101, c->nrelations);
+  mu_check(c->relations[42].s == saved_s);
+  mu_assert_string_eq("item100", c->relations[100].s);
+
+  mu_assert_int_eq(1, dlite_collection_remove_relations(c, "item3", NULL,
+                                                        NULL));
+  mu_check(!dlite_instance_sync_to_properties(inst));
+  mu_assert_int_eq(100, c->nrelations);
+  mu_check(c->relations[42].s == saved_s);
+  for (i=0; i<100; i++) mu_check(strcmp(c->relations[i].s, "item3"));
+
+  /* relations that are in sync are not reloaded */
+  mu_check(!dlite_instance_sync_from_properties(inst));
+  mu_assert_int_eq(100, triplestore_length(c->rstore));
+  mu_check(dlite_collection_find_first(c, "item42", "is_a", "thing"));
+  mu_check(!dlite_collection_find_first(c, "item3", "is_a", "thing"));
+
+  /* modified relations are loaded */
+  free(c->relations[42].o);
+  c->relations[42].o = strdup("animal");
+  mu_check(!dlite_instance_sync_from_properties(inst));
+  mu_check(dlite_collection_find_first(c, "item42", "is_a", "animal"));
+  mu_check(!dlite_collection_find_first(c, "item42", "is_a", "thing"));
+  mu_assert_int_eq(100, triplestore_length(c->rstore));
+
+  /* direct modifications of the triplestore are detected */
+  mu_check(!triplestore_add(c->rstore, "item200", "is_a", "thing"));
+  mu_check(!dlite_instance_sync_to_properties(inst));
+  mu_assert_int_eq(101, c->nrelations);
+  mu_assert_string_eq("item200", c->relations[100].s);
+  mu_assert_int_eq(1, triplestore_remove(c->rstore, "item200", NULL, NULL));
+  mu_check(!dlite_instance_sync_to_properties(inst));
+  mu_assert_int_eq(100, c->nrelations);
+
+  dlite_collection_decref(c);
+}
+
+
+MU_TEST(test_collection_view)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  DLiteProperty properties[] = {
+    {"x",      dliteFloat,     8,              0, NULL, "m", NULL, "X."},
+    {"values", dliteInt,       4,              1, dims, "",  NULL, "Values."},
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "",  NULL, "Name."}
+  };
+  char *uri = "http://onto-ns.com/meta/0.1/CollectionViewItem";
+  DLiteMeta *meta;
+  DLiteCollection *c;
+  DLiteInstance *inst;
+  DLiteStorage *s;
+  DLiteArray *arr;
+  size_t n=3;
+  char label[16];
+  int i;
+
+  mu_check((meta = dlite_meta_create(uri, NULL, "Item.", 1, dimensions,
+                                     3, properties)));
+  mu_check((c = dlite_collection_create("viewcoll")));
+  for (i=0; i<100; i++) {
+    int *values;
+    mu_check((inst = dlite_instance_create(meta, &n, NULL)));
+    *(double *)dlite_instance_get_property(inst, "x") = i / 2.0;
+    values = dlite_instance_get_property(inst, "values");
+    values[0] = i;
+    values[1] = -i;
+    values[2] = i*i;
+    *(char **)dlite_instance_get_property(inst, "name") = strdup("item");
+    snprintf(label, sizeof(label), "item%d", i);
+    mu_check(!dlite_collection_add_new(c, label, inst));
+  }
+
+  mu_check((s = dlite_storage_open("hdf5", "coll-view.h5", "mode=w")));
+  mu_assert_int_eq(0, dlite_collection_save_view(c, s, uri));
+  mu_check(!dlite_storage_close(s));
+
+  mu_check((s = dlite_storage_open("hdf5", "coll-view.h5", "mode=r")));
+  mu_check((arr = dlite_collection_load_view(s, "viewcoll", uri, "x")));
+  mu_assert_int_eq(1, arr->ndims);
+  mu_assert_int_eq(100, arr->dims[0]);
+  mu_assert_double_eq(21.0, ((double *)arr->data)[42]);
+  free(arr->data);
+  dlite_array_free(arr);
+
+  mu_check((arr = dlite_collection_load_view(s, "viewcoll", uri, "values")));
+  mu_assert_int_eq(2, arr->ndims);
+  mu_assert_int_eq(100, arr->dims[0]);
+  mu_assert_int_eq(3, arr->dims[1]);
+  mu_assert_int_eq(-42, ((int *)arr->data)[42*3 + 1]);
+  mu_assert_int_eq(99*99, ((int *)arr->data)[99*3 + 2]);
+  free(arr->data);
+  dlite_array_free(arr);
+
+  /* members are still stored as ordinary instances */
+  inst = (DLiteInstance *)dlite_collection_get(c, "item7");
+  mu_check((inst = dlite_instance_load(s, inst->uuid)));
+  mu_assert_double_eq(3.5, *(double *)dlite_instance_get_property(inst, "x"));
+  dlite_instance_decref(inst);
+
+  err_set_stream(NULL);
+  mu_check(!dlite_collection_load_view(s, "viewcoll", uri, "name"));
+  mu_check(!dlite_collection_load_view(s, "othercoll", uri, "x"));
+  err_set_stream(stderr);
+  mu_check(!dlite_storage_close(s));
+
+  dlite_collection_decref(c);
+  dlite_meta_decref(meta);
+}
+
+
+static int nprogress=0, badprogress=0;
+static size_t lastsaved=0, lasttotal=0;
+
+/* Progress callback.  Sets `badprogress` if the progress is not
+   increasing or exceeds the total. */
+static int progress(size_t nsaved, size_t total, void *data)
+{
+  int *cancel = data;
+  if (nsaved <= lastsaved || nsaved > total) badprogress = 1;
+  nprogress++;
+  lastsaved = nsaved;
+  lasttotal = total;
+  return *cancel;
+}
+
+MU_TEST(test_collection_save_with)
+{
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    {"values", dliteInt, 4, 1, dims, "", NULL, "Values."}
+  };
+  char *uri = "http://onto-ns.com/meta/0.1/CollectionSaveItem";
+  DLiteMeta *meta;
+  DLiteCollection *c, *sub;
+  DLiteInstance *inst, *shared=NULL;
+  DLiteStorage *s;
+  char **uuids, **q, label[16];
+  size_t n=2, nuuids=0;
+  int i, cancel=0;
+
+  mu_check((meta = dlite_meta_create(uri, NULL, "Item.", 1, dimensions,
+                                     1, properties)));
+  mu_check((c = dlite_collection_create("savecoll")));
+  mu_check((sub = dlite_collection_create("savesub")));
+  for (i=0; i<DLITE_COLLECTION_SAVE_BATCH + 10; i++) {
+    mu_check((inst = dlite_instance_create(meta, &n, NULL)));
+    ((int *)dlite_instance_get_property(inst, "values"))[1] = i;
+    snprintf(label, sizeof(label), "item%d", i);
+    mu_check(!dlite_collection_add_new(c, label, inst));
+    if (i == 0) shared = inst;
+  }
+  /* shared members and collections are only saved once */
+  mu_check(!dlite_collection_add(sub, "shared", shared));
+  mu_check(!dlite_collection_add(c, "sub", (DLiteInstance *)sub));
+  mu_check(!dlite_collection_add(c, "sub2", (DLiteInstance *)sub));
+
+  mu_check((s = dlite_storage_open("json", "coll-save.json", "mode=w")));
+  mu_assert_int_eq(0, dlite_collection_save_with(c, s, dliteCollectionSaveMeta,
+                                                 progress, &cancel));
+  mu_check(!dlite_storage_close(s));
+  mu_assert_int_eq(0, badprogress);
+  mu_assert_int_eq(4, nprogress);  /* metadata, 2 batches, collections */
+  mu_assert_int_eq(1 + DLITE_COLLECTION_SAVE_BATCH + 10 + 2, lasttotal);
+  mu_assert_int_eq(lasttotal, lastsaved);
+
+  mu_check((s = dlite_storage_open("json", "coll-save.json", "mode=r")));
+  mu_check((uuids = dlite_storage_uuids(s, NULL)));
+  for (q=uuids; *q; q++) nuuids++;
+  dlite_storage_uuids_free(uuids);
+  mu_assert_int_eq(lasttotal, nuuids);
+  mu_check((inst = dlite_instance_load(s, meta->uuid)));
+  dlite_instance_decref(inst);
+  mu_check(!dlite_storage_close(s));
+
+  /* cancel the save after the first batch */
+  cancel = 1;
+  nprogress = 0;
+  lastsaved = 0;
+  mu_check((s = dlite_storage_open("json", "coll-save2.json", "mode=w")));
+  err_set_stream(NULL);
+  mu_check(dlite_collection_save_with(c, s, 0, progress, &cancel));
+  err_set_stream(stderr);
+  mu_check(!dlite_storage_close(s));
+  mu_assert_int_eq(0, badprogress);
+  mu_assert_int_eq(1, nprogress);
+  mu_assert_int_eq(DLITE_COLLECTION_SAVE_BATCH, lastsaved);
+
+  dlite_collection_decref(sub);
+  dlite_collection_decref(c);
+  dlite_meta_decref(meta);
+}
+
+
 MU_TEST(test_collection_free)
 {
   dlite_collection_decref(coll);
@@ -214,14 +456,20 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_collection_remove_relations);
 
   MU_RUN_TEST(test_collection_find);
+  MU_RUN_TEST(test_collection_sync);
 
 #ifdef WITH_JSON
   MU_RUN_TEST(test_collection_add);
+  MU_RUN_TEST(test_collection_load_eager);
   MU_RUN_TEST(test_collection_get);
   MU_RUN_TEST(test_collection_next);
   MU_RUN_TEST(test_collection_remove);
   MU_RUN_TEST(test_collection_save);
   MU_RUN_TEST(test_collection_load);
+  MU_RUN_TEST(test_collection_save_with);
+#endif
+#ifdef WITH_HDF5
+  MU_RUN_TEST(test_collection_view);
 #endif
 
   MU_RUN_TEST(test_collection_free);       /* tear down */
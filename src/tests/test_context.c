@@ -0,0 +1,162 @@
+/* Tests for contexts with isolated global state.
+ *
+ * Usage: test_context [NTHREADS [NITER]]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+#include "utils/thread.h"
+#include "dlite.h"
+#include "dlite-entity.h"
+
+#define MAXTHREADS 64
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/ContextEntity";
+DLiteMeta *entity=NULL;
+int nthreads=4;
+int niter=1000;
+
+/* Counts failed operations in the worker threads */
+int nfailures=0;
+
+
+/* Worker running in its own context.  All workers use the same
+   instance id without interfering with each other. */
+static void *worker(void *arg)
+{
+  DLiteContext *ctx;
+  int i, n=0;
+  (void)arg;
+  if (!(ctx = dlite_context_create(NULL))) {
+    thread_atomic_add(&nfailures, 1);
+    return NULL;
+  }
+  dlite_context_set_current(ctx);
+  for (i=0; i<niter; i++) {
+    DLiteInstance *inst, *inst2;
+    int value = i;
+    if (!(inst = dlite_instance_create(entity, NULL, "worker-instance"))) {
+      n++;
+      continue;
+    }
+    if (inst->_refcount != 1) n++;
+    if (dlite_instance_set_property(inst, "value", &value)) n++;
+    if ((inst2 = dlite_instance_get("worker-instance"))) {
+      if (inst2 != inst) n++;
+      dlite_instance_decref(inst2);
+    } else {
+      n++;
+    }
+    dlite_instance_decref(inst);
+  }
+  if (dlite_context_free(ctx)) n++;
+  if (dlite_context_get_current()) n++;
+  thread_atomic_add(&nfailures, n);
+  return NULL;
+}
+
+
+/***************************************************************
+ * Tests
+ ***************************************************************/
+
+MU_TEST(test_setup)
+{
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri   descr */
+    {"value",  dliteInt,   sizeof(int),    0, NULL, "",   NULL, "A value."}
+  };
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Context entity.",
+                                                    NULL,
+                                                    0, NULL,
+                                                    1, properties)));
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_context)
+{
+  DLiteContext *ctx;
+  DLiteInstance *inst, *inst2;
+
+  mu_check(dlite_context_get_current() == NULL);
+  mu_check((inst = dlite_instance_create(entity, NULL, "default-instance")));
+
+  mu_check((ctx = dlite_context_create("test-context")));
+  mu_check(dlite_context_set_current(ctx) == NULL);
+  mu_check(dlite_context_get_current() == ctx);
+  mu_check(dlite_globals_get() == ctx);
+
+  /* The instance store of the context is separate */
+  mu_check(!dlite_instance_has("default-instance", 0));
+  mu_check((inst2 = dlite_instance_create(entity, NULL, "ctx-instance")));
+  mu_check(dlite_instance_has("ctx-instance", 0));
+  mu_assert_int_eq(5, entity->_refcount);  /* + 2 instances, ctx store */
+
+  mu_check(dlite_context_set_current(NULL) == ctx);
+  mu_check(dlite_globals_get() != ctx);
+  mu_check(dlite_instance_has("default-instance", 0));
+  mu_check(!dlite_instance_has("ctx-instance", 0));
+
+  /* Release instance in its own context, then free the context */
+  dlite_context_set_current(ctx);
+  dlite_instance_decref(inst2);
+  dlite_context_set_current(NULL);
+  mu_assert_int_eq(0, dlite_context_free(ctx));
+  mu_assert_int_eq(3, entity->_refcount);
+
+  /* The default globals cannot be freed as a context */
+  mu_check(dlite_context_free(dlite_globals_get()) != 0);
+  dlite_errclr();
+
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(2, entity->_refcount);
+}
+
+MU_TEST(test_threads)
+{
+  Thread threads[MAXTHREADS];
+  int i, nstarted=0;
+
+  for (i=0; i<nthreads; i++)
+    if (thread_create(threads + nstarted, worker, NULL) == 0) nstarted++;
+  for (i=0; i<nstarted; i++)
+    thread_join(threads[i], NULL);
+
+  /* Run in the main thread if threads are not supported */
+  if (nstarted == 0) worker(NULL);
+
+  mu_assert_int_eq(0, nfailures);
+  mu_check(dlite_context_get_current() == NULL);
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_teardown)
+{
+  dlite_meta_decref(entity);  /* refs: store */
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);
+  MU_RUN_TEST(test_context);
+  MU_RUN_TEST(test_threads);
+  MU_RUN_TEST(test_teardown);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1) nthreads = atoi(argv[1]);
+  if (argc > 2) niter = atoi(argv[2]);
+  if (nthreads > MAXTHREADS) nthreads = MAXTHREADS;
+
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
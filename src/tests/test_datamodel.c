@@ -222,6 +222,30 @@ MU_TEST(test_stringptr_vec_property)
     mu_assert_string_eq(v[i], u[i]);
 }
 
+MU_TEST(test_stringptr_large_vec_property)
+{
+  size_t i, n=20000, dims[1];
+  char **v, *u;
+  dims[0] = n;
+  mu_check((v = calloc(n, sizeof(char *))));
+  mu_check((u = calloc(n, 32)));
+  for (i=0; i<n; i++) {
+    mu_check((v[i] = malloc(32)));
+    snprintf(v[i], 32, "string number %d", (int)i);
+  }
+  mu_check(dlite_datamodel_set_property(d, "mystringptr_large", v,
+                                        dliteStringPtr, sizeof(char *),
+                                        1, dims) == 0);
+  mu_check(dlite_datamodel_get_property(d, "mystringptr_large", u,
+                                        dliteFixString, 32, 1, dims) == 0);
+  for (i=0; i<n; i++) {
+    mu_assert_string_eq(v[i], u + i*32);
+    free(v[i]);
+  }
+  free(v);
+  free(u);
+}
+
 MU_TEST(test_string_arr_property)
 {
   size_t i, j, dims[] = {2, 2};
@@ -249,6 +273,59 @@ MU_TEST(test_uint64_arr_property)
         mu_check(v[i][j][k] == w[k + dims[2]*(j + dims[1]*i)]);
 }
 
+MU_TEST(test_struct_arr_property)
+{
+  typedef struct { double x, y, z, mass; int32_t charge; } Particle;
+  DLiteStructField fields[] = {
+    {"x", dliteFloat, 8, 0},
+    {"y", dliteFloat, 8, 0},
+    {"z", dliteFloat, 8, 0},
+    {"mass", dliteFloat, 8, 0},
+    {"charge", dliteInt, 4, 0}
+  };
+  Particle v[3] = {{0, 0, 1, 1.5, -1}, {1, 2, 3, 4, 5}, {-1, -2, -3, 0, 0}};
+  Particle w[3];
+  size_t i, dims[] = {3};
+  DLiteType dtype = dlite_struct_register("Particle", 5, fields);
+  mu_check(dlite_type_is_struct(dtype));
+  mu_assert_int_eq(sizeof(Particle), dlite_struct_get(dtype)->size);
+  mu_check(dlite_datamodel_set_property(d, "myparticles", v, dtype,
+                                        sizeof(Particle), 1, dims) == 0);
+  memset(w, 0, sizeof(w));
+  mu_check(dlite_datamodel_get_property(d, "myparticles", w, dtype,
+                                        sizeof(Particle), 1, dims) == 0);
+  for (i=0; i<3; i++) {
+    mu_assert_double_eq(v[i].z, w[i].z);
+    mu_assert_double_eq(v[i].mass, w[i].mass);
+    mu_assert_int_eq(v[i].charge, w[i].charge);
+  }
+}
+
+MU_TEST(test_sparse_property)
+{
+  size_t i, dims[] = {200, 300};
+  DLiteSparse *sp;
+  double *w;
+  mu_check(d->api->setSparseProperty);
+  mu_check((sp = dlite_sparse_create(dliteSparseCOO, dliteFloat,
+                                     sizeof(double), 2, dims, 2)));
+  sp->indices[0] = 1;   sp->indices[1] = 2;
+  sp->indices[2] = 199; sp->indices[3] = 250;
+  ((double *)sp->values)[0] = 3.5;
+  ((double *)sp->values)[1] = -1.0;
+  mu_check(d->api->setSparseProperty(d, "mysparse", sp) == 0);
+  mu_check((w = calloc(dims[0]*dims[1], sizeof(double))));
+  mu_check(dlite_datamodel_get_property(d, "mysparse", w, dliteFloat,
+                                        sizeof(double), 2, dims) == 0);
+  mu_assert_double_eq(3.5, w[1*300 + 2]);
+  mu_assert_double_eq(-1.0, w[199*300 + 250]);
+  mu_assert_int_eq(2, dlite_sparse_count_nonzero(w, sizeof(double),
+                                                 dims[0]*dims[1]));
+  for (i=0; i<10; i++) mu_assert_double_eq(0.0, w[i*300 + 100]);
+  free(w);
+  dlite_sparse_free(sp);
+}
+
 MU_TEST(test_has_dimension)
 {
   mu_check(dlite_datamodel_has_dimension(d, "N") > 0);
@@ -261,6 +338,41 @@ MU_TEST(test_has_property)
   mu_check(dlite_datamodel_has_property(d, "xxx") == 0);
 }
 
+MU_TEST(test_copy_nested)
+{
+  size_t i, j, k, dims[] = {3, 4, 5}, big[] = {1024, 1024};
+  double flat[60], flat2[60], ***v;
+  int32_t **w, *wflat, *wflat2;
+
+  for (i=0; i<60; i++) flat[i] = i + 0.5;
+  v = dlite_nested_alloc(sizeof(double), 3, dims);
+  mu_check(v);
+  mu_assert_int_eq(0, dlite_copy_to_nested(v, flat, sizeof(double), 3, dims));
+  for (i=0; i<dims[0]; i++)
+    for (j=0; j<dims[1]; j++)
+      for (k=0; k<dims[2]; k++)
+        mu_assert_double_eq(flat[k + dims[2]*(j + dims[1]*i)], v[i][j][k]);
+  memset(flat2, 0, sizeof(flat2));
+  mu_assert_int_eq(0, dlite_copy_to_flat(flat2, v, sizeof(double), 3, dims));
+  mu_check(memcmp(flat, flat2, sizeof(flat)) == 0);
+  free(v);
+
+  /* Large enough to be copied by several threads */
+  wflat = malloc(big[0]*big[1]*sizeof(int32_t));
+  wflat2 = calloc(big[0]*big[1], sizeof(int32_t));
+  for (i=0; i<big[0]*big[1]; i++) wflat[i] = (int32_t)i;
+  w = dlite_nested_alloc(sizeof(int32_t), 2, big);
+  mu_check(w);
+  mu_assert_int_eq(0, dlite_copy_to_nested(w, wflat, sizeof(int32_t), 2, big));
+  mu_assert_int_eq(3*1024 + 7, w[3][7]);
+  mu_assert_int_eq(1000*1024 + 1023, w[1000][1023]);
+  mu_assert_int_eq(0, dlite_copy_to_flat(wflat2, w, sizeof(int32_t), 2, big));
+  mu_check(memcmp(wflat, wflat2, big[0]*big[1]*sizeof(int32_t)) == 0);
+  free(w);
+  free(wflat);
+  free(wflat2);
+}
+
 MU_TEST(test_storage_plugin_unload_all)
 {
   dlite_storage_plugin_unload_all();
@@ -289,10 +401,14 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_string_property);
   MU_RUN_TEST(test_stringptr_property);
   MU_RUN_TEST(test_stringptr_vec_property);
+  MU_RUN_TEST(test_stringptr_large_vec_property);
   MU_RUN_TEST(test_string_arr_property);
   MU_RUN_TEST(test_uint64_arr_property);
+  MU_RUN_TEST(test_struct_arr_property);
+  MU_RUN_TEST(test_sparse_property);
   MU_RUN_TEST(test_has_dimension);
   MU_RUN_TEST(test_has_property);
+  MU_RUN_TEST(test_copy_nested);
 
   MU_RUN_TEST(test_close);  /* tear down */
 
@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-device.h"
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/DeviceEntity";
+DLiteMeta *entity=NULL;
+
+/* Emulated device: device memory is host memory and transfers are
+   counted */
+int nalloc=0, nhost=0, nup=0, ndown=0;
+
+static void *host_alloc(size_t size, void *data)
+{
+  (void)data;
+  nhost++;
+  return malloc(size);
+}
+static void host_free(void *ptr, void *data)
+{
+  (void)data;
+  nhost--;
+  free(ptr);
+}
+static void *device_alloc(size_t size, void *data)
+{
+  (void)data;
+  nalloc++;
+  return malloc(size);
+}
+static void device_free(void *ptr, void *data)
+{
+  (void)data;
+  nalloc--;
+  free(ptr);
+}
+static int to_device(void *dst, const void *src, size_t size, void *data)
+{
+  (void)data;
+  nup++;
+  memcpy(dst, src, size);
+  return 0;
+}
+static int to_host(void *dst, const void *src, size_t size, void *data)
+{
+  (void)data;
+  ndown++;
+  memcpy(dst, src, size);
+  return 0;
+}
+
+DLiteDeviceBackend backend = {
+  "emulated", host_alloc, host_free, device_alloc, device_free,
+  to_device, to_host, NULL
+};
+
+
+MU_TEST(test_setup)
+{
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    /* name    type          size            ndims dims  unit iri  descr */
+    {"count",  dliteInt,     sizeof(int),    0,    NULL, "",  NULL, "Count."},
+    {"values", dliteFloat,   sizeof(double), 1,    dims, "",  NULL, "Values."},
+    {"names",  dliteStringPtr, sizeof(char *), 1,  dims, "",  NULL, "Names."}
+  };
+  mu_check((entity = dlite_meta_create(uri, NULL, "Device entity.",
+                                       1, dimensions, 3, properties)));
+}
+
+MU_TEST(test_backend)
+{
+  DLiteDeviceBackend bad = {"bad", NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+  mu_check(dlite_device_get_backend() == NULL);
+  err_clear();
+  mu_check(dlite_device_set_backend(&bad));
+  mu_check(dlite_device_set_memspace(dliteMemDevice));
+  err_clear();
+  mu_assert_int_eq(0, dlite_device_set_backend(&backend));
+  mu_check(dlite_device_get_backend() == &backend);
+}
+
+MU_TEST(test_pinned)
+{
+  DLiteInstance *inst;
+  size_t i, n=100;
+  int newdims[] = {1000};
+  double *values;
+
+  mu_assert_int_eq(0, dlite_device_set_memspace(dliteMemPinned));
+  mu_check(dlite_instance_get_allocator() == dlite_device_pinned_allocator());
+  mu_check((inst = dlite_instance_create(entity, &n, NULL)));
+  mu_check(nhost > 0);
+  mu_check(dlite_device_memspace(inst, 1) == dliteMemPinned);
+  values = dlite_instance_get_property(inst, "values");
+  for (i=0; i<n; i++) values[i] = (double)i;
+  mu_assert_int_eq(0, dlite_instance_set_dimension_sizes(inst, newdims));
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(99.0, values[99]);
+  mu_assert_double_eq(0.0, values[999]);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, nhost);
+
+  mu_assert_int_eq(0, dlite_device_set_memspace(dliteMemHost));
+  mu_check(dlite_instance_get_allocator() == NULL);
+}
+
+MU_TEST(test_mirror)
+{
+  DLiteInstance *inst, *copy;
+  size_t i, n=10;
+  int newdims[] = {20};
+  double *values, *dvalues;
+
+  mu_check((inst = dlite_instance_create(entity, &n, NULL)));
+  mu_check(dlite_device_memspace(inst, 1) == dliteMemHost);
+  values = dlite_instance_get_property(inst, "values");
+  for (i=0; i<n; i++) values[i] = (double)i;
+
+  /* read-only device access uploads once */
+  nup = ndown = 0;
+  mu_check((dvalues = dlite_device_get_property(inst, 1, dliteDeviceRead)));
+  mu_check(dvalues != values);
+  mu_assert_double_eq(9.0, dvalues[9]);
+  mu_check(inst->_flags & dliteFlagDevice);
+  mu_check(dlite_device_get_property(inst, 1, dliteDeviceRead) == dvalues);
+  mu_assert_int_eq(1, nup);
+  mu_assert_int_eq(1, nalloc);
+
+  /* a kernel writes the device copy, which is copied back lazily */
+  mu_check(dlite_device_get_property(inst, 1, dliteDeviceReadWrite));
+  for (i=0; i<n; i++) dvalues[i] = 2.0 * i;
+  mu_check(dlite_device_memspace(inst, 1) == dliteMemDevice);
+  mu_assert_double_eq(9.0, values[9]);
+  mu_assert_int_eq(0, ndown);
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(18.0, values[9]);
+  mu_assert_int_eq(1, ndown);
+  mu_check(dlite_device_memspace(inst, 1) == dliteMemHost);
+
+  /* host access makes the next read upload again */
+  values[0] = -1.0;
+  mu_check(dlite_device_get_property(inst, 1, dliteDeviceRead));
+  mu_assert_int_eq(2, nup);
+  mu_assert_double_eq(-1.0, dvalues[0]);
+
+  /* write-only access does not upload */
+  mu_check(dlite_device_get_property(inst, 1, dliteDeviceWrite));
+  mu_assert_int_eq(2, nup);
+  dvalues[1] = 42.0;
+
+  /* copies see the device data */
+  mu_check((copy = dlite_instance_copy(inst, NULL)));
+  mu_assert_double_eq(42.0, (*(double **)DLITE_PROP(copy, 1))[1]);
+  mu_assert_int_eq(2, ndown);
+  dlite_instance_decref(copy);
+
+  /* changing dimensions reallocates the device copy */
+  mu_check(dlite_device_get_property(inst, 1, dliteDeviceWrite));
+  dvalues[2] = 43.0;
+  mu_assert_int_eq(0, dlite_instance_set_dimension_sizes(inst, newdims));
+  values = *(double **)DLITE_PROP(inst, 1);
+  mu_assert_double_eq(43.0, values[2]);
+  mu_check((dvalues = dlite_device_get_property(inst, 1, dliteDeviceRead)));
+  mu_assert_double_eq(43.0, dvalues[2]);
+  mu_assert_double_eq(0.0, dvalues[19]);
+  mu_assert_int_eq(1, nalloc);
+
+  /* only numerical arrays can have device copies */
+  err_clear();
+  mu_check(!dlite_device_get_property(inst, 0, dliteDeviceRead));
+  mu_check(!dlite_device_get_property(inst, 2, dliteDeviceRead));
+  mu_check(!dlite_device_get_property(inst, 3, dliteDeviceRead));
+  err_clear();
+
+  /* release copies back and frees the device memory */
+  mu_check(dlite_device_get_property(inst, 1, dliteDeviceWrite));
+  dvalues[3] = 44.0;
+  mu_assert_int_eq(0, dlite_device_release(inst));
+  mu_assert_int_eq(0, nalloc);
+  mu_check(!(inst->_flags & dliteFlagDevice));
+  mu_assert_double_eq(44.0, values[3]);
+
+  /* device copies are free'ed with the instance */
+  mu_check(dlite_device_get_property(inst, 1, dliteDeviceRead));
+  mu_assert_int_eq(1, nalloc);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, nalloc);
+}
+
+MU_TEST(test_teardown)
+{
+  mu_assert_int_eq(0, dlite_device_set_backend(NULL));
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);     /* setup */
+  MU_RUN_TEST(test_backend);
+  MU_RUN_TEST(test_pinned);
+  MU_RUN_TEST(test_mirror);
+  MU_RUN_TEST(test_teardown);  /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
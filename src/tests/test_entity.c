@@ -6,15 +6,19 @@
 #include "minunit/minunit.h"
 #include "utils/integers.h"
 #include "utils/boolean.h"
+#include "utils/thread.h"
+#include "utils/err.h"
 #include "dlite.h"
 #include "dlite-entity.h"
 #include "dlite-storage.h"
+#include "dlite-json.h"
 
 
 #include "config.h"
 
 char *datafile = "myentity.h5";
 char *datafile2 = "myentity2.h5";
+char *datafile3 = "myentity3.h5";
 char *jsonfile = "myentity.json";
 char *jsonfile2 = "myentity2.json";
 char *uri = "http://www.sintef.no/meta/dlite/0.1/MyEntity";
@@ -22,6 +26,40 @@ char *id = "mydata";
 DLiteMeta *entity=NULL;
 DLiteInstance *mydata=NULL, *mydata2=NULL, *mydata3=NULL;
 
+/* Number of calls to count_free() */
+int nfree=0;
+
+/* Deallocator counting the number of calls */
+void count_free(void *ptr)
+{
+  nfree++;
+  free(ptr);
+}
+
+
+/* Number of live allocations made by the counting allocator */
+int nalloc=0;
+
+/* Counting allocator */
+void *count_malloc(size_t size, void *data)
+{
+  (*(int *)data)++;
+  return malloc(size);
+}
+void *count_realloc(void *ptr, size_t size, void *data)
+{
+  if (!ptr) (*(int *)data)++;
+  return realloc(ptr, size);
+}
+void count_allocator_free(void *ptr, void *data)
+{
+  (*(int *)data)--;
+  free(ptr);
+}
+DLiteAllocator counting_allocator = {
+  count_malloc, NULL, count_realloc, count_allocator_free, &nalloc
+};
+
 
 /***************************************************************
  * Test entity
@@ -79,6 +117,103 @@ MU_TEST(test_meta_create)
 #endif
 }
 
+MU_TEST(test_meta_index)
+{
+  mu_assert_int_eq(0, dlite_meta_get_dimension_index(entity, "M"));
+  mu_assert_int_eq(1, dlite_meta_get_dimension_index(entity, "N"));
+  mu_assert_int_eq(0, dlite_meta_get_property_index(entity, "a-string"));
+  mu_assert_int_eq(2, dlite_meta_get_property_index(entity, "an-int-arr"));
+  mu_assert_int_eq(4, dlite_meta_get_property_index(entity, "a-string3-arr"));
+  mu_check(dlite_meta_has_property(entity, "a-string-arr"));
+  mu_check(!dlite_meta_has_property(entity, "a-string-ar"));
+  mu_check(!dlite_meta_has_property(entity, "M"));
+  mu_check(dlite_meta_has_dimension(entity, "M"));
+  mu_check(!dlite_meta_has_dimension(entity, "a-float"));
+  mu_assert_int_eq(1, dlite_meta_find_dimension_index(entity, "N"));
+  mu_assert_int_eq(-1, dlite_meta_find_dimension_index(entity, "a-string"));
+  mu_assert_int_eq(2, dlite_meta_find_property_index(entity, "an-int-arr"));
+  mu_assert_int_eq(-1, dlite_meta_find_property_index(entity, "M"));
+  mu_assert_int_eq(0, dlite_errval());
+}
+
+MU_TEST(test_meta_layout)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  DLiteProperty properties[] = {
+    /* name    type           size             ndims dims unit iri descr */
+    {"flag",   dliteBool,     sizeof(bool),    0, NULL, "", NULL, "Flag."},
+    {"x",      dliteFloat,    sizeof(double),  0, NULL, "", NULL, "X."},
+    {"small",  dliteInt,      sizeof(int8_t),  0, NULL, "", NULL, "Small."},
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "", NULL, "Name."},
+    {"count",  dliteInt,      sizeof(int32_t), 0, NULL, "", NULL, "Count."},
+    {"values", dliteFloat,    sizeof(double),  1, dims, "", NULL, "Values."}
+  };
+  const char *hot[] = {"count", "flag"};
+  char *layout_uri = "http://www.sintef.no/meta/dlite/0.1/LayoutEntity";
+  DLiteMeta *meta;
+  DLiteInstance *inst;
+  size_t n=2, declared_size, i;
+  bool flag=true;
+  double x=1.5;
+  int8_t small=-3;
+  int32_t count=42;
+  char *name="packed", *json, *p, *q;
+
+  mu_check((meta = dlite_meta_create(layout_uri, NULL, "Layout entity.",
+                                     1, dimensions, 6, properties)));
+  mu_assert_int_eq(dliteLayoutDeclared, dlite_meta_get_layout_mode(meta));
+  for (i=1; i<6; i++)
+    mu_check(meta->_propoffsets[i] > meta->_propoffsets[i-1]);
+  declared_size = dlite_instance_size(meta, &n);
+
+  /* packed layout orders by alignment and removes padding */
+  mu_assert_int_eq(0, dlite_meta_set_layout_mode(meta, dliteLayoutPacked));
+  mu_assert_int_eq(dliteLayoutPacked, dlite_meta_get_layout_mode(meta));
+  mu_check(dlite_instance_size(meta, &n) < declared_size);
+  mu_check(meta->_propoffsets[1] < meta->_propoffsets[4]);
+  mu_check(meta->_propoffsets[4] < meta->_propoffsets[0]);
+  mu_check(meta->_propoffsets[0] < meta->_propoffsets[2]);
+
+  /* hot properties are placed first */
+  mu_assert_int_eq(0, dlite_meta_set_hot_properties(meta, hot, 2));
+  mu_check(meta->_propoffsets[4] < meta->_propoffsets[0]);
+  mu_check(meta->_propoffsets[0] < meta->_propoffsets[1]);
+  mu_check(meta->_propoffsets[0] < meta->_propoffsets[3]);
+  mu_check(meta->_propoffsets[0] < meta->_propoffsets[5]);
+  err_clear();
+  mu_check(dlite_meta_set_hot_properties(meta, (const char **)dims, 1));
+  err_clear();
+
+  /* serialisation keeps declaration order */
+  mu_check((inst = dlite_instance_create(meta, &n, NULL)));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "flag", &flag));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "x", &x));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "small", &small));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "name", &name));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "count", &count));
+  mu_assert_int_eq(42, *(int32_t *)dlite_instance_get_property(inst, "count"));
+  mu_assert_int_eq(-3, *(int8_t *)dlite_instance_get_property(inst, "small"));
+  mu_check((json = dlite_json_aprint(inst, 0, 0)));
+  mu_check((p = strstr(json, "\"flag\"")));
+  for (i=1; i<6; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "\"%s\"", properties[i].name);
+    mu_check((q = strstr(json, key)) && q > p);
+    p = q;
+  }
+  free(json);
+
+  /* the layout is fixed when the metadata has instances */
+  err_clear();
+  mu_check(dlite_meta_set_layout_mode(meta, dliteLayoutDeclared));
+  mu_check(dlite_meta_set_hot_properties(meta, NULL, 0));
+  err_clear();
+  mu_assert_int_eq(dliteLayoutPacked, dlite_meta_get_layout_mode(meta));
+  dlite_instance_decref(inst);
+  dlite_meta_decref(meta);
+}
+
 MU_TEST(test_instance_create)
 {
   size_t dims[]={3, 2};
@@ -137,6 +272,340 @@ MU_TEST(test_instance_set_dimension_sizes)
   mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
 }
 
+MU_TEST(test_instance_arena)
+{
+  DLiteInstance *inst;
+  size_t dims[]={3, 2};
+  int newdims[] = {5, -1};
+  int intarr[2][3] = {{0, 1, 2}, {3, 4, 5}};
+  char *strarr[] = {"first string", "second string"};
+  char str3arr[3][3] = {"Al", "Mg", "Si"};
+  int *iarr;
+  char **sarr;
+  char *s3arr;
+
+  mu_assert_int_eq(dliteAllocDefault, dlite_meta_get_alloc_mode(entity));
+  mu_check(dlite_meta_set_alloc_mode(entity, dliteAllocArena) == 0);
+  mu_assert_int_eq(dliteAllocArena, dlite_meta_get_alloc_mode(entity));
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+  mu_check(inst->_flags & dliteFlagArena);
+  mu_check(dlite_meta_set_alloc_mode(entity, dliteAllocDefault) == 0);
+
+  /* arrays are placed after the header, the first one cache-line aligned */
+  iarr = *(int **)DLITE_PROP(inst, 2);
+  sarr = *(char ***)DLITE_PROP(inst, 3);
+  s3arr = *(char **)DLITE_PROP(inst, 4);
+  mu_check((char *)iarr > (char *)inst);
+  mu_assert_int_eq(0, (size_t)iarr % 64);
+  mu_check((char *)sarr > (char *)iarr);
+  mu_check(s3arr > (char *)sarr);
+
+  mu_check(dlite_instance_set_property(inst, "an-int-arr", intarr) == 0);
+  mu_check(dlite_instance_set_property(inst, "a-string-arr", strarr) == 0);
+  mu_check(dlite_instance_set_property(inst, "a-string3-arr", str3arr) == 0);
+  mu_assert_int_eq(5, iarr[5]);
+  mu_assert_string_eq("second string", sarr[1]);
+
+  /* growing M moves the arrays depending on it out of the arena */
+  mu_check(dlite_instance_set_dimension_sizes(inst, newdims) == 0);
+  mu_check(*(int **)DLITE_PROP(inst, 2) != iarr);
+  mu_check(*(char ***)DLITE_PROP(inst, 3) == sarr);
+  s3arr = *(char **)DLITE_PROP(inst, 4);
+  mu_assert_string_eq("Si", s3arr + 2*3);
+  mu_assert_string_eq("", s3arr + 4*3);
+
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+}
+
+MU_TEST(test_instance_pack_strings)
+{
+  DLiteInstance *inst, *copy, *loaded;
+  DLiteStorage *st;
+  size_t dims[]={3, 2};
+  int newdims[] = {-1, 3};
+  char *astring = "a string longer than one slot";
+  char *strarr[] = {"Al", "Mg"}, *strarr2[] = {"Si", "a long string value"};
+  char **sp, **sarr;
+
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "a-string", &astring));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "a-string-arr",
+                                                  strarr));
+  mu_assert_int_eq(0, dlite_instance_pack_strings(inst));
+  mu_check(inst->_flags & dliteFlagStrings);
+
+  /* short strings are in consecutive slots followed by long strings */
+  sp = dlite_instance_get_property(inst, "a-string");
+  sarr = dlite_instance_get_property(inst, "a-string-arr");
+  mu_assert_string_eq(astring, *sp);
+  mu_assert_string_eq("Al", sarr[0]);
+  mu_assert_string_eq("Mg", sarr[1]);
+  mu_assert_int_eq(DLITE_STRING_SLOT, sarr[1] - sarr[0]);
+  mu_assert_int_eq(2*DLITE_STRING_SLOT, *sp - sarr[0]);
+
+  /* writing moves the strings of the property out of the arena */
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "a-string-arr",
+                                                  strarr2));
+  sarr = dlite_instance_get_property(inst, "a-string-arr");
+  mu_assert_string_eq("a long string value", sarr[1]);
+  mu_assert_string_eq(astring, *sp);
+
+  /* repacking includes the new strings */
+  mu_assert_int_eq(0, dlite_instance_pack_strings(inst));
+  mu_assert_string_eq("Si", sarr[0]);
+  mu_assert_int_eq(DLITE_STRING_SLOT, *sp - sarr[0]);
+  mu_check((copy = dlite_instance_copy(inst, NULL)));
+  mu_check(!(copy->_flags & dliteFlagStrings));
+  mu_assert_string_eq("a long string value",
+                      (*(char ***)DLITE_PROP(copy, 3))[1]);
+
+  /* changing dimensions unpacks the strings */
+  mu_assert_int_eq(0, dlite_instance_set_dimension_sizes(inst, newdims));
+  mu_check(!(inst->_flags & dliteFlagStrings));
+  sarr = dlite_instance_get_property(inst, "a-string-arr");
+  mu_assert_string_eq("a long string value", sarr[1]);
+  mu_check(sarr[2] == NULL);
+  mu_assert_int_eq(0, dlite_instance_pack_strings(inst));
+
+  /* instances loaded with the arena allocation mode are packed */
+  mu_check((st = dlite_storage_open("json", "pack-strings.json", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(st, copy));
+  dlite_storage_close(st);
+  dlite_instance_decref(copy);
+  mu_assert_int_eq(0, dlite_meta_set_alloc_mode(entity, dliteAllocArena));
+  mu_check((loaded = dlite_instance_load_url("json://pack-strings.json")));
+  mu_check(loaded->_flags & dliteFlagStrings);
+  mu_assert_string_eq("Si", (*(char ***)DLITE_PROP(loaded, 3))[0]);
+  mu_assert_int_eq(0, dlite_meta_set_alloc_mode(entity, dliteAllocDefault));
+
+  dlite_instance_decref(loaded);
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_instance_pool)
+{
+  DLiteInstance *inst, *inst2, *inst3, *inst4;
+  DLitePoolStats stats;
+  size_t dims[]={3, 2}, dims2[]={2, 2};
+  char uuid[DLITE_UUID_LENGTH+1];
+  char *astring="string value";
+  int intarr[2][3] = {{0, 1, 2}, {3, 4, 5}};
+  int *iarr;
+
+  mu_check(dlite_meta_enable_pool(entity, 2) == 0);
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+  mu_check(dlite_instance_set_property(inst, "a-string", &astring) == 0);
+  mu_check(dlite_instance_set_property(inst, "an-int-arr", intarr) == 0);
+  memcpy(uuid, inst->uuid, sizeof(uuid));
+  iarr = *(int **)DLITE_PROP(inst, 2);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
+
+  mu_check(dlite_meta_get_pool_stats(entity, &stats) == 0);
+  mu_assert_int_eq(2, stats.maxsize);
+  mu_assert_int_eq(1, stats.size);
+  mu_assert_int_eq(1, stats.misses);
+  mu_assert_int_eq(1, stats.recycled);
+
+  /* reuse with same dimensions gives zeroed, re-identified instance */
+  mu_check((inst2 = dlite_instance_create(entity, dims, NULL)));
+  mu_check(inst2 == inst);
+  mu_check(strcmp(uuid, inst2->uuid) != 0);
+  mu_check(*(int **)DLITE_PROP(inst2, 2) == iarr);
+  mu_assert_int_eq(0, iarr[5]);
+  mu_check(*(char **)DLITE_PROP(inst2, 0) == NULL);
+  mu_check(dlite_instance_has(inst2->uuid, 0) == inst2);
+  mu_check(dlite_instance_has(uuid, 0) == NULL);
+
+  /* flags of a free'ed instance are not inherited by the next one */
+  mu_assert_int_eq(0, dlite_instance_freeze(inst2, 0));
+  mu_check(dlite_instance_is_frozen(inst2));
+  mu_assert_int_eq(0, dlite_instance_decref(inst2));
+  mu_check((inst2 = dlite_instance_create(entity, dims, NULL)));
+  mu_check(inst2 == inst);
+  mu_check(!dlite_instance_is_frozen(inst2));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst2, "a-string",
+                                                  &astring));
+
+  /* other dimensions are not served by the pool */
+  mu_check((inst3 = dlite_instance_create(entity, dims2, NULL)));
+  mu_check((inst4 = dlite_instance_create(entity, dims2, NULL)));
+  dlite_instance_decref(inst2);
+  dlite_instance_decref(inst3);
+  dlite_instance_decref(inst4);
+
+  mu_check(dlite_meta_get_pool_stats(entity, &stats) == 0);
+  mu_assert_int_eq(2, stats.size);
+  mu_assert_int_eq(2, stats.hits);
+  mu_assert_int_eq(3, stats.misses);
+  mu_assert_int_eq(4, stats.recycled);
+  mu_assert_int_eq(1, stats.discarded);
+
+  mu_check(dlite_meta_enable_pool(entity, 0) == 0);
+  mu_check(dlite_meta_get_pool_stats(entity, &stats) == 0);
+  mu_assert_int_eq(0, stats.size);
+  mu_check(entity->_pool == NULL);
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
+}
+
+MU_TEST(test_instance_create_many)
+{
+  DLiteInstance **insts;
+  size_t i, dims[]={2, 1};  /* same as mydata */
+  const char *ids[] = {NULL, NULL, "batch-instance", NULL, NULL};
+  int intarr[2][3] = {{0, 1, 2}, {3, 4, 5}};
+  ids[1] = id;  /* existing instance */
+
+  mu_check((insts = dlite_instance_create_many(entity, dims, 5, ids)));
+  mu_check(insts[1] == mydata);
+  mu_assert_int_eq(2, mydata->_refcount);
+  mu_check(insts[0]->_flags & dliteFlagBatch);
+  mu_check(!(insts[1]->_flags & dliteFlagBatch));
+  mu_check((char *)insts[2] > (char *)insts[0]);
+  mu_check((char *)insts[4] > (char *)insts[3]);
+  mu_check(dlite_instance_has("batch-instance", 0) == insts[2]);
+  mu_check(strcmp(insts[0]->uuid, insts[3]->uuid) != 0);
+  mu_assert_int_eq(2, DLITE_PROP_DIM(insts[4], 2, 1));
+  mu_check(dlite_instance_set_property(insts[3], "an-int-arr", intarr) == 0);
+  mu_assert_int_eq(7, entity->_refcount);  /* refs: global+store+5 */
+  for (i=0; i<5; i++) dlite_instance_decref(insts[i]);
+  free(insts);
+  mu_check(!dlite_instance_has("batch-instance", 0));
+  mu_assert_int_eq(1, mydata->_refcount);
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
+
+  /* batch with property arenas */
+  mu_check(dlite_meta_set_alloc_mode(entity, dliteAllocArena) == 0);
+  mu_check((insts = dlite_instance_create_many(entity, dims, 3, NULL)));
+  mu_check(dlite_meta_set_alloc_mode(entity, dliteAllocDefault) == 0);
+  for (i=0; i<3; i++) {
+    mu_check(insts[i]->_flags & dliteFlagArena);
+    mu_check(insts[i]->_flags & dliteFlagBatch);
+    mu_assert_int_eq(0, (size_t)*(int **)DLITE_PROP(insts[i], 2) % 64);
+  }
+  for (i=0; i<3; i++) dlite_instance_decref(insts[i]);
+  free(insts);
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
+}
+
+MU_TEST(test_instance_property_handle)
+{
+  DLitePropertyHandle hfloat, hint, hstr, *h;
+  DLiteInstance *inst;
+  size_t dims[]={2, 1};
+  float afloat=2.5f, oldfloat;
+  int intarr[2] = {7, 8}, oldarr[2], *ip;
+  char *astring="handle", *oldstring, **sp;
+  FILE *old = dlite_err_get_stream();
+
+  mu_check(dlite_meta_get_property_handle(entity, "a-float", &hfloat) == 0);
+  mu_check(dlite_meta_get_property_handle(entity, "an-int-arr", &hint) == 0);
+  mu_check(dlite_meta_get_property_handle(entity, "a-string", &hstr) == 0);
+  mu_assert_int_eq(1, hfloat.index);
+  mu_assert_int_eq(dliteFloat, hfloat.type);
+  mu_assert_int_eq(entity->_propoffsets[1], hfloat.offset);
+  mu_check(hfloat.direct && hint.direct && !hstr.direct);
+  oldfloat = *(float *)DLITE_PROP(mydata, 1);
+  memcpy(oldarr, *(int **)DLITE_PROP(mydata, 2), sizeof(oldarr));
+  oldstring = *(char **)DLITE_PROP(mydata, 0);
+  if (oldstring) oldstring = strdup(oldstring);
+
+  /* direct access */
+  mu_check(dlite_instance_set_property_by_handle(mydata, &hfloat,
+                                                 &afloat) == 0);
+  mu_assert_double_eq(2.5, *(float *)dlite_instance_get_property_by_handle(
+                        mydata, &hfloat));
+  mu_assert_double_eq(2.5, *(float *)DLITE_PROP(mydata, 1));
+  mu_check(dlite_instance_set_property_by_handle(mydata, &hint, intarr) == 0);
+  mu_check((ip = dlite_instance_get_property_by_handle(mydata, &hint)));
+  mu_assert_int_eq(8, ip[1]);
+  mu_check(ip == dlite_instance_get_property(mydata, "an-int-arr"));
+
+  /* allocated types go via the generic accessors */
+  mu_check(dlite_instance_set_property_by_handle(mydata, &hstr,
+                                                 &astring) == 0);
+  mu_check((sp = dlite_instance_get_property_by_handle(mydata, &hstr)));
+  mu_assert_string_eq("handle", *sp);
+  mu_check(*sp != astring);
+
+  /* handles created for bindings */
+  mu_check((h = dlite_property_handle_create(entity, "a-float")));
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+  mu_check(dlite_instance_set_property_by_handle(inst, h, &afloat) == 0);
+  mu_assert_double_eq(2.5, *(float *)dlite_instance_get_property_by_handle(
+                        inst, h));
+  dlite_property_handle_free(h);
+  dlite_instance_decref(inst);
+
+  /* errors */
+  dlite_err_set_stream(NULL);
+  mu_check(dlite_meta_get_property_handle(entity, "no-such", &hint));
+  mu_check(!dlite_property_handle_create(entity, "no-such"));
+  mu_check(!dlite_instance_get_property_by_handle((DLiteInstance *)entity,
+                                                  &hfloat));
+  dlite_err_set_stream(old);
+
+  /* restore mydata for the following tests */
+  mu_check(dlite_instance_set_property_by_handle(mydata, &hfloat,
+                                                 &oldfloat) == 0);
+  mu_check(dlite_instance_set_property_by_handle(mydata, &hint, oldarr) == 0);
+  mu_check(dlite_instance_set_property_by_handle(mydata, &hstr,
+                                                 &oldstring) == 0);
+  if (oldstring) free(oldstring);
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
+}
+
+MU_TEST(test_instance_allocator)
+{
+  DLiteInstance *inst, *inst2, **insts;
+  size_t i, dims[]={3, 2};
+  int newdims[] = {5, -1};
+  int intarr[2][3] = {{0, 1, 2}, {3, 4, 5}};
+  int *iarr;
+
+  mu_check(dlite_instance_get_allocator() == NULL);
+  mu_check(dlite_instance_set_allocator(&counting_allocator) == NULL);
+  mu_check(dlite_instance_get_allocator() == &counting_allocator);
+
+  /* header and the three dimensional properties */
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+  mu_check(inst->_flags & dliteFlagAllocator);
+  mu_assert_int_eq(4, nalloc);
+  mu_check(dlite_instance_set_property(inst, "an-int-arr", intarr) == 0);
+  mu_check(dlite_instance_set_dimension_sizes(inst, newdims) == 0);
+  iarr = dlite_instance_get_property(inst, "an-int-arr");
+  mu_assert_int_eq(5, iarr[5]);
+  mu_assert_int_eq(4, nalloc);
+
+  /* copy-on-write copies share arrays with the same allocator */
+  mu_check((inst2 = dlite_instance_copy_cow(inst, NULL)));
+  mu_check(dlite_instance_get_property(inst2, "an-int-arr") == iarr);
+  mu_check(dlite_instance_make_writable(inst2, 2) == 0);
+  mu_check(dlite_instance_get_property(inst2, "an-int-arr") != iarr);
+  dlite_instance_decref(inst2);
+  mu_assert_int_eq(4, nalloc);
+
+  /* batches */
+  mu_check((insts = dlite_instance_create_many(entity, dims, 3, NULL)));
+  mu_assert_int_eq(4 + 1 + 3*3, nalloc);
+  for (i=0; i<3; i++) {
+    mu_check(insts[i]->_flags & dliteFlagAllocator);
+    dlite_instance_decref(insts[i]);
+  }
+  free(insts);
+
+  mu_check(dlite_instance_set_allocator(NULL) == &counting_allocator);
+  mu_check(dlite_instance_get_allocator() == NULL);
+  mu_check((inst2 = dlite_instance_create(entity, dims, NULL)));
+  mu_check(!(inst2->_flags & dliteFlagAllocator));
+  dlite_instance_decref(inst2);
+
+  mu_assert_int_eq(4, nalloc);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, nalloc);
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
+}
+
 MU_TEST(test_instance_copy)
 {
   DLiteStorage *s;
@@ -155,6 +624,188 @@ MU_TEST(test_instance_copy)
   mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
 }
 
+MU_TEST(test_instance_copy_cow)
+{
+  DLiteInstance *inst, *inst2, *inst3;
+  int *src, *arr, intarr[2] = {10, 11};
+  int newdims[] = {-1, 2};
+
+  mu_check((inst = dlite_instance_copy_cow(mydata, NULL)));
+  mu_check((inst2 = dlite_instance_copy_cow(mydata, NULL)));
+  mu_check(inst->_flags & dliteFlagShared);
+  mu_check(mydata->_flags & dliteFlagShared);
+  src = dlite_instance_get_property(mydata, "an-int-arr");
+  mu_check(dlite_instance_get_property(inst, "an-int-arr") == src);
+  mu_check(dlite_instance_get_property(inst2, "an-int-arr") == src);
+  mu_check(dlite_instance_get_property(inst, "a-string-arr") !=
+           dlite_instance_get_property(mydata, "a-string-arr"));
+
+  /* writing makes a private copy */
+  mu_check(dlite_instance_set_property(inst, "an-int-arr", intarr) == 0);
+  arr = dlite_instance_get_property(inst, "an-int-arr");
+  mu_check(arr != src);
+  mu_assert_int_eq(10, arr[0]);
+  mu_assert_int_eq(1, src[1]);
+
+  mu_check((arr = *(int **)DLITE_PROP_RW(inst2, 2)));
+  mu_check(arr != src);
+  mu_assert_int_eq(src[1], arr[1]);
+
+  /* resizing makes a private copy */
+  mu_check((inst3 = dlite_instance_copy_cow(inst2, NULL)));
+  mu_check(dlite_instance_get_property(inst3, "an-int-arr") == arr);
+  mu_check(dlite_instance_set_dimension_sizes(inst3, newdims) == 0);
+  mu_check(dlite_instance_get_property(inst3, "an-int-arr") != arr);
+  mu_assert_int_eq(arr[1], ((int *)
+                   dlite_instance_get_property(inst3, "an-int-arr"))[1]);
+  dlite_instance_decref(inst3);
+
+  /* free'ing shared arrays */
+  mu_check((inst3 = dlite_instance_copy_cow(inst2, NULL)));
+  dlite_instance_decref(inst2);
+  mu_assert_int_eq(src[1], ((int *)
+                   dlite_instance_get_property(inst3, "an-int-arr"))[1]);
+  dlite_instance_decref(inst3);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(1, mydata->_refcount);
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
+}
+
+/* Reads the frozen instance `arg` many times, taking references to it. */
+static void *read_frozen(void *arg)
+{
+  DLiteInstance *inst = arg;
+  unsigned char fp[DLITE_FINGERPRINT_SIZE];
+  long sum=0;
+  int i, *arr;
+  for (i=0; i<1000; i++) {
+    dlite_instance_incref(inst);
+    arr = dlite_instance_get_property(inst, "an-int-arr");
+    sum += arr[0] + arr[1];
+    if (i % 100 == 0 && dlite_instance_fingerprint(inst, fp)) sum = -1;
+    dlite_instance_decref(inst);
+  }
+  return (sum < 0) ? inst : NULL;
+}
+
+MU_TEST(test_instance_freeze)
+{
+  DLiteInstance *inst, *copy;
+  Thread threads[4];
+  void *result;
+  int intarr[2] = {10, 11}, newdims[] = {-1, 2}, i, count;
+  float value = 1.5;
+  FILE *old = dlite_err_get_stream();
+  DLitePropertyHandle h;
+  DLiteProperty props[] = {
+    {"x", dliteInt, sizeof(int), 0, NULL, "", NULL, "A value."}
+  };
+  DLiteMeta *meta;
+
+  mu_check((inst = dlite_instance_copy(mydata, NULL)));
+  mu_check(!dlite_instance_is_frozen(inst));
+  mu_assert_int_eq(0, dlite_instance_freeze(inst, 0));
+  mu_check(dlite_instance_is_frozen(inst));
+  mu_check(!dlite_instance_is_frozen((DLiteInstance *)entity));
+  mu_assert_int_eq(0, dlite_instance_freeze(inst, 0));  /* no-op */
+
+  /* all modifications fail */
+  dlite_err_set_stream(NULL);
+  mu_check(dlite_instance_set_property(inst, "an-int-arr", intarr));
+  mu_check(dlite_instance_set_property(inst, "a-float", &value));
+  mu_check(dlite_instance_set_dimension_sizes(inst, newdims));
+  mu_check(dlite_instance_append_dimension(inst, "M", 1));
+  mu_check(dlite_instance_reserve_dimension(inst, "M", 10));
+  mu_check(dlite_instance_mark_dirty(inst, NULL));
+  mu_check(!DLITE_PROP_RW(inst, 2));
+  mu_check(dlite_meta_get_property_handle(entity, "a-float", &h) == 0);
+  mu_check(dlite_instance_set_property_by_handle(inst, &h, &value));
+  dlite_err_set_stream(old);
+  mu_assert_int_eq(1, ((int *)dlite_instance_get_property(
+                         inst, "an-int-arr"))[1]);
+
+  /* copies are not frozen and frozen instances don't share arrays */
+  mu_check((copy = dlite_instance_copy_cow(inst, NULL)));
+  mu_check(!dlite_instance_is_frozen(copy));
+  mu_check(!(inst->_flags & dliteFlagShared));
+  mu_assert_int_eq(0, dlite_instance_set_property(copy, "an-int-arr",
+                                                  intarr));
+  mu_assert_int_eq(1, ((int *)dlite_instance_get_property(
+                         inst, "an-int-arr"))[1]);
+  dlite_instance_decref(copy);
+
+  /* concurrent reading */
+  for (i=0; i<4; i++)
+    mu_assert_int_eq(0, thread_create(threads + i, read_frozen, inst));
+  for (i=0; i<4; i++) {
+    mu_assert_int_eq(0, thread_join(threads[i], &result));
+    mu_check(result == NULL);
+  }
+  mu_assert_int_eq(1, inst->_refcount);
+
+  dlite_instance_decref(inst);
+
+  /* immortal instances and metadata ignore reference counting */
+  mu_check((meta = dlite_meta_create("http://onto-ns.com/meta/0.1/Frozen",
+                                     NULL, "Frozen.", 0, NULL, 1, props)));
+  mu_check((inst = dlite_instance_create(meta, NULL, NULL)));
+  mu_assert_int_eq(0, dlite_instance_freeze(inst, dliteFreezeImmortal |
+                                            dliteFreezeMeta));
+  mu_check(dlite_instance_is_frozen((DLiteInstance *)meta));
+  mu_check(!dlite_instance_is_frozen((DLiteInstance *)meta->meta));
+  mu_assert_int_eq(1, dlite_instance_incref(inst));
+  mu_assert_int_eq(1, dlite_instance_decref(inst));
+  mu_assert_int_eq(1, dlite_instance_decref(inst));
+  mu_check(dlite_instance_has(inst->uuid, 0) == inst);
+  count = meta->_refcount;
+  mu_check((copy = dlite_instance_create(meta, NULL, NULL)));
+  mu_assert_int_eq(count, meta->_refcount);
+  dlite_instance_decref(copy);
+  mu_assert_int_eq(count, meta->_refcount);
+}
+
+MU_TEST(test_instance_adopt)
+{
+  DLiteInstance *inst;
+  size_t dims[]={2, 1};  /* same as mydata */
+  int newdims[] = {-1, 2};
+  int *intarr, borrowed[2] = {3, 4};
+  char *strarr[1] = {NULL};
+
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+  mu_check((intarr = malloc(2*sizeof(int))));
+  intarr[0] = 7;
+  intarr[1] = 8;
+  mu_check(dlite_instance_adopt_property(inst, "an-int-arr", intarr,
+                                         count_free) == 0);
+  mu_check(inst->_flags & dliteFlagForeign);
+  mu_check(dlite_instance_get_property(inst, "an-int-arr") == intarr);
+  mu_check(dlite_instance_adopt_property(inst, "a-float", intarr, NULL));
+  mu_check(dlite_instance_borrow_property(inst, "a-string-arr", strarr));
+
+  /* resizing copies the data and releases the adopted array */
+  mu_check(dlite_instance_set_dimension_sizes(inst, newdims) == 0);
+  mu_assert_int_eq(1, nfree);
+  mu_check((intarr = dlite_instance_get_property(inst, "an-int-arr")));
+  mu_assert_int_eq(8, intarr[1]);
+  mu_assert_int_eq(0, intarr[3]);
+
+  mu_check((intarr = calloc(4, sizeof(int))));
+  mu_check(dlite_instance_adopt_property(inst, "an-int-arr", intarr,
+                                         count_free) == 0);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_assert_int_eq(2, nfree);
+
+  /* borrowed arrays are never free'ed */
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+  mu_check(dlite_instance_borrow_property(inst, "an-int-arr", borrowed) == 0);
+  mu_assert_int_eq(4, ((int *)
+                   dlite_instance_get_property(inst, "an-int-arr"))[1]);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_assert_int_eq(2, nfree);
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+mydata */
+}
+
 MU_TEST(test_instance_save)
 {
   DLiteStorage *s;
@@ -177,6 +828,11 @@ MU_TEST(test_instance_hdf5)
 {
 #ifdef WITH_HDF5
   DLiteStorage *s;
+  DLiteInstance *inst;
+  char *buf1, *buf2;
+  long size[3];
+  FILE *fp;
+  int i;
   mu_check((s = dlite_storage_open("hdf5", datafile, "mode=r")));
   mu_check((mydata2 = dlite_instance_load(s, id)));
   mu_check(dlite_storage_close(s) == 0);
@@ -185,8 +841,558 @@ MU_TEST(test_instance_hdf5)
   mu_check(dlite_instance_save(s, mydata2) == 0);
   mu_check(dlite_storage_close(s) == 0);
 
+  /* chunked and compressed datasets */
+  mu_check(!dlite_storage_open("hdf5", datafile3, "mode=w;chunk=0"));
+  mu_check(!dlite_storage_open("hdf5", datafile3, "mode=w;compression=lz"));
+  dlite_errclr();
+  mu_check((s = dlite_storage_open("hdf5", datafile3,
+                                   "mode=w;chunk=2;compression=gzip:6;"
+                                   "shuffle=yes")));
+  mu_check(dlite_instance_save(s, mydata2) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  /* repeated saves overwrite the datasets in place */
+  for (i=0; i<3; i++) {
+    mu_check((s = dlite_storage_open("hdf5", datafile3, "mode=append")));
+    mu_check(dlite_instance_save(s, mydata2) == 0);
+    mu_check(dlite_storage_close(s) == 0);
+    mu_check((fp = fopen(datafile3, "rb")));
+    fseek(fp, 0, SEEK_END);
+    size[i] = ftell(fp);
+    fclose(fp);
+  }
+  mu_assert_int_eq(size[1], size[2]);
+
+  /* chunked datasets are extended when a dimension grows */
+  mu_check(dlite_instance_set_dimension_size(mydata2, "M", 5) == 0);
+  mu_check((s = dlite_storage_open("hdf5", datafile3, "mode=append")));
+  mu_check(dlite_instance_save(s, mydata2) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check((buf1 = dlite_json_aprint(mydata2, 0, 0)));
+
   mu_assert_int_eq(1, mydata2->_refcount);
   mu_assert_int_eq(0, dlite_instance_decref(mydata2));
+
+  mu_check((s = dlite_storage_open("hdf5", datafile3, "mode=r")));
+  mu_check((inst = dlite_instance_load(s, id)));
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check((buf2 = dlite_json_aprint(inst, 0, 0)));
+  mu_assert_string_eq(buf1, buf2);
+  free(buf1);
+  free(buf2);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+#endif
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_instance_hdf5_access)
+{
+#ifdef WITH_HDF5
+  DLiteStorage *s;
+  DLiteInstance *inst, *inst2;
+  char *buf1, *buf2;
+  char *pagedfile = "myentity_paged.h5";
+  char *corefile = "myentity_core.h5";
+  int *intarr;
+  FILE *fp;
+
+  /* files without paged file space are read without page buffering */
+  mu_check((s = dlite_storage_open("hdf5", datafile,
+                                   "mode=r;page-buffer=64k")));
+  mu_check((inst = dlite_instance_load(s, id)));
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check((buf1 = dlite_json_aprint(inst, 0, 0)));
+
+  /* new files are created with paged file space */
+  remove(pagedfile);
+  mu_check((s = dlite_storage_open("hdf5", pagedfile,
+                                   "mode=append;page-buffer=64k;"
+                                   "page-size=8k;metadata-cache=2M;"
+                                   "alignment=1:512")));
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+  mu_check((s = dlite_storage_open("hdf5", pagedfile,
+                                   "mode=r;page-buffer=64k;page-size=8k")));
+  mu_check((inst2 = dlite_instance_load(s, id)));
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check((buf2 = dlite_json_aprint(inst2, 0, 0)));
+  mu_assert_string_eq(buf1, buf2);
+  free(buf2);
+
+  /* in-memory files, with and without backing store */
+  remove(corefile);
+  mu_check((s = dlite_storage_open("hdf5", corefile,
+                                   "mode=w;driver=core;backing-store=no")));
+  mu_check(dlite_instance_save(s, inst2) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check(!(fp = fopen(corefile, "rb")));
+  mu_check((s = dlite_storage_open("hdf5", corefile, "mode=w;driver=core")));
+  mu_check(dlite_instance_save(s, inst2) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_assert_int_eq(0, dlite_instance_decref(inst2));
+
+  mu_check((s = dlite_storage_open("hdf5", corefile, "mode=r;driver=core")));
+  mu_check((inst = dlite_instance_load(s, id)));
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check((buf2 = dlite_json_aprint(inst, 0, 0)));
+  mu_assert_string_eq(buf1, buf2);
+  free(buf2);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+  /* contiguous datasets mapped into memory */
+  mu_check((s = dlite_storage_open("hdf5", datafile, "mode=r;mmap=yes")));
+  mu_check((inst = dlite_instance_load(s, id)));
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check(inst->_flags & dliteFlagForeign);
+  mu_check((buf2 = dlite_json_aprint(inst, 0, 0)));
+  mu_assert_string_eq(buf1, buf2);
+  free(buf2);
+  /* modifications are private to the instance */
+  intarr = dlite_instance_get_property(inst, "an-int-arr");
+  intarr[0] = -intarr[0] - 1;
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_check((s = dlite_storage_open("hdf5", datafile, "mode=r;mmap=yes")));
+  mu_check((inst = dlite_instance_load(s, id)));
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check((buf2 = dlite_json_aprint(inst, 0, 0)));
+  mu_assert_string_eq(buf1, buf2);
+  free(buf2);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  free(buf1);
+
+  mu_check(!dlite_storage_open("hdf5", pagedfile, "page-buffer=1k"));
+  mu_check(!dlite_storage_open("hdf5", pagedfile, "driver=mpio"));
+  mu_check(!dlite_storage_open("hdf5", pagedfile, "alignment=4x"));
+  mu_check(!dlite_storage_open("hdf5", pagedfile, "mode=append;mmap=yes"));
+  dlite_errclr();
+#endif
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_instance_hdf5_lossy)
+{
+#ifdef WITH_HDF5
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  DLiteProperty properties[] = {
+    {"field", dliteFloat, sizeof(double), 1, dims, "K", NULL, "Field."}
+  };
+  char *lossyfile = "myentity_lossy.h5";
+  char *losslessfile = "myentity_lossless.h5";
+  DLiteMeta *meta;
+  DLiteInstance *inst;
+  DLiteStorage *s;
+  size_t i, n[] = {20000};
+  double *field, x=0.0;
+  long size[2];
+  FILE *fp;
+
+  mu_check((meta = dlite_meta_create("http://onto-ns.com/meta/0.1/Field",
+                                     NULL, "Lossy test.", 1, dimensions,
+                                     1, properties)));
+  mu_check((inst = dlite_instance_create(meta, n, "lossy-field")));
+  field = dlite_instance_get_property(inst, "field");
+  for (i=0; i<n[0]; i++) {
+    x = x*0.9 + (double)((i*2654435761u) % 1000) / 1000.0;
+    field[i] = 300.0 + x;
+  }
+  mu_check((s = dlite_storage_open("hdf5", losslessfile,
+                                   "mode=w;compression=gzip;shuffle=yes")));
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check((s = dlite_storage_open("hdf5", lossyfile,
+                                   "mode=w;compression=gzip;shuffle=yes;"
+                                   "rel_tol=field:1e-6")));
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+  mu_check((s = dlite_storage_open("hdf5", lossyfile, "mode=r")));
+  mu_check((inst = dlite_instance_load(s, "lossy-field")));
+  mu_check(dlite_storage_close(s) == 0);
+  field = dlite_instance_get_property(inst, "field");
+  x = 0.0;
+  for (i=0; i<n[0]; i++) {
+    double d;
+    x = x*0.9 + (double)((i*2654435761u) % 1000) / 1000.0;
+    d = field[i] - (300.0 + x);
+    mu_check(-1e-6*field[i] <= d && d <= 1e-6*field[i]);
+  }
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+  /* rounded values compress better */
+  mu_check((fp = fopen(losslessfile, "rb")));
+  fseek(fp, 0, SEEK_END);
+  size[0] = ftell(fp);
+  fclose(fp);
+  mu_check((fp = fopen(lossyfile, "rb")));
+  fseek(fp, 0, SEEK_END);
+  size[1] = ftell(fp);
+  fclose(fp);
+  mu_check(size[1] < size[0]*3/4);
+
+  mu_check(!dlite_storage_open("hdf5", lossyfile, "mode=r;abs_tol=0"));
+  mu_check(!dlite_storage_open("hdf5", lossyfile, "mode=r;rel_tol=:1e-3"));
+  dlite_errclr();
+  dlite_meta_decref(meta);
+#endif
+}
+
+MU_TEST(test_instance_hdf5_distributed)
+{
+#ifdef WITH_HDF5
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  const DLiteDecomposition *dec;
+  size_t dims[] = {3, 2};  /* M, N (local) */
+  char *distid = "my-distributed-data";
+  char *distfile = "myentity_distributed.h5";
+  char *strarr[2][2] = {{"a", "b"}, {"c", "d"}};
+  int rank, i, j, *intarr;
+  char **astring;
+
+  /* without distributed support */
+  mu_check((s = dlite_storage_open("json", "myentity_distributed.json",
+                                   "mode=w")));
+  mu_check(!(dlite_storage_get_capabilities(s) & dliteCapDistributed));
+  mu_check(dlite_storage_set_decomposition(s, "N", 0, 4));
+  mu_check(dlite_storage_close(s) == 0);
+  dlite_errclr();
+
+  /* each "rank" writes its block of dimension N in turn */
+  for (rank=0; rank<2; rank++) {
+    mu_check((inst = dlite_instance_create(entity, dims, distid)));
+    intarr = dlite_instance_get_property(inst, "an-int-arr");
+    for (i=0; i<6; i++) intarr[i] = rank*6 + i;
+    mu_check(dlite_instance_set_property(inst, "a-string-arr",
+                                         strarr[rank]) == 0);
+    mu_check((s = dlite_storage_open("hdf5", distfile,
+                                     (rank) ? "mode=append" : "mode=w")));
+    mu_check(dlite_storage_get_capabilities(s) & dliteCapDistributed);
+    mu_check(dlite_storage_set_decomposition(s, "N", 4, 4));
+    mu_check(dlite_storage_set_decomposition(s, "N", rank*2, 4) == 0);
+    mu_check((dec = dlite_storage_get_decomposition(s, "N")));
+    mu_assert_int_eq(rank*2, dec->offset);
+    mu_check(!dlite_storage_get_decomposition(s, "M"));
+    mu_check(dlite_instance_save(s, inst) == 0);
+    mu_check(dlite_storage_close(s) == 0);
+    mu_assert_int_eq(0, dlite_instance_decref(inst));
+  }
+  dlite_errclr();
+
+  mu_check((s = dlite_storage_open("hdf5", distfile, "mode=r")));
+  mu_check((inst = dlite_instance_load(s, distid)));
+  mu_check(dlite_storage_close(s) == 0);
+  mu_assert_int_eq(3, dlite_instance_get_dimension_size(inst, "M"));
+  mu_assert_int_eq(4, dlite_instance_get_dimension_size(inst, "N"));
+  intarr = dlite_instance_get_property(inst, "an-int-arr");
+  for (i=0; i<12; i++) mu_assert_int_eq(i, intarr[i]);
+  astring = dlite_instance_get_property(inst, "a-string-arr");
+  for (i=0; i<2; i++)
+    for (j=0; j<2; j++)
+      mu_assert_string_eq(strarr[i][j], astring[i*2 + j]);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+#endif
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_instance_append_dimension)
+{
+#ifdef WITH_HDF5
+  DLiteStorage *s;
+  DLiteInstance *inst, *inst2;
+  size_t dims[] = {3, 1};  /* M, N */
+  char *options[] = {"mode=w;swmr=yes", "mode=w"};
+  char *readopts[] = {"mode=r;swmr=yes", "mode=r"};
+  char *filename = "myentity_append.h5";
+  char uuid[DLITE_UUID_LENGTH+1];
+  char **sarr;
+  int i, j, k, *iarr;
+
+  for (k=0; k<2; k++) {
+    mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+    strcpy(uuid, inst->uuid);
+    iarr = dlite_instance_get_property(inst, "an-int-arr");
+    for (j=0; j<3; j++) iarr[j] = j;
+    mu_check((s = dlite_storage_open("hdf5", filename, options[k])));
+    mu_check(dlite_instance_save(s, inst) == 0);
+
+    /* append rows and save them one by one */
+    for (i=1; i<4; i++) {
+      mu_check(dlite_instance_append_dimension(inst, "N", 1) == 0);
+      mu_assert_int_eq(i+1, dlite_instance_get_dimension_size(inst, "N"));
+      iarr = dlite_instance_get_property(inst, "an-int-arr");
+      for (j=0; j<3; j++) iarr[i*3 + j] = i*3 + j;
+      sarr = dlite_instance_get_property(inst, "a-string-arr");
+      mu_check((sarr[i] = strdup("row")));
+      /* earlier rows are not rewritten, unless marked as modified */
+      iarr[0] = -1;
+      mu_check(dlite_instance_save(s, inst) == 0);
+    }
+    mu_check(dlite_storage_close(s) == 0);
+    mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+    mu_check((s = dlite_storage_open("hdf5", filename, readopts[k])));
+    mu_check((inst2 = dlite_instance_load(s, uuid)));
+    mu_check(dlite_storage_close(s) == 0);
+    mu_assert_int_eq(4, dlite_instance_get_dimension_size(inst2, "N"));
+    iarr = dlite_instance_get_property(inst2, "an-int-arr");
+    for (j=0; j<12; j++) mu_assert_int_eq(j, iarr[j]);
+    sarr = dlite_instance_get_property(inst2, "a-string-arr");
+    for (i=1; i<4; i++) mu_assert_string_eq("row", sarr[i]);
+    mu_assert_int_eq(0, dlite_instance_decref(inst2));
+  }
+#endif
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_instance_reserve_dimension)
+{
+  DLiteInstance *inst;
+  size_t dims[] = {3, 1};  /* M, N */
+  int i, j, *iarr, nmoves=0;
+  char **sarr;
+
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+
+  /* growing within the reserved capacity doesn't reallocate */
+  mu_check(dlite_instance_reserve_dimension(inst, "N", 10) == 0);
+  mu_check(inst->_flags & dliteFlagReserved);
+  mu_assert_int_eq(1, dlite_instance_get_dimension_size(inst, "N"));
+  iarr = *(int **)DLITE_PROP(inst, 2);
+  mu_check(dlite_instance_set_dimension_size(inst, "N", 10) == 0);
+  mu_check(*(int **)DLITE_PROP(inst, 2) == iarr);
+  for (j=0; j<30; j++) mu_assert_int_eq(0, iarr[j]);
+
+  /* appending rows one by one only reallocates a few times */
+  for (i=10; i<1000; i++) {
+    mu_check(dlite_instance_append_dimension(inst, "N", 1) == 0);
+    if (*(int **)DLITE_PROP(inst, 2) != iarr) nmoves++;
+    iarr = *(int **)DLITE_PROP(inst, 2);
+    for (j=0; j<3; j++) {
+      mu_assert_int_eq(0, iarr[i*3 + j]);
+      iarr[i*3 + j] = i*3 + j;
+    }
+    sarr = *(char ***)DLITE_PROP(inst, 3);
+    mu_check(sarr[i] == NULL);
+    mu_check((sarr[i] = strdup("row")));
+  }
+  mu_check(nmoves <= 10);
+  for (j=30; j<3000; j++) mu_assert_int_eq(j, iarr[j]);
+
+  /* shrinking and growing again zeroes the new rows */
+  mu_check(dlite_instance_set_dimension_size(inst, "N", 500) == 0);
+  mu_check(dlite_instance_set_dimension_size(inst, "N", 600) == 0);
+  mu_check(*(int **)DLITE_PROP(inst, 2) == iarr);
+  for (j=1497; j<1500; j++) mu_assert_int_eq(j, iarr[j]);
+  for (j=1500; j<1800; j++) mu_assert_int_eq(0, iarr[j]);
+  sarr = *(char ***)DLITE_PROP(inst, 3);
+  mu_assert_string_eq("row", sarr[499]);
+  mu_check(sarr[500] == NULL);
+
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_instance_hdf5_compact)
+{
+#ifdef WITH_HDF5
+  DLiteStorage *s;
+  DLiteInstance *insts[6], *inst;
+  size_t dims[] = {3, 2};  /* M, N */
+  size_t dims2[] = {2, 4};
+  char *filename = "myentity_compact.h5";
+  char uuids[6][DLITE_UUID_LENGTH+1];
+  char **names, **sarr;
+  float *afloat;
+  int i, j, *iarr;
+
+  /* five instances with the same dimensions share a row group */
+  mu_check((s = dlite_storage_open("hdf5", filename, "mode=w;compact=yes")));
+  for (i=0; i<6; i++) {
+    mu_check((insts[i] = dlite_instance_create(entity,
+                                               (i < 5) ? dims : dims2, NULL)));
+    strcpy(uuids[i], insts[i]->uuid);
+    afloat = dlite_instance_get_property(insts[i], "a-float");
+    *afloat = 0.5f * i;
+    iarr = dlite_instance_get_property(insts[i], "an-int-arr");
+    for (j=0; j<6; j++) iarr[j] = 10*i + j;
+    sarr = dlite_instance_get_property(insts[i], "a-string-arr");
+    mu_check((sarr[1] = strdup("compact")));
+    mu_check(dlite_instance_save(s, insts[i]) == 0);
+  }
+  mu_check(dlite_storage_close(s) == 0);
+  for (i=0; i<6; i++) mu_assert_int_eq(0, dlite_instance_decref(insts[i]));
+
+  mu_check((s = dlite_storage_open("hdf5", filename, "mode=r")));
+  mu_check((names = dlite_storage_uuids(s, NULL)));
+  for (i=0; names[i]; i++) free(names[i]);
+  free(names);
+  mu_assert_int_eq(6, i);
+  for (i=0; i<6; i++) {
+    mu_check((inst = dlite_instance_load(s, uuids[i])));
+    mu_assert_int_eq((i < 5) ? 2 : 4,
+                     dlite_instance_get_dimension_size(inst, "N"));
+    afloat = dlite_instance_get_property(inst, "a-float");
+    mu_assert_double_eq(0.5f * i, *afloat);
+    iarr = dlite_instance_get_property(inst, "an-int-arr");
+    for (j=0; j<6; j++) mu_assert_int_eq(10*i + j, iarr[j]);
+    sarr = dlite_instance_get_property(inst, "a-string-arr");
+    mu_assert_string_eq("compact", sarr[1]);
+    mu_assert_int_eq(0, dlite_instance_decref(inst));
+  }
+  mu_check(dlite_storage_close(s) == 0);
+
+  /* update an instance in place */
+  mu_check((s = dlite_storage_open("hdf5", filename,
+                                   "mode=append;compact=yes")));
+  mu_check((inst = dlite_instance_load(s, uuids[2])));
+  afloat = dlite_instance_get_property(inst, "a-float");
+  *afloat = 42.0f;
+  mu_check(dlite_instance_mark_dirty(inst, "a-float") == 0);
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+  mu_check((s = dlite_storage_open("hdf5", filename, "mode=r")));
+  mu_check((inst = dlite_instance_load(s, uuids[2])));
+  afloat = dlite_instance_get_property(inst, "a-float");
+  mu_assert_double_eq(42.0f, *afloat);
+  iarr = dlite_instance_get_property(inst, "an-int-arr");
+  mu_assert_int_eq(25, iarr[5]);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_check((inst = dlite_instance_load(s, uuids[3])));
+  afloat = dlite_instance_get_property(inst, "a-float");
+  mu_assert_double_eq(1.5f, *afloat);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_check(dlite_storage_close(s) == 0);
+#endif
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_instance_load_lazy)
+{
+#ifdef WITH_HDF5
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  float *afloat;
+  char **astring;
+  mu_check((s = dlite_storage_open("hdf5", datafile, "mode=r")));
+  mu_check((inst = dlite_instance_load_lazy(s, id)));
+  mu_check(inst->_flags & dliteFlagLazy);
+  mu_assert_double_eq(0.0, *(float *)DLITE_PROP(inst, 1));  /* not loaded */
+
+  mu_check((afloat = dlite_instance_get_property(inst, "a-float")));
+  mu_assert_double_eq(3.14f, *afloat);
+  mu_check(inst->_flags & dliteFlagLazy);
+
+  mu_check(dlite_instance_load_all(inst) == 0);
+  mu_check(!(inst->_flags & dliteFlagLazy));
+  mu_check((astring = DLITE_PROP(inst, 0)));
+  mu_assert_string_eq("string value", *astring);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+  /* free partly loaded instance */
+  mu_check((inst = dlite_instance_load_lazy(s, id)));
+  mu_check(dlite_instance_load_property(inst, 0) == 0);
+  mu_assert_string_eq("string value", *(char **)DLITE_PROP(inst, 0));
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_check(dlite_storage_close(s) == 0);
+#endif
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_instance_save_dirty)
+{
+#ifdef WITH_HDF5
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  size_t dims[]={2, 1};
+  char uuid[DLITE_UUID_LENGTH+1];
+  char *astring="first", *astring2="second";
+  float afloat=1.0f;
+
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+  strcpy(uuid, inst->uuid);
+  mu_check(dlite_instance_set_property(inst, "a-string", &astring) == 0);
+  mu_check(dlite_instance_set_property(inst, "a-float", &afloat) == 0);
+  mu_check((s = dlite_storage_open("hdf5", "myentity_dirty.h5", "mode=w")));
+  mu_check(!(inst->_flags & dliteFlagSaved));
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_check(inst->_flags & dliteFlagSaved);
+
+  /* only modified properties are written */
+  *(float *)DLITE_PROP(inst, 1) = 2.0f;
+  mu_check(dlite_instance_set_property(inst, "a-string", &astring2) == 0);
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+  mu_check((s = dlite_storage_open("hdf5", "myentity_dirty.h5", "mode=r")));
+  mu_check((inst = dlite_instance_load(s, uuid)));
+  mu_check(dlite_storage_close(s) == 0);
+  mu_assert_string_eq("second", *(char **)DLITE_PROP(inst, 0));
+  mu_assert_double_eq(1.0, *(float *)DLITE_PROP(inst, 1));
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+#endif
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_instance_load_property_slice)
+{
+#ifdef WITH_HDF5
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  DLiteArray *arr;
+  size_t i, dims[]={3, 4};
+  int intarr[4][3] = {{0, 1, 2}, {3, 4, 5}, {6, 7, 8}, {9, 10, 11}};
+  char *strarr[] = {"a", "b", "c", "d"};
+  size_t offsets[] = {1, 0}, counts[] = {2, 2}, strides[] = {2, 2};
+  size_t offset1[] = {1}, count1[] = {2}, badoffset[] = {3};
+  char uuid[DLITE_UUID_LENGTH+1];
+
+  mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+  mu_check(dlite_instance_set_property(inst, "an-int-arr", intarr) == 0);
+  mu_check(dlite_instance_set_property(inst, "a-string-arr", strarr) == 0);
+  strcpy(uuid, inst->uuid);
+  mu_check((s = dlite_storage_open("hdf5", "myentity-slice.h5", "mode=w")));
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+  mu_check((s = dlite_storage_open("hdf5", "myentity-slice.h5", "mode=r")));
+
+  /* rows 1 and 3, columns 0 and 2 */
+  mu_check((arr = dlite_instance_load_property_slice(s, uuid, "an-int-arr",
+                                                     offsets, counts,
+                                                     strides)));
+  mu_assert_int_eq(2, arr->ndims);
+  mu_assert_int_eq(2, arr->dims[0]);
+  mu_assert_int_eq(2, arr->dims[1]);
+  mu_assert_int_eq(3, ((int *)arr->data)[0]);
+  mu_assert_int_eq(5, ((int *)arr->data)[1]);
+  mu_assert_int_eq(9, ((int *)arr->data)[2]);
+  mu_assert_int_eq(11, ((int *)arr->data)[3]);
+  free(arr->data);
+  dlite_array_free(arr);
+
+  mu_check((arr = dlite_instance_load_property_slice(s, uuid, "a-string-arr",
+                                                     offset1, count1, NULL)));
+  mu_assert_string_eq("b", ((char **)arr->data)[0]);
+  mu_assert_string_eq("c", ((char **)arr->data)[1]);
+  for (i=0; i<2; i++)
+    dlite_type_clear((char **)arr->data + i, arr->type, arr->size);
+  free(arr->data);
+  dlite_array_free(arr);
+
+  /* out of range and scalar properties */
+  mu_check(!dlite_instance_load_property_slice(s, uuid, "a-string-arr",
+                                               badoffset, count1, NULL));
+  mu_check(!dlite_instance_load_property_slice(s, uuid, "a-float",
+                                               offset1, count1, NULL));
+  dlite_errclr();
+  mu_check(dlite_storage_close(s) == 0);
 #endif
   mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
 }
@@ -236,6 +1442,186 @@ MU_TEST(test_instance_snprint)
   dlite_instance_decref(inst);
 }
 
+MU_TEST(test_instance_store_budget)
+{
+#ifdef WITH_JSON
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  DLiteStats stats;
+  char uuid[DLITE_UUID_LENGTH+1];
+  size_t used, nbytes;
+  float value = 3.5;
+  mu_assert_int_eq(0, dlite_instance_store_set_budget(1 << 20));
+  mu_check((s = dlite_storage_open("json", jsonfile, "mode=r")));
+  mu_check((inst = dlite_instance_load(s, id)));
+  mu_check(dlite_storage_close(s) == 0);
+  strcpy(uuid, inst->uuid);
+  nbytes = dlite_stats_instance_nbytes(inst);
+  mu_assert_int_eq(2, inst->_refcount);  /* refs: inst+store */
+  mu_assert_int_eq(1 << 20, dlite_instance_store_get_budget(&used));
+  mu_assert_int_eq(nbytes, used);
+
+  /* the store keeps the instance alive */
+  mu_assert_int_eq(1, dlite_instance_decref(inst));
+  mu_check(dlite_instance_has(uuid, 0));
+
+  /* exceeding the budget releases it, leaving a stub that is reloaded
+     on access */
+  dlite_stats_reset();
+  mu_assert_int_eq(0, dlite_instance_store_set_budget(1));
+  mu_check(!dlite_instance_has(uuid, 0));
+  dlite_instance_store_get_budget(&used);
+  mu_assert_int_eq(0, used);
+  mu_check((inst = dlite_instance_get(uuid)));
+  mu_assert_int_eq(0, dlite_stats_get(&stats));
+  mu_assert_int_eq(2, stats.counters[dliteStatsStoreEvictions]);
+  mu_assert_int_eq(1, stats.counters[dliteStatsStoreReloads]);
+  dlite_stats_deinit(&stats);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));  /* budget exceeded */
+
+  /* modified instances are not reloaded */
+  mu_assert_int_eq(0, dlite_instance_store_set_budget(1 << 20));
+  mu_check((inst = dlite_instance_get(uuid)));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "a-float", &value));
+  mu_assert_int_eq(0, dlite_instance_store_set_budget(1));
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  dlite_stats_reset();
+  mu_check((inst = dlite_instance_get(uuid)));  /* found in storage path */
+  mu_assert_int_eq(0, dlite_stats_get(&stats));
+  mu_assert_int_eq(0, stats.counters[dliteStatsStoreReloads]);
+  dlite_stats_deinit(&stats);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+
+  mu_assert_int_eq(0, dlite_instance_store_set_budget(0));
+  mu_assert_int_eq(0, dlite_instance_store_get_budget(NULL));
+#endif
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+}
+
+MU_TEST(test_instance_fingerprint)
+{
+#ifdef WITH_JSON
+  DLiteStorage *s;
+  DLiteInstance *inst, *copy;
+  unsigned char fp1[DLITE_FINGERPRINT_SIZE], fp2[DLITE_FINGERPRINT_SIZE];
+  unsigned char fp3[DLITE_FINGERPRINT_SIZE];
+  char *str = "another string", *orig;
+  float value = 7.5;
+  mu_check((s = dlite_storage_open("json", jsonfile, "mode=r")));
+  mu_check((inst = dlite_instance_load(s, id)));
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check((copy = dlite_instance_copy(inst, NULL)));
+
+  /* equal content gives equal fingerprints, regardless of uuid */
+  mu_assert_int_eq(0, dlite_instance_fingerprint(inst, fp1));
+  mu_check(inst->_flags & dliteFlagFingerprint);
+  mu_assert_int_eq(0, dlite_instance_fingerprint(copy, fp2));
+  mu_assert_int_eq(0, memcmp(fp1, fp2, DLITE_FINGERPRINT_SIZE));
+  mu_assert_int_eq(0, dlite_instance_fingerprint(inst, fp2));
+  mu_assert_int_eq(0, memcmp(fp1, fp2, DLITE_FINGERPRINT_SIZE));
+
+  /* modifications invalidate the cached fingerprint */
+  mu_assert_int_eq(0, dlite_instance_set_property(copy, "a-float", &value));
+  mu_check(!(copy->_flags & dliteFlagFingerprint));
+  mu_assert_int_eq(0, dlite_instance_fingerprint(copy, fp2));
+  mu_check(memcmp(fp1, fp2, DLITE_FINGERPRINT_SIZE) != 0);
+
+  /* strings are compared by value */
+  mu_check((orig = strdup(*(char **)dlite_instance_get_property(inst,
+                                                                "a-string"))));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "a-string", &str));
+  mu_assert_int_eq(0, dlite_instance_fingerprint(inst, fp3));
+  mu_check(memcmp(fp1, fp3, DLITE_FINGERPRINT_SIZE) != 0);
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "a-string", &orig));
+  mu_assert_int_eq(0, dlite_instance_fingerprint(inst, fp3));
+  mu_assert_int_eq(0, memcmp(fp1, fp3, DLITE_FINGERPRINT_SIZE));
+  free(orig);
+
+  /* metadata have fingerprints too */
+  mu_assert_int_eq(0, dlite_instance_fingerprint((DLiteInstance *)entity,
+                                                 fp3));
+  mu_check(memcmp(fp1, fp3, DLITE_FINGERPRINT_SIZE) != 0);
+
+  dlite_instance_decref(copy);
+  dlite_instance_decref(inst);
+#endif
+}
+
+
+MU_TEST(test_instance_index)
+{
+  DLiteIndex *hidx, *sidx;
+  DLiteInstance *insts[4], **found;
+  size_t dims[]={1, 1};
+  char *names[] = {"alpha", "beta", "alpha", "gamma"};
+  float values[] = {2.5f, 1.0f, 2.0f, 10.0f};
+  float low=1.5f, high=3.0f;
+  char *alpha="alpha", *nosuch="no such name";
+  FILE *old;
+  int i, n;
+
+  /* instances existing when the index is created are indexed */
+  for (i=0; i<2; i++)
+    mu_check((insts[i] = dlite_instance_create(entity, dims, NULL)));
+  mu_check((hidx = dlite_index_create(entity, "a-string", dliteIndexHash)));
+  mu_check((sidx = dlite_index_create(entity, "a-float", dliteIndexSorted)));
+  for (i=2; i<4; i++)
+    mu_check((insts[i] = dlite_instance_create(entity, dims, NULL)));
+  for (i=0; i<4; i++) {
+    mu_check(insts[i]->_flags & dliteFlagIndexed);
+    mu_check(dlite_instance_set_property(insts[i], "a-string",
+                                         &names[i]) == 0);
+    mu_check(dlite_instance_set_property(insts[i], "a-float",
+                                         &values[i]) == 0);
+  }
+
+  /* equality lookup */
+  mu_assert_int_eq(2, (n = dlite_index_lookup(hidx, &alpha, &found)));
+  mu_check(found[0] == insts[0] || found[0] == insts[2]);
+  mu_check(found[1] == insts[0] || found[1] == insts[2]);
+  mu_check(found[0] != found[1]);
+  for (i=0; i<n; i++) dlite_instance_decref(found[i]);
+  free(found);
+  mu_assert_int_eq(0, dlite_index_lookup(hidx, &nosuch, &found));
+  mu_check(found == NULL);
+  mu_assert_int_eq(1, (n = dlite_index_lookup(sidx, &values[3], &found)));
+  mu_check(found[0] == insts[3]);
+  dlite_instance_decref(found[0]);
+  free(found);
+
+  /* range lookup returns instances in increasing order */
+  mu_assert_int_eq(2, (n = dlite_index_range(sidx, &low, &high, &found)));
+  mu_check(found[0] == insts[2]);
+  mu_check(found[1] == insts[0]);
+  for (i=0; i<n; i++) dlite_instance_decref(found[i]);
+  free(found);
+  mu_assert_int_eq(1, (n = dlite_index_range(sidx, &values[3], NULL,
+                                             &found)));
+  mu_check(found[0] == insts[3]);
+  dlite_instance_decref(found[0]);
+  free(found);
+  old = dlite_err_get_stream();
+  dlite_err_set_stream(NULL);
+  mu_assert_int_eq(-1, dlite_index_range(hidx, &low, &high, &found));
+  mu_check(!dlite_index_create(entity, "an-int-arr", dliteIndexHash));
+  dlite_err_set_stream(old);
+
+  /* modified and free'ed instances are updated */
+  mu_check(dlite_instance_set_property(insts[1], "a-string", &alpha) == 0);
+  dlite_instance_decref(insts[0]);
+  mu_assert_int_eq(2, (n = dlite_index_lookup(hidx, &alpha, &found)));
+  mu_check(found[0] == insts[1] || found[0] == insts[2]);
+  mu_check(found[1] == insts[1] || found[1] == insts[2]);
+  for (i=0; i<n; i++) dlite_instance_decref(found[i]);
+  free(found);
+
+  dlite_index_free(hidx);
+  mu_check(insts[1]->_flags & dliteFlagIndexed);
+  dlite_index_free(sidx);
+  mu_check(!(insts[1]->_flags & dliteFlagIndexed));
+  for (i=1; i<4; i++) dlite_instance_decref(insts[i]);
+}
+
 
 MU_TEST(test_meta_save)
 {
@@ -298,16 +1684,39 @@ MU_TEST(test_meta_free)
 MU_TEST_SUITE(test_suite)
 {
   MU_RUN_TEST(test_meta_create);    /* setup */
+  MU_RUN_TEST(test_meta_index);
+  MU_RUN_TEST(test_meta_layout);
   MU_RUN_TEST(test_instance_create);
   MU_RUN_TEST(test_instance_set_property);
   MU_RUN_TEST(test_instance_get_dimension_size);
   MU_RUN_TEST(test_instance_set_dimension_sizes);
+  MU_RUN_TEST(test_instance_arena);
+  MU_RUN_TEST(test_instance_pack_strings);
+  MU_RUN_TEST(test_instance_pool);
+  MU_RUN_TEST(test_instance_create_many);
+  MU_RUN_TEST(test_instance_property_handle);
+  MU_RUN_TEST(test_instance_allocator);
   MU_RUN_TEST(test_instance_copy);
+  MU_RUN_TEST(test_instance_copy_cow);
+  MU_RUN_TEST(test_instance_freeze);
+  MU_RUN_TEST(test_instance_adopt);
   MU_RUN_TEST(test_instance_save);
   MU_RUN_TEST(test_instance_hdf5);
+  MU_RUN_TEST(test_instance_hdf5_access);
+  MU_RUN_TEST(test_instance_hdf5_lossy);
+  MU_RUN_TEST(test_instance_hdf5_distributed);
+  MU_RUN_TEST(test_instance_append_dimension);
+  MU_RUN_TEST(test_instance_reserve_dimension);
+  MU_RUN_TEST(test_instance_hdf5_compact);
+  MU_RUN_TEST(test_instance_load_lazy);
+  MU_RUN_TEST(test_instance_save_dirty);
+  MU_RUN_TEST(test_instance_load_property_slice);
   MU_RUN_TEST(test_instance_json);
   MU_RUN_TEST(test_instance_load_url);
   MU_RUN_TEST(test_instance_snprint);
+  MU_RUN_TEST(test_instance_store_budget);
+  MU_RUN_TEST(test_instance_fingerprint);
+  MU_RUN_TEST(test_instance_index);
 
   MU_RUN_TEST(test_meta_save);
   MU_RUN_TEST(test_meta_load);
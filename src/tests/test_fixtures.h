@@ -0,0 +1,113 @@
+#ifndef _TEST_FIXTURES_H
+#define _TEST_FIXTURES_H
+
+/*
+  Fixtures shared by the storage plugin tests.
+
+  The test entity has a dimension N and the properties
+
+    - flag  (bool)
+    - value (int)
+    - name  (string)
+    - items (float64, [N])
+    - tags  (string, [N])
+
+  which cover scalars, strings and arrays of varying length.
+  Instance number `i` is created with N = i%3, such that some of the
+  instances have empty arrays, and with a NULL name if i%4 is zero.
+ */
+
+#include <string.h>
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+
+
+/* Returns the number of instances iterated over in `s`, or -1 on
+   error. */
+static inline int count_instances(DLiteStorage *s, const char *pattern)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  int n=0;
+  void *iter;
+  if (!(iter = dlite_storage_iter_create(s, pattern))) return -1;
+  while (dlite_storage_iter_next(s, iter, uuid) == 0) n++;
+  dlite_storage_iter_free(s, iter);
+  return n;
+}
+
+/* Returns a new test entity with the given uri or NULL on error. */
+static inline DLiteMeta *create_test_entity(const char *uri)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims unit iri  descr */
+    {"flag",   dliteBool,      sizeof(bool),   0, NULL, "",  NULL, "A flag."},
+    {"value",  dliteInt,       sizeof(int),    0, NULL, "",  NULL, "A value."},
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "",  NULL, "A name."},
+    {"items",  dliteFloat,     sizeof(double), 1, dims, "m", NULL, "Items."},
+    {"tags",   dliteStringPtr, sizeof(char *), 1, dims, "",  NULL, "Tags."}
+  };
+  return dlite_meta_create(uri, NULL, "Test entity.",
+                           1, dimensions, 5, properties);
+}
+
+/* Returns a new instance number `i` of the test entity `entity` or
+   NULL on error. */
+static inline DLiteInstance *create_test_instance(DLiteMeta *entity, int i)
+{
+  DLiteInstance *inst;
+  size_t j, shape[] = {i % 3};
+  double *items;
+  char **tags;
+  if (!(inst = dlite_instance_create(entity, shape, NULL))) return NULL;
+  *(bool *)dlite_instance_get_property(inst, "flag") = i % 2;
+  *(int *)dlite_instance_get_property(inst, "value") = 10*i;
+  if (i % 4 && !(*(char **)dlite_instance_get_property(inst, "name") =
+                 strdup("inst")))
+    goto fail;
+  items = dlite_instance_get_property(inst, "items");
+  tags = dlite_instance_get_property(inst, "tags");
+  for (j=0; j<shape[0]; j++) {
+    items[j] = i + 0.5*j;
+    if (!(tags[j] = strdup((j) ? "b\"\\" : "a"))) goto fail;
+  }
+  return inst;
+ fail:
+  dlite_instance_decref(inst);
+  return err(1, "allocation failure"), NULL;
+}
+
+/* Returns non-zero if `inst` differs from the instance created with
+   create_test_instance() for `i`.  The first difference is reported
+   as an error. */
+static inline int check_test_instance(const DLiteInstance *inst, int i)
+{
+  size_t j, n = i % 3;
+  char *name = *(char **)dlite_instance_get_property(inst, "name");
+  double *items = dlite_instance_get_property(inst, "items");
+  char **tags = dlite_instance_get_property(inst, "tags");
+  if (DLITE_DIM(inst, 0) != n)
+    return errx(1, "instance %d: expected N=%d, got %d", i, (int)n,
+                (int)DLITE_DIM(inst, 0));
+  if (*(bool *)dlite_instance_get_property(inst, "flag") != (bool)(i % 2))
+    return errx(1, "instance %d: unexpected flag", i);
+  if (*(int *)dlite_instance_get_property(inst, "value") != 10*i)
+    return errx(1, "instance %d: unexpected value", i);
+  if ((i % 4) ? (!name || strcmp(name, "inst")) : name != NULL)
+    return errx(1, "instance %d: unexpected name", i);
+  for (j=0; j<n; j++) {
+    if (items[j] != i + 0.5*j)
+      return errx(1, "instance %d: unexpected items[%d]", i, (int)j);
+    if (!tags[j] || strcmp(tags[j], (j) ? "b\"\\" : "a"))
+      return errx(1, "instance %d: unexpected tags[%d]", i, (int)j);
+  }
+  return 0;
+}
+
+
+#endif /* _TEST_FIXTURES_H */
@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-hugepage.h"
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/HugePageEntity";
+DLiteMeta *entity=NULL;
+
+
+MU_TEST(test_setup)
+{
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri  descr */
+    {"values", dliteFloat, sizeof(double), 1,    dims, "",  NULL, "Values."}
+  };
+  mu_check((entity = dlite_meta_create(uri, NULL, "Huge page entity.",
+                                       1, dimensions, 1, properties)));
+}
+
+MU_TEST(test_parse)
+{
+  DLiteHugePagePolicy policy;
+  size_t threshold;
+  mu_assert_int_eq(0, dlite_hugepage_parse("advise", &policy, &threshold));
+  mu_assert_int_eq(dliteHugePageAdvise, policy);
+  mu_assert_int_eq(0, threshold);
+  mu_assert_int_eq(0, dlite_hugepage_parse("explicit:4M", &policy,
+                                           &threshold));
+  mu_assert_int_eq(dliteHugePageExplicit, policy);
+  mu_assert_int_eq(4*1024*1024, threshold);
+  mu_assert_int_eq(0, dlite_hugepage_parse("none:100", &policy, &threshold));
+  mu_assert_int_eq(dliteHugePageNone, policy);
+  mu_assert_int_eq(100, threshold);
+
+  err_clear();
+  mu_check(dlite_hugepage_parse("always", &policy, &threshold));
+  mu_check(dlite_hugepage_parse("advise:", &policy, &threshold));
+  mu_check(dlite_hugepage_parse("advise:2X", &policy, &threshold));
+  err_clear();
+}
+
+/* Creates an instance with the given policy, grows and shrinks it. */
+static void check_policy(DLiteHugePagePolicy policy)
+{
+  DLiteInstance *inst;
+  size_t i, n=100000;
+  int newdims[1];
+  double *values;
+
+  mu_assert_int_eq(0, dlite_hugepage_set_policy(policy, 64*1024));
+  mu_check(dlite_instance_get_allocator() == ((policy) ?
+           dlite_hugepage_allocator() : NULL));
+  mu_check((inst = dlite_instance_create(entity, &n, NULL)));
+  values = *(double **)DLITE_PROP(inst, 0);
+  for (i=0; i<n; i++) mu_assert_double_eq(0.0, values[i]);
+  for (i=0; i<n; i++) values[i] = (double)i;
+
+  /* grow */
+  newdims[0] = 1000000;
+  mu_assert_int_eq(0, dlite_instance_set_dimension_sizes(inst, newdims));
+  values = *(double **)DLITE_PROP(inst, 0);
+  mu_assert_double_eq(99999.0, values[99999]);
+  mu_assert_double_eq(0.0, values[999999]);
+
+  /* shrink below the threshold */
+  newdims[0] = 10;
+  mu_assert_int_eq(0, dlite_instance_set_dimension_sizes(inst, newdims));
+  values = *(double **)DLITE_PROP(inst, 0);
+  mu_assert_double_eq(9.0, values[9]);
+
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_policies)
+{
+  check_policy(dliteHugePageAdvise);
+  check_policy(dliteHugePageExplicit);
+  check_policy(dliteHugePageNone);
+  mu_check(dlite_instance_get_allocator() == NULL);
+  mu_assert_int_eq(0, dlite_hugepage_configure(dliteHugePageAdvise, 0));
+}
+
+MU_TEST(test_teardown)
+{
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);     /* setup */
+  MU_RUN_TEST(test_parse);
+  MU_RUN_TEST(test_policies);
+  MU_RUN_TEST(test_teardown);  /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+/* Stress test and benchmark for concurrent use of the instance store.
+ *
+ * Usage: test_instance_threads [NTHREADS [NITER]]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "minunit/minunit.h"
+#include "utils/thread.h"
+#include "dlite.h"
+#include "dlite-entity.h"
+
+#define MAXTHREADS 64
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/ThreadEntity";
+char *shared_id = "shared-thread-instance";
+DLiteMeta *entity=NULL;
+DLiteInstance *shared=NULL;
+int nthreads=0;
+int niter=2000;
+
+/* Counts failed operations in the worker threads */
+int nfailures=0;
+
+
+/* Returns wall clock time in seconds. */
+static double walltime(void)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Worker creating, looking up and releasing instances. */
+static void *worker(void *arg)
+{
+  int i, n=0;
+  size_t dims[] = {3};
+  (void)arg;
+  for (i=0; i<niter; i++) {
+    DLiteInstance *inst, *inst2, *s;
+    int value = i;
+
+    if (!(inst = dlite_instance_create(entity, dims, NULL))) {
+      n++;
+      continue;
+    }
+    if (dlite_instance_set_property(inst, "value", &value)) n++;
+
+    /* look up own instance by uuid */
+    if ((inst2 = dlite_instance_get(inst->uuid))) {
+      if (inst2 != inst) n++;
+      dlite_instance_decref(inst2);
+    } else {
+      n++;
+    }
+
+    /* look up the instance shared by all threads */
+    if ((s = dlite_instance_get(shared_id))) {
+      if (s != shared) n++;
+      dlite_instance_decref(s);
+    } else {
+      n++;
+    }
+
+    dlite_instance_decref(inst);
+  }
+  thread_atomic_add(&nfailures, n);
+  return NULL;
+}
+
+
+/***************************************************************
+ * Tests
+ ***************************************************************/
+
+MU_TEST(test_setup)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri   descr */
+    {"value",  dliteInt,   sizeof(int),    0, NULL, "",   NULL, "A value."},
+    {"items",  dliteFloat, sizeof(double), 1, dims, "m",  NULL, "Items."}
+  };
+  size_t shape[] = {3};
+
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Thread entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    2, properties)));
+  mu_check((shared = dlite_instance_create(entity, shape, shared_id)));
+  mu_assert_int_eq(1, shared->_refcount);
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+shared */
+}
+
+MU_TEST(test_threads)
+{
+  Thread threads[MAXTHREADS];
+  int i, nstarted=0;
+  double t0, t1;
+
+  t0 = walltime();
+  for (i=0; i<nthreads; i++)
+    if (thread_create(threads + nstarted, worker, NULL) == 0) nstarted++;
+  for (i=0; i<nstarted; i++)
+    thread_join(threads[i], NULL);
+  t1 = walltime();
+
+  /* Run in the main thread if threads are not supported */
+  if (nstarted == 0) worker(NULL);
+
+  printf("\n%d threads x %d iterations: %.3f s (%.0f instances/s)\n",
+         (nstarted) ? nstarted : 1, niter, t1 - t0,
+         ((nstarted) ? nstarted : 1) * niter / (t1 - t0 + 1e-9));
+
+  mu_assert_int_eq(0, nfailures);
+  mu_assert_int_eq(1, shared->_refcount);
+  mu_assert_int_eq(3, entity->_refcount);  /* refs: global+store+shared */
+}
+
+MU_TEST(test_teardown)
+{
+  dlite_instance_decref(shared);
+  mu_assert_int_eq(2, entity->_refcount);
+  mu_check(!dlite_instance_has(shared_id, 0));
+  dlite_meta_decref(entity);  /* refs: store */
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);
+  MU_RUN_TEST(test_threads);
+  MU_RUN_TEST(test_teardown);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+  nthreads = thread_ncpus();
+  if (nthreads < 4) nthreads = 4;
+  if (argc > 1) nthreads = atoi(argv[1]);
+  if (argc > 2) niter = atoi(argv[2]);
+  if (nthreads > MAXTHREADS) nthreads = MAXTHREADS;
+
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "minunit/minunit.h"
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-mapping.h"
+#include "dlite-mapping-plugins.h"
+#include "dlite-iri-mapping.h"
+
+#define SRC_URI  "http://onto-ns.com/meta/0.1/IriSource"
+#define DEST_URI "http://onto-ns.com/meta/0.1/IriTarget"
+#define EX "http://example.com/onto#"
+
+DLiteMeta *src_meta=NULL, *dest_meta=NULL;
+DLiteInstance *src=NULL;
+
+
+MU_TEST(test_create_meta)
+{
+  DLiteProperty src_props[] = {
+    /* name   type           size            ndims dims unit  iri  descr */
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, NULL,   EX "Name", ""},
+    {"height", dliteFloat,     sizeof(double), 0, NULL, "m",    EX "Height",
+     ""},
+    {"temps",  dliteInt,       sizeof(int),    1, NULL, "degC", EX "Temp", ""},
+    {"ids",    dliteInt,       sizeof(int),    1, NULL, NULL,   EX "Id", ""},
+  };
+  DLiteProperty dest_props[] = {
+    {"label",  dliteStringPtr, sizeof(char *), 0, NULL, NULL,  EX "Name", ""},
+    {"length", dliteFloat,     sizeof(double), 0, NULL, "cm",  EX "Height",
+     ""},
+    {"temperatures", dliteFloat, sizeof(double), 1, NULL, "K", EX "Temp", ""},
+    {"ids",    dliteInt,       sizeof(int),    1, NULL, NULL,  EX "Id", ""},
+    {"extra",  dliteInt,       sizeof(int),    0, NULL, NULL,  EX "Other", ""},
+  };
+  char *src_dims[] = {"N"}, *dest_dims[] = {"M"}, *ids_dims[] = {"K"};
+  DLiteDimension src_dimensions[] = {
+    {"N", "Number of temperatures."},
+    {"K", "Number of ids."}
+  };
+  DLiteDimension dest_dimensions[] = {
+    {"M", "Number of temperatures."},
+    {"K", "Number of ids."}
+  };
+  src_props[2].dims = src_dims;
+  src_props[3].dims = ids_dims;
+  dest_props[2].dims = dest_dims;
+  dest_props[3].dims = ids_dims;
+
+  mu_check((src_meta = dlite_meta_create(SRC_URI, NULL, "Source.", 2,
+                                         src_dimensions, 4, src_props)));
+  mu_check((dest_meta = dlite_meta_create(DEST_URI, NULL, "Target.", 2,
+                                          dest_dimensions, 5, dest_props)));
+}
+
+MU_TEST(test_create_source)
+{
+  size_t dims[] = {3, 2};
+  char *name = "sample";
+  double height = 1.25;
+  int temps[] = {0, 20, 100}, ids[] = {7, 9};
+  mu_check((src = dlite_instance_create(src_meta, dims, NULL)));
+  mu_assert_int_eq(0, dlite_instance_set_property(src, "name", &name));
+  mu_assert_int_eq(0, dlite_instance_set_property(src, "height", &height));
+  mu_assert_int_eq(0, dlite_instance_set_property(src, "temps", temps));
+  mu_assert_int_eq(0, dlite_instance_set_property(src, "ids", ids));
+}
+
+MU_TEST(test_apply)
+{
+  DLiteIriMapping *plan;
+  DLiteInstance *inst;
+  double *t;
+  int *ids;
+
+  mu_check((plan = dlite_iri_mapping_compile(src_meta, dest_meta)));
+  mu_assert_int_eq(4, dlite_iri_mapping_nmatched(plan));
+  mu_check((inst = dlite_iri_mapping_apply(plan, src)));
+
+  mu_assert_int_eq(3, DLITE_DIM(inst, 0));
+  mu_assert_int_eq(2, DLITE_DIM(inst, 1));
+  mu_assert_string_eq("sample",
+                      *(char **)dlite_instance_get_property(inst, "label"));
+  mu_assert_double_eq(125.0,
+                      *(double *)dlite_instance_get_property(inst, "length"));
+  t = dlite_instance_get_property(inst, "temperatures");
+  mu_check(fabs(t[0] - 273.15) < 1e-9);
+  mu_check(fabs(t[2] - 373.15) < 1e-9);
+  ids = dlite_instance_get_property(inst, "ids");
+  mu_assert_int_eq(7, ids[0]);
+  mu_assert_int_eq(9, ids[1]);
+  mu_assert_int_eq(0, *(int *)dlite_instance_get_property(inst, "extra"));
+
+  err_set_stream(NULL);
+  mu_check(!dlite_iri_mapping_apply(plan, inst));
+  mu_check(!dlite_iri_mapping_compile(src_meta, src_meta->meta));
+  err_set_stream(stderr);
+  err_clear();
+
+  dlite_instance_decref(inst);
+  dlite_iri_mapping_free(plan);
+}
+
+MU_TEST(test_register)
+{
+  const DLiteInstance *instances[1];
+  DLiteInstance *inst;
+  instances[0] = src;
+
+  mu_assert_int_eq(0, dlite_iri_mapping_register(SRC_URI, DEST_URI));
+  mu_check((inst = dlite_mapping(DEST_URI, instances, 1)));
+  mu_assert_string_eq(DEST_URI, inst->meta->uri);
+  mu_assert_double_eq(125.0,
+                      *(double *)dlite_instance_get_property(inst, "length"));
+  dlite_instance_decref(inst);
+
+  err_set_stream(NULL);
+  mu_check(dlite_iri_mapping_register(SRC_URI, DEST_URI));
+  err_set_stream(stderr);
+  err_clear();
+
+  mu_assert_int_eq(0, dlite_mapping_plugin_unload("iri:" SRC_URI "->"
+                                                  DEST_URI));
+}
+
+MU_TEST(test_free)
+{
+  dlite_instance_decref(src);
+  dlite_meta_decref(dest_meta);
+  dlite_meta_decref(src_meta);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_create_meta);
+  MU_RUN_TEST(test_create_source);
+  MU_RUN_TEST(test_apply);
+  MU_RUN_TEST(test_register);
+  MU_RUN_TEST(test_free);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -42,7 +42,7 @@ MU_TEST(test_sprint)
                         dliteJsonWithUuid | dliteJsonMetaAsData);
   printf("\n--------------------------------------------------------\n");
   printf("%s\n", buf);
-  mu_assert_int_eq(1152, m);
+  mu_assert_int_eq(1160, m);
 
   printf("\n========================================================\n");
   m = dlite_json_sprint(buf, sizeof(buf), inst, 4, 0);
@@ -86,6 +86,51 @@ MU_TEST(test_append)
 }
 
 
+MU_TEST(test_jstore_loads_threads)
+{
+#if defined(HAVE_SETENV) && defined(HAVE_UNSETENV)
+  char *path = STRINGIFY(dlite_SOURCE_DIR) "/src/tests/test-data.json";
+  char *id = "e076a856-e36e-5335-967e-2f2fd153c17d";
+  const char *key;
+  const jsmntok_t *t1, *t2;
+  unsigned int n1, n2;
+  int count=0;
+  JStoreIter iter;
+  JStore *js1 = jstore_open();
+  JStore *js2 = jstore_open();
+  DLiteInstance *inst2;
+
+  mu_assert_int_eq(dliteJsonDataFormat, dlite_jstore_loadf(js1, path));
+  setenv("DLITE_JSON_THREADS", "3", 1);
+  mu_assert_int_eq(dliteJsonDataFormat, dlite_jstore_loadf(js2, path));
+
+  /* metadata format is still parsed serially */
+  path = STRINGIFY(dlite_SOURCE_DIR) "/src/tests/test-entity.json";
+  mu_assert_int_eq(dliteJsonMetaFormat, dlite_jstore_loadf(js2, path));
+  unsetenv("DLITE_JSON_THREADS");
+
+  jstore_iter_init(js1, &iter);
+  while ((key = jstore_iter_next(&iter))) {
+    mu_assert_string_eq(jstore_get(js1, key), jstore_get(js2, key));
+    mu_check((t1 = jstore_get_tokens(js1, key, &n1)));
+    mu_check((t2 = jstore_get_tokens(js2, key, &n2)));
+    mu_assert_int_eq(n1, n2);
+    mu_check(memcmp(t1, t2, n1*sizeof(jsmntok_t)) == 0);
+    count++;
+  }
+  jstore_iter_deinit(&iter);
+  mu_check(count > 1);
+
+  mu_check((inst2 = dlite_jstore_scan(js2, id, id)));
+  mu_assert_string_eq(id, inst2->uuid);
+  dlite_instance_decref(inst2);
+
+  jstore_close(js1);
+  jstore_close(js2);
+#endif
+}
+
+
 MU_TEST(test_decref)
 {
   dlite_instance_decref(inst);
@@ -95,6 +140,158 @@ MU_TEST(test_decref)
 }
 
 
+MU_TEST(test_binary_arrays)
+{
+  DLiteJsonFlag flags[] = {
+    dliteJsonBase64Arrays,
+    dliteJsonBase85Arrays,
+#ifdef HAVE_ZLIB
+    dliteJsonBase64Arrays | dliteJsonCompressArrays,
+#endif
+  };
+  size_t i, j, dims[] = {4, 5, 6};
+  DLiteInstance *inst1, *inst2;
+  int32_t *arr1, *arr2;
+  char *buf;
+
+  inst1 = dlite_instance_create(meta, dims, NULL);
+  mu_check(inst1);
+  arr1 = dlite_instance_get_property(inst1, "myarray");
+  for (i=0; i<4*5*6; i++) arr1[i] = (int32_t)(i * 1000003 - 7);
+
+  for (j=0; j < sizeof(flags) / sizeof(flags[0]); j++) {
+    buf = dlite_json_aprint(inst1, 0, flags[j] | dliteJsonWithUuid);
+    mu_check(buf);
+    mu_check(strstr(buf, "\"shape\": [4, 5, 6]"));
+    mu_check(strstr(buf, (flags[j] & dliteJsonBase85Arrays) ?
+                    "\"encoding\": \"base85\"" :
+                    "\"encoding\": \"base64\""));
+    if (flags[j] & dliteJsonCompressArrays)
+      mu_check(strstr(buf, "\"compression\": \"zlib\""));
+
+    inst2 = dlite_json_sscan(buf, inst1->uuid, NULL);
+    mu_check(inst2);
+    arr2 = dlite_instance_get_property(inst2, "myarray");
+    mu_check(memcmp(arr1, arr2, 4*5*6*sizeof(int32_t)) == 0);
+    dlite_instance_decref(inst2);
+    free(buf);
+  }
+  dlite_instance_decref(inst1);
+}
+
+
+/* Sink for test_write(), collecting the output in an allocated buffer */
+typedef struct {
+  char *buf;
+  size_t len;
+  int ncalls;
+} Collected;
+
+static int collect(const char *data, size_t len, void *context)
+{
+  Collected *c = context;
+  void *q;
+  if (!(q = realloc(c->buf, c->len + len + 1))) return 1;
+  c->buf = q;
+  memcpy(c->buf + c->len, data, len);
+  c->len += len;
+  c->buf[c->len] = '\0';
+  c->ncalls++;
+  return 0;
+}
+
+MU_TEST(test_write)
+{
+  DLiteJsonFlag flags[] = {0, dliteJsonBase64Arrays, dliteJsonBase85Arrays};
+  size_t i, j, dims[] = {40, 50, 60};
+  DLiteInstance *inst1, *inst2;
+  int32_t *arr1, *arr2;
+  Collected c;
+  char *buf;
+  int m;
+
+  inst1 = dlite_instance_create(meta, dims, NULL);
+  mu_check(inst1);
+  arr1 = dlite_instance_get_property(inst1, "myarray");
+  for (i=0; i<40*50*60; i++) arr1[i] = (int32_t)(i * 1000003 - 7);
+
+  for (j=0; j < sizeof(flags) / sizeof(flags[0]); j++) {
+    c.buf = NULL;
+    c.len = 0;
+    c.ncalls = 0;
+    m = dlite_json_write(collect, &c, inst1, 0, flags[j] | dliteJsonWithUuid);
+    mu_assert_int_eq((int)c.len, m);
+    mu_check(c.ncalls > 1);
+
+    buf = dlite_json_aprint(inst1, 0, flags[j] | dliteJsonWithUuid);
+    mu_check(buf);
+    mu_assert_string_eq(buf, c.buf);
+    free(buf);
+
+    inst2 = dlite_json_sscan(c.buf, inst1->uuid, NULL);
+    mu_check(inst2);
+    arr2 = dlite_instance_get_property(inst2, "myarray");
+    mu_check(memcmp(arr1, arr2, 40*50*60*sizeof(int32_t)) == 0);
+    dlite_instance_decref(inst2);
+    free(c.buf);
+  }
+  dlite_instance_decref(inst1);
+}
+
+MU_TEST(test_numeric_arrays)
+{
+  size_t i, dims[] = {40, 50, 60};
+  DLiteInstance *inst1, *inst2;
+  const jsmntok_t *tokens, *t;
+  int32_t *arr1, *arr2;
+  JStore *js;
+  char *buf, *buf2, *p;
+
+  inst1 = dlite_instance_create(meta, dims, NULL);
+  mu_check(inst1);
+  arr1 = dlite_instance_get_property(inst1, "myarray");
+  for (i=0; i<40*50*60; i++) arr1[i] = (int32_t)(i * 1000003 - 7);
+  buf = dlite_json_aprint(inst1, 0, dliteJsonWithUuid);
+  mu_check(buf);
+
+  /* the large array is a single compact token */
+  buf2 = malloc(strlen(buf) + 64);
+  sprintf(buf2, "{\"%s\": %s}", inst1->uuid, buf);
+  js = jstore_open();
+  mu_assert_int_eq(dliteJsonDataFormat, dlite_jstore_loads(js, buf2,
+                                                           strlen(buf2)));
+  free(buf2);
+  mu_check((tokens = jstore_get_tokens(js, inst1->uuid, NULL)));
+  mu_check((t = jsmn_item(jstore_get(js, inst1->uuid), tokens, "properties")));
+  mu_check((t = jsmn_item(jstore_get(js, inst1->uuid), t, "myarray")));
+  mu_assert_int_eq(JSMN_ARRAY, t->type);
+  mu_assert_int_eq(-40, t->size);
+
+  inst2 = dlite_jstore_scan(js, inst1->uuid, NULL);
+  mu_check(inst2);
+  arr2 = dlite_instance_get_property(inst2, "myarray");
+  mu_check(memcmp(arr1, arr2, 40*50*60*sizeof(int32_t)) == 0);
+  dlite_instance_decref(inst2);
+  jstore_close(js);
+
+  /* numbers not handled by the numeric scanner fall back to
+     dlite_property_scan() */
+  mu_check((p = strstr(buf, "[[[-7,")));
+  buf2 = malloc(strlen(buf) + 2);
+  memcpy(buf2, buf, p - buf + 4);
+  buf2[p - buf + 4] = '0';
+  strcpy(buf2 + (p - buf) + 5, p + 4);
+  inst2 = dlite_json_sscan(buf2, inst1->uuid, NULL);
+  mu_check(inst2);
+  arr2 = dlite_instance_get_property(inst2, "myarray");
+  mu_check(memcmp(arr1, arr2, 40*50*60*sizeof(int32_t)) == 0);
+  dlite_instance_decref(inst2);
+  free(buf2);
+
+  free(buf);
+  dlite_instance_decref(inst1);
+}
+
 MU_TEST(test_sscan)
 {
   DLiteInstance *inst;
@@ -116,6 +313,96 @@ MU_TEST(test_sscan)
 }
 
 
+MU_TEST(test_key_order)
+{
+  DLiteInstance *inst1;
+  int32_t *arr;
+  /* keys in another order than written by dlite_json_write() and an
+     unknown key */
+  char *src =
+    "{\"meta\": \"http://onto-ns.com/meta/0.1/test-entity\", "
+    "\"dimensions\": {\"N\": 1, \"M\": 1, \"L\": 2}, "
+    "\"properties\": {\"myarray\": [[[1]], [[2]]], \"unknown\": [3], "
+    "\"myshort\": 17, \"mystring\": \"s\", \"myfixstring\": \"ab\", "
+    "\"mydouble\": 2.5, \"myblob\": \"0a0b0c\"}}";
+  char *missing =
+    "{\"meta\": \"http://onto-ns.com/meta/0.1/test-entity\", "
+    "\"dimensions\": {\"L\": 1, \"M\": 1, \"N\": 1}, "
+    "\"properties\": {\"myblob\": \"0a0b0c\", \"myfixstring\": \"ab\", "
+    "\"mystring\": \"s\", \"myshort\": 17, \"myarray\": [[[1]]]}}";
+
+  inst1 = dlite_json_sscan(src, NULL, NULL);
+  mu_check(inst1);
+  mu_check(meta->_jsonparser);
+  mu_assert_int_eq(2, dlite_instance_get_dimension_size(inst1, "L"));
+  mu_assert_double_eq(2.5, *(double *)dlite_instance_get_property(inst1,
+                                                                 "mydouble"));
+  mu_assert_int_eq(17, *(uint16_t *)dlite_instance_get_property(inst1,
+                                                                "myshort"));
+  mu_assert_string_eq("s", *(char **)dlite_instance_get_property(inst1,
+                                                                 "mystring"));
+  arr = dlite_instance_get_property(inst1, "myarray");
+  mu_assert_int_eq(1, arr[0]);
+  mu_assert_int_eq(2, arr[1]);
+  dlite_instance_decref(inst1);
+
+  mu_check(!dlite_json_sscan(missing, NULL, NULL));
+  dlite_errclr();
+}
+
+
+MU_TEST(test_struct_property)
+{
+  typedef struct { double x, y, z, mass; int32_t charge; } Particle;
+  DLiteStructField fields[] = {
+    {"x", dliteFloat, 8, 0},
+    {"y", dliteFloat, 8, 0},
+    {"z", dliteFloat, 8, 0},
+    {"mass", dliteFloat, 8, 0},
+    {"charge", dliteInt, 4, 0}
+  };
+  char *entity =
+    "{\"uri\": \"http://onto-ns.com/meta/0.1/Particles\", "
+    "\"meta\": \"http://onto-ns.com/meta/0.3/EntitySchema\", "
+    "\"dimensions\": [{\"name\": \"N\", \"description\": \"\"}], "
+    "\"properties\": [{\"name\": \"particles\", \"type\": \"Particle\", "
+    "\"dims\": [\"N\"]}]}";
+  char *data =
+    "{\"meta\": \"http://onto-ns.com/meta/0.1/Particles\", "
+    "\"dimensions\": {\"N\": 2}, "
+    "\"properties\": {\"particles\": ["
+    "{\"x\": 0, \"y\": 1, \"z\": 2, \"mass\": 1.5, \"charge\": -1}, "
+    "{\"x\": 3, \"y\": 4, \"z\": 5, \"mass\": 2.5, \"charge\": 2}]}}";
+  DLiteMeta *e;
+  DLiteInstance *inst1, *inst2;
+  Particle *p;
+  char *buf;
+
+  mu_check(dlite_struct_register("Particle", 5, fields) >= 0);
+  mu_check((e = (DLiteMeta *)dlite_json_sscan(entity, NULL, NULL)));
+  mu_assert_int_eq(sizeof(Particle), e->_properties[0].size);
+  mu_check((inst1 = dlite_json_sscan(data, NULL, NULL)));
+  p = dlite_instance_get_property(inst1, "particles");
+  mu_assert_double_eq(2.5, p[1].mass);
+  mu_assert_int_eq(-1, p[0].charge);
+
+  /* the records are written as JSON objects and read back */
+  mu_check((buf = dlite_json_aprint(inst1, 0, dliteJsonWithUuid)));
+  mu_check((inst2 = dlite_json_sscan(buf, inst1->uuid, NULL)));
+  p = dlite_instance_get_property(inst2, "particles");
+  mu_assert_double_eq(5.0, p[1].z);
+  mu_assert_int_eq(2, p[1].charge);
+  free(buf);
+
+  /* the entity refers to the struct by name */
+  mu_check((buf = dlite_json_aprint((DLiteInstance *)e, 0, 0)));
+  mu_check(strstr(buf, "\"type\": \"Particle\""));
+  free(buf);
+
+  dlite_instance_decref(inst2);
+  dlite_instance_decref(inst1);
+  dlite_meta_decref(e);
+}
 
 
 /***********************************************************************/
@@ -125,8 +412,14 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_load);
   MU_RUN_TEST(test_sprint);
   MU_RUN_TEST(test_append);
+  MU_RUN_TEST(test_jstore_loads_threads);
+  MU_RUN_TEST(test_binary_arrays);
+  MU_RUN_TEST(test_write);
+  MU_RUN_TEST(test_numeric_arrays);
+  MU_RUN_TEST(test_key_order);
   MU_RUN_TEST(test_decref);
   MU_RUN_TEST(test_sscan);
+  MU_RUN_TEST(test_struct_property);
 }
 
 
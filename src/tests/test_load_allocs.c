@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "utils/scratch.h"
+#include "dlite.h"
+#include "dlite-json.h"
+
+#include "minunit/minunit.h"
+
+/* Counting heap allocations requires replacing malloc() and friends,
+   which is only done with glibc and without sanitizers. */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+# define COUNT_ALLOCS
+#endif
+
+#define NLOADS 20
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/AllocEntity";
+char *id = "alloc-inst";
+DLiteMeta *entity=NULL;
+char *src=NULL;
+
+
+#ifdef COUNT_ALLOCS
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static int counting = 0;
+static size_t nallocs = 0;
+
+void *malloc(size_t size)
+{
+  if (counting) nallocs++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+  if (counting) nallocs++;
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  if (counting) nallocs++;
+  return __libc_realloc(ptr, size);
+}
+#endif
+
+
+/* Returns the number of heap allocations done by scanning `src`,
+   averaged over NLOADS loads. */
+static size_t allocs_per_scan(const char *src)
+{
+#ifdef COUNT_ALLOCS
+  int i;
+  nallocs = 0;
+  for (i=0; i<NLOADS; i++) {
+    DLiteInstance *inst;
+    counting = 1;
+    inst = dlite_json_sscan(src, id, NULL);
+    counting = 0;
+    if (!inst) return (size_t)-1;
+    dlite_instance_decref(inst);
+  }
+  return nallocs / NLOADS;
+#else
+  (void)src;
+  return 0;
+#endif
+}
+
+/* Returns the number of heap allocations done by creating an instance
+   of `meta` with dimensions `dims`. */
+static size_t allocs_per_create(const DLiteMeta *meta, size_t *dims)
+{
+#ifdef COUNT_ALLOCS
+  DLiteInstance *inst;
+  nallocs = 0;
+  counting = 1;
+  inst = dlite_instance_create(meta, dims, id);
+  counting = 0;
+  if (!inst) return (size_t)-1;
+  dlite_instance_decref(inst);
+  return nallocs;
+#else
+  (void)meta;
+  (void)dims;
+  return 0;
+#endif
+}
+
+
+MU_TEST(test_setup)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."}
+  };
+  DLiteProperty properties[] = {
+    /* name   type            size ndims dims  unit iri   descr */
+    {"a",     dliteFixString, 64,  0,    NULL, "",  NULL, "String."},
+    {"b",     dliteFixString, 64,  0,    NULL, "",  NULL, "String."},
+    {"c",     dliteFixString, 64,  0,    NULL, "",  NULL, "String."},
+    {"d",     dliteFixString, 64,  0,    NULL, "",  NULL, "String."},
+    {"e",     dliteFixString, 64,  0,    NULL, "",  NULL, "String."},
+    {"f",     dliteFixString, 64,  0,    NULL, "",  NULL, "String."},
+    {"items", dliteFloat,     8,   1,    dims, "m", NULL, "Items."}
+  };
+  size_t shape[] = {4};
+  DLiteInstance *inst;
+  size_t i;
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Alloc entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    7, properties)));
+  mu_check((inst = dlite_instance_create(entity, shape, id)));
+
+  /* string values of increasing length */
+  for (i=0; i<6; i++) {
+    char *p = DLITE_PROP(inst, i);
+    memset(p, 'x', 8*(i+1));
+  }
+  mu_check((src = dlite_json_aprint(inst, 0, 0)));
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_scan)
+{
+  size_t shape[] = {4};
+  size_t nload, ncreate;
+  ScratchStats stats, stats2;
+
+  /* warm up */
+  mu_check(allocs_per_scan(src) != (size_t)-1);
+  scratch_stats(&stats);
+
+  nload = allocs_per_scan(src);
+  ncreate = allocs_per_create(entity, shape);
+  mu_check(nload != (size_t)-1);
+  mu_check(ncreate != (size_t)-1);
+
+  /* the scratch arena is reused */
+  scratch_stats(&stats2);
+  mu_assert_int_eq(stats.nheap, stats2.nheap);
+  mu_assert_int_eq(0, stats2.used);
+
+  /* Apart from creating the instance, loading requires only a few
+     allocations, like the token array and the uri.  In particular,
+     no allocations per property or for temporary dimension arrays. */
+  mu_check(nload <= ncreate + 4);
+}
+
+MU_TEST(test_teardown)
+{
+  free(src);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);
+  MU_RUN_TEST(test_scan);
+  MU_RUN_TEST(test_teardown);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
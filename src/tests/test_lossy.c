@@ -0,0 +1,194 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-lossy.h"
+
+#include "minunit/minunit.h"
+
+#define N 1000
+
+
+/* Returns a pseudo-random number in the range [-1, 1). */
+static double rnd(void)
+{
+  static uint64_t state = 12345;
+  state = state*6364136223846793005ULL + 1442695040888963407ULL;
+  return (double)(state >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+/* Fills `v` with values spanning many orders of magnitude. */
+static void fill(double *v, size_t n)
+{
+  size_t i;
+  int j;
+  for (i=0; i<n; i++) {
+    v[i] = rnd();
+    for (j=0; j < (int)(i % 13); j++) v[i] *= 10.0;
+    v[i] *= 1e-8;
+  }
+}
+
+/* Returns the number of trailing zero bits of `v`. */
+static int trailing_zeros(double v)
+{
+  uint64_t bits;
+  int n=0;
+  memcpy(&bits, &v, sizeof(bits));
+  if (!bits) return 64;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    n++;
+  }
+  return n;
+}
+
+
+MU_TEST(test_abs_tol)
+{
+  double v[N], w[N], tol=1e-6;
+  size_t i;
+  fill(v, N);
+  memcpy(w, v, sizeof(v));
+  mu_check(0 == dlite_quantize(w, sizeof(double), N, tol, 0));
+  for (i=0; i<N; i++) {
+    mu_check(fabs(w[i] - v[i]) <= tol);
+    if (fabs(v[i]) <= tol) mu_check(w[i] == 0.0);
+  }
+
+  /* 1.0 needs about 20 bits below the binary point */
+  w[0] = 1.0 + 1.0/3.0;
+  mu_check(0 == dlite_quantize(w, sizeof(double), 1, tol, 0));
+  mu_check(trailing_zeros(w[0]) >= 30);
+  mu_check(fabs(w[0] - (1.0 + 1.0/3.0)) <= tol);
+}
+
+
+MU_TEST(test_rel_tol)
+{
+  double v[N], w[N], tol=1e-6;
+  size_t i;
+  fill(v, N);
+  memcpy(w, v, sizeof(v));
+  mu_check(0 == dlite_quantize(w, sizeof(double), N, 0, tol));
+  for (i=0; i<N; i++) {
+    mu_check(fabs(w[i] - v[i]) <= tol*fabs(v[i]));
+    if (v[i] != 0.0) mu_check(trailing_zeros(w[i]) >= 52 - 19);
+  }
+}
+
+
+MU_TEST(test_both)
+{
+  double v[N], w[N], atol=1e-9, rtol=1e-3;
+  size_t i;
+  fill(v, N);
+  memcpy(w, v, sizeof(v));
+  mu_check(0 == dlite_quantize(w, sizeof(double), N, atol, rtol));
+  for (i=0; i<N; i++) {
+    double bound = (atol > rtol*fabs(v[i])) ? atol : rtol*fabs(v[i]);
+    mu_check(fabs(w[i] - v[i]) <= bound);
+  }
+}
+
+
+MU_TEST(test_float32)
+{
+  float v[N], w[N], tol=1e-3f;
+  size_t i;
+  for (i=0; i<N; i++) v[i] = (float)(100*rnd());
+  memcpy(w, v, sizeof(v));
+  mu_check(0 == dlite_quantize(w, sizeof(float), N, tol, 0));
+  for (i=0; i<N; i++) mu_check(fabsf(w[i] - v[i]) <= tol);
+  memcpy(w, v, sizeof(v));
+  mu_check(0 == dlite_quantize(w, sizeof(float), N, 0, tol));
+  for (i=0; i<N; i++) mu_check(fabsf(w[i] - v[i]) <= tol*fabsf(v[i]));
+}
+
+
+MU_TEST(test_special)
+{
+  double v[] = {INFINITY, -INFINITY, NAN, 0.0, -0.0, 5e-324, 1.0,
+                1.7976931348623157e308};
+  double w[8];
+  memcpy(w, v, sizeof(v));
+  mu_check(0 == dlite_quantize(w, sizeof(double), 8, 0, 0.5));
+  mu_check(isinf(w[0]) && w[0] > 0);
+  mu_check(isinf(w[1]) && w[1] < 0);
+  mu_check(isnan(w[2]));
+  mu_check(w[3] == 0.0 && !signbit(w[3]));
+  mu_check(w[4] == 0.0 && signbit(w[4]));
+  mu_check(w[5] == 5e-324);
+  mu_assert_double_eq(1.0, w[6]);
+  mu_check(isfinite(w[7]));
+
+  /* negative values are zeroed with their sign */
+  w[0] = -1e-8;
+  mu_check(0 == dlite_quantize(w, sizeof(double), 1, 1e-6, 0));
+  mu_check(w[0] == 0.0 && signbit(w[0]));
+}
+
+
+MU_TEST(test_spec)
+{
+  DLiteLossy *lossy;
+  double atol, rtol;
+
+  mu_check((lossy = dlite_lossy_create("1e-6", NULL)));
+  mu_check(dlite_lossy_get(lossy, "any", &atol, &rtol));
+  mu_assert_double_eq(1e-6, atol);
+  mu_assert_double_eq(0, rtol);
+  dlite_lossy_free(lossy);
+
+  mu_check((lossy = dlite_lossy_create("T:1e-3,*:1e-9",
+                                       "T:1e-4,p:0.01")));
+  mu_check(dlite_lossy_get(lossy, "T", &atol, &rtol));
+  mu_assert_double_eq(1e-3, atol);
+  mu_assert_double_eq(1e-4, rtol);
+  mu_check(dlite_lossy_get(lossy, "p", &atol, &rtol));
+  mu_assert_double_eq(0, atol);
+  mu_assert_double_eq(0.01, rtol);
+  mu_check(dlite_lossy_get(lossy, "rho", &atol, &rtol));
+  mu_assert_double_eq(1e-9, atol);
+  mu_assert_double_eq(0, rtol);
+  dlite_lossy_free(lossy);
+
+  mu_check((lossy = dlite_lossy_create("T:1e-3", "")));
+  mu_check(!dlite_lossy_get(lossy, "p", &atol, &rtol));
+  dlite_lossy_free(lossy);
+
+  err_set_stream(NULL);
+  mu_check(!dlite_lossy_create("abc", NULL));
+  mu_check(!dlite_lossy_create(NULL, "-1e-3"));
+  mu_check(!dlite_lossy_create("T:0", NULL));
+  mu_check(!dlite_lossy_create(":1e-3", NULL));
+  mu_check(!dlite_lossy_create("1e-3x", NULL));
+  mu_check(dlite_quantize(&atol, 2, 1, 1e-3, 0));
+  err_set_stream(stderr);
+  err_clear();
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_abs_tol);
+  MU_RUN_TEST(test_rel_tol);
+  MU_RUN_TEST(test_both);
+  MU_RUN_TEST(test_float32);
+  MU_RUN_TEST(test_special);
+  MU_RUN_TEST(test_spec);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -77,6 +77,218 @@ MU_TEST(test_get_casted)
 }
 
 
+MU_TEST(test_get_casted_cache)
+{
+  DLiteInstance *src, *inst, *inst2;
+  const char *id = "2daa6967-8ecd-4248-97b2-9ad6fefeac14";
+  const char *output_uri = "http://onto-ns.com/meta/0.1/ent2";
+  int a=7, b=3, a0;
+
+  mu_check((src = dlite_instance_get(id)));
+  a0 = *(int *)dlite_instance_get_property(src, "a");
+  mu_assert_int_eq(0, dlite_instance_set_cast_cache(8));
+  mu_check((inst = dlite_instance_get_casted(id, output_uri)));
+  mu_check((inst2 = dlite_instance_get_casted(id, output_uri)));
+  mu_check(inst == inst2);
+  dlite_instance_decref(inst2);
+
+  /* modifying the source invalidates the cached instance */
+  mu_assert_int_eq(0, dlite_instance_set_property(src, "a", &a));
+  mu_check((inst2 = dlite_instance_get_casted(id, output_uri)));
+  mu_check(inst != inst2);
+  dlite_instance_decref(inst);
+  inst = inst2;
+
+  /* ...and so does modifying the casted instance */
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "b", &b));
+  mu_check((inst2 = dlite_instance_get_casted(id, output_uri)));
+  mu_check(inst != inst2);
+  mu_assert_int_eq(8, *(int *)dlite_instance_get_property(inst2, "b"));
+  dlite_instance_decref(inst2);
+  dlite_instance_decref(inst);
+
+  mu_assert_int_eq(0, dlite_instance_set_cast_cache(0));
+  mu_assert_int_eq(0, dlite_instance_set_property(src, "a", &a0));
+  dlite_instance_decref(src);
+}
+
+
+MU_TEST(test_mapping_parallel)
+{
+  DLiteInstance *inst, *inst4;
+  DLiteMapping *m;
+  const char *output_uri = "http://onto-ns.com/meta/0.1/ent4";
+  const char *input_uris[] = { "http://onto-ns.com/meta/0.1/ent1" };
+  int *d;
+
+  /* ent4 is mapped from ent2 and ent3, which are independently mapped
+     from ent1 */
+  mu_check((inst = dlite_instance_get("2daa6967-8ecd-4248-97b2-9ad6fefeac14")));
+  mu_check((m = dlite_mapping_create(output_uri, input_uris, 1)));
+  mu_assert_int_eq(60, m->cost);
+
+  dlite_instance_incref(inst);
+  mu_check((inst4 = dlite_mapping_map(m, (const DLiteInstance **)&inst, 1)));
+  mu_assert_string_eq(output_uri, inst4->meta->uri);
+  d = dlite_instance_get_property(inst4, "d");
+  mu_assert_int_eq(43 + 84, *d);
+  dlite_instance_decref(inst4);
+
+  dlite_mapping_free(m);
+  dlite_instance_decref(inst);
+}
+
+
+MU_TEST(test_mapping_map_many)
+{
+  int i, a, *d;
+  DLiteInstance *insts[5], *out[5];
+  DLiteMapping *m;
+  const char *output_uri = "http://onto-ns.com/meta/0.1/ent4";
+  const char *input_uris[] = { "http://onto-ns.com/meta/0.1/ent1" };
+
+  for (i=0; i<5; i++) {
+    mu_check((insts[i] = dlite_instance_create_from_id(input_uris[0], NULL,
+                                                        NULL)));
+    a = 10 * i;
+    dlite_instance_set_property(insts[i], "a", &a);
+  }
+  mu_check((m = dlite_mapping_create(output_uri, input_uris, 1)));
+  mu_assert_int_eq(0, dlite_mapping_map_many(m, (const DLiteInstance **)insts,
+                                             1, 5, out));
+  for (i=0; i<5; i++) {
+    mu_assert_string_eq(output_uri, out[i]->meta->uri);
+    d = dlite_instance_get_property(out[i], "d");
+    mu_assert_int_eq((10*i + 1) + 20*i, *d);
+    dlite_instance_decref(out[i]);
+  }
+  dlite_mapping_free(m);
+
+  /* trivial mapping returns new references to the inputs */
+  mu_check((m = dlite_mapping_create(input_uris[0], input_uris, 1)));
+  mu_assert_int_eq(0, dlite_mapping_map_many(m, (const DLiteInstance **)insts,
+                                             1, 5, out));
+  for (i=0; i<5; i++) {
+    mu_check(out[i] == insts[i]);
+    dlite_instance_decref(out[i]);
+  }
+  dlite_mapping_free(m);
+
+  for (i=0; i<5; i++) dlite_instance_decref(insts[i]);
+}
+
+
+MU_TEST(test_mapping_stats)
+{
+  DLiteInstance *inst, *inst2;
+  DLiteMapping *m;
+  DLiteMappingStats st, st2;
+  const char *output_uri = "http://onto-ns.com/meta/0.1/ent2";
+  const char *input_uris[] = { "http://onto-ns.com/meta/0.1/ent1" };
+  char *str;
+  FILE *fp;
+
+  mu_check((inst = dlite_instance_get("2daa6967-8ecd-4248-97b2-9ad6fefeac14")));
+  mu_assert_int_eq(0, dlite_mapping_stats_enable(1));
+  dlite_instance_incref(inst);
+  mu_check((inst2 = dlite_mapping(output_uri, (const DLiteInstance **)&inst,
+                                  1)));
+  dlite_instance_decref(inst2);
+  mu_assert_int_eq(1, dlite_mapping_stats_enable(0));
+
+  mu_assert_int_eq(0, dlite_mapping_stats_get("mapA", &st));
+  mu_assert_int_eq(1, st.ncalls);
+  mu_check(st.time >= 0.0);
+  mu_check(st.nbytes > 0);
+  mu_check(dlite_mapping_stats_get("mapB", NULL));  /* not called */
+  mu_check((str = dlite_mapping_stats_string()));
+  printf("\n%s", str);
+  free(str);
+
+  /* persistence */
+  mu_assert_int_eq(0, dlite_mapping_stats_save("mapping-stats.txt"));
+  dlite_mapping_stats_clear();
+  mu_check(dlite_mapping_stats_get("mapA", NULL));
+  mu_assert_int_eq(0, dlite_mapping_stats_load("mapping-stats.txt"));
+  mu_assert_int_eq(0, dlite_mapping_stats_get("mapA", &st2));
+  mu_assert_int_eq(st.ncalls, st2.ncalls);
+  mu_assert_double_eq(st.time, st2.time);
+  mu_assert_int_eq(st.nbytes, st2.nbytes);
+
+  /* measured costs: mapA takes 10 seconds per instance */
+  dlite_mapping_stats_clear();
+  mu_check((fp = fopen("mapping-stats.txt", "w")));
+  fprintf(fp, "# dlite mapping stats 1\nmapA 2 20.0 100\n");
+  fclose(fp);
+  mu_assert_int_eq(0, dlite_mapping_stats_load("mapping-stats.txt"));
+  mu_check((m = dlite_mapping_create(output_uri, input_uris, 1)));
+  mu_assert_int_eq(20, m->cost);
+  dlite_mapping_free(m);
+  mu_assert_int_eq(dliteMappingCostStatic,
+                   dlite_mapping_set_cost_mode(dliteMappingCostMeasured));
+  mu_check((m = dlite_mapping_create(output_uri, input_uris, 1)));
+  mu_assert_int_eq(10000000, m->cost);
+  dlite_mapping_free(m);
+  mu_assert_int_eq(dliteMappingCostMeasured,
+                   dlite_mapping_set_cost_mode(dliteMappingCostStatic));
+  dlite_mapping_stats_clear();
+
+  dlite_instance_decref(inst);
+}
+
+
+MU_TEST(test_plugin_index)
+{
+  const char *ent1 = "http://onto-ns.com/meta/0.1/ent1";
+  const char *ent2 = "http://onto-ns.com/meta/0.1/ent2";
+  const char *ent4 = "http://onto-ns.com/meta/0.1/ent4";
+  const DLiteMappingPlugin **apis;
+  size_t n;
+
+  mu_check((apis = dlite_mapping_plugin_by_output(ent4, &n)));
+  mu_assert_int_eq(1, n);
+  mu_assert_string_eq("mapC", apis[0]->name);
+  mu_check(!dlite_mapping_plugin_by_output(ent1, &n));
+  mu_assert_int_eq(0, n);
+
+  /* ent4 is mapped from ent2 and ent3, which are mapped from ent1 */
+  mu_check(dlite_mapping_plugin_reachable(ent4, ent2));
+  mu_check(dlite_mapping_plugin_reachable(ent4, ent1));
+  mu_check(!dlite_mapping_plugin_reachable(ent1, ent4));
+  mu_check(!dlite_mapping_plugin_reachable(ent2, ent4));
+  mu_check(!dlite_mapping_plugin_reachable(ent4, NULL));
+}
+
+
+MU_TEST(test_mapping_cache)
+{
+  DLiteInstance *inst, *inst2, *inst3;
+  const char *output_uri = "http://onto-ns.com/meta/0.1/ent2";
+  int generation;
+
+  mu_check((inst = dlite_instance_get("2daa6967-8ecd-4248-97b2-9ad6fefeac14")));
+  generation = dlite_mapping_plugin_generation();
+  dlite_instance_incref(inst);
+  mu_check((inst2 = dlite_mapping(output_uri, (const DLiteInstance **)&inst,
+                                  1)));
+  dlite_instance_incref(inst);
+  mu_check((inst3 = dlite_mapping(output_uri, (const DLiteInstance **)&inst,
+                                  1)));
+  mu_assert_string_eq(output_uri, inst3->meta->uri);
+  mu_assert_int_eq(generation, dlite_mapping_plugin_generation());
+  dlite_instance_decref(inst3);
+  dlite_instance_decref(inst2);
+
+  /* cached plans are not used after the plugins are unloaded */
+  mu_assert_int_eq(0, dlite_mapping_plugin_unload_all());
+  mu_check(generation != dlite_mapping_plugin_generation());
+  dlite_instance_incref(inst);
+  mu_check(!dlite_mapping(output_uri, (const DLiteInstance **)&inst, 1));
+  dlite_errclr();
+  dlite_instance_decref(inst);
+}
+
+
 /***********************************************************************/
 
 MU_TEST_SUITE(test_suite)
@@ -85,6 +297,12 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_create_from_id);
   MU_RUN_TEST(test_mapping);
   MU_RUN_TEST(test_get_casted);
+  MU_RUN_TEST(test_get_casted_cache);
+  MU_RUN_TEST(test_mapping_parallel);
+  MU_RUN_TEST(test_mapping_map_many);
+  MU_RUN_TEST(test_mapping_stats);
+  MU_RUN_TEST(test_plugin_index);
+  MU_RUN_TEST(test_mapping_cache);     /* unloads mapping plugins */
 }
 
 
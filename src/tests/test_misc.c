@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "minunit/minunit.h"
 #include "utils/err.h"
@@ -64,6 +66,41 @@ MU_TEST(test_get_uuidn)
 
 
 
+MU_TEST(test_get_uuid_cache)
+{
+  char buff[37], buff2[37], id[256];
+  int i;
+
+  /* Repeated lookups are served from the cache */
+  for (i=0; i<3; i++) {
+    mu_assert_int_eq(5, dlite_get_uuid(buff, "abc"));
+    mu_assert_string_eq("6cb8e707-0fc5-5f55-88d4-d4fed43e64a8", buff);
+  }
+
+  /* Ids too long for the cache */
+  strcpy(id, "http://onto-ns.com/meta/0.1/");
+  memset(id + 28, 'x', 200);
+  id[228] = '\0';
+  for (i=0; i<2; i++) {
+    mu_assert_int_eq(5, dlite_get_uuid(buff, id));
+    mu_assert_string_eq("052b88df-7c4c-5098-a1ec-bcc3721f86f7", buff);
+  }
+
+  /* Evicted entries are recomputed correctly */
+  for (i=0; i<2000; i++) {
+    snprintf(id, sizeof(id), "http://onto-ns.com/meta/0.1/Entity%d", i);
+    dlite_get_uuid(buff, id);
+  }
+  for (i=0; i<2000; i+=7) {
+    snprintf(id, sizeof(id), "http://onto-ns.com/meta/0.1/Entity%d", i);
+    dlite_get_uuid(buff, id);
+    dlite_get_uuid(buff2, id);
+    mu_assert_string_eq(buff, buff2);
+  }
+  mu_assert_int_eq(5, dlite_get_uuid(buff, "abc"));
+  mu_assert_string_eq("6cb8e707-0fc5-5f55-88d4-d4fed43e64a8", buff);
+}
+
 MU_TEST(test_join_split_metadata)
 {
   char *uri = "http://www.sintef.no/meta/dlite/0.1/testdata";
@@ -165,6 +202,7 @@ MU_TEST_SUITE(test_suite)
 {
   MU_RUN_TEST(test_get_uuid);
   MU_RUN_TEST(test_get_uuidn);
+  MU_RUN_TEST(test_get_uuid_cache);
   MU_RUN_TEST(test_join_split_metadata);
   MU_RUN_TEST(test_option_parse);
   MU_RUN_TEST(test_join_url);
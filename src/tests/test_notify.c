@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-notify.h"
+
+#include "config.h"
+
+#include "minunit/minunit.h"
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/NotifyEntity";
+char *jsonfile = "test-notify.json";
+char *h5file = "test-notify.h5";
+char *sockurl = "unix:test-notify.sock";
+DLiteMeta *entity=NULL;
+DLiteInstance *inst=NULL;
+
+
+/* Copy of the last received event */
+typedef struct {
+  int count;
+  char uuid[DLITE_UUID_LENGTH+1];
+  char metauri[256];
+  char location[256];
+  int has_location;
+  unsigned long version;
+  size_t nchanged;
+  char changed[8][32];
+} Log;
+
+/* Callback recording the received event in the Log pointed to by
+   `data`. */
+void record(const DLiteEvent *event, void *data)
+{
+  Log *log = data;
+  size_t i;
+  log->count++;
+  strncpy(log->uuid, event->uuid, sizeof(log->uuid) - 1);
+  strncpy(log->metauri, event->metauri, sizeof(log->metauri) - 1);
+  log->has_location = (event->location != NULL);
+  if (event->location)
+    strncpy(log->location, event->location, sizeof(log->location) - 1);
+  log->version = (unsigned long)event->version;
+  log->nchanged = event->nchanged;
+  for (i=0; i < event->nchanged && i < 8; i++)
+    strncpy(log->changed[i], event->changed[i], sizeof(log->changed[i]) - 1);
+}
+
+/* Callback cancelling its own subscription, whose id `data` points to. */
+void once(const DLiteEvent *event, void *data)
+{
+  int *id = data;
+  (void)event;
+  if (*id > 0 && dlite_unsubscribe(*id) == 0) *id = 0;
+}
+
+
+MU_TEST(test_setup)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type         size            ndims dims  unit iri   descr */
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "",   NULL, "Name."},
+    {"value",  dliteInt,    sizeof(int),    0, NULL, "",   NULL, "A value."},
+    {"items",  dliteFloat,  sizeof(double), 1, dims, "m",  NULL, "Items."}
+  };
+  size_t shape[] = {3};
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Notify entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    3, properties)));
+  mu_check((inst = dlite_instance_create(entity, shape, NULL)));
+  mu_assert_int_eq(0, dlite_notify_count());
+
+  /* nothing happens without subscribers */
+  mu_check(dlite_instance_publish(inst, NULL, 0) == 0);
+}
+
+MU_TEST(test_publish)
+{
+  Log log, other;
+  const char *names[] = {"items", "value"};
+  const char *invalid[] = {"nonexisting"};
+  int id, id2;
+  memset(&log, 0, sizeof(log));
+  memset(&other, 0, sizeof(other));
+
+  mu_check((id = dlite_subscribe(NULL, record, &log)) > 0);
+  mu_check((id2 = dlite_subscribe("http://www.sintef.no/other/*", record,
+                                   &other)) > id);
+  mu_assert_int_eq(2, dlite_notify_count());
+
+  mu_check(dlite_instance_publish(inst, names, 2) == 0);
+  mu_assert_int_eq(1, log.count);
+  mu_assert_string_eq(inst->uuid, log.uuid);
+  mu_assert_string_eq(uri, log.metauri);
+  mu_check(!log.has_location);
+  mu_assert_int_eq(1, log.version);
+  mu_assert_int_eq(2, log.nchanged);
+  mu_assert_string_eq("items", log.changed[0]);
+  mu_assert_string_eq("value", log.changed[1]);
+
+  mu_check(dlite_instance_publish(inst, NULL, 0) == 0);
+  mu_assert_int_eq(2, log.count);
+  mu_assert_int_eq(2, log.version);
+  mu_assert_int_eq(3, log.nchanged);
+  mu_assert_string_eq("name", log.changed[0]);
+  mu_assert_string_eq("items", log.changed[2]);
+
+  err_set_stream(NULL);
+  mu_check(dlite_instance_publish(inst, invalid, 1));
+  mu_check(dlite_unsubscribe(12345));
+  err_set_stream(stderr);
+  err_clear();
+  mu_assert_int_eq(2, log.count);
+
+  /* non-matching pattern */
+  mu_assert_int_eq(0, other.count);
+  mu_check(dlite_unsubscribe(id2) == 0);
+
+  /* match by metadata uri and uuid */
+  mu_check((id2 = dlite_subscribe("*/NotifyEntity", record, &other)) > 0);
+  mu_check(dlite_instance_publish(inst, names, 1) == 0);
+  mu_assert_int_eq(1, other.count);
+  mu_assert_int_eq(3, other.version);
+  mu_check(dlite_unsubscribe(id2) == 0);
+  mu_check((id2 = dlite_subscribe(inst->uuid, record, &other)) > 0);
+  mu_check(dlite_instance_publish(inst, names, 1) == 0);
+  mu_assert_int_eq(2, other.count);
+  mu_check(dlite_unsubscribe(id2) == 0);
+
+  mu_check(dlite_unsubscribe(id) == 0);
+  mu_assert_int_eq(0, dlite_notify_count());
+  mu_check(dlite_instance_publish(inst, NULL, 0) == 0);
+  mu_assert_int_eq(4, log.count);
+}
+
+MU_TEST(test_unsubscribe_in_callback)
+{
+  int id;
+  mu_check((id = dlite_subscribe(NULL, once, &id)) > 0);
+  mu_check(dlite_instance_publish(inst, NULL, 0) == 0);
+  mu_assert_int_eq(0, id);
+  mu_assert_int_eq(0, dlite_notify_count());
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  Log log;
+  int id;
+  memset(&log, 0, sizeof(log));
+  mu_check((id = dlite_subscribe(uri, record, &log)) > 0);
+  mu_check((s = dlite_storage_open("json", jsonfile, "mode=w")));
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_check(dlite_storage_close(s) == 0);
+  mu_assert_int_eq(1, log.count);
+  mu_assert_string_eq(inst->uuid, log.uuid);
+  mu_check(log.has_location);
+  mu_assert_string_eq(jsonfile, log.location);
+  mu_assert_int_eq(3, log.nchanged);
+  mu_check(dlite_unsubscribe(id) == 0);
+}
+
+MU_TEST(test_save_incremental)
+{
+#ifdef WITH_HDF5
+  DLiteStorage *s;
+  Log log;
+  int id, value=42;
+  memset(&log, 0, sizeof(log));
+  mu_check((s = dlite_storage_open("hdf5", h5file, "mode=w")));
+  mu_check(dlite_instance_save(s, inst) == 0);
+
+  mu_check((id = dlite_subscribe(NULL, record, &log)) > 0);
+  mu_check(dlite_instance_set_property(inst, "value", &value) == 0);
+  mu_check(dlite_instance_mark_dirty(inst, "value") == 0);
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_assert_int_eq(1, log.count);
+  mu_assert_string_eq(h5file, log.location);
+  mu_assert_int_eq(1, log.nchanged);
+  mu_assert_string_eq("value", log.changed[0]);
+
+  /* appending to an array property reports it as changed */
+  mu_check(dlite_instance_set_dimension_size(inst, "N", 5) == 0);
+  mu_check(dlite_instance_save(s, inst) == 0);
+  mu_assert_int_eq(2, log.count);
+  mu_check(log.nchanged >= 1);
+  mu_assert_string_eq("items", log.changed[log.nchanged - 1]);
+
+  mu_check(dlite_storage_close(s) == 0);
+  mu_check(dlite_unsubscribe(id) == 0);
+#endif
+}
+
+MU_TEST(test_socket)
+{
+#ifndef _WIN32
+  DLiteNotifyReceiver *r;
+  const char *names[] = {"value"};
+  Log log;
+  int id;
+  memset(&log, 0, sizeof(log));
+
+  /* events are dropped silently when no one is receiving */
+  mu_check((id = dlite_subscribe_url(NULL, sockurl)) > 0);
+  mu_check(dlite_instance_publish(inst, names, 1) == 0);
+
+  mu_check((r = dlite_notify_receiver_open(sockurl)));
+  mu_check(dlite_notify_receiver_fd(r) >= 0);
+  mu_assert_int_eq(0, dlite_notify_receive(r, 0, record, &log));
+
+  mu_check(dlite_instance_publish(inst, names, 1) == 0);
+  mu_assert_int_eq(1, dlite_notify_receive(r, 1000, record, &log));
+  mu_assert_int_eq(1, log.count);
+  mu_assert_string_eq(inst->uuid, log.uuid);
+  mu_assert_string_eq(uri, log.metauri);
+  mu_check(!log.has_location);
+  mu_check(log.version > 1);
+  mu_assert_int_eq(1, log.nchanged);
+  mu_assert_string_eq("value", log.changed[0]);
+  mu_assert_int_eq(0, dlite_notify_receive(r, 0, record, &log));
+
+  mu_check(dlite_unsubscribe(id) == 0);
+  mu_check(dlite_instance_publish(inst, names, 1) == 0);
+  mu_assert_int_eq(0, dlite_notify_receive(r, 0, record, &log));
+  dlite_notify_receiver_close(r);
+
+  err_set_stream(NULL);
+  mu_check(dlite_subscribe_url(NULL, "zmq:tcp://localhost:5555") < 0);
+  mu_check(!dlite_notify_receiver_open("unix:"));
+  err_set_stream(stderr);
+  err_clear();
+#endif
+}
+
+MU_TEST(test_teardown)
+{
+  mu_assert_int_eq(0, dlite_notify_count());
+  dlite_instance_decref(inst);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);
+  MU_RUN_TEST(test_publish);
+  MU_RUN_TEST(test_unsubscribe_in_callback);
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_save_incremental);
+  MU_RUN_TEST(test_socket);
+  MU_RUN_TEST(test_teardown);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-numa.h"
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/NumaEntity";
+DLiteMeta *entity=NULL;
+
+
+MU_TEST(test_setup)
+{
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri  descr */
+    {"count",  dliteInt,   sizeof(int),    0,    NULL, "",  NULL, "Count."},
+    {"values", dliteFloat, sizeof(double), 1,    dims, "",  NULL, "Values."}
+  };
+  mu_check((entity = dlite_meta_create(uri, NULL, "NUMA entity.",
+                                       1, dimensions, 2, properties)));
+}
+
+MU_TEST(test_allocator)
+{
+  int nnodes = dlite_numa_nnodes();
+  mu_check(nnodes >= 1);
+  mu_check(dlite_numa_allocator(dliteNumaDefault, 0) == NULL);
+  mu_check(dlite_numa_allocator(dliteNumaInterleave, 0) ==
+           dlite_numa_allocator(dliteNumaInterleave, 0));
+  mu_check(dlite_numa_allocator(dliteNumaBind, 0) ==
+           dlite_numa_allocator(dliteNumaBind, 0));
+
+  err_clear();
+  mu_check(dlite_numa_allocator(dliteNumaBind, nnodes) == NULL);
+  mu_check(dlite_numa_set_policy(dliteNumaBind, nnodes));
+  err_clear();
+}
+
+/* Creates an instance with the given policy, fills it and checks it. */
+static void check_policy(DLiteNumaPolicy policy)
+{
+  DLiteInstance *inst;
+  size_t i, n=20000, m=40000;
+  int newdims[] = {40000};
+  double *values;
+
+  mu_assert_int_eq(0, dlite_numa_set_policy(policy, 0));
+  mu_check(dlite_instance_get_allocator() ==
+           dlite_numa_allocator(policy, 0));
+  mu_check((inst = dlite_instance_create(entity, &n, NULL)));
+  values = *(double **)DLITE_PROP(inst, 1);
+  for (i=0; i<n; i++) mu_assert_double_eq(0.0, values[i]);
+  for (i=0; i<n; i++) values[i] = (double)i;
+
+  /* grows beyond the mapped size */
+  mu_assert_int_eq(0, dlite_instance_set_dimension_sizes(inst, newdims));
+  values = *(double **)DLITE_PROP(inst, 1);
+  mu_assert_double_eq(19999.0, values[19999]);
+  mu_assert_double_eq(0.0, values[m-1]);
+
+  mu_assert_int_eq(0, dlite_instance_numa_migrate(inst, 1, 0));
+  mu_assert_int_eq(0, dlite_instance_numa_migrate(inst, -1, -1));
+  mu_assert_double_eq(19999.0, values[19999]);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_numa_set_policy(dliteNumaDefault, 0));
+}
+
+MU_TEST(test_policies)
+{
+  check_policy(dliteNumaFirstTouch);
+  check_policy(dliteNumaInterleave);
+  check_policy(dliteNumaBind);
+  mu_check(dlite_instance_get_allocator() == NULL);
+}
+
+MU_TEST(test_migrate)
+{
+  DLiteInstance *inst;
+  size_t n=1000;
+  int node;
+  double *values;
+  mu_check((inst = dlite_instance_create(entity, &n, NULL)));
+  values = *(double **)DLITE_PROP(inst, 1);
+  values[0] = 1.0;
+  mu_assert_int_eq(0, dlite_instance_numa_migrate(inst, -1, 0));
+  node = dlite_instance_numa_node(inst, 1);
+  mu_check(node == 0 || node == -1);
+  node = dlite_instance_numa_node(inst, -1);
+  mu_check(node == 0 || node == -1);
+
+  err_clear();
+  mu_check(dlite_instance_numa_migrate(inst, 2, 0));
+  mu_check(dlite_instance_numa_migrate(inst, 0, dlite_numa_nnodes()));
+  err_clear();
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_teardown)
+{
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);     /* setup */
+  MU_RUN_TEST(test_allocator);
+  MU_RUN_TEST(test_policies);
+  MU_RUN_TEST(test_migrate);
+  MU_RUN_TEST(test_teardown);  /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-query.h"
+
+#define NINST 6
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/QueryEntity";
+char *jsonfile = STRINGIFY(dlite_BINARY_DIR) "/src/tests/test_query.json";
+DLiteMeta *entity=NULL;
+DLiteInstance *instances[NINST];
+
+
+/* Returns the number of instances in `s` matching `predicate`. */
+static int count_matches(DLiteStorage *s, const char *predicate)
+{
+  DLiteStorageQuery *q;
+  DLiteInstance *inst;
+  int n=0, stat;
+  if (!(q = dlite_storage_query(s, uri, predicate))) return -1;
+  while ((stat = dlite_storage_query_next(q, &inst)) == 0) {
+    dlite_instance_decref(inst);
+    n++;
+  }
+  dlite_storage_query_free(q);
+  return (stat < 0) ? -1 : n;
+}
+
+
+MU_TEST(test_setup)
+{
+  DLiteProperty properties[] = {
+    /* name         type            size            ndims dims unit iri descr */
+    {"temperature", dliteFloat,     sizeof(double), 0, NULL, "K", NULL, ""},
+    {"count",       dliteUInt,      sizeof(uint16_t), 0, NULL, "", NULL, ""},
+    {"alloy",       dliteStringPtr, sizeof(char *), 0, NULL, "",  NULL, ""},
+    {"phase",       dliteFixString, 8,              0, NULL, "",  NULL, ""}
+  };
+  char *alloys[] = {"AA6060", "AA6082", NULL};
+  char phases[2][8] = {"alpha", "beta"};
+  int i;
+
+  mu_check((entity = dlite_meta_create(uri, NULL, "Query entity.",
+                                       0, NULL, 4, properties)));
+  for (i=0; i<NINST; i++) {
+    double temperature = 600.0 + 100*i;
+    uint16_t count = i;
+    mu_check((instances[i] = dlite_instance_create(entity, NULL, NULL)));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i],
+                                                    "temperature",
+                                                    &temperature));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i], "count",
+                                                    &count));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i], "alloy",
+                                                    &alloys[i % 3]));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i], "phase",
+                                                    phases[i % 2]));
+  }
+}
+
+MU_TEST(test_match)
+{
+  DLiteQuery *q;
+  mu_check((q = dlite_query_compile(uri, "temperature > 800")));
+  mu_assert_int_eq(0, dlite_query_match(q, instances[2]));
+  mu_assert_int_eq(1, dlite_query_match(q, instances[3]));
+  mu_assert_int_eq(0, dlite_query_match(q, (DLiteInstance *)entity));
+  mu_check(q->root->op == dliteQueryGt);
+  mu_check(q->root->left->op == dliteQueryProperty);
+  mu_assert_int_eq(0, q->root->left->index);
+  mu_assert_double_eq(800.0, q->root->right->number);
+  dlite_query_free(q);
+
+  mu_check((q = dlite_query_compile(uri, "  ")));
+  mu_check(q->root == NULL);
+  mu_assert_int_eq(1, dlite_query_match(q, instances[0]));
+  dlite_query_free(q);
+
+  mu_check((q = dlite_query_compile(uri, "phase = 'beta' & !(count < 3)")));
+  mu_assert_int_eq(0, dlite_query_match(q, instances[1]));
+  mu_assert_int_eq(0, dlite_query_match(q, instances[4]));
+  mu_assert_int_eq(1, dlite_query_match(q, instances[5]));
+  dlite_query_free(q);
+
+  err_clear();
+  mu_check(!dlite_query_compile(uri, "temperature > 'hot'"));
+  mu_check(!dlite_query_compile(uri, "(count = 1"));
+  mu_check(!dlite_query_compile(uri, "count = 1 )"));
+  mu_check(!dlite_query_compile(uri, "alloy = \"AA6060"));
+  mu_check(!dlite_query_compile("http://no/such/meta", "count = 1"));
+  err_clear();
+}
+
+MU_TEST(test_storage)
+{
+  DLiteStorage *s;
+  mu_check((s = dlite_storage_open("json", jsonfile, "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save_many(
+                        s, (const DLiteInstance **)instances, NINST));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* the json plugin has no native queries, so the generic evaluation
+     on loaded instances is used */
+  mu_check((s = dlite_storage_open("json", jsonfile, "mode=r")));
+  mu_assert_int_eq(NINST, count_matches(s, NULL));
+  mu_assert_int_eq(3, count_matches(s, "temperature > 800"));
+  mu_assert_int_eq(3, count_matches(s, "alloy == 'AA6082' || count = 0"));
+  mu_assert_int_eq(2, count_matches(s, "alloy = \"\""));
+  mu_assert_int_eq(1, count_matches(s, "count >= 2 && count <= 4 & "
+                                    "phase != 'alpha'"));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_teardown)
+{
+  int i;
+  for (i=0; i<NINST; i++)
+    if (instances[i]) dlite_instance_decref(instances[i]);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);     /* setup */
+  MU_RUN_TEST(test_match);
+  MU_RUN_TEST(test_storage);
+  MU_RUN_TEST(test_teardown);  /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
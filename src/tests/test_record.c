@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-record.h"
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/RecordEntity";
+char *jsonfile = STRINGIFY(dlite_BINARY_DIR) "/src/tests/test_record.json";
+char *tracefile = STRINGIFY(dlite_BINARY_DIR) "/src/tests/test_record.trace";
+DLiteMeta *entity=NULL;
+DLiteInstance *inst=NULL;
+
+
+MU_TEST(test_setup)
+{
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri  descr */
+    {"values", dliteFloat, sizeof(double), 1,    dims, "",  NULL, "Values."}
+  };
+  size_t n = 10;
+  mu_check((entity = dlite_meta_create(uri, NULL, "Record entity.",
+                                       1, dimensions, 1, properties)));
+  mu_check((inst = dlite_instance_create(entity, &n, NULL)));
+}
+
+
+MU_TEST(test_record)
+{
+  DLiteStorage *s;
+  char uuid[DLITE_UUID_LENGTH+1];
+
+  mu_check(!dlite_record_enabled());
+  mu_assert_int_eq(0, dlite_record_begin());
+  mu_assert_int_eq(0, dlite_record_start(tracefile));
+  mu_check(dlite_record_enabled());
+  dlite_err_set_stream(NULL);
+  mu_check(dlite_record_start(tracefile));
+  dlite_err_set_stream(stderr);
+  dlite_errclr();
+
+  /* Save the entity too, such that the trace can be replayed */
+  mu_check((s = dlite_storage_open("json", jsonfile, "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, (DLiteInstance *)entity));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* Free the instance such that it is read from storage */
+  strcpy(uuid, inst->uuid);
+  dlite_instance_decref(inst);
+  mu_check((s = dlite_storage_open("json", jsonfile, "mode=r")));
+  mu_check((inst = dlite_instance_load(s, uuid)));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  mu_assert_int_eq(0, dlite_record_stop());
+  mu_check(!dlite_record_enabled());
+}
+
+
+MU_TEST(test_trace)
+{
+  FILE *fp;
+  char buf[1024], ops[16];
+  size_t nbytes = dlite_stats_instance_nbytes(inst);
+  unsigned long n;
+  int i=0, storage;
+
+  mu_check((fp = fopen(tracefile, "r")));
+  mu_check(fgets(buf, sizeof(buf), fp));
+  mu_check(strcmp(buf, "#dlite-record 1\n") == 0);
+  while (i < (int)sizeof(ops) && fgets(buf, sizeof(buf), fp)) {
+    ops[i++] = buf[0];
+    if (buf[0] == 'O') {
+      mu_check(strstr(buf, "\tjson\t"));
+      mu_check(strstr(buf, jsonfile));
+    }
+    if ((buf[0] == 'L' || buf[0] == 'S') && strstr(buf, inst->uuid)) {
+      mu_check(sscanf(buf + 2, "%d\t%*u\t%*u\t%lu", &storage, &n) == 2);
+      mu_assert_int_eq(nbytes, n);
+    }
+  }
+  fclose(fp);
+  mu_assert_int_eq(7, i);
+  mu_check(strncmp(ops, "OSSCOLC", 7) == 0);
+}
+
+
+MU_TEST(test_teardown)
+{
+  dlite_instance_decref(inst);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);     /* setup */
+  MU_RUN_TEST(test_record);
+  MU_RUN_TEST(test_trace);
+  MU_RUN_TEST(test_teardown);  /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-region.h"
+
+#include "minunit/minunit.h"
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/RegionEntity";
+char *path = "test_region.dat";
+DLiteMeta *entity=NULL;
+int nfreed=0;
+
+
+/* Region freer counting the number of released regions. */
+static void count_free(DLiteRegion *r)
+{
+  free(r->base);
+  nfreed++;
+}
+
+
+MU_TEST(test_setup)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."}
+  };
+  DLiteProperty properties[] = {
+    /* name   type        size ndims dims  unit iri   descr */
+    {"x",     dliteFloat, 8,   1,    dims, "m", NULL, "X coordinates."},
+    {"y",     dliteFloat, 8,   1,    dims, "m", NULL, "Y coordinates."}
+  };
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Region entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    2, properties)));
+}
+
+MU_TEST(test_adopt)
+{
+  size_t shape[] = {4};
+  DLiteInstance *inst;
+  DLiteRegion *r, *r2;
+  double *base, *x, *y;
+  int i;
+  mu_check((base = malloc(8 * sizeof(double))));
+  for (i=0; i<8; i++) base[i] = i;
+  mu_check((r = dlite_region_create(base, 8 * sizeof(double), count_free)));
+  mu_check((inst = dlite_instance_create(entity, shape, NULL)));
+  mu_assert_int_eq(0, dlite_region_adopt(inst, 0, base, r));
+  mu_assert_int_eq(0, dlite_region_adopt(inst, 1, base + 4, r));
+  mu_assert_int_eq(3, r->refcount);
+  x = dlite_instance_get_property(inst, "x");
+  y = dlite_instance_get_property(inst, "y");
+  mu_check(x == base);
+  mu_check(y == base + 4);
+  mu_assert_double_eq(5.0, y[1]);
+
+  /* adopted arrays can be looked up */
+  mu_check((r2 = dlite_region_find(y)) == r);
+  dlite_region_decref(r2);
+  mu_check(!dlite_region_find(base + 1));
+
+  /* an array can only be attached once */
+  err_set_stream(NULL);
+  mu_check(dlite_region_attach(r, base) != 0);
+  err_set_stream(stderr);
+  err_clear();
+
+  /* the region lives until the last adopted array is released */
+  dlite_region_decref(r);
+  mu_assert_int_eq(0, nfreed);
+  dlite_region_release(base + 1);  /* not attached, no effect */
+  mu_assert_int_eq(0, nfreed);
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_assert_int_eq(1, nfreed);
+}
+
+MU_TEST(test_map_file)
+{
+  size_t shape[] = {2};
+  double data[] = {1.5, 2.5, 3.5, 4.5};
+  DLiteInstance *inst;
+  DLiteRegion *r;
+  double *x;
+  FILE *fp;
+  mu_check((fp = fopen(path, "wb")));
+  mu_assert_int_eq(4, fwrite(data, sizeof(double), 4, fp));
+  fclose(fp);
+
+  mu_check((r = dlite_region_map_file(path, 16)));
+  mu_assert_int_eq(sizeof(data), r->size);
+  mu_check(memcmp(r->addr, data, sizeof(data)) == 0);
+  mu_check((inst = dlite_instance_create(entity, shape, NULL)));
+  mu_assert_int_eq(0, dlite_region_adopt(inst, 0, r->addr + 16, r));
+  dlite_region_decref(r);
+
+  /* modifications are private to the process */
+  x = dlite_instance_get_property(inst, "x");
+  mu_assert_double_eq(3.5, x[0]);
+  x[0] = 0.0;
+  mu_assert_int_eq(0, dlite_instance_decref(inst));
+  mu_check((fp = fopen(path, "rb")));
+  mu_assert_int_eq(4, fread(data, sizeof(double), 4, fp));
+  fclose(fp);
+  mu_assert_double_eq(3.5, data[2]);
+  remove(path);
+
+  err_set_stream(NULL);
+  mu_check(!dlite_region_map_file("no-such-file.dat", 16));
+  err_set_stream(stderr);
+  err_clear();
+}
+
+MU_TEST(test_teardown)
+{
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);
+  MU_RUN_TEST(test_adopt);
+  MU_RUN_TEST(test_map_file);
+  MU_RUN_TEST(test_teardown);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
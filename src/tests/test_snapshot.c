@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-snapshot.h"
+
+#include "minunit/minunit.h"
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/SnapshotEntity";
+char *snapshot = "test_snapshot.snp";
+char *inst_id = "snapshot-inst";
+char *coll_id = "snapshot-coll";
+DLiteMeta *entity=NULL;
+
+
+MU_TEST(test_setup)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."}
+  };
+  DLiteProperty properties[] = {
+    /* name   type            size ndims dims  unit iri   descr */
+    {"name",  dliteStringPtr, sizeof(char *), 0, NULL, "", NULL, "Name."},
+    {"items", dliteFloat,     8,   1,    dims, "m", NULL, "Items."}
+  };
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Snapshot entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    2, properties)));
+}
+
+MU_TEST(test_save_load)
+{
+  size_t i, shape[] = {5};
+  double *items;
+  DLiteInstance *inst, *member;
+  DLiteCollection *coll;
+  DLiteStore *store;
+  char uuid[DLITE_UUID_LENGTH+1], coll_uuid[DLITE_UUID_LENGTH+1];
+
+  mu_check((inst = dlite_instance_create(entity, shape, inst_id)));
+  *(char **)DLITE_PROP(inst, 0) = strdup("snap");
+  items = *(double **)DLITE_PROP(inst, 1);
+  for (i=0; i<shape[0]; i++) items[i] = 1.5 * i;
+  mu_check((member = dlite_instance_create(entity, shape, NULL)));
+  mu_check((coll = dlite_collection_create(coll_id)));
+  mu_check(!dlite_collection_add(coll, "member", member));
+  mu_check(!dlite_collection_add_relation(coll, "member", "is-a", "snap"));
+  memcpy(uuid, inst->uuid, sizeof(uuid));
+  memcpy(coll_uuid, coll->uuid, sizeof(coll_uuid));
+
+  mu_assert_int_eq(0, dlite_snapshot_save(snapshot));
+
+  /* release the instances, such that loading the snapshot must decode
+     them */
+  dlite_collection_decref(coll);
+  dlite_instance_decref(inst);
+  mu_check(!dlite_instance_has(uuid, 0));
+  mu_check(!dlite_instance_has(coll_uuid, 0));
+
+  mu_check((store = dlite_snapshot_load(snapshot)));
+  mu_check((inst = dlite_store_get(store, uuid)));
+  mu_check(inst == dlite_instance_has(inst_id, 0));
+  mu_check(inst->meta == entity);
+  mu_assert_int_eq(5, dlite_instance_get_dimension_size_by_index(inst, 0));
+  mu_assert_string_eq("snap", *(char **)DLITE_PROP(inst, 0));
+  items = *(double **)DLITE_PROP(inst, 1);
+  for (i=0; i<shape[0]; i++) mu_assert_double_eq(1.5 * i, items[i]);
+
+  /* adopted arrays are writable */
+  items[0] = 10.0;
+
+  /* instances that are already in memory are reused */
+  mu_check(dlite_store_get(store, member->uuid) == member);
+  mu_check(dlite_store_get(store, entity->uuid) == (DLiteInstance *)entity);
+
+  /* collections are restored with their relations */
+  mu_check((coll = (DLiteCollection *)dlite_store_get(store, coll_uuid)));
+  mu_assert_int_eq(1, dlite_collection_count(coll));
+  mu_check(dlite_collection_get(coll, "member") == member);
+  mu_check(dlite_collection_find_first(coll, "member", "is-a", "snap"));
+
+  dlite_store_free(store);
+  mu_check(!dlite_instance_has(uuid, 0));
+  dlite_instance_decref(member);
+}
+
+MU_TEST(test_outdated)
+{
+  char *path = STRINGIFY(dlite_SOURCE_DIR) "/src/tests/test-entity.json";
+  const char **paths;
+  DLiteStore *store;
+  int n=0;
+
+  mu_assert_int_eq(0, dlite_snapshot_save(snapshot));
+  mu_check((store = dlite_snapshot_load(snapshot)));
+  dlite_store_free(store);
+
+  /* changing the storage paths invalidates the snapshot */
+  mu_check(dlite_storage_paths_append(path) >= 0);
+  err_set_stream(NULL);
+  mu_check(!dlite_snapshot_load(snapshot));
+  err_set_stream(stderr);
+  err_clear();
+
+  mu_check((paths = dlite_storage_paths_get()));
+  while (paths[n]) n++;
+  mu_assert_int_eq(0, dlite_storage_paths_delete(n - 1));
+  mu_check((store = dlite_snapshot_load(snapshot)));
+  dlite_store_free(store);
+}
+
+MU_TEST(test_corrupted)
+{
+  char *path = "test_snapshot_corrupted.snp";
+  char buf[256];
+  FILE *fp;
+  memset(buf, 'x', sizeof(buf));
+  mu_check((fp = fopen(path, "wb")));
+  mu_assert_int_eq(sizeof(buf), fwrite(buf, 1, sizeof(buf), fp));
+  fclose(fp);
+
+  err_set_stream(NULL);
+  mu_check(!dlite_snapshot_load(path));
+  mu_check(!dlite_snapshot_load("no-such-snapshot.snp"));
+  err_set_stream(stderr);
+  err_clear();
+}
+
+MU_TEST(test_teardown)
+{
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);
+  MU_RUN_TEST(test_save_load);
+  MU_RUN_TEST(test_outdated);
+  MU_RUN_TEST(test_corrupted);
+  MU_RUN_TEST(test_teardown);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+#include "dlite.h"
+#include "dlite-soa.h"
+
+#define NINST 3
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/SoAEntity";
+DLiteMeta *entity=NULL;
+DLiteInstance *instances[NINST];
+
+/* Columns of a container with NINST records */
+int values[NINST];
+char *names[NINST];
+void *columns[] = {values, names};
+
+
+MU_TEST(test_setup)
+{
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims unit iri  descr */
+    {"value",  dliteInt,       sizeof(int),    0, NULL, "",  NULL, "A value."},
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "",  NULL, "A name."}
+  };
+  char *names[] = {"first", NULL, "third"};
+  int i;
+
+  mu_check((entity = dlite_meta_create(uri, NULL, "SoA entity.",
+                                       0, NULL, 2, properties)));
+  for (i=0; i<NINST; i++) {
+    int value = 10*i;
+    mu_check((instances[i] = dlite_instance_create(entity, NULL, NULL)));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i], "value",
+                                                    &value));
+    mu_assert_int_eq(0, dlite_instance_set_property(instances[i], "name",
+                                                    names + i));
+  }
+}
+
+MU_TEST(test_meta)
+{
+  DLiteMeta *soa, *soa2;
+  DLiteDimension dimensions[] = {{"N", "Number of items."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    {"items", dliteFloat, sizeof(double), 1, dims, "", NULL, "Items."}
+  };
+  DLiteMeta *meta;
+
+  mu_check((soa = dlite_soa_meta(entity)));
+  mu_assert_string_eq("http://www.sintef.no/meta/dlite/0.1/SoAEntitySoA",
+                      soa->uri);
+  mu_assert_int_eq(1, soa->_ndimensions);
+  mu_assert_string_eq(DLITE_SOA_DIMENSION, soa->_dimensions[0].name);
+  mu_assert_int_eq(2, soa->_nproperties);
+  mu_assert_int_eq(1, soa->_properties[1].ndims);
+  mu_check((soa2 = dlite_soa_meta(entity)));
+  mu_check(soa2 == soa);
+  dlite_meta_decref(soa2);
+  dlite_meta_decref(soa);
+
+  /* Metadata with dimensions cannot be stored in SoA containers */
+  mu_check((meta = dlite_meta_create(
+    "http://www.sintef.no/meta/dlite/0.1/SoADimEntity", NULL, "Entity.",
+    1, dimensions, 1, properties)));
+  mu_check(dlite_soa_meta(meta) == NULL);
+  dlite_errclr();
+  dlite_meta_decref(meta);
+}
+
+MU_TEST(test_from_instances)
+{
+  mu_assert_int_eq(0, dlite_soa_from_instances(entity, columns, 0,
+                                               instances, NINST));
+  mu_assert_int_eq(0, values[0]);
+  mu_assert_int_eq(20, values[2]);
+  mu_assert_string_eq("first", names[0]);
+  mu_check(names[1] == NULL);
+  mu_assert_string_eq("third", names[2]);
+}
+
+MU_TEST(test_to_instances)
+{
+  DLiteInstance **insts;
+  int i;
+  mu_check((insts = dlite_soa_to_instances(entity, columns, 1, 2)));
+  mu_assert_int_eq(10, *(int *)dlite_instance_get_property(insts[0],
+                                                           "value"));
+  mu_assert_string_eq("third", *(char **)dlite_instance_get_property(
+                        insts[1], "name"));
+  for (i=0; i<2; i++) dlite_instance_decref(insts[i]);
+  free(insts);
+}
+
+MU_TEST(test_instance)
+{
+  DLiteInstance *inst;
+  int values2[NINST] = {0};
+  char *names2[NINST] = {NULL};
+  void *columns2[] = {values2, names2};
+  int i;
+
+  mu_check((inst = dlite_soa_create_instance(entity, columns, NINST,
+                                             "soa-container")));
+  mu_assert_int_eq(NINST, dlite_instance_get_dimension_size_by_index(inst,
+                                                                     0));
+  mu_assert_int_eq(20, ((int *)dlite_instance_get_property(inst,
+                                                           "value"))[2]);
+
+  mu_assert_int_eq(0, dlite_soa_from_instance(entity, columns2, 0, inst));
+  mu_assert_int_eq(10, values2[1]);
+  mu_assert_string_eq("third", names2[2]);
+  for (i=0; i<NINST; i++) free(names2[i]);
+
+  /* Not a container */
+  mu_check(dlite_soa_from_instance(entity, columns2, 0, instances[0]));
+  dlite_errclr();
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_teardown)
+{
+  int i;
+  for (i=0; i<NINST; i++) {
+    dlite_instance_decref(instances[i]);
+    free(names[i]);
+  }
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);     /* setup */
+  MU_RUN_TEST(test_meta);
+  MU_RUN_TEST(test_from_instances);
+  MU_RUN_TEST(test_to_instances);
+  MU_RUN_TEST(test_instance);
+  MU_RUN_TEST(test_teardown);  /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-sparse.h"
+
+#include "minunit/minunit.h"
+
+
+/* 3x4 array with three non-zero elements */
+double dense[3][4] = {
+  {0, 1.5, 0, 0},
+  {0, 0,   0, 0},
+  {2, 0,   0, -3}
+};
+size_t shape[] = {3, 4};
+
+
+MU_TEST(test_from_dense)
+{
+  DLiteSparse *coo, *csr, *sp;
+  double out[3][4];
+  size_t ind[2];
+  const double *v;
+
+  mu_assert_int_eq(3, dlite_sparse_count_nonzero(dense, sizeof(double), 12));
+
+  mu_check((coo = dlite_sparse_from_dense(dliteSparseCOO, dense, dliteFloat,
+                                          sizeof(double), 2, shape)));
+  mu_assert_int_eq(3, coo->nnz);
+  mu_check(coo->indptr == NULL);
+  mu_assert_int_eq(2, coo->indices[2]);
+  mu_assert_int_eq(0, coo->indices[3]);
+  mu_assert_double_eq(-3, ((double *)coo->values)[2]);
+  mu_assert_int_eq(3*(8 + 2*sizeof(size_t)), dlite_sparse_nbytes(coo));
+
+  ind[0] = 2; ind[1] = 3;
+  mu_check((v = dlite_sparse_get(coo, ind)));
+  mu_assert_double_eq(-3, *v);
+  ind[1] = 2;
+  mu_check(!dlite_sparse_get(coo, ind));
+
+  mu_check((csr = dlite_sparse_from_dense(dliteSparseCSR, dense, dliteFloat,
+                                          sizeof(double), 2, shape)));
+  mu_assert_int_eq(3, csr->nnz);
+  mu_assert_int_eq(0, csr->indptr[0]);
+  mu_assert_int_eq(1, csr->indptr[1]);
+  mu_assert_int_eq(1, csr->indptr[2]);
+  mu_assert_int_eq(3, csr->indptr[3]);
+  mu_assert_int_eq(3, csr->indices[2]);
+  mu_check(0 == dlite_sparse_coords(csr, 1, ind));
+  mu_assert_int_eq(2, ind[0]);
+  mu_assert_int_eq(0, ind[1]);
+  ind[0] = 0; ind[1] = 1;
+  mu_check((v = dlite_sparse_get(csr, ind)));
+  mu_assert_double_eq(1.5, *v);
+
+  /* conversions */
+  mu_check((sp = dlite_sparse_convert(coo, dliteSparseCSR)));
+  mu_check(memcmp(sp->indptr, csr->indptr, 4*sizeof(size_t)) == 0);
+  mu_check(memcmp(sp->indices, csr->indices, 3*sizeof(size_t)) == 0);
+  mu_check(memcmp(sp->values, csr->values, 3*sizeof(double)) == 0);
+  dlite_sparse_free(sp);
+  mu_check((sp = dlite_sparse_convert(csr, dliteSparseCOO)));
+  mu_check(memcmp(sp->indices, coo->indices, 6*sizeof(size_t)) == 0);
+  dlite_sparse_free(sp);
+
+  /* back to dense, overwriting existing data */
+  memset(out, 0xff, sizeof(out));
+  mu_check(0 == dlite_sparse_to_dense(csr, out));
+  mu_check(memcmp(out, dense, sizeof(dense)) == 0);
+  memset(out, 0xff, sizeof(out));
+  mu_check(0 == dlite_sparse_to_dense(coo, out));
+  mu_check(memcmp(out, dense, sizeof(dense)) == 0);
+
+  dlite_sparse_free(coo);
+  dlite_sparse_free(csr);
+}
+
+
+MU_TEST(test_array)
+{
+  DLiteArray *a, *arr;
+  DLiteSparse *sp;
+  double out[4][3];
+  size_t ind[2] = {3, 2};
+
+  /* transposed view of `dense` */
+  mu_check((a = dlite_array_create(dense, dliteFloat, sizeof(double), 2,
+                                   shape)));
+  mu_check((arr = dlite_array_transpose(a)));
+  dlite_array_free(a);
+  mu_check((sp = dlite_sparse_from_array(dliteSparseCOO, arr)));
+  mu_assert_int_eq(3, sp->nnz);
+  mu_assert_int_eq(4, sp->shape[0]);
+  mu_check(dlite_sparse_get(sp, ind));
+  mu_assert_double_eq(-3, *(double *)dlite_sparse_get(sp, ind));
+
+  /* writing to the transposed view restores `dense` */
+  memset(dense, 0, sizeof(dense));
+  mu_check(0 == dlite_sparse_to_array(sp, arr));
+  mu_assert_double_eq(1.5, dense[0][1]);
+  mu_assert_double_eq(-3, dense[2][3]);
+  dlite_array_free(arr);
+
+  mu_check((arr = dlite_array_create(out, dliteFloat, sizeof(double), 2,
+                                     sp->shape)));
+  mu_check(0 == dlite_sparse_to_array(sp, arr));
+  mu_assert_double_eq(-3, out[3][2]);
+  mu_assert_double_eq(2, out[0][2]);
+  dlite_array_free(arr);
+  dlite_sparse_free(sp);
+}
+
+
+MU_TEST(test_errors)
+{
+  char *strings[2] = {NULL, "a"};
+  size_t shape3[] = {2, 2, 2};
+  int data[8] = {0};
+
+  err_set_stream(NULL);
+  mu_check(!dlite_sparse_from_dense(dliteSparseCOO, strings, dliteStringPtr,
+                                    sizeof(char *), 1, shape));
+  mu_check(!dlite_sparse_from_dense(dliteSparseCSR, data, dliteInt,
+                                    sizeof(int), 3, shape3));
+  mu_check(!dlite_sparse_from_dense(dliteSparseNone, data, dliteInt,
+                                    sizeof(int), 1, shape3));
+  err_set_stream(stderr);
+  err_clear();
+
+  mu_assert_int_eq(dliteSparseCSR, dlite_sparse_format_from_name("CSR", -1));
+  mu_assert_int_eq(dliteSparseCOO, dlite_sparse_format_from_name("coox", 3));
+  mu_assert_int_eq(-1, dlite_sparse_format_from_name("dense", -1));
+  mu_assert_string_eq("csr", dlite_sparse_format_name(dliteSparseCSR));
+}
+
+
+MU_TEST(test_instance)
+{
+  DLiteDimension dimensions[] = {
+    {"N", "Number of rows."},
+    {"M", "Number of columns."}
+  };
+  char *dims[] = {"N", "M"};
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri  descr */
+    {"grid",   dliteFloat, sizeof(double), 2,    dims, "m", NULL, "Grid."},
+    {"counts", dliteInt,   sizeof(int),    1,    dims, NULL, NULL, "Counts."}
+  };
+  char *uri = "http://onto-ns.com/meta/0.1/SparseEntity";
+  size_t n[] = {300, 400};
+  DLiteMeta *e, *e2;
+  DLiteInstance *inst, *inst2;
+  DLiteSparse *sp, *sp2;
+  double *grid;
+  int *counts;
+  char *json, *ejson, *p;
+
+  mu_check((e = dlite_meta_create(uri, NULL, "Sparse entity.", 2, dimensions,
+                                  2, properties)));
+  err_set_stream(NULL);
+  mu_check(dlite_meta_set_sparse_property(e, "counts", dliteSparseCSR));
+  err_set_stream(stderr);
+  err_clear();
+  mu_check(0 == dlite_meta_set_sparse_property(e, "grid", dliteSparseCSR));
+  mu_check(0 == dlite_meta_set_sparse_property(e, "counts", dliteSparseCOO));
+  mu_assert_int_eq(dliteSparseCSR, dlite_meta_get_sparse_format(e, 0));
+
+  mu_check((inst = dlite_instance_create(e, n, NULL)));
+  mu_check((sp = dlite_sparse_create(dliteSparseCOO, dliteFloat,
+                                     sizeof(double), 2, n, 2)));
+  sp->indices[0] = 7;   sp->indices[1] = 11;
+  sp->indices[2] = 299; sp->indices[3] = 399;
+  ((double *)sp->values)[0] = 0.5;
+  ((double *)sp->values)[1] = 42;
+  mu_check(0 == dlite_instance_set_sparse(inst, "grid", sp));
+  dlite_sparse_free(sp);
+  grid = dlite_instance_get_property(inst, "grid");
+  mu_assert_double_eq(0.5, grid[7*400 + 11]);
+  mu_assert_double_eq(42, grid[300*400 - 1]);
+  counts = dlite_instance_get_property(inst, "counts");
+  counts[123] = 5;
+
+  mu_check((sp = dlite_instance_get_sparse(inst, "grid", dliteSparseNone)));
+  mu_assert_int_eq(dliteSparseCSR, sp->format);
+  mu_assert_int_eq(2, sp->nnz);
+
+  /* the JSON representation only holds the non-zero elements */
+  mu_check((json = dlite_json_aprint(inst, 0, dliteJsonWithUuid)));
+  mu_check(strlen(json) < 3000);
+  mu_check(strstr(json, "\"format\": \"csr\""));
+  mu_check(strstr(json, "\"indices\": [[123]], \"values\": [5]"));
+  dlite_instance_decref(inst);
+  mu_check((inst2 = dlite_json_sscan(json, NULL, NULL)));
+  mu_check((sp2 = dlite_instance_get_sparse(inst2, "grid", dliteSparseNone)));
+  mu_assert_int_eq(2, sp2->nnz);
+  mu_check(memcmp(sp->indptr, sp2->indptr, 301*sizeof(size_t)) == 0);
+  mu_check(memcmp(sp->indices, sp2->indices, 2*sizeof(size_t)) == 0);
+  mu_check(memcmp(sp->values, sp2->values, 2*sizeof(double)) == 0);
+  counts = dlite_instance_get_property(inst2, "counts");
+  mu_assert_int_eq(5, counts[123]);
+  mu_assert_int_eq(0, counts[122]);
+  dlite_sparse_free(sp);
+  dlite_sparse_free(sp2);
+  dlite_instance_decref(inst2);
+  free(json);
+
+  /* sparse declarations in entities */
+  mu_check((ejson = dlite_json_aprint((DLiteInstance *)e, 0, 0)));
+  mu_check(strstr(ejson, "\"sparse\": \"csr\""));
+  mu_check((p = strstr(ejson, "SparseEntity")));
+  p[11] = 'z';
+  mu_check((e2 = (DLiteMeta *)dlite_json_sscan(ejson, NULL, NULL)));
+  mu_assert_int_eq(dliteSparseCSR, dlite_meta_get_sparse_format(e2, 0));
+  mu_assert_int_eq(dliteSparseCOO, dlite_meta_get_sparse_format(e2, 1));
+  dlite_meta_decref(e2);
+  free(ejson);
+
+  dlite_meta_decref(e);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_from_dense);
+  MU_RUN_TEST(test_array);
+  MU_RUN_TEST(test_errors);
+  MU_RUN_TEST(test_instance);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
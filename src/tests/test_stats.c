@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-stats.h"
+
+#define NINST 4
+
+char *uri = "http://www.sintef.no/meta/dlite/0.1/StatsEntity";
+char *jsonfile = STRINGIFY(dlite_BINARY_DIR) "/src/tests/test_stats.json";
+DLiteMeta *entity=NULL;
+DLiteInstance *instances[NINST];
+
+
+/* Returns the live statistics of `metauri` in `stats` or NULL. */
+static const DLiteMetaStats *get_meta(const DLiteStats *stats,
+                                      const char *metauri)
+{
+  size_t i;
+  for (i=0; i<stats->nmeta; i++)
+    if (strcmp(stats->meta[i].uri, metauri) == 0) return stats->meta + i;
+  return NULL;
+}
+
+/* Returns the statistics of `driver` in `stats` or NULL. */
+static const DLiteDriverStats *get_driver(const DLiteStats *stats,
+                                          const char *driver)
+{
+  size_t i;
+  for (i=0; i<stats->ndrivers; i++)
+    if (strcmp(stats->drivers[i].driver, driver) == 0)
+      return stats->drivers + i;
+  return NULL;
+}
+
+
+MU_TEST(test_setup)
+{
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri  descr */
+    {"values", dliteFloat, sizeof(double), 1,    dims, "",  NULL, "Values."}
+  };
+  size_t n;
+  int i;
+
+  mu_check((entity = dlite_meta_create(uri, NULL, "Stats entity.",
+                                       1, dimensions, 1, properties)));
+  for (i=0; i<NINST; i++) {
+    n = 10;
+    mu_check((instances[i] = dlite_instance_create(entity, &n, NULL)));
+  }
+  dlite_stats_reset();
+}
+
+
+MU_TEST(test_live)
+{
+  DLiteStats stats;
+  const DLiteMetaStats *m;
+  size_t nbytes = dlite_stats_instance_nbytes(instances[0]);
+  mu_check(nbytes >= 10*sizeof(double));
+
+  mu_assert_int_eq(0, dlite_stats_get(&stats));
+  mu_check((m = get_meta(&stats, uri)));
+  mu_assert_int_eq(NINST, m->ninstances);
+  mu_assert_int_eq(NINST*nbytes, m->nbytes);
+  mu_check(stats.ninstances > NINST);
+  mu_check(stats.nbytes > NINST*nbytes);
+  dlite_stats_deinit(&stats);
+
+  /* A leaked instance shows up */
+  dlite_instance_incref(instances[0]);
+  dlite_instance_decref(instances[NINST-1]);
+  mu_assert_int_eq(0, dlite_stats_get(&stats));
+  mu_check((m = get_meta(&stats, uri)));
+  mu_assert_int_eq(NINST-1, m->ninstances);
+  dlite_stats_deinit(&stats);
+  dlite_instance_decref(instances[0]);
+  instances[NINST-1] = NULL;
+}
+
+
+MU_TEST(test_store)
+{
+  DLiteStats stats;
+  DLiteInstance *inst;
+  mu_check((inst = dlite_instance_has(instances[0]->uuid, 0)));
+  mu_check(!dlite_instance_has("2c7a1c1e-6b6e-4e1c-bd4c-1f4f3a5e9d11", 0));
+  mu_assert_int_eq(0, dlite_stats_get(&stats));
+  mu_assert_int_eq(1, stats.counters[dliteStatsStoreHits]);
+  mu_assert_int_eq(1, stats.counters[dliteStatsStoreMisses]);
+  dlite_stats_deinit(&stats);
+}
+
+
+MU_TEST(test_json)
+{
+  DLiteStats stats;
+  DLiteJsonIter *iter;
+  char *s;
+  mu_check((s = dlite_json_aprint(instances[1], 0, 0)));
+  dlite_stats_reset();
+  mu_check((iter = dlite_json_iter_create(s, 0, NULL)));
+  mu_assert_int_eq(0, dlite_stats_get(&stats));
+  mu_check(stats.counters[dliteStatsJsonTokens] > 10);
+  dlite_stats_deinit(&stats);
+  dlite_json_iter_free(iter);
+  free(s);
+}
+
+
+MU_TEST(test_storage)
+{
+  DLiteStats stats;
+  DLiteStorage *s;
+  const DLiteDriverStats *d;
+  size_t nbytes = dlite_stats_instance_nbytes(instances[1]);
+  char uuid[DLITE_UUID_LENGTH+1];
+
+  dlite_stats_reset();
+  mu_check((s = dlite_storage_open("json", jsonfile, "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, instances[1]));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* Free the instance such that it is read from storage */
+  strcpy(uuid, instances[1]->uuid);
+  dlite_instance_decref(instances[1]);
+  mu_check((s = dlite_storage_open("json", jsonfile, "mode=r")));
+  mu_check((instances[1] = dlite_instance_load(s, uuid)));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  mu_assert_int_eq(0, dlite_stats_get(&stats));
+  mu_check((d = get_driver(&stats, "json")));
+  mu_assert_int_eq(2, d->counters[dliteStatsOpens]);
+  mu_assert_int_eq(nbytes, d->counters[dliteStatsBytesWritten]);
+  mu_assert_int_eq(nbytes, d->counters[dliteStatsBytesRead]);
+  mu_assert_int_eq(2, stats.totals[dliteStatsOpens]);
+  dlite_stats_deinit(&stats);
+}
+
+
+MU_TEST(test_fprint)
+{
+  DLiteStats stats;
+  FILE *fp = tmpfile();
+  char buf[256];
+  int found=0;
+  mu_check(fp);
+  mu_assert_int_eq(0, dlite_stats_get(&stats));
+  mu_assert_int_eq(0, dlite_stats_fprint(fp, &stats));
+  dlite_stats_deinit(&stats);
+  rewind(fp);
+  while (fgets(buf, sizeof(buf), fp))
+    if (strstr(buf, uri)) found = 1;
+  mu_check(found);
+  fclose(fp);
+}
+
+
+MU_TEST(test_teardown)
+{
+  int i;
+  for (i=0; i<NINST; i++)
+    if (instances[i]) dlite_instance_decref(instances[i]);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);     /* setup */
+  MU_RUN_TEST(test_live);
+  MU_RUN_TEST(test_store);
+  MU_RUN_TEST(test_json);
+  MU_RUN_TEST(test_storage);
+  MU_RUN_TEST(test_fprint);
+  MU_RUN_TEST(test_teardown);  /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
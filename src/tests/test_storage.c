@@ -1,8 +1,10 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "minunit/minunit.h"
 
+#include "utils/err.h"
 #include "dlite.h"
 #include "dlite-macros.h"
 #include "dlite-storage-plugins.h"
@@ -49,6 +51,14 @@ MU_TEST(test_get_driver)
   mu_assert_string_eq("json", driver);
 }
 
+MU_TEST(test_get_capabilities)
+{
+  int caps = dlite_storage_get_capabilities(s);
+  mu_assert_int_eq(0, caps & dliteCapSlices);
+  mu_check(caps & dliteCapBatch);
+  mu_assert_int_eq(0, caps & dliteCapThreadSafe);
+}
+
 MU_TEST(test_plugin_iter)
 {
   int n=0;
@@ -78,6 +88,185 @@ MU_TEST(test_load_all)
 }
 
 
+MU_TEST(test_cache)
+{
+  char *path = STRINGIFY(dlite_SOURCE_DIR) "/src/tests/test-data.json";
+  char *tmp = "test-storage-cache.json";
+  char *uuid1 = "204b05b2-4c89-43f4-93db-fd1cb70f54ef";
+  char *uuid2 = "e076a856-e36e-5335-967e-2f2fd153c17d";
+  char *metaurl = "json://" STRINGIFY(dlite_SOURCE_DIR)
+    "/src/tests/test-entity.json?mode=r#http://onto-ns.com/meta/0.1/test-entity";
+  DLiteStorage *s1, *s2, *s3, *w;
+  DLiteInstance *inst, *meta;
+  char **uuids;
+
+  /* a released storage is reused, but only by one user at a time */
+  mu_check((s1 = dlite_storage_cache_open("json", path, "mode=r")));
+  mu_check((s2 = dlite_storage_cache_open("json", path, "mode=r")));
+  mu_check(s1 != s2);
+  mu_assert_int_eq(0, dlite_storage_cache_release(s1));
+  mu_check((s3 = dlite_storage_cache_open("json", path, "mode=r")));
+  mu_check(s3 == s1);
+  mu_assert_int_eq(0, dlite_storage_cache_release(s3));
+  mu_assert_int_eq(0, dlite_storage_cache_release(s2));
+
+  /* writable storages are not cached */
+  mu_check((w = dlite_storage_cache_open("json", tmp, "mode=w")));
+  mu_assert_int_eq(1, dlite_storage_is_writable(w));
+  mu_assert_int_eq(0, dlite_storage_cache_release(w));
+
+  /* closing a writable storage invalidates cached storages at the
+     same location */
+  mu_check((meta = dlite_instance_load_url(metaurl)));
+  mu_check((inst = dlite_instance_load(s, uuid1)));
+  mu_check((w = dlite_storage_open("json", tmp, "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(w, inst));
+  mu_assert_int_eq(0, dlite_storage_close(w));
+  dlite_instance_decref(inst);
+
+  mu_check((s1 = dlite_storage_cache_open("json", tmp, "mode=r")));
+  mu_check((uuids = dlite_storage_uuids(s1, NULL)));
+  mu_assert_string_eq(uuid1, uuids[0]);
+  dlite_storage_uuids_free(uuids);
+  mu_assert_int_eq(0, dlite_storage_cache_release(s1));
+
+  mu_check((inst = dlite_instance_load(s, uuid2)));
+  mu_check((w = dlite_storage_open("json", tmp, "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(w, inst));
+  mu_assert_int_eq(0, dlite_storage_close(w));
+  dlite_instance_decref(inst);
+
+  mu_check((s2 = dlite_storage_cache_open("json", tmp, "mode=r")));
+  mu_check((uuids = dlite_storage_uuids(s2, NULL)));
+  mu_assert_string_eq(uuid2, uuids[0]);
+  mu_check(!uuids[1]);
+  dlite_storage_uuids_free(uuids);
+  mu_assert_int_eq(0, dlite_storage_cache_release(s2));
+
+  dlite_instance_decref(meta);
+  dlite_storage_cache_clear();
+}
+
+
+MU_TEST(test_compress)
+{
+  char *tmp = "test-storage-compress.json.gz";
+  char *uuid = "204b05b2-4c89-43f4-93db-fd1cb70f54ef";
+  char *metaurl = "json://" STRINGIFY(dlite_SOURCE_DIR)
+    "/src/tests/test-entity.json?mode=r#http://onto-ns.com/meta/0.1/test-entity";
+  DLiteStorage *w, *r;
+  DLiteInstance *inst, *meta;
+  unsigned char magic[2];
+  char *buf, *buf2;
+  size_t i, n = 3*1024*1024;
+  FILE *fp;
+
+  mu_check((meta = dlite_instance_load_url(metaurl)));
+  mu_check((inst = dlite_instance_load(s, uuid)));
+  mu_check((w = dlite_storage_open("gzip+json", tmp, "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(w, inst));
+  mu_assert_int_eq(0, dlite_storage_close(w));
+  dlite_instance_decref(inst);
+
+  mu_check((fp = fopen(tmp, "rb")));
+  mu_assert_int_eq(2, fread(magic, 1, 2, fp));
+  fclose(fp);
+  mu_assert_int_eq(0x1f, magic[0]);
+  mu_assert_int_eq(0x8b, magic[1]);
+
+  /* the driver follows from the extension, or the compress option */
+  mu_check((r = dlite_storage_open(NULL, tmp, "mode=r")));
+  mu_assert_string_eq("json", dlite_storage_get_driver(r));
+  mu_check((inst = dlite_instance_load(r, uuid)));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(r));
+  mu_check((r = dlite_storage_open("json", tmp, "compress=gzip:9;mode=r")));
+  mu_check((inst = dlite_instance_load(r, uuid)));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(r));
+  dlite_instance_decref(meta);
+
+  mu_check(!dlite_storage_open("json", tmp, "mode=r;compress=zstd"));
+  mu_check(!dlite_storage_open("json", tmp, "mode=r;compress=gzip:10"));
+  err_clear();
+
+  /* files compressed by several threads decompress to the original */
+  mu_check((buf = malloc(n)));
+  for (i=0; i<n; i++) buf[i] = "dlite compress\n"[(i + i/1000) % 15];
+  mu_check((fp = fopen("test-storage-compress.txt", "wb")));
+  mu_assert_int_eq(n, fwrite(buf, 1, n, fp));
+  fclose(fp);
+  mu_assert_int_eq(0, dlite_compress_file("test-storage-compress.txt",
+                                          "test-storage-compress.txt.gz",
+                                          1, 4));
+  mu_assert_int_eq(0, dlite_decompress_file("test-storage-compress.txt.gz",
+                                            "test-storage-compress.txt"));
+  mu_check((buf2 = malloc(n + 1)));
+  mu_check((fp = fopen("test-storage-compress.txt", "rb")));
+  mu_assert_int_eq(n, fread(buf2, 1, n + 1, fp));
+  fclose(fp);
+  mu_check(memcmp(buf, buf2, n) == 0);
+  free(buf);
+  free(buf2);
+}
+
+MU_TEST(test_write_behind)
+{
+  char *tmp = "test-storage-writebehind.json";
+  char *uuid = "204b05b2-4c89-43f4-93db-fd1cb70f54ef";
+  char *metaurl = "json://" STRINGIFY(dlite_SOURCE_DIR)
+    "/src/tests/test-entity.json?mode=r#http://onto-ns.com/meta/0.1/test-entity";
+  DLiteStorage *w, *r;
+  DLiteInstance *inst, *inst2, *meta;
+  char **uuids;
+
+  mu_check((meta = dlite_instance_load_url(metaurl)));
+  mu_check((inst = dlite_instance_load(s, uuid)));
+
+  /* write-behind requires a writable storage */
+  err_set_stream(NULL);
+  mu_check(dlite_storage_set_write_behind(s, 1, 0, 0.0));
+  err_set_stream(stderr);
+
+  /* repeated saves are coalesced */
+  mu_check((w = dlite_storage_open("json", tmp, "mode=w")));
+  mu_assert_int_eq(0, dlite_storage_set_write_behind(w, 1, 0, 0.0));
+  mu_assert_int_eq(0, dlite_instance_save(w, inst));
+  mu_assert_int_eq(0, dlite_instance_save(w, inst));
+  mu_assert_int_eq(1, dlite_storage_pending(w));
+
+  /* listing the content writes pending saves */
+  mu_check((uuids = dlite_storage_uuids(w, NULL)));
+  mu_assert_int_eq(0, dlite_storage_pending(w));
+  mu_assert_string_eq(uuid, uuids[0]);
+  mu_check(uuids[1] == NULL);
+  dlite_storage_uuids_free(uuids);
+
+  mu_assert_int_eq(0, dlite_instance_save(w, inst));
+  mu_assert_int_eq(1, dlite_storage_pending(w));
+  mu_assert_int_eq(0, dlite_storage_flush(w));
+  mu_assert_int_eq(0, dlite_storage_pending(w));
+
+  /* exceeding the byte threshold flushes */
+  mu_assert_int_eq(0, dlite_storage_set_write_behind(w, 1, 1, 0.0));
+  mu_assert_int_eq(0, dlite_instance_save(w, inst));
+  mu_assert_int_eq(0, dlite_storage_pending(w));
+
+  /* pending saves are written on close */
+  mu_assert_int_eq(0, dlite_storage_set_write_behind(w, 1, 0, 0.0));
+  mu_assert_int_eq(0, dlite_instance_save(w, inst));
+  mu_assert_int_eq(1, dlite_storage_pending(w));
+  mu_assert_int_eq(0, dlite_storage_close(w));
+
+  mu_check((r = dlite_storage_open("json", tmp, "mode=r")));
+  mu_check((inst2 = dlite_instance_load(r, uuid)));
+  mu_assert_int_eq(0, dlite_storage_close(r));
+  dlite_instance_decref(inst2);
+  dlite_instance_decref(inst);
+  dlite_instance_decref(meta);
+}
+
+
 MU_TEST(test_close)
 {
   mu_assert_int_eq(0, dlite_storage_close(s));
@@ -103,8 +292,12 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_idflag);
   MU_RUN_TEST(test_uuids);
   MU_RUN_TEST(test_get_driver);
+  MU_RUN_TEST(test_get_capabilities);
   MU_RUN_TEST(test_plugin_iter);
   MU_RUN_TEST(test_load_all);
+  MU_RUN_TEST(test_cache);
+  MU_RUN_TEST(test_compress);
+  MU_RUN_TEST(test_write_behind);
 
   MU_RUN_TEST(test_close);  /* teardown */
   MU_RUN_TEST(unload_plugins);
@@ -6,8 +6,15 @@
 #include "minunit/minunit.h"
 #include "dlite.h"
 #include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
 
 #include "config.h"
+#include "utils/config.h"
+
+#ifdef HAVE_SHM_OPEN
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
 
 
 MU_TEST(test_storage_lookup)
@@ -31,11 +38,245 @@ MU_TEST(test_storage_lookup)
 
 
 
+MU_TEST(test_storage_index)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst, *inst2;
+  FILE *fp;
+  char line[64];
+  char *path = STRINGIFY(dlite_SOURCE_DIR) "/src/tests/test-data.json";
+  char *uuid = "204b05b2-4c89-43f4-93db-fd1cb70f54ef";
+  char *uuid2 = "e076a856-e36e-5335-967e-2f2fd153c17d";
+  size_t n;
+
+  /* the index was built by the lookup in test_storage_lookup */
+  mu_check((n = dlite_storage_index_count()) > 0);
+  mu_assert_int_eq(0, dlite_storage_index_excludes(path, uuid));
+  mu_check(dlite_storage_index_excludes(path, "non-existing-id"));
+  mu_check((s = dlite_storage_index_open(uuid)));
+  mu_assert_string_eq(path, s->location);
+  mu_assert_int_eq(0, dlite_storage_cache_release(s));
+  mu_check(!dlite_storage_index_open("non-existing-id"));
+
+  /* new storages in the storage paths are indexed */
+  remove("storage_index.json");
+  dlite_storage_paths_append("storage_index.json");
+  mu_check((inst = dlite_instance_get(uuid)));
+  mu_check((inst2 = dlite_instance_get(uuid2)));
+  mu_check((s = dlite_storage_open("json", "storage_index.json", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_assert_int_eq(0, dlite_storage_index_update());
+  mu_assert_int_eq(n+1, dlite_storage_index_count());
+  mu_assert_int_eq(0, dlite_storage_index_excludes("storage_index.json",
+                                                   uuid));
+
+  /* modified storages are reindexed */
+  mu_check((s = dlite_storage_open("json", "storage_index.json", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst2));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_assert_int_eq(0, dlite_storage_index_excludes("storage_index.json",
+                                                   uuid));
+  mu_assert_int_eq(0, dlite_storage_index_update());
+  mu_check(dlite_storage_index_excludes("storage_index.json", uuid));
+  mu_assert_int_eq(0, dlite_storage_index_excludes("storage_index.json",
+                                                   uuid2));
+
+  /* save the index */
+  mu_assert_int_eq(0, dlite_storage_index_save("storage_index.txt"));
+  mu_check((fp = fopen("storage_index.txt", "r")));
+  mu_check(fgets(line, sizeof(line), fp));
+  mu_assert_string_eq("# dlite storage index 1\n", line);
+  fclose(fp);
+
+  dlite_storage_index_clear();
+  mu_assert_int_eq(0, dlite_storage_index_count());
+
+  dlite_instance_decref(inst2);
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_parallel_index)
+{
+#if defined(HAVE_SETENV) && defined(HAVE_UNSETENV)
+  DLiteInstance *inst;
+  char *path = STRINGIFY(dlite_SOURCE_DIR) "/src/tests/test-data.json";
+  char *uuid = "204b05b2-4c89-43f4-93db-fd1cb70f54ef";
+  size_t n;
+
+  /* the index built with several threads equals the sequential one */
+  dlite_storage_index_clear();
+  mu_assert_int_eq(0, dlite_storage_index_update());
+  mu_check((n = dlite_storage_index_count()) > 0);
+
+  setenv("DLITE_INDEX_THREADS", "4", 1);
+  dlite_storage_index_clear();
+  mu_assert_int_eq(0, dlite_storage_index_update());
+  mu_assert_int_eq(n, dlite_storage_index_count());
+  mu_assert_int_eq(0, dlite_storage_index_excludes(path, uuid));
+
+  dlite_storage_index_clear();
+  mu_check((inst = dlite_instance_get(uuid)));
+  dlite_instance_decref(inst);
+  unsetenv("DLITE_INDEX_THREADS");
+#endif
+}
+
+MU_TEST(test_missing)
+{
+  DLiteInstance *inst;
+  DLiteStorage *s;
+  char *id = "http://onto-ns.com/meta/0.1/NonExisting";
+  unsigned mark;
+
+  mu_assert_int_eq(0, dlite_storage_paths_is_missing(id, &mark));
+  mu_check(!dlite_instance_get(id));
+  mu_assert_int_eq(1, dlite_storage_paths_is_missing(id, NULL));
+  mu_check(!dlite_instance_get(id));
+
+  /* changing the storage paths clears the cache of missing ids */
+  mu_check(dlite_storage_paths_append("storage_missing.json") >= 0);
+  mu_assert_int_eq(0, dlite_storage_paths_is_missing(id, NULL));
+  mu_check(!dlite_instance_get(id));
+  mu_assert_int_eq(1, dlite_storage_paths_is_missing(id, NULL));
+
+  /* ...and so does saving */
+  mu_check((inst = dlite_instance_get("204b05b2-4c89-43f4-93db-fd1cb70f54ef")));
+  mu_check((s = dlite_storage_open("json", "storage_missing.json", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_paths_is_missing(id, &mark));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* a search that started before the cache was cleared is not recorded */
+  dlite_storage_paths_clear_missing();
+  dlite_storage_paths_add_missing(id, mark);
+  mu_assert_int_eq(0, dlite_storage_paths_is_missing(id, NULL));
+
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_metacache)
+{
+#if defined(HAVE_SETENV) && defined(HAVE_UNSETENV)
+  DLiteMeta *entity;
+  DLiteInstance *inst;
+  DLiteStorage *s;
+  char uuid[DLITE_UUID_LENGTH+1];
+  char *uri = "http://onto-ns.com/meta/0.1/MetaCacheEntity";
+  char *missing = "http://onto-ns.com/meta/0.1/MetaCacheMissing";
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    {"values", dliteFloat, sizeof(double), 1, dims, "m", NULL, "Values."}
+  };
+
+  mu_check((entity = dlite_meta_create(uri, NULL, "Entity.", 1, dimensions,
+                                       1, properties)));
+  strcpy(uuid, entity->uuid);
+  mu_check((s = dlite_storage_open("json", "storage_metacache.json",
+                                   "mode=w")));
+  mu_assert_int_eq(0, dlite_meta_save(s, entity));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_check(dlite_storage_paths_append("storage_metacache.json") >= 0);
+
+  /* the cache is built on first lookup */
+  remove("storage_metacache.bin");
+  setenv("DLITE_META_CACHE", "storage_metacache.bin", 1);
+  dlite_metacache_clear();
+  mu_check(!dlite_instance_get(missing));
+  mu_check(dlite_metacache_count() > 0);
+
+  /* cached metadata is found without the storage */
+  mu_assert_int_eq(2, entity->_refcount);  /* refs: global+store */
+  dlite_meta_decref(entity);
+  dlite_meta_decref(entity);
+  mu_check(!dlite_instance_has(uuid, 0));
+  remove("storage_metacache.json");
+  mu_check((inst = dlite_instance_get(uri)));
+  mu_assert_string_eq(uuid, inst->uuid);
+  mu_check(dlite_instance_is_meta(inst));
+  mu_assert_int_eq(1, (int)((DLiteMeta *)inst)->_nproperties);
+  dlite_instance_decref(inst);
+
+  /* an outdated cache is rebuilt */
+  dlite_metacache_clear();
+  mu_check(!dlite_instance_get(missing));
+  mu_check(dlite_metacache_count() > 0);
+  mu_check(!dlite_metacache_load(uri));
+
+  unsetenv("DLITE_META_CACHE");
+  dlite_metacache_clear();
+#endif
+}
+
+MU_TEST(test_metacache_shm)
+{
+#if defined(HAVE_SETENV) && defined(HAVE_UNSETENV) && defined(HAVE_SHM_OPEN)
+  DLiteMeta *entity;
+  DLiteInstance *inst;
+  DLiteStorage *s;
+  char uuid[DLITE_UUID_LENGTH+1], cache[64];
+  char *uri = "http://onto-ns.com/meta/0.1/MetaCacheShmEntity";
+  char *missing = "http://onto-ns.com/meta/0.1/MetaCacheMissing";
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  char *dims[] = {"N"};
+  DLiteProperty properties[] = {
+    {"values", dliteFloat, sizeof(double), 1, dims, "m", NULL, "Values."}
+  };
+
+  mu_check((entity = dlite_meta_create(uri, NULL, "Entity.", 1, dimensions,
+                                       1, properties)));
+  strcpy(uuid, entity->uuid);
+  mu_check((s = dlite_storage_open("json", "storage_metacache_shm.json",
+                                   "mode=w")));
+  mu_assert_int_eq(0, dlite_meta_save(s, entity));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_check(dlite_storage_paths_append("storage_metacache_shm.json") >= 0);
+  dlite_meta_decref(entity);
+  dlite_meta_decref(entity);
+  mu_check(!dlite_instance_has(uuid, 0));
+
+  /* the segment is published explicitly, like `dlite-index -m` */
+  snprintf(cache, sizeof(cache), "shm:/dlite-test-metacache-%d",
+           (int)getpid());
+  mu_assert_int_eq(0, dlite_metacache_update(cache));
+  setenv("DLITE_META_CACHE", cache, 1);
+  dlite_metacache_clear();
+
+  /* release the metadata loaded while publishing */
+  mu_check((inst = dlite_instance_has(uuid, 0)));
+  dlite_instance_decref(inst);
+  mu_check(!dlite_instance_has(uuid, 0));
+
+  /* metadata from the segment are frozen and immortal */
+  mu_check(!dlite_instance_get(missing));
+  mu_check(dlite_metacache_count() > 0);
+  mu_check((inst = dlite_instance_get(uri)));
+  mu_assert_string_eq(uuid, inst->uuid);
+  mu_check(dlite_instance_is_frozen(inst));
+  mu_assert_int_eq(1, (int)((DLiteMeta *)inst)->_nproperties);
+  dlite_instance_decref(inst);
+  dlite_instance_decref(inst);
+  mu_check(dlite_instance_has(uuid, 0) == inst);
+
+  unsetenv("DLITE_META_CACHE");
+  dlite_metacache_clear();
+  shm_unlink(cache + 4);
+  remove("storage_metacache_shm.json");
+#endif
+}
+
+
 /***********************************************************************/
 
 MU_TEST_SUITE(test_suite)
 {
   MU_RUN_TEST(test_storage_lookup);
+  MU_RUN_TEST(test_storage_index);
+  MU_RUN_TEST(test_parallel_index);
+  MU_RUN_TEST(test_missing);
+  MU_RUN_TEST(test_metacache);
+  MU_RUN_TEST(test_metacache_shm);
 }
 
 
@@ -4,6 +4,8 @@
 #include <string.h>
 
 #include "minunit/minunit.h"
+#include "utils/err.h"
+#include "utils/thread.h"
 #include "dlite.h"
 #include "dlite-macros.h"
 #include "dlite-store.h"
@@ -127,6 +129,123 @@ MU_TEST(test_save_and_load)
 }
 
 
+MU_TEST(test_store_load)
+{
+  DLiteStorage *s;
+  DLiteStore *store2;
+  DLiteInstance *insts[3];
+  char uuids[3][DLITE_UUID_LENGTH+1];
+  char *path = "test_store2.json";
+  size_t dims[] = {0, 0};
+  int i;
+
+  mu_check((store2 = dlite_store_create()));
+  for (i=0; i<3; i++) {
+    mu_check((insts[i] = dlite_instance_create(entity, dims, NULL)));
+    strcpy(uuids[i], insts[i]->uuid);
+  }
+  mu_assert_int_eq(0, dlite_store_add_many(store2, insts, 3));
+  for (i=0; i<3; i++) dlite_instance_decref(insts[i]);
+  mu_check((s = dlite_storage_open("json", path, "mode=w")));
+  mu_assert_int_eq(0, dlite_store_save(s, store2));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  dlite_store_free(store2);
+
+  mu_check((s = dlite_storage_open("json", path, "mode=r")));
+  mu_check((store2 = dlite_store_load(s)));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_assert_int_eq(3, count_uuids(store2));
+  for (i=0; i<3; i++) {
+    DLiteInstance *inst2 = dlite_store_get(store2, uuids[i]);
+    mu_check(inst2);
+    mu_assert_int_eq(1, inst2->_refcount);  /* store2 */
+  }
+  dlite_store_free(store2);
+}
+
+
+MU_TEST(test_many)
+{
+  DLiteInstance *insts[] = {inst, (DLiteInstance *)entity, inst};
+  const char *ids[] = {inst->uuid, entity->uuid, inst->uuid};
+  const char *invalid[] = {inst->uuid, "not-in-store"};
+  DLiteInstance **popped;
+  int i;
+
+  mu_assert_int_eq(0, dlite_store_add_many(store, insts, 3));
+  mu_assert_int_eq(2, count_uuids(store));
+  mu_assert_int_eq(4, inst->_refcount);    /* global+3*store */
+  mu_assert_int_eq(4, entity->_refcount);  /* global+inst_store+inst+store */
+
+  /* all or nothing */
+  err_set_stream(NULL);
+  mu_check(!dlite_store_pop_many(store, invalid, 2));
+  err_set_stream(stderr);
+  err_clear();
+  mu_assert_int_eq(2, count_uuids(store));
+  mu_check(dlite_store_get(store, inst->uuid));
+
+  mu_check((popped = dlite_store_pop_many(store, ids, 3)));
+  for (i=0; i<3; i++) mu_check(popped[i] == insts[i]);
+  mu_assert_int_eq(1, count_uuids(store));
+  for (i=0; i<3; i++) dlite_instance_decref(popped[i]);
+  free(popped);
+  mu_assert_int_eq(2, inst->_refcount);    /* global+store */
+  mu_assert_int_eq(3, entity->_refcount);  /* global+inst_store+inst */
+}
+
+
+MU_TEST(test_get_ref)
+{
+  DLiteInstance *ref;
+  mu_assert_int_eq(2, inst->_refcount);    /* global+store */
+  mu_check((ref = dlite_store_get_ref(store, inst->uuid)));
+  mu_check(ref == inst);
+  mu_assert_int_eq(3, inst->_refcount);    /* global+store+ref */
+
+  /* the reference outlives removal from the store */
+  mu_assert_int_eq(0, dlite_store_remove(store, inst->uuid));
+  mu_assert_int_eq(2, ref->_refcount);     /* global+ref */
+  mu_assert_int_eq(0, dlite_store_add(store, ref));
+  dlite_instance_decref(ref);
+  mu_assert_int_eq(2, inst->_refcount);    /* global+store */
+
+  err_set_stream(NULL);
+  mu_check(!dlite_store_get_ref(store, "not-in-store"));
+  err_set_stream(stderr);
+  err_clear();
+}
+
+
+/* Thread function adding and removing `inst` to/from `store`. */
+static void *worker(void *arg)
+{
+  int i, *fail = arg;
+  DLiteInstance *ref;
+  for (i=0; i<1000; i++) {
+    if (dlite_store_add(store, inst)) *fail = 1;
+    if (!(ref = dlite_store_get_ref(store, inst->uuid))) *fail = 1;
+    if (dlite_store_remove(store, inst->uuid)) *fail = 1;
+    if (ref) dlite_instance_decref(ref);
+  }
+  return NULL;
+}
+
+MU_TEST(test_threads)
+{
+  Thread threads[4];
+  int i, fail[4] = {0, 0, 0, 0};
+  for (i=0; i<4; i++)
+    if (thread_create(threads + i, worker, fail + i)) break;
+  while (i--) {
+    mu_assert_int_eq(0, thread_join(threads[i], NULL));
+    mu_assert_int_eq(0, fail[i]);
+  }
+  mu_assert_int_eq(1, count_uuids(store));
+  mu_assert_int_eq(2, inst->_refcount);    /* global+store */
+}
+
+
 MU_TEST(test_store_free)
 {
   mu_assert_int_eq(2, inst->_refcount);    /* global + store */
@@ -165,6 +284,10 @@ MU_TEST_SUITE(test_suite)
 
   MU_RUN_TEST(test_store);
   MU_RUN_TEST(test_save_and_load);
+  MU_RUN_TEST(test_store_load);
+  MU_RUN_TEST(test_many);
+  MU_RUN_TEST(test_get_ref);
+  MU_RUN_TEST(test_threads);
 
   MU_RUN_TEST(test_store_free);
   MU_RUN_TEST(test_instance_free);   /* tear down */
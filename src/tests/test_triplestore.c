@@ -1,8 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 
+#include "utils/err.h"
 #include "utils/session.h"
+#include "utils/thread.h"
 #include "minunit/minunit.h"
 #include "triplestore.h"
 
@@ -27,6 +30,30 @@ MU_TEST(test_triple)
   free(id);
 }
 
+MU_TEST(test_triple_fast_id)
+{
+  char *id1, *id2, *id3;
+  mu_assert_int_eq(tripleIdSha1, triple_get_id_mode());
+  triple_set_id_mode(tripleIdFast);
+  id1 = triple_get_id(NULL, "book", "is-a", "thing");
+  id2 = triple_get_id(NULL, "book", "is-a", "thing");
+  id3 = triple_get_id(NULL, "boo", "kis-a", "thing");
+  mu_assert_int_eq(32, strlen(id1));
+  mu_assert_string_eq(id1, id2);
+  mu_check(strcmp(id1, id3));
+  free(id1);
+  free(id2);
+  free(id3);
+  id1 = triple_get_id("ns:", "a", "b", "c");
+  mu_assert_int_eq(35, strlen(id1));
+  mu_check(strncmp(id1, "ns:", 3) == 0);
+  free(id1);
+  triple_set_id_mode(tripleIdSha1);
+  id1 = triple_get_id(NULL, "book", "is-a", "thing");
+  mu_assert_string_eq("e86ddacd5fd2f3f8f46543fc8096eab96a12c440", id1);
+  free(id1);
+}
+
 MU_TEST(test_add)
 {
   Triple t[] = {
@@ -94,13 +121,394 @@ MU_TEST(test_find)
 
 MU_TEST(test_remove)
 {
+  size_t version = triplestore_get_version(ts);
+  mu_check(version > 0);
   mu_check(6 == triplestore_length(ts));
 
   mu_check(!triplestore_remove(ts, NULL, "is-something", NULL));
   mu_check(6 == triplestore_length(ts));
+  mu_check(version == triplestore_get_version(ts));
 
   mu_assert_int_eq(2, triplestore_remove(ts, "book", NULL, NULL));
   mu_check(4 == triplestore_length(ts));
+  mu_check(version != triplestore_get_version(ts));
+}
+
+
+MU_TEST(test_churn)
+{
+  TripleStore *ts2;
+  TripleState state;
+  const Triple *t;
+  char s[32];
+  int i, n;
+
+  mu_check((ts2 = triplestore_create()));
+  for (i=0; i<2000; i++) {
+    snprintf(s, sizeof(s), "item%d", i);
+    mu_assert_int_eq(0, triplestore_add(ts2, s, "in", "group"));
+  }
+
+  /* triples removed while iterating are skipped, but the iterator
+     still returns valid pointers to the remaining triples */
+  triplestore_init_state(ts2, &state);
+  for (i=0; i<2000; i+=2) {
+    snprintf(s, sizeof(s), "item%d", i);
+    mu_assert_int_eq(1, triplestore_remove(ts2, s, NULL, NULL));
+  }
+  mu_assert_int_eq(1000, triplestore_length(ts2));
+  n = 0;
+  while ((t = triplestore_find(&state, NULL, "in", "group"))) {
+    mu_check(atoi(t->s + 4) % 2 == 1);
+    n++;
+  }
+  mu_assert_int_eq(1000, n);
+
+  /* free slots are not reused while iterating */
+  mu_assert_int_eq(0, triplestore_add(ts2, "new", "in", "group"));
+  triplestore_reset_state(&state);
+  n = 0;
+  while ((t = triplestore_next(&state))) n++;
+  mu_assert_int_eq(1001, n);
+  triplestore_deinit_state(&state);
+
+  /* compacted when the last iterator ends */
+  mu_assert_int_eq(1001, triplestore_length(ts2));
+  triplestore_init_state(ts2, &state);
+  n = 0;
+  while ((t = triplestore_find(&state, NULL, NULL, "group"))) n++;
+  mu_assert_int_eq(1001, n);
+  triplestore_deinit_state(&state);
+
+  /* alternating removals and additions reuse free slots */
+  for (i=0; i<5000; i++) {
+    snprintf(s, sizeof(s), "item%d", 2*(i % 500) + 1);
+    mu_assert_int_eq(1, triplestore_remove(ts2, s, NULL, NULL));
+    mu_assert_int_eq(0, triplestore_add(ts2, s, "in", "group"));
+  }
+  mu_assert_int_eq(1001, triplestore_length(ts2));
+  mu_check(triplestore_find_first(ts2, "item999", "in", "group"));
+  mu_check(triplestore_find_first(ts2, "new", NULL, NULL));
+  mu_check(!triplestore_find_first(ts2, "item998", NULL, NULL));
+  triplestore_free(ts2);
+}
+
+
+MU_TEST(test_index)
+{
+  TripleStore *ts2;
+  TripleState state;
+  const Triple *t;
+  char s[32], o[32];
+  int i, n;
+
+  mu_check((ts2 = triplestore_create()));
+  for (i=0; i<1000; i++) {
+    snprintf(s, sizeof(s), "item%d", i);
+    snprintf(o, sizeof(o), "group%d", i % 10);
+    mu_assert_int_eq(0, triplestore_add(ts2, s, "in", o));
+    mu_assert_int_eq(0, triplestore_add(ts2, s, "has-number", s + 4));
+  }
+  mu_check(2000 == triplestore_length(ts2));
+
+  t = triplestore_find_first(ts2, "item42", "has-number", NULL);
+  mu_check(t);
+  mu_assert_string_eq("42", t->o);
+  mu_check(!triplestore_find_first(ts2, "item42", "has-name", NULL));
+  mu_check(!triplestore_find_first(ts2, "item42", "in", "group3"));
+
+  /* terms are interned */
+  mu_check(triplestore_find_first(ts2, "item42", "in", NULL)->s == t->s);
+  mu_check(triplestore_find_first(ts2, "item7", "in", NULL)->p ==
+           triplestore_find_first(ts2, "item8", "in", NULL)->p);
+
+  triplestore_init_state(ts2, &state);
+  n = 0;
+  while ((t = triplestore_find(&state, NULL, "in", "group3"))) {
+    mu_assert_string_eq("group3", t->o);
+    n++;
+  }
+  mu_assert_int_eq(100, n);
+  triplestore_deinit_state(&state);
+
+  /* remove while iterating */
+  triplestore_init_state(ts2, &state);
+  n = 0;
+  while ((t = triplestore_find(&state, NULL, "in", "group3"))) {
+    mu_assert_int_eq(0, triplestore_remove_by_id(ts2, t->id));
+    n++;
+  }
+  mu_assert_int_eq(100, n);
+  triplestore_deinit_state(&state);
+  mu_check(1900 == triplestore_length(ts2));
+  mu_check(!triplestore_find_first(ts2, NULL, "in", "group3"));
+
+  /* indices are kept consistent when removed triples are replaced */
+  mu_assert_int_eq(100, triplestore_remove(ts2, NULL, "in", "group5"));
+  mu_check(1800 == triplestore_length(ts2));
+  for (i=0; i<1000; i++) {
+    char *id;
+    snprintf(s, sizeof(s), "item%d", i);
+    mu_check((t = triplestore_find_first(ts2, s, "has-number", NULL)));
+    mu_assert_string_eq(s + 4, t->o);
+    mu_check((id = triple_get_id(NULL, s, "has-number", s + 4)));
+    mu_check(triplestore_get(ts2, id) == t);
+    free(id);
+  }
+  triplestore_init_state(ts2, &state);
+  n = 0;
+  while (triplestore_find(&state, NULL, "in", NULL)) n++;
+  mu_assert_int_eq(800, n);
+  triplestore_deinit_state(&state);
+
+  triplestore_free(ts2);
+}
+
+
+#ifndef HAVE_REDLAND
+MU_TEST(test_save_load)
+{
+  TripleStore *ts2, *ts3;
+  TripleState state;
+  const Triple *t, *t2;
+  FILE *fp;
+  char s[32], o[32];
+  int i, n;
+
+  mu_check((ts2 = triplestore_create()));
+  for (i=0; i<100; i++) {
+    snprintf(s, sizeof(s), "item%d", i);
+    snprintf(o, sizeof(o), "group%d", i % 10);
+    mu_assert_int_eq(0, triplestore_add(ts2, s, "in", o));
+    mu_assert_int_eq(0, triplestore_add(ts2, s, "has-number", s + 4));
+  }
+
+  /* triples pending removal are not saved */
+  triplestore_init_state(ts2, &state);
+  mu_check((t = triplestore_find(&state, NULL, "in", "group3")));
+  mu_assert_int_eq(10, triplestore_remove(ts2, NULL, "in", "group3"));
+  mu_assert_int_eq(0, triplestore_save(ts2, "triplestore.bin"));
+  triplestore_deinit_state(&state);
+  mu_check(190 == triplestore_length(ts2));
+
+  mu_check((ts3 = triplestore_create()));
+  mu_assert_int_eq(0, triplestore_load(ts3, "triplestore.bin"));
+  mu_check(190 == triplestore_length(ts3));
+  triplestore_init_state(ts2, &state);
+  while ((t = triplestore_next(&state))) {
+    mu_check((t2 = triplestore_get(ts3, t->id)));
+    mu_assert_string_eq(t->s, t2->s);
+    mu_assert_string_eq(t->p, t2->p);
+    mu_assert_string_eq(t->o, t2->o);
+  }
+  triplestore_deinit_state(&state);
+
+  /* the indices and the string pool are restored */
+  mu_check(!triplestore_find_first(ts3, NULL, "in", "group3"));
+  mu_check(triplestore_find_first(ts3, "item7", "in", NULL)->p ==
+           triplestore_find_first(ts3, "item8", "in", NULL)->p);
+  triplestore_init_state(ts3, &state);
+  n = 0;
+  while ((t = triplestore_find(&state, NULL, "in", "group4"))) n++;
+  triplestore_deinit_state(&state);
+  mu_assert_int_eq(10, n);
+  mu_assert_int_eq(10, triplestore_remove(ts3, NULL, "in", "group4"));
+  mu_check(180 == triplestore_length(ts3));
+
+  /* loading into a non-empty store adds the missing triples */
+  mu_assert_int_eq(0, triplestore_load(ts3, "triplestore.bin"));
+  mu_check(190 == triplestore_length(ts3));
+  mu_check(triplestore_find_first(ts3, "item4", "in", "group4"));
+
+  mu_check((fp = fopen("triplestore.txt", "w")));
+  fprintf(fp, "not a triplestore\n");
+  fclose(fp);
+  mu_check(triplestore_load(ts3, "triplestore.txt"));
+  mu_check(triplestore_load(ts3, "nonexisting.bin"));
+  mu_check(190 == triplestore_length(ts3));
+
+  triplestore_free(ts3);
+  triplestore_free(ts2);
+}
+#endif
+
+
+MU_TEST(test_parse_turtle)
+{
+  TripleStore *ts2;
+  const Triple *t;
+  const char *src =
+    "@prefix ex: <http://example.com/> .\n"
+    "@base <http://example.com/base/doc> .\n"
+    "PREFIX : <http://example.com/default#>\n"
+    "# a comment\n"
+    "ex:book a ex:Thing ;\n"
+    "  ex:title \"A \\\"book\\\"\"@en , 'Une livre'@fr ;\n"
+    "  ex:pages 123 ; ex:weight -1.5e2 ; ex:new true ;\n"
+    "  ex:note \"\"\"two\nlines\"\"\"^^ex:text ;\n"
+    "  ex:author [ ex:name \"Ann\" ; ex:knows _:bob ] ;\n"
+    "  ex:tags ( :a :b ) ;\n"
+    "  ex:rel <other> ; ex:abs </root> ; ex:frag <#x> .\n"
+    "_:bob ex:name \"Bob\\u00e9\".\n"
+    "<http://example.com/table> ex:under ex:book.\n";
+
+  mu_check((ts2 = triplestore_create()));
+  mu_assert_int_eq(0, triplestore_parse_string(ts2, src, NULL));
+  mu_assert_int_eq(20, triplestore_length(ts2));
+  mu_check(triplestore_find_first(ts2, "http://example.com/book",
+                                  RDF "type", "http://example.com/Thing"));
+  mu_check(triplestore_find_first(ts2, "http://example.com/book",
+                                  "http://example.com/title",
+                                  "A \"book\""));
+  mu_check(triplestore_find_first(ts2, NULL, NULL, "Une livre"));
+  mu_check(triplestore_find_first(ts2, NULL, NULL, "123"));
+  mu_check(triplestore_find_first(ts2, NULL, NULL, "-1.5e2"));
+  mu_check(triplestore_find_first(ts2, NULL, NULL, "true"));
+  mu_check(triplestore_find_first(ts2, NULL, NULL, "two\nlines"));
+  mu_check(triplestore_find_first(ts2, "_:bob", "http://example.com/name",
+                                  "Bob\xc3\xa9"));
+  mu_check(triplestore_find_first(ts2, "http://example.com/table", NULL,
+                                  "http://example.com/book"));
+  mu_check(triplestore_find_first(ts2, NULL, NULL,
+                                  "http://example.com/base/other"));
+  mu_check(triplestore_find_first(ts2, NULL, NULL,
+                                  "http://example.com/root"));
+  mu_check(triplestore_find_first(ts2, NULL, NULL,
+                                  "http://example.com/base/doc#x"));
+
+  /* blank node property list */
+  mu_check((t = triplestore_find_first(ts2, NULL, "http://example.com/name",
+                                       "Ann")));
+  mu_check(strncmp(t->s, "_:genid", 7) == 0);
+  mu_check(triplestore_find_first(ts2, t->s, "http://example.com/knows",
+                                  "_:bob"));
+
+  /* collection */
+  mu_check(triplestore_find_first(ts2, NULL, RDF "first",
+                                  "http://example.com/default#a"));
+  mu_check(triplestore_find_first(ts2, NULL, RDF "rest", RDF "nil"));
+
+  /* errors */
+  err_set_stream(NULL);
+  mu_check(triplestore_parse_string(ts2, "ex:a ex:b ex:c .", NULL));
+  mu_check(triplestore_parse_string(ts2, "<a> <b> \"c .", NULL));
+  mu_check(triplestore_parse_string(ts2, "<a> <b> <c>", NULL));
+  mu_check(triplestore_parse_file(ts2, "nonexisting.ttl", NULL));
+  err_set_stream(stderr);
+  triplestore_free(ts2);
+}
+
+MU_TEST(test_parse_ntriples)
+{
+  TripleStore *ts2;
+  FILE *fp;
+  char s[64];
+  int i;
+
+  /* large enough to span several read buffers and batches */
+  mu_check((fp = fopen("triplestore.nt", "w")));
+  for (i=0; i<20000; i++)
+    fprintf(fp, "<http://example.com/item%d> <http://example.com/in> "
+            "<http://example.com/group%d> .\n"
+            "<http://example.com/item%d> <http://example.com/label> "
+            "\"Item %d\" .\n", i, i % 10, i, i);
+  fclose(fp);
+
+  mu_check((ts2 = triplestore_create()));
+  mu_assert_int_eq(0, triplestore_parse_file(ts2, "triplestore.nt", NULL));
+  mu_assert_int_eq(40000, triplestore_length(ts2));
+  snprintf(s, sizeof(s), "Item %d", 12345);
+  mu_check(triplestore_find_first(ts2, "http://example.com/item12345",
+                                  "http://example.com/label", s));
+  mu_check(triplestore_find_first(ts2, "http://example.com/item19999",
+                                  "http://example.com/in",
+                                  "http://example.com/group9"));
+  triplestore_free(ts2);
+}
+
+/* Store shared by the threads in test_concurrent() */
+TripleStore *cts;
+int nfailures=0;
+
+/* Reader iterating over and querying `cts` while it is modified. */
+static void *reader(void *arg)
+{
+  int i, n=0;
+  (void)arg;
+  for (i=0; i<50; i++) {
+    TripleState state;
+    const Triple *t;
+    size_t count=0;
+    triplestore_init_state(cts, &state);
+    while ((t = triplestore_next(&state)))
+      if (t->s && t->p && t->o) count++;
+    if (count < 1000) n++;
+    triplestore_reset_state(&state);
+    count = 0;
+    while ((t = triplestore_find(&state, NULL, "in", "group3"))) count++;
+    if (count < 100) n++;
+    triplestore_deinit_state(&state);
+    if (!triplestore_find_first(cts, "item42", "in", "group2")) n++;
+  }
+  thread_atomic_add(&nfailures, n);
+  return NULL;
+}
+
+/* Writer appending triples to `cts` and removing them again. */
+static void *writer(void *arg)
+{
+  char s[32], o[32];
+  int i, n=0;
+  (void)arg;
+  for (i=0; i<5000; i++) {
+    snprintf(s, sizeof(s), "new%d", i);
+    snprintf(o, sizeof(o), "group%d", i % 10);
+    if (triplestore_add(cts, s, "in", o)) n++;
+    if (i % 3 == 0 && triplestore_remove(cts, s, NULL, NULL) != 1) n++;
+  }
+  thread_atomic_add(&nfailures, n);
+  return NULL;
+}
+
+MU_TEST(test_concurrent)
+{
+  Thread threads[5];
+  TripleState state;
+  const Triple *t;
+  char s[32], o[32];
+  int i, count=0, nthreads=0;
+
+  mu_check((cts = triplestore_create()));
+  for (i=0; i<1000; i++) {
+    snprintf(s, sizeof(s), "item%d", i);
+    snprintf(o, sizeof(o), "group%d", i % 10);
+    mu_assert_int_eq(0, triplestore_add(cts, s, "in", o));
+  }
+
+  /* iterators only visit triples that existed when they were
+     initialised */
+  triplestore_init_state(cts, &state);
+  mu_check((t = triplestore_next(&state)));
+  mu_assert_string_eq("item0", t->s);
+
+  for (i=0; i<4; i++)
+    if (thread_create(threads + nthreads, reader, NULL) == 0) nthreads++;
+  if (thread_create(threads + nthreads, writer, NULL) == 0) nthreads++;
+  if (nthreads == 0) writer(NULL);
+  for (i=0; i<nthreads; i++) thread_join(threads[i], NULL);
+  mu_assert_int_eq(0, nfailures);
+
+  /* pointer still valid after appending many chunks of triples */
+  mu_assert_string_eq("item0", t->s);
+  count = 1;
+  while ((t = triplestore_next(&state))) count++;
+  mu_assert_int_eq(1000, count);
+  triplestore_deinit_state(&state);
+
+  mu_assert_int_eq(1000 + 5000 - 1667, triplestore_length(cts));
+  mu_check(triplestore_find_first(cts, "new4999", "in", "group9"));
+  mu_check(!triplestore_find_first(cts, "new4998", NULL, NULL));
+  triplestore_free(cts);
 }
 
 
@@ -120,10 +528,19 @@ MU_TEST_SUITE(test_suite)
 {
   MU_RUN_TEST(test_create);
   MU_RUN_TEST(test_triple);
+  MU_RUN_TEST(test_triple_fast_id);
   MU_RUN_TEST(test_add);
   MU_RUN_TEST(test_next);
   MU_RUN_TEST(test_find);
   MU_RUN_TEST(test_remove);
+  MU_RUN_TEST(test_index);
+  MU_RUN_TEST(test_parse_turtle);
+  MU_RUN_TEST(test_parse_ntriples);
+#ifndef HAVE_REDLAND
+  MU_RUN_TEST(test_save_load);
+  MU_RUN_TEST(test_churn);
+  MU_RUN_TEST(test_concurrent);
+#endif
   MU_RUN_TEST(test_free);
 }
 
@@ -8,8 +8,10 @@
 #include "minunit/minunit.h"
 #include "utils/integers.h"
 #include "utils/boolean.h"
+#include "utils/floats.h"
 #include "utils/err.h"
 #include "dlite.h"
+#include "dlite-macros.h"
 
 
 /***************************************************************
@@ -151,9 +153,15 @@ MU_TEST(test_print)
   double v=3.141592;
   char *p=NULL, s[]="my source string", *q=s;
 
-  mu_assert_int_eq(7, dlite_type_print(buf, sizeof(buf), &v, dliteFloat,
+  mu_assert_int_eq(8, dlite_type_print(buf, sizeof(buf), &v, dliteFloat,
                                        sizeof(double), 0, -2, 0));
-  mu_assert_string_eq("3.14159", buf);
+  mu_assert_string_eq("3.141592", buf);
+
+  v = 0.1 + 0.2;
+  mu_assert_int_eq(19, dlite_type_print(buf, sizeof(buf), &v, dliteFloat,
+                                        sizeof(double), 0, -2, 0));
+  mu_assert_string_eq("0.30000000000000004", buf);
+  v = 3.141592;
 
   mu_assert_int_eq(4, dlite_type_print(buf, sizeof(buf), &v, dliteFloat,
                                        sizeof(double), 0, 3, 0));
@@ -284,6 +292,15 @@ MU_TEST(test_scan)
   mu_assert_int_eq(7, n);
   mu_assert_double_eq(2.1e-2, float64);
 
+  n = dlite_type_scan("0.30000000000000004", -1, &float64, dliteFloat,
+                      sizeof(float64), 0);
+  mu_assert_int_eq(19, n);
+  mu_check(float64 == 0.1 + 0.2);
+
+  n = dlite_type_scan("x", -1, &float64, dliteFloat, sizeof(float64), 0);
+  mu_assert_int_eq(-1, n);
+  err_clear();
+
   /* fixstring */
   n = dlite_type_scan(" 3.14 ", -1, buf, dliteFixString, sizeof(buf),
                       dliteFlagQuoted);
@@ -455,6 +472,102 @@ MU_TEST(test_copy_cast)
 
 }
 
+MU_TEST(test_struct)
+{
+  typedef struct { float x; char label[8]; bool flag; uint16_t id; } Point;
+  typedef struct { Point a, b; int8_t n; } Segment;
+  DLiteStructField pfields[] = {
+    {"x",     dliteFloat,     4,            0},
+    {"label", dliteFixString, 8,            0},
+    {"flag",  dliteBool,      sizeof(bool), 0},
+    {"id",    dliteUInt,      2,            0}
+  };
+  DLiteStructField sfields[] = {
+    {"a", 0, sizeof(Point), 0},
+    {"b", 0, sizeof(Point), 0},
+    {"n", dliteInt, 1, 0}
+  };
+  DLiteStructField bad[] = {{"s", dliteStringPtr, sizeof(char *), 0}};
+  Point p = {1.5f, "ab", true, 7}, q;
+  Segment seg, seg2;
+  const DLiteStruct *st;
+  DLiteType ptype, stype, dtype;
+  size_t size;
+  char buf[256], typename[32];
+
+  mu_check((ptype = dlite_struct_register("Point", 4, pfields)) >= 0);
+  mu_check(dlite_type_is_struct(ptype));
+  mu_check(!dlite_type_is_struct(dliteFloat));
+  mu_assert_int_eq(ptype, dlite_struct_register("Point", 4, pfields));
+  mu_check((st = dlite_struct_get(ptype)));
+  mu_check(st == dlite_struct_get_by_name("Point"));
+  mu_assert_int_eq(sizeof(Point), st->size);
+  mu_assert_int_eq(offsetof(Point, label), st->fields[1].offset);
+  mu_assert_int_eq(offsetof(Point, flag), st->fields[2].offset);
+  mu_assert_int_eq(offsetof(Point, id), st->fields[3].offset);
+  mu_assert_string_eq("struct", dlite_type_get_dtypename(ptype));
+  mu_assert_string_eq("dliteStruct", dlite_type_get_enum_name(ptype));
+  mu_check(!dlite_type_is_allocated(ptype));
+
+  sfields[0].type = sfields[1].type = ptype;
+  mu_check((stype = dlite_struct_register("Segment", 3, sfields)) > ptype);
+  mu_assert_int_eq(sizeof(Segment), dlite_struct_get(stype)->size);
+  mu_assert_int_eq(offsetof(Segment, n), dlite_struct_get(stype)->fields[2].offset);
+  mu_assert_int_eq(alignof(Segment),
+                   dlite_type_get_alignment(stype, sizeof(Segment)));
+
+  /* type names */
+  mu_assert_int_eq(0, dlite_type_set_typename(stype, sizeof(Segment),
+                                              typename, sizeof(typename)));
+  mu_assert_string_eq("Segment", typename);
+  mu_assert_int_eq(0, dlite_type_set_dtype_and_size("Segment", &dtype, &size));
+  mu_assert_int_eq(stype, dtype);
+  mu_assert_int_eq(sizeof(Segment), size);
+  mu_check(dlite_is_type("Point"));
+
+  /* print, scan and copy */
+  mu_assert_int_eq(48, dlite_type_print(buf, sizeof(buf), &p, ptype,
+                                        sizeof(Point), 0, -2, 0));
+  mu_assert_string_eq("{\"x\": 1.5, \"label\": \"ab\", \"flag\": true, "
+                      "\"id\": 7}", buf);
+  memset(&q, 0, sizeof(q));
+  mu_assert_int_eq(48, dlite_type_scan(buf, -1, &q, ptype, sizeof(Point), 0));
+  mu_assert_double_eq(1.5, q.x);
+  mu_assert_string_eq("ab", q.label);
+  mu_check(q.flag);
+  mu_assert_int_eq(7, q.id);
+
+  memset(&seg, 0, sizeof(seg));
+  seg.a = p;
+  seg.b.x = -2.0f;
+  seg.n = -3;
+  mu_check(dlite_type_print(buf, sizeof(buf), &seg, stype, sizeof(Segment),
+                            0, -2, 0) > 0);
+  memset(&seg2, 0, sizeof(seg2));
+  mu_check(dlite_type_scan(buf, -1, &seg2, stype, sizeof(Segment), 0) > 0);
+  mu_assert_string_eq("ab", seg2.a.label);
+  mu_assert_double_eq(-2.0, seg2.b.x);
+  mu_assert_int_eq(-3, seg2.n);
+  memset(&seg2, 0, sizeof(seg2));
+  mu_check(dlite_type_copy(&seg2, &seg, stype, sizeof(Segment)));
+  mu_assert_int_eq(0, memcmp(&seg, &seg2, sizeof(Segment)));
+  mu_assert_int_eq(0, dlite_type_copy_cast(&seg2, stype, sizeof(Segment),
+                                           &seg, stype, sizeof(Segment)));
+
+  /* errors */
+  err_set_stream(NULL);
+  mu_assert_int_eq(-1, dlite_struct_register("Point", 3, pfields));
+  mu_assert_int_eq(-1, dlite_struct_register("int8", 4, pfields));
+  mu_assert_int_eq(-1, dlite_struct_register("blob3", 4, pfields));
+  mu_assert_int_eq(-1, dlite_struct_register("not valid", 4, pfields));
+  mu_assert_int_eq(-1, dlite_struct_register("Bad", 1, bad));
+  mu_check(!dlite_struct_get(dliteRelation));
+  mu_check(dlite_type_scan("{\"x\": 1}", -1, &q, ptype, sizeof(Point),
+                           0) < 0);
+  err_set_stream(stderr);
+  err_clear();
+}
+
 MU_TEST(test_type_ndcast)
 {
   int s[] = {0, 1, 2,
@@ -521,6 +634,116 @@ MU_TEST(test_type_ndcast)
   mu_assert_int_eq(11, d[11]);
 }
 
+MU_TEST(test_type_cast_kernels)
+{
+  DLiteType types[] = {dliteInt, dliteInt, dliteInt, dliteInt,
+                       dliteUInt, dliteUInt, dliteUInt, dliteUInt,
+                       dliteFloat, dliteFloat};
+  size_t sizes[] = {1, 2, 4, 8, 1, 2, 4, 8, 4, 8};
+  float64_t values[] = {0, 1, 2, 3, 42, 100, 127, 7, 9};
+  size_t n = countof(values), dims[] = {countof(values)};
+  char src[8*countof(values)], dest[8*countof(values)], expect[8];
+  int i, j, neg[] = {3, -1, 5};
+  uint32_t u[3];
+  size_t k;
+
+  for (i=0; i<10; i++) {
+    /* assign `src` from `values` */
+    for (k=0; k<n; k++)
+      mu_assert_int_eq(0, dlite_type_copy_cast(src + k*sizes[i], types[i],
+                                               sizes[i], values + k,
+                                               dliteFloat, 8));
+    for (j=0; j<10; j++) {
+      DLiteTypeCastKernel kernel =
+        dlite_type_get_cast_kernel(types[j], sizes[j], types[i], sizes[i]);
+      mu_check(kernel);
+      memset(dest, 0, sizeof(dest));
+      mu_assert_int_eq(0, kernel(dest, src, n));
+      for (k=0; k<n; k++) {
+        memset(expect, 0, sizeof(expect));
+        mu_assert_int_eq(0, dlite_type_copy_cast(expect, types[j], sizes[j],
+                                                 src + k*sizes[i], types[i],
+                                                 sizes[i]));
+        mu_check(memcmp(dest + k*sizes[j], expect, sizes[j]) == 0);
+      }
+    }
+  }
+  mu_check(!dlite_type_get_cast_kernel(dliteBool, 1, dliteInt, 4));
+  mu_check(!dlite_type_get_cast_kernel(dliteFloat, 8, dliteStringPtr,
+                                       sizeof(char *)));
+
+  /* contiguous arrays are casted with the kernels */
+  mu_assert_int_eq(0, dlite_type_ndcast(1, dest, dliteFloat, 8, dims, NULL,
+                                        src, dliteFloat, 8, dims, NULL,
+                                        NULL));
+  mu_assert_int_eq(0, dlite_type_ndcast(1, src, dliteInt, 2, dims, NULL,
+                                        dest, dliteFloat, 8, dims, NULL,
+                                        NULL));
+  for (k=0; k<n; k++)
+    mu_assert_int_eq((int)values[k], ((int16_t *)src)[k]);
+
+  /* negative values cannot be casted to unsigned */
+  dims[0] = 3;
+  err_set_stream(NULL);
+  mu_check(dlite_type_ndcast(1, u, dliteUInt, 4, dims, NULL,
+                             neg, dliteInt, sizeof(int), dims, NULL,
+                             NULL));
+  err_set_stream(stderr);
+  err_clear();
+}
+
+MU_TEST(test_type_parse_kernels)
+{
+  DLiteType types[] = {dliteInt, dliteInt, dliteInt, dliteInt,
+                       dliteUInt, dliteUInt, dliteUInt, dliteUInt,
+                       dliteFloat, dliteFloat};
+  size_t sizes[] = {1, 2, 4, 8, 1, 2, 4, 8, 4, 8};
+  char *strings[] = {"0", " 17", "+42", "0x1f", "-0", "3.5e2", "0.1",
+                     "1e-3", "  -2.75", "inf"};
+  size_t n = countof(strings), dims[] = {3};
+  char dest[8*countof(strings)], expect[8];
+  char *bad[] = {"1", "2x", "3"};
+  char *neg[] = {"1", "-2", "3"};
+  uint32_t u[3];
+  int i;
+  size_t k;
+
+  for (i=0; i<10; i++) {
+    DLiteTypeCastKernel kernel =
+      dlite_type_get_parse_kernel(types[i], sizes[i]);
+    size_t m = (types[i] == dliteFloat) ? n : 4;
+    mu_check(kernel);
+    memset(dest, 0, sizeof(dest));
+    mu_assert_int_eq(0, kernel(dest, strings, m));
+    for (k=0; k<m; k++) {
+      memset(expect, 0, sizeof(expect));
+      mu_assert_int_eq(0, dlite_type_copy_cast(expect, types[i], sizes[i],
+                                               strings + k, dliteStringPtr,
+                                               sizeof(char *)));
+      mu_check(memcmp(dest + k*sizes[i], expect, sizes[i]) == 0);
+    }
+    mu_check(kernel(dest, bad, 3));
+  }
+  mu_check(dlite_type_get_parse_kernel(dliteUInt, 4)(u, neg, 3));
+  mu_check(!dlite_type_get_parse_kernel(dliteBool, 1));
+
+  /* contiguous string arrays are parsed with the kernels */
+  mu_assert_int_eq(0, dlite_type_ndcast(1, u, dliteUInt, 4, dims, NULL,
+                                        strings, dliteStringPtr,
+                                        sizeof(char *), dims, NULL, NULL));
+  mu_assert_int_eq(0, u[0]);
+  mu_assert_int_eq(17, u[1]);
+  mu_assert_int_eq(42, u[2]);
+
+  /* fall back to element-wise casting for proper error messages */
+  err_set_stream(NULL);
+  mu_check(dlite_type_ndcast(1, u, dliteUInt, 4, dims, NULL,
+                             neg, dliteStringPtr, sizeof(char *), dims, NULL,
+                             NULL));
+  err_set_stream(stderr);
+  err_clear();
+}
+
 
 /***********************************************************************/
 
@@ -542,7 +765,10 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_padding_at);
   MU_RUN_TEST(test_get_member_offset);
   MU_RUN_TEST(test_copy_cast);
+  MU_RUN_TEST(test_struct);
   MU_RUN_TEST(test_type_ndcast);
+  MU_RUN_TEST(test_type_cast_kernels);
+  MU_RUN_TEST(test_type_parse_kernels);
 }
 
 
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "minunit/minunit.h"
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-units.h"
+
+
+MU_TEST(test_unit_parse)
+{
+  DLiteUnit u;
+  signed char newton[] = {1, 1, -2, 0, 0, 0, 0};
+  signed char none[DLITE_UNIT_NDIMS] = {0};
+
+  mu_assert_int_eq(0, dlite_unit_parse("kN", &u));
+  mu_assert_double_eq(1e3, u.scale);
+  mu_check(memcmp(u.dims, newton, sizeof(newton)) == 0);
+
+  mu_assert_int_eq(0, dlite_unit_parse("kg*m/s^2", &u));
+  mu_assert_double_eq(1.0, u.scale);
+  mu_check(memcmp(u.dims, newton, sizeof(newton)) == 0);
+
+  mu_assert_int_eq(0, dlite_unit_parse("g.cm s-2", &u));
+  mu_assert_double_eq(1e-5, u.scale);
+  mu_check(memcmp(u.dims, newton, sizeof(newton)) == 0);
+
+  mu_assert_int_eq(0, dlite_unit_parse("J/(kg*K)", &u));
+  mu_assert_int_eq(0, dlite_unit_parse("J/kg/K", &u));
+  mu_assert_int_eq(2, u.dims[0]);
+  mu_assert_int_eq(-2, u.dims[2]);
+  mu_assert_int_eq(-1, u.dims[4]);
+
+  mu_assert_int_eq(0, dlite_unit_parse("\xc2\xb5m\xc2\xb2", &u));  /* µm² */
+  mu_assert_double_eq(1e-12, u.scale);
+  mu_assert_int_eq(2, u.dims[0]);
+
+  mu_assert_int_eq(0, dlite_unit_parse("degC", &u));
+  mu_assert_double_eq(273.15, u.offset);
+  mu_assert_int_eq(0, dlite_unit_parse("degC/s", &u));
+  mu_assert_double_eq(0.0, u.offset);
+
+  mu_assert_int_eq(0, dlite_unit_parse("", &u));
+  mu_check(memcmp(u.dims, none, sizeof(none)) == 0);
+  mu_assert_int_eq(0, dlite_unit_parse("1/s", &u));
+  mu_assert_int_eq(-1, u.dims[2]);
+
+  err_set_stream(NULL);
+  mu_check(dlite_unit_parse("furlong", &u));
+  mu_check(dlite_unit_parse("m^", &u));
+  mu_check(dlite_unit_parse("(m", &u));
+  err_set_stream(stderr);
+  err_clear();
+}
+
+MU_TEST(test_unit_conversion)
+{
+  double scale, offset, v[5] = {0, 20, 37, 100, -40};
+  float f[3] = {1, 2, 3};
+
+  mu_assert_int_eq(1, dlite_unit_compatible("J", "eV"));
+  mu_assert_int_eq(0, dlite_unit_compatible("J", "W"));
+
+  mu_assert_int_eq(0, dlite_unit_conversion("km/h", "m/s", &scale, &offset));
+  mu_assert_double_eq(1.0/3.6, scale);
+  mu_assert_double_eq(0.0, offset);
+
+  mu_assert_int_eq(0, dlite_unit_convert(v, dliteFloat, sizeof(double), 5,
+                                         "degC", "K"));
+  mu_assert_double_eq(273.15, v[0]);
+  mu_assert_double_eq(373.15, v[3]);
+  mu_assert_int_eq(0, dlite_unit_convert(v, dliteFloat, sizeof(double), 5,
+                                         "K", "degF"));
+  mu_assert_double_eq(32.0, v[0]);
+  mu_assert_double_eq(212.0, v[3]);
+  mu_check(fabs(v[4] + 40.0) < 1e-9);
+
+  mu_assert_int_eq(0, dlite_unit_convert(f, dliteFloat, sizeof(float), 3,
+                                         "bar", "kPa"));
+  mu_assert_double_eq(300.0, f[2]);
+
+  err_set_stream(NULL);
+  mu_check(dlite_unit_conversion("m", "s", &scale, &offset));
+  err_set_stream(stderr);
+  err_clear();
+}
+
+MU_TEST(test_cast_property_to_unit)
+{
+  DLiteProperty properties[] = {
+    /* name      type        size            ndims dims unit  iri  descr */
+    {"length",   dliteFloat, sizeof(double), 0,    NULL, "mm", NULL, ""},
+    {"heights",  dliteInt,   sizeof(int),    1,    NULL, "cm", NULL, ""}
+  };
+  char *heights_dims[] = {"N"};
+  DLiteDimension dimensions[] = {{"N", "Number of heights."}};
+  DLiteMeta *meta;
+  DLiteInstance *inst;
+  double length=1500.0, heights[3];
+  int iheights[3] = {150, 175, 205};
+  size_t dims[] = {3};
+
+  properties[1].dims = heights_dims;
+  mu_check((meta = dlite_meta_create("http://onto-ns.com/meta/0.1/Unitful",
+                                     NULL, "Entity with units.", 1,
+                                     dimensions, 2, properties)));
+  mu_check((inst = dlite_instance_create(meta, dims, NULL)));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "length", &length));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "heights",
+                                                  iheights));
+
+  length = 0;
+  mu_assert_int_eq(0, dlite_instance_get_property_in_unit(
+                        inst, "length", dliteFloat, sizeof(double), &length,
+                        "m"));
+  mu_assert_double_eq(1.5, length);
+
+  mu_assert_int_eq(0, dlite_instance_cast_property_to_unit(
+                        inst, 1, dliteFloat, sizeof(double), NULL, NULL,
+                        heights, NULL, "m"));
+  mu_assert_double_eq(1.5, heights[0]);
+  mu_assert_double_eq(1.75, heights[1]);
+  mu_assert_double_eq(2.05, heights[2]);
+
+  err_set_stream(NULL);
+  mu_check(dlite_instance_get_property_in_unit(inst, "length", dliteFloat,
+                                               sizeof(double), &length,
+                                               "kg"));
+  err_set_stream(stderr);
+  err_clear();
+
+  dlite_instance_decref(inst);
+  dlite_meta_decref(meta);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_unit_parse);
+  MU_RUN_TEST(test_unit_conversion);
+  MU_RUN_TEST(test_cast_property_to_unit);
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -15,6 +15,7 @@
 /* Global variables for this modules */
 typedef struct {
   char *default_namespace;
+  TripleIdMode id_mode;
 } TripleGlobals;
 
 
@@ -26,11 +27,25 @@ static void free_globals(void *globals)
   free(g);
 }
 
-/* Sets default namespace to be prepended to triple id's. */
-void triple_set_default_namespace(const char *namespace)
+/* Returns a pointer to global variables for this module or NULL on
+   error. */
+static TripleGlobals *get_globals(void)
 {
   Session *s = session_get_default();
   TripleGlobals *g = session_get_state(s, TRIPLE_GLOBALS_ID);
+  if (!g) {
+    if (!(g = calloc(1, sizeof(TripleGlobals))))
+      return err(1, "allocation failure"), NULL;
+    session_add_state(s, TRIPLE_GLOBALS_ID, g, free_globals);
+  }
+  return g;
+}
+
+/* Sets default namespace to be prepended to triple id's. */
+void triple_set_default_namespace(const char *namespace)
+{
+  TripleGlobals *g = get_globals();
+  if (!g) return;
   if (g->default_namespace)
     free(g->default_namespace);
   if (namespace)
@@ -42,14 +57,89 @@ void triple_set_default_namespace(const char *namespace)
 /* Returns default namespace. */
 const char *triple_get_default_namespace(void)
 {
-  Session *s = session_get_default();
-  TripleGlobals *g = session_get_state(s, TRIPLE_GLOBALS_ID);
-  if (!g) {
-    if (!(g = calloc(1, sizeof(TripleGlobals))))
-      return err(1, "allocation failure"), NULL;
-    session_add_state(s, TRIPLE_GLOBALS_ID, g, free_globals);
+  TripleGlobals *g = get_globals();
+  return (g) ? (const char *)g->default_namespace : NULL;
+}
+
+/* Sets the algorithm used by triple_get_id() to generate new ids. */
+void triple_set_id_mode(TripleIdMode mode)
+{
+  TripleGlobals *g = get_globals();
+  if (g) g->id_mode = mode;
+}
+
+/* Returns the algorithm used for generating new triple ids. */
+TripleIdMode triple_get_id_mode(void)
+{
+  TripleGlobals *g = get_globals();
+  return (g) ? g->id_mode : tripleIdSha1;
+}
+
+
+/* Returns `x` rotated left by `r` bits. */
+static uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+/* Finalisation mix of MurmurHash3. */
+static uint64_t fmix64(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+/* Adds string `str` to the two-lane hash state `h`.  Words are read
+   in little endian order, such that the hash is portable. */
+static void hash_string(uint64_t h[2], const char *str)
+{
+  const unsigned char *q = (const unsigned char *)str;
+  size_t i, len = strlen(str);
+  uint64_t k;
+  int j;
+  for (i=0; i+8 <= len; i+=8, q+=8) {
+    for (k=0, j=7; j>=0; j--) k = (k << 8) | q[j];
+    h[0] = rotl64(h[0] ^ (k * 0x87c37b91114253d5ULL), 31) * 5 + 0x52dce729;
+    h[1] = rotl64(h[1] + (k * 0x4cf5ad432745937fULL), 33) * 5 + 0x38495ab5;
+  }
+  /* the tail is padded with the length, which also separates the
+     strings */
+  for (k=(uint64_t)len << 56, j=(int)(len - i) - 1; j>=0; j--)
+    k |= (uint64_t)q[j] << (8*j);
+  h[0] = rotl64(h[0] ^ (k * 0x87c37b91114253d5ULL), 31) * 5 + 0x52dce729;
+  h[1] = rotl64(h[1] + (k * 0x4cf5ad432745937fULL), 33) * 5 + 0x38495ab5;
+}
+
+/*
+  Computes a 128-bit non-cryptographic hash of `s`, `p` and `o` and
+  writes it to `hash`.
+*/
+void triple_hash(const char *s, const char *p, const char *o,
+                 uint64_t hash[2])
+{
+  uint64_t h[2] = {0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL};
+  hash_string(h, s);
+  hash_string(h, p);
+  hash_string(h, o);
+  h[0] += h[1];
+  h[1] += h[0];
+  hash[0] = fmix64(h[0]);
+  hash[1] = fmix64(h[1]);
+}
+
+/* Writes `n` bytes of `bytes` as hex digits to `buf`. */
+static void tohex(char *buf, const unsigned char *bytes, size_t n)
+{
+  static const char digits[] = "0123456789abcdef";
+  size_t i;
+  for (i=0; i<n; i++) {
+    *buf++ = digits[bytes[i] >> 4];
+    *buf++ = digits[bytes[i] & 0xf];
   }
-  return (const char *)g->default_namespace;
 }
 
 
@@ -101,23 +191,33 @@ int triple_reset(Triple *t, const char *s, const char *p, const char *o,
 char *triple_get_id(const char *namespace, const char *s, const char *p,
                       const char *o)
 {
-  SHA1_CTX context;
+  TripleGlobals *g;
   unsigned char digest[20];
   char *id;
-  int i, n=0;
-  size_t size=41;
+  size_t i, len=0, ndigest;
   if (!s || !p || !o) return NULL;
-  SHA1Init(&context);
-  SHA1Update(&context, (unsigned char *)s, strlen(s));
-  SHA1Update(&context, (unsigned char *)p, strlen(p));
-  SHA1Update(&context, (unsigned char *)o, strlen(o));
-  SHA1Final(digest, &context);
-  if (!namespace) namespace = triple_get_default_namespace();
-  if (namespace) size += strlen(namespace);
-  if (!(id = malloc(size))) return NULL;
-  if (namespace) n += snprintf(id+n, size-n, "%s", namespace);
-  for (i=0; i<20; i++)
-    n += snprintf(id+n, size-n, "%02x", digest[i]);
+  if (!(g = get_globals())) return NULL;
+  if (g->id_mode == tripleIdFast) {
+    uint64_t hash[2];
+    triple_hash(s, p, o, hash);
+    for (i=0; i<16; i++)
+      digest[i] = (unsigned char)(hash[i / 8] >> (56 - 8*(i % 8)));
+    ndigest = 16;
+  } else {
+    SHA1_CTX context;
+    SHA1Init(&context);
+    SHA1Update(&context, (unsigned char *)s, strlen(s));
+    SHA1Update(&context, (unsigned char *)p, strlen(p));
+    SHA1Update(&context, (unsigned char *)o, strlen(o));
+    SHA1Final(digest, &context);
+    ndigest = 20;
+  }
+  if (!namespace) namespace = g->default_namespace;
+  if (namespace) len = strlen(namespace);
+  if (!(id = malloc(len + 2*ndigest + 1))) return NULL;
+  if (namespace) memcpy(id, namespace, len);
+  tohex(id + len, digest, ndigest);
+  id[len + 2*ndigest] = '\0';
   return id;
 }
 
@@ -10,7 +10,7 @@
 #ifndef _TRIPLE_H
 #define _TRIPLE_H
 
-#include "triple.h"
+#include <stdint.h>
 
 
 /**
@@ -25,6 +25,17 @@ typedef struct _Triple {
 } Triple;
 
 
+/**
+  Algorithms for generating triple ids from the subject, predicate
+  and object.
+*/
+typedef enum _TripleIdMode {
+  tripleIdSha1,   /*!< 40 hex digits of the SHA1 hash (default) */
+  tripleIdFast    /*!< 32 hex digits of a fast 128-bit non-cryptographic
+                       hash */
+} TripleIdMode;
+
+
 /**
   Sets default namespace to be prepended to triple id's.
 
@@ -37,6 +48,31 @@ void triple_set_default_namespace(const char *namespace);
 */
 const char *triple_get_default_namespace(void);
 
+/**
+  Sets the algorithm used by triple_get_id() to generate new triple
+  ids.
+
+  The default, `tripleIdSha1`, gives ids that are stable across dlite
+  versions and should be used for data that is exported, e.g. to RDF.
+  `tripleIdFast` is much cheaper and useful for large collections,
+  where the ids only need to be unique.  Existing ids are not
+  affected.
+*/
+void triple_set_id_mode(TripleIdMode mode);
+
+/**
+  Returns the algorithm used for generating new triple ids.
+*/
+TripleIdMode triple_get_id_mode(void);
+
+/**
+  Computes a 128-bit non-cryptographic hash of `s`, `p` and `o` and
+  writes it to `hash`.  The hash is independent of the host byte
+  order.
+*/
+void triple_hash(const char *s, const char *p, const char *o,
+                 uint64_t hash[2]);
+
 /**
   Frees up memory used by the s-p-o strings, but not the triple itself.
 */
@@ -10,39 +10,98 @@
     [rasqal](http://librdf.org/rasqal/) and
     [libraptor2](http://librdf.org/raptor/libraptor2.html)).
 
-  - add locks to ensure that a triplestore is not reallocated or
-    sorted while one works with pointers to the stored triples.
-    Example:
+*/
+
+/*
+  Concurrency
+
+  All public functions are protected by a reader-writer lock, such that
+  any number of threads may query the store concurrently while
+  additions and removals are serialised.  The lock is only held during
+  a single call, so a thread may modify the store while iterating over
+  it.
+
+  Triples are stored in fixed-size chunks that are never reallocated,
+  so pointers to triples stay valid while triples are appended.  While
+  iterators are running, the ids of removed triples are kept in a list
+  of dead ids, which are freed when the last iterator ends.  Each
+  iterator only visits the triples that existed when it was
+  initialised, i.e. it iterates over a stable snapshot of the store.
 
-        TRIPLE_ACQUIRE_LOCK(triplestore)
-        triple = triplestore_find_first(triplestore, s, p, o)
-        TRIPLE_RELEASE_LOCK(triplestore)
+  Removal
+
+  Removed triples are marked in a tombstone bitmap and their slots are
+  pushed to a list of free slots.  They stay in the indices, such that
+  positions in the indices don't change while iterating.  When no
+  iterators are running, new triples are stored in the free slots.
+  The store is compacted, by moving the last triples into the free
+  slots, when the number of free slots exceeds TRIPLESTORE_COMPACT
+  times the number of triples.  Hence, removal is O(1) amortised and
+  compaction only visits the removed triples.  A triple removed while
+  there are no iterators and no other free slots is replaced by the
+  last triple right away.
 */
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "utils/err.h"
 #include "utils/sha1.h"
 #include "utils/map.h"
+#include "utils/thread.h"
 #include "triplestore.h"
 
 #define UNUSED(x) (void)(x)
 
+#define FAIL(msg) do {                          \
+    err(1, msg); goto fail; } while (0)
+#define FAIL1(msg, a1) do {                     \
+    err(1, msg, a1); goto fail; } while (0)
+#define FAIL2(msg, a1, a2) do {                 \
+    err(1, msg, a1, a2); goto fail; } while (0)
 
 
-/* Allocate triplestore memory in chunks of TRIPLESTORE_BUFFSIZE */
+
+/* Allocate triplestore memory in chunks of TRIPLESTORE_BUFFSIZE triples */
 #define TRIPLESTORE_BUFFSIZE 1024
 
+/* Compact the store when more than this fraction of the slots are free */
+#define TRIPLESTORE_COMPACT 0.25
+
+/* Magic number and version of files written by triplestore_save() */
+#define TRIPLESTORE_MAGIC "DLTRIPLE"
+#define TRIPLESTORE_FILE_VERSION 1
+
 
 /* Prototype for cleanup-function */
 typedef void (*Freer)(void *ptr);
 
+/* Indices in `triples` of the triples with a given subject, predicate
+   or object */
+typedef struct {
+  size_t *ids;        /*!< array of triple indices */
+  size_t n;           /*!< number of indices */
+  size_t size;        /*!< allocated size of `ids` */
+} TripleIds;
+
+typedef map_t(TripleIds) map_ids_t;
+
 /* Triple store. */
 struct _TripleStore {
-  Triple *triples;  /*!< array of triples */
+  Triple **chunks;    /*!< array of chunks of TRIPLESTORE_BUFFSIZE triples.
+                           Chunks are never reallocated. */
+  size_t nchunks;     /*!< number of allocated chunks */
   size_t length;      /*!< logically number of triples (excluding pending
                            removes */
   size_t true_length; /*!< number of triples (including pending removes) */
@@ -50,9 +109,25 @@ struct _TripleStore {
 
   map_int_t map;      /*!< a mapping from triple id to its corresponding
                            index in `triples` */
+  map_ids_t index[3]; /*!< mappings from subject, predicate and object to
+                           the indices of the triples they occur in */
+  size_t (*pos)[3];   /*!< position of each triple in the `ids` arrays
+                           of `index`, allocated alongside `triples` */
+  map_int_t strings;  /*!< pool of interned subjects, predicates and
+                           objects, mapped to their reference counts */
+  uint64_t *tombs;    /*!< bitmap of removed triples, one bit per slot */
+  size_t *freeslots;  /*!< indices of removed triples */
+  size_t nfree;       /*!< number of free slots */
+  size_t freesize;    /*!< allocated size of `freeslots` */
+  char **dead;        /*!< ids of triples removed while iterators are
+                           running, freed when the last iterator ends */
+  size_t ndead;       /*!< number of dead ids */
+  size_t deadsize;    /*!< allocated size of `dead` */
+  ThreadRWLock lock;  /*!< protects all the fields above */
   size_t niter;       /*!< counter for number of running iterators */
   int freed;          /*!< set to non-zero when this store is supposed to
                            be freed, but kept alive due to existing iterators */
+  size_t version;     /*!< increased on each modification, never zero */
 };
 
 
@@ -62,6 +137,12 @@ struct _TripleStore {
 TripleStore *triplestore_create()
 {
   TripleStore *ts = calloc(1, sizeof(TripleStore));
+  if (!ts) return err(1, "allocation failure"), NULL;
+  if (thread_rwlock_init(&ts->lock)) {
+    free(ts);
+    return err(1, "cannot initialise triplestore lock"), NULL;
+  }
+  ts->version = 1;
   return ts;
 }
 
@@ -80,17 +161,23 @@ TripleStore *triplestore_create_with_storage(const char *storage_name,
 }
 
 
+static void _clear(TripleStore *ts);
+
 /*
   Frees triplestore `ts`.
  */
 void triplestore_free(TripleStore *ts)
 {
-  assert(ts->freed == 0 || ts->niter == 0);
-  triplestore_clear(ts);
-  if (ts->niter > 0)
-    ts->freed = 1;
-  else
+  int keep;
+  thread_rwlock_wrlock(&ts->lock);
+  assert(ts->freed == 0);
+  _clear(ts);
+  if ((keep = (ts->niter > 0))) ts->freed = 1;
+  thread_rwlock_wrunlock(&ts->lock);
+  if (!keep) {
+    thread_rwlock_destroy(&ts->lock);
     free(ts);
+  }
 }
 
 
@@ -99,7 +186,302 @@ void triplestore_free(TripleStore *ts)
 */
 size_t triplestore_length(TripleStore *ts)
 {
-  return ts->length;
+  size_t length;
+  thread_rwlock_rdlock(&ts->lock);
+  length = ts->length;
+  thread_rwlock_rdunlock(&ts->lock);
+  return length;
+}
+
+/*
+  Returns a counter that changes each time the store is modified.
+*/
+size_t triplestore_get_version(TripleStore *ts)
+{
+  size_t version;
+  thread_rwlock_rdlock(&ts->lock);
+  version = ts->version;
+  thread_rwlock_rdunlock(&ts->lock);
+  return version;
+}
+
+
+/* Returns a pointer to triple number `n` in `ts`. */
+static Triple *_triple(const TripleStore *ts, size_t n)
+{
+  return ts->chunks[n / TRIPLESTORE_BUFFSIZE] + n % TRIPLESTORE_BUFFSIZE;
+}
+
+/* Returns non-zero if triple number `n` in `ts` is removed. */
+static int _is_dead(const TripleStore *ts, size_t n)
+{
+  return (ts->tombs[n / 64] >> (n % 64)) & 1;
+}
+
+/* Returns the number of the first triple in `ts` that is not removed,
+   starting from `n` and stopping at `end`.  Returns `end` if all
+   triples in this range are removed.  Whole words of the tombstone
+   bitmap are skipped at a time. */
+static size_t _skip_dead(const TripleStore *ts, size_t n, size_t end)
+{
+  if (end > ts->true_length) end = ts->true_length;
+  while (n < end && _is_dead(ts, n)) {
+    if (n % 64 == 0 && ts->tombs[n / 64] == UINT64_MAX)
+      n += 64;
+    else
+      n++;
+  }
+  return (n < end) ? n : end;
+}
+
+/* Makes space for at least `n` triples in `ts`.  Existing triples are
+   not moved.  Returns non-zero on error. */
+static int _reserve(TripleStore *ts, size_t n)
+{
+  size_t nchunks = (n + TRIPLESTORE_BUFFSIZE - 1) / TRIPLESTORE_BUFFSIZE;
+  size_t nwords = TRIPLESTORE_BUFFSIZE / 64;
+  void *ptr;
+  if (nchunks <= ts->nchunks) return 0;
+  if (!(ptr = realloc(ts->chunks, nchunks * sizeof(Triple *))))
+    return err(1, "allocation failure");
+  ts->chunks = ptr;
+  if (!(ptr = realloc(ts->pos, nchunks * TRIPLESTORE_BUFFSIZE *
+                      sizeof(*ts->pos))))
+    return err(1, "allocation failure");
+  ts->pos = ptr;
+  if (!(ptr = realloc(ts->tombs, nchunks * nwords * sizeof(uint64_t))))
+    return err(1, "allocation failure");
+  ts->tombs = ptr;
+  memset(ts->tombs + ts->nchunks * nwords, 0,
+         (nchunks - ts->nchunks) * nwords * sizeof(uint64_t));
+  while (ts->nchunks < nchunks) {
+    if (!(ts->chunks[ts->nchunks] = calloc(TRIPLESTORE_BUFFSIZE,
+                                           sizeof(Triple))))
+      return err(1, "allocation failure");
+    ts->nchunks++;
+    ts->size = ts->nchunks * TRIPLESTORE_BUFFSIZE;
+  }
+  return 0;
+}
+
+/* Frees unused chunks, keeping one spare chunk.  Must only be called
+   when no iterators are running. */
+static void _shrink(TripleStore *ts)
+{
+  size_t nchunks = ts->true_length / TRIPLESTORE_BUFFSIZE + 1;
+  void *ptr;
+  if (ts->nchunks <= nchunks) return;
+  while (ts->nchunks > nchunks) free(ts->chunks[--ts->nchunks]);
+  ts->size = ts->nchunks * TRIPLESTORE_BUFFSIZE;
+  if ((ptr = realloc(ts->pos, ts->size * sizeof(*ts->pos)))) ts->pos = ptr;
+  if ((ptr = realloc(ts->tombs, ts->size / 64 * sizeof(uint64_t))))
+    ts->tombs = ptr;
+}
+
+
+/* Returns the interned copy of `str`, adding it to the string pool of
+   `ts` if needed.  The reference count is increased.  Returns NULL on
+   error. */
+static char *_intern(TripleStore *ts, const char *str)
+{
+  int *count;
+  if (!str) return errx(1, "triple with NULL subject, predicate or object"),
+              NULL;
+  if ((count = map_get(&ts->strings, str))) {
+    (*count)++;
+  } else if (map_set(&ts->strings, str, 1)) {
+    return err(1, "allocation failure"), NULL;
+  }
+  return (char *)map_key(&ts->strings, str);
+}
+
+/* Decreases the reference count of interned string `str` and removes
+   it from the pool when it is no longer used. */
+static void _release(TripleStore *ts, char *str)
+{
+  int *count;
+  if (!str || !(count = map_get(&ts->strings, str))) return;
+  if (--(*count) <= 0) map_remove(&ts->strings, str);
+}
+
+/* Releases the strings of triple `t` in `ts` and zeros it. */
+static void _triple_release(TripleStore *ts, Triple *t)
+{
+  _release(ts, t->s);
+  _release(ts, t->p);
+  _release(ts, t->o);
+  if (t->id) free(t->id);
+  memset(t, 0, sizeof(Triple));
+}
+
+/* Replaces `*s`, `*p` and `*o` with their interned copies.  Arguments
+   that are NULL are left unchanged.  Returns non-zero if any of the
+   non-NULL arguments are not in the pool, i.e. nothing can match. */
+static int _lookup_terms(const TripleStore *ts, const char **s,
+                         const char **p, const char **o)
+{
+  const map_int_t *m = &ts->strings;
+  if (*s && !(*s = map_key(m, *s))) return 1;
+  if (*p && !(*p = map_key(m, *p))) return 1;
+  if (*o && !(*o = map_key(m, *o))) return 1;
+  return 0;
+}
+
+/* Returns the subject, predicate or object of `t` for `k` equal to
+   0, 1 or 2, respectively. */
+static const char *_term(const Triple *t, int k)
+{
+  return (k == 0) ? t->s : (k == 1) ? t->p : t->o;
+}
+
+/* Adds triple number `n` to the indices.  Returns non-zero on error. */
+static int _index_add(TripleStore *ts, size_t n)
+{
+  int k;
+  for (k=0; k<3; k++) {
+    const char *term = _term(_triple(ts, n), k);
+    TripleIds *ids = map_get(&ts->index[k], term);
+    if (!ids) {
+      TripleIds empty = {NULL, 0, 0};
+      if (map_set(&ts->index[k], term, empty))
+        return err(1, "allocation failure");
+      ids = map_get(&ts->index[k], term);
+    }
+    if (ids->n >= ids->size) {
+      size_t size = (ids->size) ? 2*ids->size : 4;
+      size_t *ptr = realloc(ids->ids, size*sizeof(size_t));
+      if (!ptr) return err(1, "allocation failure");
+      ids->ids = ptr;
+      ids->size = size;
+    }
+    ts->pos[n][k] = ids->n;
+    ids->ids[ids->n++] = n;
+  }
+  return 0;
+}
+
+/* Removes triple number `n` from the indices. */
+static void _index_remove(TripleStore *ts, size_t n)
+{
+  int k;
+  for (k=0; k<3; k++) {
+    const char *term = _term(_triple(ts, n), k);
+    TripleIds *ids = map_get(&ts->index[k], term);
+    size_t last;
+    assert(ids && ids->n > 0);
+    last = ids->ids[--ids->n];
+    if (last != n) {
+      ids->ids[ts->pos[n][k]] = last;
+      ts->pos[last][k] = ts->pos[n][k];
+    }
+    if (ids->n == 0) {
+      free(ids->ids);
+      map_remove(&ts->index[k], term);
+    }
+  }
+}
+
+/* Moves indexed triple number `src` to the unused slot `dest`. */
+static void _move_triple(TripleStore *ts, size_t src, size_t dest)
+{
+  Triple *t = _triple(ts, src);
+  int k;
+  for (k=0; k<3; k++) {
+    TripleIds *ids = map_get(&ts->index[k], _term(t, k));
+    assert(ids);
+    ids->ids[ts->pos[src][k]] = dest;
+    ts->pos[dest][k] = ts->pos[src][k];
+  }
+  map_set(&ts->map, t->id, dest);
+  memcpy(_triple(ts, dest), t, sizeof(Triple));
+  memset(t, 0, sizeof(Triple));
+}
+
+/* Removes the removed triple in free slot `n` from the indices and
+   releases it.  The slot is no longer marked as removed. */
+static void _purge_slot(TripleStore *ts, size_t n)
+{
+  Triple *t = _triple(ts, n);
+  if (t->s) _index_remove(ts, n);
+  _triple_release(ts, t);
+  ts->tombs[n / 64] &= ~((uint64_t)1 << (n % 64));
+}
+
+/* Compare function for sorting free slots. */
+static int _compar_slots(const void *p1, const void *p2)
+{
+  size_t a = *(const size_t *)p1, b = *(const size_t *)p2;
+  return (a > b) - (a < b);
+}
+
+/* Compacts `ts` by moving the last triples into the free slots.  Must
+   only be called when no iterators are running. */
+static void _compact(TripleStore *ts)
+{
+  assert(ts->niter == 0);
+  if (ts->nfree) ts->version++;
+  qsort(ts->freeslots, ts->nfree, sizeof(size_t), _compar_slots);
+
+  /* All slots above the current free slot are occupied, since the
+     free slots are handled in descending order.  Hence, the last slot
+     is either occupied or the current free slot itself. */
+  while (ts->nfree > 0) {
+    size_t n = ts->freeslots[--ts->nfree];
+    size_t last = --ts->true_length;
+    _purge_slot(ts, n);
+    if (n < last) _move_triple(ts, last, n);
+  }
+  assert(ts->true_length == ts->length);
+  _shrink(ts);
+}
+
+/* Compacts `ts` if no iterators are running and the fraction of free
+   slots exceeds TRIPLESTORE_COMPACT. */
+static void _maybe_compact(TripleStore *ts)
+{
+  if (ts->niter == 0 && ts->nfree > 0 &&
+      ts->nfree > TRIPLESTORE_COMPACT * ts->true_length)
+    _compact(ts);
+}
+
+/* Returns the index with the fewest entries among the bound terms of
+   `s`, `p` and `o`.  If `kptr` is not NULL, the term number of the
+   selected index (0, 1 or 2) is written to it.  If none of the terms
+   are bound, NULL is returned and `*nomatch` is set to zero.  If a
+   bound term does not occur in the store, NULL is returned and
+   `*nomatch` is set to one. */
+static const TripleIds *_select_ids(const TripleStore *ts, const char *s,
+                                    const char *p, const char *o,
+                                    int *kptr, int *nomatch)
+{
+  const char *terms[3] = {s, p, o};
+  const TripleIds *best=NULL;
+  int k;
+  *nomatch = 0;
+  for (k=0; k<3; k++) {
+    const TripleIds *ids;
+    if (!terms[k]) continue;
+    if (!(ids = map_peek((map_ids_t *)&ts->index[k], terms[k]))) {
+      *nomatch = 1;
+      return NULL;
+    }
+    if (!best || ids->n < best->n) {
+      best = ids;
+      if (kptr) *kptr = k;
+    }
+  }
+  return best;
+}
+
+/* Returns non-zero if `t` matches `s`, `p` and `o`, which must be
+   interned with _lookup_terms(). */
+static int _match(const Triple *t, const char *s, const char *p,
+                  const char *o)
+{
+  return (t->id &&
+          (!s || s == t->s) &&
+          (!p || p == t->p) &&
+          (!o || o == t->o));
 }
 
 
@@ -130,31 +512,21 @@ int triplestore_add(TripleStore *ts, const char *s, const char *p,
 }
 
 
-/*
-  Adds `n` triples to store.  Returns non-zero on error.
- */
-int triplestore_add_triples(TripleStore *ts, const Triple *triples,
-                             size_t n)
+/* Adds `n` triples to store without locking.  Returns non-zero on
+   error. */
+static int _add_triples(TripleStore *ts, const Triple *triples, size_t n)
 {
   size_t i;
 
   /* make space for new triples */
-  if (ts->size < ts->true_length + n) {
-    size_t m = (ts->true_length + n - ts->size) / TRIPLESTORE_BUFFSIZE;
-    size_t size = ts->size + (m + 1) * TRIPLESTORE_BUFFSIZE;
-    void *ptr;
-    assert(size >= ts->true_length + n);
-    if (!(ptr = realloc(ts->triples, size * sizeof(Triple))))
-      return err(1, "allocation failure");
-    ts->triples = ptr;
-    ts->size = size;
-    memset(ts->triples + ts->true_length, 0,
-           (ts->size - ts->true_length)*sizeof(Triple));
-  }
+  if (_reserve(ts, ts->true_length + n)) return 1;
 
-  /* append triples (avoid duplicates) */
+  /* append triples (avoid duplicates).  Free slots can only be
+     reused when no iterators are running. */
   for (i=0; i<n; i++) {
-    Triple *t = ts->triples + ts->true_length;
+    Triple *t;
+    size_t slot;
+    int reuse;
     char *id;
     if (triples[i].id) {
       if (!(id = strdup(triples[i].id))) return err(1, "allocation error");
@@ -163,47 +535,94 @@ int triplestore_add_triples(TripleStore *ts, const Triple *triples,
                                 triples[i].p, triples[i].o)))
         return 1;
     }
-    if (!map_get(&ts->map, id)) {
-      if (!(t->s = strdup(triples[i].s))) return err(1, "allocation error");
-      if (!(t->p = strdup(triples[i].p))) return err(1, "allocation error");
-      if (!(t->o = strdup(triples[i].o))) return err(1, "allocation error");
-      t->id = id;
-      ts->length++;
-      ts->true_length++;
-      map_set(&ts->map, id, i);
-    } else {
+    if (map_get(&ts->map, id)) {
       free(id);
+      continue;
+    }
+    if ((reuse = (ts->niter == 0 && ts->nfree > 0))) {
+      slot = ts->freeslots[--ts->nfree];
+      _purge_slot(ts, slot);
+    } else {
+      slot = ts->true_length;
     }
+    t = _triple(ts, slot);
+    t->id = id;
+    if (!(t->s = _intern(ts, triples[i].s)) ||
+        !(t->p = _intern(ts, triples[i].p)) ||
+        !(t->o = _intern(ts, triples[i].o)) ||
+        map_set(&ts->map, id, slot) || _index_add(ts, slot)) {
+      map_remove(&ts->map, id);
+      _triple_release(ts, t);
+      if (reuse) {
+        /* keep the (now empty) slot free */
+        ts->tombs[slot / 64] |= (uint64_t)1 << (slot % 64);
+        ts->nfree++;
+      }
+      return (t->s) ? err(1, "allocation failure") : 1;
+    }
+    ts->length++;
+    ts->version++;
+    if (!reuse) ts->true_length++;
   }
 
   return 0;
 }
 
+/*
+  Adds `n` triples to store.  Returns non-zero on error.
+ */
+int triplestore_add_triples(TripleStore *ts, const Triple *triples,
+                             size_t n)
+{
+  int retval;
+  thread_rwlock_wrlock(&ts->lock);
+  retval = _add_triples(ts, triples, n);
+  thread_rwlock_wrunlock(&ts->lock);
+  return retval;
+}
+
 
 /* Removes triple number n.  Returns non-zero on error. */
 static int _remove_by_index(TripleStore *ts, size_t n)
 {
-  Triple *t = ts->triples + n;
+  Triple *t;
   if (n >= ts->true_length)
     return err(1, "triple index out of range: %lu", (unsigned long)n);
+  t = _triple(ts, n);
   if (!t->id)
     return err(1, "triple %lu is already removed", (unsigned long)n);
+  if (ts->nfree >= ts->freesize) {
+    size_t size = (ts->freesize) ? 2*ts->freesize : 16;
+    size_t *ptr = realloc(ts->freeslots, size*sizeof(size_t));
+    if (!ptr) return err(1, "allocation failure");
+    ts->freeslots = ptr;
+    ts->freesize = size;
+  }
+  if (ts->niter && ts->ndead >= ts->deadsize) {
+    size_t size = (ts->deadsize) ? 2*ts->deadsize : 16;
+    char **ptr = realloc(ts->dead, size*sizeof(char *));
+    if (!ptr) return err(1, "allocation failure");
+    ts->dead = ptr;
+    ts->deadsize = size;
+  }
   map_remove(&ts->map, t->id);
 
-  if (ts->niter) {
-    /* running iterator, mark triple for deletion by setting id to NULL */
+  /* Mark triple as removed by setting id to NULL.  With running
+     iterators, the id is kept alive until the last iterator ends,
+     since other threads may still hold a pointer to the triple. */
+  if (ts->niter)
+    ts->dead[ts->ndead++] = t->id;
+  else
     free(t->id);
-    t->id = NULL;
-    ts->length--;
-  } else {
-    /* no running iterators, remove triple */
-    assert(ts->length == ts->true_length);
-    triple_clean(t);
-    ts->length--;
-    if (t < ts->triples + ts->length)
-      memcpy(t, &ts->triples[ts->length], sizeof(Triple));
-    ts->true_length = ts->length;
-  }
+  t->id = NULL;
+  ts->tombs[n / 64] |= (uint64_t)1 << (n % 64);
+  ts->freeslots[ts->nfree++] = n;
+  ts->length--;
+  ts->version++;
+
+  /* without running iterators and other free slots, move the last
+     triple into the slot right away, like a compaction of one slot */
+  if (ts->niter == 0 && ts->nfree == 1) _compact(ts);
   return 0;
 }
 
@@ -213,10 +632,14 @@ static int _remove_by_index(TripleStore *ts, size_t n)
 */
 int triplestore_remove_by_id(TripleStore *ts, const char *id)
 {
-  int *n;
+  int *n, retval;
+  thread_rwlock_wrlock(&ts->lock);
   if (!(n = map_get(&ts->map, id)))
-    return err(1, "no such triple id: \"%s\"", id);
-  return _remove_by_index(ts, *n);
+    retval = err(1, "no such triple id: \"%s\"", id);
+  else if (!(retval = _remove_by_index(ts, *n)))
+    _maybe_compact(ts);
+  thread_rwlock_wrunlock(&ts->lock);
+  return retval;
 }
 
 /*
@@ -224,37 +647,97 @@ int triplestore_remove_by_id(TripleStore *ts, const char *id)
   be NULL, allowing for multiple matches.  Returns the number of
   triples removed.
 */
+static int _remove(TripleStore *ts, const char *s,
+                   const char *p, const char *o)
+{
+  const TripleIds *ids;
+  char **matches;
+  size_t i, m=0;
+  int nomatch, n=0;
+
+  if (_lookup_terms(ts, &s, &p, &o)) return 0;
+  if (!(ids = _select_ids(ts, s, p, o, NULL, &nomatch))) {
+    if (nomatch) return 0;
+    i = ts->true_length;
+    while (i-- > 0)
+      if (_match(_triple(ts, i), s, p, o) && _remove_by_index(ts, i) == 0)
+        n++;
+    return n;
+  }
+
+  /* removing triples changes the indices, so collect the ids first */
+  if (!(matches = malloc(ids->n * sizeof(char *))))
+    return err(0, "allocation failure");
+  for (i=0; i<ids->n; i++) {
+    const Triple *t = _triple(ts, ids->ids[i]);
+    if (_match(t, s, p, o)) matches[m++] = t->id;
+  }
+  for (i=0; i<m; i++) {
+    int *k = map_get(&ts->map, matches[i]);
+    if (k && _remove_by_index(ts, *k) == 0) n++;
+  }
+  free(matches);
+  return n;
+}
+
 int triplestore_remove(TripleStore *ts, const char *s,
                        const char *p, const char *o)
 {
-  int i=ts->true_length, n=0;
-  while (--i >= 0) {
-    const Triple *t = ts->triples + i;
-    if (!t->id) continue;
-    if ((!s || strcmp(s, t->s) == 0) &&
-        (!p || strcmp(p, t->p) == 0) &&
-        (!o || strcmp(o, t->o) == 0)) {
-      if (_remove_by_index(ts, i) == 0) n++;
-    }
-  }
+  int n;
+  thread_rwlock_wrlock(&ts->lock);
+  n = _remove(ts, s, p, o);
+  _maybe_compact(ts);
+  thread_rwlock_wrunlock(&ts->lock);
   return n;
 }
 
 
+/* Removes all relations in triplestore without locking. */
+static void _clear(TripleStore *ts)
+{
+  int n=ts->true_length;
+  size_t i;
+  int k;
+  if (n) ts->version++;
+  while (--n >= 0) _triple_release(ts, _triple(ts, n));
+  for (i=0; i<ts->nchunks; i++) free(ts->chunks[i]);
+  if (ts->chunks) free(ts->chunks);
+  if (ts->pos) free(ts->pos);
+  if (ts->tombs) free(ts->tombs);
+  if (ts->freeslots) free(ts->freeslots);
+  for (i=0; i<ts->ndead; i++) free(ts->dead[i]);
+  if (ts->dead) free(ts->dead);
+  map_deinit(&ts->map);
+  for (k=0; k<3; k++) {
+    const char *key;
+    map_iter_t iter = map_iter(&ts->index[k]);
+    while ((key = map_next(&ts->index[k], &iter)))
+      free(map_get(&ts->index[k], key)->ids);
+    map_deinit(&ts->index[k]);
+  }
+  map_deinit(&ts->strings);
+  ts->chunks = NULL;
+  ts->nchunks = ts->length = ts->true_length = ts->size = 0;
+  memset(&ts->map, 0, sizeof(ts->map));
+  memset(ts->index, 0, sizeof(ts->index));
+  ts->pos = NULL;
+  memset(&ts->strings, 0, sizeof(ts->strings));
+  ts->tombs = NULL;
+  ts->freeslots = NULL;
+  ts->nfree = ts->freesize = 0;
+  ts->dead = NULL;
+  ts->ndead = ts->deadsize = 0;
+}
+
 /*
   Removes all relations in triplestore and releases all references to
   external memory.  Only references to running iterators is kept.
  */
 void triplestore_clear(TripleStore *ts)
 {
-  int n=ts->true_length;
-  int niter=ts->niter;
-  while (--n >= 0)
-    if (ts->triples[n].id) _remove_by_index(ts, n);
-  if (ts->triples) free(ts->triples);
-  map_deinit(&ts->map);
-  memset(ts, 0, sizeof(TripleStore));
-  ts->niter = niter;
+  thread_rwlock_wrlock(&ts->lock);
+  _clear(ts);
+  thread_rwlock_wrunlock(&ts->lock);
 }
 
 
@@ -263,12 +746,16 @@ void triplestore_clear(TripleStore *ts)
 */
 const Triple *triplestore_get(const TripleStore *ts, const char *id)
 {
-  int *n = map_get(&((TripleStore *)ts)->map, id);
-  if (!n)
-    return errx(1, "no triple with id \"%s\"", id), NULL;
-  if (!ts->triples[*n].id)
-    return errx(1, "triple \"%s\" has been removed", id), NULL;
-  return ts->triples + *n;
+  TripleStore *store = (TripleStore *)ts;
+  const Triple *t=NULL;
+  const int *n;
+  thread_rwlock_rdlock(&store->lock);
+  if (!(n = map_peek(&store->map, id)))
+    errx(1, "no triple with id \"%s\"", id);
+  else if (!(t = _triple(ts, *n))->id)
+    t = (errx(1, "triple \"%s\" has been removed", id), NULL);
+  thread_rwlock_rdunlock(&store->lock);
+  return t;
 }
 
 
@@ -276,21 +763,38 @@ const Triple *triplestore_get(const TripleStore *ts, const char *id)
   Returns a pointer to first triple matching `s`, `p` and `o` or NULL
   if no match can be found.  Any of `s`, `p` or `o` may be NULL.
  */
-const Triple *triplestore_find_first(const TripleStore *ts, const char *s,
-                                      const char *p, const char *o)
+static const Triple *_find_first(const TripleStore *ts, const char *s,
+                                 const char *p, const char *o)
 {
+  const TripleIds *ids;
   size_t i;
-  for (i=0; i<ts->true_length; i++) {
-    const Triple *t = ts->triples + i;
-    if (t->id &&
-        (!s || strcmp(s, t->s) == 0) &&
-        (!p || strcmp(p, t->p) == 0) &&
-        (!o || strcmp(o, t->o) == 0))
-      return t;
+  int nomatch;
+  if (_lookup_terms(ts, &s, &p, &o)) return NULL;
+  if ((ids = _select_ids(ts, s, p, o, NULL, &nomatch))) {
+    for (i=0; i<ids->n; i++) {
+      const Triple *t = _triple(ts, ids->ids[i]);
+      if (_match(t, s, p, o)) return t;
+    }
+    return NULL;
+  }
+  if (nomatch) return NULL;
+  for (i=0; (i = _skip_dead(ts, i, ts->true_length)) < ts->true_length; i++) {
+    const Triple *t = _triple(ts, i);
+    if (_match(t, s, p, o)) return t;
   }
   return NULL;
 }
 
+const Triple *triplestore_find_first(const TripleStore *ts, const char *s,
+                                      const char *p, const char *o)
+{
+  const Triple *t;
+  thread_rwlock_rdlock(&((TripleStore *)ts)->lock);
+  t = _find_first(ts, s, p, o);
+  thread_rwlock_rdunlock(&((TripleStore *)ts)->lock);
+  return t;
+}
+
 
 /*
   Initiates a TripleState for triplestore_find().  The state must be
@@ -298,9 +802,13 @@ const Triple *triplestore_find_first(const TripleStore *ts, const char *s,
 */
 void triplestore_init_state(TripleStore *ts, TripleState *state)
 {
+  thread_rwlock_rdlock(&ts->lock);
+  thread_atomic_add(&ts->niter, 1);
   state->ts = ts;
-  ts->niter++;
   state->pos = 0;
+  state->data = NULL;
+  state->end = ts->true_length;
+  thread_rwlock_rdunlock(&ts->lock);
 }
 
 
@@ -310,34 +818,25 @@ void triplestore_init_state(TripleStore *ts, TripleState *state)
 void triplestore_deinit_state(TripleState *state)
 {
   TripleStore *ts = state->ts;
-  int i;
+  size_t j;
+  thread_rwlock_wrlock(&ts->lock);
   assert(ts->niter > 0 /* must match triplestore_init_state() */);
-  ts->niter--;
+  thread_atomic_add(&ts->niter, -1);
 
   /* Number of pending iterators has reased zero - free the triplestore  */
   if (ts->freed && ts->niter <= 0) {
-    triplestore_free(ts);
+    thread_rwlock_wrunlock(&ts->lock);
+    thread_rwlock_destroy(&ts->lock);
+    free(ts);
     return;
   }
 
-  if (ts->niter == 0 && ts->true_length > ts->length) {
-    for (i=ts->true_length-1; i>=0 && !ts->triples[i].id; i--)
-      ts->true_length--;
-    for (i=ts->true_length-1; i>=0; i--) {
-      Triple *t = ts->triples + i;
-      if (!t->id) {
-        Triple *tt = ts->triples + (--ts->true_length);
-        assert(t < tt);
-        triple_clean(t);
-        memcpy(t, tt, sizeof(Triple));
-      }
-    }
-    assert(ts->true_length == ts->length);
-    if (ts->size > ts->length + TRIPLESTORE_BUFFSIZE) {
-      ts->size = ts->length + ts->length % TRIPLESTORE_BUFFSIZE;
-      ts->triples = realloc(ts->triples, ts->size*sizeof(Triple));
-    }
+  if (ts->niter == 0) {
+    for (j=0; j<ts->ndead; j++) free(ts->dead[j]);
+    ts->ndead = 0;
+    _maybe_compact(ts);
   }
+  thread_rwlock_wrunlock(&ts->lock);
 }
 
 
@@ -346,7 +845,12 @@ void triplestore_deinit_state(TripleState *state)
 */
 void triplestore_reset_state(TripleState *state)
 {
+  TripleStore *ts = state->ts;
+  thread_rwlock_rdlock(&ts->lock);
   state->pos = 0;
+  state->data = NULL;
+  state->end = ts->true_length;
+  thread_rwlock_rdunlock(&ts->lock);
 }
 
 
@@ -357,11 +861,13 @@ void triplestore_reset_state(TripleState *state)
 const Triple *triplestore_next(TripleState *state)
 {
   TripleStore *ts = state->ts;
-  while (state->pos < ts->true_length) {
-    const Triple *t = ts->triples + state->pos++;
-    if (t->id) return t;
-  }
-  return NULL;
+  const Triple *t=NULL;
+  thread_rwlock_rdlock(&ts->lock);
+  state->pos = _skip_dead(ts, state->pos, state->end);
+  if (state->pos < state->end && state->pos < ts->true_length)
+    t = _triple(ts, state->pos++);
+  thread_rwlock_rdunlock(&ts->lock);
+  return t;
 }
 
 /*
@@ -371,12 +877,13 @@ const Triple *triplestore_next(TripleState *state)
 const Triple *triplestore_poll(TripleState *state)
 {
   TripleStore *ts = state->ts;
-  while (state->pos < ts->true_length) {
-    const Triple *t = ts->triples + state->pos;
-    if (t->id) return t;
-    state->pos++;
-  }
-  return NULL;
+  const Triple *t=NULL;
+  thread_rwlock_rdlock(&ts->lock);
+  state->pos = _skip_dead(ts, state->pos, state->end);
+  if (state->pos < state->end && state->pos < ts->true_length)
+    t = _triple(ts, state->pos);
+  thread_rwlock_rdunlock(&ts->lock);
+  return t;
 }
 
 
@@ -388,21 +895,61 @@ const Triple *triplestore_poll(TripleState *state)
   and `o`.  Any of `s`, `p` or `o` may be NULL.  When no more matches
   can be found, NULL is returned.
  */
-const Triple *triplestore_find(TripleState *state,
-                                const char *s, const char *p, const char *o)
+static const Triple *_find(TripleState *state,
+                           const char *s, const char *p, const char *o)
 {
   TripleStore *ts = state->ts;
-  while (state->pos < ts->true_length) {
-    const Triple *t = ts->triples + state->pos++;
-    if (t->id &&
-        (!s || strcmp(s, t->s) == 0) &&
-        (!p || strcmp(p, t->p) == 0) &&
-        (!o || strcmp(o, t->o) == 0))
-      return t;
+  const TripleIds *ids=NULL;
+  int k=0, nomatch;
+
+  if (_lookup_terms(ts, &s, &p, &o)) return NULL;
+
+  /* On the first call, select the smallest index of the bound terms
+     and store its term number (plus one) in `state->data`.  Positions
+     in the indices don't change while an iterator is running.  Triples
+     appended after the iterator was initialised are skipped. */
+  if (!state->data && state->pos == 0 && (s || p || o)) {
+    if (!(ids = _select_ids(ts, s, p, o, &k, &nomatch))) return NULL;
+    state->data = (void *)(intptr_t)(k + 1);
+  } else if (state->data) {
+    const char *terms[3] = {s, p, o};
+    k = (int)(intptr_t)state->data - 1;
+    if (!terms[k] || !(ids = map_peek(&ts->index[k], terms[k]))) return NULL;
+  }
+  if (ids) {
+    while (state->pos < ids->n) {
+      size_t n = ids->ids[state->pos++];
+      const Triple *t = _triple(ts, n);
+      if (n < state->end && _match(t, s, p, o)) return t;
+    }
+    return NULL;
+  }
+  while ((state->pos = _skip_dead(ts, state->pos, state->end)) <
+         state->end && state->pos < ts->true_length) {
+    const Triple *t = _triple(ts, state->pos++);
+    if (_match(t, s, p, o)) return t;
   }
   return NULL;
 }
 
+/*
+  This function should be called iteratively.  Before the first call
+  it should be provided a `state` initialised with triplestore_init_state().
+
+  For each call it will return a pointer to triple matching `s`, `p`
+  and `o`.  Any of `s`, `p` or `o` may be NULL.  When no more matches
+  can be found, NULL is returned.
+ */
+const Triple *triplestore_find(TripleState *state,
+                                const char *s, const char *p, const char *o)
+{
+  const Triple *t;
+  thread_rwlock_rdlock(&state->ts->lock);
+  t = _find(state, s, p, o);
+  thread_rwlock_rdunlock(&state->ts->lock);
+  return t;
+}
+
 /*
   Default implementation...
  */
@@ -414,3 +961,390 @@ const Triple *triplestore_find2(TripleState *state,
   UNUSED(lang);
   return triplestore_find(state, s, p, o);
 }
+
+
+/* ================================== */
+/* Persistence                        */
+/* ================================== */
+
+/*
+  The file format written by triplestore_save() consists of (all
+  integers are little endian):
+
+    header:   magic (8 bytes), version (uint32), reserved (uint32),
+              number of strings (uint64), size of string table (uint64)
+              and number of triples (uint64)
+    strings:  NUL-terminated strings, first the subjects, predicates
+              and objects, then the triple ids
+    triples:  for each triple, the string numbers of its subject,
+              predicate, object and id (4 x uint32)
+    indices:  for the subject, predicate and object indices, the number
+              of terms (uint32) followed by, for each term, its string
+              number (uint32), the number of triples it occurs in
+              (uint32) and the triple numbers (uint32 each)
+
+  The stored indices allows triplestore_load() to rebuild the store
+  without recalculating triple ids or growing the indices one triple
+  at a time.
+ */
+
+/* Writes `v` as a little endian integer of `size` bytes to `fp`.
+   Returns non-zero on error. */
+static int _write_uint(FILE *fp, uint64_t v, int size)
+{
+  unsigned char buf[8];
+  int i;
+  for (i=0; i<size; i++) buf[i] = (unsigned char)(v >> (8*i));
+  return fwrite(buf, size, 1, fp) != 1;
+}
+
+/* Returns the little endian integer of `size` bytes at `p`. */
+static uint64_t _peek_uint(const unsigned char *p, int size)
+{
+  uint64_t v=0;
+  int i;
+  for (i=size-1; i>=0; i--) v = (v << 8) | p[i];
+  return v;
+}
+
+/* Cursor for reading a file written by triplestore_save(). */
+typedef struct {
+  const unsigned char *p;    /* current position */
+  const unsigned char *end;  /* end of data */
+} _Reader;
+
+/* Reads a little endian integer of `size` bytes from `r` to `*v`.
+   Returns non-zero if `r` is exhausted. */
+static int _read_uint(_Reader *r, uint64_t *v, int size)
+{
+  if (r->end - r->p < size) return 1;
+  *v = _peek_uint(r->p, size);
+  r->p += size;
+  return 0;
+}
+
+
+/* Saves `ts` to `filename` without locking.  Returns non-zero on error. */
+static int _save(const TripleStore *ts, const char *filename)
+{
+  map_int_t strnum;
+  const char **strs=NULL, *key;
+  map_iter_t iter;
+  uint32_t *newpos=NULL;
+  size_t i, j, nstrings=0, strsize=0, ntriples=0;
+  FILE *fp=NULL;
+  int k, retval=1;
+
+  map_init(&strnum);
+  if (ts->true_length >= UINT32_MAX ||
+      ts->strings.base.nnodes + ts->length >= UINT32_MAX)
+    FAIL1("too many triples to save: %lu", (unsigned long)ts->length);
+  if (!(strs = malloc((ts->strings.base.nnodes + ts->length + 1) *
+                      sizeof(char *))) ||
+      !(newpos = malloc((ts->true_length + 1) * sizeof(uint32_t))))
+    FAIL("allocation failure");
+
+  /* number the strings; triples pending removal are not saved */
+  iter = map_iter(&ts->strings);
+  while ((key = map_next((map_int_t *)&ts->strings, &iter))) {
+    if (map_set(&strnum, key, nstrings)) FAIL("allocation failure");
+    strs[nstrings++] = key;
+  }
+  for (i=0; i<ts->true_length; i++) {
+    const Triple *t = _triple(ts, i);
+    newpos[i] = (uint32_t)ntriples;
+    if (!t->id) continue;
+    strs[nstrings++] = t->id;
+    ntriples++;
+  }
+  for (i=0; i<nstrings; i++) strsize += strlen(strs[i]) + 1;
+
+  if (!(fp = fopen(filename, "wb")))
+    FAIL1("cannot open triplestore file for writing: %s", filename);
+
+  /* header and strings */
+  if (fwrite(TRIPLESTORE_MAGIC, 8, 1, fp) != 1 ||
+      _write_uint(fp, TRIPLESTORE_FILE_VERSION, 4) ||
+      _write_uint(fp, 0, 4) ||
+      _write_uint(fp, nstrings, 8) ||
+      _write_uint(fp, strsize, 8) ||
+      _write_uint(fp, ntriples, 8))
+    FAIL1("error writing triplestore file: %s", filename);
+  for (i=0; i<nstrings; i++)
+    if (fwrite(strs[i], strlen(strs[i]) + 1, 1, fp) != 1)
+      FAIL1("error writing triplestore file: %s", filename);
+
+  /* triples */
+  j = ts->strings.base.nnodes;
+  for (i=0; i<ts->true_length; i++) {
+    const Triple *t = _triple(ts, i);
+    if (!t->id) continue;
+    if (_write_uint(fp, *map_get(&strnum, t->s), 4) ||
+        _write_uint(fp, *map_get(&strnum, t->p), 4) ||
+        _write_uint(fp, *map_get(&strnum, t->o), 4) ||
+        _write_uint(fp, j++, 4))
+      FAIL1("error writing triplestore file: %s", filename);
+  }
+
+  /* indices */
+  for (k=0; k<3; k++) {
+    map_ids_t *index = (map_ids_t *)&ts->index[k];
+    size_t nterms=0;
+    iter = map_iter(index);
+    while ((key = map_next(index, &iter))) {
+      const TripleIds *ids = map_peek(index, key);
+      for (i=0; i<ids->n; i++)
+        if (_triple(ts, ids->ids[i])->id) break;
+      if (i < ids->n) nterms++;
+    }
+    if (_write_uint(fp, nterms, 4))
+      FAIL1("error writing triplestore file: %s", filename);
+    iter = map_iter(index);
+    while ((key = map_next(index, &iter))) {
+      const TripleIds *ids = map_peek(index, key);
+      size_t n=0;
+      for (i=0; i<ids->n; i++)
+        if (_triple(ts, ids->ids[i])->id) n++;
+      if (!n) continue;
+      if (_write_uint(fp, *map_get(&strnum, key), 4) ||
+          _write_uint(fp, n, 4))
+        FAIL1("error writing triplestore file: %s", filename);
+      for (i=0; i<ids->n; i++)
+        if (_triple(ts, ids->ids[i])->id &&
+            _write_uint(fp, newpos[ids->ids[i]], 4))
+          FAIL1("error writing triplestore file: %s", filename);
+    }
+  }
+
+  if (fclose(fp)) {
+    fp = NULL;
+    FAIL1("error closing triplestore file: %s", filename);
+  }
+  fp = NULL;
+  retval = 0;
+ fail:
+  if (fp) fclose(fp);
+  if (strs) free(strs);
+  if (newpos) free(newpos);
+  map_deinit(&strnum);
+  return retval;
+}
+
+/*
+  Saves the triples in `ts` to `filename` in a compact binary format,
+  which can be read back with triplestore_load().
+
+  Returns non-zero on error.
+ */
+int triplestore_save(const TripleStore *ts, const char *filename)
+{
+  int retval;
+  thread_rwlock_rdlock(&((TripleStore *)ts)->lock);
+  retval = _save(ts, filename);
+  thread_rwlock_rdunlock(&((TripleStore *)ts)->lock);
+  return retval;
+}
+
+
+/* Adds the triples described by the strings `strs` and `nstrings` and
+   the reader `r` positioned at the first triple to the empty store
+   `ts`.  Returns non-zero on error. */
+static int _load_indexed(TripleStore *ts, const char **strs, size_t nstrings,
+                         size_t ntriples, _Reader *r, const char *filename)
+{
+  const unsigned char *triples = r->p;
+  char **terms=NULL;
+  size_t i, j, size;
+  int k, retval=1;
+
+  if ((size_t)(r->end - r->p) / 16 < ntriples)
+    FAIL1("truncated triplestore file: %s", filename);
+  r->p += 16 * ntriples;
+
+  size = (ntriples / TRIPLESTORE_BUFFSIZE + 1) * TRIPLESTORE_BUFFSIZE;
+  if (_reserve(ts, size)) goto fail;
+  if (!(terms = calloc(nstrings, sizeof(char *))))
+    FAIL("allocation failure");
+  memset(ts->pos, 0xff, size * sizeof(*ts->pos));
+
+  /* indices and interned strings */
+  for (k=0; k<3; k++) {
+    uint64_t nterms, total=0;
+    if (_read_uint(r, &nterms, 4))
+      FAIL1("truncated triplestore file: %s", filename);
+    for (i=0; i<nterms; i++) {
+      uint64_t num, n, pos;
+      TripleIds ids = {NULL, 0, 0};
+      int *count;
+      if (_read_uint(r, &num, 4) || _read_uint(r, &n, 4))
+        FAIL1("truncated triplestore file: %s", filename);
+      if (num >= nstrings || n == 0 || (total += n) > ntriples ||
+          (size_t)(r->end - r->p) / 4 < n)
+        FAIL1("corrupted triplestore file: %s", filename);
+      if (!terms[num]) {
+        if (map_set(&ts->strings, strs[num], 0)) FAIL("allocation failure");
+        terms[num] = (char *)map_key(&ts->strings, strs[num]);
+      }
+      count = map_get(&ts->strings, terms[num]);
+      *count += (int)n;
+      if (!(ids.ids = malloc(n * sizeof(size_t)))) FAIL("allocation failure");
+      ids.n = ids.size = n;
+      for (j=0; j<n; j++) {
+        _read_uint(r, &pos, 4);
+        if (pos >= ntriples || ts->pos[pos][k] != (size_t)-1 ||
+            _peek_uint(triples + 16*pos + 4*k, 4) != num) {
+          free(ids.ids);
+          FAIL1("corrupted triplestore file: %s", filename);
+        }
+        ids.ids[j] = pos;
+        ts->pos[pos][k] = j;
+      }
+      if (map_set(&ts->index[k], terms[num], ids)) {
+        free(ids.ids);
+        FAIL("allocation failure");
+      }
+    }
+    if (total != ntriples)
+      FAIL1("corrupted triplestore file: %s", filename);
+  }
+
+  /* triples - all terms are interned, since the indices are complete */
+  for (i=0; i<ntriples; i++) {
+    Triple *t = _triple(ts, i);
+    const unsigned char *p = triples + 16*i;
+    uint64_t id = _peek_uint(p + 12, 4);
+    t->s = terms[_peek_uint(p, 4)];
+    t->p = terms[_peek_uint(p + 4, 4)];
+    t->o = terms[_peek_uint(p + 8, 4)];
+    if (id >= nstrings || map_get(&ts->map, strs[id]))
+      FAIL1("corrupted triplestore file: %s", filename);
+    if (!(t->id = strdup(strs[id]))) FAIL("allocation failure");
+    ts->length = ts->true_length = i + 1;
+    if (map_set(&ts->map, t->id, i)) FAIL("allocation failure");
+  }
+  retval = 0;
+ fail:
+  if (terms) free(terms);
+  return retval;
+}
+
+
+/*
+  Adds the triples in `filename`, written by triplestore_save(), to `ts`.
+
+  If `ts` is empty, the store is rebuilt directly from the stored
+  strings and indices.  Otherwise the triples are added with
+  triplestore_add_triples(), without recalculating their ids.
+
+  Returns non-zero on error.
+ */
+int triplestore_load(TripleStore *ts, const char *filename)
+{
+  unsigned char *data=NULL;
+  size_t size=0, i;
+  uint64_t version, reserved, nstrings, strsize, ntriples;
+  const char **strs=NULL, *str;
+  Triple *triples=NULL;
+  int retval=1, locked=0;
+  _Reader r;
+#ifdef HAVE_MMAP
+  int fd, mapped=0;
+  struct stat st;
+  if ((fd = open(filename, O_RDONLY)) >= 0) {
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        data = p;
+        size = st.st_size;
+        mapped = 1;
+      }
+    }
+    close(fd);
+  }
+#endif
+  if (!data) {
+    FILE *fp;
+    long len;
+    if (!(fp = fopen(filename, "rb")))
+      FAIL1("cannot open triplestore file: %s", filename);
+    if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET) ||
+        !(data = malloc(len + 1)) ||
+        fread(data, 1, len, fp) != (size_t)len) {
+      fclose(fp);
+      FAIL1("cannot read triplestore file: %s", filename);
+    }
+    fclose(fp);
+    size = len;
+  }
+
+  /* header */
+  r.p = data;
+  r.end = data + size;
+  if (size < 8 || memcmp(data, TRIPLESTORE_MAGIC, 8))
+    FAIL1("not a triplestore file: %s", filename);
+  r.p += 8;
+  if (_read_uint(&r, &version, 4) || _read_uint(&r, &reserved, 4) ||
+      _read_uint(&r, &nstrings, 8) || _read_uint(&r, &strsize, 8) ||
+      _read_uint(&r, &ntriples, 8))
+    FAIL1("truncated triplestore file: %s", filename);
+  if (version != TRIPLESTORE_FILE_VERSION)
+    FAIL2("unsupported triplestore file version %d: %s", (int)version,
+          filename);
+  if (strsize > (uint64_t)(r.end - r.p) || nstrings > strsize ||
+      ntriples > nstrings || (strsize && r.p[strsize-1]))
+    FAIL1("corrupted triplestore file: %s", filename);
+
+  /* strings */
+  if (!(strs = malloc((nstrings + 1) * sizeof(char *))))
+    FAIL("allocation failure");
+  str = (const char *)r.p;
+  for (i=0; i<nstrings; i++) {
+    if (str >= (const char *)r.p + strsize)
+      FAIL1("corrupted triplestore file: %s", filename);
+    strs[i] = str;
+    str += strlen(str) + 1;
+  }
+  r.p += strsize;
+
+  thread_rwlock_wrlock(&ts->lock);
+  locked = 1;
+  if (ts->true_length == 0 && ts->niter == 0) {
+    if (_load_indexed(ts, strs, nstrings, ntriples, &r, filename)) {
+      _clear(ts);
+      goto fail;
+    }
+    ts->version++;
+  } else {
+    if ((size_t)(r.end - r.p) / 16 < ntriples)
+      FAIL1("truncated triplestore file: %s", filename);
+    if (!(triples = malloc((ntriples + 1) * sizeof(Triple))))
+      FAIL("allocation failure");
+    for (i=0; i<ntriples; i++) {
+      uint64_t num[4];
+      int k;
+      for (k=0; k<4; k++) {
+        _read_uint(&r, num + k, 4);
+        if (num[k] >= nstrings)
+          FAIL1("corrupted triplestore file: %s", filename);
+      }
+      triples[i].s = (char *)strs[num[0]];
+      triples[i].p = (char *)strs[num[1]];
+      triples[i].o = (char *)strs[num[2]];
+      triples[i].id = (char *)strs[num[3]];
+    }
+    if (_add_triples(ts, triples, ntriples)) goto fail;
+  }
+  retval = 0;
+ fail:
+  if (locked) thread_rwlock_wrunlock(&ts->lock);
+  if (triples) free(triples);
+  if (strs) free(strs);
+#ifdef HAVE_MMAP
+  if (mapped)
+    munmap(data, size);
+  else
+#endif
+    if (data) free(data);
+  return retval;
+}
@@ -10,6 +10,7 @@
 #include <redland.h>
 
 #include "utils/err.h"
+#include "utils/map.h"
 #include "utils/session.h"
 #include "utils/sha1.h"
 #include "dlite-macros.h"
@@ -17,6 +18,9 @@
 
 #define TRIPLESTORE_REDLAND_GLOBALS_ID "triplestore-redland-globals-id"
 
+/* Max number of predicate nodes and datatype uris cached per store */
+#define TRIPLESTORE_NODE_CACHE_SIZE 256
+
 /* Prototype for cleanup-function */
 typedef void (*Freer)(void *ptr);
 
@@ -31,6 +35,9 @@ struct _TripleStore {
   Triple triple;              /* A triple with current result used by
                                  triplestore_find() and
                                  triplestore_find_first() */
+  map_void_t predicates;      /* Cache of predicate nodes */
+  map_void_t datatypes;       /* Cache of datatype uris */
+  size_t version;             /* Increased on each modification. */
 };
 
 /* Global variables for this module */
@@ -345,6 +352,9 @@ TripleStore *triplestore_create_with_world(librdf_world *world,
   if (!(ts = calloc(1, sizeof(TripleStore)))) FAIL("Allocation failure");
   ts->world = world;
   ts->storage = storage;
+  ts->version = 1;
+  map_init(&ts->predicates);
+  map_init(&ts->datatypes);
   if (!(ts->model = librdf_new_model(world, storage, NULL))) goto fail;
   if (storage_name) ts->storage_name = strdup(storage_name);
   if (name) ts->name = strdup(name);
@@ -396,8 +406,18 @@ TripleStore *triplestore_create()
 void triplestore_free(TripleStore *ts)
 {
   Globals *g = get_globals();
+  const char *key;
+  map_iter_t iter;
  assert(g->nmodels > 0);
  g->nmodels--;
+  iter = map_iter(&ts->predicates);
+  while ((key = map_next(&ts->predicates, &iter)))
+    librdf_free_node(*map_get(&ts->predicates, key));
+  map_deinit(&ts->predicates);
+  iter = map_iter(&ts->datatypes);
+  while ((key = map_next(&ts->datatypes, &iter)))
+    librdf_free_uri(*map_get(&ts->datatypes, key));
+  map_deinit(&ts->datatypes);
   librdf_free_storage(ts->storage);
   librdf_free_model(ts->model);
   if (ts->storage_name)  free((char *)ts->storage_name);
@@ -424,6 +444,15 @@ size_t triplestore_length(TripleStore *ts)
 }
 
 
+/*
+  Returns a counter that changes each time the store is modified.
+*/
+size_t triplestore_get_version(TripleStore *ts)
+{
+  return ts->version;
+}
+
+
 /* Returns a newly created uri node from `uri`. If `uri` has no namespace,
    the default namespace is prepended. */
 static librdf_node *new_uri_node(TripleStore *ts, const char *uri)
@@ -445,6 +474,40 @@ static librdf_node *new_uri_node(TripleStore *ts, const char *uri)
   return node;
 }
 
+/* Returns a new predicate node from `uri`.  The nodes are cached, such
+   that repeated predicates are only parsed once.  Predicates without a
+   namespace are not cached, since they depend on the default
+   namespace. */
+static librdf_node *new_predicate_node(TripleStore *ts, const char *uri)
+{
+  void **ptr;
+  librdf_node *node;
+  if (!strchr(uri, ':')) return new_uri_node(ts, uri);
+  if ((ptr = map_get(&ts->predicates, uri)))
+    return librdf_new_node_from_node(*ptr);
+  if (!(node = new_uri_node(ts, uri))) return NULL;
+  if (ts->predicates.base.nnodes < TRIPLESTORE_NODE_CACHE_SIZE &&
+      map_set(&ts->predicates, uri, node) == 0)
+    return librdf_new_node_from_node(node);
+  return node;
+}
+
+/* Returns a new datatype uri from `datatype_uri`.  Like predicate
+   nodes, the uris are cached. */
+static librdf_uri *new_datatype_uri(TripleStore *ts, const char *datatype_uri)
+{
+  void **ptr;
+  librdf_uri *uri;
+  if ((ptr = map_get(&ts->datatypes, datatype_uri)))
+    return librdf_new_uri_from_uri(*ptr);
+  if (!(uri = librdf_new_uri(ts->world, (unsigned char *)datatype_uri)))
+    return NULL;
+  if (ts->datatypes.base.nnodes < TRIPLESTORE_NODE_CACHE_SIZE &&
+      map_set(&ts->datatypes, datatype_uri, uri) == 0)
+    return librdf_new_uri_from_uri(uri);
+  return uri;
+}
+
 /*
   Adds a single (s,p,o) triple to store.
 
@@ -467,11 +530,10 @@ int triplestore_add2(TripleStore *ts, const char *s, const char *p,
   librdf_uri *uri=NULL;
   if (!(ns = new_uri_node(ts, s)))
     FAIL1("error creating node for subject: '%s'", s);
-  if (!(np = new_uri_node(ts, p)))
+  if (!(np = new_predicate_node(ts, p)))
     FAIL1("error creating node for predicate: '%s'", p);
   if (literal) {
-    if (datatype_uri &&
-        !(uri = librdf_new_uri(ts->world, (unsigned char *)datatype_uri)))
+    if (datatype_uri && !(uri = new_datatype_uri(ts, datatype_uri)))
       FAIL1("error creating uri from '%s'", datatype_uri);
     if (!(no = librdf_new_node_from_typed_literal(ts->world, (unsigned char *)o,
                                                   lang, uri)))
@@ -482,6 +544,7 @@ int triplestore_add2(TripleStore *ts, const char *s, const char *p,
   }
   if (librdf_model_add(ts->model, ns, np, no))
     FAIL("error adding triple");
+  ts->version++;
   if (uri) librdf_free_uri(uri);
   return 0;
  fail:
@@ -528,14 +591,25 @@ int triplestore_add_uri(TripleStore *ts, const char *s, const char *p,
 
 /*
   Adds `n` triples to store.  Returns non-zero on error.
+
+  The triples are added within a single transaction if the underlying
+  storage supports transactions.  On error, no triples are added in
+  that case.
  */
 int triplestore_add_triples(TripleStore *ts, const Triple *triples, size_t n)
 {
   size_t i;
+  int transaction = (n > 1 && !librdf_model_transaction_start(ts->model));
   for (i=0; i<n; i++) {
     const Triple *t = triples + i;
-    if (triplestore_add(ts, t->s, t->p, t->o)) return 1;
+    if (triplestore_add(ts, t->s, t->p, t->o)) {
+      if (transaction) librdf_model_transaction_rollback(ts->model);
+      return 1;
+    }
   }
+  if (transaction && librdf_model_transaction_commit(ts->model))
+    return err(1, "error committing triples to triplestore: %s",
+               (ts->name) ? ts->name : "");
   return 0;
 }
 
@@ -565,6 +639,7 @@ int triplestore_remove2(TripleStore *ts, const char *s, const char *p,
     removed++;
   } while (!failed && !librdf_stream_next(stream));
   librdf_free_stream(stream);
+  if (removed) ts->version++;
   return (failed) ? -1 : removed;
 }
 
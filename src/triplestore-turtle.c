@@ -0,0 +1,714 @@
+/* triplestore-turtle.c -- streaming N-Triples and Turtle parser */
+
+/*
+  Parses N-Triples and Turtle documents and adds the triples to a
+  triplestore with triplestore_add_triples().
+
+  The input is read in blocks of TURTLE_BUFSIZE bytes and the parsed
+  triples are collected in batches of TURTLE_BATCH triples, so the
+  memory used by the parser is bounded by the batch size and the
+  longest term, independent of the size of the document.
+
+  Since the triplestore stores plain strings, IRIs are stored without
+  angle brackets and literals by their lexical form.  Language tags
+  and datatypes are parsed, but not stored.  Blank nodes are stored as
+  "_:<label>".  Anonymous blank nodes and the nodes of collections get
+  generated labels of the form "_:genid<n>".
+ */
+
+#include "config.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "triplestore.h"
+
+/* Size of the read buffer */
+#define TURTLE_BUFSIZE (64*1024)
+
+/* Number of triples added to the triplestore at a time */
+#define TURTLE_BATCH 4096
+
+/* Maximum nesting depth of blank node property lists and collections */
+#define TURTLE_MAXDEPTH 32
+
+/* Error macros reporting the current input position */
+#define PERR(P, msg) \
+  errx(1, "%s:%d: " msg, (P)->name, (P)->line)
+#define PERR1(P, msg, a1) \
+  errx(1, "%s:%d: " msg, (P)->name, (P)->line, a1)
+
+
+/* Growable NUL-terminated string */
+typedef struct {
+  char *s;          /* the string */
+  size_t len;       /* length of the string */
+  size_t size;      /* allocated size */
+} Buf;
+
+/* Parser state */
+typedef struct {
+  TripleStore *ts;
+  FILE *fp;         /* input file, NULL when parsing a string */
+  const char *name; /* name of input, for error messages */
+  char *buf;        /* read buffer */
+  size_t len;       /* number of bytes in `buf` */
+  size_t pos;       /* current position in `buf` */
+  int line;         /* current line number */
+
+  Buf base;         /* base IRI, empty if not set */
+  map_str_t prefixes;     /* maps prefixes to namespace IRIs */
+  unsigned long nbnodes;  /* number of generated blank nodes */
+
+  Buf word;         /* scratch buffer for prefixes and keywords */
+  Buf iri;          /* scratch buffer for unresolved IRIs */
+  Buf dt;           /* scratch buffer for discarded datatypes */
+  Buf stack[TURTLE_MAXDEPTH][3];  /* term buffers per nesting level */
+
+  Buf arena;        /* strings of the triples in the batch */
+  size_t (*offsets)[3];  /* offsets into `arena` of the triples */
+  Triple *triples;  /* triples passed to triplestore_add_triples() */
+  size_t ntriples;  /* number of triples in the batch */
+} Parser;
+
+
+/* Appends `n` bytes from `s` to `b`.  Returns non-zero on error. */
+static int _append(Buf *b, const char *s, size_t n)
+{
+  if (b->len + n + 1 > b->size) {
+    size_t size = (b->size) ? b->size : 256;
+    char *p;
+    while (size < b->len + n + 1) size *= 2;
+    if (!(p = realloc(b->s, size))) return err(1, "allocation failure");
+    b->s = p;
+    b->size = size;
+  }
+  if (n) memcpy(b->s + b->len, s, n);
+  b->len += n;
+  b->s[b->len] = '\0';
+  return 0;
+}
+
+/* Appends character `c` to `b`.  Returns non-zero on error. */
+static int _putc(Buf *b, int c)
+{
+  char ch = (char)c;
+  return _append(b, &ch, 1);
+}
+
+/* Clears `b` without releasing its memory.  Returns non-zero on
+   error. */
+static int _clear(Buf *b)
+{
+  b->len = 0;
+  return _append(b, NULL, 0);
+}
+
+/* Appends code point `c` encoded as UTF-8 to `b`. */
+static int _put_utf8(Buf *b, unsigned long c)
+{
+  char s[4];
+  size_t n;
+  if (c < 0x80) {
+    s[0] = (char)c;
+    n = 1;
+  } else if (c < 0x800) {
+    s[0] = (char)(0xc0 | (c >> 6));
+    s[1] = (char)(0x80 | (c & 0x3f));
+    n = 2;
+  } else if (c < 0x10000) {
+    s[0] = (char)(0xe0 | (c >> 12));
+    s[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+    s[2] = (char)(0x80 | (c & 0x3f));
+    n = 3;
+  } else {
+    s[0] = (char)(0xf0 | ((c >> 18) & 0x07));
+    s[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+    s[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+    s[3] = (char)(0x80 | (c & 0x3f));
+    n = 4;
+  }
+  return _append(b, s, n);
+}
+
+
+/* Makes at least `n` bytes available in the read buffer, unless the
+   end of the input is reached.  Returns the number of available
+   bytes. */
+static size_t _avail(Parser *P, size_t n)
+{
+  size_t m = P->len - P->pos;
+  if (m < n && P->fp && !feof(P->fp) && !ferror(P->fp)) {
+    memmove(P->buf, P->buf + P->pos, m);
+    P->len = m + fread(P->buf + m, 1, TURTLE_BUFSIZE - m, P->fp);
+    P->pos = 0;
+    m = P->len;
+  }
+  return m;
+}
+
+/* Returns the next character without consuming it, or EOF. */
+static int _peek(Parser *P)
+{
+  return (_avail(P, 1)) ? (unsigned char)P->buf[P->pos] : EOF;
+}
+
+/* Returns the character after the next character, or EOF. */
+static int _peek2(Parser *P)
+{
+  return (_avail(P, 2) >= 2) ? (unsigned char)P->buf[P->pos + 1] : EOF;
+}
+
+/* Consumes and returns the next character, or EOF. */
+static int _getc(Parser *P)
+{
+  int c = _peek(P);
+  if (c != EOF) {
+    P->pos++;
+    if (c == '\n') P->line++;
+  }
+  return c;
+}
+
+/* Skips white space and comments. */
+static void _skip(Parser *P)
+{
+  int c;
+  while ((c = _peek(P)) != EOF) {
+    if (c == '#') {
+      while ((c = _getc(P)) != EOF && c != '\n');
+    } else if (c < 0x80 && isspace(c)) {
+      _getc(P);
+    } else {
+      break;
+    }
+  }
+}
+
+/* Skips white space and consumes character `c`.  Returns non-zero if
+   the next character is not `c`. */
+static int _expect(Parser *P, int c)
+{
+  _skip(P);
+  if (_peek(P) != c) return PERR1(P, "expected '%c'", c);
+  _getc(P);
+  return 0;
+}
+
+/* Returns non-zero if `c` may occur in a prefixed name. */
+static int _is_name_char(int c)
+{
+  return (c != EOF && ((c < 0x80 && isalnum(c)) || c == '_' || c == '-' ||
+                       c >= 0x80));
+}
+
+
+static int _flush(Parser *P);
+
+/* Adds triple (`s`, `p`, `o`) to the batch. */
+static int _emit(Parser *P, const char *s, const char *p, const char *o)
+{
+  size_t *off;
+  if (P->ntriples >= TURTLE_BATCH && _flush(P)) return 1;
+  off = P->offsets[P->ntriples];
+  off[0] = P->arena.len;
+  if (_append(&P->arena, s, strlen(s) + 1)) return 1;
+  off[1] = P->arena.len;
+  if (_append(&P->arena, p, strlen(p) + 1)) return 1;
+  off[2] = P->arena.len;
+  if (_append(&P->arena, o, strlen(o) + 1)) return 1;
+  P->ntriples++;
+  return 0;
+}
+
+/* Adds the triples in the batch to the triplestore and empties the
+   batch.  Returns non-zero on error. */
+static int _flush(Parser *P)
+{
+  size_t i;
+  int stat;
+  for (i=0; i<P->ntriples; i++) {
+    P->triples[i].s = P->arena.s + P->offsets[i][0];
+    P->triples[i].p = P->arena.s + P->offsets[i][1];
+    P->triples[i].o = P->arena.s + P->offsets[i][2];
+    P->triples[i].id = NULL;
+  }
+  stat = (P->ntriples) ?
+    triplestore_add_triples(P->ts, P->triples, P->ntriples) : 0;
+  P->ntriples = 0;
+  P->arena.len = 0;
+  return stat;
+}
+
+
+/* Returns non-zero if `iri` starts with a scheme. */
+static int _has_scheme(const char *iri)
+{
+  const char *p = iri;
+  if (!(*p > 0 && isalpha(*p))) return 0;
+  while (*p > 0 && (isalnum(*p) || *p == '+' || *p == '-' || *p == '.')) p++;
+  return *p == ':';
+}
+
+/* Appends `iri` resolved against the base IRI to `b`.  The resolution
+   is simplified and does not remove dot segments. */
+static int _resolve(Parser *P, const char *iri, Buf *b)
+{
+  const char *base = P->base.s;
+  size_t n;
+  if (!P->base.len || _has_scheme(iri)) return _append(b, iri, strlen(iri));
+  if (iri[0] == '#' || iri[0] == '\0') {
+    n = strcspn(base, "#");
+  } else if (iri[0] == '/' && iri[1] == '/') {
+    n = strcspn(base, ":") + 1;
+  } else if (iri[0] == '/') {
+    const char *p = strstr(base, "//");
+    n = (p) ? (size_t)(p + 2 - base) + strcspn(p + 2, "/?#") :
+      strcspn(base, ":") + 1;
+  } else {
+    n = strcspn(base, "?#");
+    while (n > 0 && base[n-1] != '/') n--;
+  }
+  if (_append(b, base, n)) return 1;
+  return _append(b, iri, strlen(iri));
+}
+
+/* Reads `n` hex digits of a \u or \U escape and appends the encoded
+   character to `b`. */
+static int _unicode(Parser *P, Buf *b, int n)
+{
+  unsigned long v=0;
+  int i, c;
+  for (i=0; i<n; i++) {
+    c = _getc(P);
+    if (c == EOF || !isxdigit(c)) return PERR(P, "invalid unicode escape");
+    v = 16*v + ((c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10);
+  }
+  return _put_utf8(b, v);
+}
+
+/* Reads an IRI reference after the opening '<' and appends it,
+   resolved against the base IRI, to `b`. */
+static int _iriref(Parser *P, Buf *b)
+{
+  int c;
+  if (_clear(&P->iri)) return 1;
+  while ((c = _getc(P)) != '>') {
+    if (c == EOF || c == '\n' || c == ' ' || c == '<')
+      return PERR(P, "invalid IRI");
+    if (c == '\\') {
+      c = _getc(P);
+      if (c == 'u') {
+        if (_unicode(P, &P->iri, 4)) return 1;
+      } else if (c == 'U') {
+        if (_unicode(P, &P->iri, 8)) return 1;
+      } else {
+        return PERR(P, "invalid escape in IRI");
+      }
+    } else if (_putc(&P->iri, c)) {
+      return 1;
+    }
+  }
+  return _resolve(P, P->iri.s, b);
+}
+
+/* Reads a name (prefix or keyword) to P->word. */
+static int _read_name(Parser *P)
+{
+  int c;
+  if (_clear(&P->word)) return 1;
+  while ((c = _peek(P)) != EOF) {
+    if (!_is_name_char(c) && !(c == '.' && _is_name_char(_peek2(P))))
+      break;
+    if (_putc(&P->word, _getc(P))) return 1;
+  }
+  return 0;
+}
+
+/* Reads the local part of a prefixed name whose `prefix` already is
+   read and appends the expanded IRI to `b`.  The next character must
+   be the colon. */
+static int _pname(Parser *P, const char *prefix, Buf *b)
+{
+  char **ns;
+  int c;
+  if (_getc(P) != ':') return PERR(P, "expected ':'");
+  if (!(ns = map_get(&P->prefixes, prefix)))
+    return PERR1(P, "undefined prefix: '%s'", prefix);
+  if (_append(b, *ns, strlen(*ns))) return 1;
+  while ((c = _peek(P)) != EOF) {
+    if (c == '\\') {
+      _getc(P);
+      if ((c = _getc(P)) == EOF) return PERR(P, "unexpected end of input");
+    } else if (_is_name_char(c) || c == ':' || c == '%') {
+      _getc(P);
+    } else if (c == '.' && (_is_name_char(_peek2(P)) || _peek2(P) == ':')) {
+      _getc(P);
+    } else {
+      break;
+    }
+    if (_putc(b, c)) return 1;
+  }
+  return 0;
+}
+
+/* Reads an IRI or a prefixed name and appends it to `b`. */
+static int _iri(Parser *P, Buf *b)
+{
+  if (_peek(P) == '<') {
+    _getc(P);
+    return _iriref(P, b);
+  }
+  if (_read_name(P)) return 1;
+  return _pname(P, P->word.s, b);
+}
+
+/* Reads a quoted string and appends its value to `b`.  A following
+   language tag or datatype is consumed and discarded. */
+static int _string(Parser *P, Buf *b)
+{
+  int q = _getc(P), c, longstr=0;
+  if (_peek(P) == q) {
+    _getc(P);
+    if (_peek(P) != q) goto suffix;  /* empty string */
+    _getc(P);
+    longstr = 1;
+  }
+  for (;;) {
+    if ((c = _getc(P)) == EOF) return PERR(P, "unterminated string");
+    if (c == q) {
+      if (!longstr) break;
+      if (_peek(P) == q && _peek2(P) == q) {
+        _getc(P);
+        _getc(P);
+        break;
+      }
+    } else if (c == '\\') {
+      switch ((c = _getc(P))) {
+      case 't': c = '\t'; break;
+      case 'b': c = '\b'; break;
+      case 'n': c = '\n'; break;
+      case 'r': c = '\r'; break;
+      case 'f': c = '\f'; break;
+      case '"': case '\'': case '\\': break;
+      case 'u': if (_unicode(P, b, 4)) return 1; continue;
+      case 'U': if (_unicode(P, b, 8)) return 1; continue;
+      default: return PERR(P, "invalid escape in string");
+      }
+    } else if (!longstr && (c == '\n' || c == '\r')) {
+      return PERR(P, "newline in string");
+    }
+    if (_putc(b, c)) return 1;
+  }
+ suffix:
+  if ((c = _peek(P)) == '@') {
+    _getc(P);
+    while ((c = _peek(P)) != EOF && c < 0x80 && (isalnum(c) || c == '-'))
+      _getc(P);
+  } else if (c == '^') {
+    _getc(P);
+    if (_getc(P) != '^') return PERR(P, "expected '^^'");
+    if (_clear(&P->dt) || _iri(P, &P->dt)) return 1;
+  }
+  return 0;
+}
+
+/* Reads a numeric literal and appends it to `b`. */
+static int _number(Parser *P, Buf *b)
+{
+  int c, prev=0;
+  while ((c = _peek(P)) != EOF) {
+    if (!((c < 0x80 && isdigit(c)) || c == 'e' || c == 'E' ||
+          ((c == '+' || c == '-') && (!prev || prev == 'e' || prev == 'E')) ||
+          (c == '.' && _peek2(P) != EOF && isdigit(_peek2(P)))))
+      break;
+    if (_putc(b, _getc(P))) return 1;
+    prev = c;
+  }
+  if (!b->len) return PERR(P, "invalid number");
+  return 0;
+}
+
+/* Writes a new generated blank node label to `b`. */
+static int _genid(Parser *P, Buf *b)
+{
+  char s[32];
+  snprintf(s, sizeof(s), "_:genid%lu", ++P->nbnodes);
+  if (_clear(b)) return 1;
+  return _append(b, s, strlen(s));
+}
+
+static int _term(Parser *P, Buf *b, int pos, int depth);
+static int _predobjlist(Parser *P, const char *subj, int depth);
+
+/* Reads a collection after the opening '(' and writes the node that
+   represents it to `b`.  The triples of the collection are added with
+   the buffers of nesting level `depth`. */
+static int _collection(Parser *P, Buf *b, int depth)
+{
+  Buf *cur = &P->stack[depth][0], *next = &P->stack[depth][1];
+  Buf *item = &P->stack[depth][2], tmp;
+
+  _skip(P);
+  if (_peek(P) == ')') {
+    _getc(P);
+    return _append(b, RDF "nil", strlen(RDF "nil"));
+  }
+  if (_genid(P, cur) || _append(b, cur->s, cur->len)) return 1;
+  for (;;) {
+    if (_clear(item) || _term(P, item, 2, depth) ||
+        _emit(P, cur->s, RDF "first", item->s)) return 1;
+    _skip(P);
+    if (_peek(P) == ')') {
+      _getc(P);
+      return _emit(P, cur->s, RDF "rest", RDF "nil");
+    }
+    if (_peek(P) == EOF) return PERR(P, "unterminated collection");
+    if (_genid(P, next) || _emit(P, cur->s, RDF "rest", next->s)) return 1;
+    tmp = *cur;
+    *cur = *next;
+    *next = tmp;
+  }
+}
+
+/* Reads a term and appends it to `b`.  `pos` is 0, 1 or 2 for a
+   subject, predicate or object, respectively.  Nested blank node
+   property lists and collections use the buffers of nesting level
+   `depth` + 1. */
+static int _term(Parser *P, Buf *b, int pos, int depth)
+{
+  int c;
+  _skip(P);
+  c = _peek(P);
+  if (pos != 1 && (c == '[' || c == '(') && depth + 1 >= TURTLE_MAXDEPTH)
+    return PERR(P, "too deep nesting");
+
+  if (c == '<') {
+    _getc(P);
+    return _iriref(P, b);
+  } else if (c == '_' && _peek2(P) == ':' && pos != 1) {
+    _getc(P);
+    _getc(P);
+    if (_append(b, "_:", 2) || _read_name(P)) return 1;
+    return _append(b, P->word.s, P->word.len);
+  } else if (c == '[' && pos != 1) {
+    _getc(P);
+    if (_genid(P, b)) return 1;
+    _skip(P);
+    if (_peek(P) != ']' && _predobjlist(P, b->s, depth + 1)) return 1;
+    return _expect(P, ']');
+  } else if (c == '(' && pos != 1) {
+    _getc(P);
+    return _collection(P, b, depth + 1);
+  } else if ((c == '"' || c == '\'') && pos == 2) {
+    return _string(P, b);
+  } else if ((c == '+' || c == '-' || c == '.' || (c < 0x80 && isdigit(c)))
+             && pos == 2) {
+    return _number(P, b);
+  } else if (_is_name_char(c) || c == ':') {
+    if (_read_name(P)) return 1;
+    if (_peek(P) == ':') return _pname(P, P->word.s, b);
+    if (pos == 1 && strcmp(P->word.s, "a") == 0)
+      return _append(b, RDF "type", strlen(RDF "type"));
+    if (pos == 2 && (strcmp(P->word.s, "true") == 0 ||
+                     strcmp(P->word.s, "false") == 0))
+      return _append(b, P->word.s, P->word.len);
+    return PERR1(P, "unexpected '%s'", P->word.s);
+  }
+  if (c == EOF) return PERR(P, "unexpected end of input");
+  return PERR1(P, "unexpected character '%c'", c);
+}
+
+/* Reads a predicate-object list for subject `subj` using the buffers
+   of nesting level `depth`. */
+static int _predobjlist(Parser *P, const char *subj, int depth)
+{
+  Buf *pred = &P->stack[depth][1], *obj = &P->stack[depth][2];
+  int c;
+  for (;;) {
+    if (_clear(pred) || _term(P, pred, 1, depth)) return 1;
+    for (;;) {
+      if (_clear(obj) || _term(P, obj, 2, depth) ||
+          _emit(P, subj, pred->s, obj->s)) return 1;
+      _skip(P);
+      if (_peek(P) != ',') break;
+      _getc(P);
+    }
+    if (_peek(P) != ';') return 0;
+    while (_peek(P) == ';') {
+      _getc(P);
+      _skip(P);
+    }
+    c = _peek(P);
+    if (c == '.' || c == ']' || c == EOF) return 0;
+  }
+}
+
+/* Reads the IRI of a prefix directive after the directive keyword. */
+static int _prefix(Parser *P)
+{
+  Buf *iri = &P->stack[0][1];
+  char **old;
+  _skip(P);
+  if (_read_name(P) || _clear(iri)) return 1;
+  if (_getc(P) != ':') return PERR(P, "expected ':' in prefix directive");
+  _skip(P);
+  if (_getc(P) != '<') return PERR(P, "expected IRI in prefix directive");
+  if (_iriref(P, iri)) return 1;
+  if ((old = map_get(&P->prefixes, P->word.s))) {
+    free(*old);
+    map_remove(&P->prefixes, P->word.s);
+  }
+  if (map_set(&P->prefixes, P->word.s, strdup(iri->s)))
+    return err(1, "allocation failure");
+  return 0;
+}
+
+/* Reads the IRI of a base directive after the directive keyword. */
+static int _base(Parser *P)
+{
+  Buf *iri = &P->stack[0][1];
+  if (_clear(iri)) return 1;
+  _skip(P);
+  if (_getc(P) != '<') return PERR(P, "expected IRI in base directive");
+  if (_iriref(P, iri) || _clear(&P->base)) return 1;
+  return _append(&P->base, iri->s, iri->len);
+}
+
+/* Reads a directive or a statement. */
+static int _statement(Parser *P)
+{
+  Buf *subj = &P->stack[0][0];
+  int c = _peek(P);
+  if (_clear(subj)) return 1;
+
+  if (c == '@') {
+    _getc(P);
+    if (_read_name(P)) return 1;
+    if (strcmp(P->word.s, "prefix") == 0) {
+      if (_prefix(P)) return 1;
+    } else if (strcmp(P->word.s, "base") == 0) {
+      if (_base(P)) return 1;
+    } else {
+      return PERR1(P, "unknown directive: '@%s'", P->word.s);
+    }
+    return _expect(P, '.');
+  }
+
+  if (_is_name_char(c) && c != '_') {
+    if (_read_name(P)) return 1;
+    if (_peek(P) != ':') {
+      if (strcasecmp(P->word.s, "PREFIX") == 0) return _prefix(P);
+      if (strcasecmp(P->word.s, "BASE") == 0) return _base(P);
+      return PERR1(P, "unexpected '%s'", P->word.s);
+    }
+    if (_pname(P, P->word.s, subj)) return 1;
+  } else {
+    if (_term(P, subj, 0, 0)) return 1;
+    if (c == '[') {
+      _skip(P);
+      if (_peek(P) == '.') return _expect(P, '.');
+    }
+  }
+  if (_predobjlist(P, subj->s, 0)) return 1;
+  return _expect(P, '.');
+}
+
+/* Parses the input of `P` until the end.  Returns non-zero on error. */
+static int _parse(Parser *P)
+{
+  int i, k, retval=1;
+  const char *key;
+  map_iter_t iter;
+
+  map_init(&P->prefixes);
+  P->line = 1;
+  if (!(P->offsets = malloc(TURTLE_BATCH * sizeof(*P->offsets))) ||
+      !(P->triples = malloc(TURTLE_BATCH * sizeof(Triple)))) {
+    err(1, "allocation failure");
+    goto fail;
+  }
+  for (;;) {
+    _skip(P);
+    if (_peek(P) == EOF) break;
+    if (_statement(P)) goto fail;
+  }
+  if (P->fp && ferror(P->fp)) {
+    err(1, "error reading %s", P->name);
+    goto fail;
+  }
+  retval = _flush(P);
+ fail:
+  if (retval) P->ntriples = 0;
+  iter = map_iter(&P->prefixes);
+  while ((key = map_next(&P->prefixes, &iter)))
+    free(*map_get(&P->prefixes, key));
+  map_deinit(&P->prefixes);
+  for (i=0; i<TURTLE_MAXDEPTH; i++)
+    for (k=0; k<3; k++)
+      if (P->stack[i][k].s) free(P->stack[i][k].s);
+  if (P->base.s) free(P->base.s);
+  if (P->word.s) free(P->word.s);
+  if (P->iri.s) free(P->iri.s);
+  if (P->dt.s) free(P->dt.s);
+  if (P->arena.s) free(P->arena.s);
+  if (P->offsets) free(P->offsets);
+  if (P->triples) free(P->triples);
+  return retval;
+}
+
+
+/*
+  Parses the N-Triples or Turtle document in `filename` and adds its
+  triples to `ts`.  Relative IRIs are resolved against `base`, which
+  may be NULL.
+
+  The document is streamed and the triples are added in batches.  On
+  error, the triples of the batches that already are added are kept
+  in `ts`.  Returns non-zero on error.
+ */
+int triplestore_parse_file(TripleStore *ts, const char *filename,
+                           const char *base)
+{
+  Parser parser;
+  int retval=1;
+  memset(&parser, 0, sizeof(Parser));
+  parser.ts = ts;
+  parser.name = filename;
+  if (base && _append(&parser.base, base, strlen(base))) return 1;
+  if (!(parser.buf = malloc(TURTLE_BUFSIZE))) {
+    if (parser.base.s) free(parser.base.s);
+    return err(1, "allocation failure");
+  }
+  if (!(parser.fp = fopen(filename, "rb"))) {
+    if (parser.base.s) free(parser.base.s);
+    free(parser.buf);
+    return err(1, "cannot open '%s'", filename);
+  }
+  retval = _parse(&parser);
+  fclose(parser.fp);
+  free(parser.buf);
+  return retval;
+}
+
+/*
+  Like triplestore_parse_file(), but parses the NUL-terminated string
+  `src`.  Returns non-zero on error.
+ */
+int triplestore_parse_string(TripleStore *ts, const char *src,
+                             const char *base)
+{
+  Parser parser;
+  memset(&parser, 0, sizeof(Parser));
+  parser.ts = ts;
+  parser.name = "<string>";
+  parser.buf = (char *)src;
+  parser.len = strlen(src);
+  if (base && _append(&parser.base, base, strlen(base))) return 1;
+  return _parse(&parser);
+}
@@ -36,6 +36,8 @@ typedef struct _TripleState {
   TripleStore *ts;    /*!< reference to corresponding TripleStore */
   size_t pos;         /*!< current position */
   void *data;         /*!< internal data depending on the implementation */
+  size_t end;         /*!< number of triples when the state was initialised.
+                           Triples appended later are not visited. */
 } TripleState;
 
 
@@ -58,6 +60,30 @@ librdf_model *triplestore_get_model(TripleStore *ts);
 #endif
 
 
+/* ================================== */
+/* Functions specific to builtin      */
+/* ================================== */
+#ifndef HAVE_REDLAND
+
+/**
+  Saves the triples in `ts` to `filename` in a compact binary format
+  with a string table, integer-encoded triples and the subject,
+  predicate and object indices.  Returns non-zero on error.
+*/
+int triplestore_save(const TripleStore *ts, const char *filename);
+
+/**
+  Adds the triples in `filename`, written by triplestore_save(), to `ts`.
+
+  The file is memory mapped if possible.  If `ts` is empty, the store
+  and its indices are rebuilt directly from the file without
+  recalculating the triple ids.  Returns non-zero on error.
+*/
+int triplestore_load(TripleStore *ts, const char *filename);
+
+#endif
+
+
 
 /* ================================== */
 /* Generic functions                  */
@@ -110,6 +136,15 @@ const char *triplestore_get_namespace(TripleStore *ts);
 size_t triplestore_length(TripleStore *ts);
 
 
+/**
+  Returns a counter that changes each time triples are added to,
+  removed from or reordered in the store.  It is never zero.  Compare
+  it with an earlier value to check whether the store has been
+  modified.
+*/
+size_t triplestore_get_version(TripleStore *ts);
+
+
 /**
   Adds a single (s,p,o) triple to store.
 
@@ -159,6 +194,31 @@ int triplestore_add_uri(TripleStore *ts, const char *s, const char *p,
 int triplestore_add_triples(TripleStore *ts, const Triple *triples, size_t n);
 
 
+/**
+  Parses the N-Triples or Turtle document in `filename` and adds its
+  triples to `ts`.  Relative IRIs are resolved against `base`, which
+  may be NULL.
+
+  The document is streamed and the triples are added in batches with
+  triplestore_add_triples(), so the memory used by the parser does not
+  depend on the size of the document.  IRIs are stored without angle
+  brackets and literals by their lexical form, without language tag
+  and datatype.  Blank nodes are stored as "_:<label>".
+
+  On error, the batches that already are added are kept in `ts`.
+  Returns non-zero on error.
+ */
+int triplestore_parse_file(TripleStore *ts, const char *filename,
+                           const char *base);
+
+/**
+  Like triplestore_parse_file(), but parses the NUL-terminated string
+  `src`.  Returns non-zero on error.
+ */
+int triplestore_parse_string(TripleStore *ts, const char *src,
+                             const char *base);
+
+
 /**
   Removes a triple identified by it's `id`.  Returns non-zero if no such
   triple can be found.
@@ -197,6 +257,11 @@ const Triple *triplestore_find_first(const TripleStore *ts, const char *s,
 
 /**
   Initiates a TripleState for triplestore_find().
+
+  With the builtin backend, the iterator only visits the triples that
+  were in the store when it was initialised, even if other threads
+  add triples while iterating.  Pointers to triples returned by the
+  iterator stay valid until the state is deinitialised.
 */
 void triplestore_init_state(TripleStore *ts, TripleState *state);
 
@@ -0,0 +1,176 @@
+/* crc32c.c -- CRC-32C checksums
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include "config.h"
+
+#include <string.h>
+
+#include "thread.h"
+#include "crc32c.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+  (defined(__GNUC__) || defined(__clang__))
+# define USE_SSE42
+# include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+# define USE_ARMV8
+# include <arm_acle.h>
+#endif
+
+/* Reflected CRC-32C polynomial */
+#define POLY 0x82f63b78
+
+/* Tables for slicing-by-8 */
+static uint32_t table[8][256];
+static int table_ready = 0;
+static ThreadMutex table_mutex = THREAD_MUTEX_INITIALIZER;
+
+
+/* Initialises the slicing-by-8 tables, if needed. */
+static void init_table(void)
+{
+  uint32_t c;
+  int i, j;
+  if (thread_atomic_load(&table_ready)) return;
+  thread_mutex_lock(&table_mutex);
+  if (!table_ready) {
+    for (i=0; i<256; i++) {
+      c = i;
+      for (j=0; j<8; j++) c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+      table[0][i] = c;
+    }
+    for (i=0; i<256; i++) {
+      c = table[0][i];
+      for (j=1; j<8; j++) {
+        c = table[0][c & 0xff] ^ (c >> 8);
+        table[j][i] = c;
+      }
+    }
+    thread_atomic_add(&table_ready, 1);
+  }
+  thread_mutex_unlock(&table_mutex);
+}
+
+/* Portable slicing-by-8 implementation.  Bytes are combined
+   explicitly, such that it is independent of the byte order. */
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+  const unsigned char *p = buf;
+  uint32_t hi;
+  init_table();
+  crc = ~crc;
+  while (len >= 8) {
+    crc ^= (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+      (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 |
+      (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+    crc = table[7][crc & 0xff] ^ table[6][(crc >> 8) & 0xff] ^
+      table[5][(crc >> 16) & 0xff] ^ table[4][crc >> 24] ^
+      table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff] ^
+      table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+    p += 8;
+    len -= 8;
+  }
+  while (len--) crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+
+#if defined(USE_SSE42)
+
+/* Implementation using the SSE4.2 crc32 instruction. */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const void *buf, size_t len)
+{
+  const unsigned char *p = buf;
+  crc = ~crc;
+  while (len && ((uintptr_t)p & 7)) {
+    crc = _mm_crc32_u8(crc, *p++);
+    len--;
+  }
+#if defined(__x86_64__)
+  {
+    uint64_t c = crc, w;
+    while (len >= 8) {
+      memcpy(&w, p, 8);
+      c = _mm_crc32_u64(c, w);
+      p += 8;
+      len -= 8;
+    }
+    crc = (uint32_t)c;
+  }
+#endif
+  while (len >= 4) {
+    uint32_t w;
+    memcpy(&w, p, 4);
+    crc = _mm_crc32_u32(crc, w);
+    p += 4;
+    len -= 4;
+  }
+  while (len--) crc = _mm_crc32_u8(crc, *p++);
+  return ~crc;
+}
+
+/* Whether the processor supports SSE4.2.  -1 means not yet checked. */
+static int have_sse42 = -1;
+
+int crc32c_hw(void)
+{
+  int have = thread_atomic_load(&have_sse42);
+  if (have < 0) {
+    __builtin_cpu_init();
+    have = (__builtin_cpu_supports("sse4.2")) ? 1 : 0;
+    thread_atomic_cas(&have_sse42, -1, have);
+  }
+  return have;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+  if (crc32c_hw()) return crc32c_sse42(crc, buf, len);
+  return crc32c_sw(crc, buf, len);
+}
+
+#elif defined(USE_ARMV8)
+
+int crc32c_hw(void)
+{
+  return 1;
+}
+
+/* Implementation using the ARMv8 CRC instructions. */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+  const unsigned char *p = buf;
+  crc = ~crc;
+  while (len && ((uintptr_t)p & 7)) {
+    crc = __crc32cb(crc, *p++);
+    len--;
+  }
+  while (len >= 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    crc = __crc32cd(crc, w);
+    p += 8;
+    len -= 8;
+  }
+  while (len--) crc = __crc32cb(crc, *p++);
+  return ~crc;
+}
+
+#else
+
+int crc32c_hw(void)
+{
+  return 0;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+  return crc32c_sw(crc, buf, len);
+}
+
+#endif
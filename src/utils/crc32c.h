@@ -0,0 +1,48 @@
+/* crc32c.h -- CRC-32C checksums
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#ifndef _CRC32C_H
+#define _CRC32C_H
+
+/**
+  @file
+  @brief CRC-32C (Castagnoli) checksums.
+
+  Uses the SSE4.2 crc32 instruction on x86-64 processors supporting it
+  (detected at runtime) and the ARMv8 CRC instructions on aarch64 when
+  compiled for them.  Otherwise a portable slicing-by-8 implementation
+  is used.
+*/
+
+#include <stddef.h>
+
+#ifdef HAVE_STDINT_H
+# include <stdint.h>
+#else
+# include "integers.h"
+#endif
+
+/**
+  Returns the CRC-32C checksum of the `len` bytes at `buf` continued
+  from checksum `crc`.  Use zero as initial value of `crc`.
+
+  For example, the checksum of the two buffers `a` and `b` is
+
+      crc32c(crc32c(0, a, alen), b, blen)
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/**
+  Like crc32c(), but always uses the portable implementation.
+ */
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len);
+
+/**
+  Returns non-zero if crc32c() uses hardware instructions.
+ */
+int crc32c_hw(void);
+
+#endif /* _CRC32C_H */
@@ -12,12 +12,19 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "config.h"
 #include "compat.h"
 #include "err.h"
 
 /* Thread local storate */
+#if defined(HAVE_GCC_THREAD_LOCAL_STORAGE) || \
+  defined(HAVE_WIN32_THREAD_LOCAL_STORAGE)
+# define USE_THREAD_LOCAL_STORAGE
+#endif
 #ifdef USE_THREAD_LOCAL_STORAGE
 # ifdef __GNUC__
 # define _tls __thread
@@ -62,8 +69,17 @@ static ErrHandler err_handler = err_default_handler;
 /* Root of the linked list of error records. */
 static _tls ErrRecord err_root_record;
 
-/* Pointer to the top level record. */
-static _tls ErrRecord *err_record = &err_root_record;
+/* Pointer to the top level record.
+ * Since the address of a thread-local variable is not a constant, it
+ * is initialised to point to `err_root_record` on first access. */
+static _tls ErrRecord *_err_record = NULL;
+
+static ErrRecord **_err_record_ptr(void)
+{
+  if (!_err_record) _err_record = &err_root_record;
+  return &_err_record;
+}
+#define err_record (*_err_record_ptr())
 
 /* Separator between appended errors */
 static char *err_append_sep = "\n - ";
@@ -78,6 +94,305 @@ static char *error_names[] = {
 };
 
 
+/* -----------------------------------
+ * Deferred formatting of error messages
+ * -----------------------------------
+ *
+ * Errors raised within an ErrTry clause are often caught and silently
+ * discarded.  To make such errors cheap, the message is not formatted
+ * when the error is raised.  Instead the format string and a copy of
+ * the arguments are packed into the `msg` buffer of the error record
+ * and `deferred` is set.  The message is formatted on demand by
+ * err_materialise(), i.e. when it is read or propagated.
+ *
+ * Packed layout (all fields are unaligned and accessed with memcpy()):
+ *
+ *     const char *file;
+ *     const char *func;
+ *     int debug_mode;
+ *     char fmt[];           NUL-terminated copy of the format string
+ *     args...               sequence of (tag, value) pairs
+ *
+ * Strings are copied (including NUL-terminator) into the argument
+ * stream, since the memory they point to may be released before the
+ * message is formatted.  Formats that cannot be packed (e.g. %n, wide
+ * characters or arguments not fitting in the buffer) are formatted
+ * directly.
+ */
+
+/* Argument tags */
+enum {
+  tagInt='i', tagLong='l', tagLongLong='L', tagSize='z', tagIntmax='j',
+  tagPtrdiff='t', tagDouble='d', tagLongDouble='D', tagPointer='p',
+  tagString='s'
+};
+
+/* Header of the packed buffer */
+typedef struct {
+  const char *file;
+  const char *func;
+  int debug_mode;
+} PackedHead;
+
+/* Appends `size` bytes from `src` to the packed buffer `buf` at `*pos`.
+   Returns non-zero if it doesn't fit. */
+static int pack(char *buf, size_t *pos, const void *src, size_t size)
+{
+  if (*pos + size > ERR_MSGSIZE) return 1;
+  memcpy(buf + *pos, src, size);
+  *pos += size;
+  return 0;
+}
+
+#define PACK(tag, type)                                         \
+  do {                                                          \
+    char t = tag;                                               \
+    type v = va_arg(ap, type);                                  \
+    if (pack(buf, &pos, &t, 1) || pack(buf, &pos, &v, sizeof(v))) \
+      return 1;                                                 \
+  } while (0)
+
+/* Parses a conversion specification in `fmt` starting after the '%'.
+   Assigns the length modifier to `len` (one of "", "hh", "h", "l",
+   "ll", "z", "j", "t" or "L") and returns a pointer to the conversion
+   character.  `*nstars` is set to the number of '*' in the width and
+   precision and `*prec` to the literal precision, -1 if no precision
+   is given or -2 if it is given as '*'. */
+static const char *parse_spec(const char *fmt, char *len, int *nstars,
+                              int *prec)
+{
+  const char *p = fmt;
+  *nstars = 0;
+  *prec = -1;
+  while (*p && strchr("-+ #0'", *p)) p++;
+  if (*p == '*') { (*nstars)++; p++; }
+  while (*p >= '0' && *p <= '9') p++;
+  if (*p == '.') {
+    p++;
+    if (*p == '*') {
+      (*nstars)++;
+      *prec = -2;
+      p++;
+    } else {
+      *prec = 0;
+      while (*p >= '0' && *p <= '9') *prec = *prec*10 + (*p++ - '0');
+    }
+  }
+  len[0] = len[1] = len[2] = '\0';
+  if ((p[0] == 'h' && p[1] == 'h') || (p[0] == 'l' && p[1] == 'l')) {
+    len[0] = *p++;
+    len[1] = *p++;
+  } else if (*p && strchr("hlzjtL", *p)) {
+    len[0] = *p++;
+  }
+  return p;
+}
+
+/* Packs `fmt` and the arguments in `ap` into `buf`.  Returns non-zero
+   if the format cannot be packed. */
+static int pack_args(char *buf, const char *file, const char *func,
+                     int debug_mode, const char *fmt, va_list ap)
+{
+  PackedHead head;
+  size_t pos = sizeof(head);
+  const char *p = fmt;
+  head.file = file;
+  head.func = func;
+  head.debug_mode = debug_mode;
+  memcpy(buf, &head, sizeof(head));
+  if (pack(buf, &pos, fmt, strlen(fmt) + 1)) return 1;
+
+  while ((p = strchr(p, '%'))) {
+    char len[3];
+    int nstars, prec, i;
+    const char *c = parse_spec(p + 1, len, &nstars, &prec);
+    for (i=0; i<nstars; i++) {
+      char t = tagInt;
+      int v = va_arg(ap, int);
+      if (pack(buf, &pos, &t, 1) || pack(buf, &pos, &v, sizeof(v))) return 1;
+      if (i == nstars - 1 && prec == -2) prec = (v < 0) ? -1 : v;
+    }
+    switch (*c) {
+    case '%':
+      break;
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+      if (*c == 'c' && len[0] == 'l') return 1;
+      switch (len[0]) {
+      case 'l':  if (len[1]) PACK(tagLongLong, long long);
+                 else PACK(tagLong, long);
+                 break;
+      case 'z':  PACK(tagSize, size_t);        break;
+      case 'j':  PACK(tagIntmax, intmax_t);    break;
+      case 't':  PACK(tagPtrdiff, ptrdiff_t);  break;
+      case 'L':  return 1;
+      default:   PACK(tagInt, int);            break;
+      }
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+    case 'a': case 'A':
+      if (len[0] == 'L') PACK(tagLongDouble, long double);
+      else PACK(tagDouble, double);
+      break;
+    case 'p':
+      PACK(tagPointer, void *);
+      break;
+    case 's':
+      {
+        char t = tagString;
+        const char *v = va_arg(ap, const char *);
+        size_t n;
+        if (len[0]) return 1;
+        if (!v) v = "(null)";
+        for (n=0; (prec < 0 || (int)n < prec) && v[n]; n++) ;
+        if (pack(buf, &pos, &t, 1) || pack(buf, &pos, v, n) ||
+            pack(buf, &pos, "", 1)) return 1;
+      }
+      break;
+    default:
+      return 1;
+    }
+    p = (*c) ? c + 1 : c;
+  }
+  return 0;
+}
+
+/* Formats the packed argument in `src` according to the conversion
+   specification `spec`.  Writes the result to `dst` and returns the
+   number of bytes that would have been written, like snprintf(). */
+static int format_arg(char *dst, size_t size, const char *spec,
+                      const char **src, int nstars)
+{
+  int stars[2];
+  int i, n=0;
+  char tag;
+  for (i=0; i<nstars; i++) {
+    *src += 1;  /* skip tag */
+    memcpy(&stars[i], *src, sizeof(int));
+    *src += sizeof(int);
+  }
+  tag = **src;
+  *src += 1;
+
+#define FMT(type)                                                       \
+  do {                                                                  \
+    type v;                                                             \
+    memcpy(&v, *src, sizeof(v));                                        \
+    *src += sizeof(v);                                                  \
+    n = (nstars == 0) ? snprintf(dst, size, spec, v) :                  \
+      (nstars == 1) ? snprintf(dst, size, spec, stars[0], v) :          \
+      snprintf(dst, size, spec, stars[0], stars[1], v);                 \
+  } while (0)
+
+  switch (tag) {
+  case tagInt:        FMT(int);          break;
+  case tagLong:       FMT(long);         break;
+  case tagLongLong:   FMT(long long);    break;
+  case tagSize:       FMT(size_t);       break;
+  case tagIntmax:     FMT(intmax_t);     break;
+  case tagPtrdiff:    FMT(ptrdiff_t);    break;
+  case tagDouble:     FMT(double);       break;
+  case tagLongDouble: FMT(long double);  break;
+  case tagPointer:    FMT(void *);       break;
+  case tagString:
+    {
+      const char *v = *src;
+      *src += strlen(v) + 1;
+      n = (nstars == 0) ? snprintf(dst, size, spec, v) :
+        (nstars == 1) ? snprintf(dst, size, spec, stars[0], v) :
+        snprintf(dst, size, spec, stars[0], stars[1], v);
+    }
+    break;
+  default:
+    assert(0);
+  }
+#undef FMT
+  return n;
+}
+
+/* Writes the message of `record` to `errmsg`, starting at position `n`.
+   Returns the number of bytes that would have been written. */
+static int write_message(char *errmsg, int n, const ErrRecord *record,
+                         const char *file, const char *func, int debug_mode,
+                         const char *msg, va_list *ap, const char *packed)
+{
+  size_t errsize = ERR_MSGSIZE;
+  char *errname = error_names[record->level];
+  int eval = record->eval;
+
+#define REST ((n < (int)errsize) ? errsize - n : 0)
+#define POS ((n < (int)errsize) ? errmsg + n : errmsg + errsize - 1)
+
+  if (err_prefix && *err_prefix)
+    n += snprintf(POS, REST, "%s: ", err_prefix);
+
+  if (debug_mode >= 1)
+    n += snprintf(POS, REST, "%s: ", file);
+  if (debug_mode >= 2)
+    n += snprintf(POS, REST, "in %s(): ", func);
+
+  if (eval) {
+    n += snprintf(POS, REST, "%s %d: ",
+                  (errname && *errname) ? errname : "Errval", eval);
+  } else if (errname && *errname) {
+    n += snprintf(POS, REST, "%s: ", errname);
+  }
+  if (msg && *msg) {
+    if (ap) {
+      n += vsnprintf(POS, REST, msg, *ap);
+    } else {
+      /* Format packed arguments, one conversion at a time */
+      const char *p = msg, *q;
+      while ((q = strchr(p, '%'))) {
+        char spec[64], len[3];
+        int nstars, prec;
+        const char *c = parse_spec(q + 1, len, &nstars, &prec);
+        size_t m = q - p;
+        if (m) {
+          if (m < REST) memcpy(POS, p, m);
+          else if (REST) memcpy(POS, p, REST - 1);
+          n += m;
+        }
+        if (*c == '%') {
+          n += snprintf(POS, REST, "%%");
+        } else if ((size_t)(c - q + 1) < sizeof(spec)) {
+          memcpy(spec, q, c - q + 1);
+          spec[c - q + 1] = '\0';
+          n += format_arg(POS, REST, spec, &packed, nstars);
+        }
+        p = (*c) ? c + 1 : c;
+      }
+      n += snprintf(POS, REST, "%s", p);
+    }
+  }
+  if (record->errnum)
+    n += snprintf(POS, REST, ": %s", strerror(record->errnum));
+#undef REST
+#undef POS
+  return n;
+}
+
+/* Formats the message of `record` if it is deferred. */
+static void err_materialise(ErrRecord *record)
+{
+  char buf[ERR_MSGSIZE];
+  const char *fmt, *packed;
+  PackedHead head;
+  int n;
+  FILE *stream;
+  if (!record->deferred) return;
+  record->deferred = 0;
+  memcpy(&head, record->msg, sizeof(head));
+  fmt = record->msg + sizeof(head);
+  packed = fmt + strlen(fmt) + 1;
+  n = write_message(buf, 0, record, head.file, head.func, head.debug_mode,
+                    fmt, NULL, packed);
+  memcpy(record->msg, buf, sizeof(buf));
+  if (n >= ERR_MSGSIZE && (stream = err_get_stream()))
+    fprintf(stream, "Warning: error %d truncated due to full message buffer",
+            record->eval);
+}
+
+
 /* Reports the error and returns `eval`.  Args:
  *  errname : name of error, e.g. "Fatal" or "Error"
  *  eval    : error value that is returned or passed exit()
@@ -91,7 +406,6 @@ int _err_vformat(ErrLevel errlevel, int eval, int errnum, const char *file,
 		 const char *func, const char *msg, va_list ap)
 {
   int n=0;
-  char *errname = error_names[errlevel];
   char *errmsg = err_record->msg;
   size_t errsize = sizeof(err_record->msg);
   FILE *stream = err_get_stream();
@@ -112,13 +426,21 @@ int _err_vformat(ErrLevel errlevel, int eval, int errnum, const char *file,
       return 0;
     case errWarnError:
       errlevel = errLevelError;
-      errname = error_names[errlevel];
       break;
     default:  // should never be reached
       assert(0);
     }
   }
 
+  /* A deferred message of an old error must be formatted, unless it is
+     simply overwritten */
+  if (err_record->deferred) {
+    if (err_record->eval && override != errOverrideOld)
+      err_materialise(err_record);
+    else
+      err_record->deferred = 0;
+  }
+
   /* Handle overridden errors */
   if (err_record->eval) {
     switch (override) {
@@ -150,30 +472,27 @@ int _err_vformat(ErrLevel errlevel, int eval, int errnum, const char *file,
   err_record->eval = eval;
   err_record->errnum = errnum;
 
-  /* Write error message */
+  /* Write error message.  If no handler will be called, the message
+     is only formatted when needed. */
   if (!ignore_new_error) {
-
-    if (err_prefix && *err_prefix)
-      n += snprintf(errmsg + n, errsize - n, "%s: ", err_prefix);
-
-    if (debug_mode >= 1)
-      n += snprintf(errmsg + n, errsize - n, "%s: ", file);
-    if (debug_mode >= 2)
-      n += snprintf(errmsg + n, errsize - n, "in %s(): ", func);
-
-    if (eval) {
-      n += snprintf(errmsg + n, errsize - n, "%s %d: ",
-                    (errname && *errname) ? errname : "Errval", eval);
-    } else if (errname && *errname) {
-      n += snprintf(errmsg + n, errsize - n, "%s: ", errname);
+    va_list aq;
+    int packed=0;
+    if (!call_handler && n == 0 && msg) {
+      va_copy(aq, ap);
+      packed = !pack_args(errmsg, file, func, debug_mode, msg, aq);
+      va_end(aq);
+    }
+    if (packed) {
+      err_record->deferred = 1;
+    } else {
+      va_copy(aq, ap);
+      n = write_message(errmsg, n, err_record, file, func, debug_mode, msg,
+                        &aq, NULL);
+      va_end(aq);
+      if (n >= (int)errsize && stream)
+        fprintf(stream, "Warning: error %d truncated due to full message "
+                "buffer", eval);
     }
-    if (msg && *msg)
-      n += vsnprintf(errmsg + n, errsize - n, msg, ap);
-    if (errnum)
-      n += snprintf(errmsg + n, errsize - n, ": %s", strerror(errnum));
-    if (n >= (int)errsize && stream)
-      fprintf(stream, "Warning: error %d truncated due to full message buffer",
-              eval);
   }
 
   /* If this error occured after the try clause in an ErrTry handler,
@@ -325,6 +644,7 @@ int err_update_eval(int eval)
 
 const char *err_getmsg(void)
 {
+  err_materialise(err_record);
   return err_record->msg;
 }
 
@@ -335,6 +655,7 @@ void err_clear(void)
   err_record->eval = 0;
   err_record->errnum = 0;
   err_record->msg[0] = '\0';
+  err_record->deferred = 0;
   err_record->handled = 0;
   err_record->reraise = 0;
   err_record->state = 0;
@@ -535,7 +856,15 @@ ErrRecord *_err_get_record()
 
 void _err_link_record(ErrRecord *record)
 {
-  memset(record, 0, sizeof(ErrRecord));
+  /* Avoid clearing the whole message buffer */
+  record->level = 0;
+  record->eval = 0;
+  record->errnum = 0;
+  record->msg[0] = '\0';
+  record->deferred = 0;
+  record->handled = 0;
+  record->reraise = 0;
+  record->state = 0;
   record->prev = err_record;
   err_record = record;
 }
@@ -546,6 +875,8 @@ void _err_unlink_record(ErrRecord *record)
   assert(err_record->prev);
   err_record = record->prev;
   if (record->reraise || (record->eval && !record->handled)) {
+    err_materialise(record);
+    err_materialise(err_record);
     int eval = (record->reraise) ? record->reraise : record->eval;
     ErrAbortMode abort_mode = err_get_abort_mode();
     int ignore_new = 0;
@@ -462,7 +462,11 @@ typedef struct ErrRecord {
   ErrLevel level;         /*!< @brief Error level. */
   int eval;               /*!< @brief Error value. */
   int errnum;             /*!< @brief System error number. */
-  char msg[ERR_MSGSIZE];  /*!< @brief Error message. */
+  char msg[ERR_MSGSIZE];  /*!< @brief Error message.  Use err_getmsg() to
+                               read it, since it may be deferred. */
+  int deferred;           /*!< @brief Whether `msg` holds a packed format
+                               string and arguments that are not yet
+                               formatted. */
   int handled;            /*!< @brief Whether the error has been handled. */
   int reraise;            /*!< @brief Error value to reraise. */
   ErrTryState state;      /*!< @brief Where we are in ErrTry.. ErrEnd. */
@@ -102,3 +102,43 @@ int fileinfo_isreadable(const char *path)
   errno = errno_orig;
   return readable;
 }
+
+/* Returns the modification time of `path` in seconds since the epoch,
+   with sub-second resolution where supported.  Returns -1 on error. */
+double fileinfo_mtime(const char *path)
+{
+#if defined(POSIX)
+  struct stat statbuf;
+  if (stat(path, &statbuf)) return -1;
+#if defined(__linux__)
+  return statbuf.st_mtim.tv_sec + 1e-9 * statbuf.st_mtim.tv_nsec;
+#else
+  return statbuf.st_mtime;
+#endif
+#elif defined(WINDOWS)
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  ULARGE_INTEGER t;
+  if (!GetFileAttributesEx(path, GetFileExInfoStandard, &data)) return -1;
+  t.LowPart = data.ftLastWriteTime.dwLowDateTime;
+  t.HighPart = data.ftLastWriteTime.dwHighDateTime;
+  /* convert from 100 ns intervals since 1601-01-01 */
+  return (double)t.QuadPart * 1e-7 - 11644473600.0;
+#endif
+}
+
+/* Returns the size of `path` in bytes.  Returns -1 on error. */
+long long fileinfo_size(const char *path)
+{
+#if defined(POSIX)
+  struct stat statbuf;
+  if (stat(path, &statbuf)) return -1;
+  return statbuf.st_size;
+#elif defined(WINDOWS)
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  ULARGE_INTEGER n;
+  if (!GetFileAttributesEx(path, GetFileExInfoStandard, &data)) return -1;
+  n.LowPart = data.nFileSizeLow;
+  n.HighPart = data.nFileSizeHigh;
+  return (long long)n.QuadPart;
+#endif
+}
@@ -19,4 +19,11 @@ int fileinfo_isnormal(const char *path);
 /** Returns non-zero if `path` is a normal file and readable. */
 int fileinfo_isreadable(const char *path);
 
+/** Returns the modification time of `path` in seconds since the epoch,
+    with sub-second resolution where supported.  Returns -1 on error. */
+double fileinfo_mtime(const char *path);
+
+/** Returns the size of `path` in bytes.  Returns -1 on error. */
+long long fileinfo_size(const char *path);
+
 #endif  /* _FILEINFO_H */
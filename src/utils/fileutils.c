@@ -19,16 +19,33 @@
 #include "windows.h"
 #include "shlwapi.h"
 #include "fileapi.h"
+#include <io.h>
+#include <limits.h>
+#else
+#include <unistd.h>
 #endif
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
 
 #include "compat.h"
 #include "err.h"
+#include "map.h"
+#include "thread.h"
 #include "globmatch.h"
 #include "fileinfo.h"
 #include "fileutils.h"
@@ -40,6 +57,15 @@
     err(1, msg, a1); goto fail; } while (0)
 
 
+/* Cached listing of a directory */
+typedef struct {
+  double mtime;          /* Modification time of directory when listed */
+  double listtime;       /* Time when the directory was listed */
+  int refcount;          /* Number of references (cache + iterators) */
+  size_t n;              /* Number of entries */
+  char **names;          /* Entry names, allocated together with the list */
+} DirList;
+
 /* Paths iterator */
 struct _FUIter {
   const char *pattern;   /* File name glob pattern to match against. */
@@ -55,6 +81,8 @@ struct _FUIter {
   FUDir *dir;            /* Currend directory corresponding to `p`. */
   int dirsep;            /* Directory separator */
   struct _FUIter *globiter;  /* Sub-iterator over glob patterns */
+  DirList *dirlist;      /* Cached listing of current directory */
+  size_t k;              /* Index of next entry in `dirlist` */
 };
 
 /* Platform names */
@@ -393,7 +421,7 @@ const char *fu_nextpath(const char *paths, char **endptr, const char *pathsep)
     p = *endptr + 1;
 
   /* ignore repeated path separators */
-  while (strchr((pathsep) ? pathsep : ";:", *p)) p++;
+  while (*p && strchr((pathsep) ? pathsep : ";:", *p)) p++;
 
   if (pathsep) {
     *endptr = p + strcspn(p, pathsep);
@@ -688,6 +716,139 @@ int fu_closedir(FUDir *dir)
   return closedir((DIR *)dir);
 }
 
+
+/* ---------------------------------------------------------- */
+
+/*
+  Directory listing cache used by fu_nextmatch().
+
+  Reading a directory is expensive on network file systems.  Listings
+  are therefore cached by directory path and reused as long as the
+  modification time of the directory is unchanged.  Since the
+  modification time may have a coarse resolution, a listing is only
+  reused if the directory was modified more than a second before it
+  was listed.
+ */
+typedef map_t(DirList *) map_dirlist_t;
+
+static map_dirlist_t _dircache;
+static int _dircache_initialised = 0;
+static ThreadMutex _dircache_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Decreases the reference count of `list` and frees it when it reaches
+   zero.  Must be called with `_dircache_mutex` locked. */
+static void dirlist_decref(DirList *list)
+{
+  if (--list->refcount <= 0) free(list);
+}
+
+/* Reads directory `path` and returns a new listing with refcount 1 or
+   NULL if it cannot be opened. */
+static DirList *dirlist_read(const char *path, double mtime)
+{
+  DIR *dir;
+  struct dirent *ent;
+  DirList *list=NULL;
+  char **names=NULL, *p;
+  size_t i, n=0, size=0, strsize=0;
+
+  if (!(dir = opendir(path))) return NULL;
+  while ((ent = readdir(dir))) {
+    if (n >= size) {
+      char **q;
+      size = (size) ? 2*size : 64;
+      if (!(q = realloc(names, size*sizeof(char *)))) goto fail;
+      names = q;
+    }
+    if (!(names[n] = strdup(ent->d_name))) goto fail;
+    strsize += strlen(names[n++]) + 1;
+  }
+
+  if (!(list = malloc(sizeof(DirList) + n*sizeof(char *) + strsize)))
+    goto fail;
+  list->mtime = mtime;
+  list->listtime = (double)time(NULL);
+  list->refcount = 1;
+  list->n = n;
+  list->names = (char **)(list + 1);
+  p = (char *)(list->names + n);
+  for (i=0; i<n; i++) {
+    size_t len = strlen(names[i]) + 1;
+    memcpy(p, names[i], len);
+    list->names[i] = p;
+    p += len;
+  }
+ fail:
+  closedir(dir);
+  for (i=0; i<n; i++) free(names[i]);
+  free(names);
+  if (!list) err(1, "allocation failure");
+  return list;
+}
+
+/* Returns a new reference to a listing of directory `path` or NULL if
+   it cannot be opened. */
+static DirList *dirlist_get(const char *path)
+{
+  DirList *list, **q;
+  double mtime = fileinfo_mtime(path);
+  if (mtime < 0) return NULL;
+
+  thread_mutex_lock(&_dircache_mutex);
+  if (!_dircache_initialised) {
+    map_init(&_dircache);
+    _dircache_initialised = 1;
+    atexit(fu_dircache_clear);
+  }
+  if ((q = map_get(&_dircache, path))) {
+    if ((*q)->mtime == mtime && mtime + 1.0 < (*q)->listtime) {
+      list = *q;
+      list->refcount++;
+      thread_mutex_unlock(&_dircache_mutex);
+      return list;
+    }
+    dirlist_decref(*q);
+    map_remove(&_dircache, path);
+  }
+  thread_mutex_unlock(&_dircache_mutex);
+
+  /* Read the directory without holding the lock */
+  if (!(list = dirlist_read(path, mtime))) return NULL;
+
+  thread_mutex_lock(&_dircache_mutex);
+  if (!map_get(&_dircache, path) && map_set(&_dircache, path, list) == 0)
+    list->refcount++;
+  thread_mutex_unlock(&_dircache_mutex);
+  return list;
+}
+
+/* Releases a reference returned by dirlist_get(). */
+static void dirlist_release(DirList *list)
+{
+  thread_mutex_lock(&_dircache_mutex);
+  dirlist_decref(list);
+  thread_mutex_unlock(&_dircache_mutex);
+}
+
+/*
+  Clears the directory listing cache used by fu_startmatch() and fu_glob().
+ */
+void fu_dircache_clear(void)
+{
+  const char *key;
+  map_iter_t iter;
+  thread_mutex_lock(&_dircache_mutex);
+  if (_dircache_initialised) {
+    iter = map_iter(&_dircache);
+    while ((key = map_next(&_dircache, &iter)))
+      dirlist_decref(*map_get(&_dircache, key));
+    map_deinit(&_dircache);
+    map_init(&_dircache);
+  }
+  thread_mutex_unlock(&_dircache_mutex);
+}
+
+
 #if 0  // XXX
 /* Like fu_opendir(), but truncates `path` at first occation of PATHSEP. */
 static FUDir *opendir_sep(const char *path)
@@ -1044,12 +1205,13 @@ static int strlist_free(char **strlist)
   return 0;
 }
 
-/* Returns a copy of NULL-terminated list of malloc'ed strings. */
+/* Returns a copy of NULL-terminated list of malloc'ed strings.
+   A NULL `strlist` is treated as an empty list. */
 static char **strlist_copy(const char **strlist)
 {
   char **cpy;
   size_t i, n=0;
-  while (strlist[n]) n++;
+  while (strlist && strlist[n]) n++;
   if (!(cpy = calloc(n+1, sizeof(char *))))
     return err(1, "allocation failure"), NULL;
   for (i=0; i<n; i++) {
@@ -1115,23 +1277,18 @@ const char *fu_nextmatch(FUIter *iter)
 
   while (iter->i < iter->origlen) {
     const char *path = iter->origpaths[iter->i];
-    if (!iter->dir) {
-      if (iter->i >= iter->origlen) return NULL;
-      if (!path[0]) path = ".";
-
-      ErrTry:
-        iter->dir = fu_opendir(path);
-      ErrCatch(fu_OpenDirectoryError):  // suppress open directory errors
-        break;
-      ErrEnd;
-
-      if (!iter->dir) {
+    if (!path[0]) path = ".";
+    if (!iter->dirlist) {
+      /* Directories that cannot be opened are silently skipped */
+      if (!(iter->dirlist = dirlist_get(path))) {
         iter->i++;
         continue;
       }
+      iter->k = 0;
     }
 
-    if ((filename = fu_nextfile(iter->dir))) {
+    if (iter->k < iter->dirlist->n) {
+      filename = iter->dirlist->names[iter->k++];
       if (globmatch(iter->pattern, filename) == 0) {
         size_t n = strlen(path) + strlen(filename) + 2;
         if (n > iter->pathsize) {
@@ -1150,9 +1307,9 @@ const char *fu_nextmatch(FUIter *iter)
           return iter->path;
       }
     } else {
-      fu_closedir(iter->dir);
+      dirlist_release(iter->dirlist);
+      iter->dirlist = NULL;
       iter->i++;
-      iter->dir = NULL;
     }
   }
   return NULL;
@@ -1166,6 +1323,7 @@ int fu_endmatch(FUIter *iter)
   int status = 0;
   if (iter->path) free(iter->path);
   if (iter->dir) fu_closedir(iter->dir);
+  if (iter->dirlist) dirlist_release(iter->dirlist);
   status |= strlist_free(iter->origpaths);
   free(iter);
   return status;
@@ -1413,3 +1571,472 @@ char *fu_readfile(FILE *fp)
   buf[newsize] = '\0';
   return buf;
 }
+
+
+
+/* -------------------------------------------------------------- */
+/* I/O engine                                                     */
+/* -------------------------------------------------------------- */
+
+/* Default number of requests in flight */
+#define FU_IO_DEFAULT_DEPTH 32
+
+#ifdef WINDOWS
+# define FU_O_BINARY O_BINARY
+#else
+# define FU_O_BINARY 0
+#endif
+
+/* I/O engine.  `ring_fd` is -1 for the pread backend. */
+struct _FUIOEngine {
+  unsigned depth;           /* max number of requests in flight */
+  int ring_fd;              /* io_uring file descriptor */
+#ifdef HAVE_IO_URING
+  unsigned sq_entries;      /* size of submission queue */
+  unsigned *sq_head;        /* submission queue head, updated by kernel */
+  unsigned *sq_tail;        /* submission queue tail */
+  unsigned *sq_mask;        /* submission queue index mask */
+  unsigned *sq_array;       /* submission queue indices into `sqes` */
+  struct io_uring_sqe *sqes;  /* submission queue entries */
+  unsigned *cq_head;        /* completion queue head */
+  unsigned *cq_tail;        /* completion queue tail, updated by kernel */
+  unsigned *cq_mask;        /* completion queue index mask */
+  struct io_uring_cqe *cqes;  /* completion queue entries */
+  void *sq_ptr;             /* mapped submission ring */
+  void *cq_ptr;             /* mapped completion ring */
+  size_t sq_len;            /* length of `sq_ptr` */
+  size_t cq_len;            /* length of `cq_ptr` */
+  size_t sqes_len;          /* length of `sqes` */
+  int nbuffers;             /* number of registered buffers */
+#endif
+};
+
+
+/* Reads or writes up to `size` bytes at `offset` with one system call.
+   Returns the number of transferred bytes or -1 on error. */
+static long long _io_transfer(FUIOOp op, int fd, void *buf, size_t size,
+                              long long offset)
+{
+#if defined HAVE_PREAD
+  return (op == fuIORead) ?
+    (long long)pread(fd, buf, size, offset) :
+    (long long)pwrite(fd, buf, size, offset);
+#elif defined WINDOWS
+  if (size > INT_MAX) size = INT_MAX;
+  if (_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+  return (op == fuIORead) ?
+    _read(fd, buf, (unsigned int)size) : _write(fd, buf, (unsigned int)size);
+#else
+  if (lseek(fd, offset, SEEK_SET) < 0) return -1;
+  return (op == fuIORead) ?
+    (long long)read(fd, buf, size) : (long long)write(fd, buf, size);
+#endif
+}
+
+/* Executes the remaining part of request `r`, of which `done` bytes
+   already are transferred, one system call at a time.  Sets
+   `r->result` and returns non-zero on error. */
+static int _io_sync(FUIORequest *r, size_t done)
+{
+  while (done < r->size) {
+    long long n = _io_transfer(r->op, r->fd, (char *)r->buf + done,
+                               r->size - done, r->offset + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      r->result = -errno;
+      return 1;
+    }
+    if (n == 0) {
+      if (r->op == fuIORead) break;  /* end of file */
+      r->result = -EIO;
+      return 1;
+    }
+    done += n;
+  }
+  r->result = done;
+  return 0;
+}
+
+
+#ifdef HAVE_IO_URING
+
+/* Sets up an io_uring for `e`.  Returns non-zero if io_uring is not
+   available, in which case `e` uses the pread backend. */
+static int _io_uring_setup(FUIOEngine *e)
+{
+  struct io_uring_params p;
+  int fd;
+  memset(&p, 0, sizeof(p));
+  if ((fd = syscall(__NR_io_uring_setup, e->depth, &p)) < 0) return 1;
+
+  e->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  e->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (e->cq_len > e->sq_len) e->sq_len = e->cq_len;
+    e->cq_len = e->sq_len;
+  }
+  e->sq_ptr = mmap(NULL, e->sq_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (e->sq_ptr == MAP_FAILED) goto fail;
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    e->cq_ptr = e->sq_ptr;
+  } else {
+    e->cq_ptr = mmap(NULL, e->cq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (e->cq_ptr == MAP_FAILED) {
+      munmap(e->sq_ptr, e->sq_len);
+      goto fail;
+    }
+  }
+  e->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  e->sqes = mmap(NULL, e->sqes_len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (e->sqes == MAP_FAILED) {
+    if (e->cq_ptr != e->sq_ptr) munmap(e->cq_ptr, e->cq_len);
+    munmap(e->sq_ptr, e->sq_len);
+    goto fail;
+  }
+  e->sq_entries = p.sq_entries;
+  e->sq_head = (unsigned *)((char *)e->sq_ptr + p.sq_off.head);
+  e->sq_tail = (unsigned *)((char *)e->sq_ptr + p.sq_off.tail);
+  e->sq_mask = (unsigned *)((char *)e->sq_ptr + p.sq_off.ring_mask);
+  e->sq_array = (unsigned *)((char *)e->sq_ptr + p.sq_off.array);
+  e->cq_head = (unsigned *)((char *)e->cq_ptr + p.cq_off.head);
+  e->cq_tail = (unsigned *)((char *)e->cq_ptr + p.cq_off.tail);
+  e->cq_mask = (unsigned *)((char *)e->cq_ptr + p.cq_off.ring_mask);
+  e->cqes = (struct io_uring_cqe *)((char *)e->cq_ptr + p.cq_off.cqes);
+  if (e->depth > e->sq_entries) e->depth = e->sq_entries;
+  e->ring_fd = fd;
+  return 0;
+ fail:
+  close(fd);
+  return 1;
+}
+
+/* Releases the io_uring of `e`. */
+static void _io_uring_free(FUIOEngine *e)
+{
+  munmap(e->sqes, e->sqes_len);
+  if (e->cq_ptr != e->sq_ptr) munmap(e->cq_ptr, e->cq_len);
+  munmap(e->sq_ptr, e->sq_len);
+  close(e->ring_fd);
+}
+
+/* Executes requests with the io_uring of `e`.  Returns the number of
+   failed requests. */
+static int _io_uring_run(FUIOEngine *e, FUIORequest *reqs, size_t n)
+{
+  size_t next=0, ncompleted=0;
+  unsigned inflight=0, nsubmit=0;
+  int nfailed=0;
+  while (ncompleted < n) {
+    unsigned head, tail = *e->sq_tail;
+    int m;
+
+    /* queue requests until `depth` are in flight */
+    while (next < n && inflight < e->depth) {
+      FUIORequest *r = reqs + next;
+      unsigned i = tail & *e->sq_mask;
+      struct io_uring_sqe *sqe = e->sqes + i;
+      memset(sqe, 0, sizeof(*sqe));
+      if (r->bufindex >= 0 && r->bufindex < e->nbuffers) {
+        sqe->opcode = (r->op == fuIORead) ?
+          IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = r->bufindex;
+      } else {
+        sqe->opcode = (r->op == fuIORead) ?
+          IORING_OP_READ : IORING_OP_WRITE;
+      }
+      sqe->fd = r->fd;
+      sqe->addr = (unsigned long)r->buf;
+      sqe->len = (r->size > 0x7ffff000) ? 0x7ffff000 : r->size;
+      sqe->off = r->offset;
+      sqe->user_data = next;
+      e->sq_array[i] = i;
+      r->result = -EIO;
+      tail++;
+      next++;
+      inflight++;
+      nsubmit++;
+    }
+    __atomic_store_n(e->sq_tail, tail, __ATOMIC_RELEASE);
+
+    /* submit and wait for at least one completion */
+    m = syscall(__NR_io_uring_enter, e->ring_fd, nsubmit, 1,
+                IORING_ENTER_GETEVENTS, NULL, 0);
+    if (m < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    nsubmit -= (unsigned)m;
+
+    /* reap completions, short transfers are completed synchronously */
+    head = *e->cq_head;
+    while (head != __atomic_load_n(e->cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = e->cqes + (head & *e->cq_mask);
+      FUIORequest *r = reqs + cqe->user_data;
+      if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP ||
+          cqe->res == -EFAULT || cqe->res == -EAGAIN)
+        nfailed += _io_sync(r, 0);  /* e.g. opcode not supported */
+      else if (cqe->res < 0)
+        r->result = cqe->res, nfailed++;
+      else if (cqe->res > 0 && (size_t)cqe->res < r->size)
+        nfailed += _io_sync(r, cqe->res);
+      else
+        r->result = cqe->res;
+      head++;
+      inflight--;
+      ncompleted++;
+    }
+    __atomic_store_n(e->cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  /* the ring failed, there is no way to wait for requests in flight */
+  if (ncompleted < n) {
+    err(1, "io_uring_enter failed");
+    for (; next < n; next++) reqs[next].result = -EIO;
+    nfailed += (int)(n - ncompleted);
+  }
+  return nfailed;
+}
+
+#endif  /* HAVE_IO_URING */
+
+
+/*
+  Returns a new I/O engine keeping up to `depth` requests in flight.
+ */
+FUIOEngine *fu_io_create(unsigned depth)
+{
+  FUIOEngine *e;
+  if (!(e = calloc(1, sizeof(FUIOEngine))))
+    return err(1, "allocation failure"), NULL;
+  e->depth = (depth) ? depth : FU_IO_DEFAULT_DEPTH;
+  e->ring_fd = -1;
+#ifdef HAVE_IO_URING
+  if (_io_uring_setup(e)) e->ring_fd = -1;
+#endif
+  return e;
+}
+
+/*
+  Frees I/O engine `e`.
+ */
+void fu_io_free(FUIOEngine *e)
+{
+  if (!e) return;
+#ifdef HAVE_IO_URING
+  if (e->ring_fd >= 0) _io_uring_free(e);
+#endif
+  free(e);
+}
+
+/*
+  Returns the name of the backend used by `e`.
+ */
+const char *fu_io_backend(const FUIOEngine *e)
+{
+  return (e && e->ring_fd >= 0) ? "io_uring" : "pread";
+}
+
+/*
+  Registers buffers with the kernel.
+ */
+int fu_io_register_buffers(FUIOEngine *e, void **bufs, const size_t *sizes,
+                           int n)
+{
+#ifdef HAVE_IO_URING
+  struct iovec *iov;
+  int i, stat;
+  if (!e || e->ring_fd < 0) return 0;
+  if (e->nbuffers) {
+    syscall(__NR_io_uring_register, e->ring_fd, IORING_UNREGISTER_BUFFERS,
+            NULL, 0);
+    e->nbuffers = 0;
+  }
+  if (n <= 0) return 0;
+  if (!(iov = calloc(n, sizeof(struct iovec))))
+    return err(1, "allocation failure");
+  for (i=0; i<n; i++) {
+    iov[i].iov_base = bufs[i];
+    iov[i].iov_len = sizes[i];
+  }
+  stat = syscall(__NR_io_uring_register, e->ring_fd, IORING_REGISTER_BUFFERS,
+                 iov, n);
+  free(iov);
+  if (stat < 0) return err(1, "cannot register %d I/O buffers", n);
+  e->nbuffers = n;
+#else
+  (void)e;
+  (void)bufs;
+  (void)sizes;
+  (void)n;
+#endif
+  return 0;
+}
+
+/*
+  Executes the `n` requests in array `reqs` and waits until they are
+  completed.  Returns the number of failed requests.
+ */
+int fu_io_run(FUIOEngine *e, FUIORequest *reqs, size_t n)
+{
+  size_t i;
+  int nfailed=0;
+#ifdef HAVE_IO_URING
+  if (e && e->ring_fd >= 0 && n > 1) return _io_uring_run(e, reqs, n);
+#else
+  (void)e;
+#endif
+  for (i=0; i<n; i++) nfailed += _io_sync(reqs + i, 0);
+  return nfailed;
+}
+
+/* Help function for fu_io_read() and fu_io_write(). */
+static long long _io_chunked(FUIOEngine *e, FUIOOp op, int fd, void *buf,
+                             size_t size, long long offset)
+{
+  FUIORequest *reqs;
+  size_t i, n = (size + FU_IO_CHUNKSIZE - 1) / FU_IO_CHUNKSIZE;
+  long long total=0;
+  if (n <= 1) {
+    FUIORequest r = {op, fd, buf, size, offset, -1, 0};
+    if (_io_sync(&r, 0)) {
+      errno = (int)-r.result;
+      return -1;
+    }
+    return r.result;
+  }
+  if (!(reqs = calloc(n, sizeof(FUIORequest))))
+    return err(1, "allocation failure"), -1;
+  for (i=0; i<n; i++) {
+    size_t pos = i * FU_IO_CHUNKSIZE;
+    reqs[i].op = op;
+    reqs[i].fd = fd;
+    reqs[i].buf = (char *)buf + pos;
+    reqs[i].size = (size - pos < FU_IO_CHUNKSIZE) ? size - pos :
+      FU_IO_CHUNKSIZE;
+    reqs[i].offset = offset + pos;
+    reqs[i].bufindex = -1;
+  }
+  if (fu_io_run(e, reqs, n)) {
+    for (i=0; i<n; i++)
+      if (reqs[i].result < 0) errno = (int)-reqs[i].result;
+    free(reqs);
+    return -1;
+  }
+  /* bytes up to the first short chunk, which is at end of file */
+  for (i=0; i<n; i++) {
+    total += reqs[i].result;
+    if ((size_t)reqs[i].result < reqs[i].size) break;
+  }
+  free(reqs);
+  return total;
+}
+
+/*
+  Reads `size` bytes at `offset` from `fd` into `buf`.  Returns the
+  number of bytes read or -1 on error.
+ */
+long long fu_io_read(FUIOEngine *e, int fd, void *buf, size_t size,
+                     long long offset)
+{
+  long long n = _io_chunked(e, fuIORead, fd, buf, size, offset);
+  if (n < 0) err(1, "error reading %lu bytes at offset %lld",
+                 (unsigned long)size, offset);
+  return n;
+}
+
+/*
+  Writes `size` bytes from `buf` to `fd` at `offset`.  Returns
+  non-zero on error.
+ */
+int fu_io_write(FUIOEngine *e, int fd, const void *buf, size_t size,
+                long long offset)
+{
+  if (_io_chunked(e, fuIOWrite, fd, (void *)buf, size, offset) < 0)
+    return err(1, "error writing %lu bytes at offset %lld",
+               (unsigned long)size, offset);
+  return 0;
+}
+
+/*
+  Gives the kernel a hint about how a file will be accessed.
+ */
+int fu_io_advise(int fd, long long offset, long long len, FUIOAdvice advice)
+{
+#ifdef HAVE_POSIX_FADVISE
+  int stat, adv = POSIX_FADV_NORMAL;
+  switch (advice) {
+  case fuIONormal:     adv = POSIX_FADV_NORMAL;     break;
+  case fuIOSequential: adv = POSIX_FADV_SEQUENTIAL; break;
+  case fuIORandom:     adv = POSIX_FADV_RANDOM;     break;
+  case fuIOWillNeed:   adv = POSIX_FADV_WILLNEED;   break;
+  case fuIODontNeed:   adv = POSIX_FADV_DONTNEED;   break;
+  }
+  if ((stat = posix_fadvise(fd, offset, len, adv)))
+    return errx(1, "posix_fadvise failed: %s", strerror(stat));
+#else
+  (void)fd;
+  (void)offset;
+  (void)len;
+  (void)advice;
+#endif
+  return 0;
+}
+
+/*
+  Reads file `path` into a malloc'ed and NUL-terminated buffer.
+ */
+char *fu_io_readfile(FUIOEngine *e, const char *path, size_t *size)
+{
+  struct stat st;
+  char *buf=NULL;
+  long long n=0;
+  int fd;
+  if ((fd = open(path, O_RDONLY | FU_O_BINARY)) < 0)
+    return err(1, "cannot open file: \"%s\"", path), NULL;
+  if (fstat(fd, &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG &&
+      st.st_size > 0) {
+    FUIOEngine *tmp=NULL;
+    if (!e && st.st_size > 4*FU_IO_CHUNKSIZE) e = tmp = fu_io_create(0);
+    fu_io_advise(fd, 0, 0, fuIOSequential);
+    if (!(buf = malloc(st.st_size + 1))) {
+      err(1, "allocation failure");
+    } else if ((n = fu_io_read(e, fd, buf, st.st_size, 0)) < 0) {
+      free(buf);
+      buf = NULL;
+    }
+    fu_io_free(tmp);
+  } else {
+    /* size unknown, e.g. a pipe */
+    size_t bufsize=0;
+    long long m=1;
+    char *p;
+    while (m > 0) {
+      if (n + FU_IO_CHUNKSIZE > (long long)bufsize) {
+        bufsize += FU_IO_CHUNKSIZE;
+        if (!(p = realloc(buf, bufsize + 1))) {
+          err(1, "allocation failure");
+          break;
+        }
+        buf = p;
+      }
+      if ((m = read(fd, buf + n, bufsize - n)) > 0)
+        n += m;
+      else if (m < 0 && errno == EINTR)
+        m = 1;
+      else if (m < 0)
+        err(1, "error reading file \"%s\"", path);
+    }
+    if (m != 0 && buf) {
+      free(buf);
+      buf = NULL;
+    }
+  }
+  close(fd);
+  if (!buf) return NULL;
+  buf[n] = '\0';
+  if (size) *size = n;
+  return buf;
+}
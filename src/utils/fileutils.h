@@ -84,6 +84,37 @@ typedef struct _FUPaths {
 /** File matching iterator. */
 typedef struct _FUIter FUIter;
 
+/** I/O engine for batched reads and writes. */
+typedef struct _FUIOEngine FUIOEngine;
+
+/** Type of I/O request. */
+typedef enum _FUIOOp {
+  fuIORead,              /*!< Read into buffer */
+  fuIOWrite              /*!< Write from buffer */
+} FUIOOp;
+
+/** Access pattern hint passed to fu_io_advise(). */
+typedef enum _FUIOAdvice {
+  fuIONormal,            /*!< No particular access pattern */
+  fuIOSequential,        /*!< Data will be accessed sequentially */
+  fuIORandom,            /*!< Data will be accessed in random order */
+  fuIOWillNeed,          /*!< Data will be accessed soon, read ahead */
+  fuIODontNeed           /*!< Data will not be accessed soon */
+} FUIOAdvice;
+
+/** A read or write request at a given file offset. */
+typedef struct _FUIORequest {
+  FUIOOp op;             /*!< Type of request */
+  int fd;                /*!< File descriptor */
+  void *buf;             /*!< Buffer to read into or write from */
+  size_t size;           /*!< Number of bytes to transfer */
+  long long offset;      /*!< File offset */
+  int bufindex;          /*!< Index of registered buffer containing `buf`
+                              or -1 */
+  long long result;      /*!< Set to number of transferred bytes or a
+                              negative errno value on error */
+} FUIORequest;
+
 
 /**
   Returns native platform.
@@ -522,6 +553,17 @@ const char *fu_globnext(FUIter *iter);
  */
 int fu_globend(FUIter *iter);
 
+/**
+  Clears the directory listing cache.
+
+  fu_startmatch() and fu_glob() cache directory listings and reuse
+  them as long as the modification time of the directory is
+  unchanged.  Call this function to force directories to be re-read,
+  e.g. on file systems that do not update the modification time of
+  directories.
+*/
+void fu_dircache_clear(void);
+
 /**
   Sets the directory separator in returned by fu_nextmatch() and
   fu_globnext().  Defaults to DIRSEP.
@@ -537,4 +579,107 @@ void fu_iter_set_dirsep(FUIter *iter, int dirsep);
 char *fu_readfile(FILE *fp);
 
 
+/**
+  @name I/O engine
+  Batched reads and writes at given file offsets.
+
+  On Linux, requests are submitted with io_uring, keeping up to
+  `depth` of them in flight, such that a fast device is kept busy
+  with one system call per batch instead of one per request.
+  Elsewhere, or if io_uring is not permitted by the kernel, the
+  requests are executed one at a time with pread() and pwrite().
+
+  An engine must only be used by one thread at a time.  Functions
+  taking an engine also accept NULL, in which case the requests are
+  executed one at a time.
+  @{
+ */
+
+/** Chunk size that fu_io_read(), fu_io_write() and fu_io_readfile()
+    split transfers into. */
+#ifndef FU_IO_CHUNKSIZE
+# define FU_IO_CHUNKSIZE (256*1024)
+#endif
+
+/**
+  Returns a new I/O engine keeping up to `depth` requests in flight,
+  or NULL on error.  If `depth` is zero, a default of 32 is used.
+ */
+FUIOEngine *fu_io_create(unsigned depth);
+
+/**
+  Frees I/O engine `e`.
+ */
+void fu_io_free(FUIOEngine *e);
+
+/**
+  Returns the name of the backend used by `e`; "io_uring" or "pread".
+ */
+const char *fu_io_backend(const FUIOEngine *e);
+
+/**
+  Registers the `n` buffers `bufs` with sizes `sizes` with the kernel,
+  such that requests referring to them by their index in `bufs`
+  (see FUIORequest.bufindex) avoid mapping the pages for every
+  transfer.  Previously registered buffers are unregistered.  The
+  buffers must be kept alive until they are unregistered or `e` is
+  free'ed.
+
+  Returns non-zero on error.  Registering buffers is a no-op for the
+  pread backend.
+ */
+int fu_io_register_buffers(FUIOEngine *e, void **bufs, const size_t *sizes,
+                           int n);
+
+/**
+  Executes the `n` requests in array `reqs` and waits until they are
+  completed.  The requests may be executed in any order.  The `result`
+  field of each request is set.  Short reads only occur at end of file.
+
+  Returns the number of failed requests.
+ */
+int fu_io_run(FUIOEngine *e, FUIORequest *reqs, size_t n);
+
+/**
+  Reads `size` bytes at `offset` from file descriptor `fd` into `buf`
+  with `e`, split into chunks of FU_IO_CHUNKSIZE bytes.
+
+  Returns the number of bytes read, which is less than `size` only at
+  end of file, or -1 on error.
+ */
+long long fu_io_read(FUIOEngine *e, int fd, void *buf, size_t size,
+                     long long offset);
+
+/**
+  Writes `size` bytes from `buf` to file descriptor `fd` at `offset`
+  with `e`, split into chunks of FU_IO_CHUNKSIZE bytes.
+
+  Returns non-zero on error.
+ */
+int fu_io_write(FUIOEngine *e, int fd, const void *buf, size_t size,
+                long long offset);
+
+/**
+  Gives the kernel a hint about how the `len` bytes at `offset` of
+  file descriptor `fd` will be accessed.  If `len` is zero, the hint
+  applies to the rest of the file.  Does nothing on systems without
+  posix_fadvise().
+
+  Returns non-zero on error.
+ */
+int fu_io_advise(int fd, long long offset, long long len, FUIOAdvice advice);
+
+/**
+  Reads file `path` with `e` into a malloc'ed and NUL-terminated
+  buffer.  If `size` is not NULL, it is assigned to the size of the
+  file.  If `e` is NULL and the file is larger than a few chunks, a
+  temporary engine is used.
+
+  Returns a pointer to the buffer or NULL on error.
+ */
+char *fu_io_readfile(FUIOEngine *e, const char *path, size_t *size);
+
+/** @} */
+
+
 #endif  /*  _FILEUTILS_H */
@@ -0,0 +1,81 @@
+/* floatfmt.h -- fast round-trip formatting and parsing of floats
+ *
+ * Copyright (c) 2024, SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ *
+ */
+#ifndef _FLOATFMT_H
+#define _FLOATFMT_H
+
+/**
+  @file
+  @brief Fast round-trip formatting and parsing of floats.
+
+  fmtdouble() and fmtfloat() write the shortest decimal representation
+  that reads back to exactly the same value.  The Grisu2 algorithm is
+  used for that, which always round-trips and produces the shortest
+  output for the vast majority of values (otherwise a digit longer).
+
+  fast_strtod() and fast_strtof() are correctly rounded drop-in
+  replacements for strtod() and strtof().  Plain decimal numbers are
+  converted with the Eisel-Lemire algorithm, while the rare ambiguous
+  cases, subnormals and other syntaxes (hex floats, inf, nan) are
+  delegated to the C library.
+
+  fast_strtoll() and fast_strtoull() are the corresponding drop-in
+  replacements for strtoll() and strtoull().  Long runs of decimal
+  digits are converted eight at a time with SWAR arithmetic on
+  little-endian hosts.
+*/
+
+/** Minimum size of the buffer passed to fmtdouble() and fmtfloat(). */
+#define FMTFLOAT_BUFSIZE 32
+
+
+/**
+  Writes the shortest representation of `v` that round-trips to `buf`,
+  which must have space for at least FMTFLOAT_BUFSIZE bytes.
+
+  The output resembles the "%g" printf() format, but with as many
+  digits as needed.  Exponential notation is used when the decimal
+  exponent is less than -4 or larger than 15.
+
+  Returns the length of the written string (excluding the terminating
+  NUL).
+ */
+int fmtdouble(char *buf, double v);
+
+/**
+  Like fmtdouble(), but for single precision.
+ */
+int fmtfloat(char *buf, float v);
+
+/**
+  Converts the initial part of the string `s` to double.  Has the same
+  semantics as strtod(), but is faster for plain decimal numbers.
+ */
+double fast_strtod(const char *s, char **endptr);
+
+/**
+  Converts the initial part of the string `s` to float.  Has the same
+  semantics as strtof(), but is faster for plain decimal numbers.
+ */
+float fast_strtof(const char *s, char **endptr);
+
+/**
+  Converts the initial part of the string `s` to long long.  Has the
+  same semantics as strtoll(), but is faster for plain decimal numbers
+  with base 0 or 10.
+ */
+long long fast_strtoll(const char *s, char **endptr, int base);
+
+/**
+  Converts the initial part of the string `s` to unsigned long long.
+  Has the same semantics as strtoull(), but is faster for plain decimal
+  numbers with base 0 or 10.
+ */
+unsigned long long fast_strtoull(const char *s, char **endptr, int base);
+
+
+#endif /* _FLOATFMT_H */
@@ -72,7 +72,8 @@ typedef enum {
 
 /* Token types */
 typedef enum {
-  typeVal,  /* Value (number or variable) */
+  typeVal,  /* Number */
+  typeVar,  /* Variable */
   typeOp    /* Operator */
 } TokenType;
 
@@ -80,7 +81,7 @@ typedef enum {
 typedef struct {
   TokenType type;  /* Token type */
   union {
-    int val;       /* Value for numbers and variables */
+    int val;       /* Value for numbers, index for variables */
     int op;        /* Operator */
   } u;
 } TokenValue;
@@ -231,62 +232,80 @@ static int parse_token(const char *str, TokenValue *val,
     return 1;
 
   } else if ((var = get_variable(str, vars, nvars))) {
-    val->type = typeVal;
-    val->u.val = var->value;
+    val->type = typeVar;
+    val->u.val = (int)(var - vars);
     return (int)strlen(var->name);
   }
 
   return -1;
 }
 
-/* Evaluates operator `op` taking operands from the value stack
-  `vstack` and and push the result back onto `vstack`.
+/* Compiled expression.
+
+   The program is a sequence of instructions in postfix order.  Each
+   instruction is a pair of ints `(code, arg)`, where `code` is either
+   codeConst (push `arg`), codeVar (push the value of variable number
+   `arg`) or an operator (pop two operands and push the result). */
+struct _InfixCalcCode {
+  size_t ninstr;  /* number of instructions */
+  size_t depth;   /* maximum depth of the value stack */
+  int prog[];     /* program, length 2*ninstr */
+};
+
+/* Instruction codes other than operators */
+enum {
+  codeConst = 0,  /* push constant */
+  codeVar   = 1   /* push variable */
+};
+
+/* Evaluates operator `op` at compile time by appending it to the
+  program `prog`.  `depth` is the current depth of the value stack.
 
   Returns non-zero on error and write an message to `err`. */
-static int eval(Operator op, Stack *vstack, char *err, size_t errlen)
+static int eval(Operator op, Stack *prog, size_t *depth,
+                char *err, size_t errlen)
 {
   const OpInfo *opinfo = get_opinfo(op);
-  int value;
-  if (vstack->len < opinfo->nargs) {
+  if (*depth < opinfo->nargs) {
     snprintf(err, errlen, "too few arguments for operator '%c'", op);
     return -1;
   }
-  if (opinfo->nargs == 2) {
-    int arg2 = pop(vstack);
-    int arg1 = pop(vstack);
-    value = binary_eval(op, arg1, arg2);
-  } else {
+  if (opinfo->nargs != 2) {
     snprintf(err, errlen, "%lu-ary operators are not implemented",
              (unsigned long)opinfo->nargs);
     return -1;
   }
-  push(vstack, value);
+  push(prog, op);
+  push(prog, 0);
+  *depth -= 1;
   return 0;
 }
 
 
 /*
-  Parses the infix expression `expr` and returns the evaluated result.
+  Compiles the infix expression `expr` to a program that later can be
+  evaluated with infixcalc_eval().
 
-  The array `vars` lists available variables and should have length `nvars`.
-  If there are no variables, `vars` may be set to NULL.
+  The array `vars` lists available variables and should have length
+  `nvars`.  Only the variable names are used.
 
-  On error, a message will be written to `err`.  No more than `errlen`
-  characters will be written.  On success `err[0]` will be set to NUL.
-  If one is not interested to check for errors, one can set `err` to NULL.
+  Returns a newly allocated program or NULL on error, in which case a
+  message is written to `err`.
 */
-int infixcalc(const char *expr, const InfixCalcVariable *vars, size_t nvars,
-              char *err, size_t errlen)
+InfixCalcCode *infixcalc_compile(const char *expr,
+                                 const InfixCalcVariable *vars, size_t nvars,
+                                 char *err, size_t errlen)
 {
-  Stack vstack, ostack;
+  Stack prog, ostack;
   const char *p=expr;
   const OpInfo *opinfo;
   TokenValue token;
   Operator op;
-  int result=INT_MIN;
+  size_t depth=0, maxdepth=0;
+  InfixCalcCode *code=NULL;
 
   if (err && errlen) err[0] = '\0';
-  memset(&vstack, 0, sizeof(vstack));
+  memset(&prog, 0, sizeof(prog));
   memset(&ostack, 0, sizeof(ostack));
 
   while (isspace(*p)) p++;
@@ -300,7 +319,10 @@ int infixcalc(const char *expr, const InfixCalcVariable *vars, size_t nvars,
     }
     switch (token.type) {
     case typeVal:
-      push(&vstack, token.u.val);
+    case typeVar:
+      push(&prog, (token.type == typeVal) ? codeConst : codeVar);
+      push(&prog, token.u.val);
+      if (++depth > maxdepth) maxdepth = depth;
       break;
 
     case typeOp:
@@ -309,13 +331,13 @@ int infixcalc(const char *expr, const InfixCalcVariable *vars, size_t nvars,
         push(&ostack, token.u.op);
         break;
       case ')':
-        while ((op = pop(&ostack)) != '(') {
+        while (!ostack.len || (op = pop(&ostack)) != '(') {
           if (!ostack.len) {
             snprintf(err, errlen,
                      "missing start parenthesis in expression \"%s\"", expr);
             goto fail;
           }
-          if (eval(op, &vstack, err, errlen)) goto fail;
+          if (eval(op, &prog, &depth, err, errlen)) goto fail;
         }
         break;
       default:
@@ -324,7 +346,7 @@ int infixcalc(const char *expr, const InfixCalcVariable *vars, size_t nvars,
           const OpInfo *opinfo2 = get_opinfo(poll(&ostack));
           if (opinfo2->precedence < opinfo->precedence) break;
           op = pop(&ostack);
-          if (eval(op, &vstack, err, errlen)) goto fail;
+          if (eval(op, &prog, &depth, err, errlen)) goto fail;
         }
         push(&ostack, token.u.op);
         break;
@@ -336,23 +358,102 @@ int infixcalc(const char *expr, const InfixCalcVariable *vars, size_t nvars,
 
   while (ostack.len) {
     op = pop(&ostack);
-    if (eval(op, &vstack, err, errlen)) goto fail;
+    if (eval(op, &prog, &depth, err, errlen)) goto fail;
   }
 
-  if (vstack.len > 1) {
+  if (depth > 1) {
     snprintf(err, errlen, "missing operator in expression \"%s\"", expr);
     goto fail;
-  } else  if (vstack.len < 1) {
+  } else  if (depth < 1) {
     snprintf(err, errlen, "missing operands in expression \"%s\"", expr);
     goto fail;
   }
   assert(ostack.len == 0);
-  assert(vstack.len == 1);
-  result = pop(&vstack);
+
+  if (!(code = malloc(sizeof(InfixCalcCode) + prog.len*sizeof(int)))) {
+    snprintf(err, errlen, "allocation failure");
+    goto fail;
+  }
+  code->ninstr = prog.len / 2;
+  code->depth = maxdepth;
+  memcpy(code->prog, prog.items, prog.len*sizeof(int));
 
  fail:
-  if (vstack.size) free(vstack.items);
+  if (prog.size) free(prog.items);
   if (ostack.size) free(ostack.items);
+  return code;
+}
+
+
+/* Runs program `code`.  The value of variable `i` is `values[i]` if
+   `values` is not NULL and `vars[i].value` otherwise. */
+static int run(const InfixCalcCode *code, const int *values,
+               const InfixCalcVariable *vars)
+{
+  int buf[32], *stack=buf, result;
+  size_t i, n=0;
+  if (code->depth > sizeof(buf)/sizeof(int) &&
+      !(stack = malloc(code->depth*sizeof(int))))
+    return INT_MIN;
+  for (i=0; i < 2*code->ninstr; i+=2) {
+    int arg = code->prog[i+1];
+    switch (code->prog[i]) {
+    case codeConst:
+      stack[n++] = arg;
+      break;
+    case codeVar:
+      stack[n++] = (values) ? values[arg] : vars[arg].value;
+      break;
+    default:
+      n--;
+      stack[n-1] = binary_eval(code->prog[i], stack[n-1], stack[n]);
+      break;
+    }
+  }
+  assert(n == 1);
+  result = stack[0];
+  if (stack != buf) free(stack);
+  return result;
+}
+
+
+/*
+  Evaluates compiled expression `code` and returns the result.
+*/
+int infixcalc_eval(const InfixCalcCode *code, const int *values)
+{
+  return run(code, values, NULL);
+}
+
+
+/*
+  Frees compiled expression `code`.
+*/
+void infixcalc_free(InfixCalcCode *code)
+{
+  free(code);
+}
+
+
+/*
+  Parses the infix expression `expr` and returns the evaluated result.
+
+  The array `vars` lists available variables and should have length `nvars`.
+  If there are no variables, `vars` may be set to NULL.
+
+  On error, a message will be written to `err`.  No more than `errlen`
+  characters will be written.  On success `err[0]` will be set to NUL.
+  If one is not interested to check for errors, one can set `err` to NULL.
+*/
+int infixcalc(const char *expr, const InfixCalcVariable *vars, size_t nvars,
+              char *err, size_t errlen)
+{
+  InfixCalcCode *code;
+  int result;
+  if (!(code = infixcalc_compile(expr, vars, nvars, err, errlen)))
+    return INT_MIN;
+  result = run(code, NULL, vars);
+  infixcalc_free(code);
   return result;
 }
 
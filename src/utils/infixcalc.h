@@ -54,6 +54,42 @@ int infixcalc(const char *expr, const InfixCalcVariable *vars, size_t nvars,
               char *err, size_t errlen);
 
 
+/** Opaque type for a compiled expression. */
+typedef struct _InfixCalcCode InfixCalcCode;
+
+
+/**
+  Compiles the infix expression `expr` to a program that later can be
+  evaluated with infixcalc_eval().  This avoids parsing the same
+  expression over and over again.
+
+  The array `vars` lists available variables and should have length
+  `nvars`.  Only the variable names are used.  Variables are
+  referred to by their index in `vars`.
+
+  Returns a newly allocated program or NULL on error, in which case a
+  message is written to `err` (see infixcalc()).  The returned program
+  should be released with infixcalc_free().
+*/
+InfixCalcCode *infixcalc_compile(const char *expr,
+                                 const InfixCalcVariable *vars, size_t nvars,
+                                 char *err, size_t errlen);
+
+/**
+  Evaluates compiled expression `code` and returns the result.
+
+  `values` is an array with the values of the variables passed to
+  infixcalc_compile(), in the same order.  It may be NULL if the
+  expression has no variables.
+*/
+int infixcalc_eval(const InfixCalcCode *code, const int *values);
+
+/**
+  Frees compiled expression `code`.
+*/
+void infixcalc_free(InfixCalcCode *code);
+
+
 /**
   Returns non-zero if variable `varname` is in expression `expr`.
  */
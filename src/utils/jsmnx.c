@@ -7,8 +7,24 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define JSMNX_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSMNX_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define JSMNX_NEON
+#include <arm_neon.h>
+#endif
+
 #include "err.h"
 
 /* Include the jsmn.h header without defining JSMN_HEADER defined.
@@ -20,14 +36,599 @@
 
 
 /*
-  Like jsmn_parse(), but realloc's the buffer pointed to by `tokens_ptr`
-  if it is too small.  `num_tokens_ptr` should point to the number of
-  allocated tokens.
+ * Fast structural scanner
+ * -----------------------
+ *
+ * The input is processed in blocks of 64 bytes.  For each block,
+ * bitmasks of quotes, backslashes, operators ({}[]:,) and whitespace
+ * are computed with SIMD instructions (selected at runtime), from
+ * which the positions of the structural characters outside strings
+ * and the start of primitives are found without looking at the
+ * characters one by one.
+ *
+ * The structural characters are fed to a strict JSON state machine
+ * producing the same tokens as jsmn_parse().  Input that isn't plain
+ * JSON (including input that jsmn_parse() would reject) makes the
+ * scanner give up, in which case jsmn_parse() is used instead.  Hence
+ * results and error codes are always the same as with jsmn_parse().
+ *
+ * In compact mode (see jsmn_parse_compact()), large arrays of numbers
+ * are scanned with numeric_array_end() and the blocks they span are
+ * skipped.
+ */
+
+#define BLOCK_SIZE 64
+
+/* Bitmasks of a block.  Bit `i` corresponds to byte `i` in the block. */
+typedef struct {
+  uint64_t quote;       /* double quotes */
+  uint64_t bs;          /* backslashes */
+  uint64_t op;          /* operators: {}[]:, */
+  uint64_t ws;          /* whitespace */
+} BlockMasks;
+
+typedef void (*BlockMasksFunc)(const unsigned char *p, BlockMasks *m);
+
+/* Container on the stack of the state machine */
+typedef struct {
+  int tok;              /* index of the object or array token */
+  int key;              /* index of the current key (objects only) */
+  int isobj;            /* whether the container is an object */
+} Level;
+
+/* States of the state machine */
+typedef enum {
+  S_VALUE,              /* expects a value */
+  S_ARRAY_FIRST,        /* after '[', expects a value or ']' */
+  S_OBJECT_FIRST,       /* after '{', expects a key or '}' */
+  S_KEY,                /* after ',' in an object, expects a key */
+  S_COLON,              /* after a key, expects ':' */
+  S_NEXT,               /* after a value, expects ',' or closing bracket */
+  S_STRING,             /* inside a string, expects closing quote */
+  S_DONE,               /* the root value is parsed */
+  S_ERROR               /* the input cannot be handled by the scanner */
+} ScanState;
+
+/* Scanner */
+typedef struct {
+  const char *js;       /* JSON source */
+  size_t len;           /* length of `js` */
+  jsmntok_t *tokens;    /* tokens, NULL if only counting */
+  unsigned int size;    /* allocated number of tokens */
+  int grow;             /* whether `tokens` may be reallocated */
+  int ntokens;          /* number of tokens */
+  Level *stack;         /* stack of open containers */
+  int depth;            /* number of open containers */
+  int stacksize;        /* allocated size of stack */
+  ScanState state;      /* current state */
+  int strstart;         /* position of opening quote of current string */
+  int strkey;           /* whether current string is a key */
+  size_t compact;       /* min. length of compact numeric arrays, 0 if off */
+  size_t skip;          /* position to skip to after a compact array */
+} Scanner;
+
+
+/* Scalar implementation of block_masks(). */
+static void block_masks_scalar(const unsigned char *p, BlockMasks *m)
+{
+  int i;
+  memset(m, 0, sizeof(BlockMasks));
+  for (i=0; i<BLOCK_SIZE; i++) {
+    uint64_t bit = (uint64_t)1 << i;
+    switch (p[i]) {
+    case '"':  m->quote |= bit; break;
+    case '\\': m->bs |= bit; break;
+    case '{': case '}': case '[': case ']': case ':': case ',':
+      m->op |= bit; break;
+    case ' ': case '\t': case '\n': case '\r':
+      m->ws |= bit; break;
+    }
+  }
+}
+
+#ifdef JSMNX_SSE2
+/* SSE2 implementation of block_masks(). */
+static void block_masks_sse2(const unsigned char *p, BlockMasks *m)
+{
+  int i;
+  memset(m, 0, sizeof(BlockMasks));
+  for (i=0; i<BLOCK_SIZE; i+=16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+#define EQ(c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define MASK(x) ((uint64_t)(unsigned)_mm_movemask_epi8(x) << i)
+    m->quote |= MASK(EQ('"'));
+    m->bs |= MASK(EQ('\\'));
+    m->op |= MASK(_mm_or_si128(_mm_or_si128(_mm_or_si128(EQ('{'), EQ('}')),
+                                            _mm_or_si128(EQ('['), EQ(']'))),
+                               _mm_or_si128(EQ(':'), EQ(','))));
+    m->ws |= MASK(_mm_or_si128(_mm_or_si128(EQ(' '), EQ('\t')),
+                               _mm_or_si128(EQ('\n'), EQ('\r'))));
+#undef MASK
+#undef EQ
+  }
+}
+#endif
+
+#ifdef JSMNX_AVX2
+/* AVX2 implementation of block_masks(). */
+__attribute__((target("avx2")))
+static void block_masks_avx2(const unsigned char *p, BlockMasks *m)
+{
+  int i;
+  memset(m, 0, sizeof(BlockMasks));
+  for (i=0; i<BLOCK_SIZE; i+=32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+#define EQ(c) _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))
+#define MASK(x) ((uint64_t)(uint32_t)_mm256_movemask_epi8(x) << i)
+    m->quote |= MASK(EQ('"'));
+    m->bs |= MASK(EQ('\\'));
+    m->op |= MASK(_mm256_or_si256(
+        _mm256_or_si256(_mm256_or_si256(EQ('{'), EQ('}')),
+                        _mm256_or_si256(EQ('['), EQ(']'))),
+        _mm256_or_si256(EQ(':'), EQ(','))));
+    m->ws |= MASK(_mm256_or_si256(_mm256_or_si256(EQ(' '), EQ('\t')),
+                                  _mm256_or_si256(EQ('\n'), EQ('\r'))));
+#undef MASK
+#undef EQ
+  }
+}
+#endif
+
+#ifdef JSMNX_NEON
+/* Returns a bitmask with the most significant bit of each of the 64
+   bytes in `a`, `b`, `c` and `d`, which must be either 0 or 0xff. */
+static uint64_t neon_movemask(uint8x16_t a, uint8x16_t b,
+                              uint8x16_t c, uint8x16_t d)
+{
+  static const uint8_t w[16] =
+    {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t bits = vld1q_u8(w);
+  uint8x16_t s0 = vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits));
+  uint8x16_t s1 = vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits));
+  s0 = vpaddq_u8(s0, s1);
+  s0 = vpaddq_u8(s0, s0);
+  return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+}
+
+/* NEON implementation of block_masks(). */
+static void block_masks_neon(const unsigned char *p, BlockMasks *m)
+{
+  uint8x16_t v[4], quote[4], bs[4], op[4], ws[4];
+  int i;
+  for (i=0; i<4; i++) {
+    v[i] = vld1q_u8(p + 16*i);
+#define EQ(c) vceqq_u8(v[i], vdupq_n_u8(c))
+    quote[i] = EQ('"');
+    bs[i] = EQ('\\');
+    op[i] = vorrq_u8(vorrq_u8(vorrq_u8(EQ('{'), EQ('}')),
+                              vorrq_u8(EQ('['), EQ(']'))),
+                     vorrq_u8(EQ(':'), EQ(',')));
+    ws[i] = vorrq_u8(vorrq_u8(EQ(' '), EQ('\t')),
+                     vorrq_u8(EQ('\n'), EQ('\r')));
+#undef EQ
+  }
+  m->quote = neon_movemask(quote[0], quote[1], quote[2], quote[3]);
+  m->bs = neon_movemask(bs[0], bs[1], bs[2], bs[3]);
+  m->op = neon_movemask(op[0], op[1], op[2], op[3]);
+  m->ws = neon_movemask(ws[0], ws[1], ws[2], ws[3]);
+}
+#endif
+
+/* Returns the best implementation of block_masks() supported by the
+   current CPU. */
+static BlockMasksFunc block_masks_select(void)
+{
+#ifdef JSMNX_AVX2
+  if (__builtin_cpu_supports("avx2")) return block_masks_avx2;
+#endif
+#ifdef JSMNX_SSE2
+  return block_masks_sse2;
+#elif defined(JSMNX_NEON)
+  return block_masks_neon;
+#endif
+  return block_masks_scalar;
+}
+
+/* Returns the number of trailing zero bits in `x`, which must be
+   non-zero. */
+static int ctz64(uint64_t x)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n=0;
+  while (!(x & 1)) { x >>= 1; n++; }
+  return n;
+#endif
+}
+
+/* Returns a mask with the characters escaped by the backslashes in
+   `bs`.  `carry` is non-zero if the first character in the block is
+   escaped by a backslash at the end of the previous block and is
+   updated for the next block. */
+static uint64_t find_escaped(uint64_t bs, uint64_t *carry)
+{
+  uint64_t escaped = *carry;
+  *carry = 0;
+  while (bs) {
+    int i = ctz64(bs);
+    uint64_t bit = (uint64_t)1 << i;
+    bs &= ~bit;
+    if (escaped & bit) continue;  // escaped backslash
+    if (i == BLOCK_SIZE - 1)
+      *carry = 1;
+    else
+      escaped |= bit << 1;
+  }
+  return escaped;
+}
+
+/* Returns a mask where each bit is the xor of all lower bits in `x`,
+   i.e. the bits from an opening to a closing quote are set. */
+static uint64_t prefix_xor(uint64_t x)
+{
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+/* Adds a new token to the scanner.  Like jsmn_parse(), the parent of
+   a key is the object and the parent of a value in an object is the
+   key.  Returns non-zero on error. */
+static int scan_token(Scanner *sc, jsmntype_t type, int start, int end,
+                      int iskey)
+{
+  jsmntok_t *t;
+  Level *top = (sc->depth) ? sc->stack + sc->depth - 1 : NULL;
+  if (sc->tokens) {
+    if ((unsigned)sc->ntokens >= sc->size) {
+      unsigned int size = (sc->size) ? sc->size * 2 : 64;
+      if (!sc->grow || !(t = realloc(sc->tokens, size*sizeof(jsmntok_t)))) {
+        sc->state = S_ERROR;
+        return 1;
+      }
+      sc->tokens = t;
+      sc->size = size;
+    }
+    t = sc->tokens + sc->ntokens;
+    t->type = type;
+    t->start = start;
+    t->end = end;
+    t->size = 0;
+    t->parent = -1;
+    if (top) {
+      t->parent = (top->isobj && !iskey) ? top->key : top->tok;
+      sc->tokens[t->parent].size++;
+    }
+  }
+  sc->ntokens++;
+  return 0;
+}
+
+/* Called when a value is completed. */
+static void scan_value_done(Scanner *sc)
+{
+  sc->state = (sc->depth) ? S_NEXT : S_DONE;
+}
+
+/* Returns non-zero if the string between positions `start` and `end`
+   has only the escape sequences accepted by jsmn_parse(). */
+static int valid_escapes(const char *js, int start, int end)
+{
+  const char *p = js + start, *stop = js + end;
+  while ((p = memchr(p, '\\', stop - p))) {
+    int i;
+    if (++p >= stop) return 0;
+    switch (*p) {
+    case '"': case '/': case '\\': case 'b': case 'f': case 'r': case 'n':
+    case 't':
+      break;
+    case 'u':
+      for (i=0; i<4; i++) {
+        char c;
+        if (++p >= stop) return 0;
+        c = *p;
+        if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') ||
+              (c >= 'a' && c <= 'f'))) return 0;
+      }
+      break;
+    default:
+      return 0;
+    }
+    p++;
+  }
+  return 1;
+}
+
+/* Returns non-zero if `c` is a character of a number. */
+#define isnumchar(c) \
+  (((c) >= '0' && (c) <= '9') || (c) == '-' || (c) == '+' || (c) == '.' || \
+   (c) == 'e' || (c) == 'E')
+
+/* If the array starting at position `pos` only contains numbers and
+   nested arrays of numbers, returns the position after its closing
+   bracket and stores the number of (outermost) elements in `*n`.
+   Otherwise -1 is returned. */
+static long numeric_array_end(const char *js, size_t pos, size_t len, int *n)
+{
+  size_t i;
+  int depth=0, count=0;
+  char last=0;  /* last non-whitespace character, '0' for numbers */
+  for (i=pos; i < len; i++) {
+    char c = js[i];
+    switch (c) {
+    case ' ': case '\t': case '\n': case '\r':
+      continue;
+    case '[':
+      if (last == '0' || last == ']') return -1;
+      if (depth == 1 && last == '[') count++;
+      depth++;
+      break;
+    case ']':
+      if (last == ',') return -1;
+      if (--depth == 0) {
+        *n = count;
+        return i + 1;
+      }
+      break;
+    case ',':
+      if (last != '0' && last != ']') return -1;
+      if (depth == 1) count++;
+      break;
+    default:
+      if (last == '0' || last == ']' || !(c == '-' || (c >= '0' && c <= '9')))
+        return -1;
+      if (depth == 1 && last == '[') count++;
+      while (i+1 < len && isnumchar(js[i+1])) i++;
+      c = '0';
+    }
+    last = c;
+  }
+  return -1;
+}
+
+/* Process structural character at position `pos`.  Returns non-zero if
+   the input cannot be handled by the scanner. */
+static int scan_char(Scanner *sc, int pos)
+{
+  Level *top = (sc->depth) ? sc->stack + sc->depth - 1 : NULL;
+  char c = sc->js[pos];
+  long end;
+  int n;
+
+  switch (sc->state) {
+
+  case S_STRING:
+    if (c != '"' || !valid_escapes(sc->js, sc->strstart + 1, pos) ||
+        scan_token(sc, JSMN_STRING, sc->strstart + 1, pos, sc->strkey))
+      return 1;
+    if (sc->strkey) {
+      top->key = sc->ntokens - 1;
+      sc->state = S_COLON;
+    } else {
+      scan_value_done(sc);
+    }
+    break;
+
+  case S_OBJECT_FIRST:
+    if (c == '}') goto close;
+    /* fallthrough */
+  case S_KEY:
+    if (c != '"') return 1;
+    sc->strstart = pos;
+    sc->strkey = 1;
+    sc->state = S_STRING;
+    break;
+
+  case S_COLON:
+    if (c != ':') return 1;
+    sc->state = S_VALUE;
+    break;
+
+  case S_NEXT:
+    if (c == ',') {
+      sc->state = (top->isobj) ? S_KEY : S_VALUE;
+      break;
+    }
+    if (c == ((top->isobj) ? '}' : ']')) goto close;
+    return 1;
+
+  case S_ARRAY_FIRST:
+    if (c == ']') goto close;
+    /* fallthrough */
+  case S_VALUE:
+    if (c == '"') {
+      sc->strstart = pos;
+      sc->strkey = 0;
+      sc->state = S_STRING;
+    } else if (c == '[' && sc->compact && pos + sc->compact <= sc->len &&
+               (end = numeric_array_end(sc->js, pos, sc->len, &n)) >= 0 &&
+               (size_t)end - pos >= sc->compact) {
+      /* compact numeric array - a single token with size -n */
+      if (scan_token(sc, JSMN_ARRAY, pos, (int)end, 0)) return 1;
+      if (sc->tokens) sc->tokens[sc->ntokens-1].size = -n;
+      sc->skip = end;
+      scan_value_done(sc);
+    } else if (c == '{' || c == '[') {
+      if (scan_token(sc, (c == '{') ? JSMN_OBJECT : JSMN_ARRAY, pos, -1, 0))
+        return 1;
+      if (sc->depth >= sc->stacksize) {
+        int size = (sc->stacksize) ? sc->stacksize * 2 : 32;
+        Level *q = realloc(sc->stack, size*sizeof(Level));
+        if (!q) return 1;
+        sc->stack = q;
+        sc->stacksize = size;
+      }
+      top = sc->stack + sc->depth++;
+      top->tok = sc->ntokens - 1;
+      top->key = -1;
+      top->isobj = (c == '{');
+      sc->state = (c == '{') ? S_OBJECT_FIRST : S_ARRAY_FIRST;
+    } else if (c == '-' || (c >= '0' && c <= '9') ||
+               c == 't' || c == 'f' || c == 'n') {
+      /* primitive - only the characters of numbers and literals are
+         accepted, which never are structural characters */
+      end = pos + 1;
+      while ((size_t)end < sc->len &&
+             ((sc->js[end] >= '0' && sc->js[end] <= '9') ||
+              (sc->js[end] >= 'a' && sc->js[end] <= 'z') ||
+              (sc->js[end] >= 'A' && sc->js[end] <= 'Z') ||
+              sc->js[end] == '-' || sc->js[end] == '+' ||
+              sc->js[end] == '.')) end++;
+      if ((size_t)end >= sc->len) return 1;
+      switch (sc->js[end]) {
+      case ' ': case '\t': case '\n': case '\r': case ',': case ']': case '}':
+        break;
+      default:
+        return 1;
+      }
+      if (scan_token(sc, JSMN_PRIMITIVE, pos, (int)end, 0)) return 1;
+      scan_value_done(sc);
+    } else {
+      return 1;
+    }
+    break;
+
+  case S_DONE:
+  case S_ERROR:
+    return 1;
+  }
+  return 0;
+
+ close:
+  if (sc->tokens) sc->tokens[top->tok].end = pos + 1;
+  sc->depth--;
+  scan_value_done(sc);
+  return 0;
+}
+
+/*
+  Tokenises `js` with the fast structural scanner.
+
+  If `grow` is non-zero, `*tokens_ptr` is reallocated as needed and
+  `*size_ptr` is updated.  Otherwise `*tokens_ptr` is a buffer of
+  `*size_ptr` tokens.  If `*tokens_ptr` is NULL and `grow` is zero,
+  the tokens are only counted.
+
+  If `compact` is non-zero, numeric arrays of at least `compact`
+  bytes are represented by a single token (see jsmn_parse_compact()).
+
+  Returns the number of tokens or -1 if the input cannot be handled
+  by the scanner.
+ */
+static int scan(const char *js, size_t len, jsmntok_t **tokens_ptr,
+                unsigned int *size_ptr, int grow, size_t compact)
+{
+  Scanner sc;
+  BlockMasksFunc block_masks = block_masks_select();
+  uint64_t escaped_carry=0, instring=0, scalar_carry=0;
+  const char *nul;
+  size_t pos;
+  int retval=-1;
+
+  /* jsmn_parse() stops at NUL */
+  if ((nul = memchr(js, '\0', len))) len = nul - js;
+  if (len >= INT32_MAX) return -1;
+
+  memset(&sc, 0, sizeof(sc));
+  sc.js = js;
+  sc.len = len;
+  sc.tokens = *tokens_ptr;
+  sc.size = (sc.tokens) ? *size_ptr : 0;
+  sc.grow = grow;
+  sc.compact = compact;
+  sc.state = S_VALUE;
+  if (grow && !sc.tokens) {
+    sc.size = len / 16 + 16;
+    if (!(sc.tokens = malloc(sc.size * sizeof(jsmntok_t)))) return -1;
+  }
+
+  for (pos=0; pos < len; pos += BLOCK_SIZE) {
+    unsigned char buf[BLOCK_SIZE];
+    const unsigned char *p = (const unsigned char *)js + pos;
+    BlockMasks m;
+    uint64_t escaped, quote, scalar, idx;
+    if (len - pos < BLOCK_SIZE) {
+      memset(buf, ' ', BLOCK_SIZE);
+      memcpy(buf, p, len - pos);
+      p = buf;
+    }
+    block_masks(p, &m);
+    escaped = find_escaped(m.bs, &escaped_carry);
+    quote = m.quote & ~escaped;
+    instring = prefix_xor(quote) ^ instring;
+    scalar = ~(m.op | m.ws | m.quote) & ~instring;
+    idx = (m.op & ~instring) | quote |
+      (scalar & ~((scalar << 1) | scalar_carry));
+    instring = (uint64_t)0 - (instring >> 63);
+    scalar_carry = scalar >> 63;
+
+    while (idx) {
+      int i = ctz64(idx);
+      idx &= idx - 1;
+      if (pos + i < sc.skip) continue;
+      if (scan_char(&sc, pos + i)) goto done;
+    }
+
+    /* jump to the block with the end of a compact array.  Compact
+       arrays contain no strings, so only the scalar carry is needed */
+    if (sc.skip / BLOCK_SIZE * BLOCK_SIZE > pos + BLOCK_SIZE) {
+      char c;
+      pos = sc.skip / BLOCK_SIZE * BLOCK_SIZE - BLOCK_SIZE;
+      c = js[pos + BLOCK_SIZE - 1];
+      escaped_carry = instring = 0;
+      scalar_carry = (isnumchar(c)) ? 1 : 0;
+    }
+  }
+  if (sc.state == S_DONE) retval = sc.ntokens;
+
+ done:
+  if (grow) {
+    *tokens_ptr = sc.tokens;
+    *size_ptr = sc.size;
+  }
+  if (sc.stack) free(sc.stack);
+  return retval;
+}
+
+
+/*
+  Like jsmn_parse(), but uses a fast SIMD-based structural scanner
+  when the parser is newly initialised.  The result is the same as
+  for jsmn_parse().
+ */
+int jsmn_parse_fast(jsmn_parser *parser, const char *js, const size_t len,
+                    jsmntok_t *tokens, const unsigned int num_tokens)
+{
+  unsigned int size = num_tokens;
+  int n;
+  if (parser->pos == 0 && parser->toknext == 0 && parser->toksuper == -1 &&
+      (n = scan(js, len, &tokens, &size, 0, 0)) >= 0) {
+    const char *nul = memchr(js, '\0', len);
+    parser->pos = (nul) ? (unsigned int)(nul - js) : (unsigned int)len;
+    if (tokens) parser->toknext = n;
+    return n;
+  }
+  return jsmn_parse(parser, js, len, tokens, num_tokens);
+}
+
+
+/*
+  Like jsmn_parse_alloc(), but arrays of only numbers (possibly nested)
+  spanning at least `minlen` bytes are represented by a single
+  JSMN_ARRAY token, whose size is minus the number of elements.  No
+  tokens are created for the elements.  If `minlen` is zero, this is
+  equivalent to jsmn_parse_alloc().
 
   Returns JSMN_ERROR_NOMEM on allocation error.
  */
-int jsmn_parse_alloc(jsmn_parser *parser, const char *js, const size_t len,
-                     jsmntok_t **tokens_ptr, unsigned int *num_tokens_ptr)
+int jsmn_parse_compact(jsmn_parser *parser, const char *js, const size_t len,
+                       jsmntok_t **tokens_ptr, unsigned int *num_tokens_ptr,
+                       size_t minlen)
 {
   int n, n_save;
   unsigned int saved_pos;
@@ -38,18 +639,28 @@ int jsmn_parse_alloc(jsmn_parser *parser, const char *js, const size_t len,
   if (!*tokens_ptr) *num_tokens_ptr = 0;
   if (!*num_tokens_ptr) *tokens_ptr = NULL;
 
+  /* try the fast scanner first */
+  if (parser->pos == 0 && parser->toknext == 0 && parser->toksuper == -1 &&
+      (n = scan(js, len, tokens_ptr, num_tokens_ptr, 1, minlen)) >= 0) {
+    const char *nul = memchr(js, '\0', len);
+    parser->pos = (nul) ? (unsigned int)(nul - js) : (unsigned int)len;
+    parser->toknext = n;
+    return n;
+  }
+
   saved_pos = parser->pos;
   if ((n = jsmn_parse(parser, js, len, NULL, 0)) < 0) goto fail;
-  if (!(t = realloc(*tokens_ptr, n*sizeof(jsmntok_t)))) return JSMN_ERROR_NOMEM;
+  /* allocate at least one token, since realloc of zero bytes may free */
+  if (!(t = realloc(*tokens_ptr, (n ? n : 1)*sizeof(jsmntok_t))))
+    return JSMN_ERROR_NOMEM;
+  *tokens_ptr = t;
+  *num_tokens_ptr = (n ? n : 1);
   n_save = n;
   parser->pos = saved_pos;
   if ((n = jsmn_parse(parser, js, len, t, n)) < 0) goto fail;
   assert(n == n_save);
-  *tokens_ptr = t;
-  *num_tokens_ptr = n;
   return n;
  fail:
-  if (t) free(t);
   switch (n) {
   case JSMN_ERROR_NOMEM: abort();  // this should never happen
   case JSMN_ERROR_INVAL: return JSMN_ERROR_INVAL;
@@ -59,6 +670,23 @@ int jsmn_parse_alloc(jsmn_parser *parser, const char *js, const size_t len,
 }
 
 
+/*
+  Like jsmn_parse(), but realloc's the buffer pointed to by `tokens_ptr`
+  if it is too small.  `num_tokens_ptr` should point to the number of
+  allocated tokens.
+
+  Like jsmn_parse_fast(), the fast structural scanner is used when the
+  parser is newly initialised.
+
+  Returns JSMN_ERROR_NOMEM on allocation error.
+ */
+int jsmn_parse_alloc(jsmn_parser *parser, const char *js, const size_t len,
+                     jsmntok_t **tokens_ptr, unsigned int *num_tokens_ptr)
+{
+  return jsmn_parse_compact(parser, js, len, tokens_ptr, num_tokens_ptr, 0);
+}
+
+
 /*
   Returns number of sub-tokens contained in `t` or -1 on error.
 */
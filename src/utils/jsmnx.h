@@ -70,11 +70,26 @@ int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
                jsmntok_t *tokens, const unsigned int num_tokens);
 
 
+/**
+ * Like jsmn_parse(), but uses a fast SIMD-based structural scanner
+ * when the parser is newly initialised.  The result is the same as for
+ * jsmn_parse().
+ *
+ * The SIMD instructions (SSE2, AVX2 or NEON) are selected at runtime
+ * based on the features of the CPU, with a scalar fallback.
+ */
+int jsmn_parse_fast(jsmn_parser *parser, const char *js, const size_t len,
+                    jsmntok_t *tokens, const unsigned int num_tokens);
+
+
 /**
  * Like jsmn_parse(), but realloc's the buffer pointed to by `tokens_ptr`
  * if it is too small.  `num_tokens_ptr` should point to the number of
  * allocated tokens or be zero if `tokens_ptr` is not pre-allocated.
  *
+ * Like jsmn_parse_fast(), the fast structural scanner is used when the
+ * parser is newly initialised.
+ *
  * Returns JSMN_ERROR_NOMEM on allocation error.
  */
 int jsmn_parse_alloc(jsmn_parser *parser, const char *js,
@@ -82,6 +97,24 @@ int jsmn_parse_alloc(jsmn_parser *parser, const char *js,
                      unsigned int *num_tokens_ptr);
 
 
+/**
+ * Like jsmn_parse_alloc(), but arrays of only numbers (possibly
+ * nested) spanning at least `minlen` bytes of `js` are represented by
+ * a single JSMN_ARRAY token without sub-tokens.  The size of such a
+ * token is minus the number of elements (of the outermost array).
+ * This avoids one token per element for large numeric arrays, which
+ * the caller then has to parse from the source.
+ *
+ * Compact arrays are only created by the fast structural scanner.  If
+ * it cannot handle the input, the result is the same as for
+ * jsmn_parse_alloc().  If `minlen` is zero, this function is
+ * equivalent to jsmn_parse_alloc().
+ */
+int jsmn_parse_compact(jsmn_parser *parser, const char *js,
+                       const size_t len, jsmntok_t **tokens_ptr,
+                       unsigned int *num_tokens_ptr, size_t minlen);
+
+
 /**
  * Returns number of sub-tokens contained in `t` or -1 on error.
  */
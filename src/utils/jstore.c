@@ -4,8 +4,25 @@
  *
  * Distributed under terms of the MIT license.
  */
+#include "config.h"
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if defined(HAVE_FSYNC) && !defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#endif
+
 #include "err.h"
 #include "compat.h"
+#include "fileutils.h"
 #include "jstore.h"
 
 
@@ -13,9 +30,22 @@
     err(1, msg); goto fail; } while (0)
 
 
+/* JSON store item */
+typedef struct {
+  char *value;              /* JSON value, NULL if not yet copied from `ref` */
+  jsmntok_t *tokens;        /* parsed tokens of `value`, may be NULL */
+  unsigned int ntokens;     /* number of tokens */
+  const char *ref;          /* referred value, see jstore_addn_ref() */
+  size_t reflen;            /* length of `ref` */
+} JStoreItem;
+
+typedef map_t(JStoreItem) map_item_t;
+
 /* JSON store */
 struct _JStore {
-  map_str_t store;
+  map_item_t store;
+  JStoreMap *maps;          /* buffers kept with jstore_keep_map() */
+  size_t nmaps;             /* number of buffers in `maps` */
 };
 
 
@@ -54,15 +84,69 @@ char *jstore_readfp(FILE *fp)
    Returns a pointer to the buffer or NULL on error. */
 char *jstore_readfile(const char *filename)
 {
-  char *buf;
-  FILE *fp = fopen(filename, "r");
-  if (!fp) return err(1, "cannot open file: \"%s\"", filename), NULL;
-  buf = jstore_readfp(fp);
-  fclose(fp);
+  char *buf = fu_io_readfile(NULL, filename, NULL);
   if (!buf) err(1, "error reading from file \"%s\"", filename);
   return buf;
 }
 
+/* Maps the content of `filename` read-only into memory and assigns
+   `map`.  The content is NUL-terminated.
+
+   Memory mapping avoids copying the file into a heap buffer, which
+   matters for large files.  If memory mapping isn't supported, or the
+   size of the file is a multiple of the page size (such that there is
+   no room for the terminating NUL), the file is read into an allocated
+   buffer instead.
+
+   The file must not be truncated while it is mapped.  Release `map`
+   with jstore_unmapfile().
+
+   Returns non-zero on error. */
+int jstore_mapfile(JStoreMap *map, const char *filename)
+{
+#ifdef HAVE_MMAP
+  int fd;
+  struct stat st;
+  long pagesize = sysconf(_SC_PAGESIZE);
+  void *p;
+  memset(map, 0, sizeof(JStoreMap));
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return err(1, "cannot open file: \"%s\"", filename);
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+      pagesize <= 0 || st.st_size % pagesize == 0) {
+    close(fd);
+  } else {
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p != MAP_FAILED) {
+      /* the remainder of the last page is zero-filled */
+      map->data = p;
+      map->size = st.st_size;
+      map->mapped = 1;
+      return 0;
+    }
+  }
+#else
+  memset(map, 0, sizeof(JStoreMap));
+#endif
+  if (!(map->data = jstore_readfile(filename))) return 1;
+  map->size = strlen(map->data);
+  return 0;
+}
+
+/* Releases memory mapped with jstore_mapfile(). */
+void jstore_unmapfile(JStoreMap *map)
+{
+  if (!map->data) return;
+#ifdef HAVE_MMAP
+  if (map->mapped)
+    munmap(map->data, map->size);
+  else
+#endif
+    free(map->data);
+  memset(map, 0, sizeof(JStoreMap));
+}
+
 /* Read file into an allocated buffer and parse it with JSMN.
 
    The `tokens_ptr` and `num_tokens_ptr` arguments are passed on to
@@ -107,11 +191,14 @@ int jstore_close(JStore *js)
   const char *key;
   map_iter_t miter = map_iter(&js->store);
   while ((key = map_next(&js->store, &miter))) {
-    char **val = map_get(&js->store, key);
-    assert(val);
-    free(*val);
+    JStoreItem *item = map_get(&js->store, key);
+    assert(item);
+    free(item->value);
+    if (item->tokens) free(item->tokens);
   }
   map_deinit(&js->store);
+  while (js->nmaps) jstore_unmapfile(js->maps + --js->nmaps);
+  if (js->maps) free(js->maps);
   free(js);
   return 0;
 }
@@ -153,28 +240,145 @@ int jstore_addn(JStore *js, const char *key, size_t klen,
    Returns non-zero on error. */
 int jstore_addstolen(JStore *js, const char *key, const char *value)
 {
-  char **v;
-  if ((v = map_get(&js->store, key))) free(*v);  // free existing value
-  if (map_set(&js->store, key, (char *)value))
+  JStoreItem item = {(char *)value, NULL, 0, NULL, 0}, *p;
+  if ((p = map_get(&js->store, key))) {  // free existing value
+    free(p->value);
+    if (p->tokens) free(p->tokens);
+  }
+  if (map_set(&js->store, key, item)) {
+    if (p) map_remove(&js->store, key);
     return err(1, "error adding key \"%s\" to JSON store", key);
+  }
+  return 0;
+}
+
+/* Like jstore_addn(), but also stores the `ntokens` parsed JSMN tokens
+   of the value.  The `start` and `end` positions of the tokens are
+   relative to `value` and `parent` is relative to the first token.
+   The tokens are copied.
+
+   Use jstore_get_tokens() to retrieve them, such that the value does
+   not have to be parsed again.
+   Returns non-zero on error. */
+int jstore_addn_tokens(JStore *js, const char *key, size_t klen,
+                       const char *value, size_t vlen,
+                       const jsmntok_t *tokens, unsigned int ntokens)
+{
+  char *k=(char *)key;
+  JStoreItem *item;
+  jsmntok_t *t=NULL;
+  if (ntokens) {
+    if (!(t = malloc(ntokens * sizeof(jsmntok_t))))
+      return err(1, "allocation failure");
+    memcpy(t, tokens, ntokens * sizeof(jsmntok_t));
+  }
+  if (jstore_addn(js, key, klen, value, vlen)) {
+    if (t) free(t);
+    return 1;
+  }
+  if (klen && !(k = strndup(key, klen))) {
+    if (t) free(t);
+    return err(1, "allocation failure");
+  }
+  item = map_get(&js->store, k);
+  assert(item);
+  item->tokens = t;
+  item->ntokens = ntokens;
+  if (klen) free(k);
+  return 0;
+}
+
+/* Like jstore_addn(), but stores a reference to `value` instead of a
+   copy.  The value is first copied when it is retrieved with
+   jstore_get().  `value` must remain valid as long as the item is in
+   the store, for instance by handing the buffer it points into over to
+   the store with jstore_keep_map().
+   Returns non-zero on error. */
+int jstore_addn_ref(JStore *js, const char *key, size_t klen,
+                    const char *value, size_t vlen)
+{
+  char *k=(char *)key;
+  JStoreItem *item;
+  if (!vlen) vlen = strlen(value);
+  if (klen && !(k = strndup(key, klen))) return err(1, "allocation failure");
+  if (jstore_addstolen(js, k, NULL)) {
+    if (klen) free(k);
+    return 1;
+  }
+  item = map_get(&js->store, k);
+  assert(item);
+  item->ref = value;
+  item->reflen = vlen;
+  if (klen) free(k);
+  return 0;
+}
+
+/* Hands the ownership of `map` over to the store, such that values
+   referring into it with jstore_addn_ref() stay valid.  The map is
+   released when the store is closed.
+   Returns non-zero on error. */
+int jstore_keep_map(JStore *js, JStoreMap *map)
+{
+  JStoreMap *q;
+  if (!(q = realloc(js->maps, (js->nmaps + 1) * sizeof(JStoreMap))))
+    return err(1, "allocation failure");
+  js->maps = q;
+  js->maps[js->nmaps++] = *map;
   return 0;
 }
 
 /* Returns JSON value for given key or NULL if the key isn't in the store.
-   This function can also be used to check if a key exists in the store. */
+   This function can also be used to check if a key exists in the store.
+   A value added with jstore_addn_ref() is copied on the first call. */
 const char *jstore_get(JStore *js, const char *key)
 {
-  char **p = map_get(&js->store, key);
-  return (p) ? *p : NULL;
+  JStoreItem *p = map_get(&js->store, key);
+  if (!p) return NULL;
+  if (!p->value && p->ref) {
+    if (!(p->value = strndup(p->ref, p->reflen)))
+      return err(1, "allocation failure"), NULL;
+    p->ref = NULL;
+  }
+  return p->value;
+}
+
+/* Like jstore_get(), but never copies the value.  The length of the
+   value is stored in `*len` if `len` is not NULL.  Note that the
+   returned value is not NUL-terminated if it was added with
+   jstore_addn_ref() and has not been retrieved with jstore_get(). */
+const char *jstore_getn(JStore *js, const char *key, size_t *len)
+{
+  JStoreItem *p = map_get(&js->store, key);
+  if (!p) return NULL;
+  if (!p->value && p->ref) {
+    if (len) *len = p->reflen;
+    return p->ref;
+  }
+  if (len && p->value) *len = strlen(p->value);
+  return p->value;
+}
+
+/* Returns the parsed JSMN tokens of the value for given key and
+   assign `*ntokens` to the number of tokens.  Returns NULL if the key
+   isn't in the store or the value was added without tokens.  The
+   returned tokens are owned by the store. */
+const jsmntok_t *jstore_get_tokens(JStore *js, const char *key,
+                                   unsigned int *ntokens)
+{
+  JStoreItem *p = map_get(&js->store, key);
+  if (!p || !p->tokens) return NULL;
+  if (ntokens) *ntokens = p->ntokens;
+  return p->tokens;
 }
 
 /* Removes item corresponding to given key from JSON store.
    Returns zero on success and 1 if `key` doesn't exists. */
 int jstore_remove(JStore *js, const char *key)
 {
-  char **v;
-  if ((v = map_get(&js->store, key))) {
-    free(*v);
+  JStoreItem *item;
+  if ((item = map_get(&js->store, key))) {
+    free(item->value);
+    if (item->tokens) free(item->tokens);
     map_remove(&js->store, key);
     return 0;
   }
@@ -188,9 +392,12 @@ int jstore_update(JStore *js, JStore *other)
   const char *key;
   jstore_iter_init(other, &iter);
   while ((key = jstore_iter_next(&iter))) {
-    const char *val = jstore_get(other, key);
-    assert(val);
-    if (jstore_add(js, key, val)) return 1;
+    JStoreItem *item = map_get(&other->store, key);
+    size_t len;
+    const char *value = jstore_getn(other, key, &len);
+    assert(item && value);
+    if (jstore_addn_tokens(js, key, 0, value, len, item->tokens,
+                           item->ntokens)) return 1;
   }
   return 0;
 }
@@ -220,19 +427,20 @@ int jstore_update_from_file(JStore *js, const char *filename)
   jsmntok_t *tokens=NULL;
   unsigned int ntokens=0;
   int r, stat;
-  char *buf;
-  if (!(buf = jstore_readfile(filename)))
+  JStoreMap map;
+  if (jstore_mapfile(&map, filename))
     return err(1, "error reading JSON file \"%s\"", filename);
   jsmn_init(&parser);
-  r = jsmn_parse_alloc(&parser, buf, strlen(buf), &tokens, &ntokens);
+  r = jsmn_parse_alloc(&parser, map.data, map.size, &tokens, &ntokens);
   if (r < 0) {
-    free(buf);
+    jstore_unmapfile(&map);
+    if (tokens) free(tokens);
     return err(1, "error parsing JSON file \"%s\": %s",
                filename, jsmn_strerror(r));
   }
-  stat = jstore_update_from_jsmn(js, buf, tokens);
+  stat = jstore_update_from_jsmn(js, map.data, tokens);
   free(tokens);
-  free(buf);
+  jstore_unmapfile(&map);
   return stat;
 }
 
@@ -265,10 +473,12 @@ char *jstore_to_string(JStore *js)
   if ((m = asnpprintf(&buf, &size, n, "{")) < 0) goto fail;
   n += m;
   while ((key = map_next(&js->store, &iter))) {
-    char **q, *sep = (count++ > 0) ? "," : "";
-    if (!(q = map_get(&js->store, key))) goto fail;
-    if ((m = asnpprintf(&buf, &size, n, "%s\n  \"%s\": %s",
-                        sep, key, *q)) < 0) goto fail;
+    char *sep = (count++ > 0) ? "," : "";
+    const char *value;
+    size_t len;
+    if (!(value = jstore_getn(js, key, &len))) goto fail;
+    if ((m = asnpprintf(&buf, &size, n, "%s\n  \"%s\": %.*s",
+                        sep, key, (int)len, value)) < 0) goto fail;
     n += m;
   }
   if ((m = asnpprintf(&buf, &size, n, "\n}\n")) < 0) goto fail;
@@ -278,22 +488,115 @@ char *jstore_to_string(JStore *js)
   return err(1, "error creating json string"), NULL;
 }
 
+/* Writes JSON store to stream `fp`, item by item, without building
+   up the whole document in memory.  Returns non-zero on error. */
+int jstore_to_fp(JStore *js, FILE *fp)
+{
+  map_iter_t iter = map_iter(&js->store);
+  int count=0;
+  const char *key;
+  if (fputc('{', fp) == EOF) goto fail;
+  while ((key = map_next(&js->store, &iter))) {
+    char *sep = (count++ > 0) ? "," : "";
+    const char *value;
+    size_t len;
+    if (!(value = jstore_getn(js, key, &len))) goto fail;
+    if (fprintf(fp, "%s\n  \"%s\": ", sep, key) < 0) goto fail;
+    if (fwrite(value, 1, len, fp) != len) goto fail;
+  }
+  if (fputs("\n}\n", fp) == EOF) goto fail;
+  return 0;
+ fail:
+  return err(1, "error writing JSON store");
+}
+
 /* Writes JSON store to file.  If `filename` exists, it is overwritten.
    Returns non-zero on error. */
 int jstore_to_file(JStore *js, const char *filename)
 {
-  char *buf = jstore_to_string(js);
   FILE *fp;
-  size_t n;
-  if (!buf) return 1;
-  if (!(fp = fopen(filename, "w"))) {
-    free(buf);
+  int stat;
+  if (!(fp = fopen(filename, "w")))
     return err(1, "cannot write JSON store to file \"%s\"", filename);
+  stat = jstore_to_fp(js, fp);
+  if (fclose(fp) && !stat)
+    stat = err(1, "cannot write JSON store to file \"%s\"", filename);
+  return stat;
+}
+
+/* Flushes the content of `fp` to disk.  Returns non-zero on error. */
+static int sync_fp(FILE *fp)
+{
+  if (fflush(fp)) return 1;
+#if defined(HAVE_FSYNC)
+  if (fsync(fileno(fp))) return 1;
+#elif defined(_WIN32)
+  if (_commit(_fileno(fp))) return 1;
+#endif
+  return 0;
+}
+
+/* Flushes the directory entry of `filename` to disk.  Only supported
+   on POSIX systems.  Returns non-zero on error. */
+static int sync_dir(const char *filename)
+{
+#if defined(HAVE_FSYNC) && !defined(_WIN32)
+  const char *p = strrchr(filename, '/');
+  char *dirname = (p) ? strndup(filename, (p == filename) ? 1 : p-filename) :
+    strdup(".");
+  int fd, stat=0;
+  if (!dirname) return err(1, "allocation failure");
+  if ((fd = open(dirname, O_RDONLY)) < 0 || fsync(fd))
+    stat = err(1, "cannot sync directory \"%s\"", dirname);
+  if (fd >= 0) close(fd);
+  free(dirname);
+  return stat;
+#else
+  (void)filename;
+  return 0;
+#endif
+}
+
+/* Writes JSON store to a temporary file next to `filename`, which is
+   then renamed to `filename`.  Readers will therefore see either the
+   old or the new content, even if the writer is interrupted.  `sync`
+   tells how the file is flushed to disk.  Returns non-zero on error. */
+int jstore_to_file_atomic(JStore *js, const char *filename, JStoreSync sync)
+{
+  FILE *fp=NULL;
+  char *tmpname=NULL;
+  int stat=1;
+  if (!(tmpname = malloc(strlen(filename) + 5))) FAIL("allocation failure");
+  sprintf(tmpname, "%s.tmp", filename);
+  if (!(fp = fopen(tmpname, "w"))) {
+    err(1, "cannot write JSON store to file \"%s\"", tmpname);
+    goto fail;
+  }
+  if (jstore_to_fp(js, fp)) goto fail;
+  if (sync >= jstoreSyncFile && sync_fp(fp)) {
+    err(1, "cannot sync file \"%s\"", tmpname);
+    goto fail;
   }
-  n = fwrite(buf, strlen(buf), 1, fp);
-  fclose(fp);
-  free(buf);
-  return (n == 1) ? 0 : 1;
+  if (fclose(fp)) {
+    fp = NULL;
+    err(1, "cannot write JSON store to file \"%s\"", tmpname);
+    goto fail;
+  }
+  fp = NULL;
+#ifdef _WIN32
+  remove(filename);
+#endif
+  if (rename(tmpname, filename)) {
+    err(1, "cannot rename \"%s\" to \"%s\"", tmpname, filename);
+    goto fail;
+  }
+  if (sync >= jstoreSyncDir && sync_dir(filename)) goto fail;
+  stat = 0;
+ fail:
+  if (fp) fclose(fp);
+  if (stat && tmpname) remove(tmpname);
+  if (tmpname) free(tmpname);
+  return stat;
 }
 
 /* Initialise iterator.  Return non-zero on error. */
@@ -28,6 +28,13 @@
 /** JStore object */
 typedef struct _JStore JStore;
 
+/** Content of a file mapped into memory with jstore_mapfile() */
+typedef struct _JStoreMap {
+  char *data;    /*!< NUL-terminated file content */
+  size_t size;   /*!< Size of the file, not counting the terminating NUL */
+  int mapped;    /*!< Whether `data` is memory-mapped or allocated */
+} JStoreMap;
+
 /** JStore iterator object */
 typedef struct _JStoreIter {
   JStore *js;
@@ -47,6 +54,24 @@ char *jstore_readfp(FILE *fp);
     Returns a pointer to the buffer or NULL on error. */
 char *jstore_readfile(const char *filename);
 
+/** Maps the content of `filename` read-only into memory and assigns
+    `map`.  The content is NUL-terminated.
+
+    Memory mapping avoids copying the file into a heap buffer, which
+    matters for large files.  If memory mapping isn't supported, or the
+    size of the file is a multiple of the page size (such that there is
+    no room for the terminating NUL), the file is read into an allocated
+    buffer instead.
+
+    The file must not be truncated while it is mapped.  Release `map`
+    with jstore_unmapfile().
+
+    Returns non-zero on error. */
+int jstore_mapfile(JStoreMap *map, const char *filename);
+
+/** Releases memory mapped with jstore_mapfile(). */
+void jstore_unmapfile(JStoreMap *map);
+
 /** Read file into an allocated buffer and parse it with JSMN.
 
     The `tokens_ptr` and `num_tokens_ptr` arguments are passed on to
@@ -82,16 +107,57 @@ int jstore_add(JStore *js, const char *key, const char *value);
 int jstore_addn(JStore *js, const char *key, size_t klen,
                 const char *value, size_t vlen);
 
+/** Like jstore_addn(), but also stores the `ntokens` parsed JSMN tokens
+    of the value.  The `start` and `end` positions of the tokens are
+    relative to `value` and `parent` is relative to the first token.
+    The tokens are copied.
+
+    Use jstore_get_tokens() to retrieve them, such that the value does
+    not have to be parsed again.
+    Returns non-zero on error. */
+int jstore_addn_tokens(JStore *js, const char *key, size_t klen,
+                       const char *value, size_t vlen,
+                       const jsmntok_t *tokens, unsigned int ntokens);
+
 /** Add JSON value to store with given key.
     The store "steels" the ownership of the memory pointed to by `value`.
     If key already exists, it is replaced.
     Returns non-zero on error. */
 int jstore_addstolen(JStore *js, const char *key, const char *value);
 
+/** Like jstore_addn(), but stores a reference to `value` instead of a
+    copy.  The value is first copied when it is retrieved with
+    jstore_get().  `value` must remain valid as long as the item is in
+    the store, for instance by handing the buffer it points into over to
+    the store with jstore_keep_map().
+    Returns non-zero on error. */
+int jstore_addn_ref(JStore *js, const char *key, size_t klen,
+                    const char *value, size_t vlen);
+
+/** Hands the ownership of `map` over to the store, such that values
+    referring into it with jstore_addn_ref() stay valid.  The map is
+    released when the store is closed.
+    Returns non-zero on error. */
+int jstore_keep_map(JStore *js, JStoreMap *map);
+
 /** Returns JSON value for given key or NULL if the key isn't in the store.
-    This function can also be used to check if a key exists in the store. */
+    This function can also be used to check if a key exists in the store.
+    A value added with jstore_addn_ref() is copied on the first call. */
 const char *jstore_get(JStore *js, const char *key);
 
+/** Like jstore_get(), but never copies the value.  The length of the
+    value is stored in `*len` if `len` is not NULL.  Note that the
+    returned value is not NUL-terminated if it was added with
+    jstore_addn_ref() and has not been retrieved with jstore_get(). */
+const char *jstore_getn(JStore *js, const char *key, size_t *len);
+
+/** Returns the parsed JSMN tokens of the value for given key and
+    assign `*ntokens` to the number of tokens.  Returns NULL if the key
+    isn't in the store or the value was added without tokens.  The
+    returned tokens are owned by the store. */
+const jsmntok_t *jstore_get_tokens(JStore *js, const char *key,
+                                   unsigned int *ntokens);
+
 /** Removes item corresponding to given key from JSON store. */
 int jstore_remove(JStore *js, const char *key);
 
@@ -115,10 +181,28 @@ int jstore_update_file(JStore *js, const char *filename);
     NULL on error. */
 char *jstore_to_string(JStore *js);
 
+/** Writes JSON store to stream `fp`, item by item, without building
+    up the whole document in memory.  Returns non-zero on error. */
+int jstore_to_fp(JStore *js, FILE *fp);
+
 /** Writes JSON store to file.  If `filename` exists, it is overwritten.
     Returns non-zero on error. */
 int jstore_to_file(JStore *js, const char *filename);
 
+/** How far jstore_to_file_atomic() should go to ensure that the
+    written file survives a system crash. */
+typedef enum {
+  jstoreSyncNone=0,  /*!< leave it to the OS to write the file to disk */
+  jstoreSyncFile=1,  /*!< flush the file to disk before renaming it */
+  jstoreSyncDir=2    /*!< also flush the directory entry after renaming */
+} JStoreSync;
+
+/** Writes JSON store to a temporary file next to `filename`, which is
+    then renamed to `filename`.  Readers will therefore see either the
+    old or the new content, even if the writer is interrupted.  `sync`
+    tells how the file is flushed to disk.  Returns non-zero on error. */
+int jstore_to_file_atomic(JStore *js, const char *filename, JStoreSync sync);
+
 
 /** Initialise iterator.  Return non-zero on error. */
 int jstore_iter_init(JStore *js, JStoreIter *iter);
@@ -130,6 +130,12 @@ void *map_get_(const map_base_t *m, const char *key) {
 }
 
 
+const char *map_key_(const map_base_t *m, const char *key) {
+  map_node_t **next = map_getref(m, key);
+  return next ? (char*) (*next + 1) : NULL;
+}
+
+
 int map_set_(map_base_t *m, const char *key, void *value, int vsize) {
   int n, err;
   map_node_t **next, *node;
@@ -144,6 +144,22 @@ typedef struct {
 #define map_get(m, key)\
   ( (m)->ref = map_get_(&(m)->base, key) )
 
+/**
+  Like map_get(), but returns an untyped pointer and doesn't modify
+  the map.  Hence, it may be called concurrently from several threads
+  as long as no thread modifies the map.
+*/
+#define map_peek(m, key)\
+  map_get_(&(m)->base, key)
+
+/**
+  Returns a pointer to the copy of `key` stored in the map or NULL if
+  no mapping for the key exists.  The pointer is valid until the key
+  is removed from the map.
+*/
+#define map_key(m, key)\
+  map_key_(&(m)->base, key)
+
 /**
   Sets the given key to the given value. Returns 0 on success,
   otherwise -1 is returned and the map remains unchanged.
@@ -182,6 +198,7 @@ typedef struct {
  */
 void map_deinit_(map_base_t *m);
 void *map_get_(const map_base_t *m, const char *key);
+const char *map_key_(const map_base_t *m, const char *key);
 int map_set_(map_base_t *m, const char *key, void *value, int vsize);
 void map_remove_(map_base_t *m, const char *key);
 map_iter_t map_iter_(void);
@@ -0,0 +1,366 @@
+/* omap.c -- open-addressing hash map with a map.h-compatible API
+ *
+ * Copyright (c) 2026, SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define OMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "omap.h"
+
+
+/*
+ * Layout
+ * ------
+ *
+ * The map consists of `capacity` slots and `capacity + GROUP_WIDTH`
+ * control bytes, allocated in one block.  The control byte of a slot
+ * is either EMPTY, DELETED or the lowest 7 bits of the hash of the key
+ * (H2).  The last GROUP_WIDTH control bytes mirror the first ones,
+ * such that a group of GROUP_WIDTH control bytes can be loaded from any
+ * position without wrapping around.
+ *
+ * A key is looked up by probing groups starting at the position given
+ * by the remaining bits of the hash (H1).  Within a group, all control
+ * bytes are compared with H2 at once.  The probing stops at the first
+ * group containing an EMPTY control byte.
+ *
+ * Removed entries are marked as DELETED, such that probe sequences
+ * passing through them are not broken.  They are cleaned up when the
+ * map is rehashed.
+ */
+
+#define GROUP_WIDTH 16
+
+#define CTRL_EMPTY   ((unsigned char)0x80)
+#define CTRL_DELETED ((unsigned char)0xfe)
+
+/* Returns non-zero if control byte `c` corresponds to an entry. */
+#define IS_FULL(c) (((c) & 0x80) == 0)
+
+/* Header of each slot.  The value follows directly after the header. */
+typedef struct {
+  uint32_t hash;    /* hash of the key */
+  uint32_t keylen;  /* length of key, excluding NUL-terminator */
+  union {
+    char buf[OMAP_KEYSIZE];  /* inline key, if keylen < OMAP_KEYSIZE */
+    char *ptr;               /* allocated key, otherwise */
+  } key;
+} Slot;
+
+#define SLOT(m, i) ((Slot *)((m)->slots + (size_t)(i) * (m)->slotsize))
+#define SLOT_KEY(s) \
+  ((s)->keylen < OMAP_KEYSIZE ? (s)->key.buf : (s)->key.ptr)
+#define SLOT_VALUE(s) ((void *)((s) + 1))
+
+
+/* Returns a hash of the `len` first bytes of `key`.  Processes 8 bytes
+   at a time with a multiply-xorshift mix. */
+static uint32_t omap_hash(const char *key, size_t len)
+{
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ len, v;
+  while (len >= 8) {
+    memcpy(&v, key, 8);
+    h = (h ^ v) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+    key += 8;
+    len -= 8;
+  }
+  if (len) {
+    v = 0;
+    memcpy(&v, key, len);
+    h = (h ^ v) * 0xc4ceb9fe1a85ec53ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+/* Returns the number of trailing zero bits in `x`, which must be
+   non-zero. */
+static int ctz32(uint32_t x)
+{
+#if defined(__GNUC__)
+  return __builtin_ctz(x);
+#else
+  int n=0;
+  while (!(x & 1)) { x >>= 1; n++; }
+  return n;
+#endif
+}
+
+/* Returns a bitmask with bit `i` set if control byte `i` in the group
+   starting at `g` equals `c`. */
+static uint32_t group_match(const unsigned char *g, unsigned char c)
+{
+#if defined(OMAP_SSE2)
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)g);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl,
+                                                    _mm_set1_epi8((char)c)));
+#else
+  uint32_t mask=0;
+  int i;
+  for (i=0; i<GROUP_WIDTH; i++)
+    if (g[i] == c) mask |= (uint32_t)1 << i;
+  return mask;
+#endif
+}
+
+/* Returns a bitmask with bit `i` set if control byte `i` in the group
+   starting at `g` is EMPTY or DELETED. */
+static uint32_t group_match_free(const unsigned char *g)
+{
+#if defined(OMAP_SSE2)
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+#else
+  uint32_t mask=0;
+  int i;
+  for (i=0; i<GROUP_WIDTH; i++)
+    if (!IS_FULL(g[i])) mask |= (uint32_t)1 << i;
+  return mask;
+#endif
+}
+
+/* Sets control byte `i` to `c`, including its mirror. */
+static void set_ctrl(omap_base_t *m, unsigned i, unsigned char c)
+{
+  m->ctrl[i] = c;
+  if (i < GROUP_WIDTH) m->ctrl[m->capacity + i] = c;
+}
+
+/* Returns the maximum number of entries for the given capacity
+   (a load factor of 7/8). */
+static unsigned max_load(unsigned capacity)
+{
+  return capacity - capacity / 8;
+}
+
+/* Returns the index of the slot with the given key or -1 if the key is
+   not in the map. */
+static long find(const omap_base_t *m, const char *key, size_t len,
+                 uint32_t hash)
+{
+  unsigned mask = m->capacity - 1;
+  unsigned pos = (hash >> 7) & mask;
+  unsigned step = 0;
+  unsigned char h2 = (unsigned char)(hash & 0x7f);
+  if (!m->capacity) return -1;
+  while (1) {
+    const unsigned char *g = m->ctrl + pos;
+    uint32_t bits = group_match(g, h2);
+    while (bits) {
+      unsigned i = (pos + ctz32(bits)) & mask;
+      const Slot *s = SLOT(m, i);
+      if (s->hash == hash && s->keylen == len &&
+          memcmp(SLOT_KEY(s), key, len) == 0)
+        return i;
+      bits &= bits - 1;
+    }
+    if (group_match(g, CTRL_EMPTY)) return -1;
+    step += GROUP_WIDTH;
+    if (step > m->capacity) return -1;
+    pos = (pos + step) & mask;
+  }
+}
+
+/* Returns the index of the first EMPTY or DELETED slot in the probe
+   sequence for `hash`.  The map must have at least one free slot. */
+static unsigned find_free(const omap_base_t *m, uint32_t hash)
+{
+  unsigned mask = m->capacity - 1;
+  unsigned pos = (hash >> 7) & mask;
+  unsigned step = 0;
+  while (1) {
+    uint32_t bits = group_match_free(m->ctrl + pos);
+    if (bits) return (pos + ctz32(bits)) & mask;
+    step += GROUP_WIDTH;
+    pos = (pos + step) & mask;
+  }
+}
+
+/* Rehashes the map into `capacity` slots, which must be a power of two
+   not less than GROUP_WIDTH and large enough to hold all entries.
+   Returns 0 on success and -1 on allocation failure, in which case the
+   map is unchanged. */
+static int rehash(omap_base_t *m, unsigned capacity)
+{
+  omap_base_t nm = *m;
+  size_t ctrlsize = capacity + GROUP_WIDTH;
+  unsigned i;
+  assert(capacity >= GROUP_WIDTH && !(capacity & (capacity - 1)));
+  assert(m->nnodes <= max_load(capacity));
+
+  /* Control bytes first, then the slots aligned to 16 bytes */
+  ctrlsize = (ctrlsize + 15) & ~(size_t)15;
+  if (!(nm.ctrl = malloc(ctrlsize + (size_t)capacity * m->slotsize)))
+    return -1;
+  nm.slots = (char *)nm.ctrl + ctrlsize;
+  nm.capacity = capacity;
+  nm.growth_left = max_load(capacity) - m->nnodes;
+  memset(nm.ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH);
+
+  for (i=0; i < m->capacity; i++) {
+    if (IS_FULL(m->ctrl[i])) {
+      Slot *s = SLOT(m, i);
+      unsigned j = find_free(&nm, s->hash);
+      set_ctrl(&nm, j, m->ctrl[i]);
+      memcpy(SLOT(&nm, j), s, m->slotsize);
+    }
+  }
+  free(m->ctrl);
+  *m = nm;
+  return 0;
+}
+
+/* Initialises the slot size of an empty map for values of size `vsize`. */
+static void init_vsize(omap_base_t *m, unsigned vsize)
+{
+  if (!m->slotsize) {
+    m->vsize = vsize;
+    m->slotsize = sizeof(Slot) +
+      ((vsize + sizeof(void *) - 1) & ~(unsigned)(sizeof(void *) - 1));
+  }
+  assert(m->vsize == vsize);
+}
+
+/* Returns the smallest valid capacity that can hold `n` entries. */
+static unsigned capacity_for(unsigned n)
+{
+  unsigned capacity = GROUP_WIDTH;
+  while (max_load(capacity) < n) capacity <<= 1;
+  return capacity;
+}
+
+
+void omap_deinit_(omap_base_t *m)
+{
+  unsigned i;
+  for (i=0; i < m->capacity; i++) {
+    if (IS_FULL(m->ctrl[i])) {
+      Slot *s = SLOT(m, i);
+      if (s->keylen >= OMAP_KEYSIZE) free(s->key.ptr);
+    }
+  }
+  free(m->ctrl);
+  memset(m, 0, sizeof(*m));
+}
+
+
+int omap_reserve_(omap_base_t *m, unsigned n, unsigned vsize)
+{
+  init_vsize(m, vsize);
+  if (n <= m->nnodes + m->growth_left) return 0;
+  return rehash(m, capacity_for(n));
+}
+
+
+void *omap_get_(const omap_base_t *m, const char *key)
+{
+  size_t len = strlen(key);
+  long i = find(m, key, len, omap_hash(key, len));
+  return (i < 0) ? NULL : SLOT_VALUE(SLOT(m, i));
+}
+
+
+const char *omap_key_(const omap_base_t *m, const char *key)
+{
+  size_t len = strlen(key);
+  long i = find(m, key, len, omap_hash(key, len));
+  return (i < 0) ? NULL : SLOT_KEY(SLOT(m, i));
+}
+
+
+int omap_set_(omap_base_t *m, const char *key, void *value, unsigned vsize)
+{
+  size_t len = strlen(key);
+  uint32_t hash = omap_hash(key, len);
+  char *keycopy = NULL;
+  unsigned i;
+  long k;
+  Slot *s;
+
+  init_vsize(m, vsize);
+
+  /* Find & replace existing entry */
+  if ((k = find(m, key, len, hash)) >= 0) {
+    memcpy(SLOT_VALUE(SLOT(m, k)), value, vsize);
+    return 0;
+  }
+
+  if (len >= OMAP_KEYSIZE) {
+    if (len > UINT32_MAX || !(keycopy = malloc(len + 1))) return -1;
+    memcpy(keycopy, key, len + 1);
+  }
+
+  /* Make room for the new entry.  If less than half of the maximum
+     load are entries, the rest are DELETED slots and it is sufficient
+     to rehash with the same capacity. */
+  if (m->growth_left == 0) {
+    unsigned capacity;
+    if (!m->capacity)
+      capacity = GROUP_WIDTH;
+    else if (m->nnodes < max_load(m->capacity) / 2)
+      capacity = m->capacity;
+    else
+      capacity = m->capacity * 2;
+    if (rehash(m, capacity)) {
+      free(keycopy);
+      return -1;
+    }
+  }
+
+  i = find_free(m, hash);
+  if (m->ctrl[i] == CTRL_EMPTY) m->growth_left--;
+  set_ctrl(m, i, (unsigned char)(hash & 0x7f));
+  s = SLOT(m, i);
+  s->hash = hash;
+  s->keylen = (uint32_t)len;
+  if (keycopy)
+    s->key.ptr = keycopy;
+  else
+    memcpy(s->key.buf, key, len + 1);
+  memcpy(SLOT_VALUE(s), value, vsize);
+  m->nnodes++;
+  return 0;
+}
+
+
+void omap_remove_(omap_base_t *m, const char *key)
+{
+  size_t len = strlen(key);
+  long i = find(m, key, len, omap_hash(key, len));
+  if (i >= 0) {
+    Slot *s = SLOT(m, i);
+    if (s->keylen >= OMAP_KEYSIZE) free(s->key.ptr);
+    set_ctrl(m, (unsigned)i, CTRL_DELETED);
+    m->nnodes--;
+  }
+}
+
+
+omap_iter_t omap_iter_(void)
+{
+  omap_iter_t iter;
+  iter.idx = 0;
+  return iter;
+}
+
+
+const char *omap_next_(omap_base_t *m, omap_iter_t *iter)
+{
+  while (iter->idx < m->capacity) {
+    unsigned i = iter->idx++;
+    if (IS_FULL(m->ctrl[i])) return SLOT_KEY(SLOT(m, i));
+  }
+  return NULL;
+}
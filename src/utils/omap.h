@@ -0,0 +1,191 @@
+/* omap.h -- open-addressing hash map with a map.h-compatible API
+ *
+ * Copyright (c) 2026, SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#ifndef _OMAP_H
+#define _OMAP_H
+
+/**
+  @file
+  @brief A type-safe open-addressing hash map for C.
+
+  This map provides the same macro API as map.h, with the `omap_`
+  prefix instead of `map_`, but stores its entries in a single flat
+  array.  It is intended for hot lookups where the chained buckets and
+  per-entry allocations of map.h are a bottleneck.
+
+  The layout follows the "Swiss table" design: a separate array of
+  one-byte control bytes holds 7 bits of the hash for each slot.
+  Lookups probe groups of 16 control bytes at once (with SSE2 when
+  available) and only compare the stored full hash and key of slots
+  whose control byte match.  Keys shorter than `OMAP_KEYSIZE` are
+  stored inline in the slot, such that inserting a new entry normally
+  does not allocate memory.
+
+  Differences from map.h:
+    - Pointers returned by omap_get(), omap_peek() and omap_key(), and
+      keys returned by omap_next() are only valid until the next call
+      to omap_set(), omap_remove() or omap_reserve().
+    - omap_reserve() can be used to preallocate room for a given
+      number of entries.
+    - omap_count() returns the number of entries in the map.
+
+  ### Example
+
+      typedef omap_t(unsigned int) omap_uint_t;
+
+      omap_uint_t m;
+      unsigned int *p;
+      const char *key;
+      omap_iter_t iter;
+
+      omap_init(&m);
+      omap_set(&m, "testkey", 123);
+      p = omap_get(&m, "testkey");
+
+      iter = omap_iter(&m);
+      while ((key = omap_next(&m, &iter))) {
+        printf("%s -> %u\n", key, *omap_get(&m, key));
+      }
+
+      omap_deinit(&m);
+*/
+
+#include <string.h>
+
+/** Keys shorter than this are stored inline in the slots.  Chosen to
+    hold a UUID including its NUL-terminator. */
+#define OMAP_KEYSIZE 40
+
+typedef struct {
+  unsigned char *ctrl;  /*!< Control bytes, `capacity` + 16 */
+  char *slots;          /*!< Array of `capacity` slots */
+  unsigned capacity;    /*!< Number of slots, zero or a power of two */
+  unsigned nnodes;      /*!< Number of entries */
+  unsigned growth_left; /*!< Number of entries that can be added before
+                             the map must be rehashed */
+  unsigned vsize;       /*!< Size of values */
+  unsigned slotsize;    /*!< Size of each slot */
+} omap_base_t;
+
+typedef struct {
+  unsigned idx;
+} omap_iter_t;
+
+
+/**
+  Defines a new map type.
+*/
+#define omap_t(T)\
+  struct { omap_base_t base; T *ref; T tmp; }
+
+/**
+  Initialises the map, this must be called before the map can be used.
+ */
+#define omap_init(m)\
+  memset(m, 0, sizeof(*(m)))
+
+/**
+  Deinitialises the map, freeing the memory the map allocated
+  during use; this should be called when we're finished with a
+  map.
+ */
+#define omap_deinit(m)\
+  omap_deinit_(&(m)->base)
+
+/**
+  Ensures that the map can hold at least `n` entries without being
+  rehashed.  Returns 0 on success, otherwise -1 is returned and the
+  map remains unchanged.
+ */
+#define omap_reserve(m, n)\
+  omap_reserve_(&(m)->base, n, sizeof((m)->tmp))
+
+/**
+  Returns the number of entries in the map.
+ */
+#define omap_count(m)\
+  ((m)->base.nnodes)
+
+/**
+  Returns a pointer to the value of the given key. If no
+  mapping for the key exists then NULL will be returned.
+*/
+#define omap_get(m, key)\
+  ( (m)->ref = omap_get_(&(m)->base, key) )
+
+/**
+  Like omap_get(), but returns an untyped pointer and doesn't modify
+  the map.  Hence, it may be called concurrently from several threads
+  as long as no thread modifies the map.
+*/
+#define omap_peek(m, key)\
+  omap_get_(&(m)->base, key)
+
+/**
+  Returns a pointer to the copy of `key` stored in the map or NULL if
+  no mapping for the key exists.
+*/
+#define omap_key(m, key)\
+  omap_key_(&(m)->base, key)
+
+/**
+  Sets the given key to the given value. Returns 0 on success,
+  otherwise -1 is returned and the map remains unchanged.
+*/
+#define omap_set(m, key, value)\
+  ( (m)->tmp = (value),\
+    omap_set_(&(m)->base, key, &(m)->tmp, sizeof((m)->tmp)) )
+
+/**
+  Removes the mapping of the given key from the map. If the key
+  does not exist in the map then the function has no effect.
+*/
+#define omap_remove(m, key)\
+  omap_remove_(&(m)->base, key)
+
+/**
+  Returns a omap_iter_t which can be used with omap_next() to
+  iterate all the keys in the map.
+*/
+#define omap_iter(m)\
+  omap_iter_()
+
+/**
+  Uses the omap_iter_t returned by omap_iter() to iterate all the
+  keys in the map. omap_next() returns a key with each call and
+  returns NULL when there are no more keys.
+ */
+#define omap_next(m, iter)\
+  omap_next_(&(m)->base, iter)
+
+
+/**
+  @name Internal functions
+  These functions are called via the macros.  Don't call them directly.
+  @{
+ */
+void omap_deinit_(omap_base_t *m);
+int omap_reserve_(omap_base_t *m, unsigned n, unsigned vsize);
+void *omap_get_(const omap_base_t *m, const char *key);
+const char *omap_key_(const omap_base_t *m, const char *key);
+int omap_set_(omap_base_t *m, const char *key, void *value, unsigned vsize);
+void omap_remove_(omap_base_t *m, const char *key);
+omap_iter_t omap_iter_(void);
+const char *omap_next_(omap_base_t *m, omap_iter_t *iter);
+/** @} */
+
+
+/** @cond private */
+typedef omap_t(void*) omap_void_t;
+typedef omap_t(char*) omap_str_t;
+typedef omap_t(int) omap_int_t;
+typedef omap_t(char) omap_char_t;
+typedef omap_t(float) omap_float_t;
+typedef omap_t(double) omap_double_t;
+/** @endcond */
+
+
+#endif /* _OMAP_H */
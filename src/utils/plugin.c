@@ -10,12 +10,16 @@
 #endif
 
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 
+#include "compat.h"
 #include "err.h"
+#include "fileinfo.h"
 #include "fileutils.h"
 #include "dsl.h"
 #include "uuid4.h"
+#include "trace.h"
 #include "plugin.h"
 
 /** Convenient macros for failing */
@@ -28,6 +32,10 @@
 
 
 
+/* First line of manifest files */
+#define MANIFEST_HEADER "# plugin manifest 1"
+
+
 /* Struct holding data for a loaded plugin */
 struct _Plugin {
   char *path;          /* plugin file path */
@@ -35,6 +43,32 @@ struct _Plugin {
   dsl_handle handle;   /* plugin handle */
 };
 
+/* An api in the manifest */
+typedef struct {
+  char *name;          /* api name */
+  char *path;          /* path to plugin file providing the api */
+  double mtime;        /* modification time of the plugin file */
+  long long size;      /* size of the plugin file */
+} ManifestApi;
+
+/* A directory in the search path when the manifest was written */
+typedef struct {
+  char *path;          /* directory path */
+  double mtime;        /* modification time of the directory */
+} ManifestDir;
+
+/* Manifest mapping api names to plugin files */
+struct _PluginManifest {
+  char *filename;      /* manifest file */
+  int loaded;          /* whether we have tried to read the manifest file */
+  int changed;         /* whether the manifest differs from the file */
+  ManifestApi *apis;   /* apis in the manifest */
+  size_t napis;        /* number of apis */
+  ManifestDir *dirs;   /* directories in the search path */
+  size_t ndirs;        /* number of directories */
+  map_int_t names;     /* maps api names to index in `apis` */
+};
+
 
 int plugin_incref(Plugin *plugin)
 {
@@ -53,6 +87,253 @@ int plugin_decref(Plugin *plugin)
 }
 
 
+/* Removes all apis and directories from manifest `m`. */
+static void manifest_clear(PluginManifest *m)
+{
+  size_t i;
+  for (i=0; i<m->napis; i++) {
+    free(m->apis[i].name);
+    free(m->apis[i].path);
+  }
+  for (i=0; i<m->ndirs; i++) free(m->dirs[i].path);
+  if (m->apis) free(m->apis);
+  if (m->dirs) free(m->dirs);
+  m->apis = NULL;
+  m->dirs = NULL;
+  m->napis = m->ndirs = 0;
+  map_deinit(&m->names);
+  map_init(&m->names);
+}
+
+/* Frees manifest `m`. */
+static void manifest_free(PluginManifest *m)
+{
+  manifest_clear(m);
+  map_deinit(&m->names);
+  free(m->filename);
+  free(m);
+}
+
+/* Adds api `name` provided by plugin file `path` to manifest `m`.  An
+   existing entry with the same name is replaced.  Returns non-zero on
+   error. */
+static int manifest_add(PluginManifest *m, const char *name,
+                        const char *path, double mtime, long long size)
+{
+  ManifestApi *a;
+  int *ip = map_get(&m->names, name);
+  if (ip) {
+    a = m->apis + *ip;
+    if (strcmp(a->path, path) == 0 && a->mtime == mtime && a->size == size)
+      return 0;
+    free(a->path);
+  } else {
+    void *ptr = realloc(m->apis, (m->napis + 1)*sizeof(ManifestApi));
+    if (!ptr) return err(1, "allocation failure");
+    m->apis = ptr;
+    a = m->apis + m->napis;
+    if (!(a->name = strdup(name))) return err(1, "allocation failure");
+    map_set(&m->names, a->name, (int)m->napis++);
+  }
+  if (!(a->path = strdup(path))) return err(1, "allocation failure");
+  a->mtime = mtime;
+  a->size = size;
+  m->changed = 1;
+  return 0;
+}
+
+/* Reads the manifest file of `m`.  Returns non-zero on error. */
+static int manifest_read(PluginManifest *m)
+{
+  FILE *fp;
+  char line[4096];
+  int stat=1;
+  if (!(fp = fopen(m->filename, "r"))) return 1;  /* not an error */
+  if (!fgets(line, sizeof(line), fp) ||
+      strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER)) != 0)
+    FAIL1("not a plugin manifest: %s", m->filename);
+  while (fgets(line, sizeof(line), fp)) {
+    size_t len = strlen(line);
+    if (len && line[len-1] == '\n') line[--len] = '\0';
+    if (len && line[len-1] == '\r') line[--len] = '\0';
+    if (strncmp(line, "dir ", 4) == 0) {
+      double mtime;
+      int n;
+      void *ptr;
+      if (sscanf(line+4, "%lg %n", &mtime, &n) < 1)
+        FAIL1("invalid dir entry in %s", m->filename);
+      if (!(ptr = realloc(m->dirs, (m->ndirs + 1)*sizeof(ManifestDir))))
+        FAIL("allocation failure");
+      m->dirs = ptr;
+      if (!(m->dirs[m->ndirs].path = strdup(line + 4 + n)))
+        FAIL("allocation failure");
+      m->dirs[m->ndirs++].mtime = mtime;
+    } else if (strncmp(line, "api ", 4) == 0) {
+      char name[256];
+      double mtime;
+      long long size;
+      int n;
+      if (sscanf(line+4, "%lg %lld %255s %n", &mtime, &size, name, &n) < 3)
+        FAIL1("invalid api entry in %s", m->filename);
+      if (manifest_add(m, name, line + 4 + n, mtime, size)) goto fail;
+    } else if (len && line[0] != '#') {
+      FAIL2("invalid line in %s: %s", m->filename, line);
+    }
+  }
+  m->changed = 0;
+  stat = 0;
+ fail:
+  fclose(fp);
+  if (stat) manifest_clear(m);
+  return stat;
+}
+
+/* Writes the manifest file of `m`.  Returns non-zero on error. */
+static int manifest_write(PluginManifest *m)
+{
+  FILE *fp=NULL;
+  char *tmpname=NULL;
+  size_t i;
+  int stat=1;
+  if (!(tmpname = malloc(strlen(m->filename) + 5)))
+    FAIL("allocation failure");
+  sprintf(tmpname, "%s.tmp", m->filename);
+  if (!(fp = fopen(tmpname, "w")))
+    FAIL1("cannot write plugin manifest: %s", tmpname);
+  fprintf(fp, "%s\n", MANIFEST_HEADER);
+  for (i=0; i<m->ndirs; i++)
+    fprintf(fp, "dir %.17g %s\n", m->dirs[i].mtime, m->dirs[i].path);
+  for (i=0; i<m->napis; i++) {
+    ManifestApi *a = m->apis + i;
+    /* skip entries that cannot be represented in the file */
+    if (!*a->name || strchr(a->name, ' ') || strlen(a->name) > 255 ||
+        strchr(a->path, '\n')) continue;
+    fprintf(fp, "api %.17g %lld %s %s\n", a->mtime, a->size, a->name,
+            a->path);
+  }
+  if (fclose(fp)) {
+    fp = NULL;
+    FAIL1("error writing plugin manifest: %s", tmpname);
+  }
+  fp = NULL;
+#ifdef _WIN32
+  remove(m->filename);
+#endif
+  if (rename(tmpname, m->filename))
+    FAIL1("cannot write plugin manifest: %s", m->filename);
+  m->changed = 0;
+  stat = 0;
+ fail:
+  if (fp) fclose(fp);
+  if (tmpname) free(tmpname);
+  return stat;
+}
+
+/* Returns non-zero if the directories in manifest `m` are the same as
+   the current search path in `info` and have not been modified. */
+static int manifest_uptodate(PluginManifest *m, PluginInfo *info)
+{
+  const char **paths = plugin_path_get(info);
+  size_t i;
+  for (i=0; paths && paths[i]; i++)
+    if (i >= m->ndirs || strcmp(paths[i], m->dirs[i].path) != 0 ||
+        fileinfo_mtime(paths[i]) != m->dirs[i].mtime)
+      return 0;
+  return i == m->ndirs;
+}
+
+/* Returns the path to the plugin file providing api `name` according
+   to the manifest of `info`, or NULL if the manifest has no valid entry
+   for `name`. */
+static const char *manifest_lookup(PluginInfo *info, const char *name)
+{
+  PluginManifest *m = info->manifest;
+  ManifestApi *a;
+  int *ip;
+  if (!m) return NULL;
+  if (!m->loaded) {
+    m->loaded = 1;
+    if (fileinfo_exists(m->filename)) {
+      ErrTry:
+        manifest_read(m);
+      ErrOther:
+        /* ignore invalid manifest, it will be rewritten */
+        break;
+      ErrEnd;
+    }
+  }
+  if (!(ip = map_get(&m->names, name))) return NULL;
+  a = m->apis + *ip;
+  if (!manifest_uptodate(m, info) ||
+      fileinfo_mtime(a->path) != a->mtime ||
+      fileinfo_size(a->path) != a->size)
+    return NULL;
+  return a->path;
+}
+
+/* Removes apis from manifest `m` whos plugin file has been modified
+   or removed since it was added. */
+static void manifest_prune(PluginManifest *m)
+{
+  size_t i, n=0;
+  for (i=0; i<m->napis; i++) {
+    ManifestApi *a = m->apis + i;
+    if (fileinfo_mtime(a->path) == a->mtime &&
+        fileinfo_size(a->path) == a->size) {
+      m->apis[n++] = *a;
+    } else {
+      free(a->name);
+      free(a->path);
+      m->changed = 1;
+    }
+  }
+  if (n == m->napis) return;
+  m->napis = n;
+  map_deinit(&m->names);
+  map_init(&m->names);
+  for (i=0; i<n; i++) map_set(&m->names, m->apis[i].name, (int)i);
+}
+
+/* Sets the directories in the manifest of `info` to the current search
+   path and writes the manifest if it has changed.  Should be called
+   after all plugins in the search path have been opened. */
+static void manifest_update(PluginInfo *info)
+{
+  PluginManifest *m = info->manifest;
+  const char **paths = plugin_path_get(info);
+  size_t i, n=0;
+  void *ptr;
+  if (!m) return;
+  m->loaded = 1;
+  manifest_prune(m);
+  if (!manifest_uptodate(m, info)) {
+    for (i=0; i<m->ndirs; i++) free(m->dirs[i].path);
+    m->ndirs = 0;
+    while (paths && paths[n]) n++;
+    if (n && !(ptr = realloc(m->dirs, n*sizeof(ManifestDir)))) {
+      err(1, "allocation failure");
+      return;
+    }
+    if (n) m->dirs = ptr;
+    for (i=0; i<n; i++) {
+      if (!(m->dirs[i].path = strdup(paths[i]))) break;
+      m->dirs[i].mtime = fileinfo_mtime(paths[i]);
+      m->ndirs++;
+    }
+    m->changed = 1;
+  }
+  if (m->changed) {
+    ErrTry:
+      manifest_write(m);
+    ErrOther:
+      /* failing to write the manifest is not fatal */
+      warnx("cannot update plugin manifest: %s", m->filename);
+      break;
+    ErrEnd;
+  }
+}
+
+
 /*
   Creates a new plugin type and returns a pointer to information about it.
 
@@ -113,10 +394,35 @@ void plugin_info_free(PluginInfo *info)
   map_deinit(&info->plugins);
   map_deinit(&info->pluginpaths);
   map_deinit(&info->apis);
+  if (info->manifest) manifest_free(info->manifest);
   free(info);
 }
 
 
+/*
+  Enables caching of the api names exposed by the plugins in the
+  search path in the manifest file `filename`.  If `filename` is NULL,
+  the manifest is disabled.
+
+  Returns non-zero on error.
+ */
+int plugin_set_manifest(PluginInfo *info, const char *filename)
+{
+  PluginManifest *m=NULL;
+  if (info->manifest) manifest_free(info->manifest);
+  info->manifest = NULL;
+  if (!filename) return 0;
+  if (!(m = calloc(1, sizeof(PluginManifest))) ||
+      !(m->filename = strdup(filename))) {
+    if (m) free(m);
+    return err(1, "allocation failure");
+  }
+  map_init(&m->names);
+  info->manifest = m;
+  return 0;
+}
+
+
 /*
   Help function for plugin_register_api().  Registers a plugin with given
   `path`, `api` and dsl `handle` into `info`.
@@ -167,6 +473,151 @@ static int register_api(PluginInfo *info, const PluginAPI *api,
 }
 
 
+/*
+  Registers `api` directly, without any shared library.  On success,
+  `info` takes ownership of `api`.  It is released with `api->freeapi`
+  when unloaded.
+
+  Returns non-zero on error.
+ */
+int plugin_register_api(PluginInfo *info, const PluginAPI *api)
+{
+  return register_api(info, api, NULL, NULL);
+}
+
+
+/*
+  Sets the plugins that are statically linked into the application.
+ */
+void plugin_set_static(PluginInfo *info, const PluginFunc *funcs)
+{
+  info->static_funcs = funcs;
+}
+
+
+/*
+  Registers the api with the given `name` from the statically linked
+  plugin functions.  If `name` is NULL, all statically linked apis
+  are registered.
+
+  Returns a pointer to the last registered api or NULL if no api was
+  registered.
+ */
+static const PluginAPI *load_static(PluginInfo *info, const char *name)
+{
+  const PluginFunc *f;
+  const PluginAPI *registered_api=NULL;
+  PluginAPI *api;
+
+  if (!info->static_funcs) return NULL;
+  for (f=info->static_funcs; *f; f++) {
+    int iter1=0, iter2=0;
+    while ((api = (PluginAPI *)(*f)(info->state, &iter1))) {
+      int registered = 0;
+      if (!map_get(&info->apis, api->name) &&
+          (!name || strcmp(api->name, name) == 0) &&
+          !register_api(info, api, NULL, NULL)) {
+        registered_api = api;
+        registered = 1;
+      }
+      if (!registered && api->freeapi) api->freeapi(api);
+      if (registered && name) return registered_api;
+      if (iter1 == iter2) break;
+      iter2 = iter1;
+    }
+  }
+  return registered_api;
+}
+
+
+/*
+  Help function for plugin_load().  Opens plugin file `filepath` and
+  registers the api with the given `name`.  If `name` is NULL, all
+  apis in the plugin are registered.  All apis exposed by the plugin
+  are added to the manifest, if it is enabled.
+
+  If `loaded_api` is not NULL, it is assigned to the last loaded api
+  whos name is not already registered.
+
+  Returns a pointer to the last registered api or NULL if no api was
+  registered.  `*failed` is set to non-zero if registration of the
+  named api failed.
+ */
+static const PluginAPI *load_file(PluginInfo *info, const char *name,
+                                  const char *filepath,
+                                  const void **loaded_api, int *failed)
+{
+  dsl_handle handle=NULL;
+  void *sym=NULL;
+  PluginFunc func;
+  PluginAPI *api=NULL;
+  const PluginAPI *registered_api=NULL;
+  double mtime=-1;
+  long long size=-1;
+  int iter1=0, iter2=0;
+  err_clear();
+
+  /* load plugin */
+  if (!(handle = dsl_open(filepath))) {
+    warn("cannot open plugin: \"%s\": %s", filepath, dsl_error());
+    return NULL;
+  }
+
+  if (!(sym = dsl_sym(handle, info->symbol))) {
+    warn("dsl_sym: %s", dsl_error());
+    (void)dsl_close(handle);
+    return NULL;
+  }
+  err_clear();
+
+  if (info->manifest) {
+    mtime = fileinfo_mtime(filepath);
+    size = fileinfo_size(filepath);
+  }
+
+  /* Silence gcc warning about that ISO C forbids conversion of object
+     pointer to function pointer */
+  *(void **)(&func) = sym;
+
+  while ((api = (PluginAPI *)func(info->state, &iter1))) {
+    int registered = 0;
+
+    if (info->manifest)
+      manifest_add(info->manifest, api->name, filepath, mtime, size);
+
+    if (!map_get(&info->apis, api->name)) {  /* no plugin with this name */
+      if (loaded_api) *loaded_api = api;
+      if (!name) {
+        if (!register_api(info, api, filepath, handle)) {
+          registered_api = api;
+          registered = 1;
+        }
+      } else if (strcmp(api->name, name) == 0) {
+        if (register_api(info, api, filepath, handle)) {
+          *failed = 1;
+        } else {
+          registered_api = api;
+          registered = 1;
+        }
+        /* continue to add the remaining apis to the manifest */
+        if (*failed || !info->manifest) break;
+      }
+    }
+    if (!registered && api && api->freeapi)
+      api->freeapi(api);
+
+    if (iter1 == iter2) break;
+    iter2 = iter1;
+  }
+  if (!api)
+    warn("failure calling \"%s\" in plugin \"%s\": %s",
+         info->symbol, filepath, dsl_error());
+
+  if (!registered_api) (void)dsl_close(handle);
+  return registered_api;
+}
+
+
 /*
   Looks up all file names matching `pattern` in the plugin search
   paths in `info` and try to load it as a plugin.  If it succeeds and
@@ -186,66 +637,22 @@ const PluginAPI *plugin_load(PluginInfo *info, const char *name,
 {
   FUIter *iter=NULL;
   const char *filepath;
-  dsl_handle handle=NULL;
-  void *sym=NULL;
-  PluginFunc func;
-  PluginAPI *api=NULL;
-  const void *loaded_api=NULL, *registered_api=NULL, *retval=NULL;
+  const PluginAPI *api;
+  const void *loaded_api=NULL, *retval=NULL;
+  int failed=0;
 
   if (!(iter = fu_startmatch(pattern, &info->paths))) goto fail;
 
   while ((filepath = fu_nextmatch(iter))) {
-    int iter1=0, iter2=0;
-    err_clear();
 
     /* check that plugin is not already loaded */
     if (map_get(&info->plugins, filepath)) continue;
 
-    /* load plugin */
-    if (!(handle = dsl_open(filepath))) {
-      warn("cannot open plugin: \"%s\": %s", filepath, dsl_error());
-      continue;
-    }
-
-    if (!(sym = dsl_sym(handle, info->symbol))) {
-      warn("dsl_sym: %s", dsl_error());
-      (void)dsl_close(handle);
-      continue;
-    }
-    err_clear();
-
-    /* Silence gcc warning about that ISO C forbids conversion of object
-       pointer to function pointer */
-    *(void **)(&func) = sym;
-
-    while ((api = (PluginAPI *)func(info->state, &iter1))) {
-      registered_api = NULL;
-
-      if (!map_get(&info->apis, api->name)) {  /* no plugin with this name */
-        loaded_api = api;
-        if (!name) {
-          if (!register_api(info, api, filepath, handle))
-            registered_api = api;
-        } else if (strcmp(api->name, name) == 0) {
-          if (register_api(info, api, filepath, handle)) goto fail;
-          registered_api = api;
-          fu_endmatch(iter);
-          return api;
-        }
-      }
-      if (!registered_api && api && api->freeapi)
-        api->freeapi(api);
-
-      if (iter1 == iter2) break;
-      iter2 = iter1;
-    }
-    if (!api)
-      warn("failure calling \"%s\" in plugin \"%s\": %s",
-           info->symbol, filepath, dsl_error());
-
-    if (!registered_api && handle) {
-      if (handle) (void)dsl_close(handle);
-      handle = NULL;
+    api = load_file(info, name, filepath, &loaded_api, &failed);
+    if (failed) goto fail;
+    if (api && name) {
+      fu_endmatch(iter);
+      return api;
     }
   }
   if (name && emit_err)
@@ -253,8 +660,6 @@ const PluginAPI *plugin_load(PluginInfo *info, const char *name,
   else
     retval = loaded_api;
  fail:
-  if (!retval && handle)
-    (void)dsl_close(handle);
   if (iter) fu_endmatch(iter);
 
   return retval;
@@ -266,6 +671,9 @@ const PluginAPI *plugin_load(PluginInfo *info, const char *name,
 
   If a plugin with the given name is registered, it is returned.
 
+  Otherwise, if a statically linked plugin with the given name exists,
+  it is registered and returned.
+
   Otherwise the plugin search path is checked for shared libraries
   matching `name.EXT` where `EXT` is the extension for shared library
   on the current platform ("dll" on Windows and "so" on Unix/Linux).
@@ -282,12 +690,36 @@ const PluginAPI *plugin_get_api(PluginInfo *info, const char *name)
 {
   const PluginAPI *api=NULL;
   PluginAPI **p;
+  const char *path;
   char *pattern=NULL;
+  int failed=0;
 
   /* Check already registered apis */
   if ((p = map_get(&info->apis, name)))
     return (const PluginAPI *)*p;
 
+  /* Check statically linked plugins */
+  if ((api = load_static(info, name)))
+    return api;
+
+  /* Open the plugin file listed in the manifest */
+  if ((path = manifest_lookup(info, name)) &&
+      !map_get(&info->plugins, path)) {
+    char *filepath = strdup(path);  /* manifest may be updated */
+    if (!filepath) return err(1, "allocation failure"), NULL;
+    api = load_file(info, name, filepath, NULL, &failed);
+    free(filepath);
+    if (api || failed) return api;
+  }
+
+  /* Manifest is not up to date - open all plugins to update it */
+  if (info->manifest) {
+    plugin_load_all(info);
+    if ((p = map_get(&info->apis, name)))
+      return (const PluginAPI *)*p;
+    return err(1, "cannot find api: '%s'", name), NULL;
+  }
+
   /* Load plugin from search path */
   if (!(pattern = malloc(strlen(name) + strlen(DSL_EXT) + 1)))
     return err(1, "allocation failure"), NULL;
@@ -303,16 +735,21 @@ const PluginAPI *plugin_get_api(PluginInfo *info, const char *name)
 
 
 /*
-  Load all plugins that can be found in the plugin search path.
+  Load all statically linked plugins and all plugins that can be found
+  in the plugin search path.
  */
 void plugin_load_all(PluginInfo *info)
 {
   char *pattern = malloc(strlen(DSL_EXT) + 2);
+  TRACE_BEGIN(span, "plugin_load_all", info->kind);
+  load_static(info, NULL);
   pattern[0] = '*';
   strcpy(pattern+1, DSL_EXT);
   while (1)
     if (!plugin_load(info, NULL, pattern, 0)) break;
   free(pattern);
+  manifest_update(info);
+  TRACE_END(span);
 }
 
 
@@ -65,6 +65,9 @@ typedef const PluginAPI *(*PluginFunc)(void *state, int *iter);
 /** Opaque struct for list of loaded plugins (shared libraries) */
 typedef struct _Plugin Plugin;
 
+/** Opaque struct for the manifest mapping api names to plugin files */
+typedef struct _PluginManifest PluginManifest;
+
 /** New map types for plugins and plugin apis */
 typedef map_t(Plugin *) map_plg_t;
 typedef map_t(PluginAPI *) map_api_t;
@@ -80,6 +83,9 @@ typedef struct _PluginInfo {
   map_plg_t plugins;     /*!< Maps plugin paths to loaded plugins */
   map_str_t pluginpaths; /*!< Maps api names to plugin path names */
   map_api_t apis;        /*!< Maps api names to plugin apis */
+  PluginManifest *manifest; /*!< Manifest of plugin files, may be NULL */
+  const PluginFunc *static_funcs; /*!< NULL-terminated array of statically
+                                       linked plugin functions, may be NULL */
 } PluginInfo;
 
 
@@ -108,12 +114,58 @@ PluginInfo *plugin_info_create(const char *kind, const char *symbol,
  */
 void plugin_info_free(PluginInfo *info);
 
+/**
+  Enables caching of the api names exposed by the plugins in the
+  search path in the manifest file `filename`.  If `filename` is NULL,
+  the manifest is disabled.
+
+  The manifest maps api names to plugin files, together with their
+  modification time and size, and the modification times of the
+  directories in the search path.  When it is up to date,
+  plugin_get_api() only opens the plugin file providing the requested
+  api instead of opening all shared libraries in the search path.
+  The manifest is (re)written after all plugins in the search path
+  have been opened, e.g. by plugin_load_all().
+
+  Returns non-zero on error.
+ */
+int plugin_set_manifest(PluginInfo *info, const char *filename);
+
+/**
+  Sets the plugins that are statically linked into the application.
+
+  `funcs` is a NULL-terminated array of plugin functions with the same
+  prototype as the function that shared library plugins define.  It
+  is not copied and must stay valid for the lifetime of `info`.  If
+  `funcs` is NULL, no statically linked plugins are used.
+
+  The apis provided by these functions are consulted before the
+  plugin search path, such that they can be registered without any
+  filesystem scan or dynamic loading.
+ */
+void plugin_set_static(PluginInfo *info, const PluginFunc *funcs);
+
+
+/**
+  Registers `api` directly, without any shared library.  This allows
+  plugin apis to be created at runtime.  On success, `info` takes
+  ownership of `api`.  It is released with `api->freeapi` when
+  unloaded.
+
+  Returns non-zero on error, e.g. if an api with the same name is
+  already registered.
+ */
+int plugin_register_api(PluginInfo *info, const PluginAPI *api);
+
 
 /**
   Returns pointer to plugin api.
 
   If a plugin with the given name is already registered, it is returned.
 
+  Otherwise, if a statically linked plugin with the given name exists
+  (see plugin_set_static()), it is registered and returned.
+
   Otherwise the plugin search path is checked for shared libraries
   matching `name.EXT` where `EXT` is the extension for shared library
   on the current platform ("dll" on Windows and "so" on Unix/Linux).
@@ -129,7 +181,8 @@ void plugin_info_free(PluginInfo *info);
 const PluginAPI *plugin_get_api(PluginInfo *info, const char *name);
 
 /**
-  Load all plugins that can be found in the plugin search path.
+  Load all statically linked plugins and all plugins that can be found
+  in the plugin search path.
   Returns non-zero on error.
  */
 void plugin_load_all(PluginInfo *info);
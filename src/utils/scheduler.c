@@ -0,0 +1,423 @@
+/* scheduler.c -- shared work-stealing task scheduler
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.h"
+#include "session.h"
+#include "scratch.h"
+#include "scheduler.h"
+
+/* Name of the scheduler state in the default session */
+#define SCHEDULER_STATE_ID "scheduler-state-id"
+
+/* Maximum number of chunks per thread in sched_parallel_for() */
+#define CHUNKS_PER_THREAD 4
+
+
+/* A queued task */
+typedef struct {
+  SchedFunc func;
+  void *arg;
+  SchedGroup *group;
+} Task;
+
+/* A deque of tasks.  The owner pushes and pops at the back, while
+   other threads steal from the front. */
+typedef struct {
+  ThreadMutex mutex;
+  Task *tasks;              /* ring buffer */
+  size_t size;              /* allocated length of `tasks` */
+  size_t head;              /* index of front task */
+  size_t n;                 /* number of tasks */
+} Deque;
+
+struct _SchedGroup {
+  int pending;              /* number of spawned tasks not yet done */
+};
+
+/* State of the scheduler.  Deque 0 is shared by threads that are not
+   workers, deque i+1 belongs to worker i.
+
+   Since plugins link their own copy of this module, the state is
+   stored in the default session, such that all copies share the same
+   pool of workers. */
+typedef struct {
+  ThreadMutex mutex;        /* protects the fields below and `cond` */
+  ThreadCond cond;          /* signalled when tasks are queued or done */
+  int nthreads;             /* configured number of threads, 0 if unset */
+  int nworkers;             /* number of started workers */
+  Thread *threads;          /* worker threads */
+  Deque *deques;            /* nworkers+1 deques */
+  int started;              /* whether the pool is started */
+  int stop;                 /* tells the workers to exit */
+  int nsleeping;            /* number of threads waiting on `cond` */
+  int queued;               /* number of queued tasks (atomic) */
+} Scheduler;
+
+/* Pointer to the state in the default session */
+static Scheduler *_sched = NULL;
+static ThreadMutex _sched_mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Index of the deque of this thread */
+static _thread_local int self = 0;
+
+
+/* Appends `task` to the back of deque `d`.  Returns non-zero on
+   allocation failure. */
+static int deque_push(Deque *d, const Task *task)
+{
+  thread_mutex_lock(&d->mutex);
+  if (d->n == d->size) {
+    size_t i, size = (d->size) ? 2*d->size : 64;
+    Task *tasks = malloc(size * sizeof(Task));
+    if (!tasks) {
+      thread_mutex_unlock(&d->mutex);
+      return 1;
+    }
+    for (i=0; i<d->n; i++) tasks[i] = d->tasks[(d->head + i) % d->size];
+    if (d->tasks) free(d->tasks);
+    d->tasks = tasks;
+    d->size = size;
+    d->head = 0;
+  }
+  d->tasks[(d->head + d->n++) % d->size] = *task;
+  thread_mutex_unlock(&d->mutex);
+  return 0;
+}
+
+/* Removes a task from deque `d` and writes it to `task`.  Takes the
+   back task if `back` is true, otherwise the front task.  Returns
+   non-zero if `d` is empty. */
+static int deque_take(Deque *d, Task *task, int back)
+{
+  int retval=1;
+  thread_mutex_lock(&d->mutex);
+  if (d->n) {
+    if (back) {
+      *task = d->tasks[(d->head + d->n - 1) % d->size];
+    } else {
+      *task = d->tasks[d->head];
+      d->head = (d->head + 1) % d->size;
+    }
+    d->n--;
+    retval = 0;
+  }
+  thread_mutex_unlock(&d->mutex);
+  return retval;
+}
+
+/* Executes `task` and tells its group that it is done. */
+static void run_task(Scheduler *s, const Task *task)
+{
+  task->func(task->arg);
+  if (thread_atomic_add(&task->group->pending, -1) == 0) {
+    thread_mutex_lock(&s->mutex);
+    if (s->nsleeping) thread_cond_broadcast(&s->cond);
+    thread_mutex_unlock(&s->mutex);
+  }
+}
+
+/* Executes one queued task, looking first in the own deque, then in
+   the shared deque and finally in the deques of the other workers.
+   Returns non-zero if no task was found. */
+static int run_one(Scheduler *s)
+{
+  Task task;
+  int i, n = s->nworkers + 1;
+  if (!thread_atomic_load(&s->queued)) return 1;
+  if (deque_take(s->deques + self, &task, 1) &&
+      (self == 0 || deque_take(s->deques, &task, 0))) {
+    for (i=1; i<n; i++)
+      if (!deque_take(s->deques + (self + i) % n, &task, 0)) break;
+    if (i == n) return 1;
+  }
+  thread_atomic_add(&s->queued, -1);
+  run_task(s, &task);
+  return 0;
+}
+
+/* Stops the workers of `s` and free's its deques. */
+static void stop(Scheduler *s)
+{
+  int i;
+  thread_mutex_lock(&s->mutex);
+  if (!s->started) {
+    thread_mutex_unlock(&s->mutex);
+    return;
+  }
+  s->stop = 1;
+  thread_cond_broadcast(&s->cond);
+  thread_mutex_unlock(&s->mutex);
+
+  for (i=0; i<s->nworkers; i++) thread_join(s->threads[i], NULL);
+
+  thread_mutex_lock(&s->mutex);
+  for (i=0; i<=s->nworkers; i++) {
+    thread_mutex_destroy(&s->deques[i].mutex);
+    if (s->deques[i].tasks) free(s->deques[i].tasks);
+  }
+  free(s->deques);
+  if (s->threads) free(s->threads);
+  s->deques = NULL;
+  s->threads = NULL;
+  s->nworkers = 0;
+  s->started = 0;
+  thread_mutex_unlock(&s->mutex);
+}
+
+/* Free's the scheduler state.  Called when the session is free'ed. */
+static void free_sched(void *ptr)
+{
+  Scheduler *s = ptr;
+  stop(s);
+  thread_mutex_lock(&_sched_mutex);
+  if (_sched == s) _sched = NULL;
+  thread_mutex_unlock(&_sched_mutex);
+  thread_cond_destroy(&s->cond);
+  thread_mutex_destroy(&s->mutex);
+  free(s);
+}
+
+/* Returns the scheduler state or NULL on allocation failure, in which
+   case tasks are executed directly. */
+static Scheduler *get_sched(void)
+{
+  Scheduler *s;
+  thread_mutex_lock(&_sched_mutex);
+  if (!_sched) {
+    Session *session = session_get_default();
+    if (!(s = session_get_state(session, SCHEDULER_STATE_ID)) &&
+        (s = calloc(1, sizeof(Scheduler)))) {
+      thread_mutex_init(&s->mutex);
+      thread_cond_init(&s->cond);
+      if (session_add_state(session, SCHEDULER_STATE_ID, s, free_sched)) {
+        thread_cond_destroy(&s->cond);
+        thread_mutex_destroy(&s->mutex);
+        free(s);
+        s = NULL;
+      }
+    }
+    _sched = s;
+  }
+  s = _sched;
+  thread_mutex_unlock(&_sched_mutex);
+  return s;
+}
+
+/* Worker thread function. */
+static void *worker(void *arg)
+{
+  Scheduler *s = get_sched();
+  self = (int)(size_t)arg;
+  while (1) {
+    if (!run_one(s)) continue;
+    thread_mutex_lock(&s->mutex);
+    if (s->stop) {
+      thread_mutex_unlock(&s->mutex);
+      break;
+    }
+    s->nsleeping++;
+    while (!thread_atomic_load(&s->queued) && !s->stop)
+      thread_cond_wait(&s->cond, &s->mutex);
+    s->nsleeping--;
+    thread_mutex_unlock(&s->mutex);
+  }
+  scratch_cleanup();
+  return NULL;
+}
+
+/* Returns the configured number of threads.  Must be called with
+   `s->mutex` locked. */
+static int nthreads_locked(Scheduler *s)
+{
+  if (!s->nthreads) s->nthreads = thread_ncpus();
+  return s->nthreads;
+}
+
+/* Starts the worker threads of `s` if they are not already started.
+   Returns the number of workers. */
+static int start(Scheduler *s)
+{
+  int i, n;
+  if (!s) return 0;
+  if (thread_atomic_load(&s->started)) return s->nworkers;
+  thread_mutex_lock(&s->mutex);
+  if (!s->started) {
+    n = nthreads_locked(s) - 1;
+    s->nworkers = 0;
+    s->stop = 0;
+    if ((s->deques = calloc(n + 1, sizeof(Deque))) &&
+        (n == 0 || (s->threads = calloc(n, sizeof(Thread))))) {
+      for (i=0; i<=n; i++) thread_mutex_init(&s->deques[i].mutex);
+      /* Workers are started with the mutex locked, such that they
+         do not look at `s->nworkers` before it is final */
+      for (i=0; i<n; i++)
+        if (thread_create(s->threads + i, worker, (void *)(size_t)(i + 1)))
+          break;
+      s->nworkers = i;
+      thread_atomic_add(&s->started, 1);
+    }
+  }
+  thread_mutex_unlock(&s->mutex);
+  return s->nworkers;
+}
+
+
+/*
+  Sets the total number of threads executing tasks.
+ */
+int sched_set_nthreads(int n)
+{
+  Scheduler *s = get_sched();
+  if (!s) return 1;
+  stop(s);
+  thread_mutex_lock(&s->mutex);
+  s->nthreads = (n > 0) ? n : thread_ncpus();
+  thread_mutex_unlock(&s->mutex);
+  return 0;
+}
+
+/*
+  Returns the total number of threads executing tasks.
+ */
+int sched_get_nthreads(void)
+{
+  Scheduler *s = get_sched();
+  int n;
+  if (!s) return 1;
+  thread_mutex_lock(&s->mutex);
+  n = nthreads_locked(s);
+  thread_mutex_unlock(&s->mutex);
+  return n;
+}
+
+/*
+  Stops the worker threads.
+ */
+void sched_stop(void)
+{
+  Scheduler *s = get_sched();
+  if (s) stop(s);
+}
+
+
+/*
+  Returns a new task group or NULL on error.
+ */
+SchedGroup *sched_group_create(void)
+{
+  return calloc(1, sizeof(SchedGroup));
+}
+
+/*
+  Waits for the tasks in group `g` and free's it.
+ */
+void sched_group_free(SchedGroup *g)
+{
+  sched_wait(g);
+  free(g);
+}
+
+/*
+  Adds task `func(arg)` to group `g`.
+ */
+int sched_spawn(SchedGroup *g, SchedFunc func, void *arg)
+{
+  Scheduler *s = get_sched();
+  Task task;
+  task.func = func;
+  task.arg = arg;
+  task.group = g;
+  if (start(s) == 0) {
+    func(arg);
+    return 0;
+  }
+  thread_atomic_add(&g->pending, 1);
+  if (deque_push(s->deques + self, &task)) {
+    run_task(s, &task);
+    return 0;
+  }
+  thread_atomic_add(&s->queued, 1);
+  thread_mutex_lock(&s->mutex);
+  if (s->nsleeping) thread_cond_signal(&s->cond);
+  thread_mutex_unlock(&s->mutex);
+  return 0;
+}
+
+/*
+  Waits until all tasks in group `g` are done.
+ */
+int sched_wait(SchedGroup *g)
+{
+  Scheduler *s;
+  if (!thread_atomic_load(&g->pending)) return 0;
+  s = get_sched();
+  while (thread_atomic_load(&g->pending)) {
+    if (!run_one(s)) continue;
+    /* Nothing to steal - the remaining tasks of `g` are running */
+    thread_mutex_lock(&s->mutex);
+    s->nsleeping++;
+    while (thread_atomic_load(&g->pending) &&
+           !thread_atomic_load(&s->queued))
+      thread_cond_wait(&s->cond, &s->mutex);
+    s->nsleeping--;
+    thread_mutex_unlock(&s->mutex);
+  }
+  return 0;
+}
+
+
+/* A chunk of a parallel for loop */
+typedef struct {
+  SchedRangeFunc func;
+  void *arg;
+  size_t begin;
+  size_t end;
+} Chunk;
+
+/* Task executing a chunk. */
+static void run_chunk(void *arg)
+{
+  Chunk *c = arg;
+  c->func(c->begin, c->end, c->arg);
+}
+
+/*
+  Calls `func(begin, end, arg)` for consecutive chunks covering [0, n).
+ */
+int sched_parallel_for(size_t n, size_t grain, SchedRangeFunc func,
+                       void *arg)
+{
+  SchedGroup g;
+  Chunk *chunks;
+  size_t i, nchunks, maxchunks;
+
+  if (grain < 1) grain = 1;
+  nchunks = (n + grain - 1) / grain;
+  maxchunks = (size_t)sched_get_nthreads() * CHUNKS_PER_THREAD;
+  if (nchunks > maxchunks) nchunks = maxchunks;
+  if (nchunks <= 1 || start(get_sched()) == 0 ||
+      !(chunks = malloc(nchunks * sizeof(Chunk)))) {
+    if (n) func(0, n, arg);
+    return 0;
+  }
+  memset(&g, 0, sizeof(g));
+  for (i=0; i<nchunks; i++) {
+    chunks[i].func = func;
+    chunks[i].arg = arg;
+    chunks[i].begin = n * i / nchunks;
+    chunks[i].end = n * (i + 1) / nchunks;
+  }
+  for (i=nchunks-1; i>0; i--) sched_spawn(&g, run_chunk, chunks + i);
+  run_chunk(chunks);
+  sched_wait(&g);
+  free(chunks);
+  return 0;
+}
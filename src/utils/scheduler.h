@@ -0,0 +1,105 @@
+/* scheduler.h -- shared work-stealing task scheduler
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+/**
+  @file
+  @brief Shared work-stealing task scheduler.
+
+  A single process-wide pool of worker threads executing small tasks.
+  Each worker has its own deque.  Tasks spawned from a worker are
+  pushed to and popped from the back of its deque, while idle workers
+  steal from the front of the deques of others.  Tasks spawned from
+  other threads are put in a shared queue.
+
+  A thread waiting for a group of tasks executes queued tasks while
+  waiting, so tasks may themselves spawn and wait for tasks without
+  deadlocking or creating more threads.  All parallel code should
+  therefore use this scheduler instead of creating its own threads,
+  such that nested parallelism does not oversubscribe the cores.
+
+  The pool is started on first use with sched_get_nthreads() - 1
+  workers, since the waiting thread is also working.  Without thread
+  support, or with one thread, tasks are executed directly when they
+  are spawned.
+*/
+
+#include <stddef.h>
+
+/** Prototype for tasks. */
+typedef void (*SchedFunc)(void *arg);
+
+/** Prototype for functions processing the index range [`begin`, `end`). */
+typedef void (*SchedRangeFunc)(size_t begin, size_t end, void *arg);
+
+/** Opaque type for a group of tasks that can be waited for. */
+typedef struct _SchedGroup SchedGroup;
+
+
+/**
+  Sets the total number of threads executing tasks, including the
+  waiting thread.  If `n` is zero or negative, the number of online
+  processors is used.  A running pool is stopped and restarted on next
+  use.  Must not be called while tasks are running.
+
+  Returns non-zero on error.
+ */
+int sched_set_nthreads(int n);
+
+/**
+  Returns the total number of threads executing tasks.
+ */
+int sched_get_nthreads(void);
+
+/**
+  Stops the worker threads.  They are started again on next use.
+ */
+void sched_stop(void);
+
+
+/**
+  Returns a new task group or NULL on error.
+ */
+SchedGroup *sched_group_create(void);
+
+/**
+  Waits for the tasks in group `g` and free's it.
+ */
+void sched_group_free(SchedGroup *g);
+
+/**
+  Adds task `func(arg)` to group `g`.  The task is executed directly
+  if it cannot be queued.
+
+  Returns non-zero on error.
+ */
+int sched_spawn(SchedGroup *g, SchedFunc func, void *arg);
+
+/**
+  Waits until all tasks in group `g` are done, executing queued tasks
+  while waiting.
+
+  Returns non-zero on error.
+ */
+int sched_wait(SchedGroup *g);
+
+
+/**
+  Calls `func(begin, end, arg)` for consecutive chunks covering the
+  index range [0, `n`) and returns when all calls are done.  The
+  chunks are executed concurrently.  Each chunk has at least `grain`
+  indices, except possibly the last one.  The calling thread executes
+  the first chunk.
+
+  Returns non-zero on error.
+ */
+int sched_parallel_for(size_t n, size_t grain, SchedRangeFunc func,
+                       void *arg);
+
+
+#endif /* _SCHEDULER_H */
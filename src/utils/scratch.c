@@ -0,0 +1,203 @@
+/* scratch.c -- per-thread scratch arena for temporary allocations
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "err.h"
+#include "scratch.h"
+
+#if defined(HAVE_GCC_THREAD_LOCAL_STORAGE) || \
+  defined(HAVE_WIN32_THREAD_LOCAL_STORAGE)
+# define USE_ARENA
+#endif
+
+/* Alignment of scratch buffers */
+#define ALIGN 16
+
+/* Rounds `n` up to a multiple of ALIGN */
+#define ROUNDUP(n) (((n) + ALIGN - 1) & ~((size_t)ALIGN - 1))
+
+
+#ifdef USE_ARENA
+
+/* A block of arena memory.  The data follows the header. */
+typedef struct _ScratchBlock {
+  struct _ScratchBlock *prev;  /* previous block */
+  struct _ScratchBlock *next;  /* next block, spare if after `cur` */
+  size_t size;                 /* capacity of data */
+  size_t used;                 /* number of bytes in use */
+} ScratchBlock;
+
+#define HEADSIZE ROUNDUP(sizeof(ScratchBlock))
+#define DATA(b) ((char *)(b) + HEADSIZE)
+
+/* Arena of the current thread */
+static _thread_local ScratchBlock *first = NULL;  /* first block */
+static _thread_local ScratchBlock *cur = NULL;    /* current block */
+static _thread_local size_t nheap = 0;            /* heap allocations */
+
+
+/* Inserts a new block with capacity `size` after the current block and
+   makes it current.  Returns NULL on error. */
+static ScratchBlock *new_block(size_t size)
+{
+  ScratchBlock *b;
+  if (!(b = malloc(HEADSIZE + size)))
+    return err(1, "allocation failure"), NULL;
+  nheap++;
+  b->size = size;
+  b->used = 0;
+  b->prev = cur;
+  b->next = (cur) ? cur->next : NULL;
+  if (b->next) b->next->prev = b;
+  if (cur)
+    cur->next = b;
+  else
+    first = b;
+  cur = b;
+  return b;
+}
+
+/* Makes a block with at least `n` free bytes current, reusing the
+   next spare block if it is large enough.  Returns NULL on error. */
+static ScratchBlock *next_block(size_t n)
+{
+  ScratchBlock *b;
+  if (!first && !new_block(SCRATCH_BLOCKSIZE - HEADSIZE)) return NULL;
+  if (cur->used + n <= cur->size) return cur;
+  if ((b = cur->next) && b->size >= n) {
+    b->used = 0;
+    cur = b;
+    return b;
+  }
+  return new_block((n > SCRATCH_BLOCKSIZE - HEADSIZE) ?
+                   n : SCRATCH_BLOCKSIZE - HEADSIZE);
+}
+
+/* Frees all blocks after the first one. */
+static void trim(void)
+{
+  ScratchBlock *b, *next;
+  if (!first) return;
+  for (b=first->next; b; b=next) {
+    next = b->next;
+    free(b);
+  }
+  first->next = NULL;
+}
+
+#endif
+
+
+/*
+  Returns a pointer to a zero-initialised scratch buffer for an array
+  of `nmemb` elements of `size` bytes.  The buffer is aligned for any
+  type.  Returns NULL on error.
+ */
+void *scratch_calloc(size_t nmemb, size_t size)
+{
+#ifdef USE_ARENA
+  size_t n;
+  void *ptr;
+  if (size && nmemb > SIZE_MAX / size - ALIGN)
+    return err(1, "scratch allocation too large"), NULL;
+  n = ROUNDUP(nmemb * size);
+  if (!n) n = ALIGN;
+  if (!next_block(n)) return NULL;
+  ptr = DATA(cur) + cur->used;
+  cur->used += n;
+  memset(ptr, 0, n);
+  return ptr;
+#else
+  void *ptr;
+  if (!(ptr = calloc((nmemb) ? nmemb : 1, (size) ? size : 1)))
+    return err(1, "allocation failure"), NULL;
+  return ptr;
+#endif
+}
+
+/*
+  Returns a NUL-terminated scratch copy of the first `n` bytes of
+  `s`, or NULL on error.
+ */
+char *scratch_strndup(const char *s, size_t n)
+{
+  char *p;
+  if (!(p = scratch_calloc(n + 1, 1))) return NULL;
+  memcpy(p, s, n);
+  return p;
+}
+
+/*
+  Returns a scratch copy of string `s`, or NULL on error.
+ */
+char *scratch_strdup(const char *s)
+{
+  return scratch_strndup(s, strlen(s));
+}
+
+/*
+  Frees scratch buffer `ptr` and all scratch buffers allocated after
+  it by the current thread.  Does nothing if `ptr` is NULL.
+ */
+void scratch_free(void *ptr)
+{
+#ifdef USE_ARENA
+  ScratchBlock *b;
+  char *p = ptr;
+  if (!ptr) return;
+  for (b=cur; b; b=b->prev)
+    if (p >= DATA(b) && p < DATA(b) + b->used) break;
+  if (!b) {
+    errx(1, "scratch_free(): %p is not a live scratch buffer", ptr);
+    return;
+  }
+  b->used = p - DATA(b);
+  cur = b;
+  while (!cur->used && cur->prev) cur = cur->prev;
+  if (cur == first && !cur->used) trim();
+#else
+  free(ptr);
+#endif
+}
+
+/*
+  Frees all memory of the scratch arena of the current thread.
+  Outstanding scratch buffers are invalidated.
+ */
+void scratch_cleanup(void)
+{
+#ifdef USE_ARENA
+  trim();
+  free(first);
+  first = cur = NULL;
+#endif
+}
+
+/*
+  Assigns `stats` to the statistics of the scratch arena of the
+  current thread.
+ */
+void scratch_stats(ScratchStats *stats)
+{
+  memset(stats, 0, sizeof(ScratchStats));
+#ifdef USE_ARENA
+  {
+    ScratchBlock *b;
+    int passed = 0;
+    for (b=first; b; b=b->next) {
+      stats->nblocks++;
+      stats->capacity += b->size;
+      if (!passed) stats->used += b->used;
+      if (b == cur) passed = 1;
+    }
+    stats->nheap = nheap;
+  }
+#endif
+}
@@ -0,0 +1,93 @@
+/* scratch.h -- per-thread scratch arena for temporary allocations
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#ifndef _SCRATCH_H
+#define _SCRATCH_H
+
+/**
+  @file
+  @brief Per-thread scratch arena for short-lived allocations.
+
+  Temporary buffers that are allocated and freed within a single
+  function call, like dimension arrays and copies of strings to parse,
+  can be taken from a scratch arena owned by the calling thread
+  instead of the heap:
+
+      size_t *dims = scratch_calloc(ndims, sizeof(size_t));
+      ...
+      scratch_free(dims);
+
+  The arena is a stack.  scratch_free() releases the given buffer
+  together with all scratch buffers allocated after it by the same
+  thread, so buffers must be freed in reverse order of allocation
+  (nested calls that use the arena are fine as long as they free their
+  own buffers before returning).  Scratch buffers must not be passed
+  to other threads or outlive the function that allocated them.
+
+  The arena memory is retained between calls, so after warming up,
+  allocating and freeing scratch buffers doesn't touch the heap.  Only
+  the first block of SCRATCH_BLOCKSIZE bytes is kept when the arena
+  becomes empty.  Threads that use the arena should call
+  scratch_cleanup() before exiting.
+
+  If the compiler doesn't support thread local storage, the functions
+  fall back to the corresponding heap functions.  Portable code should
+  therefore free each scratch buffer explicitly.
+ */
+
+#include <stddef.h>
+
+
+/** Size of arena blocks.  Larger buffers get their own block. */
+#define SCRATCH_BLOCKSIZE 4096
+
+
+/** Statistics of the scratch arena of the current thread. */
+typedef struct {
+  size_t nblocks;   /*!< Number of allocated blocks */
+  size_t capacity;  /*!< Total capacity of allocated blocks */
+  size_t used;      /*!< Number of bytes currently in use */
+  size_t nheap;     /*!< Number of heap allocations made by the arena */
+} ScratchStats;
+
+
+/**
+  Returns a pointer to a zero-initialised scratch buffer for an array
+  of `nmemb` elements of `size` bytes.  The buffer is aligned for any
+  type.  Returns NULL on error.
+ */
+void *scratch_calloc(size_t nmemb, size_t size);
+
+/**
+  Returns a NUL-terminated scratch copy of the first `n` bytes of
+  `s`, or NULL on error.
+ */
+char *scratch_strndup(const char *s, size_t n);
+
+/**
+  Returns a scratch copy of string `s`, or NULL on error.
+ */
+char *scratch_strdup(const char *s);
+
+/**
+  Frees scratch buffer `ptr` and all scratch buffers allocated after
+  it by the current thread.  Does nothing if `ptr` is NULL.
+ */
+void scratch_free(void *ptr);
+
+/**
+  Frees all memory of the scratch arena of the current thread.
+  Outstanding scratch buffers are invalidated.
+ */
+void scratch_cleanup(void);
+
+/**
+  Assigns `stats` to the statistics of the scratch arena of the
+  current thread.
+ */
+void scratch_stats(ScratchStats *stats);
+
+#endif /* _SCRATCH_H */
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include "map.h"
 #include "err.h"
+#include "thread.h"
 #include "session.h"
 
 
@@ -36,6 +37,10 @@ static map_session_t _sessions;
 /* Number of sessions */
 static int _sessions_count=0;
 
+/* Protects `_sessions` and `_sessions_count`, such that sessions can
+   be created and freed from several threads */
+static ThreadMutex _sessions_mutex = THREAD_MUTEX_INITIALIZER;
+
 /* Returns pointer to `_sessions`.  Initialise it if needed. */
 static map_session_t *get_sessions(void)
 {
@@ -45,12 +50,9 @@ static map_session_t *get_sessions(void)
 }
 
 
-/*
-  Create a new session with given `session_id`.
-
-  Return pointer to the session or NULL on error.
-*/
-Session *session_create(const char *session_id)
+/* Help function for session_create().  Must be called with
+   `_sessions_mutex` locked. */
+static Session *_session_create(const char *session_id)
 {
   map_session_t *sessions = get_sessions();
   Session s, *sp;
@@ -72,12 +74,26 @@ Session *session_create(const char *session_id)
   return sp;
 }
 
+/*
+  Create a new session with given `session_id`.
+
+  Return pointer to the session or NULL on error.
+*/
+Session *session_create(const char *session_id)
+{
+  Session *s;
+  thread_mutex_lock(&_sessions_mutex);
+  s = _session_create(session_id);
+  thread_mutex_unlock(&_sessions_mutex);
+  return s;
+}
+
 /*
   Free all memory associated with `session`.
 */
 void session_free(Session *s)
 {
-  map_session_t *sessions = get_sessions();
+  map_session_t *sessions;
   map_iter_t iter = map_iter(&s->states);
   const char *name, *id=s->session_id;
 
@@ -87,6 +103,8 @@ void session_free(Session *s)
   }
   map_deinit(&s->states);
 
+  thread_mutex_lock(&_sessions_mutex);
+  sessions = get_sessions();
   if (id) {
     map_remove(sessions, id);
     free((char *)id);
@@ -95,6 +113,7 @@ void session_free(Session *s)
   _sessions_count--;
   if (!_sessions_count)
     map_deinit(sessions);
+  thread_mutex_unlock(&_sessions_mutex);
 }
 
 /*
@@ -104,8 +123,12 @@ void session_free(Session *s)
 */
 Session *session_get(const char *session_id)
 {
-  map_session_t *sessions = get_sessions();
-  Session *s = map_get(sessions, session_id);
+  map_session_t *sessions;
+  Session *s;
+  thread_mutex_lock(&_sessions_mutex);
+  sessions = get_sessions();
+  s = map_get(sessions, session_id);
+  thread_mutex_unlock(&_sessions_mutex);
   if (!s) return errx(1, "no session with id: %s", session_id), NULL;
   return s;
 }
@@ -134,9 +157,13 @@ const char *session_get_id(Session *s)
 */
 Session *session_get_default(void)
 {
-  map_session_t *sessions = get_sessions();
-  Session *s = map_get(sessions, DEFAULT_SESSION_ID);
-  if (!s) s = session_create(DEFAULT_SESSION_ID);
+  map_session_t *sessions;
+  Session *s;
+  thread_mutex_lock(&_sessions_mutex);
+  sessions = get_sessions();
+  s = map_get(sessions, DEFAULT_SESSION_ID);
+  if (!s) s = _session_create(DEFAULT_SESSION_ID);
+  thread_mutex_unlock(&_sessions_mutex);
   return s;
 }
 
@@ -150,11 +177,17 @@ Session *session_get_default(void)
 */
 int session_set_default(Session *s)
 {
-  map_session_t *sessions = get_sessions();
-  Session *s2 = map_get(sessions, DEFAULT_SESSION_ID);
-  if (s2 && s2 != s)
+  map_session_t *sessions;
+  Session *s2;
+  thread_mutex_lock(&_sessions_mutex);
+  sessions = get_sessions();
+  s2 = map_get(sessions, DEFAULT_SESSION_ID);
+  if (s2 && s2 != s) {
+    thread_mutex_unlock(&_sessions_mutex);
     return errx(1, "a default session has already been set");
+  }
   map_set(sessions, DEFAULT_SESSION_ID, *s);
+  thread_mutex_unlock(&_sessions_mutex);
   return 0;
 }
 
@@ -209,7 +242,7 @@ int session_remove_state(Session *s, const char *name)
  */
 void *session_get_state(Session *s, const char *name)
 {
-  State *st = map_get(&s->states, name);
+  State *st = map_peek(&s->states, name);
   return (st) ? st->ptr : NULL;
 }
 
@@ -18,6 +18,12 @@ A million repetitions of "a"
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA1_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 #include "sha1.h"
 
 /* #define SHA1HANDSOFF * Copies data before messing with it. */
@@ -49,7 +55,7 @@ A million repetitions of "a"
 
 /* Hash a single 512-bit block. This is the core of the algorithm. */
 
-void SHA1Transform(
+static void sha1_transform_scalar(
     uint32_t state[5],
     const unsigned char buffer[64]
 )
@@ -175,6 +181,121 @@ void SHA1Transform(
 }
 
 
+#ifdef SHA1_SHANI
+/* Hash a single 512-bit block using the Intel SHA extensions.  Each
+   group of four rounds is computed with one sha1rnds4 instruction,
+   while sha1msg1/sha1msg2 compute the message schedule. */
+
+/* Rounds for group `g` using the message words `m`.  `e1` accumulates
+   E for this group and `e2` saves ABCD for the next group. */
+#define SHANI_RNDS(e1, e2, m, f) \
+    e1 = _mm_sha1nexte_epu32(e1, m); \
+    e2 = abcd; \
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, f);
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_transform_shani(
+    uint32_t state[5],
+    const unsigned char buffer[64]
+)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+    __m128i abcd, abcd_save, e0, e0_save, e1;
+    __m128i m0, m1, m2, m3;
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+    e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+    abcd_save = abcd;
+    e0_save = e0;
+
+    m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)buffer), mask);
+    m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer+16)), mask);
+    m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer+32)), mask);
+    m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer+48)), mask);
+
+    /* Rounds 0-3 */
+    e0 = _mm_add_epi32(e0, m0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    /* Rounds 4-11 */
+    SHANI_RNDS(e1, e0, m1, 0); m0 = _mm_sha1msg1_epu32(m0, m1);
+    SHANI_RNDS(e0, e1, m2, 0); m1 = _mm_sha1msg1_epu32(m1, m2);
+    m0 = _mm_xor_si128(m0, m2);
+
+    /* Rounds 12-67 */
+#define SHANI_GROUP(ea, eb, mc, mn, mx, mp, f) \
+    ea = _mm_sha1nexte_epu32(ea, mc); \
+    eb = abcd; \
+    mn = _mm_sha1msg2_epu32(mn, mc); \
+    abcd = _mm_sha1rnds4_epu32(abcd, ea, f); \
+    mp = _mm_sha1msg1_epu32(mp, mc); \
+    mx = _mm_xor_si128(mx, mc);
+    SHANI_GROUP(e1, e0, m3, m0, m1, m2, 0);
+    SHANI_GROUP(e0, e1, m0, m1, m2, m3, 0);
+    SHANI_GROUP(e1, e0, m1, m2, m3, m0, 1);
+    SHANI_GROUP(e0, e1, m2, m3, m0, m1, 1);
+    SHANI_GROUP(e1, e0, m3, m0, m1, m2, 1);
+    SHANI_GROUP(e0, e1, m0, m1, m2, m3, 1);
+    SHANI_GROUP(e1, e0, m1, m2, m3, m0, 1);
+    SHANI_GROUP(e0, e1, m2, m3, m0, m1, 2);
+    SHANI_GROUP(e1, e0, m3, m0, m1, m2, 2);
+    SHANI_GROUP(e0, e1, m0, m1, m2, m3, 2);
+    SHANI_GROUP(e1, e0, m1, m2, m3, m0, 2);
+    SHANI_GROUP(e0, e1, m2, m3, m0, m1, 2);
+    SHANI_GROUP(e1, e0, m3, m0, m1, m2, 3);
+    SHANI_GROUP(e0, e1, m0, m1, m2, m3, 3);
+#undef SHANI_GROUP
+
+    /* Rounds 68-79 */
+    SHANI_RNDS(e1, e0, m1, 3);
+    m2 = _mm_sha1msg2_epu32(m2, m1);
+    m3 = _mm_xor_si128(m3, m1);
+    SHANI_RNDS(e0, e1, m2, 3);
+    m3 = _mm_sha1msg2_epu32(m3, m2);
+    SHANI_RNDS(e1, e0, m3, 3);
+
+    /* Add the working vars back into state[] */
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+#undef SHANI_RNDS
+
+/* Returns non-zero if the CPU supports the SHA and SSE4.1 extensions. */
+static int sha1_have_shani(void)
+{
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSE4_1)) return 0;
+    if (__get_cpuid_max(0, NULL) < 7) return 0;
+    __cpuid_count(7, 0, a, b, c, d);
+    return (b & (1u << 29)) != 0;
+}
+#endif
+
+
+/* Hash a single 512-bit block, using the SHA extensions if the CPU
+   supports them. */
+
+void SHA1Transform(
+    uint32_t state[5],
+    const unsigned char buffer[64]
+)
+{
+#ifdef SHA1_SHANI
+    static int have_shani = -1;
+    if (have_shani < 0) have_shani = sha1_have_shani();
+    if (have_shani) {
+        sha1_transform_shani(state, buffer);
+        return;
+    }
+#endif
+    sha1_transform_scalar(state, buffer);
+}
+
+
 /* SHA1Init - Initialize new context */
 
 void SHA1Init(
@@ -235,8 +356,6 @@ void SHA1Final(
 
     unsigned char finalcount[8];
 
-    unsigned char c;
-
 #if 0    /* untested "improvement" by DHR */
     /* Convert context->count to a sequence of bytes
      * in finalcount.  Second element first, but
@@ -256,12 +375,11 @@ void SHA1Final(
         finalcount[i] = (unsigned char) ((context->count[(i >= 4 ? 0 : 1)] >> ((3 - (i & 3)) * 8)) & 255);      /* Endian independent */
     }
 #endif
-    c = 0200;
-    SHA1Update(context, &c, 1);
-    while ((context->count[0] & 504) != 448)
     {
-        c = 0000;
-        SHA1Update(context, &c, 1);
+        /* Append 0x80 and zeros up to 56 mod 64 bytes in one update */
+        static const unsigned char padding[64] = { 0200 };
+        unsigned used = (context->count[0] >> 3) & 63;
+        SHA1Update(context, padding, (used < 56) ? 56 - used : 120 - used);
     }
     SHA1Update(context, finalcount, 8); /* Should cause a SHA1Transform() */
     for (i = 0; i < 20; i++)
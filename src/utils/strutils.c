@@ -9,6 +9,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 
 #include "compat.h"
 #include "strutils.h"
@@ -226,3 +227,190 @@ int strhex(char *hex, size_t hexsize, const unsigned char *data, size_t size)
   }
   return m;
 }
+
+
+/* Base64 alphabet (RFC 4648) */
+static const char base64_chars[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Z85 alphabet (ZeroMQ RFC 32).  It contains no quotes or backslashes,
+   so encoded data can be embedded in JSON and C strings. */
+static const char base85_chars[] =
+  "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+  ".-:+=^!/*?&<>()[]{}@%$#";
+
+/* Values of characters in the base64 and Z85 alphabets, -1 for
+   characters not in the alphabet */
+static const signed char base64_values[128] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+  -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+  -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1
+};
+static const signed char base85_values[128] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, 68, -1, 84, 83, 82, 72, -1, 75, 76, 70, 65, -1, 63, 62, 69,
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 64, -1, 73, 66, 74, 71,
+  81, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50,
+  51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 77, -1, 78, 67, -1,
+  -1, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+  25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 79, -1, 80, -1, -1
+};
+
+/* Returns the value of character `c` in `values` or -1 if `c` is not
+   in the alphabet. */
+#define DECODE_CHAR(values, c) \
+  (((unsigned char)(c) < 128) ? values[(unsigned char)(c)] : -1)
+
+/*
+  Writes binary data to base64-encoded and nul-terminated string `dest`.
+
+  `size` is the size of memory poined to by `dest`.
+  `data` points to the first byte of binary data of size `n`.
+
+  Returns number of bytes written to `dest`, assuming `size` is
+  sufficiently large.
+*/
+int strbase64(char *dest, size_t size, const unsigned char *data, size_t n)
+{
+  size_t i, m=0, len = 4 * ((n + 2) / 3);
+  if (len > INT_MAX) return -1;
+  for (i=0; i+2 < n && m+4 < size; i+=3) {
+    unsigned long v = ((unsigned long)data[i] << 16) | (data[i+1] << 8) |
+      data[i+2];
+    dest[m++] = base64_chars[(v >> 18) & 0x3f];
+    dest[m++] = base64_chars[(v >> 12) & 0x3f];
+    dest[m++] = base64_chars[(v >> 6) & 0x3f];
+    dest[m++] = base64_chars[v & 0x3f];
+  }
+  if (i < n && i+2 >= n && m+4 < size) {
+    unsigned long v = (unsigned long)data[i] << 16;
+    if (i+1 < n) v |= data[i+1] << 8;
+    dest[m++] = base64_chars[(v >> 18) & 0x3f];
+    dest[m++] = base64_chars[(v >> 12) & 0x3f];
+    dest[m++] = (i+1 < n) ? base64_chars[(v >> 6) & 0x3f] : '=';
+    dest[m++] = '=';
+  }
+  if (size) dest[(m < size) ? m : size-1] = '\0';
+  return (int)len;
+}
+
+/*
+  Decodes base64-encoded string `src` and writes the result to `data`.
+
+  `size` is the size of memory pointed to by `data`.
+  If `len` is non-negative, at most `len` bytes are read from `src`.
+  Whitespace in `src` is ignored.
+
+  Returns number of bytes written to `data`, assuming `size` is
+  sufficiently large, or -1 if `src` is not valid base64.
+*/
+int strunbase64(unsigned char *data, size_t size, const char *src, int len)
+{
+  size_t i, n=0, end = (len < 0) ? strlen(src) : (size_t)len;
+  unsigned long v=0;
+  int k=0, pad=0;
+  for (i=0; i<end && src[i]; i++) {
+    int c = DECODE_CHAR(base64_values, src[i]);
+    if (c < 0) {
+      if (isspace((unsigned char)src[i])) continue;
+      if (src[i] != '=' || k < 2) return -1;
+      pad++;
+      c = 0;
+    } else if (pad) {
+      return -1;
+    }
+    v = (v << 6) | c;
+    if (++k == 4) {
+      int j, nbytes = 3 - pad;
+      for (j=0; j<nbytes; j++, n++)
+        if (n < size) data[n] = (v >> (16 - 8*j)) & 0xff;
+      v = 0;
+      k = 0;
+    }
+  }
+  if (k) return -1;
+  return (int)n;
+}
+
+/*
+  Writes binary data to base85-encoded and nul-terminated string `dest`.
+
+  The Z85 alphabet is used.  If `n` is not a multiple of four, the last
+  group of `r` bytes is written as `r+1` characters (like in Ascii85).
+
+  `size` is the size of memory poined to by `dest`.
+  `data` points to the first byte of binary data of size `n`.
+
+  Returns number of bytes written to `dest`, assuming `size` is
+  sufficiently large.
+*/
+int strbase85(char *dest, size_t size, const unsigned char *data, size_t n)
+{
+  size_t i, m=0, r = n % 4, len = 5 * (n / 4) + ((r) ? r + 1 : 0);
+  char buf[5];
+  int j;
+  if (len > INT_MAX) return -1;
+  for (i=0; i<n && m < size; i+=4) {
+    unsigned long v = 0;
+    int nchars = (i+4 <= n) ? 5 : (int)(n - i) + 1;
+    for (j=0; j<4; j++)
+      v = (v << 8) | ((i+j < n) ? data[i+j] : 0);
+    for (j=4; j>=0; j--) {
+      buf[j] = base85_chars[v % 85];
+      v /= 85;
+    }
+    if (m + nchars >= size) break;
+    memcpy(dest+m, buf, nchars);
+    m += nchars;
+  }
+  if (size) dest[(m < size) ? m : size-1] = '\0';
+  return (int)len;
+}
+
+/*
+  Decodes base85-encoded string `src` and writes the result to `data`.
+  This is the inverse of strbase85().
+
+  `size` is the size of memory pointed to by `data`.
+  If `len` is non-negative, at most `len` bytes are read from `src`.
+  Whitespace in `src` is ignored.
+
+  Returns number of bytes written to `data`, assuming `size` is
+  sufficiently large, or -1 if `src` is not valid base85.
+*/
+int strunbase85(unsigned char *data, size_t size, const char *src, int len)
+{
+  size_t i, n=0, end = (len < 0) ? strlen(src) : (size_t)len;
+  unsigned long long v=0;
+  int j, k=0;
+  for (i=0; i<end && src[i]; i++) {
+    int c = DECODE_CHAR(base85_values, src[i]);
+    if (c < 0) {
+      if (isspace((unsigned char)src[i])) continue;
+      return -1;
+    }
+    v = v * 85 + c;
+    if (++k == 5) {
+      if (v > 0xffffffffULL) return -1;
+      for (j=0; j<4; j++, n++)
+        if (n < size) data[n] = (v >> (24 - 8*j)) & 0xff;
+      v = 0;
+      k = 0;
+    }
+  }
+  if (k == 1) return -1;
+  if (k) {
+    int nbytes = k - 1;
+    for (j=k; j<5; j++) v = v * 85 + 84;
+    if (v > 0xffffffffULL) return -1;
+    for (j=0; j<nbytes; j++, n++)
+      if (n < size) data[n] = (v >> (24 - 8*j)) & 0xff;
+  }
+  return (int)n;
+}
@@ -119,5 +119,55 @@ int strnunquote(char *dest, size_t size, const char *s, int n,
 */
 int strhex(char *hex, size_t hexsize, const unsigned char *data, size_t size);
 
+/**
+  Writes binary data to base64-encoded and nul-terminated string `dest`.
+
+  `size` is the size of memory poined to by `dest`.
+  `data` points to the first byte of binary data of size `n`.
+
+  Returns number of bytes written to `dest`, assuming `size` is
+  sufficiently large.
+*/
+int strbase64(char *dest, size_t size, const unsigned char *data, size_t n);
+
+/**
+  Decodes base64-encoded string `src` and writes the result to `data`.
+
+  `size` is the size of memory pointed to by `data`.
+  If `len` is non-negative, at most `len` bytes are read from `src`.
+  Whitespace in `src` is ignored.
+
+  Returns number of bytes written to `data`, assuming `size` is
+  sufficiently large, or -1 if `src` is not valid base64.
+*/
+int strunbase64(unsigned char *data, size_t size, const char *src, int len);
+
+/**
+  Writes binary data to base85-encoded and nul-terminated string `dest`.
+
+  The Z85 alphabet is used.  If `n` is not a multiple of four, the last
+  group of `r` bytes is written as `r+1` characters (like in Ascii85).
+
+  `size` is the size of memory poined to by `dest`.
+  `data` points to the first byte of binary data of size `n`.
+
+  Returns number of bytes written to `dest`, assuming `size` is
+  sufficiently large.
+*/
+int strbase85(char *dest, size_t size, const unsigned char *data, size_t n);
+
+/**
+  Decodes base85-encoded string `src` and writes the result to `data`.
+  This is the inverse of strbase85().
+
+  `size` is the size of memory pointed to by `data`.
+  If `len` is non-negative, at most `len` bytes are read from `src`.
+  Whitespace in `src` is ignored.
+
+  Returns number of bytes written to `data`, assuming `size` is
+  sufficiently large, or -1 if `src` is not valid base85.
+*/
+int strunbase85(unsigned char *data, size_t size, const char *src, int len);
+
 
 #endif  /* _STRUTILS_H */
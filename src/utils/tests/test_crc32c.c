@@ -0,0 +1,62 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#include "minunit/minunit.h"
+
+
+MU_TEST(test_vectors)
+{
+  /* Check value and test vectors from RFC 3720, appendix B.4 */
+  unsigned char data[32];
+  int i;
+  mu_assert_int_eq(0xe3069283, crc32c(0, "123456789", 9));
+  mu_assert_int_eq(0xe3069283, crc32c_sw(0, "123456789", 9));
+  mu_assert_int_eq(0, crc32c(0, NULL, 0));
+
+  memset(data, 0, sizeof(data));
+  mu_assert_int_eq(0x8a9136aa, crc32c(0, data, sizeof(data)));
+  memset(data, 0xff, sizeof(data));
+  mu_assert_int_eq(0x62a8ab43, crc32c(0, data, sizeof(data)));
+  for (i=0; i<32; i++) data[i] = i;
+  mu_assert_int_eq(0x46dd794e, crc32c(0, data, sizeof(data)));
+  mu_assert_int_eq(0x46dd794e, crc32c_sw(0, data, sizeof(data)));
+}
+
+MU_TEST(test_incremental)
+{
+  /* Checksums may be continued, at any alignment and length */
+  size_t n = 1000, i, j;
+  unsigned char *data = malloc(n);
+  uint32_t crc;
+  for (i=0; i<n; i++) data[i] = (unsigned char)(i * 31 + 7);
+  crc = crc32c(0, data, n);
+  mu_assert_int_eq(crc, crc32c_sw(0, data, n));
+  for (i=0; i<20; i++) {
+    for (j=0; j<20; j++) {
+      mu_assert_int_eq(crc32c_sw(0, data + i, n - i - j),
+                       crc32c(0, data + i, n - i - j));
+    }
+    mu_assert_int_eq(crc, crc32c(crc32c(0, data, i), data + i, n - i));
+    mu_assert_int_eq(crc, crc32c_sw(crc32c_sw(0, data, i), data + i, n - i));
+  }
+  free(data);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_vectors);
+  MU_RUN_TEST(test_incremental);
+}
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -306,6 +306,64 @@ MU_TEST(test_errtry2)
   mu_assert_int_eq(errE, err_geteval());
 }
 
+MU_TEST(test_deferred)
+{
+  char buf[32], expected[256], msg[256];
+  void *ptr = &buf;
+  int nfailed = 0;
+
+  err_set_prefix("");
+  err_set_debug_mode(0);
+  err_clear();
+  strcpy(buf, "volatile");
+  snprintf(expected, sizeof(expected),
+           "Error 3: %d %ld %lld %zu %x %c|%s|%.3s|%*d|%-*.*s|%.2f|%g|%p|%%|%s",
+           -1, 2L, 3LL, (size_t)4, 255, 'c', buf, buf, 5, 6, 6, 2, buf,
+           3.14159, 1e-10, ptr, (char *)NULL);
+
+  /* Caught errors are formatted on demand.  The arguments must be
+     copied, since they may be modified before the message is read. */
+  ErrTry:
+    errx(3, "%d %ld %lld %zu %x %c|%s|%.3s|%*d|%-*.*s|%.2f|%g|%p|%%|%s",
+         -1, 2L, 3LL, (size_t)4, 255, 'c', buf, buf, 5, 6, 6, 2, buf,
+         3.14159, 1e-10, ptr, (char *)NULL);
+    strcpy(buf, "modified");
+  ErrCatch(3):
+    if (!_record.deferred) nfailed++;
+    strncpy(msg, err_getmsg(), sizeof(msg) - 1);
+    msg[sizeof(msg) - 1] = '\0';
+    if (_record.deferred) nfailed++;
+    break;
+  ErrEnd;
+  mu_assert_int_eq(0, nfailed);
+  mu_assert_string_eq(expected, msg);
+  mu_assert_int_eq(0, err_geteval());
+
+  /* Uncaught errors are formatted when propagated */
+  err_set_override_mode(errOverrideOld);
+  ErrTry:
+    errx(4, "uncaught %s", "error");
+  ErrEnd;
+  mu_assert_int_eq(4, err_geteval());
+  mu_assert_string_eq("Error 4: uncaught error", err_getmsg());
+
+  /* Appending to a deferred error */
+  err_clear();
+  err_set_override_mode(errOverrideAppend);
+  ErrTry:
+    errx(5, "first %d", 1);
+    errx(6, "second %d", 2);
+  ErrCatch(6):
+    strcpy(msg, err_getmsg());
+    break;
+  ErrEnd;
+  mu_assert_string_eq("Error 5: first 1\n - Error 6: second 2", msg);
+
+  err_clear();
+  err_set_override_mode(0);
+}
+
+
 /***********************************************************************/
 
 MU_TEST_SUITE(test_suite)
@@ -313,6 +371,7 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_err_functions);
   MU_RUN_TEST(test_errtry);
   MU_RUN_TEST(test_errtry2);
+  MU_RUN_TEST(test_deferred);
 }
 
 
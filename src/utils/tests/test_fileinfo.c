@@ -69,6 +69,14 @@ MU_TEST(test_isreadable)
   mu_check( fileinfo_isreadable(abs_file));
 }
 
+MU_TEST(test_mtime)
+{
+  mu_check(fileinfo_mtime(abs_file) > 0);
+  mu_check(fileinfo_mtime(abs_dir) > 0);
+  mu_check(fileinfo_mtime("...") < 0);
+  mu_check(fileinfo_mtime("") < 0);
+}
+
 
 /***********************************************************************/
 
@@ -78,6 +86,7 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_isdir);
   MU_RUN_TEST(test_isnormal);
   MU_RUN_TEST(test_isreadable);
+  MU_RUN_TEST(test_mtime);
 }
 
 
@@ -3,6 +3,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <utime.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
 #include "fileutils.h"
 #include "test_macros.h"
 
@@ -437,6 +444,63 @@ MU_TEST(test_fu_glob)
   fu_globend(iter);
 }
 
+#ifndef _WIN32
+/* Returns the number of files matching `pattern`. */
+static int count_glob(const char *pattern)
+{
+  const char *p;
+  int n=0;
+  FUIter *iter = fu_glob(pattern);
+  while ((p = fu_globnext(iter))) n++;
+  fu_globend(iter);
+  return n;
+}
+
+/* Creates an empty file `path`. */
+static void touch(const char *path)
+{
+  FILE *fp = fopen(path, "w");
+  if (fp) fclose(fp);
+}
+#endif
+
+MU_TEST(test_fu_dircache)
+{
+#ifndef _WIN32
+  struct utimbuf times = {1000000000, 1000000000};
+  const char *dirname = "test_dircache.d";
+  mkdir(dirname, 0755);
+  touch("test_dircache.d/a.txt");
+  touch("test_dircache.d/b.txt");
+  remove("test_dircache.d/c.txt");
+
+  /* Make the directory old, such that its listing will be cached */
+  mu_assert_int_eq(0, utime(dirname, &times));
+  mu_assert_int_eq(2, count_glob("test_dircache.d/*.txt"));
+  mu_assert_int_eq(2, count_glob("test_dircache.d/*.txt"));
+
+  /* Adding a file changes the modification time of the directory */
+  touch("test_dircache.d/c.txt");
+  mu_assert_int_eq(3, count_glob("test_dircache.d/*.txt"));
+
+  /* A cached listing is stale if the modification time is reset */
+  mu_assert_int_eq(0, utime(dirname, &times));
+  mu_assert_int_eq(3, count_glob("test_dircache.d/*.txt"));
+  remove("test_dircache.d/c.txt");
+  mu_assert_int_eq(0, utime(dirname, &times));
+  mu_assert_int_eq(3, count_glob("test_dircache.d/*.txt"));
+  fu_dircache_clear();
+  mu_assert_int_eq(2, count_glob("test_dircache.d/*.txt"));
+
+  /* Non-existing directories are skipped */
+  mu_assert_int_eq(0, count_glob("no-such-dir.d/*.txt"));
+
+  remove("test_dircache.d/a.txt");
+  remove("test_dircache.d/b.txt");
+  rmdir(dirname);
+#endif
+}
+
 MU_TEST(test_fu_pathsiter)
 {
   const char *filename;
@@ -456,6 +520,81 @@ MU_TEST(test_fu_pathsiter)
   fu_paths_deinit(&paths);
 }
 
+#ifndef _WIN32
+/* Tests writing and reading with engine `e`, which may be NULL */
+static void check_io(FUIOEngine *e)
+{
+  const char *filename = "test_fu_io.dat";
+  size_t i, size = 5*FU_IO_CHUNKSIZE + 123, n;
+  unsigned char *buf, *rbuf, *filebuf;
+  FUIORequest reqs[2];
+  int fd;
+
+  buf = malloc(size);
+  rbuf = calloc(1, size);
+  for (i=0; i<size; i++) buf[i] = (unsigned char)(i * 7 + i / 1000);
+
+  fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  mu_check(fd >= 0);
+  mu_assert_int_eq(0, fu_io_write(e, fd, buf, size, 0));
+  mu_assert_int_eq(0, fu_io_advise(fd, 0, 0, fuIOWillNeed));
+  mu_check(fu_io_read(e, fd, rbuf, size, 0) == (long long)size);
+  mu_check(memcmp(buf, rbuf, size) == 0);
+
+  /* short read at end of file */
+  mu_check(fu_io_read(e, fd, rbuf, size, 100) == (long long)size - 100);
+  mu_check(memcmp(buf + 100, rbuf, size - 100) == 0);
+
+  /* batch of requests, the second using a registered buffer */
+  memset(rbuf, 0, size);
+  mu_assert_int_eq(0, fu_io_register_buffers(e, (void **)&rbuf, &size, 1));
+  reqs[0].op = fuIORead;
+  reqs[0].fd = fd;
+  reqs[0].buf = rbuf;
+  reqs[0].size = 1000;
+  reqs[0].offset = 0;
+  reqs[0].bufindex = -1;
+  reqs[1] = reqs[0];
+  reqs[1].buf = rbuf + 1000;
+  reqs[1].offset = 1000;
+  reqs[1].bufindex = 0;
+  mu_assert_int_eq(0, fu_io_run(e, reqs, 2));
+  mu_check(reqs[0].result == 1000);
+  mu_check(reqs[1].result == 1000);
+  mu_check(memcmp(buf, rbuf, 2000) == 0);
+  mu_assert_int_eq(0, fu_io_register_buffers(e, NULL, NULL, 0));
+
+  /* errors are reported per request */
+  reqs[0].fd = -1;
+  mu_assert_int_eq(1, fu_io_run(e, reqs, 2));
+  mu_check(reqs[0].result < 0);
+  mu_check(reqs[1].result == 1000);
+  close(fd);
+
+  mu_check((filebuf = (unsigned char *)fu_io_readfile(e, filename, &n)));
+  mu_assert_int_eq(size, n);
+  mu_check(memcmp(buf, filebuf, size) == 0);
+  mu_assert_int_eq(0, filebuf[size]);
+  free(filebuf);
+
+  remove(filename);
+  free(buf);
+  free(rbuf);
+}
+
+MU_TEST(test_fu_io)
+{
+  FUIOEngine *e;
+  mu_check((e = fu_io_create(4)));
+  printf("\nI/O backend: %s\n", fu_io_backend(e));
+  check_io(e);
+  fu_io_free(e);
+
+  mu_assert_string_eq("pread", fu_io_backend(NULL));
+  check_io(NULL);
+}
+#endif
+
 
 /***********************************************************************/
 
@@ -480,7 +619,11 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_fu_paths);
   MU_RUN_TEST(test_fu_match);
   MU_RUN_TEST(test_fu_glob);
+  MU_RUN_TEST(test_fu_dircache);
   MU_RUN_TEST(test_fu_pathsiter);
+#ifndef _WIN32
+  MU_RUN_TEST(test_fu_io);
+#endif
 }
 
 
@@ -0,0 +1,253 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "floatfmt.h"
+#include "test_macros.h"
+
+#include "minunit/minunit.h"
+
+
+/* Simple xorshift random number generator, for reproducible tests */
+static uint64_t rnd_state = 88172645463325252ULL;
+static uint64_t rnd(void)
+{
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 7;
+  rnd_state ^= rnd_state << 17;
+  return rnd_state;
+}
+
+/* Returns the fewest digits with which "%.*g" round-trips `v` */
+static int min_digits(double v)
+{
+  char buf[64];
+  int p;
+  for (p=1; p<17; p++) {
+    snprintf(buf, sizeof(buf), "%.*g", p, v);
+    if (strtod(buf, NULL) == v) break;
+  }
+  return p;
+}
+
+/* Returns the number of significant digits in the output of fmtdouble() */
+static int count_digits(const char *s)
+{
+  int n=0, started=0;
+  for (; *s && *s != 'e'; s++) {
+    if (*s < '0' || *s > '9') continue;
+    if (*s != '0') started = 1;
+    if (started) n++;
+  }
+  return n;
+}
+
+
+MU_TEST(test_fmtdouble)
+{
+  char buf[FMTFLOAT_BUFSIZE];
+
+  mu_assert_int_eq(1, fmtdouble(buf, 0.0));
+  mu_assert_string_eq("0", buf);
+  mu_assert_int_eq(2, fmtdouble(buf, -0.0));
+  mu_assert_string_eq("-0", buf);
+
+  fmtdouble(buf, 1.0);              mu_assert_string_eq("1", buf);
+  fmtdouble(buf, -2.5);             mu_assert_string_eq("-2.5", buf);
+  fmtdouble(buf, 0.1);              mu_assert_string_eq("0.1", buf);
+  fmtdouble(buf, 3.141592);         mu_assert_string_eq("3.141592", buf);
+  fmtdouble(buf, 0.1+0.2);          mu_assert_string_eq("0.30000000000000004",
+                                                        buf);
+  fmtdouble(buf, 123456.0);         mu_assert_string_eq("123456", buf);
+  fmtdouble(buf, 0.0001);           mu_assert_string_eq("0.0001", buf);
+  fmtdouble(buf, 0.00001);          mu_assert_string_eq("1e-05", buf);
+  fmtdouble(buf, 1e15);             mu_assert_string_eq("1000000000000000",
+                                                        buf);
+  fmtdouble(buf, 1e16);             mu_assert_string_eq("1e+16", buf);
+  fmtdouble(buf, 1.5e300);          mu_assert_string_eq("1.5e+300", buf);
+  fmtdouble(buf, 5e-324);           mu_assert_string_eq("5e-324", buf);
+  fmtdouble(buf, 1.7976931348623157e308);
+  mu_assert_string_eq("1.7976931348623157e+308", buf);
+  fmtdouble(buf, 2.2250738585072014e-308);
+  mu_assert_string_eq("2.2250738585072014e-308", buf);
+
+  fmtdouble(buf, HUGE_VAL);         mu_assert_string_eq("inf", buf);
+  fmtdouble(buf, -HUGE_VAL);        mu_assert_string_eq("-inf", buf);
+  fmtdouble(buf, NAN);              mu_assert_string_eq("nan", buf);
+}
+
+MU_TEST(test_fmtfloat)
+{
+  char buf[FMTFLOAT_BUFSIZE];
+
+  fmtfloat(buf, 0.0f);              mu_assert_string_eq("0", buf);
+  fmtfloat(buf, 0.1f);              mu_assert_string_eq("0.1", buf);
+  fmtfloat(buf, 3.141592f);         mu_assert_string_eq("3.141592", buf);
+  fmtfloat(buf, 16777216.0f);       mu_assert_string_eq("16777216", buf);
+  fmtfloat(buf, 1e-45f);            mu_assert_string_eq("1e-45", buf);
+  fmtfloat(buf, 3.4028235e38f);     mu_assert_string_eq("3.4028235e+38", buf);
+  fmtfloat(buf, -1e10f);            mu_assert_string_eq("-10000000000",
+                                                        buf);
+}
+
+MU_TEST(test_roundtrip)
+{
+  char buf[FMTFLOAT_BUFSIZE];
+  int i, n, bad=0, longer=0;
+
+  for (i=0; i<100000; i++) {
+    uint64_t u = rnd();
+    uint32_t u32 = (uint32_t)u;
+    double v, w;
+    float f, g;
+    memcpy(&v, &u, sizeof(v));
+    memcpy(&f, &u32, sizeof(f));
+    if (isnan(v) || isnan(f)) continue;
+
+    n = fmtdouble(buf, v);
+    if (n != (int)strlen(buf) || n >= FMTFLOAT_BUFSIZE) bad++;
+    w = strtod(buf, NULL);
+    if (memcmp(&v, &w, sizeof(v))) bad++;
+    if (!isinf(v) && count_digits(buf) > min_digits(v)) longer++;
+
+    n = fmtfloat(buf, f);
+    if (n != (int)strlen(buf) || n >= FMTFLOAT_BUFSIZE) bad++;
+    g = strtof(buf, NULL);
+    if (memcmp(&f, &g, sizeof(f))) bad++;
+  }
+  mu_assert_int_eq(0, bad);
+
+  /* Grisu2 is shortest for all but a small fraction of values */
+  mu_check(longer < 1000);
+}
+
+MU_TEST(test_fast_strtod)
+{
+  const char *strings[] = {
+    "0", "-0", "1", "+1.5", "  3.141592", "1e10", "1E-10", "1.", ".5",
+    "123456789012345678", "1234567890123456789", "12345678901234567890",
+    "0.000000000000000000000000000001", "9007199254740993",
+    "2.2250738585072011e-308", "4.9406564584124654e-324", "1e-400",
+    "1.7976931348623157e308", "1.7976931348623159e308", "1e400",
+    "0x1p-3", "inf", "-nan", "1e", "1e+", "2.5e-3x", "-", "abc",
+    "7.2057594037927933e+16",
+    "1.00000000000000011102230246251565404236316680908203125",
+    "1.00000000000000011102230246251565404236316680908203124",
+    "3.4028235677973366e38", "1.4012984643e-45", "7.0064923216e-46",
+    NULL
+  };
+  const char **s;
+  char buf[64];
+  int i, bad=0;
+
+  for (s=strings; *s; s++) {
+    char *e1, *e2;
+    double v1 = fast_strtod(*s, &e1), v2 = strtod(*s, &e2);
+    float f1 = fast_strtof(*s, &e1), f2 = strtof(*s, &e2);
+    if (isnan(v2)) {
+      mu_check(isnan(v1));
+    } else {
+      mu_check(memcmp(&v1, &v2, sizeof(v1)) == 0);
+      mu_check(memcmp(&f1, &f2, sizeof(f1)) == 0);
+    }
+    mu_check(e1 == e2);
+  }
+
+  for (i=0; i<100000; i++) {
+    uint64_t u = rnd();
+    double v1, v2;
+    float f1, f2;
+    int exp = (int)(u % 700) - 350;
+    int digits = (int)((u >> 10) % 19) + 1;
+    snprintf(buf, sizeof(buf), "%.*e", digits,
+             (double)(u >> 11) / 9e15 + 0.1);
+    snprintf(buf + strcspn(buf, "e"), 16, "e%d", exp);
+    v1 = fast_strtod(buf, NULL);
+    v2 = strtod(buf, NULL);
+    if (memcmp(&v1, &v2, sizeof(v1))) bad++;
+    f1 = fast_strtof(buf, NULL);
+    f2 = strtof(buf, NULL);
+    if (memcmp(&f1, &f2, sizeof(f1))) bad++;
+
+    memcpy(&v2, &u, sizeof(v2));
+    if (isnan(v2) || isinf(v2)) continue;
+    fmtdouble(buf, v2);
+    v1 = fast_strtod(buf, NULL);
+    if (memcmp(&v1, &v2, sizeof(v1))) bad++;
+  }
+  mu_assert_int_eq(0, bad);
+}
+
+
+MU_TEST(test_fast_strtoll)
+{
+  const char *strings[] = {
+    "0", "-0", "7", "+42", "  -123", "12345678", "-123456789",
+    "1234567890123456", "123456789012345678", "9223372036854775807",
+    "-9223372036854775808", "9223372036854775808", "18446744073709551615",
+    "18446744073709551616", "0x1f", "010", "09", "1.5", "12abc", "-", "",
+    "abc", NULL
+  };
+  const char **s;
+  char buf[32];
+  int base, i, bad=0;
+
+  for (s=strings; *s; s++) {
+    for (base=0; base<=16; base+=10) {
+      char *e1, *e2;
+      long long v1, v2;
+      unsigned long long u1, u2;
+      int err1;
+      errno = 0;
+      v1 = fast_strtoll(*s, &e1, base);
+      err1 = errno;
+      errno = 0;
+      v2 = strtoll(*s, &e2, base);
+      mu_check(v1 == v2);
+      mu_check(e1 == e2);
+      mu_assert_int_eq(errno, err1);
+
+      errno = 0;
+      u1 = fast_strtoull(*s, &e1, base);
+      err1 = errno;
+      errno = 0;
+      u2 = strtoull(*s, &e2, base);
+      mu_check(u1 == u2);
+      mu_check(e1 == e2);
+      mu_assert_int_eq(errno, err1);
+    }
+  }
+
+  for (i=0; i<100000; i++) {
+    uint64_t u = rnd();
+    int64_t v = (int64_t)(u >> (u % 64));
+    snprintf(buf, sizeof(buf), "%lld", (long long)((u & 1) ? -v : v));
+    if (fast_strtoll(buf, NULL, 10) != strtoll(buf, NULL, 10)) bad++;
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)(u >> (u % 64)));
+    if (fast_strtoull(buf, NULL, 10) != strtoull(buf, NULL, 10)) bad++;
+  }
+  mu_assert_int_eq(0, bad);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_fmtdouble);
+  MU_RUN_TEST(test_fmtfloat);
+  MU_RUN_TEST(test_roundtrip);
+  MU_RUN_TEST(test_fast_strtod);
+  MU_RUN_TEST(test_fast_strtoll);
+}
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -106,11 +106,42 @@ MU_TEST(test_infixcalc)
   mu_assert_int_eq(50, calc("ten*(M+N)", vars, nvars));
 }
 
+
+MU_TEST(test_infixcalc_compile)
+{
+  InfixCalcVariable vars[] = {{"N", 0}, {"M", 0}};
+  InfixCalcCode *code;
+  char err[256];
+  int values[2];
+
+  code = infixcalc_compile("2*(N+1) - M^2", vars, 2, err, sizeof(err));
+  mu_check(code);
+  mu_assert_string_eq("", err);
+  values[0] = 3;
+  values[1] = 2;
+  mu_assert_int_eq(4, infixcalc_eval(code, values));
+  values[0] = 10;
+  values[1] = 1;
+  mu_assert_int_eq(21, infixcalc_eval(code, values));
+  infixcalc_free(code);
+
+  code = infixcalc_compile("7", NULL, 0, err, sizeof(err));
+  mu_check(code);
+  mu_assert_int_eq(7, infixcalc_eval(code, NULL));
+  infixcalc_free(code);
+
+  mu_check(!infixcalc_compile("N +", vars, 2, err, sizeof(err)));
+  mu_check(err[0]);
+  mu_check(!infixcalc_compile("K", vars, 2, err, sizeof(err)));
+  mu_check(!infixcalc_compile(")", vars, 2, err, sizeof(err)));
+}
+
 /***********************************************************************/
 
 MU_TEST_SUITE(test_suite)
 {
   MU_RUN_TEST(test_infixcalc);
+  MU_RUN_TEST(test_infixcalc_compile);
 }
 
 
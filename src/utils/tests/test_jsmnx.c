@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -40,11 +41,139 @@ MU_TEST(test_jsmn)
 
 
 
+/* Returns non-zero if jsmn_parse_fast() and jsmn_parse_alloc() give the
+   same result as jsmn_parse() for `js`. */
+static int same_as_jsmn(const char *js)
+{
+  jsmn_parser p;
+  jsmntok_t t1[256], t2[256], *t3=NULL;
+  unsigned int n3=0;
+  int r1, r2, r3, c1, c2, ok=1;
+  size_t len = strlen(js);
+  memset(t1, 0, sizeof(t1));
+  memset(t2, 0, sizeof(t2));
+
+  jsmn_init(&p);
+  r1 = jsmn_parse(&p, js, len, t1, 256);
+  jsmn_init(&p);
+  r2 = jsmn_parse_fast(&p, js, len, t2, 256);
+  if (r1 != r2) ok = 0;
+  if (ok && r1 > 0 && memcmp(t1, t2, r1*sizeof(jsmntok_t))) ok = 0;
+
+  jsmn_init(&p);
+  c1 = jsmn_parse(&p, js, len, NULL, 0);
+  jsmn_init(&p);
+  c2 = jsmn_parse_fast(&p, js, len, NULL, 0);
+  if (c1 != c2) ok = 0;
+
+  if (r1 >= 0) {
+    jsmn_init(&p);
+    r3 = jsmn_parse_alloc(&p, js, len, &t3, &n3);
+    if (r3 != r1 || memcmp(t1, t3, r1*sizeof(jsmntok_t))) ok = 0;
+    free(t3);
+  }
+  if (!ok) printf("\n*** differs from jsmn: '%s'\n", js);
+  return ok;
+}
+
+MU_TEST(test_jsmn_parse_fast)
+{
+  char buf[4096];
+  int i, j, n;
+  const char *inputs[] = {
+    "", " ", "{}", "[]", "{ }", "[ ]", "1 ", "1", "\"a\"", "\"a",
+    "{\"a\": 1}", "{\"a\": 1, }", "[1, ]", "[1, 2]", "[\"x\", 1.5e-3, true]",
+    "{\"a\": {\"b\": [1, {\"c\": null}]}, \"d\": \"e\"}",
+    "[[[]], {}, [{}]]", "{\"a\" 1}", "{\"a\": 1 \"b\": 2}", "{1: 2}",
+    "[}", "{]", "]", "[", "{\"a\":", "[1 2]", "[tru\"e]", "[1#]", "[1:2]",
+    "[\"\\\"\"]", "[\"\\\\\"]", "[\"\\u00e5\"]", "[\"\\u00g5\"]",
+    "[\"\\x\"]", "[\"\\\"]", "[\\]", "[1] [2]", "[\"a\\nb\"]  ",
+    "{\"k\": \"v\"}\t\r\n", "[\"\xc3\xa5\"]", "[\xc3\xa5]", "[1]x",
+    NULL
+  };
+  for (i=0; inputs[i]; i++) mu_check(same_as_jsmn(inputs[i]));
+
+  /* backslashes and quotes around the 64-byte block boundaries */
+  for (i=0; i<70; i++) {
+    for (j=0; j<4; j++) {
+      n = snprintf(buf, sizeof(buf), "{\"%*s\": [", i, "");
+      n += snprintf(buf+n, sizeof(buf)-n, "\"%.*s\\\"\", 1, ",
+                    j, "\\\\\\\\");
+      n += snprintf(buf+n, sizeof(buf)-n, "\"%.*s\", {\"x\": -2}]}",
+                    2*j, "\\\\\\\\\\\\\\\\");
+      mu_check(same_as_jsmn(buf));
+    }
+  }
+
+  /* too few tokens */
+  {
+    jsmn_parser p;
+    jsmntok_t t[2];
+    jsmn_init(&p);
+    mu_assert_int_eq(JSMN_ERROR_NOMEM, jsmn_parse_fast(&p, "[1, 2]", 6, t, 2));
+  }
+}
+
+MU_TEST(test_jsmn_parse_compact)
+{
+  char buf[8192];
+  jsmn_parser p;
+  jsmntok_t *tokens=NULL;
+  const jsmntok_t *t;
+  unsigned int ntokens=0;
+  int i, n, offset;
+
+  /* numeric arrays spanning several blocks at varying offsets */
+  for (offset=0; offset<70; offset++) {
+    n = snprintf(buf, sizeof(buf), "{\"%*s\": [", offset, "");
+    for (i=0; i<300; i++)
+      n += snprintf(buf+n, sizeof(buf)-n, "%s%d.5e-1", (i) ? ", " : "", i);
+    n += snprintf(buf+n, sizeof(buf)-n, "], \"m\": [[1, 2], [-3, 4]], "
+                  "\"s\": [\"a\", 1], \"x\": 7}");
+
+    jsmn_init(&p);
+    mu_assert_int_eq(11, jsmn_parse_compact(&p, buf, n, &tokens, &ntokens,
+                                           16));
+    mu_assert_int_eq(4, tokens[0].size);
+    t = tokens + 2;
+    mu_assert_int_eq(JSMN_ARRAY, t->type);
+    mu_assert_int_eq(-300, t->size);
+    mu_assert_int_eq(0, jsmn_count(t));
+    mu_assert_int_eq(']', buf[t->end-1]);
+    t = jsmn_item(buf, tokens, "m");
+    mu_assert_int_eq(JSMN_ARRAY, t->type);
+    mu_assert_int_eq(-2, t->size);
+    t = jsmn_item(buf, tokens, "s");
+    mu_assert_int_eq(2, t->size);
+    t = jsmn_item(buf, tokens, "x");
+    mu_assert_int_eq(JSMN_PRIMITIVE, t->type);
+    mu_assert_int_eq('7', buf[t->start]);
+
+    /* without compact arrays */
+    jsmn_init(&p);
+    mu_assert_int_eq(11 + 300 + 6, jsmn_parse_compact(&p, buf, n, &tokens,
+                                                     &ntokens, 0));
+  }
+
+  /* arrays that aren't plain JSON are left to jsmn_parse() */
+  jsmn_init(&p);
+  mu_assert_int_eq(3, jsmn_parse_compact(&p, "[1, 2, ]", 8, &tokens,
+                                         &ntokens, 1));
+  mu_assert_int_eq(2, tokens[0].size);
+  jsmn_init(&p);
+  mu_assert_int_eq(3, jsmn_parse_compact(&p, "[[1, 2], true]", 14, &tokens,
+                                         &ntokens, 1));
+  free(tokens);
+}
+
+
 /***********************************************************************/
 
 MU_TEST_SUITE(test_suite)
 {
   MU_RUN_TEST(test_jsmn);
+  MU_RUN_TEST(test_jsmn_parse_fast);
+  MU_RUN_TEST(test_jsmn_parse_compact);
 }
 
 
@@ -36,6 +36,50 @@ MU_TEST(test_addstolen)
   jstore_addstolen(js, "str", v);  // replaces previous value
 }
 
+MU_TEST(test_addn_tokens)
+{
+  JStore *js2 = jstore_open();
+  jsmntok_t tokens[3];
+  const jsmntok_t *t;
+  unsigned int ntokens=0;
+  char *src = "{\"v\": [1, 2]}";
+
+  /* tokens of the array value "[1, 2]", relative to the value */
+  tokens[0].type = JSMN_ARRAY;
+  tokens[0].start = 0;
+  tokens[0].end = 6;
+  tokens[0].size = 2;
+  tokens[0].parent = -1;
+  tokens[1].type = tokens[2].type = JSMN_PRIMITIVE;
+  tokens[1].start = 1;
+  tokens[1].end = 2;
+  tokens[2].start = 4;
+  tokens[2].end = 5;
+  tokens[1].size = tokens[2].size = 0;
+  tokens[1].parent = tokens[2].parent = 0;
+  mu_assert_int_eq(0, jstore_addn_tokens(js, "tok", 0, src+6, 6, tokens, 3));
+  mu_assert_string_eq("[1, 2]", jstore_get(js, "tok"));
+  mu_check((t = jstore_get_tokens(js, "tok", &ntokens)));
+  mu_assert_int_eq(3, ntokens);
+  mu_assert_int_eq(JSMN_ARRAY, t[0].type);
+  mu_assert_int_eq(2, t[0].size);
+  mu_assert_int_eq(4, t[2].start);
+  mu_check(t != tokens);
+
+  /* tokens are copied by jstore_update() */
+  jstore_update(js2, js);
+  mu_check((t = jstore_get_tokens(js2, "tok", &ntokens)));
+  mu_assert_int_eq(3, ntokens);
+  jstore_close(js2);
+
+  /* replacing the value discards the tokens */
+  jstore_add(js, "tok", "[3]");
+  mu_check(!jstore_get_tokens(js, "tok", NULL));
+  mu_check(!jstore_get_tokens(js, "pi", NULL));
+  mu_check(!jstore_get_tokens(js, "xxx", NULL));
+  jstore_remove(js, "tok");
+}
+
 MU_TEST(test_get)
 {
   mu_assert_string_eq("3.14", jstore_get(js, "pi"));
@@ -97,6 +141,21 @@ MU_TEST(test_to_file)
   mu_assert_int_eq(0, stat);
 }
 
+MU_TEST(test_mapfile)
+{
+  JStoreMap map;
+  char *buf = jstore_readfile("jstore.json");
+  mu_check(buf);
+  mu_assert_int_eq(0, jstore_mapfile(&map, "jstore.json"));
+  mu_assert_int_eq(strlen(buf), map.size);
+  mu_assert_string_eq(buf, map.data);
+  jstore_unmapfile(&map);
+  mu_check(!map.data);
+  free(buf);
+
+  mu_assert_int_eq(1, jstore_mapfile(&map, "non-existing-file.json"));
+}
+
 MU_TEST(test_update_file)
 {
   int stat;
@@ -132,12 +191,14 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_add);
   MU_RUN_TEST(test_addn);
   MU_RUN_TEST(test_addstolen);
+  MU_RUN_TEST(test_addn_tokens);
   MU_RUN_TEST(test_get);
   MU_RUN_TEST(test_remove);
   MU_RUN_TEST(test_update);
   MU_RUN_TEST(test_update_from_jsmn);
   MU_RUN_TEST(test_to_string);
   MU_RUN_TEST(test_to_file);
+  MU_RUN_TEST(test_mapfile);
   MU_RUN_TEST(test_update_file);
   MU_RUN_TEST(test_iter);
   MU_RUN_TEST(test_close);
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "map.h"
@@ -44,12 +45,40 @@ MU_TEST(test_map2)
 }
 
 
+MU_TEST(test_map_key)
+{
+  map_uint_t m;
+  char buf[16];
+  const char *key;
+  int i;
+
+  map_init(&m);
+  map_set(&m, "testkey", 1);
+  strcpy(buf, "testkey");
+  key = map_key(&m, buf);
+  mu_check(key);
+  mu_check(key != buf);
+  mu_assert_string_eq("testkey", key);
+  mu_check(map_key(&m, "no-such-key") == NULL);
+
+  /* the stored key is not moved when the map grows */
+  for (i=0; i<100; i++) {
+    snprintf(buf, sizeof(buf), "key%d", i);
+    map_set(&m, buf, i);
+  }
+  mu_check(map_key(&m, "testkey") == key);
+
+  map_deinit(&m);
+}
+
+
 /***********************************************************************/
 
 MU_TEST_SUITE(test_suite)
 {
   MU_RUN_TEST(test_map);
   MU_RUN_TEST(test_map2);
+  MU_RUN_TEST(test_map_key);
 }
 
 
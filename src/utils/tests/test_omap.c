@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "omap.h"
+
+#include "minunit/minunit.h"
+
+
+typedef omap_t(unsigned int) omap_uint_t;
+
+
+MU_TEST(test_omap)
+{
+  omap_uint_t m;
+  unsigned int *p;
+  const char *key;
+  omap_iter_t iter;
+  int n=0;
+
+  omap_init(&m);
+  mu_assert_int_eq(0, omap_set(&m, "testkey", 123));
+  p = omap_get(&m, "testkey");
+  mu_assert_int_eq(123, *p);
+  mu_assert_int_eq(1, omap_count(&m));
+
+  /* replace */
+  mu_assert_int_eq(0, omap_set(&m, "testkey", 456));
+  mu_assert_int_eq(456, *omap_get(&m, "testkey"));
+  mu_assert_int_eq(1, omap_count(&m));
+
+  iter = omap_iter(&m);
+  while ((key = omap_next(&m, &iter))) {
+    mu_assert_string_eq("testkey", key);
+    n++;
+  }
+  mu_assert_int_eq(1, n);
+
+  omap_deinit(&m);
+}
+
+
+MU_TEST(test_omap2)
+{
+  omap_str_t m;
+
+  omap_init(&m);
+  char **str = omap_get(&m, "no-such-key");
+  mu_check(str == NULL);
+  omap_remove(&m, "no-such-key");
+  mu_assert_int_eq(0, omap_count(&m));
+
+  omap_deinit(&m);
+}
+
+
+MU_TEST(test_omap_many)
+{
+  omap_uint_t m;
+  char buf[80];
+  const char *key;
+  omap_iter_t iter;
+  unsigned int *p, sum=0;
+  int i, n=0;
+
+  omap_init(&m);
+  for (i=0; i<1000; i++) {
+    snprintf(buf, sizeof(buf), "key%d", i);
+    mu_assert_int_eq(0, omap_set(&m, buf, i));
+  }
+  mu_assert_int_eq(1000, omap_count(&m));
+  for (i=0; i<1000; i++) {
+    snprintf(buf, sizeof(buf), "key%d", i);
+    mu_check((p = omap_get(&m, buf)));
+    mu_assert_int_eq(i, *p);
+  }
+
+  /* remove every second key */
+  for (i=0; i<1000; i+=2) {
+    snprintf(buf, sizeof(buf), "key%d", i);
+    omap_remove(&m, buf);
+  }
+  mu_assert_int_eq(500, omap_count(&m));
+  for (i=0; i<1000; i++) {
+    snprintf(buf, sizeof(buf), "key%d", i);
+    p = omap_get(&m, buf);
+    if (i % 2) {
+      mu_check(p);
+      mu_assert_int_eq(i, *p);
+    } else {
+      mu_check(p == NULL);
+    }
+  }
+
+  iter = omap_iter(&m);
+  while ((key = omap_next(&m, &iter))) {
+    sum += *omap_get(&m, key);
+    n++;
+  }
+  mu_assert_int_eq(500, n);
+  mu_assert_int_eq(250000, sum);
+
+  omap_deinit(&m);
+}
+
+
+MU_TEST(test_omap_churn)
+{
+  /* Repeatedly adding and removing keys must not grow the map
+     without bounds */
+  omap_uint_t m;
+  char buf[80];
+  unsigned capacity;
+  int i, nfailed=0;
+
+  omap_init(&m);
+  for (i=0; i<100; i++) {
+    snprintf(buf, sizeof(buf), "key%d", i);
+    omap_set(&m, buf, i);
+  }
+  capacity = m.base.capacity;
+  for (i=100; i<100000; i++) {
+    snprintf(buf, sizeof(buf), "key%d", i - 100);
+    omap_remove(&m, buf);
+    snprintf(buf, sizeof(buf), "key%d", i);
+    if (omap_set(&m, buf, i)) nfailed++;
+  }
+  mu_assert_int_eq(0, nfailed);
+  mu_assert_int_eq(100, omap_count(&m));
+  mu_check(m.base.capacity <= 2*capacity);
+  mu_assert_int_eq(99999, *omap_get(&m, "key99999"));
+  mu_check(omap_get(&m, "key99899") == NULL);
+
+  omap_deinit(&m);
+}
+
+
+MU_TEST(test_omap_longkey)
+{
+  omap_uint_t m;
+  char key[200], key2[200];
+
+  memset(key, 'a', sizeof(key) - 1);
+  key[sizeof(key) - 1] = '\0';
+  strcpy(key2, key);
+  key2[150] = 'b';
+
+  omap_init(&m);
+  mu_assert_int_eq(0, omap_set(&m, key, 1));
+  mu_assert_int_eq(0, omap_set(&m, key2, 2));
+  mu_assert_int_eq(1, *omap_get(&m, key));
+  mu_assert_int_eq(2, *omap_get(&m, key2));
+  mu_assert_string_eq(key, omap_key(&m, key));
+  mu_check(omap_key(&m, key) != key);
+  omap_remove(&m, key);
+  mu_check(omap_get(&m, key) == NULL);
+  mu_assert_int_eq(2, *omap_get(&m, key2));
+  omap_deinit(&m);
+}
+
+
+MU_TEST(test_omap_reserve)
+{
+  omap_uint_t m;
+  char buf[80];
+  unsigned capacity;
+  int i;
+
+  omap_init(&m);
+  mu_assert_int_eq(0, omap_reserve(&m, 1000));
+  capacity = m.base.capacity;
+  mu_check(capacity >= 1000);
+  for (i=0; i<1000; i++) {
+    snprintf(buf, sizeof(buf), "key%d", i);
+    omap_set(&m, buf, i);
+  }
+  mu_assert_int_eq(capacity, m.base.capacity);
+  mu_assert_int_eq(0, omap_reserve(&m, 10));
+  mu_assert_int_eq(capacity, m.base.capacity);
+  omap_deinit(&m);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_omap);
+  MU_RUN_TEST(test_omap2);
+  MU_RUN_TEST(test_omap_many);
+  MU_RUN_TEST(test_omap_churn);
+  MU_RUN_TEST(test_omap_longkey);
+  MU_RUN_TEST(test_omap_reserve);
+}
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
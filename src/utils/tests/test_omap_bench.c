@@ -0,0 +1,163 @@
+/* Benchmark comparing omap.h with map.h.
+ *
+ * Usage: test_omap_bench [NKEYS [NITER]]
+ *
+ * Keys are UUID-like strings, like those in the instance store.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "map.h"
+#include "omap.h"
+
+#include "minunit/minunit.h"
+
+typedef map_t(void *) map_ptr_t;
+typedef omap_t(void *) omap_ptr_t;
+
+int nkeys=10000;
+int niter=20;
+char **keys=NULL;
+char **misses=NULL;
+
+
+/* Returns wall clock time in seconds. */
+static double walltime(void)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Returns a newly allocated UUID-like key. */
+static char *make_key(unsigned seed, unsigned i)
+{
+  char *key = malloc(37);
+  unsigned x = seed * 2654435761u ^ i * 40503u;
+  snprintf(key, 37, "%08x-%04x-%04x-%04x-%012x",
+           x, i & 0xffff, (x >> 8) & 0xffff, (i * 7) & 0xffff, i * 31u);
+  return key;
+}
+
+static void report(const char *what, double t_map, double t_omap, int nops)
+{
+  printf("  %-8s map: %7.1f ns/op   omap: %7.1f ns/op   speedup: %.2f\n",
+         what, 1e9*t_map/nops, 1e9*t_omap/nops,
+         (t_omap > 0) ? t_map / t_omap : 0.0);
+}
+
+
+/***************************************************************
+ * Tests
+ ***************************************************************/
+
+MU_TEST(test_setup)
+{
+  int i;
+  keys = malloc(nkeys * sizeof(char *));
+  misses = malloc(nkeys * sizeof(char *));
+  for (i=0; i<nkeys; i++) {
+    keys[i] = make_key(1, i);
+    misses[i] = make_key(2, i);
+  }
+}
+
+MU_TEST(test_bench)
+{
+  map_ptr_t m;
+  omap_ptr_t o;
+  double t0, t_map[4]={0}, t_omap[4]={0};
+  int i, k, nfound;
+
+  for (k=0; k<niter; k++) {
+    /* map.h */
+    map_init(&m);
+    t0 = walltime();
+    for (i=0; i<nkeys; i++) map_set(&m, keys[i], keys[i]);
+    t_map[0] += walltime() - t0;
+
+    t0 = walltime();
+    for (nfound=0, i=0; i<nkeys; i++)
+      if (map_get(&m, keys[i])) nfound++;
+    t_map[1] += walltime() - t0;
+    mu_assert_int_eq(nkeys, nfound);
+
+    t0 = walltime();
+    for (nfound=0, i=0; i<nkeys; i++)
+      if (map_get(&m, misses[i])) nfound++;
+    t_map[2] += walltime() - t0;
+    mu_assert_int_eq(0, nfound);
+
+    t0 = walltime();
+    for (i=0; i<nkeys; i++) map_remove(&m, keys[i]);
+    t_map[3] += walltime() - t0;
+    map_deinit(&m);
+
+    /* omap.h */
+    omap_init(&o);
+    t0 = walltime();
+    for (i=0; i<nkeys; i++) omap_set(&o, keys[i], keys[i]);
+    t_omap[0] += walltime() - t0;
+
+    t0 = walltime();
+    for (nfound=0, i=0; i<nkeys; i++)
+      if (omap_get(&o, keys[i])) nfound++;
+    t_omap[1] += walltime() - t0;
+    mu_assert_int_eq(nkeys, nfound);
+
+    t0 = walltime();
+    for (nfound=0, i=0; i<nkeys; i++)
+      if (omap_get(&o, misses[i])) nfound++;
+    t_omap[2] += walltime() - t0;
+    mu_assert_int_eq(0, nfound);
+
+    t0 = walltime();
+    for (i=0; i<nkeys; i++) omap_remove(&o, keys[i]);
+    t_omap[3] += walltime() - t0;
+    mu_assert_int_eq(0, omap_count(&o));
+    omap_deinit(&o);
+  }
+
+  printf("\n%d keys x %d iterations:\n", nkeys, niter);
+  report("insert", t_map[0], t_omap[0], nkeys*niter);
+  report("hit", t_map[1], t_omap[1], nkeys*niter);
+  report("miss", t_map[2], t_omap[2], nkeys*niter);
+  report("remove", t_map[3], t_omap[3], nkeys*niter);
+}
+
+MU_TEST(test_teardown)
+{
+  int i;
+  for (i=0; i<nkeys; i++) {
+    free(keys[i]);
+    free(misses[i]);
+  }
+  free(keys);
+  free(misses);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_setup);
+  MU_RUN_TEST(test_bench);
+  MU_RUN_TEST(test_teardown);
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1) nkeys = atoi(argv[1]);
+  if (argc > 2) niter = atoi(argv[2]);
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "err.h"
+#include "fileinfo.h"
 #include "plugin.h"
 #include "test_plugin.h"
 #include "test_macros.h"
@@ -66,6 +67,106 @@ MU_TEST(test_info_free)
   plugin_info_free(info);
 }
 
+/* Returns non-zero if file `filename` contains string `s` */
+static int file_contains(const char *filename, const char *s)
+{
+  char buf[4096];
+  size_t n;
+  FILE *fp = fopen(filename, "r");
+  if (!fp) return 0;
+  n = fread(buf, 1, sizeof(buf)-1, fp);
+  buf[n] = '\0';
+  fclose(fp);
+  return strstr(buf, s) != NULL;
+}
+
+MU_TEST(test_manifest)
+{
+  char *path = STRINGIFY(BINDIR);
+  char *manifest = STRINGIFY(BINDIR) "/test_plugin.manifest";
+  const TestAPI *api;
+  PluginInfo *info2;
+  FILE *fp;
+
+  /* No manifest file - it is written after scanning all plugins */
+  remove(manifest);
+  mu_check((info2 = plugin_info_create("TestPlugin", "get_testapi", NULL,
+                                       NULL)));
+  mu_assert_int_eq(0, plugin_path_append(info2, path));
+  mu_assert_int_eq(0, plugin_set_manifest(info2, manifest));
+  mu_check((api = (const TestAPI *)plugin_get_api(info2, "testapi")));
+  mu_assert_int_eq(4, api->fun1(1, 3));
+  plugin_info_free(info2);
+  mu_check(fileinfo_exists(manifest));
+  mu_check(file_contains(manifest, " testapi "));
+
+  /* Load via the manifest */
+  mu_check((info2 = plugin_info_create("TestPlugin", "get_testapi", NULL,
+                                       NULL)));
+  mu_assert_int_eq(0, plugin_path_append(info2, path));
+  mu_assert_int_eq(0, plugin_set_manifest(info2, manifest));
+  mu_check((api = (const TestAPI *)plugin_get_api(info2, "testapi")));
+  mu_assert_double_eq(6.28, api->fun2(3.14));
+  plugin_info_free(info2);
+
+  /* Stale manifest - falls back to scanning and rewrites it */
+  mu_check((fp = fopen(manifest, "w")));
+  fprintf(fp, "# plugin manifest 1\n");
+  fprintf(fp, "dir 0 %s\n", path);
+  fprintf(fp, "api 0 0 testapi /no/such/plugin\n");
+  fclose(fp);
+  mu_check((info2 = plugin_info_create("TestPlugin", "get_testapi", NULL,
+                                       NULL)));
+  mu_assert_int_eq(0, plugin_path_append(info2, path));
+  mu_assert_int_eq(0, plugin_set_manifest(info2, manifest));
+  mu_check((api = (const TestAPI *)plugin_get_api(info2, "testapi")));
+  mu_assert_int_eq(4, api->fun1(1, 3));
+  plugin_info_free(info2);
+  mu_check(!file_contains(manifest, "/no/such/plugin"));
+  mu_check(file_contains(manifest, " testapi "));
+
+  remove(manifest);
+}
+
+
+static int static_fun1(int a, int b)
+{
+  return a * b;
+}
+
+static TestAPI staticapi = {
+  "staticapi",
+  NULL,
+  static_fun1,
+  NULL
+};
+
+static const PluginAPI *get_staticapi(void *state, int *iter)
+{
+  (void)state;
+  (void)iter;
+  return (const PluginAPI *)&staticapi;
+}
+
+MU_TEST(test_static)
+{
+  static const PluginFunc funcs[] = {get_staticapi, NULL};
+  const TestAPI *api;
+  PluginInfo *info2;
+
+  /* No search path - the api is found among the statically linked plugins */
+  mu_check((info2 = plugin_info_create("TestPlugin", "get_testapi", NULL,
+                                       NULL)));
+  plugin_set_static(info2, funcs);
+  mu_check((api = (const TestAPI *)plugin_get_api(info2, "staticapi")));
+  mu_assert_string_eq("staticapi", api->name);
+  mu_assert_int_eq(3, api->fun1(1, 3));
+  mu_assert_int_eq(0, plugin_unload(info2, "staticapi"));
+  plugin_load_all(info2);
+  mu_check(plugin_get_api(info2, "staticapi") == (const PluginAPI *)api);
+  plugin_info_free(info2);
+}
+
 /***********************************************************************/
 
 MU_TEST_SUITE(test_suite)
@@ -75,6 +176,8 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_iter);
   MU_RUN_TEST(test_unload);
   MU_RUN_TEST(test_info_free);         /* tear down */
+  MU_RUN_TEST(test_manifest);
+  MU_RUN_TEST(test_static);
 }
 
 
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.h"
+#include "scheduler.h"
+
+#include "minunit/minunit.h"
+
+
+static int counter = 0;
+
+static void incr(void *arg)
+{
+  (void)arg;
+  thread_atomic_add(&counter, 1);
+}
+
+/* Fills arg[begin:end] with the index */
+static void fill(size_t begin, size_t end, void *arg)
+{
+  size_t i, *v = arg;
+  for (i=begin; i<end; i++) v[i] = i;
+}
+
+/* Recursive sum of the integers in a range, spawning the upper half */
+typedef struct {
+  size_t begin;
+  size_t end;
+  size_t sum;
+} Sum;
+
+static void sum(void *arg)
+{
+  Sum *s = arg;
+  if (s->end - s->begin <= 16) {
+    size_t i;
+    s->sum = 0;
+    for (i=s->begin; i<s->end; i++) s->sum += i;
+  } else {
+    size_t mid = (s->begin + s->end) / 2;
+    Sum lo = {s->begin, mid, 0}, hi = {mid, s->end, 0};
+    SchedGroup *g = sched_group_create();
+    sched_spawn(g, sum, &hi);
+    sum(&lo);
+    sched_wait(g);
+    sched_group_free(g);
+    s->sum = lo.sum + hi.sum;
+  }
+}
+
+
+MU_TEST(test_nthreads)
+{
+  mu_check(sched_get_nthreads() >= 1);
+  mu_assert_int_eq(0, sched_set_nthreads(4));
+  mu_assert_int_eq(4, sched_get_nthreads());
+}
+
+MU_TEST(test_spawn)
+{
+  SchedGroup *g;
+  int i;
+  mu_check((g = sched_group_create()));
+  for (i=0; i<1000; i++) mu_assert_int_eq(0, sched_spawn(g, incr, NULL));
+  mu_assert_int_eq(0, sched_wait(g));
+  mu_assert_int_eq(1000, counter);
+
+  /* A group can be reused */
+  for (i=0; i<10; i++) sched_spawn(g, incr, NULL);
+  sched_group_free(g);
+  mu_assert_int_eq(1010, counter);
+}
+
+MU_TEST(test_nested)
+{
+  /* Nested tasks waiting for each other must not deadlock */
+  Sum s = {0, 100000, 0};
+  sum(&s);
+  mu_check(s.sum == (size_t)100000/2*99999);
+}
+
+MU_TEST(test_parallel_for)
+{
+  size_t i, n = 10007, *v = calloc(n, sizeof(size_t));
+  mu_assert_int_eq(0, sched_parallel_for(n, 100, fill, v));
+  for (i=0; i<n; i++) if (v[i] != i) break;
+  mu_assert_int_eq(n, i);
+  mu_assert_int_eq(0, sched_parallel_for(0, 100, fill, v));
+  free(v);
+}
+
+MU_TEST(test_single_thread)
+{
+  Sum s = {0, 1000, 0};
+  mu_assert_int_eq(0, sched_set_nthreads(1));
+  sum(&s);
+  mu_check(s.sum == (size_t)1000/2*999);
+  sched_set_nthreads(0);
+  mu_check(sched_get_nthreads() >= 1);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_nthreads);
+  MU_RUN_TEST(test_spawn);
+  MU_RUN_TEST(test_nested);
+  MU_RUN_TEST(test_parallel_for);
+  MU_RUN_TEST(test_single_thread);
+}
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
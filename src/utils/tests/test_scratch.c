@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "err.h"
+#include "thread.h"
+#include "scratch.h"
+
+#include "minunit/minunit.h"
+
+#if defined(HAVE_GCC_THREAD_LOCAL_STORAGE) || \
+  defined(HAVE_WIN32_THREAD_LOCAL_STORAGE)
+# define USE_ARENA
+#endif
+
+
+MU_TEST(test_alloc)
+{
+  size_t *a, i;
+  char *s, *t;
+  mu_check((a = scratch_calloc(10, sizeof(size_t))));
+  for (i=0; i<10; i++) mu_assert_int_eq(0, a[i]);
+  for (i=0; i<10; i++) a[i] = i;
+  mu_check(((uintptr_t)a % 16) == 0);
+
+  mu_check((s = scratch_strdup("hello")));
+  mu_assert_string_eq("hello", s);
+  mu_check(((uintptr_t)s % 16) == 0);
+  mu_check((t = scratch_strndup("world wide", 5)));
+  mu_assert_string_eq("world", t);
+  for (i=0; i<10; i++) mu_assert_int_eq(i, a[i]);
+
+  scratch_free(t);
+  scratch_free(s);
+  scratch_free(a);
+}
+
+MU_TEST(test_reuse)
+{
+#ifdef USE_ARENA
+  ScratchStats stats;
+  size_t nheap;
+  char *p, *q, *big;
+  int i;
+
+  /* warm up */
+  scratch_free(scratch_calloc(1, 100));
+  scratch_stats(&stats);
+  mu_assert_int_eq(1, stats.nblocks);
+  mu_assert_int_eq(0, stats.used);
+  nheap = stats.nheap;
+
+  /* repeated allocations don't touch the heap */
+  for (i=0; i<1000; i++) {
+    mu_check((p = scratch_calloc(10, 8)));
+    mu_check((q = scratch_strdup("abc")));
+    scratch_free(p);  /* also frees q */
+  }
+  scratch_stats(&stats);
+  mu_assert_int_eq(nheap, stats.nheap);
+  mu_assert_int_eq(0, stats.used);
+
+  /* large buffers get their own block, which is freed when the arena
+     becomes empty */
+  mu_check((p = scratch_calloc(1, 100)));
+  mu_check((big = scratch_calloc(1, 3*SCRATCH_BLOCKSIZE)));
+  memset(big, 1, 3*SCRATCH_BLOCKSIZE);
+  mu_check((q = scratch_calloc(1, 100)));
+  scratch_stats(&stats);
+  mu_assert_int_eq(3, stats.nblocks);
+  mu_check(stats.used >= 3*SCRATCH_BLOCKSIZE + 200);
+  scratch_free(big);
+  scratch_stats(&stats);
+  mu_assert_int_eq(3, stats.nblocks);
+  mu_check(stats.used >= 100 && stats.used < 200);
+  scratch_free(p);
+  scratch_stats(&stats);
+  mu_assert_int_eq(1, stats.nblocks);
+  mu_assert_int_eq(0, stats.used);
+
+  /* invalid pointer */
+  err_set_stream(NULL);
+  p = scratch_calloc(1, 10);
+  scratch_free(p + SCRATCH_BLOCKSIZE);
+  mu_assert_int_eq(1, err_geteval());
+  err_set_stream(stderr);
+  err_clear();
+  scratch_free(p);
+#endif
+}
+
+/* Thread function allocating and freeing scratch buffers. */
+static void *worker(void *arg)
+{
+  int i, *fail = arg;
+  for (i=0; i<1000; i++) {
+    size_t j, n = i % 50 + 1;
+    int *a = scratch_calloc(n, sizeof(int));
+    int *b = scratch_calloc(n, sizeof(int));
+    for (j=0; j<n; j++) a[j] = b[j] = (int)j;
+    for (j=0; j<n; j++) if (a[j] != (int)j || b[j] != (int)j) *fail = 1;
+    scratch_free(b);
+    scratch_free(a);
+  }
+  scratch_cleanup();
+  return NULL;
+}
+
+MU_TEST(test_threads)
+{
+  Thread threads[4];
+  int i, fail[4] = {0, 0, 0, 0};
+  for (i=0; i<4; i++)
+    if (thread_create(threads + i, worker, fail + i)) break;
+  while (i--) {
+    mu_assert_int_eq(0, thread_join(threads[i], NULL));
+    mu_assert_int_eq(0, fail[i]);
+  }
+}
+
+MU_TEST(test_cleanup)
+{
+  ScratchStats stats;
+  scratch_cleanup();
+  scratch_stats(&stats);
+  mu_assert_int_eq(0, stats.nblocks);
+  mu_assert_int_eq(0, stats.capacity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_alloc);
+  MU_RUN_TEST(test_reuse);
+  MU_RUN_TEST(test_threads);
+  MU_RUN_TEST(test_cleanup);
+}
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sha1.h"
+#include "strutils.h"
+
+#include "minunit/minunit.h"
+
+
+const char *testsha1(const void *data, size_t n)
+{
+  static char buf[41];
+  unsigned char hash[20];
+  SHA1_CTX c;
+
+  SHA1Init(&c);
+  SHA1Update(&c, data, (uint32_t)n);
+  SHA1Final(hash, &c);
+  strhex(buf, sizeof(buf), hash, 20);
+  return buf;
+}
+
+
+MU_TEST(test_fips)
+{
+  /* Test vectors from FIPS PUB 180-1 */
+  char *data;
+
+  mu_assert_string_eq("a9993e364706816aba3e25717850c26c9cd0d89d",
+                      testsha1("abc", 3));
+  mu_assert_string_eq(
+    "84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+    testsha1("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56));
+
+  data = malloc(1000000);
+  memset(data, 'a', 1000000);
+  mu_assert_string_eq("34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+                      testsha1(data, 1000000));
+  free(data);
+}
+
+MU_TEST(test_padding)
+{
+  /* Lengths around the block boundaries, where the padding needs one
+     or two blocks.  Python: hashlib.sha1(b'x'*n).hexdigest() */
+  char data[128];
+  memset(data, 'x', sizeof(data));
+  mu_assert_string_eq("da39a3ee5e6b4b0d3255bfef95601890afd80709",
+                      testsha1(data, 0));
+  mu_assert_string_eq("cef734ba81a024479e09eb5a75b6ddae62e6abf1",
+                      testsha1(data, 55));
+  mu_assert_string_eq("901305367c259952f4e7af8323f480d59f81335b",
+                      testsha1(data, 56));
+  mu_assert_string_eq("bb2fa3ee7afb9f54c6dfb5d021f14b1ffe40c163",
+                      testsha1(data, 64));
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_fips);
+  MU_RUN_TEST(test_padding);
+}
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
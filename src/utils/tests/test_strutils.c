@@ -121,6 +121,64 @@ MU_TEST(test_strunquote)
 }
 
 
+MU_TEST(test_strbase64)
+{
+  char buf[32];
+  unsigned char data[32];
+  int n;
+
+  mu_assert_int_eq(0, strbase64(buf, sizeof(buf), (unsigned char *)"", 0));
+  mu_assert_string_eq("", buf);
+  mu_assert_int_eq(4, strbase64(buf, sizeof(buf), (unsigned char *)"f", 1));
+  mu_assert_string_eq("Zg==", buf);
+  mu_assert_int_eq(4, strbase64(buf, sizeof(buf), (unsigned char *)"fo", 2));
+  mu_assert_string_eq("Zm8=", buf);
+  mu_assert_int_eq(8, strbase64(buf, sizeof(buf),
+                                (unsigned char *)"foobar", 6));
+  mu_assert_string_eq("Zm9vYmFy", buf);
+  mu_assert_int_eq(8, strbase64(buf, 6, (unsigned char *)"foobar", 6));
+  mu_assert_string_eq("Zm9v", buf);
+
+  n = strunbase64(data, sizeof(data), "Zm9vYmE=", -1);
+  mu_assert_int_eq(5, n);
+  mu_check(memcmp(data, "fooba", 5) == 0);
+  n = strunbase64(data, sizeof(data), "Zm9v\nYg==", -1);
+  mu_assert_int_eq(4, n);
+  mu_check(memcmp(data, "foob", 4) == 0);
+  mu_assert_int_eq(6, strunbase64(data, 2, "Zm9vYmFy", -1));
+  mu_assert_int_eq(3, strunbase64(data, sizeof(data), "Zm9vYmFy", 4));
+  mu_assert_int_eq(-1, strunbase64(data, sizeof(data), "Zm9", -1));
+  mu_assert_int_eq(-1, strunbase64(data, sizeof(data), "Z\"9v", -1));
+  mu_assert_int_eq(-1, strunbase64(data, sizeof(data), "Zg==Zg==", -1));
+}
+
+MU_TEST(test_strbase85)
+{
+  char buf[32];
+  unsigned char data[32], hello[] = {0x86, 0x4F, 0xD2, 0x6F,
+                                     0xB5, 0x59, 0xF7, 0x5B};
+  int i, n;
+
+  /* Test vector from the Z85 specification */
+  mu_assert_int_eq(10, strbase85(buf, sizeof(buf), hello, 8));
+  mu_assert_string_eq("HelloWorld", buf);
+  n = strunbase85(data, sizeof(data), "HelloWorld", -1);
+  mu_assert_int_eq(8, n);
+  mu_check(memcmp(data, hello, 8) == 0);
+
+  /* Partial groups */
+  for (i=0; i<8; i++) {
+    mu_assert_int_eq(5*(i/4) + ((i%4) ? i%4 + 1 : 0),
+                     strbase85(buf, sizeof(buf), hello, i));
+    memset(data, 0, sizeof(data));
+    mu_assert_int_eq(i, strunbase85(data, sizeof(data), buf, -1));
+    mu_check(memcmp(data, hello, i) == 0);
+  }
+  mu_assert_int_eq(-1, strunbase85(data, sizeof(data), "Hello W", -1));
+  mu_assert_int_eq(-1, strunbase85(data, sizeof(data), "Hello\"", -1));
+}
+
+
 
 /***********************************************************************/
 
@@ -130,6 +188,8 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_strquote);
   MU_RUN_TEST(test_strnquote);
   MU_RUN_TEST(test_strunquote);
+  MU_RUN_TEST(test_strbase64);
+  MU_RUN_TEST(test_strbase85);
 }
 
 
@@ -463,6 +463,67 @@ MU_TEST(test_tgen)
 
 
 
+MU_TEST(test_tgen_compile)
+{
+  char *str, *expected;
+  size_t i;
+  TGenSubs subs, subs1, subs2;
+  TGenTemplate *tt;
+  char *templates[] = {
+    "{name} got n={n}!",
+    "simple template",
+    "{name:valid {n}{} got n={n}!",
+    "should {{ work }}!",
+    "pi is {pi%-6.3T}...",
+    "Answer: {s%M}",
+    "func subst {f:pi={pi}{}",
+    "func subst {f2}",
+    "show loop:\n{loop:  i={i} - data={data}\n}",
+    "{xxx?}{name?}",
+    "exists={x?}, {x=5} exists={x?}, x={x}",
+    "{@if:0}a{@elif:}b{@else}pi = {pi}{@endif}...",
+    "{@if: '{name}' }true{@else}false{@endif} {n}",
+    "pi{@4}is\n {@6}{pi:templ string}...",
+  };
+
+  tgen_subs_init(&subs);
+  tgen_subs_set(&subs, "n",     "42",   NULL);
+  tgen_subs_set(&subs, "pi",    "3.14", NULL);
+  tgen_subs_set(&subs, "name",  "Adam", NULL);
+  tgen_subs_set(&subs, "s",     "length is 5.5mm", NULL);
+  tgen_subs_set(&subs, "f",     NULL,   tgen_append);
+  tgen_subs_set(&subs, "f2",    "XX",   tgen_append);
+  tgen_subs_set(&subs, "loop",  NULL,   loop);
+
+  /* assignments modify the substitutions, so render with copies */
+  for (i=0; i<sizeof(templates)/sizeof(char *); i++) {
+    mu_check((tt = tgen_compile(templates[i], -1, (i % 2) ? &subs : NULL)));
+    mu_assert_int_eq(0, tgen_subs_copy(&subs1, &subs));
+    mu_assert_int_eq(0, tgen_subs_copy(&subs2, &subs));
+    mu_check((str = tgen_render(tt, &subs1, NULL)));
+    mu_check((expected = tgen(templates[i], &subs2, NULL)));
+    mu_assert_string_eq(expected, str);
+    free(expected);
+    free(str);
+    tgen_subs_deinit(&subs2);
+    tgen_subs_deinit(&subs1);
+    tgen_template_free(tt);
+  }
+
+  /* syntax errors are reported by the compiler */
+  mu_check(!tgen_compile("invalid } template", -1, NULL));
+  mu_check(!tgen_compile("{name:invalid {{n}} got n={n}!", -1, NULL));
+  err_clear();
+
+  /* unknown variables are reported when rendering */
+  mu_check((tt = tgen_compile("{xname} got n={n}!", -1, NULL)));
+  mu_check(!tgen_render(tt, &subs, NULL));
+  err_clear();
+  tgen_template_free(tt);
+
+  tgen_subs_deinit(&subs);
+}
+
 
 
 
@@ -477,6 +538,7 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_tgen_lineno);
   MU_RUN_TEST(test_tgen_subs);
   MU_RUN_TEST(test_tgen);
+  MU_RUN_TEST(test_tgen_compile);
 }
 
 
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "err.h"
+#include "thread.h"
+#include "trace.h"
+#include "test_macros.h"
+
+#include "minunit/minunit.h"
+
+#define TRACEFILE STRINGIFY(BINDIR) "/test_trace.json"
+
+
+MU_TEST(test_now)
+{
+  uint64_t t1 = trace_now();
+  uint64_t t2 = trace_now();
+  mu_check(t1 > 0);
+  mu_check(t2 >= t1);
+}
+
+#ifdef WITH_TRACE
+
+/* Returns a newly allocated string with the content of the trace file. */
+static char *read_trace(void)
+{
+  FILE *fp = fopen(TRACEFILE, "r");
+  char *buf;
+  long n;
+  if (!fp) return NULL;
+  fseek(fp, 0, SEEK_END);
+  n = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buf = calloc(n + 1, 1);
+  if (fread(buf, 1, n, fp) != (size_t)n) buf[0] = '\0';
+  fclose(fp);
+  return buf;
+}
+
+/* Records a span in a new thread. */
+static void *record(void *arg)
+{
+  TRACE_BEGIN(span, "thread", (const char *)arg);
+  TRACE_END(span);
+  return NULL;
+}
+
+
+MU_TEST(test_disabled)
+{
+  mu_check(!trace_enabled());
+  TRACE_BEGIN(span, "disabled", NULL);
+  TRACE_END(span);
+  mu_assert_int_eq(0, trace_write(TRACEFILE));
+}
+
+MU_TEST(test_spans)
+{
+  char *buf;
+  mu_assert_int_eq(0, trace_enable(NULL));
+  mu_check(trace_enabled());
+  {
+    TRACE_BEGIN(outer, "outer", "a \"quoted\" detail");
+    {
+      TRACE_BEGIN(inner, "inner", NULL);
+      TRACE_END(inner);
+    }
+    TRACE_END(outer);
+  }
+  mu_assert_int_eq(2, trace_write(TRACEFILE));
+
+  mu_check((buf = read_trace()));
+  mu_check(strstr(buf, "\"traceEvents\""));
+  mu_check(strstr(buf, "\"name\": \"outer\""));
+  mu_check(strstr(buf, "\"name\": \"inner\""));
+  mu_check(strstr(buf, "{\"detail\": \"a \\\"quoted\\\" detail\"}"));
+  mu_check(strstr(buf, "\"ph\": \"X\""));
+  free(buf);
+}
+
+MU_TEST(test_thread)
+{
+  Thread thread;
+  char *buf;
+  if (thread_create(&thread, record, "from thread")) return;
+  mu_assert_int_eq(0, thread_join(thread, NULL));
+  mu_assert_int_eq(3, trace_write(TRACEFILE));
+
+  mu_check((buf = read_trace()));
+  mu_check(strstr(buf, "\"tid\": 2"));
+  mu_check(strstr(buf, "{\"detail\": \"from thread\"}"));
+  free(buf);
+}
+
+MU_TEST(test_overflow)
+{
+  int i;
+  trace_clear();
+  mu_assert_int_eq(0, trace_write(TRACEFILE));
+  for (i=0; i < TRACE_BUFSIZE + 10; i++) {
+    TRACE_BEGIN(span, "loop", NULL);
+    TRACE_END(span);
+  }
+  mu_assert_int_eq(TRACE_BUFSIZE, trace_write(TRACEFILE));
+}
+
+MU_TEST(test_disable)
+{
+  trace_clear();
+  trace_disable();
+  mu_check(!trace_enabled());
+  {
+    TRACE_BEGIN(span, "disabled", NULL);
+    TRACE_END(span);
+  }
+  mu_assert_int_eq(0, trace_write(TRACEFILE));
+}
+
+#else
+
+MU_TEST(test_unsupported)
+{
+  err_clear();
+  mu_check(trace_enable(NULL));
+  mu_check(!trace_enabled());
+  err_clear();
+}
+
+#endif
+
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_now);
+#ifdef WITH_TRACE
+  MU_RUN_TEST(test_disabled);
+  MU_RUN_TEST(test_spans);
+  MU_RUN_TEST(test_thread);
+  MU_RUN_TEST(test_overflow);
+  MU_RUN_TEST(test_disable);
+#else
+  MU_RUN_TEST(test_unsupported);
+#endif
+}
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "uuid4.h"
 
@@ -16,12 +17,68 @@ MU_TEST(test_uuid4)
 }
 
 
+/* Returns non-zero if `s` is a well-formed lower-case version 4 UUID. */
+static int is_uuid4(const char *s)
+{
+  int i;
+  if (strlen(s) != UUID4_LEN - 1) return 0;
+  for (i=0; i<UUID4_LEN-1; i++) {
+    if (i == 8 || i == 13 || i == 18 || i == 23) {
+      if (s[i] != '-') return 0;
+    } else if (!strchr("0123456789abcdef", s[i])) {
+      return 0;
+    }
+  }
+  return s[14] == '4' && strchr("89ab", s[19]);
+}
+
+MU_TEST(test_uuid4_format)
+{
+  char buf[UUID4_LEN];
+  int i, nbad=0;
+  for (i=0; i<1000; i++) {
+    mu_assert_int_eq(0, uuid4_generate(buf));
+    if (!is_uuid4(buf)) nbad++;
+  }
+  mu_assert_int_eq(0, nbad);
+}
+
+MU_TEST(test_uuid4_generate_many)
+{
+  size_t i, n=1000, nbad=0, ndup=0;
+  char *buf = malloc(n * UUID4_LEN);
+  char strided[3][64];
+
+  mu_assert_int_eq(0, uuid4_generate_many(buf, n, 0));
+  for (i=0; i<n; i++) {
+    if (!is_uuid4(buf + i*UUID4_LEN)) nbad++;
+    if (i && strcmp(buf + i*UUID4_LEN, buf + (i-1)*UUID4_LEN) == 0) ndup++;
+  }
+  mu_assert_int_eq(0, nbad);
+  mu_assert_int_eq(0, ndup);
+
+  /* Strided output */
+  memset(strided, 'x', sizeof(strided));
+  mu_assert_int_eq(0, uuid4_generate_many(strided[0], 3, sizeof(strided[0])));
+  for (i=0; i<3; i++) {
+    mu_check(is_uuid4(strided[i]));
+    mu_assert_int_eq('x', strided[i][UUID4_LEN]);
+  }
+
+  /* Too small stride */
+  mu_assert_int_eq(UUID4_EFAILURE, uuid4_generate_many(buf, 2, 10));
+  free(buf);
+}
+
+
 
 /***********************************************************************/
 
 MU_TEST_SUITE(test_suite)
 {
   MU_RUN_TEST(test_uuid4);
+  MU_RUN_TEST(test_uuid4_format);
+  MU_RUN_TEST(test_uuid4_generate_many);
 }
 
 
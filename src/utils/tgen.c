@@ -1217,3 +1217,394 @@ int tgen_append(TGenBuf *s, const char *template, int tlen,
 
   return 0;
 }
+
+
+/***************************************************************
+ * Compiled templates
+ ***************************************************************/
+
+/* Instruction types */
+typedef enum {
+  TGenOpText,      /* append literal text */
+  TGenOpVar,       /* variable or function substitution */
+  TGenOpDefined,   /* {VAR?} */
+  TGenOpInterp     /* interpret a range of the template with tgen_append() */
+} TGenOpType;
+
+/* A compiled instruction */
+typedef struct {
+  TGenOpType type;
+  const char *str;   /* text, template range or variable position (points
+                        into source) */
+  int len;           /* length of `str` */
+  char *var;         /* NUL-terminated variable name */
+  int slot;          /* index of `var` in the prototype substitutions or -1 */
+  char fmt[10];      /* printf() format or empty string */
+  int casemode;      /* case conversion mode */
+  const char *templ; /* subtemplate or NULL */
+  int templ_len;     /* length of subtemplate */
+} TGenOp;
+
+struct _TGenTemplate {
+  char *source;      /* copy of the template source */
+  TGenOp *ops;       /* instruction list */
+  int nops;          /* number of instructions */
+  int size;          /* allocated number of instructions */
+};
+
+/* Appends a new zeroed instruction of type `type` to `tt`.  Returns a
+   pointer to it or NULL on error. */
+static TGenOp *tgen_template_addop(TGenTemplate *tt, TGenOpType type)
+{
+  TGenOp *op;
+  if (tt->nops >= tt->size) {
+    int size = (tt->size) ? 2*tt->size : 16;
+    TGenOp *ops = realloc(tt->ops, size*sizeof(TGenOp));
+    if (!ops) return err(TGenAllocationError, "allocation failure"), NULL;
+    tt->ops = ops;
+    tt->size = size;
+  }
+  op = tt->ops + tt->nops++;
+  memset(op, 0, sizeof(TGenOp));
+  op->type = type;
+  op->slot = -1;
+  op->casemode = 's';
+  return op;
+}
+
+/* Appends a text or interpret instruction for `len` bytes of `str`. */
+static int tgen_template_addrange(TGenTemplate *tt, TGenOpType type,
+                                  const char *str, int len)
+{
+  TGenOp *op;
+  if (len <= 0) return 0;
+  /* merge consecutive text */
+  if (type == TGenOpText && tt->nops &&
+      tt->ops[tt->nops-1].type == TGenOpText &&
+      tt->ops[tt->nops-1].str + tt->ops[tt->nops-1].len == str) {
+    tt->ops[tt->nops-1].len += len;
+    return 0;
+  }
+  if (!(op = tgen_template_addop(tt, type))) return TGenAllocationError;
+  op->str = str;
+  op->len = len;
+  return 0;
+}
+
+/* Appends a variable instruction for variable `var` of length `len`. */
+static TGenOp *tgen_template_addvar(TGenTemplate *tt, TGenOpType type,
+                                    const char *var, int len,
+                                    const TGenSubs *subs)
+{
+  TGenOp *op;
+  int *ip;
+  if (!(op = tgen_template_addop(tt, type))) return NULL;
+  op->str = var;
+  if (!(op->var = strndup(var, len))) {
+    tt->nops--;
+    return err(TGenAllocationError, "allocation failure"), NULL;
+  }
+  if (subs && (ip = map_get((map_int_t *)&subs->map, op->var)))
+    op->slot = *ip;
+  return op;
+}
+
+/*
+  Compiles the `len` first bytes of `template` (all of it if `len` is
+  negative) into a list of instructions.
+ */
+TGenTemplate *tgen_compile(const char *template, int len,
+                           const TGenSubs *subs)
+{
+  TGenTemplate *tt;
+  const char *t, *source;
+  int tlen;
+
+  if (!(tt = calloc(1, sizeof(TGenTemplate))))
+    return err(TGenAllocationError, "allocation failure"), NULL;
+  tlen = (len < 0) ? (int)strlen(template) : len;
+  if (!(tt->source = strndup(template, tlen))) {
+    free(tt);
+    return err(TGenAllocationError, "allocation failure"), NULL;
+  }
+  source = t = tt->source;
+
+  /* The parsing below follows tgen_append() */
+  while (*t) {
+    const char *start;
+    int n = strcspn(t, "{}");
+    if (tgen_template_addrange(tt, TGenOpText, t, n)) goto fail;
+    t += n;
+
+    switch (*(t++)) {
+
+    case '\0':
+      return tt;
+
+    case '{':
+      switch (*t) {
+      case '\0':
+        err(TGenSyntaxError, "line %d: template ends with unmatched '{'",
+            tgen_lineno(source, t));
+        goto fail;
+      case '{':
+        if (tgen_template_addrange(tt, TGenOpText, t, 1)) goto fail;
+        t++;
+        break;
+      case '}':
+        break;
+      default:
+        start = t - 1;
+        n = strcspn(t, "%:{}=?");
+        if (t[n] == '\0') {
+          err(TGenSyntaxError, "line %d: template ends with unmatched '{'",
+              tgen_lineno(source, t));
+          goto fail;
+        }
+        if (t[n] == '{') {
+          err(TGenSyntaxError, "line %d: unexpected '{' within a "
+              "substitution", tgen_lineno(source, t));
+          goto fail;
+        }
+
+        if (strncmp(t, "@error", n) == 0) {
+          /* always fails, let the interpreter report the error */
+          if (tgen_template_addrange(tt, TGenOpInterp, start,
+                                     strlen(start)))
+            goto fail;
+          return tt;
+
+        } else if (strncmp(t, "@if", n) == 0) {
+          /* find the end of the conditional like builtin_if() */
+          const char *p = t;
+          int m, k = strcspn(p, ":");
+          if (!p[k]) goto invalid_if;
+          p += k + 1;
+          if ((k = length_to_endbrace(p)) < 0 || !p[k]) goto invalid_if;
+          p += k + 1;
+          if ((k = length_to_var(p, "@endif", -1)) < 0) goto invalid_if;
+          if ((m = length_to_endbrace(p+k+1)) < 0) goto invalid_if;
+          p += k + m + 2;
+          if (tgen_template_addrange(tt, TGenOpInterp, start, p - start))
+            goto fail;
+          t = p;
+          continue;
+        invalid_if:
+          err(TGenSyntaxError, "line %d: invalid conditional: \"%.*s\"",
+              tgen_lineno(source, t), 120, t);
+          goto fail;
+
+        } else if (is_identifier(t, '=') ||
+                   (t[0] == '@' && isdigit(t[1]))) {
+          /* assignments and alignments are interpreted */
+          if ((n = length_to_endbrace(t)) < 0) {
+            err(TGenSyntaxError, "line %d: unterminated tag '%.*s'...",
+                tgen_lineno(source, t), 30, t);
+            goto fail;
+          }
+          if (tgen_template_addrange(tt, TGenOpInterp, start,
+                                     t + n + 1 - start))
+            goto fail;
+          t += n + 1;
+          continue;
+
+        } else if (t[0] == ':' && t[1] == ' ') {  /* comment */
+          if ((n = length_to_endbrace(t)) < 0) {
+            err(TGenSyntaxError, "line %d: invalid comment tag '%.*s'...",
+                tgen_lineno(source, t), 20, t);
+            goto fail;
+          }
+          t += n + 1;
+          continue;
+        }
+
+        if (t[n] == '?') {
+          if (t[n+1] != '}') {
+            err(TGenVariableError, "line %d: expect '}' after '?' in var "
+                "'%.*s'", tgen_lineno(source, t), n, t);
+            goto fail;
+          }
+          if (!tgen_template_addvar(tt, TGenOpDefined, t, n, subs))
+            goto fail;
+          t += n + 2;
+          continue;
+
+        } else {
+          TGenOp *op;
+          if (!(op = tgen_template_addvar(tt, TGenOpVar, t, n, subs)))
+            goto fail;
+
+          /* parse FMT */
+          if (t[n] == '%') {
+            const char *tt_ = t + n;
+            int m = strcspn(tt_, ":}");
+            if (m >= (int)sizeof(op->fmt)) {
+              err(TGenSyntaxError, "line %d: format specifier \"%.*s\" "
+                  "must not exceed %lu characters", tgen_lineno(source, t),
+                  m, tt_, (unsigned long)sizeof(op->fmt)-1);
+              goto fail;
+            }
+            if (tt_[m] == '\0') {
+              err(TGenSyntaxError, "line %d: template ends with "
+                  "unmatched '{'", tgen_lineno(source, t));
+              goto fail;
+            }
+            if (!validate_fmt(tt_, m)) {
+              err(TGenSyntaxError, "line %d: invalid format specifier "
+                  "\"%.*s\"", tgen_lineno(source, t), m, tt_);
+              goto fail;
+            }
+            n += m;
+            op->casemode = tt_[m-1];
+            strncpy(op->fmt, tt_, m);
+            op->fmt[m-1] = 's';
+            op->fmt[m] = '\0';
+          }
+
+          /* parse TEMPL */
+          if (t[n] == ':') {
+            int depth = 0;
+            const char *q = t + n + 1;
+            op->templ = q;
+            while (*q && *q != '}') {
+              int m = strcspn(q, "{}");
+              q += m;
+              switch (*(q++)) {
+              case '\0':
+                err(TGenSyntaxError, "line %d: unterminated subtemplate "
+                    "in substitution for '%s'", tgen_lineno(source, t),
+                    op->var);
+                goto fail;
+              case '{':
+                if (*q == '{')
+                  q++;
+                else if (*q != '}')
+                  depth++;
+                break;
+              case '}':
+                if (*q == '}')
+                  q++;
+                else if (depth-- <= 0)
+                  q--;
+                break;
+              default:
+                abort();
+              }
+            }
+            t = q;
+            op->templ_len = q - op->templ;
+          }
+          n = strcspn(t, "}");
+          assert(t[n]);
+          t += n + 1;
+        }
+      }
+      break;
+
+    case '}':
+      if (*t != '}') {
+        err(TGenSyntaxError, "line %d: unescaped terminating brace",
+            tgen_lineno(source, t));
+        goto fail;
+      }
+      if (tgen_template_addrange(tt, TGenOpText, t, 1)) goto fail;
+      t++;
+      break;
+
+    default:
+      abort();  /* should never be reached*/
+    }
+  }
+  return tt;
+ fail:
+  tgen_template_free(tt);
+  return NULL;
+}
+
+/*
+  Frees compiled template `tt`.
+ */
+void tgen_template_free(TGenTemplate *tt)
+{
+  int i;
+  if (!tt) return;
+  for (i=0; i<tt->nops; i++)
+    if (tt->ops[i].var) free(tt->ops[i].var);
+  if (tt->ops) free(tt->ops);
+  free(tt->source);
+  free(tt);
+}
+
+/* Returns the substitution for instruction `op`. */
+static const TGenSub *tgen_template_getsub(const TGenOp *op,
+                                           const TGenSubs *subs)
+{
+  if (op->slot >= 0 && op->slot < subs->nsubs &&
+      strcmp(subs->subs[op->slot].var, op->var) == 0)
+    return subs->subs + op->slot;
+  return tgen_subs_get(subs, op->var);
+}
+
+/*
+  Like tgen_append(), but renders compiled template `tt`.
+ */
+int tgen_render_append(TGenBuf *s, const TGenTemplate *tt, TGenSubs *subs,
+                       void *context)
+{
+  int i, stat;
+  for (i=0; i<tt->nops; i++) {
+    const TGenOp *op = tt->ops + i;
+    const TGenSub *sub;
+    switch (op->type) {
+    case TGenOpText:
+      if (tgen_buf_append(s, op->str, op->len) < 0) return -1;
+      break;
+    case TGenOpInterp:
+      if ((stat = tgen_append(s, op->str, op->len, subs, context)))
+        return stat;
+      break;
+    case TGenOpDefined:
+      tgen_buf_append(s, (tgen_template_getsub(op, subs)) ? "1" : "0", 1);
+      break;
+    case TGenOpVar:
+      if (!(sub = tgen_template_getsub(op, subs)))
+        return err(TGenVariableError, "line %d: unknown var '%s'",
+                   tgen_lineno(tt->source, op->str), op->var);
+      if (sub->func) {
+        const char *templ = (op->templ) ? op->templ : sub->repl;
+        if (!templ)
+          return err(TGenSubtemplateError, "subtemplate must be provided "
+                     "for var '%s'", sub->var);
+        if ((stat = sub->func(s, templ, (op->templ) ? op->templ_len : -1,
+                              subs, context)))
+          return stat;
+      } else if (op->fmt[0]) {
+        char *p = tgen_convert_case(sub->repl, -1, op->casemode);
+        int nchars;
+        if (!p) return -1;
+        nchars = tgen_buf_append_fmt(s, op->fmt, p);
+        free(p);
+        if (nchars < 0) return nchars;
+      } else {
+        if (tgen_buf_append(s, sub->repl, -1) < 0) return -1;
+      }
+      break;
+    }
+  }
+  return 0;
+}
+
+/*
+  Like tgen(), but renders compiled template `tt`.
+ */
+char *tgen_render(const TGenTemplate *tt, TGenSubs *subs, void *context)
+{
+  TGenBuf s;
+  tgen_buf_init(&s);
+  if (tgen_render_append(&s, tt, subs, context)) {
+    if (s.buf) free(s.buf);
+    return NULL;
+  }
+  if (!s.buf) return strdup("");
+  return s.buf;
+}
@@ -623,4 +623,58 @@ int tgen_append(TGenBuf *s, const char *template, int len,
 /** @} */
 
 
+/**
+  @name Compiled templates
+  A template that is rendered many times, e.g. once for each of many
+  instances, can be compiled once into a list of instructions with
+  tgen_compile().  Rendering a compiled template with tgen_render()
+  gives the same result as tgen(), but avoids scanning the template
+  for tags on each call.  Conditionals, assignments and alignment tags
+  are still interpreted, as are the subtemplates passed to
+  substitution functions.
+  @{
+ */
+
+/** Opaque type for a compiled template. */
+typedef struct _TGenTemplate TGenTemplate;
+
+/**
+  Compiles the `len` first bytes of `template` into a list of
+  instructions.  If `len` is negative, the whole NUL-terminated
+  template is compiled.  The template is copied.
+
+  If `subs` is not NULL, variables are resolved to their position in
+  `subs`.  Substitutions created in the same order for other
+  documents can then be looked up without hashing when rendering.
+
+  Returns a new compiled template or NULL on syntax error.
+ */
+TGenTemplate *tgen_compile(const char *template, int len,
+                           const TGenSubs *subs);
+
+/**
+  Frees compiled template `tt`.
+ */
+void tgen_template_free(TGenTemplate *tt);
+
+/**
+  Like tgen(), but renders compiled template `tt`.  A compiled
+  template may be rendered concurrently from several threads with
+  different substitutions.
+
+  Returns NULL, on error.
+ */
+char *tgen_render(const TGenTemplate *tt, TGenSubs *subs, void *context);
+
+/**
+  Like tgen_append(), but renders compiled template `tt`.
+
+  Returns non-zero on error.
+ */
+int tgen_render_append(TGenBuf *s, const TGenTemplate *tt, TGenSubs *subs,
+                       void *context);
+
+/** @} */
+
+
 #endif /* _TGEN_H */
@@ -0,0 +1,201 @@
+/* thread.c -- thin portable layer over threads, locks and atomics
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include "config.h"
+
+#include <stdlib.h>
+
+#if defined(HAVE_PTHREADS)
+# include <errno.h>
+# include <time.h>
+# include <unistd.h>
+#endif
+
+#include "thread.h"
+
+
+#if defined(HAVE_PTHREADS)
+
+int thread_create(Thread *thread, ThreadFunc func, void *arg)
+  { return pthread_create(thread, NULL, func, arg); }
+int thread_join(Thread thread, void **retval)
+  { return pthread_join(thread, retval); }
+
+int thread_ncpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n > 0) return (int)n;
+#endif
+  return 1;
+}
+
+int thread_mutex_init(ThreadMutex *mutex)
+  { return pthread_mutex_init(mutex, NULL); }
+int thread_mutex_destroy(ThreadMutex *mutex)
+  { return pthread_mutex_destroy(mutex); }
+int thread_mutex_lock(ThreadMutex *mutex)
+  { return pthread_mutex_lock(mutex); }
+int thread_mutex_unlock(ThreadMutex *mutex)
+  { return pthread_mutex_unlock(mutex); }
+
+int thread_rwlock_init(ThreadRWLock *lock)
+  { return pthread_rwlock_init(lock, NULL); }
+int thread_rwlock_destroy(ThreadRWLock *lock)
+  { return pthread_rwlock_destroy(lock); }
+int thread_rwlock_rdlock(ThreadRWLock *lock)
+  { return pthread_rwlock_rdlock(lock); }
+int thread_rwlock_wrlock(ThreadRWLock *lock)
+  { return pthread_rwlock_wrlock(lock); }
+int thread_rwlock_rdunlock(ThreadRWLock *lock)
+  { return pthread_rwlock_unlock(lock); }
+int thread_rwlock_wrunlock(ThreadRWLock *lock)
+  { return pthread_rwlock_unlock(lock); }
+
+int thread_cond_init(ThreadCond *cond)
+  { return pthread_cond_init(cond, NULL); }
+int thread_cond_destroy(ThreadCond *cond)
+  { return pthread_cond_destroy(cond); }
+int thread_cond_wait(ThreadCond *cond, ThreadMutex *mutex)
+  { return pthread_cond_wait(cond, mutex); }
+int thread_cond_timedwait(ThreadCond *cond, ThreadMutex *mutex,
+                          double timeout)
+{
+  struct timespec ts;
+  int stat;
+  if (timeout < 0) timeout = 0;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += (time_t)timeout;
+  ts.tv_nsec += (long)((timeout - (time_t)timeout) * 1e9);
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  stat = pthread_cond_timedwait(cond, mutex, &ts);
+  return (stat == ETIMEDOUT) ? 0 : stat;
+}
+int thread_cond_signal(ThreadCond *cond)
+  { return pthread_cond_signal(cond); }
+int thread_cond_broadcast(ThreadCond *cond)
+  { return pthread_cond_broadcast(cond); }
+
+
+#elif defined(_WIN32)
+
+/* Trampoline matching the signature expected by CreateThread() */
+typedef struct {
+  ThreadFunc func;
+  void *arg;
+} ThreadStart;
+
+static DWORD WINAPI thread_start(LPVOID param)
+{
+  ThreadStart start = *(ThreadStart *)param;
+  free(param);
+  start.func(start.arg);
+  return 0;
+}
+
+int thread_create(Thread *thread, ThreadFunc func, void *arg)
+{
+  ThreadStart *start;
+  if (!(start = malloc(sizeof(ThreadStart)))) return 1;
+  start->func = func;
+  start->arg = arg;
+  if (!(*thread = CreateThread(NULL, 0, thread_start, start, 0, NULL))) {
+    free(start);
+    return 1;
+  }
+  return 0;
+}
+
+int thread_join(Thread thread, void **retval)
+{
+  if (retval) *retval = NULL;
+  if (WaitForSingleObject(thread, INFINITE) != WAIT_OBJECT_0) return 1;
+  CloseHandle(thread);
+  return 0;
+}
+
+int thread_ncpus(void)
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (info.dwNumberOfProcessors > 0) ? (int)info.dwNumberOfProcessors : 1;
+}
+
+int thread_mutex_init(ThreadMutex *mutex)
+  { InitializeSRWLock(mutex); return 0; }
+int thread_mutex_destroy(ThreadMutex *mutex)
+  { (void)mutex; return 0; }
+int thread_mutex_lock(ThreadMutex *mutex)
+  { AcquireSRWLockExclusive(mutex); return 0; }
+int thread_mutex_unlock(ThreadMutex *mutex)
+  { ReleaseSRWLockExclusive(mutex); return 0; }
+
+int thread_rwlock_init(ThreadRWLock *lock)
+  { InitializeSRWLock(lock); return 0; }
+int thread_rwlock_destroy(ThreadRWLock *lock)
+  { (void)lock; return 0; }
+int thread_rwlock_rdlock(ThreadRWLock *lock)
+  { AcquireSRWLockShared(lock); return 0; }
+int thread_rwlock_wrlock(ThreadRWLock *lock)
+  { AcquireSRWLockExclusive(lock); return 0; }
+int thread_rwlock_rdunlock(ThreadRWLock *lock)
+  { ReleaseSRWLockShared(lock); return 0; }
+int thread_rwlock_wrunlock(ThreadRWLock *lock)
+  { ReleaseSRWLockExclusive(lock); return 0; }
+
+int thread_cond_init(ThreadCond *cond)
+  { InitializeConditionVariable(cond); return 0; }
+int thread_cond_destroy(ThreadCond *cond)
+  { (void)cond; return 0; }
+int thread_cond_wait(ThreadCond *cond, ThreadMutex *mutex)
+  { return (SleepConditionVariableSRW(cond, mutex, INFINITE, 0)) ? 0 : 1; }
+int thread_cond_timedwait(ThreadCond *cond, ThreadMutex *mutex,
+                          double timeout)
+{
+  DWORD ms = (timeout > 0) ? (DWORD)(timeout * 1000) : 0;
+  if (SleepConditionVariableSRW(cond, mutex, ms, 0)) return 0;
+  return (GetLastError() == ERROR_TIMEOUT) ? 0 : 1;
+}
+int thread_cond_signal(ThreadCond *cond)
+  { WakeConditionVariable(cond); return 0; }
+int thread_cond_broadcast(ThreadCond *cond)
+  { WakeAllConditionVariable(cond); return 0; }
+
+
+#else  /* no thread support */
+
+int thread_create(Thread *thread, ThreadFunc func, void *arg)
+  { (void)thread; (void)func; (void)arg; return 1; }
+int thread_join(Thread thread, void **retval)
+  { (void)thread; if (retval) *retval = NULL; return 1; }
+int thread_ncpus(void) { return 1; }
+
+int thread_mutex_init(ThreadMutex *mutex) { (void)mutex; return 0; }
+int thread_mutex_destroy(ThreadMutex *mutex) { (void)mutex; return 0; }
+int thread_mutex_lock(ThreadMutex *mutex) { (void)mutex; return 0; }
+int thread_mutex_unlock(ThreadMutex *mutex) { (void)mutex; return 0; }
+
+int thread_rwlock_init(ThreadRWLock *lock) { (void)lock; return 0; }
+int thread_rwlock_destroy(ThreadRWLock *lock) { (void)lock; return 0; }
+int thread_rwlock_rdlock(ThreadRWLock *lock) { (void)lock; return 0; }
+int thread_rwlock_wrlock(ThreadRWLock *lock) { (void)lock; return 0; }
+int thread_rwlock_rdunlock(ThreadRWLock *lock) { (void)lock; return 0; }
+int thread_rwlock_wrunlock(ThreadRWLock *lock) { (void)lock; return 0; }
+
+int thread_cond_init(ThreadCond *cond) { (void)cond; return 0; }
+int thread_cond_destroy(ThreadCond *cond) { (void)cond; return 0; }
+int thread_cond_wait(ThreadCond *cond, ThreadMutex *mutex)
+  { (void)cond; (void)mutex; return 1; }
+int thread_cond_timedwait(ThreadCond *cond, ThreadMutex *mutex,
+                          double timeout)
+  { (void)cond; (void)mutex; (void)timeout; return 1; }
+int thread_cond_signal(ThreadCond *cond) { (void)cond; return 0; }
+int thread_cond_broadcast(ThreadCond *cond) { (void)cond; return 0; }
+
+#endif
@@ -0,0 +1,242 @@
+/* thread.h -- thin portable layer over threads, locks and atomics
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#ifndef _THREAD_H
+#define _THREAD_H
+
+/**
+  @file
+  @brief Thin portable layer over threads, locks and atomic operations.
+
+  Uses POSIX threads if available, otherwise the native Windows API.
+  If neither is available, all locks are no-ops, thread_create()
+  fails and the atomic operations falls back to plain integer
+  arithmetics.  This allows code to be written thread-safe without
+  requiring thread support on the target.
+
+  All functions returning `int` return zero on success and non-zero on
+  error, unless otherwise documented.
+ */
+
+#include <stdint.h>
+
+#include "config.h"
+
+#if defined(HAVE_PTHREADS)
+# include <pthread.h>
+#elif defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+
+/** @cond private */
+#if defined(HAVE_PTHREADS)
+typedef pthread_mutex_t  ThreadMutex;
+typedef pthread_rwlock_t ThreadRWLock;
+typedef pthread_cond_t   ThreadCond;
+typedef pthread_t        Thread;
+# define THREAD_MUTEX_INITIALIZER  PTHREAD_MUTEX_INITIALIZER
+# define THREAD_RWLOCK_INITIALIZER PTHREAD_RWLOCK_INITIALIZER
+# define THREAD_COND_INITIALIZER   PTHREAD_COND_INITIALIZER
+#elif defined(_WIN32)
+typedef SRWLOCK          ThreadMutex;
+typedef SRWLOCK          ThreadRWLock;
+typedef CONDITION_VARIABLE ThreadCond;
+typedef HANDLE           Thread;
+# define THREAD_MUTEX_INITIALIZER  SRWLOCK_INIT
+# define THREAD_RWLOCK_INITIALIZER SRWLOCK_INIT
+# define THREAD_COND_INITIALIZER   CONDITION_VARIABLE_INIT
+#else
+typedef int              ThreadMutex;
+typedef int              ThreadRWLock;
+typedef int              ThreadCond;
+typedef int              Thread;
+# define THREAD_MUTEX_INITIALIZER  0
+# define THREAD_RWLOCK_INITIALIZER 0
+# define THREAD_COND_INITIALIZER   0
+#endif
+/** @endcond */
+
+
+/** Prototype for thread functions. */
+typedef void *(*ThreadFunc)(void *arg);
+
+
+/**
+  @name Threads
+  @{
+ */
+
+/**
+  Starts a new thread running `func(arg)` and store its handle in `thread`.
+ */
+int thread_create(Thread *thread, ThreadFunc func, void *arg);
+
+/**
+  Waits for `thread` to finish.  If `retval` is not NULL, the value
+  returned by the thread function is stored in it.
+ */
+int thread_join(Thread thread, void **retval);
+
+/**
+  Returns number of online processors, or 1 if it cannot be determined.
+ */
+int thread_ncpus(void);
+
+/** @} */
+
+
+/**
+  @name Mutexes
+  Statically allocated mutexes may be initialised with
+  THREAD_MUTEX_INITIALIZER instead of calling thread_mutex_init().
+  @{
+ */
+int thread_mutex_init(ThreadMutex *mutex);
+int thread_mutex_destroy(ThreadMutex *mutex);
+int thread_mutex_lock(ThreadMutex *mutex);
+int thread_mutex_unlock(ThreadMutex *mutex);
+/** @} */
+
+
+/**
+  @name Read-write locks
+  Statically allocated locks may be initialised with
+  THREAD_RWLOCK_INITIALIZER instead of calling thread_rwlock_init().
+
+  Since not all platforms can tell a read lock from a write lock, a
+  lock must be released with the unlock function corresponding to
+  how it was acquired.
+  @{
+ */
+int thread_rwlock_init(ThreadRWLock *lock);
+int thread_rwlock_destroy(ThreadRWLock *lock);
+int thread_rwlock_rdlock(ThreadRWLock *lock);
+int thread_rwlock_wrlock(ThreadRWLock *lock);
+int thread_rwlock_rdunlock(ThreadRWLock *lock);
+int thread_rwlock_wrunlock(ThreadRWLock *lock);
+/** @} */
+
+
+/**
+  @name Condition variables
+  Statically allocated condition variables may be initialised with
+  THREAD_COND_INITIALIZER instead of calling thread_cond_init().
+
+  thread_cond_wait() atomically releases `mutex`, which must be locked
+  by the calling thread, and waits for `cond` to be signalled.  The
+  mutex is locked again before it returns.  Since wakeups may be
+  spurious, the waited-for condition should be checked in a loop.
+
+  thread_cond_timedwait() is like thread_cond_wait(), but returns
+  after at most `timeout` seconds.  It returns zero both when it is
+  signalled and when it times out, so the caller should check the
+  clock.
+
+  Without thread support, thread_cond_wait() and thread_cond_timedwait()
+  fail, since there is nobody to signal the condition.
+  @{
+ */
+int thread_cond_init(ThreadCond *cond);
+int thread_cond_destroy(ThreadCond *cond);
+int thread_cond_wait(ThreadCond *cond, ThreadMutex *mutex);
+int thread_cond_timedwait(ThreadCond *cond, ThreadMutex *mutex,
+                          double timeout);
+int thread_cond_signal(ThreadCond *cond);
+int thread_cond_broadcast(ThreadCond *cond);
+/** @} */
+
+
+/**
+  @name Atomic operations on int
+  @{
+ */
+#if defined(__GNUC__) || defined(__clang__)
+
+/** Atomically adds `n` to `*ptr` and returns the new value. */
+#define thread_atomic_add(ptr, n) \
+  __atomic_add_fetch((ptr), (n), __ATOMIC_ACQ_REL)
+
+/** Atomically loads and returns `*ptr`. */
+#define thread_atomic_load(ptr) \
+  __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+
+/** If `*ptr` equals `expected`, atomically set it to `desired`.
+    Returns non-zero if `*ptr` was updated. */
+#define thread_atomic_cas(ptr, expected, desired)                       \
+  __extension__ ({ int _exp = (expected);                               \
+      __atomic_compare_exchange_n((ptr), &_exp, (desired), 0,           \
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); })
+
+/** Full memory barrier. */
+#define thread_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#elif defined(_WIN32)
+
+#define thread_atomic_add(ptr, n) \
+  (InterlockedExchangeAdd((volatile LONG *)(ptr), (n)) + (n))
+#define thread_atomic_load(ptr) \
+  InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0)
+#define thread_atomic_cas(ptr, expected, desired)                       \
+  (InterlockedCompareExchange((volatile LONG *)(ptr), (desired),        \
+                              (expected)) == (expected))
+#define thread_atomic_fence() MemoryBarrier()
+
+#else
+
+#define thread_atomic_add(ptr, n) (*(ptr) += (n))
+#define thread_atomic_load(ptr) (*(ptr))
+#define thread_atomic_cas(ptr, expected, desired) \
+  ((*(ptr) == (expected)) ? (*(ptr) = (desired), 1) : 0)
+#define thread_atomic_fence() ((void)0)
+
+#endif
+/** @} */
+
+
+/**
+  @name Atomic counters
+  Operations on `int64_t` counters.  Unlike the operations on int,
+  these impose no memory ordering, so they are only suitable for
+  statistics and similar counters that are not used for
+  synchronisation.
+  @{
+ */
+#if defined(__GNUC__) || defined(__clang__)
+
+/** Atomically adds `n` to the counter `*ptr` and returns the new value. */
+#define thread_counter_add(ptr, n) \
+  __atomic_add_fetch((ptr), (int64_t)(n), __ATOMIC_RELAXED)
+
+/** Atomically loads and returns the counter `*ptr`. */
+#define thread_counter_load(ptr) \
+  __atomic_load_n((ptr), __ATOMIC_RELAXED)
+
+/** Atomically sets the counter `*ptr` to `n`. */
+#define thread_counter_store(ptr, n) \
+  __atomic_store_n((ptr), (int64_t)(n), __ATOMIC_RELAXED)
+
+#elif defined(_WIN32)
+
+#define thread_counter_add(ptr, n) \
+  (InterlockedExchangeAdd64((volatile LONG64 *)(ptr), (n)) + (n))
+#define thread_counter_load(ptr) \
+  InterlockedCompareExchange64((volatile LONG64 *)(ptr), 0, 0)
+#define thread_counter_store(ptr, n) \
+  ((void)InterlockedExchange64((volatile LONG64 *)(ptr), (n)))
+
+#else
+
+#define thread_counter_add(ptr, n) (*(ptr) += (n))
+#define thread_counter_load(ptr) (*(ptr))
+#define thread_counter_store(ptr, n) ((void)(*(ptr) = (n)))
+
+#endif
+/** @} */
+
+
+#endif /* _THREAD_H */
@@ -0,0 +1,243 @@
+/* trace.c -- lightweight tracing of spans
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "err.h"
+#include "thread.h"
+#include "trace.h"
+
+
+/* A recorded span */
+typedef struct {
+  const char *name;
+  uint64_t start;
+  uint64_t duration;
+  char detail[TRACE_DETAIL_SIZE];
+} TraceEvent;
+
+/* Ring buffer with the spans recorded by one thread.  Buffers are
+   never freed, since threads keep a pointer to their buffer. */
+typedef struct _TraceBuffer {
+  int tid;                      /* thread number, starting from 1 */
+  uint64_t count;               /* total number of recorded spans */
+  TraceEvent events[TRACE_BUFSIZE];
+  struct _TraceBuffer *next;    /* next buffer */
+} TraceBuffer;
+
+
+static int trace_on = 0;               /* whether tracing is enabled */
+static uint64_t trace_epoch = 0;       /* time tracing was first enabled */
+static char *trace_filename = NULL;    /* file to write at exit */
+static TraceBuffer *buffers = NULL;    /* linked list of all buffers */
+static int nbuffers = 0;               /* number of buffers */
+static ThreadMutex mutex = THREAD_MUTEX_INITIALIZER;
+
+/* Buffer of the current thread */
+static _thread_local TraceBuffer *buffer = NULL;
+
+
+/* Returns a new buffer for the current thread or NULL on error. */
+static TraceBuffer *new_buffer(void)
+{
+  TraceBuffer *b;
+  if (!(b = calloc(1, sizeof(TraceBuffer))))
+    return err(1, "allocation failure"), NULL;
+  thread_mutex_lock(&mutex);
+  b->tid = ++nbuffers;
+  b->next = buffers;
+  buffers = b;
+  thread_mutex_unlock(&mutex);
+  return b;
+}
+
+/* Writes `s` as a quoted JSON string to `fp`. */
+static void write_string(FILE *fp, const char *s)
+{
+  fputc('"', fp);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(fp, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      fprintf(fp, "\\u%04x", (unsigned char)*s);
+    else
+      fputc(*s, fp);
+  }
+  fputc('"', fp);
+}
+
+/* Writes the trace at exit. */
+static void write_atexit(void)
+{
+  if (trace_filename) trace_write(trace_filename);
+  free(trace_filename);
+  trace_filename = NULL;
+}
+
+
+/*
+  Enables tracing.  If `filename` is not NULL, the recorded spans are
+  written to this file with trace_write() at exit.
+ */
+int trace_enable(const char *filename)
+{
+#ifdef WITH_TRACE
+  static int atexit_registered = 0;
+  int retval = 0;
+  thread_mutex_lock(&mutex);
+  if (!trace_epoch) trace_epoch = trace_now();
+  if (filename) {
+    free(trace_filename);
+    if (!(trace_filename = strdup(filename)))
+      retval = err(1, "allocation failure");
+    if (!atexit_registered) {
+      atexit(write_atexit);
+      atexit_registered = 1;
+    }
+  }
+  trace_on = 1;
+  thread_mutex_unlock(&mutex);
+  return retval;
+#else
+  (void)filename;
+  (void)write_atexit;
+  return errx(1, "tracing is not supported.  Compile with WITH_TRACE");
+#endif
+}
+
+/*
+  Disables tracing.  Already recorded spans are kept.
+ */
+void trace_disable(void)
+{
+  trace_on = 0;
+}
+
+/*
+  Returns non-zero if tracing is enabled.
+ */
+int trace_enabled(void)
+{
+  return trace_on;
+}
+
+/*
+  Discards all recorded spans.
+ */
+void trace_clear(void)
+{
+  TraceBuffer *b;
+  thread_mutex_lock(&mutex);
+  for (b=buffers; b; b=b->next) b->count = 0;
+  thread_mutex_unlock(&mutex);
+}
+
+/*
+  Writes all recorded spans to `filename` in Chrome trace event
+  format.
+
+  Returns the number of written spans or -1 on error.
+ */
+int trace_write(const char *filename)
+{
+  FILE *fp;
+  TraceBuffer *b;
+  uint64_t i, n;
+  int nspans=0;
+  if (!(fp = fopen(filename, "w")))
+    return err(-1, "cannot open trace file: %s", filename);
+  fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+  thread_mutex_lock(&mutex);
+  for (b=buffers; b; b=b->next) {
+    n = (b->count < TRACE_BUFSIZE) ? b->count : TRACE_BUFSIZE;
+    for (i=b->count - n; i < b->count; i++) {
+      const TraceEvent *ev = b->events + i % TRACE_BUFSIZE;
+      fprintf(fp, "%s\n  {\"name\": ", (nspans) ? "," : "");
+      write_string(fp, ev->name);
+      fprintf(fp, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+              "\"ts\": %.3f, \"dur\": %.3f", b->tid,
+              (ev->start - trace_epoch) / 1000.0, ev->duration / 1000.0);
+      if (ev->detail[0]) {
+        fprintf(fp, ", \"args\": {\"detail\": ");
+        write_string(fp, ev->detail);
+        fprintf(fp, "}");
+      }
+      fprintf(fp, "}");
+      nspans++;
+    }
+  }
+  thread_mutex_unlock(&mutex);
+  fprintf(fp, "\n]}\n");
+  if (fclose(fp))
+    return err(-1, "cannot write trace file: %s", filename);
+  return nspans;
+}
+
+/*
+  Returns the current value of a monotonic clock in nanoseconds.
+ */
+uint64_t trace_now(void)
+{
+#if defined(_WIN32)
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER t;
+  if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  return (uint64_t)(t.QuadPart * (1e9 / freq.QuadPart));
+#elif defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#else
+  return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+
+/*
+  Starts timing `span`.
+ */
+void trace_begin(TraceSpan *span, const char *name, const char *detail)
+{
+  size_t len=0;
+  if (!trace_on) {
+    span->name = NULL;
+    return;
+  }
+  span->name = name;
+  if (detail) {
+    len = strlen(detail);
+    if (len >= TRACE_DETAIL_SIZE) len = TRACE_DETAIL_SIZE - 1;
+    memcpy(span->detail, detail, len);
+  }
+  span->detail[len] = '\0';
+  span->start = trace_now();
+}
+
+/*
+  Records `span` in the ring buffer of the calling thread.
+ */
+void trace_end(TraceSpan *span)
+{
+  TraceEvent *ev;
+  uint64_t end;
+  if (!span->name) return;
+  end = trace_now();
+  if (!buffer && !(buffer = new_buffer())) return;
+  ev = buffer->events + buffer->count % TRACE_BUFSIZE;
+  ev->name = span->name;
+  ev->start = span->start;
+  ev->duration = end - span->start;
+  strcpy(ev->detail, span->detail);
+  buffer->count++;
+}
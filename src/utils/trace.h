@@ -0,0 +1,127 @@
+/* trace.h -- lightweight tracing of spans
+ *
+ * Copyright (C) 2026 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#ifndef _TRACE_H
+#define _TRACE_H
+
+/**
+  @file
+  @brief Lightweight tracing of the time spent in spans of code.
+
+  A span is a named region of code that is timed with nanosecond
+  resolution:
+
+      TRACE_BEGIN(span, "load", id);
+      ...
+      TRACE_END(span);
+
+  Completed spans are recorded in a ring buffer owned by the calling
+  thread, so recording doesn't require any locking.  When a buffer is
+  full, the oldest spans are overwritten.  The recorded spans can be
+  written with trace_write() in the Chrome trace event format, which
+  can be viewed in chrome://tracing or https://ui.perfetto.dev.
+
+  Tracing is disabled by default.  When disabled, a span costs a
+  function call and a test.  If the library is compiled without
+  `WITH_TRACE`, the macros expand to nothing.
+ */
+
+#include <stdint.h>
+
+#include "config.h"
+
+/** Number of spans in the ring buffer of each thread. */
+#define TRACE_BUFSIZE 4096
+
+/** Size of span detail, including the terminating NUL. */
+#define TRACE_DETAIL_SIZE 48
+
+
+/** A span that is being timed. */
+typedef struct {
+  const char *name;  /*!< Name of span or NULL if tracing is disabled.
+                          Must be a string literal or otherwise outlive
+                          the trace. */
+  uint64_t start;    /*!< Start time in nanoseconds */
+  char detail[TRACE_DETAIL_SIZE];  /*!< Truncated copy of detail */
+} TraceSpan;
+
+
+/**
+  @name Macros for recording spans
+  @{
+ */
+#ifdef WITH_TRACE
+
+/** Declares and starts span `span` with given name.  `detail` is an
+    optional string, like an id or a path, that is stored with the span.
+    It may be NULL. */
+#define TRACE_BEGIN(span, name, detail) \
+  TraceSpan span; trace_begin(&span, name, detail)
+
+/** Ends span `span` and records it. */
+#define TRACE_END(span) trace_end(&span)
+
+#else
+
+#define TRACE_BEGIN(span, name, detail) do {} while (0)
+#define TRACE_END(span) do {} while (0)
+
+#endif
+/** @} */
+
+
+/**
+  Enables tracing.  If `filename` is not NULL, the recorded spans are
+  written to this file with trace_write() at exit.
+
+  Returns non-zero on error, e.g. if the library is compiled without
+  `WITH_TRACE`.
+ */
+int trace_enable(const char *filename);
+
+/**
+  Disables tracing.  Already recorded spans are kept.
+ */
+void trace_disable(void);
+
+/**
+  Returns non-zero if tracing is enabled.
+ */
+int trace_enabled(void);
+
+/**
+  Discards all recorded spans.
+ */
+void trace_clear(void);
+
+/**
+  Writes all recorded spans to `filename` in Chrome trace event
+  format.  The spans should not be recorded concurrently.
+
+  Returns the number of written spans or -1 on error.
+ */
+int trace_write(const char *filename);
+
+/**
+  Returns the current value of a monotonic clock in nanoseconds.
+ */
+uint64_t trace_now(void);
+
+/**
+  Starts timing `span`.  Use the TRACE_BEGIN() macro instead of
+  calling this function directly.
+ */
+void trace_begin(TraceSpan *span, const char *name, const char *detail);
+
+/**
+  Records `span` in the ring buffer of the calling thread.  Use the
+  TRACE_END() macro instead of calling this function directly.
+ */
+void trace_end(TraceSpan *span);
+
+
+#endif /* _TRACE_H */
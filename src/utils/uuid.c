@@ -180,19 +180,34 @@ int uuid_compare(uuid_s *u1, uuid_s *u2)
     return 0;
 }
 
+/* hex_write -- write the `ndigits` lowest hex digits of `v` to `s` */
+static char *hex_write(char *s, unsigned long v, int ndigits)
+{
+  static const char digits[] = "0123456789abcdef";
+  int i;
+  for (i = ndigits - 1; i >= 0; i--, v >>= 4)
+    s[i] = digits[v & 0xf];
+  return s + ndigits;
+}
+
 /* uuid_as_string -- write uuid to string (of length 36+1 bytes) */
 void uuid_as_string(uuid_s *uuid, char s[37])
 {
-  int i, n=0;
-  n += sprintf(s + n, "%8.8x-%4.4x-%4.4x-%2.2x%2.2x-",
-               uuid->time_low, uuid->time_mid,
-               uuid->time_hi_and_version,
-               uuid->clock_seq_hi_and_reserved,
-               uuid->clock_seq_low);
+  char *p = s;
+  int i;
+  p = hex_write(p, uuid->time_low, 8);
+  *p++ = '-';
+  p = hex_write(p, uuid->time_mid, 4);
+  *p++ = '-';
+  p = hex_write(p, uuid->time_hi_and_version, 4);
+  *p++ = '-';
+  p = hex_write(p, uuid->clock_seq_hi_and_reserved, 2);
+  p = hex_write(p, uuid->clock_seq_low, 2);
+  *p++ = '-';
   for (i = 0; i < 6; i++)
-    n += sprintf(s + n, "%2.2x", uuid->node[i]);
-  assert(n == 36);
-  s[n] = '\0';
+    p = hex_write(p, uuid->node[i], 2);
+  assert(p - s == 36);
+  *p = '\0';
 }
 
 /* uuid_from_string -- set uuid from string s. Returns non-zero if s
@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #ifdef HAVE_STDINT_H
@@ -19,11 +20,19 @@
 #include <wincrypt.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define UUID4_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "config.h"
 #include "uuid4.h"
 
 
-static int seeded = 0;
-static uint64_t seed[2];
+/* The generator state is thread-local, such that uuid4_generate() can
+   be called concurrently from several threads. */
+static _thread_local int seeded = 0;
+static _thread_local uint64_t seed[2];
 
 
 static uint64_t xorshift128plus(uint64_t *s) {
@@ -118,13 +127,8 @@ static int init_seed(void) {
 }
 
 
-int uuid4_generate(char *dst) {
-  static const char *template = "xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx";
-  static const char *chars = "0123456789abcdef";
-  union { unsigned char b[16]; uint64_t word[2]; } s;
-  const char *p;
-  int i, n;
-  /* seed? */
+/* Seeds the generator of the current thread if it is not already seeded. */
+static int ensure_seeded(void) {
   if (!seeded) {
     do {
       int err = init_seed();
@@ -134,23 +138,88 @@ int uuid4_generate(char *dst) {
     } while (seed[0] == 0 && seed[1] == 0);
     seeded = 1;
   }
-  /* get random */
+  return UUID4_ESUCCESS;
+}
+
+
+/* Writes the 16 random bytes `b` as a NUL-terminated version 4 UUID
+   string to `dst`.  The nibbles are written in the same order as the
+   original template-based implementation: low nibble first. */
+static void format_uuid4(char *dst, unsigned char *b) {
+  char hex[32];
+  /* set version (4) and variant (10xx) nibbles */
+  b[6] = (b[6] & 0xf0) | 0x04;
+  b[8] = (b[8] & 0xf3) | 0x08;
+#if defined(UUID4_SSE2)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)b);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i lo = _mm_and_si128(v, mask);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    __m128i a = _mm_unpacklo_epi8(lo, hi);
+    __m128i c = _mm_unpackhi_epi8(lo, hi);
+    __m128i nine = _mm_set1_epi8(9);
+    __m128i zero = _mm_set1_epi8('0');
+    __m128i alpha = _mm_set1_epi8('a' - '0' - 10);
+    a = _mm_add_epi8(_mm_add_epi8(a, zero),
+                     _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+    c = _mm_add_epi8(_mm_add_epi8(c, zero),
+                     _mm_and_si128(_mm_cmpgt_epi8(c, nine), alpha));
+    _mm_storeu_si128((__m128i *)hex, a);
+    _mm_storeu_si128((__m128i *)(hex + 16), c);
+  }
+#else
+  {
+    static const char *chars = "0123456789abcdef";
+    int i;
+    for (i=0; i<16; i++) {
+      hex[2*i] = chars[b[i] & 0xf];
+      hex[2*i+1] = chars[b[i] >> 4];
+    }
+  }
+#endif
+  memcpy(dst, hex, 8);
+  dst[8] = '-';
+  memcpy(dst + 9, hex + 8, 4);
+  dst[13] = '-';
+  memcpy(dst + 14, hex + 12, 4);
+  dst[18] = '-';
+  memcpy(dst + 19, hex + 16, 4);
+  dst[23] = '-';
+  memcpy(dst + 24, hex + 20, 12);
+  dst[36] = '\0';
+}
+
+
+int uuid4_generate(char *dst) {
+  union { unsigned char b[16]; uint64_t word[2]; } s;
+  int err;
+  if ((err = ensure_seeded()) != UUID4_ESUCCESS) return err;
   s.word[0] = xorshift128plus(seed);
   s.word[1] = xorshift128plus(seed);
-  /* build string */
-  p = template;
-  i = 0;
-  while (*p) {
-    n = s.b[i >> 1];
-    n = (i & 1) ? (n >> 4) : (n & 0xf);
-    switch (*p) {
-      case 'x'  : *dst = chars[n];              i++;  break;
-      case 'y'  : *dst = chars[(n & 0x3) + 8];  i++;  break;
-      default   : *dst = *p;
-    }
-    dst++, p++;
+  format_uuid4(dst, s.b);
+  return UUID4_ESUCCESS;
+}
+
+
+int uuid4_generate_many(char *dst, size_t n, size_t stride) {
+  union { unsigned char b[16]; uint64_t word[2]; } s;
+  uint64_t state[2];
+  size_t i;
+  int err;
+  if (stride == 0) stride = UUID4_LEN;
+  if (stride < UUID4_LEN) return UUID4_EFAILURE;
+  if ((err = ensure_seeded()) != UUID4_ESUCCESS) return err;
+  /* work on a local copy of the thread-local state, such that it can
+     be kept in registers */
+  state[0] = seed[0];
+  state[1] = seed[1];
+  for (i=0; i<n; i++, dst+=stride) {
+    s.word[0] = xorshift128plus(state);
+    s.word[1] = xorshift128plus(state);
+    format_uuid4(dst, s.b);
   }
-  *dst = '\0';
-  /* return ok */
+  seed[0] = state[0];
+  seed[1] = state[1];
   return UUID4_ESUCCESS;
 }
@@ -16,6 +16,16 @@ enum {
   UUID4_EFAILURE = -1
 };
 
+#include <stddef.h>
+
 int uuid4_generate(char *dst);
 
+/* Writes `n` NUL-terminated random UUIDs to `dst`, each starting
+ * `stride` bytes after the previous one.  If `stride` is zero, the
+ * UUIDs are packed with UUID4_LEN bytes each.  This is faster than
+ * calling uuid4_generate() `n` times.
+ *
+ * Returns UUID4_ESUCCESS on success, UUID4_EFAILURE on error. */
+int uuid4_generate_many(char *dst, size_t n, size_t stride);
+
 #endif
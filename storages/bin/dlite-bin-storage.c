@@ -0,0 +1,1333 @@
+/* dlite-bin-storage.c -- DLite plugin for a native, memory-mapped
+ * binary format
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+  File layout
+  -----------
+  All integers are 64-bit and stored in native byte order.  A file
+  written on a machine with another byte order is rejected.
+
+    BinHeader                           (file offset 0)
+    record 1                            (file offset aligned to BIN_ALIGN)
+    record 2
+    ...
+    BinIndexEntry[ninstances]           (at BinHeader.index)
+
+  Each record is a binary record as documented in dlite-binrecord.h,
+  which mirrors the in-memory layout of the instance.  Records hold
+  CRC-32C checksums of their property data, which are verified when
+  an instance is loaded, unless the `verify` option is false.
+
+  When loading, the file is memory-mapped (copy-on-write) and arrays of
+  non-allocated types in data instances are adopted by the instance
+  directly from the mapping.  The mapping is kept alive until the
+  storage is closed and all adopted arrays are released.
+
+  Versions
+  --------
+  With the `versioned` option, saving an instance that already is in
+  the file appends a version record instead of a full copy.  A
+  version record starts with a BinDelta header linking to the record
+  of the previous version.  It is either a keyframe, where a full
+  record follows the header, or a delta holding only the chunks of
+  non-allocated property data that changed since the previous version:
+
+    BinDelta                            (record offset 0)
+    BinChunk[nchunks]                   changed chunks
+    chunk data                          aligned to 8 bytes
+
+  Chunks of float properties may be stored XOR'ed with the previous
+  version and byte-shuffled, which compresses well when the file is
+  compressed (e.g. with the `compress=gzip` storage option).
+
+  The index always refers to the latest version.  Plain records have
+  version 0.  A version is reconstructed by decoding the nearest
+  preceding full record and applying the deltas that follow it.
+  Files with version records are written with BIN_VERSION 2, other
+  files with version 1, such that older readers still can read them.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "config.h"
+
+#ifdef HAVE_MMAP
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include "utils/err.h"
+#include "utils/crc32c.h"
+#include "utils/fileutils.h"
+#include "utils/map.h"
+#include "utils/md5.h"
+#include "utils/strtob.h"
+#include "utils/strutils.h"
+#include "dlite.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-binrecord.h"
+#include "dlite-lossy.h"
+#include "dlite-macros.h"
+
+#define BIN_MAGIC     "DLITEBIN"   /* 8 bytes, not NUL-terminated */
+#define BIN_VERSION   2            /* version of files with versions */
+#define BIN_VERSION_PLAIN 1        /* version of files without versions */
+#define BIN_DELTA_MAGIC "DLITEDLT" /* 8 bytes, not NUL-terminated */
+#define BIN_KEYFRAME  1            /* version record holds a full record */
+#define BIN_XOR       1            /* chunk is XOR'ed with the previous
+                                      version and byte-shuffled */
+#define BIN_BYTEORDER DLITE_BINRECORD_BYTEORDER
+#define BIN_ALIGN     DLITE_BINRECORD_ALIGN  /* alignment of records */
+#define BIN_DIRECT_ALIGN 4096      /* alignment of direct I/O writes */
+
+
+/** File header */
+typedef struct {
+  char magic[8];            /* BIN_MAGIC */
+  uint32_t version;         /* BIN_VERSION */
+  uint32_t byteorder;       /* BIN_BYTEORDER in native byte order */
+  uint64_t ninstances;      /* number of instances */
+  uint64_t index;           /* file offset of index */
+} BinHeader;
+
+/** Entry in the instance index */
+typedef struct {
+  char uuid[DLITE_UUID_LENGTH+1];  /* uuid of instance */
+  char pad[7];
+  uint64_t offset;          /* file offset of record */
+  uint64_t size;            /* size of record */
+} BinIndexEntry;
+
+/** Header of a version record */
+typedef struct {
+  char magic[8];            /* BIN_DELTA_MAGIC */
+  uint64_t size;            /* size of record */
+  uint64_t version;         /* version number */
+  uint64_t parent;          /* file offset of record of previous version */
+  uint64_t parentsize;      /* size of record of previous version */
+  uint64_t flags;           /* BIN_KEYFRAME */
+  uint64_t nchunks;         /* number of changed chunks */
+  uint64_t reserved;
+} BinDelta;
+
+/** A changed chunk of property data in a delta */
+typedef struct {
+  uint64_t prop;            /* property index */
+  uint64_t flags;           /* BIN_XOR */
+  uint64_t offset;          /* byte offset into property data */
+  uint64_t size;            /* size of chunk in bytes */
+  uint64_t data;            /* record offset of chunk data */
+} BinChunk;
+
+/** Copy of the latest saved version of an instance, used to find what
+    changed when it is saved again. */
+typedef struct {
+  uint64_t version;         /* version number */
+  uint64_t offset;          /* file offset of record */
+  uint64_t size;            /* size of record */
+  uint64_t fullsize;        /* size of the latest full record */
+  size_t ndeltas;           /* number of deltas since the full record */
+  size_t ndims;             /* number of dimensions */
+  size_t *dims;             /* dimension sizes */
+  size_t nprops;            /* number of properties */
+  char **data;              /* non-allocated property data, NULL for
+                               allocated types */
+  size_t *nbytes;           /* size of property data */
+  unsigned char (*digests)[16];  /* digests of allocated properties */
+} BinShadow;
+
+typedef map_t(size_t) map_index_t;
+typedef map_t(BinShadow *) map_shadow_t;
+
+/** Storage for the bin backend. */
+typedef struct {
+  DLiteStorage_HEAD
+  FILE *fp;                 /* file to write to, NULL if read-only */
+  FUIOEngine *io;           /* engine for writing large batches */
+  int dfd;                  /* file opened with O_DIRECT, -1 if unused */
+  DLiteRegion *mapping;     /* mapped file, NULL for new files */
+  BinIndexEntry *index;     /* instance index */
+  size_t nindex;            /* number of entries in index */
+  size_t indexsize;         /* allocated size of index */
+  map_index_t uuids;        /* maps uuids to position in index */
+  uint64_t end;             /* file offset of end of last record */
+  int changed;              /* whether the index must be written */
+  int hasversions;          /* whether the file has version records */
+  int versioned;            /* whether to save new versions as deltas */
+  int xor;                  /* whether to XOR float chunks */
+  int verify;               /* whether to verify checksums on load */
+  int64_t version;          /* version to load, -1 for latest */
+  size_t keyframe;          /* max number of deltas between full records */
+  size_t chunksize;         /* chunk size of deltas */
+  map_shadow_t shadows;     /* maps uuids to latest saved versions */
+  DLiteLossy *lossy;        /* tolerances of float properties, NULL if
+                               lossless */
+} BinStorage;
+
+
+/********************************************************************
+ * Reading
+ ********************************************************************/
+
+/* Reads header and index of the mapped file of `s`.  Returns non-zero
+   on error. */
+static int read_index(BinStorage *s)
+{
+  const DLiteRegion *m = s->mapping;
+  BinHeader h;
+  size_t i;
+  if (m->size < sizeof(BinHeader))
+    return errx(1, "not a dlite binary file: %s", s->location);
+  memcpy(&h, m->addr, sizeof(h));
+  if (memcmp(h.magic, BIN_MAGIC, sizeof(h.magic)) != 0)
+    return errx(1, "not a dlite binary file: %s", s->location);
+  if (h.byteorder != BIN_BYTEORDER)
+    return errx(1, "non-native byte order in %s", s->location);
+  if (h.version != BIN_VERSION && h.version != BIN_VERSION_PLAIN)
+    return errx(1, "unsupported version %d of %s", (int)h.version,
+                s->location);
+  s->hasversions = (h.version == BIN_VERSION);
+  /* the index of an empty storage may start after the end of the file,
+     since nothing is written after the header */
+  if ((h.index > m->size && h.ninstances) ||
+      (h.index <= m->size &&
+       h.ninstances > (m->size - h.index) / sizeof(BinIndexEntry)))
+    return errx(1, "corrupted index in %s", s->location);
+  if (h.ninstances) {
+    if (!(s->index = malloc(h.ninstances*sizeof(BinIndexEntry))))
+      return err(1, "allocation failure");
+    memcpy(s->index, m->addr + h.index, h.ninstances*sizeof(BinIndexEntry));
+  }
+  s->nindex = s->indexsize = h.ninstances;
+  s->end = h.index;
+  for (i=0; i < s->nindex; i++) {
+    BinIndexEntry *e = s->index + i;
+    e->uuid[DLITE_UUID_LENGTH] = '\0';
+    if (e->offset > m->size || e->size > m->size - e->offset ||
+        e->size < sizeof(DLiteBinRecord))
+      return errx(1, "corrupted index in %s", s->location);
+    if (map_set(&s->uuids, e->uuid, i))
+      return err(1, "cannot index %s", e->uuid);
+  }
+  return 0;
+}
+
+/* Returns a pointer to the `size` bytes at file offset `offset` of the
+   mapped file of `s`, or NULL if they are not mapped.  `uuid` is the
+   instance the bytes belong to, used in error messages. */
+static const char *get_bytes(const BinStorage *s, const char *uuid,
+                             uint64_t offset, uint64_t size)
+{
+  if (!s->mapping || offset > s->mapping->size ||
+      size > s->mapping->size - offset)
+    return errx(1, "instance %s is not readable from %s",
+                uuid, s->location), NULL;
+  return s->mapping->addr + offset;
+}
+
+/********************************************************************
+ * Versions
+ ********************************************************************/
+
+/** Records needed to reconstruct a version of an instance */
+typedef struct {
+  uint64_t version;         /* version to reconstruct */
+  uint64_t latest;          /* latest version */
+  const DLiteBinRecord *rec;  /* nearest preceding full record */
+  uint64_t recsize;         /* size of `rec` */
+  const BinDelta **deltas;  /* deltas to apply to `rec`, newest first */
+  size_t ndeltas;           /* number of deltas */
+} BinChain;
+
+/* Returns non-zero if `d` is not a consistent version record of at
+   most `size` bytes. */
+static int check_delta(const BinDelta *d, uint64_t size)
+{
+  if (d->size != size || size < sizeof(BinDelta) || d->version == 0)
+    return 1;
+  if (d->flags & BIN_KEYFRAME)
+    return (d->nchunks != 0 || size == sizeof(BinDelta));
+  return (d->nchunks > (size - sizeof(BinDelta)) / sizeof(BinChunk));
+}
+
+/* Frees memory allocated by find_chain(). */
+static void chain_free(BinChain *chain)
+{
+  if (chain->deltas) free(chain->deltas);
+  chain->deltas = NULL;
+}
+
+/*
+  Finds the records needed to reconstruct version `version` (-1 for
+  the latest) of the instance of index entry `e` and stores them in
+  `chain`, which must be freed with chain_free().  The chain is
+  followed backwards from the latest version to the nearest full
+  record preceding the requested version.
+
+  Returns non-zero on error.
+ */
+static int find_chain(const BinStorage *s, const BinIndexEntry *e,
+                      int64_t version, BinChain *chain)
+{
+  uint64_t offset=e->offset, size=e->size;
+  size_t nalloc=0;
+  int first=1;
+
+  memset(chain, 0, sizeof(BinChain));
+  while (1) {
+    const BinDelta *d=NULL;
+    const char *p;
+    uint64_t ver=0;
+    if (!(p = get_bytes(s, e->uuid, offset, size))) goto fail;
+    if (size >= sizeof(BinDelta) &&
+        memcmp(p, BIN_DELTA_MAGIC, sizeof(d->magic)) == 0) {
+      d = (const BinDelta *)p;
+      if (check_delta(d, size))
+        FAIL2("corrupted version record of %s in %s", e->uuid, s->location);
+      ver = d->version;
+    }
+    if (first) {
+      chain->latest = ver;
+      if (version < 0) version = ver;
+      if ((uint64_t)version > ver)
+        FAIL3("no version %lld of %s in %s", (long long)version, e->uuid,
+              s->location);
+      chain->version = version;
+      first = 0;
+    }
+    if (ver <= (uint64_t)version) {
+      if (!d || d->flags & BIN_KEYFRAME) {
+        chain->rec = (const DLiteBinRecord *)((d) ? (const char *)(d+1) : p);
+        chain->recsize = (d) ? size - sizeof(BinDelta) : size;
+        if (dlite_binrecord_check(chain->rec, chain->recsize))
+          FAIL2("corrupted record %s in %s", e->uuid, s->location);
+        return 0;
+      }
+      if (chain->ndeltas >= nalloc) {
+        const BinDelta **ptr;
+        nalloc += 16;
+        if (!(ptr = realloc(chain->deltas, nalloc*sizeof(BinDelta *))))
+          FAIL("allocation failure");
+        chain->deltas = ptr;
+      }
+      chain->deltas[chain->ndeltas++] = d;
+    }
+    if (d->parent >= offset)
+      FAIL2("corrupted version record of %s in %s", e->uuid, s->location);
+    offset = d->parent;
+    size = d->parentsize;
+  }
+ fail:
+  chain_free(chain);
+  return 1;
+}
+
+/* Returns a pointer to the data of property `i` of `inst` and stores
+   its size in bytes in `*nbytes`. */
+static char *prop_data(const DLiteInstance *inst, size_t i, size_t *nbytes)
+{
+  const DLiteProperty *p = inst->meta->_properties + i;
+  char *ptr = DLITE_PROP(inst, i);
+  size_t nmemb=1;
+  int j;
+  if (p->ndims > 0) {
+    for (j=0; j < p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+    ptr = *(char **)ptr;
+  }
+  *nbytes = nmemb * p->size;
+  return ptr;
+}
+
+/* Writes `n` bytes of `a` XOR `b` to `dst`, byte-shuffled for items
+   of size `itemsize`, i.e. the first bytes of all items are followed
+   by the second bytes, etc.  `n` must be a multiple of `itemsize`. */
+static void shuffle_xor(char *dst, const char *a, const char *b, size_t n,
+                        size_t itemsize)
+{
+  size_t j, k, nitems = n / itemsize;
+  for (k=0; k < itemsize; k++)
+    for (j=0; j < nitems; j++)
+      dst[k*nitems + j] = a[j*itemsize + k] ^ b[j*itemsize + k];
+}
+
+/* Inverse of shuffle_xor(): XOR's the `n` byte-shuffled bytes at `src`
+   into `dst`. */
+static void unshuffle_xor(char *dst, const char *src, size_t n,
+                          size_t itemsize)
+{
+  size_t j, k, nitems = n / itemsize;
+  for (k=0; k < itemsize; k++)
+    for (j=0; j < nitems; j++)
+      dst[j*itemsize + k] ^= src[k*nitems + j];
+}
+
+/* Applies delta `d` to the property data of `inst`.  Returns non-zero
+   on error. */
+static int apply_delta(DLiteInstance *inst, const BinDelta *d)
+{
+  const BinChunk *c = (const BinChunk *)(d + 1);
+  size_t k;
+  for (k=0; k < d->nchunks; k++, c++) {
+    const DLiteProperty *p;
+    const char *src = (const char *)d + c->data;
+    char *ptr;
+    size_t nbytes;
+    if (c->prop >= inst->meta->_nproperties ||
+        dlite_type_is_allocated(inst->meta->_properties[c->prop].type))
+      return errx(1, "corrupted delta of %s", inst->uuid);
+    p = inst->meta->_properties + c->prop;
+    ptr = prop_data(inst, c->prop, &nbytes);
+    if (c->offset > nbytes || c->size > nbytes - c->offset ||
+        c->data > d->size || c->size > d->size - c->data ||
+        c->size % p->size)
+      return errx(1, "corrupted delta of %s", inst->uuid);
+    if (c->flags & BIN_XOR)
+      unshuffle_xor(ptr + c->offset, src, c->size, p->size);
+    else
+      memcpy(ptr + c->offset, src, c->size);
+    if (inst->meta->_loadprop) inst->meta->_loadprop(inst, c->prop);
+  }
+  return 0;
+}
+
+/*
+  Returns a new instance reconstructed from `chain`, found for index
+  entry `e` with find_chain().  The instance gets id `id`, or the id
+  stored in the record if `id` is NULL.
+
+  Arrays are adopted from the mapping if no deltas are applied.
+ */
+static DLiteInstance *decode_chain(const BinStorage *s,
+                                   const BinIndexEntry *e,
+                                   const BinChain *chain, const char *id)
+{
+  DLiteInstance *inst;
+  size_t k;
+  int flags = (s->verify) ? 0 : dliteBinRecordNoVerify;
+  if (!(inst = dlite_binrecord_decode_with(chain->rec, e->uuid, id, flags,
+                                           (chain->ndeltas) ? NULL :
+                                           dlite_region_adopt, s->mapping)))
+    return NULL;
+  for (k=chain->ndeltas; k > 0; k--)
+    if (apply_delta(inst, chain->deltas[k-1])) {
+      dlite_instance_decref(inst);
+      return NULL;
+    }
+  return inst;
+}
+
+/*
+  Returns version `version` (-1 for latest) of the instance of index
+  entry `e`.  Older versions are given the id of the instance with
+  "#v<version>" appended, such that they can coexist with the latest
+  version.  Returns NULL on error.
+ */
+static DLiteInstance *load_version(const BinStorage *s,
+                                   const BinIndexEntry *e, int64_t version)
+{
+  DLiteInstance *inst=NULL;
+  BinChain chain;
+  char *id=NULL;
+
+  if (find_chain(s, e, version, &chain)) return NULL;
+  if (chain.version < chain.latest) {
+    int status=0;
+    const char *uri = dlite_binrecord_str(chain.rec, chain.rec->uri, &status);
+    if (!(id = aprintf("%s#v%llu", (uri) ? uri : e->uuid,
+                       (unsigned long long)chain.version))) {
+      err(1, "allocation failure");
+      goto done;
+    }
+  }
+  if (!dlite_instance_has((id) ? id : e->uuid, 0) ||
+      !(inst = dlite_instance_get((id) ? id : e->uuid)))
+    inst = decode_chain(s, e, &chain, id);
+ done:
+  if (id) free(id);
+  chain_free(&chain);
+  return inst;
+}
+
+/* Frees shadow `sh`. */
+static void shadow_free(BinShadow *sh)
+{
+  size_t i;
+  if (!sh) return;
+  if (sh->data) {
+    for (i=0; i < sh->nprops; i++)
+      if (sh->data[i]) free(sh->data[i]);
+    free(sh->data);
+  }
+  if (sh->dims) free(sh->dims);
+  if (sh->nbytes) free(sh->nbytes);
+  if (sh->digests) free(sh->digests);
+  free(sh);
+}
+
+/* Frees all shadows of `s`. */
+static void free_shadows(BinStorage *s)
+{
+  const char *key;
+  map_iter_t iter = map_iter(&s->shadows);
+  while ((key = map_next(&s->shadows, &iter)))
+    shadow_free(*map_get(&s->shadows, key));
+  map_deinit(&s->shadows);
+  map_init(&s->shadows);
+}
+
+/* Adds string `str` to `ctx`.  NULL and "" are distinguished. */
+static void digest_str(MD5_CTX *ctx, const char *str)
+{
+  uint64_t len = (str) ? strlen(str) + 1 : 0;
+  MD5Update(ctx, &len, sizeof(len));
+  if (str) MD5Update(ctx, str, (unsigned long)(len - 1));
+}
+
+/* Writes a digest of property `i` of `inst`, which has an allocated
+   type, to `digest`.  Returns non-zero if the type is not supported. */
+static int digest_prop(const DLiteInstance *inst, size_t i,
+                       unsigned char *digest)
+{
+  const DLiteProperty *p = inst->meta->_properties + i;
+  size_t n, nbytes, nmemb;
+  char *ptr = prop_data(inst, i, &nbytes);
+  MD5_CTX ctx;
+  MD5Init(&ctx);
+  nmemb = nbytes / p->size;
+  for (n=0; n < nmemb; n++) {
+    switch (p->type) {
+    case dliteStringPtr:
+      digest_str(&ctx, ((char **)ptr)[n]);
+      break;
+    case dliteRelation:
+      {
+        DLiteRelation *r = (DLiteRelation *)ptr + n;
+        digest_str(&ctx, r->s);
+        digest_str(&ctx, r->p);
+        digest_str(&ctx, r->o);
+        digest_str(&ctx, r->id);
+      }
+      break;
+    default:
+      return 1;
+    }
+  }
+  MD5Final(digest, &ctx);
+  return 0;
+}
+
+/* Returns a new shadow with a copy of the data of `inst`, or NULL on
+   error.  If `inst` has properties of allocated types that cannot be
+   compared, `*comparable` is set to zero. */
+static BinShadow *shadow_create(const DLiteInstance *inst, int *comparable)
+{
+  BinShadow *sh;
+  size_t i;
+  *comparable = 1;
+  if (!(sh = calloc(1, sizeof(BinShadow)))) goto fail;
+  sh->ndims = inst->meta->_ndimensions;
+  sh->nprops = inst->meta->_nproperties;
+  if (!(sh->dims = calloc(sh->ndims + 1, sizeof(size_t))) ||
+      !(sh->data = calloc(sh->nprops + 1, sizeof(char *))) ||
+      !(sh->nbytes = calloc(sh->nprops + 1, sizeof(size_t))) ||
+      !(sh->digests = calloc(sh->nprops + 1, sizeof(*sh->digests))))
+    goto fail;
+  for (i=0; i < sh->ndims; i++)
+    sh->dims[i] = dlite_instance_get_dimension_size_by_index(inst, i);
+  for (i=0; i < sh->nprops; i++) {
+    const DLiteProperty *p = inst->meta->_properties + i;
+    char *ptr = prop_data(inst, i, &sh->nbytes[i]);
+    if (dlite_type_is_allocated(p->type)) {
+      if (digest_prop(inst, i, sh->digests[i])) *comparable = 0;
+    } else {
+      if (!(sh->data[i] = malloc(sh->nbytes[i] + 1))) goto fail;
+      if (sh->nbytes[i]) memcpy(sh->data[i], ptr, sh->nbytes[i]);
+    }
+  }
+  return sh;
+ fail:
+  shadow_free(sh);
+  return err(1, "allocation failure"), NULL;
+}
+
+/*
+  Assigns `*sh` to the shadow of the latest saved version of `inst`,
+  which is reconstructed from the file if needed.  `*sh` is set to
+  NULL if `inst` is not in the file or cannot be read from it.
+
+  Returns non-zero on error.
+ */
+static int get_shadow(BinStorage *s, const DLiteInstance *inst,
+                      BinShadow **sh)
+{
+  BinShadow **ptr;
+  const BinIndexEntry *e;
+  DLiteInstance *tmp;
+  BinChain chain;
+  size_t *pos;
+  char *id;
+  int comparable;
+
+  *sh = NULL;
+  if ((ptr = map_get(&s->shadows, inst->uuid))) {
+    *sh = *ptr;
+    return 0;
+  }
+  if (!(pos = map_get(&s->uuids, inst->uuid))) return 0;
+  e = s->index + *pos;
+  if (!s->mapping || e->offset + e->size > s->mapping->size) return 0;
+
+  /* reconstruct the latest version as a temporary instance */
+  if (find_chain(s, e, -1, &chain)) return 1;
+  if (!(id = aprintf("%s#shadow", e->uuid))) {
+    chain_free(&chain);
+    return err(1, "allocation failure");
+  }
+  tmp = decode_chain(s, e, &chain, id);
+  free(id);
+  if (!tmp) {
+    chain_free(&chain);
+    return 1;
+  }
+  *sh = shadow_create(tmp, &comparable);
+  dlite_instance_decref(tmp);
+  if (!*sh) {
+    chain_free(&chain);
+    return 1;
+  }
+  (*sh)->version = chain.latest;
+  (*sh)->offset = e->offset;
+  (*sh)->size = e->size;
+  (*sh)->fullsize = chain.recsize;
+  (*sh)->ndeltas = chain.ndeltas;
+  chain_free(&chain);
+  if (!comparable) (*sh)->ndeltas = s->keyframe;  /* force a full record */
+  if (map_set(&s->shadows, inst->uuid, *sh)) {
+    shadow_free(*sh);
+    *sh = NULL;
+    return err(1, "cannot add shadow of %s", inst->uuid);
+  }
+  return 0;
+}
+
+/* Ensures that `*buf` of allocated size `*size` can hold `n` bytes. */
+static int buf_fit(char **buf, size_t *size, size_t n)
+{
+  if (n > *size) {
+    size_t newsize = n + 4096;
+    void *ptr;
+    if (!(ptr = realloc(*buf, newsize))) return err(1, "allocation failure");
+    *buf = ptr;
+    *size = newsize;
+  }
+  return 0;
+}
+
+/*
+  Appends a delta of `inst` relative to shadow `sh` to `*buf` at
+  position `pos`.  See dlite_binrecord_encode() for `buf` and `size`.
+
+  Returns the number of bytes appended, zero if a full record should
+  be written instead or a negative value on error.
+ */
+static int encode_delta(const BinStorage *s, char **buf, size_t *size,
+                        size_t pos, const DLiteInstance *inst,
+                        const BinShadow *sh)
+{
+  BinChunk *chunks=NULL;
+  BinDelta *d;
+  size_t i, n, nchunks=0, nalloc=0, total=0, datapos;
+  int retval=-1;
+
+  if (sh->ndeltas >= s->keyframe) return 0;
+  if (sh->ndims != inst->meta->_ndimensions ||
+      sh->nprops != inst->meta->_nproperties) return 0;
+  for (i=0; i < sh->ndims; i++)
+    if (sh->dims[i] != dlite_instance_get_dimension_size_by_index(inst, i))
+      return 0;
+
+  /* find changed chunks */
+  for (i=0; i < sh->nprops; i++) {
+    const DLiteProperty *p = inst->meta->_properties + i;
+    size_t nbytes, chunksize, offset;
+    const char *ptr = prop_data(inst, i, &nbytes);
+    if (dlite_type_is_allocated(p->type)) {
+      unsigned char digest[16];
+      if (digest_prop(inst, i, digest) ||
+          memcmp(digest, sh->digests[i], sizeof(digest)))
+        goto full;
+      continue;
+    }
+    if (nbytes != sh->nbytes[i]) goto full;
+    chunksize = (s->chunksize / p->size) * p->size;
+    if (chunksize == 0) chunksize = p->size;
+    for (offset=0; offset < nbytes; offset += chunksize) {
+      size_t m = (nbytes - offset < chunksize) ? nbytes - offset : chunksize;
+      if (memcmp(ptr + offset, sh->data[i] + offset, m) == 0) continue;
+      if (nchunks >= nalloc) {
+        void *q;
+        nalloc += 64;
+        if (!(q = realloc(chunks, nalloc*sizeof(BinChunk))))
+          FAIL("allocation failure");
+        chunks = q;
+      }
+      chunks[nchunks].prop = i;
+      chunks[nchunks].flags = (s->xor && p->type == dliteFloat) ? BIN_XOR : 0;
+      chunks[nchunks].offset = offset;
+      chunks[nchunks].size = m;
+      nchunks++;
+      total += align_up(m, 8);
+      if (total > sh->fullsize / 2) goto full;
+    }
+  }
+
+  /* write header, chunk table and chunk data */
+  datapos = sizeof(BinDelta) + nchunks*sizeof(BinChunk);
+  n = align_up(datapos + total, BIN_ALIGN);
+  if (buf_fit(buf, size, pos + n)) goto fail;
+  memset(*buf + pos, 0, n);
+  for (i=0; i < nchunks; i++) {
+    BinChunk *c = chunks + i;
+    size_t nbytes;
+    const char *ptr = prop_data(inst, c->prop, &nbytes) + c->offset;
+    char *dst = *buf + pos + datapos;
+    if (c->flags & BIN_XOR)
+      shuffle_xor(dst, ptr, sh->data[c->prop] + c->offset, c->size,
+                  inst->meta->_properties[c->prop].size);
+    else
+      memcpy(dst, ptr, c->size);
+    c->data = datapos;
+    datapos += align_up(c->size, 8);
+  }
+  d = (BinDelta *)(*buf + pos);
+  memcpy(d->magic, BIN_DELTA_MAGIC, sizeof(d->magic));
+  d->size = n;
+  d->version = sh->version + 1;
+  d->parent = sh->offset;
+  d->parentsize = sh->size;
+  d->flags = 0;
+  d->nchunks = nchunks;
+  if (nchunks)
+    memcpy(d + 1, chunks, nchunks*sizeof(BinChunk));
+  retval = (int)n;
+  goto fail;
+ full:
+  retval = 0;
+ fail:
+  if (chunks) free(chunks);
+  return retval;
+}
+
+/*
+  Appends the next version of data instance `inst` to `*buf` at
+  position `pos`, which will be written to file offset `offset`.  A
+  new instance is written as a plain record, otherwise a delta or a
+  keyframe is written.  The new shadow is stored in `*newsh`.
+
+  Returns the number of bytes appended or a negative value on error.
+ */
+static int encode_version(BinStorage *s, char **buf, size_t *size,
+                          size_t pos, uint64_t offset,
+                          const DLiteInstance *inst, BinShadow **newsh)
+{
+  BinShadow *sh;
+  BinDelta d;
+  int m=0, comparable;
+
+  *newsh = NULL;
+  if (get_shadow(s, inst, &sh)) return -1;
+  if (sh && (m = encode_delta(s, buf, size, pos, inst, sh)) < 0) return -1;
+  if (m == 0 && sh) {
+    /* keyframe */
+    if (buf_fit(buf, size, pos + sizeof(BinDelta))) return -1;
+    if ((m = dlite_binrecord_encode(buf, size, pos + sizeof(BinDelta),
+                                    inst)) < 0) return -1;
+    memset(&d, 0, sizeof(d));
+    memcpy(d.magic, BIN_DELTA_MAGIC, sizeof(d.magic));
+    d.size = sizeof(BinDelta) + m;
+    d.version = sh->version + 1;
+    d.parent = sh->offset;
+    d.parentsize = sh->size;
+    d.flags = BIN_KEYFRAME;
+    memcpy(*buf + pos, &d, sizeof(d));
+    if (!(*newsh = shadow_create(inst, &comparable))) return -1;
+    (*newsh)->fullsize = m;
+    m += sizeof(BinDelta);
+  } else if (m == 0) {
+    /* first version */
+    if ((m = dlite_binrecord_encode(buf, size, pos, inst)) < 0) return -1;
+    if (!(*newsh = shadow_create(inst, &comparable))) return -1;
+    (*newsh)->fullsize = m;
+  } else {
+    /* delta */
+    if (!(*newsh = shadow_create(inst, &comparable))) return -1;
+    (*newsh)->fullsize = sh->fullsize;
+    (*newsh)->ndeltas = sh->ndeltas + 1;
+  }
+  (*newsh)->version = (sh) ? sh->version + 1 : 0;
+  (*newsh)->offset = offset;
+  (*newsh)->size = m;
+  if (!comparable) (*newsh)->ndeltas = s->keyframe;
+  if (sh) s->hasversions = 1;
+  return m;
+}
+
+/********************************************************************
+ * Plugin api
+ ********************************************************************/
+
+/**
+  Opens `uri` as a dlite binary storage.
+
+  Valid `options` are:
+
+  - mode : r | w | a
+      Valid values are:
+      - r   Open existing file for read-only
+      - w   Truncate existing file or create new file
+      - a   Append to existing file or create new file (default)
+  - versioned : bool
+      Whether to save instances already in the file as new versions
+      holding only the changed data.  Default: false
+  - version : int
+      Version of instances to load.  Default: -1 (latest)
+  - keyframe : int
+      Maximum number of deltas between full records.  Default: 16
+  - chunksize : int
+      Granularity in bytes of changes stored in deltas.  Default: 4096
+  - xor : bool
+      Whether to store changed chunks of float properties XOR'ed with
+      the previous version and byte-shuffled.  This only pays off when
+      the file is compressed.  Default: false
+  - verify : bool
+      Whether to verify the checksums of the records of loaded
+      instances.  Only the records that are loaded are verified.  May
+      be turned off for trusted local files.  Default: true
+  - odirect : bool
+      Whether to write records with direct I/O (O_DIRECT), bypassing
+      the page cache.  Useful for checkpointing large amounts of data
+      without evicting the working set of other processes.  Each
+      batch of records then starts at a multiple of BIN_DIRECT_ALIGN
+      bytes.  Ignored with a warning on systems without O_DIRECT.
+      Default: false
+  - abs_tol : tolerance | name:tolerance,...
+      Absolute error tolerance of float properties of saved data
+      instances.  The low mantissa bits of the values are rounded away
+      within the tolerance, such that the file compresses well, e.g.
+      with `compress=gzip`.  See dlite-lossy.h for the format.  Cannot
+      be combined with `versioned`.  Default: lossless
+  - rel_tol : tolerance | name:tolerance,...
+      Relative error tolerance of float properties, like `abs_tol`.
+      Default: lossless
+ */
+DLiteStorage *bin_open(const DLiteStoragePlugin *api, const char *uri,
+                       const char *options)
+{
+  BinStorage *s;
+  DLiteStorage *retval=NULL;
+  FILE *fp;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"r\" (read-only); "
+    "\"w\" (truncate existing storage or create a new one); "
+    "\"a\" (appends to existing storage or creates a new one)";
+  DLiteOpt opts[] = {
+    {'m', "mode", "a", mode_descr},
+    {'v', "versioned", "false", "Whether to save new versions as deltas"},
+    {'V', "version", "-1", "Version to load, -1 for latest"},
+    {'k', "keyframe", "16", "Max number of deltas between full records"},
+    {'c', "chunksize", "4096", "Granularity of deltas in bytes"},
+    {'x', "xor", "false", "Whether to XOR and shuffle float chunks"},
+    {'C', "verify", "true", "Whether to verify checksums on load"},
+    {'D', "odirect", "false", "Whether to write with direct I/O"},
+    {'a', "abs_tol", NULL, "Absolute error tolerance of float properties"},
+    {'r', "rel_tol", NULL, "Relative error tolerance of float properties"},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  char mode;
+  int exists, odirect;
+
+  if (!(s = calloc(1, sizeof(BinStorage)))) FAIL("allocation failure");
+  s->api = api;
+  s->dfd = -1;
+  map_init(&s->uuids);
+  map_init(&s->shadows);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = *opts[0].value;
+  if ((s->versioned = atob(opts[1].value)) < 0)
+    FAIL1("invalid boolean value for `versioned` option: '%s'",
+          opts[1].value);
+  s->version = strtoll(opts[2].value, NULL, 10);
+  s->keyframe = strtoul(opts[3].value, NULL, 10);
+  if ((s->chunksize = strtoul(opts[4].value, NULL, 10)) == 0)
+    FAIL1("`chunksize` option must be positive: '%s'", opts[4].value);
+  if ((s->xor = atob(opts[5].value)) < 0)
+    FAIL1("invalid boolean value for `xor` option: '%s'", opts[5].value);
+  if ((s->verify = atob(opts[6].value)) < 0)
+    FAIL1("invalid boolean value for `verify` option: '%s'", opts[6].value);
+  if ((odirect = atob(opts[7].value)) < 0)
+    FAIL1("invalid boolean value for `odirect` option: '%s'", opts[7].value);
+  if ((opts[8].value && *opts[8].value) || (opts[9].value && *opts[9].value)) {
+    if (s->versioned)
+      FAIL("options `abs_tol` and `rel_tol` cannot be combined with "
+           "`versioned`");
+    if (!(s->lossy = dlite_lossy_create(opts[8].value, opts[9].value)))
+      goto fail;
+  }
+  if ((fp = fopen(uri, "rb"))) fclose(fp);
+  exists = (fp) ? 1 : 0;
+
+  switch (mode) {
+  case 'r':
+    if (!(s->mapping = dlite_region_map_file(uri, BIN_ALIGN))) goto fail;
+    if (read_index(s)) goto fail;
+    break;
+  case 'a':
+    if (exists) {
+      if (!(s->mapping = dlite_region_map_file(uri, BIN_ALIGN))) goto fail;
+      if (read_index(s)) goto fail;
+      if (!(s->fp = fopen(uri, "r+b")))
+        FAIL1("cannot open \"%s\" for writing", uri);
+      s->writable = 1;
+      break;
+    }
+    /* fall through */
+  case 'w':
+    if (!(s->fp = fopen(uri, "w+b"))) FAIL1("cannot create \"%s\"", uri);
+    s->end = align_up(sizeof(BinHeader), BIN_ALIGN);
+    s->writable = 1;
+    s->changed = 1;
+    break;
+  default:
+    FAIL1("invalid \"mode\" value: '%c'. Must be \"r\" (read-only), "
+          "\"w\" (write) or \"a\" (append)", mode);
+  }
+
+  if (odirect && s->writable) {
+#ifdef O_DIRECT
+    if ((s->dfd = open(uri, O_WRONLY | O_DIRECT)) < 0)
+      FAIL1("cannot open \"%s\" for direct I/O", uri);
+#else
+    warnx("direct I/O is not supported on this system, ignoring `odirect` "
+          "option for \"%s\"", uri);
+#endif
+  }
+  retval = (DLiteStorage *)s;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && s) {
+    if (s->fp) fclose(s->fp);
+#ifdef O_DIRECT
+    if (s->dfd >= 0) close(s->dfd);
+#endif
+    if (s->mapping) dlite_region_decref(s->mapping);
+    if (s->index) free(s->index);
+    map_deinit(&s->uuids);
+    map_deinit(&s->shadows);
+    dlite_lossy_free(s->lossy);
+    free(s);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s`, writes the index if it has changed.  Returns
+  non-zero on error.
+ */
+int bin_close(DLiteStorage *s)
+{
+  BinStorage *bs = (BinStorage *)s;
+  int stat=0;
+  if (bs->fp) {
+    if (bs->changed) {
+      BinHeader h;
+      memset(&h, 0, sizeof(h));
+      memcpy(h.magic, BIN_MAGIC, sizeof(h.magic));
+      h.version = (bs->hasversions) ? BIN_VERSION : BIN_VERSION_PLAIN;
+      h.byteorder = BIN_BYTEORDER;
+      h.ninstances = bs->nindex;
+      h.index = bs->end;
+      if (fseek(bs->fp, bs->end, SEEK_SET) ||
+          fwrite(bs->index, sizeof(BinIndexEntry), bs->nindex, bs->fp) !=
+          bs->nindex ||
+          fseek(bs->fp, 0, SEEK_SET) ||
+          fwrite(&h, sizeof(h), 1, bs->fp) != 1)
+        stat = err(1, "error writing index of \"%s\"", s->location);
+#ifdef O_DIRECT
+      /* remove padding of the last direct write after the index */
+      if (bs->dfd >= 0 &&
+          (fflush(bs->fp) ||
+           ftruncate(fileno(bs->fp),
+                     bs->end + bs->nindex*sizeof(BinIndexEntry))))
+        stat = err(1, "error truncating \"%s\"", s->location);
+#endif
+    }
+    if (fclose(bs->fp))
+      stat = err(1, "error closing \"%s\"", s->location);
+  }
+  fu_io_free(bs->io);
+#ifdef O_DIRECT
+  if (bs->dfd >= 0) close(bs->dfd);
+#endif
+  if (bs->mapping) dlite_region_decref(bs->mapping);
+  if (bs->index) free(bs->index);
+  map_deinit(&bs->uuids);
+  free_shadows(bs);
+  map_deinit(&bs->shadows);
+  dlite_lossy_free(bs->lossy);
+  return stat;
+}
+
+
+/**
+  Load instance `id` from storage `s` and return it.  If the `version`
+  option is given, that version of the instance is loaded.
+  NULL is returned on error.
+ */
+DLiteInstance *bin_load(const DLiteStorage *s, const char *id)
+{
+  const BinStorage *bs = (const BinStorage *)s;
+  const BinIndexEntry *e;
+  char uuid[DLITE_UUID_LENGTH+1];
+  size_t *pos;
+
+  /* find record */
+  if (!id || !*id) {
+    if (bs->nindex != 1)
+      return errx(1, "id is required when loading from storage with more "
+                  "or less than one instance: %s", s->location), NULL;
+    e = bs->index;
+  } else {
+    if (dlite_get_uuid(uuid, id) < 0) return NULL;
+    if (!(pos = map_get((map_index_t *)&bs->uuids, uuid)))
+      return errx(1, "no instance with id \"%s\" in storage \"%s\"",
+                  id, s->location), NULL;
+    e = bs->index + *pos;
+  }
+  return load_version(bs, e, bs->version);
+}
+
+
+/* Adds record of size `size` at file offset `offset` for instance
+   `uuid` to the index of `bs`.  An existing record for the same uuid
+   is replaced.  Returns non-zero on error. */
+static int add_index(BinStorage *bs, const char *uuid, uint64_t offset,
+                     uint64_t size)
+{
+  BinIndexEntry *e;
+  size_t *pos;
+  if ((pos = map_get(&bs->uuids, uuid))) {
+    e = bs->index + *pos;
+  } else {
+    if (bs->nindex >= bs->indexsize) {
+      size_t size = bs->indexsize + 64;
+      void *ptr;
+      if (!(ptr = realloc(bs->index, size*sizeof(BinIndexEntry))))
+        return err(1, "allocation failure");
+      bs->index = ptr;
+      bs->indexsize = size;
+    }
+    e = bs->index + bs->nindex;
+    memset(e, 0, sizeof(BinIndexEntry));
+    strncpy(e->uuid, uuid, DLITE_UUID_LENGTH);
+    if (map_set(&bs->uuids, e->uuid, bs->nindex))
+      return err(1, "cannot index %s", uuid);
+    bs->nindex++;
+  }
+  e->offset = offset;
+  e->size = size;
+  bs->changed = 1;
+  return 0;
+}
+
+
+/* Writes the `size` bytes of `buf` to the direct I/O file descriptor
+   of `bs` at `offset`, which must be a multiple of BIN_DIRECT_ALIGN.
+   Direct I/O requires aligned buffers and sizes, hence the data is
+   copied to an aligned buffer padded with zeros.  Returns non-zero on
+   error. */
+static int write_direct(BinStorage *bs, const char *buf, size_t size,
+                        uint64_t offset)
+{
+#ifdef O_DIRECT
+  size_t padded = align_up(size, BIN_DIRECT_ALIGN);
+  void *abuf;
+  int stat;
+  if (!bs->io) bs->io = fu_io_create(0);
+  if (posix_memalign(&abuf, BIN_DIRECT_ALIGN, padded))
+    return err(1, "allocation failure");
+  memcpy(abuf, buf, size);
+  memset((char *)abuf + size, 0, padded - size);
+  stat = fu_io_write(bs->io, bs->dfd, abuf, padded, offset);
+  free(abuf);
+  return stat;
+#else
+  UNUSED(bs);
+  UNUSED(buf);
+  UNUSED(size);
+  UNUSED(offset);
+  return errx(1, "direct I/O is not supported on this system");
+#endif
+}
+
+/* Rounds the float properties of data instance `inst` in record `rec`
+   within the tolerances of `bs` and updates their checksums.  Returns
+   non-zero on error. */
+static int quantize_record(const BinStorage *bs, char *rec,
+                           const DLiteInstance *inst)
+{
+  const DLiteMeta *meta = inst->meta;
+  const DLiteBinRecord *r = (const DLiteBinRecord *)rec;
+  const uint64_t *props;
+  uint32_t *crcs;
+  size_t i;
+  int j;
+  if (!dlite_instance_is_data(inst)) return 0;
+  props = (const uint64_t *)(rec + sizeof(DLiteBinRecord) +
+                             r->ndims*sizeof(uint64_t));
+  crcs = (uint32_t *)(rec + r->checksums);
+  for (i=0; i < meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    double abs_tol, rel_tol;
+    size_t nmemb=1;
+    if (p->type != dliteFloat ||
+        !dlite_lossy_get(bs->lossy, p->name, &abs_tol, &rel_tol)) continue;
+    for (j=0; j < p->ndims; j++) nmemb *= DLITE_PROP_DIM(inst, i, j);
+    if (nmemb == 0) continue;
+    if (dlite_quantize(rec + props[i], p->size, nmemb, abs_tol, rel_tol))
+      return errx(1, "cannot apply tolerances to property \"%s\"", p->name);
+    crcs[i] = crc32c(0, rec + props[i], nmemb*p->size);
+  }
+  return 0;
+}
+
+/**
+  Saves the `n` instances in array `insts` to storage `s` with a
+  single write.  Returns non-zero on error.
+*/
+int bin_save_instances(DLiteStorage *s, const DLiteInstance **insts, size_t n)
+{
+  BinStorage *bs = (BinStorage *)s;
+  BinShadow *sh=NULL, **ptr;
+  char *buf=NULL;
+  size_t i, size=0, pos=0, *offsets=NULL;
+  uint64_t base = (bs->dfd >= 0) ? align_up(bs->end, BIN_DIRECT_ALIGN) :
+    bs->end;
+  int retval=1;
+
+  if (!s->writable)
+    return errx(1, "storage \"%s\" is not writable", s->location);
+  if (!(offsets = malloc((n + 1)*sizeof(size_t)))) FAIL("allocation failure");
+  for (i=0; i<n; i++) {
+    int m;
+    offsets[i] = pos;
+    if (bs->versioned && dlite_instance_is_data(insts[i])) {
+      if ((m = encode_version(bs, &buf, &size, pos, base + pos, insts[i],
+                              &sh)) < 0) goto fail;
+      if ((ptr = map_get(&bs->shadows, insts[i]->uuid))) shadow_free(*ptr);
+      if (map_set(&bs->shadows, insts[i]->uuid, sh))
+        FAIL1("cannot add shadow of %s", insts[i]->uuid);
+      sh = NULL;
+    } else if ((m = dlite_binrecord_encode(&buf, &size, pos, insts[i])) < 0) {
+      goto fail;
+    } else if (bs->lossy && quantize_record(bs, buf + pos, insts[i])) {
+      goto fail;
+    }
+    pos += m;
+  }
+  offsets[n] = pos;
+
+  /* large batches are written in chunks kept in flight together */
+  if (bs->dfd >= 0) {
+    if (write_direct(bs, buf, pos, base))
+      FAIL1("error writing to \"%s\"", s->location);
+  } else {
+    if (pos > 2*FU_IO_CHUNKSIZE && !bs->io) bs->io = fu_io_create(0);
+    if (fflush(bs->fp) || fu_io_write(bs->io, fileno(bs->fp), buf, pos, base))
+      FAIL1("error writing to \"%s\"", s->location);
+  }
+  bs->end = base + pos;
+
+  /* update index, a new record for an existing uuid replaces the old */
+  for (i=0; i<n; i++)
+    if (add_index(bs, insts[i]->uuid, base + offsets[i],
+                  offsets[i+1] - offsets[i])) goto fail;
+  retval = 0;
+ fail:
+  /* shadows must agree with the file, drop them if the write failed */
+  if (retval && bs->versioned) free_shadows(bs);
+  if (sh) shadow_free(sh);
+  if (offsets) free(offsets);
+  if (buf) free(buf);
+  return retval;
+}
+
+
+/**
+  Saves instance `inst` to storage `s`.  Returns non-zero on error.
+*/
+int bin_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  return bin_save_instances(s, &inst, 1);
+}
+
+
+/** Iterator over instances in storage */
+typedef struct {
+  const BinStorage *s;
+  size_t pos;
+  char metauuid[DLITE_UUID_LENGTH+1];
+} BinIter;
+
+/**
+  Creates and returns a new iterator used by bin_iter_next().
+
+  If `metaid` is not NULL, bin_iter_next() will only iterate over
+  instances whos metadata corresponds to this id.
+
+  Returns new iterator or NULL on error.
+ */
+void *bin_iter_create(const DLiteStorage *s, const char *metaid)
+{
+  BinIter *iter;
+  if (!(iter = calloc(1, sizeof(BinIter))))
+    return err(1, "allocation failure"), NULL;
+  iter->s = (const BinStorage *)s;
+  if (metaid && *metaid && dlite_get_uuid(iter->metauuid, metaid) < 0) {
+    free(iter);
+    return NULL;
+  }
+  return iter;
+}
+
+/**
+  Writes the uuid of the next instance to `buf`, where `iter` is an
+  iterator returned by bin_iter_create().
+
+  Returns zero on success, 1 if there are no more UUIDs to iterate
+  over and a negative number on other errors.
+ */
+int bin_iter_next(void *iter, char *buf)
+{
+  BinIter *it = iter;
+  while (it->pos < it->s->nindex) {
+    const BinIndexEntry *e = it->s->index + it->pos++;
+    if (it->metauuid[0]) {
+      BinChain chain;
+      const char *metauri;
+      char uuid[DLITE_UUID_LENGTH+1];
+      int status=0, stat;
+      if (find_chain(it->s, e, -1, &chain)) continue;
+      metauri = dlite_binrecord_str(chain.rec, chain.rec->metauri, &status);
+      stat = (metauri) ? dlite_get_uuid(uuid, metauri) : 0;
+      chain_free(&chain);
+      if (!metauri) continue;
+      if (stat < 0) return -1;
+      if (strcmp(uuid, it->metauuid) != 0) continue;
+    }
+    memcpy(buf, e->uuid, DLITE_UUID_LENGTH+1);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+  Free's iterator created with bin_iter_create().
+ */
+void bin_iter_free(void *iter)
+{
+  free(iter);
+}
+
+
+static DLiteStoragePlugin dlite_bin_plugin = {
+  /* head */
+  "bin",                    /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  bin_open,                 /* open */
+  bin_close,                /* close */
+
+  /* queue api */
+  bin_iter_create,          /* iterCreate */
+  bin_iter_next,            /* iterNext */
+  bin_iter_free,            /* iterFree */
+  NULL,                     /* getUUIDs */
+
+  /* direct api */
+  bin_load,                 /* loadInstance */
+  bin_save,                 /* saveInstance */
+  NULL,                     /* loadInstances */
+  bin_save_instances,       /* saveInstances */
+
+  /* datamodel api */
+  NULL,                     /* dataModel */
+  NULL,                     /* dataModelFree */
+
+  NULL,                     /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  NULL,                     /* getDimensionSize */
+  NULL,                     /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                     /* setMetaURI */
+  NULL,                     /* setDimensionSize */
+  NULL,                     /* setProperty */
+
+  NULL,                     /* hasDimension */
+  NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  NULL,                     /* getDataName, obsolute */
+  NULL,                     /* setDataName, obsolute */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  dliteCapZeroCopy | dliteCapRandomAccess | dliteCapAppendOnly,  /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &dlite_bin_plugin;
+}
@@ -0,0 +1,522 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+
+#include "config.h"
+
+#define NINST 6
+
+
+/* Forward declarations */
+DLiteInstance *bin_load(const DLiteStorage *s, const char *id);
+int bin_save(DLiteStorage *s, const DLiteInstance *inst);
+void *bin_iter_create(const DLiteStorage *s, const char *metaid);
+int bin_iter_next(void *iter, char *buf);
+void bin_iter_free(void *iter);
+
+
+char *ids[NINST] = {
+  "dlite/1/A",
+  "dlite/1/test-c",
+  "dlite/1/empty",
+  "dbd9d597-16b4-58f5-b10f-7e49cf85084b",
+  "2f4ae7b7-247a-5cc2-b6c5-5ac0ccd8cc5c",
+  "data3"
+};
+char uuids[NINST][DLITE_UUID_LENGTH+1];
+char *jsons[NINST];
+DLiteInstance *insts[NINST];
+
+
+/* Frees all instances in `insts`, the metadata (first three) last.
+   Metadata is also referred to by the store. */
+static void free_instances(void)
+{
+  int i;
+  for (i=NINST-1; i>=0; i--) {
+    dlite_instance_decref(insts[i]);
+    if (i < 3) dlite_instance_decref(insts[i]);
+    insts[i] = NULL;
+  }
+}
+
+
+MU_TEST(test_write)
+{
+  char *filename = STRINGIFY(DLITE_ROOT) "/src/tests/test-read-data.json";
+  DLiteStorage *s;
+  int i, stat;
+
+  /* load instances, metadata first */
+  mu_check((s = dlite_storage_open("json", filename, "mode=r")));
+  for (i=0; i<NINST; i++) {
+    mu_check((insts[i] = dlite_instance_load(s, ids[i])));
+    mu_check((jsons[i] = dlite_json_aprint(insts[i], 0, 0)));
+    strcpy(uuids[i], insts[i]->uuid);
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  s = dlite_storage_open("bin", "test-bin-write.bin", "mode=w");
+  mu_check(s);
+  for (i=0; i<NINST; i++) {
+    stat = bin_save(s, insts[i]);
+    mu_assert_int_eq(0, stat);
+  }
+  stat = dlite_storage_close(s);
+  mu_assert_int_eq(0, stat);
+
+  free_instances();
+  for (i=0; i<NINST; i++)
+    mu_check(!dlite_instance_has(uuids[i], 0));
+}
+
+
+MU_TEST(test_read)
+{
+  DLiteStorage *s;
+  void *iter;
+  char uuid[DLITE_UUID_LENGTH+1];
+  int i, r, n=0, nforeign=0;
+
+  s = dlite_storage_open("bin", "test-bin-write.bin", "mode=r");
+  mu_check(s);
+
+  /* instances are iterated in the order they were saved */
+  mu_check((iter = bin_iter_create(s, NULL)));
+  while ((r = bin_iter_next(iter, uuid)) == 0) {
+    mu_assert_string_eq(uuids[n], uuid);
+    mu_check((insts[n] = bin_load(s, uuid)));
+    n++;
+  }
+  mu_assert_int_eq(1, r);
+  mu_assert_int_eq(NINST, n);
+  bin_iter_free(iter);
+
+  /* loading an instance already in the store returns it */
+  mu_check(bin_load(s, uuids[0]) == insts[0]);
+  dlite_instance_decref(insts[0]);
+
+  /* the storage may be closed while arrays are still mapped */
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  for (i=0; i<NINST; i++) {
+    char *json = dlite_json_aprint(insts[i], 0, 0);
+    mu_check(json);
+    mu_assert_string_eq(jsons[i], json);
+    if (insts[i]->_flags & dliteFlagForeign) nforeign++;
+    free(json);
+  }
+  mu_assert_int_eq(2, nforeign);  /* test-a and data3 */
+}
+
+
+MU_TEST(test_many)
+{
+  DLiteStorage *s;
+  DLiteInstance **loaded;
+  const char *uuidp[NINST];
+  int i;
+
+  s = dlite_storage_open("bin", "test-bin-many.bin", "mode=w");
+  mu_check(s);
+  mu_assert_int_eq(0, dlite_instance_save_many(s, (const DLiteInstance **)insts,
+                                               NINST));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  for (i=0; i<NINST; i++) uuidp[i] = uuids[i];
+  s = dlite_storage_open("bin", "test-bin-many.bin", "mode=r");
+  mu_check(s);
+  mu_check((loaded = dlite_instance_load_many(s, uuidp, NINST)));
+  for (i=0; i<NINST; i++) {
+    mu_check(loaded[i] == insts[i]);  /* already in store */
+    dlite_instance_decref(loaded[i]);
+  }
+  free(loaded);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+
+MU_TEST(test_odirect)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  char *json;
+  int i;
+
+  /* direct I/O is not supported by all file systems, e.g. tmpfs */
+  if (!(s = dlite_storage_open("bin", "test-bin-odirect.bin",
+                               "mode=w;odirect=true"))) {
+    dlite_errclr();
+    return;
+  }
+  for (i=0; i<NINST; i++)
+    mu_assert_int_eq(0, dlite_instance_save(s, insts[i]));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  s = dlite_storage_open("bin", "test-bin-odirect.bin", "mode=r");
+  mu_check(s);
+  for (i=0; i<NINST; i++) {
+    mu_check((inst = dlite_instance_load(s, uuids[i])));
+    mu_check((json = dlite_json_aprint(inst, 0, 0)));
+    mu_assert_string_eq(jsons[i], json);
+    free(json);
+    dlite_instance_decref(inst);
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+
+MU_TEST(test_iter_meta)
+{
+  DLiteStorage *s;
+  void *iter;
+  char uuid[DLITE_UUID_LENGTH+1];
+  int n=0;
+
+  s = dlite_storage_open("bin", "test-bin-write.bin", "mode=r");
+  mu_check(s);
+  mu_check((iter = bin_iter_create(s, "dlite/1/A")));
+  while (bin_iter_next(iter, uuid) == 0) n++;
+  bin_iter_free(iter);
+  mu_assert_int_eq(3, n);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+
+MU_TEST(test_append)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  float *p2;
+  int i, n=0;
+  char uuid[DLITE_UUID_LENGTH+1];
+  void *iter;
+
+  /* find data3 and overwrite it with a modified copy */
+  for (i=0; i<NINST; i++)
+    if (dlite_instance_is_data(insts[i]) &&
+        insts[i]->uri && strcmp(insts[i]->uri, "data3") == 0) break;
+  mu_check(i < NINST);
+  inst = insts[i];
+  mu_check((p2 = dlite_instance_get_property(inst, "P2")));
+  mu_assert_double_eq(3.14f, p2[0]);
+
+  /* writing to an adopted array does not change the file */
+  mu_check((p2 = *(float **)DLITE_PROP_RW(inst, 1)));
+  p2[0] = 2.5;
+
+  s = dlite_storage_open("bin", "test-bin-write.bin", "mode=a");
+  mu_check(s);
+  mu_assert_int_eq(dliteCapBatch | dliteCapZeroCopy | dliteCapRandomAccess |
+                   dliteCapAppendOnly, dlite_storage_get_capabilities(s));
+  mu_assert_int_eq(0, bin_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  s = dlite_storage_open("bin", "test-bin-write.bin", "mode=r");
+  mu_check(s);
+  mu_check((iter = bin_iter_create(s, NULL)));
+  while (bin_iter_next(iter, uuid) == 0) n++;
+  bin_iter_free(iter);
+  mu_assert_int_eq(NINST, n);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  free_instances();
+
+  /* reload the metadata and the updated instance */
+  s = dlite_storage_open("bin", "test-bin-write.bin", "mode=r");
+  mu_check(s);
+  mu_check((insts[0] = bin_load(s, "dlite/1/A")));
+  mu_check((inst = bin_load(s, "data3")));
+  mu_check((p2 = dlite_instance_get_property(inst, "P2")));
+  mu_assert_double_eq(2.5, p2[0]);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  dlite_instance_decref(inst);
+  dlite_instance_decref(insts[0]);
+
+  for (i=0; i<NINST; i++) free(jsons[i]);
+}
+
+
+MU_TEST(test_versions)
+{
+  char *filename = STRINGIFY(DLITE_ROOT) "/src/tests/test-read-data.json";
+  DLiteStorage *s;
+  DLiteMeta *meta;
+  DLiteInstance *inst, *v;
+  size_t dims[] = {10000};
+  int i, *p1;
+  float *p2;
+  long fullsize, size;
+  FILE *fp, *old;
+
+  mu_check((s = dlite_storage_open("json", filename, "mode=r")));
+  mu_check((meta = (DLiteMeta *)dlite_instance_load(s, "dlite/1/A")));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_check((inst = dlite_instance_create(meta, dims, "timeseries")));
+  p1 = DLITE_PROP(inst, 0);
+  p2 = *(float **)DLITE_PROP(inst, 1);
+  for (i=0; i<10000; i++) p2[i] = (float)i;
+
+  /* save 5 versions, each changing a single value */
+  s = dlite_storage_open("bin", "test-bin-versions.bin",
+                         "mode=w;versioned=true;keyframe=3");
+  mu_check(s);
+  for (i=0; i<5; i++) {
+    *p1 = i;
+    p2[100*i] = -1.0f;
+    mu_assert_int_eq(0, bin_save(s, inst));
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* versions 1-3 are deltas and version 4 a keyframe */
+  mu_check((fp = fopen("test-bin-versions.bin", "rb")));
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fclose(fp);
+  fullsize = 10000*sizeof(float);
+  mu_check(size > 2*fullsize);
+  mu_check(size < 3*fullsize);
+
+  /* save one more version, appending with XOR'ed chunks */
+  s = dlite_storage_open("bin", "test-bin-versions.bin",
+                         "mode=a;versioned=true;xor=true");
+  mu_check(s);
+  *p1 = 5;
+  p2[500] = -1.0f;
+  mu_assert_int_eq(0, bin_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  dlite_instance_decref(inst);
+
+  /* load each version */
+  for (i=0; i<=5; i++) {
+    char options[32], id[32];
+    int j;
+    snprintf(options, sizeof(options), "mode=r;version=%d", i);
+    mu_check((s = dlite_storage_open("bin", "test-bin-versions.bin",
+                                     options)));
+    mu_check((v = bin_load(s, "timeseries")));
+    if (i < 5) {
+      snprintf(id, sizeof(id), "timeseries#v%d", i);
+      mu_assert_string_eq(id, v->uri);
+    } else {
+      mu_assert_string_eq("timeseries", v->uri);
+    }
+    mu_assert_int_eq(i, *(int *)DLITE_PROP(v, 0));
+    p2 = *(float **)DLITE_PROP(v, 1);
+    for (j=0; j<=5; j++)
+      mu_assert_double_eq((j <= i) ? -1.0 : 100.0*j, p2[100*j]);
+    mu_assert_double_eq(9999.0, p2[9999]);
+    mu_assert_int_eq(0, dlite_storage_close(s));
+    dlite_instance_decref(v);
+  }
+
+  /* a version that does not exist */
+  mu_check((s = dlite_storage_open("bin", "test-bin-versions.bin",
+                                   "mode=r;version=6")));
+  old = dlite_err_get_stream();
+  dlite_err_set_stream(NULL);
+  mu_check(!bin_load(s, "timeseries"));
+  dlite_err_set_stream(old);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  dlite_meta_decref(meta);
+}
+
+
+MU_TEST(test_checksums)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  DLiteProperty properties[] = {
+    {"values", dliteFloat, sizeof(double), 1, dims, "", NULL, "Values."}
+  };
+  DLiteMeta *meta;
+  DLiteInstance *inst;
+  DLiteStorage *s;
+  FILE *fp, *old;
+  size_t i, n, d[] = {100};
+  double *values, v=42.0;
+  char *buf, *p;
+
+  mu_check((meta = dlite_meta_create("http://onto-ns.com/meta/0.1/Crc",
+                                     NULL, "Checksum test.", 1, dimensions,
+                                     1, properties)));
+  mu_check((inst = dlite_instance_create(meta, d, "crc-data")));
+  values = dlite_instance_get_property(inst, "values");
+  for (i=0; i<d[0]; i++) values[i] = v;
+  mu_check((s = dlite_storage_open("bin", "test-bin-crc.bin", "mode=w")));
+  mu_assert_int_eq(0, bin_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  dlite_instance_decref(inst);
+
+  /* flip a bit in the middle of the values */
+  mu_check((fp = fopen("test-bin-crc.bin", "rb")));
+  fseek(fp, 0, SEEK_END);
+  n = ftell(fp);
+  rewind(fp);
+  mu_check((buf = malloc(n)));
+  mu_assert_int_eq(n, fread(buf, 1, n, fp));
+  fclose(fp);
+  for (p=buf; p + sizeof(v) <= buf + n; p++)
+    if (memcmp(p, &v, sizeof(v)) == 0) break;
+  mu_check(p + sizeof(v) <= buf + n);
+  p[50*sizeof(v) + 3] ^= 1;
+  mu_check((fp = fopen("test-bin-crc.bin", "wb")));
+  mu_assert_int_eq(n, fwrite(buf, 1, n, fp));
+  fclose(fp);
+  free(buf);
+
+  /* the corruption is detected on load */
+  mu_check((s = dlite_storage_open("bin", "test-bin-crc.bin", "mode=r")));
+  old = dlite_err_get_stream();
+  dlite_err_set_stream(NULL);
+  mu_check(!bin_load(s, "crc-data"));
+  dlite_err_set_stream(old);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* ...unless verification is turned off */
+  mu_check((s = dlite_storage_open("bin", "test-bin-crc.bin",
+                                   "mode=r;verify=false")));
+  mu_check((inst = bin_load(s, "crc-data")));
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(v, values[49]);
+  mu_check(values[50] != v);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  dlite_instance_decref(inst);
+  dlite_meta_decref(meta);
+}
+
+
+/* Returns the size of file `path`. */
+static long file_size(const char *path)
+{
+  FILE *fp;
+  long n;
+  if (!(fp = fopen(path, "rb"))) return -1;
+  fseek(fp, 0, SEEK_END);
+  n = ftell(fp);
+  fclose(fp);
+  return n;
+}
+
+
+MU_TEST(test_lossy)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {{"N", "Number of values."}};
+  DLiteProperty properties[] = {
+    {"T", dliteFloat, sizeof(double), 1, dims, "K", NULL, "Temperature."},
+    {"p", dliteFloat, sizeof(double), 1, dims, "Pa", NULL, "Pressure."}
+  };
+  DLiteMeta *meta;
+  DLiteInstance *inst;
+  DLiteStorage *s;
+  FILE *old;
+  size_t i, d[] = {20000};
+  double *T, *p, *T2, *p2, x=0.0;
+  long lossless, lossy;
+
+  mu_check((meta = dlite_meta_create("http://onto-ns.com/meta/0.1/Lossy",
+                                     NULL, "Lossy test.", 1, dimensions,
+                                     2, properties)));
+  mu_check((inst = dlite_instance_create(meta, d, "lossy-data")));
+  T = dlite_instance_get_property(inst, "T");
+  p = dlite_instance_get_property(inst, "p");
+  for (i=0; i<d[0]; i++) {
+    x = x*0.9 + (double)((i*2654435761u) % 1000) / 1000.0;
+    T[i] = 300.0 + x;
+    p[i] = 1e5 + 1e3*x;
+  }
+  mu_check((s = dlite_storage_open("bin", "test-bin-lossless.bin",
+                                   "mode=w")));
+  mu_assert_int_eq(0, bin_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_check((s = dlite_storage_open("bin", "test-bin-lossy.bin",
+                                   "mode=w;abs_tol=T:1e-3;rel_tol=1e-6")));
+  mu_assert_int_eq(0, bin_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  dlite_instance_decref(inst);
+
+  /* the loaded values are within the tolerances and checksums match */
+  mu_check((s = dlite_storage_open("bin", "test-bin-lossy.bin", "mode=r")));
+  mu_check((inst = bin_load(s, "lossy-data")));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  T2 = dlite_instance_get_property(inst, "T");
+  p2 = dlite_instance_get_property(inst, "p");
+  x = 0.0;
+  for (i=0; i<d[0]; i++) {
+    double T0, p0, bound;
+    x = x*0.9 + (double)((i*2654435761u) % 1000) / 1000.0;
+    T0 = 300.0 + x;
+    p0 = 1e5 + 1e3*x;
+    bound = (1e-3 > 1e-6*fabs(T0)) ? 1e-3 : 1e-6*fabs(T0);
+    mu_check(fabs(T2[i] - T0) <= bound);
+    mu_check(fabs(p2[i] - p0) <= 1e-6*fabs(p0));
+  }
+  dlite_instance_decref(inst);
+
+#ifdef HAVE_ZLIB
+  /* rounded values compress better */
+  mu_check((s = dlite_storage_open("bin", "test-bin-lossless.bin",
+                                   "mode=r")));
+  mu_check((inst = dlite_instance_load(s, "lossy-data")));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_check((s = dlite_storage_open("bin", "test-bin-lossless.bin.gz",
+                                   "mode=w;compress=gzip")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_check((s = dlite_storage_open("bin", "test-bin-lossy.bin.gz",
+                                   "mode=w;compress=gzip;rel_tol=1e-6")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  dlite_instance_decref(inst);
+  lossless = file_size("test-bin-lossless.bin.gz");
+  lossy = file_size("test-bin-lossy.bin.gz");
+  mu_check(lossy > 0);
+  mu_check(lossy < lossless*3/4);
+#else
+  UNUSED(lossless);
+  UNUSED(lossy);
+#endif
+
+  /* invalid tolerances */
+  old = dlite_err_get_stream();
+  dlite_err_set_stream(NULL);
+  mu_check(!dlite_storage_open("bin", "test-bin-lossy.bin",
+                               "mode=r;abs_tol=-1"));
+  mu_check(!dlite_storage_open("bin", "test-bin-lossy.bin",
+                               "versioned=true;rel_tol=1e-6"));
+  dlite_err_set_stream(old);
+  dlite_meta_decref(meta);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_write);
+  MU_RUN_TEST(test_read);
+  MU_RUN_TEST(test_many);
+  MU_RUN_TEST(test_odirect);
+  MU_RUN_TEST(test_iter_meta);
+  MU_RUN_TEST(test_append);
+  MU_RUN_TEST(test_versions);
+  MU_RUN_TEST(test_checksums);
+  MU_RUN_TEST(test_lossy);
+}
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,574 @@
+/* dlite-blob-storage.c -- DLite storage plugin for binary blobs */
+
+/*
+  This plugin reads/writes a file to/from an instance as a binary
+  blob.  By default, loaded instances are of the metadata
+
+      http://onto-ns.com/meta/0.1/Blob
+
+  with no dimensions and one property `content`, which is a blob with
+  the size of the file.  This is the same as was created by the
+  earlier Python blob plugin.  The file content is copied into the
+  instance.  As before, the size of `content` is fixed by the first
+  file loaded in a session.
+
+  With the `mmap` option, loaded instances are instead of the metadata
+
+      http://onto-ns.com/meta/0.2/Blob
+
+  with one dimension `nbytes` and one property `content`, which is a
+  uint8 array with the content of the file.  The instance adopts a
+  memory mapping of the file as the `content` array, so no data is
+  copied and pages are only read from disk when they are accessed.  In
+  mode "r" the mapping is read-only and writing to `content` is an
+  error (it raises SIGSEGV).  In mode "a" the mapping is copy-on-write,
+  such that modifications to `content` stay private to the instance
+  until it is saved.  On systems without mmap() the file is read into
+  a buffer adopted by the instance.
+
+  Code using 0.1/Blob instances can migrate to 0.2/Blob by passing
+  `mmap=true` and accessing `content` as an array of `nbytes` bytes.
+
+  Saving writes the `content` property of any instance with a single
+  write().  If `content` is a read-only mapping of another file, the
+  data is copied with copy_file_range(), which lets the kernel copy (or
+  reflink) the data without passing it through user space.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE  /* for copy_file_range() */
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "config.h"
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "utils/err.h"
+#include "utils/strtob.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+#define BLOB_META_URI "http://onto-ns.com/meta/0.1/Blob"
+#define BLOB_MAPPED_META_URI "http://onto-ns.com/meta/0.2/Blob"
+
+
+/* Storage for binary blobs */
+typedef struct {
+  DLiteStorage_HEAD
+  int mode;            /* Open mode: 'r', 'a' or 'w' */
+  int mapped;          /* Whether to load content as a memory mapping */
+  char *id;            /* Id of loaded instance, NULL if not given */
+} BlobStorage;
+
+
+/***************************************************************
+ * Mappings
+ ***************************************************************/
+
+#ifdef HAVE_MMAP
+
+/* Information about a mapped file adopted as the content of an
+   instance, stored as the `data` of its region */
+typedef struct {
+  int readonly;        /* Whether the mapping is read-only */
+  char *path;          /* Path to mapped file */
+  dev_t dev;           /* Device of mapped file */
+  ino_t ino;           /* Inode of mapped file */
+} BlobMapping;
+
+/* Unmaps region `r` and frees its mapping information. */
+static void mapping_free(DLiteRegion *r)
+{
+  BlobMapping *m = r->data;
+  munmap(r->base, r->basesize);
+  if (m) free(m->path);
+  free(m);
+}
+
+/* Copies the mapping starting at `ptr` with `size` bytes to `*copy`.
+   The `path` of the copy is a new malloc'ed string.  Returns non-zero
+   if such a mapping is found. */
+static int mapping_lookup(const void *ptr, size_t size, BlobMapping *copy)
+{
+  DLiteRegion *r;
+  BlobMapping *m;
+  int found=0;
+  if (!(r = dlite_region_find(ptr))) return 0;
+  if ((m = r->data) && r->addr == ptr && r->size == size) {
+    *copy = *m;
+    copy->path = strdup(m->path);
+    found = (copy->path) ? 1 : 0;
+  }
+  dlite_region_decref(r);
+  return found;
+}
+
+/* Maps file `path` and lets property `i` of `inst` adopt the mapping.
+   Returns non-zero on error. */
+static int adopt_mapping(DLiteInstance *inst, size_t i, int fd,
+                         const struct stat *st, const char *path,
+                         int readonly)
+{
+  DLiteRegion *r;
+  BlobMapping *m;
+  void *addr;
+  size_t size = st->st_size;
+  int prot = (readonly) ? PROT_READ : PROT_READ | PROT_WRITE;
+  int retval;
+  if (!(m = calloc(1, sizeof(BlobMapping))))
+    return err(1, "allocation failure");
+  if (!(m->path = strdup(path))) {
+    free(m);
+    return err(1, "allocation failure");
+  }
+  m->readonly = readonly;
+  m->dev = st->st_dev;
+  m->ino = st->st_ino;
+  addr = mmap(NULL, size, prot, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    free(m->path);
+    free(m);
+    return err(1, "blob: cannot memory map \"%s\"", path);
+  }
+  if (!(r = dlite_region_create(addr, size, mapping_free))) {
+    munmap(addr, size);
+    free(m->path);
+    free(m);
+    return 1;
+  }
+  r->data = m;
+  retval = (dlite_region_adopt(inst, i, addr, r)) ? 1 : 0;
+  dlite_region_decref(r);
+  return retval;
+}
+
+#endif  /* HAVE_MMAP */
+
+
+/***************************************************************
+ * Reading and writing
+ ***************************************************************/
+
+#ifdef HAVE_MMAP
+
+/* Reads `size` bytes from `fd` into `buf`.  Returns non-zero on error
+   or if the file is shorter than `size`. */
+static int read_all(int fd, char *buf, size_t size)
+{
+  while (size > 0) {
+    ssize_t n = read(fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+    if (n == 0) return 1;
+    buf += n;
+    size -= n;
+  }
+  return 0;
+}
+
+/* Writes `size` bytes from `buf` to `fd`.  Returns non-zero on error. */
+static int write_all(int fd, const char *buf, size_t size)
+{
+  while (size > 0) {
+    ssize_t n = write(fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+    buf += n;
+    size -= n;
+  }
+  return 0;
+}
+
+/* Copies the `size` bytes of the file mapped by `m` to the start of
+   `fd` with copy_file_range().  The file offset of `fd` is not
+   changed.  Returns zero on success and non-zero if the data could not
+   be copied this way. */
+static int copy_mapping(int fd, const BlobMapping *m, size_t size)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+  struct stat st;
+  int src, retval=1;
+  if ((src = open(m->path, O_RDONLY)) < 0) return 1;
+  if (fstat(src, &st) == 0 && st.st_dev == m->dev && st.st_ino == m->ino &&
+      (size_t)st.st_size == size) {
+    loff_t off_in=0, off_out=0;
+    while (size > 0) {
+      ssize_t n = copy_file_range(src, &off_in, fd, &off_out, size, 0);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+      size -= n;
+    }
+    retval = (size > 0) ? 1 : 0;
+  }
+  close(src);
+  return retval;
+#else
+  UNUSED(fd);
+  UNUSED(m);
+  UNUSED(size);
+  return 1;
+#endif
+}
+
+#endif  /* HAVE_MMAP */
+
+
+/***************************************************************
+ * API
+ ***************************************************************/
+
+/**
+  Returns a new blob storage.
+
+  Valid `options` are:
+
+  - mode : r | a | w
+      How to open the storage:
+        - r: Read-only (default).  With `mmap`, loaded content is a
+             read-only mapping of the file.
+        - a: Read and write.  With `mmap`, loaded content is a
+             copy-on-write mapping of the file.
+        - w: Write-only.
+  - id : string
+      Explicit id of the loaded instance.
+  - mmap : bool
+      Whether to load the content as a zero-copy memory mapping of the
+      file, using the 0.2/Blob metadata.  Default is false, which
+      copies the content into a 0.1/Blob instance.
+ */
+DLiteStorage *blob_open(const DLiteStoragePlugin *api, const char *location,
+                        const char *options)
+{
+  BlobStorage *bs=NULL;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open the storage.  Valid values are: "
+    "\"r\" (read-only, default), \"a\" (read and write, loaded content "
+    "is copy-on-write) and \"w\" (write)";
+  DLiteOpt opts[] = {
+    {'m', "mode", "r", mode_descr},
+    {'i', "id",   "",  "Explicit id of the loaded instance"},
+    {'M', "mmap", "false", "Whether to load the content as a memory mapping "
+     "of the file, using the 0.2/Blob metadata"},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode;
+  UNUSED(api);
+  UNUSED(location);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+
+  if (!(bs = calloc(1, sizeof(BlobStorage)))) FAIL("allocation failure");
+  if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    bs->mode = 'r';
+  } else if (strcmp(mode, "a") == 0 || strcmp(mode, "append") == 0) {
+    bs->mode = 'a';
+  } else if (strcmp(mode, "w") == 0 || strcmp(mode, "write") == 0) {
+    bs->mode = 'w';
+  } else {
+    FAIL1("blob: invalid \"mode\" value: '%s'. Must be \"r\" (read), "
+          "\"a\" (append) or \"w\" (write)", mode);
+  }
+  bs->writable = (bs->mode != 'r');
+  if ((bs->mapped = atob(opts[2].value)) < 0)
+    FAIL1("blob: invalid boolean value for `mmap` option: '%s'",
+          opts[2].value);
+  if (*opts[1].value && !(bs->id = strdup(opts[1].value)))
+    FAIL("allocation failure");
+
+  retval = (DLiteStorage *)bs;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && bs) free(bs);
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  Returns non-zero on error.
+ */
+int blob_close(DLiteStorage *s)
+{
+  BlobStorage *bs = (BlobStorage *)s;
+  if (bs->id) free(bs->id);
+  return 0;
+}
+
+/**
+  Loads the file of storage `s` and returns it as a new instance.  The
+  id of the instance is given by the `id` option, or by `id` if the
+  option is not given.  NULL is returned on error.
+ */
+DLiteInstance *blob_load(const DLiteStorage *s, const char *id)
+{
+  const BlobStorage *bs = (const BlobStorage *)s;
+  char *descr = "Entity representing a single binary blob.";
+  char *dims[] = {"nbytes"};
+  DLiteDimension dimensions[] = {
+    {"nbytes", "Number of bytes."}
+  };
+  DLiteProperty properties[] = {
+    {"content", dliteUInt, 1, 1, dims, "", NULL,
+     "Content of the binary blob."}
+  };
+  DLiteMeta *meta=NULL;
+  DLiteInstance *inst=NULL, *retval=NULL;
+  size_t size;
+#ifdef HAVE_MMAP
+  struct stat st;
+  int fd=-1;
+#else
+  FILE *fp=NULL;
+  char *buf=NULL;
+  long n=-1;
+#endif
+
+  if (bs->mode == 'w')
+    FAIL1("blob: cannot load from \"%s\" opened in write mode",
+          s->location);
+  if (bs->id) id = bs->id;
+
+#ifdef HAVE_MMAP
+  if ((fd = open(s->location, O_RDONLY)) < 0)
+    FAIL1("blob: cannot open \"%s\"", s->location);
+  if (fstat(fd, &st))
+    FAIL1("blob: cannot determine size of \"%s\"", s->location);
+  size = st.st_size;
+#else
+  if (!(fp = fopen(s->location, "rb")))
+    FAIL1("blob: cannot open \"%s\"", s->location);
+  if (fseek(fp, 0, SEEK_END) == 0) n = ftell(fp);
+  if (n < 0 || fseek(fp, 0, SEEK_SET))
+    FAIL1("blob: cannot determine size of \"%s\"", s->location);
+  size = n;
+#endif
+
+  if (bs->mapped) {
+    if (!(meta = dlite_meta_create(BLOB_MAPPED_META_URI, NULL, descr,
+                                   1, dimensions, 1, properties)))
+      goto fail;
+    if (!(inst = dlite_instance_create(meta, &size, id))) goto fail;
+    if (size > 0) {
+#ifdef HAVE_MMAP
+      if (adopt_mapping(inst, 0, fd, &st, s->location, bs->mode == 'r'))
+        goto fail;
+#else
+      if (!(buf = malloc(size))) FAIL("allocation failure");
+      if (fread(buf, 1, size, fp) != size)
+        FAIL1("blob: cannot read \"%s\"", s->location);
+      if (dlite_instance_adopt_property_by_index(inst, 0, buf, free))
+        goto fail;
+      buf = NULL;
+#endif
+    }
+  } else {
+    /* Like in the earlier Python plugin, the size of `content` is
+       fixed when 0.1/Blob is created.  Since metadata are kept in the
+       instance store, blobs of other sizes cannot be loaded this way
+       in the same session. */
+    properties[0].type = dliteBlob;
+    properties[0].size = size;
+    properties[0].ndims = 0;
+    properties[0].dims = NULL;
+    if (!(meta = dlite_meta_create(BLOB_META_URI, NULL, descr,
+                                   0, NULL, 1, properties)))
+      goto fail;
+    if (meta->_properties[0].size != size)
+      FAIL3("blob: cannot load %zu bytes from \"%s\" as %s of another "
+            "size.  Use the `mmap` option to load blobs of any size",
+            size, s->location, BLOB_META_URI);
+    if (!(inst = dlite_instance_create(meta, NULL, id))) goto fail;
+#ifdef HAVE_MMAP
+    if (size > 0 && read_all(fd, DLITE_PROP(inst, 0), size))
+#else
+    if (size > 0 && fread(DLITE_PROP(inst, 0), 1, size, fp) != size)
+#endif
+      FAIL1("blob: cannot read \"%s\"", s->location);
+  }
+  retval = inst;
+ fail:
+#ifdef HAVE_MMAP
+  if (fd >= 0) close(fd);
+#else
+  if (fp) fclose(fp);
+  if (buf) free(buf);
+#endif
+  if (meta) dlite_meta_decref(meta);
+  if (!retval && inst) dlite_instance_decref(inst);
+  return retval;
+}
+
+
+/**
+  Writes the `content` property of `inst` to the file of storage `s`.
+  Returns non-zero on error.
+ */
+int blob_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  const BlobStorage *bs = (const BlobStorage *)s;
+  const DLiteProperty *p;
+  const char *content;
+  size_t size=1;
+  int i, j, retval=1;
+#ifdef HAVE_MMAP
+  BlobMapping m;
+  struct stat st;
+  int fd=-1, flags=O_WRONLY | O_CREAT | O_TRUNC, mapped=0, copied=0;
+#else
+  FILE *fp;
+#endif
+
+  if (!bs->writable)
+    return errx(1, "blob: storage \"%s\" is not writable", s->location);
+  if ((i = dlite_meta_get_property_index(inst->meta, "content")) < 0)
+    return errx(1, "blob: cannot save instance without a \"content\" "
+                "property: %s", inst->uuid);
+  p = inst->meta->_properties + i;
+  if (dlite_type_is_allocated(p->type))
+    return errx(1, "blob: cannot save \"content\" of type %s",
+                dlite_type_get_dtypename(p->type));
+  for (j=0; j<p->ndims; j++) size *= DLITE_PROP_DIM(inst, i, j);
+  size *= p->size;
+  content = dlite_instance_get_property_by_index(inst, i);
+  if (size > 0 && !content)
+    return errx(1, "blob: no content in instance %s", inst->uuid);
+
+#ifdef HAVE_MMAP
+  /* Truncating the file that `content` maps would invalidate the
+     mapping.  An unmodified read-only mapping of the file is already
+     saved, and a copy-on-write mapping of the file is written in place
+     since it has the same size as the file. */
+  if (size > 0 && (mapped = mapping_lookup(content, size, &m)) &&
+      stat(s->location, &st) == 0 &&
+      st.st_dev == m.dev && st.st_ino == m.ino) {
+    if (m.readonly && (size_t)st.st_size == size) {
+      retval = 0;
+      goto fail;
+    }
+    flags &= ~O_TRUNC;
+  }
+  if ((fd = open(s->location, flags, 0666)) < 0)
+    FAIL1("blob: cannot open \"%s\" for writing", s->location);
+  if (mapped && m.readonly) copied = (copy_mapping(fd, &m, size) == 0);
+  if (!copied && write_all(fd, content, size))
+    FAIL1("blob: cannot write \"%s\"", s->location);
+  if (!(flags & O_TRUNC) && ftruncate(fd, size))
+    FAIL1("blob: cannot truncate \"%s\"", s->location);
+  if (close(fd)) {
+    fd = -1;
+    FAIL1("blob: cannot close \"%s\"", s->location);
+  }
+  fd = -1;
+  retval = 0;
+ fail:
+  if (fd >= 0) close(fd);
+  if (mapped) free(m.path);
+#else
+  if (!(fp = fopen(s->location, "wb")))
+    return err(1, "blob: cannot open \"%s\" for writing", s->location);
+  if (fwrite(content, 1, size, fp) != size)
+    err(1, "blob: cannot write \"%s\"", s->location);
+  else
+    retval = 0;
+  if (fclose(fp))
+    retval = err(1, "blob: cannot close \"%s\"", s->location);
+#endif
+  return retval;
+}
+
+
+static DLiteStoragePlugin dlite_blob_plugin = {
+  /* head */
+  "blob",                   /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  blob_open,                /* open */
+  blob_close,               /* close */
+
+  /* queue api */
+  NULL,                     /* iterCreate */
+  NULL,                     /* iterNext */
+  NULL,                     /* iterFree */
+  NULL,                     /* getUUIDs */
+
+  /* direct api */
+  blob_load,                /* loadInstance */
+  blob_save,                /* saveInstance */
+  NULL,                     /* loadInstances */
+  NULL,                     /* saveInstances */
+
+  /* datamodel api */
+  NULL,                     /* dataModel */
+  NULL,                     /* dataModelFree */
+
+  NULL,                     /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  NULL,                     /* getDimensionSize */
+  NULL,                     /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                     /* setMetaURI */
+  NULL,                     /* setDimensionSize */
+  NULL,                     /* setProperty */
+
+  NULL,                     /* hasDimension */
+  NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  NULL,                     /* getDataName, obsolute */
+  NULL,                     /* setDataName, obsolute */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &dlite_blob_plugin;
+}
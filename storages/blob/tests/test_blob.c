@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+#define NBYTES 10000
+
+
+/* Writes `size` bytes of `buf` to file `path`. */
+static int write_file(const char *path, const void *buf, size_t size)
+{
+  FILE *fp;
+  if (!(fp = fopen(path, "wb"))) return 1;
+  if (size && fwrite(buf, 1, size, fp) != size) {
+    fclose(fp);
+    return 1;
+  }
+  return fclose(fp);
+}
+
+/* Returns non-zero if the content of file `path` differs from the
+   `size` bytes of `buf`. */
+static int cmp_file(const char *path, const void *buf, size_t size)
+{
+  FILE *fp;
+  char *data;
+  size_t n;
+  int retval;
+  if (!(fp = fopen(path, "rb"))) return 1;
+  if (!(data = malloc(size + 1))) {
+    fclose(fp);
+    return 1;
+  }
+  n = fread(data, 1, size + 1, fp);
+  fclose(fp);
+  retval = (n != size || memcmp(data, buf, size)) ? 1 : 0;
+  free(data);
+  return retval;
+}
+
+/* Loads instance from blob file `path` opened with `options`. */
+static DLiteInstance *load(const char *path, const char *options)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  if (!(s = dlite_storage_open("blob", path, options))) return NULL;
+  inst = dlite_instance_load(s, NULL);
+  dlite_storage_close(s);
+  return inst;
+}
+
+static unsigned char data[NBYTES];
+
+
+MU_TEST(test_load)
+{
+  DLiteInstance *inst;
+  uint8_t *content;
+  int i;
+  for (i=0; i<NBYTES; i++) data[i] = (i * 7) % 256;
+  mu_assert_int_eq(0, write_file("test-blob.bin", data, NBYTES));
+
+  mu_check((inst = load("test-blob.bin", "id=blob-data;mmap=true")));
+  mu_assert_string_eq("http://onto-ns.com/meta/0.2/Blob", inst->meta->uri);
+  mu_assert_string_eq("blob-data", inst->uri);
+  mu_assert_int_eq(NBYTES, dlite_instance_get_dimension_size(inst, "nbytes"));
+  content = dlite_instance_get_property(inst, "content");
+  mu_check(content);
+  mu_assert_int_eq(0, memcmp(content, data, NBYTES));
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_load_copy)
+{
+  /* By default the content is copied into a 0.1/Blob instance */
+  DLiteInstance *inst, *inst2;
+  DLiteStorage *s;
+  unsigned char *content;
+  mu_check((inst = load("test-blob.bin", NULL)));
+  mu_assert_string_eq("http://onto-ns.com/meta/0.1/Blob", inst->meta->uri);
+  mu_assert_int_eq(0, inst->meta->_ndimensions);
+  mu_assert_int_eq(dliteBlob, inst->meta->_properties[0].type);
+  mu_assert_int_eq(NBYTES, inst->meta->_properties[0].size);
+  content = dlite_instance_get_property(inst, "content");
+  mu_assert_int_eq(0, memcmp(content, data, NBYTES));
+
+  /* The copy is writable, also in read-only mode */
+  content[0] = 1;
+  mu_assert_int_eq(0, cmp_file("test-blob.bin", data, NBYTES));
+  content[0] = data[0];
+
+  /* 0.1/Blob is kept, so blobs of other sizes need the `mmap` option */
+  mu_assert_int_eq(0, write_file("test-blob-small.bin", data, 10));
+  err_set_stream(NULL);
+  mu_check(!load("test-blob-small.bin", NULL));
+  err_set_stream(stderr);
+  err_clear();
+  mu_check((inst2 = load("test-blob-small.bin", "mmap=true")));
+  dlite_instance_decref(inst2);
+
+  mu_check((s = dlite_storage_open("blob", "test-blob-copy.bin", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_storage_close(s);
+  mu_assert_int_eq(0, cmp_file("test-blob-copy.bin", data, NBYTES));
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  mu_check((inst = load("test-blob.bin", "mmap=true")));
+
+  /* Saving to a read-only storage fails */
+  mu_check((s = dlite_storage_open("blob", "test-blob-copy.bin", NULL)));
+  err_set_stream(NULL);
+  mu_check(dlite_instance_save(s, inst));
+  err_set_stream(stderr);
+  dlite_storage_close(s);
+
+  /* Copy a read-only mapping to another file */
+  mu_check((s = dlite_storage_open("blob", "test-blob-copy.bin", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_storage_close(s);
+  mu_assert_int_eq(0, cmp_file("test-blob-copy.bin", data, NBYTES));
+
+  /* Saving a read-only mapping to its own file keeps the file */
+  mu_check((s = dlite_storage_open("blob", "test-blob.bin", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_storage_close(s);
+  mu_assert_int_eq(0, cmp_file("test-blob.bin", data, NBYTES));
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_copy_on_write)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  uint8_t *content;
+  mu_check((s = dlite_storage_open("blob", "test-blob-copy.bin",
+                                   "mode=a;mmap=true")));
+  mu_check((inst = dlite_instance_load(s, NULL)));
+  content = dlite_instance_get_property(inst, "content");
+  content[0] = 255;
+  content[NBYTES-1] = 254;
+
+  /* Modifications are private until saved */
+  mu_assert_int_eq(0, cmp_file("test-blob-copy.bin", data, NBYTES));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_storage_close(s);
+  data[0] = 255;
+  data[NBYTES-1] = 254;
+  mu_assert_int_eq(0, cmp_file("test-blob-copy.bin", data, NBYTES));
+  mu_assert_int_eq(0, memcmp(content, data, NBYTES));
+  dlite_instance_decref(inst);
+
+  mu_check((inst = load("test-blob-copy.bin", "mmap=true")));
+  mu_assert_int_eq(0, memcmp(dlite_instance_get_property(inst, "content"),
+                             data, NBYTES));
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_scalar_blob)
+{
+  /* Instances with a scalar blob "content", as created by earlier
+     versions of the blob plugin, can also be saved */
+  DLiteDimension dimensions[] = {{"N", "Unused dimension."}};
+  DLiteProperty properties[] = {
+    {"content", dliteBlob, 16, 0, NULL, "", NULL, "Content."}
+  };
+  DLiteMeta *meta;
+  DLiteInstance *inst;
+  DLiteStorage *s;
+  size_t dims[] = {0};
+  mu_check((meta = dlite_meta_create("http://onto-ns.com/meta/0.1/Blob16",
+                                     NULL, "Blob with 16 bytes.",
+                                     1, dimensions, 1, properties)));
+  mu_check((inst = dlite_instance_create(meta, dims, NULL)));
+  memcpy(dlite_instance_get_property(inst, "content"), "0123456789abcdef",
+         16);
+  mu_check((s = dlite_storage_open("blob", "test-blob16.bin", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_storage_close(s);
+  mu_assert_int_eq(0, cmp_file("test-blob16.bin", "0123456789abcdef", 16));
+  dlite_instance_decref(inst);
+  dlite_meta_decref(meta);
+}
+
+MU_TEST(test_empty)
+{
+  DLiteInstance *inst;
+  DLiteStorage *s;
+  mu_assert_int_eq(0, write_file("test-blob-empty.bin", NULL, 0));
+  mu_check((inst = load("test-blob-empty.bin", "mmap=true")));
+  mu_assert_int_eq(0, dlite_instance_get_dimension_size(inst, "nbytes"));
+  mu_check((s = dlite_storage_open("blob", "test-blob-empty2.bin",
+                                   "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_storage_close(s);
+  mu_assert_int_eq(0, cmp_file("test-blob-empty2.bin", "", 0));
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_errors)
+{
+  err_set_stream(NULL);
+  mu_check(!load("test-blob.bin", "mode=w"));
+  mu_check(!load("test-blob-nonexisting.bin", NULL));
+  mu_check(!dlite_storage_open("blob", "test-blob.bin", "mode=x"));
+  mu_check(!dlite_storage_open("blob", "test-blob.bin", "mmap=maybe"));
+  err_set_stream(stderr);
+}
+
+MU_TEST(test_free)
+{
+  dlite_storage_plugin_unload_all();
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_load_copy);
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_copy_on_write);
+  MU_RUN_TEST(test_scalar_blob);
+  MU_RUN_TEST(test_empty);
+  MU_RUN_TEST(test_errors);
+  MU_RUN_TEST(test_free);
+}
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,890 @@
+/* dlite-cas-storage.c -- DLite plugin for a content-addressed store */
+
+/*
+  This plugin stores instances in a local directory where array
+  payloads are deduplicated by content.  It is intended for parameter
+  sweeps and similar, where many instances share identical large
+  arrays, like the same mesh.
+
+  Directory layout:
+
+      <root>/instances/<uuid>.json      manifest of each instance
+      <root>/blobs/<xx>/<yyyy...>       unique array payloads
+
+  Array properties of boolean, numerical, fixed string and blob type
+  of at least `minsize` bytes are hashed with SHA3-256 and written to
+  a blob named by the 64 hex digits of the hash, split after the first
+  two.  A blob that already exists is not written again.  All other
+  properties are stored in the manifest:
+
+      {
+        "dlite:meta": "http://onto-ns.com/meta/0.1/MyEntity",
+        "dlite:byteorder": "little",
+        "dlite:dimensions": {"N": 3},
+        "dlite:properties": {"name": "foo"},
+        "dlite:blobs": {"mesh": {"type": "float64", "hash": "5f3c..."}}
+      }
+
+  Blobs hold the raw elements in native byte order and C order.  Since
+  the hash is cryptographic, two different payloads are assumed never
+  to share a blob.  Blobs are never removed, since other instances may
+  refer to them.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+# include <direct.h>
+# define mkdir(path, mode) _mkdir(path)
+#else
+# include <sys/stat.h>
+#endif
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/fileutils.h"
+#include "utils/strutils.h"
+#include "utils/jsmnx.h"
+#include "utils/sha3.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-datamodel.h"
+#include "dlite-storage-plugins.h"
+
+
+/* Default min size in bytes of arrays stored as blobs */
+#define CAS_MINSIZE "1024"
+
+/* Number of hex digits in a hash */
+#define CAS_HASHLEN 64
+
+
+/* Storage for a content-addressed store */
+typedef struct {
+  DLiteStorage_HEAD
+  char *root;         /* Root directory, without trailing slash */
+  size_t minsize;     /* Min size in bytes of arrays stored as blobs */
+  map_int_t known;    /* Hashes of blobs known to exist */
+} CasStorage;
+
+/* Data model for a content-addressed store */
+typedef struct {
+  DLiteDataModel_HEAD
+  char *metauri;      /* Metadata uri, NULL if not set */
+  char *dataname;     /* Data name, NULL if not set */
+  map_int_t dims;     /* Maps dimension names to sizes */
+  map_str_t props;    /* Maps names of properties stored in the manifest
+                         to their JSON value */
+  map_str_t blobs;    /* Maps names of properties stored as blobs to
+                         "<typename>:<hash>" */
+  int modified;       /* Whether the manifest must be written */
+} CasDataModel;
+
+
+/********************************************************************
+ * Hashing
+ ********************************************************************/
+
+/* Writes the SHA3-256 hash of the `len` bytes at `data` as CAS_HASHLEN
+   hex digits to `hex`, which must have space for the terminating NUL. */
+static void hash_bytes(char *hex, const void *data, size_t len)
+{
+  sha3_context c;
+  sha3_Init256(&c);
+  sha3_Update(&c, data, len);
+  strhex(hex, CAS_HASHLEN+1, sha3_Finalize(&c), CAS_HASHLEN/2);
+}
+
+
+/********************************************************************
+ * Files
+ ********************************************************************/
+
+/* Returns non-zero if this machine is big endian. */
+static int big_endian(void)
+{
+  const uint16_t one = 1;
+  return *(const unsigned char *)&one == 0;
+}
+
+/* Creates the parent directories of `path`.  Returns non-zero on
+   error. */
+static int make_parents(char *path)
+{
+  char *p;
+  for (p=strchr(path+1, '/'); p; p=strchr(p+1, '/')) {
+    int stat;
+    *p = '\0';
+    stat = (mkdir(path, 0777) && errno != EEXIST) ?
+      err(1, "cas: cannot create directory: %s", path) : 0;
+    *p = '/';
+    if (stat) return stat;
+  }
+  return 0;
+}
+
+/* Returns a newly allocated path to the blob with hash `hash`. */
+static char *blob_path(const CasStorage *cs, const char *hash)
+{
+  return aprintf("%s/blobs/%.2s/%s", cs->root, hash, hash+2);
+}
+
+/* Returns a newly allocated path to the manifest of `uuid`. */
+static char *manifest_path(const CasStorage *cs, const char *uuid)
+{
+  return aprintf("%s/instances/%s.json", cs->root, uuid);
+}
+
+/* Writes `len` bytes from `data` to a temporary file next to `path`
+   named after `tag`, which is then renamed to `path`.  Readers will
+   therefore never see a partly written file.  Returns non-zero on
+   error. */
+static int write_file(char *path, const void *data, size_t len,
+                      const char *tag)
+{
+  char *tmp;
+  FILE *fp;
+  int stat=0;
+  if (make_parents(path)) return 1;
+  if (!(tmp = aprintf("%s.%s.tmp", path, tag)))
+    return err(1, "allocation failure");
+  if (!(fp = fopen(tmp, "wb"))) {
+    free(tmp);
+    return err(1, "cas: cannot create %s", path);
+  }
+  if (fwrite(data, 1, len, fp) != len) stat = err(1, "cas: cannot write %s",
+                                                  path);
+  if (fclose(fp) && !stat) stat = err(1, "cas: cannot write %s", path);
+  if (!stat && rename(tmp, path)) {
+    /* rename() does not replace existing files on Windows */
+    remove(path);
+    if (rename(tmp, path)) stat = err(1, "cas: cannot rename %s", tmp);
+  }
+  if (stat) remove(tmp);
+  free(tmp);
+  return stat;
+}
+
+/* Reads file `path` into a newly allocated NUL-terminated buffer.
+   Returns NULL if it doesn't exist (`*found` is set to zero) or on
+   error. */
+static char *read_text(const char *path, int *found)
+{
+  FILE *fp;
+  char *buf=NULL;
+  long len;
+  *found = 1;
+  if (!(fp = fopen(path, "rb"))) {
+    if (errno == ENOENT) {
+      *found = 0;
+      return NULL;
+    }
+    return err(1, "cas: cannot open %s", path), NULL;
+  }
+  if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) < 0 ||
+      fseek(fp, 0, SEEK_SET)) {
+    fclose(fp);
+    return err(1, "cas: cannot read %s", path), NULL;
+  }
+  if (!(buf = malloc(len + 1))) {
+    fclose(fp);
+    return err(1, "allocation failure"), NULL;
+  }
+  if (fread(buf, 1, len, fp) != (size_t)len) {
+    fclose(fp);
+    free(buf);
+    return err(1, "cas: cannot read %s", path), NULL;
+  }
+  buf[len] = '\0';
+  fclose(fp);
+  return buf;
+}
+
+/* Stores the `len` bytes at `data` as a blob, unless it already
+   exists.  The hash is written to `hash`.  Returns non-zero on
+   error. */
+static int put_blob(CasStorage *cs, char *hash, const void *data, size_t len,
+                    const char *tag)
+{
+  char *path;
+  FILE *fp;
+  int stat=0;
+  hash_bytes(hash, data, len);
+  if (map_get(&cs->known, hash)) return 0;
+  if (!(path = blob_path(cs, hash))) return err(1, "allocation failure");
+  if ((fp = fopen(path, "rb"))) {
+    fclose(fp);
+  } else {
+    stat = write_file(path, data, len, tag);
+  }
+  free(path);
+  if (!stat) map_set(&cs->known, hash, 1);
+  return stat;
+}
+
+/* Reads blob `hash` of exactly `len` bytes into `data`.  Returns
+   non-zero on error. */
+static int get_blob(const CasStorage *cs, const char *hash, void *data,
+                    size_t len)
+{
+  char *path;
+  FILE *fp;
+  int stat=0;
+  if (!(path = blob_path(cs, hash))) return err(1, "allocation failure");
+  if (!(fp = fopen(path, "rb"))) {
+    stat = err(1, "cas: missing blob %s", path);
+  } else {
+    if (fread(data, 1, len, fp) != len || fgetc(fp) != EOF)
+      stat = errx(1, "cas: blob %s does not have the expected size", path);
+    fclose(fp);
+  }
+  free(path);
+  return stat;
+}
+
+/* Returns non-zero if arrays of `type` are stored as blobs. */
+static int cas_supported(DLiteType type)
+{
+  switch (type) {
+  case dliteBlob:
+  case dliteBool:
+  case dliteInt:
+  case dliteUInt:
+  case dliteFloat:
+  case dliteFixString:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+/********************************************************************
+ * Required api
+ ********************************************************************/
+
+/**
+  Returns a new storage for the directory `uri`.
+
+  Valid `options` are:
+
+  - mode : append | r | w
+      Valid values are:
+      - append   Append to existing store or create a new (default)
+      - r        Open existing store for read-only
+      - w        Same as append.  Existing blobs are kept, since they
+                 may be shared with other stores.
+  - minsize : Min size in bytes of arrays stored as blobs (default 1024)
+
+  Returns NULL on error.
+ */
+DLiteStorage *cas_open(const DLiteStoragePlugin *api, const char *uri,
+                       const char *options)
+{
+  CasStorage *cs=NULL;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"append\" (appends to existing storage or creates a new one); "
+    "\"r\" (read-only); "
+    "\"w\" (same as append)";
+  DLiteOpt opts[] = {
+    {'m', "mode",    "append",    mode_descr},
+    {'s', "minsize", CAS_MINSIZE, "Min size in bytes of arrays stored as "
+     "blobs"},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode;
+  char *endptr;
+  size_t len;
+  long minsize;
+  UNUSED(api);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+  minsize = strtol(opts[1].value, &endptr, 10);
+  if (*endptr || endptr == opts[1].value || minsize < 0)
+    FAIL1("cas: invalid \"minsize\" value: '%s'", opts[1].value);
+
+  if (!(cs = calloc(1, sizeof(CasStorage)))) FAIL("allocation failure");
+  map_init(&cs->known);
+  cs->minsize = minsize;
+
+  if (strcmp(mode, "append") == 0 || strcmp(mode, "a") == 0 ||
+      strcmp(mode, "w") == 0 || strcmp(mode, "write") == 0) {
+    cs->writable = 1;
+  } else if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    cs->writable = 0;
+  } else {
+    FAIL1("invalid \"mode\" value: '%s'. Must be \"append\", \"r\" "
+          "(read-only) or \"w\" (write)", mode);
+  }
+
+  len = strlen(uri);
+  while (len > 1 && uri[len-1] == '/') len--;
+  if (!(cs->root = strndup(uri, len))) FAIL("allocation failure");
+
+  cs->idflag = dliteIDTranslateToUUID;
+  retval = (DLiteStorage *)cs;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && cs) {
+    if (cs->root) free(cs->root);
+    map_deinit(&cs->known);
+    free(cs);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  Returns non-zero on error.
+ */
+int cas_close(DLiteStorage *s)
+{
+  CasStorage *cs = (CasStorage *)s;
+  map_deinit(&cs->known);
+  free(cs->root);
+  return 0;
+}
+
+
+/* Frees the content of data model `d`. */
+static void cas_clear(CasDataModel *d)
+{
+  const char *name;
+  map_iter_t iter = map_iter(&d->props);
+  while ((name = map_next(&d->props, &iter)))
+    free(*map_get(&d->props, name));
+  iter = map_iter(&d->blobs);
+  while ((name = map_next(&d->blobs, &iter)))
+    free(*map_get(&d->blobs, name));
+  map_deinit(&d->props);
+  map_deinit(&d->blobs);
+  map_deinit(&d->dims);
+  if (d->metauri) free(d->metauri);
+  if (d->dataname) free(d->dataname);
+}
+
+/* Returns a newly allocated copy of the value of token `t` in `js`,
+   including the quotes of strings if `quoted` is non-zero. */
+static char *tokdup(const char *js, const jsmntok_t *t, int quoted)
+{
+  int q = (quoted && t->type == JSMN_STRING);
+  char *s = strndup(js + t->start - q, t->end - t->start + 2*q);
+  if (!s) err(1, "allocation failure");
+  return s;
+}
+
+/**
+  Returns a new data model for instance `uuid` in storage `s` or NULL
+  on error.
+ */
+DLiteDataModel *cas_datamodel(const DLiteStorage *s, const char *uuid)
+{
+  CasStorage *cs = (CasStorage *)s;
+  CasDataModel *d=NULL;
+  DLiteDataModel *retval=NULL;
+  jsmn_parser parser;
+  jsmntok_t *tokens=NULL;
+  unsigned int ntokens=0;
+  const jsmntok_t *t, *key;
+  char *path=NULL, *js=NULL;
+  int i, n, found;
+
+  if (!(d = calloc(1, sizeof(CasDataModel)))) FAIL("allocation failure");
+  map_init(&d->dims);
+  map_init(&d->props);
+  map_init(&d->blobs);
+  if (!(path = manifest_path(cs, uuid))) FAIL("allocation failure");
+  if (!(js = read_text(path, &found))) {
+    if (found) goto fail;
+    if (!s->writable) FAIL2("cas: no instance '%s' in %s", uuid, cs->root);
+    retval = (DLiteDataModel *)d;
+    goto fail;
+  }
+
+  jsmn_init(&parser);
+  if ((n = jsmn_parse_alloc(&parser, js, strlen(js), &tokens, &ntokens)) < 0)
+    FAIL2("cas: cannot parse %s: %s", path, jsmn_strerror(n));
+  if ((t = jsmn_item(js, tokens, "dlite:byteorder")) &&
+      strncmp(js + t->start, (big_endian()) ? "big" : "little",
+              t->end - t->start) != 0)
+    FAIL1("cas: %s is stored with another byte order", path);
+  if ((t = jsmn_item(js, tokens, "dlite:meta")) && t->type == JSMN_STRING &&
+      !(d->metauri = tokdup(js, t, 0))) goto fail;
+  if ((t = jsmn_item(js, tokens, "dlite:dataname")) &&
+      t->type == JSMN_STRING && !(d->dataname = tokdup(js, t, 0))) goto fail;
+  if ((t = jsmn_item(js, tokens, "dlite:dimensions")) &&
+      t->type == JSMN_OBJECT) {
+    for (i=0, key=t+1; i < t->size; i++, key+=2) {
+      char *name = tokdup(js, key, 0);
+      if (!name) goto fail;
+      map_set(&d->dims, name, atoi(js + key[1].start));
+      free(name);
+    }
+  }
+  if ((t = jsmn_item(js, tokens, "dlite:properties")) &&
+      t->type == JSMN_OBJECT) {
+    for (i=0, key=t+1; i < t->size; i++) {
+      const jsmntok_t *val = key + 1;
+      char *name = tokdup(js, key, 0), *value = tokdup(js, val, 1);
+      if (!name || !value) {
+        if (name) free(name);
+        if (value) free(value);
+        goto fail;
+      }
+      map_set(&d->props, name, value);
+      free(name);
+      key = val + 1 + jsmn_count(val);
+    }
+  }
+  if ((t = jsmn_item(js, tokens, "dlite:blobs")) && t->type == JSMN_OBJECT) {
+    for (i=0, key=t+1; i < t->size; i++) {
+      const jsmntok_t *val = key + 1, *type, *hash;
+      char *name, *ref;
+      if (val->type != JSMN_OBJECT ||
+          !(type = jsmn_item(js, val, "type")) ||
+          !(hash = jsmn_item(js, val, "hash")) ||
+          hash->end - hash->start != CAS_HASHLEN)
+        FAIL1("cas: invalid blob reference in %s", path);
+      name = tokdup(js, key, 0);
+      ref = aprintf("%.*s:%.*s", type->end - type->start, js + type->start,
+                    CAS_HASHLEN, js + hash->start);
+      if (!name || !ref) {
+        if (name) free(name);
+        if (ref) free(ref);
+        FAIL("allocation failure");
+      }
+      map_set(&d->blobs, name, ref);
+      free(name);
+      key = val + 1 + jsmn_count(val);
+    }
+  }
+  retval = (DLiteDataModel *)d;
+ fail:
+  if (path) free(path);
+  if (js) free(js);
+  if (tokens) free(tokens);
+  if (!retval && d) {
+    cas_clear(d);
+    free(d);
+  }
+  return retval;
+}
+
+
+/* Writes the manifest of `d`.  Returns non-zero on error. */
+static int write_manifest(DLiteDataModel *d)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  CasStorage *cs = (CasStorage *)d->s;
+  char *buf=NULL, *path=NULL;
+  size_t size=0, m=0;
+  const char *name, *sep="";
+  map_iter_t iter;
+  int retval=1;
+
+  m += asnpprintf(&buf, &size, m, "{\n  \"dlite:meta\": ");
+  m += dlite_type_aprint(&buf, &size, m, &cd->metauri, dliteStringPtr,
+                         sizeof(char *), 0, -2, dliteFlagQuoted);
+  if (cd->dataname) {
+    m += asnpprintf(&buf, &size, m, ",\n  \"dlite:dataname\": ");
+    m += dlite_type_aprint(&buf, &size, m, &cd->dataname, dliteStringPtr,
+                           sizeof(char *), 0, -2, dliteFlagQuoted);
+  }
+  m += asnpprintf(&buf, &size, m, ",\n  \"dlite:byteorder\": \"%s\"",
+                  (big_endian()) ? "big" : "little");
+  m += asnpprintf(&buf, &size, m, ",\n  \"dlite:dimensions\": {");
+  iter = map_iter(&cd->dims);
+  while ((name = map_next(&cd->dims, &iter))) {
+    m += asnpprintf(&buf, &size, m, "%s\"%s\": %d", sep, name,
+                    *map_get(&cd->dims, name));
+    sep = ", ";
+  }
+  m += asnpprintf(&buf, &size, m, "},\n  \"dlite:properties\": {");
+  sep = "";
+  iter = map_iter(&cd->props);
+  while ((name = map_next(&cd->props, &iter))) {
+    m += asnpprintf(&buf, &size, m, "%s\n    \"%s\": %s", sep, name,
+                    *map_get(&cd->props, name));
+    sep = ",";
+  }
+  m += asnpprintf(&buf, &size, m, "\n  },\n  \"dlite:blobs\": {");
+  sep = "";
+  iter = map_iter(&cd->blobs);
+  while ((name = map_next(&cd->blobs, &iter))) {
+    const char *ref = *map_get(&cd->blobs, name);
+    const char *hash = strchr(ref, ':') + 1;
+    m += asnpprintf(&buf, &size, m,
+                    "%s\n    \"%s\": {\"type\": \"%.*s\", \"hash\": \"%s\"}",
+                    sep, name, (int)(hash - ref - 1), ref, hash);
+    sep = ",";
+  }
+  m += asnpprintf(&buf, &size, m, "\n  }\n}\n");
+  if (!buf) FAIL("allocation failure");
+
+  if (!(path = manifest_path(cs, d->uuid))) FAIL("allocation failure");
+  if (write_file(path, buf, m, d->uuid)) goto fail;
+  cd->modified = 0;
+  retval = 0;
+ fail:
+  if (buf) free(buf);
+  if (path) free(path);
+  return retval;
+}
+
+/**
+  Frees data model `d`, writing its manifest if it has been modified.
+  Returns non-zero on error.
+ */
+int cas_datamodel_free(DLiteDataModel *d)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  int stat=0;
+  if (cd->modified) {
+    if (!cd->metauri)
+      stat = errx(1, "cas: no metadata uri for instance '%s'", d->uuid);
+    else
+      stat = write_manifest(d);
+  }
+  cas_clear(cd);
+  return stat;
+}
+
+
+/**
+  Returns pointer to (malloc'ed) metadata uri or NULL on error.
+ */
+char *cas_get_meta_uri(const DLiteDataModel *d)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  char *uri;
+  if (!cd->metauri)
+    return errx(1, "cas: no metadata uri for instance '%s'", d->uuid), NULL;
+  if (!(uri = strdup(cd->metauri))) err(1, "allocation failure");
+  return uri;
+}
+
+
+/**
+  Returns the size of dimension `name` or -1 on error.
+ */
+int cas_get_dimension_size(const DLiteDataModel *d, const char *name)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  int *size;
+  if (!(size = map_get(&cd->dims, name)))
+    return errx(-1, "cas: no dimension '%s' in instance '%s'",
+                name, d->uuid);
+  return *size;
+}
+
+
+/**
+  Copies property `name` to memory pointed to by `ptr`.
+  Returns non-zero on error.
+ */
+int cas_get_property(const DLiteDataModel *d, const char *name, void *ptr,
+                     DLiteType type, size_t size,
+                     size_t ndims, const size_t *dims)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  char **value, typename[32];
+  size_t i, len=size;
+  if ((value = map_get(&cd->props, name))) {
+    DLiteProperty p;
+    memset(&p, 0, sizeof(p));
+    p.name = (char *)name;
+    p.type = type;
+    p.size = size;
+    p.ndims = (int)ndims;
+    /* Array elements are unquoted by the JSON parser */
+    if (dlite_property_scan(*value, ptr, &p, dims,
+                            (ndims) ? 0 : dliteFlagQuoted) < 0)
+      return errx(1, "cas: cannot parse property '%s' of '%s'",
+                  name, d->uuid);
+    return 0;
+  }
+  if (!(value = map_get(&cd->blobs, name)))
+    return errx(1, "cas: no property '%s' in instance '%s'", name, d->uuid);
+  if (dlite_type_set_typename(type, size, typename, sizeof(typename)))
+    return 1;
+  if (strncmp(*value, typename, strlen(typename)) != 0 ||
+      (*value)[strlen(typename)] != ':')
+    return errx(1, "cas: property '%s' of '%s' is stored as %.*s, not %s",
+                name, d->uuid, (int)(strchr(*value, ':') - *value), *value,
+                typename);
+  for (i=0; i<ndims; i++) len *= dims[i];
+  return get_blob((CasStorage *)d->s, strchr(*value, ':') + 1, ptr, len);
+}
+
+
+/********************************************************************
+ * Optional api
+ ********************************************************************/
+
+/**
+  Sets metadata uri.  Returns non-zero on error.
+*/
+int cas_set_meta_uri(DLiteDataModel *d, const char *uri)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  if (cd->metauri) free(cd->metauri);
+  if (!(cd->metauri = strdup(uri))) return err(1, "allocation failure");
+  cd->modified = 1;
+  return 0;
+}
+
+
+/**
+  Sets size of dimension `name`.  Returns non-zero on error.
+*/
+int cas_set_dimension_size(DLiteDataModel *d, const char *name, size_t size)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  if (map_set(&cd->dims, name, (int)size))
+    return errx(1, "cas: cannot set dimension '%s'", name);
+  cd->modified = 1;
+  return 0;
+}
+
+
+/**
+  Sets property `name` to the memory pointed to by `ptr`.  Large arrays
+  are stored as blobs, which are only written if they don't already
+  exist.  Returns non-zero on error.
+*/
+int cas_set_property(DLiteDataModel *d, const char *name, const void *ptr,
+                     DLiteType type, size_t size,
+                     size_t ndims, const size_t *dims)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  CasStorage *cs = (CasStorage *)d->s;
+  char **old, *buf=NULL;
+  size_t n=0, i, len=size;
+  DLiteProperty p;
+
+  for (i=0; i<ndims; i++) len *= dims[i];
+  if (ndims > 0 && len > 0 && len >= cs->minsize && cas_supported(type)) {
+    char hash[CAS_HASHLEN+1], typename[32], *ref;
+    if (dlite_type_set_typename(type, size, typename, sizeof(typename)) ||
+        put_blob(cs, hash, ptr, len, d->uuid)) return 1;
+    if (!(ref = aprintf("%s:%s", typename, hash)))
+      return err(1, "allocation failure");
+    if ((old = map_get(&cd->props, name))) {
+      free(*old);
+      map_remove(&cd->props, name);
+    }
+    if ((old = map_get(&cd->blobs, name))) free(*old);
+    if (map_set(&cd->blobs, name, ref)) {
+      free(ref);
+      return errx(1, "cas: cannot set property '%s'", name);
+    }
+    cd->modified = 1;
+    return 0;
+  }
+
+  memset(&p, 0, sizeof(p));
+  p.name = (char *)name;
+  p.type = type;
+  p.size = size;
+  p.ndims = (int)ndims;
+  if (dlite_property_aprint(&buf, &n, 0, ptr, &p, dims, 0, -2,
+                            dliteFlagQuoted) < 0) {
+    if (buf) free(buf);
+    return errx(1, "cas: cannot serialise property '%s'", name);
+  }
+  if ((old = map_get(&cd->blobs, name))) {
+    free(*old);
+    map_remove(&cd->blobs, name);
+  }
+  if ((old = map_get(&cd->props, name))) free(*old);
+  if (map_set(&cd->props, name, buf)) {
+    free(buf);
+    return errx(1, "cas: cannot set property '%s'", name);
+  }
+  cd->modified = 1;
+  return 0;
+}
+
+
+/**
+  Returns a NULL-terminated array of string pointers to instance UUID's.
+  The caller is responsible to free the returned array.
+
+  Returns NULL on error.
+*/
+char **cas_get_uuids(const DLiteStorage *s)
+{
+  CasStorage *cs = (CasStorage *)s;
+  FUDir *dir;
+  const char *fname;
+  char *path, **uuids=NULL, **p;
+  size_t n=0, size=0;
+
+  if (!(path = aprintf("%s/instances", cs->root)))
+    return err(1, "allocation failure"), NULL;
+  dir = fu_opendir(path);
+  free(path);
+  if (!(uuids = calloc(1, sizeof(char *))))
+    return err(1, "allocation failure"), NULL;
+  if (!dir) {
+    err_clear();
+    return uuids;
+  }
+  while ((fname = fu_nextfile(dir))) {
+    if (strlen(fname) != DLITE_UUID_LENGTH + 5 ||
+        strcmp(fname + DLITE_UUID_LENGTH, ".json") != 0) continue;
+    if (n + 1 >= size) {
+      size = (size) ? 2*size : 16;
+      if (!(p = realloc(uuids, size*sizeof(char *)))) goto fail;
+      uuids = p;
+    }
+    if (!(uuids[n] = strndup(fname, DLITE_UUID_LENGTH))) goto fail;
+    uuids[++n] = NULL;
+  }
+  fu_closedir(dir);
+  return uuids;
+ fail:
+  fu_closedir(dir);
+  while (n > 0) free(uuids[--n]);
+  free(uuids);
+  return err(1, "allocation failure"), NULL;
+}
+
+
+/**
+  Returns a positive value if dimension `name` is defined, zero if it
+  isn't and a negative value on error.
+ */
+int cas_has_dimension(const DLiteDataModel *d, const char *name)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  return map_get(&cd->dims, name) != NULL;
+}
+
+
+/**
+  Returns a positive value if property `name` is defined, zero if it
+  isn't and a negative value on error.
+ */
+int cas_has_property(const DLiteDataModel *d, const char *name)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  return map_get(&cd->props, name) != NULL ||
+    map_get(&cd->blobs, name) != NULL;
+}
+
+
+/**
+  If the uuid was generated from a unique name, return a pointer to a
+  newly malloc'ed string with this name.  Otherwise NULL is returned.
+*/
+char *cas_get_dataname(const DLiteDataModel *d)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  return (cd->dataname) ? strdup(cd->dataname) : NULL;
+}
+
+
+/**
+  Gives the instance a name.  This function should only be called
+  if the uuid was generated from `name`.
+  Returns non-zero on error.
+*/
+int cas_set_dataname(DLiteDataModel *d, const char *name)
+{
+  CasDataModel *cd = (CasDataModel *)d;
+  if (cd->dataname) free(cd->dataname);
+  if (!(cd->dataname = strdup(name))) return err(1, "allocation failure");
+  cd->modified = 1;
+  return 0;
+}
+
+
+static DLiteStoragePlugin cas_plugin = {
+  /* head */
+  "cas",                    /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  cas_open,                 /* open */
+  cas_close,                /* close */
+
+  /* queue api */
+  NULL,                     /* iterCreate */
+  NULL,                     /* iterNext */
+  NULL,                     /* iterFree */
+  cas_get_uuids,            /* getUUIDs */
+
+  /* direct api */
+  NULL,                     /* loadInstance */
+  NULL,                     /* saveInstance */
+  NULL,                     /* loadInstances */
+  NULL,                     /* saveInstances */
+
+  /* datamodel api */
+  cas_datamodel,            /* dataModel */
+  cas_datamodel_free,       /* dataModelFree */
+
+  cas_get_meta_uri,         /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  cas_get_dimension_size,   /* getDimensionSize */
+  cas_get_property,         /* getProperty */
+
+  /* -- datamodel api (optional) */
+  cas_set_meta_uri,         /* setMetaURI */
+  cas_set_dimension_size,   /* setDimensionSize */
+  cas_set_property,         /* setProperty */
+
+  cas_has_dimension,        /* hasDimension */
+  cas_has_property,         /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  cas_get_dataname,         /* getDataName */
+  cas_set_dataname,         /* setDataName */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &cas_plugin;
+}
@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "utils/strutils.h"
+#include "utils/fileutils.h"
+#include "utils/sha3.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+
+#define N 1000
+#define M 3
+
+char root[64];
+char *uri = "http://onto-ns.com/meta/0.1/CasTestEntity";
+DLiteMeta *entity=NULL;
+char uuid1[DLITE_UUID_LENGTH+1];
+char uuid2[DLITE_UUID_LENGTH+1];
+
+
+/* Returns a new instance, where the mesh only depends on `n` and
+   values are scaled by `scale`. */
+static DLiteInstance *new_instance(size_t n, double scale)
+{
+  DLiteInstance *inst;
+  size_t i, dims[] = {n, M};
+  char *name = "cas";
+  double *mesh, *values;
+  if (!(inst = dlite_instance_create(entity, dims, NULL))) return NULL;
+  dlite_instance_set_property(inst, "name", &name);
+  mesh = dlite_instance_get_property(inst, "mesh");
+  values = dlite_instance_get_property(inst, "values");
+  for (i=0; i<n; i++) mesh[i] = i * 0.5;
+  for (i=0; i<M; i++) values[i] = i * scale;
+  return inst;
+}
+
+/* Returns the number of entries in directory `path`, excluding "." and
+   "..".  If `clear` is non-zero, the directory is also removed. */
+static int count_entries(const char *path, int clear)
+{
+  FUDir *dir;
+  const char *fname;
+  int n=0;
+  if (!(dir = fu_opendir(path))) return 0;
+  while ((fname = fu_nextfile(dir))) {
+    char *sub;
+    if (strcmp(fname, ".") == 0 || strcmp(fname, "..") == 0) continue;
+    n++;
+    if (clear && (sub = aprintf("%s/%s", path, fname))) {
+      if (remove(sub)) count_entries(sub, 1);
+      free(sub);
+    }
+  }
+  fu_closedir(dir);
+  if (clear) remove(path);
+  return n;
+}
+
+
+MU_TEST(test_create)
+{
+  char *dims1[] = {"N"}, *dims2[] = {"M"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of mesh points."},
+    {"M", "Number of values."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims  unit iri  descr */
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL,  "",  NULL, "Name."},
+    {"mesh",   dliteFloat,     sizeof(double), 1, dims1, "m", NULL, "Mesh."},
+    {"values", dliteFloat,     sizeof(double), 1, dims2, "K", NULL, "Values."}
+  };
+  snprintf(root, sizeof(root), "test-cas-%d", (int)getpid());
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Test entity.",
+                                                    NULL,
+                                                    2, dimensions,
+                                                    3, properties)));
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  sha3_context c;
+  FILE *fp;
+  size_t i;
+  double mesh[N];
+  char *path, hash[65];
+  mu_check((s = dlite_storage_open("cas", root, NULL)));
+  mu_check((inst = new_instance(N, 1.0)));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  strcpy(uuid1, inst->uuid);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* The same mesh is only stored once, also from another session */
+  mu_check((s = dlite_storage_open("cas", root, "mode=w")));
+  mu_check((inst = new_instance(N, 2.0)));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  strcpy(uuid2, inst->uuid);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  mu_check((path = aprintf("%s/instances", root)));
+  mu_assert_int_eq(2, count_entries(path, 0));
+  free(path);
+  mu_check((path = aprintf("%s/blobs", root)));
+  mu_assert_int_eq(1, count_entries(path, 0));
+  free(path);
+
+  /* The blob is named by the SHA3-256 hash of the mesh */
+  for (i=0; i<N; i++) mesh[i] = i * 0.5;
+  sha3_Init256(&c);
+  sha3_Update(&c, mesh, sizeof(mesh));
+  mu_assert_int_eq(64, strhex(hash, sizeof(hash), sha3_Finalize(&c), 32));
+  mu_check((path = aprintf("%s/blobs/%.2s/%s", root, hash, hash+2)));
+  mu_check((fp = fopen(path, "rb")));
+  fclose(fp);
+  free(path);
+
+  /* A smaller min size also stores the small values as blobs */
+  mu_check((s = dlite_storage_open("cas", root, "minsize=0")));
+  mu_check((inst = new_instance(N, 2.0)));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_check((path = aprintf("%s/blobs", root)));
+  mu_check(count_entries(path, 0) >= 2);
+  free(path);
+}
+
+MU_TEST(test_load)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  double *mesh, *values;
+  mu_check((s = dlite_storage_open("cas", root, "mode=r")));
+  mu_check((inst = dlite_instance_load(s, uuid2)));
+  mu_assert_string_eq("cas", *(char **)dlite_instance_get_property(inst,
+                                                                   "name"));
+  mu_assert_int_eq(N, dlite_instance_get_dimension_size(inst, "N"));
+  mesh = dlite_instance_get_property(inst, "mesh");
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(0.5, mesh[1]);
+  mu_assert_double_eq((N - 1) * 0.5, mesh[N-1]);
+  mu_assert_double_eq(4.0, values[2]);
+  dlite_instance_decref(inst);
+
+  mu_check((inst = dlite_instance_load(s, uuid1)));
+  mesh = dlite_instance_get_property(inst, "mesh");
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq((N - 1) * 0.5, mesh[N-1]);
+  mu_assert_double_eq(2.0, values[2]);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_iter)
+{
+  DLiteStorage *s;
+  char **uuids;
+  int n=0;
+  mu_check((s = dlite_storage_open("cas", root, "mode=r")));
+  mu_check((uuids = dlite_storage_uuids(s, NULL)));
+  while (uuids[n]) n++;
+  mu_assert_int_eq(3, n);
+  dlite_storage_uuids_free(uuids);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_errors)
+{
+  DLiteStorage *s;
+  char *path;
+  err_clear();
+  mu_check(!dlite_storage_open("cas", root, "mode=x"));
+  mu_check(!dlite_storage_open("cas", root, "minsize=-1"));
+  mu_check((s = dlite_storage_open("cas", root, "mode=r")));
+  mu_check(!dlite_instance_load(s, "no-such-instance"));
+
+  /* Missing blobs are detected */
+  mu_check((path = aprintf("%s/blobs", root)));
+  count_entries(path, 1);
+  free(path);
+  mu_check(!dlite_instance_load(s, uuid1));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  err_clear();
+}
+
+MU_TEST(test_teardown)
+{
+  count_entries(root, 1);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_create);     /* setup */
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_iter);
+  MU_RUN_TEST(test_errors);
+  MU_RUN_TEST(test_teardown);   /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,1275 @@
+/* dlite-csv-storage.c -- DLite storage plugin for CSV files */
+
+/*
+  This plugin, with driver name "csvstream", reads a CSV file into a
+  single instance, whose properties are one-dimensional arrays along
+  the rows of the table.  Columns are mapped to properties by
+  position.  The metadata is either given with the `meta` option or
+  inferred from the header and the values in the first chunk of the
+  file.
+
+  The file is read in chunks of fixed size.  Rows are appended to the
+  instance chunk by chunk, using the amortised growing of dimensions
+  provided by dlite_instance_append_dimension().  The values are
+  converted directly into the property arrays, such that only one
+  copy of the data is kept in memory.
+
+  With the `threads` option, the file is split into segments at line
+  boundaries that are parsed in parallel.  This is done in two passes.
+  The first pass counts the rows of each segment, which gives the total
+  number of rows and the first row of each segment.  The second pass
+  parses each segment into its rows of the instance.  If a quoted
+  field containing a newline is found, the segments cannot be located
+  reliably and the file is parsed sequentially instead.
+
+  Saving writes the instance as a table with one column per property
+  and a header with the property names and units.
+
+  The driver name "csv" is used by the pandas-based Python plugin,
+  which supports other options and formats.
+ */
+#include <assert.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/sha3.h"
+#include "utils/strtob.h"
+#include "utils/strutils.h"
+#include "utils/scheduler.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+
+/* Default chunk size in bytes */
+#define CHUNKSIZE 1048576
+
+/* Minimum chunk size in bytes */
+#define MIN_CHUNKSIZE 16
+
+/* Maximum number of parsing threads */
+#define MAX_THREADS 64
+
+/* Size of error message buffers */
+#define ERRSIZE 256
+
+
+/* Storage for CSV files */
+typedef struct {
+  DLiteStorage_HEAD
+  char delim;          /* Field delimiter */
+  char quote;          /* Quote character */
+  int header;          /* Whether the first row is a header */
+  int infer;           /* Whether to infer metadata, -1 if not given */
+  char *meta;          /* Metadata uri, NULL if not given */
+  char *id;            /* Id of loaded instance, NULL if not given */
+  size_t chunksize;    /* Chunk size in bytes */
+  int nthreads;        /* Number of parsing threads */
+} CsvStorage;
+
+/* A record in the chunk buffer.  `end` points to the terminating
+   newline or the end of the data. */
+typedef struct {
+  char *start;
+  char *end;
+} Record;
+
+/* Reads a segment of a file in chunks and splits it into records */
+typedef struct {
+  FILE *fp;
+  char *buf;           /* Buffer, allocated with one extra byte */
+  size_t size;         /* Size of buffer, excluding the extra byte */
+  size_t len;          /* Number of bytes in buffer */
+  size_t pos;          /* Start of unprocessed data in buffer */
+  long offset;         /* File offset of buf[0] */
+  long remaining;      /* Bytes left to read in segment, -1 until EOF */
+  int eof;             /* Whether the end of the segment is reached */
+  char quote;          /* Quote character */
+  int quoted_nl;       /* Whether a newline in a quoted field is found */
+  Record *recs;        /* Records in buffer */
+  size_t nrecs;        /* Allocated number of records */
+} Chunker;
+
+/* Column type flags used for inferring metadata */
+enum {
+  colInt=1,
+  colFloat=2,
+  colBool=4,
+  colString=8
+};
+
+/* A file segment parsed by a task */
+typedef struct {
+  const CsvStorage *cs;
+  const char *location;
+  long start;          /* File offset of first byte */
+  long stop;           /* File offset after last byte */
+  DLiteInstance *inst; /* Instance to parse into, NULL for counting */
+  int rowdim;          /* Index of rows dimension */
+  size_t row0;         /* First row of the segment */
+  size_t nrows;        /* Number of rows in the segment */
+  int quoted_nl;       /* Whether a newline in a quoted field is found */
+  int stat;            /* Non-zero on error */
+  char errmsg[ERRSIZE];
+} Segment;
+
+
+/***************************************************************
+ * Scanning
+ ***************************************************************/
+
+/* Returns a pointer to the newline terminating the record starting at
+   `p` or NULL if there is no complete record before `end`.  Newlines
+   in quoted fields do not terminate records.  `*quoted_nl` is set to
+   1 if such a newline is found. */
+static char *record_end(char *p, char *end, char quote, int *quoted_nl)
+{
+  char *nl, *q;
+  int inquote=0;
+  if (!(nl = memchr(p, '\n', end - p))) {
+    if (!memchr(p, quote, end - p)) return NULL;
+  } else if (!memchr(p, quote, nl - p)) {
+    /* Fast path: no quotes in record */
+    return nl;
+  }
+  for (q=p; q<end; q++) {
+    if (*q == quote) {
+      inquote = !inquote;
+    } else if (*q == '\n') {
+      if (!inquote) return q;
+      *quoted_nl = 1;
+    }
+  }
+  return NULL;
+}
+
+/* Returns non-zero if the record from `start` to `end` is blank. */
+static int is_blank(const char *start, const char *end)
+{
+  return (end == start || (end == start + 1 && *start == '\r'));
+}
+
+/* Splits the record from `p` to `end` into fields, which are
+   unquoted and NUL-terminated in place.  Pointers to the first
+   `nmax` fields are stored in `fields`.
+
+   Returns the number of fields in the record. */
+static int split_record(char *p, char *end, char delim, char quote,
+                        char **fields, int nmax)
+{
+  int n=0;
+  if (end > p && end[-1] == '\r') end--;
+  *end = '\0';
+  while (1) {
+    char *field=p, *d;
+    if (*p == quote) {
+      char *w=p++;
+      while (p < end) {
+        if (*p == quote) {
+          if (p + 1 < end && p[1] == quote) {
+            *w++ = quote;
+            p += 2;
+            continue;
+          }
+          p++;
+          break;
+        }
+        *w++ = *p++;
+      }
+      d = memchr(p, delim, end - p);
+      *w = '\0';
+    } else {
+      if ((d = memchr(p, delim, end - p))) *d = '\0';
+    }
+    if (n < nmax) fields[n] = field;
+    n++;
+    if (!d) break;
+    p = d + 1;
+  }
+  return n;
+}
+
+
+/***************************************************************
+ * Reading chunks
+ ***************************************************************/
+
+/* Initialises chunker `c` for reading `fp` from offset `start` to
+   `stop`.  If `stop` is negative, `fp` is read until EOF.  Returns
+   non-zero on error. */
+static int chunker_init(Chunker *c, FILE *fp, size_t chunksize, long start,
+                        long stop, char quote)
+{
+  memset(c, 0, sizeof(Chunker));
+  c->fp = fp;
+  c->size = chunksize;
+  c->offset = start;
+  c->remaining = (stop < 0) ? -1 : stop - start;
+  c->quote = quote;
+  if (!(c->buf = malloc(c->size + 1))) return 1;
+  if (start > 0 && fseek(fp, start, SEEK_SET)) return 1;
+  return 0;
+}
+
+/* Releases resources held by `c`. */
+static void chunker_deinit(Chunker *c)
+{
+  if (c->buf) free(c->buf);
+  if (c->recs) free(c->recs);
+  memset(c, 0, sizeof(Chunker));
+}
+
+/* Moves unprocessed data to the start of the buffer and reads more
+   data.  The buffer is doubled if it is full.  Returns non-zero on
+   error. */
+static int chunker_fill(Chunker *c)
+{
+  size_t n, toread;
+  if (c->pos) {
+    memmove(c->buf, c->buf + c->pos, c->len - c->pos);
+    c->offset += c->pos;
+    c->len -= c->pos;
+    c->pos = 0;
+  }
+  if (c->len == c->size) {
+    char *buf = realloc(c->buf, 2*c->size + 1);
+    if (!buf) return 1;
+    c->buf = buf;
+    c->size *= 2;
+  }
+  toread = c->size - c->len;
+  if (c->remaining >= 0 && toread > (size_t)c->remaining)
+    toread = c->remaining;
+  n = fread(c->buf + c->len, 1, toread, c->fp);
+  if (n < toread && ferror(c->fp)) return 1;
+  c->len += n;
+  if (c->remaining >= 0) c->remaining -= n;
+  if (n == 0 || c->remaining == 0 || feof(c->fp)) c->eof = 1;
+  return 0;
+}
+
+/* Reads the next complete records into `c->recs`.  The records are
+   valid until the next call.  Returns the number of records, zero at
+   the end of the segment and -1 on error. */
+static int chunker_next(Chunker *c)
+{
+  size_t n=0;
+  while (1) {
+    char *p = c->buf + c->pos, *end = c->buf + c->len, *q;
+    while (p < end) {
+      if (!(q = record_end(p, end, c->quote, &c->quoted_nl))) {
+        if (!c->eof) break;
+        q = end;  /* last record without newline */
+      }
+      if (n >= c->nrecs) {
+        size_t nrecs = (c->nrecs) ? 2*c->nrecs : 1024;
+        Record *recs = realloc(c->recs, nrecs * sizeof(Record));
+        if (!recs) return -1;
+        c->recs = recs;
+        c->nrecs = nrecs;
+      }
+      c->recs[n].start = p;
+      c->recs[n].end = q;
+      n++;
+      p = (q < end) ? q + 1 : end;
+    }
+    c->pos = p - c->buf;
+    if (n > 0 || (c->eof && c->pos == c->len)) return n;
+    if (chunker_fill(c)) return -1;
+  }
+}
+
+
+/***************************************************************
+ * Values
+ ***************************************************************/
+
+/* Returns non-zero if `s` only contains whitespace. */
+static int is_space(const char *s)
+{
+  while (isspace(*s)) s++;
+  return *s == '\0';
+}
+
+/* Converts field `s` to a value of type `type` and size `size` and
+   stores it in `ptr`.  Empty fields are converted to zero, NaN,
+   false or NULL.  Returns non-zero if `s` is not a valid value. */
+static int convert(const char *s, void *ptr, DLiteType type, size_t size)
+{
+  char *endptr;
+  int empty = is_space(s);
+
+  switch (type) {
+  case dliteBool:
+    {
+      int v = (empty) ? 0 : strtob(s, &endptr);
+      if (!empty && (v < 0 || !is_space(endptr))) return 1;
+      *(bool *)ptr = v;
+    }
+    return 0;
+
+  case dliteInt:
+    {
+      long long v = 0;
+      if (!empty) {
+        v = strtoll(s, &endptr, 10);
+        if (!is_space(endptr)) return 1;
+      }
+      switch (size) {
+      case 1:
+        if (v < INT8_MIN || v > INT8_MAX) return 1;
+        *(int8_t *)ptr = v;
+        return 0;
+      case 2:
+        if (v < INT16_MIN || v > INT16_MAX) return 1;
+        *(int16_t *)ptr = v;
+        return 0;
+      case 4:
+        if (v < INT32_MIN || v > INT32_MAX) return 1;
+        *(int32_t *)ptr = v;
+        return 0;
+      case 8:
+        *(int64_t *)ptr = v;
+        return 0;
+      }
+    }
+    return 1;
+
+  case dliteUInt:
+    {
+      unsigned long long v = 0;
+      if (!empty) {
+        while (isspace(*s)) s++;
+        if (*s == '-') return 1;
+        v = strtoull(s, &endptr, 10);
+        if (!is_space(endptr)) return 1;
+      }
+      switch (size) {
+      case 1:
+        if (v > UINT8_MAX) return 1;
+        *(uint8_t *)ptr = v;
+        return 0;
+      case 2:
+        if (v > UINT16_MAX) return 1;
+        *(uint16_t *)ptr = v;
+        return 0;
+      case 4:
+        if (v > UINT32_MAX) return 1;
+        *(uint32_t *)ptr = v;
+        return 0;
+      case 8:
+        *(uint64_t *)ptr = v;
+        return 0;
+      }
+    }
+    return 1;
+
+  case dliteFloat:
+    {
+      double v = NAN;
+      if (!empty) {
+        v = strtod(s, &endptr);
+        if (!is_space(endptr)) return 1;
+      }
+      switch (size) {
+      case sizeof(float):
+        *(float *)ptr = v;
+        return 0;
+      case sizeof(double):
+        *(double *)ptr = v;
+        return 0;
+      case sizeof(long double):
+        *(long double *)ptr = v;
+        return 0;
+      }
+    }
+    return 1;
+
+  case dliteFixString:
+    strncpy(ptr, s, size);
+    ((char *)ptr)[size-1] = '\0';
+    return 0;
+
+  case dliteStringPtr:
+    {
+      char **p = ptr;
+      if (*p) free(*p);
+      *p = NULL;
+      if (*s && !(*p = strdup(s))) return 1;
+    }
+    return 0;
+
+  default:
+    return 1;
+  }
+}
+
+/* Returns the column type flag of field `s`, or zero if it is empty. */
+static int field_type(const char *s)
+{
+  char *endptr;
+  if (is_space(s)) return 0;
+  strtoll(s, &endptr, 10);
+  if (is_space(endptr)) return colInt;
+  strtod(s, &endptr);
+  if (is_space(endptr)) return colFloat;
+  while (isspace(*s)) s++;
+  if ((strncasecmp(s, "true", 4) == 0 && is_space(s + 4)) ||
+      (strncasecmp(s, "false", 5) == 0 && is_space(s + 5))) return colBool;
+  return colString;
+}
+
+/* Returns the type name corresponding to column type flags `flags`. */
+static const char *column_typename(int flags)
+{
+  if (flags & colString) return "string";
+  if ((flags & colBool) && (flags & (colInt | colFloat))) return "string";
+  if (flags & colBool) return "bool";
+  if (flags & colFloat) return "float64";
+  if (flags & colInt) return "int64";
+  return "float64";  /* empty columns, like pandas */
+}
+
+
+/***************************************************************
+ * Metadata
+ ***************************************************************/
+
+/* Returns a pointer to the last occurrence of `c` in the `n` first
+   bytes of `s`, or NULL if `c` is not found. */
+static const char *find_last(const char *s, int c, size_t n)
+{
+  while (n-- > 0) if (s[n] == c) return s + n;
+  return NULL;
+}
+
+/* Returns a newly allocated property name inferred from column name
+   `s`.  Quotes, surrounding spaces and units in parentheses or
+   brackets are removed and spaces are replaced with underscores. */
+static char *infer_prop_name(const char *s, int col)
+{
+  const char *end, *p;
+  char *name, *q;
+  while (*s == ' ' || *s == '"') s++;
+  end = s + strlen(s);
+  while (end > s && (end[-1] == ' ' || end[-1] == '"')) end--;
+  if ((p = find_last(s, '(', end - s)) || (p = find_last(s, '[', end - s)))
+    end = p;
+  while (end > s && isspace(end[-1])) end--;
+  if (end == s) return aprintf("col%d", col);
+  if (!(name = strndup(s, end - s))) return NULL;
+  for (q=name; *q; q++) if (*q == ' ') *q = '_';
+  return name;
+}
+
+/* Returns a newly allocated unit inferred from column name `s` or
+   NULL if the column name has no unit. */
+static char *infer_prop_unit(const char *s)
+{
+  const char *end, *p;
+  char close;
+  while (*s == ' ' || *s == '"') s++;
+  end = s + strlen(s);
+  while (end > s && (end[-1] == ' ' || end[-1] == '"')) end--;
+  if ((p = find_last(s, '(', end - s))) close = ')';
+  else if ((p = find_last(s, '[', end - s))) close = ']';
+  else return NULL;
+  p++;
+  while (isspace(*p)) p++;
+  while (end > p && isspace(end[-1])) end--;
+  if (end > p && end[-1] == close) end--;
+  while (end > p && isspace(end[-1])) end--;
+  return strndup(p, end - p);
+}
+
+/* Returns the index of the dimension along which all properties of
+   `meta` are arrays, or -1 if `meta` cannot describe a table. */
+static int rows_dimension(const DLiteMeta *meta)
+{
+  const char *dim=NULL;
+  size_t i;
+  if (meta->_nproperties == 0)
+    return errx(-1, "csvstream: metadata has no properties: %s", meta->uri);
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    if (p->ndims != 1)
+      return errx(-1, "csvstream: property \"%s\" of %s must be one-dimensional",
+                  p->name, meta->uri);
+    if (dim && strcmp(dim, p->dims[0]))
+      return errx(-1, "csvstream: all properties of %s must have the same "
+                  "dimension", meta->uri);
+    dim = p->dims[0];
+    switch (p->type) {
+    case dliteBool:
+    case dliteInt:
+    case dliteUInt:
+    case dliteFloat:
+    case dliteFixString:
+    case dliteStringPtr:
+      break;
+    default:
+      return errx(-1, "csvstream: unsupported type of property \"%s\" of %s",
+                  p->name, meta->uri);
+    }
+  }
+  return dlite_meta_get_dimension_index(meta, dim);
+}
+
+/* Returns new metadata inferred from the column names `names` and the
+   column type flags `flags` of the `ncols` columns.  `uri` is the uri
+   of the metadata.  If it is NULL, it is generated from a hash of the
+   names and types.  Returns NULL on error. */
+static DLiteMeta *infer_meta(const char *uri, const char *location,
+                             char **names, const int *flags, int ncols)
+{
+  DLiteDimension dims[] = {{"rows", "Number of rows."}};
+  char *pdims[] = {"rows"};
+  DLiteProperty *props=NULL;
+  DLiteMeta *meta=NULL;
+  DLiteInstance *existing;
+  char *gen=NULL, *descr=NULL;
+  int i;
+
+  if (!(props = calloc(ncols, sizeof(DLiteProperty))))
+    FAIL("allocation failure");
+  for (i=0; i<ncols; i++) {
+    DLiteProperty *p = props + i;
+    if (!(p->name = infer_prop_name(names[i], i)))
+      FAIL("allocation failure");
+    p->unit = infer_prop_unit(names[i]);
+    if (dlite_type_set_dtype_and_size(column_typename(flags[i]),
+                                      &p->type, &p->size)) goto fail;
+    p->ndims = 1;
+    p->dims = pdims;
+  }
+
+  if (!uri) {
+    sha3_context c;
+    const uint8_t *hash;
+    char hex[65];
+    sha3_Init256(&c);
+    for (i=0; i<ncols; i++) {
+      const char *type = column_typename(flags[i]);
+      sha3_Update(&c, names[i], strlen(names[i]) + 1);
+      sha3_Update(&c, type, strlen(type) + 1);
+    }
+    hash = sha3_Finalize(&c);
+    for (i=0; i<32; i++) snprintf(hex + 2*i, 3, "%02x", hash[i]);
+    if (!(gen = aprintf("onto-ns.com/meta/1.0/generated_from_csv_%s", hex)))
+      FAIL("allocation failure");
+    uri = gen;
+  }
+
+  if ((existing = dlite_instance_has(uri, 0))) {
+    if (!dlite_instance_is_meta(existing))
+      FAIL1("csvstream: \"%s\" is not metadata", uri);
+    meta = (DLiteMeta *)existing;
+    dlite_meta_incref(meta);
+  } else {
+    if (!(descr = aprintf("Inferred metadata for %s", location)))
+      FAIL("allocation failure");
+    meta = dlite_meta_create(uri, NULL, descr, 1, dims, ncols, props);
+  }
+ fail:
+  if (props) {
+    for (i=0; i<ncols; i++) {
+      if (props[i].name) free(props[i].name);
+      if (props[i].unit) free(props[i].unit);
+    }
+    free(props);
+  }
+  if (gen) free(gen);
+  if (descr) free(descr);
+  return meta;
+}
+
+
+/***************************************************************
+ * Parsing
+ ***************************************************************/
+
+/* Parses the record `rec` into row `row` of `inst`.  `fields` is a
+   work array with room for one pointer per property.  On error, a
+   message is written to `errmsg` and non-zero is returned. */
+static int parse_record(const CsvStorage *cs, const Record *rec,
+                        DLiteInstance *inst, size_t row, char **fields,
+                        char *errmsg)
+{
+  const DLiteMeta *meta = inst->meta;
+  int i, n, nprops = meta->_nproperties;
+  n = split_record(rec->start, rec->end, cs->delim, cs->quote, fields,
+                   nprops);
+  if (n < nprops) {
+    snprintf(errmsg, ERRSIZE, "expected %d fields in row %lu, got %d",
+             nprops, (unsigned long)row + 1, n);
+    return 1;
+  }
+  for (i=0; i<nprops; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    char *ptr = *(char **)DLITE_PROP(inst, i) + row * p->size;
+    if (convert(fields[i], ptr, p->type, p->size)) {
+      snprintf(errmsg, ERRSIZE, "invalid value of \"%s\" in row %lu: '%s'",
+               p->name, (unsigned long)row + 1, fields[i]);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Counts or parses (if `seg->inst` is not NULL) the rows of a
+   segment. */
+static void parse_segment(Segment *seg)
+{
+  const CsvStorage *cs = seg->cs;
+  Chunker c;
+  FILE *fp;
+  char **fields=NULL;
+  size_t row = seg->row0;
+  int i, n;
+
+  if (!(fp = fopen(seg->location, "rb"))) {
+    snprintf(seg->errmsg, ERRSIZE, "cannot open \"%s\"", seg->location);
+    seg->stat = 1;
+    return;
+  }
+  if (chunker_init(&c, fp, cs->chunksize, seg->start, seg->stop,
+                   cs->quote) ||
+      (seg->inst && !(fields = calloc(seg->inst->meta->_nproperties,
+                                      sizeof(char *))))) {
+    snprintf(seg->errmsg, ERRSIZE, "cannot read \"%s\"", seg->location);
+    seg->stat = 1;
+  }
+  while (!seg->stat && (n = chunker_next(&c)) > 0) {
+    for (i=0; i<n; i++) {
+      Record *rec = c.recs + i;
+      if (is_blank(rec->start, rec->end)) continue;
+      if (seg->inst && parse_record(cs, rec, seg->inst, row, fields,
+                                    seg->errmsg)) {
+        seg->stat = 1;
+        break;
+      }
+      row++;
+    }
+  }
+  if (!seg->stat && n < 0) {
+    snprintf(seg->errmsg, ERRSIZE, "error reading \"%s\"", seg->location);
+    seg->stat = 1;
+  }
+  seg->nrows = row - seg->row0;
+  seg->quoted_nl = c.quoted_nl;
+  chunker_deinit(&c);
+  if (fields) free(fields);
+  fclose(fp);
+}
+
+/* Task parsing segments `begin` to `end` of the array `arg`. */
+static void parse_segments(size_t begin, size_t end, void *arg)
+{
+  Segment *segs = arg;
+  size_t i;
+  for (i=begin; i<end; i++) parse_segment(segs + i);
+}
+
+/* Parses all `n` segments in parallel with the shared task scheduler.
+   Returns non-zero on error. */
+static int run_segments(Segment *segs, int n)
+{
+  int i;
+  sched_parallel_for(n, 1, parse_segments, segs);
+  for (i=0; i<n; i++)
+    if (segs[i].stat) return errx(1, "csvstream: %s", segs[i].errmsg);
+  return 0;
+}
+
+/* Returns the file offset of the first record starting at or after
+   `offset` in `fp` or -1 on error. */
+static long find_record_start(FILE *fp, long offset)
+{
+  int ch;
+  if (fseek(fp, offset - 1, SEEK_SET)) return -1;
+  while ((ch = getc(fp)) != EOF && ch != '\n');
+  return ftell(fp);
+}
+
+/* Parses the rows of `location` from offset `start` to `stop` in
+   parallel into a new instance of `meta`.  `rowdim` is the index of
+   the rows dimension.
+
+   Returns the new instance or NULL on error.  If a newline in a quoted
+   field is found, NULL is returned and `*fallback` is set to 1. */
+static DLiteInstance *parse_parallel(const CsvStorage *cs,
+                                     const char *location,
+                                     DLiteMeta *meta, int rowdim,
+                                     const char *id, long start, long stop,
+                                     int *fallback)
+{
+  Segment segs[MAX_THREADS];
+  DLiteInstance *inst=NULL;
+  FILE *fp;
+  size_t *dims=NULL, nrows=0;
+  long offset = start;
+  int i, n=0;
+
+  if (!(fp = fopen(location, "rb")))
+    return err(1, "csvstream: cannot open \"%s\"", location), NULL;
+  memset(segs, 0, sizeof(segs));
+  for (i=0; i<cs->nthreads && offset < stop; i++) {
+    long end = (i == cs->nthreads - 1) ? stop :
+      start + (stop - start) / cs->nthreads * (i + 1);
+    if (end < offset) end = offset;
+    if (end < stop && (end = find_record_start(fp, end)) < 0) {
+      fclose(fp);
+      return err(1, "csvstream: cannot read \"%s\"", location), NULL;
+    }
+    if (end > stop) end = stop;
+    segs[n].cs = cs;
+    segs[n].location = location;
+    segs[n].start = offset;
+    segs[n].stop = end;
+    segs[n].rowdim = rowdim;
+    n++;
+    offset = end;
+  }
+  fclose(fp);
+
+  /* First pass: count rows */
+  if (run_segments(segs, n)) return NULL;
+  for (i=0; i<n; i++) {
+    if (segs[i].quoted_nl) {
+      *fallback = 1;
+      return NULL;
+    }
+    segs[i].row0 = nrows;
+    nrows += segs[i].nrows;
+  }
+
+  /* Second pass: parse rows */
+  if (!(dims = calloc(meta->_ndimensions, sizeof(size_t))))
+    return err(1, "allocation failure"), NULL;
+  dims[rowdim] = nrows;
+  inst = dlite_instance_create(meta, dims, id);
+  free(dims);
+  if (!inst) return NULL;
+  for (i=0; i<n; i++) segs[i].inst = inst;
+  if (run_segments(segs, n)) {
+    dlite_instance_decref(inst);
+    return NULL;
+  }
+  return inst;
+}
+
+/* Parses the rows of `location` from offset `start` sequentially into
+   a new instance of `meta`.  The rows dimension, with index `rowdim`,
+   grows chunk by chunk.  `estimate` is the estimated number of rows.
+   Returns the new instance or NULL on error. */
+static DLiteInstance *parse_sequential(const CsvStorage *cs,
+                                       const char *location,
+                                       DLiteMeta *meta, int rowdim,
+                                       const char *id, long start,
+                                       size_t estimate)
+{
+  DLiteInstance *inst=NULL, *retval=NULL;
+  Chunker c;
+  FILE *fp=NULL;
+  size_t *dims=NULL, row=0;
+  char **fields=NULL, errmsg[ERRSIZE];
+  int i, n, m;
+
+  memset(&c, 0, sizeof(Chunker));
+  if (!(fp = fopen(location, "rb")))
+    FAIL1("csvstream: cannot open \"%s\"", location);
+  if (chunker_init(&c, fp, cs->chunksize, start, -1, cs->quote) ||
+      !(dims = calloc(meta->_ndimensions, sizeof(size_t))) ||
+      !(fields = calloc(meta->_nproperties, sizeof(char *))))
+    FAIL("allocation failure");
+  if (!(inst = dlite_instance_create(meta, dims, id))) goto fail;
+  if (dlite_instance_reserve_dimension_by_index(inst, rowdim, estimate))
+    goto fail;
+
+  while ((n = chunker_next(&c)) > 0) {
+    for (i=0, m=0; i<n; i++)
+      if (!is_blank(c.recs[i].start, c.recs[i].end)) m++;
+    if (dlite_instance_append_dimension_by_index(inst, rowdim, m))
+      goto fail;
+    for (i=0; i<n; i++) {
+      if (is_blank(c.recs[i].start, c.recs[i].end)) continue;
+      if (parse_record(cs, c.recs + i, inst, row++, fields, errmsg))
+        FAIL1("csvstream: %s", errmsg);
+    }
+  }
+  if (n < 0) FAIL1("csvstream: error reading \"%s\"", location);
+  retval = inst;
+ fail:
+  chunker_deinit(&c);
+  if (fp) fclose(fp);
+  if (dims) free(dims);
+  if (fields) free(fields);
+  if (!retval && inst) dlite_instance_decref(inst);
+  return retval;
+}
+
+
+/***************************************************************
+ * Writing
+ ***************************************************************/
+
+/* Writes string `s` to `fp`, quoted if needed. */
+static void write_string(FILE *fp, const char *s, char delim, char quote)
+{
+  const char *p;
+  if (!s) return;
+  if (!*s || (!strchr(s, delim) && !strchr(s, quote) && !strpbrk(s, "\r\n")
+              && !isspace(s[0]) && !isspace(s[strlen(s)-1]))) {
+    fputs(s, fp);
+    return;
+  }
+  fputc(quote, fp);
+  for (p=s; *p; p++) {
+    if (*p == quote) fputc(quote, fp);
+    fputc(*p, fp);
+  }
+  fputc(quote, fp);
+}
+
+/* Writes the value of type `type` and size `size` at `ptr` to `fp`.
+   Returns non-zero on error. */
+static int write_value(FILE *fp, const void *ptr, DLiteType type,
+                       size_t size, char delim, char quote)
+{
+  char buf[64];
+  switch (type) {
+  case dliteBool:
+    fputs((*(bool *)ptr) ? "True" : "False", fp);
+    return 0;
+  case dliteFloat:
+    {
+      double v;
+      if (dlite_type_copy_cast(&v, dliteFloat, sizeof(double), ptr, type,
+                               size)) return 1;
+      if (isnan(v)) return 0;  /* NaN is written as empty, like pandas */
+      if (dlite_type_print(buf, sizeof(buf) - 2, ptr, type, size, 0, -2,
+                           dliteFlagRaw) < 0) return 1;
+      /* Write a decimal point, such that the type is inferred correctly */
+      if (!strpbrk(buf, ".eEn")) strcat(buf, ".0");
+      fputs(buf, fp);
+    }
+    return 0;
+  case dliteInt:
+  case dliteUInt:
+    if (dlite_type_print(buf, sizeof(buf), ptr, type, size, 0, -2,
+                         dliteFlagRaw) < 0) return 1;
+    fputs(buf, fp);
+    return 0;
+  case dliteFixString:
+    write_string(fp, ptr, delim, quote);
+    return 0;
+  case dliteStringPtr:
+    write_string(fp, *(char **)ptr, delim, quote);
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+
+/***************************************************************
+ * Plugin api
+ ***************************************************************/
+
+/* Returns the delimiter given by option value `s` or -1 if it is
+   invalid. */
+static int parse_delimiter(const char *s)
+{
+  if (strcmp(s, "tab") == 0 || strcmp(s, "\\t") == 0) return '\t';
+  if (strcmp(s, "semicolon") == 0) return ';';
+  if (strcmp(s, "space") == 0) return ' ';
+  if (strcmp(s, "comma") == 0) return ',';
+  if (strlen(s) == 1 && s[0] != '\n' && s[0] != '"') return s[0];
+  return -1;
+}
+
+/**
+  Returns a new CSV storage.
+
+  Valid `options` are:
+
+  - mode : r | w
+      Whether to read or write the file.  Default is "r".
+  - meta : URI
+      URI of metadata describing the table.  Required if `infer` is
+      false.
+  - infer : bool
+      Whether to infer the metadata from the header and the first chunk
+      of the file.  Default is true, unless `meta` refers to existing
+      metadata.
+  - id : string
+      Explicit id of the loaded instance.
+  - delimiter : char
+      Field delimiter.  May also be "tab", "semicolon" or "space".
+      Default is ",".
+  - header : bool
+      Whether the first row is a header with column names.  Default is
+      true.
+  - chunksize : int
+      Size of chunks read from the file in bytes.  Default is 1048576.
+  - threads : int
+      Number of threads parsing segments of the file in parallel.
+      Default is given by the DLITE_CSV_THREADS environment variable,
+      or 1 if it is not set.
+ */
+DLiteStorage *csv_open(const DLiteStoragePlugin *api, const char *location,
+                       const char *options)
+{
+  CsvStorage *cs=NULL;
+  DLiteStorage *retval=NULL;
+  char *endptr, *threads_env = getenv("DLITE_CSV_THREADS");
+  char *mode_descr = "Whether to read or write the file.  Valid values "
+    "are: \"r\" (read, default) and \"w\" (write)";
+  DLiteOpt opts[] = {
+    {'m', "mode",      "r",    mode_descr},
+    {'M', "meta",      "",     "URI of metadata describing the table"},
+    {'i', "infer",     "",     "Whether to infer metadata"},
+    {'I', "id",        "",     "Explicit id of the loaded instance"},
+    {'d', "delimiter", ",",    "Field delimiter"},
+    {'h', "header",    "true", "Whether the first row is a header"},
+    {'c', "chunksize", "",     "Chunk size in bytes"},
+    {'t', "threads",   "",     "Number of parsing threads"},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode;
+  int delim;
+  long v;
+  UNUSED(api);
+  UNUSED(location);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+
+  if (!(cs = calloc(1, sizeof(CsvStorage)))) FAIL("allocation failure");
+  if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    cs->writable = 0;
+  } else if (strcmp(mode, "w") == 0 || strcmp(mode, "write") == 0) {
+    cs->writable = 1;
+  } else {
+    FAIL1("csvstream: invalid \"mode\" value: '%s'. Must be \"r\" (read) or "
+          "\"w\" (write)", mode);
+  }
+  if (*opts[1].value && !(cs->meta = strdup(opts[1].value)))
+    FAIL("allocation failure");
+  cs->infer = (*opts[2].value) ? atob(opts[2].value) : -1;
+  if (*opts[3].value && !(cs->id = strdup(opts[3].value)))
+    FAIL("allocation failure");
+  if ((delim = parse_delimiter(opts[4].value)) < 0)
+    FAIL1("csvstream: invalid delimiter: '%s'", opts[4].value);
+  cs->delim = delim;
+  cs->quote = '"';
+  cs->header = atob(opts[5].value);
+
+  cs->chunksize = CHUNKSIZE;
+  if (*opts[6].value) {
+    v = strtol(opts[6].value, &endptr, 10);
+    if (*endptr || v <= 0)
+      FAIL1("csvstream: invalid chunksize: '%s'", opts[6].value);
+    cs->chunksize = (v < MIN_CHUNKSIZE) ? MIN_CHUNKSIZE : v;
+  }
+
+  cs->nthreads = 1;
+  if (*opts[7].value) {
+    v = strtol(opts[7].value, &endptr, 10);
+    if (*endptr || v <= 0)
+      FAIL1("csvstream: invalid number of threads: '%s'", opts[7].value);
+    cs->nthreads = v;
+  } else if (threads_env && *threads_env) {
+    v = strtol(threads_env, &endptr, 10);
+    if (*endptr || v <= 0)
+      warnx("invalid value of DLITE_CSV_THREADS: '%s'", threads_env);
+    else
+      cs->nthreads = v;
+  }
+  if (cs->nthreads > MAX_THREADS) cs->nthreads = MAX_THREADS;
+
+  retval = (DLiteStorage *)cs;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && cs) {
+    if (cs->meta) free(cs->meta);
+    if (cs->id) free(cs->id);
+    free(cs);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  Returns non-zero on error.
+ */
+int csv_close(DLiteStorage *s)
+{
+  CsvStorage *cs = (CsvStorage *)s;
+  if (cs->meta) free(cs->meta);
+  if (cs->id) free(cs->id);
+  return 0;
+}
+
+
+/**
+  Loads the table in storage `s` and returns it as a new instance.
+  The id of the instance is given by the `id` option, or by `id` if
+  the option is not given.  NULL is returned on error.
+ */
+DLiteInstance *csv_load(const DLiteStorage *s, const char *id)
+{
+  const CsvStorage *cs = (const CsvStorage *)s;
+  DLiteInstance *inst=NULL;
+  DLiteMeta *meta=NULL;
+  Chunker c;
+  FILE *fp=NULL;
+  char **names=NULL;
+  int *flags=NULL;
+  int i, j, n, k=0, ncols=0, rowdim, fallback=0;
+  long start, size=-1;
+  size_t estimate=1024, nsample=0, sample_bytes=0;
+
+  if (cs->id) id = cs->id;
+  memset(&c, 0, sizeof(Chunker));
+  if (!(fp = fopen(s->location, "rb")))
+    FAIL1("csvstream: cannot open \"%s\"", s->location);
+  if (fseek(fp, 0, SEEK_END) == 0) size = ftell(fp);
+  rewind(fp);
+
+  /* Read the first chunk */
+  if (chunker_init(&c, fp, cs->chunksize, 0, -1, cs->quote))
+    FAIL("allocation failure");
+  if ((n = chunker_next(&c)) < 0)
+    FAIL1("csvstream: error reading \"%s\"", s->location);
+  while (k < n && is_blank(c.recs[k].start, c.recs[k].end)) k++;
+  if (k == n) FAIL1("csvstream: no rows in \"%s\"", s->location);
+
+  /* Column names */
+  {
+    Record *rec = c.recs + k;
+    char *buf = strndup(rec->start, rec->end - rec->start);
+    if (!buf) FAIL("allocation failure");
+    ncols = split_record(buf, buf + (rec->end - rec->start), cs->delim,
+                         cs->quote, NULL, 0);
+    free(buf);
+    if (!(names = calloc(ncols, sizeof(char *))) ||
+        !(flags = calloc(ncols, sizeof(int))))
+      FAIL("allocation failure");
+    if (cs->header) {
+      split_record(rec->start, rec->end, cs->delim, cs->quote, names, ncols);
+      for (i=0; i<ncols; i++)
+        if (!(names[i] = strdup(names[i]))) FAIL("allocation failure");
+      k++;
+    } else {
+      for (i=0; i<ncols; i++)
+        if (!(names[i] = aprintf("col%d", i))) FAIL("allocation failure");
+    }
+  }
+  start = (k < n) ? c.offset + (c.recs[k].start - c.buf) :
+    c.offset + (long)c.pos;
+
+  /* Infer column types from the rest of the first chunk.  Records are
+     copied, since they are parsed again later. */
+  if (cs->infer == 1 || (cs->infer < 0 &&
+                         !(cs->meta && dlite_instance_has(cs->meta, 0)))) {
+    char **fields;
+    if (!(fields = calloc(ncols, sizeof(char *)))) FAIL("allocation failure");
+    for (i=k; i<n; i++) {
+      Record *rec = c.recs + i;
+      size_t len = rec->end - rec->start;
+      char *buf;
+      if (is_blank(rec->start, rec->end)) continue;
+      if (!(buf = strndup(rec->start, len))) {
+        free(fields);
+        FAIL("allocation failure");
+      }
+      j = split_record(buf, buf + len, cs->delim, cs->quote, fields, ncols);
+      for (j=(j < ncols) ? j : ncols; j>0; j--)
+        flags[j-1] |= field_type(fields[j-1]);
+      free(buf);
+      nsample++;
+      sample_bytes += len + 1;
+    }
+    free(fields);
+    if (!(meta = infer_meta(cs->meta, s->location, names, flags, ncols)))
+      goto fail;
+  } else if (cs->meta) {
+    if (!(meta = dlite_meta_get(cs->meta))) goto fail;
+  } else {
+    FAIL("csvstream: option `meta` must be provided if `infer` is false");
+  }
+  if ((rowdim = rows_dimension(meta)) < 0) goto fail;
+  if ((int)meta->_nproperties > ncols)
+    FAIL3("csvstream: \"%s\" has %d columns, but %s has more properties",
+          s->location, ncols, meta->uri);
+  chunker_deinit(&c);
+  fclose(fp);
+  fp = NULL;
+
+  /* Parse rows.  Each thread gets at least one chunk. */
+  if (cs->nthreads > 1 && size > start &&
+      (size_t)(size - start) >= cs->chunksize * cs->nthreads)
+    inst = parse_parallel(cs, s->location, meta, rowdim, id, start, size,
+                          &fallback);
+  else
+    fallback = 1;
+  if (fallback) {
+    if (nsample && size > start)
+      estimate = (size - start) / (sample_bytes / nsample) + 1;
+    inst = parse_sequential(cs, s->location, meta, rowdim, id, start,
+                            estimate);
+  }
+
+ fail:
+  chunker_deinit(&c);
+  if (fp) fclose(fp);
+  if (names) {
+    for (i=0; i<ncols; i++) if (names[i]) free(names[i]);
+    free(names);
+  }
+  if (flags) free(flags);
+  if (meta) dlite_meta_decref(meta);
+  return inst;
+}
+
+
+/**
+  Saves instance `inst` to storage `s` as a table.  All properties of
+  `inst` must be one-dimensional arrays along the same dimension.
+  Returns non-zero on error.
+ */
+int csv_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  const CsvStorage *cs = (const CsvStorage *)s;
+  const DLiteMeta *meta = inst->meta;
+  FILE *fp;
+  size_t i, row, nrows;
+  int rowdim, retval=1;
+
+  if (!cs->writable)
+    return errx(1, "csvstream: storage \"%s\" is not writable", s->location);
+  if ((rowdim = rows_dimension(meta)) < 0) return 1;
+  nrows = DLITE_DIM(inst, rowdim);
+  if (!(fp = fopen(s->location, "wb")))
+    return err(1, "csvstream: cannot open \"%s\" for writing", s->location);
+
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    char *name = (p->unit && *p->unit) ?
+      aprintf("%s (%s)", p->name, p->unit) : strdup(p->name);
+    if (!name) FAIL("allocation failure");
+    if (i) fputc(cs->delim, fp);
+    write_string(fp, name, cs->delim, cs->quote);
+    free(name);
+  }
+  fputc('\n', fp);
+
+  for (row=0; row<nrows; row++) {
+    for (i=0; i<meta->_nproperties; i++) {
+      DLiteProperty *p = meta->_properties + i;
+      const char *ptr = *(char **)DLITE_PROP(inst, i) + row * p->size;
+      if (i) fputc(cs->delim, fp);
+      if (write_value(fp, ptr, p->type, p->size, cs->delim, cs->quote))
+        FAIL2("csvstream: cannot write value of \"%s\" in row %lu", p->name,
+              (unsigned long)row + 1);
+    }
+    fputc('\n', fp);
+  }
+  if (ferror(fp)) FAIL1("csvstream: error writing \"%s\"", s->location);
+  retval = 0;
+ fail:
+  if (fclose(fp) && !retval)
+    retval = err(1, "csvstream: error closing \"%s\"", s->location);
+  return retval;
+}
+
+
+static DLiteStoragePlugin dlite_csv_plugin = {
+  /* head */
+  "csvstream",              /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  csv_open,                 /* open */
+  csv_close,                /* close */
+
+  /* queue api */
+  NULL,                     /* iterCreate */
+  NULL,                     /* iterNext */
+  NULL,                     /* iterFree */
+  NULL,                     /* getUUIDs */
+
+  /* direct api */
+  csv_load,                 /* loadInstance */
+  csv_save,                 /* saveInstance */
+  NULL,                     /* loadInstances */
+  NULL,                     /* saveInstances */
+
+  /* datamodel api */
+  NULL,                     /* dataModel */
+  NULL,                     /* dataModelFree */
+
+  NULL,                     /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  NULL,                     /* getDimensionSize */
+  NULL,                     /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                     /* setMetaURI */
+  NULL,                     /* setDimensionSize */
+  NULL,                     /* setProperty */
+
+  NULL,                     /* hasDimension */
+  NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  NULL,                     /* getDataName, obsolute */
+  NULL,                     /* setDataName, obsolute */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &dlite_csv_plugin;
+}
@@ -0,0 +1,224 @@
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "utils/strutils.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+#define NROWS 1000
+
+char *uri = "http://onto-ns.com/meta/0.1/CsvTestEntity";
+DLiteMeta *entity=NULL;
+
+
+/* Writes `content` to file `path`. */
+static int write_file(const char *path, const char *content)
+{
+  FILE *fp;
+  if (!(fp = fopen(path, "wb"))) return 1;
+  fputs(content, fp);
+  return fclose(fp);
+}
+
+/* Loads the instance in CSV file `path` with the given options. */
+static DLiteInstance *load(const char *path, const char *options)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  if (!(s = dlite_storage_open("csvstream", path, options))) return NULL;
+  inst = dlite_instance_load(s, NULL);
+  dlite_storage_close(s);
+  return inst;
+}
+
+
+MU_TEST(test_infer)
+{
+  DLiteInstance *inst;
+  const DLiteMeta *meta;
+  double *length;
+  int64_t *index;
+  bool *ok;
+  char **names;
+  mu_assert_int_eq(0, write_file("test-csv-infer.csv",
+    "\"Index\", \"Eruption length (mins)\",Name,ok\r\n"
+    "  1, 3.600, Old Faithful,True\r\n"
+    "\r\n"
+    "  2, 1.800,\"Steamboat, \"\"big\"\"\",false\r\n"
+    "  3,,,TRUE\r\n"));
+  mu_check((inst = load("test-csv-infer.csv", NULL)));
+  meta = inst->meta;
+  mu_assert_int_eq(4, meta->_nproperties);
+  mu_assert_string_eq("Index", meta->_properties[0].name);
+  mu_assert_string_eq("Eruption_length", meta->_properties[1].name);
+  mu_assert_string_eq("mins", meta->_properties[1].unit);
+  mu_assert_int_eq(dliteInt, meta->_properties[0].type);
+  mu_assert_int_eq(dliteFloat, meta->_properties[1].type);
+  mu_assert_int_eq(dliteStringPtr, meta->_properties[2].type);
+  mu_assert_int_eq(dliteBool, meta->_properties[3].type);
+  mu_assert_int_eq(3, (int)dlite_instance_get_dimension_size(inst, "rows"));
+
+  index = dlite_instance_get_property(inst, "Index");
+  length = dlite_instance_get_property(inst, "Eruption_length");
+  names = dlite_instance_get_property(inst, "Name");
+  ok = dlite_instance_get_property(inst, "ok");
+  mu_assert_int_eq(3, (int)index[2]);
+  mu_assert_double_eq(1.8, length[1]);
+  mu_check(isnan(length[2]));
+  mu_assert_string_eq(" Old Faithful", names[0]);
+  mu_assert_string_eq("Steamboat, \"big\"", names[1]);
+  mu_check(names[2] == NULL);
+  mu_check(ok[0] && !ok[1] && ok[2]);
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_create)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of rows."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims unit iri  descr */
+    {"flag",   dliteBool,      sizeof(bool),   1, dims, "",  NULL, "A flag."},
+    {"value",  dliteInt,       sizeof(int),    1, dims, "",  NULL, "A value."},
+    {"length", dliteFloat,     sizeof(double), 1, dims, "m", NULL, "Length."},
+    {"name",   dliteStringPtr, sizeof(char *), 1, dims, "",  NULL, "A name."}
+  };
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, NULL,
+                                                    "Test entity.",
+                                                    1, dimensions,
+                                                    4, properties)));
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  size_t dims[] = {NROWS};
+  bool *flag;
+  int *value, i;
+  double *length;
+  char **name;
+  mu_check((inst = dlite_instance_create(entity, dims, "csv-data")));
+  flag = dlite_instance_get_property(inst, "flag");
+  value = dlite_instance_get_property(inst, "value");
+  length = dlite_instance_get_property(inst, "length");
+  name = dlite_instance_get_property(inst, "name");
+  for (i=0; i<NROWS; i++) {
+    flag[i] = i % 3 == 0;
+    value[i] = i - 10;
+    length[i] = i / 7.0;
+    name[i] = aprintf((i % 2) ? "row %d" : "row\n%d", i);
+  }
+  mu_check((s = dlite_storage_open("csvstream", "test-csv.csv", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* Without newlines in quoted fields */
+  for (i=0; i<NROWS; i+=2) {
+    free(name[i]);
+    name[i] = aprintf("row, %d", i);
+  }
+  mu_check((s = dlite_storage_open("csvstream", "test-csv2.csv", "mode=w")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  dlite_instance_decref(inst);
+}
+
+/* Checks that `inst` contains the rows saved by test_save(). */
+static int check_rows(DLiteInstance *inst, int newlines)
+{
+  bool *flag = dlite_instance_get_property(inst, "flag");
+  int *value = dlite_instance_get_property(inst, "value");
+  double *length = dlite_instance_get_property(inst, "length");
+  char **name = dlite_instance_get_property(inst, "name");
+  char buf[32];
+  int i;
+  if (dlite_instance_get_dimension_size(inst, "N") != NROWS) return 1;
+  for (i=0; i<NROWS; i++) {
+    snprintf(buf, sizeof(buf), (i % 2) ? "row %d" : (newlines) ?
+             "row\n%d" : "row, %d", i);
+    if (flag[i] != (i % 3 == 0) || value[i] != i - 10 ||
+        length[i] != i / 7.0 || strcmp(name[i], buf))
+      return errx(1, "mismatch in row %d", i);
+  }
+  return 0;
+}
+
+MU_TEST(test_load)
+{
+  DLiteInstance *inst;
+  mu_check((inst = load("test-csv.csv", "meta=http://onto-ns.com/meta/0.1/"
+                        "CsvTestEntity;chunksize=100")));
+  mu_assert_string_eq(uri, inst->meta->uri);
+  mu_assert_int_eq(0, check_rows(inst, 1));
+  dlite_instance_decref(inst);
+
+  /* Falls back to sequential parsing due to quoted newlines */
+  mu_check((inst = load("test-csv.csv", "meta=http://onto-ns.com/meta/0.1/"
+                        "CsvTestEntity;chunksize=100;threads=4")));
+  mu_assert_int_eq(0, check_rows(inst, 1));
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_load_parallel)
+{
+  DLiteInstance *inst;
+  mu_check((inst = load("test-csv2.csv", "meta=http://onto-ns.com/meta/0.1/"
+                        "CsvTestEntity;chunksize=64;threads=4")));
+  mu_assert_int_eq(0, check_rows(inst, 0));
+  dlite_instance_decref(inst);
+
+  mu_check((inst = load("test-csv2.csv", "chunksize=64;threads=3")));
+  mu_assert_int_eq(NROWS, (int)dlite_instance_get_dimension_size(inst,
+                                                                 "rows"));
+  mu_assert_string_eq("length", inst->meta->_properties[2].name);
+  mu_assert_string_eq("m", inst->meta->_properties[2].unit);
+  mu_assert_double_eq(999 / 7.0, ((double *)dlite_instance_get_property(
+                        inst, "length"))[999]);
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_errors)
+{
+  mu_assert_int_eq(0, write_file("test-csv-bad.csv", "a,b\n1,2\n3,x\n"));
+  err_set_stream(NULL);
+  mu_check(!load("test-csv-bad.csv", "infer=false"));
+  mu_check(!load("test-csv-bad.csv", "chunksize=4;delimiter=semicolon;"
+                 "meta=http://onto-ns.com/meta/0.1/CsvTestEntity"));
+  err_set_stream(stderr);
+}
+
+MU_TEST(test_free)
+{
+  dlite_meta_decref(entity);
+  dlite_storage_plugin_unload_all();
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_infer);
+  MU_RUN_TEST(test_create);
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_load_parallel);
+  MU_RUN_TEST(test_errors);
+  MU_RUN_TEST(test_free);
+}
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
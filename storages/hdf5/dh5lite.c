@@ -4,13 +4,22 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <math.h>
 
 #include <hdf5.h>
 
 #include "config.h"
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "boolean.h"
 #include "utils/err.h"
+#include "utils/strtob.h"
+#include "utils/map.h"
 
 #include "dlite.h"
 #include "dlite-datamodel.h"
@@ -20,10 +29,94 @@
 #define UNUSED(x) (void)(x)
 
 
+/* Registered ids of third-party compression filters */
+#define DH5_FILTER_BLOSC 32001
+#define DH5_FILTER_ZSTD  32015
+
+/* Limits for the chunk size in bytes selected by chunk=auto */
+#define DH5_CHUNK_BASE (16*1024)
+#define DH5_CHUNK_MIN  (8*1024)
+#define DH5_CHUNK_MAX  (1024*1024)
+
+/* Number of data spaces kept in the cache of each storage */
+#define DH5_SPACE_CACHE 16
+
+/* Minimum size of the blocks in a string arena */
+#define DH5_ARENA_BLOCK (64*1024)
+
+/* Name of the top-level group holding the compact layout */
+#define DH5_COMPACT "_compact"
+
+/* Name of the top-level group holding collection views */
+#define DH5_VIEWS "_views"
+
+/* Chunking of datasets */
+typedef enum {
+  dh5ChunkNone,     /* contiguous datasets */
+  dh5ChunkAuto,     /* chunk shape selected by guess_chunk() */
+  dh5ChunkDims,     /* chunk shape given by the `chunk` option */
+  dh5ChunkRows      /* chunks of rows along the first dimension, for
+                       datasets that grow by appending rows */
+} DH5Chunk;
+
+/* Single-writer/multiple-reader (SWMR) mode */
+typedef enum {
+  dh5SwmrNone,      /* no SWMR */
+  dh5SwmrRead,      /* reader */
+  dh5SwmrWrite,     /* writer, SWMR not started yet */
+  dh5SwmrWriting    /* writer, SWMR started */
+} DH5Swmr;
+
+/* Cached hdf5 memory type */
+typedef struct {
+  DLiteType type;   /* dlite type */
+  size_t size;      /* size of dlite type */
+  hid_t id;         /* hdf5 memory type */
+} DH5Memtype;
+
+/* Cached hdf5 data space */
+typedef struct {
+  size_t ndims;     /* number of dimensions */
+  hsize_t dims[H5S_MAX_RANK];  /* dimension sizes */
+  hid_t id;         /* hdf5 data space, zero if unused */
+} DH5Space;
+
+/* Location of an instance in the compact layout */
+typedef struct {
+  size_t group;     /* index of compact group */
+  hsize_t row;      /* row in the compact group */
+} DH5Row;
+
 /* Storage for hdf5 backend. */
 typedef struct {
   DLiteStorage_HEAD
   hid_t root;       /* h5 file identifier to root */
+  DH5Chunk chunk;   /* how datasets are chunked */
+  int nchunkdims;   /* number of dimensions in `chunkdims` */
+  hsize_t chunkdims[H5S_MAX_RANK];  /* chunk shape for dh5ChunkDims */
+  H5Z_filter_t filter;  /* compression filter, H5Z_FILTER_NONE if none */
+  int level;        /* compression level, -1 for the filter default */
+  int shuffle;      /* whether to apply the shuffle filter */
+  hid_t dxpl;       /* data transfer property list, H5P_DEFAULT unless mpi */
+  DH5Swmr swmr;     /* SWMR mode */
+  int mapfd;        /* file descriptor for mapping datasets, -1 if not
+                       mapping */
+  DLiteLossy *lossy;  /* tolerances of float properties, NULL if
+                         lossless */
+
+  /* compact layout */
+  int compact;      /* whether new instances use the compact layout */
+  hid_t compactgroup;    /* the DH5_COMPACT group, zero if not opened */
+  char **groups;    /* names of groups in the DH5_COMPACT group */
+  size_t ngroups;   /* number of groups */
+  DH5Row *rows;     /* location of instances in the compact layout */
+  size_t nrows;     /* number of instances in the compact layout */
+  size_t rowsize;   /* allocated length of `rows` */
+  map_int_t index;  /* maps uuid to index in `rows` */
+  DH5Memtype *memtypes;  /* cache of memory types */
+  size_t nmemtypes;      /* number of cached memory types */
+  DH5Space spaces[DH5_SPACE_CACHE];  /* ring buffer of data spaces */
+  size_t nextspace;      /* index of next entry in `spaces` to replace */
 } DH5Storage;
 
 
@@ -34,6 +127,16 @@ typedef struct {
   hid_t meta;         /* h5 group identifier to metadata */
   hid_t dimensions;   /* h5 group identifier to dimensions */
   hid_t properties;   /* h5 group identifier to properties */
+
+  /* compact layout */
+  int compact;        /* whether the instance is in the compact layout */
+  hsize_t row;        /* row of the instance in the compact group */
+  hsize_t nrows;      /* number of rows in the compact group */
+  char *metauri;      /* metadata uri, until the row is assigned */
+  char **dimnames;    /* dimension names, until the row is assigned */
+  size_t *dimsizes;   /* dimension sizes, until the row is assigned */
+  size_t ndims;       /* number of dimensions in `dimnames` */
+  char *dataname;     /* data name, until the row is assigned */
 } DH5DataModel;
 
 
@@ -124,7 +227,28 @@ static hid_t get_memtype(DLiteType type, size_t size)
       return err(-1, "cannot set DStringPtr memtype size");
     return memtype;
 
-  default:      return errx(-1, "Invalid type number: %d", type);
+  default:
+    {
+      /* structs are mapped to compound types with the same layout */
+      const DLiteStruct *st = dlite_struct_get(type);
+      size_t i;
+      if (!st) return errx(-1, "Invalid type number: %d", type);
+      if ((memtype = H5Tcreate(H5T_COMPOUND, st->size)) < 0)
+        return err(-1, "cannot create compound memtype for struct %s",
+                   st->name);
+      for (i=0; i<st->nfields; i++) {
+        const DLiteStructField *f = st->fields + i;
+        hid_t ftype = get_memtype(f->type, f->size);
+        if (ftype < 0 || H5Tinsert(memtype, f->name, f->offset, ftype) < 0) {
+          if (ftype >= 0) H5Tclose(ftype);
+          H5Tclose(memtype);
+          return err(-1, "cannot add field \"%s\" to compound memtype for "
+                     "struct %s", f->name, st->name);
+        }
+        H5Tclose(ftype);
+      }
+      return memtype;
+    }
   }
   abort();  /* sould never be reached */
 }
@@ -132,25 +256,101 @@ static hid_t get_memtype(DLiteType type, size_t size)
 
 /* Returns the HDF5 data space identifier corresponding to `ndims` and `dims`.
    If `dims` is NULL, length of all dimensions are assumed to be one.
+   If `extendible` is non-zero, the maximum dimensions are unlimited.
    Returns -1 on error.
 
    On success, the returned identifier should be closed with H5Sclose(). */
-static hid_t get_space(size_t ndims, const size_t *dims)
+static hid_t get_space(size_t ndims, const size_t *dims, int extendible)
 {
-  hid_t space=-1;
-  hsize_t *hdims=NULL;
+  hid_t space;
+  hsize_t hdims[H5S_MAX_RANK], maxdims[H5S_MAX_RANK];
   size_t i;
-  if (!(hdims = calloc(ndims, sizeof(hsize_t))))
-    return err(-1, "allocation failure");
+  if (ndims > H5S_MAX_RANK)
+    return errx(-1, "number of dimensions (%d) exceeds the maximum "
+                "supported by hdf5 (%d)", (int)ndims, H5S_MAX_RANK);
   for (i=0; i<ndims; i++) hdims[i] = (dims) ? dims[i] : 1;
-  if ((space = H5Screate_simple(ndims, hdims, NULL)) < 0)
+  for (i=0; i<ndims; i++) maxdims[i] = H5S_UNLIMITED;
+  if ((space = H5Screate_simple(ndims, hdims,
+                                (extendible) ? maxdims : NULL)) < 0)
     space = errx(-1, "cannot create hdf5 data space");
- /* fail: */
-  if (hdims) free(hdims);
   return space;
 }
 
 
+/* Like get_memtype(), but returns a memory type cached in storage `s`.
+   Returns -1 on error.
+
+   The returned identifier is owned by `s` and should not be closed. */
+static hid_t cached_memtype(DH5Storage *s, DLiteType type, size_t size)
+{
+  DH5Memtype *m;
+  hid_t memtype;
+  size_t i;
+  for (i=0; i<s->nmemtypes; i++)
+    if (s->memtypes[i].type == type && s->memtypes[i].size == size)
+      return s->memtypes[i].id;
+  if ((memtype = get_memtype(type, size)) < 0) return -1;
+  if (!(m = realloc(s->memtypes, (s->nmemtypes + 1)*sizeof(DH5Memtype)))) {
+    H5Tclose(memtype);
+    return err(-1, "allocation failure");
+  }
+  s->memtypes = m;
+  m[s->nmemtypes].type = type;
+  m[s->nmemtypes].size = size;
+  m[s->nmemtypes].id = memtype;
+  s->nmemtypes++;
+  return memtype;
+}
+
+/* Like get_space(), but returns a fixed-sized data space cached in
+   storage `s`.  Returns -1 on error.
+
+   The returned identifier is owned by `s` and should not be closed.
+   It stays valid until DH5_SPACE_CACHE other shapes have been
+   requested, and its selection should not be modified. */
+static hid_t cached_space(DH5Storage *s, size_t ndims, const size_t *dims)
+{
+  DH5Space *sp;
+  hid_t space;
+  size_t i, j;
+  if (ndims > H5S_MAX_RANK)
+    return errx(-1, "too many dimensions: %lu", (unsigned long)ndims);
+  for (i=0; i<DH5_SPACE_CACHE; i++) {
+    sp = s->spaces + i;
+    if (sp->id <= 0 || sp->ndims != ndims) continue;
+    for (j=0; j<ndims; j++)
+      if (sp->dims[j] != (hsize_t)((dims) ? dims[j] : 1)) break;
+    if (j == ndims) return sp->id;
+  }
+  if ((space = get_space(ndims, dims, 0)) < 0) return -1;
+  sp = s->spaces + s->nextspace;
+  if (sp->id > 0) H5Sclose(sp->id);
+  sp->ndims = ndims;
+  for (j=0; j<ndims; j++) sp->dims[j] = (dims) ? dims[j] : 1;
+  sp->id = space;
+  s->nextspace = (s->nextspace + 1) % DH5_SPACE_CACHE;
+  return space;
+}
+
+/* Closes all memory types and data spaces cached in storage `s`.
+   Returns the number of identifiers that could not be closed. */
+static int free_caches(DH5Storage *s)
+{
+  size_t i;
+  int nerr=0;
+  for (i=0; i<s->nmemtypes; i++)
+    if (H5Tclose(s->memtypes[i].id) < 0) nerr++;
+  if (s->memtypes) free(s->memtypes);
+  s->memtypes = NULL;
+  s->nmemtypes = 0;
+  for (i=0; i<DH5_SPACE_CACHE; i++) {
+    if (s->spaces[i].id > 0 && H5Sclose(s->spaces[i].id) < 0) nerr++;
+    s->spaces[i].id = 0;
+  }
+  return nerr;
+}
+
+
 /* Returns DLiteType corresponding to hdf5 dtype.
 
    Note: bool is returned ad int (since we store it as int). */
@@ -176,37 +376,129 @@ static DLiteType get_type(hid_t dtype)
     if ((isvariable = H5Tis_variable_str(dtype)) < 0)
       return err(-1,"cannot dtermine wheter hdf5 string is of variable length");
     return (isvariable) ? dliteStringPtr : dliteFixString;
+  case H5T_COMPOUND:
+    /* any struct type, hdf5 matches the fields by name */
+    return dliteStruct;
   default:
-    return err(-1, "hdf5 data class is not opaque, integer, float or string");
+    return err(-1, "hdf5 data class is not opaque, integer, float, string "
+               "or compound");
   }
 }
 
 
-/* Copied hdf5  dataset `name` in `group` to memory pointed to by `ptr`.
+/* Returns non-zero if hdf5 can convert data from type `src` to `dst`. */
+static int has_conversion(hid_t src, hid_t dst)
+{
+  H5T_cdata_t *pcdata;
+  H5T_conv_t conv;
+  H5E_BEGIN_TRY {
+    conv = H5Tfind(src, dst, &pcdata);
+  } H5E_END_TRY;
+  return conv != NULL;
+}
 
-   Multi-dimensional arrays are supported.  `size` is the size of each
-   data element, `ndims` is the number of dimensions and `dims` is an
-   array of dimension sizes.
+
+/* Block in a string arena */
+typedef struct _DH5Block {
+  struct _DH5Block *next;  /* previous allocated block */
+  size_t used;             /* number of used bytes in `data` */
+  size_t size;             /* size of `data` */
+  char data[];             /* string data */
+} DH5Block;
+
+/* Variable length memory allocator with string arena semantics.  All
+   strings are released together with arena_clear(). */
+static void *arena_alloc(size_t size, void *info)
+{
+  DH5Block **head = info, *b = *head;
+  size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  if (!b || b->used + size > b->size) {
+    size_t n = (size > DH5_ARENA_BLOCK) ? size : DH5_ARENA_BLOCK;
+    if (!(b = malloc(sizeof(DH5Block) + n))) return NULL;
+    b->next = *head;
+    b->used = 0;
+    b->size = n;
+    *head = b;
+  }
+  b->used += size;
+  return b->data + b->used - size;
+}
+
+/* Strings in the arena are not released individually. */
+static void arena_free(void *ptr, void *info)
+{
+  UNUSED(ptr);
+  UNUSED(info);
+}
+
+/* Releases all blocks in a string arena. */
+static void arena_clear(DH5Block **head)
+{
+  while (*head) {
+    DH5Block *next = (*head)->next;
+    free(*head);
+    *head = next;
+  }
+}
+
+/* Variable length memory allocator that allocates strings with our own
+   malloc(), such that they can be released with free() on all
+   platforms. */
+static void *vlen_malloc(size_t size, void *info)
+{
+  UNUSED(info);
+  return malloc(size);
+}
+
+static void vlen_free(void *ptr, void *info)
+{
+  UNUSED(info);
+  free(ptr);
+}
+
+
+/* Copies a hyperslab of hdf5 dataset `name` in `group` to memory
+   pointed to by `ptr`.
+
+   `size` is the size of each data element and `ndims` is the number
+   of dimensions.  `offsets`, `counts` and `strides` are arrays of
+   length `ndims` with the start index, number of elements and step
+   along each dimension.  `strides` may be NULL, in which case it
+   defaults to one along all dimensions.  The data is written
+   continuously to `ptr`, which should have space for the product of
+   `counts` elements.
+
+   If `counts` is NULL, the whole dataset is read and `dims` should be
+   an array of dimension sizes.
 
    Returns non-zero on error.
  */
-static int get_data(const DLiteDataModel *d, hid_t group,
-                    const char *name, void *ptr,
-                    DLiteType type, size_t size,
-                    size_t ndims, const size_t *dims)
+static int get_data_slice(const DLiteDataModel *d, hid_t group,
+                          const char *name, void *ptr,
+                          DLiteType type, size_t size,
+                          size_t ndims, const size_t *dims,
+                          const size_t *offsets, const size_t *counts,
+                          const size_t *strides)
 {
+  DH5Storage *s = (DH5Storage *)d->s;
   hid_t memtype=0, space=0, dspace=0, dset=0, dtype=0;
   htri_t isvariable;
   herr_t stat;
-  hsize_t *ddims=NULL;
+  hsize_t ddims[H5S_MAX_RANK];
+  hsize_t hstart[H5S_MAX_RANK], hcount[H5S_MAX_RANK], hstride[H5S_MAX_RANK];
+  hid_t filespace=H5S_ALL, xfer=H5P_DEFAULT;
   DLiteType savedtype;
+  DH5Block *arena=NULL;
   size_t i, nmemb=1;
-  int dsize, dndims, retval=-1;
+  int dsize, dndims, convert=0, retval=-1;
   void *buff=ptr;
 
   errno=0;
-  if ((memtype = get_memtype(type, size)) < 0) goto fail;
-  if ((space = get_space(ndims, dims)) < 0) goto fail;
+  if (ndims > H5S_MAX_RANK)
+    DFAIL1(d, "too many dimensions of '%s'", name);
+  if ((memtype = cached_memtype(s, type, size)) < 0) goto fail;
+  if ((space = cached_space(s, ndims, (counts) ? counts : dims)) < 0)
+    goto fail;
 
   /* Get: dset, dtype, dsize, dspace, dndims, ddims, */
   if ((dset = H5Dopen2(group, name, H5P_DEFAULT)) < 0)
@@ -219,10 +511,12 @@ static int get_data(const DLiteDataModel *d, hid_t group,
     DFAIL1(d, "cannot get data space of '%s'", name);
   if ((dndims = H5Sget_simple_extent_ndims(dspace)) < 0)
     DFAIL1(d, "cannot get number of dimimensions of '%s'", name);
-  if (!(ddims = calloc(sizeof(hsize_t), dndims)))
-    FAIL0("allocation failure");
+  if (dndims > H5S_MAX_RANK)
+    DFAIL1(d, "too many dimensions of '%s'", name);
   if ((stat = H5Sget_simple_extent_dims(dspace, ddims, NULL)) < 0)
     DFAIL1(d, "cannot get dims of '%s'", name);
+  if (counts && dndims == 0)
+    DFAIL1(d, "cannot read slice of scalar '%s'", name);
 
   /* Check that dimensions matches */
   if (dndims == 0 && ndims == 1)
@@ -235,7 +529,30 @@ static int get_data(const DLiteDataModel *d, hid_t group,
         DFAIL4(d, "dimension %lu of '%s': expected %lu, got %d",
                i, name, (dims) ? dims[i] : 1, (int)ddims[i]);
   }
-  for (i=0; i<ndims; i++) nmemb *= (dims) ? dims[i] : 1;
+  if (counts) {
+    for (i=0; i<ndims; i++) {
+      size_t step = (strides) ? strides[i] : 1;
+      if (step == 0)
+        DFAIL2(d, "zero stride along dimension %lu of '%s'", i, name);
+      if (counts[i] &&
+          offsets[i] + (counts[i] - 1) * step >= (size_t)ddims[i])
+        DFAIL2(d, "slice exceeds dimension %lu of '%s'", i, name);
+      hstart[i] = offsets[i];
+      hcount[i] = counts[i];
+      hstride[i] = step;
+      nmemb *= counts[i];
+    }
+    if (nmemb == 0) {
+      retval = 0;
+      goto fail;
+    }
+    if (H5Sselect_hyperslab(dspace, H5S_SELECT_SET, hstart, hstride, hcount,
+                            NULL) < 0)
+      DFAIL1(d, "cannot select hyperslab of '%s'", name);
+    filespace = dspace;
+  } else {
+    for (i=0; i<ndims; i++) nmemb *= (dims) ? dims[i] : 1;
+  }
 
   /* Get type of data saved in the hdf5 file */
   if ((savedtype = get_type(dtype)) < 0)
@@ -249,24 +566,48 @@ static int get_data(const DLiteDataModel *d, hid_t group,
     if (!isvariable) dsize++;
   }
 
-  /* Allocate temporary buffer for data type convertion */
+  /* Convert between fixed and variable length strings.  Let hdf5 write
+     directly to `ptr` if it supports the conversion.  Otherwise read to
+     a temporary buffer.  Variable length strings that are not returned
+     to the caller are allocated in a string arena. */
   if (type == dliteStringPtr && savedtype == dliteFixString) {
-    if (!(buff = calloc(nmemb, dsize))) FAIL0("allocation failure");
-    if (memtype > 0) H5Tclose(memtype);
-    if ((memtype = get_memtype(dliteFixString, dsize)) < 0) goto fail;
+    if ((xfer = H5Pcreate(H5P_DATASET_XFER)) < 0)
+      DFAIL1(d, "cannot create transfer property list for '%s'", name);
+    if (has_conversion(dtype, memtype)) {
+      if (H5Pset_vlen_mem_manager(xfer, vlen_malloc, NULL,
+                                  vlen_free, NULL) < 0)
+        DFAIL1(d, "cannot set memory manager for '%s'", name);
+    } else {
+      if (!(buff = calloc(nmemb, dsize))) FAIL0("allocation failure");
+      if ((memtype = cached_memtype(s, dliteFixString, dsize)) < 0)
+        goto fail;
+      convert = 1;
+    }
   } else if (type == dliteFixString && savedtype == dliteStringPtr) {
-    if (!(buff = calloc(nmemb, sizeof(void *)))) FAIL0("allocation failure");
-    if (memtype > 0) H5Tclose(memtype);
-    if ((memtype = get_memtype(dliteStringPtr, sizeof(void *))) < 0) goto fail;
+    if (!has_conversion(dtype, memtype)) {
+      if (!(buff = calloc(nmemb, sizeof(void *)))) FAIL0("allocation failure");
+      if ((memtype = cached_memtype(s, dliteStringPtr, sizeof(void *))) < 0)
+        goto fail;
+      if ((xfer = H5Pcreate(H5P_DATASET_XFER)) < 0 ||
+          H5Pset_vlen_mem_manager(xfer, arena_alloc, &arena,
+                                  arena_free, NULL) < 0)
+        DFAIL1(d, "cannot set up string arena for '%s'", name);
+      convert = 1;
+    }
   } else if (type == dliteBool && savedtype == dliteUInt) {
     ;  /* pass, bool is saved as uint */
+  } else if (savedtype == dliteStruct && dlite_type_is_struct(type)) {
+    if (!has_conversion(dtype, memtype))
+      DFAIL2(d, "cannot read compound '%s' as struct %s", name,
+             dlite_struct_get(type)->name);
   } else if (savedtype != type) {
     DFAIL3(d, "trying to read '%s' as %s, but it is %s",
            name, dlite_type_get_dtypename(type),
            dlite_type_get_dtypename(savedtype));
   }
 
-  if ((stat = H5Dread(dset, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, buff)) < 0)
+  if ((stat = H5Dread(dset, memtype, (counts) ? space : H5S_ALL, filespace,
+                      xfer, buff)) < 0)
     DFAIL1(d, "cannot read dataset '%s'", name);
 
 #if _WIN32
@@ -276,7 +617,7 @@ static int get_data(const DLiteDataModel *d, hid_t group,
      As a work around we allocate new strings with malloc() and reclaim
      the memory allocated by H5Dread().
   */
-  if (savedtype == dliteStringPtr) {
+  if (savedtype == dliteStringPtr && type == dliteStringPtr) {
     char **tmp;
     if (!(tmp = malloc(nmemb*sizeof(char *)))) FAIL0("allocation failure");
     for (i=0; i<nmemb; i++)
@@ -291,31 +632,30 @@ static int get_data(const DLiteDataModel *d, hid_t group,
 #endif
 
   /* Convert data type */
-  if (type == dliteStringPtr && savedtype == dliteFixString) {
+  if (convert && type == dliteStringPtr) {
     for (i=0; i<nmemb; i++)
       if (!(((char **)ptr)[i] = strdup((char *)buff + i*dsize)))
         FAIL0("allocation failure");
-  } else if (type == dliteFixString && savedtype == dliteStringPtr) {
+  } else if (convert && type == dliteFixString) {
     for (i=0; i<nmemb; i++) {
-      strncpy((char *)ptr + i*size, ((char **)buff)[i], size);
-      free(((char **)buff)[i]);
+      const char *str = ((char **)buff)[i];
+      strncpy((char *)ptr + i*size, (str) ? str : "", size);
     }
   }
 
   retval = 0;
  fail:
+  if (arena) arena_clear(&arena);
+  if (xfer > 0) H5Pclose(xfer);
   if (dset > 0) H5Dclose(dset);
   if (dtype > 0) H5Tclose(dtype);
-  if (space > 0) H5Sclose(space);
   if (dspace > 0) H5Sclose(dspace);
-  if (memtype > 0) H5Tclose(memtype);
   if (buff != ptr) free(buff);
-  if (ddims != ptr) free(ddims);
   return retval;
 }
 
 
-/* Copies memory pointed to by `ptr` to hdf5 dataset `name` in `group`.
+/* Copied hdf5  dataset `name` in `group` to memory pointed to by `ptr`.
 
    Multi-dimensional arrays are supported.  `size` is the size of each
    data element, `ndims` is the number of dimensions and `dims` is an
@@ -323,98 +663,990 @@ static int get_data(const DLiteDataModel *d, hid_t group,
 
    Returns non-zero on error.
  */
-static int set_data(DLiteDataModel *d, hid_t group,
-                    const char *name, const void *ptr,
+static int get_data(const DLiteDataModel *d, hid_t group,
+                    const char *name, void *ptr,
                     DLiteType type, size_t size,
                     size_t ndims, const size_t *dims)
 {
-  hid_t memtype=0, space=0, dset=0;
+  return get_data_slice(d, group, name, ptr, type, size, ndims, dims,
+                        NULL, NULL, NULL);
+}
+
+
+/* Assigns `cdims` to a chunk shape for a dataset with `ndims`
+   dimensions of sizes `dims` and elements of `size` bytes.
+
+   The heuristic is the same as used by h5py: the target chunk size
+   grows with the size of the dataset (between DH5_CHUNK_MIN and
+   DH5_CHUNK_MAX bytes) and the dimensions are halved in turn until the
+   chunk is close to the target. */
+static void guess_chunk(hsize_t *cdims, size_t size, size_t ndims,
+                        const size_t *dims)
+{
+  size_t i, idx=0;
+  double nbytes=size, target;
+  for (i=0; i<ndims; i++) {
+    cdims[i] = (dims[i]) ? dims[i] : 1;
+    nbytes *= cdims[i];
+  }
+  target = DH5_CHUNK_BASE * pow(2, log10(nbytes / (1024.*1024.)));
+  if (target > DH5_CHUNK_MAX) target = DH5_CHUNK_MAX;
+  if (target < DH5_CHUNK_MIN) target = DH5_CHUNK_MIN;
+
+  while (1) {
+    double cbytes=size, nelem=1;
+    for (i=0; i<ndims; i++) nelem *= cdims[i];
+    cbytes *= nelem;
+    if ((cbytes < target || fabs(cbytes - target) / target < 0.5) &&
+        cbytes < DH5_CHUNK_MAX) break;
+    if (nelem == 1) break;
+    i = idx++ % ndims;
+    cdims[i] = (cdims[i] + 1) / 2;
+  }
+}
+
+/* Returns a dataset creation property list implementing the chunking
+   and filter options of `s` for a dataset with `ndims` dimensions of
+   sizes `dims` and elements of `size` bytes.
+
+   Datasets with less than two elements are always contiguous.  With chunk=auto,
+   so are datasets smaller than DH5_CHUNK_MIN bytes.  H5P_DEFAULT is
+   returned for contiguous datasets.
+
+   If `extendible` is non-zero (SWMR mode and rows in the compact
+   layout), all array datasets are chunked, by default with chunks of
+   rows along the first dimension, such that they can be extended.
+
+   Returns -1 on error.  Other returned values than H5P_DEFAULT should be
+   closed with H5Pclose(). */
+static hid_t get_dcpl(const DH5Storage *s, int extendible, size_t size,
+                      size_t ndims, const size_t *dims)
+{
+  hid_t dcpl=-1;
+  hsize_t cdims[H5S_MAX_RANK];
+  DH5Chunk chunk = s->chunk;
+  size_t i, nelem=1;
+  unsigned int cd_values[5] = {0, 0, 0, 0, 0};
+
+  /* filters require chunking */
+  if (chunk == dh5ChunkNone && extendible)
+    chunk = dh5ChunkRows;
+  if (chunk == dh5ChunkNone && (s->filter != H5Z_FILTER_NONE || s->shuffle))
+    chunk = dh5ChunkAuto;
+  if (chunk == dh5ChunkNone || ndims == 0 || ndims > H5S_MAX_RANK)
+    return H5P_DEFAULT;
+  for (i=0; i<ndims; i++) nelem *= dims[i];
+  if (nelem < 2 && !extendible) return H5P_DEFAULT;
+
+  if (chunk == dh5ChunkRows) {
+    /* whole rows with about DH5_CHUNK_BASE bytes per chunk */
+    size_t rowsize = size;
+    for (i=1; i<ndims; i++) {
+      cdims[i] = (dims[i]) ? dims[i] : 1;
+      rowsize *= cdims[i];
+    }
+    cdims[0] = (rowsize < DH5_CHUNK_BASE) ? DH5_CHUNK_BASE / rowsize : 1;
+  } else if (chunk == dh5ChunkAuto) {
+    if (nelem * size < DH5_CHUNK_MIN && !extendible)
+      return H5P_DEFAULT;
+    guess_chunk(cdims, size, ndims, dims);
+  } else {
+    /* the given chunk shape applies to the last dimensions */
+    for (i=0; i<ndims; i++) {
+      int j = (int)i - (int)ndims + s->nchunkdims;
+      cdims[i] = (j >= 0) ? s->chunkdims[j] : 1;
+      if (cdims[i] > dims[i]) cdims[i] = (dims[i]) ? dims[i] : 1;
+    }
+  }
+
+  if ((dcpl = H5Pcreate(H5P_DATASET_CREATE)) < 0)
+    return err(-1, "cannot create dataset creation property list");
+  if (H5Pset_chunk(dcpl, ndims, cdims) < 0)
+    FAIL0("cannot set chunk shape");
+  if (s->shuffle && H5Pset_shuffle(dcpl) < 0)
+    FAIL0("cannot set shuffle filter");
+  switch (s->filter) {
+  case H5Z_FILTER_NONE:
+    break;
+  case H5Z_FILTER_DEFLATE:
+    if (H5Pset_deflate(dcpl, (s->level < 0) ? 4 : s->level) < 0)
+      FAIL0("cannot set gzip compression");
+    break;
+  case DH5_FILTER_ZSTD:
+    cd_values[0] = (s->level < 0) ? 3 : s->level;
+    if (H5Pset_filter(dcpl, s->filter, H5Z_FLAG_MANDATORY, 1, cd_values) < 0)
+      FAIL0("cannot set zstd compression");
+    break;
+  case DH5_FILTER_BLOSC:
+    /* the first four values are set by the filter itself */
+    cd_values[4] = s->level;
+    if (H5Pset_filter(dcpl, s->filter, H5Z_FLAG_MANDATORY,
+                      (s->level < 0) ? 0 : 5, cd_values) < 0)
+      FAIL0("cannot set blosc compression");
+    break;
+  }
+  return dcpl;
+ fail:
+  H5Pclose(dcpl);
+  return -1;
+}
+
+/* Prepares the existing dataset `dset` for being overwritten in place
+   with data of type `memtype` with `ndims` dimensions of sizes `dims`.
+
+   This is possible if the stored type equals `memtype` and the dataset
+   either has the same shape or is chunked with maximum dimensions that
+   can hold `dims`.  In the latter case the extent of `dset` is changed.
+
+   Returns 1 if `dset` can be overwritten, 0 if it must be recreated and
+   -1 on error. */
+static int reuse_dataset(hid_t dset, hid_t memtype, size_t ndims,
+                         const size_t *dims)
+{
+  hid_t dtype=-1, dspace=-1, dcpl=-1;
+  hsize_t cur[H5S_MAX_RANK], max[H5S_MAX_RANK], hdims[H5S_MAX_RANK];
+  htri_t equal;
+  int i, rank, same=1, retval=-1;
+
+  if (ndims > H5S_MAX_RANK) return 0;
+  if ((dtype = H5Dget_type(dset)) < 0) goto fail;
+  if ((equal = H5Tequal(dtype, memtype)) < 0) goto fail;
+  if (!equal) {
+    retval = 0;
+    goto fail;
+  }
+  if ((dspace = H5Dget_space(dset)) < 0) goto fail;
+  if ((rank = H5Sget_simple_extent_dims(dspace, cur, max)) < 0) goto fail;
+  if (rank != (int)ndims) {
+    retval = 0;
+    goto fail;
+  }
+  for (i=0; i<rank; i++) {
+    hdims[i] = (dims) ? dims[i] : 1;
+    if (hdims[i] != cur[i]) same = 0;
+    if (max[i] != H5S_UNLIMITED && hdims[i] > max[i]) {
+      retval = 0;
+      goto fail;
+    }
+  }
+  if (!same) {
+    if ((dcpl = H5Dget_create_plist(dset)) < 0) goto fail;
+    if (H5Pget_layout(dcpl) != H5D_CHUNKED) {
+      retval = 0;
+      goto fail;
+    }
+    if (H5Dset_extent(dset, hdims) < 0) goto fail;
+  }
+  retval = 1;
+ fail:
+  if (dcpl > 0) H5Pclose(dcpl);
+  if (dspace > 0) H5Sclose(dspace);
+  if (dtype > 0) H5Tclose(dtype);
+  return retval;
+}
+
+/* Reads the content of existing dataset `dset` of type `memtype`,
+   such that it can be copied to a recreated dataset with `ndims`
+   dimensions of sizes `dims`.
+
+   On success, `olddims` is assigned to the dimensions of `dset` and
+   `*buf` to a newly malloc'ed buffer with its data (NULL if it is
+   empty).  Variable length strings in `*buf` should be released with
+   H5Dvlen_reclaim().
+
+   Returns non-zero on error. */
+static int read_old_data(DLiteDataModel *d, hid_t dset, hid_t memtype,
+                         size_t size, size_t ndims, const size_t *dims,
+                         hsize_t *olddims, void **buf)
+{
+  hid_t dtype=-1, dspace=-1;
+  htri_t equal;
+  size_t i, nmemb=1;
+  int rank, retval=1;
+
+  *buf = NULL;
+  if ((dtype = H5Dget_type(dset)) < 0 ||
+      (equal = H5Tequal(dtype, memtype)) < 0 ||
+      (dspace = H5Dget_space(dset)) < 0 ||
+      (rank = H5Sget_simple_extent_dims(dspace, olddims, NULL)) < 0)
+    DFAIL0(d, "cannot get type and shape of existing dataset");
+  if (!equal || rank != (int)ndims)
+    DFAIL0(d, "cannot write block to dataset of different type or rank");
+  for (i=0; i<ndims; i++) {
+    if (olddims[i] > dims[i])
+      DFAIL0(d, "cannot write block to dataset that has shrunk");
+    nmemb *= olddims[i];
+  }
+  if (nmemb) {
+    if (!(*buf = malloc(nmemb * size))) FAIL0("allocation failure");
+    if (H5Dread(dset, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, *buf) < 0) {
+      free(*buf);
+      *buf = NULL;
+      DFAIL0(d, "cannot read existing dataset");
+    }
+  }
+  retval = 0;
+ fail:
+  if (dspace > 0) H5Sclose(dspace);
+  if (dtype > 0) H5Tclose(dtype);
+  return retval;
+}
+
+/* Writes `buf` returned by read_old_data() to the start of the
+   recreated dataset `dset` and releases it.  Returns non-zero on
+   error. */
+static int write_old_data(DLiteDataModel *d, hid_t dset, hid_t memtype,
+                          size_t ndims, const hsize_t *olddims, void *buf)
+{
+  DH5Storage *s = (DH5Storage *)d->s;
+  hid_t memspace=-1, filespace=-1;
+  hsize_t start[H5S_MAX_RANK];
+  size_t i;
+  int retval=1;
+  if (!buf) return 0;
+  for (i=0; i<ndims; i++) start[i] = 0;
+  if ((memspace = H5Screate_simple(ndims, olddims, NULL)) < 0 ||
+      (filespace = H5Dget_space(dset)) < 0 ||
+      H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, olddims,
+                          NULL) < 0)
+    DFAIL0(d, "cannot select existing data in recreated dataset");
+  if (H5Dwrite(dset, memtype, memspace, filespace, s->dxpl, buf) < 0)
+    DFAIL0(d, "cannot write existing data to recreated dataset");
+  retval = 0;
+ fail:
+  if (H5Tis_variable_str(memtype) > 0 && memspace > 0)
+    H5Dvlen_reclaim(memtype, memspace, H5P_DEFAULT, buf);
+  free(buf);
+  if (filespace > 0) H5Sclose(filespace);
+  if (memspace > 0) H5Sclose(memspace);
+  return retval;
+}
+
+/* Copies memory pointed to by `ptr` to a block of hdf5 dataset `name`
+   in `group`.
+
+   Multi-dimensional arrays are supported.  `size` is the size of each
+   data element, `ndims` is the number of dimensions and `dims` is an
+   array of dimension sizes of the dataset.  `offsets` and `counts` are
+   arrays of length `ndims` with the start index and number of elements
+   along each dimension of the block.  `ptr` holds the elements of the
+   block in C order.  If `counts` is NULL, the whole dataset is written.
+
+   An existing dataset is overwritten in place if its type and shape
+   allows (see reuse_dataset()), otherwise it is recreated.  Chunked
+   datasets are created with unlimited maximum dimensions, such that
+   they can grow.  When a block is written to a dataset that must be
+   recreated, its existing data is copied to the new dataset.
+
+   With option `mpi`, this function is collective.
+
+   Returns non-zero on error.
+ */
+static int set_data_slice(DLiteDataModel *d, hid_t group,
+                          const char *name, const void *ptr,
+                          DLiteType type, size_t size,
+                          size_t ndims, const size_t *dims,
+                          const size_t *offsets, const size_t *counts)
+{
+  DH5Storage *s = (DH5Storage *)d->s;
+  hid_t memtype=0, space=0, dset=0, dcpl=H5P_DEFAULT;
+  hid_t memspace=H5S_ALL, filespace=H5S_ALL;
+  hsize_t hstart[H5S_MAX_RANK], hcount[H5S_MAX_RANK];
+  hsize_t olddims[H5S_MAX_RANK];
   herr_t stat;
   htri_t exists;
-  int retval=-1;
+  size_t i, nmemb=1;
+  int reuse=0, retval=-1;
+  void *old=NULL;
 
   errno=0;
+  if ((memtype = cached_memtype(s, type, size)) < 0) goto fail;
   if ((exists = H5Lexists(group, name, H5P_DEFAULT)) < 0)
     DFAIL1(d, "cannot determine if dataset '%s' already exists", name);
 
-  /* Delete dataset if it already exists */
-  if (exists && H5Ldelete(group, name, H5P_DEFAULT) < 0)
-    DFAIL1(d, "cannot delete dataset '%s' for overwrite", name);
+  /* Overwrite existing dataset in place or delete it */
+  if (exists) {
+    if ((dset = H5Dopen2(group, name, H5P_DEFAULT)) < 0)
+      DFAIL1(d, "cannot open dataset '%s'", name);
+    if ((reuse = reuse_dataset(dset, memtype, ndims, dims)) < 0)
+      DFAIL1(d, "cannot prepare dataset '%s' for overwrite", name);
+    if (!reuse) {
+      if (counts && read_old_data(d, dset, memtype, size, ndims, dims,
+                                  olddims, &old))
+        DFAIL1(d, "cannot recreate dataset '%s'", name);
+      H5Dclose(dset);
+      dset = 0;
+      if (H5Ldelete(group, name, H5P_DEFAULT) < 0)
+        DFAIL1(d, "cannot delete dataset '%s' for overwrite", name);
+    }
+  }
 
-  if ((memtype = get_memtype(type, size)) < 0) goto fail;
-  if ((space = get_space(ndims, dims)) < 0) goto fail;
+  if (!reuse) {
+    int extendible = (s->swmr != dh5SwmrNone ||
+                      (((DH5DataModel *)d)->compact && counts));
+    if ((dcpl = get_dcpl(s, extendible, size, ndims, dims)) < 0)
+      DFAIL1(d, "cannot create creation property list for dataset '%s'",
+             name);
+    space = (dcpl > 0) ? get_space(ndims, dims, 1) :
+      cached_space(s, ndims, dims);
+    if (space < 0) goto fail;
+    if ((dset = H5Dcreate(group, name, memtype, space,
+                          H5P_DEFAULT, dcpl, H5P_DEFAULT)) < 0)
+      DFAIL1(d, "cannot create dataset '%s'", name);
+    if (old) {
+      void *buf = old;
+      old = NULL;  /* released by write_old_data() */
+      if (write_old_data(d, dset, memtype, ndims, olddims, buf))
+        DFAIL1(d, "cannot copy existing data of '%s'", name);
+    }
+  }
 
-  if ((dset = H5Dcreate(group, name, memtype, space,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT)) < 0)
-    DFAIL1(d, "cannot create dataset '%s'", name);
+  /* Select block */
+  if (counts) {
+    if (ndims > H5S_MAX_RANK)
+      DFAIL1(d, "too many dimensions of '%s'", name);
+    for (i=0; i<ndims; i++) {
+      if (offsets[i] + counts[i] > dims[i])
+        DFAIL2(d, "block exceeds dimension %lu of '%s'",
+               (unsigned long)i, name);
+      hstart[i] = offsets[i];
+      hcount[i] = counts[i];
+      nmemb *= counts[i];
+    }
+    if ((memspace = cached_space(s, ndims, counts)) < 0) goto fail;
+    if ((filespace = H5Dget_space(dset)) < 0)
+      DFAIL1(d, "cannot get data space of '%s'", name);
+    if (nmemb == 0) {
+      /* still take part in collective writes */
+      if (H5Sselect_none(filespace) < 0)
+        DFAIL1(d, "cannot select empty block of '%s'", name);
+    } else if (H5Sselect_hyperslab(filespace, H5S_SELECT_SET, hstart, NULL,
+                                   hcount, NULL) < 0) {
+      DFAIL1(d, "cannot select block of '%s'", name);
+    }
+  }
 
-  if ((stat = H5Dwrite(dset, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, ptr)) < 0)
+  if ((stat = H5Dwrite(dset, memtype, memspace, filespace, s->dxpl,
+                       ptr)) < 0)
     DFAIL1(d, "cannot write dataset '%s'", name);
 
   retval = 0;
  fail:
+  if (old) {
+    if (H5Tis_variable_str(memtype) > 0) {
+      hid_t oldspace = H5Screate_simple(ndims, olddims, NULL);
+      H5Dvlen_reclaim(memtype, oldspace, H5P_DEFAULT, old);
+      H5Sclose(oldspace);
+    }
+    free(old);
+  }
+  if (filespace > 0) H5Sclose(filespace);
   if (dset > 0) H5Dclose(dset);
-  if (space > 0) H5Sclose(space);
-  if (memtype > 0) H5Tclose(memtype);
+  if (space > 0 && dcpl > 0) H5Sclose(space);
+  if (dcpl > 0) H5Pclose(dcpl);
   return retval;
 }
 
+/* Copies memory pointed to by `ptr` to hdf5 dataset `name` in `group`.
+
+   Multi-dimensional arrays are supported.  `size` is the size of each
+   data element, `ndims` is the number of dimensions and `dims` is an
+   array of dimension sizes.
+
+   Returns non-zero on error.
+ */
+static int set_data(DLiteDataModel *d, hid_t group,
+                    const char *name, const void *ptr,
+                    DLiteType type, size_t size,
+                    size_t ndims, const size_t *dims)
+{
+  return set_data_slice(d, group, name, ptr, type, size, ndims, dims,
+                        NULL, NULL);
+}
+
 
 #if 0
 /* Deletes dataset `name` from group `group`. Returns -1 on error. */
 static int delete_data(DLiteDataModel *d, hid_t group, const char *name)
 {
-  UNUSED(d);
-  if (H5Ldelete(group, name, H5P_DEFAULT) < 0)
-    return errx(-1, "cannot delete dataset '%s'", name);
+  UNUSED(d);
+  if (H5Ldelete(group, name, H5P_DEFAULT) < 0)
+    return errx(-1, "cannot delete dataset '%s'", name);
+  return 0;
+}
+#endif
+
+
+/* Entry in the linked list of entries created by find_entries() */
+typedef struct _EntryList {
+  char *name;
+  struct _EntryList *next;
+} EntryList;
+
+/* Callback function for H5Literate(). For each visited entry, add its
+   name to the front of the EntryList pointed to by `op_data`. */
+static herr_t find_entries(hid_t loc_id, const char *name,
+                           const H5L_info_t *info, void *op_data)
+{
+  herr_t stat;
+  H5O_info_t infobuf;
+  EntryList *e, **ep = op_data;
+  UNUSED(info);
+
+  if ((stat = H5Oget_info_by_name(loc_id, name, &infobuf, H5P_DEFAULT)) < 0)
+    err(-1, "cannot get info about '%s'", name);
+  else {
+    int n = strlen(name) + 1;
+    if (!(e = malloc(sizeof(EntryList)))) return err(-1, NULL);
+    if (!(e->name = malloc(n))) {
+      free(e);
+      return err(-1, NULL);
+    }
+    memcpy(e->name, name, n);
+    e->next = *ep;
+    *ep = e;
+  }
+
+  return 0;
+}
+
+/* Free's all items in an EntryList. */
+static void entrylist_free(EntryList *e)
+{
+  EntryList *next;
+  while (e) {
+    next = e->next;
+    free(e->name);
+    free(e);
+    e = next;
+  }
+}
+
+
+/********************************************************************
+ * Compact layout
+ *
+ * With option `compact`, instances with the same metadata and
+ * dimension sizes are stored as rows in shared datasets in group
+ * /_compact/<key>, where <key> is an uuid generated from the metadata
+ * uri and dimension sizes.  The group contains:
+ *
+ *   meta/        name, version and namespace of the metadata
+ *   dimensions/  dimension sizes
+ *   properties/  one dataset per property, with rows as first dimension
+ *   uuids        uuid of the instance in each row
+ *   datanames    data name of the instance in each row, or ""
+ *
+ * The uuids of all rows are read into an index when the storage is
+ * opened.
+ ********************************************************************/
+
+/* Returns the length of the first dimension of dataset `name` in
+   `group`, zero if it does not exist or -1 on error. */
+static hssize_t dataset_length(hid_t group, const char *name)
+{
+  hid_t dset, space;
+  hsize_t dims[H5S_MAX_RANK];
+  htri_t exists;
+  int rank;
+  if ((exists = H5Lexists(group, name, H5P_DEFAULT)) < 0) return -1;
+  if (!exists) return 0;
+  if ((dset = H5Dopen2(group, name, H5P_DEFAULT)) < 0) return -1;
+  if ((space = H5Dget_space(dset)) < 0) {
+    H5Dclose(dset);
+    return -1;
+  }
+  rank = H5Sget_simple_extent_dims(space, dims, NULL);
+  H5Sclose(space);
+  H5Dclose(dset);
+  if (rank < 0) return -1;
+  return (rank) ? (hssize_t)dims[0] : 1;
+}
+
+/* Returns the index of compact group `name` in `s`.  The group is
+   added if it is not already known.  Returns -1 on error. */
+static int compact_group_index(DH5Storage *s, const char *name)
+{
+  char **groups;
+  size_t i;
+  for (i=0; i<s->ngroups; i++)
+    if (strcmp(s->groups[i], name) == 0) return i;
+  if (!(groups = realloc(s->groups, (s->ngroups + 1)*sizeof(char *))))
+    return err(-1, "allocation failure");
+  s->groups = groups;
+  if (!(groups[s->ngroups] = strdup(name)))
+    return err(-1, "allocation failure");
+  return s->ngroups++;
+}
+
+/* Adds instance `uuid` stored in `row` of compact group number `group`
+   to the index of `s`.  Returns non-zero on error. */
+static int compact_add_row(DH5Storage *s, size_t group, hsize_t row,
+                           const char *uuid)
+{
+  if (s->nrows >= s->rowsize) {
+    size_t n = (s->rowsize) ? 2*s->rowsize : 64;
+    DH5Row *rows;
+    if (!(rows = realloc(s->rows, n*sizeof(DH5Row))))
+      return err(1, "allocation failure");
+    s->rows = rows;
+    s->rowsize = n;
+  }
+  s->rows[s->nrows].group = group;
+  s->rows[s->nrows].row = row;
+  if (map_set(&s->index, uuid, s->nrows))
+    return err(1, "allocation failure");
+  s->nrows++;
+  return 0;
+}
+
+/* Reads the uuids of all instances in the compact layout of `s` into
+   its index.  Returns non-zero on error. */
+static int compact_load_index(DH5Storage *s)
+{
+  EntryList *entries=NULL, *e;
+  hid_t group=-1, dset=-1, memtype=-1;
+  size_t len = DLITE_UUID_LENGTH + 1;
+  char *buf=NULL;
+  htri_t exists;
+  int retval=1;
+
+  if ((exists = H5Lexists(s->root, DH5_COMPACT, H5P_DEFAULT)) < 0)
+    FAIL1("cannot determine if %s has a compact layout", s->location);
+  if (!exists) return 0;
+  if ((s->compactgroup = H5Gopen(s->root, DH5_COMPACT, H5P_DEFAULT)) < 0)
+    FAIL2("cannot open '/%s' in %s", DH5_COMPACT, s->location);
+  if (H5Literate(s->compactgroup, H5_INDEX_NAME, H5_ITER_NATIVE, NULL,
+                 find_entries, &entries) < 0)
+    FAIL1("cannot list compact groups in %s", s->location);
+  if ((memtype = H5Tcopy(H5T_C_S1)) < 0 || H5Tset_size(memtype, len) < 0)
+    FAIL0("cannot create uuid memory type");
+
+  for (e=entries; e; e=e->next) {
+    hssize_t i, n;
+    int gidx;
+    if ((group = H5Gopen(s->compactgroup, e->name, H5P_DEFAULT)) < 0)
+      FAIL3("cannot open '/%s/%s' in %s", DH5_COMPACT, e->name, s->location);
+    if ((n = dataset_length(group, "uuids")) < 0)
+      FAIL3("cannot get number of rows in '/%s/%s' in %s",
+            DH5_COMPACT, e->name, s->location);
+    if ((gidx = compact_group_index(s, e->name)) < 0) goto fail;
+    if (n > 0) {
+      if (!(buf = malloc(n * len))) FAIL0("allocation failure");
+      if ((dset = H5Dopen2(group, "uuids", H5P_DEFAULT)) < 0 ||
+          H5Dread(dset, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf) < 0)
+        FAIL3("cannot read '/%s/%s/uuids' in %s",
+              DH5_COMPACT, e->name, s->location);
+      for (i=0; i<n; i++)
+        if (compact_add_row(s, gidx, i, buf + i*len)) goto fail;
+      H5Dclose(dset);
+      dset = -1;
+      free(buf);
+      buf = NULL;
+    }
+    H5Gclose(group);
+    group = -1;
+  }
+  retval = 0;
+ fail:
+  if (buf) free(buf);
+  if (dset > 0) H5Dclose(dset);
+  if (group > 0) H5Gclose(group);
+  if (memtype > 0) H5Tclose(memtype);
+  if (entries) entrylist_free(entries);
+  return retval;
+}
+
+/* Opens compact group `name` and assigns the group identifiers of
+   `d`.  If `create` is non-zero, the group is created.  Returns
+   non-zero on error. */
+static int compact_open(DLiteDataModel *d, const char *name, int create)
+{
+  DH5DataModel *dh5 = (DH5DataModel *)d;
+  DH5Storage *s = (DH5Storage *)d->s;
+  const char *subgroups[] = {"meta", "dimensions", "properties"};
+  hid_t *ids[] = {&dh5->meta, &dh5->dimensions, &dh5->properties};
+  int i;
+
+  if (create && !s->compactgroup &&
+      (s->compactgroup = H5Gcreate(s->root, DH5_COMPACT, H5P_DEFAULT,
+                                   H5P_DEFAULT, H5P_DEFAULT)) < 0) {
+    s->compactgroup = 0;
+    return err(1, "cannot create '/%s' in %s", DH5_COMPACT, s->location);
+  }
+  if (create)
+    dh5->instance = H5Gcreate(s->compactgroup, name, H5P_DEFAULT,
+                              H5P_DEFAULT, H5P_DEFAULT);
+  else
+    dh5->instance = H5Gopen(s->compactgroup, name, H5P_DEFAULT);
+  if (dh5->instance < 0) {
+    dh5->instance = 0;
+    return err(1, "cannot open '/%s/%s' in %s",
+               DH5_COMPACT, name, s->location);
+  }
+  for (i=0; i<3; i++) {
+    if (create)
+      *ids[i] = H5Gcreate(dh5->instance, subgroups[i], H5P_DEFAULT,
+                          H5P_DEFAULT, H5P_DEFAULT);
+    else
+      *ids[i] = H5Gopen(dh5->instance, subgroups[i], H5P_DEFAULT);
+    if (*ids[i] < 0) {
+      *ids[i] = 0;
+      return err(1, "cannot open '/%s/%s/%s' in %s",
+                 DH5_COMPACT, name, subgroups[i], s->location);
+    }
+  }
+  return 0;
+}
+
+/* Frees the data of `d` that is kept until its row is assigned. */
+static void compact_free_pending(DLiteDataModel *d)
+{
+  DH5DataModel *dh5 = (DH5DataModel *)d;
+  size_t i;
+  if (dh5->metauri) free(dh5->metauri);
+  for (i=0; i<dh5->ndims; i++) free(dh5->dimnames[i]);
+  if (dh5->dimnames) free(dh5->dimnames);
+  if (dh5->dimsizes) free(dh5->dimsizes);
+  if (dh5->dataname) free(dh5->dataname);
+  dh5->metauri = NULL;
+  dh5->dimnames = NULL;
+  dh5->dimsizes = NULL;
+  dh5->ndims = 0;
+  dh5->dataname = NULL;
+}
+
+/* Writes metadata uri `uri` to the group `meta`.  Returns non-zero
+   on error. */
+static int write_meta_uri(DLiteDataModel *d, hid_t meta, const char *uri)
+{
+  size_t dims[1]={1};
+  char *name, *version, *namespace;
+  int nerr=0;
+
+  if (dlite_split_meta_uri(uri, &name, &version, &namespace))
+    return 1;
+
+  nerr += set_data(d, meta, "name", name, dliteFixString,
+                   strlen(name), 1, dims) != 0;
+  nerr += set_data(d, meta, "version", version, dliteFixString,
+                   strlen(version), 1, dims) != 0;
+  nerr += set_data(d, meta, "namespace", namespace, dliteFixString,
+                   strlen(namespace), 1, dims) != 0;
+
+  free(name);
+  free(version);
+  free(namespace);
+  return nerr;
+}
+
+/* Writes size of dimension `name` to group `dimensions`.  Returns
+   non-zero on error. */
+static int write_dimension_size(DLiteDataModel *d, hid_t dimensions,
+                                const char *name, size_t size)
+{
+  size_t dims[1]={1};
+  int64_t dsize=size;
+  return set_data(d, dimensions, name, &dsize, dliteInt,
+                  sizeof(int64_t), 1, dims);
+}
+
+/* Assigns a row in the compact layout to the new instance of `d`,
+   creating the compact group for its metadata and dimension sizes
+   if needed.  Does nothing if the row is already assigned.
+
+   Returns non-zero on error. */
+static int compact_assign(DLiteDataModel *d)
+{
+  DH5DataModel *dh5 = (DH5DataModel *)d;
+  DH5Storage *s = (DH5Storage *)d->s;
+  char name[DLITE_UUID_LENGTH+1], *key=NULL, *q;
+  const char *dataname = (dh5->dataname) ? dh5->dataname : "";
+  size_t i, len, dims[1], offsets[1], counts[1]={1};
+  htri_t exists=0;
+  hssize_t n;
+  int gidx, retval=1;
+
+  if (dh5->instance > 0) return 0;
+  if (!dh5->metauri)
+    return errx(1, "%s/%s: metadata uri must be set before properties in "
+                "the compact layout", s->location, d->uuid);
+
+  /* name of compact group */
+  len = strlen(dh5->metauri) + 1;
+  for (i=0; i<dh5->ndims; i++) len += strlen(dh5->dimnames[i]) + 24;
+  if (!(key = malloc(len))) FAIL0("allocation failure");
+  q = key + sprintf(key, "%s", dh5->metauri);
+  for (i=0; i<dh5->ndims; i++)
+    q += sprintf(q, ";%s=%lu", dh5->dimnames[i],
+                 (unsigned long)dh5->dimsizes[i]);
+  if (dlite_get_uuid(name, key) < 0) goto fail;
+
+  if (s->compactgroup &&
+      (exists = H5Lexists(s->compactgroup, name, H5P_DEFAULT)) < 0)
+    DFAIL1(d, "cannot determine if compact group '%s' exists", name);
+  if (compact_open(d, name, !exists)) goto fail;
+  if (!exists) {
+    if (write_meta_uri(d, dh5->meta, dh5->metauri)) goto fail;
+    for (i=0; i<dh5->ndims; i++)
+      if (write_dimension_size(d, dh5->dimensions, dh5->dimnames[i],
+                               dh5->dimsizes[i])) goto fail;
+  }
+  if ((gidx = compact_group_index(s, name)) < 0) goto fail;
+
+  /* append row */
+  if ((n = dataset_length(dh5->instance, "uuids")) < 0)
+    DFAIL1(d, "cannot get number of rows in compact group '%s'", name);
+  dims[0] = n + 1;
+  offsets[0] = n;
+  if (set_data_slice(d, dh5->instance, "uuids", d->uuid, dliteFixString,
+                     DLITE_UUID_LENGTH, 1, dims, offsets, counts) ||
+      set_data_slice(d, dh5->instance, "datanames", &dataname,
+                     dliteStringPtr, sizeof(char *), 1, dims, offsets,
+                     counts))
+    goto fail;
+  dh5->row = n;
+  dh5->nrows = n + 1;
+  if (compact_add_row(s, gidx, dh5->row, d->uuid)) goto fail;
+  compact_free_pending(d);
+
+  retval = 0;
+ fail:
+  if (key) free(key);
+  return retval;
+}
+
+/* Returns non-zero and reports an error if `d` refers to an instance
+   in the compact layout that has not been saved. */
+static int compact_missing(const DLiteDataModel *d)
+{
+  const DH5DataModel *dh5 = (const DH5DataModel *)d;
+  if (dh5->compact && dh5->instance <= 0)
+    return errx(1, "no instance '%s' in %s", d->uuid, d->s->location);
+  return 0;
+}
+
+/* Prepends the row of `d` to the `ndims` elements of `dims`,
+   `offsets` and `counts` and writes the results to `rdims`, `roffsets`
+   and `rcounts`.  Any of the input arrays may be NULL, in which case
+   sizes of one, zero offsets and sizes of one are assumed,
+   respectively.  Returns non-zero on error. */
+static int compact_row_slice(const DLiteDataModel *d, size_t ndims,
+                             const size_t *dims, const size_t *offsets,
+                             const size_t *counts, size_t *rdims,
+                             size_t *roffsets, size_t *rcounts)
+{
+  const DH5DataModel *dh5 = (const DH5DataModel *)d;
+  size_t i;
+  if (ndims + 1 > H5S_MAX_RANK)
+    return errx(1, "too many dimensions for the compact layout: %lu",
+                (unsigned long)ndims);
+  rdims[0] = dh5->nrows;
+  roffsets[0] = dh5->row;
+  rcounts[0] = 1;
+  for (i=0; i<ndims; i++) {
+    rdims[i+1] = (dims) ? dims[i] : 1;
+    roffsets[i+1] = (offsets) ? offsets[i] : 0;
+    rcounts[i+1] = (counts) ? counts[i] : rdims[i+1];
+  }
+  return 0;
+}
+
+
+/* Parses the value of the `chunk` option and assigns the chunking
+   fields of `s`.  Returns non-zero on error. */
+static int parse_chunk(DH5Storage *s, const char *value)
+{
+  const char *p = value;
+  char *endptr;
+  if (strcmp(value, "none") == 0 || strcmp(value, "no") == 0) {
+    s->chunk = dh5ChunkNone;
+    return 0;
+  }
+  if (strcmp(value, "auto") == 0) {
+    s->chunk = dh5ChunkAuto;
+    return 0;
+  }
+  s->chunk = dh5ChunkDims;
+  s->nchunkdims = 0;
+  while (1) {
+    long n = strtol(p, &endptr, 10);
+    if (endptr == p || n <= 0 || s->nchunkdims >= H5S_MAX_RANK)
+      return errx(1, "invalid `chunk=%s`.  Should be \"none\", \"auto\" "
+                  "or chunk dimensions separated by 'x', like \"64x64\"",
+                  value);
+    s->chunkdims[s->nchunkdims++] = n;
+    if (!*endptr) break;
+    if (*endptr != 'x' && *endptr != ',')
+      return errx(1, "invalid separator in `chunk=%s`", value);
+    p = endptr + 1;
+  }
+  return 0;
+}
+
+/* Parses the value of the `compression` option and assigns the filter
+   fields of `s`.  Returns non-zero on error. */
+static int parse_compression(DH5Storage *s, const char *value)
+{
+  size_t len = strcspn(value, ":");
+  const char *name = value;
+  htri_t avail;
+  s->level = -1;
+  if (value[len]) {
+    char *endptr;
+    s->level = strtol(value + len + 1, &endptr, 10);
+    if (*endptr || endptr == value + len + 1 || s->level < 0)
+      return errx(1, "invalid compression level in `compression=%s`", value);
+  }
+  if (strncmp(name, "none", len) == 0 && len == 4) {
+    s->filter = H5Z_FILTER_NONE;
+    return 0;
+  } else if (strncmp(name, "gzip", len) == 0 && len == 4) {
+    s->filter = H5Z_FILTER_DEFLATE;
+    if (s->level > 9)
+      return errx(1, "gzip compression level must be in range 0-9");
+  } else if (strncmp(name, "zstd", len) == 0 && len == 4) {
+    s->filter = DH5_FILTER_ZSTD;
+  } else if (strncmp(name, "blosc", len) == 0 && len == 5) {
+    s->filter = DH5_FILTER_BLOSC;
+  } else {
+    return errx(1, "invalid `compression=%s`.  Should be \"none\", "
+                "\"gzip\", \"zstd\" or \"blosc\", optionally followed "
+                "by a colon and a compression level", value);
+  }
+  if ((avail = H5Zfilter_avail(s->filter)) <= 0)
+    return errx(1, "compression filter \"%.*s\" is not available in hdf5",
+                (int)len, name);
+  return 0;
+}
+
+/* Parses the value of option `name` as a number of bytes, optionally
+   followed by a k, M or G suffix, and stores it in `*size`.  Returns
+   non-zero on error. */
+static int parse_bytes(const char *name, const char *value, hsize_t *size)
+{
+  char *endptr;
+  double v = strtod(value, &endptr);
+  switch (*endptr) {
+  case 'k': case 'K': v *= 1024.0; endptr++; break;
+  case 'M':           v *= 1024.0*1024; endptr++; break;
+  case 'G':           v *= 1024.0*1024*1024; endptr++; break;
+  }
+  if (endptr == value || *endptr || v < 0)
+    return errx(1, "invalid `%s=%s`.  Should be a number of bytes, "
+                "optionally followed by k, M or G", name, value);
+  *size = (hsize_t)v;
+  return 0;
+}
+
+/* Creates the file access property list `*fapl` if it is H5P_DEFAULT.
+   Returns non-zero on error. */
+static int ensure_fapl(hid_t *fapl)
+{
+  if (*fapl == H5P_DEFAULT && (*fapl = H5Pcreate(H5P_FILE_ACCESS)) < 0)
+    return errx(1, "cannot create hdf5 file access property list");
   return 0;
 }
-#endif
 
+/* Adds the file access tuning options `opts` (page-buffer, page-size,
+   metadata-cache, driver, backing-store and alignment, in that order)
+   to `*fapl`.  If a page buffer is requested, `*fcpl` is created with
+   a paged file space strategy for new files.  Returns non-zero on
+   error. */
+static int set_file_access(hid_t *fapl, hid_t *fcpl, const DLiteOpt *opts,
+                           int mpi)
+{
+  hsize_t pagebuf, pagesize, mdcsize, align=0, threshold=1;
+  const char *p;
+  int backing;
+  if (parse_bytes("page-buffer", opts[0].value, &pagebuf) ||
+      parse_bytes("page-size", opts[1].value, &pagesize) ||
+      parse_bytes("metadata-cache", opts[2].value, &mdcsize))
+    return 1;
+  if ((backing = atob(opts[4].value)) < 0)
+    return errx(1, "invalid boolean value for `backing-store=%s`",
+                opts[4].value);
+  if ((p = strchr(opts[5].value, ':'))) {
+    char *buf = strndup(opts[5].value, p - opts[5].value);
+    int stat = (buf) ? parse_bytes("alignment", buf, &threshold) : 1;
+    if (buf) free(buf);
+    if (stat || parse_bytes("alignment", p + 1, &align)) return 1;
+  } else if (parse_bytes("alignment", opts[5].value, &align)) {
+    return 1;
+  }
 
-/* Entry in the linked list of entries created by find_entries() */
-typedef struct _EntryList {
-  char *name;
-  struct _EntryList *next;
-} EntryList;
+  if (pagebuf) {
+    if (pagebuf < pagesize)
+      return errx(1, "`page-buffer=%s` must be at least `page-size=%s`",
+                  opts[0].value, opts[1].value);
+    if (ensure_fapl(fapl) ||
+        H5Pset_page_buffer_size(*fapl, (size_t)pagebuf, 0, 0) < 0)
+      return errx(1, "cannot set page buffer size");
+    if ((*fcpl = H5Pcreate(H5P_FILE_CREATE)) < 0 ||
+        H5Pset_file_space_strategy(*fcpl, H5F_FSPACE_STRATEGY_PAGE, 1, 1) < 0 ||
+        H5Pset_file_space_page_size(*fcpl, pagesize) < 0)
+      return errx(1, "cannot set paged file space strategy");
+  }
 
-/* Callback function for H5Literate(). For each visited entry, add its
-   name to the front of the EntryList pointed to by `op_data`. */
-static herr_t find_entries(hid_t loc_id, const char *name,
-                           const H5L_info_t *info, void *op_data)
-{
-  herr_t stat;
-  H5O_info_t infobuf;
-  EntryList *e, **ep = op_data;
-  UNUSED(info);
+  if (mdcsize) {
+    H5AC_cache_config_t config;
+    config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+    if (ensure_fapl(fapl) || H5Pget_mdc_config(*fapl, &config) < 0)
+      return errx(1, "cannot get metadata cache configuration");
+    config.set_initial_size = 1;
+    config.initial_size = (size_t)mdcsize;
+    config.max_size = (size_t)mdcsize;
+    if (config.min_size > config.max_size) config.min_size = config.max_size;
+    if (H5Pset_mdc_config(*fapl, &config) < 0)
+      return errx(1, "invalid `metadata-cache=%s`", opts[2].value);
+  }
 
-  if ((stat = H5Oget_info_by_name(loc_id, name, &infobuf, H5P_DEFAULT)) < 0)
-    err(-1, "cannot get info about '%s'", name);
-  else {
-    int n = strlen(name) + 1;
-    if (!(e = malloc(sizeof(EntryList)))) return err(-1, NULL);
-    if (!(e->name = malloc(n))) {
-      free(e);
-      return err(-1, NULL);
-    }
-    memcpy(e->name, name, n);
-    e->next = *ep;
-    *ep = e;
+  if (strcmp(opts[3].value, "core") == 0) {
+    if (mpi) return errx(1, "option `driver=core` cannot be combined "
+                         "with `mpi`");
+    if (ensure_fapl(fapl) ||
+        H5Pset_fapl_core(*fapl, 1024*1024, (hbool_t)backing) < 0)
+      return errx(1, "cannot set core file driver");
+  } else if (strcmp(opts[3].value, "direct") == 0) {
+#ifdef H5_HAVE_DIRECT
+    if (mpi) return errx(1, "option `driver=direct` cannot be combined "
+                         "with `mpi`");
+    if (ensure_fapl(fapl) ||
+        H5Pset_fapl_direct(*fapl, 4096, 4096, 16*1024*1024) < 0)
+      return errx(1, "cannot set direct file driver");
+#else
+    return errx(1, "`driver=direct` requires an hdf5 build with the "
+                "direct file driver");
+#endif
+  } else if (strcmp(opts[3].value, "sec2") != 0) {
+    return errx(1, "invalid `driver=%s`.  Should be \"sec2\", \"core\" "
+                "or \"direct\"", opts[3].value);
   }
 
+  if (align > 1) {
+    if (ensure_fapl(fapl) || H5Pset_alignment(*fapl, threshold, align) < 0)
+      return errx(1, "invalid `alignment=%s`", opts[5].value);
+  }
   return 0;
 }
 
-/* Free's all items in an EntryList. */
-static void entrylist_free(EntryList *e)
+/* Opens existing file `uri` with `flags` and `fapl`.  Since page
+   buffering requires a file created with paged file space, files
+   without are opened without page buffering.  Returns a file
+   identifier or a negative number on error. */
+static hid_t open_file(const char *uri, unsigned flags, hid_t fapl)
 {
-  EntryList *next;
-  while (e) {
-    next = e->next;
-    free(e->name);
-    free(e);
-    e = next;
-  }
+  hid_t root;
+  size_t pagebuf=0;
+  if (fapl == H5P_DEFAULT ||
+      H5Pget_page_buffer_size(fapl, &pagebuf, NULL, NULL) < 0 || !pagebuf)
+    return H5Fopen(uri, flags, fapl);
+  H5E_BEGIN_TRY {
+    root = H5Fopen(uri, flags, fapl);
+  } H5E_END_TRY;
+  if (root < 0 && H5Pset_page_buffer_size(fapl, 0, 0, 0) >= 0)
+    root = H5Fopen(uri, flags, fapl);
+  return root;
 }
 
 
@@ -433,6 +1665,82 @@ static void entrylist_free(EntryList *e)
       - r        Open existing file for read-only
       - rw       Open existing file for read and write
       - w        Truncate existing file or create new file
+  - chunk : none | auto | <dims>
+      Chunk shape of array datasets, like "64x64".  The given shape
+      applies to the last dimensions of a dataset and is limited by the
+      dataset dimensions.  With "auto", the shape is selected from the
+      dataset shape.  Default is "none" (contiguous datasets), unless
+      compression or shuffle is enabled, in which case it is "auto".
+  - compression : none | gzip[:level] | zstd[:level] | blosc[:level]
+      Compression filter of array datasets.  Default is "none".  zstd
+      and blosc require that the corresponding hdf5 filter plugin is
+      installed.
+  - shuffle : yes | no
+      Whether to apply the byte shuffle filter before compression.
+  - mpi : yes | no
+      Whether to open the file with the MPI-IO driver on MPI_COMM_WORLD.
+      Must be called collectively by all ranks, which write their block
+      of the properties with collective IO.  Use
+      dlite_storage_set_decomposition() to define the block of each
+      rank.  Requires that dlite is built against a parallel hdf5.
+  - swmr : yes | no
+      Single-writer/multiple-reader mode, for streaming time series to
+      a file while other processes read it.  With mode=r, the file is
+      opened as a SWMR reader.  Otherwise all array datasets are
+      chunked with unlimited dimensions, SWMR writing is started after
+      the first instance has been saved and the file is flushed after
+      each save.  Rows appended with dlite_instance_append_dimension()
+      are then written without rewriting earlier rows.  New instances
+      cannot be added to the file once SWMR writing has started.
+      Requires hdf5 1.10 or newer.
+  - compact : yes | no
+      Whether to store new instances with the same metadata and
+      dimension sizes as rows in shared datasets, instead of in a
+      group per instance.  Useful for files with many small instances.
+      Instances in the compact layout cannot change their dimension
+      sizes.  Instances stored in either layout can be read regardless
+      of this option.
+  - page-buffer : bytes
+      Size of the page buffer, which caches metadata and raw data in
+      pages and reduces the number of small reads on parallel and
+      network file systems.  New files are created with a paged file
+      space strategy, which page buffering requires.  Existing files
+      without are opened without page buffering.  Zero (the default)
+      disables page buffering.  Sizes may have a k, M or G suffix.
+  - page-size : bytes
+      File space page size of new files with a page buffer.  Default
+      is 4k.
+  - metadata-cache : bytes
+      Initial and maximum size of the metadata cache.  Zero (default)
+      uses the hdf5 default.
+  - driver : sec2 | core | direct
+      File driver.  The core driver keeps the whole file in memory.
+      The direct driver bypasses the page cache with O_DIRECT, which
+      avoids polluting it when writing very large datasets.  Requires
+      an hdf5 build with the direct driver.
+  - backing-store : yes | no
+      With driver=core, whether to write the file when it is closed.
+      Default is yes.
+  - alignment : [threshold:]bytes
+      Align file objects of at least `threshold` bytes (default 1) to
+      multiples of `bytes`.  Useful for matching the stripe size of
+      parallel file systems.
+  - mmap : yes | no
+      Whether to map contiguous datasets directly into memory when
+      loading instances, instead of reading them.  Arrays are then
+      read on demand, page by page, when they are accessed.  Only
+      uncompressed datasets stored with the native type and byte order
+      are mapped, others are read as usual.  Requires mode=r and that
+      the file is not modified while instances loaded from it exist.
+  - abs_tol : tolerance | name:tolerance,...
+      Absolute error tolerance of float properties.  The low mantissa
+      bits of the values are rounded away within the tolerance before
+      they are written, such that they compress well with the
+      `compression` option.  See dlite-lossy.h for the format.
+      Default: lossless
+  - rel_tol : tolerance | name:tolerance,...
+      Relative error tolerance of float properties, like `abs_tol`.
+      Default: lossless
 
 
 
@@ -453,10 +1761,37 @@ dh5_open(const DLiteStoragePlugin *api, const char *uri, const char *options)
     "\"w\" (truncate existing storage or create a new one)";
   DLiteOpt opts[] = {
     {'m', "mode",    "append", mode_descr},
+    {'c', "chunk",   "none",   "Chunk shape of datasets: \"none\", \"auto\" "
+     "or dimensions like \"64x64\""},
+    {'z', "compression", "none", "Compression filter, like \"gzip:4\""},
+    {'s', "shuffle", "false",  "Whether to apply the shuffle filter"},
+    {'p', "mpi",     "false",  "Whether to use parallel IO with MPI-IO"},
+    {'w', "swmr",    "false",  "Whether to use single-writer/multiple-reader "
+     "mode"},
+    {'k', "compact", "false",  "Whether to pack instances with the same "
+     "metadata and dimensions into shared datasets"},
+    {'b', "page-buffer", "0",  "Page buffer size in bytes, zero to disable"},
+    {'P', "page-size", "4k",   "File space page size of new files with a "
+     "page buffer"},
+    {'M', "metadata-cache", "0", "Metadata cache size in bytes, zero for "
+     "the hdf5 default"},
+    {'d', "driver",  "sec2",
+     "File driver: \"sec2\", \"core\" or \"direct\""},
+    {'B', "backing-store", "true", "With driver=core, whether to write the "
+     "file when it is closed"},
+    {'a', "alignment", "0",    "Alignment of file objects in bytes, "
+     "optionally preceded by a size threshold and a colon"},
+    {'x', "mmap",    "false",  "Whether to map contiguous datasets into "
+     "memory when loading, requires mode=r"},
+    {'A', "abs_tol", NULL,   "Absolute error tolerance of float properties"},
+    {'R', "rel_tol", NULL,   "Relative error tolerance of float properties"},
     {0, NULL, NULL, NULL}
   };
   char *optcopy = (options) ? strdup(options) : NULL;
   const char **mode = &opts[0].value;
+  hid_t fapl=H5P_DEFAULT, fcpl=H5P_DEFAULT;
+  unsigned swmrflag=0;
+  int mpi, swmr, mapped;
   UNUSED(api);
 
   if (dlite_option_parse(optcopy, opts, 1)) goto fail;
@@ -464,18 +1799,82 @@ dh5_open(const DLiteStoragePlugin *api, const char *uri, const char *options)
   H5open();  /* Opens hdf5 library */
 
   if (!(s = calloc(1, sizeof(DH5Storage)))) FAIL0("allocation failure");
+  s->mapfd = -1;
+  if (parse_chunk(s, opts[1].value)) goto fail;
+  if (parse_compression(s, opts[2].value)) goto fail;
+  if ((s->shuffle = atob(opts[3].value)) < 0)
+    FAIL1("invalid boolean value for `shuffle=%s`", opts[3].value);
+  if ((mpi = atob(opts[4].value)) < 0)
+    FAIL1("invalid boolean value for `mpi=%s`", opts[4].value);
+  if ((swmr = atob(opts[5].value)) < 0)
+    FAIL1("invalid boolean value for `swmr=%s`", opts[5].value);
+  if (mpi && swmr)
+    FAIL0("options `mpi` and `swmr` cannot be combined");
+  if ((s->compact = atob(opts[6].value)) < 0)
+    FAIL1("invalid boolean value for `compact=%s`", opts[6].value);
+  if ((mapped = atob(opts[13].value)) < 0)
+    FAIL1("invalid boolean value for `mmap=%s`", opts[13].value);
+  if (mapped && (strcmp(*mode, "r") != 0 || mpi ||
+                 strcmp(opts[10].value, "core") == 0))
+    FAIL0("option `mmap` requires mode=r and cannot be combined with "
+          "`mpi` or `driver=core`");
+  if (((opts[14].value && *opts[14].value) ||
+       (opts[15].value && *opts[15].value)) &&
+      !(s->lossy = dlite_lossy_create(opts[14].value, opts[15].value)))
+    goto fail;
+  map_init(&s->index);
+
+  s->dxpl = H5P_DEFAULT;
+  if (mpi) {
+#ifdef H5_HAVE_PARALLEL
+    if (ensure_fapl(&fapl) ||
+        H5Pset_fapl_mpio(fapl, MPI_COMM_WORLD, MPI_INFO_NULL) < 0)
+      FAIL1("cannot set up MPI-IO file access for '%s'", uri);
+    if ((s->dxpl = H5Pcreate(H5P_DATASET_XFER)) < 0 ||
+        H5Pset_dxpl_mpio(s->dxpl, H5FD_MPIO_COLLECTIVE) < 0)
+      FAIL1("cannot set up collective data transfer for '%s'", uri);
+#else
+    FAIL1("option `mpi` requires a parallel hdf5 build: '%s'", uri);
+#endif
+  }
+
+  if (swmr) {
+#ifdef H5F_ACC_SWMR_READ
+    if (strcmp(*mode, "r") == 0) {
+      s->swmr = dh5SwmrRead;
+      swmrflag = H5F_ACC_SWMR_READ;
+    } else {
+      /* SWMR writing requires the latest file format */
+      s->swmr = dh5SwmrWrite;
+      if (ensure_fapl(&fapl) ||
+          H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST,
+                               H5F_LIBVER_LATEST) < 0)
+        FAIL1("cannot set up file access for SWMR writing of '%s'", uri);
+    }
+#else
+    FAIL1("option `swmr` requires hdf5 1.10 or newer: '%s'", uri);
+#endif
+  }
+
+  if (set_file_access(&fapl, &fcpl, opts + 7, mpi)) goto fail;
 
   if (strcmp(*mode, "append") == 0) {  /* default */
-    s->root = H5Fopen(uri, H5F_ACC_RDWR | H5F_ACC_CREAT, H5P_DEFAULT);
+    FILE *fp=NULL;
+    /* new files must be created with `fcpl` */
+    if (fcpl != H5P_DEFAULT && !(fp = fopen(uri, "rb")))
+      s->root = H5Fcreate(uri, H5F_ACC_EXCL, fcpl, fapl);
+    else
+      s->root = open_file(uri, H5F_ACC_RDWR | H5F_ACC_CREAT, fapl);
+    if (fp) fclose(fp);
     s->writable = 1;
   } else if (strcmp(*mode, "r") == 0) {
-    s->root = H5Fopen(uri, H5F_ACC_RDONLY, H5P_DEFAULT);
+    s->root = open_file(uri, H5F_ACC_RDONLY | swmrflag, fapl);
     s->writable = 0;
   } else if (strcmp(*mode, "rw") == 0) {
-    s->root = H5Fopen(uri, H5F_ACC_RDWR, H5P_DEFAULT);
+    s->root = open_file(uri, H5F_ACC_RDWR, fapl);
     s->writable = 0;
   } else if (strcmp(*mode, "w") == 0) {
-    s->root = H5Fcreate(uri, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    s->root = H5Fcreate(uri, H5F_ACC_TRUNC, fcpl, fapl);
     s->writable = 1;
   } else {
     FAIL1("invalid \"mode\" value: '%s'. Must be \"append\", \"r\" "
@@ -485,12 +1884,36 @@ dh5_open(const DLiteStoragePlugin *api, const char *uri, const char *options)
   if (s->root < 0)
     FAIL2("cannot open: '%s' with options '%s'", uri, options);
 
+#ifdef HAVE_MMAP
+  if (mapped && (s->mapfd = open(uri, O_RDONLY)) < 0)
+    FAIL1("cannot open '%s' for memory mapping", uri);
+#endif
+
   s->idflag = dliteIDTranslateToUUID;
+  s->location = (char *)uri;  /* borrowed for error messages */
+  if (compact_load_index(s)) goto fail;
+  s->location = NULL;
 
   retval = (DLiteStorage *)s;
  fail:
   if (optcopy) free(optcopy);
-  if (!retval && s) free(s);
+  if (fapl > 0) H5Pclose(fapl);
+  if (fcpl > 0) H5Pclose(fcpl);
+  if (!retval && s) {
+    size_t i;
+    if (s->compactgroup > 0) H5Gclose(s->compactgroup);
+    if (s->root > 0) H5Fclose(s->root);
+    if (s->dxpl > 0) H5Pclose(s->dxpl);
+#ifdef HAVE_MMAP
+    if (s->mapfd >= 0) close(s->mapfd);
+#endif
+    for (i=0; i<s->ngroups; i++) free(s->groups[i]);
+    if (s->groups) free(s->groups);
+    if (s->rows) free(s->rows);
+    map_deinit(&s->index);
+    dlite_lossy_free(s->lossy);
+    free(s);
+  }
   return retval;
 }
 
@@ -501,9 +1924,25 @@ dh5_open(const DLiteStoragePlugin *api, const char *uri, const char *options)
 int dh5_close(DLiteStorage *s)
 {
   DH5Storage *sh5 = (DH5Storage *)s;
+  size_t i;
   int nerr=0;
+  if (sh5->compactgroup > 0 && H5Gclose(sh5->compactgroup) < 0)
+    nerr += err(1, "cannot close /%s in %s", DH5_COMPACT, s->location);
+  for (i=0; i<sh5->ngroups; i++) free(sh5->groups[i]);
+  if (sh5->groups) free(sh5->groups);
+  if (sh5->rows) free(sh5->rows);
+  map_deinit(&sh5->index);
   if (H5Fclose(sh5->root) < 0)
     nerr += err(1, "cannot close %s", s->location);
+  if (free_caches(sh5))
+    nerr += errx(1, "cannot close cached identifiers of %s", s->location);
+  if (sh5->dxpl > 0 && H5Pclose(sh5->dxpl) < 0)
+    nerr += err(1, "cannot close transfer property list of %s", s->location);
+#ifdef HAVE_MMAP
+  if (sh5->mapfd >= 0 && close(sh5->mapfd) < 0)
+    nerr += err(1, "cannot close mapped file %s", s->location);
+#endif
+  dlite_lossy_free(sh5->lossy);
   return nerr;
 }
 
@@ -514,13 +1953,37 @@ DLiteDataModel *dh5_datamodel(const DLiteStorage *s, const char *uuid)
   DLiteDataModel *retval=NULL;
   DH5Storage *sh5 = (DH5Storage *)s;
   htri_t exists;
+  int *idx;
 
   if (!(d = calloc(1, sizeof(DH5DataModel)))) FAIL0("allocation failure");
+  d->s = (DLiteStorage *)s;  /* needed by compact_open() */
+
+  if ((idx = map_get(&sh5->index, uuid))) {
+    /* Instance `uuid` is a row in the compact layout */
+    DH5Row *row = sh5->rows + *idx;
+    hssize_t n;
+    d->compact = 1;
+    d->row = row->row;
+    if (compact_open((DLiteDataModel *)d, sh5->groups[row->group], 0))
+      goto fail;
+    if ((n = dataset_length(d->instance, "uuids")) < 0)
+      FAIL2("cannot get number of rows for '%s' in %s", uuid, sh5->location);
+    d->nrows = n;
+    retval = (DLiteDataModel *)d;
+    goto fail;
+  }
 
   if ((exists = H5Lexists(sh5->root, uuid, H5P_DEFAULT)) < 0)
     FAIL2("cannot determine if '%s' exists in %s", uuid, sh5->location);
 
-  if (exists) {
+  if (!exists && sh5->compact) {
+    /* New instance in the compact layout.  Its row is assigned when
+       the metadata and dimensions are known. */
+    if (!s->writable)
+      FAIL2("cannot create new instance '%s' in read-only storage %s",
+            uuid, sh5->location);
+    d->compact = 1;
+  } else if (exists) {
     /* Instance `uuid` already exists: assign groups */
     if ((d->instance = H5Gopen(sh5->root, uuid, H5P_DEFAULT)) < 0)
       FAIL2("cannot open instance '/%s' in '%s'", uuid, sh5->location);
@@ -560,7 +2023,13 @@ DLiteDataModel *dh5_datamodel(const DLiteStorage *s, const char *uuid)
 
   retval = (DLiteDataModel *)d;
  fail:
-  if (!retval && d) free(d);
+  if (!retval && d) {
+    if (d->properties > 0) H5Gclose(d->properties);
+    if (d->dimensions > 0) H5Gclose(d->dimensions);
+    if (d->meta > 0) H5Gclose(d->meta);
+    if (d->instance > 0) H5Gclose(d->instance);
+    free(d);
+  }
   return retval;
 }
 
@@ -571,7 +2040,14 @@ DLiteDataModel *dh5_datamodel(const DLiteStorage *s, const char *uuid)
 int dh5_datamodel_free(DLiteDataModel *d)
 {
   DH5DataModel *dh5=(DH5DataModel *)d;
+  DH5Storage *sh5=(DH5Storage *)d->s;
   int nerr=0;
+  if (dh5->compact) {
+    /* assign a row to new instances without properties */
+    if (dh5->instance <= 0 && dh5->metauri && compact_assign(d)) nerr++;
+    compact_free_pending(d);
+    if (dh5->instance <= 0) return nerr;
+  }
   if (H5Gclose(dh5->properties) < 0)
     nerr += err(1, "cannot close /%s/properties in %s",
                 d->uuid, d->s->location);
@@ -582,6 +2058,22 @@ int dh5_datamodel_free(DLiteDataModel *d)
     nerr += err(1, "cannot close /%s/meta in %s", d->uuid, d->s->location);
   if (H5Gclose(dh5->instance) < 0)
     nerr += err(1, "cannot close /%s in %s", d->uuid, d->s->location);
+
+#ifdef H5F_ACC_SWMR_WRITE
+  /* Start SWMR writing when the objects of the first instance have
+     been created.  Flush such that readers see the written data. */
+  if (sh5->swmr == dh5SwmrWrite) {
+    if (H5Fstart_swmr_write(sh5->root) < 0)
+      nerr += err(1, "cannot start SWMR writing of %s.  Was it created "
+                  "with option swmr?", d->s->location);
+    else
+      sh5->swmr = dh5SwmrWriting;
+  }
+  if (sh5->swmr == dh5SwmrWriting && H5Fflush(sh5->root, H5F_SCOPE_LOCAL) < 0)
+    nerr += err(1, "cannot flush %s", d->s->location);
+#else
+  UNUSED(sh5);
+#endif
   return nerr;
 }
 
@@ -594,6 +2086,7 @@ char *dh5_get_meta_uri(const DLiteDataModel *d)
   const DH5DataModel *dh5 = (DH5DataModel *)d;
   char *name=NULL, *version=NULL, *namespace=NULL, *uri=NULL;
 
+  if (compact_missing(d)) return NULL;
   if (get_data(d, dh5->meta, "name", &name, dliteStringPtr,
                sizeof(char *), 1, NULL) < 0) goto fail;
   if (get_data(d, dh5->meta, "version", &version, dliteStringPtr,
@@ -619,6 +2112,7 @@ int dh5_get_dimension_size(const DLiteDataModel *d, const char *name)
 {
   DH5DataModel *dh5 = (DH5DataModel *)d;
   int dimsize;
+  if (compact_missing(d)) return -1;
   if (get_data(d, dh5->dimensions, name, (void *)&dimsize, dliteInt,
                sizeof(dimsize), 1, NULL) < 0)
     return err(-1, "cannot get size of dimension '%s'", name);
@@ -635,7 +2129,42 @@ int dh5_get_property(const DLiteDataModel *d, const char *name, void *ptr,
                      size_t ndims, const size_t *dims)
 {
   DH5DataModel *dh5 = (DH5DataModel *)d;
-  return get_data(d, dh5->properties, name, ptr, type, size, ndims, dims);
+  size_t rdims[H5S_MAX_RANK], roffsets[H5S_MAX_RANK], rcounts[H5S_MAX_RANK];
+  if (!dh5->compact)
+    return get_data(d, dh5->properties, name, ptr, type, size, ndims, dims);
+  if (compact_missing(d) ||
+      compact_row_slice(d, ndims, dims, NULL, NULL, rdims, roffsets, rcounts))
+    return 1;
+  return get_data_slice(d, dh5->properties, name, ptr, type, size, ndims+1,
+                        NULL, roffsets, rcounts, NULL);
+}
+
+
+/**
+  Copies a slice of property `name` to memory pointed to by `ptr`.
+  See GetPropertySlice() in dlite-storage-plugins.h.
+
+  Returns non-zero on error.
+ */
+int dh5_get_property_slice(const DLiteDataModel *d, const char *name,
+                           void *ptr, DLiteType type, size_t size,
+                           size_t ndims, const size_t *offsets,
+                           const size_t *counts, const size_t *strides)
+{
+  DH5DataModel *dh5 = (DH5DataModel *)d;
+  size_t rdims[H5S_MAX_RANK], roffsets[H5S_MAX_RANK], rcounts[H5S_MAX_RANK];
+  size_t rstrides[H5S_MAX_RANK], i;
+  if (!dh5->compact)
+    return get_data_slice(d, dh5->properties, name, ptr, type, size, ndims,
+                          NULL, offsets, counts, strides);
+  if (compact_missing(d) ||
+      compact_row_slice(d, ndims, NULL, offsets, counts,
+                        rdims, roffsets, rcounts))
+    return 1;
+  rstrides[0] = 1;
+  for (i=0; i<ndims; i++) rstrides[i+1] = (strides) ? strides[i] : 1;
+  return get_data_slice(d, dh5->properties, name, ptr, type, size, ndims+1,
+                        NULL, roffsets, rcounts, rstrides);
 }
 
 
@@ -649,23 +2178,23 @@ int dh5_get_property(const DLiteDataModel *d, const char *name, void *ptr,
 int dh5_set_meta_uri(DLiteDataModel *d, const char *uri)
 {
   DH5DataModel *dh5 = (DH5DataModel *)d;
-  size_t dims[1]={1};
-  char *name, *version, *namespace;
-
-  if (dlite_split_meta_uri(uri, &name, &version, &namespace))
-    return 1;
-
-  set_data(d, dh5->meta, "name", name, dliteFixString,
-           strlen(name), 1, dims);
-  set_data(d, dh5->meta, "version", version, dliteFixString,
-           strlen(version), 1, dims);
-  set_data(d, dh5->meta, "namespace", namespace, dliteFixString,
-           strlen(namespace), 1, dims);
-
-  free(name);
-  free(version);
-  free(namespace);
-  return 0;
+  if (dh5->compact) {
+    char *olduri;
+    int stat;
+    if (dh5->instance <= 0) {
+      if (dh5->metauri) free(dh5->metauri);
+      if (!(dh5->metauri = strdup(uri))) return err(1, "allocation failure");
+      return 0;
+    }
+    if (!(olduri = dh5_get_meta_uri(d))) return 1;
+    stat = strcmp(olduri, uri);
+    free(olduri);
+    if (stat)
+      return errx(1, "cannot change metadata of '%s' to '%s' in the compact "
+                  "layout of %s", d->uuid, uri, d->s->location);
+    return 0;
+  }
+  return write_meta_uri(d, dh5->meta, uri);
 }
 
 
@@ -675,14 +2204,59 @@ int dh5_set_meta_uri(DLiteDataModel *d, const char *uri)
 int dh5_set_dimension_size(DLiteDataModel *d, const char *name, size_t size)
 {
   DH5DataModel *dh5 = (DH5DataModel *)d;
-  size_t dims[1]={1};
-  int64_t dsize=size;
-
-  return set_data(d, dh5->dimensions, name, &dsize, dliteInt,
-                  sizeof(int64_t), 1, dims);
+  if (dh5->compact) {
+    char **dimnames;
+    size_t *dimsizes;
+    if (dh5->instance > 0) {
+      if (dh5_get_dimension_size(d, name) != (int)size)
+        return errx(1, "cannot change dimension '%s' of '%s' in the "
+                    "compact layout of %s", name, d->uuid, d->s->location);
+      return 0;
+    }
+    if (!(dimnames = realloc(dh5->dimnames,
+                             (dh5->ndims + 1)*sizeof(char *))))
+      return err(1, "allocation failure");
+    dh5->dimnames = dimnames;
+    if (!(dimsizes = realloc(dh5->dimsizes,
+                             (dh5->ndims + 1)*sizeof(size_t))))
+      return err(1, "allocation failure");
+    dh5->dimsizes = dimsizes;
+    if (!(dimnames[dh5->ndims] = strdup(name)))
+      return err(1, "allocation failure");
+    dimsizes[dh5->ndims++] = size;
+    return 0;
+  }
+  return write_dimension_size(d, dh5->dimensions, name, size);
 }
 
 
+/* If option `abs_tol` or `rel_tol` applies to float property `name`,
+   `*copy` is assigned to a newly malloc'ed copy of the elements
+   pointed to by `ptr`, rounded within the tolerances.  `ndims` and
+   `counts` give the shape of the elements.  Otherwise `*copy` is set
+   to NULL.  Returns non-zero on error. */
+static int lossy_copy(DLiteDataModel *d, const char *name, const void *ptr,
+                      DLiteType type, size_t size, size_t ndims,
+                      const size_t *counts, void **copy)
+{
+  DH5Storage *s = (DH5Storage *)d->s;
+  double abs_tol, rel_tol;
+  size_t i, nmemb=1;
+  *copy = NULL;
+  if (type != dliteFloat ||
+      !dlite_lossy_get(s->lossy, name, &abs_tol, &rel_tol)) return 0;
+  for (i=0; i<ndims; i++) nmemb *= counts[i];
+  if (nmemb == 0) return 0;
+  if (!(*copy = malloc(nmemb*size))) return err(1, "allocation failure");
+  memcpy(*copy, ptr, nmemb*size);
+  if (dlite_quantize(*copy, size, nmemb, abs_tol, rel_tol)) {
+    free(*copy);
+    *copy = NULL;
+    return errx(1, "cannot apply tolerances to property '%s'", name);
+  }
+  return 0;
+}
+
 /**
   Sets property `name` to the memory (of `size` bytes) pointed to by `ptr`.
   Returns non-zero on error.
@@ -692,7 +2266,297 @@ int dh5_set_property(DLiteDataModel *d, const char *name, const void *ptr,
                      size_t ndims, const size_t *dims)
 {
   DH5DataModel *dh5 = (DH5DataModel *)d;
-  return set_data(d, dh5->properties, name, ptr, type, size, ndims, dims);
+  size_t rdims[H5S_MAX_RANK], roffsets[H5S_MAX_RANK], rcounts[H5S_MAX_RANK];
+  void *copy=NULL;
+  int retval;
+  if (lossy_copy(d, name, ptr, type, size, ndims, dims, &copy)) return 1;
+  if (copy) ptr = copy;
+  if (!dh5->compact) {
+    retval = set_data(d, dh5->properties, name, ptr, type, size, ndims, dims);
+  } else if (compact_assign(d) ||
+             compact_row_slice(d, ndims, dims, NULL, NULL, rdims, roffsets,
+                               rcounts)) {
+    retval = 1;
+  } else {
+    retval = set_data_slice(d, dh5->properties, name, ptr, type, size,
+                            ndims+1, rdims, roffsets, rcounts);
+  }
+  if (copy) free(copy);
+  return retval;
+}
+
+
+/**
+  Sets the block of property `name` starting at index `offsets` with
+  `counts` elements along each dimension to the memory pointed to by
+  `ptr`.  `dims` are the global dimensions of the property.
+
+  With option `mpi`, this function is collective.
+
+  Returns non-zero on error.
+*/
+int dh5_set_property_slice(DLiteDataModel *d, const char *name,
+                           const void *ptr, DLiteType type, size_t size,
+                           size_t ndims, const size_t *dims,
+                           const size_t *offsets, const size_t *counts)
+{
+  DH5DataModel *dh5 = (DH5DataModel *)d;
+  void *copy=NULL;
+  int retval;
+  if (dh5->compact)
+    return errx(1, "cannot write a slice of '%s' in the compact layout of %s",
+                name, d->s->location);
+  if (lossy_copy(d, name, ptr, type, size, ndims, counts, &copy)) return 1;
+  retval = set_data_slice(d, dh5->properties, name, (copy) ? copy : ptr,
+                          type, size, ndims, dims, offsets, counts);
+  if (copy) free(copy);
+  return retval;
+}
+
+
+/* Stored element of a sparse array and the chunk it belongs to */
+typedef struct {
+  hsize_t chunk;   /* linear index of the chunk */
+  size_t k;        /* index of the element in the sparse array */
+} DH5SparseItem;
+
+/* Compares DH5SparseItem's by chunk and element index. */
+static int sparse_item_cmp(const void *a, const void *b)
+{
+  const DH5SparseItem *x=a, *y=b;
+  if (x->chunk != y->chunk) return (x->chunk < y->chunk) ? -1 : 1;
+  return (x->k < y->k) ? -1 : (x->k > y->k);
+}
+
+/**
+  Sets property `name` from sparse array `sp`.
+
+  The property is written to a chunked dataset, but only the chunks
+  with non-zero elements are written.  HDF5 does not allocate the
+  other chunks, which read as the fill value, i.e. zero.  Hence, the
+  dataset is read as any other dataset.
+
+  In the compact layout and with option `mpi`, the property is written
+  dense.
+
+  Returns non-zero on error.
+*/
+int dh5_set_sparse_property(DLiteDataModel *d, const char *name,
+                            const DLiteSparse *sp)
+{
+  DH5DataModel *dh5 = (DH5DataModel *)d;
+  DH5Storage *s = (DH5Storage *)d->s;
+  hid_t memtype, space=-1, dset=-1, dcpl=-1, memspace=-1, filespace=-1;
+  hsize_t cdims[H5S_MAX_RANK], nchunks[H5S_MAX_RANK];
+  hsize_t start[H5S_MAX_RANK], count[H5S_MAX_RANK];
+  size_t ind[H5S_MAX_RANK], i, k, j, nmemb=1, csize=sp->size;
+  DH5SparseItem *items=NULL;
+  char *buf=NULL;
+  htri_t exists;
+  int n=sp->ndims, retval=1;
+
+  for (i=0; i<(size_t)n; i++) nmemb *= sp->shape[i];
+  if (dh5->compact || s->dxpl != H5P_DEFAULT || n > H5S_MAX_RANK ||
+      nmemb == 0) {
+    if (!(buf = calloc((nmemb) ? nmemb : 1, sp->size)))
+      FAIL0("allocation failure");
+    if (dlite_sparse_to_dense(sp, buf) == 0)
+      retval = dh5_set_property(d, name, buf, sp->type, sp->size, n,
+                                sp->shape);
+    free(buf);
+    return retval;
+  }
+
+  if ((memtype = cached_memtype(s, sp->type, sp->size)) < 0) goto fail;
+  if ((exists = H5Lexists(dh5->properties, name, H5P_DEFAULT)) < 0)
+    DFAIL1(d, "cannot determine if dataset '%s' already exists", name);
+  if (exists && H5Ldelete(dh5->properties, name, H5P_DEFAULT) < 0)
+    DFAIL1(d, "cannot delete dataset '%s' for overwrite", name);
+
+  /* chunked dataset, with the chunk shape and filters of the storage if
+     it has any */
+  if ((dcpl = get_dcpl(s, 0, sp->size, n, sp->shape)) < 0)
+    DFAIL1(d, "cannot create creation property list for dataset '%s'",
+           name);
+  if (dcpl != H5P_DEFAULT && H5Pget_layout(dcpl) == H5D_CHUNKED) {
+    if (H5Pget_chunk(dcpl, n, cdims) != n)
+      DFAIL1(d, "cannot get chunk shape of dataset '%s'", name);
+  } else {
+    if ((dcpl = H5Pcreate(H5P_DATASET_CREATE)) < 0)
+      DFAIL1(d, "cannot create creation property list for dataset '%s'",
+             name);
+    guess_chunk(cdims, sp->size, n, sp->shape);
+    if (H5Pset_chunk(dcpl, n, cdims) < 0)
+      DFAIL1(d, "cannot set chunk shape of dataset '%s'", name);
+  }
+  if ((space = get_space(n, sp->shape, 1)) < 0) goto fail;
+  if ((dset = H5Dcreate(dh5->properties, name, memtype, space,
+                        H5P_DEFAULT, dcpl, H5P_DEFAULT)) < 0)
+    DFAIL1(d, "cannot create dataset '%s'", name);
+  if (sp->nnz == 0) goto done;
+
+  /* sort the stored elements by chunk */
+  for (i=0; i<(size_t)n; i++) {
+    nchunks[i] = (sp->shape[i] + cdims[i] - 1) / cdims[i];
+    csize *= cdims[i];
+  }
+  if (!(items = malloc(sp->nnz * sizeof(DH5SparseItem))) ||
+      !(buf = malloc(csize)))
+    FAIL0("allocation failure");
+  for (k=0; k<sp->nnz; k++) {
+    if (dlite_sparse_coords(sp, k, ind)) goto fail;
+    items[k].chunk = 0;
+    items[k].k = k;
+    for (i=0; i<(size_t)n; i++) {
+      if (ind[i] >= sp->shape[i])
+        DFAIL1(d, "index of sparse element is out of range in '%s'", name);
+      items[k].chunk = items[k].chunk * nchunks[i] + ind[i] / cdims[i];
+    }
+  }
+  qsort(items, sp->nnz, sizeof(DH5SparseItem), sparse_item_cmp);
+
+  /* write each chunk with stored elements */
+  if ((filespace = H5Dget_space(dset)) < 0)
+    DFAIL1(d, "cannot get data space of '%s'", name);
+  for (k=0; k<sp->nnz; k=j) {
+    hsize_t c = items[k].chunk;
+    for (i=n; i-- > 0;) {
+      start[i] = (c % nchunks[i]) * cdims[i];
+      count[i] = (start[i] + cdims[i] <= sp->shape[i]) ?
+        cdims[i] : sp->shape[i] - start[i];
+      c /= nchunks[i];
+    }
+    memset(buf, 0, csize);
+    for (j=k; j<sp->nnz && items[j].chunk == items[k].chunk; j++) {
+      size_t offset=0;
+      dlite_sparse_coords(sp, items[j].k, ind);
+      for (i=0; i<(size_t)n; i++)
+        offset = offset * count[i] + (ind[i] - start[i]);
+      memcpy(buf + offset*sp->size,
+             (char *)sp->values + items[j].k*sp->size, sp->size);
+    }
+    if ((memspace = H5Screate_simple(n, count, NULL)) < 0 ||
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, count,
+                            NULL) < 0)
+      DFAIL1(d, "cannot select chunk of '%s'", name);
+    if (H5Dwrite(dset, memtype, memspace, filespace, s->dxpl, buf) < 0)
+      DFAIL1(d, "cannot write dataset '%s'", name);
+    H5Sclose(memspace);
+    memspace = -1;
+  }
+ done:
+  retval = 0;
+ fail:
+  if (buf) free(buf);
+  if (items) free(items);
+  if (memspace > 0) H5Sclose(memspace);
+  if (filespace > 0) H5Sclose(filespace);
+  if (dset > 0) H5Dclose(dset);
+  if (space > 0) H5Sclose(space);
+  if (dcpl > 0) H5Pclose(dcpl);
+  return retval;
+}
+
+
+#ifdef HAVE_MMAP
+
+/* Unmaps a region created by dh5_map_property(). */
+static void mapping_free(DLiteRegion *r)
+{
+  munmap(r->base, r->basesize);
+}
+
+#endif  /* HAVE_MMAP */
+
+/**
+  Returns a pointer to the data of property `name` mapped directly
+  from the file, or NULL if it cannot be mapped.  `*dealloc` is
+  assigned to the function that releases the mapping.
+
+  Only done with option `mmap`.  The dataset must be contiguous (hence
+  not compressed), allocated and stored with exactly the memory type
+  and byte order of the property, such that no conversion is needed.
+  The mapping is copy-on-write, so pages are read on demand and
+  modifications of the property are private to the instance.
+
+  No error is set if the property cannot be mapped.
+*/
+void *dh5_map_property(const DLiteDataModel *d, const char *name,
+                       DLiteType type, size_t size,
+                       size_t ndims, const size_t *dims,
+                       DLiteDeallocator *dealloc)
+{
+#ifdef HAVE_MMAP
+  DH5DataModel *dh5 = (DH5DataModel *)d;
+  DH5Storage *s = (DH5Storage *)d->s;
+  hid_t memtype, dset=-1, dtype=-1, dspace=-1, dcpl=-1;
+  hsize_t ddims[H5S_MAX_RANK];
+  haddr_t offset;
+  size_t i, nmemb=1, align, pagesize, start, len;
+  DLiteRegion *r;
+  void *addr, *ptr=NULL;
+
+  if (s->mapfd < 0 || dh5->compact || ndims == 0 || ndims > H5S_MAX_RANK)
+    return NULL;
+  for (i=0; i<ndims; i++) nmemb *= dims[i];
+  if (nmemb == 0) return NULL;
+
+  /* the data must be aligned to the largest power of two dividing
+     `size` (at most 16), which suffices for any element type */
+  align = size & (~size + 1);
+  if (align > 16) align = 16;
+
+  if ((memtype = cached_memtype(s, type, size)) < 0) return NULL;
+  H5E_BEGIN_TRY {
+    dset = H5Dopen2(dh5->properties, name, H5P_DEFAULT);
+  } H5E_END_TRY;
+  if (dset < 0) goto fail;
+  if ((dcpl = H5Dget_create_plist(dset)) < 0 ||
+      H5Pget_layout(dcpl) != H5D_CONTIGUOUS ||
+      H5Pget_external_count(dcpl) != 0) goto fail;
+  if ((dtype = H5Dget_type(dset)) < 0 || H5Tequal(dtype, memtype) <= 0)
+    goto fail;
+  if ((dspace = H5Dget_space(dset)) < 0 ||
+      H5Sget_simple_extent_ndims(dspace) != (int)ndims ||
+      H5Sget_simple_extent_dims(dspace, ddims, NULL) < 0) goto fail;
+  for (i=0; i<ndims; i++)
+    if (ddims[i] != (hsize_t)dims[i]) goto fail;
+  if ((offset = H5Dget_offset(dset)) == HADDR_UNDEF || offset % align ||
+      H5Dget_storage_size(dset) != (hsize_t)(nmemb * size)) goto fail;
+
+  pagesize = sysconf(_SC_PAGESIZE);
+  start = offset - offset % pagesize;
+  len = offset - start + nmemb * size;
+  addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+              s->mapfd, (off_t)start);
+  if (addr == MAP_FAILED) goto fail;
+  if (!(r = dlite_region_create(addr, len, mapping_free))) {
+    munmap(addr, len);
+    goto fail;
+  }
+  r->addr = (char *)addr + (offset - start);
+  r->size = nmemb * size;
+  if (dlite_region_attach(r, r->addr) == 0) {
+    *dealloc = dlite_region_release;
+    ptr = r->addr;
+  }
+  dlite_region_decref(r);
+ fail:
+  if (dcpl > 0) H5Pclose(dcpl);
+  if (dspace > 0) H5Sclose(dspace);
+  if (dtype > 0) H5Tclose(dtype);
+  if (dset > 0) H5Dclose(dset);
+  return ptr;
+#else
+  UNUSED(d);
+  UNUSED(name);
+  UNUSED(type);
+  UNUSED(size);
+  UNUSED(ndims);
+  UNUSED(dims);
+  UNUSED(dealloc);
+  return NULL;
+#endif
 }
 
 
@@ -709,18 +2573,26 @@ char **dh5_get_uuids(const DLiteStorage *s)
   EntryList *entries=NULL, *e;
   int i, n;
   char **names=NULL;
+  map_iter_t iter;
+  const char *key;
 
   if ((stat = H5Literate(sh5->root, H5_INDEX_NAME, H5_ITER_NATIVE, NULL,
                          find_entries, &entries)) < 0)
     FAIL0("error finding instances");
 
   for (n=0, e=entries; e; e=e->next) n++;
+  n += sh5->nrows;
   if (!(names = calloc((n + 1), sizeof(char *)))) FAIL0("allocation failure");
-  for (i=0, e=entries; e; i++, e=e->next) {
+  for (i=0, e=entries; e; e=e->next) {
     size_t len = strlen(e->name) + 1;
+    if (strcmp(e->name, DH5_COMPACT) == 0 ||
+        strcmp(e->name, DH5_VIEWS) == 0) continue;
     if (!(names[i] = malloc(len))) FAIL0("allocation failure");
-    memcpy(names[i], e->name, len);
+    memcpy(names[i++], e->name, len);
   }
+  iter = map_iter(&sh5->index);
+  while ((key = map_next(&sh5->index, &iter)))
+    if (!(names[i++] = strdup(key))) FAIL0("allocation failure");
 
  fail:
   if (entries) entrylist_free(entries);
@@ -736,6 +2608,7 @@ int dh5_has_dimension(const DLiteDataModel *d, const char *name)
 {
   DH5DataModel *dh5 = (DH5DataModel *)d;
   htri_t exists;
+  if (dh5->compact && dh5->instance <= 0) return 0;
   if ((exists = H5Lexists(dh5->dimensions, name, H5P_DEFAULT)) < 0)
     return err(-1, "cannot determine if '%s' has dimension '%s' in %s",
                d->uuid, name, d->s->location);
@@ -750,6 +2623,7 @@ int dh5_has_property(const DLiteDataModel *d, const char *name)
 {
   DH5DataModel *dh5 = (DH5DataModel *)d;
   htri_t exists;
+  if (dh5->compact && dh5->instance <= 0) return 0;
   if ((exists = H5Lexists(dh5->properties, name, H5P_DEFAULT)) < 0)
     return err(-1, "cannot determine if '%s' has property '%s' in %s",
                d->uuid, name, d->s->location);
@@ -765,6 +2639,20 @@ char *dh5_get_dataname(const DLiteDataModel *d)
 {
   DH5DataModel *dh5 = (DH5DataModel *)d;
   char *s=NULL;
+  if (dh5->compact) {
+    size_t offsets[1], counts[1]={1};
+    if (dh5->instance <= 0)
+      return (dh5->dataname) ? strdup(dh5->dataname) : NULL;
+    offsets[0] = dh5->row;
+    if (get_data_slice(d, dh5->instance, "datanames", &s, dliteStringPtr,
+                       sizeof(char *), 1, NULL, offsets, counts, NULL))
+      return NULL;
+    if (s && !*s) {
+      free(s);
+      s = NULL;
+    }
+    return s;
+  }
   if (get_data(d, dh5->instance, "dataname", &s,
                dliteStringPtr, sizeof(char *), 1, NULL)) return NULL;
   return s;
@@ -778,12 +2666,246 @@ char *dh5_get_dataname(const DLiteDataModel *d)
 int dh5_set_dataname(DLiteDataModel *d, const char *name)
 {
   DH5DataModel *dh5 = (DH5DataModel *)d;
+  if (dh5->compact) {
+    size_t dims[1], offsets[1], counts[1]={1};
+    if (dh5->instance <= 0) {
+      if (dh5->dataname) free(dh5->dataname);
+      if (!(dh5->dataname = strdup(name)))
+        return err(1, "allocation failure");
+      return 0;
+    }
+    dims[0] = dh5->nrows;
+    offsets[0] = dh5->row;
+    return set_data_slice(d, dh5->instance, "datanames", &name,
+                          dliteStringPtr, sizeof(char *), 1, dims, offsets,
+                          counts);
+  }
   return set_data(d, dh5->instance, "dataname", name,
                   dliteFixString, strlen(name), 1, NULL);
 }
 
 
 
+/********************************************************************
+ * Collection views
+ *
+ * A view stacks the properties of instances with the same metadata
+ * along a new first dimension, using virtual datasets that map to
+ * the property datasets of the instances.  The view of collection
+ * <id> is stored in group /_views/<id>/<metauuid>, which contains:
+ *
+ *   uuids        uuid of the instance in each row
+ *   <property>   one virtual dataset per property
+ *
+ * Properties with variable-length strings and properties whose type
+ * or shape differ between the instances are left out.
+ ********************************************************************/
+
+/* Returns group `name` in `loc`, which is created if it doesn't exist.
+   Returns a negative value on error. */
+static hid_t require_group(hid_t loc, const char *name)
+{
+  htri_t exists = H5Lexists(loc, name, H5P_DEFAULT);
+  if (exists < 0) return -1;
+  if (exists) return H5Gopen(loc, name, H5P_DEFAULT);
+  return H5Gcreate(loc, name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+}
+
+/* Writes the virtual dataset `name` in `group`, stacking dataset
+   properties/`name` of the `n` instances in `uuids`.  Returns zero on
+   success, a positive value if the property is left out and a
+   negative value on error. */
+static int write_view_dataset(DH5Storage *s, hid_t group, const char *name,
+                              const char **uuids, size_t n)
+{
+  hid_t dset=0, dtype=0, space=0, vspace=0, dcpl=0, view=0;
+  hsize_t dims[H5S_MAX_RANK], vdims[H5S_MAX_RANK];
+  hsize_t start[H5S_MAX_RANK], count[H5S_MAX_RANK];
+  char path[128];
+  size_t i;
+  int j, ndims, retval=-1;
+
+  snprintf(path, sizeof(path), "/%s/properties/%s", uuids[0], name);
+  if ((dset = H5Dopen2(s->root, path, H5P_DEFAULT)) < 0 ||
+      (dtype = H5Dget_type(dset)) < 0 ||
+      (space = H5Dget_space(dset)) < 0 ||
+      (ndims = H5Sget_simple_extent_dims(space, dims, NULL)) < 0)
+    FAIL2("cannot inspect '%s' in %s", path, s->location);
+  H5Dclose(dset);
+  dset = 0;
+  retval = 1;
+  if (ndims >= H5S_MAX_RANK || H5Tis_variable_str(dtype) != 0) goto fail;
+  for (j=0; j<ndims; j++) if (!dims[j]) goto fail;
+
+  /* check that all instances agree on type and shape */
+  for (i=1; i<n; i++) {
+    hid_t t=0, sp=0;
+    int same;
+    snprintf(path, sizeof(path), "/%s/properties/%s", uuids[i], name);
+    H5E_BEGIN_TRY {
+      dset = H5Dopen2(s->root, path, H5P_DEFAULT);
+    } H5E_END_TRY;
+    if (dset < 0) goto fail;
+    same = ((t = H5Dget_type(dset)) >= 0 && H5Tequal(t, dtype) > 0 &&
+            (sp = H5Dget_space(dset)) >= 0 &&
+            H5Sextent_equal(sp, space) > 0);
+    if (t > 0) H5Tclose(t);
+    if (sp > 0) H5Sclose(sp);
+    H5Dclose(dset);
+    dset = 0;
+    if (!same) goto fail;
+  }
+
+  retval = -1;
+  vdims[0] = n;
+  start[0] = 0;
+  count[0] = 1;
+  for (j=0; j<ndims; j++) {
+    vdims[j+1] = dims[j];
+    start[j+1] = 0;
+    count[j+1] = dims[j];
+  }
+  if ((vspace = H5Screate_simple(ndims+1, vdims, NULL)) < 0 ||
+      (dcpl = H5Pcreate(H5P_DATASET_CREATE)) < 0 ||
+      H5Sselect_all(space) < 0)
+    FAIL1("cannot create view of '%s'", name);
+  for (i=0; i<n; i++) {
+    start[0] = i;
+    snprintf(path, sizeof(path), "/%s/properties/%s", uuids[i], name);
+    if (H5Sselect_hyperslab(vspace, H5S_SELECT_SET, start, NULL, count,
+                            NULL) < 0 ||
+        H5Pset_virtual(dcpl, vspace, ".", path, space) < 0)
+      FAIL2("cannot map '%s' to view of '%s'", path, name);
+  }
+  if ((view = H5Dcreate(group, name, dtype, vspace, H5P_DEFAULT, dcpl,
+                        H5P_DEFAULT)) < 0)
+    FAIL2("cannot create view of '%s' in %s", name, s->location);
+  retval = 0;
+ fail:
+  if (view > 0) H5Dclose(view);
+  if (dcpl > 0) H5Pclose(dcpl);
+  if (vspace > 0) H5Sclose(vspace);
+  if (space > 0) H5Sclose(space);
+  if (dtype > 0) H5Tclose(dtype);
+  if (dset > 0) H5Dclose(dset);
+  return retval;
+}
+
+/**
+  Writes a view of the `n` instances with the given `uuids`.
+  See SaveView() in dlite-storage-plugins.h.
+
+  Returns non-zero on error.
+ */
+int dh5_save_view(DLiteStorage *s, const char *id, const char *metauuid,
+                  const char **uuids, size_t n)
+{
+  DH5Storage *sh5 = (DH5Storage *)s;
+  hid_t views=0, coll=0, group=0, props=0, type=0, space=0, dset=0;
+  EntryList *entries=NULL, *e;
+  hsize_t dims[1];
+  char path[64], *buf=NULL;
+  htri_t exists;
+  size_t i;
+  int retval=-1;
+
+  if (!s->writable) FAIL1("cannot write view to read-only %s", s->location);
+  for (i=0; i<n; i++)
+    if (map_get(&sh5->index, uuids[i]))
+      FAIL2("cannot write view of '%s' in the compact layout of %s",
+            uuids[i], s->location);
+
+  if ((views = require_group(sh5->root, DH5_VIEWS)) < 0 ||
+      (coll = require_group(views, id)) < 0 ||
+      (exists = H5Lexists(coll, metauuid, H5P_DEFAULT)) < 0 ||
+      (exists && H5Ldelete(coll, metauuid, H5P_DEFAULT) < 0) ||
+      (group = H5Gcreate(coll, metauuid, H5P_DEFAULT, H5P_DEFAULT,
+                         H5P_DEFAULT)) < 0)
+    FAIL2("cannot create group for view of '%s' in %s", id, s->location);
+
+  /* uuids */
+  if (!(buf = malloc(n * DLITE_UUID_LENGTH + 1)))
+    FAIL0("allocation failure");
+  for (i=0; i<n; i++)
+    memcpy(buf + i*DLITE_UUID_LENGTH, uuids[i], DLITE_UUID_LENGTH);
+  dims[0] = n;
+  if ((type = H5Tcopy(H5T_C_S1)) < 0 ||
+      H5Tset_size(type, DLITE_UUID_LENGTH) < 0 ||
+      (space = H5Screate_simple(1, dims, NULL)) < 0 ||
+      (dset = H5Dcreate(group, "uuids", type, space, H5P_DEFAULT,
+                        H5P_DEFAULT, H5P_DEFAULT)) < 0 ||
+      H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf) < 0)
+    FAIL1("cannot write uuids of view in %s", s->location);
+
+  /* properties */
+  snprintf(path, sizeof(path), "/%s/properties", uuids[0]);
+  if ((props = H5Gopen(sh5->root, path, H5P_DEFAULT)) < 0 ||
+      H5Literate(props, H5_INDEX_NAME, H5_ITER_NATIVE, NULL,
+                 find_entries, &entries) < 0)
+    FAIL2("cannot find properties of '%s' in %s", uuids[0], s->location);
+  for (e=entries; e; e=e->next)
+    if (write_view_dataset(sh5, group, e->name, uuids, n) < 0) goto fail;
+
+  retval = 0;
+ fail:
+  if (entries) entrylist_free(entries);
+  if (props > 0) H5Gclose(props);
+  if (dset > 0) H5Dclose(dset);
+  if (space > 0) H5Sclose(space);
+  if (type > 0) H5Tclose(type);
+  if (buf) free(buf);
+  if (group > 0) H5Gclose(group);
+  if (coll > 0) H5Gclose(coll);
+  if (views > 0) H5Gclose(views);
+  return retval;
+}
+
+/**
+  Reads property `name` of a view with a single H5Dread().
+  See LoadView() in dlite-storage-plugins.h.
+
+  Returns NULL on error.
+ */
+DLiteArray *dh5_load_view(const DLiteStorage *s, const char *id,
+                          const char *metauuid, const char *name,
+                          DLiteType type, size_t size)
+{
+  DH5Storage *sh5 = (DH5Storage *)s;
+  DLiteArray *arr=NULL;
+  hid_t memtype, dset=0, space=0;
+  hsize_t hdims[H5S_MAX_RANK];
+  size_t dims[H5S_MAX_RANK], nmemb=1;
+  char path[128];
+  void *data=NULL;
+  int i, ndims;
+
+  snprintf(path, sizeof(path), "/%s/%s/%s/%s", DH5_VIEWS, id, metauuid, name);
+  if ((memtype = cached_memtype(sh5, type, size)) < 0) goto fail;
+  H5E_BEGIN_TRY {
+    dset = H5Dopen2(sh5->root, path, H5P_DEFAULT);
+  } H5E_END_TRY;
+  if (dset < 0) {
+    errx(-1, "no view of property '%s' of collection '%s' in %s",
+         name, id, s->location);
+    goto fail;
+  }
+  if ((space = H5Dget_space(dset)) < 0 ||
+      (ndims = H5Sget_simple_extent_dims(space, hdims, NULL)) < 0)
+    FAIL2("cannot get data space of view '%s' in %s", path, s->location);
+  for (i=0; i<ndims; i++) nmemb *= (dims[i] = hdims[i]);
+  if (!(data = malloc((nmemb) ? nmemb*size : 1))) FAIL0("allocation failure");
+  if (H5Dread(dset, memtype, H5S_ALL, H5S_ALL, sh5->dxpl, data) < 0)
+    FAIL2("cannot read view '%s' in %s", path, s->location);
+  if (!(arr = dlite_array_create(data, type, size, ndims, dims))) goto fail;
+  data = NULL;
+ fail:
+  if (data) free(data);
+  if (space > 0) H5Sclose(space);
+  if (dset > 0) H5Dclose(dset);
+  return arr;
+}
+
+
 static DLiteStoragePlugin h5_plugin = {
   "hdf5",
   NULL,
@@ -801,6 +2923,8 @@ static DLiteStoragePlugin h5_plugin = {
   /* direct api */
   NULL,
   NULL,
+  NULL,
+  NULL,
 
   /* datamodel api */
   dh5_datamodel,
@@ -818,12 +2942,38 @@ static DLiteStoragePlugin h5_plugin = {
 
   dh5_has_dimension,
   dh5_has_property,
+  dh5_get_property_slice,
 
   dh5_get_dataname,
   dh5_set_dataname,
 
   /* internal data */
-  NULL
+  NULL,
+
+  /* capabilities */
+  dliteCapRandomAccess,
+
+  /* distributed datamodel api (optional) */
+  dh5_set_property_slice,
+
+  /* query api (optional) */
+  NULL,
+
+  /* collection view api (optional) */
+  dh5_save_view,
+  dh5_load_view,
+
+  /* asynchronous api (optional) */
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+
+  /* sparse datamodel api (optional) */
+  dh5_set_sparse_property,
+
+  /* mapped datamodel api (optional) */
+  dh5_map_property
 };
 
 
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
 
 #include "config.h"
 
@@ -11,6 +12,9 @@
 #include "utils/strtob.h"
 #include "utils/jstore.h"
 #include "utils/map.h"
+#include "utils/thread.h"
+#include "utils/scheduler.h"
+#include "utils/trace.h"
 #include "dlite.h"
 #include "dlite-storage-plugins.h"
 #include "dlite-macros.h"
@@ -25,9 +29,197 @@ typedef struct {
   DLiteJsonFlag flags;  /* output flags */
   int changed;          /* whether the storage is changed */
   map_uuid_t ids;       /* maps uuids to ids */
+  FILE *fp;             /* file saved instances are streamed to */
+  long end;             /* position of the closing brace in `fp` */
+  int nonempty;         /* whether the json object in `fp` has members */
+  int loaded;           /* whether the file has been read into `jstore` */
+  int writebehind;      /* whether to write the file in the background */
+  JStoreSync sync;      /* durability of written files */
+  double coalesce;      /* time window for coalescing background writes */
 } DLiteJsonStorage;
 
 
+/* Pending background write of a json store to a file */
+typedef struct _Flush {
+  char *location;       /* file to write to */
+  JStore *jstore;       /* content to write (owned) */
+  JStoreSync sync;      /* durability */
+  uint64_t due;         /* monotonic time (ns) when the file is written */
+  struct _Flush *next;  /* next pending write */
+} Flush;
+
+/* Background thread writing json stores to file.  There is at most
+   one pending write per file.  Closing a write-behind storage for a
+   file with a pending write replaces the content to write, such that
+   repeated saves within the coalescing window result in one write. */
+static struct {
+  ThreadMutex mutex;    /* protects everything below */
+  ThreadCond work;      /* signalled when the thread has work to do */
+  ThreadCond done;      /* broadcasted when a write is completed */
+  Flush *pending;       /* pending writes */
+  const char *busy;     /* location currently being written or NULL */
+  int started;          /* whether the thread is running */
+  int stop;             /* set to stop the thread */
+  int atexit;           /* whether the atexit handler is registered */
+  Thread thread;
+} flusher = {
+  THREAD_MUTEX_INITIALIZER,
+  THREAD_COND_INITIALIZER,
+  THREAD_COND_INITIALIZER,
+  NULL, NULL, 0, 0, 0, 0
+};
+
+
+/* Thread function writing pending json stores when they are due. */
+static void *flusher_run(void *arg)
+{
+  UNUSED(arg);
+  thread_mutex_lock(&flusher.mutex);
+  while (1) {
+    Flush *f, **fp, **first=NULL;
+    uint64_t now = trace_now();
+    for (fp=&flusher.pending; *fp; fp=&(*fp)->next)
+      if (!first || (*fp)->due < (*first)->due) first = fp;
+    if (!first) {
+      if (flusher.stop) {
+        flusher.started = 0;
+        break;
+      }
+      thread_cond_wait(&flusher.work, &flusher.mutex);
+      continue;
+    }
+    if ((*first)->due > now && !flusher.stop) {
+      thread_cond_timedwait(&flusher.work, &flusher.mutex,
+                            ((*first)->due - now) * 1e-9);
+      continue;
+    }
+    f = *first;
+    *first = f->next;
+    flusher.busy = f->location;
+    thread_mutex_unlock(&flusher.mutex);
+
+    /* errors are reported, but there is nobody to return them to */
+    if (jstore_to_file_atomic(f->jstore, f->location, f->sync)) err_clear();
+    jstore_close(f->jstore);
+
+    thread_mutex_lock(&flusher.mutex);
+    flusher.busy = NULL;
+    free(f->location);
+    free(f);
+    thread_cond_broadcast(&flusher.done);
+  }
+  thread_mutex_unlock(&flusher.mutex);
+  return NULL;
+}
+
+/* Returns the pending write to `location` or NULL.  Must be called
+   with the flusher lock held. */
+static Flush *flusher_find(const char *location)
+{
+  Flush *f;
+  for (f=flusher.pending; f; f=f->next)
+    if (strcmp(f->location, location) == 0) return f;
+  return NULL;
+}
+
+/* Writes all pending json stores and stops the background thread.  A
+   new thread is started by the next write-behind storage. */
+static void flusher_stop(void)
+{
+  int started;
+  thread_mutex_lock(&flusher.mutex);
+  started = flusher.started;
+  flusher.stop = 1;
+  thread_cond_signal(&flusher.work);
+  thread_mutex_unlock(&flusher.mutex);
+  if (started) thread_join(flusher.thread, NULL);
+  thread_mutex_lock(&flusher.mutex);
+  flusher.stop = 0;
+  thread_mutex_unlock(&flusher.mutex);
+}
+
+/* Hands over `js->jstore` to the background thread, which writes it
+   to `js->location` when the coalescing window has passed.  Falls back
+   to writing the file directly if the thread cannot be started or has
+   stopped, in which case it has no pending writes.
+   Returns non-zero on error. */
+static int flusher_submit(DLiteJsonStorage *js)
+{
+  Flush *f;
+  thread_mutex_lock(&flusher.mutex);
+  if (!flusher.started && !flusher.stop &&
+      thread_create(&flusher.thread, flusher_run, NULL) == 0) {
+    flusher.started = 1;
+    if (!flusher.atexit) atexit(flusher_stop);
+    flusher.atexit = 1;
+  }
+  if (!flusher.started) {
+    thread_mutex_unlock(&flusher.mutex);
+    return jstore_to_file_atomic(js->jstore, js->location, js->sync);
+  }
+  if ((f = flusher_find(js->location))) {
+    /* coalesce with the pending write, keeping its due time */
+    jstore_close(f->jstore);
+    if (js->sync > f->sync) f->sync = js->sync;
+  } else {
+    if (!(f = calloc(1, sizeof(Flush))) ||
+        !(f->location = strdup(js->location))) {
+      if (f) free(f);
+      thread_mutex_unlock(&flusher.mutex);
+      return err(1, "allocation failure");
+    }
+    f->sync = js->sync;
+    f->due = trace_now() + (uint64_t)(js->coalesce * 1e9);
+    f->next = flusher.pending;
+    flusher.pending = f;
+    thread_cond_signal(&flusher.work);
+  }
+  f->jstore = js->jstore;
+  js->jstore = NULL;
+  thread_mutex_unlock(&flusher.mutex);
+  return 0;
+}
+
+/* Makes sure that pending writes to `location` are completed before
+   the file is read.  If `copy` is not NULL and there is a pending
+   write, the file is not waited for.  Instead, the content of the
+   pending write is copied into `copy` and 1 is returned.  Returns
+   zero if `location` is up to date and a negative number on error. */
+static int flusher_sync(const char *location, JStore *copy)
+{
+  Flush *f;
+  int retval=0;
+  thread_mutex_lock(&flusher.mutex);
+  while (1) {
+    if ((f = flusher_find(location))) {
+      if (copy) {
+        retval = (jstore_update(copy, f->jstore)) ? -1 : 1;
+        break;
+      }
+      f->due = 0;
+      thread_cond_signal(&flusher.work);
+    } else if (!flusher.busy || strcmp(flusher.busy, location)) {
+      break;
+    }
+    thread_cond_wait(&flusher.done, &flusher.mutex);
+  }
+  thread_mutex_unlock(&flusher.mutex);
+  return retval;
+}
+
+/*
+  Waits until all pending background writes to `location` are
+  completed.  If `location` is NULL, all pending writes are completed.
+  Returns non-zero on error.
+ */
+int json_flush(const char *location)
+{
+  if (location) return (flusher_sync(location, NULL) < 0) ? 1 : 0;
+  flusher_stop();
+  return 0;
+}
+
+
 /** Returns default mode:
     - 'w': if we can't open `uri`
     - 'a': if `uri` is in data format
@@ -53,6 +245,141 @@ static int default_mode(const char *uri)
 }
 
 
+/* Help function for stream_open().  Returns the last non-whitespace
+   character in `fp` before position `*pos` and sets `*pos` to its
+   position.  Returns EOF if there is no such character. */
+static int last_char(FILE *fp, long *pos)
+{
+  int c;
+  while (*pos > 0) {
+    if (fseek(fp, --(*pos), SEEK_SET) || (c = fgetc(fp)) == EOF) return EOF;
+    if (!strchr(" \t\r\n", c)) return c;
+  }
+  return EOF;
+}
+
+/* Opens `js->fp` for streaming saved instances to `uri`.  If `truncate`
+   is non-zero or `uri` is empty or doesn't exist, a new file with an
+   empty json object is created.  New members are written after the
+   last member, at position `js->end`.  Returns non-zero on error. */
+static int stream_open(DLiteJsonStorage *js, const char *uri, int truncate)
+{
+  long pos;
+  int c;
+  if (!truncate) {
+    if (!(js->fp = fopen(uri, "r+b")) && errno != ENOENT)
+      return err(1, "cannot open \"%s\" for writing", uri);
+  }
+  if (js->fp) {
+    /* find the closing brace and whether the object has members */
+    if (fseek(js->fp, 0, SEEK_END) || (pos = ftell(js->fp)) < 0)
+      return err(1, "cannot seek in \"%s\"", uri);
+    if ((c = last_char(js->fp, &pos)) != EOF) {
+      if (c != '}' || (c = last_char(js->fp, &pos)) == EOF)
+        return errx(1, "cannot append to \"%s\": not a json object", uri);
+      js->end = pos + 1;
+      js->nonempty = (c != '{');
+      return 0;
+    }
+    /* empty file */
+    fclose(js->fp);
+    js->fp = NULL;
+  }
+  if (!(js->fp = fopen(uri, "w+b")))
+    return err(1, "cannot create \"%s\"", uri);
+  if (fputs("{\n}\n", js->fp) == EOF || fflush(js->fp))
+    return err(1, "error writing \"%s\"", uri);
+  js->end = 1;
+  js->nonempty = 0;
+  return 0;
+}
+
+/* Sink for stream_write_instance().  Skips leading white space, such
+   that the output is laid out as by stream_write(). */
+typedef struct {
+  FILE *fp;     /* stream to write to */
+  int started;  /* whether non-space output has been written */
+} StreamSink;
+
+/* DLiteJsonWriter for a StreamSink.  Returns non-zero on error. */
+static int stream_writer(const char *data, size_t len, void *context)
+{
+  StreamSink *sink = context;
+  if (!sink->started) {
+    while (len > 0 && isspace((unsigned char)*data)) data++, len--;
+    if (len > 0) sink->started = 1;
+  }
+  return fwrite(data, 1, len, sink->fp) != len;
+}
+
+/* Positions `js->fp` for appending the item with key `uuid` to the
+   object in the file.  Returns non-zero on error. */
+static int stream_begin(DLiteJsonStorage *js, const char *uuid)
+{
+  if (fseek(js->fp, js->end, SEEK_SET) ||
+      fprintf(js->fp, "%s\n  \"%s\": ", (js->nonempty) ? "," : "", uuid) < 0)
+    return err(1, "error writing to \"%s\"", js->location);
+  return 0;
+}
+
+/* Closes the object in `js->fp` after an item has been written.
+   Returns non-zero on error. */
+static int stream_end(DLiteJsonStorage *js)
+{
+  long end;
+  if ((end = ftell(js->fp)) < 0 ||
+      fputs("\n}\n", js->fp) == EOF ||
+      fflush(js->fp))
+    return err(1, "error writing to \"%s\"", js->location);
+  js->end = end;
+  js->nonempty = 1;
+  return 0;
+}
+
+/* Appends the json representation `buf` of instance `uuid` to the
+   object in `js->fp`.  Returns non-zero on error. */
+static int stream_write(DLiteJsonStorage *js, const char *uuid,
+                        const char *buf)
+{
+  int len;
+  while (isspace((unsigned char)*buf)) buf++;
+  len = strlen(buf);
+  while (len > 0 && isspace((unsigned char)buf[len-1])) len--;
+  if (stream_begin(js, uuid)) return 1;
+  if (fprintf(js->fp, "%.*s", len, buf) < 0)
+    return err(1, "error writing to \"%s\"", js->location);
+  return stream_end(js);
+}
+
+/* Serialises `inst` directly to the object in `js->fp`, without
+   building up its json representation in memory.  Returns non-zero on
+   error. */
+static int stream_write_instance(DLiteJsonStorage *js,
+                                 const DLiteInstance *inst)
+{
+  StreamSink sink;
+  sink.fp = js->fp;
+  sink.started = 0;
+  if (stream_begin(js, inst->uuid)) return 1;
+  if (dlite_json_write(stream_writer, &sink, inst, 2, js->flags) < 0)
+    return err(1, "error writing to \"%s\"", js->location);
+  return stream_end(js);
+}
+
+/* Reads the file of a streaming storage into the json store on first
+   use.  Returns non-zero on error. */
+static int stream_load(DLiteJsonStorage *js)
+{
+  if (js->loaded) return 0;
+  if (js->fp && fflush(js->fp))
+    return err(1, "error writing to \"%s\"", js->location);
+  if (dlite_jstore_loadf(js->jstore, js->location) < 0) return 1;
+  dlite_storage_paths_append(js->location);
+  js->loaded = 1;
+  return 0;
+}
+
+
 /**
   Returns an url to the metadata.
 
@@ -72,6 +399,39 @@ static int default_mode(const char *uri)
       Whether to write output in compact format. Alias for `as-data`
   - useid: translate | require | keep (deprecated)
       How to use the ID.
+  - stream : yes | no
+      Whether to write saved instances directly to the end of the file,
+      instead of rewriting the whole file when the storage is closed.
+      The file is only read if instances are loaded from the storage.
+      Only for mode "w" and "a" and files in data format.
+  - binary-arrays : no | base64 | base85
+      Whether to write boolean, integer and float arrays with at least
+      DLITE_JSON_BINARY_MINSIZE elements as base64 or base85 encoded
+      binary data instead of as nested json arrays.  Both forms are
+      always accepted when reading.
+  - compress-arrays : yes | no
+      Whether to compress binary arrays with zlib.
+  - lazy : yes | no
+      Whether to only index the instances in the file when it is opened
+      and defer parsing of an instance until it is loaded.  This is much
+      faster if only a few instances are loaded from a large file.
+      Only for mode "r".  The file must not be modified while the
+      storage is open.
+  - write-behind : yes | no
+      Whether to write the file in a background thread when the storage
+      is closed, instead of on the closing thread.  If storages for the
+      same file are closed again within the `coalesce` window, only the
+      last content is written.  Other json storages opened in the same
+      process see the pending content.  Not for streaming storages.
+  - coalesce : seconds
+      Time window for coalescing background writes (default: 0.05).
+  - durability : none | file | full
+      How the file is flushed to disk before it replaces the old file:
+      - none  Leave it to the OS (default)
+      - file  Flush the file before it is renamed
+      - full  Also flush the directory after renaming
+      In all cases the file is written to a temporary file that is
+      renamed, such that the old content is kept if the writer fails.
  */
 DLiteStorage *json_open(const DLiteStoragePlugin *api, const char *uri,
                         const char *options)
@@ -89,9 +449,24 @@ DLiteStorage *json_open(const DLiteStoragePlugin *api, const char *uri,
     {'c', "compact",   "false", "Aliad for `as-data=false` (deprecated)"},
     {'M', "meta",      "false", "Alias for `with-uuid` (deprecated)"},
     {'U', "useid",     "",      "Unused (deprecated)"},
+    {'s', "stream",    "false", "Whether to append saved instances directly "
+     "to the file"},
+    {'b', "binary-arrays", "no", "Write large numerical arrays as binary data. "
+     "Valid values are \"no\", \"base64\" and \"base85\""},
+    {'z', "compress-arrays", "false", "Whether to compress binary arrays"},
+    {'l', "lazy",      "false", "Whether to defer parsing of instances until "
+     "they are loaded"},
+    {'W', "write-behind", "false", "Whether to write the file in a "
+     "background thread"},
+    {'C', "coalesce",  "0.05", "Time window in seconds for coalescing "
+     "background writes"},
+    {'D', "durability", "none", "How to flush written files to disk. Valid "
+     "values are \"none\", \"file\" and \"full\""},
     {0, NULL, NULL, NULL}
   };
   int load;  // whether to load uri
+  int stream, compress, lazy, pending=0;
+  char *endptr;
 
   /* parse options */
   char *optcopy = (options) ? strdup(options) : NULL;
@@ -100,13 +475,44 @@ DLiteStorage *json_open(const DLiteStoragePlugin *api, const char *uri,
   char mode = *opts[0].value;
   int withuuid = atob(opts[1].value);
   int asdata = atob(opts[2].value);
+  if ((stream = atob(opts[6].value)) < 0)
+    FAIL1("invalid boolean value for `stream=%s`.", opts[6].value);
+  if ((lazy = atob(opts[9].value)) < 0)
+    FAIL1("invalid boolean value for `lazy=%s`.", opts[9].value);
 
   if (!(s = calloc(1, sizeof(DLiteJsonStorage)))) FAIL("allocation failure");
   s->api = api;
 
+  if ((s->writebehind = atob(opts[10].value)) < 0)
+    FAIL1("invalid boolean value for `write-behind=%s`.", opts[10].value);
+  s->coalesce = strtod(opts[11].value, &endptr);
+  if (*endptr || s->coalesce < 0)
+    FAIL1("invalid value for `coalesce=%s`.", opts[11].value);
+  if (strcmp(opts[12].value, "none") == 0)
+    s->sync = jstoreSyncNone;
+  else if (strcmp(opts[12].value, "file") == 0)
+    s->sync = jstoreSyncFile;
+  else if (strcmp(opts[12].value, "full") == 0)
+    s->sync = jstoreSyncDir;
+  else
+    FAIL1("invalid value for `durability=%s`.  Should be \"none\", "
+          "\"file\" or \"full\"", opts[12].value);
+
   if (!(s->jstore = jstore_open())) goto fail;
 
-  if (!mode) mode = default_mode(uri);
+  /* Don't miss pending background writes to `uri`.  Storages that
+     read the file directly wait for the write, while others take the
+     pending content. */
+  if (stream || lazy) {
+    if (flusher_sync(uri, NULL) < 0) goto fail;
+  } else if (mode != 'w') {
+    if ((pending = flusher_sync(uri, s->jstore)) < 0) goto fail;
+  }
+
+  if (!mode) mode = (stream) ? 'a' : (lazy) ? 'r' : (pending) ? 'a' :
+               default_mode(uri);
+  if (lazy && mode != 'r')
+    FAIL1("option `lazy` requires mode \"r\", got '%c'", mode);
   switch (mode) {
   case 'r':
     load = 1;
@@ -125,11 +531,21 @@ DLiteStorage *json_open(const DLiteStoragePlugin *api, const char *uri,
           "\"w\" (write) or \"a\" (append)", mode);
   }
 
-  if (load) {
-    DLiteJsonFormat fmt = dlite_jstore_loadf(s->jstore, uri);
+  if (stream && s->writable) {
+    /* defer reading the file until an instance is loaded */
+    if (stream_open(s, uri, mode == 'w')) goto fail;
+  } else if (load && pending) {
+    dlite_storage_paths_append(uri);
+    s->loaded = 1;
+  } else if (load) {
+    DLiteJsonFormat fmt = (lazy) ? dlite_jstore_loadf_lazy(s->jstore, uri) :
+      dlite_jstore_loadf(s->jstore, uri);
     if (fmt < 0) goto fail;
     if (fmt == dliteJsonMetaFormat) s->writable = 0;
     dlite_storage_paths_append(uri);
+    s->loaded = 1;
+  } else {
+    s->loaded = 1;
   }
 
   if (withuuid < 0) FAIL1("invalid boolean value for `with-uuid=%s`.",
@@ -142,6 +558,23 @@ DLiteStorage *json_open(const DLiteStoragePlugin *api, const char *uri,
   if (withuuid) s->flags |= dliteJsonWithUuid;
   if (asdata) s->flags |= dliteJsonMetaAsData;
 
+  if (strcmp(opts[7].value, "base64") == 0)
+    s->flags |= dliteJsonBase64Arrays;
+  else if (strcmp(opts[7].value, "base85") == 0)
+    s->flags |= dliteJsonBase85Arrays;
+  else if (atob(opts[7].value) != 0)
+    FAIL1("invalid value for `binary-arrays=%s`.  Should be \"no\", "
+          "\"base64\" or \"base85\"", opts[7].value);
+  if ((compress = atob(opts[8].value)) < 0)
+    FAIL1("invalid boolean value for `compress-arrays=%s`.", opts[8].value);
+  if (compress) {
+#ifdef HAVE_ZLIB
+    s->flags |= dliteJsonCompressArrays;
+#else
+    FAIL("`compress-arrays` requires that dlite is built with zlib");
+#endif
+  }
+
   retval = (DLiteStorage *)s;
 
  fail:
@@ -159,9 +592,16 @@ int json_close(DLiteStorage *s)
 {
   DLiteJsonStorage *js = (DLiteJsonStorage *)s;
   int stat=0;
-  if (js->writable && js->changed)
-    stat = jstore_to_file(js->jstore, js->location);
-  stat |= jstore_close(js->jstore);
+  if (js->fp) {
+    if (fclose(js->fp))
+      stat = err(1, "error closing \"%s\"", s->location);
+  } else if (js->writable && js->changed) {
+    if (js->writebehind)
+      stat = flusher_submit(js);
+    else if (!(stat = json_flush(js->location)))
+      stat = jstore_to_file_atomic(js->jstore, js->location, js->sync);
+  }
+  if (js->jstore) stat |= jstore_close(js->jstore);
   return stat;
 }
 
@@ -173,9 +613,10 @@ int json_close(DLiteStorage *s)
 DLiteInstance *json_load(const DLiteStorage *s, const char *id)
 {
   DLiteJsonStorage *js = (DLiteJsonStorage *)s;
-  const char *buf=NULL;
+  const char *key=NULL;
   char uuid[DLITE_UUID_LENGTH+1];
 
+  if (stream_load(js)) goto fail;
   if (!id || !*id) {
     JStoreIter iter;
     if (jstore_iter_init(js->jstore, &iter)) goto fail;
@@ -186,12 +627,13 @@ DLiteInstance *json_load(const DLiteStorage *s, const char *id)
             "than one instance: %s", s->location);
     }
     if (jstore_iter_deinit(&iter)) goto fail;
-  } else if (dlite_get_uuid(uuid, id) == 5) {
-    buf = jstore_get(js->jstore, uuid);
+  } else if (dlite_get_uuid(uuid, id) == 5 &&
+             jstore_getn(js->jstore, uuid, NULL)) {
+    key = uuid;
   }
-  if (!buf && !(buf = jstore_get(js->jstore, id)))
+  if (!key && !jstore_getn(js->jstore, (key = id), NULL))
     FAIL2("no instance with id \"%s\" in storage \"%s\"", id, s->location);
-  return dlite_json_sscan(buf, id, NULL);
+  return dlite_jstore_scan(js->jstore, key, id);
  fail:
   return NULL;
 }
@@ -205,12 +647,86 @@ int json_save(DLiteStorage *s, const DLiteInstance *inst)
   DLiteJsonStorage *js = (DLiteJsonStorage *)s;
   if (!s->writable)
     return errx(1, "storage \"%s\" is not writable", s->location);
+  if (js->fp && !js->loaded) return stream_write_instance(js, inst);
+  if (js->fp) {
+    char *buf;
+    if (!(buf = dlite_json_aprint(inst, 2, js->flags))) return 1;
+    if (stream_write(js, inst->uuid, buf)) {
+      free(buf);
+      return 1;
+    }
+    return jstore_addstolen(js->jstore, inst->uuid, buf);
+  }
   if (dlite_jstore_add(js->jstore, inst, js->flags)) return 1;
   js->changed = 1;
   return 0;
 }
 
 
+/* Instances serialised in parallel by json_save_many() */
+typedef struct {
+  const DLiteInstance **insts;  /* instances to serialise */
+  char **bufs;                  /* their serialisation or NULL on error */
+  DLiteJsonFlag flags;          /* output flags */
+} SaveWork;
+
+/* Serialises the instances with index in [`begin`, `end`). */
+static void save_range(size_t begin, size_t end, void *arg)
+{
+  SaveWork *work = arg;
+  size_t i;
+  for (i=begin; i<end; i++)
+    work->bufs[i] = dlite_json_aprint(work->insts[i], 2, work->flags);
+}
+
+/**
+  Saves the `n` instances in `insts` to storage `s`.
+
+  The instances are serialised concurrently by the shared task
+  scheduler and then added to the storage in order.  Returns non-zero
+  on error.
+ */
+int json_save_many(DLiteStorage *s, const DLiteInstance **insts, size_t n)
+{
+  DLiteJsonStorage *js = (DLiteJsonStorage *)s;
+  SaveWork work;
+  size_t i, nthreads = sched_get_nthreads();
+  int retval=1;
+
+  if (!s->writable)
+    return errx(1, "storage \"%s\" is not writable", s->location);
+  if (n < 2) return (n) ? json_save(s, insts[0]) : 0;
+
+  work.insts = insts;
+  work.flags = js->flags;
+  if (!(work.bufs = calloc(n, sizeof(char *))))
+    return err(1, "allocation failure");
+  if (nthreads < 1) nthreads = 1;
+  sched_parallel_for(n, (n + nthreads - 1) / nthreads, save_range, &work);
+
+  for (i=0; i<n; i++) {
+    if (!work.bufs[i])
+      FAIL1("cannot serialise instance: %s", insts[i]->uuid);
+    if (js->fp) {
+      if (stream_write(js, insts[i]->uuid, work.bufs[i])) goto fail;
+      if (!js->loaded) continue;
+    }
+    if (jstore_addstolen(js->jstore, insts[i]->uuid, work.bufs[i])) {
+      work.bufs[i] = NULL;
+      goto fail;
+    }
+    work.bufs[i] = NULL;
+  }
+  if (!js->fp) js->changed = 1;
+  retval = 0;
+ fail:
+  for (i=0; i<n; i++)
+    if (work.bufs[i]) free(work.bufs[i]);
+  free(work.bufs);
+  return retval;
+}
+
+
 /**
   Creates and returns a new iterator used by dlite_json_iter_next().
 
@@ -222,6 +738,7 @@ int json_save(DLiteStorage *s, const DLiteInstance *inst)
 void *json_iter_create(const DLiteStorage *s, const char *metaid)
 {
   DLiteJsonStorage *js = (DLiteJsonStorage *)s;
+  if (stream_load(js)) return NULL;
   return dlite_jstore_iter_create(js->jstore, metaid);
 }
 
@@ -250,10 +767,20 @@ void json_iter_free(void *iter)
 }
 
 
+/**
+  Completes pending background writes when the plugin is unloaded.
+ */
+void json_freeapi(PluginAPI *api)
+{
+  UNUSED(api);
+  flusher_stop();
+}
+
+
 static DLiteStoragePlugin dlite_json_plugin = {
   /* head */
   "json",                   /* name */
-  NULL,                     /* freeapi */
+  json_freeapi,             /* freeapi */
 
   /* basic api */
   json_open,                /* open */
@@ -268,6 +795,8 @@ static DLiteStoragePlugin dlite_json_plugin = {
   /* direct api */
   json_load,                /* loadInstance */
   json_save,                /* saveInstance */
+  NULL,                     /* loadInstances */
+  json_save_many,           /* saveInstances */
 
   /* datamodel api */
   NULL,                     /* dataModel */
@@ -285,12 +814,38 @@ static DLiteStoragePlugin dlite_json_plugin = {
 
   NULL,                     /* hasDimension */
   NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
 
   NULL,                     /* getDataName, obsolute */
   NULL,                     /* setDataName, obsolute */
 
   /* internal data */
-  NULL                      /* data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
 };
 
 
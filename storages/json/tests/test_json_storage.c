@@ -6,9 +6,11 @@
 #include "minunit/minunit.h"
 #include "utils/integers.h"
 #include "utils/boolean.h"
+#include "utils/floats.h"
 #include "dlite.h"
 #include "dlite-macros.h"
 #include "dlite-datamodel.h"
+#include "utils/jstore.h"
 
 #include "config.h"
 
@@ -19,6 +21,7 @@ int json_save(DLiteStorage *s, const DLiteInstance *inst);
 void *json_iter_create(const DLiteStorage *s, const char *metaid);
 int json_iter_next(void *iter, char *buf);
 void json_iter_free(void *iter);
+int json_flush(const char *location);
 
 
 DLiteInstance *inst, *data3;
@@ -125,6 +128,218 @@ MU_TEST(test_append)
 }
 
 
+MU_TEST(test_stream)
+{
+  char *filename = STRINGIFY(DLITE_ROOT) "/src/tests/test-read-data.json";
+  char *ids[] = {"dlite/1/test-c", "data3"};
+  DLiteInstance *insts[2], *inst2;
+  DLiteStorage *s;
+  char *buf, *buf2;
+  size_t len;
+  void *iter;
+  char uuid[DLITE_UUID_LENGTH+1];
+  int i, n=0;
+
+  s = dlite_storage_open("json", filename, "mode=r");
+  mu_check(s);
+  for (i=0; i<2; i++) mu_check((insts[i] = json_load(s, ids[i])));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* saved instances are written directly to the file */
+  s = dlite_storage_open("json", "test-json-stream.json", "mode=w;stream=true");
+  mu_check(s);
+  mu_assert_int_eq(0, json_save(s, insts[0]));
+  mu_check((buf = jstore_readfile("test-json-stream.json")));
+  mu_check(strstr(buf, insts[0]->uuid));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* appending does not rewrite the existing content */
+  s = dlite_storage_open("json", "test-json-stream.json", "mode=a;stream=yes");
+  mu_check(s);
+  mu_assert_int_eq(0, json_save(s, insts[1]));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_check((buf2 = jstore_readfile("test-json-stream.json")));
+  len = strlen(buf) - 3;  /* excluding the closing brace */
+  mu_check(strncmp(buf, buf2, len) == 0);
+  free(buf);
+  free(buf2);
+
+  /* saving an existing instance again replaces it */
+  s = dlite_storage_open("json", "test-json-stream.json", "mode=a;stream=yes");
+  mu_check(s);
+  mu_assert_int_eq(0, json_save(s, insts[0]));
+  mu_check((iter = json_iter_create(s, NULL)));  /* reads the file */
+  json_iter_free(iter);
+  mu_assert_int_eq(0, json_save(s, insts[1]));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* the result is an ordinary json storage */
+  s = dlite_storage_open("json", "test-json-stream.json", "mode=r");
+  mu_check(s);
+  iter = json_iter_create(s, NULL);
+  while (json_iter_next(iter, uuid) == 0) n++;
+  json_iter_free(iter);
+  mu_assert_int_eq(2, n);
+  for (i=0; i<2; i++) {
+    mu_check((inst2 = json_load(s, insts[i]->uuid)));
+    mu_assert_string_eq(insts[i]->uuid, inst2->uuid);
+    dlite_instance_decref(inst2);
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  for (i=0; i<2; i++) dlite_instance_decref(insts[i]);
+}
+
+
+MU_TEST(test_binary_arrays)
+{
+  char *url = STRINGIFY(DLITE_ROOT) "/src/tests/test-read-data.json"
+    "#dlite/1/A";
+  char *options[] = {
+    "mode=w;binary-arrays=base64",
+    "mode=w;binary-arrays=base85",
+#ifdef HAVE_ZLIB
+    "mode=w;binary-arrays=base64;compress-arrays=yes",
+#endif
+    NULL
+  };
+  DLiteMeta *meta;
+  DLiteInstance *inst1, *inst2;
+  DLiteStorage *s;
+  size_t i, dims[] = {1000};
+  float32_t *p1, *p2;
+  char **opt, *buf;
+
+  mu_check((meta = dlite_meta_load_url(url)));
+  mu_check((inst1 = dlite_instance_create(meta, dims, NULL)));
+  p1 = dlite_instance_get_property(inst1, "P2");
+  for (i=0; i<dims[0]; i++) p1[i] = 1.0f / (i + 1);
+
+  for (opt=options; *opt; opt++) {
+    s = dlite_storage_open("json", "test-json-binary.json", *opt);
+    mu_check(s);
+    mu_assert_int_eq(0, json_save(s, inst1));
+    mu_assert_int_eq(0, dlite_storage_close(s));
+
+    mu_check((buf = jstore_readfile("test-json-binary.json")));
+    mu_check(strstr(buf, "\"shape\": [1000]"));
+    free(buf);
+
+    s = dlite_storage_open("json", "test-json-binary.json", "mode=r");
+    mu_check(s);
+    mu_check((inst2 = json_load(s, inst1->uuid)));
+    p2 = dlite_instance_get_property(inst2, "P2");
+    mu_check(memcmp(p1, p2, dims[0] * sizeof(float32_t)) == 0);
+    dlite_instance_decref(inst2);
+    mu_assert_int_eq(0, dlite_storage_close(s));
+  }
+
+  s = dlite_storage_open("json", "test-json-binary.json",
+                         "mode=w;binary-arrays=base32");
+  mu_check(!s);
+  dlite_errclr();
+
+  dlite_instance_decref(inst1);
+  dlite_meta_decref(meta);
+}
+
+
+MU_TEST(test_write_behind)
+{
+  char *filename = STRINGIFY(DLITE_ROOT) "/src/tests/test-read-data.json";
+  char *options[] = {
+    "mode=w;write-behind=yes;coalesce=60;durability=full",
+    "mode=a;write-behind=yes;coalesce=60;durability=full"
+  };
+  char *ids[] = {"dlite/1/test-c", "data3"};
+  DLiteInstance *insts[2];
+  DLiteStorage *s;
+  FILE *fp;
+  char *buf;
+  void *iter;
+  char uuid[DLITE_UUID_LENGTH+1];
+  int i, n=0;
+
+  s = dlite_storage_open("json", filename, "mode=r");
+  mu_check(s);
+  for (i=0; i<2; i++) mu_check((insts[i] = json_load(s, ids[i])));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* saves within the coalescing window are not written yet */
+  remove("test-json-behind.json");
+  for (i=0; i<2; i++) {
+    mu_check((s = dlite_storage_open("json", "test-json-behind.json",
+                                     options[i])));
+    mu_assert_int_eq(0, json_save(s, insts[i]));
+    mu_assert_int_eq(0, dlite_storage_close(s));
+  }
+  mu_check(!(fp = fopen("test-json-behind.json", "r")));
+
+  /* but the pending content is seen by other storages */
+  s = dlite_storage_open("json", "test-json-behind.json", "mode=r");
+  mu_check(s);
+  iter = json_iter_create(s, NULL);
+  while (json_iter_next(iter, uuid) == 0) n++;
+  json_iter_free(iter);
+  mu_assert_int_eq(2, n);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* the file is written once when flushed */
+  mu_assert_int_eq(0, json_flush("test-json-behind.json"));
+  mu_check((buf = jstore_readfile("test-json-behind.json")));
+  for (i=0; i<2; i++) mu_check(strstr(buf, insts[i]->uuid));
+  free(buf);
+  mu_check(!(fp = fopen("test-json-behind.json.tmp", "r")));
+
+  s = dlite_storage_open("json", "test-json-behind.json", "durability=disk");
+  mu_check(!s);
+  dlite_errclr();
+
+  for (i=0; i<2; i++) dlite_instance_decref(insts[i]);
+}
+
+
+MU_TEST(test_lazy)
+{
+  char *filename = STRINGIFY(DLITE_ROOT) "/src/tests/test-read-data.json";
+  DLiteStorage *s=NULL;
+  DLiteInstance *inst2;
+  void *iter;
+  char uuid[DLITE_UUID_LENGTH+1];
+  int r, n=0;
+
+  s = dlite_storage_open("json", filename, "mode=a;lazy=yes");
+  mu_check(!s);
+  dlite_errclr();
+
+  s = dlite_storage_open("json", filename, "lazy=yes");
+  mu_check(s);
+
+  iter = json_iter_create(s, "dlite/1/A");
+  while ((r = json_iter_next(iter, uuid)) == 0) n++;
+  mu_assert_int_eq(1, r);
+  mu_assert_int_eq(3, n);  /* incl. an instance with meta as object */
+  json_iter_free(iter);
+
+  n = 0;
+  iter = json_iter_create(s, "http://onto-ns.com/meta/0.3/EntitySchema");
+  while ((r = json_iter_next(iter, uuid)) == 0) n++;
+  mu_assert_int_eq(3, n);
+  json_iter_free(iter);
+
+  inst2 = json_load(s, "data3");
+  mu_check(inst2);
+  mu_assert_string_eq("dlite/1/A", inst2->meta->uri);
+  dlite_instance_decref(inst2);
+
+  inst2 = json_load(s, "dbd9d597-16b4-58f5-b10f-7e49cf85084b");
+  mu_check(inst2);
+  dlite_instance_decref(inst2);
+
+  r = dlite_storage_close(s);
+  mu_assert_int_eq(0, r);
+}
+
 MU_TEST(test_iter)
 {
   char *filename = STRINGIFY(DLITE_ROOT) "/src/tests/test-read-data.json";
@@ -171,7 +386,11 @@ MU_TEST_SUITE(test_suite)
   MU_RUN_TEST(test_load_data3);
   MU_RUN_TEST(test_write);
   MU_RUN_TEST(test_append);
+  MU_RUN_TEST(test_stream);
+  MU_RUN_TEST(test_binary_arrays);
   MU_RUN_TEST(test_iter);
+  MU_RUN_TEST(test_lazy);
+  MU_RUN_TEST(test_write_behind);
 }
 
 
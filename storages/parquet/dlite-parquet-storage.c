@@ -0,0 +1,1446 @@
+/* dlite-parquet-storage.c -- DLite storage plugin for Apache Parquet */
+
+/*
+  This plugin stores all instances of one metadata in a Parquet file,
+  using the C API of Apache Arrow (arrow-glib and parquet-glib).
+
+  The file has one row per instance and the columns:
+
+    - uuid: uuid of the instance (string)
+    - uri: uri of the instance or null (string)
+    - dims: dimension values (list of int64)
+
+  followed by one column per property, named after the property.
+  Dimensional properties are stored as list columns with the elements
+  in C order.  The metadata uri and the dimension names are stored
+  in the file metadata under the keys "dlite.meta" and
+  "dlite.dimensions".
+
+  Parquet files cannot be modified in place.  Saved instances are
+  therefore kept until the storage is closed, at which point the file
+  is written.  In append mode the existing rows are read at open and
+  written back together with the new instances.
+
+  When reading, the row groups are read in parallel.  The properties
+  to read can be selected with the "columns" option and the instances
+  with the "filter" option, whose condition is also used to skip row
+  groups based on their column statistics.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <arrow-glib/arrow-glib.h>
+#include <parquet-glib/parquet-glib.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/globmatch.h"
+#include "utils/thread.h"
+#include "utils/scheduler.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+
+/* Max number of threads used for reading row groups */
+#define PARQUET_MAX_THREADS 64
+
+/* Comparison operators of a filter */
+typedef enum {
+  OpNone, OpLt, OpLe, OpGt, OpGe, OpEq, OpNe
+} FilterOp;
+
+/* Filter on a scalar numerical or boolean property */
+typedef struct {
+  int prop;           /* Property index, -1 if no filter */
+  FilterOp op;        /* Comparison operator */
+  double value;       /* Value to compare with */
+} Filter;
+
+/* Columns of a row group read from file */
+typedef struct {
+  GArrowArray *uuid;  /* uuid column */
+  GArrowArray *uri;   /* uri column */
+  GArrowArray *dims;  /* dims column */
+  GArrowArray **props;  /* Property columns, NULL if not read */
+  gint64 nrows;       /* Number of rows */
+} Group;
+
+/* Location of an instance in the file */
+typedef struct {
+  char uuid[DLITE_UUID_LENGTH+1];
+  int group;          /* Row group index */
+  gint64 row;         /* Row index within row group */
+} Row;
+
+/* Storage for Parquet */
+typedef struct {
+  DLiteStorage_HEAD
+  char *path;         /* Path to file */
+  DLiteMeta *meta;    /* Metadata of the stored instances */
+  int *load;          /* Whether to load each property (projection) */
+  Filter filter;      /* Instance filter */
+  int nthreads;       /* Number of threads for reading */
+  gint64 rowgroup;    /* Max number of rows per row group when writing */
+  GArrowCompressionType compression;  /* Compression when writing */
+
+  Group *groups;      /* Row groups read from file */
+  int ngroups;        /* Number of row groups */
+  Row *rows;          /* Instances read from file, after filtering */
+  size_t nrows;       /* Number of rows */
+  map_int_t index;    /* Maps uuid to index in `rows` */
+
+  DLiteInstance **insts;  /* Saved instances, written on close */
+  size_t ninsts;      /* Number of saved instances */
+  size_t size;        /* Allocated size of `insts` */
+  map_int_t saved;    /* Maps uuid to index in `insts` */
+} PqStorage;
+
+/* Iterator over uuids */
+typedef struct {
+  const PqStorage *ps;  /* Storage */
+  size_t next;        /* Index of next row */
+  int match;          /* Whether the metadata matches the pattern */
+} PqIter;
+
+/* Shared state for the row group readers */
+typedef struct {
+  PqStorage *ps;      /* Storage */
+  const gint *columns;  /* Indices of columns to read */
+  gsize ncolumns;     /* Number of columns to read */
+  int *skip;          /* Whether to skip each row group */
+  int stat;           /* Non-zero on error (atomic) */
+} ReadWork;
+
+
+/* Reports `error` together with `msg` and frees it.  Returns `stat`. */
+static int gerror(int stat, GError *error, const char *msg)
+{
+  if (!error) return errx(stat, "parquet: %s", msg);
+  stat = errx(stat, "parquet: %s: %s", msg, error->message);
+  g_error_free(error);
+  return stat;
+}
+
+/* Unrefs Arrow object `obj` if it is not NULL. */
+#define UNREF(obj) do { if (obj) g_object_unref(obj); } while (0)
+
+
+/* Returns a new Arrow type for the elements of property `p` or NULL if
+   the property type is not supported. */
+static GArrowDataType *elem_type(const DLiteProperty *p)
+{
+  switch (p->type) {
+  case dliteInt:
+    switch (p->size) {
+    case 1: return GARROW_DATA_TYPE(garrow_int8_data_type_new());
+    case 2: return GARROW_DATA_TYPE(garrow_int16_data_type_new());
+    case 4: return GARROW_DATA_TYPE(garrow_int32_data_type_new());
+    case 8: return GARROW_DATA_TYPE(garrow_int64_data_type_new());
+    }
+    break;
+  case dliteUInt:
+    switch (p->size) {
+    case 1: return GARROW_DATA_TYPE(garrow_uint8_data_type_new());
+    case 2: return GARROW_DATA_TYPE(garrow_uint16_data_type_new());
+    case 4: return GARROW_DATA_TYPE(garrow_uint32_data_type_new());
+    case 8: return GARROW_DATA_TYPE(garrow_uint64_data_type_new());
+    }
+    break;
+  case dliteFloat:
+    switch (p->size) {
+    case 4: return GARROW_DATA_TYPE(garrow_float_data_type_new());
+    case 8: return GARROW_DATA_TYPE(garrow_double_data_type_new());
+    }
+    break;
+  case dliteBool:
+    return GARROW_DATA_TYPE(garrow_boolean_data_type_new());
+  case dliteFixString:
+  case dliteStringPtr:
+    return GARROW_DATA_TYPE(garrow_string_data_type_new());
+  case dliteBlob:
+    return GARROW_DATA_TYPE(garrow_binary_data_type_new());
+  default:
+    break;
+  }
+  return NULL;
+}
+
+/* Returns a new Arrow field for property `p`, or NULL on error. */
+static GArrowField *prop_field(const DLiteProperty *p)
+{
+  GArrowDataType *type, *list;
+  GArrowField *field, *item;
+  if (!(type = elem_type(p)))
+    return errx(1, "parquet: unsupported type of property '%s'", p->name),
+      NULL;
+  if (!p->ndims) {
+    field = garrow_field_new(p->name, type);
+  } else {
+    item = garrow_field_new("item", type);
+    list = GARROW_DATA_TYPE(garrow_list_data_type_new(item));
+    field = garrow_field_new(p->name, list);
+    g_object_unref(list);
+    g_object_unref(item);
+  }
+  g_object_unref(type);
+  return field;
+}
+
+/* Returns a new array builder for elements of type `type` or NULL on
+   error. */
+static GArrowArrayBuilder *new_builder(GArrowDataType *type)
+{
+  GError *error=NULL;
+  GArrowArrayBuilder *b=NULL;
+  if (GARROW_IS_LIST_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(
+      garrow_list_array_builder_new(GARROW_LIST_DATA_TYPE(type), &error));
+  else if (GARROW_IS_INT8_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_int8_array_builder_new());
+  else if (GARROW_IS_INT16_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_int16_array_builder_new());
+  else if (GARROW_IS_INT32_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_int32_array_builder_new());
+  else if (GARROW_IS_INT64_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_int64_array_builder_new());
+  else if (GARROW_IS_UINT8_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_uint8_array_builder_new());
+  else if (GARROW_IS_UINT16_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_uint16_array_builder_new());
+  else if (GARROW_IS_UINT32_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_uint32_array_builder_new());
+  else if (GARROW_IS_UINT64_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_uint64_array_builder_new());
+  else if (GARROW_IS_FLOAT_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_float_array_builder_new());
+  else if (GARROW_IS_DOUBLE_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_double_array_builder_new());
+  else if (GARROW_IS_BOOLEAN_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_boolean_array_builder_new());
+  else if (GARROW_IS_STRING_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_string_array_builder_new());
+  else if (GARROW_IS_BINARY_DATA_TYPE(type))
+    b = GARROW_ARRAY_BUILDER(garrow_binary_array_builder_new());
+  if (!b) gerror(1, error, "cannot create array builder");
+  return b;
+}
+
+/* Appends `n` elements of type `type` and size `size` from `src` to
+   builder `b`.  Returns non-zero on error. */
+static int append_values(GArrowArrayBuilder *b, const void *src, size_t n,
+                         DLiteType type, size_t size)
+{
+  GError *error=NULL;
+  gboolean ok=TRUE;
+  size_t i;
+  switch (type) {
+  case dliteInt:
+    switch (size) {
+    case 1:
+      ok = garrow_int8_array_builder_append_values(
+        GARROW_INT8_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+      break;
+    case 2:
+      ok = garrow_int16_array_builder_append_values(
+        GARROW_INT16_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+      break;
+    case 4:
+      ok = garrow_int32_array_builder_append_values(
+        GARROW_INT32_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+      break;
+    case 8:
+      ok = garrow_int64_array_builder_append_values(
+        GARROW_INT64_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+      break;
+    }
+    break;
+  case dliteUInt:
+    switch (size) {
+    case 1:
+      ok = garrow_uint8_array_builder_append_values(
+        GARROW_UINT8_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+      break;
+    case 2:
+      ok = garrow_uint16_array_builder_append_values(
+        GARROW_UINT16_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+      break;
+    case 4:
+      ok = garrow_uint32_array_builder_append_values(
+        GARROW_UINT32_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+      break;
+    case 8:
+      ok = garrow_uint64_array_builder_append_values(
+        GARROW_UINT64_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+      break;
+    }
+    break;
+  case dliteFloat:
+    if (size == 4)
+      ok = garrow_float_array_builder_append_values(
+        GARROW_FLOAT_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+    else
+      ok = garrow_double_array_builder_append_values(
+        GARROW_DOUBLE_ARRAY_BUILDER(b), src, n, NULL, 0, &error);
+    break;
+  case dliteBool:
+    for (i=0; i<n && ok; i++)
+      ok = garrow_boolean_array_builder_append_value(
+        GARROW_BOOLEAN_ARRAY_BUILDER(b), ((const bool *)src)[i], &error);
+    break;
+  case dliteFixString:
+    for (i=0; i<n && ok; i++) {
+      gchar *s = g_strndup((const char *)src + i*size, size);
+      ok = garrow_string_array_builder_append_string(
+        GARROW_STRING_ARRAY_BUILDER(b), s, &error);
+      g_free(s);
+    }
+    break;
+  case dliteStringPtr:
+    for (i=0; i<n && ok; i++) {
+      const char *s = ((char **)src)[i];
+      ok = (s) ?
+        garrow_string_array_builder_append_string(
+          GARROW_STRING_ARRAY_BUILDER(b), s, &error) :
+        garrow_array_builder_append_null(b, &error);
+    }
+    break;
+  case dliteBlob:
+    for (i=0; i<n && ok; i++)
+      ok = garrow_binary_array_builder_append_value(
+        GARROW_BINARY_ARRAY_BUILDER(b), (const guint8 *)src + i*size,
+        size, &error);
+    break;
+  default:
+    return errx(1, "parquet: unsupported type: %s",
+                dlite_type_get_enum_name(type));
+  }
+  if (!ok) return gerror(1, error, "cannot append value");
+  return 0;
+}
+
+/* Appends the value of property `i` of `inst` to builder `b`.  Returns
+   non-zero on error. */
+static int append_prop(GArrowArrayBuilder *b, const DLiteInstance *inst,
+                       size_t i)
+{
+  DLiteProperty *p = inst->meta->_properties + i;
+  void *ptr = DLITE_PROP(inst, i);
+  size_t n=1;
+  int j;
+  if (p->ndims) {
+    GError *error=NULL;
+    ptr = *(void **)ptr;
+    for (j=0; j<p->ndims; j++) n *= DLITE_PROP_DIM(inst, i, j);
+    if (!garrow_list_array_builder_append_value(
+          GARROW_LIST_ARRAY_BUILDER(b), &error))
+      return gerror(1, error, "cannot append list");
+    b = garrow_list_array_builder_get_value_builder(
+      GARROW_LIST_ARRAY_BUILDER(b));
+  }
+  return append_values(b, ptr, n, p->type, p->size);
+}
+
+/* Copies `n` elements starting at `offset` in Arrow array `arr` to
+   `dest`, which is an array of type `type` and size `size`.  Returns
+   non-zero on error. */
+static int get_values(void *dest, GArrowArray *arr, gint64 offset, size_t n,
+                      DLiteType type, size_t size)
+{
+  const void *values=NULL;
+  gint64 len, i;
+  if (offset + (gint64)n > garrow_array_get_length(arr))
+    return errx(1, "parquet: column is too short");
+
+  switch (type) {
+  case dliteInt:
+  case dliteUInt:
+  case dliteFloat:
+    if (type == dliteInt && size == 1 && GARROW_IS_INT8_ARRAY(arr))
+      values = garrow_int8_array_get_values(GARROW_INT8_ARRAY(arr), &len);
+    else if (type == dliteInt && size == 2 && GARROW_IS_INT16_ARRAY(arr))
+      values = garrow_int16_array_get_values(GARROW_INT16_ARRAY(arr), &len);
+    else if (type == dliteInt && size == 4 && GARROW_IS_INT32_ARRAY(arr))
+      values = garrow_int32_array_get_values(GARROW_INT32_ARRAY(arr), &len);
+    else if (type == dliteInt && size == 8 && GARROW_IS_INT64_ARRAY(arr))
+      values = garrow_int64_array_get_values(GARROW_INT64_ARRAY(arr), &len);
+    else if (type == dliteUInt && size == 1 && GARROW_IS_UINT8_ARRAY(arr))
+      values = garrow_uint8_array_get_values(GARROW_UINT8_ARRAY(arr), &len);
+    else if (type == dliteUInt && size == 2 && GARROW_IS_UINT16_ARRAY(arr))
+      values = garrow_uint16_array_get_values(GARROW_UINT16_ARRAY(arr),
+                                              &len);
+    else if (type == dliteUInt && size == 4 && GARROW_IS_UINT32_ARRAY(arr))
+      values = garrow_uint32_array_get_values(GARROW_UINT32_ARRAY(arr),
+                                              &len);
+    else if (type == dliteUInt && size == 8 && GARROW_IS_UINT64_ARRAY(arr))
+      values = garrow_uint64_array_get_values(GARROW_UINT64_ARRAY(arr),
+                                              &len);
+    else if (type == dliteFloat && size == 4 && GARROW_IS_FLOAT_ARRAY(arr))
+      values = garrow_float_array_get_values(GARROW_FLOAT_ARRAY(arr), &len);
+    else if (type == dliteFloat && size == 8 && GARROW_IS_DOUBLE_ARRAY(arr))
+      values = garrow_double_array_get_values(GARROW_DOUBLE_ARRAY(arr),
+                                              &len);
+    if (!values) break;
+    memcpy(dest, (const char *)values + offset*size, n*size);
+    return 0;
+
+  case dliteBool:
+    if (!GARROW_IS_BOOLEAN_ARRAY(arr)) break;
+    for (i=0; i<(gint64)n; i++)
+      ((bool *)dest)[i] =
+        garrow_boolean_array_get_value(GARROW_BOOLEAN_ARRAY(arr), offset+i);
+    return 0;
+
+  case dliteFixString:
+  case dliteStringPtr:
+    if (!GARROW_IS_STRING_ARRAY(arr)) break;
+    for (i=0; i<(gint64)n; i++) {
+      gchar *s;
+      if (garrow_array_is_null(arr, offset+i)) {
+        if (type == dliteFixString)
+          ((char *)dest)[i*size] = '\0';
+        continue;
+      }
+      s = garrow_string_array_get_string(GARROW_STRING_ARRAY(arr), offset+i);
+      if (type == dliteFixString) {
+        strncpy((char *)dest + i*size, s, size);
+        ((char *)dest)[(i+1)*size - 1] = '\0';
+      } else {
+        char **q = (char **)dest + i;
+        if (*q) free(*q);
+        *q = strdup(s);
+      }
+      g_free(s);
+    }
+    return 0;
+
+  case dliteBlob:
+    if (!GARROW_IS_BINARY_ARRAY(arr)) break;
+    for (i=0; i<(gint64)n; i++) {
+      GBytes *bytes = garrow_binary_array_get_value(GARROW_BINARY_ARRAY(arr),
+                                                    offset+i);
+      gsize nbytes;
+      gconstpointer data = g_bytes_get_data(bytes, &nbytes);
+      memset((char *)dest + i*size, 0, size);
+      memcpy((char *)dest + i*size, data, (nbytes < size) ? nbytes : size);
+      g_bytes_unref(bytes);
+    }
+    return 0;
+
+  default:
+    break;
+  }
+  return errx(1, "parquet: column type doesn't match %s property",
+              dlite_type_get_enum_name(type));
+}
+
+/* Returns the value of scalar numerical or boolean property `p` in
+   row `row` of column `arr` as a double.  Returns non-zero on
+   error. */
+static int get_number(double *v, GArrowArray *arr, gint64 row,
+                      const DLiteProperty *p)
+{
+  union {
+    int8_t i8; int16_t i16; int32_t i32; int64_t i64;
+    uint8_t u8; uint16_t u16; uint32_t u32; uint64_t u64;
+    float f32; double f64; bool b;
+  } u;
+  if (garrow_array_is_null(arr, row)) return 1;
+  if (get_values(&u, arr, row, 1, p->type, p->size)) return 1;
+  switch (p->type) {
+  case dliteInt:
+    switch (p->size) {
+    case 1: *v = u.i8; break;
+    case 2: *v = u.i16; break;
+    case 4: *v = u.i32; break;
+    default: *v = (double)u.i64; break;
+    }
+    break;
+  case dliteUInt:
+    switch (p->size) {
+    case 1: *v = u.u8; break;
+    case 2: *v = u.u16; break;
+    case 4: *v = u.u32; break;
+    default: *v = (double)u.u64; break;
+    }
+    break;
+  case dliteFloat:
+    *v = (p->size == 4) ? u.f32 : u.f64;
+    break;
+  default:
+    *v = u.b;
+  }
+  return 0;
+}
+
+
+/* Parses filter expression `expr` of the form "NAME OP VALUE", where
+   OP is one of <, <=, >, >=, ==, !=.  Returns non-zero on error. */
+static int parse_filter(Filter *f, const DLiteMeta *meta, const char *expr)
+{
+  size_t len = strcspn(expr, "<>=!");
+  const char *s = expr + len;
+  char *endptr;
+  int i;
+  DLiteProperty *p;
+
+  while (len > 0 && expr[len-1] == ' ') len--;
+  for (i=0; i < (int)meta->_nproperties; i++) {
+    p = meta->_properties + i;
+    if (strncmp(p->name, expr, len) == 0 && strlen(p->name) == len) break;
+  }
+  if (i >= (int)meta->_nproperties)
+    return errx(1, "parquet: no property '%.*s' in filter: %s",
+                (int)len, expr, meta->uri);
+  p = meta->_properties + i;
+  if (p->ndims || !(p->type == dliteInt || p->type == dliteUInt ||
+                    p->type == dliteFloat || p->type == dliteBool))
+    return errx(1, "parquet: filter property '%s' must be a numerical or "
+                "boolean scalar", p->name);
+
+  if (strncmp(s, "<=", 2) == 0)      f->op = OpLe, s += 2;
+  else if (strncmp(s, ">=", 2) == 0) f->op = OpGe, s += 2;
+  else if (strncmp(s, "==", 2) == 0) f->op = OpEq, s += 2;
+  else if (strncmp(s, "!=", 2) == 0) f->op = OpNe, s += 2;
+  else if (*s == '<')                f->op = OpLt, s += 1;
+  else if (*s == '>')                f->op = OpGt, s += 1;
+  else return errx(1, "parquet: invalid filter operator: %s", expr);
+
+  if (strcmp(s, "true") == 0)
+    f->value = 1.0;
+  else if (strcmp(s, "false") == 0)
+    f->value = 0.0;
+  else {
+    f->value = strtod(s, &endptr);
+    if (endptr == s || *endptr)
+      return errx(1, "parquet: invalid filter value: %s", expr);
+  }
+  f->prop = i;
+  return 0;
+}
+
+/* Returns non-zero if value `v` passes filter `f`. */
+static int filter_match(const Filter *f, double v)
+{
+  switch (f->op) {
+  case OpLt: return v < f->value;
+  case OpLe: return v <= f->value;
+  case OpGt: return v > f->value;
+  case OpGe: return v >= f->value;
+  case OpEq: return v == f->value;
+  case OpNe: return v != f->value;
+  default:   return 1;
+  }
+}
+
+/* Returns non-zero if no value in the range [`min`, `max`] can pass
+   filter `f`. */
+static int filter_excludes(const Filter *f, double min, double max)
+{
+  switch (f->op) {
+  case OpLt: return min >= f->value;
+  case OpLe: return min > f->value;
+  case OpGt: return max <= f->value;
+  case OpGe: return max < f->value;
+  case OpEq: return f->value < min || f->value > max;
+  case OpNe: return min == max && min == f->value;
+  default:   return 0;
+  }
+}
+
+/* Returns non-zero if row group `i` can be skipped, since the
+   statistics of column `col` show that none of its rows pass the
+   filter.  Unsigned columns are never skipped, since their statistics
+   may be stored as signed values. */
+static int skip_group(const PqStorage *ps, GParquetFileMetadata *metadata,
+                      int i, int col)
+{
+  GParquetRowGroupMetadata *group=NULL;
+  GParquetColumnChunkMetadata *chunk=NULL;
+  GParquetStatistics *stats=NULL;
+  const DLiteProperty *p = ps->meta->_properties + ps->filter.prop;
+  double min=0, max=0;
+  int skip=0, found=1;
+
+  if (p->type == dliteUInt) return 0;
+  if (!(group = gparquet_file_metadata_get_row_group(metadata, i, NULL)) ||
+      !(chunk = gparquet_row_group_metadata_get_column_chunk(group, col,
+                                                             NULL)) ||
+      !(stats = gparquet_column_chunk_metadata_get_statistics(chunk)) ||
+      !gparquet_statistics_has_min_max(stats))
+    goto done;
+
+  if (GPARQUET_IS_INT32_STATISTICS(stats)) {
+    min = gparquet_int32_statistics_get_min(GPARQUET_INT32_STATISTICS(stats));
+    max = gparquet_int32_statistics_get_max(GPARQUET_INT32_STATISTICS(stats));
+  } else if (GPARQUET_IS_INT64_STATISTICS(stats)) {
+    min = gparquet_int64_statistics_get_min(GPARQUET_INT64_STATISTICS(stats));
+    max = gparquet_int64_statistics_get_max(GPARQUET_INT64_STATISTICS(stats));
+  } else if (GPARQUET_IS_FLOAT_STATISTICS(stats)) {
+    min = gparquet_float_statistics_get_min(GPARQUET_FLOAT_STATISTICS(stats));
+    max = gparquet_float_statistics_get_max(GPARQUET_FLOAT_STATISTICS(stats));
+  } else if (GPARQUET_IS_DOUBLE_STATISTICS(stats)) {
+    min = gparquet_double_statistics_get_min(
+      GPARQUET_DOUBLE_STATISTICS(stats));
+    max = gparquet_double_statistics_get_max(
+      GPARQUET_DOUBLE_STATISTICS(stats));
+  } else if (GPARQUET_IS_BOOLEAN_STATISTICS(stats)) {
+    min = gparquet_boolean_statistics_get_min(
+      GPARQUET_BOOLEAN_STATISTICS(stats));
+    max = gparquet_boolean_statistics_get_max(
+      GPARQUET_BOOLEAN_STATISTICS(stats));
+  } else {
+    found = 0;
+  }
+  if (found) skip = filter_excludes(&ps->filter, min, max);
+ done:
+  UNREF(stats);
+  UNREF(chunk);
+  UNREF(group);
+  return skip;
+}
+
+
+/* Returns a new combined array of column `name` in `table` or NULL if
+   there is no such column. */
+static GArrowArray *table_column(GArrowTable *table, const char *name)
+{
+  GArrowSchema *schema = garrow_table_get_schema(table);
+  GArrowChunkedArray *chunked;
+  GArrowArray *arr;
+  GError *error=NULL;
+  gint i = garrow_schema_get_field_index(schema, name);
+  g_object_unref(schema);
+  if (i < 0) return NULL;
+  chunked = garrow_table_get_column_data(table, i);
+  if (!(arr = garrow_chunked_array_combine(chunked, &error)))
+    gerror(1, error, "cannot combine column chunks");
+  g_object_unref(chunked);
+  return arr;
+}
+
+/* Reads row group `i` with `reader` into `ps->groups[i]`.  Returns
+   non-zero on error. */
+static int read_group(PqStorage *ps, GParquetArrowFileReader *reader, int i,
+                      const gint *columns, gsize ncolumns)
+{
+  Group *g = ps->groups + i;
+  GArrowTable *table;
+  GError *error=NULL;
+  size_t j;
+  if (!(table = gparquet_arrow_file_reader_read_row_group(
+          reader, i, (gint *)columns, ncolumns, &error)))
+    return gerror(1, error, "cannot read row group");
+  g->nrows = garrow_table_get_n_rows(table);
+  g->uuid = table_column(table, "uuid");
+  g->uri = table_column(table, "uri");
+  g->dims = table_column(table, "dims");
+  for (j=0; j < ps->meta->_nproperties; j++)
+    if (ps->load[j] || (int)j == ps->filter.prop)
+      g->props[j] = table_column(table, ps->meta->_properties[j].name);
+  g_object_unref(table);
+  if (!g->uuid || !g->dims)
+    return errx(1, "parquet: missing uuid or dims column: %s", ps->path);
+  return 0;
+}
+
+/* Task reading row groups `begin` to `end`. */
+static void read_groups(size_t begin, size_t end, void *arg)
+{
+  ReadWork *work = arg;
+  GParquetArrowFileReader *reader;
+  GError *error=NULL;
+  size_t i;
+  int stat=0;
+  if (!(reader = gparquet_arrow_file_reader_new_path(work->ps->path,
+                                                     &error))) {
+    gerror(1, error, "cannot open file");
+    thread_atomic_add(&work->stat, 1);
+    return;
+  }
+  for (i=begin; i<end && !stat && !thread_atomic_load(&work->stat); i++)
+    if (!work->skip[i])
+      stat = read_group(work->ps, reader, (int)i, work->columns,
+                        work->ncolumns);
+  if (stat) thread_atomic_add(&work->stat, 1);
+  UNREF(reader);
+}
+
+/* Reads the metadata uri from the schema of `reader`.  Returns a new
+   reference to the metadata or NULL on error. */
+static DLiteMeta *read_meta(GParquetArrowFileReader *reader,
+                            const char *location)
+{
+  GArrowSchema *schema;
+  GHashTable *metadata=NULL;
+  GError *error=NULL;
+  const char *uri;
+  DLiteMeta *meta=NULL;
+  if (!(schema = gparquet_arrow_file_reader_get_schema(reader, &error)))
+    return gerror(1, error, "cannot read schema"), NULL;
+  if (!(metadata = garrow_schema_get_metadata(schema)) ||
+      !(uri = g_hash_table_lookup(metadata, "dlite.meta")))
+    errx(1, "parquet: no \"dlite.meta\" in file metadata: %s", location);
+  else
+    meta = dlite_meta_get(uri);
+  if (metadata) g_hash_table_unref(metadata);
+  g_object_unref(schema);
+  return meta;
+}
+
+/* Reads all row groups of the file into `ps`, applying the
+   projection and filter.  Returns non-zero on error. */
+static int read_file(PqStorage *ps)
+{
+  GParquetArrowFileReader *reader=NULL;
+  GParquetFileMetadata *metadata=NULL;
+  GArrowSchema *schema=NULL;
+  GError *error=NULL;
+  ReadWork work;
+  gint *columns=NULL;
+  gsize ncolumns=0;
+  int *skip=NULL, i, nthreads, fcol=-1, retval=1;
+  size_t j;
+
+  memset(&work, 0, sizeof(work));
+  if (!(reader = gparquet_arrow_file_reader_new_path(ps->path, &error)))
+    return gerror(1, error, "cannot open file");
+  if (!(schema = gparquet_arrow_file_reader_get_schema(reader, &error))) {
+    gerror(1, error, "cannot read schema");
+    goto fail;
+  }
+  metadata = gparquet_arrow_file_reader_get_metadata(reader);
+  ps->ngroups = gparquet_arrow_file_reader_get_n_row_groups(reader);
+
+  /* -- columns to read.  All columns have exactly one leaf, such that
+        the field indices are also the Parquet column indices */
+  if (!(columns = calloc(3 + ps->meta->_nproperties, sizeof(gint))))
+    FAIL("allocation failure");
+  if ((columns[ncolumns++] = garrow_schema_get_field_index(schema,
+                                                           "uuid")) < 0 ||
+      (columns[ncolumns++] = garrow_schema_get_field_index(schema,
+                                                           "dims")) < 0)
+    FAIL1("parquet: missing uuid or dims column: %s", ps->path);
+  if ((i = garrow_schema_get_field_index(schema, "uri")) >= 0)
+    columns[ncolumns++] = i;
+  for (j=0; j < ps->meta->_nproperties; j++) {
+    const DLiteProperty *p = ps->meta->_properties + j;
+    if (!ps->load[j] && (int)j != ps->filter.prop) continue;
+    if ((i = garrow_schema_get_field_index(schema, p->name)) < 0) {
+      if ((int)j == ps->filter.prop)
+        FAIL2("parquet: no column for filter property '%s': %s",
+              p->name, ps->path);
+      continue;
+    }
+    if ((int)j == ps->filter.prop) fcol = i;
+    columns[ncolumns++] = i;
+  }
+
+  /* -- row groups to skip */
+  if (!(ps->groups = calloc(ps->ngroups + 1, sizeof(Group))) ||
+      !(skip = calloc(ps->ngroups + 1, sizeof(int))))
+    FAIL("allocation failure");
+  for (i=0; i<ps->ngroups; i++) {
+    if (!(ps->groups[i].props = calloc(ps->meta->_nproperties + 1,
+                                       sizeof(GArrowArray *))))
+      FAIL("allocation failure");
+    if (fcol >= 0 && metadata) skip[i] = skip_group(ps, metadata, i, fcol);
+  }
+
+  /* -- read row groups in parallel with the shared task scheduler */
+  work.ps = ps;
+  work.columns = columns;
+  work.ncolumns = ncolumns;
+  work.skip = skip;
+  nthreads = (ps->nthreads < ps->ngroups) ? ps->nthreads : ps->ngroups;
+  if (nthreads < 1) nthreads = 1;
+  sched_parallel_for(ps->ngroups, (ps->ngroups + nthreads - 1) / nthreads,
+                     read_groups, &work);
+  if (work.stat) goto fail;
+
+  /* -- index rows passing the filter */
+  for (i=0; i<ps->ngroups; i++) {
+    Group *g = ps->groups + i;
+    gint64 r;
+    if (skip[i]) continue;
+    if (!(ps->rows = realloc(ps->rows, (ps->nrows + g->nrows + 1) *
+                             sizeof(Row))))
+      FAIL("allocation failure");
+    for (r=0; r < g->nrows; r++) {
+      Row *row = ps->rows + ps->nrows;
+      double v;
+      if (ps->filter.prop >= 0 &&
+          (!g->props[ps->filter.prop] ||
+           get_number(&v, g->props[ps->filter.prop], r,
+                      ps->meta->_properties + ps->filter.prop) ||
+           !filter_match(&ps->filter, v)))
+        continue;
+      if (get_values(row->uuid, g->uuid, r, 1, dliteFixString,
+                     sizeof(row->uuid))) goto fail;
+      row->group = i;
+      row->row = r;
+      map_set(&ps->index, row->uuid, (int)ps->nrows);
+      ps->nrows++;
+    }
+  }
+  retval = 0;
+ fail:
+  if (columns) free(columns);
+  if (skip) free(skip);
+  UNREF(metadata);
+  UNREF(schema);
+  UNREF(reader);
+  return retval;
+}
+
+/* Frees the row groups read from file. */
+static void free_groups(PqStorage *ps)
+{
+  int i;
+  size_t j;
+  for (i=0; i<ps->ngroups; i++) {
+    Group *g = ps->groups + i;
+    UNREF(g->uuid);
+    UNREF(g->uri);
+    UNREF(g->dims);
+    if (g->props) {
+      for (j=0; j < ps->meta->_nproperties; j++) UNREF(g->props[j]);
+      free(g->props);
+    }
+  }
+  if (ps->groups) free(ps->groups);
+  ps->groups = NULL;
+  ps->ngroups = 0;
+}
+
+
+/* Returns a new instance from `row`.  Only the projected properties
+   are assigned.  Returns NULL on error. */
+static DLiteInstance *row_instance(const PqStorage *ps, const Row *row)
+{
+  const Group *g = ps->groups + row->group;
+  DLiteInstance *inst=NULL, *retval=NULL;
+  GArrowArray *arr=NULL;
+  size_t *dims=NULL, i, nelem;
+  int64_t *idims=NULL;
+  char *uri=NULL;
+  int j;
+
+  /* -- dimensions */
+  if (ps->meta->_ndimensions &&
+      (!(dims = calloc(ps->meta->_ndimensions, sizeof(size_t))) ||
+       !(idims = calloc(ps->meta->_ndimensions, sizeof(int64_t)))))
+    FAIL("allocation failure");
+  arr = garrow_list_array_get_value(GARROW_LIST_ARRAY(g->dims), row->row);
+  if (garrow_array_get_length(arr) != (gint64)ps->meta->_ndimensions)
+    FAIL2("parquet: expected %d dimensions for instance %s",
+          (int)ps->meta->_ndimensions, row->uuid);
+  if (ps->meta->_ndimensions &&
+      get_values(idims, arr, 0, ps->meta->_ndimensions, dliteInt,
+                 sizeof(int64_t))) goto fail;
+  for (i=0; i < ps->meta->_ndimensions; i++) dims[i] = idims[i];
+  g_object_unref(arr);
+  arr = NULL;
+
+  /* -- create instance */
+  if (g->uri && !garrow_array_is_null(g->uri, row->row) &&
+      get_values(&uri, g->uri, row->row, 1, dliteStringPtr, sizeof(char *)))
+    goto fail;
+  if (!(inst = dlite_instance_create(ps->meta, dims,
+                                     (uri) ? uri : row->uuid)))
+    goto fail;
+
+  /* -- assign properties */
+  for (i=0; i < ps->meta->_nproperties; i++) {
+    const DLiteProperty *p = ps->meta->_properties + i;
+    GArrowArray *col = g->props[i];
+    void *ptr;
+    if (!ps->load[i] || !col || garrow_array_is_null(col, row->row))
+      continue;
+    if (!(ptr = DLITE_PROP_RW(inst, i))) goto fail;
+    if (p->ndims) {
+      ptr = *(void **)ptr;
+      for (nelem=1, j=0; j<p->ndims; j++)
+        nelem *= DLITE_PROP_DIM(inst, i, j);
+      arr = garrow_list_array_get_value(GARROW_LIST_ARRAY(col), row->row);
+      if (garrow_array_get_length(arr) != (gint64)nelem)
+        FAIL2("parquet: length of property '%s' doesn't match dimensions "
+              "of instance %s", p->name, row->uuid);
+      if (get_values(ptr, arr, 0, nelem, p->type, p->size)) goto fail;
+      g_object_unref(arr);
+      arr = NULL;
+    } else {
+      if (get_values(ptr, col, row->row, 1, p->type, p->size)) goto fail;
+    }
+  }
+  retval = inst;
+ fail:
+  UNREF(arr);
+  if (uri) free(uri);
+  if (dims) free(dims);
+  if (idims) free(idims);
+  if (!retval && inst) dlite_instance_decref(inst);
+  return retval;
+}
+
+
+/* Writes the instances in `insts` to the file of `ps`.  Returns
+   non-zero on error. */
+static int write_file(PqStorage *ps, DLiteInstance **insts, size_t n)
+{
+  const DLiteMeta *meta = ps->meta;
+  size_t ncols = 3 + meta->_nproperties, i, j, k;
+  GList *fields=NULL;
+  GArrowSchema *schema0=NULL, *schema=NULL;
+  GArrowArrayBuilder **builders=NULL;
+  GArrowArray **arrays=NULL;
+  GArrowTable *table=NULL;
+  GParquetWriterProperties *props=NULL;
+  GParquetArrowFileWriter *writer=NULL;
+  GHashTable *metadata=NULL;
+  GError *error=NULL;
+  GArrowDataType *type;
+  GArrowField *item;
+  char *dimnames=NULL;
+  size_t len=0;
+  int retval=1;
+
+  if (!(builders = calloc(ncols, sizeof(GArrowArrayBuilder *))) ||
+      !(arrays = calloc(ncols, sizeof(GArrowArray *))))
+    FAIL("allocation failure");
+
+  /* -- schema */
+  type = GARROW_DATA_TYPE(garrow_string_data_type_new());
+  fields = g_list_append(fields, garrow_field_new("uuid", type));
+  fields = g_list_append(fields, garrow_field_new("uri", type));
+  g_object_unref(type);
+  type = GARROW_DATA_TYPE(garrow_int64_data_type_new());
+  item = garrow_field_new("item", type);
+  g_object_unref(type);
+  type = GARROW_DATA_TYPE(garrow_list_data_type_new(item));
+  fields = g_list_append(fields, garrow_field_new("dims", type));
+  g_object_unref(type);
+  g_object_unref(item);
+  for (i=0; i < meta->_nproperties; i++) {
+    GArrowField *field;
+    if (!(field = prop_field(meta->_properties + i))) goto fail;
+    fields = g_list_append(fields, field);
+  }
+  schema0 = garrow_schema_new(fields);
+
+  metadata = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  for (i=0; i < meta->_ndimensions; i++)
+    len += strlen(meta->_dimensions[i].name) + 1;
+  if (!(dimnames = calloc(len + 1, 1))) FAIL("allocation failure");
+  for (i=0; i < meta->_ndimensions; i++) {
+    if (i) strcat(dimnames, ",");
+    strcat(dimnames, meta->_dimensions[i].name);
+  }
+  g_hash_table_insert(metadata, g_strdup("dlite.meta"), g_strdup(meta->uri));
+  g_hash_table_insert(metadata, g_strdup("dlite.dimensions"),
+                      g_strdup(dimnames));
+  schema = garrow_schema_with_metadata(schema0, metadata);
+
+  /* -- columns */
+  for (k=0; k<ncols; k++) {
+    GArrowField *field = garrow_schema_get_field(schema, k);
+    type = garrow_field_get_data_type(field);
+    builders[k] = new_builder(type);
+    g_object_unref(field);
+    if (!builders[k]) goto fail;
+  }
+  for (j=0; j<n; j++) {
+    const DLiteInstance *inst = insts[j];
+    GArrowArrayBuilder *b;
+    int64_t dims[64];
+    if (append_values(builders[0], inst->uuid, 1, dliteFixString,
+                      DLITE_UUID_LENGTH + 1) ||
+        append_values(builders[1], &inst->uri, 1, dliteStringPtr,
+                      sizeof(char *))) goto fail;
+    if (meta->_ndimensions > sizeof(dims) / sizeof(dims[0]))
+      FAIL1("parquet: too many dimensions: %s", meta->uri);
+    for (i=0; i < meta->_ndimensions; i++) dims[i] = DLITE_DIM(inst, i);
+    if (!garrow_list_array_builder_append_value(
+          GARROW_LIST_ARRAY_BUILDER(builders[2]), &error)) {
+      gerror(1, error, "cannot append list");
+      goto fail;
+    }
+    b = garrow_list_array_builder_get_value_builder(
+      GARROW_LIST_ARRAY_BUILDER(builders[2]));
+    if (append_values(b, dims, meta->_ndimensions, dliteInt,
+                      sizeof(int64_t))) goto fail;
+    for (i=0; i < meta->_nproperties; i++)
+      if (append_prop(builders[3+i], inst, i))
+        FAIL2("parquet: cannot store property '%s' of '%s'",
+              meta->_properties[i].name, inst->uuid);
+  }
+  for (k=0; k<ncols; k++)
+    if (!(arrays[k] = garrow_array_builder_finish(builders[k], &error))) {
+      gerror(1, error, "cannot finish column");
+      goto fail;
+    }
+
+  /* -- write */
+  if (!(table = garrow_table_new_arrays(schema, arrays, ncols, &error))) {
+    gerror(1, error, "cannot create table");
+    goto fail;
+  }
+  props = gparquet_writer_properties_new();
+  gparquet_writer_properties_set_compression(props, ps->compression, NULL);
+  if (!(writer = gparquet_arrow_file_writer_new_path(schema, ps->path,
+                                                     props, &error)) ||
+      !gparquet_arrow_file_writer_write_table(writer, table, ps->rowgroup,
+                                              &error) ||
+      !gparquet_arrow_file_writer_close(writer, &error)) {
+    gerror(1, error, "cannot write file");
+    goto fail;
+  }
+  retval = 0;
+ fail:
+  if (builders) {
+    for (k=0; k<ncols; k++) UNREF(builders[k]);
+    free(builders);
+  }
+  if (arrays) {
+    for (k=0; k<ncols; k++) UNREF(arrays[k]);
+    free(arrays);
+  }
+  if (fields) g_list_free_full(fields, (GDestroyNotify)g_object_unref);
+  if (metadata) g_hash_table_unref(metadata);
+  if (dimnames) free(dimnames);
+  UNREF(writer);
+  UNREF(props);
+  UNREF(table);
+  UNREF(schema);
+  UNREF(schema0);
+  return retval;
+}
+
+
+/* Frees all resources of `ps`, except `ps` itself. */
+static void pq_free(PqStorage *ps)
+{
+  size_t i;
+  for (i=0; i < ps->ninsts; i++) dlite_instance_decref(ps->insts[i]);
+  if (ps->insts) free(ps->insts);
+  if (ps->meta) free_groups(ps);
+  if (ps->rows) free(ps->rows);
+  if (ps->load) free(ps->load);
+  map_deinit(&ps->index);
+  map_deinit(&ps->saved);
+  if (ps->meta) dlite_meta_decref(ps->meta);
+  if (ps->path) free(ps->path);
+}
+
+
+/**
+  Opens Parquet file `location` and returns a newly created storage
+  for it.
+
+  The `options` argument provies additional input to the driver.
+  Valid `options` are:
+
+  - mode : append | r | w
+      Valid values are:
+      - append   Append to existing file or create new file (default)
+      - r        Open existing file for read-only
+      - w        Truncate existing file or create new file
+  - meta : Metadata URI of the stored instances.  Only needed for
+      validating the columns and filter before any instance is saved
+      to a new file.
+  - columns : Comma-separated list of properties to load.  The other
+      properties are left uninitialised.  Default is all properties.
+  - filter : Only load instances whos property passes the condition
+      "NAME OP VALUE", where OP is one of <, <=, >, >=, == or !=.
+      Row groups are skipped based on the column statistics.
+  - threads : Number of threads for reading row groups.  Default is the
+      number of CPUs.
+  - rowgroup : Max number of rows per row group when writing.
+  - compression : Compression when writing.  One of "uncompressed"
+      (default), "snappy", "gzip", "brotli", "zstd", "lz4".
+
+  Returns NULL on error.
+ */
+DLiteStorage *pq_open(const DLiteStoragePlugin *api, const char *location,
+                      const char *options)
+{
+  PqStorage *ps=NULL;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"append\" (append to existing file or create new file, default); "
+    "\"r\" (read-only); "
+    "\"w\" (truncate existing file or create new file)";
+  DLiteOpt opts[] = {
+    {'m', "mode",        "append",       mode_descr},
+    {'M', "meta",        NULL,           "Metadata of stored instances."},
+    {'c', "columns",     NULL,           "Properties to load."},
+    {'f', "filter",      NULL,           "Condition for loaded instances."},
+    {'t', "threads",     "0",            "Number of reader threads."},
+    {'r', "rowgroup",    "65536",        "Max rows per row group."},
+    {'z', "compression", "uncompressed", "Compression when writing."},
+    {0, NULL, NULL, NULL}
+  };
+  struct { const char *name; GArrowCompressionType type; } compressions[] = {
+    {"uncompressed", GARROW_COMPRESSION_TYPE_UNCOMPRESSED},
+    {"snappy",       GARROW_COMPRESSION_TYPE_SNAPPY},
+    {"gzip",         GARROW_COMPRESSION_TYPE_GZIP},
+    {"brotli",       GARROW_COMPRESSION_TYPE_BROTLI},
+    {"zstd",         GARROW_COMPRESSION_TYPE_ZSTD},
+    {"lz4",          GARROW_COMPRESSION_TYPE_LZ4},
+    {NULL,           GARROW_COMPRESSION_TYPE_UNCOMPRESSED}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode, *metaid, *columns, *filter;
+  int i, exists;
+  FILE *fp;
+  UNUSED(api);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+  metaid = opts[1].value;
+  columns = opts[2].value;
+  filter = opts[3].value;
+
+  if (!(ps = calloc(1, sizeof(PqStorage)))) FAIL("allocation failure");
+  map_init(&ps->index);
+  map_init(&ps->saved);
+  ps->filter.prop = -1;
+  if (!(ps->path = strdup(location))) FAIL("allocation failure");
+
+  if (strcmp(mode, "append") == 0 || strcmp(mode, "a") == 0) {
+    ps->writable = 1;
+  } else if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    ps->writable = 0;
+  } else if (strcmp(mode, "w") == 0 || strcmp(mode, "write") == 0) {
+    ps->writable = 1;
+  } else {
+    FAIL1("invalid \"mode\" value: '%s'. Must be \"append\", \"r\" "
+          "(read-only) or \"w\" (write)", mode);
+  }
+  if (ps->writable && (columns || filter))
+    FAIL("parquet: \"columns\" and \"filter\" options require mode=r");
+
+  if ((ps->nthreads = atoi(opts[4].value)) <= 0)
+    ps->nthreads = sched_get_nthreads();
+  if (ps->nthreads > PARQUET_MAX_THREADS) ps->nthreads = PARQUET_MAX_THREADS;
+  if ((ps->rowgroup = atol(opts[5].value)) <= 0)
+    FAIL1("parquet: invalid \"rowgroup\" value: %s", opts[5].value);
+  for (i=0; compressions[i].name; i++)
+    if (strcmp(opts[6].value, compressions[i].name) == 0) break;
+  if (!compressions[i].name)
+    FAIL1("parquet: invalid \"compression\" value: %s", opts[6].value);
+  ps->compression = compressions[i].type;
+
+  if ((fp = fopen(location, "rb"))) fclose(fp);
+  exists = (fp != NULL) && strcmp(mode, "w") != 0 && strcmp(mode, "write");
+  if (!exists && !ps->writable)
+    FAIL1("parquet: cannot open file: %s", location);
+
+  /* -- metadata */
+  if (exists) {
+    GParquetArrowFileReader *reader;
+    GError *error=NULL;
+    if (!(reader = gparquet_arrow_file_reader_new_path(location, &error))) {
+      gerror(1, error, "cannot open file");
+      goto fail;
+    }
+    ps->meta = read_meta(reader, location);
+    g_object_unref(reader);
+    if (!ps->meta) goto fail;
+    if (metaid && strcmp(metaid, ps->meta->uri) != 0)
+      FAIL3("parquet: storage contains instances of '%s', not '%s': %s",
+            ps->meta->uri, metaid, location);
+  } else if (metaid) {
+    if (!(ps->meta = dlite_meta_get(metaid))) goto fail;
+  }
+
+  /* -- projection and filter */
+  if (ps->meta) {
+    if (!(ps->load = calloc(ps->meta->_nproperties + 1, sizeof(int))))
+      FAIL("allocation failure");
+    for (i=0; i < (int)ps->meta->_nproperties; i++) ps->load[i] = !columns;
+    while (columns && *columns) {
+      size_t len = strcspn(columns, ",");
+      for (i=0; i < (int)ps->meta->_nproperties; i++) {
+        const char *name = ps->meta->_properties[i].name;
+        if (strncmp(name, columns, len) == 0 && strlen(name) == len) break;
+      }
+      if (i >= (int)ps->meta->_nproperties)
+        FAIL2("parquet: no property '%.*s' in columns", (int)len, columns);
+      ps->load[i] = 1;
+      columns += len;
+      if (*columns == ',') columns++;
+    }
+    if (filter && parse_filter(&ps->filter, ps->meta, filter)) goto fail;
+  } else if (columns || filter) {
+    FAIL("parquet: \"columns\" and \"filter\" options require metadata");
+  }
+
+  if (exists && read_file(ps)) goto fail;
+
+  retval = (DLiteStorage *)ps;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && ps) {
+    pq_free(ps);
+    free(ps);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s` and writes saved instances to file.  Returns
+  non-zero on error.
+ */
+int pq_close(DLiteStorage *s)
+{
+  PqStorage *ps = (PqStorage *)s;
+  DLiteInstance **insts=NULL;
+  size_t i, n=0;
+  int retval=0;
+
+  /* -- write existing rows that are not replaced and saved instances */
+  if (ps->writable && ps->meta && ps->ninsts) {
+    if (!(insts = calloc(ps->nrows + ps->ninsts, sizeof(DLiteInstance *)))) {
+      retval = err(1, "allocation failure");
+    } else {
+      for (i=0; i < ps->nrows && !retval; i++) {
+        if (map_get(&ps->saved, ps->rows[i].uuid)) continue;
+        if (!(insts[n++] = row_instance(ps, ps->rows + i))) retval = 1;
+      }
+      for (i=0; i < ps->ninsts && !retval; i++) {
+        insts[n++] = ps->insts[i];
+        dlite_instance_incref(ps->insts[i]);
+      }
+      free_groups(ps);
+      if (!retval) retval = write_file(ps, insts, n);
+      for (i=0; i<n; i++)
+        if (insts[i]) dlite_instance_decref(insts[i]);
+      free(insts);
+    }
+  }
+
+  pq_free(ps);
+  return retval;
+}
+
+
+/**
+  Loads instance `id` from storage `s` and returns it.
+  NULL is returned on error.
+ */
+DLiteInstance *pq_load(const DLiteStorage *s, const char *id)
+{
+  PqStorage *ps = (PqStorage *)s;
+  char uuid[DLITE_UUID_LENGTH+1];
+  int *i;
+  if (!id) {
+    if (ps->nrows != 1)
+      return errx(1, "parquet: an id is required when the storage doesn't "
+                  "contain exactly one instance"), NULL;
+    return row_instance(ps, ps->rows);
+  }
+  if (dlite_get_uuid(uuid, id) < 0) return NULL;
+  if (!(i = map_get(&ps->index, uuid)))
+    return errx(1, "parquet: no instance with id \"%s\" in storage \"%s\"",
+                id, s->location), NULL;
+  return row_instance(ps, ps->rows + *i);
+}
+
+
+/**
+  Saves instance `inst` to storage `s`.  The instances are written
+  when the storage is closed.  Returns non-zero on error.
+ */
+int pq_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  PqStorage *ps = (PqStorage *)s;
+  size_t i;
+  int *j;
+  if (dlite_instance_is_meta(inst))
+    return errx(1, "parquet: storing metadata is not supported: %s",
+                inst->uuid);
+  if (!ps->meta) {
+    for (i=0; i < inst->meta->_nproperties; i++) {
+      GArrowField *field = prop_field(inst->meta->_properties + i);
+      if (!field) return 1;
+      g_object_unref(field);
+    }
+    if (!(ps->load = calloc(inst->meta->_nproperties + 1, sizeof(int))))
+      return err(1, "allocation failure");
+    for (i=0; i < inst->meta->_nproperties; i++) ps->load[i] = 1;
+    ps->meta = (DLiteMeta *)inst->meta;
+    dlite_meta_incref(ps->meta);
+  } else if (strcmp(inst->meta->uri, ps->meta->uri) != 0) {
+    return errx(1, "parquet: cannot store instance of '%s' in storage of "
+                "'%s' instances: %s", inst->meta->uri, ps->meta->uri,
+                s->location);
+  }
+
+  /* replace already saved instance with the same uuid */
+  if ((j = map_get(&ps->saved, inst->uuid))) {
+    dlite_instance_decref(ps->insts[*j]);
+    ps->insts[*j] = (DLiteInstance *)inst;
+    dlite_instance_incref(ps->insts[*j]);
+    return 0;
+  }
+  if (ps->ninsts >= ps->size) {
+    size_t size = (ps->size) ? 2*ps->size : 64;
+    DLiteInstance **q = realloc(ps->insts, size*sizeof(DLiteInstance *));
+    if (!q) return err(1, "allocation failure");
+    ps->insts = q;
+    ps->size = size;
+  }
+  ps->insts[ps->ninsts] = (DLiteInstance *)inst;
+  dlite_instance_incref(ps->insts[ps->ninsts]);
+  map_set(&ps->saved, inst->uuid, (int)ps->ninsts);
+  ps->ninsts++;
+  return 0;
+}
+
+
+/**
+  Saves the `n` instances in `insts` to storage `s`.  Returns non-zero
+  on error.
+ */
+int pq_save_many(DLiteStorage *s, const DLiteInstance **insts, size_t n)
+{
+  size_t i;
+  for (i=0; i<n; i++)
+    if (pq_save(s, insts[i])) return 1;
+  return 0;
+}
+
+
+/**
+  Returns a new iterator over all instances in storage `s` whose
+  metadata uri matches glob `pattern`.  If `pattern` is NULL, all
+  instances are iterated over.
+
+  Only instances read from file (and passing the filter) are iterated
+  over.
+
+  Returns NULL on error.
+ */
+void *pq_iter_create(const DLiteStorage *s, const char *pattern)
+{
+  const PqStorage *ps = (const PqStorage *)s;
+  PqIter *iter;
+  if (!(iter = calloc(1, sizeof(PqIter))))
+    return err(1, "allocation failure"), NULL;
+  iter->ps = ps;
+  iter->match = (ps->meta && (!pattern || !globmatch(pattern,
+                                                      ps->meta->uri)));
+  return iter;
+}
+
+/**
+  Writes the uuid of the next instance to `buf`, where `iter` is an
+  iterator returned by pq_iter_create().
+
+  Returns zero on success, 1 if there are no more UUIDs to iterate
+  over and a negative number on other errors.
+ */
+int pq_iter_next(void *iter, char *buf)
+{
+  PqIter *it = iter;
+  if (!it->match || it->next >= it->ps->nrows) return 1;
+  strcpy(buf, it->ps->rows[it->next++].uuid);
+  return 0;
+}
+
+/**
+  Free's iterator created with pq_iter_create().
+ */
+void pq_iter_free(void *iter)
+{
+  free(iter);
+}
+
+
+static DLiteStoragePlugin dlite_parquet_plugin = {
+  /* head */
+  "parquet",                /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  pq_open,                  /* open */
+  pq_close,                 /* close */
+
+  /* queue api */
+  pq_iter_create,           /* iterCreate */
+  pq_iter_next,             /* iterNext */
+  pq_iter_free,             /* iterFree */
+  NULL,                     /* getUUIDs */
+
+  /* direct api */
+  pq_load,                  /* loadInstance */
+  pq_save,                  /* saveInstance */
+  NULL,                     /* loadInstances */
+  pq_save_many,             /* saveInstances */
+
+  /* datamodel api */
+  NULL,                     /* dataModel */
+  NULL,                     /* dataModelFree */
+
+  NULL,                     /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  NULL,                     /* getDimensionSize */
+  NULL,                     /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                     /* setMetaURI */
+  NULL,                     /* setDimensionSize */
+  NULL,                     /* setProperty */
+
+  NULL,                     /* hasDimension */
+  NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  NULL,                     /* getDataName, obsolute */
+  NULL,                     /* setDataName, obsolute */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &dlite_parquet_plugin;
+}
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+
+#include "test_fixtures.h"
+
+#define NINST 10
+
+char *path = "test-parquet.parquet";
+char *uri = "http://onto-ns.com/meta/0.1/ParquetTestEntity";
+DLiteMeta *entity=NULL;
+DLiteInstance *instances[NINST];
+
+
+MU_TEST(test_create)
+{
+  int i;
+  mu_check((entity = create_test_entity(uri)));
+  for (i=0; i<NINST; i++)
+    mu_check((instances[i] = create_test_instance(entity, i)));
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  mu_check((s = dlite_storage_open("parquet", path, "mode=w;rowgroup=3")));
+  mu_assert_int_eq(1, dlite_storage_is_writable(s));
+  mu_assert_int_eq(0, dlite_instance_save(s, instances[0]));
+  mu_assert_int_eq(0, dlite_instance_save_many(s,
+                                               (const DLiteInstance **)instances,
+                                               NINST));
+
+  /* metadata is not supported */
+  err_clear();
+  mu_check(dlite_instance_save(s, (DLiteInstance *)entity));
+  err_clear();
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_load)
+{
+  DLiteStorage *s;
+  int i;
+  mu_check((s = dlite_storage_open("parquet", path, "mode=r")));
+  mu_assert_int_eq(0, dlite_storage_is_writable(s));
+  for (i=0; i<NINST; i++) {
+    DLiteInstance *inst;
+    mu_check((inst = dlite_instance_load(s, instances[i]->uuid)));
+    mu_assert_string_eq(instances[i]->uuid, inst->uuid);
+    mu_assert_int_eq(0, check_test_instance(inst, i));
+    dlite_instance_decref(inst);
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_iter)
+{
+  DLiteStorage *s;
+  mu_check((s = dlite_storage_open("parquet", path, "mode=r;threads=2")));
+  mu_assert_int_eq(NINST, count_instances(s, NULL));
+  mu_assert_int_eq(NINST, count_instances(s, "*/ParquetTestEnt?ty"));
+  mu_assert_int_eq(0, count_instances(s, "http://no/such/meta"));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_projection)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  char *options = "mode=r;meta=http://onto-ns.com/meta/0.1/ParquetTestEntity;"
+    "columns=value;filter=value>=50";
+  mu_check((s = dlite_storage_open("parquet", path, options)));
+  mu_assert_int_eq(5, count_instances(s, NULL));
+
+  mu_check((inst = dlite_instance_load(s, instances[7]->uuid)));
+  mu_assert_int_eq(70, *(int *)dlite_instance_get_property(inst, "value"));
+  mu_assert_int_eq(0, *(bool *)dlite_instance_get_property(inst, "flag"));
+  mu_check(*(char **)dlite_instance_get_property(inst, "name") == NULL);
+  dlite_instance_decref(inst);
+
+  /* filtered out */
+  err_clear();
+  mu_check(dlite_instance_load(s, instances[2]->uuid) == NULL);
+  err_clear();
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* invalid options */
+  err_clear();
+  mu_check(!dlite_storage_open("parquet", path, "mode=r;columns=nosuch"));
+  mu_check(!dlite_storage_open("parquet", path, "mode=r;filter=name>1"));
+  mu_check(!dlite_storage_open("parquet", path, "mode=w;filter=value>1"));
+  err_clear();
+}
+
+MU_TEST(test_append)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  size_t shape[] = {2};
+  mu_check((inst = dlite_instance_create(entity, shape, NULL)));
+  mu_check((s = dlite_storage_open("parquet", path, "mode=append")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  mu_check((s = dlite_storage_open("parquet", path, "mode=r")));
+  mu_assert_int_eq(NINST + 1, count_instances(s, NULL));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  dlite_instance_decref(inst);
+}
+
+MU_TEST(test_teardown)
+{
+  int i;
+  for (i=0; i<NINST; i++) dlite_instance_decref(instances[i]);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_create);
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_iter);
+  MU_RUN_TEST(test_projection);
+  MU_RUN_TEST(test_append);
+  MU_RUN_TEST(test_teardown);
+}
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
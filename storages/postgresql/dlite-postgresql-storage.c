@@ -0,0 +1,1188 @@
+/* dlite-postgresql-storage.c -- DLite storage plugin for PostgreSQL */
+
+/*
+  This plugin talks to PostgreSQL via libpq.  All values are sent and
+  received in the binary format, such that no conversion to or from
+  text is needed.
+
+  The table layout is the same as for the Python postgresql plugin:
+
+    - uuidtable: maps the uuid of every stored instance to its
+      metadata uri (columns: uuid, meta)
+    - one table per metadata, named after the metadata uri, with the
+      columns: uuid, uri, meta, dims, followed by one column per
+      property.  Dimensional properties are stored as PostgreSQL arrays.
+
+  Tables created by one of the plugins can hence be read by the other.
+  Since the plugins have the same driver name, this plugin is found
+  before the Python plugin when both are in the plugin search path.
+  Storing metadata is not supported.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libpq-fe.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+
+/* Max number of queries sent in a pipeline before waiting for results */
+#define PIPELINE_DEPTH 256
+
+/* Object ids of the PostgreSQL types used by this plugin.  These are
+   fixed and defined in the PostgreSQL catalog header pg_type_d.h,
+   which is not part of the client headers. */
+#define PGBOOL       16
+#define PGBYTEA      17
+#define PGINT8       20
+#define PGINT2       21
+#define PGINT4       23
+#define PGTEXT       25
+#define PGFLOAT4    700
+#define PGFLOAT8    701
+#define PGBPCHAR   1042
+#define PGVARCHAR  1043
+
+/* Array type and corresponding element type */
+typedef struct {
+  Oid array;
+  Oid elem;
+} ArrayType;
+
+static ArrayType array_types[] = {
+  {1000, PGBOOL},
+  {1001, PGBYTEA},
+  {1016, PGINT8},
+  {1005, PGINT2},
+  {1007, PGINT4},
+  {1009, PGTEXT},
+  {1021, PGFLOAT4},
+  {1022, PGFLOAT8},
+  {1014, PGBPCHAR},
+  {1015, PGVARCHAR},
+  {0, 0}
+};
+
+
+/* Prepared insert statement for instances of a given metadata */
+typedef struct {
+  char name[24];      /* Statement name */
+  int nparams;        /* Number of parameters */
+  Oid *types;         /* Parameter types, as inferred by the server */
+} Statement;
+
+/* Storage for PostgreSQL */
+typedef struct {
+  DLiteStorage_HEAD
+  PGconn *conn;       /* Database connection */
+  map_void_t stmts;   /* Maps metadata uri to prepared Statement */
+  int nstmts;         /* Number of prepared statements */
+} PgStorage;
+
+/* Iterator over uuids */
+typedef struct {
+  PGresult *res;      /* Query result */
+  int row;            /* Index of next row */
+} PgIter;
+
+/* Growing byte buffer used for encoding parameters */
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+} Buf;
+
+
+/* Reports the last error on the connection of `ps` together with `msg`.
+   Returns `stat`. */
+static int pg_error(const PgStorage *ps, int stat, const char *msg)
+{
+  const char *pgmsg = PQerrorMessage(ps->conn);
+  int n = (int)strlen(pgmsg);
+  while (n > 0 && (pgmsg[n-1] == '\n' || pgmsg[n-1] == '\r')) n--;
+  return errx(stat, "postgresql: %s: %.*s", msg, n, pgmsg);
+}
+
+/* Like pg_error(), but reports the error from result `res`. */
+static int pg_result_error(PGresult *res, int stat, const char *msg)
+{
+  const char *pgmsg = PQresultErrorMessage(res);
+  int n = (int)strlen(pgmsg);
+  while (n > 0 && (pgmsg[n-1] == '\n' || pgmsg[n-1] == '\r')) n--;
+  return errx(stat, "postgresql: %s: %.*s", msg, n, pgmsg);
+}
+
+
+/* Copies `n` bytes from `src` to `dest` in big-endian (network) order. */
+static void copy_be(void *dest, const void *src, size_t n)
+{
+  static const int one = 1;
+  const unsigned char *s = src;
+  unsigned char *d = dest;
+  size_t i;
+  if (*(const char *)&one)
+    for (i=0; i<n; i++) d[i] = s[n-i-1];
+  else
+    memcpy(d, s, n);
+}
+
+/* Reserves space for `n` more bytes in `b` and returns a pointer to
+   it.  Returns NULL on error. */
+static char *buf_reserve(Buf *b, size_t n)
+{
+  char *p;
+  if (b->len + n > b->size) {
+    size_t size = (b->size) ? b->size : 256;
+    while (size < b->len + n) size *= 2;
+    if (!(b->data = realloc(b->data, size))) {
+      b->len = b->size = 0;
+      return err(1, "allocation failure"), NULL;
+    }
+    b->size = size;
+  }
+  p = b->data + b->len;
+  b->len += n;
+  return p;
+}
+
+/* Appends `n` bytes from `src` to `b`.  Returns non-zero on error. */
+static int buf_add(Buf *b, const void *src, size_t n)
+{
+  char *p;
+  if (!(p = buf_reserve(b, n))) return 1;
+  if (n) memcpy(p, src, n);
+  return 0;
+}
+
+/* Appends `v` to `b` as a big-endian 32-bit integer. */
+static int buf_add_int32(Buf *b, int32_t v)
+{
+  char *p;
+  if (!(p = buf_reserve(b, 4))) return 1;
+  copy_be(p, &v, 4);
+  return 0;
+}
+
+
+/* Returns the element type if `oid` is an array type, otherwise 0. */
+static Oid array_elem(Oid oid)
+{
+  ArrayType *a;
+  for (a=array_types; a->array; a++)
+    if (a->array == oid) return a->elem;
+  return 0;
+}
+
+/* Returns the DLite type and size corresponding to numerical type
+   `oid`.  Returns non-zero if `oid` is not numerical. */
+static int numeric_type(Oid oid, DLiteType *type, size_t *size)
+{
+  switch (oid) {
+  case PGBOOL:   *type = dliteBool;  *size = sizeof(bool); break;
+  case PGINT2:   *type = dliteInt;   *size = 2; break;
+  case PGINT4:   *type = dliteInt;   *size = 4; break;
+  case PGINT8:   *type = dliteInt;   *size = 8; break;
+  case PGFLOAT4: *type = dliteFloat; *size = 4; break;
+  case PGFLOAT8: *type = dliteFloat; *size = 8; break;
+  default: return 1;
+  }
+  return 0;
+}
+
+/* Casts a numerical value.  Casts to and from bool are handled here,
+   other casts by dlite_type_copy_cast().  Returns non-zero on error. */
+static int cast_number(void *dest, DLiteType dest_type, size_t dest_size,
+                       const void *src, DLiteType src_type, size_t src_size)
+{
+  if (dest_type == dliteBool) {
+    double v=0;
+    if (src_type == dliteBool)
+      *(bool *)dest = *(bool *)src;
+    else if (dlite_type_copy_cast(&v, dliteFloat, sizeof(v),
+                                  src, src_type, src_size))
+      return 1;
+    else
+      *(bool *)dest = (v != 0);
+    return 0;
+  } else if (src_type == dliteBool) {
+    int v = *(bool *)src;
+    return dlite_type_copy_cast(dest, dest_type, dest_size,
+                                &v, dliteInt, sizeof(v));
+  }
+  return dlite_type_copy_cast(dest, dest_type, dest_size,
+                              src, src_type, src_size);
+}
+
+
+/* Returns the name of the PostgreSQL type used for storing properties
+   of type `type` and size `size`, or NULL if it is not supported. */
+static const char *pg_typename(DLiteType type, size_t size)
+{
+  switch (type) {
+  case dliteBlob:   return "bytea";
+  case dliteBool:   return "bool";
+  case dliteInt:
+    switch (size) {
+    case 1: return "bytea";
+    case 2: return "smallint";
+    case 4: return "integer";
+    case 8: return "bigint";
+    }
+    break;
+  case dliteUInt:
+    switch (size) {
+    case 1: return "bytea";
+    case 2: return "integer";
+    case 4: return "bigint";
+    case 8: return "bigint";
+    }
+    break;
+  case dliteFloat:
+    switch (size) {
+    case 4: return "real";
+    case 8: return "float8";
+    }
+    break;
+  case dliteFixString:
+  case dliteStringPtr:
+    return "varchar";
+  default:
+    break;
+  }
+  return NULL;
+}
+
+
+/* Encodes a single element `src` of type `type` and size `size` as
+   PostgreSQL type `oid` and appends it to `b`.  Sets `*isnull` if the
+   element is NULL.  Returns non-zero on error. */
+static int encode_elem(Buf *b, Oid oid, const void *src, DLiteType type,
+                       size_t size, int *isnull)
+{
+  const char *s;
+  DLiteType t;
+  size_t n;
+  char buf[8];
+
+  *isnull = 0;
+  switch (oid) {
+  case PGBOOL:
+  case PGINT2:
+  case PGINT4:
+  case PGINT8:
+  case PGFLOAT4:
+  case PGFLOAT8:
+    numeric_type(oid, &t, &n);
+    if (cast_number(buf, t, n, src, type, size))
+      return errx(1, "postgresql: cannot cast %s to %s",
+                  dlite_type_get_enum_name(type),
+                  dlite_type_get_enum_name(t));
+    if (t == dliteBool) {
+      char c = *(bool *)buf;
+      return buf_add(b, &c, 1);
+    } else {
+      char *p;
+      if (!(p = buf_reserve(b, n))) return 1;
+      copy_be(p, buf, n);
+    }
+    return 0;
+
+  case PGTEXT:
+  case PGVARCHAR:
+  case PGBPCHAR:
+    if (type == dliteFixString) {
+      s = src;
+      n = strnlen(s, size);
+    } else if (type == dliteStringPtr) {
+      if (!(s = *(char **)src)) {
+        *isnull = 1;
+        return 0;
+      }
+      n = strlen(s);
+    } else {
+      return errx(1, "postgresql: cannot store %s in a text column",
+                  dlite_type_get_enum_name(type));
+    }
+    return buf_add(b, s, n);
+
+  case PGBYTEA:
+    return buf_add(b, src, size);
+  }
+  return errx(1, "postgresql: unsupported column type (oid=%u)", oid);
+}
+
+/* Encodes `src` of type `type` and size `size` with `ndims` dimensions
+   `dims` as PostgreSQL type `oid` and appends it to `b`.  If `oid` is
+   an array type, `src` points to the first element.  Sets `*isnull` if
+   the value is NULL.  Returns non-zero on error. */
+static int encode_value(Buf *b, Oid oid, const void *src, DLiteType type,
+                        size_t size, int ndims, const size_t *dims,
+                        int *isnull)
+{
+  Oid elem = array_elem(oid);
+  size_t i, nelem=1;
+  int j;
+
+  if (!elem) {
+    if (ndims)
+      return errx(1, "postgresql: cannot store array in a scalar column");
+    return encode_elem(b, oid, src, type, size, isnull);
+  }
+
+  /* Array header: ndim, flags, element type and dimensions */
+  *isnull = 0;
+  for (j=0; j<ndims; j++) nelem *= dims[j];
+  if (buf_add_int32(b, (nelem) ? ndims : 0)) return 1;
+  if (buf_add_int32(b, 0)) return 1;
+  if (buf_add_int32(b, elem)) return 1;
+  if (nelem)
+    for (j=0; j<ndims; j++)
+      if (buf_add_int32(b, (int32_t)dims[j]) || buf_add_int32(b, 1))
+        return 1;
+
+  /* Elements, each prefixed with its length */
+  for (i=0; i<nelem; i++) {
+    size_t pos = b->len;
+    int null;
+    int32_t len;
+    if (buf_add_int32(b, 0)) return 1;
+    if (encode_elem(b, elem, (char *)src + i*size, type, size, &null))
+      return 1;
+    len = (null) ? -1 : (int32_t)(b->len - pos - 4);
+    copy_be(b->data + pos, &len, 4);
+  }
+  return 0;
+}
+
+
+/* Decodes a single element of PostgreSQL type `oid` from `src` with
+   length `len` and writes it to `dest` of type `type` and size `size`.
+   Returns non-zero on error. */
+static int decode_elem(void *dest, DLiteType type, size_t size, Oid oid,
+                       const char *src, int len)
+{
+  DLiteType t;
+  size_t n;
+  char buf[8];
+
+  switch (oid) {
+  case PGBOOL:
+  case PGINT2:
+  case PGINT4:
+  case PGINT8:
+  case PGFLOAT4:
+  case PGFLOAT8:
+    numeric_type(oid, &t, &n);
+    if ((size_t)len != ((t == dliteBool) ? 1 : n))
+      return errx(1, "postgresql: unexpected length of %s value: %d",
+                  dlite_type_get_enum_name(t), len);
+    if (t == dliteBool)
+      *(bool *)buf = (*src != 0);
+    else
+      copy_be(buf, src, n);
+    if (cast_number(dest, type, size, buf, t, n))
+      return errx(1, "postgresql: cannot cast %s to %s",
+                  dlite_type_get_enum_name(t),
+                  dlite_type_get_enum_name(type));
+    return 0;
+
+  case PGTEXT:
+  case PGVARCHAR:
+  case PGBPCHAR:
+    if (oid == PGBPCHAR)
+      while (len > 0 && src[len-1] == ' ') len--;
+    if (type == dliteFixString) {
+      memset(dest, 0, size);
+      strncpy(dest, src, ((size_t)len < size) ? (size_t)len : size - 1);
+    } else if (type == dliteStringPtr) {
+      char **p = dest;
+      if (*p) free(*p);
+      if (!(*p = strndup(src, len))) return err(1, "allocation failure");
+    } else {
+      return errx(1, "postgresql: cannot load text column to %s",
+                  dlite_type_get_enum_name(type));
+    }
+    return 0;
+
+  case PGBYTEA:
+    if ((size_t)len != size)
+      return errx(1, "postgresql: expected %zu bytes, got %d", size, len);
+    memcpy(dest, src, size);
+    return 0;
+  }
+  return errx(1, "postgresql: unsupported column type (oid=%u)", oid);
+}
+
+/* Decodes value of PostgreSQL type `oid` from `src` with length `len`
+   and writes it to `dest`, which is of type `type` and size `size`
+   with `nelem` elements.  For arrays, `dest` points to the first
+   element.  Returns non-zero on error. */
+static int decode_value(void *dest, DLiteType type, size_t size,
+                        size_t nelem, Oid oid, const char *src, int len)
+{
+  Oid elem = array_elem(oid);
+  const char *end = src + len;
+  int32_t ndim, flags, dim, v;
+  size_t i, n=1;
+
+  if (!elem) {
+    if (nelem != 1)
+      return errx(1, "postgresql: expected array, got scalar column");
+    return decode_elem(dest, type, size, oid, src, len);
+  }
+  if (len < 12) return errx(1, "postgresql: invalid array");
+  copy_be(&ndim, src, 4);
+  copy_be(&flags, src + 4, 4);
+  src += 12;
+  if (end - src < (ptrdiff_t)(8*ndim))
+    return errx(1, "postgresql: invalid array");
+  for (i=0; i<(size_t)ndim; i++) {
+    copy_be(&dim, src + 8*i, 4);
+    n *= dim;
+  }
+  if (ndim == 0) n = 0;
+  src += 8*ndim;
+  if (n != nelem)
+    return errx(1, "postgresql: expected %zu array elements, got %zu",
+                nelem, n);
+  for (i=0; i<n; i++) {
+    if (end - src < 4) return errx(1, "postgresql: invalid array");
+    copy_be(&v, src, 4);
+    src += 4;
+    if (v < 0) continue;  /* NULL - leave element unchanged */
+    if (end - src < v) return errx(1, "postgresql: invalid array");
+    if (decode_elem((char *)dest + i*size, type, size, elem, src, v))
+      return 1;
+    src += v;
+  }
+  return 0;
+}
+
+
+/* Converts glob `pattern` to a newly malloc'ed LIKE pattern. */
+static char *glob_to_like(const char *pattern)
+{
+  const char *p;
+  char *like, *q;
+  if (!(like = malloc(2*strlen(pattern) + 1)))
+    return err(1, "allocation failure"), NULL;
+  for (p=pattern, q=like; *p; p++) {
+    switch (*p) {
+    case '*': *q++ = '%'; break;
+    case '?': *q++ = '_'; break;
+    case '%':
+    case '_':
+    case '\\': *q++ = '\\'; *q++ = *p; break;
+    default: *q++ = *p;
+    }
+  }
+  *q = '\0';
+  return like;
+}
+
+/* Executes SQL command `sql` without parameters.  Returns non-zero on
+   error. */
+static int pg_exec(PgStorage *ps, const char *sql)
+{
+  PGresult *res = PQexec(ps->conn, sql);
+  int stat = 0;
+  if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    stat = pg_result_error(res, 1, "cannot execute command");
+  PQclear(res);
+  return stat;
+}
+
+
+/* Creates table for `meta`, if it doesn't already exists.  Returns
+   non-zero on error. */
+static int table_create(PgStorage *ps, const DLiteMeta *meta)
+{
+  char *sql=NULL, *ident=NULL;
+  size_t size=0, m=0, i;
+  int retval=1;
+
+  if (pg_exec(ps, "CREATE TABLE IF NOT EXISTS uuidtable ("
+              "uuid char(36) PRIMARY KEY, meta varchar)")) goto fail;
+
+  if (!(ident = PQescapeIdentifier(ps->conn, meta->uri, strlen(meta->uri))))
+    FAIL1("postgresql: cannot escape identifier: %s", meta->uri);
+  m += asnpprintf(&sql, &size, m, "CREATE TABLE IF NOT EXISTS %s ("
+                  "uuid char(36) PRIMARY KEY, uri varchar, meta varchar, "
+                  "dims integer[%zu]", ident, meta->_ndimensions);
+  PQfreemem(ident);
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    const char *typename = pg_typename(p->type, p->size);
+    int j;
+    if (!typename)
+      FAIL2("postgresql: unsupported type of property '%s': %s",
+            p->name, dlite_type_get_enum_name(p->type));
+    if (!(ident = PQescapeIdentifier(ps->conn, p->name, strlen(p->name))))
+      FAIL1("postgresql: cannot escape identifier: %s", p->name);
+    m += asnpprintf(&sql, &size, m, ", %s %s", ident, typename);
+    PQfreemem(ident);
+    for (j=0; j<p->ndims; j++) m += asnpprintf(&sql, &size, m, "[]");
+  }
+  m += asnpprintf(&sql, &size, m, ")");
+  if (pg_exec(ps, sql)) goto fail;
+  retval = 0;
+ fail:
+  if (sql) free(sql);
+  return retval;
+}
+
+
+/* Returns a prepared insert statement for instances of `meta`.  The
+   statement is prepared the first time it is requested.  Returns NULL
+   on error. */
+static Statement *get_statement(PgStorage *ps, const DLiteMeta *meta)
+{
+  Statement *stmt=NULL;
+  void **sp;
+  PGresult *res=NULL;
+  char *sql=NULL, *table=NULL, *ident;
+  size_t size=0, m=0, i, n;
+
+  if ((sp = map_get(&ps->stmts, meta->uri))) return *sp;
+  if (dlite_meta_is_metameta(meta))
+    FAIL("postgresql: storing metadata is not supported");
+
+  if (table_create(ps, meta)) goto fail;
+  if (!(stmt = calloc(1, sizeof(Statement)))) FAIL("allocation failure");
+  snprintf(stmt->name, sizeof(stmt->name), "dlite_insert%d", ps->nstmts++);
+
+  /* Insert to both the metadata table and uuidtable in one statement.
+     Instances that already are in the database are left untouched. */
+  if (!(table = PQescapeIdentifier(ps->conn, meta->uri, strlen(meta->uri))))
+    FAIL1("postgresql: cannot escape identifier: %s", meta->uri);
+  m += asnpprintf(&sql, &size, m, "WITH ins AS (INSERT INTO %s "
+                  "(uuid, uri, meta, dims", table);
+  for (i=0; i<meta->_nproperties; i++) {
+    const char *name = meta->_properties[i].name;
+    if (!(ident = PQescapeIdentifier(ps->conn, name, strlen(name))))
+      FAIL1("postgresql: cannot escape identifier: %s", name);
+    m += asnpprintf(&sql, &size, m, ", %s", ident);
+    PQfreemem(ident);
+  }
+  n = meta->_nproperties + 4;
+  m += asnpprintf(&sql, &size, m, ") VALUES (");
+  for (i=0; i<n; i++)
+    m += asnpprintf(&sql, &size, m, "%s$%zu", (i) ? ", " : "", i+1);
+  m += asnpprintf(&sql, &size, m, ") ON CONFLICT (uuid) DO NOTHING "
+                  "RETURNING uuid, meta) "
+                  "INSERT INTO uuidtable (uuid, meta) SELECT uuid, meta "
+                  "FROM ins ON CONFLICT (uuid) DO NOTHING");
+
+  /* Let the server infer the parameter types from the table */
+  res = PQprepare(ps->conn, stmt->name, sql, 0, NULL);
+  if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+    pg_result_error(res, 1, "cannot prepare statement");
+    goto fail;
+  }
+  PQclear(res);
+  res = PQdescribePrepared(ps->conn, stmt->name);
+  if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+    pg_result_error(res, 1, "cannot describe statement");
+    goto fail;
+  }
+  stmt->nparams = PQnparams(res);
+  if (stmt->nparams != (int)n)
+    FAIL2("postgresql: expected %zu parameters, got %d", n, stmt->nparams);
+  if (!(stmt->types = calloc(n, sizeof(Oid)))) FAIL("allocation failure");
+  for (i=0; i<n; i++) stmt->types[i] = PQparamtype(res, i);
+
+  if (map_set(&ps->stmts, meta->uri, stmt))
+    FAIL("postgresql: cannot register prepared statement");
+  PQclear(res);
+  PQfreemem(table);
+  free(sql);
+  return stmt;
+ fail:
+  if (res) PQclear(res);
+  if (table) PQfreemem(table);
+  if (sql) free(sql);
+  if (stmt) {
+    if (stmt->types) free(stmt->types);
+    free(stmt);
+  }
+  return NULL;
+}
+
+
+/* Parameters for inserting an instance */
+typedef struct {
+  Buf buf;             /* Encoded parameter values */
+  int n;               /* Number of parameters */
+  size_t *offsets;     /* Offset of each value in `buf`, -1 if NULL */
+  const char **values; /* Pointers to parameter values */
+  int *lengths;        /* Parameter lengths */
+  int *formats;        /* Parameter formats (all binary) */
+} Params;
+
+/* Initialises `params` for `n` parameters.  Returns non-zero on error. */
+static int params_init(Params *params, int n)
+{
+  int i;
+  memset(params, 0, sizeof(Params));
+  params->n = n;
+  if (!(params->offsets = calloc(n, sizeof(size_t))) ||
+      !(params->values = calloc(n, sizeof(char *))) ||
+      !(params->lengths = calloc(n, sizeof(int))) ||
+      !(params->formats = calloc(n, sizeof(int))))
+    return err(1, "allocation failure");
+  for (i=0; i<n; i++) params->formats[i] = 1;
+  return 0;
+}
+
+/* Releases resources held by `params`. */
+static void params_deinit(Params *params)
+{
+  if (params->buf.data) free(params->buf.data);
+  if (params->offsets) free(params->offsets);
+  if (params->values) free(params->values);
+  if (params->lengths) free(params->lengths);
+  if (params->formats) free(params->formats);
+  memset(params, 0, sizeof(Params));
+}
+
+/* Appends parameter `i`. */
+static int params_add(Params *params, int i, Oid oid, const void *src,
+                      DLiteType type, size_t size, int ndims,
+                      const size_t *dims)
+{
+  size_t pos = params->buf.len;
+  int isnull;
+  if (encode_value(&params->buf, oid, src, type, size, ndims, dims, &isnull))
+    return 1;
+  params->offsets[i] = (isnull) ? (size_t)-1 : pos;
+  params->lengths[i] = (int)(params->buf.len - pos);
+  return 0;
+}
+
+/* Encodes the parameters for inserting `inst` with `stmt` into
+   `params`, which should be initialised.  Returns non-zero on error. */
+static int params_set(Params *params, const Statement *stmt,
+                      const DLiteInstance *inst)
+{
+  const DLiteMeta *meta = inst->meta;
+  const char *uri = inst->uri;
+  const char *metauri = meta->uri;
+  size_t ndims = meta->_ndimensions;
+  size_t i;
+  int j;
+
+  params->buf.len = 0;
+  if (params_add(params, 0, stmt->types[0], &inst->uuid, dliteFixString,
+                 sizeof(inst->uuid), 0, NULL) ||
+      params_add(params, 1, stmt->types[1], &uri, dliteStringPtr,
+                 sizeof(char *), 0, NULL) ||
+      params_add(params, 2, stmt->types[2], &metauri, dliteStringPtr,
+                 sizeof(char *), 0, NULL) ||
+      params_add(params, 3, stmt->types[3], DLITE_DIMS(inst), dliteUInt,
+                 sizeof(size_t), 1, &ndims))
+    return 1;
+
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    void *ptr = DLITE_PROP(inst, i);
+    if (p->ndims) ptr = *(void **)ptr;
+    if (params_add(params, i+4, stmt->types[i+4], ptr, p->type, p->size,
+                   p->ndims, (p->ndims) ? DLITE_PROP_DIMS(inst, i) : NULL))
+      return errx(1, "postgresql: cannot store property '%s' of '%s'",
+                  p->name, inst->uuid);
+  }
+
+  /* Resolve pointers after all values are added, since the buffer may
+     have been reallocated */
+  for (j=0; j<params->n; j++)
+    params->values[j] = (params->offsets[j] == (size_t)-1) ? NULL :
+      params->buf.data + params->offsets[j];
+  return 0;
+}
+
+
+/**
+  Opens connection to PostgreSQL server at `location` (host name)
+  and returns a newly created storage for it.
+
+  The `options` argument provies additional input to the driver.
+  Valid `options` are:
+
+  - database : Name of database to connect to (default: dlite)
+  - user : User name.
+  - password : Password.
+  - port : Server port.
+  - mode : append | r
+      Valid values are:
+      - append   Append to existing database (default)
+      - r        Open existing database for read-only
+
+  Returns NULL on error.
+ */
+DLiteStorage *pg_open(const DLiteStoragePlugin *api, const char *location,
+                      const char *options)
+{
+  PgStorage *ps=NULL;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"append\" (append to existing database, default); "
+    "\"r\" (read-only)";
+  DLiteOpt opts[] = {
+    {'d', "database",  "dlite",  "Name of database to connect to."},
+    {'u', "user",      NULL,     "User name."},
+    {'p', "password",  NULL,     "Password."},
+    {'P', "port",      NULL,     "Server port."},
+    {'m', "mode",      "append", mode_descr},
+    {0, NULL, NULL, NULL}
+  };
+  const char *keywords[] = {"host", "dbname", "user", "password", "port",
+                            NULL};
+  const char *values[6];
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode;
+  UNUSED(api);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[4].value;
+
+  if (!(ps = calloc(1, sizeof(PgStorage)))) FAIL("allocation failure");
+  map_init(&ps->stmts);
+
+  if (strcmp(mode, "append") == 0 || strcmp(mode, "a") == 0) {
+    ps->writable = 1;
+  } else if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    ps->writable = 0;
+  } else {
+    FAIL1("invalid \"mode\" value: '%s'. Must be \"append\" or \"r\" "
+          "(read-only)", mode);
+  }
+
+  values[0] = location;
+  values[1] = opts[0].value;
+  values[2] = opts[1].value;
+  values[3] = opts[2].value;
+  values[4] = opts[3].value;
+  values[5] = NULL;
+  ps->conn = PQconnectdbParams(keywords, values, 0);
+  if (!ps->conn) FAIL("postgresql: allocation failure");
+  if (PQstatus(ps->conn) != CONNECTION_OK) {
+    pg_error(ps, 1, "cannot connect to server");
+    goto fail;
+  }
+
+  retval = (DLiteStorage *)ps;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && ps) {
+    if (ps->conn) PQfinish(ps->conn);
+    map_deinit(&ps->stmts);
+    free(ps);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  Returns non-zero on error.
+ */
+int pg_close(DLiteStorage *s)
+{
+  PgStorage *ps = (PgStorage *)s;
+  const char *key;
+  map_iter_t iter = map_iter(&ps->stmts);
+  while ((key = map_next(&ps->stmts, &iter))) {
+    Statement *stmt = *map_get(&ps->stmts, key);
+    free(stmt->types);
+    free(stmt);
+  }
+  map_deinit(&ps->stmts);
+  PQfinish(ps->conn);
+  return 0;
+}
+
+
+/**
+  Loads instance `id` from storage `s` and returns it.
+  NULL is returned on error.
+ */
+DLiteInstance *pg_load(const DLiteStorage *s, const char *id)
+{
+  PgStorage *ps = (PgStorage *)s;
+  PGresult *res=NULL;
+  DLiteMeta *meta=NULL;
+  DLiteInstance *inst=NULL, *retval=NULL;
+  char uuid[DLITE_UUID_LENGTH+1], *sql=NULL, *table=NULL;
+  const char *params[1] = {uuid};
+  size_t *dims=NULL, i;
+  int col, ncols, idims=-1, iuri=-1;
+
+  if (!id) FAIL("postgresql: an id is required when loading an instance");
+  if (dlite_get_uuid(uuid, id) < 0) goto fail;
+
+  /* Look up metadata in uuidtable */
+  res = PQexecParams(ps->conn, "SELECT meta FROM uuidtable WHERE uuid = $1",
+                     1, NULL, params, NULL, NULL, 0);
+  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+    pg_result_error(res, 1, "cannot look up instance");
+    goto fail;
+  }
+  if (PQntuples(res) != 1)
+    FAIL2("postgresql: no instance with id \"%s\" in storage \"%s\"",
+          id, s->location);
+  if (!(meta = dlite_meta_get(PQgetvalue(res, 0, 0)))) goto fail;
+  PQclear(res);
+  res = NULL;
+
+  /* Select the row in binary format */
+  if (!(table = PQescapeIdentifier(ps->conn, meta->uri, strlen(meta->uri))))
+    FAIL1("postgresql: cannot escape identifier: %s", meta->uri);
+  asprintf(&sql, "SELECT * FROM %s WHERE uuid = $1", table);
+  if (!sql) FAIL("allocation failure");
+  res = PQexecParams(ps->conn, sql, 1, NULL, params, NULL, NULL, 1);
+  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+    pg_result_error(res, 1, "cannot load instance");
+    goto fail;
+  }
+  if (PQntuples(res) != 1)
+    FAIL2("postgresql: no instance with id \"%s\" in storage \"%s\"",
+          id, s->location);
+
+  /* Create instance */
+  ncols = PQnfields(res);
+  for (col=0; col<ncols; col++) {
+    if (strcmp(PQfname(res, col), "dims") == 0) idims = col;
+    if (strcmp(PQfname(res, col), "uri") == 0) iuri = col;
+  }
+  if (idims < 0) FAIL1("postgresql: no dims column in table %s", table);
+  if (meta->_ndimensions &&
+      !(dims = calloc(meta->_ndimensions, sizeof(size_t))))
+    FAIL("allocation failure");
+  if (!PQgetisnull(res, 0, idims) &&
+      decode_value(dims, dliteUInt, sizeof(size_t), meta->_ndimensions,
+                   PQftype(res, idims), PQgetvalue(res, 0, idims),
+                   PQgetlength(res, 0, idims)))
+    goto fail;
+  if (!(inst = dlite_instance_create(meta, dims,
+                                     (iuri >= 0 && !PQgetisnull(res, 0, iuri))
+                                     ? PQgetvalue(res, 0, iuri) : uuid)))
+    goto fail;
+
+  /* Assign properties, columns without a property are ignored */
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    size_t nelem = 1;
+    void *ptr;
+    int j;
+    for (col=0; col<ncols; col++)
+      if (strcmp(PQfname(res, col), p->name) == 0) break;
+    if (col >= ncols || PQgetisnull(res, 0, col)) continue;
+    if (!(ptr = DLITE_PROP_RW(inst, i))) goto fail;
+    if (p->ndims) {
+      ptr = *(void **)ptr;
+      for (j=0; j<p->ndims; j++) nelem *= DLITE_PROP_DIM(inst, i, j);
+    }
+    if (decode_value(ptr, p->type, p->size, nelem, PQftype(res, col),
+                     PQgetvalue(res, 0, col), PQgetlength(res, 0, col)))
+      FAIL2("postgresql: cannot load property '%s' of '%s'", p->name, id);
+  }
+
+  retval = inst;
+ fail:
+  if (res) PQclear(res);
+  if (table) PQfreemem(table);
+  if (sql) free(sql);
+  if (dims) free(dims);
+  if (meta) dlite_meta_decref(meta);
+  if (!retval && inst) dlite_instance_decref(inst);
+  return retval;
+}
+
+
+/**
+  Saves instance `inst` to storage `s`.  Returns non-zero on error.
+ */
+int pg_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  PgStorage *ps = (PgStorage *)s;
+  PGresult *res=NULL;
+  Statement *stmt;
+  Params params;
+  int retval=1;
+
+  memset(&params, 0, sizeof(Params));
+  if (!(stmt = get_statement(ps, inst->meta))) goto fail;
+  if (params_init(&params, stmt->nparams)) goto fail;
+  if (params_set(&params, stmt, inst)) goto fail;
+  res = PQexecPrepared(ps->conn, stmt->name, params.n, params.values,
+                       params.lengths, params.formats, 1);
+  if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+    pg_result_error(res, 1, "cannot save instance");
+    goto fail;
+  }
+  retval = 0;
+ fail:
+  if (res) PQclear(res);
+  params_deinit(&params);
+  return retval;
+}
+
+
+#ifdef LIBPQ_HAS_PIPELINING
+
+/* Reads the results of `n` queries followed by a sync from a
+   pipeline.  Returns non-zero on error. */
+static int pipeline_results(PgStorage *ps, size_t n)
+{
+  PGresult *res;
+  size_t i;
+  int stat=0;
+  for (i=0; i<n; i++) {
+    while ((res = PQgetResult(ps->conn))) {
+      ExecStatusType status = PQresultStatus(res);
+      if (!stat && status != PGRES_COMMAND_OK)
+        stat = pg_result_error(res, 1, "cannot save instances");
+      PQclear(res);
+    }
+  }
+  if (!(res = PQgetResult(ps->conn)) ||
+      PQresultStatus(res) != PGRES_PIPELINE_SYNC)
+    if (!stat) stat = pg_error(ps, 1, "pipeline out of sync");
+  if (res) PQclear(res);
+  return stat;
+}
+
+#endif
+
+
+/**
+  Saves the `n` instances in `insts` to storage `s`.
+
+  If libpq supports pipeline mode, the instances are sent without
+  waiting for the server in between, which avoids a round-trip per
+  instance.  Each chunk of PIPELINE_DEPTH instances is stored in a
+  transaction of its own.
+
+  Returns non-zero on error.
+ */
+int pg_save_many(DLiteStorage *s, const DLiteInstance **insts, size_t n)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+  PgStorage *ps = (PgStorage *)s;
+  Statement *stmt;
+  Params params;
+  size_t i, k, pending=0;
+  int retval=1, nparams=0;
+
+  /* Prepare statements before entering pipeline mode */
+  memset(&params, 0, sizeof(Params));
+  for (i=0; i<n; i++) {
+    if (!(stmt = get_statement(ps, insts[i]->meta))) return 1;
+    if (stmt->nparams > nparams) nparams = stmt->nparams;
+  }
+  if (params_init(&params, nparams)) goto fail;
+
+  if (!PQenterPipelineMode(ps->conn)) {
+    pg_error(ps, 1, "cannot enter pipeline mode");
+    goto fail;
+  }
+  for (i=0; i<n; i++) {
+    stmt = *map_get(&ps->stmts, insts[i]->meta->uri);
+    params.n = stmt->nparams;
+    if (params_set(&params, stmt, insts[i])) break;
+    if (!PQsendQueryPrepared(ps->conn, stmt->name, params.n, params.values,
+                             params.lengths, params.formats, 1)) {
+      pg_error(ps, 1, "cannot send instance");
+      break;
+    }
+    if (++pending >= PIPELINE_DEPTH || i == n-1) {
+      if (!PQpipelineSync(ps->conn)) {
+        pg_error(ps, 1, "cannot sync pipeline");
+        break;
+      }
+      k = pending;
+      pending = 0;
+      if (pipeline_results(ps, k)) break;
+    }
+  }
+  if (i == n) retval = 0;
+
+  /* Flush queries that are sent but not synced */
+  if (pending && PQpipelineSync(ps->conn)) pipeline_results(ps, pending);
+  if (!PQexitPipelineMode(ps->conn)) {
+    pg_error(ps, 1, "cannot exit pipeline mode");
+    retval = 1;
+  }
+ fail:
+  params.n = nparams;
+  params_deinit(&params);
+  return retval;
+#else
+  size_t i;
+  for (i=0; i<n; i++)
+    if (pg_save(s, insts[i])) return 1;
+  return 0;
+#endif
+}
+
+
+/**
+  Returns a new iterator over the uuids of all instances in storage
+  `s` whos metadata uri matches glob `pattern`.  If `pattern` is
+  NULL, all instances are iterated over.
+
+  Returns NULL on error.
+ */
+void *pg_iter_create(const DLiteStorage *s, const char *pattern)
+{
+  PgStorage *ps = (PgStorage *)s;
+  PgIter *iter=NULL;
+  char *like=NULL;
+  const char *params[1];
+
+  if (!(iter = calloc(1, sizeof(PgIter)))) FAIL("allocation failure");
+  if (pattern) {
+    if (!(like = glob_to_like(pattern))) goto fail;
+    params[0] = like;
+    iter->res = PQexecParams(ps->conn, "SELECT uuid FROM uuidtable "
+                             "WHERE meta LIKE $1", 1, NULL, params,
+                             NULL, NULL, 0);
+  } else {
+    iter->res = PQexec(ps->conn, "SELECT uuid FROM uuidtable");
+  }
+  if (PQresultStatus(iter->res) != PGRES_TUPLES_OK) {
+    /* An empty database has no uuidtable */
+    const char *state = PQresultErrorField(iter->res, PG_DIAG_SQLSTATE);
+    if (!state || strcmp(state, "42P01") != 0) {
+      pg_result_error(iter->res, 1, "cannot query instances");
+      goto fail;
+    }
+  }
+  free(like);
+  return iter;
+ fail:
+  if (iter) {
+    if (iter->res) PQclear(iter->res);
+    free(iter);
+  }
+  if (like) free(like);
+  return NULL;
+}
+
+/**
+  Writes the uuid of the next instance to `buf`, where `iter` is an
+  iterator returned by pg_iter_create().
+
+  Returns zero on success, 1 if there are no more UUIDs to iterate
+  over and a negative number on other errors.
+ */
+int pg_iter_next(void *iter, char *buf)
+{
+  PgIter *it = iter;
+  if (PQresultStatus(it->res) != PGRES_TUPLES_OK ||
+      it->row >= PQntuples(it->res))
+    return 1;
+  strncpy(buf, PQgetvalue(it->res, it->row++, 0), DLITE_UUID_LENGTH);
+  buf[DLITE_UUID_LENGTH] = '\0';
+  return 0;
+}
+
+/**
+  Free's iterator created with pg_iter_create().
+ */
+void pg_iter_free(void *iter)
+{
+  PgIter *it = iter;
+  PQclear(it->res);
+  free(it);
+}
+
+
+static DLiteStoragePlugin dlite_postgresql_plugin = {
+  /* head */
+  "postgresql",             /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  pg_open,                  /* open */
+  pg_close,                 /* close */
+
+  /* queue api */
+  pg_iter_create,           /* iterCreate */
+  pg_iter_next,             /* iterNext */
+  pg_iter_free,             /* iterFree */
+  NULL,                     /* getUUIDs */
+
+  /* direct api */
+  pg_load,                  /* loadInstance */
+  pg_save,                  /* saveInstance */
+  NULL,                     /* loadInstances */
+  pg_save_many,             /* saveInstances */
+
+  /* datamodel api */
+  NULL,                     /* dataModel */
+  NULL,                     /* dataModelFree */
+
+  NULL,                     /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  NULL,                     /* getDimensionSize */
+  NULL,                     /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                     /* setMetaURI */
+  NULL,                     /* setDimensionSize */
+  NULL,                     /* setProperty */
+
+  NULL,                     /* hasDimension */
+  NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  NULL,                     /* getDataName, obsolute */
+  NULL,                     /* setDataName, obsolute */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &dlite_postgresql_plugin;
+}
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+
+#include "dlite.h"
+#include "dlite-macros.h"
+
+#include "test_fixtures.h"
+
+/* This header should define HOST, DATABASE, USER and PASSWORD */
+#include "pgconf.h"
+
+#define NINST 10
+
+DLiteStorage *db=NULL;
+#ifdef PASSWORD
+char *options = "database=" DATABASE ";user=" USER ";password=" PASSWORD;
+#else
+char *options = "database=" DATABASE ";user=" USER;
+#endif
+
+char *uri = "http://onto-ns.com/meta/0.1/PgTestEntity";
+DLiteMeta *entity=NULL;
+DLiteInstance *instances[NINST];
+
+
+MU_TEST(test_open_db)
+{
+  mu_check((db = dlite_storage_open("postgresql", HOST, options)));
+  mu_assert_int_eq(1, dlite_storage_is_writable(db));
+}
+
+MU_TEST(test_create)
+{
+  int i;
+  mu_check((entity = create_test_entity(uri)));
+  for (i=0; i<NINST; i++)
+    mu_check((instances[i] = create_test_instance(entity, i)));
+}
+
+MU_TEST(test_save)
+{
+  mu_assert_int_eq(0, dlite_instance_save(db, instances[0]));
+  mu_assert_int_eq(0, dlite_instance_save_many(db,
+                                               (const DLiteInstance **)instances,
+                                               NINST));
+
+  /* saving existing instances is a no-op */
+  mu_assert_int_eq(0, dlite_instance_save_many(db,
+                                               (const DLiteInstance **)instances,
+                                               NINST));
+
+  /* metadata is not supported */
+  mu_check(dlite_instance_save(db, (DLiteInstance *)entity));
+}
+
+MU_TEST(test_load)
+{
+  int i;
+  for (i=0; i<NINST; i++) {
+    DLiteInstance *inst;
+    mu_check((inst = dlite_instance_load(db, instances[i]->uuid)));
+    mu_assert_string_eq(instances[i]->uuid, inst->uuid);
+    mu_assert_int_eq(0, check_test_instance(inst, i));
+    dlite_instance_decref(inst);
+  }
+}
+
+MU_TEST(test_iter)
+{
+  mu_check(count_instances(db, uri) >= NINST);
+  mu_check(count_instances(db, "*/PgTestEnt?ty") >= NINST);
+  mu_assert_int_eq(0, count_instances(db, "http://no/such/meta"));
+}
+
+MU_TEST(test_close_db)
+{
+  int i;
+  mu_assert_int_eq(0, dlite_storage_close(db));
+  for (i=0; i<NINST; i++) dlite_instance_decref(instances[i]);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_open_db);
+  MU_RUN_TEST(test_create);
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_iter);
+  MU_RUN_TEST(test_close_db);
+}
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -21,6 +21,52 @@ typedef struct {
   PyObject *obj;      /* Python instance of storage class */
 } DLitePythonStorage;
 
+/* Data of a storage plugin API, pointed to by `api->data` */
+typedef struct {
+  PyObject *plugin;   /* plugin description, see dlite_python_storage_load() */
+  PyObject *pool;     /* maps (location, options) to lists of idle plugin
+                         objects, NULL if the plugin is not reusable */
+  int save_view;      /* whether the plugin has a save_view() method */
+  int load_into;      /* whether the plugin has load_layout() and
+                         load_into() methods */
+} PluginData;
+
+/* Default maximum number of idle plugin objects kept per location and
+   options of reusable plugins */
+#define POOL_DEFAULT_SIZE 4
+
+
+/* Returns the class name of the storage plugin implemented by `api` */
+static const char *plugin_classname(const DLiteStoragePlugin *api)
+{
+  PluginData *pd = (PluginData *)api->data;
+  const char *classname;
+  if (!(classname = PyUnicode_AsUTF8(PyList_GetItem(pd->plugin, 4)))) {
+    PyErr_Clear();
+    dlite_warnx("cannot get class name for storage plugin %s", api->name);
+  }
+  return classname;
+}
+
+/* Returns the maximum number of idle plugin objects per pool key.  It
+   may be set with the environment variable DLITE_PYTHON_POOL_SIZE. */
+static int pool_size(void)
+{
+  static int size = -1;
+  if (size < 0) {
+    char *endptr, *s = getenv("DLITE_PYTHON_POOL_SIZE");
+    long n = (s) ? strtol(s, &endptr, 10) : POOL_DEFAULT_SIZE;
+    size = (s && (*endptr || n < 0)) ? POOL_DEFAULT_SIZE : (int)n;
+  }
+  return size;
+}
+
+/* Returns a new reference to the key into the pool of idle plugin
+   objects for `location` and `options`. */
+static PyObject *pool_key(const char *location, const char *options)
+{
+  return Py_BuildValue("(zz)", location, options);
+}
 
 
 /*
@@ -37,18 +83,52 @@ opener(const DLiteStoragePlugin *api, const char *location,
 {
   DLitePythonStorage *s=NULL;
   DLiteStorage *retval=NULL;
-  PyObject *obj=NULL, *v=NULL, *writable=NULL;
-  PyObject *cls = (PyObject *)api->data;
+  PyObject *obj=NULL, *v=NULL, *writable=NULL, *key=NULL;
+  PyObject *cls;
+  PluginData *pd = (PluginData *)api->data;
   const char *classname;
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
+
+  classname = plugin_classname(api);
+
+  /* Import the plugin module on first use */
+  if (!(cls = dlite_python_storage_get_class(pd->plugin))) goto fail;
+
+  /* Create pool of idle plugin objects if the plugin is reusable */
+  if (!pd->pool && pool_size() > 0 &&
+      PyObject_HasAttrString(cls, "reusable")) {
+    PyObject *reusable = PyObject_GetAttrString(cls, "reusable");
+    if (reusable && PyObject_IsTrue(reusable) == 1 &&
+        !(pd->pool = PyDict_New())) {
+      Py_DECREF(reusable);
+      FAIL("cannot create pool of plugin objects");
+    }
+    Py_XDECREF(reusable);
+    PyErr_Clear();
+  }
 
-  if (!(classname = dlite_pyembed_classname(cls)))
-    dlite_warnx("cannot get class name for storage plugin %s", api->name);
+  /* Reuse an idle plugin object opened with the same location and
+     options, if any */
+  if (pd->pool) {
+    PyObject *idle;
+    if (!(key = pool_key(location, options)))
+      FAIL("cannot create key for pool of plugin objects");
+    if ((idle = PyDict_GetItem(pd->pool, key)) && PyList_Size(idle) > 0) {
+      Py_ssize_t n = PyList_Size(idle);
+      obj = PyList_GetItem(idle, n-1);
+      Py_INCREF(obj);
+      PyList_SetSlice(idle, n-1, n, NULL);
+    }
+  }
 
   /* Call method: open() */
-  if (!(obj = PyObject_CallObject(cls, NULL)))
-    FAIL1("error instantiating %s", classname);
-  v = PyObject_CallMethod(obj, "open", "ss", location, options);
-  if (dlite_pyembed_err_check("error calling %s.open()", classname)) goto fail;
+  if (!obj) {
+    if (!(obj = PyObject_CallObject(cls, NULL)))
+      FAIL1("error instantiating %s", classname);
+    v = PyObject_CallMethod(obj, "open", "ss", location, options);
+    if (dlite_pyembed_err_check("error calling %s.open()", classname))
+      goto fail;
+  }
 
   /* Check if the open() method has set attribute `writable` */
   if (PyObject_HasAttrString(obj, "writable"))
@@ -65,40 +145,187 @@ opener(const DLiteStoragePlugin *api, const char *location,
 
   retval = (DLiteStorage *)s;
  fail:
-  if (s && !retval) {
-    free(s->location);
-    if (s->options) free(s->options);
-    Py_DECREF(s->obj);
-    free(s);
+  if (!retval) {
+    if (s) {
+      free(s->location);
+      if (s->options) free(s->options);
+      free(s);
+    }
+    Py_XDECREF(obj);
   }
   Py_XDECREF(v);
   Py_XDECREF(writable);
-
+  Py_XDECREF(key);
+  PyGILState_Release(gstate);
   return retval;
 }
 
 
+/*
+  Returns the plugin object of `sp` to the pool of idle plugin objects.
+  The reset() method of the plugin object is called, if it exists.
+
+  Returns zero if the plugin object was returned to the pool and
+  non-zero if it should be closed.
+*/
+static int pool_release(DLitePythonStorage *sp, const char *classname)
+{
+  PluginData *pd = (PluginData *)sp->api->data;
+  PyObject *key=NULL, *idle, *v=NULL;
+  int retval=1;
+
+  if (!pd->pool) return 1;
+
+  if (PyObject_HasAttrString(sp->obj, "reset")) {
+    v = PyObject_CallMethod(sp->obj, "reset", "");
+    if (dlite_pyembed_err_check("error calling %s.reset()", classname))
+      goto fail;
+    if (v == Py_False) goto fail;  /* reset() refused reuse */
+  }
+  if (!(key = pool_key(sp->location, sp->options))) goto fail;
+  if (!(idle = PyDict_GetItem(pd->pool, key))) {
+    if (!(idle = PyList_New(0))) goto fail;
+    if (PyDict_SetItem(pd->pool, key, idle)) {
+      Py_DECREF(idle);
+      goto fail;
+    }
+    Py_DECREF(idle);  /* borrowed reference owned by the pool */
+  }
+  if (PyList_Size(idle) >= pool_size()) goto fail;
+  if (PyList_Append(idle, sp->obj)) goto fail;
+  retval = 0;
+ fail:
+  PyErr_Clear();
+  Py_XDECREF(v);
+  Py_XDECREF(key);
+  return retval;
+}
+
 /*
   Closes storage `s`.  Returns non-zero on error.
+
+  The plugin objects of reusable plugins are returned to a pool
+  instead of being closed.
  */
 int closer(DLiteStorage *s)
 {
   int retval=0;
   DLitePythonStorage *sp = (DLitePythonStorage *)s;
   PyObject *v = NULL;
-  PyObject *class = (PyObject *)s->api->data;
   const char *classname;
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
 
   dlite_errclr();
-  if (!(classname = dlite_pyembed_classname(class)))
-    dlite_warnx("cannot get class name for storage plugin %s",
-		*((char **)s->api));
+  classname = plugin_classname(s->api);
+  if (pool_release(sp, classname) == 0) {
+    Py_DECREF(sp->obj);
+    PyGILState_Release(gstate);
+    return 0;
+  }
   v = PyObject_CallMethod(sp->obj, "close", "");
   if (dlite_pyembed_err_check("error calling %s.close()", classname))
     retval = 1;
   Py_XDECREF(v);
   //Py_XDECREF(v);  // why do we have to call this twice?
   Py_DECREF(sp->obj);
+  PyGILState_Release(gstate);
+  return retval;
+}
+
+
+/*
+  Returns the dimension sizes of `meta` given by `pydims`, which may
+  be either a sequence of sizes or a dict mapping dimension names to
+  sizes.  Returns a malloc'ed array or NULL on error.
+ */
+static size_t *layout_dims(const DLiteMeta *meta, PyObject *pydims,
+                           const char *classname)
+{
+  PyObject *seq=NULL;
+  size_t i, *dims;
+  if (!(dims = calloc(meta->_ndimensions + 1, sizeof(size_t))))
+    return dlite_err(1, "allocation failure"), NULL;
+  if (!PyDict_Check(pydims) &&
+      (!(seq = PySequence_Fast(pydims, "")) ||
+       (size_t)PySequence_Fast_GET_SIZE(seq) != meta->_ndimensions)) {
+    PyErr_Clear();
+    FAIL3("%s.load_layout() must return %d dimensions for %s",
+          classname, (int)meta->_ndimensions, meta->uri);
+  }
+  for (i=0; i<meta->_ndimensions; i++) {
+    const char *name = meta->_dimensions[i].name;
+    PyObject *item = (seq) ? PySequence_Fast_GET_ITEM(seq, i) :
+      PyDict_GetItemString(pydims, name);
+    if (!item)
+      FAIL2("%s.load_layout() returned no size of dimension '%s'",
+            classname, name);
+    dims[i] = PyLong_AsSize_t(item);
+    if (PyErr_Occurred()) {
+      dlite_pyembed_err(1, "invalid size of dimension '%s' returned by "
+                        "%s.load_layout()", name, classname);
+      goto fail;
+    }
+  }
+  Py_XDECREF(seq);
+  return dims;
+ fail:
+  Py_XDECREF(seq);
+  free(dims);
+  return NULL;
+}
+
+/*
+  Returns a new instance from `id` in storage `s`, which is loaded with
+  the load_layout() and load_into() methods.  NULL is returned on error.
+
+  load_layout() returns the metadata and dimensions of the instance,
+  which is created and passed as a view to load_into(), which fills its
+  property arrays in place.
+ */
+static DLiteInstance *load_view(DLitePythonStorage *sp, const char *id,
+                                const char *classname)
+{
+  PyObject *layout=NULL, *view=NULL, *v=NULL, *pyid;
+  DLiteMeta *meta=NULL;
+  DLiteInstance *inst=NULL, *retval=NULL;
+  const char *metaid, *instid=id;
+  size_t *dims=NULL;
+  Py_ssize_t n;
+
+  layout = PyObject_CallMethod(sp->obj, "load_layout", "z", id);
+  if (dlite_pyembed_err_check("error calling %s.load_layout()", classname))
+    goto fail;
+  if (!PyTuple_Check(layout) || (n = PyTuple_Size(layout)) < 2 || n > 3)
+    FAIL1("%s.load_layout() must return a (meta, dims) or "
+          "(meta, dims, id) tuple", classname);
+  if (!(metaid = PyUnicode_AsUTF8(PyTuple_GET_ITEM(layout, 0)))) {
+    dlite_pyembed_err(1, "metadata returned by %s.load_layout() must be "
+                      "a string", classname);
+    goto fail;
+  }
+  if (n == 3 && (pyid = PyTuple_GET_ITEM(layout, 2)) != Py_None &&
+      !(instid = PyUnicode_AsUTF8(pyid))) {
+    dlite_pyembed_err(1, "id returned by %s.load_layout() must be a string",
+                      classname);
+    goto fail;
+  }
+  if (!(meta = dlite_meta_get(metaid))) goto fail;
+  if (!(dims = layout_dims(meta, PyTuple_GET_ITEM(layout, 1), classname)))
+    goto fail;
+  if (!(inst = dlite_instance_create(meta, dims, instid))) goto fail;
+
+  if (!(view = dlite_pyembed_instance_view(inst, 1))) goto fail;
+  v = PyObject_CallMethod(sp->obj, "load_into", "O", view);
+  if (dlite_pyembed_err_check("error calling %s.load_into()", classname))
+    goto fail;
+  retval = inst;
+ fail:
+  dlite_pyembed_instance_view_release(view);
+  if (!retval && inst) dlite_instance_decref(inst);
+  if (meta) dlite_meta_decref(meta);
+  if (dims) free(dims);
+  Py_XDECREF(layout);
+  Py_XDECREF(v);
   return retval;
 }
 
@@ -110,17 +337,21 @@ int closer(DLiteStorage *s)
 DLiteInstance *loader(const DLiteStorage *s, const char *id)
 {
   DLitePythonStorage *sp = (DLitePythonStorage *)s;
+  PluginData *pd = (PluginData *)s->api->data;
   PyObject *pyuuid;
   DLiteInstance *inst = NULL;
-  PyObject *class = (PyObject *)s->api->data;
   const char *classname;
-
-  pyuuid = PyUnicode_FromString(id);
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
 
   dlite_errclr();
-  if (!(classname = dlite_pyembed_classname(class)))
-    dlite_warnx("cannot get class name for storage plugin %s",
-		*((char **)s->api));
+  classname = plugin_classname(s->api);
+  if (pd->load_into) {
+    inst = load_view(sp, id, classname);
+    PyGILState_Release(gstate);
+    return inst;
+  }
+
+  pyuuid = PyUnicode_FromString(id);
   PyObject *v = PyObject_CallMethod(sp->obj, "load", "O", pyuuid);
   if (dlite_pyembed_err_check("error calling %s.load()", classname))
     goto fail;
@@ -129,32 +360,80 @@ DLiteInstance *loader(const DLiteStorage *s, const char *id)
  fail:
   Py_XDECREF(pyuuid);
   Py_XDECREF(v);
+  PyGILState_Release(gstate);
   return inst;
 }
 
 
 /*
   Stores instance `inst` to storage `s`.  Returns non-zero on error.
+
+  If the plugin has a save_view() method, it is called with a read-only
+  view of `inst` instead of calling save() with a dlite.Instance.
 */
 int saver(DLiteStorage *s, const DLiteInstance *inst)
 {
   DLitePythonStorage *sp = (DLitePythonStorage *)s;
-  PyObject *pyinst = dlite_pyembed_from_instance(inst->uuid);
+  PluginData *pd = (PluginData *)s->api->data;
+  PyObject *pyinst = NULL;
+  PyObject *v = NULL;
+  int retval = 1;
+  const char *classname;
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
+  dlite_errclr();
+  classname = plugin_classname(s->api);
+  if (pd->save_view) {
+    if (!(pyinst = dlite_pyembed_instance_view(inst, 0))) goto fail;
+    v = PyObject_CallMethod(sp->obj, "save_view", "O", pyinst);
+    if (dlite_pyembed_err_check("error calling %s.save_view()", classname))
+      goto fail;
+  } else {
+    if (!(pyinst = dlite_pyembed_wrap_instance(inst))) goto fail;
+    v = PyObject_CallMethod(sp->obj, "save", "O", pyinst);
+    if (dlite_pyembed_err_check("error calling %s.save()", classname))
+      goto fail;
+  }
+  retval = 0;
+ fail:
+  if (pd->save_view)
+    dlite_pyembed_instance_view_release(pyinst);
+  else
+    Py_XDECREF(pyinst);
+  Py_XDECREF(v);
+  PyGILState_Release(gstate);
+  return retval;
+}
+
+
+/*
+  Stores the `n` instances in `insts` to storage `s` with a single call
+  to the save_many() method of the plugin.  Returns non-zero on error.
+*/
+int savemany(DLiteStorage *s, const DLiteInstance **insts, size_t n)
+{
+  DLitePythonStorage *sp = (DLitePythonStorage *)s;
+  PyObject *lst = NULL;
   PyObject *v = NULL;
   int retval = 1;
-  PyObject *class = (PyObject *)s->api->data;
+  size_t i;
   const char *classname;
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
   dlite_errclr();
-  if (!(classname = dlite_pyembed_classname(class)))
-    dlite_warnx("cannot get class name for storage plugin %s",
-		*((char **)s->api));
-  v = PyObject_CallMethod(sp->obj, "save", "O", pyinst);
-  if (dlite_pyembed_err_check("error calling %s.save()", classname)) goto fail;
+  classname = plugin_classname(s->api);
+  if (!(lst = PyList_New(n))) FAIL("cannot create list of instances");
+  for (i=0; i<n; i++) {
+    PyObject *pyinst = dlite_pyembed_wrap_instance(insts[i]);
+    if (!pyinst) goto fail;
+    PyList_SET_ITEM(lst, i, pyinst);  /* steals reference */
+  }
+  v = PyObject_CallMethod(sp->obj, "save_many", "O", lst);
+  if (dlite_pyembed_err_check("error calling %s.save_many()", classname))
+    goto fail;
   retval = 0;
  fail:
-  Py_XDECREF(pyinst);
-  //Py_XDECREF(pyinst);  // why do we have to call this twice?
+  Py_XDECREF(lst);
   Py_XDECREF(v);
+  PyGILState_Release(gstate);
   return retval;
 }
 
@@ -165,9 +444,32 @@ int saver(DLiteStorage *s, const DLiteInstance *inst)
 static void freeapi(PluginAPI *api)
 {
   DLiteStoragePlugin *a = (DLiteStoragePlugin *)api;
+  PluginData *pd = (PluginData *)a->data;
 
   free((char *)a->name);
-  Py_XDECREF(a->data);
+
+  /* Close idle plugin objects.  Do not call Python if we are in an
+     atexit handler. */
+  if (pd && !dlite_globals_in_atexit()) {
+    PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
+    if (pd->pool) {
+      PyObject *idle;
+      Py_ssize_t pos=0, i;
+      while (PyDict_Next(pd->pool, &pos, NULL, &idle)) {
+        for (i=0; i<PyList_Size(idle); i++) {
+          PyObject *v = PyObject_CallMethod(PyList_GetItem(idle, i),
+                                            "close", "");
+          dlite_pyembed_err_check("error closing idle storage plugin %s",
+                                  a->name);
+          Py_XDECREF(v);
+        }
+      }
+      Py_DECREF(pd->pool);
+    }
+    Py_XDECREF(pd->plugin);
+    PyGILState_Release(gstate);
+  }
+  free(pd);
   free(a);
 }
 
@@ -185,7 +487,9 @@ typedef struct {
 void iterFree(void *iter)
 {
   Iter *i = (Iter *)iter;
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
   Py_XDECREF(i->v);
+  PyGILState_Release(gstate);
   //if (i->pattern) free((char *)i->pattern);
   free(i);
 }
@@ -199,13 +503,11 @@ void *iterCreate(const DLiteStorage *s, const char *pattern)
   DLitePythonStorage *sp = (DLitePythonStorage *)s;
   void *retval=NULL;
   Iter *iter = NULL;
-  PyObject *class = (PyObject *)s->api->data;
   PyObject *patt = NULL;
   const char *classname;
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
   dlite_errclr();
-  if (!(classname = dlite_pyembed_classname(class)))
-    dlite_warnx("cannot get class name for storage plugin %s",
-		*((char **)s->api));
+  classname = plugin_classname(s->api);
 
   if (!(iter = calloc(1, sizeof(Iter)))) FAIL("allocation failure");
 
@@ -224,6 +526,7 @@ void *iterCreate(const DLiteStorage *s, const char *pattern)
   retval = (void *)iter;
  fail:
   if (!retval && iter) iterFree(iter);
+  PyGILState_Release(gstate);
   return retval;
 }
 
@@ -239,6 +542,7 @@ int iterNext(void *iter, char *buf)
   const char *uuid;
   int retval = -1;
   Iter *i = (Iter *)iter;
+  PyGILState_STATE gstate = dlite_pyembed_gil_ensure();
   PyObject *next = PyIter_Next((PyObject *)i->v);
   if (dlite_pyembed_err_check("error iteratine over %s.queue()",
                               i->classname)) goto fail;
@@ -254,82 +558,124 @@ int iterNext(void *iter, char *buf)
   }
  fail:
   Py_XDECREF(next);
+  PyGILState_Release(gstate);
+  return retval;
+}
+
+
+/*
+  Returns non-zero if the storage plugin described by `plugin` has
+  method `method`.  Returns -1 if `method` is an attribute that is not
+  callable.
+*/
+static int has_method(PyObject *plugin, const char *method)
+{
+  PyObject *cls = PyList_GetItem(plugin, 2);
+  PyObject *methods = PyList_GetItem(plugin, 1);
+  int retval = 0;
+
+  if (cls != Py_None) {
+    if (PyObject_HasAttrString(cls, method)) {
+      PyObject *attr = PyObject_GetAttrString(cls, method);
+      retval = (attr && PyCallable_Check(attr)) ? 1 : -1;
+      Py_XDECREF(attr);
+    }
+  } else {
+    PyObject *name = PyUnicode_FromString(method);
+    if (name) retval = PySequence_Contains(methods, name);
+    Py_XDECREF(name);
+    if (retval < 0) {
+      PyErr_Clear();
+      retval = 0;
+    }
+  }
   return retval;
 }
 
 
 /*
   Returns API provided by storage plugin `name` implemented in Python.
+
+  The Python module implementing the plugin is not imported before a
+  storage is opened with it.
 */
 DSL_EXPORT const DLiteStoragePlugin *
 get_dlite_storage_plugin_api(void *state, int *iter)
 {
-  int n;
+  int n, open, close, queue, load, save, save_many, save_view, load_layout,
+    load_into;
   DLiteStoragePlugin *api=NULL, *retval=NULL;
-  PyObject *storages=NULL, *cls=NULL, *name=NULL;
-  PyObject *open=NULL, *close=NULL, *queue=NULL, *load=NULL, *save=NULL;
+  PluginData *pd=NULL;
+  PyObject *storages=NULL, *plugin=NULL, *name=NULL;
   const char *classname=NULL;
+  PyGILState_STATE gstate;
 
   dlite_globals_set(state);
+  gstate = dlite_pyembed_gil_ensure();
 
   if (!(storages = dlite_python_storage_load())) goto fail;
   assert(PyList_Check(storages));
   n = (int)PyList_Size(storages);
 
-  /* get class implementing the plugin API */
+  /* get description of the plugin */
   dlite_errclr();
   if (*iter < 0 || *iter >= n)
     FAIL1("API iterator index is out of range: %d", *iter);
-  cls = PyList_GetItem(storages, *iter);
-  assert(cls);
+  plugin = PyList_GetItem(storages, *iter);
+  assert(plugin);
   if (*iter < n - 1) (*iter)++;
 
   /* get classname for error messages */
-  if (!(classname = dlite_pyembed_classname(cls)))
-    dlite_warnx("cannot get class name for storage plugin");
+  if (!(classname = PyUnicode_AsUTF8(PyList_GetItem(plugin, 4))))
+    FAIL("cannot get class name for storage plugin");
 
   /* get attributes to fill into the api */
-  if (PyObject_HasAttrString(cls, "name"))
-    name = PyObject_GetAttrString(cls, "name");
-  else
-    name = PyUnicode_FromString(classname);
+  name = PyList_GetItem(plugin, 0);
   if (!PyUnicode_Check(name))
     FAIL1("attribute 'name' (or '__name__') of '%s' is not a string",
-          (char *)PyUnicode_AsUTF8(name));
+          classname);
 
-  if (!(open = PyObject_GetAttrString(cls, "open")))
+  if (!(open = has_method(plugin, "open")))
     FAIL1("'%s' has no method: 'open'", classname);
-  if (!PyCallable_Check(open))
+  if (open < 0)
     FAIL1("attribute 'open' of '%s' is not callable", classname);
 
-  if (!(close = PyObject_GetAttrString(cls, "close")))
+  if (!(close = has_method(plugin, "close")))
     FAIL1("'%s' has no method: 'close'", classname);
-  if (!PyCallable_Check(close))
+  if (close < 0)
     FAIL1("attribute 'close' of '%s' is not callable", classname);
 
-  if (PyObject_HasAttrString(cls, "queue")) {
-    queue = PyObject_GetAttrString(cls, "queue");
-    if (!PyCallable_Check(queue))
-      FAIL1("attribute 'queue' of '%s' is not callable", classname);
-  }
+  if ((queue = has_method(plugin, "queue")) < 0)
+    FAIL1("attribute 'queue' of '%s' is not callable", classname);
 
-  if (PyObject_HasAttrString(cls, "load")) {
-    load = PyObject_GetAttrString(cls, "load");
-    if (!PyCallable_Check(load))
-      FAIL1("attribute 'load' of '%s' is not callable", classname);
-  }
+  if ((load = has_method(plugin, "load")) < 0)
+    FAIL1("attribute 'load' of '%s' is not callable", classname);
 
-  if (PyObject_HasAttrString(cls, "save")) {
-    save = PyObject_GetAttrString(cls, "save");
-    if (!PyCallable_Check(save))
-      FAIL1("attribute 'save' of '%s' is not callable", classname);
-  }
+  if ((save = has_method(plugin, "save")) < 0)
+    FAIL1("attribute 'save' of '%s' is not callable", classname);
 
-  if (!load && !save)
+  if ((save_many = has_method(plugin, "save_many")) < 0)
+    FAIL1("attribute 'save_many' of '%s' is not callable", classname);
+
+  if ((save_view = has_method(plugin, "save_view")) < 0)
+    FAIL1("attribute 'save_view' of '%s' is not callable", classname);
+
+  if ((load_layout = has_method(plugin, "load_layout")) < 0)
+    FAIL1("attribute 'load_layout' of '%s' is not callable", classname);
+
+  if ((load_into = has_method(plugin, "load_into")) < 0)
+    FAIL1("attribute 'load_into' of '%s' is not callable", classname);
+
+  if (load_into != load_layout)
+    FAIL1("methods 'load_layout()' and 'load_into()' must be defined "
+          "together in '%s'", classname);
+
+  if (!load && !save && !save_view && !load_into)
     FAIL1("expect either method 'load()' or 'save()' to be defined in '%s'",
 	  classname);
 
-  if (!(api = calloc(1, sizeof(DLiteStoragePlugin))))
+  if (!(api = calloc(1, sizeof(DLiteStoragePlugin))) ||
+      !(pd = calloc(1, sizeof(PluginData))))
     FAIL("allocation failure");
 
   api->name = strdup(PyUnicode_AsUTF8(name));
@@ -343,17 +689,19 @@ get_dlite_storage_plugin_api(void *state, int *iter)
   }
   api->loadInstance = loader;
   api->saveInstance = saver;
-  api->data = (void *)cls;
-  Py_INCREF(cls);
+  if (save_many) api->saveInstances = savemany;
+  pd->plugin = plugin;
+  pd->save_view = save_view;
+  pd->load_into = load_into;
+  Py_INCREF(plugin);
+  api->data = (void *)pd;
 
   retval = api;
  fail:
-  if (!retval && api) free(api);
-  Py_XDECREF(name);
-  Py_XDECREF(open);
-  Py_XDECREF(close);
-  Py_XDECREF(load);
-  Py_XDECREF(save);
-
+  if (!retval) {
+    if (api) free(api);
+    if (pd) free(pd);
+  }
+  PyGILState_Release(gstate);
   return retval;
 }
@@ -57,7 +57,6 @@ class csv(DLiteStorageBase):  # noqa: F821
         pdopts = optstring2keywords(self.options.get('pandas_opts', ''))
         metaid = self.options.meta if 'meta' in self.options else None
         data = reader(self.uri, **pdopts)
-        rows, columns = data.shape
 
         if 'infer' not in self.options or dlite.asbool(self.options.infer):
             Meta = infer_meta(data, metaid, self.uri)
@@ -67,11 +66,11 @@ class csv(DLiteStorageBase):  # noqa: F821
             raise ValueError(
                 'csv option `meta` must be provided if `infer` if false')
 
-        inst = Meta(dims=(rows, ), id=self.options.get('id'))
-        for i, name in enumerate(inst.properties):
-            inst[i] = data.iloc[:, i]
-
-        return inst
+        # Columns are mapped to properties by position
+        columns = {p.name: data.iloc[:, i].to_numpy()
+                   for i, p in enumerate(Meta['properties'])}
+        return dlite.Instance.from_table(Meta, columns,
+                                         id=self.options.get('id'))
 
     def save(self, inst):
         """Stores `inst` in current storage."""
@@ -1,7 +1,7 @@
+import io
 import os
 import sys
 import warnings
-import fnmatch
 
 import psycopg2
 from psycopg2 import sql
@@ -29,6 +29,30 @@ pgtypes = {
     'relation': 'varchar[3]',
 }
 
+def copy_text(value, quote=False):
+    """Returns `value` formatted as a field in the text format of
+    PostgreSQL COPY.  If `quote` is true, `value` is formatted as an
+    element of an array literal."""
+    if value is None:
+        return 'NULL' if quote else r'\N'
+    if hasattr(value, 'tolist'):
+        value = value.tolist()
+    if isinstance(value, (list, tuple)):
+        s = '{%s}' % ','.join(copy_text(v, quote=True) for v in value)
+    elif isinstance(value, bool):
+        s = 't' if value else 'f'
+    elif isinstance(value, (bytes, bytearray)):
+        s = r'\x' + bytes(value).hex()
+    else:
+        s = str(value)
+    if quote and not isinstance(value, (list, tuple, bool, int, float)):
+        s = '"%s"' % s.replace('\\', '\\\\').replace('"', '\\"')
+    if not quote:
+        s = (s.replace('\\', '\\\\').replace('\t', '\\t')
+             .replace('\n', '\\n').replace('\r', '\\r'))
+    return s
+
+
 def to_pgtype(typename):
     """Returns PostGreSQL type corresponding to dlite typename."""
     if typename in pgtypes:
@@ -40,6 +64,10 @@ def to_pgtype(typename):
 
 class postgresql(DLiteStorageBase):
     """DLite storage plugin for PostgreSQL."""
+
+    # Keep connections open between storages
+    reusable = True
+
     def open(self, uri, options=None):
         """Opens `uri`.
 
@@ -59,12 +87,15 @@ class postgresql(DLiteStorageBase):
             Valid values are:
             - append   Append to existing file or create new file (default)
             - r        Open existing file for read-only
+        - itersize : Number of rows fetched per round-trip when iterating
+            (default: 1000)
 
         After the options are passed, this method may set attribute
         `writable` to true if it is writable and to false otherwise.
         If `writable` is not set, it is assumed to be true.
         """
-        self.options = Options(options, defaults='database=dlite;mode=append')
+        self.options = Options(
+            options, defaults='database=dlite;mode=append;itersize=1000')
         opts = self.options
         opts.setdefault('password', None)
         self.writable = False if opts.mode == 'r' else True
@@ -85,6 +116,15 @@ class postgresql(DLiteStorageBase):
         self.cur.close()
         self.conn.close()
 
+    def reset(self):
+        """Ends the current transaction, such that the connection can be
+        reused by another storage.  Returns false if the connection is
+        lost."""
+        if self.conn.closed:
+            return False
+        self.conn.rollback()
+        return True
+
     def load(self, uuid):
         """Loads `uuid` from current storage and return it as a new instance."""
         uuid = dlite.get_uuid(uuid)
@@ -145,6 +185,62 @@ class postgresql(DLiteStorageBase):
         self.cur.execute(q, [inst.uuid, inst.meta.uri])
         self.conn.commit()
 
+    def save_many(self, instances):
+        """Stores all `instances` in current storage.
+
+        Instances of the same metadata are streamed to the database
+        with a single COPY statement.  Like save(), instances that
+        already are in the database are left untouched."""
+        groups = {}
+        for inst in instances:
+            if inst.is_meta:
+                self.save(inst)
+            else:
+                groups.setdefault(inst.meta.uri, []).append(inst)
+        if not groups:
+            return
+        if not self.table_exists('uuidtable'):
+            self.uuidtable_create()
+        for insts in groups.values():
+            self.copy_instances(insts)
+        self.conn.commit()
+
+    def copy_instances(self, instances):
+        """Copies `instances`, which must all be of the same metadata,
+        to the database within the current transaction."""
+        meta = instances[0].meta
+        if not self.table_exists(meta.uri):
+            self.table_create(meta, instances[0].dimensions.values())
+        colnames = ['uuid', 'uri', 'meta', 'dims'] + [
+            p.name for p in meta['properties']]
+        buf = io.StringIO()
+        for inst in instances:
+            values = [inst.uuid,
+                      inst.uri,
+                      meta.uri,
+                      list(inst.dimensions.values()),
+            ] + [dlite.standardise(v, asdict=False)
+                 for v in inst.properties.values()]
+            buf.write('\t'.join(copy_text(v) for v in values))
+            buf.write('\n')
+        buf.seek(0)
+
+        # Copy to a temporary table first, such that instances already
+        # in the database can be skipped
+        tmp = sql.Identifier('dlite_copy')
+        table = sql.Identifier(meta.uri)
+        self.cur.execute(sql.SQL(
+            'CREATE TEMPORARY TABLE {0} (LIKE {1});').format(tmp, table))
+        self.cur.copy_expert(sql.SQL('COPY {0} ({1}) FROM STDIN;').format(
+            tmp, sql.SQL(', ').join(map(sql.Identifier, colnames))), buf)
+        self.cur.execute(sql.SQL(
+            'WITH ins AS ('
+            'INSERT INTO {1} SELECT * FROM {0} '
+            'ON CONFLICT (uuid) DO NOTHING RETURNING uuid, meta) '
+            'INSERT INTO uuidtable (uuid, meta) SELECT uuid, meta FROM ins '
+            'ON CONFLICT (uuid) DO NOTHING;').format(tmp, table))
+        self.cur.execute(sql.SQL('DROP TABLE {};').format(tmp))
+
     def table_exists(self, table_name):
         """Returns true if a table named `table_name` exists."""
         self.cur.execute(
@@ -188,17 +284,25 @@ class postgresql(DLiteStorageBase):
     def queue(self, pattern):
         """Generator method that iterates over all UUIDs in the storage
         who's metadata URI matches glob pattern `pattern`."""
-        if pattern:
-            # Convert glob patter to PostgreSQL regular expression
-            regex = '^{}'.format(fnmatch.translate(globex).replace(
-                '\\Z(?ms)', '$'))
-            q = sql.SQL('SELECT uuid from uuidtable WHERE uuid ~ %s;')
-            self.cur.execute(q, (regex, ))
-        else:
-            q = sql.SQL('SELECT uuid from uuidtable;')
-            self.cur.execute(q)
-        tokens = self.cur.fetchone()
-        while tokens:
-            uuid, = tokens
-            yield uuid
-            tokens = self.cur.fetchone()
+        # Use a named (server-side) cursor, such that the result is
+        # fetched in chunks of `itersize` rows
+        itersize = int(self.options.itersize)
+        cur = self.conn.cursor(name='dlite_queue_%x' % id(self))
+        try:
+            if pattern:
+                # Convert glob pattern to a LIKE pattern
+                like = (pattern.replace('\\', '\\\\')
+                        .replace('%', '\\%').replace('_', '\\_')
+                        .replace('*', '%').replace('?', '_'))
+                q = sql.SQL('SELECT uuid from uuidtable WHERE meta LIKE %s;')
+                cur.execute(q, (like, ))
+            else:
+                q = sql.SQL('SELECT uuid from uuidtable;')
+                cur.execute(q)
+            rows = cur.fetchmany(itersize)
+            while rows:
+                for uuid, in rows:
+                    yield uuid.strip()
+                rows = cur.fetchmany(itersize)
+        finally:
+            cur.close()
@@ -15,6 +15,7 @@
 #include "utils/strutils.h"
 #include "utils/globmatch.h"
 #include "utils/err.h"
+#include "utils/map.h"
 
 #include "triplestore.h"
 #include "dlite.h"
@@ -44,6 +45,19 @@ typedef enum {
 } FmtFlags;
 
 
+/** Predicate and object of a triple in the subject index. */
+typedef struct {
+  char *p;          /*!< Predicate. */
+  char *o;          /*!< Object. */
+} PredObj;
+
+/** All triples with a given subject in the subject index. */
+typedef struct {
+  PredObj *po;      /*!< Array of predicate-object pairs. */
+  size_t n;         /*!< Number of pairs. */
+  size_t size;      /*!< Allocated size of `po`. */
+} Subject;
+
 /** Storage for librdf backend. */
 typedef struct {
   DLiteStorage_HEAD
@@ -55,6 +69,8 @@ typedef struct {
   char *mime_type;  /*!< Mime time of optional input/output file. */
   char *type_uri;   /*!< Type uri of optional input/output file. */
   FmtFlags flags;   /*!< Formatting flags. */
+  map_void_t subjects; /*!< Subject index, maps subjects to Subject. */
+  int indexed;      /*!< Whether the subject index is up to date. */
 } RdfStorage;
 
 /** Data model for librdf backend. */
@@ -169,6 +185,7 @@ DLiteStorage *rdf_open(const DLiteStoragePlugin *api, const char *uri,
   UNUSED(api);
 
   if (!(s = calloc(1, sizeof(RdfStorage)))) FAIL("allocation failure");
+  map_init(&s->subjects);
 
   /* parse options */
   if (dlite_option_parse(optcopy, opts, 1)) goto fail;
@@ -214,12 +231,82 @@ DLiteStorage *rdf_open(const DLiteStoragePlugin *api, const char *uri,
   if (optcopy) free(optcopy);
   if (!retval && s) {
     if (s->ts) triplestore_free(s->ts);
+    map_deinit(&s->subjects);
     free(s);
   }
   return retval;
 }
 
 
+/* Clears the subject index. */
+static void index_clear(RdfStorage *rdf)
+{
+  const char *key;
+  map_iter_t iter = map_iter(&rdf->subjects);
+  while ((key = map_next(&rdf->subjects, &iter))) {
+    Subject *subj = *map_get(&rdf->subjects, key);
+    size_t i;
+    for (i=0; i < subj->n; i++) {
+      free(subj->po[i].p);
+      free(subj->po[i].o);
+    }
+    if (subj->po) free(subj->po);
+    free(subj);
+  }
+  map_deinit(&rdf->subjects);
+  map_init(&rdf->subjects);
+  rdf->indexed = 0;
+}
+
+
+/* Builds the subject index with a single sweep over all triples, unless
+   it is already up to date.  Returns non-zero on error.
+
+   Loading an instance requires a large number of lookups by subject.
+   Doing them via the index instead of separate queries to the
+   triplestore makes loading many instances from the same storage fast. */
+static int index_update(RdfStorage *rdf)
+{
+  TripleState state;
+  const Triple *t;
+  int retval=1;
+  if (rdf->indexed) return 0;
+  index_clear(rdf);
+  triplestore_init_state(rdf->ts, &state);
+  while ((t = triplestore_next(&state))) {
+    Subject *subj, **ptr;
+    if ((ptr = (Subject **)map_get(&rdf->subjects, t->s))) {
+      subj = *ptr;
+    } else {
+      if (!(subj = calloc(1, sizeof(Subject)))) FAIL("allocation failure");
+      if (map_set(&rdf->subjects, t->s, subj)) {
+        free(subj);
+        FAIL1("cannot index subject: %s", t->s);
+      }
+    }
+    if (subj->n >= subj->size) {
+      size_t size = (subj->size) ? 2*subj->size : 8;
+      PredObj *po = realloc(subj->po, size*sizeof(PredObj));
+      if (!po) FAIL("allocation failure");
+      subj->po = po;
+      subj->size = size;
+    }
+    if (!(subj->po[subj->n].p = strdup(t->p))) FAIL("allocation failure");
+    if (!(subj->po[subj->n].o = strdup(t->o))) {
+      free(subj->po[subj->n].p);
+      FAIL("allocation failure");
+    }
+    subj->n++;
+  }
+  rdf->indexed = 1;
+  retval = 0;
+ fail:
+  triplestore_deinit_state(&state);
+  if (retval) index_clear(rdf);
+  return retval;
+}
+
+
 /**
   Closes data handle json. Returns non-zero on error.
  */
@@ -264,6 +351,8 @@ int rdf_close(DLiteStorage *storage)
   }
 
   triplestore_free(s->ts);
+  index_clear(s);
+  map_deinit(&s->subjects);
   if (s->store) free(s->store);
   if (s->base_uri) free(s->base_uri);
   if (s->filename) free(s->filename);
@@ -274,6 +363,28 @@ int rdf_close(DLiteStorage *storage)
 }
 
 
+/* Returns the subject index entry for subject `s` or NULL if `s` is not
+   a subject in the storage. */
+static const Subject *get_subject(RdfStorage *rdf, const char *s)
+{
+  void **ptr = map_get(&rdf->subjects, s);
+  return (ptr) ? *ptr : NULL;
+}
+
+/* Returns the object of the next triple with subject `subj` and
+   predicate `p`, starting from position `*pos`, or NULL if there are
+   no more matches.  `subj` may be NULL.
+
+   `*pos` should be initialised to zero and is updated on return. */
+static const char *nextobj(const Subject *subj, const char *p, size_t *pos)
+{
+  if (!subj) return NULL;
+  for (; *pos < subj->n; (*pos)++) {
+    if (strcmp(subj->po[*pos].p, p) == 0) return subj->po[(*pos)++].o;
+  }
+  return NULL;
+}
+
 /* Returns pointer to object corresponding to subject `s` and predicate `p`
    or NULL on error.
 
@@ -281,103 +392,121 @@ int rdf_close(DLiteStorage *storage)
 static const char *getobj(RdfStorage *rdf, const char *s, const char *p,
                           int verbose)
 {
-  TripleStore *ts = rdf->ts;
-  const Triple *t;
-  if (!(t = triplestore_find_first(ts, s, p, NULL))) {
+  size_t pos=0;
+  const char *o;
+  if (!(o = nextobj(get_subject(rdf, s), p, &pos))) {
     if (verbose) err(1, "missing s='%s' p='%s': %s", s, p, rdf->location);
     return NULL;
   }
-  return t->o;
+  return o;
 }
 
-/* Returns number of triples matching (s, p, o) or -1 on error. */
-static int count(TripleStore *ts, const char *s, const char *p, const char *o)
+/* Returns number of triples with subject `subj` and predicate `p`. */
+static int count(const Subject *subj, const char *p)
 {
-  TripleState state;
+  size_t pos=0;
   int n=0;
-  triplestore_init_state(ts, &state);
-  while (triplestore_find(&state, s, p, o)) n++;
-  triplestore_deinit_state(&state);
+  while (nextobj(subj, p, &pos)) n++;
+  return n;
+}
+
+/* Finds a subject with predicate `p`.  If `s` is not NULL, only subject
+   `s` is considered, otherwise all subjects.  On return `subj` and
+   `obj` are assigned to the subject and object of the first match.
+   Returns the number of matches, but at most 2. */
+static int find_subject(RdfStorage *rdf, const char *s, const char *p,
+                        const Subject **subj, const char **obj)
+{
+  const Subject *sub;
+  const char *key, *o;
+  map_iter_t iter = map_iter(&rdf->subjects);
+  int n=0;
+  while (n < 2) {
+    size_t pos=0;
+    if (s) {
+      sub = get_subject(rdf, s);
+    } else {
+      if (!(key = map_next(&rdf->subjects, &iter))) break;
+      sub = *map_get(&rdf->subjects, key);
+    }
+    while (n < 2 && (o = nextobj(sub, p, &pos))) {
+      if (n++ == 0) {
+        *subj = sub;
+        *obj = o;
+      }
+    }
+    if (s) break;
+  }
   return n;
 }
 
 
 /*
   Loads instance from storage `s`.  Returns non-zero on error.
+
+  All lookups are done via the subject index, which is built on the
+  first call.
  */
 DLiteInstance *rdf_load_instance(const DLiteStorage *storage, const char *id)
 {
   RdfStorage *s = (RdfStorage *)storage;
-  TripleStore *ts = s->ts;
-  TripleState state;
-  const Triple *t=NULL, *t2;
+  const Subject *subj=NULL;
   DLiteInstance *inst=NULL;
   DLiteMeta *meta;
-  size_t i, *dims=NULL;
+  size_t i, pos, *dims=NULL;
   int ok=0, n, j;
   char uuid[DLITE_UUID_LENGTH+1], muuid[DLITE_UUID_LENGTH+1];
-  char *pid=NULL, *mid=NULL, *propiri=NULL;
+  char *pid=NULL;
+  const char *str=NULL, *obj;
 
   errno = 0;
+  if (index_update(s)) goto fail;
   dlite_get_uuid(uuid, id);
   pid = (s->base_uri) ? aprintf("%s:%s", s->base_uri, uuid) : NULL;
 
   /* find instance and metadata UUIDs */
-  triplestore_init_state(ts, &state);
-  while ((t2 = triplestore_find(&state, pid, _P ":hasMeta", NULL))) {
-    if (t) FAIL1("ID must be provided if storage holds "
-                 "more than one instance: %s", s->location);
-    t = t2;
-  }
-  triplestore_deinit_state(&state);
-  if (t) {
-    dlite_get_uuid(muuid, t->o);
+  if ((n = find_subject(s, pid, _P ":hasMeta", &subj, &str)) > 1)
+    FAIL1("ID must be provided if storage holds "
+          "more than one instance: %s", s->location);
+  if (n) {
+    dlite_get_uuid(muuid, str);
   } else {
-    triplestore_init_state(ts, &state);
-    while ((t2 = triplestore_find(&state, pid, _P ":hasURI", NULL))) {
-      if (t) FAIL1("ID must be provided if storage holds "
-                   "more than one instance: %s", s->location);
-      t = t2;
-    }
-    triplestore_deinit_state(&state);
+    if ((n = find_subject(s, pid, _P ":hasURI", &subj, &str)) > 1)
+      FAIL1("ID must be provided if storage holds "
+            "more than one instance: %s", s->location);
     dlite_get_uuid(muuid, DLITE_ENTITY_SCHEMA);
   }
-  if (!t) FAIL2("no instance with id '%s' in store: %s", id, s->location);
+  if (!n) FAIL2("no instance with id '%s' in store: %s", id, s->location);
 
   /* get/load metadata */
-  mid = (s->base_uri) ? aprintf("%s:%s", s->base_uri, muuid) : NULL;
   if (!(meta = dlite_meta_get(muuid)) &&
       !(meta = dlite_meta_load(storage, muuid)))
-    FAIL1("cannot load metadata: '%s'", t->o);
+    FAIL1("cannot load metadata: '%s'", str);
 
   /* allocate and read dimension values */
   if (meta->_ndimensions) {
     const char *name, *val;
     if (!(dims = calloc(meta->_ndimensions, sizeof(size_t))))
       FAIL("allocation failure");
-    if (triplestore_find_first(ts, pid, _P ":hasDimensionValue", NULL)) {
+    if (count(subj, _P ":hasDimensionValue")) {
       /* -- read dimension values */
       n = 0;
-      triplestore_init_state(ts, &state);
-      while ((t = triplestore_find(&state, pid, _P ":hasDimensionValue",
-                                   NULL))) {
-        char *dimval = strdup(t->o);
-        if (!(name = getobj(s, dimval, _P ":hasLabel", 1))) goto fail;
-        j = dlite_meta_get_dimension_index(meta, name);
-        if (!(val = getobj(s, dimval, _P ":hasDimensionSize", 1))) goto fail;
+      pos = 0;
+      while ((obj = nextobj(subj, _P ":hasDimensionValue", &pos))) {
+        if (!(name = getobj(s, obj, _P ":hasLabel", 1))) goto fail;
+        if ((j = dlite_meta_get_dimension_index(meta, name)) < 0) goto fail;
+        if (!(val = getobj(s, obj, _P ":hasDimensionSize", 1))) goto fail;
         dims[j] = atoi(val);
         n++;
-        free(dimval);
       }
-      triplestore_deinit_state(&state);
       if (n != (int)meta->_ndimensions)
         FAIL4("entity %s expect %d dimension values, but got %d: %s",
               id, (int)meta->_ndimensions, n, s->location);
     } else if (strcmp(meta->uri, DLITE_ENTITY_SCHEMA) == 0) {
       /* -- infer dimension values */
       assert(meta->_ndimensions == 2);
-      dims[0] = count(ts, pid, _P ":hasDimension", NULL);
-      dims[1] = count(ts, pid, _P ":hasProperty", NULL);
+      dims[0] = count(subj, _P ":hasDimension");
+      dims[1] = count(subj, _P ":hasProperty");
     } else {
       FAIL2("missing dimension values for instance '%s' in storage '%s'",
             id, s->location);
@@ -385,38 +514,34 @@ DLiteInstance *rdf_load_instance(const DLiteStorage *storage, const char *id)
   }
 
   if (!(inst = dlite_instance_create(meta, dims, (id) ? id : uuid))) goto fail;
-  if (!inst->uri && (t = triplestore_find_first(ts, pid, _P ":hasURI", NULL)))
-    inst->uri = strdup(t->o);
+  pos = 0;
+  if (!inst->uri && (obj = nextobj(subj, _P ":hasURI", &pos)))
+    inst->uri = strdup(obj);
 
   /* FIXME - should have been called by dlite_instance_create() */
   if (dlite_instance_is_meta(inst)) dlite_meta_init((DLiteMeta *)inst);
 
   n = 0;
-  while ((t = triplestore_find(&state, pid, _P ":hasPropertyValue", NULL))) {
+  pos = 0;
+  while ((obj = nextobj(subj, _P ":hasPropertyValue", &pos))) {
     /* -- read property values */
     DLiteProperty *p;
     const char *name, *val;
     size_t *pdims;
     void *ptr;
-    char *prop=strdup(t->o);
-    if (!(name = getobj(s, prop, _P ":hasLabel", 1))) goto fail;
-    j = dlite_meta_get_property_index(meta, name);
-    if (!(name = getobj(s, prop, _P ":hasLabel", 1))) goto fail;
+    if (!(name = getobj(s, obj, _P ":hasLabel", 1))) goto fail;
     if ((j = dlite_meta_get_property_index(meta, name)) < 0) goto fail;
-    if (!(val = getobj(s, prop, _P ":hasValue", 1))) goto fail;
+    if (!(val = getobj(s, obj, _P ":hasValue", 1))) goto fail;
     p = meta->_properties + j;
     pdims = DLITE_PROP_DIMS(inst, j);
     ptr = dlite_instance_get_property_by_index(inst, j);
     if (dlite_property_scan(val, ptr, p, pdims, dliteFlagRaw) < 0) goto fail;
     n++;
-    free(prop);
   }
-  triplestore_deinit_state(&state);
 
   /* Metadata is normally stored with dedicated relations according to the
      datamodel ontology. */
   if (n == 0 && strcmp(meta->uri, DLITE_ENTITY_SCHEMA) == 0) {
-    const char *str;
     char **namep, **verp, **nsp, **descrp;
     DLiteDimension *d;
     DLiteProperty *p;
@@ -428,50 +553,45 @@ DLiteInstance *rdf_load_instance(const DLiteStorage *storage, const char *id)
     if (!(namep && verp && nsp))
       fatal(1, "%s should have name, version and namespace properties",
             DLITE_ENTITY_SCHEMA);
-    if (!(str = getobj(s, pid, _P ":hasURI", 1))) goto fail;
+    pos = 0;
+    if (!(str = nextobj(subj, _P ":hasURI", &pos)))
+      FAIL2("missing uri for metadata '%s': %s", id, s->location);
     dlite_split_meta_uri(str, namep, verp, nsp);
 
     descrp = dlite_instance_get_property(inst, "description");
-    if ((str = getobj(s, pid, _P ":hasDescription", 0)))
+    pos = 0;
+    if ((str = nextobj(subj, _P ":hasDescription", &pos)))
       *descrp = strdup(str);
 
     /* -- read dimensions */
     d = dlite_instance_get_property(inst, "dimensions");
-    triplestore_init_state(ts, &state);
-    while ((t = triplestore_find(&state, pid, _P ":hasDimension", NULL))) {
-      propiri = strdup(t->o);
-      if (!(str = getobj(s, propiri, _P ":hasLabel", 1))) goto fail;
+    pos = 0;
+    while ((obj = nextobj(subj, _P ":hasDimension", &pos))) {
+      if (!(str = getobj(s, obj, _P ":hasLabel", 1))) goto fail;
       d->name = strdup(str);
-      if ((str = getobj(s, propiri, _P ":hasDescription", 0)))
+      if ((str = getobj(s, obj, _P ":hasDescription", 0)))
         d->description = strdup(str);
       d++;
-      free(propiri);
-      propiri = NULL;
     }
-    triplestore_deinit_state(&state);
-
 
     /* -- read properties */
     p = dlite_instance_get_property(inst, "properties");
-    triplestore_init_state(ts, &state);
-    while ((t = triplestore_find(&state, pid, _P ":hasProperty", NULL))) {
+    pos = 0;
+    while ((obj = nextobj(subj, _P ":hasProperty", &pos))) {
       const char *name, *typename, *shape, *unit, *descr;
 
-      /* save propiri so it is not overwritten by getobj() */
-      propiri = strdup(t->o);
-
-      if (!(name = getobj(s, propiri, _P ":hasLabel", 1))) goto fail;
+      if (!(name = getobj(s, obj, _P ":hasLabel", 1))) goto fail;
       p->name = strdup(name);
-      if (!(typename = getobj(s, propiri, _P ":hasType", 1))) goto fail;
+      if (!(typename = getobj(s, obj, _P ":hasType", 1))) goto fail;
       if (dlite_type_set_dtype_and_size(typename, &p->type, &p->size))
         goto fail;
-      if ((unit = getobj(s, propiri, _P ":hasUnit", 0)))
+      if ((unit = getobj(s, obj, _P ":hasUnit", 0)))
         p->unit = strdup(unit);
-      if ((descr = getobj(s, propiri, _P ":hasDescription", 0)))
+      if ((descr = getobj(s, obj, _P ":hasDescription", 0)))
         p->description = strdup(descr);
 
       /* count and allocate property dimensions */
-      shape = getobj(s, propiri, _P ":hasFirstShape", 0);
+      shape = getobj(s, obj, _P ":hasFirstShape", 0);
       while (shape) {
         p->ndims++;
         shape = getobj(s, shape, _P ":hasNextShape", 0);
@@ -480,22 +600,17 @@ DLiteInstance *rdf_load_instance(const DLiteStorage *storage, const char *id)
 
       /* assign property dimensions */
       i = 0;
-      shape = getobj(s, propiri, _P ":hasFirstShape", 0);
+      shape = getobj(s, obj, _P ":hasFirstShape", 0);
       while (shape) {
         const char *expr;
-        char buf[64];
-        strncpy(buf, shape, sizeof(buf));
-        if (!(expr = getobj(s, buf, _P ":hasDimensionExpression", 1)))
-          FAIL2("%s has no dimension expression: %s", t2->s, s->location);
+        if (!(expr = getobj(s, shape, _P ":hasDimensionExpression", 1)))
+          FAIL2("%s has no dimension expression: %s", shape, s->location);
         p->dims[i++] = strdup(expr);
-        shape = getobj(s, buf, _P ":hasNextShape", 0);
+        shape = getobj(s, shape, _P ":hasNextShape", 0);
       }
       p++;
       n++;
-      free(propiri);
-      propiri = NULL;
     }
-    triplestore_deinit_state(&state);
 
     /* reinitialise metadata after property dimensions have been set */
     dlite_meta_init((DLiteMeta *)inst);
@@ -507,11 +622,8 @@ DLiteInstance *rdf_load_instance(const DLiteStorage *storage, const char *id)
   ok = 1;
  fail:
   if (pid) free(pid);
-  if (mid) free(mid);
-  if (propiri) free(propiri);
   if (dims) free(dims);
   if (!ok && inst) dlite_instance_decref(inst);
-  triplestore_deinit_state(&state);
   return (ok) ? inst : NULL;
 }
 
@@ -536,15 +648,22 @@ static char *get_blank_node(TripleStore *ts, const char *id)
 
 /**
   Stores instance `inst` to `storage`.  Returns non-zero on error.
+
+  The triples are added within a single transaction if the storage
+  supports transactions, which is much faster for persistent Redland
+  storages.
  */
 int rdf_save_instance(DLiteStorage *storage, const DLiteInstance *inst)
 {
   RdfStorage *s = (RdfStorage *)storage;
   TripleStore *ts = s->ts;
+  librdf_model *model = triplestore_get_model(ts);
   DLiteMeta *meta = (dlite_instance_is_meta(inst)) ? (DLiteMeta *)inst : NULL;
   size_t i, bufsize=0, buf2size=0;
   int j, retval=1;
   char *buf=NULL, *buf2=NULL, *b1, *b2;
+  int transaction = !librdf_model_transaction_start(model);
+  s->indexed = 0;
   triplestore_add_uri(ts, inst->uuid, "rdf:type", "owl:NamedIndividual");
   if (meta)
     triplestore_add_uri(ts, inst->uuid, "rdf:type", _P ":Entity");
@@ -645,8 +764,14 @@ int rdf_save_instance(DLiteStorage *storage, const DLiteInstance *inst)
     }
   }
 
+  if (transaction) {
+    transaction = 0;
+    if (librdf_model_transaction_commit(model))
+      FAIL1("error committing instance '%s' to rdf storage", inst->uuid);
+  }
   retval = 0;
  fail:
+  if (transaction) librdf_model_transaction_rollback(model);
   if (buf) free(buf);
   if (buf2) free(buf2);
   return retval;
@@ -725,6 +850,8 @@ static DLiteStoragePlugin rdf_plugin = {
   /* direct api */
   rdf_load_instance,                    /* loadInstance */
   rdf_save_instance,                    /* saveInstance */
+  NULL,                                 /* loadInstances */
+  NULL,                                 /* saveInstances */
 
   /* datamodel api */
   NULL,                                 /* dataModel */
@@ -742,12 +869,38 @@ static DLiteStoragePlugin rdf_plugin = {
 
   NULL,                                 /* hasDimension */
   NULL,                                 /* hasProperty */
+  NULL,                                 /* getPropertySlice */
 
   NULL,                                 /* getDataName */
   NULL,                                 /* setDataName */
 
   /* internal data */
-  NULL                                  /* data */
+  NULL,                                 /* data */
+
+  /* capabilities */
+  0,                                    /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                                 /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                                 /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                                 /* saveView */
+  NULL,                                 /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                                 /* loadInstanceAsync */
+  NULL,                                 /* saveInstanceAsync */
+  NULL,                                 /* asyncFd */
+  NULL,                                 /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                                 /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                                  /* mapProperty */
 };
 
 
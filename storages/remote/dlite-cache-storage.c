@@ -0,0 +1,429 @@
+/* dlite-cache-storage.c -- DLite storage plugin caching another
+   storage in Redis */
+
+/*
+  This plugin wraps another storage, the backend, and keeps instances
+  loaded from or saved to it in a Redis server shared by all clients.
+  It is intended for services that repeatedly load the same metadata
+  and reference instances from a slow storage, like a database.
+
+  The location is the url of the backend, like
+
+      dlite_storage_open("cache", "postgresql://db?database=mydb",
+                         "redis=cachehost:6379;ttl=600");
+
+  Instances are cached as binary records (see dlite-binrecord.h) with
+  key "<prefix><uuid>", where prefix defaults to "dlite:".
+
+  - Loads are read-through: a cache miss loads the instance from the
+    backend and adds it to the cache.  Metadata of cached instances
+    that is not available to the client is loaded through the cache
+    as well.
+  - Saves are write-through (default) or write-behind.  Write-through
+    saves to the backend and then updates the cache.  Write-behind
+    updates the cache directly and saves to the backend when the
+    storage is closed.
+
+  Each entry expires after `ttl` seconds.  An entry is invalidated by
+  saving the instance through a cache storage or by deleting its key,
+  e.g. with `redis-cli DEL dlite:<uuid>`.
+
+  If the Redis server fails, a warning is issued and the storage
+  continues without cache.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/strutils.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-binrecord.h"
+#include "redis-client.h"
+
+
+/* Storage caching a backend storage in Redis */
+typedef struct {
+  DLiteStorage_HEAD
+  DLiteStorage *backend;    /* Wrapped storage */
+  RedisClient *redis;       /* Cache, NULL if disabled */
+  char *prefix;             /* Prefix of keys */
+  int ttl;                  /* Time to live of entries in seconds */
+  int behind;               /* Whether saves are write-behind */
+  DLiteInstance **queue;    /* Instances to save at close (write-behind) */
+  size_t nqueue;            /* Number of queued instances */
+  size_t queuesize;         /* Allocated length of `queue` */
+  char *rec;                /* Buffer for encoding records */
+  size_t recsize;           /* Allocated size of `rec` */
+} CacheStorage;
+
+/* Iterator over the backend */
+typedef struct {
+  DLiteStorage *backend;
+  void *iter;
+} CacheIter;
+
+
+/* Disables the cache after an error. */
+static void disable_cache(CacheStorage *cs, const char *msg)
+{
+  warnx("cache: disabling Redis cache for '%s' after error: %s",
+        cs->location, msg);
+  redis_free(cs->redis);
+  cs->redis = NULL;
+}
+
+/* Returns a newly allocated key for `uuid`. */
+static char *make_key(const CacheStorage *cs, const char *uuid)
+{
+  char *key = aprintf("%s%s", cs->prefix, uuid);
+  if (!key) err(1, "allocation failure");
+  return key;
+}
+
+/* Adds `inst` to the cache.  Errors disable the cache. */
+static void cache_put(CacheStorage *cs, const DLiteInstance *inst)
+{
+  char *key=NULL;
+  int n;
+  if (!cs->redis) return;
+  ErrTry:
+    if ((n = dlite_binrecord_encode(&cs->rec, &cs->recsize, 0, inst)) >= 0 &&
+        (key = make_key(cs, inst->uuid)))
+      redis_set(cs->redis, key, cs->rec, n, cs->ttl);
+  ErrOther:
+    disable_cache(cs, err_getmsg());
+  ErrEnd;
+  if (key) free(key);
+}
+
+/* Returns instance `uuid` from the cache, or NULL if it is not cached.
+   Errors disable the cache. */
+static DLiteInstance *cache_get(CacheStorage *cs, const char *uuid)
+{
+  DLiteInstance *inst=NULL, *meta;
+  const DLiteBinRecord *rec;
+  const char *metauri;
+  char *key=NULL, *buf=NULL;
+  size_t len;
+  int stat=1;
+  if (!cs->redis) return NULL;
+  ErrTry:
+    if ((key = make_key(cs, uuid)) &&
+        (stat = redis_get(cs->redis, key, &buf, &len)) == 0 &&
+        dlite_binrecord_check((DLiteBinRecord *)buf, len))
+      errx(1, "corrupted record for %s", uuid);
+  ErrOther:
+    disable_cache(cs, err_getmsg());
+    stat = 1;
+  ErrEnd;
+  if (key) free(key);
+  if (stat) {
+    if (buf) free(buf);
+    return NULL;
+  }
+
+  /* Load unknown metadata through this storage */
+  ErrTry:
+    rec = (DLiteBinRecord *)buf;
+    metauri = dlite_binrecord_str(rec, rec->metauri, &stat);
+    if (!stat && metauri && !dlite_instance_has(metauri, 0) &&
+        (meta = dlite_instance_load((DLiteStorage *)cs, metauri)))
+      dlite_instance_decref(meta);
+    inst = dlite_binrecord_decode(rec, uuid, NULL, NULL);
+  ErrOther:
+    /* fall back to the backend */
+    warnx("cache: cannot decode cached instance %s: %s", uuid, err_getmsg());
+  ErrEnd;
+  free(buf);
+  return inst;
+}
+
+/* Saves queued instances to the backend.  Returns non-zero on error. */
+static int flush_queue(CacheStorage *cs)
+{
+  int stat=0;
+  size_t i;
+  for (i=0; i<cs->nqueue; i++) {
+    if (!stat && dlite_instance_save(cs->backend, cs->queue[i])) stat = 1;
+    dlite_instance_decref(cs->queue[i]);
+  }
+  cs->nqueue = 0;
+  return stat;
+}
+
+
+/**
+  Returns a new storage caching the backend storage with url `uri`.
+
+  Valid `options` are:
+
+  - mode : append | r
+      Valid values are:
+      - append   Load and save instances (default)
+      - r        Read-only
+  - redis : Address of the Redis server as "host[:port]"
+      (default "127.0.0.1:6379")
+  - ttl : Seconds before cached entries expire, zero for never
+      (default 3600)
+  - prefix : Prefix of cache keys (default "dlite:")
+  - write : through | behind
+      Valid values are:
+      - through  Save to the backend, then update the cache (default)
+      - behind   Update the cache and save to the backend when the
+                 storage is closed
+
+  Returns NULL on error.
+ */
+DLiteStorage *cache_open(const DLiteStoragePlugin *api, const char *uri,
+                         const char *options)
+{
+  CacheStorage *cs=NULL;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"append\" (load and save instances, default); "
+    "\"r\" (read-only)";
+  char *write_descr = "How to save instances.  Valid values are: "
+    "\"through\" (save to the backend, then update the cache, default); "
+    "\"behind\" (update the cache and save to the backend at close)";
+  DLiteOpt opts[] = {
+    {'m', "mode",   "append",         mode_descr},
+    {'r', "redis",  "127.0.0.1:6379", "Address of the Redis server."},
+    {'t', "ttl",    "3600",           "Seconds before entries expire."},
+    {'p', "prefix", "dlite:",         "Prefix of cache keys."},
+    {'w', "write",  "through",        write_descr},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode, *write;
+  char *endptr;
+  long ttl;
+  UNUSED(api);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+  write = opts[4].value;
+  ttl = strtol(opts[2].value, &endptr, 10);
+  if (*endptr || endptr == opts[2].value || ttl < 0 || ttl > 0x7fffffff)
+    FAIL1("cache: invalid \"ttl\" value: '%s'", opts[2].value);
+
+  if (!(cs = calloc(1, sizeof(CacheStorage)))) FAIL("allocation failure");
+  cs->ttl = ttl;
+  if (strcmp(mode, "append") == 0 || strcmp(mode, "a") == 0) {
+    cs->writable = 1;
+  } else if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    cs->writable = 0;
+  } else {
+    FAIL1("invalid \"mode\" value: '%s'. Must be \"append\" or \"r\" "
+          "(read-only)", mode);
+  }
+  if (strcmp(write, "through") == 0) {
+    cs->behind = 0;
+  } else if (strcmp(write, "behind") == 0) {
+    cs->behind = 1;
+  } else {
+    FAIL1("cache: invalid \"write\" value: '%s'. Must be \"through\" or "
+          "\"behind\"", write);
+  }
+  if (!(cs->prefix = strdup(opts[3].value))) FAIL("allocation failure");
+
+  if (!(cs->backend = dlite_storage_open_url(uri))) goto fail;
+  if (!dlite_storage_is_writable(cs->backend)) cs->writable = 0;
+  if (!(cs->redis = redis_connect(opts[1].value))) goto fail;
+
+  cs->idflag = dliteIDTranslateToUUID;
+  retval = (DLiteStorage *)cs;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && cs) {
+    if (cs->backend) dlite_storage_close(cs->backend);
+    if (cs->prefix) free(cs->prefix);
+    free(cs);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  Queued write-behind saves are written to the
+  backend.  Returns non-zero on error.
+ */
+int cache_close(DLiteStorage *s)
+{
+  CacheStorage *cs = (CacheStorage *)s;
+  int stat = flush_queue(cs);
+  if (dlite_storage_close(cs->backend)) stat = 1;
+  if (cs->redis) redis_free(cs->redis);
+  if (cs->queue) free(cs->queue);
+  if (cs->rec) free(cs->rec);
+  free(cs->prefix);
+  return stat;
+}
+
+
+/**
+  Returns a new iterator over the backend.
+ */
+void *cache_iter_create(const DLiteStorage *s, const char *pattern)
+{
+  CacheStorage *cs = (CacheStorage *)s;
+  CacheIter *iter;
+  if (!(iter = calloc(1, sizeof(CacheIter))))
+    return err(1, "allocation failure"), NULL;
+  iter->backend = cs->backend;
+  if (!(iter->iter = dlite_storage_iter_create(cs->backend, pattern))) {
+    free(iter);
+    return NULL;
+  }
+  return iter;
+}
+
+/**
+  Writes the uuid of the next instance to `buf`.  Returns zero on
+  success, 1 if there are no more instances and a negative value on
+  error.
+ */
+int cache_iter_next(void *iter, char *buf)
+{
+  CacheIter *it = iter;
+  return dlite_storage_iter_next(it->backend, it->iter, buf);
+}
+
+/**
+  Frees iterator.
+ */
+void cache_iter_free(void *iter)
+{
+  CacheIter *it = iter;
+  dlite_storage_iter_free(it->backend, it->iter);
+  free(it);
+}
+
+
+/**
+  Loads instance `id` from the cache, or from the backend on a cache
+  miss.  NULL is returned on error.
+ */
+DLiteInstance *cache_load(const DLiteStorage *s, const char *id)
+{
+  CacheStorage *cs = (CacheStorage *)s;
+  DLiteInstance *inst;
+  char uuid[DLITE_UUID_LENGTH+1];
+  if (!id || !*id)
+    return errx(1, "id is required when loading from a cache storage"), NULL;
+  if (dlite_get_uuid(uuid, id) < 0) return NULL;
+  if ((inst = cache_get(cs, uuid))) return inst;
+  if (!(inst = dlite_instance_load(cs->backend, id))) return NULL;
+  cache_put(cs, inst);
+  return inst;
+}
+
+
+/**
+  Saves instance `inst`.  Returns non-zero on error.
+ */
+int cache_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  CacheStorage *cs = (CacheStorage *)s;
+  if (cs->behind) {
+    if (cs->nqueue >= cs->queuesize) {
+      size_t size = (cs->queuesize) ? 2*cs->queuesize : 16;
+      DLiteInstance **q = realloc(cs->queue, size*sizeof(DLiteInstance *));
+      if (!q) return err(1, "allocation failure");
+      cs->queue = q;
+      cs->queuesize = size;
+    }
+    cs->queue[cs->nqueue++] = (DLiteInstance *)inst;
+    dlite_instance_incref((DLiteInstance *)inst);
+  } else if (dlite_instance_save(cs->backend, inst)) {
+    return 1;
+  }
+  cache_put(cs, inst);
+  return 0;
+}
+
+
+static DLiteStoragePlugin cache_plugin = {
+  /* head */
+  "cache",                     /* name */
+  NULL,                        /* freeapi */
+
+  /* basic api */
+  cache_open,                  /* open */
+  cache_close,                 /* close */
+
+  /* queue api */
+  cache_iter_create,           /* iterCreate */
+  cache_iter_next,             /* iterNext */
+  cache_iter_free,             /* iterFree */
+  NULL,                        /* getUUIDs */
+
+  /* direct api */
+  cache_load,                  /* loadInstance */
+  cache_save,                  /* saveInstance */
+  NULL,                        /* loadInstances */
+  NULL,                        /* saveInstances */
+
+  /* datamodel api */
+  NULL,                        /* dataModel */
+  NULL,                        /* dataModelFree */
+
+  NULL,                        /* getMetaURI */
+  NULL,                        /* resolveDimensions */
+  NULL,                        /* getDimensionSize */
+  NULL,                        /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                        /* setMetaURI */
+  NULL,                        /* setDimensionSize */
+  NULL,                        /* setProperty */
+
+  NULL,                        /* hasDimension */
+  NULL,                        /* hasProperty */
+  NULL,                        /* getPropertySlice */
+
+  NULL,                        /* getDataName */
+  NULL,                        /* setDataName */
+
+  /* internal data */
+  NULL,                        /* data */
+
+  /* capabilities */
+  0,                           /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                        /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                        /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                        /* saveView */
+  NULL,                        /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                        /* loadInstanceAsync */
+  NULL,                        /* saveInstanceAsync */
+  NULL,                        /* asyncFd */
+  NULL,                        /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                        /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                         /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &cache_plugin;
+}
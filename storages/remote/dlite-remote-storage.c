@@ -0,0 +1,462 @@
+/* dlite-remote-storage.c -- DLite storage plugin for dlite-server */
+
+/*
+  This plugin is a client to dlite-server, which keeps instances in a
+  remote process.  The location is the address of the server on the
+  form "host[:port]", where port defaults to 7466.
+
+  Instances are transferred as binary records (see dlite-binrecord.h)
+  over a persistent TCP connection with the protocol described in
+  remote-protocol.h.  Saves are pipelined: a save returns as soon as
+  its request is sent and its acknowledgement is collected later, so
+  saving many instances does not pay one round trip each.  At most
+  `window` saves are unacknowledged at any time.  Errors reported for
+  pipelined saves are raised by the next call that collects them,
+  at the latest when the storage is closed.
+
+  Loading many instances with dlite_instance_load_many() or
+  similar is a single request.  The metadata of loaded instances must
+  be available to the client.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-binrecord.h"
+#include "remote-protocol.h"
+
+
+/* Storage for a dlite-server connection */
+typedef struct {
+  DLiteStorage_HEAD
+  RemoteSocket sock;        /* Connection to the server */
+  uint32_t nextid;          /* Id of next request */
+  uint32_t ackid;           /* Id of next expected response */
+  size_t window;            /* Max number of unacknowledged saves */
+  size_t pending;           /* Number of unacknowledged saves */
+  char *in;                 /* Receive buffer */
+  size_t insize;
+  char *out;                /* Request buffer */
+  size_t outsize;
+  char *rec;                /* Buffer for encoding a record */
+  size_t recsize;
+} RemoteStorage;
+
+/* Iterator over uuids */
+typedef struct {
+  char *uuids;              /* Received uuids */
+  size_t n;                 /* Number of uuids */
+  size_t pos;               /* Index of next uuid */
+} RemoteIter;
+
+
+/* Sends request `op` with `count` items and `size` bytes of `payload`.
+   Returns non-zero on error. */
+static int send_request(RemoteStorage *rs, RemoteOp op, uint32_t count,
+                        const void *payload, size_t size)
+{
+  RemoteHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = REMOTE_MAGIC;
+  h.op = op;
+  h.id = rs->nextid++;
+  h.count = count;
+  h.size = size;
+  return remote_send(rs->sock, &h, payload);
+}
+
+/* Receives the next response into `h` and the receive buffer and
+   checks that it answers operation `op`.  Returns zero on success, 1
+   if the server reported an error and a negative value if the
+   connection is broken. */
+static int recv_response(RemoteStorage *rs, RemoteOp op, RemoteHeader *h)
+{
+  int stat;
+  if ((stat = remote_recv(rs->sock, h, &rs->in, &rs->insize)))
+    return (stat > 0) ? errx(-1, "connection closed by dlite-server at %s",
+                             rs->location) : stat;
+  if (h->id != rs->ackid++ || h->op != op)
+    return errx(-1, "unexpected response from dlite-server at %s",
+                rs->location);
+  if (h->status != RemoteOk)
+    return errx(1, "dlite-server at %s: %s", rs->location,
+                (h->size) ? rs->in : "unknown error");
+  return 0;
+}
+
+/* Collects save acknowledgements until at most `keep` are pending.
+   Returns the number of failed saves or a negative value if the
+   connection is broken. */
+static int drain(RemoteStorage *rs, size_t keep)
+{
+  RemoteHeader h;
+  int stat, nerr=0;
+  while (rs->pending > keep) {
+    if ((stat = recv_response(rs, RemoteSave, &h)) < 0) return stat;
+    if (stat) nerr++;
+    rs->pending--;
+  }
+  return nerr;
+}
+
+/* Grows `*buf` of `*size` bytes to at least `n` bytes.  Returns
+   non-zero on error. */
+static int reserve(char **buf, size_t *size, size_t n)
+{
+  char *p;
+  if (n <= *size) return 0;
+  if (n < 2 * *size) n = 2 * *size;
+  if (!(p = realloc(*buf, n))) return err(1, "allocation failure");
+  *buf = p;
+  *size = n;
+  return 0;
+}
+
+
+/**
+  Opens a connection to dlite-server at `location`.
+
+  Valid `options` are:
+
+  - mode : Access mode.  Valid values are:
+      - append   Load and save instances (default)
+      - r        Load instances only
+  - window : Max number of saves that are sent before their
+      acknowledgements are collected (default: 16)
+
+  Returns NULL on error.
+ */
+DLiteStorage *remote_open(const DLiteStoragePlugin *api, const char *location,
+                          const char *options)
+{
+  RemoteStorage *rs=NULL;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"append\" (load and save instances, default); "
+    "\"r\" (read-only)";
+  DLiteOpt opts[] = {
+    {'m', "mode",   "append", mode_descr},
+    {'W', "window", "16",     "Max number of unacknowledged saves."},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode;
+  uint32_t hello[2] = {DLITE_BINRECORD_BYTEORDER, REMOTE_VERSION};
+  RemoteHeader h;
+  int window;
+  UNUSED(api);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+  window = atoi(opts[1].value);
+  if (window < 1) FAIL1("\"window\" must be a positive integer, got '%s'",
+                        opts[1].value);
+
+  if (!(rs = calloc(1, sizeof(RemoteStorage)))) FAIL("allocation failure");
+  rs->sock = REMOTE_INVALID_SOCKET;
+  rs->window = window;
+  rs->location = (char *)location;
+
+  if (strcmp(mode, "append") == 0 || strcmp(mode, "a") == 0) {
+    rs->writable = 1;
+  } else if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    rs->writable = 0;
+  } else {
+    FAIL1("invalid \"mode\" value: '%s'. Must be \"append\" or \"r\" "
+          "(read-only)", mode);
+  }
+
+  if ((rs->sock = remote_connect_address(location, REMOTE_DEFAULT_PORT)) ==
+      REMOTE_INVALID_SOCKET) goto fail;
+  if (send_request(rs, RemoteHello, 0, hello, sizeof(hello)) ||
+      recv_response(rs, RemoteHello, &h)) goto fail;
+
+  retval = (DLiteStorage *)rs;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && rs) {
+    remote_close(rs->sock);
+    if (rs->in) free(rs->in);
+    free(rs);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  Returns non-zero on error, including if any
+  pipelined save failed.
+ */
+int remote_close_storage(DLiteStorage *s)
+{
+  RemoteStorage *rs = (RemoteStorage *)s;
+  int retval = (drain(rs, 0) != 0);
+  remote_close(rs->sock);
+  if (rs->in) free(rs->in);
+  if (rs->out) free(rs->out);
+  if (rs->rec) free(rs->rec);
+  return retval;
+}
+
+
+/**
+  Returns a newly allocated array of the `n` instances in `ids` loaded
+  from storage `s`.  NULL is returned on error.
+ */
+DLiteInstance **remote_load_many(const DLiteStorage *s, const char **ids,
+                                 size_t n)
+{
+  RemoteStorage *rs = (RemoteStorage *)s;
+  DLiteInstance **insts=NULL, **retval=NULL;
+  RemoteHeader h;
+  size_t i, len=0, pos=0;
+  char uuid[DLITE_UUID_LENGTH+1];
+
+  /* request all instances in one message */
+  for (i=0; i<n; i++) {
+    size_t m;
+    if (dlite_get_uuid(uuid, ids[i]) < 0) return NULL;
+    m = strlen(ids[i]) + 1;
+    if (reserve(&rs->out, &rs->outsize, len + m)) return NULL;
+    memcpy(rs->out + len, ids[i], m);
+    len += m;
+  }
+  if (send_request(rs, RemoteLoad, (uint32_t)n, rs->out, len)) return NULL;
+
+  /* responses are in order, so pending saves are acknowledged first */
+  if (drain(rs, 0) < 0) return NULL;
+  if (recv_response(rs, RemoteLoad, &h)) return NULL;
+  if (h.count != n)
+    return errx(1, "dlite-server returned %u instances, expected %zu",
+                h.count, n), NULL;
+
+  if (!(insts = calloc(n, sizeof(DLiteInstance *))))
+    FAIL("allocation failure");
+  for (i=0; i<n; i++) {
+    RemoteItem item;
+    const DLiteBinRecord *rec;
+    if (h.size - pos < sizeof(item))
+      FAIL("truncated LOAD response from dlite-server");
+    memcpy(&item, rs->in + pos, sizeof(item));
+    item.uuid[DLITE_UUID_LENGTH] = '\0';
+    pos += sizeof(item);
+    if (item.size == 0)
+      FAIL2("no instance with id \"%s\" in storage \"%s\"",
+            ids[i], rs->location);
+    rec = (const DLiteBinRecord *)(rs->in + pos);
+    if (item.size > h.size - pos || dlite_binrecord_check(rec, item.size))
+      FAIL1("corrupted record for %s from dlite-server", item.uuid);
+    pos += item.size;
+    if (dlite_instance_has(item.uuid, 0) &&
+        (insts[i] = dlite_instance_get(item.uuid)))
+      continue;
+    if (!(insts[i] = dlite_binrecord_decode(rec, item.uuid, NULL, NULL)))
+      goto fail;
+  }
+  retval = insts;
+ fail:
+  if (!retval && insts) {
+    for (i=0; i<n; i++)
+      if (insts[i]) dlite_instance_decref(insts[i]);
+    free(insts);
+  }
+  return retval;
+}
+
+
+/**
+  Loads instance `id` from storage `s` and returns it.
+  NULL is returned on error.
+ */
+DLiteInstance *remote_load(const DLiteStorage *s, const char *id)
+{
+  DLiteInstance **insts, *inst;
+  if (!id || !*id)
+    return errx(1, "id is required when loading from dlite-server"), NULL;
+  if (!(insts = remote_load_many(s, &id, 1))) return NULL;
+  inst = insts[0];
+  free(insts);
+  return inst;
+}
+
+
+/**
+  Sends the `n` instances in `insts` to storage `s` in one request.
+  The acknowledgement is collected later.  Returns non-zero on error.
+ */
+int remote_save_many(DLiteStorage *s, const DLiteInstance **insts, size_t n)
+{
+  RemoteStorage *rs = (RemoteStorage *)s;
+  size_t i, len=0;
+  int stat;
+
+  for (i=0; i<n; i++) {
+    RemoteItem item;
+    if ((stat = dlite_binrecord_encode(&rs->rec, &rs->recsize, 0, insts[i]))
+        < 0) return 1;
+    memset(&item, 0, sizeof(item));
+    strncpy(item.uuid, insts[i]->uuid, DLITE_UUID_LENGTH);
+    item.size = stat;
+    if (reserve(&rs->out, &rs->outsize, len + sizeof(item) + stat)) return 1;
+    memcpy(rs->out + len, &item, sizeof(item));
+    memcpy(rs->out + len + sizeof(item), rs->rec, stat);
+    len += sizeof(item) + stat;
+  }
+  if (send_request(rs, RemoteSave, (uint32_t)n, rs->out, len)) return 1;
+  rs->pending++;
+  if (rs->pending >= rs->window && drain(rs, rs->window / 2)) return 1;
+  return 0;
+}
+
+
+/**
+  Saves instance `inst` to storage `s`.  Returns non-zero on error.
+ */
+int remote_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  return remote_save_many(s, &inst, 1);
+}
+
+
+/**
+  Returns a new iterator over the uuids of all instances in storage `s`
+  whose metadata uri matches the glob `pattern`, or NULL on error.
+ */
+void *remote_iter_create(const DLiteStorage *s, const char *pattern)
+{
+  RemoteStorage *rs = (RemoteStorage *)s;
+  RemoteIter *iter;
+  RemoteHeader h;
+  size_t size;
+  if (!pattern) pattern = "";
+  if (send_request(rs, RemoteUUIDs, 0, pattern, strlen(pattern) + 1))
+    return NULL;
+  if (drain(rs, 0) < 0) return NULL;
+  if (recv_response(rs, RemoteUUIDs, &h)) return NULL;
+  size = (size_t)h.count * (DLITE_UUID_LENGTH+1);
+  if (h.size < size)
+    return errx(1, "truncated UUIDS response from dlite-server"), NULL;
+  if (!(iter = calloc(1, sizeof(RemoteIter))))
+    return err(1, "allocation failure"), NULL;
+  if (size && !(iter->uuids = malloc(size))) {
+    free(iter);
+    return err(1, "allocation failure"), NULL;
+  }
+  if (size) memcpy(iter->uuids, rs->in, size);
+  iter->n = h.count;
+  return iter;
+}
+
+
+/**
+  Writes the next uuid of `iter` to `buf`.  Returns zero on success,
+  1 if there are no more uuids.
+ */
+int remote_iter_next(void *iter, char *buf)
+{
+  RemoteIter *it = iter;
+  if (it->pos >= it->n) return 1;
+  memcpy(buf, it->uuids + it->pos++ * (DLITE_UUID_LENGTH+1),
+         DLITE_UUID_LENGTH+1);
+  return 0;
+}
+
+
+/**
+  Free's iterator created with remote_iter_create().
+ */
+void remote_iter_free(void *iter)
+{
+  RemoteIter *it = iter;
+  if (it->uuids) free(it->uuids);
+  free(it);
+}
+
+
+static DLiteStoragePlugin dlite_remote_plugin = {
+  /* head */
+  "remote",                 /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  remote_open,              /* open */
+  remote_close_storage,     /* close */
+
+  /* queue api */
+  remote_iter_create,       /* iterCreate */
+  remote_iter_next,         /* iterNext */
+  remote_iter_free,         /* iterFree */
+  NULL,                     /* getUUIDs */
+
+  /* direct api */
+  remote_load,              /* loadInstance */
+  remote_save,              /* saveInstance */
+  remote_load_many,         /* loadInstances */
+  remote_save_many,         /* saveInstances */
+
+  /* datamodel api */
+  NULL,                     /* dataModel */
+  NULL,                     /* dataModelFree */
+
+  NULL,                     /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  NULL,                     /* getDimensionSize */
+  NULL,                     /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                     /* setMetaURI */
+  NULL,                     /* setDimensionSize */
+  NULL,                     /* setProperty */
+
+  NULL,                     /* hasDimension */
+  NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  NULL,                     /* getDataName, obsolute */
+  NULL,                     /* setDataName, obsolute */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &dlite_remote_plugin;
+}
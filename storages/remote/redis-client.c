@@ -0,0 +1,214 @@
+/* redis-client.c -- minimal Redis client for the cache storage plugin
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "remote-protocol.h"
+#include "redis-client.h"
+
+/* Initial size of the receive buffer */
+#define REDIS_BUFSIZE 4096
+
+
+struct _RedisClient {
+  RemoteSocket sock;        /* Connection to the server */
+  int broken;               /* Whether the connection is out of sync */
+  char *in;                 /* Receive buffer */
+  size_t insize;            /* Allocated size of `in` */
+  size_t pos;               /* Position of next unread byte in `in` */
+  size_t len;               /* Number of bytes in `in` */
+  char *out;                /* Command buffer */
+  size_t outsize;           /* Allocated size of `out` */
+};
+
+
+/* Returns a new connection to the server at `address`. */
+RedisClient *redis_connect(const char *address)
+{
+  RedisClient *c;
+  if (remote_init()) return NULL;
+  if (!(c = calloc(1, sizeof(RedisClient))))
+    return err(1, "allocation failure"), NULL;
+  if ((c->sock = remote_connect_address(address, REDIS_DEFAULT_PORT)) ==
+      REMOTE_INVALID_SOCKET) {
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+/* Closes connection `c`. */
+void redis_free(RedisClient *c)
+{
+  remote_close(c->sock);
+  if (c->in) free(c->in);
+  if (c->out) free(c->out);
+  free(c);
+}
+
+/* Receives more bytes into the receive buffer.  Returns non-zero on
+   error. */
+static int fill(RedisClient *c)
+{
+  long m;
+  if (c->pos > 0) {
+    memmove(c->in, c->in + c->pos, c->len - c->pos);
+    c->len -= c->pos;
+    c->pos = 0;
+  }
+  if (c->len == c->insize) {
+    size_t size = (c->insize) ? 2*c->insize : REDIS_BUFSIZE;
+    char *p;
+    if (!(p = realloc(c->in, size))) return err(1, "allocation failure");
+    c->in = p;
+    c->insize = size;
+  }
+  if ((m = remote_recv_some(c->sock, c->in + c->len, c->insize - c->len)) <= 0)
+    return (m) ? 1 : errx(1, "redis: connection closed by server");
+  c->len += m;
+  return 0;
+}
+
+/* Reads a reply line and stores its type character in `*type` and
+   the integer following it in `*num`.  Error replies are reported.
+   Returns non-zero on error. */
+static int read_reply(RedisClient *c, char *type, long long *num)
+{
+  char *line, *end;
+  size_t n=0;
+  while (1) {
+    line = c->in + c->pos;
+    if (c->len - c->pos > 1 &&
+        (end = memchr(line + n, '\r', c->len - c->pos - n - 1))) break;
+    n = (c->len - c->pos > 1) ? c->len - c->pos - 1 : 0;
+    if (fill(c)) return 1;
+  }
+  if (end[1] != '\n') return errx(1, "redis: invalid reply");
+  *end = '\0';
+  c->pos += end + 2 - line;
+  *type = line[0];
+  if (*type == '-') return errx(1, "redis: %s", line + 1);
+  *num = strtoll(line + 1, NULL, 10);
+  return 0;
+}
+
+/* Reads `n` bytes to `dst`, followed by CRLF.  Returns non-zero on
+   error. */
+static int read_bulk(RedisClient *c, char *dst, size_t n)
+{
+  size_t got=0;
+  while (got < n + 2) {
+    size_t m = c->len - c->pos;
+    if (m == 0) {
+      if (fill(c)) return 1;
+      continue;
+    }
+    if (m > n + 2 - got) m = n + 2 - got;
+    if (got < n) memcpy(dst + got, c->in + c->pos, (got + m > n) ? n - got : m);
+    got += m;
+    c->pos += m;
+  }
+  return 0;
+}
+
+/* Sends a command with `argc` arguments `argv` of lengths `lens` and
+   reads the first line of the reply.  Returns non-zero on error. */
+static int command(RedisClient *c, int argc, const char **argv,
+                   const size_t *lens, char *type, long long *num)
+{
+  size_t m=0;
+  int i;
+  if (c->broken) return errx(1, "redis: connection is out of sync");
+  m += asnpprintf(&c->out, &c->outsize, m, "*%d\r\n", argc);
+  for (i=0; i<argc; i++) {
+    m += asnpprintf(&c->out, &c->outsize, m, "$%zu\r\n", lens[i]);
+    if (m + lens[i] + 3 > c->outsize) {
+      char *p;
+      if (!(p = realloc(c->out, m + lens[i] + 3)))
+        return err(1, "allocation failure");
+      c->out = p;
+      c->outsize = m + lens[i] + 3;
+    }
+    memcpy(c->out + m, argv[i], lens[i]);
+    m += lens[i];
+    m += asnpprintf(&c->out, &c->outsize, m, "\r\n");
+  }
+  c->broken = 1;  /* until the reply is read */
+  if (remote_send_all(c->sock, c->out, m)) return 1;
+  if (read_reply(c, type, num)) {
+    c->broken = (*type != '-');
+    return 1;
+  }
+  c->broken = 0;
+  return 0;
+}
+
+
+/* Gets the value of `key`. */
+int redis_get(RedisClient *c, const char *key, char **value, size_t *len)
+{
+  const char *argv[] = {"GET", key};
+  size_t lens[] = {3, strlen(key)};
+  char type;
+  long long num;
+  if (command(c, 2, argv, lens, &type, &num)) return -1;
+  if (type != '$') {
+    c->broken = 1;
+    return errx(-1, "redis: unexpected reply to GET");
+  }
+  if (num < 0) return 1;
+  if (!(*value = malloc((size_t)num + 1))) {
+    c->broken = 1;
+    return err(-1, "allocation failure");
+  }
+  if (read_bulk(c, *value, (size_t)num)) {
+    c->broken = 1;
+    free(*value);
+    return -1;
+  }
+  (*value)[num] = '\0';
+  *len = (size_t)num;
+  return 0;
+}
+
+/* Sets `key` to `value`, expiring after `ttl` seconds if positive. */
+int redis_set(RedisClient *c, const char *key, const void *value,
+              size_t len, int ttl)
+{
+  char ttlbuf[16];
+  const char *argv[] = {"SET", key, value, "EX", ttlbuf};
+  size_t lens[] = {3, strlen(key), len, 2, 0};
+  char type;
+  long long num;
+  lens[4] = snprintf(ttlbuf, sizeof(ttlbuf), "%d", ttl);
+  if (command(c, (ttl > 0) ? 5 : 3, argv, lens, &type, &num)) return 1;
+  if (type != '+') {
+    c->broken = 1;
+    return errx(1, "redis: unexpected reply to SET");
+  }
+  return 0;
+}
+
+/* Deletes `key`. */
+int redis_del(RedisClient *c, const char *key)
+{
+  const char *argv[] = {"DEL", key};
+  size_t lens[] = {3, strlen(key)};
+  char type;
+  long long num;
+  if (command(c, 2, argv, lens, &type, &num)) return -1;
+  if (type != ':') {
+    c->broken = 1;
+    return errx(-1, "redis: unexpected reply to DEL");
+  }
+  return (num > 0) ? 0 : 1;
+}
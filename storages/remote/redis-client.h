@@ -0,0 +1,48 @@
+/* redis-client.h -- minimal Redis client for the cache storage plugin
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#ifndef _REDIS_CLIENT_H
+#define _REDIS_CLIENT_H
+
+/*
+  A blocking client speaking the subset of the Redis serialisation
+  protocol (RESP) needed for caching binary values: GET, SET with
+  expiry and DEL.  Any server implementing these commands, like Redis,
+  Valkey or KeyDB, can be used.
+ */
+
+#include <stddef.h>
+
+#define REDIS_DEFAULT_PORT "6379"
+
+/** Redis connection */
+typedef struct _RedisClient RedisClient;
+
+
+/** Returns a new connection to the server at `address` on the form
+    "host[:port]" or NULL on error. */
+RedisClient *redis_connect(const char *address);
+
+/** Closes connection `c`. */
+void redis_free(RedisClient *c);
+
+/** Gets the value of `key`.  On success, `*value` is a malloc'ed
+    buffer with the `*len` bytes of the value.
+
+    Returns zero on success, 1 if `key` does not exist and a negative
+    value on error. */
+int redis_get(RedisClient *c, const char *key, char **value, size_t *len);
+
+/** Sets `key` to the `len` bytes at `value`.  If `ttl` is positive,
+    the key expires after `ttl` seconds.  Returns non-zero on error. */
+int redis_set(RedisClient *c, const char *key, const void *value,
+              size_t len, int ttl);
+
+/** Deletes `key`.  Returns zero if it was deleted, 1 if it did not
+    exist and a negative value on error. */
+int redis_del(RedisClient *c, const char *key);
+
+#endif /* _REDIS_CLIENT_H */
@@ -0,0 +1,270 @@
+/* remote-protocol.c -- wire protocol between dlite-server and the
+ * remote storage plugin
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#else
+# include <errno.h>
+# include <unistd.h>
+# include <netdb.h>
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+#endif
+
+#include "config.h"
+
+#include "utils/err.h"
+#include "remote-protocol.h"
+
+/* Max size of a message payload */
+#define REMOTE_MAX_PAYLOAD ((uint64_t)1 << 40)
+
+#ifdef _WIN32
+# define closesocket_ closesocket
+typedef int sendlen_t;
+#else
+# define closesocket_ close
+typedef size_t sendlen_t;
+#endif
+
+
+/* Initialises the socket library. */
+int remote_init(void)
+{
+#ifdef _WIN32
+  static int initialised = 0;
+  WSADATA data;
+  if (initialised) return 0;
+  if (WSAStartup(MAKEWORD(2, 2), &data))
+    return errx(1, "cannot initialise winsock");
+  initialised = 1;
+#endif
+  return 0;
+}
+
+/* Disables Nagle's algorithm, since requests are small and latency
+   matters more than packet count. */
+static void set_nodelay(RemoteSocket sock)
+{
+  int one = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+}
+
+/* Returns a new socket connected to `host` and `port`. */
+RemoteSocket remote_connect(const char *host, const char *port)
+{
+  struct addrinfo hints, *res=NULL, *ai;
+  RemoteSocket sock = REMOTE_INVALID_SOCKET;
+  int stat;
+  if (remote_init()) return REMOTE_INVALID_SOCKET;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if ((stat = getaddrinfo(host, port, &hints, &res)))
+    return errx(1, "cannot resolve %s:%s: %s", host, port,
+                gai_strerror(stat)), REMOTE_INVALID_SOCKET;
+  for (ai=res; ai; ai=ai->ai_next) {
+    sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (sock == REMOTE_INVALID_SOCKET) continue;
+    if (connect(sock, ai->ai_addr, (int)ai->ai_addrlen) == 0) break;
+    closesocket_(sock);
+    sock = REMOTE_INVALID_SOCKET;
+  }
+  freeaddrinfo(res);
+  if (sock == REMOTE_INVALID_SOCKET)
+    return err(1, "cannot connect to %s:%s", host, port),
+      REMOTE_INVALID_SOCKET;
+  set_nodelay(sock);
+  return sock;
+}
+
+/* Returns a new socket listening on `host` and `port`. */
+RemoteSocket remote_listen(const char *host, const char *port, int *bound)
+{
+  struct addrinfo hints, *res=NULL, *ai;
+  RemoteSocket sock = REMOTE_INVALID_SOCKET;
+  int stat, one=1;
+  if (remote_init()) return REMOTE_INVALID_SOCKET;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if ((stat = getaddrinfo(host, port, &hints, &res)))
+    return errx(1, "cannot resolve %s:%s: %s", (host) ? host : "*", port,
+                gai_strerror(stat)), REMOTE_INVALID_SOCKET;
+  for (ai=res; ai; ai=ai->ai_next) {
+    sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (sock == REMOTE_INVALID_SOCKET) continue;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&one,
+               sizeof(one));
+    if (bind(sock, ai->ai_addr, (int)ai->ai_addrlen) == 0 &&
+        listen(sock, 64) == 0) break;
+    closesocket_(sock);
+    sock = REMOTE_INVALID_SOCKET;
+  }
+  freeaddrinfo(res);
+  if (sock == REMOTE_INVALID_SOCKET)
+    return err(1, "cannot listen on %s:%s", (host) ? host : "*", port),
+      REMOTE_INVALID_SOCKET;
+  if (bound) {
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    *bound = 0;
+    if (getsockname(sock, (struct sockaddr *)&addr, &len) == 0) {
+      if (addr.ss_family == AF_INET)
+        *bound = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+      else if (addr.ss_family == AF_INET6)
+        *bound = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+    }
+  }
+  return sock;
+}
+
+/* Returns a new socket for the next connection to `listener`. */
+RemoteSocket remote_accept(RemoteSocket listener)
+{
+  RemoteSocket sock = accept(listener, NULL, NULL);
+  if (sock == REMOTE_INVALID_SOCKET)
+    return err(1, "cannot accept connection"), REMOTE_INVALID_SOCKET;
+  set_nodelay(sock);
+  return sock;
+}
+
+/* Closes socket `sock`. */
+void remote_close(RemoteSocket sock)
+{
+  if (sock != REMOTE_INVALID_SOCKET) closesocket_(sock);
+}
+
+/* Returns a new socket connected to `address` on the form
+   "host[:port]" or "[ipv6]:port". */
+RemoteSocket remote_connect_address(const char *address, const char *defport)
+{
+  RemoteSocket sock = REMOTE_INVALID_SOCKET;
+  char *host, *port=NULL, *p;
+  if (!(host = strdup(address)))
+    return err(1, "allocation failure"), REMOTE_INVALID_SOCKET;
+  if (host[0] == '[' && (p = strchr(host, ']'))) {
+    *p++ = '\0';
+    memmove(host, host+1, strlen(host+1) + 1);
+    if (*p == ':') port = p + 1;
+  } else if ((p = strrchr(host, ':'))) {
+    *p = '\0';
+    port = p + 1;
+  }
+  if (port && !*port) port = NULL;
+  if (!*host)
+    errx(1, "no host in address: '%s'", address);
+  else
+    sock = remote_connect(host, (port) ? port : defport);
+  free(host);
+  return sock;
+}
+
+/* Sends `n` bytes from `buf`.  Returns non-zero on error. */
+int remote_send_all(RemoteSocket sock, const char *buf, size_t n)
+{
+  while (n > 0) {
+    size_t len = (n > (1 << 30)) ? (1 << 30) : n;
+#ifdef MSG_NOSIGNAL
+    long m = (long)send(sock, buf, (sendlen_t)len, MSG_NOSIGNAL);
+#else
+    long m = (long)send(sock, buf, (sendlen_t)len, 0);
+#endif
+    if (m < 0) {
+#ifdef EINTR
+      if (errno == EINTR) continue;
+#endif
+      return err(1, "error sending to socket");
+    }
+    buf += m;
+    n -= m;
+  }
+  return 0;
+}
+
+/* Receives `n` bytes to `buf`.  Returns zero on success, 1 if the
+   connection is closed before any byte is received and a negative
+   value on error. */
+static int recv_all(RemoteSocket sock, char *buf, size_t n)
+{
+  size_t got=0;
+  while (got < n) {
+    size_t len = (n - got > (1 << 30)) ? (1 << 30) : n - got;
+    long m = (long)recv(sock, buf + got, (sendlen_t)len, 0);
+    if (m == 0) {
+      if (got == 0) return 1;
+      return errx(-1, "connection closed in the middle of a message");
+    }
+    if (m < 0) {
+#ifdef EINTR
+      if (errno == EINTR) continue;
+#endif
+      return err(-1, "error receiving from socket");
+    }
+    got += m;
+  }
+  return 0;
+}
+
+/* Receives up to `n` bytes to `buf`.  Returns the number of bytes
+   received, zero if the connection is closed and a negative value on
+   error. */
+long remote_recv_some(RemoteSocket sock, char *buf, size_t n)
+{
+  while (1) {
+    size_t len = (n > (1 << 30)) ? (1 << 30) : n;
+    long m = (long)recv(sock, buf, (sendlen_t)len, 0);
+    if (m >= 0) return m;
+#ifdef EINTR
+    if (errno == EINTR) continue;
+#endif
+    return err(-1, "error receiving from socket");
+  }
+}
+
+/* Sends a message with header `h` and `h->size` bytes of `payload`. */
+int remote_send(RemoteSocket sock, const RemoteHeader *h,
+                const void *payload)
+{
+  if (remote_send_all(sock, (const char *)h, sizeof(RemoteHeader))) return 1;
+  if (h->size && remote_send_all(sock, payload, (size_t)h->size)) return 1;
+  return 0;
+}
+
+/* Receives a message.  Returns zero on success, 1 if the connection
+   was closed before a message and a negative value on error. */
+int remote_recv(RemoteSocket sock, RemoteHeader *h, char **buf,
+                size_t *bufsize)
+{
+  int stat;
+  if ((stat = recv_all(sock, (char *)h, sizeof(RemoteHeader)))) return stat;
+  if (h->magic != REMOTE_MAGIC)
+    return errx(-1, "invalid message, wrong magic number or byte order");
+  if (h->size > REMOTE_MAX_PAYLOAD)
+    return errx(-1, "too large message payload: %llu bytes",
+                (unsigned long long)h->size);
+  if (h->size + 1 > *bufsize) {
+    char *p;
+    if (!(p = realloc(*buf, (size_t)h->size + 1)))
+      return err(-1, "allocation failure");
+    *buf = p;
+    *bufsize = (size_t)h->size + 1;
+  }
+  if (h->size && (stat = recv_all(sock, *buf, (size_t)h->size)))
+    return (stat > 0) ?
+      errx(-1, "connection closed in the middle of a message") : stat;
+  (*buf)[h->size] = '\0';
+  return 0;
+}
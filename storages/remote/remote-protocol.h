@@ -0,0 +1,141 @@
+/* remote-protocol.h -- wire protocol between dlite-server and the
+ * remote storage plugin
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#ifndef _REMOTE_PROTOCOL_H
+#define _REMOTE_PROTOCOL_H
+
+/*
+  Protocol
+  --------
+  Messages are a RemoteHeader followed by `size` bytes of payload.  All
+  integers are in native byte order.  A client starts with a HELLO
+  request, which the server rejects if the byte order or protocol
+  version does not match its own.
+
+  The client may send any number of requests before reading the
+  responses (pipelining).  The server handles the requests of a
+  connection in order and answers each with a response with the same
+  `id`.  An error response has status RemoteError and an error message
+  as payload.
+
+  Requests and their payloads:
+
+    HELLO  request:  uint32_t byteorder, uint32_t version
+           response: empty
+    LOAD   request:  `count` NUL-terminated ids
+           response: `count` items, each a RemoteItem followed by a
+                     binary record (see dlite-binrecord.h) of
+                     `item.size` bytes.  Size zero means not found.
+    SAVE   request:  `count` items, each a RemoteItem followed by a
+                     binary record
+           response: empty
+    UUIDS  request:  NUL-terminated glob pattern matched against the
+                     metadata uri, empty to match all
+           response: `count` uuids of DLITE_UUID_LENGTH+1 bytes each
+
+  Since records are multiples of DLITE_BINRECORD_ALIGN bytes and
+  items are 48 bytes, records are 16-byte aligned within a payload.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# include <ws2tcpip.h>
+typedef SOCKET RemoteSocket;
+# define REMOTE_INVALID_SOCKET INVALID_SOCKET
+#else
+typedef int RemoteSocket;
+# define REMOTE_INVALID_SOCKET -1
+#endif
+
+#include "dlite.h"
+
+#define REMOTE_MAGIC        0x4d524c44  /* "DLRM" in little endian */
+#define REMOTE_VERSION      1
+#define REMOTE_DEFAULT_PORT "7466"
+
+/** Operations */
+typedef enum {
+  RemoteHello=1,
+  RemoteLoad,
+  RemoteSave,
+  RemoteUUIDs
+} RemoteOp;
+
+/** Response status */
+typedef enum {
+  RemoteOk=0,
+  RemoteError
+} RemoteStatus;
+
+/** Message header */
+typedef struct {
+  uint32_t magic;           /* REMOTE_MAGIC */
+  uint16_t op;              /* RemoteOp */
+  uint16_t status;          /* RemoteStatus, zero for requests */
+  uint32_t id;              /* request id, echoed in the response */
+  uint32_t count;           /* number of items in payload */
+  uint64_t size;            /* size of payload in bytes */
+} RemoteHeader;
+
+/** Header of an instance in LOAD responses and SAVE requests */
+typedef struct {
+  char uuid[DLITE_UUID_LENGTH+1];  /* uuid of instance */
+  char pad[3];
+  uint64_t size;            /* size of the following record */
+} RemoteItem;
+
+
+/** Initialises the socket library.  Returns non-zero on error. */
+int remote_init(void);
+
+/** Returns a new socket connected to `host` and `port` or
+    REMOTE_INVALID_SOCKET on error. */
+RemoteSocket remote_connect(const char *host, const char *port);
+
+/** Returns a new socket connected to `address` on the form
+    "host[:port]" or "[ipv6]:port", where port defaults to `defport`.
+    Returns REMOTE_INVALID_SOCKET on error. */
+RemoteSocket remote_connect_address(const char *address, const char *defport);
+
+/** Returns a new socket listening on `host` and `port` or
+    REMOTE_INVALID_SOCKET on error.  If `port` is "0", a free port is
+    selected and written to `*bound` if it is not NULL. */
+RemoteSocket remote_listen(const char *host, const char *port, int *bound);
+
+/** Returns a new socket for the next connection to `listener` or
+    REMOTE_INVALID_SOCKET on error. */
+RemoteSocket remote_accept(RemoteSocket listener);
+
+/** Closes socket `sock`. */
+void remote_close(RemoteSocket sock);
+
+/** Sends `n` bytes from `buf`.  Returns non-zero on error. */
+int remote_send_all(RemoteSocket sock, const char *buf, size_t n);
+
+/** Receives up to `n` bytes to `buf`.  Returns the number of bytes
+    received, zero if the connection is closed and a negative value
+    on error. */
+long remote_recv_some(RemoteSocket sock, char *buf, size_t n);
+
+/** Sends a message with header `h` and `h->size` bytes of `payload`.
+    Returns non-zero on error. */
+int remote_send(RemoteSocket sock, const RemoteHeader *h,
+                const void *payload);
+
+/** Receives a message, storing its header in `h` and its payload in
+    `*buf`, which is a malloc'ed buffer of `*bufsize` bytes that is
+    reallocated as needed.  The payload is NUL-terminated.
+
+    Returns zero on success, 1 if the connection was closed before a
+    message and a negative value on error. */
+int remote_recv(RemoteSocket sock, RemoteHeader *h, char **buf,
+                size_t *bufsize);
+
+#endif /* _REMOTE_PROTOCOL_H */
@@ -0,0 +1,489 @@
+/* remote-server.c -- instance store served over TCP
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# define poll WSAPoll
+typedef WSAPOLLFD PollFd;
+#else
+# include <poll.h>
+typedef struct pollfd PollFd;
+#endif
+
+#include "config.h"
+
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/globmatch.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-binrecord.h"
+#include "remote-protocol.h"
+#include "remote-server.h"
+
+/* Poll timeout in milliseconds, bounds the latency of stopping */
+#define POLL_TIMEOUT 200
+
+/* Cached record */
+typedef struct _Entry {
+  char uuid[DLITE_UUID_LENGTH+1];
+  char *rec;                /* binary record */
+  size_t size;              /* size of record */
+  struct _Entry *prev;      /* more recently used */
+  struct _Entry *next;      /* less recently used */
+} Entry;
+
+/* Client connection */
+typedef struct {
+  RemoteSocket sock;
+  int hello;                /* whether HELLO is received */
+} Client;
+
+struct _RemoteServer {
+  RemoteSocket listener;
+  int port;
+  DLiteStorage *storage;    /* backend storage, may be NULL */
+  map_void_t cache;         /* maps uuids to entries */
+  Entry *head;              /* most recently used entry */
+  Entry *tail;              /* least recently used entry */
+  size_t cachesize;         /* max bytes of cached records */
+  size_t cached;            /* bytes of cached records */
+  Client *clients;
+  size_t nclients;
+  size_t clientsize;        /* allocated number of clients */
+  volatile int stop;
+  char *in;                 /* receive buffer */
+  size_t insize;
+  char *out;                /* response buffer */
+  size_t outsize;
+  size_t outlen;            /* used bytes of response buffer */
+};
+
+
+/********************************************************************
+ * Cache
+ ********************************************************************/
+
+/* Unlinks `e` from the LRU list. */
+static void lru_unlink(RemoteServer *srv, Entry *e)
+{
+  if (e->prev) e->prev->next = e->next; else srv->head = e->next;
+  if (e->next) e->next->prev = e->prev; else srv->tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+/* Inserts `e` first in the LRU list. */
+static void lru_push(RemoteServer *srv, Entry *e)
+{
+  e->prev = NULL;
+  e->next = srv->head;
+  if (srv->head) srv->head->prev = e;
+  srv->head = e;
+  if (!srv->tail) srv->tail = e;
+}
+
+/* Removes and frees entry `e`. */
+static void cache_remove(RemoteServer *srv, Entry *e)
+{
+  lru_unlink(srv, e);
+  map_remove(&srv->cache, e->uuid);
+  srv->cached -= e->size;
+  free(e->rec);
+  free(e);
+}
+
+/* Returns the cached entry for `uuid` or NULL. */
+static Entry *cache_get(RemoteServer *srv, const char *uuid)
+{
+  void **p = map_get(&srv->cache, uuid);
+  Entry *e;
+  if (!p) return NULL;
+  e = *p;
+  lru_unlink(srv, e);
+  lru_push(srv, e);
+  return e;
+}
+
+/* Stores a copy of record `rec` of `size` bytes for `uuid` in the
+   cache.  Least recently used entries are evicted if the cache grows
+   too large and a backend holds them.  Returns non-zero on error. */
+static int cache_put(RemoteServer *srv, const char *uuid, const void *rec,
+                     size_t size)
+{
+  void **p = map_get(&srv->cache, uuid);
+  Entry *e;
+  char *copy;
+  if (!(copy = malloc(size))) return err(1, "allocation failure");
+  memcpy(copy, rec, size);
+  if (p) {
+    e = *p;
+    srv->cached -= e->size;
+    free(e->rec);
+    lru_unlink(srv, e);
+  } else {
+    if (!(e = calloc(1, sizeof(Entry)))) {
+      free(copy);
+      return err(1, "allocation failure");
+    }
+    strncpy(e->uuid, uuid, DLITE_UUID_LENGTH);
+    if (map_set(&srv->cache, e->uuid, e)) {
+      free(copy);
+      free(e);
+      return err(1, "cannot cache %s", uuid);
+    }
+  }
+  e->rec = copy;
+  e->size = size;
+  srv->cached += size;
+  lru_push(srv, e);
+  if (srv->storage)
+    while (srv->cached > srv->cachesize && srv->tail != e)
+      cache_remove(srv, srv->tail);
+  return 0;
+}
+
+
+/********************************************************************
+ * Requests
+ ********************************************************************/
+
+/* Appends `n` bytes from `src` to the response buffer.  Returns
+   non-zero on error. */
+static int out_append(RemoteServer *srv, const void *src, size_t n)
+{
+  if (srv->outlen + n > srv->outsize) {
+    size_t size = srv->outsize + n + 65536;
+    char *p;
+    if (!(p = realloc(srv->out, size))) return err(1, "allocation failure");
+    srv->out = p;
+    srv->outsize = size;
+  }
+  memcpy(srv->out + srv->outlen, src, n);
+  srv->outlen += n;
+  return 0;
+}
+
+/* Loads instance `uuid` from the backend into the cache.  Returns the
+   new entry or NULL if it is not found. */
+static Entry *load_backend(RemoteServer *srv, const char *uuid)
+{
+  DLiteInstance *inst;
+  char *buf=NULL;
+  size_t size=0;
+  int n;
+  Entry *e=NULL;
+  ErrTry:
+    if ((inst = dlite_instance_load(srv->storage, uuid))) {
+      if ((n = dlite_binrecord_encode(&buf, &size, 0, inst)) >= 0 &&
+          cache_put(srv, uuid, buf, n) == 0)
+        e = cache_get(srv, uuid);
+      dlite_instance_decref(inst);
+    }
+  ErrOther:
+    e = NULL;  /* not found */
+  ErrEnd;
+  if (buf) free(buf);
+  return e;
+}
+
+/* Handles LOAD request with `count` ids in `payload`.  Returns
+   non-zero on error. */
+static int handle_load(RemoteServer *srv, const char *payload, size_t size,
+                       uint32_t count)
+{
+  const char *id = payload;
+  uint32_t i;
+  for (i=0; i<count; i++) {
+    RemoteItem item;
+    Entry *e;
+    if (id >= payload + size) return errx(1, "too few ids in LOAD request");
+    memset(&item, 0, sizeof(item));
+    if (dlite_get_uuid(item.uuid, id) < 0) return 1;
+    if (!(e = cache_get(srv, item.uuid)) && srv->storage)
+      e = load_backend(srv, item.uuid);
+    item.size = (e) ? e->size : 0;
+    if (out_append(srv, &item, sizeof(item))) return 1;
+    if (e && out_append(srv, e->rec, e->size)) return 1;
+    id += strlen(id) + 1;
+  }
+  return 0;
+}
+
+/* Handles SAVE request with `count` items in `payload`.  Returns
+   non-zero on error. */
+static int handle_save(RemoteServer *srv, char *payload, size_t size,
+                       uint32_t count)
+{
+  size_t pos=0;
+  uint32_t i;
+  for (i=0; i<count; i++) {
+    RemoteItem item;
+    const DLiteBinRecord *rec;
+    if (size - pos < sizeof(item))
+      return errx(1, "truncated SAVE request");
+    memcpy(&item, payload + pos, sizeof(item));
+    item.uuid[DLITE_UUID_LENGTH] = '\0';
+    pos += sizeof(item);
+    rec = (const DLiteBinRecord *)(payload + pos);
+    if (item.size > size - pos || dlite_binrecord_check(rec, item.size))
+      return errx(1, "corrupted record %s in SAVE request", item.uuid);
+    pos += item.size;
+
+    /* write through to the backend before caching */
+    if (srv->storage) {
+      DLiteInstance *inst;
+      int stat;
+      if (!(inst = dlite_binrecord_decode(rec, item.uuid, NULL, NULL)))
+        return 1;
+      stat = dlite_instance_save(srv->storage, inst);
+      dlite_instance_decref(inst);
+      if (stat) return 1;
+    }
+    if (cache_put(srv, item.uuid, rec, item.size)) return 1;
+  }
+  return 0;
+}
+
+/* Handles UUIDS request with glob `pattern`.  Returns the number of
+   uuids or -1 on error. */
+static int handle_uuids(RemoteServer *srv, const char *pattern)
+{
+  map_int_t seen;
+  map_iter_t iter;
+  const char *uuid;
+  int n=0, retval=-1;
+  map_init(&seen);
+
+  iter = map_iter(&srv->cache);
+  while ((uuid = map_next(&srv->cache, &iter))) {
+    Entry *e = *map_get(&srv->cache, uuid);
+    const DLiteBinRecord *rec = (const DLiteBinRecord *)e->rec;
+    const char *metauri;
+    int status=0;
+    if (*pattern) {
+      metauri = dlite_binrecord_str(rec, rec->metauri, &status);
+      if (!metauri || globmatch(pattern, metauri)) continue;
+    }
+    if (out_append(srv, e->uuid, DLITE_UUID_LENGTH+1)) goto fail;
+    map_set(&seen, e->uuid, 1);
+    n++;
+  }
+  if (srv->storage && srv->storage->api->iterCreate) {
+    char buf[DLITE_UUID_LENGTH+1];
+    void *it;
+    if (!(it = dlite_storage_iter_create(srv->storage,
+                                         (*pattern) ? pattern : NULL)))
+      goto fail;
+    while (dlite_storage_iter_next(srv->storage, it, buf) == 0) {
+      if (map_get(&seen, buf)) continue;
+      if (out_append(srv, buf, sizeof(buf))) {
+        dlite_storage_iter_free(srv->storage, it);
+        goto fail;
+      }
+      n++;
+    }
+    dlite_storage_iter_free(srv->storage, it);
+  }
+  retval = n;
+ fail:
+  map_deinit(&seen);
+  return retval;
+}
+
+/* Receives and handles one request from client `c`.  Returns zero on
+   success, 1 if the connection should be closed. */
+static int handle_request(RemoteServer *srv, Client *c)
+{
+  RemoteHeader h, r;
+  int stat;
+  if ((stat = remote_recv(c->sock, &h, &srv->in, &srv->insize)))
+    return 1;
+
+  err_clear();
+  memset(&r, 0, sizeof(r));
+  r.magic = REMOTE_MAGIC;
+  r.op = h.op;
+  r.id = h.id;
+  srv->outlen = 0;
+
+  if (!c->hello && h.op != RemoteHello) {
+    stat = errx(1, "expected HELLO as first request");
+  } else {
+    switch (h.op) {
+    case RemoteHello:
+      {
+        uint32_t v[2] = {0, 0};
+        if (h.size >= sizeof(v)) memcpy(v, srv->in, sizeof(v));
+        if (v[0] != DLITE_BINRECORD_BYTEORDER)
+          stat = errx(1, "client has different byte order than server");
+        else if (v[1] != REMOTE_VERSION)
+          stat = errx(1, "unsupported protocol version %u", v[1]);
+        else
+          c->hello = 1;
+      }
+      break;
+    case RemoteLoad:
+      stat = handle_load(srv, srv->in, (size_t)h.size, h.count);
+      r.count = h.count;
+      break;
+    case RemoteSave:
+      stat = handle_save(srv, srv->in, (size_t)h.size, h.count);
+      break;
+    case RemoteUUIDs:
+      if ((stat = handle_uuids(srv, srv->in)) >= 0) {
+        r.count = stat;
+        stat = 0;
+      }
+      break;
+    default:
+      stat = errx(1, "unknown operation: %d", h.op);
+    }
+  }
+
+  if (stat) {
+    const char *msg = err_getmsg();
+    if (!msg || !*msg) msg = "unknown error";
+    r.status = RemoteError;
+    r.count = 0;
+    srv->outlen = 0;
+    out_append(srv, msg, strlen(msg) + 1);
+  }
+  r.size = srv->outlen;
+  if (remote_send(c->sock, &r, srv->out)) return 1;
+  return (c->hello) ? 0 : 1;
+}
+
+
+/********************************************************************
+ * Server
+ ********************************************************************/
+
+/* Returns a new server. */
+RemoteServer *remote_server_create(const char *host, const char *port,
+                                   const char *storage, size_t cachesize)
+{
+  RemoteServer *srv;
+  if (!(srv = calloc(1, sizeof(RemoteServer))))
+    return err(1, "allocation failure"), NULL;
+  srv->listener = REMOTE_INVALID_SOCKET;
+  map_init(&srv->cache);
+  srv->cachesize = (cachesize) ? cachesize : REMOTE_CACHE_SIZE;
+  if (storage && !(srv->storage = dlite_storage_open_url(storage))) goto fail;
+  if ((srv->listener = remote_listen(host, (port) ? port :
+                                     REMOTE_DEFAULT_PORT, &srv->port)) ==
+      REMOTE_INVALID_SOCKET) goto fail;
+  return srv;
+ fail:
+  remote_server_free(srv);
+  return NULL;
+}
+
+/* Returns the port the server is listening on. */
+int remote_server_port(const RemoteServer *srv)
+{
+  return srv->port;
+}
+
+/* Removes client number `i`. */
+static void drop_client(RemoteServer *srv, size_t i)
+{
+  remote_close(srv->clients[i].sock);
+  srv->clients[i] = srv->clients[--srv->nclients];
+}
+
+/* Serves clients until remote_server_stop() is called. */
+int remote_server_run(RemoteServer *srv)
+{
+  PollFd *fds=NULL;
+  size_t i, nfds=0;
+  int retval=1;
+
+  srv->stop = 0;
+  while (!srv->stop) {
+    int n;
+    if (nfds < srv->nclients + 1) {
+      PollFd *p;
+      nfds = srv->clientsize + 1;
+      if (!(p = realloc(fds, nfds*sizeof(PollFd))))
+        FAIL("allocation failure");
+      fds = p;
+    }
+    memset(fds, 0, (srv->nclients + 1)*sizeof(PollFd));
+    fds[0].fd = srv->listener;
+    fds[0].events = POLLIN;
+    for (i=0; i < srv->nclients; i++) {
+      fds[i+1].fd = srv->clients[i].sock;
+      fds[i+1].events = POLLIN;
+    }
+    if ((n = poll(fds, (unsigned long)srv->nclients + 1, POLL_TIMEOUT)) < 0) {
+#ifdef EINTR
+      if (errno == EINTR) continue;
+#endif
+      FAIL("error polling sockets");
+    }
+    if (n == 0) continue;
+
+    /* Handle clients in reverse order, since dropping a client moves
+       the last client into its place */
+    for (i=srv->nclients; i>0; i--) {
+      if (!fds[i].revents) continue;
+      if ((fds[i].revents & (POLLERR | POLLNVAL)) ||
+          handle_request(srv, srv->clients + i - 1))
+        drop_client(srv, i - 1);
+    }
+
+    if (fds[0].revents & POLLIN) {
+      RemoteSocket sock;
+      if ((sock = remote_accept(srv->listener)) == REMOTE_INVALID_SOCKET)
+        continue;
+      if (srv->nclients >= srv->clientsize) {
+        size_t size = srv->clientsize + 16;
+        Client *p;
+        if (!(p = realloc(srv->clients, size*sizeof(Client)))) {
+          remote_close(sock);
+          FAIL("allocation failure");
+        }
+        srv->clients = p;
+        srv->clientsize = size;
+      }
+      srv->clients[srv->nclients].sock = sock;
+      srv->clients[srv->nclients].hello = 0;
+      srv->nclients++;
+    }
+  }
+  retval = 0;
+ fail:
+  if (fds) free(fds);
+  return retval;
+}
+
+/* Makes remote_server_run() return. */
+void remote_server_stop(RemoteServer *srv)
+{
+  srv->stop = 1;
+}
+
+/* Frees `srv`. */
+int remote_server_free(RemoteServer *srv)
+{
+  int stat=0;
+  while (srv->nclients) drop_client(srv, srv->nclients - 1);
+  while (srv->head) cache_remove(srv, srv->head);
+  map_deinit(&srv->cache);
+  remote_close(srv->listener);
+  if (srv->storage) stat = dlite_storage_close(srv->storage);
+  if (srv->clients) free(srv->clients);
+  if (srv->in) free(srv->in);
+  if (srv->out) free(srv->out);
+  free(srv);
+  return stat;
+}
@@ -0,0 +1,63 @@
+/* remote-server.h -- instance store served over TCP
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+#ifndef _REMOTE_SERVER_H
+#define _REMOTE_SERVER_H
+
+/*
+  A single-threaded server holding instances as binary records (see
+  dlite-binrecord.h) in an in-memory cache.  Loads and saves are
+  served directly from and to the cache without decoding the records.
+
+  If a backend storage is given, cache misses are loaded from it and
+  saved instances are written through to it.  Resolving the metadata
+  of these instances requires that it is available to the server, for
+  instance via the DLITE_STORAGES environment variable.  Without a
+  backend, the server is a pure in-memory hub and all instances are
+  kept in the cache.
+ */
+
+#include <stddef.h>
+
+typedef struct _RemoteServer RemoteServer;
+
+/** Default max size in bytes of cached records with a backend. */
+#define REMOTE_CACHE_SIZE ((size_t)256*1024*1024)
+
+/**
+  Returns a new server listening on `host` (may be NULL for all
+  interfaces) and `port`.  `storage` is the url of the backend storage
+  (see dlite_storage_open_url()) or NULL.  `cachesize` is the max
+  number of bytes of cached records when a backend is given.  Zero
+  means REMOTE_CACHE_SIZE.
+
+  Returns NULL on error.
+ */
+RemoteServer *remote_server_create(const char *host, const char *port,
+                                   const char *storage, size_t cachesize);
+
+/** Returns the port the server is listening on. */
+int remote_server_port(const RemoteServer *srv);
+
+/**
+  Serves clients until remote_server_stop() is called.  Returns
+  non-zero on error.
+ */
+int remote_server_run(RemoteServer *srv);
+
+/**
+  Makes remote_server_run() return.  May be called from another thread
+  or a signal handler.
+ */
+void remote_server_stop(RemoteServer *srv);
+
+/**
+  Closes all connections and the backend storage and frees `srv`.
+  Returns non-zero on error.
+ */
+int remote_server_free(RemoteServer *srv);
+
+#endif /* _REMOTE_SERVER_H */
@@ -0,0 +1,363 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "utils/strutils.h"
+#include "utils/thread.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "remote-protocol.h"
+
+#define N 5
+#define NKEYS 16
+
+char *uri = "http://onto-ns.com/meta/0.1/CacheTestEntity";
+char *path = "test-cache.json";
+DLiteMeta *entity=NULL;
+char uuid1[DLITE_UUID_LENGTH+1];
+char uuid2[DLITE_UUID_LENGTH+1];
+
+
+/* A mock Redis server, handling GET, SET and DEL */
+RemoteSocket listener;
+Thread thread;
+char redis[64];
+int stop=0;
+int drop=0;        /* close the connection at the next command */
+int ngets=0;       /* number of GET commands */
+int nhits=0;       /* number of GET commands for existing keys */
+int nsets=0;       /* number of SET commands */
+struct {
+  char *key;
+  char *value;
+  size_t len;
+} entries[NKEYS];
+
+/* Receives exactly `n` bytes.  Returns non-zero on error. */
+static int recv_n(RemoteSocket sock, char *buf, size_t n)
+{
+  while (n > 0) {
+    long m = remote_recv_some(sock, buf, n);
+    if (m <= 0) return 1;
+    buf += m;
+    n -= m;
+  }
+  return 0;
+}
+
+/* Reads a line of the form "<c><number>\r\n" and returns the number,
+   or -1 on error. */
+static long recv_num(RemoteSocket sock, char c)
+{
+  char line[32];
+  size_t n=0;
+  while (n < sizeof(line) - 1) {
+    if (recv_n(sock, line + n, 1)) return -1;
+    if (line[n++] == '\n') break;
+  }
+  line[n] = '\0';
+  if (line[0] != c) return -1;
+  return atol(line + 1);
+}
+
+/* Returns index of entry `key` or -1 if it doesn't exist. */
+static int find(const char *key)
+{
+  int i;
+  for (i=0; i<NKEYS; i++)
+    if (entries[i].key && strcmp(entries[i].key, key) == 0) return i;
+  return -1;
+}
+
+static void *serve(void *arg)
+{
+  UNUSED(arg);
+  while (!stop) {
+    RemoteSocket sock = remote_accept(listener);
+    if (sock == REMOTE_INVALID_SOCKET) continue;
+    while (!stop) {
+      char *args[5], reply[64];
+      size_t lens[5];
+      long i, j, argc, len;
+      if ((argc = recv_num(sock, '*')) < 1 || argc > 5) break;
+      for (i=0; i<argc; i++) {
+        len = recv_num(sock, '$');
+        args[i] = malloc(len + 2);
+        recv_n(sock, args[i], len + 2);
+        args[i][len] = '\0';
+        lens[i] = len;
+      }
+      if (drop) {
+        drop = 0;
+        for (i=0; i<argc; i++) free(args[i]);
+        break;
+      }
+      if (strcmp(args[0], "GET") == 0) {
+        ngets++;
+        if ((j = find(args[1])) >= 0) {
+          nhits++;
+          snprintf(reply, sizeof(reply), "$%zu\r\n", entries[j].len);
+          remote_send_all(sock, reply, strlen(reply));
+          remote_send_all(sock, entries[j].value, entries[j].len);
+          remote_send_all(sock, "\r\n", 2);
+        } else {
+          remote_send_all(sock, "$-1\r\n", 5);
+        }
+      } else if (strcmp(args[0], "SET") == 0) {
+        nsets++;
+        if ((j = find(args[1])) < 0)
+          for (j=0; j<NKEYS-1; j++) if (!entries[j].key) break;
+        if (entries[j].key) free(entries[j].key);
+        if (entries[j].value) free(entries[j].value);
+        entries[j].key = args[1];
+        entries[j].value = args[2];
+        entries[j].len = lens[2];
+        args[1] = args[2] = NULL;
+        remote_send_all(sock, "+OK\r\n", 5);
+      } else if (strcmp(args[0], "DEL") == 0) {
+        if ((j = find(args[1])) >= 0) {
+          free(entries[j].key);
+          free(entries[j].value);
+          entries[j].key = entries[j].value = NULL;
+        }
+        remote_send_all(sock, (j >= 0) ? ":1\r\n" : ":0\r\n", 4);
+      } else {
+        remote_send_all(sock, "-ERR unknown command\r\n", 22);
+      }
+      for (i=0; i<argc; i++) if (args[i]) free(args[i]);
+    }
+    remote_close(sock);
+  }
+  return NULL;
+}
+
+/* Returns a new instance named `name`, where value i is i + offset. */
+static DLiteInstance *new_instance(const char *name, double offset)
+{
+  DLiteInstance *inst;
+  size_t i, dims[] = {N};
+  double *values;
+  if (!(inst = dlite_instance_create(entity, dims, NULL))) return NULL;
+  dlite_instance_set_property(inst, "name", &name);
+  values = dlite_instance_get_property(inst, "values");
+  for (i=0; i<N; i++) values[i] = i + offset;
+  return inst;
+}
+
+/* Returns the number of instances in json file `filename`. */
+static int count(const char *filename)
+{
+  DLiteStorage *s;
+  char **uuids;
+  int n=0;
+  if (!(s = dlite_storage_open("json", filename, "mode=r"))) return -1;
+  if ((uuids = dlite_storage_uuids(s, NULL))) {
+    while (uuids[n]) n++;
+    dlite_storage_uuids_free(uuids);
+  }
+  dlite_storage_close(s);
+  return n;
+}
+
+/* Returns a newly allocated cache key for `uuid`. */
+static char *key(const char *uuid)
+{
+  return aprintf("dlite:%s", uuid);
+}
+
+
+MU_TEST(test_start)
+{
+  int port;
+  mu_assert_int_eq(0, remote_init());
+  mu_check((listener = remote_listen("127.0.0.1", "0", &port)) !=
+           REMOTE_INVALID_SOCKET);
+  snprintf(redis, sizeof(redis), "redis=127.0.0.1:%d", port);
+  mu_assert_int_eq(0, thread_create(&thread, serve, NULL));
+}
+
+MU_TEST(test_create)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of values."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims unit iri  descr */
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "",  NULL, "Name."},
+    {"values", dliteFloat,     sizeof(double), 1, dims, "m", NULL, "Values."}
+  };
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Test entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    2, properties)));
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  char *k;
+  mu_check((s = dlite_storage_open("cache", "json://test-cache.json?mode=w",
+                                   redis)));
+  mu_check((inst = new_instance("first", 0.0)));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  strcpy(uuid1, inst->uuid);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* write-through: the instance is both cached and in the backend */
+  mu_assert_int_eq(1, nsets);
+  mu_check((k = key(uuid1)));
+  mu_check(find(k) >= 0);
+  free(k);
+  mu_check((s = dlite_storage_open("json", path, "mode=r")));
+  mu_check((inst = dlite_instance_load(s, uuid1)));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_load)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  double *values;
+  char *k;
+  int i;
+  mu_check((s = dlite_storage_open("cache", "json://test-cache.json?mode=r",
+                                   redis)));
+  mu_assert_int_eq(0, dlite_storage_is_writable(s));
+
+  /* cache hit */
+  mu_check((inst = dlite_instance_load(s, uuid1)));
+  mu_assert_int_eq(1, nhits);
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(3.0, values[3]);
+  dlite_instance_decref(inst);
+
+  /* read-through after invalidation */
+  mu_check((k = key(uuid1)));
+  free(entries[(i = find(k))].key);
+  free(entries[i].value);
+  entries[i].key = entries[i].value = NULL;
+  mu_check((inst = dlite_instance_load(s, uuid1)));
+  mu_assert_int_eq(1, nhits);
+  mu_assert_int_eq(2, nsets);
+  mu_check(find(k) >= 0);
+  free(k);
+  mu_assert_string_eq("first",
+                      *(char **)dlite_instance_get_property(inst, "name"));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_write_behind)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  char *k, *options = aprintf("%s;write=behind;ttl=0", redis);
+  mu_check((s = dlite_storage_open("cache", "json://test-cache.json?mode=a",
+                                   options)));
+  mu_check((inst = new_instance("second", 10.0)));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  strcpy(uuid2, inst->uuid);
+  dlite_instance_decref(inst);
+
+  /* cached, but not yet in the backend */
+  mu_assert_int_eq(3, nsets);
+  mu_check((k = key(uuid2)));
+  mu_check(find(k) >= 0);
+  free(k);
+  mu_assert_int_eq(1, count(path));
+
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_assert_int_eq(2, count(path));
+  free(options);
+}
+
+MU_TEST(test_iter)
+{
+  DLiteStorage *s;
+  char **uuids;
+  int n=0;
+  mu_check((s = dlite_storage_open("cache", "json://test-cache.json?mode=r",
+                                   redis)));
+  mu_check((uuids = dlite_storage_uuids(s, NULL)));
+  while (uuids[n]) n++;
+  mu_assert_int_eq(2, n);
+  dlite_storage_uuids_free(uuids);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_errors)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  char *options;
+  err_clear();
+
+  /* a failing cache falls back to the backend */
+  mu_check((s = dlite_storage_open("cache", "json://test-cache.json?mode=r",
+                                   redis)));
+  drop = 1;
+  mu_check((inst = dlite_instance_load(s, uuid1)));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  mu_check((options = aprintf("%s;ttl=-1", redis)));
+  mu_check(!dlite_storage_open("cache", "json://test-cache.json?mode=r",
+                               options));
+  free(options);
+  mu_check((options = aprintf("%s;write=later", redis)));
+  mu_check(!dlite_storage_open("cache", "json://test-cache.json?mode=r",
+                               options));
+  free(options);
+  mu_check(!dlite_storage_open("cache", "json://test-cache.json?mode=r",
+                               "redis=127.0.0.1:1"));
+  err_clear();
+}
+
+MU_TEST(test_stop)
+{
+  RemoteSocket sock;
+  char port[16];
+  int i;
+  stop = 1;
+  snprintf(port, sizeof(port), "%s", strrchr(redis, ':') + 1);
+  sock = remote_connect("127.0.0.1", port);  /* wake up accept() */
+  mu_assert_int_eq(0, thread_join(thread, NULL));
+  remote_close(sock);
+  remote_close(listener);
+  for (i=0; i<NKEYS; i++) {
+    if (entries[i].key) free(entries[i].key);
+    if (entries[i].value) free(entries[i].value);
+  }
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_start);      /* setup */
+  MU_RUN_TEST(test_create);
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_write_behind);
+  MU_RUN_TEST(test_iter);
+  MU_RUN_TEST(test_errors);
+  MU_RUN_TEST(test_stop);       /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "utils/strutils.h"
+#include "utils/thread.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "remote-server.h"
+
+#define N 5
+#define NINST 40
+
+char *uri = "http://onto-ns.com/meta/0.1/RemoteTestEntity";
+DLiteMeta *entity=NULL;
+RemoteServer *server=NULL;
+Thread thread;
+char location[64];
+char uuids[NINST][DLITE_UUID_LENGTH+1];
+
+
+static void *serve(void *arg)
+{
+  remote_server_run(arg);
+  return NULL;
+}
+
+MU_TEST(test_start)
+{
+  mu_check((server = remote_server_create("127.0.0.1", "0", NULL, 0)));
+  mu_check(remote_server_port(server) > 0);
+  snprintf(location, sizeof(location), "127.0.0.1:%d",
+           remote_server_port(server));
+  mu_assert_int_eq(0, thread_create(&thread, serve, server));
+}
+
+MU_TEST(test_create)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of values."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims unit iri  descr */
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "",  NULL, "Name."},
+    {"values", dliteFloat,     sizeof(double), 1, dims, "m", NULL, "Values."}
+  };
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Test entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    2, properties)));
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  size_t dims[] = {N};
+  int i, j;
+  mu_check((s = dlite_storage_open("remote", location, "window=4")));
+  mu_assert_int_eq(0, dlite_instance_save(s, (DLiteInstance *)entity));
+
+  /* Saves are pipelined, so more saves than the window are in flight */
+  for (i=0; i<NINST; i++) {
+    DLiteInstance *inst;
+    char *name = aprintf("inst%d", i);
+    double *values;
+    mu_check((inst = dlite_instance_create(entity, dims, NULL)));
+    mu_assert_int_eq(0, dlite_instance_set_property(inst, "name", &name));
+    values = dlite_instance_get_property(inst, "values");
+    for (j=0; j<N; j++) values[j] = i*10.0 + j;
+    mu_assert_int_eq(0, dlite_instance_save(s, inst));
+    strcpy(uuids[i], inst->uuid);
+    dlite_instance_decref(inst);
+    free(name);
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_load)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  double *values;
+  int i;
+  mu_check((s = dlite_storage_open("remote", location, "mode=r")));
+  for (i=0; i<NINST; i+=7) {
+    mu_check((inst = dlite_instance_load(s, uuids[i])));
+    mu_assert_string_eq(uuids[i], inst->uuid);
+    mu_assert_int_eq(N, dlite_instance_get_dimension_size(inst, "N"));
+    values = dlite_instance_get_property(inst, "values");
+    mu_assert_double_eq(i*10.0 + 3, values[3]);
+    dlite_instance_decref(inst);
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_load_many)
+{
+  DLiteStorage *s;
+  DLiteInstance **insts;
+  const char *ids[NINST];
+  char name[16];
+  int i;
+  for (i=0; i<NINST; i++) ids[i] = uuids[i];
+  mu_check((s = dlite_storage_open("remote", location, NULL)));
+  mu_check((insts = dlite_instance_load_many(s, ids, NINST)));
+  for (i=0; i<NINST; i++) {
+    snprintf(name, sizeof(name), "inst%d", i);
+    mu_assert_string_eq(name,
+                        *(char **)dlite_instance_get_property(insts[i],
+                                                              "name"));
+    dlite_instance_decref(insts[i]);
+  }
+  free(insts);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_uuids)
+{
+  DLiteStorage *s;
+  char **ids;
+  int n=0;
+  mu_check((s = dlite_storage_open("remote", location, "mode=r")));
+  mu_check((ids = dlite_storage_uuids(s, uri)));
+  while (ids[n]) n++;
+  mu_assert_int_eq(NINST, n);
+  dlite_storage_uuids_free(ids);
+
+  mu_check((ids = dlite_storage_uuids(s, "http://onto-ns.com/meta/*")));
+  n = 0;
+  while (ids[n]) n++;
+  mu_assert_int_eq(NINST + 1, n);  /* the entity is an instance too */
+  dlite_storage_uuids_free(ids);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_errors)
+{
+  DLiteStorage *s;
+  err_clear();
+  mu_check((s = dlite_storage_open("remote", location, NULL)));
+  mu_check(!dlite_instance_load(s, "no-such-instance"));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  mu_check(!dlite_storage_open("remote", location, "mode=x"));
+  mu_check(!dlite_storage_open("remote", location, "window=0"));
+  mu_check(!dlite_storage_open("remote", "127.0.0.1:1", NULL));
+  err_clear();
+}
+
+MU_TEST(test_stop)
+{
+  remote_server_stop(server);
+  mu_assert_int_eq(0, thread_join(thread, NULL));
+  mu_assert_int_eq(0, remote_server_free(server));
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_start);      /* setup */
+  MU_RUN_TEST(test_create);
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_load_many);
+  MU_RUN_TEST(test_uuids);
+  MU_RUN_TEST(test_errors);
+  MU_RUN_TEST(test_stop);       /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
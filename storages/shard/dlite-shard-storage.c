@@ -0,0 +1,736 @@
+/* dlite-shard-storage.c -- DLite storage plugin distributing instances
+   over several storages */
+
+/*
+  This plugin is a meta-storage, that distributes instances over a set
+  of underlying storages (shards) by consistent hashing of their UUID.
+  It is intended for collections that are too large or too busy for a
+  single file or database.
+
+  The location is a list of storage urls separated by whitespace or
+  "|", like
+
+      dlite_storage_open("shard",
+                         "json://a.json?mode=a | json://b.json?mode=a",
+                         "vnodes=128");
+
+  Each shard is placed on a hash ring at `vnodes` points derived from
+  its url without options.  An instance is owned by the shard at the
+  first point following the hash of its UUID.  Adding a shard hence
+  only moves the instances that the new shard takes over, which is
+  approximately 1/N of them.  The order of the urls does not matter.
+
+  - Single loads and saves are routed to the owning shard.  If an
+    instance is not found in its owner, the other shards are tried,
+    such that instances remain available after shards are added and
+    before they are rebalanced.
+  - Batch loads and saves are split per shard and dispatched to the
+    shards in parallel threads.
+  - Iteration is the union of all shards.  Instances stored in more
+    than one shard are only returned once.
+
+  Rebalancing is done by opening the storage with `rebalance=true`
+  after adding a shard.  All instances that are not stored in their
+  owner are then copied to it.  Since the storage plugin API has no
+  way to delete instances, the old copies are left in place.  They
+  are not returned twice by the iterator, but takes up space until
+  they are removed with the tools of the underlying storage.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/strtob.h"
+#include "utils/strutils.h"
+#include "utils/thread.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+/* Characters separating urls in the location */
+#define SEPARATORS " \t\r\n|"
+
+/* Point on the hash ring */
+typedef struct {
+  uint64_t hash;            /* Position on the ring */
+  int shard;                /* Index of the shard owning the position */
+} RingNode;
+
+/* Storage distributing instances over shards */
+typedef struct {
+  DLiteStorage_HEAD
+  DLiteStorage **shards;    /* Underlying storages */
+  char **urls;              /* Urls of the shards */
+  int nshards;              /* Number of shards */
+  RingNode *ring;           /* Sorted hash ring */
+  size_t nring;             /* Number of points on the ring */
+  int parallel;             /* Whether to dispatch batches in parallel */
+} ShardStorage;
+
+/* Union iterator over all shards */
+typedef struct {
+  const ShardStorage *ss;
+  char *pattern;            /* Metadata pattern, may be NULL */
+  int k;                    /* Index of current shard */
+  void *iter;               /* Iterator over current shard */
+  map_int_t seen;           /* UUIDs returned so far */
+} ShardIter;
+
+/* Batch of instances to load from or save to one shard */
+typedef struct {
+  DLiteStorage *shard;
+  size_t n;                 /* Number of instances */
+  size_t *index;            /* Index of each instance in the full batch */
+  const char **ids;         /* Ids to load */
+  const DLiteInstance **insts;  /* Instances to save */
+  DLiteInstance **result;   /* Loaded instances */
+  int stat;                 /* Non-zero on error */
+  char errmsg[256];         /* Error message */
+} ShardTask;
+
+
+/* Returns a 64-bit hash of the `len` first bytes of `s`.  This is
+   FNV-1a followed by the finaliser of MurmurHash3, which spreads
+   keys that only differ in their last bytes over the whole ring. */
+static uint64_t hash64(const char *s, size_t len)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  size_t i;
+  for (i=0; i<len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 0x100000001b3ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* qsort() comparison function for ring nodes. */
+static int ring_cmp(const void *a, const void *b)
+{
+  const RingNode *p = a, *q = b;
+  if (p->hash < q->hash) return -1;
+  if (p->hash > q->hash) return 1;
+  return p->shard - q->shard;
+}
+
+/* Returns the index of the shard owning instance `uuid`. */
+static int owner(const ShardStorage *ss, const char *uuid)
+{
+  uint64_t h = hash64(uuid, strlen(uuid));
+  size_t lo=0, hi=ss->nring;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (ss->ring[mid].hash < h)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return ss->ring[(lo < ss->nring) ? lo : 0].shard;
+}
+
+/* Returns the length of the part of `url` identifying the shard on the
+   ring, i.e. without options. */
+static size_t keylen(const char *url)
+{
+  return strcspn(url, "?#");
+}
+
+/* Adds `vnodes` points for each shard to the hash ring.  Returns
+   non-zero on error. */
+static int build_ring(ShardStorage *ss, int vnodes)
+{
+  int i, j;
+  size_t n=0;
+  if (!(ss->ring = calloc(ss->nshards * vnodes, sizeof(RingNode))))
+    return err(1, "allocation failure");
+  for (i=0; i<ss->nshards; i++) {
+    size_t len = keylen(ss->urls[i]);
+    for (j=0; j<i; j++)
+      if (keylen(ss->urls[j]) == len &&
+          strncmp(ss->urls[i], ss->urls[j], len) == 0)
+        return errx(1, "shard: same location used for several shards: %.*s",
+                    (int)len, ss->urls[i]);
+    for (j=0; j<vnodes; j++) {
+      char *key = aprintf("%.*s#%d", (int)len, ss->urls[i], j);
+      if (!key) return err(1, "allocation failure");
+      ss->ring[n].hash = hash64(key, strlen(key));
+      ss->ring[n].shard = i;
+      n++;
+      free(key);
+    }
+  }
+  qsort(ss->ring, n, sizeof(RingNode), ring_cmp);
+  ss->nring = n;
+  return 0;
+}
+
+/* Thread function loading the instances in a task. */
+static void *load_worker(void *arg)
+{
+  ShardTask *task = arg;
+  ErrTry:
+    task->result = dlite_instance_load_many(task->shard, task->ids, task->n);
+  ErrOther:
+    snprintf(task->errmsg, sizeof(task->errmsg), "%s", err_getmsg());
+  ErrEnd;
+  task->stat = (task->result) ? 0 : 1;
+  return NULL;
+}
+
+/* Thread function saving the instances in a task. */
+static void *save_worker(void *arg)
+{
+  ShardTask *task = arg;
+  ErrTry:
+    task->stat = dlite_instance_save_many(task->shard, task->insts, task->n);
+  ErrOther:
+    snprintf(task->errmsg, sizeof(task->errmsg), "%s", err_getmsg());
+    task->stat = 1;
+  ErrEnd;
+  return NULL;
+}
+
+/* Runs `func` on the non-empty tasks in `tasks`.  If `parallel` is
+   non-zero, each task runs in its own thread.  The current thread runs
+   the last task and tasks for which no thread could be started. */
+static void run_tasks(ShardTask *tasks, size_t ntasks, ThreadFunc func,
+                      int parallel)
+{
+  Thread *threads=NULL;
+  int *started=NULL;
+  size_t i, last=0;
+  for (i=0; i<ntasks; i++)
+    if (tasks[i].n) last = i;
+  if (parallel && ntasks > 1) {
+    threads = calloc(ntasks, sizeof(Thread));
+    started = calloc(ntasks, sizeof(int));
+  }
+  for (i=0; i<ntasks; i++) {
+    if (!tasks[i].n) continue;
+    if (threads && started && i < last &&
+        thread_create(threads + i, func, tasks + i) == 0)
+      started[i] = 1;
+    else
+      func(tasks + i);
+  }
+  for (i=0; started && i<ntasks; i++)
+    if (started[i]) thread_join(threads[i], NULL);
+  if (threads) free(threads);
+  if (started) free(started);
+}
+
+/* Splits the `n` instances with UUIDs `uuids` into one task per shard.
+   Returns a newly allocated array of `ss->nshards` tasks or NULL on
+   error.  Free it with free_tasks(). */
+static ShardTask *split_tasks(const ShardStorage *ss, char (*uuids)[DLITE_UUID_LENGTH+1],
+                              size_t n)
+{
+  ShardTask *tasks;
+  size_t i;
+  int *owners, k;
+  if (!(tasks = calloc(ss->nshards, sizeof(ShardTask))))
+    return err(1, "allocation failure"), NULL;
+  if (!(owners = calloc((n) ? n : 1, sizeof(int)))) {
+    free(tasks);
+    return err(1, "allocation failure"), NULL;
+  }
+  for (i=0; i<n; i++) tasks[owners[i] = owner(ss, uuids[i])].n++;
+  for (k=0; k<ss->nshards; k++) {
+    tasks[k].shard = ss->shards[k];
+    if (!(tasks[k].index = calloc(tasks[k].n + 1, sizeof(size_t)))) {
+      while (k-- > 0) free(tasks[k].index);
+      free(tasks);
+      free(owners);
+      return err(1, "allocation failure"), NULL;
+    }
+    tasks[k].n = 0;
+  }
+  for (i=0; i<n; i++) {
+    ShardTask *task = tasks + owners[i];
+    task->index[task->n++] = i;
+  }
+  free(owners);
+  return tasks;
+}
+
+/* Frees tasks created with split_tasks(). */
+static void free_tasks(ShardTask *tasks, int ntasks)
+{
+  int k;
+  for (k=0; k<ntasks; k++) {
+    if (tasks[k].index) free(tasks[k].index);
+    if (tasks[k].ids) free(tasks[k].ids);
+    if (tasks[k].insts) free(tasks[k].insts);
+    if (tasks[k].result) free(tasks[k].result);
+  }
+  free(tasks);
+}
+
+/* Copies all instances that are not stored in their owner to it.
+   Returns the number of copied instances or -1 on error. */
+static int rebalance(ShardStorage *ss)
+{
+  map_int_t placed;
+  char (*uuids)[DLITE_UUID_LENGTH+1]=NULL;
+  int *where=NULL, stat, k, copied=0, retval=-1;
+  size_t i, n=0, size=0;
+  void *iter;
+
+  /* Collect where all instances are stored and which of them are
+     stored in their owner */
+  map_init(&placed);
+  for (k=0; k<ss->nshards; k++) {
+    if (!(iter = dlite_storage_iter_create(ss->shards[k], NULL))) goto fail;
+    while (1) {
+      if (n >= size) {
+        size_t newsize = (size) ? 2*size : 64;
+        void *p = realloc(uuids, newsize*sizeof(*uuids));
+        void *q = realloc(where, newsize*sizeof(int));
+        if (p) uuids = p;
+        if (q) where = q;
+        if (!p || !q) {
+          dlite_storage_iter_free(ss->shards[k], iter);
+          FAIL("allocation failure");
+        }
+        size = newsize;
+      }
+      if ((stat = dlite_storage_iter_next(ss->shards[k], iter, uuids[n])))
+        break;
+      where[n] = k;
+      if (owner(ss, uuids[n]) == k) map_set(&placed, uuids[n], 1);
+      n++;
+    }
+    dlite_storage_iter_free(ss->shards[k], iter);
+    if (stat < 0) goto fail;
+  }
+
+  /* Copy misplaced instances */
+  for (i=0; i<n; i++) {
+    DLiteInstance *inst;
+    int o = owner(ss, uuids[i]);
+    if (o == where[i] || map_get(&placed, uuids[i])) continue;
+    if (!(inst = dlite_instance_load(ss->shards[where[i]], uuids[i])))
+      goto fail;
+    stat = dlite_instance_save(ss->shards[o], inst);
+    dlite_instance_decref(inst);
+    if (stat) goto fail;
+    map_set(&placed, uuids[i], 1);
+    copied++;
+  }
+  retval = copied;
+ fail:
+  map_deinit(&placed);
+  if (uuids) free(uuids);
+  if (where) free(where);
+  return retval;
+}
+
+/* Closes all shards and frees the memory they occupy in `ss`.
+   Returns non-zero on error. */
+static int free_shards(ShardStorage *ss)
+{
+  int k, stat=0;
+  for (k=0; k<ss->nshards; k++) {
+    if (ss->shards[k] && dlite_storage_close(ss->shards[k])) stat = 1;
+    if (ss->urls[k]) free(ss->urls[k]);
+  }
+  if (ss->shards) free(ss->shards);
+  if (ss->urls) free(ss->urls);
+  if (ss->ring) free(ss->ring);
+  return stat;
+}
+
+
+/**
+  Returns a new storage distributing instances over the storages
+  listed in `location`, separated by whitespace or "|".
+
+  Valid `options` are:
+
+  - mode : append | r
+      Valid values are:
+      - append   Load and save instances (default)
+      - r        Read-only
+  - vnodes : Number of points on the hash ring per shard (default 64).
+      More points gives a more even distribution.  Must be the same
+      each time the storage is opened.
+  - parallel : Whether to dispatch batch loads and saves to the
+      shards in parallel threads (default true).
+  - rebalance : Whether to copy instances that are not stored in
+      their owner to it when the storage is opened (default false).
+      Use this after adding a shard.
+
+  Returns NULL on error.
+ */
+DLiteStorage *shard_open(const DLiteStoragePlugin *api, const char *location,
+                         const char *options)
+{
+  ShardStorage *ss=NULL;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"append\" (load and save instances, default); "
+    "\"r\" (read-only)";
+  DLiteOpt opts[] = {
+    {'m', "mode",      "append", mode_descr},
+    {'v', "vnodes",    "64",     "Number of points on the ring per shard."},
+    {'p', "parallel",  "true",   "Whether to dispatch batches in parallel."},
+    {'r', "rebalance", "false",  "Whether to copy misplaced instances to "
+                                 "their owner."},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  char *endptr;
+  const char *mode, *p;
+  size_t len;
+  long vnodes;
+  int k, n, reb;
+  UNUSED(api);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+  vnodes = strtol(opts[1].value, &endptr, 10);
+  if (*endptr || endptr == opts[1].value || vnodes < 1 || vnodes > 65536)
+    FAIL1("shard: invalid \"vnodes\" value: '%s'", opts[1].value);
+  if (!(ss = calloc(1, sizeof(ShardStorage)))) FAIL("allocation failure");
+  if ((ss->parallel = atob(opts[2].value)) < 0)
+    FAIL1("shard: invalid boolean value for \"parallel\": '%s'",
+          opts[2].value);
+  if ((reb = atob(opts[3].value)) < 0)
+    FAIL1("shard: invalid boolean value for \"rebalance\": '%s'",
+          opts[3].value);
+  if (strcmp(mode, "append") == 0 || strcmp(mode, "a") == 0) {
+    ss->writable = 1;
+  } else if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    ss->writable = 0;
+  } else {
+    FAIL1("invalid \"mode\" value: '%s'. Must be \"append\" or \"r\" "
+          "(read-only)", mode);
+  }
+
+  /* Open shards */
+  for (n=0, p=location; *(p += strspn(p, SEPARATORS)); n++)
+    p += strcspn(p, SEPARATORS);
+  if (!n) FAIL1("shard: no storage urls in location: '%s'", location);
+  if (!(ss->shards = calloc(n, sizeof(DLiteStorage *))) ||
+      !(ss->urls = calloc(n, sizeof(char *))))
+    FAIL("allocation failure");
+  for (p=location; *(p += strspn(p, SEPARATORS)); p += len) {
+    len = strcspn(p, SEPARATORS);
+    k = ss->nshards++;
+    if (!(ss->urls[k] = strndup(p, len))) FAIL("allocation failure");
+    if (!(ss->shards[k] = dlite_storage_open_url(ss->urls[k]))) goto fail;
+    if (!dlite_storage_is_writable(ss->shards[k])) ss->writable = 0;
+  }
+  if (build_ring(ss, vnodes)) goto fail;
+
+  if (reb) {
+    if (!ss->writable)
+      FAIL1("shard: cannot rebalance read-only storage: %s", location);
+    if (rebalance(ss) < 0) goto fail;
+  }
+
+  ss->idflag = dliteIDTranslateToUUID;
+  retval = (DLiteStorage *)ss;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && ss) {
+    free_shards(ss);
+    free(ss);
+  }
+  return retval;
+}
+
+
+/**
+  Closes all shards of storage `s`.  Returns non-zero on error.
+ */
+int shard_close(DLiteStorage *s)
+{
+  return free_shards((ShardStorage *)s);
+}
+
+
+/**
+  Returns a new iterator over all instances in all shards whose
+  metadata matches `pattern`.
+ */
+void *shard_iter_create(const DLiteStorage *s, const char *pattern)
+{
+  ShardIter *iter;
+  if (!(iter = calloc(1, sizeof(ShardIter))))
+    return err(1, "allocation failure"), NULL;
+  iter->ss = (const ShardStorage *)s;
+  if (pattern && !(iter->pattern = strdup(pattern))) {
+    free(iter);
+    return err(1, "allocation failure"), NULL;
+  }
+  map_init(&iter->seen);
+  return iter;
+}
+
+/**
+  Writes the uuid of the next instance to `buf`.  Returns zero on
+  success, 1 if there are no more instances and a negative value on
+  error.
+ */
+int shard_iter_next(void *iter, char *buf)
+{
+  ShardIter *it = iter;
+  int stat;
+  while (it->k < it->ss->nshards) {
+    DLiteStorage *shard = it->ss->shards[it->k];
+    if (!it->iter &&
+        !(it->iter = dlite_storage_iter_create(shard, it->pattern)))
+      return -1;
+    if ((stat = dlite_storage_iter_next(shard, it->iter, buf)) < 0)
+      return stat;
+    if (stat == 0) {
+      if (map_get(&it->seen, buf)) continue;
+      map_set(&it->seen, buf, 1);
+      return 0;
+    }
+    dlite_storage_iter_free(shard, it->iter);
+    it->iter = NULL;
+    it->k++;
+  }
+  return 1;
+}
+
+/**
+  Frees iterator.
+ */
+void shard_iter_free(void *iter)
+{
+  ShardIter *it = iter;
+  if (it->iter) dlite_storage_iter_free(it->ss->shards[it->k], it->iter);
+  if (it->pattern) free(it->pattern);
+  map_deinit(&it->seen);
+  free(it);
+}
+
+
+/**
+  Loads instance `id` from its owning shard.  If it is not found
+  there, the other shards are tried.  NULL is returned on error.
+ */
+DLiteInstance *shard_load(const DLiteStorage *s, const char *id)
+{
+  const ShardStorage *ss = (const ShardStorage *)s;
+  DLiteInstance *inst=NULL;
+  char uuid[DLITE_UUID_LENGTH+1], errmsg[256]="";
+  int k, o;
+  if (!id || !*id)
+    return errx(1, "id is required when loading from a shard storage"), NULL;
+  if (dlite_get_uuid(uuid, id) < 0) return NULL;
+  o = owner(ss, uuid);
+  ErrTry:
+    inst = dlite_instance_load(ss->shards[o], id);
+  ErrOther:
+    snprintf(errmsg, sizeof(errmsg), "%s", err_getmsg());
+  ErrEnd;
+  for (k=0; !inst && k<ss->nshards; k++) {
+    if (k == o) continue;
+    ErrTry:
+      inst = dlite_instance_load(ss->shards[k], id);
+    ErrEnd;
+  }
+  if (!inst)
+    errx(1, "shard: cannot load '%s' from %s: %s", id, ss->urls[o], errmsg);
+  return inst;
+}
+
+
+/**
+  Saves instance `inst` to its owning shard.  Returns non-zero on error.
+ */
+int shard_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  ShardStorage *ss = (ShardStorage *)s;
+  return dlite_instance_save(ss->shards[owner(ss, inst->uuid)], inst);
+}
+
+
+/**
+  Loads the `n` instances in `ids`.  The ids are split by owner and
+  loaded from the shards in parallel.  Instances not found in their
+  owner are looked up in the other shards.
+
+  Returns a newly allocated array of new references or NULL on error.
+ */
+DLiteInstance **shard_load_many(const DLiteStorage *s, const char **ids,
+                                size_t n)
+{
+  const ShardStorage *ss = (const ShardStorage *)s;
+  DLiteInstance **insts=NULL, **retval=NULL;
+  ShardTask *tasks=NULL;
+  char (*uuids)[DLITE_UUID_LENGTH+1]=NULL;
+  size_t i, j;
+  int k;
+
+  if (!(insts = calloc((n) ? n : 1, sizeof(DLiteInstance *))) ||
+      !(uuids = calloc((n) ? n : 1, sizeof(*uuids))))
+    FAIL("allocation failure");
+  for (i=0; i<n; i++)
+    if (!ids[i] || dlite_get_uuid(uuids[i], ids[i]) < 0)
+      FAIL1("shard: invalid id: '%s'", (ids[i]) ? ids[i] : "(null)");
+  if (!(tasks = split_tasks(ss, uuids, n))) goto fail;
+  for (k=0; k<ss->nshards; k++) {
+    ShardTask *task = tasks + k;
+    if (!(task->ids = calloc(task->n + 1, sizeof(char *))))
+      FAIL("allocation failure");
+    for (j=0; j<task->n; j++) task->ids[j] = ids[task->index[j]];
+  }
+  run_tasks(tasks, ss->nshards, load_worker, ss->parallel);
+
+  /* Collect results.  Failed batches are retried one by one, falling
+     back to the other shards. */
+  for (k=0; k<ss->nshards; k++) {
+    ShardTask *task = tasks + k;
+    for (j=0; j<task->n; j++) {
+      if (task->result)
+        insts[task->index[j]] = task->result[j];
+      else if (!(insts[task->index[j]] = shard_load(s, task->ids[j])))
+        goto fail;
+    }
+  }
+  retval = insts;
+ fail:
+  if (!retval && insts) {
+    for (i=0; i<n; i++)
+      if (insts[i]) dlite_instance_decref(insts[i]);
+    /* decref instances loaded by later batches that were not collected */
+    for (k=0; tasks && k<ss->nshards; k++)
+      for (j=0; tasks[k].result && j<tasks[k].n; j++)
+        if (!insts[tasks[k].index[j]])
+          dlite_instance_decref(tasks[k].result[j]);
+    free(insts);
+  }
+  if (tasks) free_tasks(tasks, ss->nshards);
+  if (uuids) free(uuids);
+  return retval;
+}
+
+
+/**
+  Saves the `n` instances in `insts`.  The instances are split by
+  owner and saved to the shards in parallel.  Returns non-zero on error.
+ */
+int shard_save_many(DLiteStorage *s, const DLiteInstance **insts, size_t n)
+{
+  ShardStorage *ss = (ShardStorage *)s;
+  ShardTask *tasks=NULL;
+  char (*uuids)[DLITE_UUID_LENGTH+1]=NULL;
+  size_t i, j;
+  int k, retval=1;
+
+  if (!(uuids = calloc((n) ? n : 1, sizeof(*uuids))))
+    FAIL("allocation failure");
+  for (i=0; i<n; i++) strcpy(uuids[i], insts[i]->uuid);
+  if (!(tasks = split_tasks(ss, uuids, n))) goto fail;
+  for (k=0; k<ss->nshards; k++) {
+    ShardTask *task = tasks + k;
+    if (!(task->insts = calloc(task->n + 1, sizeof(DLiteInstance *))))
+      FAIL("allocation failure");
+    for (j=0; j<task->n; j++) task->insts[j] = insts[task->index[j]];
+  }
+  run_tasks(tasks, ss->nshards, save_worker, ss->parallel);
+  for (k=0; k<ss->nshards; k++)
+    if (tasks[k].stat)
+      FAIL2("shard: cannot save to %s: %s", ss->urls[k], tasks[k].errmsg);
+  retval = 0;
+ fail:
+  if (tasks) free_tasks(tasks, ss->nshards);
+  if (uuids) free(uuids);
+  return retval;
+}
+
+
+static DLiteStoragePlugin shard_plugin = {
+  /* head */
+  "shard",                     /* name */
+  NULL,                        /* freeapi */
+
+  /* basic api */
+  shard_open,                  /* open */
+  shard_close,                 /* close */
+
+  /* queue api */
+  shard_iter_create,           /* iterCreate */
+  shard_iter_next,             /* iterNext */
+  shard_iter_free,             /* iterFree */
+  NULL,                        /* getUUIDs */
+
+  /* direct api */
+  shard_load,                  /* loadInstance */
+  shard_save,                  /* saveInstance */
+  shard_load_many,             /* loadInstances */
+  shard_save_many,             /* saveInstances */
+
+  /* datamodel api */
+  NULL,                        /* dataModel */
+  NULL,                        /* dataModelFree */
+
+  NULL,                        /* getMetaURI */
+  NULL,                        /* resolveDimensions */
+  NULL,                        /* getDimensionSize */
+  NULL,                        /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                        /* setMetaURI */
+  NULL,                        /* setDimensionSize */
+  NULL,                        /* setProperty */
+
+  NULL,                        /* hasDimension */
+  NULL,                        /* hasProperty */
+  NULL,                        /* getPropertySlice */
+
+  NULL,                        /* getDataName */
+  NULL,                        /* setDataName */
+
+  /* internal data */
+  NULL,                        /* data */
+
+  /* capabilities */
+  0,                           /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                        /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                        /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                        /* saveView */
+  NULL,                        /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                        /* loadInstanceAsync */
+  NULL,                        /* saveInstanceAsync */
+  NULL,                        /* asyncFd */
+  NULL,                        /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                        /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                         /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &shard_plugin;
+}
@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "utils/strutils.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+
+#define NSHARDS 4
+#define N 60
+
+char *uri = "http://onto-ns.com/meta/0.1/ShardTestEntity";
+DLiteMeta *entity=NULL;
+char paths[NSHARDS][64];
+char uuids[2*N][DLITE_UUID_LENGTH+1];
+
+
+/* Returns the location of a shard storage with the `n` first shards. */
+static char *location(int n)
+{
+  char *loc=NULL;
+  int i;
+  for (i=0; i<n; i++) {
+    char *p = aprintf("%s bin://%s?mode=a", (loc) ? loc : "", paths[i]);
+    if (loc) free(loc);
+    loc = p;
+  }
+  return loc;
+}
+
+/* Returns the number of instances in storage `s`. */
+static int count(DLiteStorage *s)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  void *iter;
+  int n=0;
+  if (!(iter = dlite_storage_iter_create(s, NULL))) return -1;
+  while (dlite_storage_iter_next(s, iter, uuid) == 0) n++;
+  dlite_storage_iter_free(s, iter);
+  return n;
+}
+
+/* Returns the number of instances in shard `i`. */
+static int count_shard(int i)
+{
+  DLiteStorage *s;
+  int n;
+  if (!(s = dlite_storage_open("bin", paths[i], "mode=r"))) return -1;
+  n = count(s);
+  dlite_storage_close(s);
+  return n;
+}
+
+/* Returns a new instance with value `i`. */
+static DLiteInstance *new_instance(int i)
+{
+  DLiteInstance *inst;
+  size_t dims[] = {3};
+  double *values;
+  if (!(inst = dlite_instance_create(entity, dims, NULL))) return NULL;
+  dlite_instance_set_property(inst, "index", &i);
+  values = dlite_instance_get_property(inst, "values");
+  values[0] = i;
+  values[2] = -i;
+  return inst;
+}
+
+
+MU_TEST(test_create)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of values."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type        size            ndims dims  unit iri  descr */
+    {"index",  dliteInt,   sizeof(int),    0,    NULL, "",  NULL, "Index."},
+    {"values", dliteFloat, sizeof(double), 1,    dims, "K", NULL, "Values."}
+  };
+  int i;
+  for (i=0; i<NSHARDS; i++) {
+    snprintf(paths[i], sizeof(paths[i]), "test-shard-%d-%d.bin",
+             (int)getpid(), i);
+    remove(paths[i]);
+  }
+  mu_check((entity = dlite_meta_create(uri, NULL, "Test entity.",
+                                       1, dimensions, 2, properties)));
+}
+
+
+MU_TEST(test_save_load)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  char *loc = location(3);
+  int i, n, total=0;
+
+  mu_check((s = dlite_storage_open("shard", loc, NULL)));
+  mu_check(dlite_storage_is_writable(s));
+  for (i=0; i<N; i++) {
+    mu_check((inst = new_instance(i)));
+    strcpy(uuids[i], inst->uuid);
+    mu_check(0 == dlite_instance_save(s, inst));
+    dlite_instance_decref(inst);
+  }
+  mu_check(0 == dlite_storage_close(s));
+
+  /* all shards got a share of the instances */
+  for (i=0; i<3; i++) {
+    n = count_shard(i);
+    mu_check(n > N/10);
+    total += n;
+  }
+  mu_assert_int_eq(N, total);
+
+  mu_check((s = dlite_storage_open("shard", loc, "mode=r")));
+  mu_check(!dlite_storage_is_writable(s));
+  for (i=0; i<N; i++) {
+    mu_check((inst = dlite_instance_load(s, uuids[i])));
+    mu_assert_int_eq(i, *(int *)dlite_instance_get_property(inst, "index"));
+    dlite_instance_decref(inst);
+  }
+  mu_assert_int_eq(N, count(s));
+  mu_check(0 == dlite_storage_close(s));
+  free(loc);
+}
+
+
+MU_TEST(test_batch)
+{
+  DLiteStorage *s;
+  DLiteInstance *insts[N], **loaded;
+  const char *ids[2*N];
+  char *loc = location(3);
+  int i;
+
+  mu_check((s = dlite_storage_open("shard", loc, NULL)));
+  for (i=0; i<N; i++) {
+    mu_check((insts[i] = new_instance(N + i)));
+    strcpy(uuids[N + i], insts[i]->uuid);
+  }
+  mu_check(0 == dlite_instance_save_many(s, (const DLiteInstance **)insts,
+                                         N));
+  for (i=0; i<N; i++) dlite_instance_decref(insts[i]);
+  mu_check(0 == dlite_storage_close(s));
+
+  mu_check((s = dlite_storage_open("shard", loc, "parallel=false")));
+  mu_assert_int_eq(2*N, count(s));
+  mu_check(0 == dlite_storage_close(s));
+
+  mu_check((s = dlite_storage_open("shard", loc, "mode=r")));
+  for (i=0; i<2*N; i++) ids[i] = uuids[2*N - 1 - i];
+  mu_check((loaded = dlite_instance_load_many(s, ids, 2*N)));
+  for (i=0; i<2*N; i++) {
+    double *values = dlite_instance_get_property(loaded[i], "values");
+    mu_assert_string_eq(ids[i], loaded[i]->uuid);
+    mu_assert_int_eq(2*N - 1 - i,
+                     *(int *)dlite_instance_get_property(loaded[i], "index"));
+    mu_assert_double_eq(-(2*N - 1 - i), values[2]);
+    dlite_instance_decref(loaded[i]);
+  }
+  free(loaded);
+  mu_check(0 == dlite_storage_close(s));
+  free(loc);
+}
+
+
+MU_TEST(test_rebalance)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  char *loc = location(NSHARDS);
+  int i, n, total=0;
+
+  /* with a new, empty shard, instances are still found before
+     rebalancing */
+  mu_check((s = dlite_storage_open("shard", loc, NULL)));
+  mu_check((inst = dlite_instance_load(s, uuids[0])));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(2*N, count(s));
+  mu_check(0 == dlite_storage_close(s));
+
+  /* the new shard takes over about a quarter of the instances */
+  mu_check((s = dlite_storage_open("shard", loc, "rebalance=true")));
+  mu_assert_int_eq(2*N, count(s));
+  mu_check(0 == dlite_storage_close(s));
+  n = count_shard(NSHARDS-1);
+  mu_check(n > 2*N/10);
+  mu_check(n < 2*N/2);
+  for (i=0; i<NSHARDS-1; i++) total += count_shard(i);
+  mu_assert_int_eq(2*N, total);
+
+  /* rebalancing again copies nothing */
+  mu_check((s = dlite_storage_open("shard", loc, "rebalance=true")));
+  mu_check(0 == dlite_storage_close(s));
+  mu_assert_int_eq(n, count_shard(NSHARDS-1));
+
+  mu_check((s = dlite_storage_open("shard", loc, "mode=r")));
+  for (i=0; i<2*N; i++) {
+    mu_check((inst = dlite_instance_load(s, uuids[i])));
+    mu_assert_int_eq(i, *(int *)dlite_instance_get_property(inst, "index"));
+    dlite_instance_decref(inst);
+  }
+  mu_check(0 == dlite_storage_close(s));
+  free(loc);
+}
+
+
+MU_TEST(test_errors)
+{
+  DLiteStorage *s;
+  char *loc = aprintf("bin://%s bin://%s?mode=r", paths[0], paths[0]);
+  err_set_stream(NULL);
+  mu_check(!dlite_storage_open("shard", " | ", NULL));
+  mu_check(!dlite_storage_open("shard", loc, NULL));
+  mu_check(!dlite_storage_open("shard", paths[0], "vnodes=0"));
+  err_set_stream(stderr);
+  err_clear();
+  free(loc);
+
+  loc = location(1);
+  mu_check((s = dlite_storage_open("shard", loc, "mode=r")));
+  err_set_stream(NULL);
+  mu_check(!dlite_instance_load(s, "00000000-0000-0000-0000-000000000000"));
+  err_set_stream(stderr);
+  err_clear();
+  mu_check(0 == dlite_storage_close(s));
+  free(loc);
+}
+
+
+MU_TEST(test_cleanup)
+{
+  int i;
+  for (i=0; i<NSHARDS; i++) remove(paths[i]);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_create);
+  MU_RUN_TEST(test_save_load);
+  MU_RUN_TEST(test_batch);
+  MU_RUN_TEST(test_rebalance);
+  MU_RUN_TEST(test_errors);
+  MU_RUN_TEST(test_cleanup);
+}
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,600 @@
+/* dlite-shm-storage.c -- DLite plugin for POSIX shared memory
+ *
+ * Copyright (C) 2021 SINTEF
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+  This plugin lets processes on the same host exchange instances via
+  POSIX shared memory instead of files.  The location is a namespace
+  (without slashes), and each instance is stored in its own segment
+  named "/dlite-<namespace>-<uuid>".  Segments persist until they are
+  removed with mode=w or the host is rebooted.
+
+  Segment layout
+  --------------
+    ShmHeader                           (segment offset 0)
+    binary record                       (segment offset SHM_RECORD)
+
+  The record is a binary record as documented in dlite-binrecord.h.
+
+  Updates
+  -------
+  The `generation` field of the header is a sequence lock.  A writer
+  makes it odd while it copies a record into the segment and even
+  when it is done.  A reader retries until it sees the same even
+  generation before and after decoding.  Zero means that the segment
+  is not initialised yet.
+
+  Saving an instance whose record has the same layout (same metadata,
+  dimensions and property offsets) as the record already in the
+  segment updates the segment in place.  Otherwise the old segment is
+  unlinked and a new one created, such that readers that have mapped
+  the old segment are not affected.
+
+  Loading maps the segment copy-on-write and arrays of non-allocated
+  types in data instances are adopted directly from the mapping, so
+  no data is copied.  Since pages are only copied when the reader
+  writes to them, a zero-copy instance sees later in-place updates of
+  its arrays.  Use the option copy=true for a private snapshot.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "config.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+
+#include "utils/err.h"
+#include "utils/strtob.h"
+#include "utils/thread.h"
+#include "dlite.h"
+#include "dlite-storage-plugins.h"
+#include "dlite-binrecord.h"
+#include "dlite-macros.h"
+
+#define SHM_MAGIC     "DLITESHM"   /* 8 bytes, not NUL-terminated */
+#define SHM_VERSION   1
+#define SHM_RECORD    DLITE_BINRECORD_ALIGN  /* segment offset of record */
+#define SHM_RETRIES   10000        /* max attempts to read a stable record */
+#define SHM_DIR       "/dev/shm"   /* where segments are listed on Linux */
+
+
+/** Segment header */
+typedef struct {
+  char magic[8];            /* SHM_MAGIC */
+  uint32_t version;         /* SHM_VERSION */
+  uint32_t byteorder;       /* DLITE_BINRECORD_BYTEORDER */
+  int generation;           /* sequence lock, odd while writing */
+  int pad;
+  uint64_t size;            /* size of record */
+} ShmHeader;
+
+/** Storage for the shm backend. */
+typedef struct {
+  DLiteStorage_HEAD
+  int copy;                 /* whether to copy arrays when loading */
+} ShmStorage;
+
+
+/********************************************************************
+ * Mappings
+ ********************************************************************/
+
+/* Unmaps the segment mapped by region `r`. */
+static void mapping_free(DLiteRegion *r)
+{
+  munmap(r->base, r->basesize);
+}
+
+/* Maps the segment opened as `fd` copy-on-write.  The loader holds the
+   returned reference and each adopted array holds one.  Returns NULL
+   on error. */
+static DLiteRegion *mapping_open(int fd, const char *name)
+{
+  DLiteRegion *r;
+  struct stat st;
+  size_t size;
+  void *addr;
+  if (fstat(fd, &st))
+    return err(1, "cannot determine size of shared memory \"%s\"", name),
+      NULL;
+  size = st.st_size;
+  if (size < SHM_RECORD)
+    return errx(1, "shared memory \"%s\" is not initialised", name), NULL;
+  addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED)
+    return err(1, "cannot map shared memory \"%s\"", name), NULL;
+  if (!(r = dlite_region_create(addr, size, mapping_free))) munmap(addr, size);
+  return r;
+}
+
+
+/********************************************************************
+ * Segments
+ ********************************************************************/
+
+/* Writes the name of the segment for `uuid` in namespace `ns` to
+   `buf`.  Returns non-zero on error. */
+static int segment_name(char *buf, size_t size, const char *ns,
+                        const char *uuid)
+{
+  int n = snprintf(buf, size, "/dlite-%s-%s", ns, uuid);
+  if (n < 0 || (size_t)n >= size)
+    return errx(1, "too long shared memory namespace: %s", ns);
+  return 0;
+}
+
+/* Returns the header of the segment at `addr` of `size` bytes if it
+   is initialised and stable, otherwise NULL.  The generation is
+   written to `*gen`. */
+static const ShmHeader *segment_header(const char *addr, size_t size,
+                                       int *gen)
+{
+  const ShmHeader *h = (const ShmHeader *)addr;
+  *gen = thread_atomic_load((int *)&h->generation);
+  if (*gen == 0 || *gen % 2) return NULL;
+  if (memcmp(h->magic, SHM_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != SHM_VERSION || h->byteorder != DLITE_BINRECORD_BYTEORDER ||
+      h->size > size - SHM_RECORD)
+    return NULL;
+  return h;
+}
+
+/* Returns non-zero if records `a` and `b` have the same layout. */
+static int same_layout(const DLiteBinRecord *a, const DLiteBinRecord *b)
+{
+  size_t n;
+  if (a->size != b->size || a->ndims != b->ndims || a->nprops != b->nprops ||
+      a->strtab != b->strtab)
+    return 0;
+  n = (a->ndims + a->nprops)*sizeof(uint64_t);
+  return memcmp((const char *)a + sizeof(DLiteBinRecord),
+                (const char *)b + sizeof(DLiteBinRecord), n) == 0;
+}
+
+/* Writes record `rec` to segment `name`, updating it in place if
+   possible.  Returns non-zero on error. */
+static int segment_write(const char *name, const DLiteBinRecord *rec)
+{
+  ShmHeader *h;
+  char *addr;
+  size_t size = SHM_RECORD + rec->size;
+  int fd, gen;
+
+  /* update in place */
+  if ((fd = shm_open(name, O_RDWR, 0)) >= 0) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == size &&
+        (addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))
+        != MAP_FAILED) {
+      close(fd);
+      if (segment_header(addr, size, &gen) &&
+          same_layout((DLiteBinRecord *)(addr + SHM_RECORD), rec)) {
+        h = (ShmHeader *)addr;
+        thread_atomic_add(&h->generation, 1);
+        memcpy(addr + SHM_RECORD, rec, rec->size);
+        thread_atomic_add(&h->generation, 1);
+        munmap(addr, size);
+        return 0;
+      }
+      munmap(addr, size);
+    } else {
+      close(fd);
+    }
+    if (shm_unlink(name) && errno != ENOENT)
+      return err(1, "cannot remove shared memory \"%s\"", name);
+  }
+
+  /* create new segment */
+  if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+    return err(1, "cannot create shared memory \"%s\"", name);
+  if (ftruncate(fd, size)) {
+    close(fd);
+    shm_unlink(name);
+    return err(1, "cannot resize shared memory \"%s\"", name);
+  }
+  addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    shm_unlink(name);
+    return err(1, "cannot map shared memory \"%s\"", name);
+  }
+  h = (ShmHeader *)addr;
+  memcpy(h->magic, SHM_MAGIC, sizeof(h->magic));
+  h->version = SHM_VERSION;
+  h->byteorder = DLITE_BINRECORD_BYTEORDER;
+  h->size = rec->size;
+  memcpy(addr + SHM_RECORD, rec, rec->size);
+  thread_atomic_add(&h->generation, 2);
+  munmap(addr, size);
+  return 0;
+}
+
+/* Returns a new instance loaded from segment `name`.  Arrays are
+   adopted from the mapping unless `copy` is non-zero.  Returns NULL on
+   error. */
+static DLiteInstance *segment_read(const char *name, const char *uuid,
+                                   int copy)
+{
+  DLiteRegion *m;
+  DLiteInstance *inst=NULL;
+  int fd, i, gen, gen2;
+
+  if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+    if (errno == ENOENT)
+      return errx(1, "no instance \"%s\" in shared memory", uuid), NULL;
+    return err(1, "cannot open shared memory \"%s\"", name), NULL;
+  }
+  m = mapping_open(fd, name);
+  close(fd);
+  if (!m) return NULL;
+
+  for (i=0; i<SHM_RETRIES; i++) {
+    const ShmHeader *h;
+    const DLiteBinRecord *rec;
+    if (!(h = segment_header(m->addr, m->size, &gen))) {
+      sched_yield();
+      continue;
+    }
+    rec = (const DLiteBinRecord *)(m->addr + SHM_RECORD);
+    if (dlite_binrecord_check(rec, h->size) == 0)
+      inst = dlite_binrecord_decode(rec, uuid,
+                                    (copy) ? NULL : dlite_region_adopt, m);
+    thread_atomic_fence();
+    gen2 = thread_atomic_load((int *)&h->generation);
+    if (inst && gen2 == gen) break;
+    if (inst) dlite_instance_decref(inst);
+    inst = NULL;
+    if (gen2 == gen) {
+      errx(1, "corrupted instance \"%s\" in shared memory", uuid);
+      break;
+    }
+  }
+  if (i == SHM_RETRIES)
+    errx(1, "timeout reading instance \"%s\" from shared memory", uuid);
+  dlite_region_decref(m);
+  return inst;
+}
+
+/* Returns the metadata uri of the record in segment `name` or NULL. */
+static char *segment_metauri(const char *name)
+{
+  const ShmHeader *h;
+  const DLiteBinRecord *rec;
+  const char *metauri;
+  char *addr, *copy, *retval=NULL;
+  struct stat st;
+  size_t size;
+  int fd, i, gen, status;
+  if ((fd = shm_open(name, O_RDONLY, 0)) < 0) return NULL;
+  if (fstat(fd, &st) || (size = st.st_size) < SHM_RECORD) {
+    close(fd);
+    return NULL;
+  }
+  addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return NULL;
+  for (i=0; i<SHM_RETRIES; i++) {
+    if (!(h = segment_header(addr, size, &gen))) {
+      sched_yield();
+      continue;
+    }
+    rec = (const DLiteBinRecord *)(addr + SHM_RECORD);
+    metauri = NULL;
+    status = 0;
+    if (dlite_binrecord_check(rec, h->size) == 0)
+      metauri = dlite_binrecord_str(rec, rec->metauri, &status);
+    copy = (metauri) ? strdup(metauri) : NULL;
+    thread_atomic_fence();
+    if (thread_atomic_load((int *)&h->generation) == gen) {
+      retval = copy;
+      break;
+    }
+    if (copy) free(copy);
+  }
+  munmap(addr, size);
+  return retval;
+}
+
+
+/** Iterator over instances in a namespace */
+typedef struct {
+  DIR *dir;
+  char prefix[256];         /* name prefix of segments, without slash */
+  char metauuid[DLITE_UUID_LENGTH+1];
+} ShmIter;
+
+/* Removes all segments in namespace `ns`.  Returns non-zero on error. */
+static int remove_segments(const char *ns)
+{
+  DIR *dir;
+  struct dirent *ent;
+  char prefix[256];
+  size_t len;
+  int stat=0;
+  snprintf(prefix, sizeof(prefix), "dlite-%s-", ns);
+  len = strlen(prefix);
+  if (!(dir = opendir(SHM_DIR)))
+    return err(1, "cannot list shared memory in " SHM_DIR);
+  while ((ent = readdir(dir))) {
+    char name[300];
+    if (strncmp(ent->d_name, prefix, len) != 0 ||
+        strlen(ent->d_name + len) != DLITE_UUID_LENGTH) continue;
+    snprintf(name, sizeof(name), "/%s", ent->d_name);
+    if (shm_unlink(name) && errno != ENOENT)
+      stat = err(1, "cannot remove shared memory \"%s\"", name);
+  }
+  closedir(dir);
+  return stat;
+}
+
+
+/********************************************************************
+ * Plugin api
+ ********************************************************************/
+
+/**
+  Opens shared memory namespace `location`.
+
+  Valid `options` are:
+
+  - mode : r | w | a
+      Valid values are:
+      - r   Load only
+      - w   Remove all instances in the namespace
+      - a   Load and save instances (default)
+  - copy : Whether to copy arrays when loading instead of mapping them
+      (default: false)
+ */
+DLiteStorage *shm_open_storage(const DLiteStoragePlugin *api,
+                               const char *location, const char *options)
+{
+  ShmStorage *s;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"r\" (read-only); "
+    "\"w\" (remove all instances in the namespace); "
+    "\"a\" (load and save instances)";
+  DLiteOpt opts[] = {
+    {'m', "mode", "a",     mode_descr},
+    {'c', "copy", "false", "Whether to copy arrays when loading."},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  char mode;
+
+  if (!(s = calloc(1, sizeof(ShmStorage)))) FAIL("allocation failure");
+  s->api = api;
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = *opts[0].value;
+  s->copy = atob(opts[1].value);
+  if (s->copy < 0) FAIL1("invalid \"copy\" value: '%s'", opts[1].value);
+  if (!*location || strchr(location, '/') ||
+      strlen(location) > 200)
+    FAIL1("invalid shared memory namespace: '%s'", location);
+
+  switch (mode) {
+  case 'r':
+    break;
+  case 'w':
+    if (remove_segments(location)) goto fail;
+    /* fall through */
+  case 'a':
+    s->writable = 1;
+    break;
+  default:
+    FAIL1("invalid \"mode\" value: '%c'. Must be \"r\" (read-only), "
+          "\"w\" (write) or \"a\" (append)", mode);
+  }
+  retval = (DLiteStorage *)s;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && s) free(s);
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  Returns non-zero on error.
+ */
+int shm_close(DLiteStorage *s)
+{
+  UNUSED(s);
+  return 0;
+}
+
+
+/**
+  Load instance `id` from storage `s` and return it.
+  NULL is returned on error.
+ */
+DLiteInstance *shm_load(const DLiteStorage *s, const char *id)
+{
+  const ShmStorage *ss = (const ShmStorage *)s;
+  char uuid[DLITE_UUID_LENGTH+1], name[256];
+  DLiteInstance *inst;
+  if (!id || !*id)
+    return errx(1, "id is required when loading from shared memory"), NULL;
+  if (dlite_get_uuid(uuid, id) < 0) return NULL;
+  if (dlite_instance_has(uuid, 0) && (inst = dlite_instance_get(uuid)))
+    return inst;
+  if (segment_name(name, sizeof(name), s->location, uuid)) return NULL;
+  return segment_read(name, uuid, ss->copy);
+}
+
+
+/**
+  Saves instance `inst` to storage `s`.  Returns non-zero on error.
+*/
+int shm_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  char *buf=NULL, name[256];
+  size_t size=0;
+  int n, stat=1;
+  if (segment_name(name, sizeof(name), s->location, inst->uuid)) return 1;
+  if ((n = dlite_binrecord_encode(&buf, &size, 0, inst)) < 0) goto fail;
+  stat = segment_write(name, (const DLiteBinRecord *)buf);
+ fail:
+  if (buf) free(buf);
+  return stat;
+}
+
+
+/**
+  Creates and returns a new iterator used by shm_iter_next().
+
+  If `metaid` is not NULL, shm_iter_next() will only iterate over
+  instances whos metadata corresponds to this id.
+
+  Returns new iterator or NULL on error.
+ */
+void *shm_iter_create(const DLiteStorage *s, const char *metaid)
+{
+  ShmIter *iter;
+  if (!(iter = calloc(1, sizeof(ShmIter))))
+    return err(1, "allocation failure"), NULL;
+  snprintf(iter->prefix, sizeof(iter->prefix), "dlite-%s-", s->location);
+  if (metaid && *metaid && dlite_get_uuid(iter->metauuid, metaid) < 0) {
+    free(iter);
+    return NULL;
+  }
+  if (!(iter->dir = opendir(SHM_DIR))) {
+    free(iter);
+    return err(1, "cannot list shared memory in " SHM_DIR), NULL;
+  }
+  return iter;
+}
+
+/**
+  Writes the uuid of the next instance to `buf`, where `iter` is an
+  iterator returned by shm_iter_create().
+
+  Returns zero on success, 1 if there are no more UUIDs to iterate
+  over and a negative number on other errors.
+ */
+int shm_iter_next(void *iter, char *buf)
+{
+  ShmIter *it = iter;
+  struct dirent *ent;
+  size_t len = strlen(it->prefix);
+  while ((ent = readdir(it->dir))) {
+    const char *uuid = ent->d_name + len;
+    if (strncmp(ent->d_name, it->prefix, len) != 0 ||
+        strlen(uuid) != DLITE_UUID_LENGTH) continue;
+    if (it->metauuid[0]) {
+      char name[300], metauuid[DLITE_UUID_LENGTH+1], *metauri;
+      int stat;
+      snprintf(name, sizeof(name), "/%s", ent->d_name);
+      if (!(metauri = segment_metauri(name))) continue;
+      stat = dlite_get_uuid(metauuid, metauri);
+      free(metauri);
+      if (stat < 0) return -1;
+      if (strcmp(metauuid, it->metauuid) != 0) continue;
+    }
+    memcpy(buf, uuid, DLITE_UUID_LENGTH+1);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+  Free's iterator created with shm_iter_create().
+ */
+void shm_iter_free(void *iter)
+{
+  ShmIter *it = iter;
+  closedir(it->dir);
+  free(it);
+}
+
+
+static DLiteStoragePlugin dlite_shm_plugin = {
+  /* head */
+  "shm",                    /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  shm_open_storage,         /* open */
+  shm_close,                /* close */
+
+  /* queue api */
+  shm_iter_create,          /* iterCreate */
+  shm_iter_next,            /* iterNext */
+  shm_iter_free,            /* iterFree */
+  NULL,                     /* getUUIDs */
+
+  /* direct api */
+  shm_load,                 /* loadInstance */
+  shm_save,                 /* saveInstance */
+  NULL,                     /* loadInstances */
+  NULL,                     /* saveInstances */
+
+  /* datamodel api */
+  NULL,                     /* dataModel */
+  NULL,                     /* dataModelFree */
+
+  NULL,                     /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  NULL,                     /* getDimensionSize */
+  NULL,                     /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                     /* setMetaURI */
+  NULL,                     /* setDimensionSize */
+  NULL,                     /* setProperty */
+
+  NULL,                     /* hasDimension */
+  NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  NULL,                     /* getDataName, obsolute */
+  NULL,                     /* setDataName, obsolute */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &dlite_shm_plugin;
+}
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+
+#define N 1000
+
+char ns[64];
+char *uri = "http://onto-ns.com/meta/0.1/ShmTestEntity";
+DLiteMeta *entity=NULL;
+char uuid[DLITE_UUID_LENGTH+1];
+
+
+/* Returns a new instance with `n` values, where value i is i + offset. */
+static DLiteInstance *new_instance(size_t n, const char *id, double offset)
+{
+  DLiteInstance *inst;
+  size_t i, dims[] = {n};
+  char *name = "shm";
+  double *values;
+  if (!(inst = dlite_instance_create(entity, dims, id))) return NULL;
+  dlite_instance_set_property(inst, "name", &name);
+  values = dlite_instance_get_property(inst, "values");
+  for (i=0; i<n; i++) values[i] = i + offset;
+  return inst;
+}
+
+MU_TEST(test_create)
+{
+  char *dims[] = {"N"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of values."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims unit iri  descr */
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "",  NULL, "Name."},
+    {"values", dliteFloat,     sizeof(double), 1, dims, "m", NULL, "Values."}
+  };
+  snprintf(ns, sizeof(ns), "test-shm-%d", (int)getpid());
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Test entity.",
+                                                    NULL,
+                                                    1, dimensions,
+                                                    2, properties)));
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  mu_check((s = dlite_storage_open("shm", ns, "mode=w")));
+  mu_check((inst = new_instance(N, NULL, 0.0)));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  strcpy(uuid, inst->uuid);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_load)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  double *values;
+  mu_check((s = dlite_storage_open("shm", ns, NULL)));
+  mu_check((inst = dlite_instance_load(s, uuid)));
+  mu_assert_string_eq("shm", *(char **)dlite_instance_get_property(inst,
+                                                                   "name"));
+  mu_assert_int_eq(N, dlite_instance_get_dimension_size(inst, "N"));
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(0.0, values[0]);
+  mu_assert_double_eq(N - 1.0, values[N-1]);
+
+  /* Writing to a mapped array does not change the segment... */
+  values[0] = -1.0;
+  dlite_instance_decref(inst);
+  mu_check((inst = dlite_instance_load(s, uuid)));
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(0.0, values[0]);
+
+  /* ...until it is saved, which updates the segment in place */
+  values[0] = -1.0;
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  mu_check((s = dlite_storage_open("shm", ns, "mode=r;copy=true")));
+  mu_check((inst = dlite_instance_load(s, uuid)));
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(-1.0, values[0]);
+  mu_assert_double_eq(1.0, values[1]);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_update)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  double *values;
+  pid_t pid;
+  int status;
+  mu_check((s = dlite_storage_open("shm", ns, NULL)));
+  mu_check((inst = dlite_instance_load(s, uuid)));
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(1.0, values[1]);
+
+  /* Another process saves a new version with the same layout */
+  mu_check((pid = fork()) >= 0);
+  if (pid == 0) {
+    DLiteInstance *inst2;
+    dlite_instance_decref(inst);
+    if (!(inst2 = new_instance(N, uuid, 100.0))) _exit(1);
+    _exit(dlite_instance_save(s, inst2) ? 1 : 0);
+  }
+  mu_assert_int_eq(pid, waitpid(pid, &status, 0));
+  mu_check(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  /* The zero-copy instance sees the update */
+  mu_assert_double_eq(101.0, values[1]);
+  mu_assert_double_eq(N + 99.0, values[N-1]);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_resize)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  double *values;
+  pid_t pid;
+  int status;
+  mu_check((s = dlite_storage_open("shm", ns, NULL)));
+  mu_check((inst = dlite_instance_load(s, uuid)));
+  values = dlite_instance_get_property(inst, "values");
+
+  /* A new layout replaces the segment, mapped instances keep the old */
+  mu_check((pid = fork()) >= 0);
+  if (pid == 0) {
+    DLiteInstance *inst2;
+    dlite_instance_decref(inst);
+    if (!(inst2 = new_instance(2*N, uuid, 1000.0))) _exit(1);
+    _exit(dlite_instance_save(s, inst2) ? 1 : 0);
+  }
+  mu_assert_int_eq(pid, waitpid(pid, &status, 0));
+  mu_check(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  mu_assert_double_eq(101.0, values[1]);
+  dlite_instance_decref(inst);
+
+  mu_check((inst = dlite_instance_load(s, uuid)));
+  mu_assert_int_eq(2*N, dlite_instance_get_dimension_size(inst, "N"));
+  values = dlite_instance_get_property(inst, "values");
+  mu_assert_double_eq(1001.0, values[1]);
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_iter)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  char **uuids;
+  int n=0;
+  mu_check((s = dlite_storage_open("shm", ns, NULL)));
+  mu_check((inst = new_instance(3, NULL, 0.0)));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_instance_save(s, (DLiteInstance *)entity));
+  dlite_instance_decref(inst);
+
+  mu_check((uuids = dlite_storage_uuids(s, uri)));
+  while (uuids[n]) n++;
+  mu_assert_int_eq(2, n);
+  dlite_storage_uuids_free(uuids);
+
+  mu_check((uuids = dlite_storage_uuids(s, NULL)));
+  n = 0;
+  while (uuids[n]) n++;
+  mu_assert_int_eq(3, n);
+  dlite_storage_uuids_free(uuids);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_remove)
+{
+  DLiteStorage *s;
+  err_clear();
+  mu_check(!dlite_storage_open("shm", ns, "mode=x"));
+  mu_check(!dlite_storage_open("shm", "a/b", NULL));
+  mu_check((s = dlite_storage_open("shm", ns, "mode=w")));
+  mu_check(!dlite_instance_load(s, uuid));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  err_clear();
+}
+
+MU_TEST(test_teardown)
+{
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_create);     /* setup */
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_update);
+  MU_RUN_TEST(test_resize);
+  MU_RUN_TEST(test_iter);
+  MU_RUN_TEST(test_remove);
+  MU_RUN_TEST(test_teardown);   /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
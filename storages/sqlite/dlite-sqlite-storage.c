@@ -0,0 +1,1027 @@
+/* dlite-sqlite-storage.c -- DLite storage plugin for SQLite */
+
+/*
+  This plugin stores instances in an embedded SQLite database file.
+  The table layout follows the postgresql plugins:
+
+    - uuidtable: maps the uuid of every stored instance to its
+      metadata uri (columns: uuid, meta).  The meta column is indexed,
+      such that iterating over the instances of a given metadata is
+      an indexed query.
+    - one table per metadata, named after the metadata uri, with the
+      columns: uuid, uri, meta, dims, followed by one column per
+      property.  The uuid column is the primary key.
+
+  Scalar properties are stored as the corresponding SQLite type.
+  Dimensional properties and dims are stored as blobs with the
+  elements in native byte order and C order.  String arrays are
+  stored as a sequence of elements, each either a zero byte (NULL)
+  or a one byte followed by the NUL-terminated string.
+
+  Insert and select statements are prepared once per metadata and
+  cached for the lifetime of the storage.  All instances saved in one
+  call are inserted in a single transaction.  Writable databases are
+  by default switched to write-ahead logging (WAL), which allows
+  readers in other processes to run concurrently with a writer.
+
+  Like for the postgresql plugin, saving an instance that already is
+  in the database is a no-op and storing metadata is not supported.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/strtob.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+
+/* Number of fixed columns (uuid, uri, meta, dims) before the properties */
+#define NFIXED 4
+
+
+/* Cached statements for instances of a given metadata */
+typedef struct {
+  sqlite3_stmt *insert;  /* Insert instance, NULL if not prepared */
+  sqlite3_stmt *select;  /* Select instance by uuid, NULL if not prepared */
+  int iuri;              /* Column index of uri in `select`, -1 if none */
+  int idims;             /* Column index of dims in `select` */
+  int *cols;             /* Column index of each property in `select`,
+                            -1 if the property has no column */
+} Statements;
+
+/* Storage for SQLite */
+typedef struct {
+  DLiteStorage_HEAD
+  sqlite3 *db;                /* Database connection */
+  sqlite3_stmt *insert_uuid;  /* Insert into uuidtable */
+  sqlite3_stmt *select_meta;  /* Look up metadata uri of uuid */
+  map_void_t stmts;           /* Maps metadata uri to Statements */
+} SqlStorage;
+
+/* Iterator over uuids */
+typedef struct {
+  sqlite3_stmt *stmt;   /* Query, NULL if the database has no instances */
+} SqlIter;
+
+/* Growing byte buffer used for encoding string arrays */
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+} Buf;
+
+
+/* Reports the last error on the connection of `ss` together with `msg`.
+   Returns `stat`. */
+static int sql_error(const SqlStorage *ss, int stat, const char *msg)
+{
+  return errx(stat, "sqlite: %s: %s", msg, sqlite3_errmsg(ss->db));
+}
+
+/* Executes SQL command `sql` without parameters.  Returns non-zero on
+   error. */
+static int sql_exec(SqlStorage *ss, const char *sql)
+{
+  char *msg=NULL;
+  int stat=0;
+  if (sqlite3_exec(ss->db, sql, NULL, NULL, &msg) != SQLITE_OK)
+    stat = errx(1, "sqlite: cannot execute command: %s",
+                (msg) ? msg : sqlite3_errmsg(ss->db));
+  if (msg) sqlite3_free(msg);
+  return stat;
+}
+
+/* Prepares `sql` and returns the statement, or NULL on error. */
+static sqlite3_stmt *sql_prepare(SqlStorage *ss, const char *sql)
+{
+  sqlite3_stmt *stmt=NULL;
+  if (sqlite3_prepare_v3(ss->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt,
+                         NULL) != SQLITE_OK) {
+    sql_error(ss, 1, "cannot prepare statement");
+    return NULL;
+  }
+  return stmt;
+}
+
+/* Returns a newly allocated quoted identifier for `name`, which should
+   be released with sqlite3_free().  Returns NULL on error. */
+static char *quote_ident(const char *name)
+{
+  char *ident = sqlite3_mprintf("\"%w\"", name);
+  if (!ident) err(1, "allocation failure");
+  return ident;
+}
+
+
+/* Appends `n` bytes from `src` to `b`.  Returns non-zero on error. */
+static int buf_add(Buf *b, const void *src, size_t n)
+{
+  if (b->len + n > b->size) {
+    size_t size = (b->size) ? b->size : 256;
+    while (size < b->len + n) size *= 2;
+    if (!(b->data = realloc(b->data, size))) {
+      b->len = b->size = 0;
+      return err(1, "allocation failure");
+    }
+    b->size = size;
+  }
+  if (n) memcpy(b->data + b->len, src, n);
+  b->len += n;
+  return 0;
+}
+
+
+/* Returns the declared SQLite type used for storing properties of
+   type `type` and size `size` with `ndims` dimensions, or NULL if it
+   is not supported. */
+static const char *sql_typename(DLiteType type, size_t size, int ndims)
+{
+  switch (type) {
+  case dliteBlob:   return "BLOB";
+  case dliteBool:   return (ndims) ? "BLOB" : "BOOLEAN";
+  case dliteInt:
+  case dliteUInt:
+    if (size > 8) break;
+    return (ndims) ? "BLOB" : "INTEGER";
+  case dliteFloat:
+    if (size != 4 && size != 8) break;
+    return (ndims) ? "BLOB" : "REAL";
+  case dliteFixString:
+  case dliteStringPtr:
+    return (ndims) ? "BLOB" : "TEXT";
+  default:
+    break;
+  }
+  return NULL;
+}
+
+
+/* Binds scalar value `src` of type `type` and size `size` to parameter
+   `i` of `stmt`.  Returns non-zero on error. */
+static int bind_scalar(sqlite3_stmt *stmt, int i, const void *src,
+                       DLiteType type, size_t size)
+{
+  int64_t v;
+  double d;
+  const char *s;
+  int stat;
+
+  switch (type) {
+  case dliteBool:
+    stat = sqlite3_bind_int(stmt, i, *(bool *)src);
+    break;
+  case dliteInt:
+  case dliteUInt:
+    if (dlite_type_copy_cast(&v, dliteInt, sizeof(v), src, type, size))
+      return 1;
+    stat = sqlite3_bind_int64(stmt, i, v);
+    break;
+  case dliteFloat:
+    if (dlite_type_copy_cast(&d, dliteFloat, sizeof(d), src, type, size))
+      return 1;
+    stat = sqlite3_bind_double(stmt, i, d);
+    break;
+  case dliteFixString:
+    s = src;
+    stat = sqlite3_bind_text(stmt, i, s, (int)strnlen(s, size),
+                             SQLITE_STATIC);
+    break;
+  case dliteStringPtr:
+    if ((s = *(char **)src))
+      stat = sqlite3_bind_text(stmt, i, s, -1, SQLITE_STATIC);
+    else
+      stat = sqlite3_bind_null(stmt, i);
+    break;
+  case dliteBlob:
+    stat = sqlite3_bind_blob(stmt, i, src, (int)size, SQLITE_STATIC);
+    break;
+  default:
+    return errx(1, "sqlite: cannot store %s", dlite_type_get_enum_name(type));
+  }
+  if (stat != SQLITE_OK)
+    return errx(1, "sqlite: cannot bind parameter: %s", sqlite3_errstr(stat));
+  return 0;
+}
+
+/* Binds array `src` with `nelem` elements of type `type` and size
+   `size` to parameter `i` of `stmt` as a blob.  String pointers are
+   encoded in `b`.  Returns non-zero on error. */
+static int bind_array(sqlite3_stmt *stmt, int i, const void *src,
+                      DLiteType type, size_t size, size_t nelem, Buf *b)
+{
+  int stat;
+  if (type == dliteStringPtr) {
+    char **strings = (char **)src;
+    size_t j;
+    b->len = 0;
+    for (j=0; j<nelem; j++) {
+      char flag = (strings[j] != NULL);
+      if (buf_add(b, &flag, 1)) return 1;
+      if (flag && buf_add(b, strings[j], strlen(strings[j]) + 1)) return 1;
+    }
+    stat = sqlite3_bind_blob64(stmt, i, (b->len) ? b->data : "", b->len,
+                               SQLITE_TRANSIENT);
+  } else {
+    stat = sqlite3_bind_blob64(stmt, i, (nelem) ? src : "", nelem*size,
+                               SQLITE_STATIC);
+  }
+  if (stat != SQLITE_OK)
+    return errx(1, "sqlite: cannot bind parameter: %s", sqlite3_errstr(stat));
+  return 0;
+}
+
+
+/* Reads scalar column `col` of `stmt` into `dest` of type `type` and
+   size `size`.  Returns non-zero on error. */
+static int column_scalar(void *dest, DLiteType type, size_t size,
+                         sqlite3_stmt *stmt, int col)
+{
+  int64_t v;
+  double d;
+  const unsigned char *s;
+  int n;
+
+  switch (type) {
+  case dliteBool:
+    *(bool *)dest = (sqlite3_column_int64(stmt, col) != 0);
+    return 0;
+  case dliteInt:
+  case dliteUInt:
+    v = sqlite3_column_int64(stmt, col);
+    return dlite_type_copy_cast(dest, type, size, &v, dliteInt, sizeof(v));
+  case dliteFloat:
+    d = sqlite3_column_double(stmt, col);
+    return dlite_type_copy_cast(dest, type, size, &d, dliteFloat, sizeof(d));
+  case dliteFixString:
+    s = sqlite3_column_text(stmt, col);
+    n = sqlite3_column_bytes(stmt, col);
+    memset(dest, 0, size);
+    if (s) strncpy(dest, (const char *)s,
+                   ((size_t)n < size) ? (size_t)n : size - 1);
+    return 0;
+  case dliteStringPtr:
+    {
+      char **p = dest;
+      s = sqlite3_column_text(stmt, col);
+      if (*p) free(*p);
+      *p = NULL;
+      if (s && !(*p = strdup((const char *)s)))
+        return err(1, "allocation failure");
+    }
+    return 0;
+  case dliteBlob:
+    if ((size_t)sqlite3_column_bytes(stmt, col) != size)
+      return errx(1, "sqlite: expected %zu bytes, got %d", size,
+                  sqlite3_column_bytes(stmt, col));
+    memcpy(dest, sqlite3_column_blob(stmt, col), size);
+    return 0;
+  default:
+    break;
+  }
+  return errx(1, "sqlite: cannot load %s", dlite_type_get_enum_name(type));
+}
+
+/* Reads array blob column `col` of `stmt` into `dest` with `nelem`
+   elements of type `type` and size `size`.  Returns non-zero on
+   error. */
+static int column_array(void *dest, DLiteType type, size_t size,
+                        size_t nelem, sqlite3_stmt *stmt, int col)
+{
+  const char *src = sqlite3_column_blob(stmt, col);
+  size_t len = sqlite3_column_bytes(stmt, col);
+
+  if (type == dliteStringPtr) {
+    char **strings = dest;
+    const char *end = src + len;
+    size_t j;
+    for (j=0; j<nelem; j++) {
+      if (src >= end) return errx(1, "sqlite: too few array elements");
+      if (strings[j]) free(strings[j]);
+      strings[j] = NULL;
+      if (*src++) {
+        size_t n = strnlen(src, end - src);
+        if (src + n >= end) return errx(1, "sqlite: invalid string array");
+        if (!(strings[j] = strndup(src, n)))
+          return err(1, "allocation failure");
+        src += n + 1;
+      }
+    }
+    if (src != end) return errx(1, "sqlite: too many array elements");
+    return 0;
+  }
+  if (len != nelem*size)
+    return errx(1, "sqlite: expected %zu array elements, got %zu",
+                nelem, len / size);
+  if (len) memcpy(dest, src, len);
+  return 0;
+}
+
+
+/* Creates tables for `meta`, if they don't already exists.  Returns
+   non-zero on error. */
+static int table_create(SqlStorage *ss, const DLiteMeta *meta)
+{
+  char *sql=NULL, *ident=NULL;
+  size_t size=0, m=0, i;
+  int retval=1;
+
+  if (!(ident = quote_ident(meta->uri))) goto fail;
+  m += asnpprintf(&sql, &size, m, "CREATE TABLE IF NOT EXISTS %s ("
+                  "uuid TEXT PRIMARY KEY, uri TEXT, meta TEXT, dims BLOB",
+                  ident);
+  sqlite3_free(ident);
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    const char *typename = sql_typename(p->type, p->size, p->ndims);
+    if (!typename)
+      FAIL2("sqlite: unsupported type of property '%s': %s",
+            p->name, dlite_type_get_enum_name(p->type));
+    if (!(ident = quote_ident(p->name))) goto fail;
+    m += asnpprintf(&sql, &size, m, ", %s %s", ident, typename);
+    sqlite3_free(ident);
+  }
+  m += asnpprintf(&sql, &size, m, ")");
+  if (sql_exec(ss, sql)) goto fail;
+  retval = 0;
+ fail:
+  if (sql) free(sql);
+  return retval;
+}
+
+
+/* Frees statements `st`. */
+static void free_statements(Statements *st)
+{
+  if (st->insert) sqlite3_finalize(st->insert);
+  if (st->select) sqlite3_finalize(st->select);
+  if (st->cols) free(st->cols);
+  free(st);
+}
+
+/* Returns the cached statements for instances of `meta`, creating an
+   empty entry the first time.  Returns NULL on error. */
+static Statements *get_statements(SqlStorage *ss, const DLiteMeta *meta)
+{
+  Statements *st;
+  void **sp;
+  if ((sp = map_get(&ss->stmts, meta->uri))) return *sp;
+  if (!(st = calloc(1, sizeof(Statements))))
+    return err(1, "allocation failure"), NULL;
+  if (map_set(&ss->stmts, meta->uri, st)) {
+    free(st);
+    return errx(1, "sqlite: cannot register statements"), NULL;
+  }
+  return st;
+}
+
+/* Returns a prepared insert statement for instances of `meta`.  The
+   table is created and the statement prepared the first time it is
+   requested.  Returns NULL on error. */
+static sqlite3_stmt *get_insert(SqlStorage *ss, const DLiteMeta *meta)
+{
+  Statements *st;
+  char *sql=NULL, *ident=NULL;
+  size_t size=0, m=0, i;
+
+  if (!(st = get_statements(ss, meta))) return NULL;
+  if (st->insert) return st->insert;
+  if (dlite_meta_is_metameta(meta))
+    FAIL("sqlite: storing metadata is not supported");
+  if (table_create(ss, meta)) goto fail;
+
+  /* Instances that already are in the database are left untouched */
+  if (!(ident = quote_ident(meta->uri))) goto fail;
+  m += asnpprintf(&sql, &size, m, "INSERT OR IGNORE INTO %s "
+                  "(uuid, uri, meta, dims", ident);
+  sqlite3_free(ident);
+  for (i=0; i<meta->_nproperties; i++) {
+    if (!(ident = quote_ident(meta->_properties[i].name))) goto fail;
+    m += asnpprintf(&sql, &size, m, ", %s", ident);
+    sqlite3_free(ident);
+  }
+  m += asnpprintf(&sql, &size, m, ") VALUES (?");
+  for (i=1; i<meta->_nproperties + NFIXED; i++)
+    m += asnpprintf(&sql, &size, m, ", ?");
+  m += asnpprintf(&sql, &size, m, ")");
+  st->insert = sql_prepare(ss, sql);
+ fail:
+  if (sql) free(sql);
+  return st->insert;
+}
+
+/* Returns cached statements with a prepared select statement for
+   instances of `meta`.  Returns NULL on error. */
+static Statements *get_select(SqlStorage *ss, const DLiteMeta *meta)
+{
+  Statements *st;
+  char *sql=NULL, *ident=NULL;
+  size_t i;
+  int col, ncols;
+
+  if (!(st = get_statements(ss, meta))) return NULL;
+  if (st->select) return st;
+
+  if (!(ident = quote_ident(meta->uri))) return NULL;
+  sql = sqlite3_mprintf("SELECT * FROM %s WHERE uuid = ?", ident);
+  sqlite3_free(ident);
+  if (!sql) return err(1, "allocation failure"), NULL;
+  st->select = sql_prepare(ss, sql);
+  sqlite3_free(sql);
+  if (!st->select) return NULL;
+
+  /* Map properties to columns, columns without a property are ignored */
+  if (!(st->cols = calloc(meta->_nproperties + 1, sizeof(int))))
+    return err(1, "allocation failure"), NULL;
+  st->iuri = st->idims = -1;
+  ncols = sqlite3_column_count(st->select);
+  for (col=0; col<ncols; col++) {
+    const char *name = sqlite3_column_name(st->select, col);
+    if (strcmp(name, "dims") == 0) st->idims = col;
+    if (strcmp(name, "uri") == 0) st->iuri = col;
+  }
+  for (i=0; i<meta->_nproperties; i++) {
+    st->cols[i] = -1;
+    for (col=0; col<ncols; col++)
+      if (strcmp(sqlite3_column_name(st->select, col),
+                 meta->_properties[i].name) == 0) st->cols[i] = col;
+  }
+  if (st->idims < 0) {
+    sqlite3_finalize(st->select);
+    st->select = NULL;
+    return errx(1, "sqlite: no dims column in table %s", meta->uri), NULL;
+  }
+  return st;
+}
+
+
+/* Inserts `inst` without starting a transaction.  String arrays are
+   encoded in `b`.  Returns non-zero on error. */
+static int insert_instance(SqlStorage *ss, const DLiteInstance *inst, Buf *b)
+{
+  const DLiteMeta *meta = inst->meta;
+  sqlite3_stmt *stmt;
+  int64_t *dims=NULL;
+  size_t i;
+  int retval=1;
+
+  if (!(stmt = get_insert(ss, meta))) return 1;
+  if (!ss->insert_uuid &&
+      !(ss->insert_uuid = sql_prepare(ss, "INSERT OR IGNORE INTO uuidtable "
+                                      "(uuid, meta) VALUES (?, ?)")))
+    return 1;
+
+  if (meta->_ndimensions &&
+      !(dims = malloc(meta->_ndimensions * sizeof(int64_t))))
+    FAIL("allocation failure");
+  for (i=0; i<meta->_ndimensions; i++) dims[i] = DLITE_DIM(inst, i);
+
+  if (bind_scalar(stmt, 1, inst->uuid, dliteFixString, sizeof(inst->uuid)) ||
+      bind_scalar(stmt, 2, &inst->uri, dliteStringPtr, sizeof(char *)) ||
+      bind_scalar(stmt, 3, &meta->uri, dliteStringPtr, sizeof(char *)) ||
+      bind_array(stmt, 4, dims, dliteInt, sizeof(int64_t),
+                 meta->_ndimensions, b))
+    goto fail;
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    void *ptr = DLITE_PROP(inst, i);
+    int stat;
+    if (p->ndims) {
+      size_t nelem=1;
+      int j;
+      for (j=0; j<p->ndims; j++) nelem *= DLITE_PROP_DIM(inst, i, j);
+      stat = bind_array(stmt, i+NFIXED+1, *(void **)ptr, p->type, p->size,
+                        nelem, b);
+    } else {
+      stat = bind_scalar(stmt, i+NFIXED+1, ptr, p->type, p->size);
+    }
+    if (stat)
+      FAIL2("sqlite: cannot store property '%s' of '%s'",
+            p->name, inst->uuid);
+  }
+  if (sqlite3_step(stmt) != SQLITE_DONE) {
+    sql_error(ss, 1, "cannot save instance");
+    goto fail;
+  }
+
+  if (bind_scalar(ss->insert_uuid, 1, inst->uuid, dliteFixString,
+                  sizeof(inst->uuid)) ||
+      bind_scalar(ss->insert_uuid, 2, &meta->uri, dliteStringPtr,
+                  sizeof(char *)))
+    goto fail;
+  if (sqlite3_step(ss->insert_uuid) != SQLITE_DONE) {
+    sql_error(ss, 1, "cannot save instance");
+    goto fail;
+  }
+  retval = 0;
+ fail:
+  sqlite3_reset(stmt);
+  if (ss->insert_uuid) sqlite3_reset(ss->insert_uuid);
+  if (dims) free(dims);
+  return retval;
+}
+
+
+/**
+  Opens SQLite database file `location` and returns a newly created
+  storage for it.
+
+  The `options` argument provies additional input to the driver.
+  Valid `options` are:
+
+  - mode : append | r | w
+      Valid values are:
+      - append   Append to existing database or create a new (default)
+      - r        Open existing database for read-only
+      - w        Truncate existing database or create a new
+  - wal : Whether to switch a writable database to write-ahead logging,
+      which lets readers run concurrently with a writer (default: true)
+  - timeout : Milliseconds to wait for a locked database (default: 5000)
+
+  Returns NULL on error.
+ */
+DLiteStorage *sql_open(const DLiteStoragePlugin *api, const char *location,
+                       const char *options)
+{
+  SqlStorage *ss=NULL;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"append\" (append to existing database or create new, default); "
+    "\"r\" (read-only); "
+    "\"w\" (truncate existing database or create new)";
+  DLiteOpt opts[] = {
+    {'m', "mode",    "append", mode_descr},
+    {'W', "wal",     "true",   "Whether to use write-ahead logging."},
+    {'t', "timeout", "5000",   "Milliseconds to wait for a locked database."},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode;
+  int i, flags, wal;
+  UNUSED(api);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+  wal = atob(opts[1].value);
+
+  if (!(ss = calloc(1, sizeof(SqlStorage)))) FAIL("allocation failure");
+  map_init(&ss->stmts);
+
+  if (strcmp(mode, "append") == 0 || strcmp(mode, "a") == 0) {
+    ss->writable = 1;
+    flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+  } else if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    ss->writable = 0;
+    flags = SQLITE_OPEN_READONLY;
+  } else if (strcmp(mode, "w") == 0 || strcmp(mode, "write") == 0) {
+    const char *suffixes[] = {"", "-wal", "-shm", NULL};
+    ss->writable = 1;
+    flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    for (i=0; suffixes[i]; i++) {
+      char *path=NULL;
+      asprintf(&path, "%s%s", location, suffixes[i]);
+      if (!path) FAIL("allocation failure");
+      remove(path);
+      free(path);
+    }
+  } else {
+    FAIL1("invalid \"mode\" value: '%s'. Must be \"append\", \"r\" "
+          "(read-only) or \"w\" (write)", mode);
+  }
+
+  if (sqlite3_open_v2(location, &ss->db, flags, NULL) != SQLITE_OK) {
+    if (!ss->db) FAIL("sqlite: allocation failure");
+    sql_error(ss, 1, "cannot open database");
+    goto fail;
+  }
+  sqlite3_busy_timeout(ss->db, atoi(opts[2].value));
+
+  if (ss->writable) {
+    /* The journal mode is persistent, so readers opening the database
+       later use WAL as well */
+    if (wal && sql_exec(ss, "PRAGMA journal_mode=WAL; "
+                        "PRAGMA synchronous=NORMAL")) goto fail;
+    if (sql_exec(ss, "CREATE TABLE IF NOT EXISTS uuidtable ("
+                 "uuid TEXT PRIMARY KEY, meta TEXT); "
+                 "CREATE INDEX IF NOT EXISTS uuidtable_meta "
+                 "ON uuidtable (meta)")) goto fail;
+  }
+
+  retval = (DLiteStorage *)ss;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && ss) {
+    if (ss->db) sqlite3_close(ss->db);
+    map_deinit(&ss->stmts);
+    free(ss);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  Returns non-zero on error.
+ */
+int sql_close(DLiteStorage *s)
+{
+  SqlStorage *ss = (SqlStorage *)s;
+  const char *key;
+  map_iter_t iter = map_iter(&ss->stmts);
+  int retval=0;
+  while ((key = map_next(&ss->stmts, &iter)))
+    free_statements(*map_get(&ss->stmts, key));
+  map_deinit(&ss->stmts);
+  if (ss->insert_uuid) sqlite3_finalize(ss->insert_uuid);
+  if (ss->select_meta) sqlite3_finalize(ss->select_meta);
+  if (sqlite3_close(ss->db) != SQLITE_OK)
+    retval = sql_error(ss, 1, "cannot close database");
+  return retval;
+}
+
+
+/**
+  Loads instance `id` from storage `s` and returns it.
+  NULL is returned on error.
+ */
+DLiteInstance *sql_load(const DLiteStorage *s, const char *id)
+{
+  SqlStorage *ss = (SqlStorage *)s;
+  sqlite3_stmt *stmt=NULL;
+  Statements *st;
+  DLiteMeta *meta=NULL;
+  DLiteInstance *inst=NULL, *retval=NULL;
+  char uuid[DLITE_UUID_LENGTH+1];
+  const char *uri;
+  size_t *dims=NULL, i;
+  int stat;
+
+  if (!id) FAIL("sqlite: an id is required when loading an instance");
+  if (dlite_get_uuid(uuid, id) < 0) goto fail;
+
+  /* Look up metadata in uuidtable */
+  if (!ss->select_meta &&
+      !(ss->select_meta = sql_prepare(ss, "SELECT meta FROM uuidtable "
+                                      "WHERE uuid = ?")))
+    goto fail;
+  stmt = ss->select_meta;
+  sqlite3_bind_text(stmt, 1, uuid, -1, SQLITE_STATIC);
+  if ((stat = sqlite3_step(stmt)) != SQLITE_ROW) {
+    if (stat == SQLITE_DONE)
+      FAIL2("sqlite: no instance with id \"%s\" in storage \"%s\"",
+            id, s->location);
+    sql_error(ss, 1, "cannot look up instance");
+    goto fail;
+  }
+  if (!(meta = dlite_meta_get((const char *)sqlite3_column_text(stmt, 0))))
+    goto fail;
+  sqlite3_reset(stmt);
+
+  /* Select the row */
+  if (!(st = get_select(ss, meta))) goto fail;
+  stmt = st->select;
+  sqlite3_bind_text(stmt, 1, uuid, -1, SQLITE_STATIC);
+  if ((stat = sqlite3_step(stmt)) != SQLITE_ROW) {
+    if (stat == SQLITE_DONE)
+      FAIL2("sqlite: no instance with id \"%s\" in storage \"%s\"",
+            id, s->location);
+    sql_error(ss, 1, "cannot load instance");
+    goto fail;
+  }
+
+  /* Create instance */
+  if (meta->_ndimensions &&
+      !(dims = calloc(meta->_ndimensions, sizeof(size_t))))
+    FAIL("allocation failure");
+  if (sqlite3_column_type(stmt, st->idims) != SQLITE_NULL) {
+    int64_t *v = (int64_t *)sqlite3_column_blob(stmt, st->idims);
+    if ((size_t)sqlite3_column_bytes(stmt, st->idims) !=
+        meta->_ndimensions * sizeof(int64_t))
+      FAIL1("sqlite: invalid dims of instance '%s'", id);
+    for (i=0; i<meta->_ndimensions; i++) dims[i] = v[i];
+  }
+  uri = (st->iuri >= 0) ?
+    (const char *)sqlite3_column_text(stmt, st->iuri) : NULL;
+  if (!(inst = dlite_instance_create(meta, dims, (uri) ? uri : uuid)))
+    goto fail;
+
+  /* Assign properties */
+  for (i=0; i<meta->_nproperties; i++) {
+    DLiteProperty *p = meta->_properties + i;
+    int col = st->cols[i];
+    void *ptr;
+    if (col < 0 || sqlite3_column_type(stmt, col) == SQLITE_NULL) continue;
+    if (!(ptr = DLITE_PROP_RW(inst, i))) goto fail;
+    if (p->ndims) {
+      size_t nelem=1;
+      int j;
+      for (j=0; j<p->ndims; j++) nelem *= DLITE_PROP_DIM(inst, i, j);
+      stat = column_array(*(void **)ptr, p->type, p->size, nelem, stmt, col);
+    } else {
+      stat = column_scalar(ptr, p->type, p->size, stmt, col);
+    }
+    if (stat)
+      FAIL2("sqlite: cannot load property '%s' of '%s'", p->name, id);
+  }
+
+  retval = inst;
+ fail:
+  if (stmt) sqlite3_reset(stmt);
+  if (dims) free(dims);
+  if (meta) dlite_meta_decref(meta);
+  if (!retval && inst) dlite_instance_decref(inst);
+  return retval;
+}
+
+
+/**
+  Saves the `n` instances in `insts` to storage `s` in a single
+  transaction.  Returns non-zero on error.
+ */
+int sql_save_many(DLiteStorage *s, const DLiteInstance **insts, size_t n)
+{
+  SqlStorage *ss = (SqlStorage *)s;
+  Buf b = {NULL, 0, 0};
+  size_t i;
+  int retval=1;
+
+  if (sql_exec(ss, "BEGIN IMMEDIATE")) return 1;
+  for (i=0; i<n; i++)
+    if (insert_instance(ss, insts[i], &b)) break;
+  if (i == n && sql_exec(ss, "COMMIT") == 0)
+    retval = 0;
+  else
+    sqlite3_exec(ss->db, "ROLLBACK", NULL, NULL, NULL);
+  if (b.data) free(b.data);
+  return retval;
+}
+
+/**
+  Saves instance `inst` to storage `s`.  Returns non-zero on error.
+ */
+int sql_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  return sql_save_many(s, &inst, 1);
+}
+
+
+/**
+  Returns a new iterator over the uuids of all instances in storage
+  `s` whose metadata uri matches glob `pattern`.  If `pattern` is
+  NULL, all instances are iterated over.
+
+  The pattern is matched with the SQLite GLOB operator, which uses
+  the index on the metadata uri for the part of `pattern` before the
+  first wildcard.
+
+  Returns NULL on error.
+ */
+void *sql_iter_create(const DLiteStorage *s, const char *pattern)
+{
+  SqlStorage *ss = (SqlStorage *)s;
+  SqlIter *iter=NULL;
+  const char *sql = (pattern) ?
+    "SELECT uuid FROM uuidtable WHERE meta GLOB ?" :
+    "SELECT uuid FROM uuidtable";
+
+  if (!(iter = calloc(1, sizeof(SqlIter)))) FAIL("allocation failure");
+  if (sqlite3_prepare_v2(ss->db, sql, -1, &iter->stmt, NULL) != SQLITE_OK) {
+    /* A database without instances has no uuidtable */
+    if (strncmp(sqlite3_errmsg(ss->db), "no such table", 13) == 0)
+      return iter;
+    sql_error(ss, 1, "cannot query instances");
+    goto fail;
+  }
+  if (pattern &&
+      sqlite3_bind_text(iter->stmt, 1, pattern, -1, SQLITE_TRANSIENT) !=
+      SQLITE_OK) {
+    sql_error(ss, 1, "cannot query instances");
+    goto fail;
+  }
+  return iter;
+ fail:
+  if (iter) {
+    if (iter->stmt) sqlite3_finalize(iter->stmt);
+    free(iter);
+  }
+  return NULL;
+}
+
+/**
+  Writes the uuid of the next instance to `buf`, where `iter` is an
+  iterator returned by sql_iter_create().
+
+  Returns zero on success, 1 if there are no more UUIDs to iterate
+  over and a negative number on other errors.
+ */
+int sql_iter_next(void *iter, char *buf)
+{
+  SqlIter *it = iter;
+  int stat;
+  if (!it->stmt) return 1;
+  if ((stat = sqlite3_step(it->stmt)) == SQLITE_DONE) return 1;
+  if (stat != SQLITE_ROW)
+    return errx(-1, "sqlite: cannot query instances: %s",
+                sqlite3_errstr(stat));
+  strncpy(buf, (const char *)sqlite3_column_text(it->stmt, 0),
+          DLITE_UUID_LENGTH);
+  buf[DLITE_UUID_LENGTH] = '\0';
+  return 0;
+}
+
+/**
+  Free's iterator created with sql_iter_create().
+ */
+void sql_iter_free(void *iter)
+{
+  SqlIter *it = iter;
+  if (it->stmt) sqlite3_finalize(it->stmt);
+  free(it);
+}
+
+
+/* Appends the SQL translation of query node `n` to `*sql`, which has
+   allocated size `*size`, at position `*m`.  Returns non-zero on
+   error. */
+static int query_sql(char **sql, size_t *size, size_t *m,
+                     const DLiteQuery *q, const DLiteQueryNode *n)
+{
+  static const char *ops[] = {
+    " OR ", " AND ", "NOT ", " = ", " <> ", " < ", " <= ", " > ", " >= "
+  };
+  char *str;
+  switch (n->op) {
+  case dliteQueryNot:
+    *m += asnpprintf(sql, size, *m, "(NOT ");
+    if (query_sql(sql, size, m, q, n->left)) return 1;
+    *m += asnpprintf(sql, size, *m, ")");
+    break;
+  case dliteQueryOr:
+  case dliteQueryAnd:
+  case dliteQueryEq:
+  case dliteQueryNe:
+  case dliteQueryLt:
+  case dliteQueryLe:
+  case dliteQueryGt:
+  case dliteQueryGe:
+    *m += asnpprintf(sql, size, *m, "(");
+    if (query_sql(sql, size, m, q, n->left)) return 1;
+    *m += asnpprintf(sql, size, *m, "%s", ops[n->op]);
+    if (query_sql(sql, size, m, q, n->right)) return 1;
+    *m += asnpprintf(sql, size, *m, ")");
+    break;
+  case dliteQueryProperty:
+    /* NULL strings compare equal to the empty string */
+    if (!(str = quote_ident(q->meta->_properties[n->index].name))) return 1;
+    if (n->isstring)
+      *m += asnpprintf(sql, size, *m, "COALESCE(%s, '')", str);
+    else
+      *m += asnpprintf(sql, size, *m, "%s", str);
+    sqlite3_free(str);
+    break;
+  case dliteQueryNumber:
+    *m += asnpprintf(sql, size, *m, "%.17g", n->number);
+    break;
+  case dliteQueryString:
+    if (!(str = sqlite3_mprintf("%Q", n->string)))
+      return err(1, "allocation failure");
+    *m += asnpprintf(sql, size, *m, "%s", str);
+    sqlite3_free(str);
+    break;
+  }
+  return 0;
+}
+
+/**
+  Returns a new iterator over the uuids of instances in `s` matching
+  query `q`.  The predicate is translated to an SQL WHERE clause on
+  the table of the metadata of `q`.
+
+  Returns NULL on error.
+ */
+void *sql_query_create(const DLiteStorage *s, const DLiteQuery *q)
+{
+  SqlStorage *ss = (SqlStorage *)s;
+  SqlIter *iter=NULL;
+  char *sql=NULL, *ident=NULL;
+  size_t size=0, m=0;
+
+  if (!(iter = calloc(1, sizeof(SqlIter)))) FAIL("allocation failure");
+  if (!(ident = quote_ident(q->meta->uri))) goto fail;
+  m += asnpprintf(&sql, &size, m, "SELECT uuid FROM %s", ident);
+  if (q->root) {
+    m += asnpprintf(&sql, &size, m, " WHERE ");
+    if (query_sql(&sql, &size, &m, q, q->root)) goto fail;
+  }
+  if (sqlite3_prepare_v2(ss->db, sql, -1, &iter->stmt, NULL) != SQLITE_OK) {
+    /* No table means no instances of this metadata */
+    if (strncmp(sqlite3_errmsg(ss->db), "no such table", 13) == 0) {
+      iter->stmt = NULL;
+      goto done;
+    }
+    sql_error(ss, 1, "cannot query instances");
+    goto fail;
+  }
+ done:
+  sqlite3_free(ident);
+  free(sql);
+  return iter;
+ fail:
+  if (ident) sqlite3_free(ident);
+  if (sql) free(sql);
+  if (iter) {
+    if (iter->stmt) sqlite3_finalize(iter->stmt);
+    free(iter);
+  }
+  return NULL;
+}
+
+
+static DLiteStoragePlugin dlite_sqlite_plugin = {
+  /* head */
+  "sqlite",                 /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  sql_open,                 /* open */
+  sql_close,                /* close */
+
+  /* queue api */
+  sql_iter_create,          /* iterCreate */
+  sql_iter_next,            /* iterNext */
+  sql_iter_free,            /* iterFree */
+  NULL,                     /* getUUIDs */
+
+  /* direct api */
+  sql_load,                 /* loadInstance */
+  sql_save,                 /* saveInstance */
+  NULL,                     /* loadInstances */
+  sql_save_many,            /* saveInstances */
+
+  /* datamodel api */
+  NULL,                     /* dataModel */
+  NULL,                     /* dataModelFree */
+
+  NULL,                     /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  NULL,                     /* getDimensionSize */
+  NULL,                     /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                     /* setMetaURI */
+  NULL,                     /* setDimensionSize */
+  NULL,                     /* setProperty */
+
+  NULL,                     /* hasDimension */
+  NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  NULL,                     /* getDataName, obsolute */
+  NULL,                     /* setDataName, obsolute */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  sql_query_create,         /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &dlite_sqlite_plugin;
+}
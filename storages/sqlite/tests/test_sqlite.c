@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+
+#include "test_fixtures.h"
+
+#define NINST 10
+
+DLiteStorage *db=NULL;
+char *path = "test-sqlite.db";
+char *uri = "http://onto-ns.com/meta/0.1/SqliteTestEntity";
+DLiteMeta *entity=NULL;
+DLiteInstance *instances[NINST];
+
+
+MU_TEST(test_open_db)
+{
+  mu_check((db = dlite_storage_open("sqlite", path, "mode=w")));
+  mu_assert_int_eq(1, dlite_storage_is_writable(db));
+  mu_assert_int_eq(0, count_instances(db, NULL));
+}
+
+MU_TEST(test_create)
+{
+  int i;
+  mu_check((entity = create_test_entity(uri)));
+  for (i=0; i<NINST; i++)
+    mu_check((instances[i] = create_test_instance(entity, i)));
+}
+
+MU_TEST(test_save)
+{
+  mu_assert_int_eq(0, dlite_instance_save(db, instances[0]));
+  mu_assert_int_eq(0, dlite_instance_save_many(db,
+                                               (const DLiteInstance **)instances,
+                                               NINST));
+
+  /* saving existing instances is a no-op */
+  mu_assert_int_eq(0, dlite_instance_save_many(db,
+                                               (const DLiteInstance **)instances,
+                                               NINST));
+  mu_assert_int_eq(NINST, count_instances(db, NULL));
+
+  /* metadata is not supported */
+  err_clear();
+  mu_check(dlite_instance_save(db, (DLiteInstance *)entity));
+  err_clear();
+}
+
+MU_TEST(test_load)
+{
+  int i;
+  for (i=0; i<NINST; i++) {
+    DLiteInstance *inst;
+    mu_check((inst = dlite_instance_load(db, instances[i]->uuid)));
+    mu_assert_string_eq(instances[i]->uuid, inst->uuid);
+    mu_assert_int_eq(0, check_test_instance(inst, i));
+    dlite_instance_decref(inst);
+  }
+
+  err_clear();
+  mu_check(!dlite_instance_load(db, "00000000-0000-0000-0000-000000000000"));
+  err_clear();
+}
+
+MU_TEST(test_iter)
+{
+  mu_assert_int_eq(NINST, count_instances(db, uri));
+  mu_assert_int_eq(NINST, count_instances(db,
+                                          "http://onto-ns.com/meta/0.1/*"));
+  mu_assert_int_eq(NINST, count_instances(db, "*/SqliteTestEnt?ty"));
+  mu_assert_int_eq(0, count_instances(db, "http://no/such/meta"));
+}
+
+/* Returns the number of instances in `s` matching `predicate`. */
+static int count_matches(DLiteStorage *s, const char *predicate)
+{
+  DLiteStorageQuery *q;
+  DLiteInstance *inst;
+  int n=0, stat;
+  if (!(q = dlite_storage_query(s, uri, predicate))) return -1;
+  while ((stat = dlite_storage_query_next(q, &inst)) == 0) {
+    dlite_instance_decref(inst);
+    n++;
+  }
+  dlite_storage_query_free(q);
+  return (stat < 0) ? -1 : n;
+}
+
+MU_TEST(test_query)
+{
+  mu_assert_int_eq(NINST, count_matches(db, NULL));
+  mu_assert_int_eq(5, count_matches(db, "value >= 50"));
+  mu_assert_int_eq(3, count_matches(db, "value >= 50 & flag"));
+  mu_assert_int_eq(5, count_matches(db, "!flag & value != 0 | value = 90"));
+  mu_assert_int_eq(7, count_matches(db, "name == 'inst'"));
+  mu_assert_int_eq(3, count_matches(db, "!name"));
+  mu_assert_int_eq(2, count_matches(db, "(name = \"\") & value < 50"));
+
+  err_clear();
+  mu_check(!dlite_storage_query(db, uri, "items > 1"));
+  mu_check(!dlite_storage_query(db, uri, "nosuchprop = 1"));
+  mu_check(!dlite_storage_query(db, uri, "name = 1"));
+  mu_check(!dlite_storage_query(db, uri, "value > "));
+  err_clear();
+}
+
+MU_TEST(test_concurrent_reader)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  size_t shape[] = {1};
+
+  /* A reader sees committed instances while the writer is open */
+  mu_check((s = dlite_storage_open("sqlite", path, "mode=r")));
+  mu_assert_int_eq(0, dlite_storage_is_writable(s));
+  mu_assert_int_eq(NINST, count_instances(s, uri));
+
+  mu_check((inst = dlite_instance_create(entity, shape, NULL)));
+  mu_assert_int_eq(0, dlite_instance_save(db, inst));
+  mu_assert_int_eq(NINST + 1, count_instances(s, uri));
+  dlite_instance_decref(inst);
+
+  mu_check((inst = dlite_instance_load(s, instances[5]->uuid)));
+  mu_assert_int_eq(50, *(int *)dlite_instance_get_property(inst, "value"));
+  dlite_instance_decref(inst);
+
+  /* read-only */
+  err_clear();
+  mu_check(dlite_instance_save(s, instances[0]));
+  err_clear();
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_close_db)
+{
+  int i;
+  mu_assert_int_eq(0, dlite_storage_close(db));
+  for (i=0; i<NINST; i++) dlite_instance_decref(instances[i]);
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_open_db);
+  MU_RUN_TEST(test_create);
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_iter);
+  MU_RUN_TEST(test_query);
+  MU_RUN_TEST(test_concurrent_reader);
+  MU_RUN_TEST(test_close_db);
+}
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,1713 @@
+/* dlite-yaml-storage.c -- DLite storage plugin for YAML */
+
+/*
+  This plugin stores instances in a YAML file.  The file is a mapping
+  from the uuid of each instance to its dict representation, as
+  returned by Instance.asdict() in Python:
+
+      8a5b1e18-c2f0-5c1f-8c5c-6fbb4f16a4ba:
+        dimensions:
+          N: 2
+        meta: http://onto-ns.com/meta/0.1/MyEntity
+        properties:
+          length: 1.5
+          tags:
+          - foo
+          - bar
+        uuid: 8a5b1e18-c2f0-5c1f-8c5c-6fbb4f16a4ba
+
+  The dimensions, properties and relations of metadata are written as
+  sequences, like in Instance.asdict().  When loading metadata, they
+  may also be given as mappings from names to descriptions, like in
+  the SOFT7 format.  Keys are written in sorted order and
+  multi-dimensional arrays as nested sequences, such that the output
+  is the same as yaml.dump() of the dict representation.
+
+  The plugin is implemented with the event API of libyaml and never
+  builds an in-memory document tree.  When a storage is opened, the
+  file is read into memory and scanned once to record the byte range
+  and metadata uri of each instance.  Loading an instance parses only
+  its byte range and writes the values directly into the property
+  buffers of the new instance.
+
+  Saved instances are serialised immediately.  The file is written
+  when a writable storage is closed.  The events of instances that
+  were not saved are passed through from the original file.
+
+  Files written by the Python yaml plugin, where each instance is
+  represented as a !!python/object/apply:collections.OrderedDict
+  sequence of key-value pairs, can also be read.
+ */
+#include <assert.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <yaml.h>
+
+#include "config.h"
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/globmatch.h"
+#include "utils/strtob.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+
+/* Maximum length of mapping keys */
+#define KEYSIZE 256
+
+
+/* An instance in the storage */
+typedef struct {
+  char *key;        /* Key in the top-level mapping, normally the uuid */
+  char *meta;       /* Metadata uri, NULL if not given */
+  const char *src;  /* YAML source of the instance */
+  size_t len;       /* Length of `src` */
+  char *text;       /* Serialised YAML of a saved instance, NULL if the
+                       instance is read from the file */
+} Entry;
+
+/* Storage for YAML */
+typedef struct {
+  DLiteStorage_HEAD
+  char *buf;          /* Content of the file */
+  Entry *entries;     /* Instances in the storage */
+  size_t nentries;    /* Number of entries */
+  size_t size;        /* Allocated number of entries */
+  map_int_t index;    /* Maps keys to entry index */
+  int modified;       /* Whether any instance has been saved */
+} YamlStorage;
+
+/* Iterator over uuids */
+typedef struct {
+  const YamlStorage *ys;
+  char *pattern;
+  size_t pos;
+} YamlIter;
+
+/* Event reader */
+typedef struct {
+  yaml_parser_t parser;
+  yaml_event_t event;   /* Current event */
+  int has_event;        /* Whether `event` should be deleted */
+  size_t keyline;       /* Line of the last mapping key */
+  const char *id;       /* Id used in error messages */
+} Reader;
+
+/* Kinds of mapping nodes */
+typedef enum {
+  mapPlain=1,  /* YAML mapping */
+  mapPairs     /* Sequence of [key, value] pairs (Python OrderedDict) */
+} MapKind;
+
+/* Mapping key and an associated index, used for sorting */
+typedef struct {
+  const char *name;
+  int index;
+} Key;
+
+/* Dimension read before the metadata is known */
+typedef struct {
+  char *name;
+  long value;    /* -1 if not an integer */
+} DimItem;
+
+
+/* Compares keys by name */
+static int keycmp(const void *a, const void *b)
+{
+  return strcmp(((const Key *)a)->name, ((const Key *)b)->name);
+}
+
+
+/***************************************************************
+ * Reading
+ ***************************************************************/
+
+/* Advances `r` to the next event.  Returns non-zero on error. */
+static int next_event(Reader *r)
+{
+  if (r->has_event) yaml_event_delete(&r->event);
+  r->has_event = 0;
+  if (!yaml_parser_parse(&r->parser, &r->event))
+    return errx(1, "yaml: %s at line %d, column %d: %s",
+                (r->parser.problem) ? r->parser.problem : "parse error",
+                (int)r->parser.problem_mark.line + 1,
+                (int)r->parser.problem_mark.column + 1, r->id);
+  r->has_event = 1;
+  if (r->event.type == YAML_ALIAS_EVENT)
+    return errx(1, "yaml: aliases are not supported: %s", r->id);
+  return 0;
+}
+
+/* Initialises `r` for reading the YAML document in `src` of length
+   `len` and advances to its root node.  If `src` has no document,
+   the current event is the end of the stream.  Returns non-zero on
+   error. */
+static int reader_init(Reader *r, const char *src, size_t len,
+                       const char *id)
+{
+  memset(r, 0, sizeof(Reader));
+  r->id = id;
+  if (!yaml_parser_initialize(&r->parser))
+    return err(1, "yaml: cannot initialise parser");
+  yaml_parser_set_input_string(&r->parser, (const unsigned char *)src, len);
+  if (next_event(r) || next_event(r)) return 1;
+  if (r->event.type == YAML_STREAM_END_EVENT) return 0;
+  if (r->event.type != YAML_DOCUMENT_START_EVENT)
+    return errx(1, "yaml: expected start of document: %s", id);
+  return next_event(r);
+}
+
+/* Releases resources held by `r`.  It is safe to call this function
+   more than once. */
+static void reader_deinit(Reader *r)
+{
+  if (r->has_event) yaml_event_delete(&r->event);
+  yaml_parser_delete(&r->parser);
+  memset(r, 0, sizeof(Reader));
+}
+
+/* Skips the node starting at the current event.  On return, the
+   current event is the last event of the node.  Returns non-zero on
+   error. */
+static int skip_node(Reader *r)
+{
+  int depth=0;
+  do {
+    switch (r->event.type) {
+    case YAML_MAPPING_START_EVENT:
+    case YAML_SEQUENCE_START_EVENT:
+      depth++;
+      break;
+    case YAML_MAPPING_END_EVENT:
+    case YAML_SEQUENCE_END_EVENT:
+      depth--;
+      break;
+    default:
+      break;
+    }
+    if (depth == 0) return 0;
+  } while (next_event(r) == 0);
+  return 1;
+}
+
+/* Returns the value of the current event if it is a scalar, otherwise
+   NULL. */
+static const char *scalar(const Reader *r)
+{
+  if (r->event.type != YAML_SCALAR_EVENT) return NULL;
+  return (const char *)r->event.data.scalar.value;
+}
+
+/* Returns non-zero if the current event is a null scalar. */
+static int is_null(const Reader *r)
+{
+  const char *s = scalar(r);
+  if (!s || r->event.data.scalar.style != YAML_PLAIN_SCALAR_STYLE) return 0;
+  return (!*s || strcmp(s, "~") == 0 || strcmp(s, "null") == 0 ||
+          strcmp(s, "Null") == 0 || strcmp(s, "NULL") == 0);
+}
+
+/* Returns the kind of the mapping starting at the current event or
+   zero if the current event does not start a mapping. */
+static MapKind mapping_kind(const Reader *r)
+{
+  const char *tag;
+  if (r->event.type == YAML_MAPPING_START_EVENT) return mapPlain;
+  if (r->event.type == YAML_SEQUENCE_START_EVENT &&
+      (tag = (const char *)r->event.data.sequence_start.tag) &&
+      strstr(tag, "OrderedDict")) return mapPairs;
+  return 0;
+}
+
+/* Advances to the next key of a mapping of kind `kind` and copies it
+   to `key`, which should be of size KEYSIZE.  On return, the current
+   event is the first event of the value.
+
+   Returns 1 if a key was read, 0 at the end of the mapping and -1 on
+   error. */
+static int mapping_next(Reader *r, MapKind kind, char *key)
+{
+  const char *s;
+  if (next_event(r)) return -1;
+  if (r->event.type == YAML_MAPPING_END_EVENT ||
+      r->event.type == YAML_SEQUENCE_END_EVENT) return 0;
+  if (kind == mapPairs) {
+    if (r->event.type != YAML_SEQUENCE_START_EVENT)
+      return errx(-1, "yaml: expected key-value pair: %s", r->id);
+    if (next_event(r)) return -1;
+  }
+  if (!(s = scalar(r)))
+    return errx(-1, "yaml: mapping keys must be scalars: %s", r->id);
+  if (strlen(s) >= KEYSIZE)
+    return errx(-1, "yaml: too long key \"%.40s...\": %s", s, r->id);
+  strcpy(key, s);
+  r->keyline = r->event.start_mark.line;
+  if (next_event(r)) return -1;
+  return 1;
+}
+
+/* Finishes reading a value of a mapping of kind `kind`.  The current
+   event should be the last event of the value.  Returns non-zero on
+   error. */
+static int mapping_value_end(Reader *r, MapKind kind)
+{
+  if (kind == mapPairs) {
+    if (next_event(r)) return 1;
+    if (r->event.type != YAML_SEQUENCE_END_EVENT)
+      return errx(1, "yaml: expected end of key-value pair: %s", r->id);
+  }
+  return 0;
+}
+
+/* Advances to the next item of a sequence.  Returns 1 if the current
+   event is the first event of an item, 0 at the end of the sequence
+   and -1 on error. */
+static int seq_next(Reader *r)
+{
+  if (next_event(r)) return -1;
+  return (r->event.type == YAML_SEQUENCE_END_EVENT) ? 0 : 1;
+}
+
+/* Returns the number of items in the sequence or mapping starting at
+   the current event and skips it.  Returns -1 on error. */
+static int count_items(Reader *r)
+{
+  char key[KEYSIZE];
+  MapKind kind = mapping_kind(r);
+  int n=0, stat;
+  if (kind) {
+    while ((stat = mapping_next(r, kind, key)) == 1) {
+      if (skip_node(r) || mapping_value_end(r, kind)) return -1;
+      n++;
+    }
+  } else if (r->event.type == YAML_SEQUENCE_START_EVENT) {
+    while ((stat = seq_next(r)) == 1) {
+      if (skip_node(r)) return -1;
+      n++;
+    }
+  } else if (is_null(r)) {
+    return 0;
+  } else {
+    return errx(-1, "yaml: expected sequence or mapping: %s", r->id);
+  }
+  return (stat) ? -1 : n;
+}
+
+/* Returns a newly allocated copy of the current scalar or NULL if it
+   is null.  `*ok` is set to zero on error. */
+static char *scalar_dup(const Reader *r, int *ok)
+{
+  char *s;
+  if (is_null(r)) return NULL;
+  if (!scalar(r)) {
+    *ok = 0;
+    return errx(1, "yaml: expected scalar: %s", r->id), NULL;
+  }
+  if (!(s = strdup(scalar(r)))) {
+    *ok = 0;
+    err(1, "allocation failure");
+  }
+  return s;
+}
+
+
+/* Parses the scalar at the current event into `ptr`.  Returns
+   non-zero on error. */
+static int parse_scalar(Reader *r, void *ptr, DLiteType type, size_t size)
+{
+  const char *s = scalar(r);
+  int n;
+  if (!s) return errx(1, "yaml: expected scalar value: %s", r->id);
+
+  if (is_null(r)) {
+    if (type == dliteStringPtr && *(char **)ptr) {
+      free(*(char **)ptr);
+      *(char **)ptr = NULL;
+    }
+    return 0;
+  }
+
+  switch (type) {
+  case dliteFixString:
+    strncpy(ptr, s, size);
+    ((char *)ptr)[size-1] = '\0';
+    return 0;
+
+  case dliteStringPtr:
+    {
+      char *q = strdup(s);
+      if (!q) return err(1, "allocation failure");
+      if (*(char **)ptr) free(*(char **)ptr);
+      *(char **)ptr = q;
+    }
+    return 0;
+
+  case dliteFloat:
+    /* YAML names of special values */
+    {
+      const char *q = (*s == '-' || *s == '+') ? s + 1 : s;
+      double v;
+      if (strcasecmp(q, ".nan") == 0)
+        v = NAN;
+      else if (strcasecmp(q, ".inf") == 0)
+        v = (*s == '-') ? -INFINITY : INFINITY;
+      else
+        break;
+      return dlite_type_copy_cast(ptr, type, size, &v, dliteFloat,
+                                  sizeof(double));
+    }
+
+  default:
+    break;
+  }
+
+  if ((n = dlite_type_scan(s, -1, ptr, type, size, dliteFlagRaw)) < 0)
+    return errx(1, "yaml: invalid value \"%s\": %s", s, r->id);
+  while (isspace(s[n])) n++;
+  if (s[n])
+    return errx(1, "yaml: invalid value \"%s\": %s", s, r->id);
+  return 0;
+}
+
+/* Parses the dimension at the current event into `d`.  If `name` is
+   not NULL, the dimension is given as a name-description pair and the
+   current event is the description. */
+static int parse_dimension(Reader *r, DLiteDimension *d, const char *name)
+{
+  char key[KEYSIZE];
+  MapKind kind;
+  int stat, ok=1;
+  if (d->name) free(d->name);
+  if (d->description) free(d->description);
+  memset(d, 0, sizeof(DLiteDimension));
+
+  if (name) {
+    if (!(d->name = strdup(name))) return err(1, "allocation failure");
+    d->description = scalar_dup(r, &ok);
+    return !ok;
+  }
+  if (!(kind = mapping_kind(r)))
+    return errx(1, "yaml: dimension must be a mapping: %s", r->id);
+  while ((stat = mapping_next(r, kind, key)) == 1) {
+    if (strcmp(key, "name") == 0 && !d->name)
+      d->name = scalar_dup(r, &ok);
+    else if (strcmp(key, "description") == 0 && !d->description)
+      d->description = scalar_dup(r, &ok);
+    else if (skip_node(r))
+      return 1;
+    if (!ok || mapping_value_end(r, kind)) return 1;
+  }
+  if (stat) return 1;
+  if (!d->name) return errx(1, "yaml: dimension has no name: %s", r->id);
+  return 0;
+}
+
+/* Parses the property definition at the current event into `p`.  If
+   `name` is not NULL, the property is given as a name-definition
+   pair and `name` is the name. */
+static int parse_propdef(Reader *r, DLiteProperty *p, const char *name)
+{
+  char key[KEYSIZE];
+  MapKind kind;
+  int stat, ok=1;
+  if (p->name) free(p->name);
+  if (p->dims) {
+    int i;
+    for (i=0; i<p->ndims; i++) if (p->dims[i]) free(p->dims[i]);
+    free(p->dims);
+  }
+  if (p->unit) free(p->unit);
+  if (p->iri) free(p->iri);
+  if (p->description) free(p->description);
+  memset(p, 0, sizeof(DLiteProperty));
+
+  if (name && !(p->name = strdup(name))) return err(1, "allocation failure");
+  if (!(kind = mapping_kind(r)))
+    return errx(1, "yaml: property must be a mapping: %s", r->id);
+  while ((stat = mapping_next(r, kind, key)) == 1) {
+    if (strcmp(key, "name") == 0 && !p->name) {
+      p->name = scalar_dup(r, &ok);
+    } else if (strcmp(key, "type") == 0) {
+      if (!scalar(r))
+        return errx(1, "yaml: property type must be a string: %s", r->id);
+      if (dlite_type_set_dtype_and_size(scalar(r), &p->type, &p->size))
+        return 1;
+    } else if ((strcmp(key, "dims") == 0 || strcmp(key, "shape") == 0) &&
+               !p->dims) {
+      int n;
+      if (r->event.type != YAML_SEQUENCE_START_EVENT)
+        return errx(1, "yaml: property dims must be a sequence: %s", r->id);
+      while ((n = seq_next(r)) == 1) {
+        char **dims = realloc(p->dims, (p->ndims + 1) * sizeof(char *));
+        if (!dims) return err(1, "allocation failure");
+        p->dims = dims;
+        if (!(p->dims[p->ndims++] = scalar_dup(r, &ok)) && ok)
+          return errx(1, "yaml: property dims must be strings: %s", r->id);
+        if (!ok) return 1;
+      }
+      if (n) return 1;
+    } else if (strcmp(key, "unit") == 0 && !p->unit) {
+      p->unit = scalar_dup(r, &ok);
+    } else if (strcmp(key, "iri") == 0 && !p->iri) {
+      p->iri = scalar_dup(r, &ok);
+    } else if (strcmp(key, "description") == 0 && !p->description) {
+      p->description = scalar_dup(r, &ok);
+    } else if (skip_node(r)) {
+      return 1;
+    }
+    if (!ok || mapping_value_end(r, kind)) return 1;
+  }
+  if (stat) return 1;
+  if (!p->name) return errx(1, "yaml: property has no name: %s", r->id);
+  if (!p->size)
+    return errx(1, "yaml: property \"%s\" has no type: %s", p->name, r->id);
+  return 0;
+}
+
+/* Parses the relation at the current event into `t`.  The relation
+   may be given as a sequence [s, p, o] or [s, p, o, id] or as a
+   mapping with keys s, p, o and optionally id. */
+static int parse_relation(Reader *r, DLiteRelation *t)
+{
+  char key[KEYSIZE], *v[4]={NULL, NULL, NULL, NULL};
+  const char *names[] = {"s", "p", "o", "id"};
+  MapKind kind;
+  int i, n=0, stat, ok=1, retval=1;
+
+  if ((kind = mapping_kind(r))) {
+    while ((stat = mapping_next(r, kind, key)) == 1) {
+      for (i=0; i<4; i++)
+        if (strcmp(key, names[i]) == 0 && !v[i]) break;
+      if (i < 4) {
+        if (!(v[i] = scalar_dup(r, &ok)) && ok)
+          FAIL1("yaml: relation items must be strings: %s", r->id);
+      } else if (skip_node(r)) {
+        goto fail;
+      }
+      if (!ok || mapping_value_end(r, kind)) goto fail;
+    }
+  } else if (r->event.type == YAML_SEQUENCE_START_EVENT) {
+    while ((stat = seq_next(r)) == 1) {
+      if (n >= 4) FAIL1("yaml: too many items in relation: %s", r->id);
+      if (!(v[n++] = scalar_dup(r, &ok)) && ok)
+        FAIL1("yaml: relation items must be strings: %s", r->id);
+      if (!ok) goto fail;
+    }
+  } else {
+    FAIL1("yaml: relation must be a sequence or mapping: %s", r->id);
+  }
+  if (stat) goto fail;
+  if (!v[0] || !v[1] || !v[2])
+    FAIL1("yaml: relation must have a subject, predicate and object: %s",
+          r->id);
+  if (triple_reset(t, v[0], v[1], v[2], v[3])) goto fail;
+  retval = 0;
+ fail:
+  for (i=0; i<4; i++) if (v[i]) free(v[i]);
+  return retval;
+}
+
+static int parse_value(Reader *r, void *ptr, DLiteType type, size_t size);
+
+/* Parses the struct of type `type` at the current event into `ptr`.
+   Returns non-zero on error. */
+static int parse_struct(Reader *r, void *ptr, DLiteType type)
+{
+  const DLiteStruct *st = dlite_struct_get(type);
+  char key[KEYSIZE];
+  MapKind kind;
+  size_t i;
+  int stat;
+  if (!(kind = mapping_kind(r)))
+    return errx(1, "yaml: struct %s must be a mapping: %s", st->name, r->id);
+  while ((stat = mapping_next(r, kind, key)) == 1) {
+    for (i=0; i < st->nfields; i++)
+      if (strcmp(key, st->fields[i].name) == 0) break;
+    if (i < st->nfields) {
+      const DLiteStructField *f = st->fields + i;
+      if (parse_value(r, (char *)ptr + f->offset, f->type, f->size)) return 1;
+    } else if (skip_node(r)) {
+      return 1;
+    }
+    if (mapping_value_end(r, kind)) return 1;
+  }
+  return stat;
+}
+
+/* Parses the value of type `type` and size `size` at the current event
+   into `ptr`.  Returns non-zero on error. */
+static int parse_value(Reader *r, void *ptr, DLiteType type, size_t size)
+{
+  switch (type) {
+  case dliteDimension:
+    return parse_dimension(r, ptr, NULL);
+  case dliteProperty:
+    return parse_propdef(r, ptr, NULL);
+  case dliteRelation:
+    return parse_relation(r, ptr);
+  default:
+    if (dlite_type_is_struct(type)) return parse_struct(r, ptr, type);
+    return parse_scalar(r, ptr, type, size);
+  }
+}
+
+/* Parses nested sequences at the current event into the array `*dst`
+   with dimensions `dims`.  `level` is the current nesting level.
+   `*dst` is advanced for each element. */
+static int parse_array(Reader *r, const DLiteProperty *p, const size_t *dims,
+                       int level, char **dst)
+{
+  size_t n=0;
+  int stat;
+  if (r->event.type != YAML_SEQUENCE_START_EVENT)
+    return errx(1, "yaml: expected sequence for property \"%s\": %s",
+                p->name, r->id);
+  while ((stat = seq_next(r)) == 1) {
+    if (n >= dims[level])
+      return errx(1, "yaml: too many elements in dimension %d of property "
+                  "\"%s\": %s", level, p->name, r->id);
+    if (level < p->ndims - 1) {
+      if (parse_array(r, p, dims, level + 1, dst)) return 1;
+    } else {
+      if (parse_value(r, *dst, p->type, p->size)) return 1;
+      *dst += p->size;
+    }
+    n++;
+  }
+  if (stat) return 1;
+  if (n != dims[level])
+    return errx(1, "yaml: expected %d elements in dimension %d of property "
+                "\"%s\", got %d: %s", (int)dims[level], level, p->name,
+                (int)n, r->id);
+  return 0;
+}
+
+/* Parses dimensions or property definitions given as a mapping from
+   names to descriptions or definitions at the current event into the
+   array `dst` of length `n`. */
+static int parse_named(Reader *r, const DLiteProperty *p, size_t n, char *dst)
+{
+  char key[KEYSIZE];
+  MapKind kind = mapping_kind(r);
+  size_t i=0;
+  int stat;
+  while ((stat = mapping_next(r, kind, key)) == 1) {
+    if (i >= n)
+      return errx(1, "yaml: too many items in \"%s\": %s", p->name, r->id);
+    if (p->type == dliteDimension) {
+      if (parse_dimension(r, (DLiteDimension *)dst + i, key)) return 1;
+    } else {
+      if (parse_propdef(r, (DLiteProperty *)dst + i, key)) return 1;
+    }
+    if (mapping_value_end(r, kind)) return 1;
+    i++;
+  }
+  return stat;
+}
+
+/* Parses the value of property `i` of `inst` at the current event
+   directly into the property buffer.  Returns non-zero on error. */
+static int parse_prop(Reader *r, DLiteInstance *inst, int i)
+{
+  const DLiteProperty *p = inst->meta->_properties + i;
+  void *ptr;
+  int stat;
+  if (!(ptr = DLITE_PROP_RW(inst, i))) return 1;
+  if (p->ndims == 0) {
+    stat = parse_value(r, ptr, p->type, p->size);
+  } else {
+    char *dst = *(char **)ptr;
+    size_t *dims = DLITE_PROP_DIMS(inst, i);
+    if (p->ndims == 1 && mapping_kind(r) &&
+        (p->type == dliteDimension || p->type == dliteProperty))
+      stat = parse_named(r, p, dims[0], dst);
+    else if (is_null(r))
+      stat = 0;
+    else
+      stat = parse_array(r, p, dims, 0, &dst);
+  }
+  if (stat)
+    return errx(1, "yaml: cannot load property \"%s\": %s", p->name, r->id);
+  if (inst->meta->_loadprop) inst->meta->_loadprop(inst, i);
+  return 0;
+}
+
+/* Returns the index of property `name` in `meta` or -1 if there is no
+   such property. */
+static int prop_index(const DLiteMeta *meta, const char *name)
+{
+  size_t i;
+  for (i=0; i<meta->_nproperties; i++)
+    if (strcmp(meta->_properties[i].name, name) == 0) return (int)i;
+  return -1;
+}
+
+/* Parses the properties of data instance `inst` given as a mapping at
+   the current event. */
+static int parse_data_props(Reader *r, DLiteInstance *inst)
+{
+  char key[KEYSIZE];
+  MapKind kind = mapping_kind(r);
+  int i, stat;
+  if (!kind) {
+    if (is_null(r)) return 0;
+    return errx(1, "yaml: properties must be a mapping: %s", r->id);
+  }
+  while ((stat = mapping_next(r, kind, key)) == 1) {
+    if ((i = prop_index(inst->meta, key)) < 0)
+      return errx(1, "yaml: \"%s\" has no property \"%s\": %s",
+                  inst->meta->uri, key, r->id);
+    if (parse_prop(r, inst, i) || mapping_value_end(r, kind)) return 1;
+  }
+  return stat;
+}
+
+/* Reads data dimensions given as a mapping at the current event into
+   `*items`.  Returns the number of dimensions or -1 on error. */
+static int read_dims(Reader *r, DimItem **items)
+{
+  char key[KEYSIZE], *endptr;
+  MapKind kind = mapping_kind(r);
+  int n=0, stat;
+  if (!kind) return count_items(r);
+  while ((stat = mapping_next(r, kind, key)) == 1) {
+    DimItem *p = realloc(*items, (n + 1) * sizeof(DimItem));
+    const char *s = scalar(r);
+    if (!p) return err(-1, "allocation failure");
+    *items = p;
+    p += n++;
+    p->value = -1;
+    if (!(p->name = strdup(key))) return err(-1, "allocation failure");
+    if (s) {
+      long v = strtol(s, &endptr, 10);
+      if (*s && !*endptr && v >= 0) p->value = v;
+    } else if (skip_node(r)) {
+      return -1;
+    }
+    if (mapping_value_end(r, kind)) return -1;
+  }
+  return (stat) ? -1 : n;
+}
+
+
+/*
+  Loads the instance in entry `e`.
+
+  The instance is read in one pass if the metadata and dimensions
+  precede the properties, which is the case for sorted keys.
+  Otherwise, and for metadata, whose dimensions are given by the
+  lengths of their dimensions, properties and relations, the header
+  is read in a first pass and the properties in a second pass.
+ */
+static DLiteInstance *load_entry(const Entry *e)
+{
+  Reader r;
+  char key[KEYSIZE], *uuid=NULL, *uri=NULL, *iri=NULL, *metauri=NULL;
+  DimItem *items=NULL;
+  DLiteMeta *meta=NULL;
+  DLiteInstance *inst=NULL, *retval=NULL;
+  size_t i, *dims=NULL;
+  int j, stat, ok=1, nitems=0, ismeta=0, pass2=0;
+  int lens[3] = {0, 0, 0};  /* number of dimensions, properties, relations */
+  MapKind kind;
+
+  /* First pass */
+  memset(&r, 0, sizeof(Reader));
+  if (reader_init(&r, e->src, e->len, e->key)) goto fail;
+  if (!(kind = mapping_kind(&r)))
+    FAIL1("yaml: instance must be a mapping: %s", e->key);
+  while ((stat = mapping_next(&r, kind, key)) == 1) {
+    if (strcmp(key, "uuid") == 0 && !uuid) {
+      uuid = scalar_dup(&r, &ok);
+    } else if (strcmp(key, "uri") == 0 && !uri) {
+      uri = scalar_dup(&r, &ok);
+    } else if (strcmp(key, "iri") == 0 && !iri) {
+      iri = scalar_dup(&r, &ok);
+    } else if (strcmp(key, "meta") == 0 && !metauri) {
+      if (!(metauri = scalar_dup(&r, &ok)) && ok)
+        FAIL1("yaml: \"meta\" must be a string: %s", e->key);
+      if (ok && !(meta = dlite_meta_get(metauri))) goto fail;
+      if (meta) ismeta = dlite_meta_is_metameta(meta);
+    } else if (strcmp(key, "dimensions") == 0) {
+      if ((nitems = read_dims(&r, &items)) < 0) goto fail;
+      lens[0] = nitems;
+    } else if (strcmp(key, "properties") == 0 && meta && !ismeta) {
+      /* Stream data properties directly into a new instance */
+      if (!(dims = calloc(meta->_ndimensions + 1, sizeof(size_t))))
+        FAIL("allocation failure");
+      for (i=0; i<meta->_ndimensions; i++) {
+        for (j=0; j<nitems; j++)
+          if (strcmp(items[j].name, meta->_dimensions[i].name) == 0) break;
+        if (j == nitems)
+          FAIL2("yaml: missing dimension \"%s\": %s",
+                meta->_dimensions[i].name, e->key);
+        if (items[j].value < 0)
+          FAIL2("yaml: dimension \"%s\" must be a non-negative integer: %s",
+                items[j].name, e->key);
+        dims[i] = items[j].value;
+      }
+      if (!(inst = dlite_instance_create(meta, dims,
+                                         (uri) ? uri :
+                                         (uuid) ? uuid : e->key)))
+        goto fail;
+      if (parse_data_props(&r, inst)) goto fail;
+    } else if (strcmp(key, "properties") == 0) {
+      if ((lens[1] = count_items(&r)) < 0) goto fail;
+      pass2 = 1;
+    } else if (strcmp(key, "relations") == 0) {
+      if ((lens[2] = count_items(&r)) < 0) goto fail;
+      pass2 = 1;
+    } else {
+      if (skip_node(&r)) goto fail;
+      pass2 = 1;
+    }
+    if (!ok || mapping_value_end(&r, kind)) goto fail;
+  }
+  reader_deinit(&r);
+  if (stat) goto fail;
+
+  /* Create instance if it was not created in the first pass */
+  if (!inst) {
+    if (!meta) {
+      /* If "meta" is not given, we assume it is an entity */
+      meta = (DLiteMeta *)dlite_get_entity_schema();
+      dlite_meta_incref(meta);
+      ismeta = 1;
+    }
+    if (!(dims = calloc(meta->_ndimensions + 1, sizeof(size_t))))
+      FAIL("allocation failure");
+    if (ismeta) {
+      for (i=0; i<meta->_ndimensions && i<3; i++) dims[i] = lens[i];
+    } else {
+      for (i=0; i<meta->_ndimensions; i++) {
+        for (j=0; j<nitems; j++)
+          if (strcmp(items[j].name, meta->_dimensions[i].name) == 0) break;
+        if (j == nitems || items[j].value < 0)
+          FAIL2("yaml: missing or invalid dimension \"%s\": %s",
+                meta->_dimensions[i].name, e->key);
+        dims[i] = items[j].value;
+      }
+    }
+    if (!(inst = dlite_instance_create(meta, dims,
+                                       (uri) ? uri : (uuid) ? uuid : e->key)))
+      goto fail;
+    pass2 = 1;
+  }
+
+  /* Second pass */
+  if (pass2) {
+    if (reader_init(&r, e->src, e->len, e->key)) goto fail;
+    while ((stat = mapping_next(&r, kind, key)) == 1) {
+      if (!ismeta && strcmp(key, "properties") == 0 &&
+          !dlite_instance_is_meta(inst)) {
+        if (parse_data_props(&r, inst)) break;
+      } else if (ismeta && (j = prop_index(meta, key)) >= 0) {
+        if (parse_prop(&r, inst, j)) break;
+      } else if (skip_node(&r)) {
+        break;
+      }
+      if (mapping_value_end(&r, kind)) break;
+    }
+    reader_deinit(&r);
+    if (stat) goto fail;
+  }
+
+  if (ismeta) {
+    /* Infer name, version and namespace from the uri if not given */
+    char *name=NULL, *version=NULL, *namespace=NULL;
+    const char *vals[3];
+    const char *names[] = {"name", "version", "namespace"};
+    if (dlite_split_meta_uri(inst->uri, &name, &version, &namespace) == 0) {
+      vals[0] = name;
+      vals[1] = version;
+      vals[2] = namespace;
+      for (i=0; i<3; i++) {
+        char **p;
+        if ((j = prop_index(meta, names[i])) < 0 ||
+            meta->_properties[j].type != dliteStringPtr) continue;
+        p = DLITE_PROP(inst, j);
+        if (!*p) *p = strdup(vals[i]);
+      }
+    }
+    if (name) free(name);
+    if (version) free(version);
+    if (namespace) free(namespace);
+    if (dlite_meta_init((DLiteMeta *)inst)) goto fail;
+  }
+  if (iri && !inst->iri) {
+    inst->iri = iri;
+    iri = NULL;
+  }
+
+  retval = inst;
+ fail:
+  reader_deinit(&r);
+  if (uuid) free(uuid);
+  if (uri) free(uri);
+  if (iri) free(iri);
+  if (metauri) free(metauri);
+  if (dims) free(dims);
+  if (items) {
+    for (j=0; j<nitems; j++) free(items[j].name);
+    free(items);
+  }
+  if (meta) dlite_meta_decref(meta);
+  if (!retval && inst) dlite_instance_decref(inst);
+  return retval;
+}
+
+
+/***************************************************************
+ * Writing
+ ***************************************************************/
+
+/* Emits `event`.  Returns non-zero on error. */
+static int emit(yaml_emitter_t *e, yaml_event_t *event)
+{
+  if (!yaml_emitter_emit(e, event))
+    return errx(1, "yaml: %s",
+                (e->problem) ? e->problem : "cannot write event");
+  return 0;
+}
+
+/* Emits scalar `s` with style `style`. */
+static int emit_scalar(yaml_emitter_t *e, const char *s,
+                       yaml_scalar_style_t style)
+{
+  yaml_event_t event;
+  if (!yaml_scalar_event_initialize(&event, NULL, NULL, (yaml_char_t *)s,
+                                    -1, 1, 1, style))
+    return err(1, "allocation failure");
+  return emit(e, &event);
+}
+
+/* Emits string `s`.  Strings that would be read as another type by a
+   YAML loader are quoted.  NULL is written as null. */
+static int emit_string(yaml_emitter_t *e, const char *s)
+{
+  static const char *special[] = {
+    "~", "null", "Null", "NULL", "true", "True", "TRUE", "false", "False",
+    "FALSE", "yes", "Yes", "YES", "no", "No", "NO", "on", "On", "ON",
+    "off", "Off", "OFF", "y", "Y", "n", "N", NULL
+  };
+  int i;
+  if (!s) return emit_scalar(e, "null", YAML_PLAIN_SCALAR_STYLE);
+  if (!*s || isdigit(*s) || ((*s == '-' || *s == '+' || *s == '.') &&
+                             s[1] && (isdigit(s[1]) || s[1] == '.')))
+    return emit_scalar(e, s, YAML_SINGLE_QUOTED_SCALAR_STYLE);
+  for (i=0; special[i]; i++)
+    if (strcmp(s, special[i]) == 0)
+      return emit_scalar(e, s, YAML_SINGLE_QUOTED_SCALAR_STYLE);
+  return emit_scalar(e, s, YAML_ANY_SCALAR_STYLE);
+}
+
+/* Emits the start of a block mapping. */
+static int emit_mapping_start(yaml_emitter_t *e)
+{
+  yaml_event_t event;
+  yaml_mapping_start_event_initialize(&event, NULL, NULL, 1,
+                                      YAML_BLOCK_MAPPING_STYLE);
+  return emit(e, &event);
+}
+
+/* Emits the end of a mapping. */
+static int emit_mapping_end(yaml_emitter_t *e)
+{
+  yaml_event_t event;
+  yaml_mapping_end_event_initialize(&event);
+  return emit(e, &event);
+}
+
+/* Emits the start of a block sequence. */
+static int emit_sequence_start(yaml_emitter_t *e)
+{
+  yaml_event_t event;
+  yaml_sequence_start_event_initialize(&event, NULL, NULL, 1,
+                                       YAML_BLOCK_SEQUENCE_STYLE);
+  return emit(e, &event);
+}
+
+/* Emits the end of a sequence. */
+static int emit_sequence_end(yaml_emitter_t *e)
+{
+  yaml_event_t event;
+  yaml_sequence_end_event_initialize(&event);
+  return emit(e, &event);
+}
+
+/* Emits key `key` followed by string `value` if `value` is not NULL. */
+static int emit_item(yaml_emitter_t *e, const char *key, const char *value)
+{
+  if (!value) return 0;
+  return emit_string(e, key) || emit_string(e, value);
+}
+
+/* Emits the value of type `type` and size `size` pointed to by `ptr`. */
+static int emit_value(yaml_emitter_t *e, const void *ptr, DLiteType type,
+                      size_t size)
+{
+  char buf[64], *s=NULL;
+  size_t n=0;
+  int stat;
+
+  switch (type) {
+  case dliteBlob:
+    if (dlite_type_aprint(&s, &n, 0, ptr, type, size, 0, -1,
+                          dliteFlagRaw) < 0) return 1;
+    stat = emit_string(e, s);
+    free(s);
+    return stat;
+
+  case dliteBool:
+    return emit_scalar(e, (*(bool *)ptr) ? "true" : "false",
+                       YAML_PLAIN_SCALAR_STYLE);
+
+  case dliteInt:
+  case dliteUInt:
+    if (dlite_type_print(buf, sizeof(buf), ptr, type, size, 0, -1,
+                         dliteFlagRaw) < 0) return 1;
+    return emit_scalar(e, buf, YAML_PLAIN_SCALAR_STYLE);
+
+  case dliteFloat:
+    {
+      double v;
+      if (dlite_type_copy_cast(&v, dliteFloat, sizeof(double),
+                               ptr, type, size)) return 1;
+      if (isnan(v)) return emit_scalar(e, ".nan", YAML_PLAIN_SCALAR_STYLE);
+      if (isinf(v))
+        return emit_scalar(e, (v < 0) ? "-.inf" : ".inf",
+                           YAML_PLAIN_SCALAR_STYLE);
+      if ((stat = dlite_type_print(buf, sizeof(buf) - 2, ptr, type, size,
+                                   0, -2, dliteFlagRaw)) < 0) return 1;
+      /* Write floats with a decimal point, like Python */
+      if (!strpbrk(buf, ".eEn")) strcat(buf, ".0");
+      return emit_scalar(e, buf, YAML_PLAIN_SCALAR_STYLE);
+    }
+
+  case dliteFixString:
+    return emit_string(e, ptr);
+
+  case dliteStringPtr:
+    return emit_string(e, *(char **)ptr);
+
+  case dliteDimension:
+    {
+      const DLiteDimension *d = ptr;
+      return (emit_mapping_start(e) ||
+              emit_item(e, "description", d->description) ||
+              emit_item(e, "name", d->name) ||
+              emit_mapping_end(e));
+    }
+
+  case dliteProperty:
+    {
+      const DLiteProperty *p = ptr;
+      int i;
+      if (dlite_type_set_typename(p->type, p->size, buf, sizeof(buf)))
+        return 1;
+      if (emit_mapping_start(e) ||
+          emit_item(e, "description", p->description)) return 1;
+      if (p->ndims) {
+        if (emit_string(e, "dims") || emit_sequence_start(e)) return 1;
+        for (i=0; i<p->ndims; i++)
+          if (emit_string(e, p->dims[i])) return 1;
+        if (emit_sequence_end(e)) return 1;
+      }
+      return (emit_item(e, "iri", p->iri) ||
+              emit_item(e, "name", p->name) ||
+              emit_item(e, "type", buf) ||
+              emit_item(e, "unit", p->unit) ||
+              emit_mapping_end(e));
+    }
+
+  case dliteRelation:
+    {
+      const DLiteRelation *t = ptr;
+      return (emit_mapping_start(e) ||
+              emit_item(e, "id", t->id) ||
+              emit_item(e, "o", t->o) ||
+              emit_item(e, "p", t->p) ||
+              emit_item(e, "s", t->s) ||
+              emit_mapping_end(e));
+    }
+
+  default:
+    {
+      const DLiteStruct *st = dlite_struct_get(type);
+      size_t i;
+      if (!st) break;
+      if (emit_mapping_start(e)) return 1;
+      for (i=0; i < st->nfields; i++) {
+        const DLiteStructField *f = st->fields + i;
+        if (emit_string(e, f->name) ||
+            emit_value(e, (const char *)ptr + f->offset, f->type, f->size))
+          return 1;
+      }
+      return emit_mapping_end(e);
+    }
+  }
+  return errx(1, "yaml: unsupported type: %d", type);
+}
+
+/* Emits array `*src` with dimensions `dims` as nested sequences.
+   `level` is the current nesting level.  `*src` is advanced for each
+   element. */
+static int emit_array(yaml_emitter_t *e, const DLiteProperty *p,
+                      const size_t *dims, int level, const char **src)
+{
+  size_t i;
+  if (emit_sequence_start(e)) return 1;
+  for (i=0; i<dims[level]; i++) {
+    if (level < p->ndims - 1) {
+      if (emit_array(e, p, dims, level + 1, src)) return 1;
+    } else {
+      if (emit_value(e, *src, p->type, p->size)) return 1;
+      *src += p->size;
+    }
+  }
+  return emit_sequence_end(e);
+}
+
+/* Emits property `i` of `inst`. */
+static int emit_prop(yaml_emitter_t *e, const DLiteInstance *inst, int i)
+{
+  const DLiteProperty *p = inst->meta->_properties + i;
+  const void *ptr = DLITE_PROP(inst, i);
+  const char *src;
+  if (p->ndims == 0) return emit_value(e, ptr, p->type, p->size);
+  src = *(char **)ptr;
+  return emit_array(e, p, DLITE_PROP_DIMS(inst, i), 0, &src);
+}
+
+/* Emits the dict representation of `inst` with sorted keys. */
+static int emit_instance(yaml_emitter_t *e, const DLiteInstance *inst)
+{
+  const DLiteMeta *meta = inst->meta;
+  enum {kDims=-1, kProps=-2, kMeta=-3, kUri=-4, kIri=-5, kUuid=-6};
+  Key *keys=NULL, *sub=NULL;
+  size_t i, n=0;
+  int ismeta = dlite_instance_is_meta(inst), retval=1;
+
+  if (!(keys = calloc(meta->_nproperties + 6, sizeof(Key))) ||
+      !(sub = calloc(meta->_nproperties + meta->_ndimensions + 1,
+                     sizeof(Key))))
+    FAIL("allocation failure");
+  keys[n].name = "meta";  keys[n++].index = kMeta;
+  keys[n].name = "uuid";  keys[n++].index = kUuid;
+  if (inst->uri) { keys[n].name = "uri";  keys[n++].index = kUri; }
+  if (inst->iri) { keys[n].name = "iri";  keys[n++].index = kIri; }
+  if (ismeta) {
+    /* Properties of metadata are written at the top level */
+    for (i=0; i<meta->_nproperties; i++) {
+      keys[n].name = meta->_properties[i].name;
+      keys[n++].index = i;
+    }
+  } else {
+    keys[n].name = "dimensions";  keys[n++].index = kDims;
+    keys[n].name = "properties";  keys[n++].index = kProps;
+  }
+  qsort(keys, n, sizeof(Key), keycmp);
+
+  if (emit_mapping_start(e)) goto fail;
+  for (i=0; i<n; i++) {
+    size_t j;
+    if (emit_string(e, keys[i].name)) goto fail;
+    switch (keys[i].index) {
+    case kMeta:
+      if (emit_string(e, meta->uri)) goto fail;
+      break;
+    case kUuid:
+      if (emit_string(e, inst->uuid)) goto fail;
+      break;
+    case kUri:
+      if (emit_string(e, inst->uri)) goto fail;
+      break;
+    case kIri:
+      if (emit_string(e, inst->iri)) goto fail;
+      break;
+    case kDims:
+      for (j=0; j<meta->_ndimensions; j++) {
+        sub[j].name = meta->_dimensions[j].name;
+        sub[j].index = j;
+      }
+      qsort(sub, meta->_ndimensions, sizeof(Key), keycmp);
+      if (emit_mapping_start(e)) goto fail;
+      for (j=0; j<meta->_ndimensions; j++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%lu",
+                 (unsigned long)DLITE_DIM(inst, sub[j].index));
+        if (emit_string(e, sub[j].name) ||
+            emit_scalar(e, buf, YAML_PLAIN_SCALAR_STYLE)) goto fail;
+      }
+      if (emit_mapping_end(e)) goto fail;
+      break;
+    case kProps:
+      for (j=0; j<meta->_nproperties; j++) {
+        sub[j].name = meta->_properties[j].name;
+        sub[j].index = j;
+      }
+      qsort(sub, meta->_nproperties, sizeof(Key), keycmp);
+      if (emit_mapping_start(e)) goto fail;
+      for (j=0; j<meta->_nproperties; j++)
+        if (emit_string(e, sub[j].name) ||
+            emit_prop(e, inst, sub[j].index)) goto fail;
+      if (emit_mapping_end(e)) goto fail;
+      break;
+    default:
+      if (emit_prop(e, inst, keys[i].index)) goto fail;
+    }
+  }
+  if (emit_mapping_end(e)) goto fail;
+  retval = 0;
+ fail:
+  if (keys) free(keys);
+  if (sub) free(sub);
+  return retval;
+}
+
+/* Emits the start of a stream and an implicit document. */
+static int emit_document_start(yaml_emitter_t *e)
+{
+  yaml_event_t event;
+  yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING);
+  if (emit(e, &event)) return 1;
+  yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 1);
+  return emit(e, &event);
+}
+
+/* Emits the end of an implicit document and the stream. */
+static int emit_document_end(yaml_emitter_t *e)
+{
+  yaml_event_t event;
+  yaml_document_end_event_initialize(&event, 1);
+  if (emit(e, &event)) return 1;
+  yaml_stream_end_event_initialize(&event);
+  return emit(e, &event);
+}
+
+/* Initialises emitter `e` with the same settings as yaml.dump(). */
+static int emitter_init(yaml_emitter_t *e)
+{
+  if (!yaml_emitter_initialize(e))
+    return err(1, "yaml: cannot initialise emitter");
+  yaml_emitter_set_unicode(e, 1);
+  yaml_emitter_set_width(e, 80);
+  yaml_emitter_set_indent(e, 2);
+  return 0;
+}
+
+/* Output buffer for yaml_emitter_set_output() */
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+} Buf;
+
+/* Write handler appending to a Buf. */
+static int buf_write(void *data, unsigned char *buffer, size_t size)
+{
+  Buf *b = data;
+  if (b->len + size + 1 > b->size) {
+    size_t newsize = (b->size) ? b->size : 1024;
+    char *p;
+    while (newsize < b->len + size + 1) newsize *= 2;
+    if (!(p = realloc(b->data, newsize))) return 0;
+    b->data = p;
+    b->size = newsize;
+  }
+  memcpy(b->data + b->len, buffer, size);
+  b->len += size;
+  b->data[b->len] = '\0';
+  return 1;
+}
+
+/* Returns a newly allocated string with `inst` serialised as a YAML
+   document or NULL on error. */
+static char *serialise(const DLiteInstance *inst)
+{
+  yaml_emitter_t e;
+  Buf b = {NULL, 0, 0};
+  int stat;
+  if (emitter_init(&e)) return NULL;
+  yaml_emitter_set_output(&e, buf_write, &b);
+  stat = (emit_document_start(&e) || emit_instance(&e, inst) ||
+          emit_document_end(&e));
+  yaml_emitter_delete(&e);
+  if (stat) {
+    if (b.data) free(b.data);
+    return NULL;
+  }
+  return b.data;
+}
+
+/* Passes the events of the node at the current event of `r` through to
+   `e`. */
+static int copy_node(Reader *r, yaml_emitter_t *e)
+{
+  int depth=0;
+  while (1) {
+    switch (r->event.type) {
+    case YAML_MAPPING_START_EVENT:
+    case YAML_SEQUENCE_START_EVENT:
+      depth++;
+      break;
+    case YAML_MAPPING_END_EVENT:
+    case YAML_SEQUENCE_END_EVENT:
+      depth--;
+      break;
+    default:
+      break;
+    }
+    r->has_event = 0;  /* the emitter takes ownership of the event */
+    if (emit(e, &r->event)) return 1;
+    if (depth == 0) return 0;
+    if (next_event(r)) return 1;
+  }
+}
+
+/* Writes all instances in `ys` to its file.  Returns non-zero on
+   error. */
+static int write_file(YamlStorage *ys)
+{
+  yaml_emitter_t e;
+  FILE *fp;
+  size_t i;
+  int retval=1;
+
+  if (!(fp = fopen(ys->location, "wb")))
+    return err(1, "yaml: cannot open \"%s\" for writing", ys->location);
+  if (emitter_init(&e)) {
+    fclose(fp);
+    return 1;
+  }
+  yaml_emitter_set_output_file(&e, fp);
+  if (emit_document_start(&e) || emit_mapping_start(&e)) goto fail;
+  for (i=0; i<ys->nentries; i++) {
+    Entry *entry = ys->entries + i;
+    Reader r;
+    int stat;
+    if (emit_string(&e, entry->key)) goto fail;
+    stat = (reader_init(&r, entry->src, entry->len, entry->key) ||
+            copy_node(&r, &e));
+    reader_deinit(&r);
+    if (stat) goto fail;
+  }
+  if (emit_mapping_end(&e) || emit_document_end(&e)) goto fail;
+  if (!yaml_emitter_flush(&e)) {
+    errx(1, "yaml: cannot write \"%s\"", ys->location);
+    goto fail;
+  }
+  retval = 0;
+ fail:
+  yaml_emitter_delete(&e);
+  if (fclose(fp) && !retval)
+    retval = err(1, "yaml: error closing \"%s\"", ys->location);
+  return retval;
+}
+
+
+/***************************************************************
+ * Storage entries
+ ***************************************************************/
+
+/* Adds an entry to `ys`, or replaces the entry with the same key.
+   Takes over the ownership of `meta` and `text`.  Returns non-zero on
+   error. */
+static int add_entry(YamlStorage *ys, const char *key, char *meta,
+                     const char *src, size_t len, char *text)
+{
+  int *ip;
+  Entry *e;
+  if ((ip = map_get(&ys->index, key))) {
+    e = ys->entries + *ip;
+    if (e->meta) free(e->meta);
+    if (e->text) free(e->text);
+  } else {
+    if (ys->nentries >= ys->size) {
+      size_t size = (ys->size) ? 2*ys->size : 64;
+      Entry *entries = realloc(ys->entries, size * sizeof(Entry));
+      if (!entries) return err(1, "allocation failure");
+      ys->entries = entries;
+      ys->size = size;
+    }
+    e = ys->entries + ys->nentries;
+    memset(e, 0, sizeof(Entry));
+    if (!(e->key = strdup(key))) return err(1, "allocation failure");
+    if (map_set(&ys->index, key, (int)ys->nentries)) {
+      free(e->key);
+      return err(1, "allocation failure");
+    }
+    ys->nentries++;
+  }
+  e->meta = meta;
+  e->src = src;
+  e->len = len;
+  e->text = text;
+  return 0;
+}
+
+/* Scans the top-level mapping of the content of file `location` in
+   `ys->buf` of length `len` and adds an entry for each instance.
+   Returns non-zero on error. */
+static int scan_file(YamlStorage *ys, size_t len, const char *location)
+{
+  Reader r;
+  char key[KEYSIZE], subkey[KEYSIZE];
+  MapKind kind, subkind;
+  int stat, stat2, retval=1;
+
+  if (reader_init(&r, ys->buf, len, location)) goto fail;
+  if (r.event.type == YAML_STREAM_END_EVENT || is_null(&r)) {
+    retval = 0;
+    goto fail;
+  }
+  if (!(kind = mapping_kind(&r)))
+    FAIL1("yaml: expected a mapping of instances: %s", location);
+
+  while ((stat = mapping_next(&r, kind, key)) == 1) {
+    yaml_mark_t start = r.event.start_mark;
+    size_t begin;
+    char *meta=NULL;
+
+    /* Block nodes starting on a new line are read from the start of
+       the line, such that their indentation is consistent */
+    begin = (start.line > r.keyline) ? start.index - start.column :
+      start.index;
+
+    if ((subkind = mapping_kind(&r))) {
+      while ((stat2 = mapping_next(&r, subkind, subkey)) == 1) {
+        if (strcmp(subkey, "meta") == 0 && !meta && scalar(&r)) {
+          if (!(meta = strdup(scalar(&r)))) FAIL("allocation failure");
+        } else if (skip_node(&r)) {
+          stat2 = -1;
+          break;
+        }
+        if (mapping_value_end(&r, subkind)) {
+          stat2 = -1;
+          break;
+        }
+      }
+    } else {
+      stat2 = skip_node(&r);
+    }
+    if (stat2 || add_entry(ys, key, meta, ys->buf + begin,
+                           r.event.end_mark.index - begin, NULL)) {
+      if (meta) free(meta);
+      goto fail;
+    }
+    if (mapping_value_end(&r, kind)) goto fail;
+  }
+  if (stat == 0) retval = 0;
+ fail:
+  reader_deinit(&r);
+  return retval;
+}
+
+/* Returns the entry with the given id or NULL if there is no such
+   entry.  If `id` is NULL and the storage has only one entry, it is
+   returned. */
+static const Entry *get_entry(const YamlStorage *ys, const char *id)
+{
+  char uuid[DLITE_UUID_LENGTH+1];
+  int *ip;
+  if (!id) return (ys->nentries == 1) ? ys->entries : NULL;
+  if ((ip = map_get((map_int_t *)&ys->index, id)))
+    return ys->entries + *ip;
+  if (dlite_get_uuid(uuid, id) >= 0 &&
+      (ip = map_get((map_int_t *)&ys->index, uuid)))
+    return ys->entries + *ip;
+  return NULL;
+}
+
+
+/***************************************************************
+ * Plugin api
+ ***************************************************************/
+
+/* Frees the internal data of `ys`. */
+static void yaml_storage_free(YamlStorage *ys)
+{
+  size_t i;
+  for (i=0; i<ys->nentries; i++) {
+    Entry *e = ys->entries + i;
+    free(e->key);
+    if (e->meta) free(e->meta);
+    if (e->text) free(e->text);
+  }
+  if (ys->entries) free(ys->entries);
+  map_deinit(&ys->index);
+  if (ys->buf) free(ys->buf);
+}
+
+/**
+  Returns a new YAML storage.
+
+  Valid `options` are:
+
+  - mode : append | r | w
+      Valid values are:
+      - append   Append to existing file or create new file (default)
+      - r        Open existing file for read-only
+      - w        Truncate existing file or create new file
+
+  Returns NULL on error.
+ */
+DLiteStorage *yaml_open(const DLiteStoragePlugin *api, const char *location,
+                        const char *options)
+{
+  YamlStorage *ys=NULL;
+  DLiteStorage *retval=NULL;
+  FILE *fp=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"append\" (append to existing file or create new file, default); "
+    "\"r\" (read-only); "
+    "\"w\" (truncate existing file or create new)";
+  DLiteOpt opts[] = {
+    {'m', "mode", "append", mode_descr},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode;
+  int load=0;
+  UNUSED(api);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+
+  if (!(ys = calloc(1, sizeof(YamlStorage)))) FAIL("allocation failure");
+  map_init(&ys->index);
+
+  if (strcmp(mode, "append") == 0 || strcmp(mode, "a") == 0) {
+    ys->writable = 1;
+    load = 1;
+  } else if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    ys->writable = 0;
+    load = 1;
+  } else if (strcmp(mode, "w") == 0 || strcmp(mode, "write") == 0) {
+    ys->writable = 1;
+    ys->modified = 1;  /* truncate the file on close */
+  } else {
+    FAIL1("invalid \"mode\" value: '%s'. Must be \"append\", \"r\" "
+          "(read-only) or \"w\" (write)", mode);
+  }
+
+  if (load && (fp = fopen(location, "rb"))) {
+    long len;
+    if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET))
+      FAIL1("yaml: cannot determine size of \"%s\"", location);
+    if (!(ys->buf = malloc(len + 1))) FAIL("allocation failure");
+    if (fread(ys->buf, 1, len, fp) != (size_t)len)
+      FAIL1("yaml: cannot read \"%s\"", location);
+    ys->buf[len] = '\0';
+    if (scan_file(ys, len, location)) goto fail;
+  } else if (load && !ys->writable) {
+    FAIL1("yaml: cannot open \"%s\"", location);
+  }
+
+  retval = (DLiteStorage *)ys;
+ fail:
+  if (fp) fclose(fp);
+  if (optcopy) free(optcopy);
+  if (!retval && ys) {
+    yaml_storage_free(ys);
+    free(ys);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  A writable storage is written to its file if
+  any instance has been saved.  Returns non-zero on error.
+ */
+int yaml_close(DLiteStorage *s)
+{
+  YamlStorage *ys = (YamlStorage *)s;
+  int retval=0;
+  if (ys->writable && ys->modified) retval = write_file(ys);
+  yaml_storage_free(ys);
+  return retval;
+}
+
+
+/**
+  Loads instance `id` from storage `s` and returns it.
+  NULL is returned on error.
+ */
+DLiteInstance *yaml_load(const DLiteStorage *s, const char *id)
+{
+  const YamlStorage *ys = (const YamlStorage *)s;
+  const Entry *e;
+  if (!(e = get_entry(ys, id))) {
+    if (!id)
+      return errx(1, "yaml: an id is required for loading "
+                  "from a storage with %d instances: %s", (int)ys->nentries,
+                  s->location), NULL;
+    return errx(1, "yaml: no instance with id "
+                "\"%s\" in storage \"%s\"", id, s->location), NULL;
+  }
+  return load_entry(e);
+}
+
+
+/**
+  Saves instance `inst` to storage `s`.  Returns non-zero on error.
+ */
+int yaml_save(DLiteStorage *s, const DLiteInstance *inst)
+{
+  YamlStorage *ys = (YamlStorage *)s;
+  char *text, *meta;
+  if (!(text = serialise(inst))) return 1;
+  if (!(meta = strdup(inst->meta->uri))) {
+    free(text);
+    return err(1, "allocation failure");
+  }
+  if (add_entry(ys, inst->uuid, meta, text, strlen(text), text)) {
+    free(meta);
+    free(text);
+    return 1;
+  }
+  ys->modified = 1;
+  return 0;
+}
+
+
+/**
+  Returns a new iterator over the uuids of all instances in storage
+  `s` whose metadata uri matches glob `pattern`.  If `pattern` is
+  NULL, all instances are iterated over.
+
+  Returns NULL on error.
+ */
+void *yaml_iter_create(const DLiteStorage *s, const char *pattern)
+{
+  YamlIter *iter;
+  if (!(iter = calloc(1, sizeof(YamlIter))))
+    return err(1, "allocation failure"), NULL;
+  iter->ys = (const YamlStorage *)s;
+  if (pattern && !(iter->pattern = strdup(pattern))) {
+    free(iter);
+    return err(1, "allocation failure"), NULL;
+  }
+  return iter;
+}
+
+/**
+  Writes the uuid of the next instance to `buf`, where `iter` is an
+  iterator returned by yaml_iter_create().
+
+  Returns zero on success, 1 if there are no more UUIDs to iterate
+  over and a negative number on other errors.
+ */
+int yaml_iter_next(void *iter, char *buf)
+{
+  YamlIter *it = iter;
+  while (it->pos < it->ys->nentries) {
+    const Entry *e = it->ys->entries + it->pos++;
+    if (it->pattern && (!e->meta || globmatch(it->pattern, e->meta)))
+      continue;
+    if (dlite_get_uuid(buf, e->key) < 0) return -1;
+    return 0;
+  }
+  return 1;
+}
+
+/**
+  Free's iterator created with yaml_iter_create().
+ */
+void yaml_iter_free(void *iter)
+{
+  YamlIter *it = iter;
+  if (it->pattern) free(it->pattern);
+  free(it);
+}
+
+
+static DLiteStoragePlugin dlite_yaml_plugin = {
+  /* head */
+  "yaml",                   /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  yaml_open,                /* open */
+  yaml_close,               /* close */
+
+  /* queue api */
+  yaml_iter_create,         /* iterCreate */
+  yaml_iter_next,           /* iterNext */
+  yaml_iter_free,           /* iterFree */
+  NULL,                     /* getUUIDs */
+
+  /* direct api */
+  yaml_load,                /* loadInstance */
+  yaml_save,                /* saveInstance */
+  NULL,                     /* loadInstances */
+  NULL,                     /* saveInstances */
+
+  /* datamodel api */
+  NULL,                     /* dataModel */
+  NULL,                     /* dataModelFree */
+
+  NULL,                     /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  NULL,                     /* getDimensionSize */
+  NULL,                     /* getProperty */
+
+  /* -- datamodel api (optional) */
+  NULL,                     /* setMetaURI */
+  NULL,                     /* setDimensionSize */
+  NULL,                     /* setProperty */
+
+  NULL,                     /* hasDimension */
+  NULL,                     /* hasProperty */
+  NULL,                     /* getPropertySlice */
+
+  NULL,                     /* getDataName, obsolute */
+  NULL,                     /* setDataName, obsolute */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  0,                        /* flags */
+
+  /* distributed datamodel api (optional) */
+  NULL,                     /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &dlite_yaml_plugin;
+}
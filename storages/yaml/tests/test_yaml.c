@@ -0,0 +1,292 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-storage-plugins.h"
+
+#include "test_fixtures.h"
+
+#define NINST 3
+
+char *path = "test-yaml.yaml";
+char *uri = "http://onto-ns.com/meta/0.1/YamlTestEntity";
+DLiteMeta *entity=NULL;
+char uuids[NINST][DLITE_UUID_LENGTH+1];
+
+
+MU_TEST(test_create)
+{
+  char *dims[] = {"N", "M"};
+  DLiteDimension dimensions[] = {
+    {"N", "Number of items."},
+    {"M", "Number of columns."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims unit iri  descr */
+    {"flag",   dliteBool,      sizeof(bool),   0, NULL, "",  NULL, "A flag."},
+    {"value",  dliteInt,       sizeof(int),    0, NULL, "",  NULL, "A value."},
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL, "",  NULL, "A name."},
+    {"items",  dliteFloat,     sizeof(double), 1, dims, "m", NULL, "Items."},
+    {"tags",   dliteStringPtr, sizeof(char *), 1, dims, "",  NULL, "Tags."},
+    {"matrix", dliteInt,       sizeof(int),    2, dims, "",  NULL, "Matrix."}
+  };
+  size_t d[] = {2, 3};
+  int i, j;
+
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, NULL,
+                                                    "Test entity.",
+                                                    2, dimensions,
+                                                    6, properties)));
+  for (i=0; i<NINST; i++) {
+    DLiteInstance *inst;
+    double *items;
+    char **tags;
+    int *matrix;
+    mu_check((inst = dlite_instance_create(entity, d, NULL)));
+    *(bool *)dlite_instance_get_property(inst, "flag") = i % 2;
+    *(int *)dlite_instance_get_property(inst, "value") = 10 * i - 7;
+    if (i) *(char **)dlite_instance_get_property(inst, "name") = strdup("yes");
+    items = dlite_instance_get_property(inst, "items");
+    items[0] = 1.5 * i;
+    items[1] = 1e-20;
+    tags = dlite_instance_get_property(inst, "tags");
+    tags[0] = strdup("a: b");
+    tags[1] = strdup("12");
+    matrix = dlite_instance_get_property(inst, "matrix");
+    for (j=0; j<6; j++) matrix[j] = i * j;
+    strcpy(uuids[i], inst->uuid);
+  }
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  int i;
+  mu_check((s = dlite_storage_open("yaml", path, "mode=w")));
+  mu_assert_int_eq(1, dlite_storage_is_writable(s));
+  mu_assert_int_eq(0, dlite_instance_save(s, (DLiteInstance *)entity));
+  for (i=0; i<NINST; i++) {
+    DLiteInstance *inst = dlite_instance_get(uuids[i]);
+    mu_check(inst);
+    mu_assert_int_eq(0, dlite_instance_save(s, inst));
+    dlite_instance_decref(inst);  /* reference from dlite_instance_get() */
+    dlite_instance_decref(inst);  /* free instance */
+  }
+  mu_assert_int_eq(NINST + 1, count_instances(s, NULL));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_load)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  double *items;
+  char **tags;
+  int *matrix, i;
+  mu_check((s = dlite_storage_open("yaml", path, "mode=r")));
+  mu_assert_int_eq(0, dlite_storage_is_writable(s));
+  mu_assert_int_eq(NINST, count_instances(s, uri));
+  mu_assert_int_eq(1, count_instances(s, "*/EntitySchema"));
+
+  for (i=0; i<NINST; i++) {
+    mu_check((inst = dlite_instance_load(s, uuids[i])));
+    mu_assert_int_eq(i % 2, *(bool *)dlite_instance_get_property(inst, "flag"));
+    mu_assert_int_eq(10 * i - 7,
+                     *(int *)dlite_instance_get_property(inst, "value"));
+    if (i)
+      mu_assert_string_eq("yes",
+                          *(char **)dlite_instance_get_property(inst, "name"));
+    else
+      mu_check(!*(char **)dlite_instance_get_property(inst, "name"));
+    items = dlite_instance_get_property(inst, "items");
+    mu_assert_double_eq(1.5 * i, items[0]);
+    mu_assert_double_eq(1e-20, items[1]);
+    tags = dlite_instance_get_property(inst, "tags");
+    mu_assert_string_eq("a: b", tags[0]);
+    mu_assert_string_eq("12", tags[1]);
+    matrix = dlite_instance_get_property(inst, "matrix");
+    mu_assert_int_eq(5 * i, matrix[5]);
+    mu_assert_int_eq(3, (int)dlite_instance_get_dimension_size(inst, "M"));
+    dlite_instance_decref(inst);
+  }
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_append)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  mu_check((s = dlite_storage_open("yaml", path, NULL)));
+  mu_assert_int_eq(1, dlite_storage_is_writable(s));
+  mu_check((inst = dlite_instance_load(s, uuids[0])));
+  *(int *)dlite_instance_get_property(inst, "value") = 42;
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(NINST + 1, count_instances(s, NULL));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  mu_check((s = dlite_storage_open("yaml", path, "mode=r")));
+  mu_assert_int_eq(NINST + 1, count_instances(s, NULL));
+  mu_check((inst = dlite_instance_load(s, uuids[0])));
+  mu_assert_int_eq(42, *(int *)dlite_instance_get_property(inst, "value"));
+  dlite_instance_decref(inst);
+  mu_check((inst = dlite_instance_load(s, uuids[2])));
+  mu_assert_int_eq(13, *(int *)dlite_instance_get_property(inst, "value"));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_metadata)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  DLiteMeta *meta;
+  mu_check((s = dlite_storage_open("yaml", "test-yaml-meta.yaml", "mode=w")));
+  inst = dlite_instance_get(DLITE_ENTITY_SCHEMA);
+  mu_check(inst);
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  dlite_instance_decref(inst);
+  mu_assert_int_eq(0, dlite_instance_save(s, (DLiteInstance *)entity));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+  dlite_meta_decref(entity);
+
+  mu_check((s = dlite_storage_open("yaml", "test-yaml-meta.yaml", "mode=r")));
+  inst = dlite_instance_load(s, DLITE_ENTITY_SCHEMA);
+  mu_check(inst);
+  mu_assert_string_eq(DLITE_ENTITY_SCHEMA, inst->uri);
+  dlite_instance_decref(inst);
+
+  meta = (DLiteMeta *)dlite_instance_load(s, uri);
+  mu_check(meta);
+  mu_assert_int_eq(2, meta->_ndimensions);
+  mu_assert_int_eq(6, meta->_nproperties);
+  mu_assert_string_eq("matrix", meta->_properties[5].name);
+  mu_assert_int_eq(2, meta->_properties[5].ndims);
+  mu_assert_string_eq("M", meta->_properties[5].dims[1]);
+  mu_assert_string_eq("m", meta->_properties[3].unit);
+  dlite_meta_decref(meta);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+/* Reads metadata that is not already in memory, the format written by
+   the Python yaml plugin, where instances are represented as
+   OrderedDict pairs, and the SOFT7 mapping form of metadata dimensions
+   and properties. */
+MU_TEST(test_compat)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst;
+  DLiteMeta *meta, *meta2;
+  FILE *fp;
+  char *id = "ee9ab8d6-8ad3-5b2f-8fa4-93a6d8ad3bf4";
+  double *items;
+  mu_check((fp = fopen("test-yaml-compat.yaml", "w")));
+  fprintf(fp,
+          "http://onto-ns.com/meta/0.1/Soft7Entity:\n"
+          "  description: A SOFT7 entity.\n"
+          "  dimensions:\n"
+          "    N: Number of items.\n"
+          "  properties:\n"
+          "    items:\n"
+          "      type: float64\n"
+          "      shape: [N]\n"
+          "      unit: m\n"
+          "  uri: http://onto-ns.com/meta/0.1/Soft7Entity\n"
+          "http://onto-ns.com/meta/0.1/ListEntity:\n"
+          "  description: An entity.\n"
+          "  dimensions:\n"
+          "  - description: Number of rows.\n"
+          "    name: 'N'\n"
+          "  - name: M\n"
+          "  meta: http://onto-ns.com/meta/0.3/EntitySchema\n"
+          "  properties:\n"
+          "  - description: A matrix.\n"
+          "    dims:\n"
+          "    - 'N'\n"
+          "    - M\n"
+          "    name: matrix\n"
+          "    type: int16\n"
+          "    unit: ''\n"
+          "  uri: http://onto-ns.com/meta/0.1/ListEntity\n"
+          "%s: !!python/object/apply:collections.OrderedDict\n"
+          "- - uuid\n"
+          "  - %s\n"
+          "- - meta\n"
+          "  - http://onto-ns.com/meta/0.1/Soft7Entity\n"
+          "- - dimensions\n"
+          "  - N: 3\n"
+          "- - properties\n"
+          "  - !!python/object/apply:collections.OrderedDict\n"
+          "    - - items\n"
+          "      - [1.0, .inf, -2.5e3]\n",
+          id, id);
+  fclose(fp);
+
+  mu_check((s = dlite_storage_open("yaml", "test-yaml-compat.yaml",
+                                  "mode=r")));
+  mu_assert_int_eq(1, count_instances(s, "*/Soft7Entity"));
+  meta = (DLiteMeta *)dlite_instance_load(s,
+                                          "http://onto-ns.com/meta/0.1/"
+                                          "Soft7Entity");
+  mu_check(meta);
+  mu_assert_int_eq(1, meta->_ndimensions);
+  mu_assert_string_eq("items", meta->_properties[0].name);
+  mu_assert_int_eq(dliteFloat, meta->_properties[0].type);
+  mu_assert_string_eq("m", meta->_properties[0].unit);
+  mu_assert_string_eq("A SOFT7 entity.", *(char **)dlite_instance_get_property(
+                        (DLiteInstance *)meta, "description"));
+
+  meta2 = (DLiteMeta *)dlite_instance_load(s, "http://onto-ns.com/meta/0.1/"
+                                           "ListEntity");
+  mu_check(meta2);
+  mu_assert_int_eq(2, meta2->_ndimensions);
+  mu_assert_string_eq("Number of rows.", meta2->_dimensions[0].description);
+  mu_assert_string_eq("M", meta2->_dimensions[1].name);
+  mu_assert_int_eq(1, meta2->_nproperties);
+  mu_assert_int_eq(2, meta2->_properties[0].ndims);
+  mu_assert_int_eq(dliteInt, meta2->_properties[0].type);
+  mu_assert_int_eq(2, meta2->_properties[0].size);
+  mu_assert_string_eq("0.1", *(char **)dlite_instance_get_property(
+                        (DLiteInstance *)meta2, "version"));
+  dlite_meta_decref(meta2);
+
+  mu_check((inst = dlite_instance_load(s, id)));
+  items = dlite_instance_get_property(inst, "items");
+  mu_assert_double_eq(1.0, items[0]);
+  mu_check(items[1] > 1e300);
+  mu_assert_double_eq(-2500.0, items[2]);
+  dlite_instance_decref(inst);
+  dlite_meta_decref(meta);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_unload_plugins)
+{
+  dlite_storage_plugin_unload_all();
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_create);
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_append);
+  MU_RUN_TEST(test_metadata);
+  MU_RUN_TEST(test_compat);
+  MU_RUN_TEST(test_unload_plugins);
+}
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -0,0 +1,1828 @@
+/* dlite-zarr-storage.c -- DLite storage plugin for Zarr */
+
+/*
+  This plugin stores instances in a Zarr (format version 2) hierarchy,
+  either in a local directory or in an object store accessed over
+  HTTP, like an S3-compatible service.
+
+  Each instance is a Zarr group named after its uuid.  The group
+  attributes (.zattrs) hold the metadata uri, the dimension sizes and
+  all properties that are not stored as Zarr arrays:
+
+      {
+        "dlite:meta": "http://onto-ns.com/meta/0.1/MyEntity",
+        "dlite:dataname": "myinst",
+        "dlite:dimensions": {"N": 3},
+        "dlite:properties": {"name": "foo", "tags": ["a", "b"]}
+      }
+
+  Array properties of boolean, numerical, fixed string and blob type
+  are stored as Zarr arrays in the instance group.  They are chunked
+  and optionally compressed with zlib.  Scalars and arrays of other
+  types are stored as attributes.
+
+  When a modified storage is closed, the metadata of all groups and
+  arrays is written to a consolidated .zmetadata object in the root,
+  such that readers get it with a single request.  Instances are
+  listed from the consolidated metadata.
+
+  URLs (http://, https:// and file://) are accessed with libcurl.
+  Chunks are transferred concurrently over a pool of connections that
+  are kept open for the lifetime of the storage.  Since the plugin
+  implements getPropertySlice(), loading a slice of a property with
+  dlite_instance_load_property_slice() only fetches the chunks
+  overlapping the slice.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+# include <direct.h>
+# define mkdir(path, mode) _mkdir(path)
+#else
+# include <sys/stat.h>
+#endif
+
+#include "config.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_CURL
+#include <curl/curl.h>
+#endif
+
+#include "utils/compat.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/strutils.h"
+#include "utils/jsmnx.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-datamodel.h"
+#include "dlite-storage-plugins.h"
+
+
+/* Target size in bytes of chunks selected by chunk=auto */
+#define ZARR_CHUNK_TARGET (1024*1024)
+
+/* Max number of dimensions of an array */
+#define ZARR_MAX_DIMS 32
+
+/* Max number of chunks transferred in one batch */
+#define ZARR_BATCH 64
+
+/* Default number of concurrent connections */
+#define ZARR_CONNECTIONS "8"
+
+
+/* Transfer of one object */
+typedef struct {
+  char *key;          /* Object key relative to the root */
+  char *data;         /* Data read or to write */
+  size_t len;         /* Length of `data` */
+  size_t size;        /* Allocated size of `data` */
+  size_t pos;         /* Upload position */
+  int status;         /* 0: ok, 1: not found, -1: error */
+} Request;
+
+/* Parsed .zarray */
+typedef struct {
+  int ndims;                     /* Number of dimensions */
+  size_t shape[ZARR_MAX_DIMS];   /* Array shape */
+  size_t chunks[ZARR_MAX_DIMS];  /* Chunk shape */
+  DLiteType type;     /* Element type */
+  size_t size;        /* Element size */
+  int swap;           /* Whether elements are in non-native byte order */
+  int level;          /* zlib compression level, -1 if uncompressed */
+  double fill;        /* Fill value of missing chunks */
+  char sep;           /* Dimension separator in chunk keys */
+} ZArray;
+
+/* Storage for Zarr */
+typedef struct {
+  DLiteStorage_HEAD
+  char *root;         /* Root directory or URL, without trailing slash */
+  int url;            /* Whether `root` is an URL */
+  size_t nchunkdims;  /* Number of dimensions in `chunkdims`, 0 for auto */
+  size_t chunkdims[ZARR_MAX_DIMS];  /* Chunk shape given by option */
+  int level;          /* zlib compression level, -1 for no compression */
+  map_str_t meta;     /* Maps metadata keys to JSON text */
+  int modified;       /* Whether `meta` must be consolidated on close */
+#ifdef HAVE_CURL
+  CURLM *multi;       /* Multi handle for concurrent transfers */
+  CURL **handles;     /* Pool of easy handles, one per connection */
+  int nhandles;       /* Number of easy handles */
+#endif
+} ZStorage;
+
+/* Data model for Zarr */
+typedef struct {
+  DLiteDataModel_HEAD
+  char *metauri;      /* Metadata uri, NULL if not set */
+  char *dataname;     /* Data name, NULL if not set */
+  map_int_t dims;     /* Maps dimension names to sizes */
+  map_str_t props;    /* Maps names of properties stored as attributes
+                         to their JSON value */
+  int exists;         /* Whether the instance group exists */
+  int modified;       /* Whether the attributes must be written */
+} ZDataModel;
+
+
+/* Returns non-zero if this machine is big endian. */
+static int big_endian(void)
+{
+  static const int one = 1;
+  return *(const char *)&one == 0;
+}
+
+/* Appends `n` bytes from `src` to the data of request `r`.  Returns
+   non-zero on error. */
+static int req_add(Request *r, const void *src, size_t n)
+{
+  if (r->len + n > r->size) {
+    size_t size = (r->size) ? r->size : 1024;
+    char *p;
+    while (size < r->len + n) size *= 2;
+    if (!(p = realloc(r->data, size))) return err(1, "allocation failure");
+    r->data = p;
+    r->size = size;
+  }
+  if (n) memcpy(r->data + r->len, src, n);
+  r->len += n;
+  return 0;
+}
+
+/* Releases the key and data of the `n` requests in `reqs`. */
+static void req_clear(Request *reqs, size_t n)
+{
+  size_t i;
+  for (i=0; i<n; i++) {
+    if (reqs[i].key) free(reqs[i].key);
+    if (reqs[i].data) free(reqs[i].data);
+  }
+  memset(reqs, 0, n*sizeof(Request));
+}
+
+
+/********************************************************************
+ * Object store
+ ********************************************************************/
+
+/* Creates the parent directories of `path`.  Returns non-zero on
+   error. */
+static int make_parents(char *path)
+{
+  char *p;
+  for (p=strchr(path+1, '/'); p; p=strchr(p+1, '/')) {
+    int stat;
+    *p = '\0';
+    stat = (mkdir(path, 0777) && errno != EEXIST) ?
+      err(1, "zarr: cannot create directory: %s", path) : 0;
+    *p = '/';
+    if (stat) return stat;
+  }
+  return 0;
+}
+
+/* Reads request `r` from the local directory. */
+static void local_get(const ZStorage *zs, Request *r)
+{
+  char *path, buf[4096];
+  size_t n;
+  FILE *fp;
+  r->len = 0;
+  if (!(path = aprintf("%s/%s", zs->root, r->key))) {
+    r->status = err(-1, "allocation failure");
+    return;
+  }
+  if (!(fp = fopen(path, "rb"))) {
+    r->status = (errno == ENOENT) ? 1 : err(-1, "zarr: cannot open %s", path);
+    free(path);
+    return;
+  }
+  r->status = 0;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    if (req_add(r, buf, n)) r->status = -1;
+  if (ferror(fp)) r->status = err(-1, "zarr: cannot read %s", path);
+  fclose(fp);
+  free(path);
+}
+
+/* Writes request `r` to the local directory. */
+static void local_put(const ZStorage *zs, Request *r)
+{
+  char *path;
+  FILE *fp;
+  if (!(path = aprintf("%s/%s", zs->root, r->key))) {
+    r->status = err(-1, "allocation failure");
+    return;
+  }
+  r->status = 0;
+  if (make_parents(path)) {
+    r->status = -1;
+  } else if (!(fp = fopen(path, "wb"))) {
+    r->status = err(-1, "zarr: cannot create %s", path);
+  } else {
+    if (fwrite(r->data, 1, r->len, fp) != r->len)
+      r->status = err(-1, "zarr: cannot write %s", path);
+    if (fclose(fp)) r->status = err(-1, "zarr: cannot write %s", path);
+  }
+  free(path);
+}
+
+
+#ifdef HAVE_CURL
+
+/* Callback receiving downloaded data */
+static size_t curl_write(char *ptr, size_t size, size_t nmemb, void *data)
+{
+  Request *r = data;
+  if (req_add(r, ptr, size*nmemb)) return 0;
+  return size*nmemb;
+}
+
+/* Callback providing data to upload */
+static size_t curl_read(char *ptr, size_t size, size_t nmemb, void *data)
+{
+  Request *r = data;
+  size_t n = r->len - r->pos;
+  if (n > size*nmemb) n = size*nmemb;
+  if (n) memcpy(ptr, r->data + r->pos, n);
+  r->pos += n;
+  return n;
+}
+
+/* Prepares easy handle `h` for request `r`.  Returns non-zero on
+   error. */
+static int curl_setup(const ZStorage *zs, CURL *h, Request *r, int upload)
+{
+  char *url;
+  if (!(url = aprintf("%s/%s", zs->root, r->key)))
+    return err(1, "allocation failure");
+  curl_easy_setopt(h, CURLOPT_URL, url);
+  free(url);
+  curl_easy_setopt(h, CURLOPT_PRIVATE, r);
+  if (upload) {
+    r->pos = 0;
+    curl_easy_setopt(h, CURLOPT_UPLOAD, 1L);
+    curl_easy_setopt(h, CURLOPT_READFUNCTION, curl_read);
+    curl_easy_setopt(h, CURLOPT_READDATA, r);
+    curl_easy_setopt(h, CURLOPT_INFILESIZE_LARGE, (curl_off_t)r->len);
+  } else {
+    r->len = 0;
+    curl_easy_setopt(h, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, curl_write);
+    curl_easy_setopt(h, CURLOPT_WRITEDATA, r);
+  }
+  return 0;
+}
+
+/* Sets the status of request `r` from the result of its transfer. */
+static void curl_finish(CURL *h, Request *r, CURLcode result, int upload)
+{
+  long code=0;
+  curl_easy_getinfo(h, CURLINFO_RESPONSE_CODE, &code);
+  if (result == CURLE_OK && (code == 0 || (code >= 200 && code < 300))) {
+    r->status = 0;
+  } else if (!upload && (code == 404 ||
+                         result == CURLE_FILE_COULDNT_READ_FILE ||
+                         result == CURLE_REMOTE_FILE_NOT_FOUND)) {
+    r->status = 1;
+    r->len = 0;
+  } else if (result != CURLE_OK) {
+    r->status = errx(-1, "zarr: cannot %s %s: %s", (upload) ? "put" : "get",
+                     r->key, curl_easy_strerror(result));
+  } else {
+    r->status = errx(-1, "zarr: cannot %s %s: HTTP status %ld",
+                     (upload) ? "put" : "get", r->key, code);
+  }
+}
+
+/* Transfers the `n` requests in `reqs` concurrently, using the pool
+   of easy handles in `zs`. */
+static void curl_transfer(const ZStorage *zs, Request *reqs, size_t n,
+                          int upload)
+{
+  CURL **idle = zs->handles;
+  int nidle = zs->nhandles, running=0, nmsg;
+  size_t next=0, done=0;
+  CURLMsg *msg;
+
+  while (done < n) {
+    while (nidle > 0 && next < n) {
+      CURL *h = idle[--nidle];
+      Request *r = reqs + next++;
+      if (curl_setup(zs, h, r, upload) ||
+          curl_multi_add_handle(zs->multi, h) != CURLM_OK) {
+        if (r->status >= 0)
+          r->status = errx(-1, "zarr: cannot start transfer of %s", r->key);
+        idle[nidle++] = h;
+        done++;
+      }
+    }
+    if (curl_multi_perform(zs->multi, &running) != CURLM_OK) {
+      /* Fail all remaining requests */
+      for (; next < n; next++) reqs[next].status = -1;
+      errx(1, "zarr: transfer failure");
+    }
+    while ((msg = curl_multi_info_read(zs->multi, &nmsg))) {
+      Request *r;
+      if (msg->msg != CURLMSG_DONE) continue;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&r);
+      curl_finish(msg->easy_handle, r, msg->data.result, upload);
+      curl_multi_remove_handle(zs->multi, msg->easy_handle);
+      idle[nidle++] = msg->easy_handle;
+      done++;
+    }
+    if (done < n && running)
+      curl_multi_poll(zs->multi, NULL, 0, 1000, NULL);
+  }
+}
+
+#endif
+
+
+/* Transfers the `n` requests in `reqs`.  If `upload` is non-zero the
+   data of the requests is written, otherwise it is read.  Returns the
+   number of failed requests.  Missing objects are not failures. */
+static int transfer(const ZStorage *zs, Request *reqs, size_t n, int upload)
+{
+  size_t i;
+  int nerr=0;
+#ifdef HAVE_CURL
+  if (zs->url)
+    curl_transfer(zs, reqs, n, upload);
+  else
+#endif
+  for (i=0; i<n; i++) {
+    if (upload)
+      local_put(zs, reqs + i);
+    else
+      local_get(zs, reqs + i);
+  }
+  for (i=0; i<n; i++)
+    if (reqs[i].status < 0) nerr++;
+  return nerr;
+}
+
+
+/********************************************************************
+ * Metadata
+ ********************************************************************/
+
+/* Returns the JSON text of metadata object `key`, or NULL if it
+   doesn't exist or on error.  `*found` is set to zero if it doesn't
+   exist.  The returned text is cached and owned by the storage. */
+static const char *get_meta(ZStorage *zs, const char *key, int *found)
+{
+  char **p, *text;
+  Request r;
+  *found = 1;
+  if ((p = map_get(&zs->meta, key))) return *p;
+  memset(&r, 0, sizeof(r));
+  if (!(r.key = strdup(key))) return err(1, "allocation failure"), NULL;
+  if (transfer(zs, &r, 1, 0) || req_add(&r, "", 1)) goto fail;
+  if (r.status == 1) {
+    *found = 0;
+    goto fail;
+  }
+  text = r.data;
+  r.data = NULL;
+  if (map_set(&zs->meta, key, text)) {
+    free(text);
+    errx(1, "zarr: cannot cache metadata: %s", key);
+    goto fail;
+  }
+  req_clear(&r, 1);
+  return *map_get(&zs->meta, key);
+ fail:
+  req_clear(&r, 1);
+  return NULL;
+}
+
+/* Writes metadata object `key` with JSON text `text`.  Returns
+   non-zero on error. */
+static int put_meta(ZStorage *zs, const char *key, const char *text)
+{
+  Request r;
+  char **p, *copy;
+  int stat;
+  memset(&r, 0, sizeof(r));
+  r.key = (char *)key;
+  r.data = (char *)text;
+  r.len = strlen(text);
+  stat = transfer(zs, &r, 1, 1);
+  if (stat) return 1;
+  if (!(copy = strdup(text))) return err(1, "allocation failure");
+  if ((p = map_get(&zs->meta, key))) free(*p);
+  if (map_set(&zs->meta, key, copy)) {
+    free(copy);
+    return errx(1, "zarr: cannot cache metadata: %s", key);
+  }
+  zs->modified = 1;
+  return 0;
+}
+
+/* Reads the consolidated metadata into the cache.  Returns non-zero on
+   error. */
+static int read_consolidated(ZStorage *zs)
+{
+  Request r;
+  jsmn_parser parser;
+  jsmntok_t *tokens=NULL;
+  unsigned int ntokens=0;
+  const jsmntok_t *t, *key;
+  int i, n, retval=1;
+
+  memset(&r, 0, sizeof(r));
+  if (!(r.key = strdup(".zmetadata"))) FAIL("allocation failure");
+  if (transfer(zs, &r, 1, 0)) goto fail;
+  if (r.status == 1) {
+    retval = 0;
+    goto fail;
+  }
+  jsmn_init(&parser);
+  if ((n = jsmn_parse_alloc(&parser, r.data, r.len, &tokens, &ntokens)) < 0)
+    FAIL2("zarr: cannot parse %s/.zmetadata: %s", zs->root,
+          jsmn_strerror(n));
+  if (!(t = jsmn_item(r.data, tokens, "metadata")) || t->type != JSMN_OBJECT)
+    FAIL1("zarr: no metadata in %s/.zmetadata", zs->root);
+  key = t + 1;
+  for (i=0; i < t->size; i++) {
+    const jsmntok_t *val = key + 1;
+    char *k, *v, **p;
+    if (!(k = strndup(r.data + key->start, key->end - key->start)) ||
+        !(v = strndup(r.data + val->start, val->end - val->start))) {
+      if (k) free(k);
+      FAIL("allocation failure");
+    }
+    if ((p = map_get(&zs->meta, k))) free(*p);
+    map_set(&zs->meta, k, v);
+    free(k);
+    key = val + 1 + jsmn_count(val);
+  }
+  retval = 0;
+ fail:
+  if (tokens) free(tokens);
+  req_clear(&r, 1);
+  return retval;
+}
+
+/* Writes the consolidated metadata.  Returns non-zero on error. */
+static int write_consolidated(ZStorage *zs)
+{
+  char *buf=NULL;
+  size_t size=0, m=0;
+  const char *key, *sep="";
+  map_iter_t iter = map_iter(&zs->meta);
+  Request r;
+  int stat;
+
+  m += asnpprintf(&buf, &size, m, "{\n  \"zarr_consolidated_format\": 1,\n"
+                  "  \"metadata\": {");
+  while ((key = map_next(&zs->meta, &iter))) {
+    m += asnpprintf(&buf, &size, m, "%s\n    \"%s\": %s", sep, key,
+                    *map_get(&zs->meta, key));
+    sep = ",";
+  }
+  m += asnpprintf(&buf, &size, m, "\n  }\n}\n");
+  if (!buf) return err(1, "allocation failure");
+  memset(&r, 0, sizeof(r));
+  r.key = ".zmetadata";
+  r.data = buf;
+  r.len = m;
+  stat = transfer(zs, &r, 1, 1);
+  free(buf);
+  return stat;
+}
+
+/* Returns non-zero if token `t` is a string equal to `s`. */
+static int tokeq(const char *js, const jsmntok_t *t, const char *s)
+{
+  int len = t->end - t->start;
+  return t->type == JSMN_STRING && (int)strlen(s) == len &&
+    strncmp(js + t->start, s, len) == 0;
+}
+
+
+/********************************************************************
+ * Arrays
+ ********************************************************************/
+
+/* Returns non-zero if properties of type `type` and size `size` can be
+   stored as Zarr arrays. */
+static int zarr_supported(DLiteType type, size_t size)
+{
+  switch (type) {
+  case dliteBool:
+    return size == sizeof(bool) && size == 1;
+  case dliteInt:
+  case dliteUInt:
+    return size == 1 || size == 2 || size == 4 || size == 8;
+  case dliteFloat:
+    return size == 4 || size == 8;
+  case dliteFixString:
+  case dliteBlob:
+    return size > 0;
+  default:
+    return 0;
+  }
+}
+
+/* Writes the Zarr data type of `type` and `size` to `buf`. */
+static void zarr_dtype(char *buf, size_t n, DLiteType type, size_t size)
+{
+  char order = (size == 1) ? '|' : (big_endian()) ? '>' : '<';
+  switch (type) {
+  case dliteBool:      snprintf(buf, n, "|b1"); break;
+  case dliteInt:       snprintf(buf, n, "%ci%zu", order, size); break;
+  case dliteUInt:      snprintf(buf, n, "%cu%zu", order, size); break;
+  case dliteFloat:     snprintf(buf, n, "%cf%zu", order, size); break;
+  case dliteFixString: snprintf(buf, n, "|S%zu", size); break;
+  default:             snprintf(buf, n, "|V%zu", size); break;
+  }
+}
+
+/* Parses Zarr data type `s` of length `len` into `a`.  Returns
+   non-zero on error. */
+static int parse_dtype(ZArray *a, const char *s, int len)
+{
+  char *endptr;
+  long n;
+  if (len < 3 || !strchr("<>|", s[0]) ||
+      (n = strtol(s + 2, &endptr, 10)) <= 0 || endptr != s + len)
+    return errx(1, "zarr: invalid dtype: %.*s", len, s);
+  a->size = n;
+  switch (s[1]) {
+  case 'b': a->type = dliteBool; break;
+  case 'i': a->type = dliteInt; break;
+  case 'u': a->type = dliteUInt; break;
+  case 'f': a->type = dliteFloat; break;
+  case 'S': a->type = dliteFixString; break;
+  case 'V': a->type = dliteBlob; break;
+  default:
+    return errx(1, "zarr: unsupported dtype: %.*s", len, s);
+  }
+  if (!zarr_supported(a->type, a->size))
+    return errx(1, "zarr: unsupported dtype: %.*s", len, s);
+  a->swap = (n > 1 && strchr("iuf", s[1]) &&
+             ((s[0] == '<' && big_endian()) ||
+              (s[0] == '>' && !big_endian())));
+  return 0;
+}
+
+/* Parses the JSON content of a .zarray object into `a`.  `key` is
+   used for error messages.  Returns non-zero on error. */
+static int parse_zarray(ZArray *a, const char *js, const char *key)
+{
+  jsmn_parser parser;
+  jsmntok_t *tokens=NULL;
+  unsigned int ntokens=0;
+  const jsmntok_t *t, *t2;
+  int i, n, retval=1;
+
+  memset(a, 0, sizeof(ZArray));
+  a->level = -1;
+  a->sep = '.';
+  jsmn_init(&parser);
+  if ((n = jsmn_parse_alloc(&parser, js, strlen(js), &tokens, &ntokens)) < 0)
+    FAIL2("zarr: cannot parse %s: %s", key, jsmn_strerror(n));
+
+  if (!(t = jsmn_item(js, tokens, "shape")) || t->type != JSMN_ARRAY ||
+      !(t2 = jsmn_item(js, tokens, "chunks")) || t2->type != JSMN_ARRAY ||
+      t->size != t2->size || t->size < 1 || t->size > ZARR_MAX_DIMS)
+    FAIL1("zarr: invalid shape or chunks in %s", key);
+  a->ndims = t->size;
+  for (i=0; i < a->ndims; i++) {
+    a->shape[i] = strtoul(js + jsmn_element(js, t, i)->start, NULL, 10);
+    a->chunks[i] = strtoul(js + jsmn_element(js, t2, i)->start, NULL, 10);
+    if (a->chunks[i] == 0) FAIL1("zarr: zero chunk size in %s", key);
+  }
+
+  if (!(t = jsmn_item(js, tokens, "dtype")) || t->type != JSMN_STRING)
+    FAIL1("zarr: missing dtype in %s", key);
+  if (parse_dtype(a, js + t->start, t->end - t->start)) goto fail;
+
+  if ((t = jsmn_item(js, tokens, "order")) && !tokeq(js, t, "C"))
+    FAIL1("zarr: only C order is supported: %s", key);
+  if ((t = jsmn_item(js, tokens, "filters")) && t->type != JSMN_PRIMITIVE)
+    FAIL1("zarr: filters are not supported: %s", key);
+  if ((t = jsmn_item(js, tokens, "dimension_separator")) &&
+      t->type == JSMN_STRING && t->end - t->start == 1)
+    a->sep = js[t->start];
+
+  if ((t = jsmn_item(js, tokens, "compressor")) && t->type == JSMN_OBJECT) {
+    if (!(t2 = jsmn_item(js, t, "id")) ||
+        !(tokeq(js, t2, "zlib") || tokeq(js, t2, "gzip")))
+      FAIL1("zarr: unsupported compressor in %s", key);
+    a->level = ((t2 = jsmn_item(js, t, "level"))) ?
+      atoi(js + t2->start) : 1;
+  }
+
+  if ((t = jsmn_item(js, tokens, "fill_value")) && t->type == JSMN_PRIMITIVE) {
+    if (js[t->start] == 't')
+      a->fill = 1;
+    else if (js[t->start] != 'n' && js[t->start] != 'f')
+      a->fill = strtod(js + t->start, NULL);
+  }
+  retval = 0;
+ fail:
+  if (tokens) free(tokens);
+  return retval;
+}
+
+/* Returns a newly malloc'ed JSON text of `a`. */
+static char *zarray_text(const ZArray *a)
+{
+  char *buf=NULL, dtype[16];
+  size_t size=0, m=0;
+  int i;
+  zarr_dtype(dtype, sizeof(dtype), a->type, a->size);
+  m += asnpprintf(&buf, &size, m, "{\n  \"zarr_format\": 2,\n  \"shape\": [");
+  for (i=0; i < a->ndims; i++)
+    m += asnpprintf(&buf, &size, m, "%s%zu", (i) ? ", " : "", a->shape[i]);
+  m += asnpprintf(&buf, &size, m, "],\n  \"chunks\": [");
+  for (i=0; i < a->ndims; i++)
+    m += asnpprintf(&buf, &size, m, "%s%zu", (i) ? ", " : "", a->chunks[i]);
+  m += asnpprintf(&buf, &size, m, "],\n  \"dtype\": \"%s\",\n", dtype);
+  if (a->level >= 0)
+    m += asnpprintf(&buf, &size, m, "  \"compressor\": {\"id\": \"zlib\", "
+                    "\"level\": %d},\n", a->level);
+  else
+    m += asnpprintf(&buf, &size, m, "  \"compressor\": null,\n");
+  if (a->type == dliteBool)
+    m += asnpprintf(&buf, &size, m, "  \"fill_value\": false,\n");
+  else if (a->type == dliteFixString || a->type == dliteBlob)
+    m += asnpprintf(&buf, &size, m, "  \"fill_value\": null,\n");
+  else
+    m += asnpprintf(&buf, &size, m, "  \"fill_value\": 0,\n");
+  m += asnpprintf(&buf, &size, m, "  \"order\": \"C\",\n  \"filters\": null,\n"
+                  "  \"dimension_separator\": \"%c\"\n}\n", a->sep);
+  if (!buf) err(1, "allocation failure");
+  return buf;
+}
+
+/* Selects the chunk shape of a new array `a` with shape already
+   assigned. */
+static void guess_chunks(const ZStorage *zs, ZArray *a)
+{
+  int i;
+  if (zs->nchunkdims) {
+    /* The given chunk shape applies to the last dimensions */
+    for (i=0; i < a->ndims; i++) {
+      int j = i - (a->ndims - (int)zs->nchunkdims);
+      size_t c = (j >= 0) ? zs->chunkdims[j] : 1;
+      a->chunks[i] = (c < a->shape[i]) ? c : a->shape[i];
+      if (a->chunks[i] == 0) a->chunks[i] = 1;
+    }
+  } else {
+    /* Halve the largest dimension until the chunk is small enough */
+    size_t nbytes = a->size;
+    for (i=0; i < a->ndims; i++) {
+      a->chunks[i] = (a->shape[i]) ? a->shape[i] : 1;
+      nbytes *= a->chunks[i];
+    }
+    while (nbytes > ZARR_CHUNK_TARGET) {
+      int k=0;
+      for (i=1; i < a->ndims; i++)
+        if (a->chunks[i] > a->chunks[k]) k = i;
+      if (a->chunks[k] == 1) break;
+      nbytes /= a->chunks[k];
+      a->chunks[k] = (a->chunks[k] + 1) / 2;
+      nbytes *= a->chunks[k];
+    }
+  }
+}
+
+/* Returns a newly malloc'ed key of the chunk with indices `cidx` of
+   array `name` in instance `uuid`. */
+static char *chunk_key(const char *uuid, const char *name, const ZArray *a,
+                       const size_t *cidx)
+{
+  char *buf=NULL;
+  size_t size=0, m=0;
+  int i;
+  m += asnpprintf(&buf, &size, m, "%s/%s/", uuid, name);
+  for (i=0; i < a->ndims; i++) {
+    if (i) m += asnpprintf(&buf, &size, m, "%c", a->sep);
+    m += asnpprintf(&buf, &size, m, "%zu", cidx[i]);
+  }
+  if (!buf) err(1, "allocation failure");
+  return buf;
+}
+
+/* Casts a value.  Casts to and from bool are handled here, other
+   casts by dlite_type_copy_cast().  Returns non-zero on error. */
+static int cast_value(void *dest, DLiteType dest_type, size_t dest_size,
+                      const void *src, DLiteType src_type, size_t src_size)
+{
+  if (dest_type == src_type && dest_size == src_size) {
+    memcpy(dest, src, dest_size);
+    return 0;
+  } else if (dest_type == dliteBool) {
+    double v=0;
+    if (src_type == dliteBool)
+      *(bool *)dest = *(bool *)src;
+    else if (dlite_type_copy_cast(&v, dliteFloat, sizeof(v),
+                                  src, src_type, src_size))
+      return 1;
+    else
+      *(bool *)dest = (v != 0);
+    return 0;
+  } else if (src_type == dliteBool) {
+    int v = *(bool *)src;
+    return dlite_type_copy_cast(dest, dest_type, dest_size,
+                                &v, dliteInt, sizeof(v));
+  }
+  return dlite_type_copy_cast(dest, dest_type, dest_size,
+                              src, src_type, src_size);
+}
+
+/* Reverses the byte order of the `n` elements of size `size` in `buf`. */
+static void swap_bytes(char *buf, size_t n, size_t size)
+{
+  size_t i, j;
+  for (i=0; i<n; i++, buf+=size)
+    for (j=0; j<size/2; j++) {
+      char c = buf[j];
+      buf[j] = buf[size-j-1];
+      buf[size-j-1] = c;
+    }
+}
+
+/* Fills the `n` elements of `chunk` with the fill value of `a`.
+   Returns non-zero on error. */
+static int fill_chunk(const ZArray *a, char *chunk, size_t n)
+{
+  size_t i;
+  memset(chunk, 0, n*a->size);
+  if (a->fill == 0 || a->type == dliteFixString || a->type == dliteBlob)
+    return 0;
+  if (cast_value(chunk, a->type, a->size, &a->fill, dliteFloat,
+                 sizeof(double))) return 1;
+  for (i=1; i<n; i++) memcpy(chunk + i*a->size, chunk, a->size);
+  return 0;
+}
+
+/* Decodes the data of chunk request `r` of array `a` to `chunk`, which
+   has space for `n` elements.  Returns non-zero on error. */
+static int decode_chunk(const ZArray *a, const Request *r, char *chunk,
+                        size_t n)
+{
+  size_t nbytes = n*a->size;
+  if (r->status == 1) return fill_chunk(a, chunk, n);
+  if (a->level >= 0) {
+#ifdef HAVE_ZLIB
+    z_stream z;
+    int stat;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, 15 + 32) != Z_OK)  /* zlib or gzip header */
+      return errx(1, "zarr: cannot initialise decompression");
+    z.next_in = (Bytef *)r->data;
+    z.avail_in = (uInt)r->len;
+    z.next_out = (Bytef *)chunk;
+    z.avail_out = (uInt)nbytes;
+    stat = inflate(&z, Z_FINISH);
+    inflateEnd(&z);
+    if (stat != Z_STREAM_END || z.total_out != nbytes)
+      return errx(1, "zarr: cannot decompress chunk %s", r->key);
+#else
+    return errx(1, "zarr: dlite is built without zlib, cannot decompress "
+                "chunk %s", r->key);
+#endif
+  } else {
+    if (r->len != nbytes)
+      return errx(1, "zarr: expected %zu bytes in chunk %s, got %zu",
+                  nbytes, r->key, r->len);
+    memcpy(chunk, r->data, nbytes);
+  }
+  if (a->swap) swap_bytes(chunk, n, a->size);
+  return 0;
+}
+
+/* Encodes `chunk` with `n` elements of array `a` as the data of
+   request `r`.  Note that `chunk` is byte swapped in place if `a` is
+   in non-native byte order.  Returns non-zero on error. */
+static int encode_chunk(const ZArray *a, Request *r, char *chunk, size_t n)
+{
+  size_t nbytes = n*a->size;
+  if (a->swap) swap_bytes(chunk, n, a->size);
+  r->len = 0;
+  if (a->level >= 0) {
+#ifdef HAVE_ZLIB
+    uLongf len = compressBound(nbytes);
+    if (!(r->data = malloc(len))) return err(1, "allocation failure");
+    r->size = len;
+    if (compress2((Bytef *)r->data, &len, (Bytef *)chunk, nbytes,
+                  a->level) != Z_OK)
+      return errx(1, "zarr: cannot compress chunk %s", r->key);
+    r->len = len;
+    return 0;
+#else
+    return errx(1, "zarr: dlite is built without zlib, cannot compress "
+                "chunk %s", r->key);
+#endif
+  }
+  return req_add(r, chunk, nbytes);
+}
+
+/* Returns the array stored for property `name` of `d` in `a`.  Returns
+   1 if it doesn't exist and a negative number on error. */
+static int get_zarray(const DLiteDataModel *d, const char *name, ZArray *a)
+{
+  ZStorage *zs = (ZStorage *)d->s;
+  const char *text;
+  char *key;
+  int found;
+  if (!(key = aprintf("%s/%s/.zarray", d->uuid, name)))
+    return err(-1, "allocation failure");
+  text = get_meta(zs, key, &found);
+  if (!text) {
+    free(key);
+    return (found) ? -1 : 1;
+  }
+  found = parse_zarray(a, text, key);
+  free(key);
+  return (found) ? -1 : 0;
+}
+
+/* Writes array metadata `a` for property `name` of `d`.  Returns
+   non-zero on error. */
+static int put_zarray(DLiteDataModel *d, const char *name, const ZArray *a)
+{
+  ZStorage *zs = (ZStorage *)d->s;
+  char *key=NULL, *text=NULL;
+  int stat=1;
+  if (!(key = aprintf("%s/%s/.zarray", d->uuid, name)))
+    FAIL("allocation failure");
+  if (!(text = zarray_text(a))) goto fail;
+  stat = put_meta(zs, key, text);
+ fail:
+  if (key) free(key);
+  if (text) free(text);
+  return stat;
+}
+
+
+/* Iterates over the chunks in a selection.  `lo[i]` and `hi[i]` are the
+   first and last chunk index along dimension i. */
+typedef struct {
+  int ndims;
+  size_t lo[ZARR_MAX_DIMS];
+  size_t hi[ZARR_MAX_DIMS];
+  size_t cidx[ZARR_MAX_DIMS];
+  size_t n;           /* Total number of chunks */
+} ChunkIter;
+
+/* Initialises `it` over the chunks of `a` overlapping the selection
+   given by `offsets`, `counts` and `strides`.  With strides, chunks
+   containing no selected element may be included. */
+static void chunkiter_init(ChunkIter *it, const ZArray *a,
+                           const size_t *offsets, const size_t *counts,
+                           const size_t *strides)
+{
+  int i;
+  it->ndims = a->ndims;
+  it->n = 1;
+  for (i=0; i < a->ndims; i++) {
+    size_t step = (strides) ? strides[i] : 1;
+    size_t last = offsets[i] + (counts[i] - 1) * step;
+    it->lo[i] = offsets[i] / a->chunks[i];
+    it->hi[i] = last / a->chunks[i];
+    it->cidx[i] = it->lo[i];
+    it->n *= it->hi[i] - it->lo[i] + 1;
+  }
+}
+
+/* Advances `it` to the next chunk. */
+static void chunkiter_next(ChunkIter *it)
+{
+  int i;
+  for (i=it->ndims-1; i>=0; i--) {
+    if (++it->cidx[i] <= it->hi[i]) break;
+    it->cidx[i] = it->lo[i];
+  }
+}
+
+/* Copies the selected elements in chunk `cidx` between `chunk` of array
+   `a` and `buf`, which holds the selection given by `offsets`,
+   `counts` and `strides` in C order with type `type` and size `size`.
+   If `in` is non-zero, elements are copied from `buf` to `chunk`,
+   otherwise from `chunk` to `buf`.  Returns non-zero on error. */
+static int copy_chunk(const ZArray *a, const size_t *cidx, char *chunk,
+                      char *buf, DLiteType type, size_t size,
+                      const size_t *offsets, const size_t *counts,
+                      const size_t *strides, int in)
+{
+  size_t klo[ZARR_MAX_DIMS], khi[ZARR_MAX_DIMS], k[ZARR_MAX_DIMS];
+  size_t bstride[ZARR_MAX_DIMS], cstride[ZARR_MAX_DIMS];
+  int i, n = a->ndims;
+
+  for (i=n-1; i>=0; i--) {
+    size_t step = (strides) ? strides[i] : 1;
+    size_t c0 = cidx[i] * a->chunks[i], c1 = c0 + a->chunks[i];
+    bstride[i] = (i == n-1) ? 1 : bstride[i+1] * counts[i+1];
+    cstride[i] = (i == n-1) ? 1 : cstride[i+1] * a->chunks[i+1];
+    klo[i] = (c0 > offsets[i]) ? (c0 - offsets[i] + step - 1) / step : 0;
+    if (c1 <= offsets[i]) return 0;
+    khi[i] = (c1 - 1 - offsets[i]) / step;
+    if (khi[i] >= counts[i]) khi[i] = counts[i] - 1;
+    if (klo[i] > khi[i]) return 0;  /* no selected element in chunk */
+    k[i] = klo[i];
+  }
+  while (1) {
+    size_t b=0, c=0;
+    for (i=0; i<n; i++) {
+      size_t step = (strides) ? strides[i] : 1;
+      b += k[i] * bstride[i];
+      c += (offsets[i] + k[i]*step - cidx[i]*a->chunks[i]) * cstride[i];
+    }
+    if (in) {
+      if (cast_value(chunk + c*a->size, a->type, a->size, buf + b*size,
+                     type, size)) return 1;
+    } else {
+      if (cast_value(buf + b*size, type, size, chunk + c*a->size,
+                     a->type, a->size)) return 1;
+    }
+    for (i=n-1; i>=0; i--) {
+      if (++k[i] <= khi[i]) break;
+      k[i] = klo[i];
+    }
+    if (i < 0) break;
+  }
+  return 0;
+}
+
+/* Returns non-zero if the selection given by `offsets` and `counts`
+   covers all elements of chunk `cidx` of `a` that are within the
+   array shape. */
+static int covers_chunk(const ZArray *a, const size_t *cidx,
+                        const size_t *offsets, const size_t *counts)
+{
+  int i;
+  for (i=0; i < a->ndims; i++) {
+    size_t c0 = cidx[i] * a->chunks[i], c1 = c0 + a->chunks[i];
+    if (c1 > a->shape[i]) c1 = a->shape[i];
+    if (c0 < offsets[i] || c1 > offsets[i] + counts[i]) return 0;
+  }
+  return 1;
+}
+
+/* Reads a slice of array property `name` of `d` to `ptr`.  See
+   GetPropertySlice() in dlite-storage-plugins.h.  Returns non-zero on
+   error. */
+static int read_slice(const DLiteDataModel *d, const char *name, void *ptr,
+                      DLiteType type, size_t size, size_t ndims,
+                      const size_t *offsets, const size_t *counts,
+                      const size_t *strides)
+{
+  ZStorage *zs = (ZStorage *)d->s;
+  Request reqs[ZARR_BATCH];
+  ChunkIter it;
+  ZArray a;
+  char *chunk=NULL;
+  size_t i, b, nb, nelem=1, start;
+  int stat, retval=1;
+
+  memset(reqs, 0, sizeof(reqs));
+  if ((stat = get_zarray(d, name, &a)))
+    return (stat > 0) ?
+      errx(1, "zarr: no property '%s' in %s/%s", name, zs->root, d->uuid) : 1;
+  if ((size_t)a.ndims != ndims)
+    return errx(1, "zarr: expected %zu dimensions of '%s', got %d",
+                ndims, name, a.ndims);
+  for (i=0; i<ndims; i++) {
+    size_t step = (strides) ? strides[i] : 1;
+    if (counts[i] == 0) return 0;
+    if (offsets[i] + (counts[i] - 1) * step >= a.shape[i])
+      return errx(1, "zarr: slice exceeds dimension %zu of '%s'", i, name);
+  }
+  for (i=0; i<ndims; i++) nelem *= a.chunks[i];
+  if (!(chunk = malloc(nelem * a.size))) return err(1, "allocation failure");
+
+  chunkiter_init(&it, &a, offsets, counts, strides);
+  for (start=0; start < it.n; start+=nb) {
+    ChunkIter it2;
+    nb = (it.n - start < ZARR_BATCH) ? it.n - start : ZARR_BATCH;
+    memcpy(&it2, &it, sizeof(it));
+    for (b=0; b<nb; b++, chunkiter_next(&it))
+      if (!(reqs[b].key = chunk_key(d->uuid, name, &a, it.cidx))) goto fail;
+    if (transfer(zs, reqs, nb, 0)) goto fail;
+    for (b=0; b<nb; b++, chunkiter_next(&it2))
+      if (decode_chunk(&a, reqs + b, chunk, nelem) ||
+          copy_chunk(&a, it2.cidx, chunk, ptr, type, size, offsets, counts,
+                     strides, 0))
+        goto fail;
+    req_clear(reqs, nb);
+  }
+  retval = 0;
+ fail:
+  req_clear(reqs, ZARR_BATCH);
+  free(chunk);
+  return retval;
+}
+
+/* Writes the block of array property `name` of `d` with global
+   dimensions `dims`, starting at `offsets` and with `counts` elements
+   along each dimension from `ptr`.  Returns non-zero on error. */
+static int write_slice(DLiteDataModel *d, const char *name, const void *ptr,
+                       DLiteType type, size_t size, size_t ndims,
+                       const size_t *dims, const size_t *offsets,
+                       const size_t *counts)
+{
+  ZStorage *zs = (ZStorage *)d->s;
+  Request reqs[ZARR_BATCH];
+  char *chunks[ZARR_BATCH];
+  int full[ZARR_BATCH];
+  ChunkIter it;
+  ZArray a, old;
+  size_t i, b, nb, nelem=1, start;
+  int stat, fresh=0, retval=1;
+
+  memset(reqs, 0, sizeof(reqs));
+  memset(chunks, 0, sizeof(chunks));
+  if (ndims < 1 || ndims > ZARR_MAX_DIMS)
+    return errx(1, "zarr: cannot store %zu-dimensional property '%s'",
+                ndims, name);
+  if ((stat = get_zarray(d, name, &old)) < 0) return 1;
+
+  /* Reuse the chunk grid of an existing compatible array, since chunks
+     stay valid when the array is resized.  Otherwise create a new
+     array, whose partly written chunks are padded with fill values. */
+  memset(&a, 0, sizeof(a));
+  a.ndims = (int)ndims;
+  for (i=0; i<ndims; i++) a.shape[i] = dims[i];
+  a.type = type;
+  a.size = size;
+  a.level = zs->level;
+  a.sep = '.';
+  if (stat == 0 && old.ndims == a.ndims && old.type == type &&
+      old.size == size) {
+    memcpy(a.chunks, old.chunks, sizeof(a.chunks));
+    a.swap = old.swap;
+    a.level = old.level;
+    a.fill = old.fill;
+    a.sep = old.sep;
+    if (memcmp(a.shape, old.shape, sizeof(a.shape)) &&
+        put_zarray(d, name, &a)) return 1;
+  } else {
+    guess_chunks(zs, &a);
+    if (put_zarray(d, name, &a)) return 1;
+    fresh = 1;
+  }
+
+  for (i=0; i<ndims; i++) {
+    if (counts[i] == 0) return 0;
+    if (offsets[i] + counts[i] > dims[i])
+      return errx(1, "zarr: block exceeds dimension %zu of '%s'", i, name);
+    nelem *= a.chunks[i];
+  }
+
+  chunkiter_init(&it, &a, offsets, counts, NULL);
+  for (start=0; start < it.n; start+=nb) {
+    ChunkIter it2;
+    size_t nget=0;
+    Request gets[ZARR_BATCH];
+    nb = (it.n - start < ZARR_BATCH) ? it.n - start : ZARR_BATCH;
+    memset(gets, 0, sizeof(gets));
+    memcpy(&it2, &it, sizeof(it));
+
+    /* Fetch chunks that are only partly written */
+    for (b=0; b<nb; b++, chunkiter_next(&it)) {
+      if (!(reqs[b].key = chunk_key(d->uuid, name, &a, it.cidx))) goto fail;
+      full[b] = fresh || covers_chunk(&a, it.cidx, offsets, counts);
+      if (!full[b]) gets[nget++].key = reqs[b].key;
+    }
+    if (nget && transfer(zs, gets, nget, 0)) {
+      for (b=0; b<nget; b++) free(gets[b].data);
+      goto fail;
+    }
+
+    /* Assemble and encode chunks */
+    for (b=0, nget=0; b<nb; b++, chunkiter_next(&it2)) {
+      if (!(chunks[b] = malloc(nelem * a.size))) {
+        err(1, "allocation failure");
+        break;
+      }
+      if (full[b])
+        stat = fill_chunk(&a, chunks[b], nelem);
+      else
+        stat = decode_chunk(&a, gets + nget, chunks[b], nelem);
+      if (!full[b]) free(gets[nget++].data);
+      if (stat ||
+          copy_chunk(&a, it2.cidx, chunks[b], (char *)ptr, type, size,
+                     offsets, counts, NULL, 1) ||
+          encode_chunk(&a, reqs + b, chunks[b], nelem))
+        break;
+      free(chunks[b]);
+      chunks[b] = NULL;
+    }
+    for (; nget < nb; nget++) if (gets[nget].data) free(gets[nget].data);
+    if (b < nb) goto fail;
+    if (transfer(zs, reqs, nb, 1)) goto fail;
+    req_clear(reqs, nb);
+  }
+  retval = 0;
+ fail:
+  req_clear(reqs, ZARR_BATCH);
+  for (b=0; b<ZARR_BATCH; b++) if (chunks[b]) free(chunks[b]);
+  return retval;
+}
+
+
+/********************************************************************
+ * Required api
+ ********************************************************************/
+
+/* Parses chunk option `value`.  Returns non-zero on error. */
+static int parse_chunk(ZStorage *zs, const char *value)
+{
+  const char *p = value;
+  if (strcmp(value, "auto") == 0) return 0;
+  while (*p) {
+    char *endptr;
+    long n = strtol(p, &endptr, 10);
+    if (n <= 0 || endptr == p || zs->nchunkdims >= ZARR_MAX_DIMS ||
+        (*endptr && *endptr != 'x'))
+      return errx(1, "zarr: invalid chunk shape: \"%s\"", value);
+    zs->chunkdims[zs->nchunkdims++] = n;
+    p = (*endptr) ? endptr + 1 : endptr;
+  }
+  return 0;
+}
+
+/* Parses compression option `value`.  Returns non-zero on error. */
+static int parse_compression(ZStorage *zs, const char *value)
+{
+  size_t len = strcspn(value, ":");
+  zs->level = -1;
+  if (strcmp(value, "none") == 0) return 0;
+  if (len != 4 || strncmp(value, "zlib", 4) != 0)
+    return errx(1, "zarr: invalid compression: \"%s\"", value);
+#ifdef HAVE_ZLIB
+  zs->level = (value[len] == ':') ? atoi(value + len + 1) : 1;
+  if (zs->level < 0 || zs->level > 9)
+    return errx(1, "zarr: invalid compression level: \"%s\"", value);
+  return 0;
+#else
+  return errx(1, "zarr: dlite is built without zlib compression");
+#endif
+}
+
+/* Frees all memory allocated by storage `zs`, except `zs` itself. */
+static void zarr_clear(ZStorage *zs)
+{
+  const char *key;
+  map_iter_t iter = map_iter(&zs->meta);
+  while ((key = map_next(&zs->meta, &iter))) free(*map_get(&zs->meta, key));
+  map_deinit(&zs->meta);
+#ifdef HAVE_CURL
+  if (zs->handles) {
+    int i;
+    for (i=0; i < zs->nhandles; i++) curl_easy_cleanup(zs->handles[i]);
+    free(zs->handles);
+  }
+  if (zs->multi) curl_multi_cleanup(zs->multi);
+#endif
+  if (zs->root) free(zs->root);
+}
+
+/**
+  Returns a new storage for the Zarr hierarchy at `uri`, which is a
+  local directory or an URL.
+
+  Valid `options` are:
+
+  - mode : append | r | w
+      Valid values are:
+      - append   Append to existing hierarchy or create a new (default)
+      - r        Open existing hierarchy for read-only
+      - w        Create a new hierarchy.  Existing objects are not
+                 deleted, but are no longer listed.
+  - chunk : auto | <dims>
+      Chunk shape of new arrays, like "64x64".  The given shape applies
+      to the last dimensions of an array and is limited by the array
+      dimensions.  With "auto" (default), chunks of about 1 MB are
+      selected from the array shape.
+  - compression : none | zlib[:level]
+      Compression of new arrays.  Default is "none".
+  - connections : Max number of concurrent transfers for URLs (default 8)
+  - user : User name and password separated by colon, for URLs.  For
+      S3-compatible stores this is the access key and secret key.
+  - aws_sigv4 : Sign requests with AWS signature version 4 for the
+      given provider, like "aws:amz:eu-north-1:s3".
+
+  Returns NULL on error.
+ */
+DLiteStorage *zarr_open(const DLiteStoragePlugin *api, const char *uri,
+                        const char *options)
+{
+  ZStorage *zs=NULL;
+  DLiteStorage *retval=NULL;
+  char *mode_descr = "How to open storage.  Valid values are: "
+    "\"append\" (appends to existing storage or creates a new one); "
+    "\"r\" (read-only); "
+    "\"w\" (create a new storage)";
+  DLiteOpt opts[] = {
+    {'m', "mode",        "append", mode_descr},
+    {'c', "chunk",       "auto",   "Chunk shape of arrays: \"auto\" or "
+     "dimensions like \"64x64\""},
+    {'z', "compression", "none",   "Compression: \"none\" or \"zlib[:level]\""},
+    {'n', "connections", ZARR_CONNECTIONS, "Max number of concurrent "
+     "transfers"},
+    {'u', "user",        NULL,     "User name and password separated by "
+     "colon"},
+    {'s', "aws_sigv4",   NULL,     "Provider for AWS signature version 4"},
+    {0, NULL, NULL, NULL}
+  };
+  char *optcopy = (options) ? strdup(options) : NULL;
+  const char *mode;
+  size_t len;
+  UNUSED(api);
+
+  if (dlite_option_parse(optcopy, opts, 1)) goto fail;
+  mode = opts[0].value;
+
+  if (!(zs = calloc(1, sizeof(ZStorage)))) FAIL("allocation failure");
+  map_init(&zs->meta);
+  if (parse_chunk(zs, opts[1].value) ||
+      parse_compression(zs, opts[2].value)) goto fail;
+
+  if (strcmp(mode, "append") == 0 || strcmp(mode, "a") == 0) {
+    zs->writable = 1;
+  } else if (strcmp(mode, "r") == 0 || strcmp(mode, "read") == 0) {
+    zs->writable = 0;
+  } else if (strcmp(mode, "w") == 0 || strcmp(mode, "write") == 0) {
+    zs->writable = 1;
+  } else {
+    FAIL1("invalid \"mode\" value: '%s'. Must be \"append\", \"r\" "
+          "(read-only) or \"w\" (write)", mode);
+  }
+
+  len = strlen(uri);
+  while (len > 1 && uri[len-1] == '/') len--;
+  if (!(zs->root = strndup(uri, len))) FAIL("allocation failure");
+  zs->url = (strstr(zs->root, "://") != NULL);
+
+  if (zs->url) {
+#ifdef HAVE_CURL
+    int i, n = atoi(opts[3].value);
+    if (n < 1) FAIL1("zarr: invalid number of connections: %s",
+                     opts[3].value);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (!(zs->multi = curl_multi_init()))
+      FAIL("zarr: cannot initialise libcurl");
+    curl_multi_setopt(zs->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)n);
+    if (!(zs->handles = calloc(n, sizeof(CURL *))))
+      FAIL("allocation failure");
+    for (i=0; i<n; i++) {
+      CURL *h;
+      if (!(h = curl_easy_init())) FAIL("zarr: cannot initialise libcurl");
+      zs->handles[zs->nhandles++] = h;
+      curl_easy_setopt(h, CURLOPT_NOSIGNAL, 1L);
+      curl_easy_setopt(h, CURLOPT_FOLLOWLOCATION, 1L);
+      if (opts[4].value) curl_easy_setopt(h, CURLOPT_USERPWD, opts[4].value);
+      if (opts[5].value)
+        curl_easy_setopt(h, CURLOPT_AWS_SIGV4, opts[5].value);
+    }
+#else
+    FAIL1("zarr: dlite is built without libcurl, cannot open URL: %s", uri);
+#endif
+  }
+
+  if (strcmp(mode, "w") && strcmp(mode, "write") &&
+      read_consolidated(zs)) goto fail;
+  if (zs->writable && !map_get(&zs->meta, ".zgroup") &&
+      put_meta(zs, ".zgroup", "{\n  \"zarr_format\": 2\n}\n")) goto fail;
+
+  zs->idflag = dliteIDTranslateToUUID;
+  retval = (DLiteStorage *)zs;
+ fail:
+  if (optcopy) free(optcopy);
+  if (!retval && zs) {
+    zarr_clear(zs);
+    free(zs);
+  }
+  return retval;
+}
+
+
+/**
+  Closes storage `s`.  Returns non-zero on error.
+ */
+int zarr_close(DLiteStorage *s)
+{
+  ZStorage *zs = (ZStorage *)s;
+  int stat=0;
+  if (zs->writable && zs->modified) stat = write_consolidated(zs);
+  zarr_clear(zs);
+  return stat;
+}
+
+
+/**
+  Returns a new data model for instance `uuid` in storage `s` or NULL
+  on error.
+ */
+DLiteDataModel *zarr_datamodel(const DLiteStorage *s, const char *uuid)
+{
+  ZStorage *zs = (ZStorage *)s;
+  ZDataModel *d=NULL;
+  DLiteDataModel *retval=NULL;
+  jsmn_parser parser;
+  jsmntok_t *tokens=NULL;
+  unsigned int ntokens=0;
+  const jsmntok_t *t, *key;
+  const char *js;
+  char *k=NULL;
+  int i, n, found;
+
+  if (!(d = calloc(1, sizeof(ZDataModel)))) FAIL("allocation failure");
+  map_init(&d->dims);
+  map_init(&d->props);
+  if (!(k = aprintf("%s/.zattrs", uuid))) FAIL("allocation failure");
+  if (!(js = get_meta(zs, k, &found))) {
+    if (found) goto fail;
+    if (!s->writable)
+      FAIL2("zarr: no instance '%s' in %s", uuid, zs->root);
+    retval = (DLiteDataModel *)d;
+    goto fail;
+  }
+  d->exists = 1;
+
+  /* Parse attributes */
+  jsmn_init(&parser);
+  if ((n = jsmn_parse_alloc(&parser, js, strlen(js), &tokens, &ntokens)) < 0)
+    FAIL2("zarr: cannot parse %s: %s", k, jsmn_strerror(n));
+  if ((t = jsmn_item(js, tokens, "dlite:meta")) && t->type == JSMN_STRING &&
+      !(d->metauri = strndup(js + t->start, t->end - t->start)))
+    FAIL("allocation failure");
+  if ((t = jsmn_item(js, tokens, "dlite:dataname")) &&
+      t->type == JSMN_STRING &&
+      !(d->dataname = strndup(js + t->start, t->end - t->start)))
+    FAIL("allocation failure");
+  if ((t = jsmn_item(js, tokens, "dlite:dimensions")) &&
+      t->type == JSMN_OBJECT) {
+    for (i=0, key=t+1; i < t->size; i++, key+=2) {
+      char *name = strndup(js + key->start, key->end - key->start);
+      if (!name) FAIL("allocation failure");
+      map_set(&d->dims, name, atoi(js + key[1].start));
+      free(name);
+    }
+  }
+  if ((t = jsmn_item(js, tokens, "dlite:properties")) &&
+      t->type == JSMN_OBJECT) {
+    for (i=0, key=t+1; i < t->size; i++) {
+      const jsmntok_t *val = key + 1;
+      int q = (val->type == JSMN_STRING);  /* include quotes of strings */
+      char *name = strndup(js + key->start, key->end - key->start);
+      char *value = strndup(js + val->start - q, val->end - val->start + 2*q);
+      if (!name || !value) {
+        if (name) free(name);
+        if (value) free(value);
+        FAIL("allocation failure");
+      }
+      map_set(&d->props, name, value);
+      free(name);
+      key = val + 1 + jsmn_count(val);
+    }
+  }
+  retval = (DLiteDataModel *)d;
+ fail:
+  if (k) free(k);
+  if (tokens) free(tokens);
+  if (!retval && d) {
+    if (d->metauri) free(d->metauri);
+    if (d->dataname) free(d->dataname);
+    map_deinit(&d->dims);
+    map_deinit(&d->props);
+    free(d);
+  }
+  return retval;
+}
+
+
+/* Writes the attributes of `d`.  Returns non-zero on error. */
+static int write_attrs(DLiteDataModel *d)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  ZStorage *zs = (ZStorage *)d->s;
+  char *buf=NULL, *key=NULL;
+  size_t size=0, m=0;
+  const char *name, *sep="";
+  map_iter_t iter;
+  int retval=1;
+
+  m += asnpprintf(&buf, &size, m, "{\n  \"dlite:meta\": ");
+  m += dlite_type_aprint(&buf, &size, m, &zd->metauri, dliteStringPtr,
+                         sizeof(char *), 0, -2, dliteFlagQuoted);
+  if (zd->dataname) {
+    m += asnpprintf(&buf, &size, m, ",\n  \"dlite:dataname\": ");
+    m += dlite_type_aprint(&buf, &size, m, &zd->dataname, dliteStringPtr,
+                           sizeof(char *), 0, -2, dliteFlagQuoted);
+  }
+  m += asnpprintf(&buf, &size, m, ",\n  \"dlite:dimensions\": {");
+  iter = map_iter(&zd->dims);
+  while ((name = map_next(&zd->dims, &iter))) {
+    m += asnpprintf(&buf, &size, m, "%s\"%s\": %d", sep, name,
+                    *map_get(&zd->dims, name));
+    sep = ", ";
+  }
+  m += asnpprintf(&buf, &size, m, "},\n  \"dlite:properties\": {");
+  sep = "";
+  iter = map_iter(&zd->props);
+  while ((name = map_next(&zd->props, &iter))) {
+    m += asnpprintf(&buf, &size, m, "%s\n    \"%s\": %s", sep, name,
+                    *map_get(&zd->props, name));
+    sep = ",";
+  }
+  m += asnpprintf(&buf, &size, m, "\n  }\n}\n");
+  if (!buf) FAIL("allocation failure");
+
+  if (!zd->exists) {
+    if (!(key = aprintf("%s/.zgroup", d->uuid))) FAIL("allocation failure");
+    if (put_meta(zs, key, "{\n  \"zarr_format\": 2\n}\n")) goto fail;
+    free(key);
+  }
+  if (!(key = aprintf("%s/.zattrs", d->uuid))) FAIL("allocation failure");
+  if (put_meta(zs, key, buf)) goto fail;
+  zd->exists = 1;
+  zd->modified = 0;
+  retval = 0;
+ fail:
+  if (buf) free(buf);
+  if (key) free(key);
+  return retval;
+}
+
+/**
+  Frees data model `d`, writing its attributes if it has been
+  modified.  Returns non-zero on error.
+ */
+int zarr_datamodel_free(DLiteDataModel *d)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  const char *name;
+  map_iter_t iter = map_iter(&zd->props);
+  int stat=0;
+  if (zd->modified) {
+    if (!zd->metauri)
+      stat = errx(1, "zarr: no metadata uri for instance '%s'", d->uuid);
+    else
+      stat = write_attrs(d);
+  }
+  while ((name = map_next(&zd->props, &iter)))
+    free(*map_get(&zd->props, name));
+  map_deinit(&zd->props);
+  map_deinit(&zd->dims);
+  if (zd->metauri) free(zd->metauri);
+  if (zd->dataname) free(zd->dataname);
+  return stat;
+}
+
+
+/**
+  Returns pointer to (malloc'ed) metadata uri or NULL on error.
+ */
+char *zarr_get_meta_uri(const DLiteDataModel *d)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  char *uri;
+  if (!zd->metauri)
+    return errx(1, "zarr: no metadata uri for instance '%s'", d->uuid), NULL;
+  if (!(uri = strdup(zd->metauri))) err(1, "allocation failure");
+  return uri;
+}
+
+
+/**
+  Returns the size of dimension `name` or -1 on error.
+ */
+int zarr_get_dimension_size(const DLiteDataModel *d, const char *name)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  int *size;
+  if (!(size = map_get(&zd->dims, name)))
+    return errx(-1, "zarr: no dimension '%s' in instance '%s'",
+                name, d->uuid);
+  return *size;
+}
+
+
+/**
+  Copies property `name` to memory pointed to by `ptr`.
+  Returns non-zero on error.
+ */
+int zarr_get_property(const DLiteDataModel *d, const char *name, void *ptr,
+                      DLiteType type, size_t size,
+                      size_t ndims, const size_t *dims)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  char **value;
+  size_t i, offsets[ZARR_MAX_DIMS];
+  if ((value = map_get(&zd->props, name))) {
+    DLiteProperty p;
+    memset(&p, 0, sizeof(p));
+    p.name = (char *)name;
+    p.type = type;
+    p.size = size;
+    p.ndims = (int)ndims;
+    /* Array elements are unquoted by the JSON parser */
+    if (dlite_property_scan(*value, ptr, &p, dims,
+                            (ndims) ? 0 : dliteFlagQuoted) < 0)
+      return errx(1, "zarr: cannot parse property '%s' of '%s'",
+                  name, d->uuid);
+    return 0;
+  }
+  if (ndims == 0 || ndims > ZARR_MAX_DIMS)
+    return errx(1, "zarr: no property '%s' in instance '%s'", name, d->uuid);
+  for (i=0; i<ndims; i++) offsets[i] = 0;
+  return read_slice(d, name, ptr, type, size, ndims, offsets, dims, NULL);
+}
+
+
+/**
+  Copies a slice of property `name` to memory pointed to by `ptr`.
+  See GetPropertySlice() in dlite-storage-plugins.h.
+
+  Only the chunks overlapping the slice are fetched.
+
+  Returns non-zero on error.
+ */
+int zarr_get_property_slice(const DLiteDataModel *d, const char *name,
+                            void *ptr, DLiteType type, size_t size,
+                            size_t ndims, const size_t *offsets,
+                            const size_t *counts, const size_t *strides)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  if (map_get(&zd->props, name))
+    return errx(1, "zarr: property '%s' of '%s' is not stored as an array",
+                name, d->uuid);
+  return read_slice(d, name, ptr, type, size, ndims, offsets, counts,
+                    strides);
+}
+
+
+/********************************************************************
+ * Optional api
+ ********************************************************************/
+
+/**
+  Sets metadata uri.  Returns non-zero on error.
+*/
+int zarr_set_meta_uri(DLiteDataModel *d, const char *uri)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  if (zd->metauri) free(zd->metauri);
+  if (!(zd->metauri = strdup(uri))) return err(1, "allocation failure");
+  zd->modified = 1;
+  return 0;
+}
+
+
+/**
+  Sets size of dimension `name`.  Returns non-zero on error.
+*/
+int zarr_set_dimension_size(DLiteDataModel *d, const char *name, size_t size)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  if (map_set(&zd->dims, name, (int)size))
+    return errx(1, "zarr: cannot set dimension '%s'", name);
+  zd->modified = 1;
+  return 0;
+}
+
+
+/**
+  Sets property `name` to the memory pointed to by `ptr`.
+  Returns non-zero on error.
+*/
+int zarr_set_property(DLiteDataModel *d, const char *name, const void *ptr,
+                      DLiteType type, size_t size,
+                      size_t ndims, const size_t *dims)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  char **old, *buf=NULL;
+  size_t n=0, i, offsets[ZARR_MAX_DIMS];
+  DLiteProperty p;
+
+  if (ndims > 0 && ndims <= ZARR_MAX_DIMS && zarr_supported(type, size)) {
+    if ((old = map_get(&zd->props, name))) {
+      free(*old);
+      map_remove(&zd->props, name);
+      zd->modified = 1;
+    }
+    for (i=0; i<ndims; i++) offsets[i] = 0;
+    return write_slice(d, name, ptr, type, size, ndims, dims, offsets, dims);
+  }
+
+  memset(&p, 0, sizeof(p));
+  p.name = (char *)name;
+  p.type = type;
+  p.size = size;
+  p.ndims = (int)ndims;
+  if (dlite_property_aprint(&buf, &n, 0, ptr, &p, dims, 0, -2,
+                            dliteFlagQuoted) < 0) {
+    if (buf) free(buf);
+    return errx(1, "zarr: cannot serialise property '%s'", name);
+  }
+  if ((old = map_get(&zd->props, name))) free(*old);
+  if (map_set(&zd->props, name, buf)) {
+    free(buf);
+    return errx(1, "zarr: cannot set property '%s'", name);
+  }
+  zd->modified = 1;
+  return 0;
+}
+
+
+/**
+  Sets the block of property `name` starting at index `offsets` with
+  `counts` elements along each dimension to the memory pointed to by
+  `ptr`.  `dims` are the global dimensions of the property.
+
+  Chunks that are only partly covered by the block are read, updated
+  and written back.
+
+  Returns non-zero on error.
+*/
+int zarr_set_property_slice(DLiteDataModel *d, const char *name,
+                            const void *ptr, DLiteType type, size_t size,
+                            size_t ndims, const size_t *dims,
+                            const size_t *offsets, const size_t *counts)
+{
+  if (!zarr_supported(type, size))
+    return errx(1, "zarr: cannot write a slice of '%s' of type %s", name,
+                dlite_type_get_enum_name(type));
+  return write_slice(d, name, ptr, type, size, ndims, dims, offsets, counts);
+}
+
+
+/**
+  Returns a NULL-terminated array of string pointers to instance UUID's.
+  The caller is responsible to free the returned array.
+
+  Instances are listed from the consolidated metadata.
+
+  Returns NULL on error.
+*/
+char **zarr_get_uuids(const DLiteStorage *s)
+{
+  ZStorage *zs = (ZStorage *)s;
+  map_iter_t iter = map_iter(&zs->meta);
+  const char *key;
+  char **uuids;
+  size_t n=0;
+
+  if (!(uuids = calloc(zs->meta.base.nnodes + 1, sizeof(char *))))
+    return err(1, "allocation failure"), NULL;
+  while ((key = map_next(&zs->meta, &iter))) {
+    const char *p = strchr(key, '/');
+    if (p && p > key && strcmp(p, "/.zattrs") == 0 &&
+        !(uuids[n++] = strndup(key, p - key))) {
+      while (n > 1) free(uuids[--n - 1]);
+      free(uuids);
+      return err(1, "allocation failure"), NULL;
+    }
+  }
+  return uuids;
+}
+
+
+/**
+  Returns a positive value if dimension `name` is defined, zero if it
+  isn't and a negative value on error.
+ */
+int zarr_has_dimension(const DLiteDataModel *d, const char *name)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  return map_get(&zd->dims, name) != NULL;
+}
+
+
+/**
+  Returns a positive value if property `name` is defined, zero if it
+  isn't and a negative value on error.
+ */
+int zarr_has_property(const DLiteDataModel *d, const char *name)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  ZArray a;
+  int stat;
+  if (map_get(&zd->props, name)) return 1;
+  if ((stat = get_zarray(d, name, &a)) < 0) return -1;
+  return stat == 0;
+}
+
+
+/**
+  If the uuid was generated from a unique name, return a pointer to a
+  newly malloc'ed string with this name.  Otherwise NULL is returned.
+*/
+char *zarr_get_dataname(const DLiteDataModel *d)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  return (zd->dataname) ? strdup(zd->dataname) : NULL;
+}
+
+
+/**
+  Gives the instance a name.  This function should only be called
+  if the uuid was generated from `name`.
+  Returns non-zero on error.
+*/
+int zarr_set_dataname(DLiteDataModel *d, const char *name)
+{
+  ZDataModel *zd = (ZDataModel *)d;
+  if (zd->dataname) free(zd->dataname);
+  if (!(zd->dataname = strdup(name))) return err(1, "allocation failure");
+  zd->modified = 1;
+  return 0;
+}
+
+
+static DLiteStoragePlugin zarr_plugin = {
+  /* head */
+  "zarr",                   /* name */
+  NULL,                     /* freeapi */
+
+  /* basic api */
+  zarr_open,                /* open */
+  zarr_close,               /* close */
+
+  /* queue api */
+  NULL,                     /* iterCreate */
+  NULL,                     /* iterNext */
+  NULL,                     /* iterFree */
+  zarr_get_uuids,           /* getUUIDs */
+
+  /* direct api */
+  NULL,                     /* loadInstance */
+  NULL,                     /* saveInstance */
+  NULL,                     /* loadInstances */
+  NULL,                     /* saveInstances */
+
+  /* datamodel api */
+  zarr_datamodel,           /* dataModel */
+  zarr_datamodel_free,      /* dataModelFree */
+
+  zarr_get_meta_uri,        /* getMetaURI */
+  NULL,                     /* resolveDimensions */
+  zarr_get_dimension_size,  /* getDimensionSize */
+  zarr_get_property,        /* getProperty */
+
+  /* -- datamodel api (optional) */
+  zarr_set_meta_uri,        /* setMetaURI */
+  zarr_set_dimension_size,  /* setDimensionSize */
+  zarr_set_property,        /* setProperty */
+
+  zarr_has_dimension,       /* hasDimension */
+  zarr_has_property,        /* hasProperty */
+  zarr_get_property_slice,  /* getPropertySlice */
+
+  zarr_get_dataname,        /* getDataName */
+  zarr_set_dataname,        /* setDataName */
+
+  /* internal data */
+  NULL,                     /* data */
+
+  /* capabilities */
+  dliteCapRandomAccess,     /* flags */
+
+  /* distributed datamodel api (optional) */
+  zarr_set_property_slice,  /* setPropertySlice */
+
+  /* query api (optional) */
+  NULL,                     /* queryCreate */
+
+  /* collection view api (optional) */
+  NULL,                     /* saveView */
+  NULL,                     /* loadView */
+
+  /* asynchronous api (optional) */
+  NULL,                     /* loadInstanceAsync */
+  NULL,                     /* saveInstanceAsync */
+  NULL,                     /* asyncFd */
+  NULL,                     /* asyncPoll */
+
+  /* sparse datamodel api (optional) */
+  NULL,                     /* setSparseProperty */
+
+  /* mapped datamodel api (optional) */
+  NULL                      /* mapProperty */
+};
+
+
+DSL_EXPORT const DLiteStoragePlugin *
+get_dlite_storage_plugin_api(void *state, int *iter)
+{
+  UNUSED(iter);
+  dlite_globals_set(state);
+  return &zarr_plugin;
+}
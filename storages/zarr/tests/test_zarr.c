@@ -0,0 +1,292 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "minunit/minunit.h"
+
+#include "utils/err.h"
+#include "utils/strutils.h"
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-datamodel.h"
+
+#define NX 20
+#define NY 30
+
+char *path = "test-zarr.zarr";
+char *uri = "http://onto-ns.com/meta/0.1/ZarrTestEntity";
+DLiteMeta *entity=NULL;
+DLiteInstance *inst=NULL;
+char uuid[DLITE_UUID_LENGTH+1];
+
+
+/* Returns non-zero if `arr` has `n` elements that equal the grid values
+   selected by `offsets` and `strides`. */
+static int check_grid(const DLiteArray *arr, size_t n, const size_t *offsets,
+                      const size_t *strides)
+{
+  size_t i, j, k=0;
+  const double *v = arr->data;
+  if (arr->ndims != 2 || arr->dims[0]*arr->dims[1] != n) return 0;
+  for (i=0; i < arr->dims[0]; i++)
+    for (j=0; j < arr->dims[1]; j++, k++) {
+      size_t x = offsets[0] + i*strides[0], y = offsets[1] + j*strides[1];
+      if (v[k] != x*100.0 + y) return 0;
+    }
+  return 1;
+}
+
+
+MU_TEST(test_create)
+{
+  char *dims2[] = {"NX", "NY"}, *dims1[] = {"NX"};
+  DLiteDimension dimensions[] = {
+    {"NX", "Number of rows."},
+    {"NY", "Number of columns."}
+  };
+  DLiteProperty properties[] = {
+    /* name    type            size            ndims dims  unit iri  descr */
+    {"flag",   dliteBool,      sizeof(bool),   0, NULL,  "",  NULL, "Flag."},
+    {"name",   dliteStringPtr, sizeof(char *), 0, NULL,  "",  NULL, "Name."},
+    {"grid",   dliteFloat,     sizeof(double), 2, dims2, "K", NULL, "Grid."},
+    {"index",  dliteInt,       sizeof(int),    1, dims1, "",  NULL, "Index."},
+    {"mask",   dliteBool,      sizeof(bool),   1, dims1, "",  NULL, "Mask."},
+    {"tags",   dliteStringPtr, sizeof(char *), 1, dims1, "",  NULL, "Tags."}
+  };
+  size_t shape[] = {NX, NY};
+  bool flag = 1;
+  char *name = "zarr \"test\"";
+  double *grid;
+  int *index;
+  bool *mask;
+  char **tags;
+  int i, j;
+
+  mu_check((entity = (DLiteMeta *)dlite_meta_create(uri, "Test entity.",
+                                                    NULL,
+                                                    2, dimensions,
+                                                    6, properties)));
+  mu_check((inst = dlite_instance_create(entity, shape, "zarrinst")));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "flag", &flag));
+  mu_assert_int_eq(0, dlite_instance_set_property(inst, "name", &name));
+  grid = dlite_instance_get_property(inst, "grid");
+  index = dlite_instance_get_property(inst, "index");
+  mask = dlite_instance_get_property(inst, "mask");
+  tags = dlite_instance_get_property(inst, "tags");
+  for (i=0; i<NX; i++) {
+    for (j=0; j<NY; j++) grid[i*NY + j] = i*100.0 + j;
+    index[i] = -i;
+    mask[i] = i % 3 == 0;
+    tags[i] = aprintf("tag%d", i);
+  }
+}
+
+/* Returns non-zero if object `key` exists in the Zarr directory. */
+static int exists(const char *key)
+{
+  FILE *fp;
+  char *filename = aprintf("%s/%s", path, key);
+  if ((fp = fopen(filename, "rb"))) fclose(fp);
+  free(filename);
+  return fp != NULL;
+}
+
+MU_TEST(test_save)
+{
+  DLiteStorage *s;
+  char key[64];
+  mu_check((s = dlite_storage_open("zarr", path,
+                                   "mode=w;chunk=8x7;compression=zlib:6")));
+  mu_assert_int_eq(0, dlite_instance_save(s, inst));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* Release the instance such that it is loaded from the storage */
+  strcpy(uuid, inst->uuid);
+  dlite_instance_decref(inst);
+  inst = NULL;
+
+  /* A 20x30 grid in 8x7 chunks has 3x5 chunks */
+  mu_check(exists(".zmetadata"));
+  snprintf(key, sizeof(key), "%s/grid/.zarray", uuid);
+  mu_check(exists(key));
+  snprintf(key, sizeof(key), "%s/grid/2.4", uuid);
+  mu_check(exists(key));
+  snprintf(key, sizeof(key), "%s/grid/3.0", uuid);
+  mu_check(!exists(key));
+}
+
+MU_TEST(test_load)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst2;
+  char **uuids;
+  int i, j;
+  mu_check((s = dlite_storage_open("zarr", path, "mode=r")));
+  mu_check((uuids = dlite_storage_uuids(s, NULL)));
+  mu_check(uuids[0]);
+  mu_assert_string_eq(uuid, uuids[0]);
+  mu_check(!uuids[1]);
+  dlite_storage_uuids_free(uuids);
+
+  mu_check((inst2 = dlite_instance_load(s, "zarrinst")));
+  mu_assert_string_eq(uuid, inst2->uuid);
+  mu_assert_int_eq(NX, dlite_instance_get_dimension_size(inst2, "NX"));
+  mu_assert_int_eq(NY, dlite_instance_get_dimension_size(inst2, "NY"));
+  mu_check(*(bool *)dlite_instance_get_property(inst2, "flag"));
+  mu_assert_string_eq("zarr \"test\"",
+                      *(char **)dlite_instance_get_property(inst2, "name"));
+  for (i=0; i<NX; i++) {
+    double *grid = dlite_instance_get_property(inst2, "grid");
+    int *index = dlite_instance_get_property(inst2, "index");
+    bool *mask = dlite_instance_get_property(inst2, "mask");
+    char **tags = dlite_instance_get_property(inst2, "tags");
+    char tag[16];
+    for (j=0; j<NY; j++) mu_assert_double_eq(i*100.0 + j, grid[i*NY + j]);
+    mu_assert_int_eq(-i, index[i]);
+    mu_assert_int_eq(i % 3 == 0, mask[i]);
+    snprintf(tag, sizeof(tag), "tag%d", i);
+    mu_assert_string_eq(tag, tags[i]);
+  }
+  dlite_instance_decref(inst2);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_load_slice)
+{
+  DLiteStorage *s;
+  DLiteArray *arr;
+  size_t offsets[] = {3, 5}, counts[] = {6, 4}, strides[] = {2, 6};
+  size_t ones[] = {1, 1};
+  mu_check((s = dlite_storage_open("zarr", path, "mode=r")));
+
+  mu_check((arr = dlite_instance_load_property_slice(s, "zarrinst", "grid",
+                                                     offsets, counts, NULL)));
+  mu_check(check_grid(arr, 24, offsets, ones));
+  free(arr->data);
+  dlite_array_free(arr);
+
+  mu_check((arr = dlite_instance_load_property_slice(s, "zarrinst", "grid",
+                                                     offsets, counts,
+                                                     strides)));
+  mu_check(check_grid(arr, 24, offsets, strides));
+  free(arr->data);
+  dlite_array_free(arr);
+
+  counts[1] = 5;  /* 5 + 4*6 = 29 is still within NY */
+  mu_check((arr = dlite_instance_load_property_slice(s, "zarrinst", "grid",
+                                                     offsets, counts,
+                                                     strides)));
+  mu_check(check_grid(arr, 30, offsets, strides));
+  free(arr->data);
+  dlite_array_free(arr);
+
+  err_clear();
+  counts[1] = 6;  /* exceeds NY */
+  mu_check(!dlite_instance_load_property_slice(s, "zarrinst", "grid",
+                                               offsets, counts, strides));
+  err_clear();
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_set_slice)
+{
+  DLiteStorage *s;
+  DLiteDataModel *d;
+  size_t dims[] = {NX, NY}, offsets[] = {4, 10}, counts[] = {5, 9};
+  double block[5*9], v;
+  size_t i, j;
+
+  for (i=0; i<5*9; i++) block[i] = -1.0 - i;
+  mu_check((s = dlite_storage_open("zarr", path, NULL)));
+  mu_check((d = dlite_datamodel(s, uuid)));
+  mu_assert_int_eq(0, dlite_datamodel_set_property_slice(d, "grid", block,
+                                                         dliteFloat,
+                                                         sizeof(double), 2,
+                                                         dims, offsets,
+                                                         counts));
+  mu_assert_int_eq(0, dlite_datamodel_free(d));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+
+  /* Check that the block is updated and the rest is unchanged */
+  mu_check((s = dlite_storage_open("zarr", path, "mode=r")));
+  mu_check((d = dlite_datamodel(s, uuid)));
+  for (i=0; i<NX; i++) {
+    for (j=0; j<NY; j++) {
+      size_t off[] = {i, j}, cnt[] = {1, 1};
+      mu_assert_int_eq(0, dlite_datamodel_get_property_slice(d, "grid", &v,
+                                                             dliteFloat,
+                                                             sizeof(double),
+                                                             2, off, cnt,
+                                                             NULL));
+      if (i >= 4 && i < 9 && j >= 10 && j < 19)
+        mu_assert_double_eq(-1.0 - ((i-4)*9 + j-10), v);
+      else
+        mu_assert_double_eq(i*100.0 + j, v);
+    }
+  }
+  mu_assert_int_eq(0, dlite_datamodel_free(d));
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_url)
+{
+  DLiteStorage *s;
+  DLiteInstance *inst2;
+  char *cwd, *url;
+  double *grid;
+  mu_check((cwd = getcwd(NULL, 0)));
+  mu_check((url = aprintf("file://%s/%s", cwd, path)));
+  free(cwd);
+  s = dlite_storage_open("zarr", url, "mode=r;connections=4");
+  free(url);
+  if (!s) {
+    /* Built without libcurl */
+    err_clear();
+    return;
+  }
+  mu_check((inst2 = dlite_instance_load(s, "zarrinst")));
+  grid = dlite_instance_get_property(inst2, "grid");
+  mu_assert_double_eq(3*100.0 + 7, grid[3*NY + 7]);
+  mu_assert_double_eq(-1.0, grid[4*NY + 10]);
+  dlite_instance_decref(inst2);
+  mu_assert_int_eq(0, dlite_storage_close(s));
+}
+
+MU_TEST(test_options)
+{
+  err_clear();
+  mu_check(!dlite_storage_open("zarr", path, "chunk=4x0"));
+  mu_check(!dlite_storage_open("zarr", path, "compression=lz4"));
+  mu_check(!dlite_storage_open("zarr", path, "mode=x"));
+  err_clear();
+}
+
+MU_TEST(test_teardown)
+{
+  dlite_meta_decref(entity);
+}
+
+
+/***********************************************************************/
+
+MU_TEST_SUITE(test_suite)
+{
+  MU_RUN_TEST(test_create);     /* setup */
+  MU_RUN_TEST(test_save);
+  MU_RUN_TEST(test_load);
+  MU_RUN_TEST(test_load_slice);
+  MU_RUN_TEST(test_set_slice);
+  MU_RUN_TEST(test_url);
+  MU_RUN_TEST(test_options);
+  MU_RUN_TEST(test_teardown);   /* teardown */
+}
+
+
+
+int main()
+{
+  MU_RUN_SUITE(test_suite);
+  MU_REPORT();
+  return (minunit_fail) ? 1 : 0;
+}
@@ -20,8 +20,8 @@
 void help()
 {
   char **p, *msg[] = {
-    "Usage: dlite-codegen [OPTIONS] URL",
-    "Generates code from a template and a DLite instance.",
+    "Usage: dlite-codegen [OPTIONS] URL...",
+    "Generates code from a template and one or more DLite instances.",
     "  -b, --built-in               Whether the URL refers to a built-in",
     "                               instance, rather than an instance located",
     "                               in a storage.",
@@ -32,10 +32,17 @@ void help()
     "                               It should correspond to a template name.",
     "                               Defaults to \"c-header\"",
     "  -h, --help                   Prints this help and exit.",
+    "  -j, --jobs=N                 Number of threads used when generating",
+    "                               code for several instances.  Defaults",
+    "                               to the number of CPUs.",
     "  -n, --native-typenames       Whether to use native typenames.  The",
     "                               default is to use portable typenames.",
     "                               Ex. \"double\" instead of \"float64_t\".",
     "  -o, --output=PATH            Output file.  Default is stdout.",
+    "  -O, --output-pattern=PATTERN Template for the output file names.",
+    "                               Required if more than one URL is given.",
+    "                               It is expanded for each instance, e.g.",
+    "                               \"{name%c}.h\".",
     "  -s, --storage-plugins=PATH   Additional paths to look for storage ",
     "                               plugins.  May be provided multiple times.",
     "  -m, --metadata=URL           Additional metadata to load.  May be ",
@@ -50,6 +57,9 @@ void help()
     "The template is either specified with the --format or --template-file "
     "options.",
     "",
+    "If several URLs are given, the template is compiled once and the ",
+    "documents are generated in parallel.",
+    "",
     "The URL identifies the instance and should be of the general form:",
     "",
     "    driver://loc?options#id",
@@ -73,18 +83,50 @@ void help()
 }
 
 
+/* Writes `text` to file `output` or stdout if `output` is NULL.
+   Returns non-zero on error. */
+static int write_output(const char *output, const char *text)
+{
+  if (output) {
+    FILE *fp = fopen(output, "wb");
+    if (!fp) return err(1, "cannot open \"%s\" for writing", output);
+    fwrite(text, 1, strlen(text), fp);
+    fclose(fp);
+  } else {
+    fwrite(text, 1, strlen(text), stdout);
+  }
+  return 0;
+}
+
+/* Loads instance from `url`.  Returns a new reference or NULL on error. */
+static DLiteInstance *load_instance(const char *url, int builtin)
+{
+  DLiteInstance *inst;
+  if (builtin) {
+    /* FIXME - this should be updated when default paths for entity lookup
+       has been implemented... */
+    if (!(inst = dlite_instance_get(url))) return NULL;
+    dlite_instance_incref(inst);
+    return inst;
+  }
+  return dlite_instance_load_url(url);
+}
+
+
 int main(int argc, char *argv[])
 {
   int retval = 1;
-  size_t n;
+  size_t n, i, nurls=0;
   int builtin = 0;
-  DLiteInstance *inst = NULL;
-  char *text=NULL, *template=NULL, *template_path=NULL;
+  DLiteInstance *inst = NULL, **insts = NULL;
+  char *text=NULL, *template=NULL, *template_path=NULL, **texts=NULL;
 
   /* Command line arguments */
-  char *url = NULL;
+  char *url = NULL, **urls = NULL;
   char *format = "c-header";
   char *output = NULL;
+  char *output_pattern = NULL;
+  int jobs = 0;
   const char *template_file = NULL;
   TGenBuf variables;
 
@@ -100,8 +142,10 @@ int main(int argc, char *argv[])
       {"build-root",       0, NULL, 'B'},
       {"format",           1, NULL, 'f'},
       {"help",             0, NULL, 'h'},
+      {"jobs",             1, NULL, 'j'},
       {"native-typenames", 0, NULL, 'n'},
       {"output",           1, NULL, 'o'},
+      {"output-pattern",   1, NULL, 'O'},
       {"storage-plugins",  1, NULL, 's'},
       {"metadata",         1, NULL, 'm'},
       {"template-file",    1, NULL, 't'},
@@ -109,15 +153,18 @@ int main(int argc, char *argv[])
       {"version",          0, NULL, 'V'},
       {NULL, 0, NULL, 0}
     };
-    int c = getopt_long(argc, argv, "bBf:hno:s:m:t:v:V", longopts, &longindex);
+    int c = getopt_long(argc, argv, "bBf:hj:no:O:s:m:t:v:V", longopts,
+                        &longindex);
     if (c == -1) break;
     switch (c) {
     case 'b':  builtin = 1; break;
     case 'B':  dlite_set_use_build_root(1); break;
     case 'f':  format = optarg; break;
     case 'h':  help(stdout); exit(0);
+    case 'j':  jobs = atoi(optarg); break;
     case 'n':  dlite_codegen_set_native_typenames(1); break;
     case 'o':  output = optarg; break;
+    case 'O':  output_pattern = optarg; break;
     case 's':  dlite_storage_plugin_path_append(optarg); break;
     case 'm':  dlite_instance_load_url(optarg); break;
     case 't':  template_file = optarg; break;
@@ -127,27 +174,20 @@ int main(int argc, char *argv[])
     default:   abort();
     }
   }
-  if (optind < argc) url = argv[optind++];
-  if (optind != argc)
-    return errx(1, "Too many arguments");
-
-  if (!url) return errx(1, "Missing url argument");
+  urls = argv + optind;
+  nurls = argc - optind;
+  if (nurls == 0) return errx(1, "Missing url argument");
+  if (nurls > 1 && !output_pattern)
+    return errx(1, "--output-pattern is required for more than one url");
+  if (nurls > 1 && output)
+    return errx(1, "--output cannot be combined with more than one url");
+  url = urls[0];
 
   /* Remove trailing semicolon or ampersand from variables */
   if ((n = tgen_buf_length(&variables)) &&
       strchr(";&", tgen_buf_get(&variables)[n-1]))
     tgen_buf_unappend(&variables, 1);
 
-  /* Load instance */
-  if (builtin) {
-    /* FIXME - this should be updated when default paths for entity lookup
-       has been implemented... */
-    if (!(inst = dlite_instance_get(url))) goto fail;
-    dlite_instance_incref(inst);
-  } else {
-    if (!(inst = dlite_instance_load_url(url))) goto fail;
-  }
-
   /* Get template file name */
   if (!template_file) {
     if (!(template_path = dlite_codegen_template_file(format))) goto fail;
@@ -157,24 +197,58 @@ int main(int argc, char *argv[])
   /* Load template */
   if (!(template = tgen_readfile(template_file))) goto fail;
 
-  /* Generate */
-  if (!(text = dlite_codegen(template, inst, tgen_buf_get(&variables))))
-    goto fail;
+  if (nurls > 1) {
+    /* Batch mode: load all instances and generate in parallel */
+    int nfailed;
+    if (!(insts = calloc(nurls, sizeof(DLiteInstance *))) ||
+        !(texts = calloc(nurls, sizeof(char *))))
+      FAIL("allocation failure");
+    for (i=0; i<nurls; i++)
+      if (!(insts[i] = load_instance(urls[i], builtin))) goto fail;
+    if ((nfailed = dlite_codegen_many(template, insts, nurls,
+                                      tgen_buf_get(&variables), texts,
+                                      jobs)) < 0)
+      goto fail;
+    for (i=0; i<nurls; i++) {
+      char *path;
+      if (!texts[i]) continue;
+      if (!(path = dlite_codegen(output_pattern, insts[i],
+                                 tgen_buf_get(&variables))))
+        goto fail;
+      if (write_output(path, texts[i])) {
+        free(path);
+        goto fail;
+      }
+      free(path);
+    }
+    if (nfailed) FAIL1("code generation failed for %d instance(s)", nfailed);
 
-  /* Write output */
-  if (output) {
-    FILE *fp = fopen(output, "wb");
-    if (!fp) FAIL1("cannot open \"%s\" for writing", output);
-    fwrite(text, 1, strlen(text), fp);
-    fclose(fp);
   } else {
-    fwrite(text, 1, strlen(text), stdout);
+    /* Load instance */
+    if (!(inst = load_instance(url, builtin))) goto fail;
+
+    /* Generate */
+    if (!(text = dlite_codegen(template, inst, tgen_buf_get(&variables))))
+      goto fail;
+
+    /* Write output */
+    if (write_output(output, text)) goto fail;
   }
 
   /* Cleanup */
   retval = 0;
  fail:
   if (inst) dlite_instance_decref(inst);
+  if (insts) {
+    for (i=0; i<nurls; i++)
+      if (insts[i]) dlite_instance_decref(insts[i]);
+    free(insts);
+  }
+  if (texts) {
+    for (i=0; i<nurls; i++)
+      if (texts[i]) free(texts[i]);
+    free(texts);
+  }
   tgen_buf_deinit(&variables);
   if (template_path) free(template_path);
   if (template) free(template);
@@ -0,0 +1,480 @@
+/* dlite-convert.c -- copies all instances from one storage to another */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "dlite-mapping.h"
+#include "utils/compat/getopt.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/thread.h"
+#include "utils/trace.h"
+
+/* A batch of instances passed between the stages */
+typedef struct {
+  size_t n;                 /* number of instances */
+  char *uuids;              /* n NUL-terminated uuids */
+  const char **ids;         /* pointers into `uuids` */
+  DLiteInstance **insts;    /* loaded (and mapped) instances */
+} Batch;
+
+/* A bounded queue of batches */
+typedef struct {
+  ThreadMutex mutex;
+  ThreadCond notempty;
+  ThreadCond notfull;
+  Batch **items;            /* ring buffer */
+  size_t size;              /* capacity */
+  size_t head;              /* index of first item */
+  size_t n;                 /* number of items */
+  int nproducers;           /* number of stage threads still pushing */
+} Queue;
+
+/* Settings and shared state of a conversion */
+typedef struct {
+  const char *input;        /* input url */
+  const char *output;       /* output url */
+  const char *metauri;      /* metadata to map to, or NULL */
+  Queue *toread;            /* batches of ids to load */
+  Queue *tomap;             /* loaded batches to map */
+  Queue *towrite;           /* batches to save */
+  FILE *checkpoint;         /* file with uuids of saved instances */
+  ThreadMutex mutex;        /* protects `checkpoint` and `nwritten` */
+  size_t nwritten;          /* number of saved instances */
+  int failed;               /* set if any stage failed */
+} Convert;
+
+
+void help()
+{
+  char **p, *msg[] = {
+    "Usage: dlite-convert [OPTIONS] INPUT OUTPUT",
+    "Copies all instances in the storage given by the url INPUT to the",
+    "storage given by the url OUTPUT.",
+    "  -b, --batch N       Number of instances loaded and saved in each",
+    "                      call to the storage plugins (default: 64).",
+    "  -c, --checkpoint FILE",
+    "                      Append the uuid of each saved instance to FILE.",
+    "                      Instances listed in FILE are skipped, such that",
+    "                      an interrupted conversion can be resumed.",
+    "  -h, --help          Prints this help and exit.",
+    "  -m, --meta URI      Map the instances to metadata URI before saving.",
+    "  -M, --mappers N     Number of mapper threads (default: 1).",
+    "  -p, --pattern GLOB  Only convert instances whose metadata URI",
+    "                      matches GLOB.",
+    "  -q, --queue N       Number of batches that may wait between each",
+    "                      stage (default: 4).",
+    "  -r, --readers N     Number of reader threads (default: 2).",
+    "  -w, --writers N     Number of writer threads (default: 1).",
+    "  -V, --version       Print dlite version number and exit.",
+    "",
+    "INPUT and OUTPUT are of the form driver://location?options.",
+    "",
+    "The conversion is a pipeline of reader, mapper and writer threads",
+    "connected by bounded queues.  Each reader and writer opens its own",
+    "connection to the storage.  More than one writer should therefore",
+    "only be used with drivers that support concurrent writers, like",
+    "database drivers.",
+    "",
+    "The checkpoint is written after each batch is saved.  Resuming is",
+    "hence only reliable for drivers that write instances when they are",
+    "saved and not when the storage is closed.  Remember to open OUTPUT",
+    "in append mode when resuming.",
+    "",
+    NULL
+  };
+  for (p=msg; *p; p++) printf("%s\n", *p);
+}
+
+
+/* Free's batch `b`. */
+static void batch_free(Batch *b)
+{
+  size_t i;
+  if (b->insts) {
+    for (i=0; i<b->n; i++)
+      if (b->insts[i]) dlite_instance_decref(b->insts[i]);
+    free(b->insts);
+  }
+  if (b->uuids) free(b->uuids);
+  if (b->ids) free(b->ids);
+  free(b);
+}
+
+
+/* Returns a new queue of capacity `size` fed by `nproducers` threads. */
+static Queue *queue_create(size_t size, int nproducers)
+{
+  Queue *q = calloc(1, sizeof(Queue));
+  if (!q || !(q->items = calloc(size, sizeof(Batch *)))) {
+    if (q) free(q);
+    return err(1, "allocation failure"), NULL;
+  }
+  thread_mutex_init(&q->mutex);
+  thread_cond_init(&q->notempty);
+  thread_cond_init(&q->notfull);
+  q->size = size;
+  q->nproducers = nproducers;
+  return q;
+}
+
+/* Free's queue `q` and all batches left in it. */
+static void queue_free(Queue *q)
+{
+  if (!q) return;
+  for (; q->n; q->n--, q->head = (q->head + 1) % q->size)
+    batch_free(q->items[q->head]);
+  thread_cond_destroy(&q->notfull);
+  thread_cond_destroy(&q->notempty);
+  thread_mutex_destroy(&q->mutex);
+  free(q->items);
+  free(q);
+}
+
+/* Adds batch `b` to `q`, waiting while it is full.  Returns non-zero
+   if the conversion failed, in which case `b` is free'ed. */
+static int queue_push(Convert *c, Queue *q, Batch *b)
+{
+  thread_mutex_lock(&q->mutex);
+  while (q->n == q->size && !thread_atomic_load(&c->failed))
+    thread_cond_wait(&q->notfull, &q->mutex);
+  if (thread_atomic_load(&c->failed)) {
+    thread_mutex_unlock(&q->mutex);
+    batch_free(b);
+    return 1;
+  }
+  q->items[(q->head + q->n++) % q->size] = b;
+  thread_cond_signal(&q->notempty);
+  thread_mutex_unlock(&q->mutex);
+  return 0;
+}
+
+/* Removes and returns the next batch from `q`, waiting while it is
+   empty.  Returns NULL when all producers are done and `q` is empty,
+   or if the conversion failed. */
+static Batch *queue_pop(Convert *c, Queue *q)
+{
+  Batch *b=NULL;
+  thread_mutex_lock(&q->mutex);
+  while (!q->n && q->nproducers && !thread_atomic_load(&c->failed))
+    thread_cond_wait(&q->notempty, &q->mutex);
+  if (q->n && !thread_atomic_load(&c->failed)) {
+    b = q->items[q->head];
+    q->head = (q->head + 1) % q->size;
+    q->n--;
+    thread_cond_signal(&q->notfull);
+  }
+  thread_mutex_unlock(&q->mutex);
+  return b;
+}
+
+/* Tells `q` that one of its producers is done. */
+static void queue_done(Queue *q)
+{
+  thread_mutex_lock(&q->mutex);
+  if (--q->nproducers == 0) thread_cond_broadcast(&q->notempty);
+  thread_mutex_unlock(&q->mutex);
+}
+
+/* Marks the conversion as failed and wakes up all waiting threads. */
+static void set_failed(Convert *c)
+{
+  Queue *queues[3];
+  int i;
+  thread_atomic_add(&c->failed, 1);
+  queues[0] = c->toread;
+  queues[1] = c->tomap;
+  queues[2] = c->towrite;
+  for (i=0; i<3; i++) {
+    if (!queues[i]) continue;
+    thread_mutex_lock(&queues[i]->mutex);
+    thread_cond_broadcast(&queues[i]->notempty);
+    thread_cond_broadcast(&queues[i]->notfull);
+    thread_mutex_unlock(&queues[i]->mutex);
+  }
+}
+
+
+/* Reader thread.  Loads batches of instances from the input. */
+static void *reader(void *arg)
+{
+  Convert *c = arg;
+  Queue *next = (c->tomap) ? c->tomap : c->towrite;
+  DLiteStorage *s;
+  Batch *b;
+  if (!(s = dlite_storage_open_url(c->input))) {
+    set_failed(c);
+  } else {
+    while ((b = queue_pop(c, c->toread))) {
+      if (!(b->insts = dlite_instance_load_many(s, b->ids, b->n))) {
+        batch_free(b);
+        set_failed(c);
+        break;
+      }
+      if (queue_push(c, next, b)) break;
+    }
+    dlite_storage_close(s);
+  }
+  queue_done(next);
+  return NULL;
+}
+
+/* Maps instances `b->insts[i:i+n]`, which all have the same metadata,
+   to `c->metauri`.  Returns non-zero on error. */
+static int map_run(Convert *c, Batch *b, size_t i, size_t n)
+{
+  const char *uri = b->insts[i]->meta->uri;
+  DLiteMapping *m;
+  DLiteInstance **out;
+  size_t j;
+  int retval=1;
+  if (!(m = dlite_mapping_create(c->metauri, &uri, 1))) return 1;
+  if (!(out = calloc(n, sizeof(DLiteInstance *)))) {
+    dlite_mapping_free(m);
+    return err(1, "allocation failure");
+  }
+  if (dlite_mapping_map_many(m, (const DLiteInstance **)b->insts + i, 1, n,
+                             out) == 0) {
+    for (j=0; j<n; j++) {
+      dlite_instance_decref(b->insts[i + j]);
+      b->insts[i + j] = out[j];
+    }
+    retval = 0;
+  }
+  free(out);
+  dlite_mapping_free(m);
+  return retval;
+}
+
+/* Mapper thread.  Maps the instances in each batch to `c->metauri`.
+   Metadata and instances already of `c->metauri` are passed through. */
+static void *mapper(void *arg)
+{
+  Convert *c = arg;
+  Batch *b;
+  size_t i, j;
+  while ((b = queue_pop(c, c->tomap))) {
+    for (i=0; i<b->n; i=j) {
+      DLiteInstance *inst = b->insts[i];
+      j = i + 1;
+      if (dlite_instance_is_meta(inst) ||
+          strcmp(inst->meta->uri, c->metauri) == 0) continue;
+      while (j < b->n && b->insts[j]->meta == inst->meta) j++;
+      if (map_run(c, b, i, j - i)) break;
+    }
+    if (i < b->n) {
+      batch_free(b);
+      set_failed(c);
+      break;
+    }
+    if (queue_push(c, c->towrite, b)) break;
+  }
+  queue_done(c->towrite);
+  return NULL;
+}
+
+/* Writer thread.  Saves batches of instances to the output. */
+static void *writer(void *arg)
+{
+  Convert *c = arg;
+  DLiteStorage *s;
+  Batch *b;
+  size_t i;
+  if (!(s = dlite_storage_open_url(c->output))) {
+    set_failed(c);
+    return NULL;
+  }
+  while ((b = queue_pop(c, c->towrite))) {
+    if (dlite_instance_save_many(s, (const DLiteInstance **)b->insts, b->n)) {
+      batch_free(b);
+      set_failed(c);
+      break;
+    }
+    thread_mutex_lock(&c->mutex);
+    c->nwritten += b->n;
+    if (c->checkpoint) {
+      for (i=0; i<b->n; i++) fprintf(c->checkpoint, "%s\n", b->ids[i]);
+      fflush(c->checkpoint);
+    }
+    thread_mutex_unlock(&c->mutex);
+    batch_free(b);
+  }
+  if (dlite_storage_close(s)) set_failed(c);
+  return NULL;
+}
+
+
+/* Returns a new batch with room for `n` uuids. */
+static Batch *batch_create(size_t n)
+{
+  Batch *b = calloc(1, sizeof(Batch));
+  if (!b || !(b->uuids = malloc(n * (DLITE_UUID_LENGTH + 1))) ||
+      !(b->ids = calloc(n, sizeof(char *)))) {
+    if (b) batch_free(b);
+    return err(1, "allocation failure"), NULL;
+  }
+  return b;
+}
+
+/* Reads the uuids in checkpoint file `filename` into `done`.  A
+   missing file is not an error.  Returns non-zero on error. */
+static int read_checkpoint(const char *filename, map_int_t *done)
+{
+  char buf[256];
+  FILE *fp = fopen(filename, "r");
+  if (!fp) return 0;
+  while (fgets(buf, sizeof(buf), fp)) {
+    buf[strcspn(buf, "\r\n")] = '\0';
+    if (*buf) map_set(done, buf, 1);
+  }
+  fclose(fp);
+  return 0;
+}
+
+/* Lists the uuids in the input and pushes them in batches of `nbatch`
+   to `c->toread`, skipping those in `done`.  Returns the number of
+   listed uuids or -1 on error. */
+static long list_ids(Convert *c, const char *pattern, size_t nbatch,
+                     map_int_t *done)
+{
+  DLiteStorage *s;
+  Batch *b=NULL;
+  char uuid[DLITE_UUID_LENGTH+1];
+  void *iter=NULL;
+  long n=0;
+  int stat;
+  if (!(s = dlite_storage_open_url(c->input))) return -1;
+  if (!(iter = dlite_storage_iter_create(s, pattern))) goto fail;
+  while ((stat = dlite_storage_iter_next(s, iter, uuid)) == 0) {
+    if (map_get(done, uuid)) continue;
+    if (!b && !(b = batch_create(nbatch))) goto fail;
+    b->ids[b->n] = strcpy(b->uuids + b->n * (DLITE_UUID_LENGTH + 1), uuid);
+    n++;
+    if (++b->n == nbatch) {
+      if (queue_push(c, c->toread, b)) goto fail;
+      b = NULL;
+    }
+  }
+  if (stat < 0) goto fail;
+  if (b && queue_push(c, c->toread, b)) goto fail;
+  b = NULL;
+  dlite_storage_iter_free(s, iter);
+  dlite_storage_close(s);
+  return n;
+ fail:
+  if (b) batch_free(b);
+  if (iter) dlite_storage_iter_free(s, iter);
+  dlite_storage_close(s);
+  return -1;
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *pattern=NULL, *checkpoint=NULL;
+  Convert conv;
+  Thread *threads=NULL;
+  map_int_t done;
+  int nreaders=2, nmappers=1, nwriters=1, nthreads=0, i;
+  size_t nbatch=64, nqueue=4;
+  uint64_t t0;
+  int retval=1;
+
+  err_set_prefix("dlite-convert");
+  memset(&conv, 0, sizeof(conv));
+
+  /* Parse options and arguments */
+  while (1) {
+    int longindex = 0;
+    struct option longopts[] = {
+      {"batch",         1, NULL, 'b'},
+      {"checkpoint",    1, NULL, 'c'},
+      {"help",          0, NULL, 'h'},
+      {"meta",          1, NULL, 'm'},
+      {"mappers",       1, NULL, 'M'},
+      {"pattern",       1, NULL, 'p'},
+      {"queue",         1, NULL, 'q'},
+      {"readers",       1, NULL, 'r'},
+      {"writers",       1, NULL, 'w'},
+      {"version",       0, NULL, 'V'},
+      {NULL, 0, NULL, 0}
+    };
+    int c = getopt_long(argc, argv, "b:c:hm:M:p:q:r:w:V", longopts,
+                        &longindex);
+    if (c == -1) break;
+    switch (c) {
+    case 'b':  nbatch = strtoul(optarg, NULL, 10); break;
+    case 'c':  checkpoint = optarg; break;
+    case 'h':  help(); exit(0);
+    case 'm':  conv.metauri = optarg; break;
+    case 'M':  nmappers = atoi(optarg); break;
+    case 'p':  pattern = optarg; break;
+    case 'q':  nqueue = strtoul(optarg, NULL, 10); break;
+    case 'r':  nreaders = atoi(optarg); break;
+    case 'w':  nwriters = atoi(optarg); break;
+    case 'V':  printf("%s\n", dlite_VERSION); exit(0);
+    case '?':  exit(1);
+    default:   abort();
+    }
+  }
+  if (optind + 2 != argc) return err(1, "expects two arguments: INPUT OUTPUT");
+  if (nbatch < 1 || nqueue < 1 || nreaders < 1 || nmappers < 1 ||
+      nwriters < 1)
+    return err(1, "batch, queue and thread numbers must be positive");
+  conv.input = argv[optind];
+  conv.output = argv[optind + 1];
+  if (!conv.metauri) nmappers = 0;
+
+  map_init(&done);
+  thread_mutex_init(&conv.mutex);
+  if (checkpoint) {
+    if (read_checkpoint(checkpoint, &done)) goto fail;
+    if (!(conv.checkpoint = fopen(checkpoint, "a")))
+      FAIL1("cannot open checkpoint file: %s", checkpoint);
+  }
+  if (!(conv.toread = queue_create(nqueue, 1))) goto fail;
+  if (nmappers && !(conv.tomap = queue_create(nqueue, nreaders))) goto fail;
+  if (!(conv.towrite = queue_create(nqueue, (nmappers) ? nmappers : nreaders)))
+    goto fail;
+  if (!(threads = calloc(nreaders + nmappers + nwriters, sizeof(Thread))))
+    FAIL("allocation failure");
+
+  /* Start the pipeline and feed it from this thread */
+  t0 = trace_now();
+  for (i=0; i<nwriters; i++)
+    if (thread_create(threads + nthreads++, writer, &conv)) goto fail;
+  for (i=0; i<nmappers; i++)
+    if (thread_create(threads + nthreads++, mapper, &conv)) goto fail;
+  for (i=0; i<nreaders; i++)
+    if (thread_create(threads + nthreads++, reader, &conv)) goto fail;
+  if (list_ids(&conv, pattern, nbatch, &done) < 0) set_failed(&conv);
+  queue_done(conv.toread);
+  for (i=0; i<nthreads; i++) thread_join(threads[i], NULL);
+  nthreads = 0;
+  if (conv.failed) goto fail;
+
+  printf("Converted %lu instances in %.3f s", (unsigned long)conv.nwritten,
+         (trace_now() - t0) * 1e-9);
+  if (done.base.nnodes)
+    printf(" (%lu skipped from checkpoint)", (unsigned long)done.base.nnodes);
+  printf("\n");
+  retval = 0;
+ fail:
+  if (nthreads) {
+    set_failed(&conv);
+    queue_done(conv.toread);
+    for (i=0; i<nthreads; i++) thread_join(threads[i], NULL);
+  }
+  if (threads) free(threads);
+  queue_free(conv.toread);
+  queue_free(conv.tomap);
+  queue_free(conv.towrite);
+  if (conv.checkpoint) fclose(conv.checkpoint);
+  thread_mutex_destroy(&conv.mutex);
+  map_deinit(&done);
+  return retval;
+}
@@ -36,6 +36,9 @@ void help()
     "                      Set environment variables according to this ",
     "                      platform.  PLATFORM should be either \"Unix\" or ",
     "                      \"Windows\".  Defaults to the host platform.",
+    "  -s, --stats FILE    Let COMMAND write dlite runtime statistics to",
+    "                      FILE at exit.  Use \"-\" or \"stderr\" to write",
+    "                      to standard output or standard error.",
     "  -v  --variable NAME=VALUE",
     "                      Add NAME-VALUE pair to environment.",
     "  -V, --version       Print dlite version number and exit.",
@@ -95,6 +98,7 @@ int main(int argc, char *argv[])
   /* Command line arguments */
   int with_build=0, with_env=1, with_install=1, print=0;
   char **args=NULL, **env=NULL, **vars=NULL;
+  const char *stats=NULL;
 
   err_set_prefix("dlite-env");
 
@@ -108,11 +112,12 @@ int main(int argc, char *argv[])
       {"no-install",    0, NULL, 'i'},
       {"print",         0, NULL, 'p'},
       {"platform",      1, NULL, 'P'},
+      {"stats",         1, NULL, 's'},
       {"variable",      1, NULL, 'v'},
       {"version",       0, NULL, 'V'},
       {NULL, 0, NULL, 0}
     };
-    int c = getopt_long(argc, argv, "behipP:v:V", longopts, &longindex);
+    int c = getopt_long(argc, argv, "behipP:s:v:V", longopts, &longindex);
     if (c == -1) break;
     switch (c) {
     case 'b':  with_build=1; with_install=0; break;
@@ -121,6 +126,7 @@ int main(int argc, char *argv[])
     case 'i':  with_install = 0; break;
     case 'p':  print = 1; break;
     case 'P':  set_platform(optarg); break;
+    case 's':  stats = optarg; break;
     case 'v':  vars = strlist_add(vars, optarg); break;
     case 'V':  printf("%s\n", dlite_VERSION); exit(0);
     case '?':  exit(1);
@@ -173,6 +179,10 @@ int main(int argc, char *argv[])
     env = add_paths(env, "DLITE_STORAGES",
                     dlite_STORAGES, Replace);
   }
+  if (stats) {
+    /* -- write statistics at exit */
+    env = set_envvar(env, "DLITE_STATS", stats);
+  }
   if (vars) {
     /* -- add additional variables from command line */
     for (q=vars; *q; q++)
@@ -0,0 +1,100 @@
+/* dlite-index.c -- build index of instances in the dlite storage paths */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "dlite.h"
+#include "utils/compat/getopt.h"
+#include "utils/err.h"
+
+
+void help()
+{
+  char **p, *msg[] = {
+    "Usage: dlite-index [OPTIONS]",
+    "Builds an index of all instances in the dlite storage paths.",
+    "  -b, --bloom         Also write a Bloom filter sidecar next to each",
+    "                      indexed storage file.",
+    "  -h, --help          Prints this help and exit.",
+    "  -m, --meta-cache FILE",
+    "                      Also write a binary cache of all metadata to",
+    "                      FILE.  A FILE of the form shm:NAME publishes",
+    "                      the cache to the shared memory segment NAME.",
+    "  -o, --output FILE   Write the index to FILE.  Defaults to the value",
+    "                      of the DLITE_STORAGE_INDEX environment variable.",
+    "  -s, --storage URL   Append URL to the storage paths.  May be given",
+    "                      multiple times.",
+    "  -V, --version       Print dlite version number and exit.",
+    "",
+    "The storage paths are initialised from the DLITE_STORAGES environment",
+    "variable.  If DLITE_STORAGE_INDEX refers to the written file, the",
+    "index will be used by dlite_instance_get() to look up instances",
+    "without opening all storages.  Likewise, if DLITE_META_CACHE refers",
+    "to the metadata cache, metadata will be looked up in it without",
+    "parsing the storages.  The Bloom filter sidecars let",
+    "dlite_instance_get() skip storage files without an index.",
+    "",
+    NULL
+  };
+  for (p=msg; *p; p++) printf("%s\n", *p);
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *output = getenv("DLITE_STORAGE_INDEX");
+  const char *metacache = NULL;
+  int bloom = 0;
+
+  err_set_prefix("dlite-index");
+
+  /* Parse options and arguments */
+  while (1) {
+    int longindex = 0;
+    struct option longopts[] = {
+      {"bloom",         0, NULL, 'b'},
+      {"help",          0, NULL, 'h'},
+      {"meta-cache",    1, NULL, 'm'},
+      {"output",        1, NULL, 'o'},
+      {"storage",       1, NULL, 's'},
+      {"version",       0, NULL, 'V'},
+      {NULL, 0, NULL, 0}
+    };
+    int c = getopt_long(argc, argv, "bhm:o:s:V", longopts, &longindex);
+    if (c == -1) break;
+    switch (c) {
+    case 'b':  bloom = 1; break;
+    case 'h':  help(); exit(0);
+    case 'm':  metacache = optarg; break;
+    case 'o':  output = optarg; break;
+    case 's':  dlite_storage_paths_append(optarg); break;
+    case 'V':  printf("%s\n", dlite_VERSION); exit(0);
+    case '?':  exit(1);
+    default:   abort();
+    }
+  }
+  if (optind < argc) return err(1, "too many arguments");
+  if ((!output || !*output) && (!metacache || !*metacache) && !bloom)
+    return err(1, "no output file.  Use the --output option or set "
+               "DLITE_STORAGE_INDEX");
+
+  if (output && *output) {
+    if (dlite_storage_index_update()) return 1;
+    if (dlite_storage_index_save(output)) return 1;
+    printf("Indexed %lu instances\n",
+           (unsigned long)dlite_storage_index_count());
+  }
+  if (bloom) {
+    int n;
+    if (!(output && *output) && dlite_storage_index_update()) return 1;
+    if ((n = dlite_storage_index_write_bloom()) < 0) return 1;
+    printf("Wrote %d Bloom filter sidecars\n", n);
+  }
+  if (metacache && *metacache) {
+    if (dlite_metacache_update(metacache)) return 1;
+    printf("Wrote metadata cache to %s\n", metacache);
+  }
+  return 0;
+}
@@ -0,0 +1,483 @@
+/* dlite-replay.c -- replays a recorded storage access trace */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "utils/compat/getopt.h"
+#include "utils/err.h"
+#include "utils/map.h"
+#include "utils/strutils.h"
+#include "utils/trace.h"
+
+/* Operations in the order they are reported */
+static const char ops[] = "OLSPC";
+#define NOPS 5
+
+/* A recorded event */
+typedef struct {
+  char op;                  /* one of `ops` */
+  int storage;              /* storage number in the trace */
+  double dt;                /* recorded duration in seconds */
+  size_t nbytes;            /* number of bytes */
+  char *id;                 /* instance id, NULL for open and close */
+  char *property;           /* property name, for get property */
+  char mode;                /* recorded mode for open, or zero */
+} Event;
+
+/* A recorded storage */
+typedef struct {
+  char *driver;
+  char *location;
+  char *options;
+} Source;
+
+/* Durations and bytes of one operation */
+typedef struct {
+  size_t n;                 /* number of durations */
+  size_t size;              /* allocated length of `dt` */
+  double *dt;               /* durations in seconds */
+  double nbytes;            /* total number of bytes */
+} Timings;
+
+
+void help()
+{
+  char **p, *msg[] = {
+    "Usage: dlite-replay [OPTIONS] TRACE URL",
+    "Replays the storage accesses recorded in TRACE against the storage",
+    "given by URL and reports throughput and latency percentiles.",
+    "  -h, --help          Prints this help and exit.",
+    "  -n, --no-populate   Do not copy the loaded instances to the storage",
+    "                      before replaying.  The storage must already",
+    "                      contain them.",
+    "  -V, --version       Print dlite version number and exit.",
+    "",
+    "TRACE is a trace recorded by setting the DLITE_RECORD environment",
+    "variable.  URL is of the form driver://location?options.  All",
+    "recorded storages are replayed against this storage, opened with",
+    "the recorded mode.  The options in URL should therefore not",
+    "include a mode.",
+    "",
+    "Before replaying, all instances that are loaded or saved in the",
+    "trace are loaded from the recorded storages and saved to URL.",
+    "Property reads are replayed by reading the property of an instance",
+    "loaded with dlite_instance_load_lazy().  Timings are reported both",
+    "for the recording and the replay.",
+    "",
+    NULL
+  };
+  for (p=msg; *p; p++) printf("%s\n", *p);
+}
+
+
+/* Reads a line of any length from `fp` into `*buf` of size `*size`,
+   which is reallocated as needed.  The newline is stripped.  Returns
+   non-zero at end of file or on error. */
+static int readline(FILE *fp, char **buf, size_t *size)
+{
+  size_t n=0;
+  while (1) {
+    if (*size - n < 2) {
+      char *p = realloc(*buf, *size + 1024);
+      if (!p) return err(1, "allocation failure");
+      *buf = p;
+      *size += 1024;
+    }
+    if (!fgets(*buf + n, (int)(*size - n), fp)) return (n) ? 0 : 1;
+    n += strlen(*buf + n);
+    if (n && (*buf)[n-1] == '\n') {
+      (*buf)[--n] = '\0';
+      if (n && (*buf)[n-1] == '\r') (*buf)[--n] = '\0';
+      return 0;
+    }
+  }
+}
+
+/* Splits `line` into at most `max` tab-separated fields.  Returns the
+   number of fields. */
+static int split(char *line, char **fields, int max)
+{
+  int n=0;
+  char *p = line;
+  while (n < max) {
+    fields[n++] = p;
+    if (!(p = strchr(p, '\t'))) break;
+    *p++ = '\0';
+  }
+  return n;
+}
+
+/* Returns a copy of `s`, or NULL if it is empty. */
+static char *field_dup(const char *s)
+{
+  char *copy;
+  if (!s || !*s) return NULL;
+  if (!(copy = strdup(s))) err(1, "allocation failure");
+  return copy;
+}
+
+/* Reads the trace `filename`.  Returns the events and assigns `*n` to
+   their number.  The recorded storages are stored in `*sources` and
+   their number in `*nsources`.  Returns NULL on error. */
+static Event *read_trace(const char *filename, size_t *n, Source **sources,
+                         int *nsources)
+{
+  FILE *fp;
+  Event *events=NULL;
+  char *line=NULL, *f[7], *p;
+  size_t size=0, len=0;
+  int nf, lineno=1, ok=0;
+
+  *n = 0;
+  *sources = NULL;
+  *nsources = 0;
+  if (!(fp = fopen(filename, "r")))
+    return err(1, "cannot open trace: %s", filename), NULL;
+  if (readline(fp, &line, &size) || strcmp(line, "#dlite-record 1")) {
+    errx(1, "not a dlite storage access trace: %s", filename);
+    goto fail;
+  }
+  while (!readline(fp, &line, &size)) {
+    Event *e;
+    lineno++;
+    if (!*line || *line == '#') continue;
+    nf = split(line, f, 7);
+    if (nf < 4 || strlen(f[0]) != 1 || !strchr(ops, f[0][0]) ||
+        atoi(f[1]) <= 0 ||
+        (f[0][0] == 'O' && nf < 7) ||
+        (strchr("LS", f[0][0]) && nf < 6) ||
+        (f[0][0] == 'P' && nf < 7)) {
+      errx(1, "%s:%d: invalid event", filename, lineno);
+      goto fail;
+    }
+    if (*n >= len) {
+      void *p = realloc(events, (len + 1024)*sizeof(Event));
+      if (!p) {
+        err(1, "allocation failure");
+        goto fail;
+      }
+      events = p;
+      len += 1024;
+    }
+    e = events + (*n)++;
+    memset(e, 0, sizeof(Event));
+    e->op = f[0][0];
+    e->storage = atoi(f[1]);
+    e->dt = strtod(f[3], NULL) * 1e-9;
+    if (e->op == 'O') {
+      if (e->storage > *nsources) {
+        void *p = realloc(*sources, e->storage*sizeof(Source));
+        if (!p) {
+          err(1, "allocation failure");
+          goto fail;
+        }
+        *sources = p;
+        memset(*sources + *nsources, 0,
+               (e->storage - *nsources)*sizeof(Source));
+        *nsources = e->storage;
+      }
+      (*sources)[e->storage-1].driver = field_dup(f[4]);
+      (*sources)[e->storage-1].location = field_dup(f[5]);
+      (*sources)[e->storage-1].options = field_dup(f[6]);
+      if ((p = strstr(f[6], "mode=")) && (p == f[6] || strchr(";&", p[-1])))
+        e->mode = p[5];
+    } else if (e->op != 'C') {
+      e->nbytes = strtoul(f[4], NULL, 10);
+      e->id = field_dup(f[5]);
+      if (e->op == 'P') e->property = field_dup(f[6]);
+    }
+  }
+  ok = 1;
+ fail:
+  fclose(fp);
+  if (line) free(line);
+  if (!ok && events) {
+    free(events);
+    events = NULL;
+  }
+  return events;
+}
+
+/* Adds duration `dt` and `nbytes` bytes to `t`. */
+static void add_timing(Timings *t, double dt, size_t nbytes)
+{
+  if (t->n >= t->size) {
+    void *p = realloc(t->dt, (t->size + 1024)*sizeof(double));
+    if (!p) {
+      err(1, "allocation failure");
+      return;
+    }
+    t->dt = p;
+    t->size += 1024;
+  }
+  t->dt[t->n++] = dt;
+  t->nbytes += nbytes;
+}
+
+/* Compares doubles, for qsort() */
+static int dblcmp(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Returns the `q` quantile of the `n` sorted durations `dt`. */
+static double quantile(const double *dt, size_t n, double q)
+{
+  return dt[(size_t)(q*(n - 1) + 0.5)];
+}
+
+/* Prints a row of the report for operation `op` with timings `t`. */
+static void print_row(char op, const char *label, Timings *t)
+{
+  const char *names[] = {"open", "load", "save", "getprop", "close"};
+  double total=0.0;
+  size_t i;
+  if (!t->n) return;
+  qsort(t->dt, t->n, sizeof(double), dblcmp);
+  for (i=0; i<t->n; i++) total += t->dt[i];
+  printf("%-8s %-9s %7lu %11.3f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+         names[strchr(ops, op) - ops], label, (unsigned long)t->n,
+         t->nbytes / 1e6, (total > 0) ? t->nbytes / 1e6 / total : 0.0,
+         quantile(t->dt, t->n, 0.5) * 1e6, quantile(t->dt, t->n, 0.9) * 1e6,
+         quantile(t->dt, t->n, 0.99) * 1e6, t->dt[t->n-1] * 1e6);
+}
+
+/* Opens the storage given by `url` with mode `mode`, or the default
+   mode of the driver if `mode` is zero.  Returns NULL on error. */
+static DLiteStorage *open_target(const char *url, char mode)
+{
+  char *driver=NULL, *location=NULL, *options=NULL, *p, *opts=NULL;
+  char *url2 = strdup(url);
+  DLiteStorage *s=NULL;
+  if (!url2) return err(1, "allocation failure"), NULL;
+  if (dlite_split_url(url2, &driver, &location, &options, NULL)) goto fail;
+  if (!driver && (p = strrchr(location, '.'))) driver = p+1;
+  if (!driver) FAIL1("missing driver: %s", url);
+  if (mode && !(opts = aprintf("%s%smode=%c", (options) ? options : "",
+                               (options && *options) ? ";" : "", mode)))
+    FAIL("allocation failure");
+  s = dlite_storage_open(driver, location, (opts) ? opts : options);
+ fail:
+  if (opts) free(opts);
+  free(url2);
+  return s;
+}
+
+/* Copies the instances loaded or saved in the trace from the
+   recorded storages to `url`.  Instances that are saved are also
+   kept as JSON in `saved`.  Returns non-zero on error. */
+static int populate(const char *url, const Event *events, size_t n,
+                    const Source *sources, int nsources, map_str_t *saved)
+{
+  DLiteStorage **src, *dst=NULL;
+  map_int_t copied, savedids;
+  size_t i;
+  int retval=1;
+
+  map_init(&copied);
+  map_init(&savedids);
+  for (i=0; i<n; i++)
+    if (events[i].op == 'S') map_set(&savedids, events[i].id, 1);
+  if (!(src = calloc(nsources + 1, sizeof(DLiteStorage *))))
+    return err(1, "allocation failure");
+  if (!(dst = open_target(url, 'w'))) goto fail;
+  for (i=0; i<n; i++) {
+    const Event *e = events + i;
+    const Source *so;
+    DLiteInstance *inst;
+    if (!e->id || map_get(&copied, e->id)) continue;
+    if (e->storage > nsources || !sources[e->storage-1].driver)
+      FAIL1("no recorded storage for %s", e->id);
+    so = sources + e->storage - 1;
+    if (!src[e->storage] &&
+        !(src[e->storage] = dlite_storage_open(so->driver, so->location,
+                                               "mode=r")))
+      goto fail;
+    if (!(inst = dlite_instance_load(src[e->storage], e->id))) goto fail;
+    if (dlite_instance_save(dst, inst) == 0 && map_get(&savedids, e->id)) {
+      char *json = dlite_json_aprint(inst, 0, 0);
+      if (json) map_set(saved, e->id, json);
+    }
+    dlite_instance_decref(inst);
+    map_set(&copied, e->id, 1);
+  }
+  retval = 0;
+ fail:
+  for (i=0; i <= (size_t)nsources; i++)
+    if (src[i]) dlite_storage_close(src[i]);
+  free(src);
+  if (dst && dlite_storage_close(dst)) retval = 1;
+  map_deinit(&copied);
+  map_deinit(&savedids);
+  return retval;
+}
+
+/* Replays `events` against `url` and adds the timings of each
+   operation to `timings`.  Returns non-zero on error. */
+static int replay(const char *url, const Event *events, size_t n,
+                  int nsources, int populated, map_str_t *saved, Timings *timings)
+{
+  DLiteStorage **storages;
+  DLiteInstance *lazy=NULL;
+  const char *lazyid=NULL;
+  size_t i;
+  int retval=1;
+
+  if (!(storages = calloc(nsources + 1, sizeof(DLiteStorage *))))
+    return err(1, "allocation failure");
+  for (i=0; i<n; i++) {
+    const Event *e = events + i;
+    DLiteStorage *s;
+    DLiteInstance *inst=NULL;
+    Timings *t = timings + (strchr(ops, e->op) - ops);
+    char **json, mode;
+    uint64_t t0;
+
+    if (e->storage > nsources) FAIL1("storage %d is not opened", e->storage);
+    s = storages[e->storage];
+    if (lazy && (e->op != 'P' || strcmp(e->id, lazyid))) {
+      dlite_instance_decref(lazy);
+      lazy = NULL;
+    }
+    if (e->op != 'O' && !s) continue;  /* opened before recording */
+
+    switch (e->op) {
+    case 'O':
+      t0 = trace_now();
+      /* Append instead of truncating the storage that was populated */
+      mode = (e->mode == 'w' && populated) ? 'a' : e->mode;
+      if (!(storages[e->storage] = open_target(url, mode))) goto fail;
+      add_timing(t, (trace_now() - t0) * 1e-9, 0);
+      break;
+    case 'C':
+      t0 = trace_now();
+      if (dlite_storage_close(s)) goto fail;
+      add_timing(t, (trace_now() - t0) * 1e-9, 0);
+      storages[e->storage] = NULL;
+      break;
+    case 'L':
+      t0 = trace_now();
+      if (!(inst = dlite_instance_load(s, e->id))) goto fail;
+      add_timing(t, (trace_now() - t0) * 1e-9, e->nbytes);
+      dlite_instance_decref(inst);
+      break;
+    case 'S':
+      if (!(json = map_get(saved, e->id)))
+        FAIL1("no copy of saved instance %s", e->id);
+      if ((inst = dlite_instance_has(e->id, 0)))  /* e.g. metadata */
+        dlite_instance_incref(inst);
+      else if (!(inst = dlite_json_sscan(*json, NULL, NULL)))
+        goto fail;
+      t0 = trace_now();
+      if (dlite_instance_save(s, inst)) {
+        dlite_instance_decref(inst);
+        goto fail;
+      }
+      add_timing(t, (trace_now() - t0) * 1e-9, e->nbytes);
+      dlite_instance_decref(inst);
+      break;
+    case 'P':
+      if (!lazy && !(lazy = dlite_instance_load_lazy(s, e->id))) goto fail;
+      lazyid = e->id;
+      t0 = trace_now();
+      if (!dlite_instance_get_property(lazy, e->property)) goto fail;
+      add_timing(t, (trace_now() - t0) * 1e-9, e->nbytes);
+      break;
+    }
+  }
+  retval = 0;
+ fail:
+  if (lazy) dlite_instance_decref(lazy);
+  for (i=0; i <= (size_t)nsources; i++)
+    if (storages[i]) dlite_storage_close(storages[i]);
+  free(storages);
+  return retval;
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *trace, *url;
+  Event *events;
+  Source *sources;
+  Timings recorded[NOPS], replayed[NOPS];
+  map_str_t saved;
+  map_iter_t iter;
+  const char *key;
+  size_t i, n;
+  int nsources, nopopulate=0, retval=1;
+
+  err_set_prefix("dlite-replay");
+
+  /* Parse options and arguments */
+  while (1) {
+    int longindex = 0;
+    struct option longopts[] = {
+      {"help",          0, NULL, 'h'},
+      {"no-populate",   0, NULL, 'n'},
+      {"version",       0, NULL, 'V'},
+      {NULL, 0, NULL, 0}
+    };
+    int c = getopt_long(argc, argv, "hnV", longopts, &longindex);
+    if (c == -1) break;
+    switch (c) {
+    case 'h':  help(); exit(0);
+    case 'n':  nopopulate = 1; break;
+    case 'V':  printf("%s\n", dlite_VERSION); exit(0);
+    case '?':  exit(1);
+    default:   abort();
+    }
+  }
+  if (optind + 2 != argc) return err(1, "expects two arguments: TRACE URL");
+  trace = argv[optind];
+  url = argv[optind + 1];
+
+  /* A recording of the replay is not a recording of the workload */
+  if (dlite_record_enabled()) dlite_record_stop();
+
+  if (!(events = read_trace(trace, &n, &sources, &nsources))) return 1;
+  memset(recorded, 0, sizeof(recorded));
+  memset(replayed, 0, sizeof(replayed));
+  map_init(&saved);
+  for (i=0; i<n; i++)
+    add_timing(recorded + (strchr(ops, events[i].op) - ops), events[i].dt,
+               events[i].nbytes);
+
+  if (!nopopulate &&
+      populate(url, events, n, sources, nsources, &saved)) goto fail;
+  if (replay(url, events, n, nsources, !nopopulate, &saved, replayed))
+    goto fail;
+
+  printf("%-8s %-9s %7s %11s %10s %10s %10s %10s %10s\n", "op", "run",
+         "count", "MB", "MB/s", "p50 us", "p90 us", "p99 us", "max us");
+  for (i=0; i<NOPS; i++) {
+    print_row(ops[i], "recorded", recorded + i);
+    print_row(ops[i], "replayed", replayed + i);
+  }
+  retval = 0;
+ fail:
+  for (i=0; i<n; i++) {
+    if (events[i].id) free(events[i].id);
+    if (events[i].property) free(events[i].property);
+  }
+  free(events);
+  for (i=0; i<(size_t)nsources; i++) {
+    if (sources[i].driver) free(sources[i].driver);
+    if (sources[i].location) free(sources[i].location);
+    if (sources[i].options) free(sources[i].options);
+  }
+  if (sources) free(sources);
+  for (i=0; i<NOPS; i++) {
+    if (recorded[i].dt) free(recorded[i].dt);
+    if (replayed[i].dt) free(replayed[i].dt);
+  }
+  iter = map_iter(&saved);
+  while ((key = map_next(&saved, &iter))) free(*map_get(&saved, key));
+  map_deinit(&saved);
+  return retval;
+}
@@ -0,0 +1,118 @@
+/* dlite-server.c -- serve instances to the remote storage plugin */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+
+#include "config.h"
+
+#include "dlite.h"
+#include "utils/compat/getopt.h"
+#include "utils/err.h"
+#include "remote-protocol.h"
+#include "remote-server.h"
+
+
+static RemoteServer *server = NULL;
+
+void help()
+{
+  char **p, *msg[] = {
+    "Usage: dlite-server [OPTIONS]",
+    "Serves instances to clients using the remote storage plugin.",
+    "  -c, --cache SIZE    Max size of cached records when a backend",
+    "                      storage is given.  SIZE may have a K, M or G",
+    "                      suffix.  Defaults to 256M.",
+    "  -h, --help          Prints this help and exit.",
+    "  -H, --host HOST     Interface to listen on.  Defaults to 127.0.0.1.",
+    "                      Use \"*\" for all interfaces.",
+    "  -p, --port PORT     Port to listen on.  Defaults to " REMOTE_DEFAULT_PORT
+    ".",
+    "  -s, --storage URL   Backend storage that cache misses are loaded from",
+    "                      and saved instances are written through to.",
+    "  -V, --version       Print dlite version number and exit.",
+    "",
+    "Without a backend storage, all instances are kept in memory until the",
+    "server exits.  Metadata of instances written to a backend storage must",
+    "be available to the server, e.g. via the DLITE_STORAGES environment",
+    "variable.  Clients connect with the url remote://HOST:PORT.",
+    "",
+    NULL
+  };
+  for (p=msg; *p; p++) printf("%s\n", *p);
+}
+
+/* Returns the number of bytes in `s`, which may have a K, M or G
+   suffix, or zero on error. */
+static size_t parse_size(const char *s)
+{
+  char *endptr;
+  double v = strtod(s, &endptr);
+  switch (*endptr) {
+  case 'k': case 'K':  v *= 1024; endptr++; break;
+  case 'm': case 'M':  v *= 1024*1024; endptr++; break;
+  case 'g': case 'G':  v *= 1024*1024*1024; endptr++; break;
+  }
+  if (endptr == s || *endptr || v < 1) return 0;
+  return (size_t)v;
+}
+
+static void on_signal(int sig)
+{
+  (void)sig;
+  if (server) remote_server_stop(server);
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *host = "127.0.0.1";
+  const char *port = REMOTE_DEFAULT_PORT;
+  const char *storage = NULL;
+  size_t cachesize = 0;
+  int stat;
+
+  err_set_prefix("dlite-server");
+
+  /* Parse options and arguments */
+  while (1) {
+    int longindex = 0;
+    struct option longopts[] = {
+      {"cache",         1, NULL, 'c'},
+      {"help",          0, NULL, 'h'},
+      {"host",          1, NULL, 'H'},
+      {"port",          1, NULL, 'p'},
+      {"storage",       1, NULL, 's'},
+      {"version",       0, NULL, 'V'},
+      {NULL, 0, NULL, 0}
+    };
+    int c = getopt_long(argc, argv, "c:hH:p:s:V", longopts, &longindex);
+    if (c == -1) break;
+    switch (c) {
+    case 'c':
+      if (!(cachesize = parse_size(optarg)))
+        return err(1, "invalid cache size: %s", optarg);
+      break;
+    case 'h':  help(); exit(0);
+    case 'H':  host = (strcmp(optarg, "*") == 0) ? NULL : optarg; break;
+    case 'p':  port = optarg; break;
+    case 's':  storage = optarg; break;
+    case 'V':  printf("%s\n", dlite_VERSION); exit(0);
+    case '?':  exit(1);
+    default:   abort();
+    }
+  }
+  if (optind < argc) return err(1, "too many arguments");
+
+  if (!(server = remote_server_create(host, port, storage, cachesize)))
+    return 1;
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  printf("Listening on %s:%d\n", (host) ? host : "*",
+         remote_server_port(server));
+  fflush(stdout);
+
+  stat = remote_server_run(server);
+  if (remote_server_free(server)) stat = 1;
+  return stat;
+}
@@ -15,6 +15,7 @@ int main()
   char *phases[] = {"FCC_A1", "MG2SI", "ALFESI_ALPHA"};
   size_t i, j;
   double tmp, atvol0;
+  size_t dimoffset, reloffset, propdimsoffset, propoffsets[8];
 
   size_t dims[] = {nelements, nphases};
   char *path = STRINGIFY(DLITE_ROOT) "/tools/tests/Chemistry-0.1.json";
@@ -28,6 +29,18 @@ int main()
     dlite_meta_load(s, "http://sintef.no/calm/0.1/Chemistry");
   dlite_storage_close(s);
 
+  /* The compile-time layout must agree with the one computed by
+     dlite_meta_init() */
+  dimoffset = chem->_dimoffset;
+  reloffset = chem->_reloffset;
+  propdimsoffset = chem->_propdimsoffset;
+  memcpy(propoffsets, chem->_propoffsets, sizeof(propoffsets));
+  if (Chemistry_meta_init_fast(chem)) return 1;
+  if (chem->_dimoffset != dimoffset) return 1;
+  if (chem->_reloffset != reloffset) return 1;
+  if (chem->_propdimsoffset != propdimsoffset) return 1;
+  if (memcmp(chem->_propoffsets, propoffsets, sizeof(propoffsets))) return 1;
+
   /* Create instance */
   p = (Chemistry *)dlite_instance_create(chem, dims, "example-6xxx");
 
@@ -78,11 +91,18 @@ int main()
       p->Xp[i] -= atvol0/p->atvol[j] * p->volfrac[j] * p->Xp[j*nelements + i];
 
 
+  /* Typed accessors */
+  if (Chemistry_nelem_Xp(p) != nelements*nphases) return 1;
+  if (Chemistry_get_Xp(p, 2, 1) != p->Xp[2*nelements + 1]) return 1;
+  Chemistry_set_Xp(p, 2, 3, 0.25);
+  if (p->Xp[2*nelements + 3] != 0.25) return 1;
+  if (strcmp(Chemistry_get_phases(p, 1), "MG2SI")) return 1;
+
   dlite_instance_debug((DLiteInstance *)p->meta);
 
   /* Save instance */
   s = dlite_storage_open("json", "example-6xxx.json", "mode=w");
-  dlite_instance_save(s, (DLiteInstance *)p);
+  Chemistry_save(s, p);
   dlite_storage_close(s);
 
   /* Free instance and its entity */
@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "dlite.h"
+#include "dlite-macros.h"
+#include "particle_soa.h"
+
+#ifdef _MSC_VER
+# pragma warning(disable: 4996)
+#endif
+
+#define N 1000
+
+int main()
+{
+  char *path = STRINGIFY(DLITE_ROOT) "/tools/tests/Particle-0.1.json";
+  char *ids[] = {"p1", "p2", "p3"};
+  char *phases[] = {"FCC_A1", "MG2SI", "BETA"};
+  DLiteStorage *s;
+  DLiteMeta *meta;
+  DLiteInstance *insts[3], **copies;
+  ParticleSoA soa, soa2;
+  double sum=0.0;
+  size_t i;
+  int32_t count;
+
+  /* Load Particle entity */
+  s = dlite_storage_open("json", path, "mode=r");
+  meta = dlite_meta_load(s, PARTICLE_URI);
+  dlite_storage_close(s);
+  if (!meta) return 1;
+
+  for (i=0; i<3; i++) {
+    double radius = 1e-9 * (i + 1);
+    count = 10 * (int32_t)i;
+    insts[i] = dlite_instance_create(meta, NULL, NULL);
+    dlite_instance_set_property(insts[i], "id", &ids[i]);
+    dlite_instance_set_property(insts[i], "phase", phases[i]);
+    dlite_instance_set_property(insts[i], "radius", &radius);
+    dlite_instance_set_property(insts[i], "count", &count);
+  }
+
+  /* Fill the container */
+  ParticleSoA_init(&soa);
+  for (i=0; i<N; i+=3)
+    if (ParticleSoA_append(&soa, insts, (N - i < 3) ? N - i : 3)) return 1;
+  if (soa.n != N || soa.capacity < N) return 1;
+  if (strcmp(soa.id[4], "p2")) return 1;
+  if (strcmp(soa.phase + 5*9, "BETA")) return 1;
+  if (soa.count[2] != 20) return 1;
+  for (i=0; i<soa.n; i++) sum += soa.radius[i];
+  if (sum < 1.99e-6 || sum > 2.01e-6) return 1;
+
+  /* Convert back to instances */
+  if (!(copies = ParticleSoA_to_instances(&soa, 1, 2))) return 1;
+  if (strcmp(*(char **)dlite_instance_get_property(copies[0], "id"), "p2"))
+    return 1;
+  if (*(int32_t *)dlite_instance_get_property(copies[1], "count") != 20)
+    return 1;
+  for (i=0; i<2; i++) dlite_instance_decref(copies[i]);
+  free(copies);
+  if (ParticleSoA_to_instances(&soa, N-1, 2)) return 1;
+  dlite_errclr();
+
+  /* Save and load the container as one instance */
+  s = dlite_storage_open("json", "particles-soa.json", "mode=w");
+  if (ParticleSoA_save(&soa, s, "particles")) return 1;
+  dlite_storage_close(s);
+
+  ParticleSoA_init(&soa2);
+  s = dlite_storage_open("json", "particles-soa.json", "mode=r");
+  if (ParticleSoA_load(&soa2, s, "particles")) return 1;
+  dlite_storage_close(s);
+  if (soa2.n != N) return 1;
+  if (strcmp(soa2.id[N-1], soa.id[N-1])) return 1;
+  if (memcmp(soa2.radius, soa.radius, N*sizeof(double))) return 1;
+  for (i=0; i<N; i++)
+    if (strcmp(soa2.phase + i*9, soa.phase + i*9)) return 1;
+
+  ParticleSoA_deinit(&soa2);
+  ParticleSoA_deinit(&soa);
+  for (i=0; i<3; i++) dlite_instance_decref(insts[i]);
+  dlite_meta_decref(meta);
+  return 0;
+}